@@ -383,12 +383,12 @@ def build_LLVM(version_LLVM, revision, folder, tarball, debug, selfbuild, extra,
 
 
 def unsupported_llvm_targets(LLVM_VERSION):
-    prohibited_list = {"3.2":["avx512knl-i32x16", "avx512skx-i32x16"],
-                       "3.3":["avx512knl-i32x16", "avx512skx-i32x16"],
-                       "3.4":["avx512knl-i32x16", "avx512skx-i32x16"],
-                       "3.5":["avx512knl-i32x16", "avx512skx-i32x16"],
-                       "3.6":["avx512knl-i32x16", "avx512skx-i32x16"],
-                       "3.7":["avx512skx-i32x16"],
+    prohibited_list = {"3.2":["avx512knl-i32x16", "avx512skx-i32x16", "avx512skx-i32x8"],
+                       "3.3":["avx512knl-i32x16", "avx512skx-i32x16", "avx512skx-i32x8"],
+                       "3.4":["avx512knl-i32x16", "avx512skx-i32x16", "avx512skx-i32x8"],
+                       "3.5":["avx512knl-i32x16", "avx512skx-i32x16", "avx512skx-i32x8"],
+                       "3.6":["avx512knl-i32x16", "avx512skx-i32x16", "avx512skx-i32x8"],
+                       "3.7":["avx512skx-i32x16", "avx512skx-i32x8"],
                        "3.8":[],
                        "3.9":[],
                        "4.0":[],
@@ -416,9 +416,9 @@ def check_targets():
     SSE4  = ["sse4-i32x4",  "sse4-i32x8",   "sse4-i16x8", "sse4-i8x16"]
     AVX   = ["avx1-i32x4",  "avx1-i32x8",  "avx1-i32x16",  "avx1-i64x4"]
     AVX11 = ["avx1.1-i32x8","avx1.1-i32x16","avx1.1-i64x4"]
-    AVX2  = ["avx2-i32x8",  "avx2-i32x16",  "avx2-i64x4"]
+    AVX2  = ["avx2-i32x8",  "avx2-i32x16",  "avx2-i64x4", "avx2-i16x16", "avx2-i8x32"]
     KNL   = ["knl-generic", "avx512knl-i32x16"]
-    SKX   = ["avx512skx-i32x16"]
+    SKX   = ["avx512skx-i32x16", "avx512skx-i32x8"]
 
     targets = [["AVX2", AVX2, False], ["AVX1.1", AVX11, False], ["AVX", AVX, False], ["SSE4", SSE4, False], 
                ["SSE2", SSE2, False], ["KNL", KNL, False], ["SKX", SKX, False]]
@@ -446,7 +446,7 @@ def check_targets():
     f_lines = take_lines(sde_exists + " -help", "all")
     for i in range(0,len(f_lines)):
         if targets[6][2] == False and "skx" in f_lines[i]:
-            answer_sde = answer_sde + [["-skx", "avx512skx-i32x16"]]
+            answer_sde = answer_sde + [["-skx", "avx512skx-i32x16"], ["-skx", "avx512skx-i32x8"]]
         if targets[5][2] == False and "knl" in f_lines[i]:
             answer_sde = answer_sde + [["-knl", "knl-generic"], ["-knl", "avx512knl-i32x16"]]
         if targets[3][2] == False and "wsm" in f_lines[i]:
@@ -456,7 +456,8 @@ def check_targets():
         if targets[1][2] == False and "ivb" in f_lines[i]:
             answer_sde = answer_sde + [["-ivb", "avx1.1-i32x8"], ["-ivb", "avx1.1-i32x16"], ["-ivb", "avx1.1-i64x4"]]
         if targets[0][2] == False and "hsw" in f_lines[i]:
-            answer_sde = answer_sde + [["-hsw", "avx2-i32x8"], ["-hsw", "avx2-i32x16"], ["-hsw", "avx2-i64x4"]]
+            answer_sde = answer_sde + [["-hsw", "avx2-i32x8"], ["-hsw", "avx2-i32x16"], ["-hsw", "avx2-i64x4"],
+                                       ["-hsw", "avx2-i16x16"], ["-hsw", "avx2-i8x32"]]
     return [answer, answer_generic, answer_sde, answer_knc]
 
 def build_ispc(version_LLVM, make):
@@ -827,6 +828,8 @@ def validation_run(only, only_targets, reference_branch, number, notify, update,
         if current_OS == "Windows":
             performance.ref = "ispc_ref.exe"
         performance.perf_target = ""
+        performance.cpp_avx2 = False
+        performance.cpp_skx = False
         performance.in_file = "." + os.sep + f_date + os.sep + "performance.log"
 # prepare newest LLVM
         need_LLVM = check_LLVM([newest_LLVM])
@@ -40,6 +40,7 @@
 #include "ast.h"
 #include "expr.h"
 #include "func.h"
+#include "module.h"
 #include "stmt.h"
 #include "sym.h"
 #include "util.h"
@@ -51,6 +52,27 @@ ASTNode::~ASTNode() {
 }
 
 
+static void
+lDestroyASTNode(void *ptr) {
+    ((ASTNode *)ptr)->~ASTNode();
+}
+
+
+void *
+ASTNode::operator new(size_t size) {
+    // Nodes created outside of a Module (there shouldn't be any) just
+    // come from the heap and are never freed.
+    if (m == NULL)
+        return ::operator new(size);
+
+    // ~ASTNode() is virtual, so this also frees the strings, vectors,
+    // etc. held by the subclass that's being allocated.
+    void *ptr = m->arena.Allocate(size);
+    m->arena.AddDestructor(lDestroyASTNode, ptr);
+    return ptr;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 // AST
 
@@ -62,10 +84,50 @@ AST::AddFunction(Symbol *sym, Stmt *code) {
 }
 
 
+const Function *
+AST::LookupFunction(const Symbol *sym) const {
+    for (unsigned int i = 0; i < functions.size(); ++i)
+        if (functions[i]->GetSymbol() == sym)
+            return functions[i];
+    return NULL;
+}
+
+
 void
 AST::GenerateIR() {
-    for (unsigned int i = 0; i < functions.size(); ++i)
-        functions[i]->GenerateIR();
+    // The standard library defines thousands of functions, only a handful
+    // of which are used by a typical program.  Rather than generating IR
+    // for all of them and leaving it to the optimizer to throw the unused
+    // ones away again, first emit the program's own functions and then
+    // only those standard library functions that are actually referenced.
+    std::vector<Function *> stdlibFunctions;
+    for (unsigned int i = 0; i < functions.size(); ++i) {
+        if (functions[i]->IsStdlibFunction())
+            stdlibFunctions.push_back(functions[i]);
+        else
+            functions[i]->GenerateIR();
+    }
+
+    // Emitting a standard library function may in turn add references to
+    // others, so keep going until no new ones are needed.
+    bool emittedAny = true;
+    while (emittedAny) {
+        emittedAny = false;
+        for (unsigned int i = 0; i < stdlibFunctions.size(); ++i) {
+            if (stdlibFunctions[i] != NULL &&
+                stdlibFunctions[i]->IsReferenced()) {
+                stdlibFunctions[i]->GenerateIR();
+                stdlibFunctions[i] = NULL;
+                emittedAny = true;
+            }
+        }
+    }
+
+    // Internal functions without a definition aren't legal, so get rid of
+    // the declarations of the ones that weren't needed.
+    for (unsigned int i = 0; i < stdlibFunctions.size(); ++i)
+        if (stdlibFunctions[i] != NULL)
+            stdlibFunctions[i]->EraseDeclaration();
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -93,6 +155,7 @@ WalkAST(ASTNode *node, ASTPreCallBackFunc preFunc, ASTPostCallBackFunc postFunc,
         ForStmt *fs;
         ForeachStmt *fes;
         ForeachActiveStmt *fas;
+        ForeachCompactStmt *fcs;
         ForeachUniqueStmt *fus;
         CaseStmt *cs;
         DefaultStmt *defs;
@@ -102,6 +165,7 @@ WalkAST(ASTNode *node, ASTPreCallBackFunc preFunc, ASTPostCallBackFunc postFunc,
         StmtList *sl;
         PrintStmt *ps;
         AssertStmt *as;
+        AssumeStmt *ams;
         DeleteStmt *dels;
         UnmaskedStmt *ums;
 
@@ -143,6 +207,12 @@ WalkAST(ASTNode *node, ASTPreCallBackFunc preFunc, ASTPostCallBackFunc postFunc,
         else if ((fas = llvm::dyn_cast<ForeachActiveStmt>(node)) != NULL) {
             fas->stmts = (Stmt *)WalkAST(fas->stmts, preFunc, postFunc, data);
         }
+        else if ((fcs = llvm::dyn_cast<ForeachCompactStmt>(node)) != NULL) {
+            fcs->startExpr = (Expr *)WalkAST(fcs->startExpr, preFunc, postFunc,
+                                             data);
+            fcs->endExpr = (Expr *)WalkAST(fcs->endExpr, preFunc, postFunc, data);
+            fcs->stmts = (Stmt *)WalkAST(fcs->stmts, preFunc, postFunc, data);
+        }
         else if ((fus = llvm::dyn_cast<ForeachUniqueStmt>(node)) != NULL) {
             fus->expr = (Expr *)WalkAST(fus->expr, preFunc, postFunc, data);
             fus->stmts = (Stmt *)WalkAST(fus->stmts, preFunc, postFunc, data);
@@ -173,6 +243,8 @@ WalkAST(ASTNode *node, ASTPreCallBackFunc preFunc, ASTPostCallBackFunc postFunc,
             ps->values = (Expr *)WalkAST(ps->values, preFunc, postFunc, data);
         else if ((as = llvm::dyn_cast<AssertStmt>(node)) != NULL)
             as->expr = (Expr *)WalkAST(as->expr, preFunc, postFunc, data);
+        else if ((ams = llvm::dyn_cast<AssumeStmt>(node)) != NULL)
+            ams->expr = (Expr *)WalkAST(ams->expr, preFunc, postFunc, data);
         else if ((dels = llvm::dyn_cast<DeleteStmt>(node)) != NULL)
             dels->expr = (Expr *)WalkAST(dels->expr, preFunc, postFunc, data);
         else if ((ums = llvm::dyn_cast<UnmaskedStmt>(node)) != NULL)
@@ -199,6 +271,7 @@ WalkAST(ASTNode *node, ASTPreCallBackFunc preFunc, ASTPostCallBackFunc postFunc,
         SizeOfExpr *soe;
         AddressOfExpr *aoe;
         NewExpr *newe;
+        SyncExpr *synce;
 
         if ((ue = llvm::dyn_cast<UnaryExpr>(node)) != NULL)
             ue->expr = (Expr *)WalkAST(ue->expr, preFunc, postFunc, data);
@@ -226,6 +299,8 @@ WalkAST(ASTNode *node, ASTPreCallBackFunc preFunc, ASTPostCallBackFunc postFunc,
             for (int k = 0; k < 3; k++)
               fce->launchCountExpr[0] = (Expr *)WalkAST(fce->launchCountExpr[0], preFunc,
                                                    postFunc, data);
+            fce->launchAfter = (ExprList *)WalkAST(fce->launchAfter, preFunc,
+                                                   postFunc, data);
         }
         else if ((ie = llvm::dyn_cast<IndexExpr>(node)) != NULL) {
             ie->baseExpr = (Expr *)WalkAST(ie->baseExpr, preFunc, postFunc, data);
@@ -253,10 +328,12 @@ WalkAST(ASTNode *node, ASTPreCallBackFunc preFunc, ASTPostCallBackFunc postFunc,
             newe->initExpr = (Expr *)WalkAST(newe->initExpr, preFunc,
                                              postFunc, data);
         }
+        else if ((synce = llvm::dyn_cast<SyncExpr>(node)) != NULL)
+            synce->handle = (Expr *)WalkAST(synce->handle, preFunc, postFunc,
+                                            data);
         else if (llvm::dyn_cast<SymbolExpr>(node) != NULL ||
                  llvm::dyn_cast<ConstExpr>(node) != NULL ||
                  llvm::dyn_cast<FunctionSymbolExpr>(node) != NULL ||
-                 llvm::dyn_cast<SyncExpr>(node) != NULL ||
                  llvm::dyn_cast<NullPointerExpr>(node) != NULL) {
             // nothing to do
         }
@@ -389,6 +466,13 @@ lCheckAllOffSafety(ASTNode *node, void *data) {
         return false;
     }
 
+    if (llvm::dyn_cast<AssumeStmt>(node) != NULL) {
+        // Similarly, a uniform assumption only needs to hold when some
+        // program instance actually reaches it.
+        *okPtr = false;
+        return false;
+    }
+
     if (llvm::dyn_cast<PrintStmt>(node) != NULL) {
         *okPtr = false;
         return false;
@@ -405,6 +489,7 @@ lCheckAllOffSafety(ASTNode *node, void *data) {
 
     if (llvm::dyn_cast<ForeachStmt>(node) != NULL ||
         llvm::dyn_cast<ForeachActiveStmt>(node) != NULL ||
+        llvm::dyn_cast<ForeachCompactStmt>(node) != NULL ||
         llvm::dyn_cast<ForeachUniqueStmt>(node) != NULL ||
         llvm::dyn_cast<UnmaskedStmt>(node) != NULL) {
         // The various foreach statements also shouldn't be run with an
@@ -53,6 +53,12 @@ public:
     ASTNode(SourcePos p, unsigned scid) : SubclassID(scid), pos(p) { }
     virtual ~ASTNode();
 
+    /** AST nodes are allocated from the current Module's MemoryArena and
+        are destroyed and freed all at once along with it, so deleting an
+        individual node does nothing. */
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr) { }
+
     /** The Optimize() method should perform any appropriate early-stage
         optimizations on the node (e.g. constant folding).  This method
         will be called after the node's children have already been
@@ -106,6 +112,7 @@ public:
         MaxExprID,
         /* For classes inherited from Stmt */
         AssertStmtID,
+        AssumeStmtID,
         BreakStmtID,
         CaseStmtID,
         ContinueStmtID,
@@ -115,6 +122,7 @@ public:
         DoStmtID,
         ExprStmtID,
         ForeachActiveStmtID,
+        ForeachCompactStmtID,
         ForeachStmtID,
         ForeachUniqueStmtID,
         ForStmtID,
@@ -151,6 +159,10 @@ public:
         module. */
     void GenerateIR();
 
+    /** Returns the Function for the given function symbol, or NULL if the
+        function hasn't been defined (so far). */
+    const Function *LookupFunction(const Symbol *sym) const;
+
 private:
     std::vector<Function *> functions;
 };
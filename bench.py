@@ -0,0 +1,275 @@
+#!/usr/bin/python
+#
+#  Copyright (c) 2017, Intel Corporation
+#  All rights reserved.
+# 
+#  Redistribution and use in source and binary forms, with or without
+#  modification, are permitted provided that the following conditions are
+#  met:
+# 
+#    * Redistributions of source code must retain the above copyright
+#      notice, this list of conditions and the following disclaimer.
+# 
+#    * Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+# 
+#    * Neither the name of Intel Corporation nor the names of its
+#      contributors may be used to endorse or promote products derived from
+#      this software without specific prior written permission.
+# 
+# 
+#   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+#   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+#   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+#   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+#   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+#   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+#   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+#   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+#   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+#   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+#   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Runs the examples listed in perf.ini under the benchmark harness from
+# examples/benchmark.h, saves the raw samples as JSON and compares them
+# against a previously saved baseline with a Mann-Whitney U test.
+#
+#   ./bench.py --save=base.json
+#   (rebuild ispc)
+#   ./bench.py --save=new.json --baseline=base.json
+#
+# The script exits with status 1 when some benchmark regressed, i.e. its
+# median got slower by more than --threshold percent and the difference is
+# significant at level --alpha, or when an example failed or didn't report
+# any results.
+
+from optparse import OptionParser
+import sys
+import os
+import re
+import math
+import json
+import time
+import socket
+import platform
+import subprocess
+
+def read_config(config):
+    # Returns a list of (name, dir, args) triples; lines starting with '%'
+    # are comments, '!' and '^' lines are perf.py output directives.
+    tests = []
+    block = []
+    for line in open(config):
+        line = line.rstrip("\n").rstrip("\r")
+        if line.startswith("%") or line.startswith("!") or line.startswith("^"):
+            continue
+        if line.startswith("#***"):
+            if len(block) >= 2:
+                tests.append((block[0], block[1], block[2] if len(block) > 2 else ""))
+            block = []
+            continue
+        block.append(line)
+    return tests
+
+def example_executable(path):
+    for line in open(os.path.join(path, "Makefile")):
+        m = re.match(r"\s*EXAMPLE\s*=\s*(\S+)", line)
+        if m:
+            return m.group(1)
+    return None
+
+def median(x):
+    s = sorted(x)
+    n = len(s)
+    if n == 0:
+        return 0.0
+    if n % 2 == 1:
+        return s[n // 2]
+    return 0.5 * (s[n // 2 - 1] + s[n // 2])
+
+def mann_whitney(a, b):
+    # Two-sided Mann-Whitney U test with the normal approximation and tie
+    # correction; returns the p-value.
+    n1 = len(a)
+    n2 = len(b)
+    if n1 == 0 or n2 == 0:
+        return 1.0
+    values = sorted([(v, 0) for v in a] + [(v, 1) for v in b])
+    n = n1 + n2
+    ranks = [0.0] * n
+    ties = 0.0
+    i = 0
+    while i < n:
+        j = i
+        while j + 1 < n and values[j + 1][0] == values[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = 0.5 * (i + j) + 1
+        t = j - i + 1
+        ties += t * t * t - t
+        i = j + 1
+    r1 = sum([ranks[k] for k in range(n) if values[k][1] == 0])
+    u = r1 - n1 * (n1 + 1) / 2.0
+    mu = n1 * n2 / 2.0
+    sigma2 = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1.0)))
+    if sigma2 <= 0:
+        return 1.0
+    z = (abs(u - mu) - 0.5) / math.sqrt(sigma2)
+    if z < 0:
+        z = 0.0
+    return math.erfc(z / math.sqrt(2.0))
+
+def count_records(json_file):
+    if not os.path.exists(json_file):
+        return 0
+    return len([line for line in open(json_file) if line.strip() != ""])
+
+def run_benchmarks(options):
+    tests = read_config(options.config)
+    examples = os.path.join(options.path, "examples")
+    json_file = os.path.abspath(options.save + ".tmp" if options.save != "" else "bench.tmp.json")
+    if os.path.exists(json_file):
+        os.remove(json_file)
+    env = dict(os.environ)
+    env["ISPC_BENCH_JSON"] = json_file
+    env["ISPC_BENCH_RUNS"] = options.runs
+    env["ISPC_BENCH_WARMUP"] = options.warmup
+    if options.cpus != "":
+        env["ISPC_BENCH_CPUS"] = options.cpus
+    if options.counters != "":
+        env["ISPC_BENCH_COUNTERS"] = options.counters
+    done = set()
+    failed = []
+    for (name, folder, args) in tests:
+        if folder in done:
+            continue
+        done.add(folder)
+        if options.only != "" and not re.search(options.only, name + " " + folder):
+            continue
+        path = os.path.join(examples, folder)
+        exe = example_executable(path)
+        if exe == None:
+            sys.stderr.write("Can't find the executable name for %s\n" % folder)
+            failed.append(folder)
+            continue
+        sys.stdout.write("%s (%s)\n" % (name, folder))
+        null = open(os.devnull, "w")
+        if not options.no_build and subprocess.call(["make"], cwd=path, stdout=null) != 0:
+            sys.stderr.write("Build of %s failed\n" % folder)
+            failed.append(folder)
+            continue
+        records = count_records(json_file)
+        cmd = [os.path.join(".", exe)] + args.split()
+        if subprocess.call(cmd, cwd=path, env=env, stdout=null, stderr=null) != 0:
+            sys.stderr.write("Run of %s failed\n" % folder)
+            failed.append(folder)
+        elif count_records(json_file) == records:
+            # The example doesn't time its runs with examples/benchmark.h.
+            sys.stderr.write("%s produced no benchmark records\n" % folder)
+            failed.append(folder)
+    results = {}
+    if os.path.exists(json_file):
+        for line in open(json_file):
+            line = line.strip()
+            if line != "":
+                r = json.loads(line)
+                results[r["benchmark"]] = r
+        os.remove(json_file)
+    if options.counters != "":
+        # The counters may be unavailable, e.g. without permission to use
+        # perf_event_open; the harness then only reports the timings.
+        missing = [name for name in sorted(results.keys())
+                   if len(results[name].get("counters", {})) == 0]
+        if len(missing) > 0:
+            sys.stderr.write("Warning: no counters were reported for: %s\n" %
+                             ", ".join(missing))
+    return (results, failed)
+
+def ispc_version(options):
+    try:
+        p = subprocess.Popen(["ispc", "--version"], stdout=subprocess.PIPE)
+        return p.communicate()[0].decode().strip()
+    except OSError:
+        return "unknown"
+
+def compare(results, baseline, options):
+    regressions = 0
+    sys.stdout.write("%-36s %12s %12s %8s %8s\n" % ("benchmark", "baseline", "current", "change", "p"))
+    for name in sorted(results.keys()):
+        if not name in baseline:
+            continue
+        a = baseline[name]["samples"]
+        b = results[name]["samples"]
+        m_a = median(a)
+        m_b = median(b)
+        change = 100.0 * (m_b - m_a) / m_a if m_a > 0 else 0.0
+        p = mann_whitney(a, b)
+        mark = ""
+        if p < float(options.alpha) and abs(change) > float(options.threshold):
+            if change > 0:
+                mark = " <- regression"
+                regressions += 1
+            else:
+                mark = " <+ improvement"
+        sys.stdout.write("%-36s %12.3f %12.3f %7.2f%% %8.4f%s\n" %
+                         (name, m_a, m_b, change, p, mark))
+        # Show the counters of significant changes, to tell whether they
+        # come from instructions, cache misses or something else.
+        if mark != "":
+            c_a = baseline[name].get("counters", {})
+            c_b = results[name].get("counters", {})
+            for counter in sorted(c_b.keys()):
+                if counter in c_a:
+                    v_a = median(c_a[counter])
+                    v_b = median(c_b[counter])
+                    d = 100.0 * (v_b - v_a) / v_a if v_a > 0 else 0.0
+                    sys.stdout.write("    %-32s %12.0f %12.0f %7.2f%%\n" %
+                                     (counter, v_a, v_b, d))
+    return regressions
+
+if __name__ == "__main__":
+    parser = OptionParser()
+    parser.add_option('-c', '--config', dest='config',
+        help='config file of tests', default="./perf.ini")
+    parser.add_option('-p', '--path', dest='path',
+        help='path to ispc root', default=".")
+    parser.add_option('-n', '--runs', dest='runs',
+        help='measured runs of each benchmark (overrides the example defaults)', default="15")
+    parser.add_option('-w', '--warmup', dest='warmup',
+        help='untimed warmup runs of each benchmark', default="1")
+    parser.add_option('--cpus', dest='cpus',
+        help='pin the benchmarks to these CPUs, e.g. "0-3" (Linux only)', default="")
+    parser.add_option('--counters', dest='counters',
+        help='hardware counters to collect, e.g. "default" (Linux only, see examples/perf_counters.h)', default="")
+    parser.add_option('--only', dest='only',
+        help='run only the tests whose name or folder matches this regex', default="")
+    parser.add_option('--no-build', dest='no_build',
+        help='do not rebuild the examples', default=False, action="store_true")
+    parser.add_option('-s', '--save', dest='save',
+        help='save the results to this JSON file', default="")
+    parser.add_option('-b', '--baseline', dest='baseline',
+        help='JSON file with results to compare against', default="")
+    parser.add_option('--alpha', dest='alpha',
+        help='significance level of the Mann-Whitney U test', default="0.01")
+    parser.add_option('--threshold', dest='threshold',
+        help='minimal change of the median, in percent, reported as a regression', default="3")
+    (options, args) = parser.parse_args()
+
+    (results, failed) = run_benchmarks(options)
+    if options.save != "":
+        out = {"ispc": ispc_version(options), "host": socket.gethostname(),
+               "platform": platform.platform(), "date": time.strftime("%Y-%m-%d %H:%M:%S"),
+               "runs": int(options.runs), "warmup": int(options.warmup),
+               "cpus": options.cpus, "results": results}
+        f = open(options.save, "w")
+        json.dump(out, f, indent=1, sort_keys=True)
+        f.close()
+    regressions = 0
+    if options.baseline != "":
+        baseline = json.load(open(options.baseline))["results"]
+        regressions = compare(results, baseline, options)
+    if len(failed) > 0:
+        sys.stderr.write("No results for: %s\n" % ", ".join(failed))
+    if regressions > 0 or len(failed) > 0:
+        sys.exit(1)
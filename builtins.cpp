@@ -72,6 +72,7 @@
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/ADT/Triple.h>
 #include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
     #include <llvm/Bitcode/ReaderWriter.h>
 #else
@@ -351,6 +352,9 @@ lSetInternalFunctions(llvm::Module *module) {
         "__add_varying_int64",
         "__all",
         "__any",
+        "__aos_to_soa2_double",
+        "__aos_to_soa2_float",
+        "__aos_to_soa3_double",
         "__aos_to_soa3_float",
 //#ifdef ISPC_NVPTX_ENABLED
         "__aos_to_soa3_float1",
@@ -359,6 +363,7 @@ lSetInternalFunctions(llvm::Module *module) {
         "__aos_to_soa3_float4",
         "__aos_to_soa3_float8",
         "__aos_to_soa3_int32",
+        "__aos_to_soa4_double",
         "__aos_to_soa4_float",
 //#ifdef ISPC_NVPTX_ENABLED
         "__aos_to_soa4_float1",
@@ -367,6 +372,10 @@ lSetInternalFunctions(llvm::Module *module) {
         "__aos_to_soa4_float4",
         "__aos_to_soa4_float8",
         "__aos_to_soa4_int32",
+        "__aos_to_soa6_double",
+        "__aos_to_soa6_float",
+        "__aos_to_soa8_double",
+        "__aos_to_soa8_float",
         "__atomic_add_int32_global",
         "__atomic_add_int64_global",
         "__atomic_add_uniform_int32_global",
@@ -443,6 +452,8 @@ lSetInternalFunctions(llvm::Module *module) {
         "__atomic_xor_varying_int32_global",
         "__atomic_xor_varying_int64_global",
 //#endif /* ISPC_NVPTX_ENABLED */
+        "__autotune_next",
+        "__autotune_record",
         "__broadcast_double",
         "__broadcast_float",
         "__broadcast_i16",
@@ -456,6 +467,8 @@ lSetInternalFunctions(llvm::Module *module) {
         "__ceil_varying_double",
         "__ceil_varying_float",
         "__clock",
+        "__conflict_i32",
+        "__conflict_i64",
         "__count_trailing_zeros_i32",
         "__count_trailing_zeros_i64",
         "__count_leading_zeros_i32",
@@ -466,6 +479,10 @@ lSetInternalFunctions(llvm::Module *module) {
         "__delete_varying_64rt",
         "__do_assert_uniform",
         "__do_assert_varying",
+        "__do_delete_uniform",
+        "__do_delete_varying",
+        "__do_new_uniform",
+        "__do_new_varying",
         "__do_print",
 //#ifdef ISPC_NVPTX_ENABLED
         "__do_print_nvptx",
@@ -478,6 +495,22 @@ lSetInternalFunctions(llvm::Module *module) {
         "__exclusive_scan_add_i64",
         "__exclusive_scan_and_i32",
         "__exclusive_scan_and_i64",
+        "__exclusive_scan_max_double",
+        "__exclusive_scan_max_float",
+        "__exclusive_scan_max_i32",
+        "__exclusive_scan_max_i64",
+        "__exclusive_scan_max_uint32",
+        "__exclusive_scan_max_uint64",
+        "__exclusive_scan_min_double",
+        "__exclusive_scan_min_float",
+        "__exclusive_scan_min_i32",
+        "__exclusive_scan_min_i64",
+        "__exclusive_scan_min_uint32",
+        "__exclusive_scan_min_uint64",
+        "__exclusive_scan_mul_double",
+        "__exclusive_scan_mul_float",
+        "__exclusive_scan_mul_i32",
+        "__exclusive_scan_mul_i64",
         "__exclusive_scan_or_i32",
         "__exclusive_scan_or_i64",
         "__extract_int16",
@@ -499,6 +532,7 @@ lSetInternalFunctions(llvm::Module *module) {
         "__floor_uniform_float",
         "__floor_varying_double",
         "__floor_varying_float",
+        "__get_system_cpu_model",
         "__get_system_isa",
         "__half_to_float_uniform",
         "__half_to_float_varying",
@@ -557,14 +591,22 @@ lSetInternalFunctions(llvm::Module *module) {
         "__none",
         "__num_cores",
         "__packed_load_active",
+        "__packed_load_active_i64",
         "__packed_store_active",
         "__packed_store_active2",
+        "__packed_store_active_i64",
         "__padds_vi8",
         "__padds_vi16",
         "__paddus_vi8",
         "__paddus_vi16",
+        "__pdep_u32",
+        "__pdep_u64",
+        "__pext_u32",
+        "__pext_u64",
         "__popcnt_int32",
         "__popcnt_int64",
+        "__popcnt_varying_int32",
+        "__popcnt_varying_int64",
         "__prefetch_read_uniform_1",
         "__prefetch_read_uniform_2",
         "__prefetch_read_uniform_3",
@@ -577,6 +619,8 @@ lSetInternalFunctions(llvm::Module *module) {
         "__psubs_vi16",
         "__psubus_vi8",
         "__psubus_vi16",
+        "__rcp_fast_uniform_float",
+        "__rcp_fast_varying_float",
         "__rcp_uniform_float",
         "__rcp_varying_float",
         "__rcp_uniform_double",
@@ -616,10 +660,19 @@ lSetInternalFunctions(llvm::Module *module) {
         "__round_uniform_float",
         "__round_varying_double",
         "__round_varying_float",
+        "__rsqrt_fast_uniform_float",
+        "__rsqrt_fast_varying_float",
         "__rsqrt_uniform_float",
         "__rsqrt_varying_float",
         "__rsqrt_uniform_double",
         "__rsqrt_varying_double",
+        "__sat_trunc_int16_int8",
+        "__sat_trunc_int16_uint8",
+        "__sat_trunc_int32_int16",
+        "__sat_trunc_int32_uint16",
+        "__sat_trunc_uint16_uint8",
+        "__sat_trunc_uint32_uint16",
+        "__set_system_cpu_model",
         "__set_system_isa",
         "__sext_uniform_bool",
         "__sext_varying_bool",
@@ -641,11 +694,15 @@ lSetInternalFunctions(llvm::Module *module) {
         "__shuffle_i32",
         "__shuffle_i64",
         "__shuffle_i8",
+        "__soa_to_aos2_double",
+        "__soa_to_aos2_float",
+        "__soa_to_aos3_double",
         "__soa_to_aos3_float",
         "__soa_to_aos3_float16",
         "__soa_to_aos3_float4",
         "__soa_to_aos3_float8",
         "__soa_to_aos3_int32",
+        "__soa_to_aos4_double",
         "__soa_to_aos4_float",
 //#ifdef ISPC_NVPTX_ENABLED
         "__soa_to_aos3_float1",
@@ -655,6 +712,10 @@ lSetInternalFunctions(llvm::Module *module) {
         "__soa_to_aos4_float4",
         "__soa_to_aos4_float8",
         "__soa_to_aos4_int32",
+        "__soa_to_aos6_double",
+        "__soa_to_aos6_float",
+        "__soa_to_aos8_double",
+        "__soa_to_aos8_float",
         "__sqrt_uniform_double",
         "__sqrt_uniform_float",
         "__sqrt_varying_double",
@@ -680,6 +741,18 @@ lSetInternalFunctions(llvm::Module *module) {
         "__stdlib_sinf",
         "__stdlib_tan",
         "__stdlib_tanf",
+        "__streaming_load_double",
+        "__streaming_load_float",
+        "__streaming_load_i16",
+        "__streaming_load_i32",
+        "__streaming_load_i64",
+        "__streaming_load_i8",
+        "__streaming_store_double",
+        "__streaming_store_float",
+        "__streaming_store_i16",
+        "__streaming_store_i32",
+        "__streaming_store_i64",
+        "__streaming_store_i8",
         "__svml_sind",
         "__svml_asind",
         "__svml_cosd",
@@ -785,18 +858,10 @@ lSetInternalFunctions(llvm::Module *module) {
 }
 
 
-/** This utility function takes serialized binary LLVM bitcode and adds its
-    definitions to the given module.  Functions in the bitcode that can be
-    mapped to ispc functions are also added to the symbol table.
-
-    @param bitcode     Binary LLVM bitcode (e.g. the contents of a *.bc file)
-    @param length      Length of the bitcode buffer
-    @param module      Module to link the bitcode into
-    @param symbolTable Symbol table to add definitions to
- */
-void
-AddBitcodeToModule(const unsigned char *bitcode, int length,
-                   llvm::Module *module, SymbolTable *symbolTable, bool warn) {
+/** Parses the given serialized binary LLVM bitcode, returning NULL (after
+    issuing an error) if it's invalid. */
+static llvm::Module *
+lParseBitcode(const unsigned char *bitcode, int length) {
     llvm::StringRef sb = llvm::StringRef((char *)bitcode, length);
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_5
     llvm::MemoryBuffer *bcBuf = llvm::MemoryBuffer::getMemBuffer(sb);
@@ -808,27 +873,74 @@ AddBitcodeToModule(const unsigned char *bitcode, int length,
     llvm::Expected<std::unique_ptr<llvm::Module>> ModuleOrErr = llvm::parseBitcodeFile(bcBuf, *g->ctx);
     if (!ModuleOrErr) {
         Error(SourcePos(), "Error parsing stdlib bitcode: %s", toString(ModuleOrErr.takeError()).c_str());
-    } else {
-        llvm::Module *bcModule = ModuleOrErr.get().release();
+        return NULL;
+    }
+    return ModuleOrErr.get().release();
 #elif ISPC_LLVM_VERSION >= ISPC_LLVM_3_7 // LLVM 3.7+
     llvm::ErrorOr<std::unique_ptr<llvm::Module>> ModuleOrErr = llvm::parseBitcodeFile(bcBuf, *g->ctx);
-    if (std::error_code EC = ModuleOrErr.getError())
+    if (std::error_code EC = ModuleOrErr.getError()) {
         Error(SourcePos(), "Error parsing stdlib bitcode: %s", EC.message().c_str());
-    else {
-        llvm::Module *bcModule = ModuleOrErr.get().release();
+        return NULL;
+    }
+    return ModuleOrErr.get().release();
 #elif ISPC_LLVM_VERSION == ISPC_LLVM_3_5 || ISPC_LLVM_VERSION == ISPC_LLVM_3_6
     llvm::ErrorOr<llvm::Module *> ModuleOrErr = llvm::parseBitcodeFile(bcBuf, *g->ctx);
-    if (std::error_code EC = ModuleOrErr.getError())
+    if (std::error_code EC = ModuleOrErr.getError()) {
         Error(SourcePos(), "Error parsing stdlib bitcode: %s", EC.message().c_str());
-    else {
-        llvm::Module *bcModule = ModuleOrErr.get();
+        return NULL;
+    }
+    return ModuleOrErr.get();
 #else // LLVM 3.2 - 3.4
     std::string bcErr;
     llvm::Module *bcModule = llvm::ParseBitcodeFile(bcBuf, *g->ctx, &bcErr);
     if (!bcModule)
         Error(SourcePos(), "Error parsing stdlib bitcode: %s", bcErr.c_str());
-    else {
+    return bcModule;
+#endif
+}
+
+
+/** Returns a new module with the contents of the given bitcode.  When
+    several files are compiled in one run (see
+    Globals::reuseBuiltinBitcode), each bitcode buffer is only parsed the
+    first time that it's needed, and later calls return copies of that
+    module, which is kept unmodified. */
+static llvm::Module *
+lGetBitcodeModule(const unsigned char *bitcode, int length) {
+    if (!g->reuseBuiltinBitcode)
+        return lParseBitcode(bitcode, length);
+
+    static std::map<const unsigned char *, llvm::Module *> parsedBitcode;
+    std::map<const unsigned char *, llvm::Module *>::iterator iter =
+        parsedBitcode.find(bitcode);
+    if (iter == parsedBitcode.end()) {
+        llvm::Module *bcModule = lParseBitcode(bitcode, length);
+        if (bcModule == NULL)
+            return NULL;
+        iter = parsedBitcode.insert(std::make_pair(bitcode, bcModule)).first;
+    }
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_7 // 3.2-3.7
+    return llvm::CloneModule(iter->second);
+#else // LLVM 3.8+
+    return llvm::CloneModule(iter->second).release();
 #endif
+}
+
+
+/** This utility function takes serialized binary LLVM bitcode and adds its
+    definitions to the given module.  Functions in the bitcode that can be
+    mapped to ispc functions are also added to the symbol table.
+
+    @param bitcode     Binary LLVM bitcode (e.g. the contents of a *.bc file)
+    @param length      Length of the bitcode buffer
+    @param module      Module to link the bitcode into
+    @param symbolTable Symbol table to add definitions to
+ */
+void
+AddBitcodeToModule(const unsigned char *bitcode, int length,
+                   llvm::Module *module, SymbolTable *symbolTable, bool warn) {
+    llvm::Module *bcModule = lGetBitcodeModule(bitcode, length);
+    if (bcModule != NULL) {
         // FIXME: this feels like a bad idea, but the issue is that when we
         // set the llvm::Module's target triple in the ispc Module::Module
         // constructor, we start by calling llvm::sys::getHostTriple() (and
@@ -841,7 +953,7 @@ AddBitcodeToModule(const unsigned char *bitcode, int length,
         llvm::Triple bcTriple(bcModule->getTargetTriple());
         Debug(SourcePos(), "module triple: %s\nbitcode triple: %s\n",
               mTriple.str().c_str(), bcTriple.str().c_str());
-#if defined(ISPC_ARM_ENABLED) && !defined(__arm__)
+#if defined(ISPC_ARM_ENABLED) && !defined(__arm__) && !defined(__aarch64__)
         // FIXME: More ugly and dangerous stuff.  We really haven't set up
         // proper build and runtime infrastructure for ispc to do
         // cross-compilation, yet it's at minimum useful to be able to emit
@@ -942,6 +1054,46 @@ AddBitcodeToModule(const unsigned char *bitcode, int length,
 }
 
 
+/** Once the IR for the user's program (and the parts of stdlib.ispc that
+    it uses) has been generated, only a handful of the builtin functions
+    that were linked in from the target's bitcode are actually called.
+    Rather than having every pass in Optimize() walk the hundreds of
+    unused definitions until GlobalDCE finally gets to them, we drop all
+    of the internal functions that nothing refers to here, before any
+    optimization is done.  Functions that the optimization passes may
+    introduce calls to later (gathers, scatters, masked loads and stores,
+    ...) are kept alive by __keep_funcs_live and aren't internal yet, so
+    they are unaffected.
+ */
+void
+RemoveUnusedBuiltins(llvm::Module *module) {
+    // Removing a function may leave the functions it called without any
+    // remaining uses, so iterate until nothing more is removed.
+    bool removedAny;
+    do {
+        removedAny = false;
+        llvm::Module::iterator iter = module->begin();
+        while (iter != module->end()) {
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_7 /* 3.2, 3.3, 3.4, 3.5, 3.6, 3.7 */
+            llvm::Function *func = iter++;
+#else /* LLVM 3.8+ */
+            llvm::Function *func = &*iter++;
+#endif
+            if (func->isDeclaration() || !func->hasLocalLinkage())
+                continue;
+
+            func->removeDeadConstantUsers();
+            if (func->use_empty()) {
+                Debug(SourcePos(), "Removing unused builtin \"%s\".",
+                      func->getName().str().c_str());
+                func->eraseFromParent();
+                removedAny = true;
+            }
+        }
+    } while (removedAny);
+}
+
+
 /** Utility routine that defines a constant int32 with given value, adding
     the symbol to both the ispc symbol table and the given LLVM module.
  */
@@ -956,8 +1108,9 @@ lDefineConstantInt(const char *name, int val, llvm::Module *module,
     llvm::Constant *linit = LLVMInt32(val);
     // Use WeakODRLinkage rather than InternalLinkage so that a definition
     // survives even if it's not used in the module, so that the symbol is
-    // there in the debugger.
-    llvm::GlobalValue::LinkageTypes linkage = g->generateDebuggingSymbols ?
+    // there in the debugger.  (Line tables don't describe variables.)
+    llvm::GlobalValue::LinkageTypes linkage =
+        (g->generateDebuggingSymbols && !g->debugLineTablesOnly) ?
         llvm::GlobalValue::WeakODRLinkage : llvm::GlobalValue::InternalLinkage;
     sym->storagePtr = new llvm::GlobalVariable(*module, ltype, true, linkage,
                                                linit, name);
@@ -1070,7 +1223,8 @@ lDefineProgramIndex(llvm::Module *module, SymbolTable *symbolTable) {
     llvm::Type *ltype = LLVMTypes::Int32VectorType;
     llvm::Constant *linit = LLVMInt32Vector(pi);
     // See comment in lDefineConstantInt() for why WeakODRLinkage is used here
-    llvm::GlobalValue::LinkageTypes linkage = g->generateDebuggingSymbols ?
+    llvm::GlobalValue::LinkageTypes linkage =
+        (g->generateDebuggingSymbols && !g->debugLineTablesOnly) ?
         llvm::GlobalValue::WeakODRLinkage : llvm::GlobalValue::InternalLinkage;
     sym->storagePtr = new llvm::GlobalVariable(*module, ltype, true, linkage,
                                                linit, sym->name.c_str());
@@ -1208,11 +1362,25 @@ DefineStdlib(SymbolTable *symbolTable, llvm::LLVMContext *ctx, llvm::Module *mod
         break;
     }
     case Target::NEON32: {
-        if (runtime32) {
-            EXPORT_MODULE(builtins_bitcode_neon_32_32bit);
-        }
-        else {
-            EXPORT_MODULE(builtins_bitcode_neon_32_64bit);
+        switch (g->target->getVectorWidth()) {
+        case 4:
+            if (runtime32) {
+                EXPORT_MODULE(builtins_bitcode_neon_32_32bit);
+            }
+            else {
+                EXPORT_MODULE(builtins_bitcode_neon_32_64bit);
+            }
+            break;
+        case 8:
+            if (runtime32) {
+                EXPORT_MODULE(builtins_bitcode_neon_32_x2_32bit);
+            }
+            else {
+                EXPORT_MODULE(builtins_bitcode_neon_32_x2_64bit);
+            }
+            break;
+        default:
+            FATAL("logic error in DefineStdlib");
         }
         break;
     }
@@ -1386,10 +1554,31 @@ DefineStdlib(SymbolTable *symbolTable, llvm::LLVMContext *ctx, llvm::Module *mod
             break;
         case 16:
             if (runtime32) {
-                EXPORT_MODULE(builtins_bitcode_avx2_x2_32bit);
+                if (g->target->getMaskBitCount() == 16) {
+                    EXPORT_MODULE(builtins_bitcode_avx2_16_32bit);
+                }
+                else {
+                    Assert(g->target->getMaskBitCount() == 32);
+                    EXPORT_MODULE(builtins_bitcode_avx2_x2_32bit);
+                }
+            }
+            else {
+                if (g->target->getMaskBitCount() == 16) {
+                    EXPORT_MODULE(builtins_bitcode_avx2_16_64bit);
+                }
+                else {
+                    Assert(g->target->getMaskBitCount() == 32);
+                    EXPORT_MODULE(builtins_bitcode_avx2_x2_64bit);
+                }
+            }
+            break;
+        case 32:
+            Assert(g->target->getMaskBitCount() == 8);
+            if (runtime32) {
+                EXPORT_MODULE(builtins_bitcode_avx2_8_32bit);
             }
             else {
-                EXPORT_MODULE(builtins_bitcode_avx2_x2_64bit);
+                EXPORT_MODULE(builtins_bitcode_avx2_8_64bit);
             }
             break;
         default:
@@ -1425,6 +1614,14 @@ DefineStdlib(SymbolTable *symbolTable, llvm::LLVMContext *ctx, llvm::Module *mod
                 EXPORT_MODULE(builtins_bitcode_skx_64bit);
             }
             break;
+        case 8:
+            if (runtime32) {
+                EXPORT_MODULE(builtins_bitcode_skx_i32x8_32bit);
+            }
+            else {
+                EXPORT_MODULE(builtins_bitcode_skx_i32x8_64bit);
+            }
+            break;
         default:
             FATAL("logic error in DefineStdlib");
         }
@@ -1520,6 +1717,11 @@ DefineStdlib(SymbolTable *symbolTable, llvm::LLVMContext *ctx, llvm::Module *mod
                        symbolTable);
     lDefineConstantIntFunc("__fast_masked_vload", (int)g->opt.fastMaskedVload,
                            module, symbolTable);
+    lDefineConstantIntFunc("__sparse_gather_threshold",
+                           g->opt.sparseGatherThreshold >= 0 ?
+                           g->opt.sparseGatherThreshold :
+                           g->target->getSparseGatherThreshold(),
+                           module, symbolTable);
 
     lDefineConstantInt("__have_native_half", g->target->hasHalf(), module,
                        symbolTable);
@@ -1533,6 +1735,8 @@ DefineStdlib(SymbolTable *symbolTable, llvm::LLVMContext *ctx, llvm::Module *mod
                        module, symbolTable);
     lDefineConstantInt("__have_native_rcpd", g->target->hasRcpd(),
                        module, symbolTable);
+    lDefineConstantInt("__have_native_conflict_detection",
+                       g->target->hasConflictDetection(), module, symbolTable);
 
 #ifdef ISPC_NVPTX_ENABLED
     lDefineConstantInt("__is_nvptx_target", (int)(g->target->getISA() == Target::NVPTX),
@@ -1549,7 +1753,10 @@ DefineStdlib(SymbolTable *symbolTable, llvm::LLVMContext *ctx, llvm::Module *mod
     if (includeStdlibISPC) {
         // If the user wants the standard library to be included, parse the
         // serialized version of the stdlib.ispc file to get its
-        // definitions added.
+        // definitions added.  This is the preprocessed source text; it is
+        // still lexed, parsed and type-checked on every compile, and only
+        // the IR generation for the functions that the program doesn't use
+        // is skipped (see AST::GenerateIR()).
         extern char stdlib_mask1_code[], stdlib_mask8_code[];
         extern char stdlib_mask16_code[], stdlib_mask32_code[], stdlib_mask64_code[];
         if (g->target->getISA() == Target::GENERIC &&
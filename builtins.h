@@ -59,4 +59,10 @@ void AddBitcodeToModule(const unsigned char *bitcode, int length,
                         llvm::Module *module, SymbolTable *symbolTable = NULL,
                         bool warn = true);
 
+/** Removes the definitions of internal functions (in practice, builtins
+    linked in by AddBitcodeToModule()) that nothing in the module refers
+    to, so that the optimizer doesn't have to process them.
+ */
+void RemoveUnusedBuiltins(llvm::Module *module);
+
 #endif // ISPC_STDLIB_H
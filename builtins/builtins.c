@@ -284,3 +284,158 @@ int __num_cores() {
     return sysconf(_SC_NPROCESSORS_ONLN);
 #endif // !_MSC_VER
 }
+
+
+/* Support for new and delete.
+
+   All of the program instances' allocations from a single varying new
+   come from one block of memory, so that both the new and the matching
+   varying delete only make one call to the memory allocator.  The block
+   starts with a BlockHeader, padded out to the allocation alignment;
+   each program instance's memory is then preceded by an alignment's
+   worth of padding that ends with a pointer back to the block, so that
+   delete can find it.  The block is freed once all of the program
+   instances' allocations from it have been deleted.  (Program instances
+   may delete their pointers separately, or from different threads.)
+   Uniform new uses the same layout, with a single allocation in the
+   block.
+
+   By default, blocks are allocated with the C library's aligned
+   allocation functions.  On platforms with weak symbols, if the
+   application defines ISPCMallocHook() and ISPCFreeHook(), they are
+   called instead; this makes it possible to use a size-class pool
+   allocator, for example.  ISPCFreeHook() is given the size of the block
+   that was allocated.
+ */
+
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+extern void *ISPCMallocHook(int64_t size, int32_t alignment) __attribute__((weak));
+extern void ISPCFreeHook(void *ptr, int64_t size) __attribute__((weak));
+#define ISPC_HAVE_ALLOC_HOOKS
+#else
+extern void *_aligned_malloc(size_t size, size_t alignment);
+extern void _aligned_free(void *ptr);
+#endif
+
+typedef struct {
+    int64_t size;        // Total size of the block
+    int32_t numLive;     // Number of allocations that haven't been deleted
+    int32_t alignment;
+} BlockHeader;
+
+
+static void *lBlockAlloc(int64_t size, int32_t alignment) {
+#ifdef ISPC_HAVE_ALLOC_HOOKS
+    if (ISPCMallocHook && ISPCFreeHook)
+        return ISPCMallocHook(size, alignment);
+#endif
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    return _aligned_malloc((size_t)size, (size_t)alignment);
+#else
+    void *ptr;
+    if (posix_memalign(&ptr, (size_t)alignment, (size_t)size) != 0)
+        return NULL;
+    return ptr;
+#endif
+}
+
+
+static void lBlockFree(BlockHeader *block) {
+#ifdef ISPC_HAVE_ALLOC_HOOKS
+    if (ISPCMallocHook && ISPCFreeHook) {
+        ISPCFreeHook(block, block->size);
+        return;
+    }
+#endif
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    _aligned_free(block);
+#else
+    free(block);
+#endif
+}
+
+
+/** Runs a varying new: for each program instance that's on in the mask,
+    allocates sizes[i] bytes with the given alignment (which must be a
+    power of two of at least sizeof(void *)) and stores a pointer to it
+    in result[i].  result[i] is set to zero for the other program
+    instances, and for all of them if the allocation fails.
+
+    @param width      Vector width of the compilation target
+    @param mask       Current lane mask when new is executed
+    @param sizes      Per-program-instance allocation sizes
+    @param alignment  Alignment of each program instance's memory
+    @param result     Where the per-program-instance pointers are stored
+ */
+void __do_new_varying(int width, uint64_t mask, const int64_t *sizes,
+                      int alignment, int64_t *result) {
+    int64_t headerSize = (sizeof(BlockHeader) + alignment - 1) & ~(int64_t)(alignment - 1);
+    int64_t total = headerSize;
+    int numLive = 0;
+    for (int i = 0; i < width; ++i) {
+        result[i] = 0;
+        if (mask & (1ull << i)) {
+            total += alignment + ((sizes[i] + alignment - 1) & ~(int64_t)(alignment - 1));
+            ++numLive;
+        }
+    }
+    if (numLive == 0)
+        return;
+
+    BlockHeader *block = (BlockHeader *)lBlockAlloc(total, alignment);
+    if (block == NULL)
+        return;
+    block->size = total;
+    block->numLive = numLive;
+    block->alignment = alignment;
+
+    char *ptr = (char *)block + headerSize;
+    for (int i = 0; i < width; ++i) {
+        if (mask & (1ull << i)) {
+            ptr += alignment;
+            ((BlockHeader **)ptr)[-1] = block;
+            result[i] = (int64_t)(intptr_t)ptr;
+            ptr += (sizes[i] + alignment - 1) & ~(int64_t)(alignment - 1);
+        }
+    }
+}
+
+
+/** Uniform new; see __do_new_varying(). */
+void *__do_new_uniform(int64_t size, int alignment) {
+    int64_t result;
+    __do_new_varying(1, 1, &size, alignment, &result);
+    return (void *)(intptr_t)result;
+}
+
+
+/** Runs a varying delete of the pointers in ptrs[] for the program
+    instances that are on in the mask.  NULL pointers are ignored.
+    Consecutive program instances with memory from the same block (the
+    common case) drop their references to it together. */
+void __do_delete_varying(int width, uint64_t mask, const int64_t *ptrs) {
+    BlockHeader *block = NULL;
+    int count = 0;
+    for (int i = 0; i < width; ++i) {
+        if ((mask & (1ull << i)) == 0 || ptrs[i] == 0)
+            continue;
+
+        BlockHeader *b = ((BlockHeader **)(intptr_t)ptrs[i])[-1];
+        if (b != block) {
+            if (block != NULL && __sync_sub_and_fetch(&block->numLive, count) == 0)
+                lBlockFree(block);
+            block = b;
+            count = 0;
+        }
+        ++count;
+    }
+    if (block != NULL && __sync_sub_and_fetch(&block->numLive, count) == 0)
+        lBlockFree(block);
+}
+
+
+/** Uniform delete; see __do_delete_varying(). */
+void __do_delete_uniform(void *ptr) {
+    int64_t p = (int64_t)(intptr_t)ptr;
+    __do_delete_varying(1, 1, &p);
+}
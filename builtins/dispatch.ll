@@ -236,6 +236,69 @@ return:                                           ; preds = %if.else70, %if.else
 }
 
 declare void @abort() noreturn nounwind
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Stores the system's CPU vendor, family and model, as returned by
+;; __get_system_cpu_model(); -1 represents "uninitialized".  The dispatch
+;; functions use this to choose between variants of a target ISA that were
+;; tuned for different CPUs (e.g. --target=avx2:haswell,avx2:znver1).
+
+@__system_cpu_model = internal global i32 -1
+
+;; __get_system_cpu_model() returns (vendor << 16) | (family << 8) | model,
+;; where vendor is 1 for Intel, 2 for AMD and 0 otherwise, and the family
+;; and model include the extended family and model fields, following the
+;; vendors' documentation of CPUID leaf 1:
+;;
+;; int32_t __get_system_cpu_model() {
+;;     int info[4];
+;;     __cpuid(info, 0);
+;;     int vendor = (info[1] == 0x756e6547) ? 1 :  // "Genu"ineIntel
+;;                  (info[1] == 0x68747541) ? 2 :  // "Auth"enticAMD
+;;                  0;
+;;     __cpuid(info, 1);
+;;     int family = (info[0] >> 8) & 0xf, model = (info[0] >> 4) & 0xf;
+;;     if (family == 6 || family == 0xf)
+;;         model += ((info[0] >> 16) & 0xf) << 4;
+;;     if (family == 0xf)
+;;         family += (info[0] >> 20) & 0xff;
+;;     return (vendor << 16) | (family << 8) | model;
+;; }
+
+define i32 @__get_system_cpu_model() nounwind uwtable {
+entry:
+  %0 = tail call { i32, i32, i32, i32 } asm sideeffect "cpuid", "={ax},={bx},={cx},={dx},0,~{dirflag},~{fpsr},~{flags}"(i32 0) nounwind
+  %vendor_ebx = extractvalue { i32, i32, i32, i32 } %0, 1
+  %is_intel = icmp eq i32 %vendor_ebx, 1970169159
+  %is_amd = icmp eq i32 %vendor_ebx, 1752462657
+  %vendor_amd = select i1 %is_amd, i32 2, i32 0
+  %vendor = select i1 %is_intel, i32 1, i32 %vendor_amd
+
+  %1 = tail call { i32, i32, i32, i32 } asm sideeffect "cpuid", "={ax},={bx},={cx},={dx},0,~{dirflag},~{fpsr},~{flags}"(i32 1) nounwind
+  %signature = extractvalue { i32, i32, i32, i32 } %1, 0
+  %family_shift = lshr i32 %signature, 8
+  %base_family = and i32 %family_shift, 15
+  %model_shift = lshr i32 %signature, 4
+  %base_model = and i32 %model_shift, 15
+  %ext_model_shift = lshr i32 %signature, 12
+  %ext_model = and i32 %ext_model_shift, 240
+  %ext_family_shift = lshr i32 %signature, 20
+  %ext_family = and i32 %ext_family_shift, 255
+
+  %is_family_6 = icmp eq i32 %base_family, 6
+  %is_family_f = icmp eq i32 %base_family, 15
+  %use_ext_model = or i1 %is_family_6, %is_family_f
+  %model_add = select i1 %use_ext_model, i32 %ext_model, i32 0
+  %model = add i32 %base_model, %model_add
+  %family_add = select i1 %is_family_f, i32 %ext_family, i32 0
+  %family = add i32 %base_family, %family_add
+
+  %vendor_bits = shl i32 %vendor, 16
+  %family_bits = shl i32 %family, 8
+  %vendor_family = or i32 %vendor_bits, %family_bits
+  %result = or i32 %vendor_family, %model
+  ret i32 %result
+}
+
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; This function is called by each of the dispatch functions we generate;
@@ -256,3 +319,311 @@ done:
   ret void
 }
 
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Similarly, this is called by the dispatch functions that have CPU-tuned
+;; variants to choose from; it sets @__system_cpu_model if it is unset.
+
+define void @__set_system_cpu_model() {
+entry:
+  %cm = load PTR_OP_ARGS(`i32 ')  @__system_cpu_model
+  %unset = icmp eq i32 %cm, -1
+  br i1 %unset, label %set_system_cpu_model, label %done
+
+set_system_cpu_model:
+  %cmval = call i32 @__get_system_cpu_model()
+  store i32 %cmval, i32* @__system_cpu_model
+  ret void
+
+done:
+  ret void
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Support for --dispatch=autotune, where the dispatch function of each
+;; exported function times the variants that can run on the system on its
+;; first calls and then calls the fastest one from then on.
+;;
+;; Each dispatch function has a state array of i64s: element 0 is the
+;; Target::ISA value of the chosen variant, or -1 while it's still being
+;; tuned; element 1 counts the calls made so far, and element 2+isa holds
+;; the total cycles spent in the variant for each isa.  The sets of
+;; variants are given as masks with bit isa set for each one that can run.
+;; The threads of a program may race on updating the state; that only
+;; affects the measurements, since every choice is a valid one.
+;;
+;; If the ISPC_AUTOTUNE_CACHE environment variable names a file, the
+;; choices are appended to it as lines of the form "<function> <isa>", and
+;; a later run of the program uses the last choice given in it for each
+;; function, if that variant can run on the system.
+;;
+;; int32_t __autotune_next(int64_t *state, const char *name, int32_t runnable) {
+;;     if (state[1] == 0) {
+;;         int32_t cached = __autotune_cache_lookup(name);
+;;         if (cached >= 0 && (runnable & (1 << cached)) != 0) {
+;;             state[0] = cached;
+;;             return cached;
+;;         }
+;;     }
+;;     // Cycle through the runnable variants
+;;     int32_t nth = state[1]++ % __builtin_popcount(runnable);
+;;     while (nth-- > 0)
+;;         runnable &= runnable - 1;
+;;     return __builtin_ctz(runnable);
+;; }
+;;
+;; void __autotune_record(int64_t *state, const char *name, int32_t isa,
+;;                        int64_t cycles, int32_t runnable,
+;;                        int32_t callsPerVariant) {
+;;     if (state[0] >= 0)
+;;         return;
+;;     state[2 + isa] += cycles;
+;;     if (state[1] < __builtin_popcount(runnable) * callsPerVariant)
+;;         return;
+;;     // Ties go to the more capable ISA
+;;     int32_t best = -1;
+;;     for (; runnable != 0; runnable &= runnable - 1) {
+;;         int32_t k = __builtin_ctz(runnable);
+;;         if (best < 0 || (uint64_t)state[2 + k] <= (uint64_t)state[2 + best])
+;;             best = k;
+;;     }
+;;     state[0] = best;
+;;     __autotune_cache_store(name, best);
+;; }
+
+declare i8* @getenv(i8*) nounwind
+declare i8* @fopen(i8*, i8*) nounwind
+declare i8* @fgets(i8*, i32, i8*) nounwind
+declare i32 @fputs(i8*, i8*) nounwind
+declare i32 @fputc(i32, i8*) nounwind
+declare i32 @fclose(i8*) nounwind
+declare i32 @llvm.ctpop.i32(i32) nounwind readnone
+declare i32 @llvm.cttz.i32(i32, i1) nounwind readnone
+
+@__autotune_cache_env = internal constant [20 x i8] c"ISPC_AUTOTUNE_CACHE\00"
+@__autotune_read_mode = internal constant [2 x i8] c"r\00"
+@__autotune_append_mode = internal constant [2 x i8] c"a\00"
+
+;; Returns the isa given for the named function by the last line for it in
+;; the cache file, or -1 if there isn't one.
+
+define internal i32 @__autotune_cache_lookup(i8* %name) nounwind {
+entry:
+  %result = alloca i32
+  store i32 -1, i32* %result
+  %buf = alloca [256 x i8]
+  %bufp = getelementptr PTR_OP_ARGS(`[256 x i8]') %buf, i32 0, i32 0
+  %env = getelementptr PTR_OP_ARGS(`[20 x i8]') @__autotune_cache_env, i32 0, i32 0
+  %file_name = call i8* @getenv(i8* %env)
+  %no_file_name = icmp eq i8* %file_name, null
+  br i1 %no_file_name, label %done, label %open
+
+open:
+  %mode = getelementptr PTR_OP_ARGS(`[2 x i8]') @__autotune_read_mode, i32 0, i32 0
+  %f = call i8* @fopen(i8* %file_name, i8* %mode)
+  %no_file = icmp eq i8* %f, null
+  br i1 %no_file, label %done, label %read
+
+read:
+  %line = call i8* @fgets(i8* %bufp, i32 256, i8* %f)
+  %eof = icmp eq i8* %line, null
+  br i1 %eof, label %close, label %compare
+
+compare:
+  ; does the line start with the name followed by a space?
+  %i = phi i32 [ 0, %read ], [ %i_next, %compare_next ]
+  %name_ptr = getelementptr PTR_OP_ARGS(`i8') %name, i32 %i
+  %name_char = load PTR_OP_ARGS(`i8 ') %name_ptr
+  %line_ptr = getelementptr PTR_OP_ARGS(`i8') %bufp, i32 %i
+  %line_char = load PTR_OP_ARGS(`i8 ') %line_ptr
+  %name_end = icmp eq i8 %name_char, 0
+  br i1 %name_end, label %check_space, label %compare_char
+
+compare_char:
+  %same = icmp eq i8 %name_char, %line_char
+  br i1 %same, label %compare_next, label %read
+
+compare_next:
+  %i_next = add i32 %i, 1
+  br label %compare
+
+check_space:
+  %is_space = icmp eq i8 %line_char, 32
+  br i1 %is_space, label %parse, label %read
+
+parse:
+  %start = add i32 %i, 1
+  br label %digit
+
+digit:
+  %j = phi i32 [ %start, %parse ], [ %j_next, %digit_next ]
+  %val = phi i32 [ 0, %parse ], [ %val_next, %digit_next ]
+  %digit_ptr = getelementptr PTR_OP_ARGS(`i8') %bufp, i32 %j
+  %digit_char = load PTR_OP_ARGS(`i8 ') %digit_ptr
+  %digit_val8 = sub i8 %digit_char, 48
+  %is_digit = icmp ult i8 %digit_val8, 10
+  br i1 %is_digit, label %digit_next, label %digits_done
+
+digit_next:
+  %digit_val = zext i8 %digit_val8 to i32
+  %val10 = mul i32 %val, 10
+  %val_next = add i32 %val10, %digit_val
+  %j_next = add i32 %j, 1
+  br label %digit
+
+digits_done:
+  %got_digits = icmp ne i32 %j, %start
+  br i1 %got_digits, label %store_result, label %read
+
+store_result:
+  store i32 %val, i32* %result
+  br label %read
+
+close:
+  call i32 @fclose(i8* %f)
+  br label %done
+
+done:
+  %r = load PTR_OP_ARGS(`i32 ') %result
+  ret i32 %r
+}
+
+;; Appends the choice of isa for the named function to the cache file.
+
+define internal void @__autotune_cache_store(i8* %name, i32 %isa) nounwind {
+entry:
+  %env = getelementptr PTR_OP_ARGS(`[20 x i8]') @__autotune_cache_env, i32 0, i32 0
+  %file_name = call i8* @getenv(i8* %env)
+  %no_file_name = icmp eq i8* %file_name, null
+  br i1 %no_file_name, label %done, label %open
+
+open:
+  %mode = getelementptr PTR_OP_ARGS(`[2 x i8]') @__autotune_append_mode, i32 0, i32 0
+  %f = call i8* @fopen(i8* %file_name, i8* %mode)
+  %no_file = icmp eq i8* %f, null
+  br i1 %no_file, label %done, label %write
+
+write:
+  call i32 @fputs(i8* %name, i8* %f)
+  call i32 @fputc(i32 32, i8* %f)
+  %tens = udiv i32 %isa, 10
+  %has_tens = icmp ne i32 %tens, 0
+  br i1 %has_tens, label %write_tens, label %write_ones
+
+write_tens:
+  %tens_char = add i32 %tens, 48
+  call i32 @fputc(i32 %tens_char, i8* %f)
+  br label %write_ones
+
+write_ones:
+  %ones = urem i32 %isa, 10
+  %ones_char = add i32 %ones, 48
+  call i32 @fputc(i32 %ones_char, i8* %f)
+  call i32 @fputc(i32 10, i8* %f)
+  call i32 @fclose(i8* %f)
+  br label %done
+
+done:
+  ret void
+}
+
+define i32 @__autotune_next(i64* %state, i8* %name, i32 %runnable) nounwind {
+entry:
+  %calls_ptr = getelementptr PTR_OP_ARGS(`i64') %state, i32 1
+  %calls = load PTR_OP_ARGS(`i64 ') %calls_ptr
+  %first = icmp eq i64 %calls, 0
+  br i1 %first, label %lookup, label %pick
+
+lookup:
+  %cached = call i32 @__autotune_cache_lookup(i8* %name)
+  %valid = icmp sge i32 %cached, 0
+  %cached_bit_index = and i32 %cached, 31
+  %cached_bit = shl i32 1, %cached_bit_index
+  %cached_runnable_bit = and i32 %runnable, %cached_bit
+  %cached_runnable = icmp ne i32 %cached_runnable_bit, 0
+  %use_cached = and i1 %valid, %cached_runnable
+  br i1 %use_cached, label %use_cache, label %pick
+
+use_cache:
+  %cached64 = sext i32 %cached to i64
+  store i64 %cached64, i64* %state
+  ret i32 %cached
+
+pick:
+  %next_calls = add i64 %calls, 1
+  store i64 %next_calls, i64* %calls_ptr
+  %count = call i32 @llvm.ctpop.i32(i32 %runnable)
+  %count64 = zext i32 %count to i64
+  %nth64 = urem i64 %calls, %count64
+  %nth = trunc i64 %nth64 to i32
+  br label %skip
+
+skip:
+  %bits = phi i32 [ %runnable, %pick ], [ %bits_next, %skip_one ]
+  %left = phi i32 [ %nth, %pick ], [ %left_next, %skip_one ]
+  %skipped = icmp eq i32 %left, 0
+  br i1 %skipped, label %found, label %skip_one
+
+skip_one:
+  %bits_minus_1 = sub i32 %bits, 1
+  %bits_next = and i32 %bits, %bits_minus_1
+  %left_next = sub i32 %left, 1
+  br label %skip
+
+found:
+  %isa = call i32 @llvm.cttz.i32(i32 %bits, i1 true)
+  ret i32 %isa
+}
+
+define void @__autotune_record(i64* %state, i8* %name, i32 %isa, i64 %cycles,
+                               i32 %runnable, i32 %calls_per_variant) nounwind {
+entry:
+  %choice = load PTR_OP_ARGS(`i64 ') %state
+  %decided = icmp sge i64 %choice, 0
+  br i1 %decided, label %done, label %add
+
+add:
+  %slot = add i32 %isa, 2
+  %cycles_ptr = getelementptr PTR_OP_ARGS(`i64') %state, i32 %slot
+  %old_cycles = load PTR_OP_ARGS(`i64 ') %cycles_ptr
+  %new_cycles = add i64 %old_cycles, %cycles
+  store i64 %new_cycles, i64* %cycles_ptr
+
+  %calls_ptr = getelementptr PTR_OP_ARGS(`i64') %state, i32 1
+  %calls = load PTR_OP_ARGS(`i64 ') %calls_ptr
+  %count = call i32 @llvm.ctpop.i32(i32 %runnable)
+  %needed = mul i32 %count, %calls_per_variant
+  %needed64 = zext i32 %needed to i64
+  %enough = icmp uge i64 %calls, %needed64
+  br i1 %enough, label %choose, label %done
+
+choose:
+  %bits = phi i32 [ %runnable, %add ], [ %bits_next, %choose_next ]
+  %best = phi i32 [ -1, %add ], [ %best_next, %choose_next ]
+  %best_cycles = phi i64 [ 0, %add ], [ %best_cycles_next, %choose_next ]
+  %no_more = icmp eq i32 %bits, 0
+  br i1 %no_more, label %commit, label %choose_next
+
+choose_next:
+  %k = call i32 @llvm.cttz.i32(i32 %bits, i1 true)
+  %k_slot = add i32 %k, 2
+  %k_cycles_ptr = getelementptr PTR_OP_ARGS(`i64') %state, i32 %k_slot
+  %k_cycles = load PTR_OP_ARGS(`i64 ') %k_cycles_ptr
+  %no_best = icmp slt i32 %best, 0
+  %not_slower = icmp ule i64 %k_cycles, %best_cycles
+  %take = or i1 %no_best, %not_slower
+  %best_next = select i1 %take, i32 %k, i32 %best
+  %best_cycles_next = select i1 %take, i64 %k_cycles, i64 %best_cycles
+  %bits_minus_1 = sub i32 %bits, 1
+  %bits_next = and i32 %bits, %bits_minus_1
+  br label %choose
+
+commit:
+  %best64 = sext i32 %best to i64
+  store i64 %best64, i64* %state
+  call void @__autotune_cache_store(i8* %name, i32 %best)
+  br label %done
+
+done:
+  ret void
+}
@@ -37,7 +37,7 @@ define(`MASK',`i32')
 include(`util.m4')
 
 stdlib_core()
-packed_load_and_store()
+ifelse(HAVE_PERMD, `1', `packed_load_and_store_permd()', `packed_load_and_store()')
 scans()
 int64minmax()
 saturation_arithmetic()
@@ -695,5 +695,10 @@ define <16 x double> @__max_varying_double(<16 x double>, <16 x double>) nounwin
 rsqrtd_decl()
 rcpd_decl()
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unrefined rcp/rsqrt estimates, for rcp_fast() and rsqrt_fast()
+
+rcp_rsqrt_fast_float(8, @llvm.x86.avx.rcp.ps.256, @llvm.x86.avx.rsqrt.ps.256)
+
 transcendetals_decl()
 trigonometry_decl()
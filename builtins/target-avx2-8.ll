@@ -0,0 +1,93 @@
+;;  Copyright (c) 2010-2016, Intel Corporation
+;;  All rights reserved.
+;;
+;;  Redistribution and use in source and binary forms, with or without
+;;  modification, are permitted provided that the following conditions are
+;;  met:
+;;
+;;    * Redistributions of source code must retain the above copyright
+;;      notice, this list of conditions and the following disclaimer.
+;;
+;;    * Redistributions in binary form must reproduce the above copyright
+;;      notice, this list of conditions and the following disclaimer in the
+;;      documentation and/or other materials provided with the distribution.
+;;
+;;    * Neither the name of Intel Corporation nor the names of its
+;;      contributors may be used to endorse or promote products derived from
+;;      this software without specific prior written permission.
+;;
+;;
+;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+;;   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+;;   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+;;   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+;;   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+;;   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+;;   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Basic 32-wide definitions, with 8-bit masks
+
+define(`WIDTH',`32')
+define(`MASK',`i8')
+define(`HAVE_BMI2',`1')
+include(`util.m4')
+
+stdlib_core()
+packed_load_and_store()
+scans()
+int64minmax()
+saturation_arithmetic()
+
+include(`target-avx2-narrow-common.ll')
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; mask handling
+
+declare i32 @llvm.x86.avx2.pmovmskb(<32 x i8>) nounwind readnone
+
+define i64 @__movmsk(<32 x i8>) nounwind readnone alwaysinline {
+  %m = call i32 @llvm.x86.avx2.pmovmskb(<32 x i8> %0)
+  %m64 = zext i32 %m to i64
+  ret i64 %m64
+}
+
+define i1 @__any(<32 x i8>) nounwind readnone alwaysinline {
+  %m = call i32 @llvm.x86.avx2.pmovmskb(<32 x i8> %0)
+  %mne = icmp ne i32 %m, 0
+  ret i1 %mne
+}
+
+define i1 @__all(<32 x i8>) nounwind readnone alwaysinline {
+  %m = call i32 @llvm.x86.avx2.pmovmskb(<32 x i8> %0)
+  %meq = icmp eq i32 %m, -1
+  ret i1 %meq
+}
+
+define i1 @__none(<32 x i8>) nounwind readnone alwaysinline {
+  %m = call i32 @llvm.x86.avx2.pmovmskb(<32 x i8> %0)
+  %meq = icmp eq i32 %m, 0
+  ret i1 %meq
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; int8 reductions
+
+declare <4 x i64> @llvm.x86.avx2.psad.bw(<32 x i8>, <32 x i8>) nounwind readnone
+
+define i16 @__reduce_add_int8(<32 x i8>) nounwind readnone alwaysinline {
+  %rv = call <4 x i64> @llvm.x86.avx2.psad.bw(<32 x i8> %0,
+                                              <32 x i8> zeroinitializer)
+  %r0 = extractelement <4 x i64> %rv, i32 0
+  %r1 = extractelement <4 x i64> %rv, i32 1
+  %r2 = extractelement <4 x i64> %rv, i32 2
+  %r3 = extractelement <4 x i64> %rv, i32 3
+  %r01 = add i64 %r0, %r1
+  %r23 = add i64 %r2, %r3
+  %r = add i64 %r01, %r23
+  %r16 = trunc i64 %r to i16
+  ret i16 %r16
+}
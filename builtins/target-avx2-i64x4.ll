@@ -30,6 +30,7 @@
 ;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
 
 define(`HAVE_GATHER', `1')
+define(`HAVE_BMI2', `1')
 
 include(`target-avx1-i64x4base.ll')
 
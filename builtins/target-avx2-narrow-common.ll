@@ -0,0 +1,446 @@
+;;  Copyright (c) 2010-2016, Intel Corporation
+;;  All rights reserved.
+;;
+;;  Redistribution and use in source and binary forms, with or without
+;;  modification, are permitted provided that the following conditions are
+;;  met:
+;;
+;;    * Redistributions of source code must retain the above copyright
+;;      notice, this list of conditions and the following disclaimer.
+;;
+;;    * Redistributions in binary form must reproduce the above copyright
+;;      notice, this list of conditions and the following disclaimer in the
+;;      documentation and/or other materials provided with the distribution.
+;;
+;;    * Neither the name of Intel Corporation nor the names of its
+;;      contributors may be used to endorse or promote products derived from
+;;      this software without specific prior written permission.
+;;
+;;
+;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+;;   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+;;   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+;;   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+;;   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+;;   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+;;   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+
+;; Definitions shared by the AVX2 targets with 8- and 16-bit masks
+;; (avx2-i8x32 and avx2-i16x16).  The including file defines WIDTH and
+;; MASK, pulls in util.m4, and provides the mask-specific routines
+;; (__movmsk, __any/__all/__none, and __reduce_add_int8); everything here
+;; is written for a generic WIDTH and splits the work into 256-bit pieces.
+
+include(`target-avx-common.ll')
+
+rdrand_definition()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; rcp
+
+declare <8 x float> @llvm.x86.avx.rcp.ps.256(<8 x float>) nounwind readnone
+
+define <WIDTH x float> @__rcp_varying_float(<WIDTH x float>) nounwind readonly alwaysinline {
+  ;  float iv = __rcp_v(v);
+  ;  return iv * (2. - v * iv);
+
+  unary_split(call, WIDTH, 8, float, float, @llvm.x86.avx.rcp.ps.256, %0)
+  ; do one N-R iteration
+  %v_iv = fmul <WIDTH x float> %0, %call
+  %two_minus = fsub <WIDTH x float> const_vector(float, 2.), %v_iv
+  %iv_mul = fmul <WIDTH x float> %call, %two_minus
+  ret <WIDTH x float> %iv_mul
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; rsqrt
+
+declare <8 x float> @llvm.x86.avx.rsqrt.ps.256(<8 x float>) nounwind readnone
+
+define <WIDTH x float> @__rsqrt_varying_float(<WIDTH x float> %v) nounwind readonly alwaysinline {
+  ;  float is = __rsqrt_v(v);
+  unary_split(is, WIDTH, 8, float, float, @llvm.x86.avx.rsqrt.ps.256, %v)
+  ;  return 0.5 * is * (3. - (v * is) * is);
+  %v_is = fmul <WIDTH x float> %v, %is
+  %v_is_is = fmul <WIDTH x float> %v_is, %is
+  %three_sub = fsub <WIDTH x float> const_vector(float, 3.), %v_is_is
+  %is_mul = fmul <WIDTH x float> %is, %three_sub
+  %half_scale = fmul <WIDTH x float> const_vector(float, 0.5), %is_mul
+  ret <WIDTH x float> %half_scale
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; sqrt
+
+declare <8 x float> @llvm.x86.avx.sqrt.ps.256(<8 x float>) nounwind readnone
+
+define <WIDTH x float> @__sqrt_varying_float(<WIDTH x float>) nounwind readonly alwaysinline {
+  unary_split(call, WIDTH, 8, float, float, @llvm.x86.avx.sqrt.ps.256, %0)
+  ret <WIDTH x float> %call
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; double precision sqrt
+
+declare <4 x double> @llvm.x86.avx.sqrt.pd.256(<4 x double>) nounwind readnone
+
+define <WIDTH x double> @__sqrt_varying_double(<WIDTH x double>) nounwind alwaysinline {
+  unary_split(call, WIDTH, 4, double, double, @llvm.x86.avx.sqrt.pd.256, %0)
+  ret <WIDTH x double> %call
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; rounding floats
+
+declare <8 x float> @llvm.x86.avx.round.ps.256(<8 x float>, i32) nounwind readnone
+
+define <WIDTH x float> @__round_varying_float(<WIDTH x float>) nounwind readonly alwaysinline {
+  ; roundps, round mode nearest 0b00 | don't signal precision exceptions 0b1000 = 8
+  unary_split(call, WIDTH, 8, float, float, @llvm.x86.avx.round.ps.256, %0, `, i32 8')
+  ret <WIDTH x float> %call
+}
+
+define <WIDTH x float> @__floor_varying_float(<WIDTH x float>) nounwind readonly alwaysinline {
+  ; roundps, round down 0b01 | don't signal precision exceptions 0b1001 = 9
+  unary_split(call, WIDTH, 8, float, float, @llvm.x86.avx.round.ps.256, %0, `, i32 9')
+  ret <WIDTH x float> %call
+}
+
+define <WIDTH x float> @__ceil_varying_float(<WIDTH x float>) nounwind readonly alwaysinline {
+  ; roundps, round up 0b10 | don't signal precision exceptions 0b1010 = 10
+  unary_split(call, WIDTH, 8, float, float, @llvm.x86.avx.round.ps.256, %0, `, i32 10')
+  ret <WIDTH x float> %call
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; rounding doubles
+
+declare <4 x double> @llvm.x86.avx.round.pd.256(<4 x double>, i32) nounwind readnone
+
+define <WIDTH x double> @__round_varying_double(<WIDTH x double>) nounwind readonly alwaysinline {
+  unary_split(call, WIDTH, 4, double, double, @llvm.x86.avx.round.pd.256, %0, `, i32 8')
+  ret <WIDTH x double> %call
+}
+
+define <WIDTH x double> @__floor_varying_double(<WIDTH x double>) nounwind readonly alwaysinline {
+  unary_split(call, WIDTH, 4, double, double, @llvm.x86.avx.round.pd.256, %0, `, i32 9')
+  ret <WIDTH x double> %call
+}
+
+define <WIDTH x double> @__ceil_varying_double(<WIDTH x double>) nounwind readonly alwaysinline {
+  unary_split(call, WIDTH, 4, double, double, @llvm.x86.avx.round.pd.256, %0, `, i32 10')
+  ret <WIDTH x double> %call
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; float min/max
+
+declare <8 x float> @llvm.x86.avx.max.ps.256(<8 x float>, <8 x float>) nounwind readnone
+declare <8 x float> @llvm.x86.avx.min.ps.256(<8 x float>, <8 x float>) nounwind readnone
+
+define <WIDTH x float> @__max_varying_float(<WIDTH x float>, <WIDTH x float>) nounwind readonly alwaysinline {
+  binary_split(call, WIDTH, 8, float, float, @llvm.x86.avx.max.ps.256, %0, %1)
+  ret <WIDTH x float> %call
+}
+
+define <WIDTH x float> @__min_varying_float(<WIDTH x float>, <WIDTH x float>) nounwind readonly alwaysinline {
+  binary_split(call, WIDTH, 8, float, float, @llvm.x86.avx.min.ps.256, %0, %1)
+  ret <WIDTH x float> %call
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; double precision min/max
+
+declare <4 x double> @llvm.x86.avx.max.pd.256(<4 x double>, <4 x double>) nounwind readnone
+declare <4 x double> @llvm.x86.avx.min.pd.256(<4 x double>, <4 x double>) nounwind readnone
+
+define <WIDTH x double> @__min_varying_double(<WIDTH x double>, <WIDTH x double>) nounwind readnone alwaysinline {
+  binary_split(ret, WIDTH, 4, double, double, @llvm.x86.avx.min.pd.256, %0, %1)
+  ret <WIDTH x double> %ret
+}
+
+define <WIDTH x double> @__max_varying_double(<WIDTH x double>, <WIDTH x double>) nounwind readnone alwaysinline {
+  binary_split(ret, WIDTH, 4, double, double, @llvm.x86.avx.max.pd.256, %0, %1)
+  ret <WIDTH x double> %ret
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; int min/max
+
+declare <8 x i32> @llvm.x86.avx2.pmins.d(<8 x i32>, <8 x i32>) nounwind readonly
+declare <8 x i32> @llvm.x86.avx2.pmaxs.d(<8 x i32>, <8 x i32>) nounwind readonly
+
+define <WIDTH x i32> @__min_varying_int32(<WIDTH x i32>, <WIDTH x i32>) nounwind readonly alwaysinline {
+  binary_split(m, WIDTH, 8, i32, i32, @llvm.x86.avx2.pmins.d, %0, %1)
+  ret <WIDTH x i32> %m
+}
+
+define <WIDTH x i32> @__max_varying_int32(<WIDTH x i32>, <WIDTH x i32>) nounwind readonly alwaysinline {
+  binary_split(m, WIDTH, 8, i32, i32, @llvm.x86.avx2.pmaxs.d, %0, %1)
+  ret <WIDTH x i32> %m
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unsigned int min/max
+
+declare <8 x i32> @llvm.x86.avx2.pminu.d(<8 x i32>, <8 x i32>) nounwind readonly
+declare <8 x i32> @llvm.x86.avx2.pmaxu.d(<8 x i32>, <8 x i32>) nounwind readonly
+
+define <WIDTH x i32> @__min_varying_uint32(<WIDTH x i32>, <WIDTH x i32>) nounwind readonly alwaysinline {
+  binary_split(m, WIDTH, 8, i32, i32, @llvm.x86.avx2.pminu.d, %0, %1)
+  ret <WIDTH x i32> %m
+}
+
+define <WIDTH x i32> @__max_varying_uint32(<WIDTH x i32>, <WIDTH x i32>) nounwind readonly alwaysinline {
+  binary_split(m, WIDTH, 8, i32, i32, @llvm.x86.avx2.pmaxu.d, %0, %1)
+  ret <WIDTH x i32> %m
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; float/half conversions
+
+declare <8 x float> @llvm.x86.vcvtph2ps.256(<8 x i16>) nounwind readnone
+; 0 is round nearest even
+declare <8 x i16> @llvm.x86.vcvtps2ph.256(<8 x float>, i32) nounwind readnone
+
+define <WIDTH x float> @__half_to_float_varying(<WIDTH x i16> %v) nounwind readnone {
+  unary_split(r, WIDTH, 8, i16, float, @llvm.x86.vcvtph2ps.256, %v)
+  ret <WIDTH x float> %r
+}
+
+define <WIDTH x i16> @__float_to_half_varying(<WIDTH x float> %v) nounwind readnone {
+  unary_split(r, WIDTH, 8, float, i16, @llvm.x86.vcvtps2ph.256, %v, `, i32 0')
+  ret <WIDTH x i16> %r
+}
+
+define float @__half_to_float_uniform(i16 %v) nounwind readnone {
+  %v1 = bitcast i16 %v to <1 x i16>
+  %vv = shufflevector <1 x i16> %v1, <1 x i16> undef,
+           <8 x i32> <i32 0, i32 undef, i32 undef, i32 undef,
+                      i32 undef, i32 undef, i32 undef, i32 undef>
+  %rv = call <8 x float> @llvm.x86.vcvtph2ps.256(<8 x i16> %vv)
+  %r = extractelement <8 x float> %rv, i32 0
+  ret float %r
+}
+
+define i16 @__float_to_half_uniform(float %v) nounwind readnone {
+  %v1 = bitcast float %v to <1 x float>
+  %vv = shufflevector <1 x float> %v1, <1 x float> undef,
+           <8 x i32> <i32 0, i32 undef, i32 undef, i32 undef,
+                      i32 undef, i32 undef, i32 undef, i32 undef>
+  ; round to nearest even
+  %rv = call <8 x i16> @llvm.x86.vcvtps2ph.256(<8 x float> %vv, i32 0)
+  %r = extractelement <8 x i16> %rv, i32 0
+  ret i16 %r
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; svml
+
+include(`svml.m4')
+svml_declare(float,f8,8)
+svml_define_x(float,f8,8,f,WIDTH)
+
+svml_declare(double,4,4)
+svml_define_x(double,4,4,d,WIDTH)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; horizontal ops / reductions
+
+define(`reduce_width', `ifelse(WIDTH, `16', `reduce16($@)', `reduce32($@)')')
+
+define internal <WIDTH x i16> @__add_varying_i16(<WIDTH x i16>,
+                                  <WIDTH x i16>) nounwind readnone alwaysinline {
+  %r = add <WIDTH x i16> %0, %1
+  ret <WIDTH x i16> %r
+}
+
+define internal i16 @__add_uniform_i16(i16, i16) nounwind readnone alwaysinline {
+  %r = add i16 %0, %1
+  ret i16 %r
+}
+
+define i16 @__reduce_add_int16(<WIDTH x i16>) nounwind readnone alwaysinline {
+  reduce_width(i16, @__add_varying_i16, @__add_uniform_i16)
+}
+
+define internal <WIDTH x float> @__add_varying_float(<WIDTH x float>, <WIDTH x float>) {
+  %r = fadd <WIDTH x float> %0, %1
+  ret <WIDTH x float> %r
+}
+
+define internal float @__add_uniform_float(float, float) {
+  %r = fadd float %0, %1
+  ret float %r
+}
+
+define float @__reduce_add_float(<WIDTH x float>) nounwind readonly alwaysinline {
+  reduce_width(float, @__add_varying_float, @__add_uniform_float)
+}
+
+define float @__reduce_min_float(<WIDTH x float>) nounwind readnone {
+  reduce_width(float, @__min_varying_float, @__min_uniform_float)
+}
+
+define float @__reduce_max_float(<WIDTH x float>) nounwind readnone {
+  reduce_width(float, @__max_varying_float, @__max_uniform_float)
+}
+
+define internal <WIDTH x i32> @__add_varying_int32(<WIDTH x i32>, <WIDTH x i32>) {
+  %r = add <WIDTH x i32> %0, %1
+  ret <WIDTH x i32> %r
+}
+
+define internal i32 @__add_uniform_int32(i32, i32) {
+  %r = add i32 %0, %1
+  ret i32 %r
+}
+
+define i32 @__reduce_add_int32(<WIDTH x i32>) nounwind readnone {
+  reduce_width(i32, @__add_varying_int32, @__add_uniform_int32)
+}
+
+define i32 @__reduce_min_int32(<WIDTH x i32>) nounwind readnone {
+  reduce_width(i32, @__min_varying_int32, @__min_uniform_int32)
+}
+
+define i32 @__reduce_max_int32(<WIDTH x i32>) nounwind readnone {
+  reduce_width(i32, @__max_varying_int32, @__max_uniform_int32)
+}
+
+define i32 @__reduce_min_uint32(<WIDTH x i32>) nounwind readnone {
+  reduce_width(i32, @__min_varying_uint32, @__min_uniform_uint32)
+}
+
+define i32 @__reduce_max_uint32(<WIDTH x i32>) nounwind readnone {
+  reduce_width(i32, @__max_varying_uint32, @__max_uniform_uint32)
+}
+
+define internal <WIDTH x double> @__add_varying_double(<WIDTH x double>, <WIDTH x double>) {
+  %r = fadd <WIDTH x double> %0, %1
+  ret <WIDTH x double> %r
+}
+
+define internal double @__add_uniform_double(double, double) {
+  %r = fadd double %0, %1
+  ret double %r
+}
+
+define double @__reduce_add_double(<WIDTH x double>) nounwind readnone {
+  reduce_width(double, @__add_varying_double, @__add_uniform_double)
+}
+
+define double @__reduce_min_double(<WIDTH x double>) nounwind readnone {
+  reduce_width(double, @__min_varying_double, @__min_uniform_double)
+}
+
+define double @__reduce_max_double(<WIDTH x double>) nounwind readnone {
+  reduce_width(double, @__max_varying_double, @__max_uniform_double)
+}
+
+define internal <WIDTH x i64> @__add_varying_int64(<WIDTH x i64>, <WIDTH x i64>) {
+  %r = add <WIDTH x i64> %0, %1
+  ret <WIDTH x i64> %r
+}
+
+define internal i64 @__add_uniform_int64(i64, i64) {
+  %r = add i64 %0, %1
+  ret i64 %r
+}
+
+define i64 @__reduce_add_int64(<WIDTH x i64>) nounwind readnone {
+  reduce_width(i64, @__add_varying_int64, @__add_uniform_int64)
+}
+
+define i64 @__reduce_min_int64(<WIDTH x i64>) nounwind readnone {
+  reduce_width(i64, @__min_varying_int64, @__min_uniform_int64)
+}
+
+define i64 @__reduce_max_int64(<WIDTH x i64>) nounwind readnone {
+  reduce_width(i64, @__max_varying_int64, @__max_uniform_int64)
+}
+
+define i64 @__reduce_min_uint64(<WIDTH x i64>) nounwind readnone {
+  reduce_width(i64, @__min_varying_uint64, @__min_uniform_uint64)
+}
+
+define i64 @__reduce_max_uint64(<WIDTH x i64>) nounwind readnone {
+  reduce_width(i64, @__max_varying_uint64, @__max_uniform_uint64)
+}
+
+reduce_equal(WIDTH)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; masked store
+
+; The narrow masks don't map onto vmaskmov, so blend with a select; the
+; backend turns that into vpblendvb on the widened mask.
+define(`masked_store_blend_select', `
+define void @__masked_store_blend_$1(<WIDTH x $1>* nocapture, <WIDTH x $1>,
+                                      <WIDTH x MASK> %mask) nounwind alwaysinline {
+  %mask_as_i1 = trunc <WIDTH x MASK> %mask to <WIDTH x i1>
+  %old = load PTR_OP_ARGS(`<WIDTH x $1>')  %0, align 4
+  %blend = select <WIDTH x i1> %mask_as_i1, <WIDTH x $1> %1, <WIDTH x $1> %old
+  store <WIDTH x $1> %blend, <WIDTH x $1>* %0, align 4
+  ret void
+}
+')
+
+masked_store_blend_select(i8)
+masked_store_blend_select(i16)
+masked_store_blend_select(i32)
+masked_store_blend_select(i64)
+
+gen_masked_store(i8)
+gen_masked_store(i16)
+gen_masked_store(i32)
+gen_masked_store(i64)
+
+masked_store_float_double()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unaligned loads/loads+broadcasts
+
+masked_load(i8,  1)
+masked_load(i16, 2)
+masked_load(i32, 4)
+masked_load(float, 4)
+masked_load(i64, 8)
+masked_load(double, 8)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; gather/scatter
+
+; FIXME: the AVX2 gathers want 32/64-bit masks; use the generic versions
+; until it is clear that widening the mask pays off.
+
+gen_gather_factored(i8)
+gen_gather_factored(i16)
+gen_gather_factored(i32)
+gen_gather_factored(float)
+gen_gather_factored(i64)
+gen_gather_factored(double)
+
+gen_scatter(i8)
+gen_scatter(i16)
+gen_scatter(i32)
+gen_scatter(float)
+gen_scatter(i64)
+gen_scatter(double)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; reciprocals in double precision, if supported
+
+rsqrtd_decl()
+rcpd_decl()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unrefined rcp/rsqrt estimates, for rcp_fast() and rsqrt_fast()
+
+rcp_rsqrt_fast_float(8, @llvm.x86.avx.rcp.ps.256, @llvm.x86.avx.rsqrt.ps.256)
+
+transcendetals_decl()
+trigonometry_decl()
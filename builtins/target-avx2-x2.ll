@@ -30,6 +30,8 @@
 ;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
 
 define(`HAVE_GATHER', `1')
+define(`HAVE_BMI2', `1')
+define(`HAVE_PERMD', `1')
 
 include(`target-avx-x2.ll')
 
@@ -30,6 +30,8 @@
 ;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
 
 define(`HAVE_GATHER', `1')
+define(`HAVE_BMI2', `1')
+define(`HAVE_PERMD', `1')
 
 include(`target-avx.ll')
 
@@ -130,6 +132,7 @@ declare <4 x i32> @llvm.x86.avx2.gather.q.d.256(<4 x i32> %target, i8 * %ptr,
 define <8 x i32> @__gather_base_offsets32_i32(i8 * %ptr,
                              i32 %scale, <8 x i32> %offsets,
                              <8 x i32> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(i32, i32, %ptr, %scale, %offsets, %vecmask)
   %scale8 = trunc i32 %scale to i8
 
   %v = call <8 x i32> @llvm.x86.avx2.gather.d.d.256(<8 x i32> undef, i8 * %ptr,
@@ -142,6 +145,7 @@ define <8 x i32> @__gather_base_offsets32_i32(i8 * %ptr,
 define <8 x i32> @__gather_base_offsets64_i32(i8 * %ptr,
                              i32 %scale, <8 x i64> %offsets,
                              <8 x i32> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(i32, i64, %ptr, %scale, %offsets, %vecmask)
   %scale8 = trunc i32 %scale to i8
   extract_4s(i32, vecmask)
   extract_4s(i64, offsets)
@@ -159,6 +163,7 @@ define <8 x i32> @__gather_base_offsets64_i32(i8 * %ptr,
 
 define <8 x i32> @__gather32_i32(<8 x i32> %ptrs, 
                                  <8 x i32> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(i32, i32, null, 1, %ptrs, %vecmask)
   %v = call <8 x i32> @llvm.x86.avx2.gather.d.d.256(<8 x i32> undef, i8 * null,
                       <8 x i32> %ptrs, <8 x i32> %vecmask, i8 1)
   ret <8 x i32> %v
@@ -167,6 +172,7 @@ define <8 x i32> @__gather32_i32(<8 x i32> %ptrs,
 
 define <8 x i32> @__gather64_i32(<8 x i64> %ptrs, 
                                  <8 x i32> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(i32, i64, null, 1, %ptrs, %vecmask)
   extract_4s(i64, ptrs)
   extract_4s(i32, vecmask)
 
@@ -192,6 +198,7 @@ declare <4 x float> @llvm.x86.avx2.gather.q.ps.256(<4 x float> %target, i8 * %pt
 define <8 x float> @__gather_base_offsets32_float(i8 * %ptr,
                                   i32 %scale, <8 x i32> %offsets,
                                   <8 x i32> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(float, i32, %ptr, %scale, %offsets, %vecmask)
   %scale8 = trunc i32 %scale to i8
   %mask = bitcast <8 x i32> %vecmask to <8 x float>
 
@@ -205,6 +212,7 @@ define <8 x float> @__gather_base_offsets32_float(i8 * %ptr,
 define <8 x float> @__gather_base_offsets64_float(i8 * %ptr,
                                    i32 %scale, <8 x i64> %offsets,
                                    <8 x i32> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(float, i64, %ptr, %scale, %offsets, %vecmask)
   %scale8 = trunc i32 %scale to i8
   %mask = bitcast <8 x i32> %vecmask to <8 x float>
   extract_4s(i64, offsets)
@@ -223,6 +231,7 @@ define <8 x float> @__gather_base_offsets64_float(i8 * %ptr,
 
 define <8 x float> @__gather32_float(<8 x i32> %ptrs, 
                                      <8 x i32> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(float, i32, null, 1, %ptrs, %vecmask)
   %mask = bitcast <8 x i32> %vecmask to <8 x float>
 
   %v = call <8 x float> @llvm.x86.avx2.gather.d.ps.256(<8 x float> undef, i8 * null,
@@ -234,6 +243,7 @@ define <8 x float> @__gather32_float(<8 x i32> %ptrs,
 
 define <8 x float> @__gather64_float(<8 x i64> %ptrs, 
                                      <8 x i32> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(float, i64, null, 1, %ptrs, %vecmask)
   %mask = bitcast <8 x i32> %vecmask to <8 x float>
   extract_4s(i64, ptrs)
   extract_4s(float, mask)
@@ -259,6 +269,7 @@ declare <4 x i64> @llvm.x86.avx2.gather.q.q.256(<4 x i64> %target, i8 * %ptr,
 define <8 x i64> @__gather_base_offsets32_i64(i8 * %ptr,
                              i32 %scale, <8 x i32> %offsets,
                              <8 x i32> %mask32) nounwind readonly alwaysinline {
+  sparse_gather(i64, i32, %ptr, %scale, %offsets, %mask32)
   %scale8 = trunc i32 %scale to i8
   %vecmask = sext <8 x i32> %mask32 to <8 x i64>
   extract_4s(i32, offsets)
@@ -278,6 +289,7 @@ define <8 x i64> @__gather_base_offsets32_i64(i8 * %ptr,
 define <8 x i64> @__gather_base_offsets64_i64(i8 * %ptr,
                              i32 %scale, <8 x i64> %offsets,
                              <8 x i32> %mask32) nounwind readonly alwaysinline {
+  sparse_gather(i64, i64, %ptr, %scale, %offsets, %mask32)
   %scale8 = trunc i32 %scale to i8
   %vecmask = sext <8 x i32> %mask32 to <8 x i64>
   extract_4s(i64, offsets)
@@ -296,6 +308,7 @@ define <8 x i64> @__gather_base_offsets64_i64(i8 * %ptr,
 
 define <8 x i64> @__gather32_i64(<8 x i32> %ptrs, 
                                  <8 x i32> %mask32) nounwind readonly alwaysinline {
+  sparse_gather(i64, i32, null, 1, %ptrs, %mask32)
   %vecmask = sext <8 x i32> %mask32 to <8 x i64>
 
   extract_4s(i32, ptrs)
@@ -313,6 +326,7 @@ define <8 x i64> @__gather32_i64(<8 x i32> %ptrs,
 
 define <8 x i64> @__gather64_i64(<8 x i64> %ptrs, 
                                  <8 x i32> %mask32) nounwind readonly alwaysinline {
+  sparse_gather(i64, i64, null, 1, %ptrs, %mask32)
   %vecmask = sext <8 x i32> %mask32 to <8 x i64>
   extract_4s(i64, ptrs)
   extract_4s(i64, vecmask)
@@ -338,6 +352,7 @@ declare <4 x double> @llvm.x86.avx2.gather.d.pd.256(<4 x double> %target, i8 * %
 define <8 x double> @__gather_base_offsets32_double(i8 * %ptr,
                              i32 %scale, <8 x i32> %offsets,
                              <8 x i32> %mask32) nounwind readonly alwaysinline {
+  sparse_gather(double, i32, %ptr, %scale, %offsets, %mask32)
   %scale8 = trunc i32 %scale to i8
   %vecmask64 = sext <8 x i32> %mask32 to <8 x i64>
   %vecmask = bitcast <8 x i64> %vecmask64 to <8 x double>
@@ -357,6 +372,7 @@ define <8 x double> @__gather_base_offsets32_double(i8 * %ptr,
 define <8 x double> @__gather_base_offsets64_double(i8 * %ptr,
                              i32 %scale, <8 x i64> %offsets,
                              <8 x i32> %mask32) nounwind readonly alwaysinline {
+  sparse_gather(double, i64, %ptr, %scale, %offsets, %mask32)
   %scale8 = trunc i32 %scale to i8
   %vecmask64 = sext <8 x i32> %mask32 to <8 x i64>
   %vecmask = bitcast <8 x i64> %vecmask64 to <8 x double>
@@ -375,6 +391,7 @@ define <8 x double> @__gather_base_offsets64_double(i8 * %ptr,
 
 define <8 x double> @__gather32_double(<8 x i32> %ptrs, 
                                        <8 x i32> %mask32) nounwind readonly alwaysinline {
+  sparse_gather(double, i32, null, 1, %ptrs, %mask32)
   %vecmask64 = sext <8 x i32> %mask32 to <8 x i64>
   %vecmask = bitcast <8 x i64> %vecmask64 to <8 x double>
   extract_4s(i32, ptrs)
@@ -392,6 +409,7 @@ define <8 x double> @__gather32_double(<8 x i32> %ptrs,
 
 define <8 x double> @__gather64_double(<8 x i64> %ptrs, 
                                        <8 x i32> %mask32) nounwind readonly alwaysinline {
+  sparse_gather(double, i64, null, 1, %ptrs, %mask32)
   %vecmask64 = sext <8 x i32> %mask32 to <8 x i64>
   %vecmask = bitcast <8 x i64> %vecmask64 to <8 x double>
   extract_4s(i64, ptrs)
@@ -32,6 +32,9 @@
 define(`MASK',`i8')
 define(`HAVE_GATHER',`1')
 define(`HAVE_SCATTER',`1')
+define(`HAVE_CONFLICT',`1')
+define(`HAVE_CONFLICT_I64',`1')
+define(`HAVE_BMI2',`1')
 
 include(`util.m4')
 
@@ -70,6 +73,25 @@ define i8 @__extract_mask_low (<WIDTH x MASK> %mask) alwaysinline {
   ret i8 %mask_low
 }
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; conflict detection
+
+declare <16 x i32> @llvm.x86.avx512.mask.conflict.d.512(<16 x i32>, <16 x i32>, i16) nounwind readnone
+
+define <16 x i32> @__conflict_i32(<16 x i32> %v, <WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %c = call <16 x i32> @llvm.x86.avx512.mask.conflict.d.512(<16 x i32> %v,
+                            <16 x i32> zeroinitializer, i16 -1)
+  ; drop the bits of inactive lanes
+  %m = call i16 @__cast_mask_to_i16(<WIDTH x MASK> %mask)
+  %m32 = zext i16 %m to i32
+  %mi = insertelement <16 x i32> undef, i32 %m32, i32 0
+  %mb = shufflevector <16 x i32> %mi, <16 x i32> undef, <16 x i32> zeroinitializer
+  %r = and <16 x i32> %c, %mb
+  ret <16 x i32> %r
+}
+
+conflict_detect_i64_avx512(@llvm.x86.avx512.mask.conflict.q.512, 8)
+
 define i8 @__extract_mask_hi (<WIDTH x MASK> %mask) alwaysinline {
   %mask_i16 = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %mask)
   %mask_shifted = lshr i16 %mask_i16, 8
@@ -83,29 +105,20 @@ define i8 @__extract_mask_hi (<WIDTH x MASK> %mask) alwaysinline {
 declare <8 x float> @llvm.x86.vcvtph2ps.256(<8 x i16>) nounwind readnone
 declare <8 x i16> @llvm.x86.vcvtps2ph.256(<8 x float>, i32) nounwind readnone
 
+declare <16 x float> @llvm.x86.avx512.mask.vcvtph2ps.512(<16 x i16>, <16 x float>, i16, i32) nounwind readnone
+declare <16 x i16> @llvm.x86.avx512.mask.vcvtps2ph.512(<16 x float>, i32, <16 x i16>, i16) nounwind readnone
+
 define <16 x float> @__half_to_float_varying(<16 x i16> %v) nounwind readnone {
-  %r_0 = shufflevector <16 x i16> %v, <16 x i16> undef,
-             <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
-  %vr_0 = call <8 x float> @llvm.x86.vcvtph2ps.256(<8 x i16> %r_0)
-  %r_1 = shufflevector <16 x i16> %v, <16 x i16> undef,
-             <8 x i32> <i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
-  %vr_1 = call <8 x float> @llvm.x86.vcvtph2ps.256(<8 x i16> %r_1)
-  %r = shufflevector <8 x float> %vr_0, <8 x float> %vr_1,
-           <16 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7,
-                       i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  ; a single 512-bit vcvtph2ps; rounding argument 4 = current direction
+  %r = call <16 x float> @llvm.x86.avx512.mask.vcvtph2ps.512(<16 x i16> %v,
+                            <16 x float> undef, i16 -1, i32 4)
   ret <16 x float> %r
 }
 
 define <16 x i16> @__float_to_half_varying(<16 x float> %v) nounwind readnone {
-  %r_0 = shufflevector <16 x float> %v, <16 x float> undef,
-             <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
-  %vr_0 = call <8 x i16> @llvm.x86.vcvtps2ph.256(<8 x float> %r_0, i32 0)
-  %r_1 = shufflevector <16 x float> %v, <16 x float> undef,
-             <8 x i32> <i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
-  %vr_1 = call <8 x i16> @llvm.x86.vcvtps2ph.256(<8 x float> %r_1, i32 0)
-  %r = shufflevector <8 x i16> %vr_0, <8 x i16> %vr_1,
-           <16 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7,
-                       i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  ; round to nearest even
+  %r = call <16 x i16> @llvm.x86.avx512.mask.vcvtps2ph.512(<16 x float> %v, i32 0,
+                            <16 x i16> undef, i16 -1)
   ret <16 x i16> %r
 }
 
@@ -1004,6 +1017,7 @@ gen_gather(i16)
 declare <16 x i32> @llvm.x86.avx512.gather.dpi.512(<16 x i32>, i8*, <16 x i32>, i16, i32)
 define <16 x i32> 
 @__gather_base_offsets32_i32(i8 * %ptr, i32 %offset_scale, <16 x i32> %offsets, <WIDTH x MASK> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(i32, i32, %ptr, %offset_scale, %offsets, %vecmask)
   %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %vecmask)
   %res =  call <16 x i32> @llvm.x86.avx512.gather.dpi.512 (<16 x i32> undef, i8* %ptr, <16 x i32> %offsets, i16 %mask, i32 %offset_scale)
   ret <16 x i32> %res
@@ -1012,6 +1026,7 @@ define <16 x i32>
 declare <8 x i32> @llvm.x86.avx512.gather.qpi.512 (<8 x i32>, i8*, <8 x i64>, i8, i32)
 define <16 x i32> 
 @__gather_base_offsets64_i32(i8 * %ptr, i32 %offset_scale, <16 x i64> %offsets, <WIDTH x MASK> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(i32, i64, %ptr, %offset_scale, %offsets, %vecmask)
   %scalarMask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %vecmask) 
   %scalarMask1 = trunc i16 %scalarMask to i8 
   %scalarMask2Tmp = lshr i16 %scalarMask, 8
@@ -1043,6 +1058,7 @@ gen_gather(i64)
 declare <16 x float> @llvm.x86.avx512.gather.dps.512 (<16 x float>, i8*, <16 x i32>, i16, i32)
 define <16 x float>
 @__gather_base_offsets32_float(i8 * %ptr, i32 %offset_scale, <16 x i32> %offsets, <WIDTH x MASK> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(float, i32, %ptr, %offset_scale, %offsets, %vecmask)
   %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %vecmask)
   %res = call <16 x float> @llvm.x86.avx512.gather.dps.512 (<16 x float> undef, i8* %ptr, <16 x i32>%offsets, i16 %mask, i32 %offset_scale)
   ret <16 x float> %res
@@ -1051,6 +1067,7 @@ define <16 x float>
 declare <8 x float> @llvm.x86.avx512.gather.qps.512 (<8 x float>, i8*, <8 x i64>, i8, i32)
 define <16 x float>
 @__gather_base_offsets64_float(i8 * %ptr, i32 %offset_scale, <16 x i64> %offsets, <WIDTH x MASK> %vecmask) nounwind readonly alwaysinline {
+  sparse_gather(float, i64, %ptr, %offset_scale, %offsets, %vecmask)
   %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %vecmask)
   %mask_shifted = lshr i16 %mask, 8
   %mask_lo = trunc i16 %mask to i8 
@@ -1107,6 +1124,7 @@ gen_scatter(i16)
 declare void @llvm.x86.avx512.scatter.dpi.512 (i8*, i16, <16 x i32>, <16 x i32>, i32)
 define void 
 @__scatter_base_offsets32_i32(i8* %ptr, i32 %offset_scale, <16 x i32> %offsets, <16 x i32> %vals, <WIDTH x MASK> %vecmask) nounwind {
+  sparse_scatter(i32, i32, %ptr, %offset_scale, %offsets, %vals, %vecmask)
   %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %vecmask)
   call void @llvm.x86.avx512.scatter.dpi.512 (i8* %ptr, i16 %mask, <16 x i32> %offsets, <16 x i32> %vals, i32 %offset_scale)
   ret void
@@ -1115,6 +1133,7 @@ define void
 declare void @llvm.x86.avx512.scatter.qpi.512 (i8*, i8, <8 x i64>, <8 x i32>, i32)
 define void 
 @__scatter_base_offsets64_i32(i8* %ptr, i32 %offset_scale, <16 x i64> %offsets, <16 x i32> %vals, <WIDTH x MASK> %vecmask) nounwind {
+  sparse_scatter(i32, i64, %ptr, %offset_scale, %offsets, %vals, %vecmask)
   %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %vecmask)
   %mask_shifted = lshr i16 %mask, 8
   %mask_lo = trunc i16 %mask to i8 
@@ -1148,6 +1167,7 @@ gen_scatter(i64)
 declare void @llvm.x86.avx512.scatter.dps.512 (i8*, i16, <16 x i32>, <16 x float>, i32)
 define void 
 @__scatter_base_offsets32_float(i8* %ptr, i32 %offset_scale, <16 x i32> %offsets, <16 x float> %vals, <WIDTH x MASK> %vecmask) nounwind {
+  sparse_scatter(float, i32, %ptr, %offset_scale, %offsets, %vals, %vecmask)
   %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %vecmask)
   call void @llvm.x86.avx512.scatter.dps.512 (i8* %ptr, i16 %mask, <16 x i32> %offsets, <16 x float> %vals, i32 %offset_scale)
   ret void
@@ -1156,6 +1176,7 @@ define void
 declare void @llvm.x86.avx512.scatter.qps.512 (i8*, i8, <8 x i64>, <8 x float>, i32)
 define void 
 @__scatter_base_offsets64_float(i8* %ptr, i32 %offset_scale, <16 x i64> %offsets, <16 x float> %vals, <WIDTH x MASK> %vecmask) nounwind {
+  sparse_scatter(float, i64, %ptr, %offset_scale, %offsets, %vals, %vecmask)
   %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %vecmask)
   %mask_shifted = lshr i16 %mask, 8
   %mask_lo = trunc i16 %mask to i8 
@@ -1221,6 +1242,62 @@ define i32 @__packed_store_active2(i32 * %startptr, <16 x i32> %vals,
   ret i32 %res
 }
 
+;; 64-bit elements: the two halves of the vector are expanded or compressed
+;; separately, with the upper half starting after the elements for the
+;; lower one.
+
+declare <8 x i64> @llvm.x86.avx512.mask.expand.load.q.512(i8* %addr, <8 x i64> %data, i8 %mask)
+declare void @llvm.x86.avx512.mask.compress.store.q.512(i8* %addr, <8 x i64> %data, i8 %mask)
+
+define i32 @__packed_load_active_i64(i64 * %startptr, <16 x i64> * %val_ptr,
+                                     <WIDTH x MASK> %full_mask) nounwind alwaysinline {
+  %data = load PTR_OP_ARGS(`<16 x i64> ') %val_ptr
+  %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %full_mask)
+  %mask_lo = trunc i16 %mask to i8
+  %mask_hi_shift = lshr i16 %mask, 8
+  %mask_hi = trunc i16 %mask_hi_shift to i8
+  %data_lo = shufflevector <16 x i64> %data, <16 x i64> undef,
+      <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  %data_hi = shufflevector <16 x i64> %data, <16 x i64> undef,
+      <8 x i32> <i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  %addr_lo = bitcast i64* %startptr to i8*
+  %val_lo = call <8 x i64> @llvm.x86.avx512.mask.expand.load.q.512(i8* %addr_lo, <8 x i64> %data_lo, i8 %mask_lo)
+  %mask_lo_i32 = zext i8 %mask_lo to i32
+  %count_lo = call i32 @llvm.ctpop.i32(i32 %mask_lo_i32)
+  %ptr_hi = getelementptr PTR_OP_ARGS(`i64') %startptr, i32 %count_lo
+  %addr_hi = bitcast i64* %ptr_hi to i8*
+  %val_hi = call <8 x i64> @llvm.x86.avx512.mask.expand.load.q.512(i8* %addr_hi, <8 x i64> %data_hi, i8 %mask_hi)
+  %val = shufflevector <8 x i64> %val_lo, <8 x i64> %val_hi,
+      <16 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7,
+                  i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  store <16 x i64> %val, <16 x i64> * %val_ptr
+  %mask_i32 = zext i16 %mask to i32
+  %res = call i32 @llvm.ctpop.i32(i32 %mask_i32)
+  ret i32 %res
+}
+
+define i32 @__packed_store_active_i64(i64 * %startptr, <16 x i64> %vals,
+                                      <WIDTH x MASK> %full_mask) nounwind alwaysinline {
+  %mask = call i16 @__cast_mask_to_i16 (<WIDTH x MASK> %full_mask)
+  %mask_lo = trunc i16 %mask to i8
+  %mask_hi_shift = lshr i16 %mask, 8
+  %mask_hi = trunc i16 %mask_hi_shift to i8
+  %vals_lo = shufflevector <16 x i64> %vals, <16 x i64> undef,
+      <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  %vals_hi = shufflevector <16 x i64> %vals, <16 x i64> undef,
+      <8 x i32> <i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  %addr_lo = bitcast i64* %startptr to i8*
+  call void @llvm.x86.avx512.mask.compress.store.q.512(i8* %addr_lo, <8 x i64> %vals_lo, i8 %mask_lo)
+  %mask_lo_i32 = zext i8 %mask_lo to i32
+  %count_lo = call i32 @llvm.ctpop.i32(i32 %mask_lo_i32)
+  %ptr_hi = getelementptr PTR_OP_ARGS(`i64') %startptr, i32 %count_lo
+  %addr_hi = bitcast i64* %ptr_hi to i8*
+  call void @llvm.x86.avx512.mask.compress.store.q.512(i8* %addr_hi, <8 x i64> %vals_hi, i8 %mask_hi)
+  %mask_i32 = zext i16 %mask to i32
+  %res = call i32 @llvm.ctpop.i32(i32 %mask_i32)
+  ret i32 %res
+}
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; prefetch
 
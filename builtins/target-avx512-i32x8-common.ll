@@ -0,0 +1,1078 @@
+;;  Copyright (c) 2016, Intel Corporation
+;;  All rights reserved.
+;;
+;;  Redistribution and use in source and binary forms, with or without
+;;  modification, are permitted provided that the following conditions are
+;;  met:
+;;
+;;    * Redistributions of source code must retain the above copyright
+;;      notice, this list of conditions and the following disclaimer.
+;;
+;;    * Redistributions in binary form must reproduce the above copyright
+;;      notice, this list of conditions and the following disclaimer in the
+;;      documentation and/or other materials provided with the distribution.
+;;
+;;    * Neither the name of Intel Corporation nor the names of its
+;;      contributors may be used to endorse or promote products derived from
+;;      this software without specific prior written permission.
+;;
+;;
+;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+;;   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+;;   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+;;   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+;;   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+;;   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+;;   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+;; 8-wide AVX-512 target for SKX: the gang fits in a single 256-bit ymm
+;; register, but the AVX-512VL forms of the instructions still give us
+;; k-register masks, native scatters, compress/expand and conflict
+;; detection.  Keeping the vectors at 256 bits avoids the frequency drop
+;; that comes with heavy use of the 512-bit units.
+
+define(`MASK',`i8')
+define(`HAVE_GATHER',`1')
+define(`HAVE_SCATTER',`1')
+define(`HAVE_CONFLICT',`1')
+define(`HAVE_CONFLICT_I64',`1')
+define(`HAVE_BMI2',`1')
+
+include(`util.m4')
+
+stdlib_core()
+scans()
+reduce_equal(WIDTH)
+saturation_arithmetic()
+rdrand_definition()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; broadcast/rotate/shuffle
+
+define_shuffles()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; aos/soa
+
+aossoa()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Stub for mask conversion. LLVM's intrinsics want i1 mask, but we use i8
+
+define <WIDTH x i1> @__cast_mask_to_i1 (<WIDTH x MASK> %mask) alwaysinline {
+  %mask_vec_i1 = icmp ne <WIDTH x MASK> %mask, const_vector(MASK, 0)
+  ret <WIDTH x i1> %mask_vec_i1
+}
+
+define i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask) alwaysinline {
+  %mask_i1 = call <WIDTH x i1> @__cast_mask_to_i1 (<WIDTH x MASK> %mask)
+  %mask_i8 = bitcast <WIDTH x i1> %mask_i1 to i8
+  ret i8 %mask_i8
+}
+
+define i8 @__extract_mask_low (<WIDTH x MASK> %mask) alwaysinline {
+  %mask_i8 = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %mask_low = and i8 %mask_i8, 15
+  ret i8 %mask_low
+}
+
+define i8 @__extract_mask_hi (<WIDTH x MASK> %mask) alwaysinline {
+  %mask_i8 = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %mask_hi = lshr i8 %mask_i8, 4
+  ret i8 %mask_hi
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; conflict detection
+
+declare <8 x i32> @llvm.x86.avx512.mask.conflict.d.256(<8 x i32>, <8 x i32>, i8) nounwind readnone
+
+define <8 x i32> @__conflict_i32(<8 x i32> %v, <WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %c = call <8 x i32> @llvm.x86.avx512.mask.conflict.d.256(<8 x i32> %v,
+                            <8 x i32> zeroinitializer, i8 -1)
+  ; drop the bits of inactive lanes
+  %m = call i8 @__cast_mask_to_i8(<WIDTH x MASK> %mask)
+  %m32 = zext i8 %m to i32
+  %mi = insertelement <8 x i32> undef, i32 %m32, i32 0
+  %mb = shufflevector <8 x i32> %mi, <8 x i32> undef, <8 x i32> zeroinitializer
+  %r = and <8 x i32> %c, %mb
+  ret <8 x i32> %r
+}
+
+conflict_detect_i64_avx512(@llvm.x86.avx512.mask.conflict.q.256, 4)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; half conversion routines
+
+declare <8 x float> @llvm.x86.vcvtph2ps.256(<8 x i16>) nounwind readnone
+declare <8 x i16> @llvm.x86.vcvtps2ph.256(<8 x float>, i32) nounwind readnone
+
+define <8 x float> @__half_to_float_varying(<8 x i16> %v) nounwind readnone {
+  %r = call <8 x float> @llvm.x86.vcvtph2ps.256(<8 x i16> %v)
+  ret <8 x float> %r
+}
+
+define <8 x i16> @__float_to_half_varying(<8 x float> %v) nounwind readnone {
+  ; round to nearest even
+  %r = call <8 x i16> @llvm.x86.vcvtps2ph.256(<8 x float> %v, i32 0)
+  ret <8 x i16> %r
+}
+
+define float @__half_to_float_uniform(i16 %v) nounwind readnone {
+  %v1 = bitcast i16 %v to <1 x i16>
+  %vv = shufflevector <1 x i16> %v1, <1 x i16> undef,
+           <8 x i32> <i32 0, i32 undef, i32 undef, i32 undef,
+                      i32 undef, i32 undef, i32 undef, i32 undef>
+  %rv = call <8 x float> @llvm.x86.vcvtph2ps.256(<8 x i16> %vv)
+  %r = extractelement <8 x float> %rv, i32 0
+  ret float %r
+}
+
+define i16 @__float_to_half_uniform(float %v) nounwind readnone {
+  %v1 = bitcast float %v to <1 x float>
+  %vv = shufflevector <1 x float> %v1, <1 x float> undef,
+           <8 x i32> <i32 0, i32 undef, i32 undef, i32 undef,
+                      i32 undef, i32 undef, i32 undef, i32 undef>
+  ; round to nearest even
+  %rv = call <8 x i16> @llvm.x86.vcvtps2ph.256(<8 x float> %vv, i32 0)
+  %r = extractelement <8 x i16> %rv, i32 0
+  ret i16 %r
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; fast math mode
+
+declare void @llvm.x86.sse.stmxcsr(i8 *) nounwind
+declare void @llvm.x86.sse.ldmxcsr(i8 *) nounwind
+
+define void @__fastmath() nounwind alwaysinline {
+  %ptr = alloca i32
+  %ptr8 = bitcast i32 * %ptr to i8 *
+  call void @llvm.x86.sse.stmxcsr(i8 * %ptr8)
+  %oldval = load PTR_OP_ARGS(`i32 ') %ptr
+
+  ; turn on DAZ (64)/FTZ (32768) -> 32832
+  %update = or i32 %oldval, 32832
+  store i32 %update, i32 *%ptr
+  call void @llvm.x86.sse.ldmxcsr(i8 * %ptr8)
+  ret void
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; round/floor/ceil
+
+declare <4 x float> @llvm.x86.sse41.round.ss(<4 x float>, <4 x float>, i32) nounwind readnone
+
+define float @__round_uniform_float(float) nounwind readonly alwaysinline {
+  ; roundss, round mode nearest 0b00 | don't signal precision exceptions 0b1000 = 8
+  ; see target-avx512-common.ll for a discussion of the roundss intrinsic
+  %xi = insertelement <4 x float> undef, float %0, i32 0
+  %xr = call <4 x float> @llvm.x86.sse41.round.ss(<4 x float> %xi, <4 x float> %xi, i32 8)
+  %rs = extractelement <4 x float> %xr, i32 0
+  ret float %rs
+}
+
+define float @__floor_uniform_float(float) nounwind readonly alwaysinline {
+  %xi = insertelement <4 x float> undef, float %0, i32 0
+  ; roundps, round down 0b01 | don't signal precision exceptions 0b1001 = 9
+  %xr = call <4 x float> @llvm.x86.sse41.round.ss(<4 x float> %xi, <4 x float> %xi, i32 9)
+  %rs = extractelement <4 x float> %xr, i32 0
+  ret float %rs
+}
+
+define float @__ceil_uniform_float(float) nounwind readonly alwaysinline {
+  %xi = insertelement <4 x float> undef, float %0, i32 0
+  ; roundps, round up 0b10 | don't signal precision exceptions 0b1010 = 10
+  %xr = call <4 x float> @llvm.x86.sse41.round.ss(<4 x float> %xi, <4 x float> %xi, i32 10)
+  %rs = extractelement <4 x float> %xr, i32 0
+  ret float %rs
+}
+
+declare <2 x double> @llvm.x86.sse41.round.sd(<2 x double>, <2 x double>, i32) nounwind readnone
+
+define double @__round_uniform_double(double) nounwind readonly alwaysinline {
+  %xi = insertelement <2 x double> undef, double %0, i32 0
+  %xr = call <2 x double> @llvm.x86.sse41.round.sd(<2 x double> %xi, <2 x double> %xi, i32 8)
+  %rs = extractelement <2 x double> %xr, i32 0
+  ret double %rs
+}
+
+define double @__floor_uniform_double(double) nounwind readonly alwaysinline {
+  %xi = insertelement <2 x double> undef, double %0, i32 0
+  ; roundsd, round down 0b01 | don't signal precision exceptions 0b1001 = 9
+  %xr = call <2 x double> @llvm.x86.sse41.round.sd(<2 x double> %xi, <2 x double> %xi, i32 9)
+  %rs = extractelement <2 x double> %xr, i32 0
+  ret double %rs
+}
+
+define double @__ceil_uniform_double(double) nounwind readonly alwaysinline {
+  %xi = insertelement <2 x double> undef, double %0, i32 0
+  ; roundsd, round up 0b10 | don't signal precision exceptions 0b1010 = 10
+  %xr = call <2 x double> @llvm.x86.sse41.round.sd(<2 x double> %xi, <2 x double> %xi, i32 10)
+  %rs = extractelement <2 x double> %xr, i32 0
+  ret double %rs
+}
+
+declare <8 x float> @llvm.nearbyint.v8f32(<8 x float> %p)
+declare <8 x float> @llvm.floor.v8f32(<8 x float> %p)
+declare <8 x float> @llvm.ceil.v8f32(<8 x float> %p)
+
+define <8 x float> @__round_varying_float(<8 x float>) nounwind readonly alwaysinline {
+  %res = call <8 x float> @llvm.nearbyint.v8f32(<8 x float> %0)
+  ret <8 x float> %res
+}
+
+define <8 x float> @__floor_varying_float(<8 x float>) nounwind readonly alwaysinline {
+  %res = call <8 x float> @llvm.floor.v8f32(<8 x float> %0)
+  ret <8 x float> %res
+}
+
+define <8 x float> @__ceil_varying_float(<8 x float>) nounwind readonly alwaysinline {
+  %res = call <8 x float> @llvm.ceil.v8f32(<8 x float> %0)
+  ret <8 x float> %res
+}
+
+declare <8 x double> @llvm.nearbyint.v8f64(<8 x double> %p)
+declare <8 x double> @llvm.floor.v8f64(<8 x double> %p)
+declare <8 x double> @llvm.ceil.v8f64(<8 x double> %p)
+
+;; the legalizer splits these into two 256-bit operations
+define <8 x double> @__round_varying_double(<8 x double>) nounwind readonly alwaysinline {
+  %res = call <8 x double> @llvm.nearbyint.v8f64(<8 x double> %0)
+  ret <8 x double> %res
+}
+
+define <8 x double> @__floor_varying_double(<8 x double>) nounwind readonly alwaysinline {
+  %res = call <8 x double> @llvm.floor.v8f64(<8 x double> %0)
+  ret <8 x double> %res
+}
+
+define <8 x double> @__ceil_varying_double(<8 x double>) nounwind readonly alwaysinline {
+  %res = call <8 x double> @llvm.ceil.v8f64(<8 x double> %0)
+  ret <8 x double> %res
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; min/max
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; int64/uint64 min/max
+define i64 @__max_uniform_int64(i64, i64) nounwind readonly alwaysinline {
+  %c = icmp sgt i64 %0, %1
+  %r = select i1 %c, i64 %0, i64 %1
+  ret i64 %r
+}
+
+define i64 @__max_uniform_uint64(i64, i64) nounwind readonly alwaysinline {
+  %c = icmp ugt i64 %0, %1
+  %r = select i1 %c, i64 %0, i64 %1
+  ret i64 %r
+}
+
+define i64 @__min_uniform_int64(i64, i64) nounwind readonly alwaysinline {
+  %c = icmp slt i64 %0, %1
+  %r = select i1 %c, i64 %0, i64 %1
+  ret i64 %r
+}
+
+define i64 @__min_uniform_uint64(i64, i64) nounwind readonly alwaysinline {
+  %c = icmp ult i64 %0, %1
+  %r = select i1 %c, i64 %0, i64 %1
+  ret i64 %r
+}
+
+declare <4 x i64> @llvm.x86.avx512.mask.pmaxs.q.256(<4 x i64>, <4 x i64>, <4 x i64>, i8)
+declare <4 x i64> @llvm.x86.avx512.mask.pmaxu.q.256(<4 x i64>, <4 x i64>, <4 x i64>, i8)
+declare <4 x i64> @llvm.x86.avx512.mask.pmins.q.256(<4 x i64>, <4 x i64>, <4 x i64>, i8)
+declare <4 x i64> @llvm.x86.avx512.mask.pminu.q.256(<4 x i64>, <4 x i64>, <4 x i64>, i8)
+
+define(`minmax_int64_vl', `
+define <8 x i64> @__$1_varying_$2(<8 x i64>, <8 x i64>) nounwind readonly alwaysinline {
+  %v0_lo = shufflevector <8 x i64> %0, <8 x i64> undef, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %v0_hi = shufflevector <8 x i64> %0, <8 x i64> undef, <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+  %v1_lo = shufflevector <8 x i64> %1, <8 x i64> undef, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %v1_hi = shufflevector <8 x i64> %1, <8 x i64> undef, <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+  %r0 = call <4 x i64> @llvm.x86.avx512.mask.$3.q.256(<4 x i64> %v0_lo, <4 x i64> %v1_lo, <4 x i64> zeroinitializer, i8 -1)
+  %r1 = call <4 x i64> @llvm.x86.avx512.mask.$3.q.256(<4 x i64> %v0_hi, <4 x i64> %v1_hi, <4 x i64> zeroinitializer, i8 -1)
+  %res = shufflevector <4 x i64> %r0, <4 x i64> %r1,
+                       <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  ret <8 x i64> %res
+}
+')
+
+minmax_int64_vl(max, int64, pmaxs)
+minmax_int64_vl(max, uint64, pmaxu)
+minmax_int64_vl(min, int64, pmins)
+minmax_int64_vl(min, uint64, pminu)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; float min/max
+
+define float @__max_uniform_float(float, float) nounwind readonly alwaysinline {
+  %cmp = fcmp ogt float %1, %0
+  %ret = select i1 %cmp, float %1, float %0
+  ret float %ret
+}
+
+define float @__min_uniform_float(float, float) nounwind readonly alwaysinline {
+  %cmp = fcmp ogt float %1, %0
+  %ret = select i1 %cmp, float %0, float %1
+  ret float %ret
+}
+
+declare <8 x float> @llvm.x86.avx.max.ps.256(<8 x float>, <8 x float>) nounwind readnone
+declare <8 x float> @llvm.x86.avx.min.ps.256(<8 x float>, <8 x float>) nounwind readnone
+
+define <8 x float> @__max_varying_float(<8 x float>, <8 x float>) nounwind readonly alwaysinline {
+  %res = call <8 x float> @llvm.x86.avx.max.ps.256(<8 x float> %0, <8 x float> %1)
+  ret <8 x float> %res
+}
+
+define <8 x float> @__min_varying_float(<8 x float>, <8 x float>) nounwind readonly alwaysinline {
+  %res = call <8 x float> @llvm.x86.avx.min.ps.256(<8 x float> %0, <8 x float> %1)
+  ret <8 x float> %res
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; int min/max
+
+define i32 @__min_uniform_int32(i32, i32) nounwind readonly alwaysinline {
+  %cmp = icmp sgt i32 %1, %0
+  %ret = select i1 %cmp, i32 %0, i32 %1
+  ret i32 %ret
+}
+
+define i32 @__max_uniform_int32(i32, i32) nounwind readonly alwaysinline {
+  %cmp = icmp sgt i32 %1, %0
+  %ret = select i1 %cmp, i32 %1, i32 %0
+  ret i32 %ret
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unsigned int min/max
+
+define i32 @__min_uniform_uint32(i32, i32) nounwind readonly alwaysinline {
+  %cmp = icmp ugt i32 %1, %0
+  %ret = select i1 %cmp, i32 %0, i32 %1
+  ret i32 %ret
+}
+
+define i32 @__max_uniform_uint32(i32, i32) nounwind readonly alwaysinline {
+  %cmp = icmp ugt i32 %1, %0
+  %ret = select i1 %cmp, i32 %1, i32 %0
+  ret i32 %ret
+}
+
+declare <8 x i32> @llvm.x86.avx2.pmins.d(<8 x i32>, <8 x i32>) nounwind readonly
+declare <8 x i32> @llvm.x86.avx2.pmaxs.d(<8 x i32>, <8 x i32>) nounwind readonly
+declare <8 x i32> @llvm.x86.avx2.pminu.d(<8 x i32>, <8 x i32>) nounwind readonly
+declare <8 x i32> @llvm.x86.avx2.pmaxu.d(<8 x i32>, <8 x i32>) nounwind readonly
+
+define <8 x i32> @__min_varying_int32(<8 x i32>, <8 x i32>) nounwind readonly alwaysinline {
+  %ret = call <8 x i32> @llvm.x86.avx2.pmins.d(<8 x i32> %0, <8 x i32> %1)
+  ret <8 x i32> %ret
+}
+
+define <8 x i32> @__max_varying_int32(<8 x i32>, <8 x i32>) nounwind readonly alwaysinline {
+  %ret = call <8 x i32> @llvm.x86.avx2.pmaxs.d(<8 x i32> %0, <8 x i32> %1)
+  ret <8 x i32> %ret
+}
+
+define <8 x i32> @__min_varying_uint32(<8 x i32>, <8 x i32>) nounwind readonly alwaysinline {
+  %ret = call <8 x i32> @llvm.x86.avx2.pminu.d(<8 x i32> %0, <8 x i32> %1)
+  ret <8 x i32> %ret
+}
+
+define <8 x i32> @__max_varying_uint32(<8 x i32>, <8 x i32>) nounwind readonly alwaysinline {
+  %ret = call <8 x i32> @llvm.x86.avx2.pmaxu.d(<8 x i32> %0, <8 x i32> %1)
+  ret <8 x i32> %ret
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; double precision min/max
+
+define double @__min_uniform_double(double, double) nounwind readnone alwaysinline {
+  %cmp = fcmp ogt double %1, %0
+  %ret = select i1 %cmp, double %0, double %1
+  ret double %ret
+}
+
+define double @__max_uniform_double(double, double) nounwind readnone alwaysinline {
+  %cmp = fcmp ogt double %1, %0
+  %ret = select i1 %cmp, double %1, double %0
+  ret double %ret
+}
+
+declare <4 x double> @llvm.x86.avx.min.pd.256(<4 x double>, <4 x double>) nounwind readnone
+declare <4 x double> @llvm.x86.avx.max.pd.256(<4 x double>, <4 x double>) nounwind readnone
+
+define <8 x double> @__min_varying_double(<8 x double>, <8 x double>) nounwind readnone alwaysinline {
+  binary4to8(ret, double, @llvm.x86.avx.min.pd.256, %0, %1)
+  ret <8 x double> %ret
+}
+
+define <8 x double> @__max_varying_double(<8 x double>, <8 x double>) nounwind readnone alwaysinline {
+  binary4to8(ret, double, @llvm.x86.avx.max.pd.256, %0, %1)
+  ret <8 x double> %ret
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; rsqrt
+
+declare <4 x float> @llvm.x86.sse.rsqrt.ss(<4 x float>) nounwind readnone
+
+define float @__rsqrt_uniform_float(float) nounwind readonly alwaysinline {
+  ;  uniform float is = extract(__rsqrt_u(v), 0);
+  %v = insertelement <4 x float> undef, float %0, i32 0
+  %vis = call <4 x float> @llvm.x86.sse.rsqrt.ss(<4 x float> %v)
+  %is = extractelement <4 x float> %vis, i32 0
+
+  ; Newton-Raphson iteration to improve precision
+  ;  return 0.5 * is * (3. - (v * is) * is);
+  %v_is = fmul float %0, %is
+  %v_is_is = fmul float %v_is, %is
+  %three_sub = fsub float 3., %v_is_is
+  %is_mul = fmul float %is, %three_sub
+  %half_scale = fmul float 0.5, %is_mul
+  ret float %half_scale
+}
+
+declare <8 x float> @llvm.x86.avx512.rsqrt14.ps.256(<8 x float>, <8 x float>, i8) nounwind readnone
+
+define <8 x float> @__rsqrt_varying_float(<8 x float> %v) nounwind readonly alwaysinline {
+  %is = call <8 x float> @llvm.x86.avx512.rsqrt14.ps.256(<8 x float> %v, <8 x float> undef, i8 -1)
+  ; Newton-Raphson iteration to improve precision
+  ;  float is = __rsqrt_v(v);
+  ;  return 0.5 * is * (3. - (v * is) * is);
+  %v_is = fmul <8 x float> %v, %is
+  %v_is_is = fmul <8 x float> %v_is, %is
+  %three_sub = fsub <8 x float> <float 3., float 3., float 3., float 3.,
+                                 float 3., float 3., float 3., float 3.>, %v_is_is
+  %is_mul = fmul <8 x float> %is, %three_sub
+  %half_scale = fmul <8 x float> <float 0.5, float 0.5, float 0.5, float 0.5,
+                                  float 0.5, float 0.5, float 0.5, float 0.5>, %is_mul
+  ret <8 x float> %half_scale
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; rcp
+
+declare <4 x float> @llvm.x86.sse.rcp.ss(<4 x float>) nounwind readnone
+
+define float @__rcp_uniform_float(float) nounwind readonly alwaysinline {
+  ; do the rcpss call
+  ;    uniform float iv = extract(__rcp_u(v), 0);
+  ;    return iv * (2. - v * iv);
+  %vecval = insertelement <4 x float> undef, float %0, i32 0
+  %call = call <4 x float> @llvm.x86.sse.rcp.ss(<4 x float> %vecval)
+  %scall = extractelement <4 x float> %call, i32 0
+
+  ; do one N-R iteration to improve precision, as above
+  %v_iv = fmul float %0, %scall
+  %two_minus = fsub float 2., %v_iv
+  %iv_mul = fmul float %scall, %two_minus
+  ret float %iv_mul
+}
+
+declare <8 x float> @llvm.x86.avx512.rcp14.ps.256(<8 x float>, <8 x float>, i8) nounwind readnone
+
+define <8 x float> @__rcp_varying_float(<8 x float>) nounwind readonly alwaysinline {
+  %call = call <8 x float> @llvm.x86.avx512.rcp14.ps.256(<8 x float> %0, <8 x float> undef, i8 -1)
+  ;; do one Newton-Raphson iteration to improve precision
+  ;;  float iv = __rcp_v(v);
+  ;;  return iv * (2. - v * iv);
+  %v_iv = fmul <8 x float> %0, %call
+  %two_minus = fsub <8 x float> <float 2., float 2., float 2., float 2.,
+                                 float 2., float 2., float 2., float 2.>, %v_iv
+  %iv_mul = fmul <8 x float> %call, %two_minus
+  ret <8 x float> %iv_mul
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; sqrt
+
+declare <4 x float> @llvm.x86.sse.sqrt.ss(<4 x float>) nounwind readnone
+
+define float @__sqrt_uniform_float(float) nounwind readonly alwaysinline {
+  sse_unary_scalar(ret, 4, float, @llvm.x86.sse.sqrt.ss, %0)
+  ret float %ret
+}
+
+declare <8 x float> @llvm.x86.avx.sqrt.ps.256(<8 x float>) nounwind readnone
+
+define <8 x float> @__sqrt_varying_float(<8 x float>) nounwind readonly alwaysinline {
+  %res = call <8 x float> @llvm.x86.avx.sqrt.ps.256(<8 x float> %0)
+  ret <8 x float> %res
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; double precision sqrt
+
+declare <2 x double> @llvm.x86.sse2.sqrt.sd(<2 x double>) nounwind readnone
+
+define double @__sqrt_uniform_double(double) nounwind alwaysinline {
+  sse_unary_scalar(ret, 2, double, @llvm.x86.sse2.sqrt.sd, %0)
+  ret double %ret
+}
+
+declare <4 x double> @llvm.x86.avx.sqrt.pd.256(<4 x double>) nounwind readnone
+
+define <8 x double> @__sqrt_varying_double(<8 x double>) nounwind alwaysinline {
+  unary4to8(ret, double, @llvm.x86.avx.sqrt.pd.256, %0)
+  ret <8 x double> %ret
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; bit ops
+
+declare i32 @llvm.ctpop.i32(i32) nounwind readnone
+
+define i32 @__popcnt_int32(i32) nounwind readonly alwaysinline {
+  %call = call i32 @llvm.ctpop.i32(i32 %0)
+  ret i32 %call
+}
+
+declare i64 @llvm.ctpop.i64(i64) nounwind readnone
+
+define i64 @__popcnt_int64(i64) nounwind readonly alwaysinline {
+  %call = call i64 @llvm.ctpop.i64(i64 %0)
+  ret i64 %call
+}
+ctlztz()
+
+;; svml
+
+include(`svml.m4')
+svml_declare(float,f8,8)
+svml_define(float,f8,8,f)
+
+;; double precision
+svml_declare(double,4,4)
+svml_define_x(double,4,4,d,8)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; reductions
+
+define i64 @__movmsk(<WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %intmask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %res = zext i8 %intmask to i64
+  ret i64 %res
+}
+
+define i1 @__any(<WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %intmask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %res = icmp ne i8 %intmask, 0
+  ret i1 %res
+}
+
+define i1 @__all(<WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %intmask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %res = icmp eq i8 %intmask, -1
+  ret i1 %res
+}
+
+define i1 @__none(<WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %intmask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %res = icmp eq i8 %intmask, 0
+  ret i1 %res
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; horizontal int8/16 ops
+
+declare <2 x i64> @llvm.x86.sse2.psad.bw(<16 x i8>, <16 x i8>) nounwind readnone
+
+define i16 @__reduce_add_int8(<8 x i8>) nounwind readnone alwaysinline {
+  %wide8 = shufflevector <8 x i8> %0, <8 x i8> zeroinitializer,
+      <16 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7,
+                  i32 8, i32 8, i32 8, i32 8, i32 8, i32 8, i32 8, i32 8>
+  %rv = call <2 x i64> @llvm.x86.sse2.psad.bw(<16 x i8> %wide8,
+                                              <16 x i8> zeroinitializer)
+  %r0 = extractelement <2 x i64> %rv, i32 0
+  %r16 = trunc i64 %r0 to i16
+  ret i16 %r16
+}
+
+define internal <8 x i16> @__add_varying_i16(<8 x i16>,
+                                  <8 x i16>) nounwind readnone alwaysinline {
+  %r = add <8 x i16> %0, %1
+  ret <8 x i16> %r
+}
+
+define internal i16 @__add_uniform_i16(i16, i16) nounwind readnone alwaysinline {
+  %r = add i16 %0, %1
+  ret i16 %r
+}
+
+define i16 @__reduce_add_int16(<8 x i16>) nounwind readnone alwaysinline {
+  reduce8(i16, @__add_varying_i16, @__add_uniform_i16)
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; horizontal float ops
+
+declare <8 x float> @llvm.x86.avx.hadd.ps.256(<8 x float>, <8 x float>) nounwind readnone
+
+define float @__reduce_add_float(<8 x float>) nounwind readonly alwaysinline {
+  %v1 = call <8 x float> @llvm.x86.avx.hadd.ps.256(<8 x float> %0, <8 x float> %0)
+  %v2 = call <8 x float> @llvm.x86.avx.hadd.ps.256(<8 x float> %v1, <8 x float> %v1)
+  %scalar1 = extractelement <8 x float> %v2, i32 0
+  %scalar2 = extractelement <8 x float> %v2, i32 4
+  %sum = fadd float %scalar1, %scalar2
+  ret float %sum
+}
+
+define float @__reduce_min_float(<8 x float>) nounwind readnone alwaysinline {
+  reduce8(float, @__min_varying_float, @__min_uniform_float)
+}
+
+define float @__reduce_max_float(<8 x float>) nounwind readnone alwaysinline {
+  reduce8(float, @__max_varying_float, @__max_uniform_float)
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; horizontal int32 ops
+
+define internal <8 x i32> @__add_varying_int32(<8 x i32>,
+                                       <8 x i32>) nounwind readnone alwaysinline {
+  %s = add <8 x i32> %0, %1
+  ret <8 x i32> %s
+}
+
+define internal i32 @__add_uniform_int32(i32, i32) nounwind readnone alwaysinline {
+  %s = add i32 %0, %1
+  ret i32 %s
+}
+
+define i32 @__reduce_add_int32(<8 x i32>) nounwind readnone alwaysinline {
+  reduce8(i32, @__add_varying_int32, @__add_uniform_int32)
+}
+
+define i32 @__reduce_min_int32(<8 x i32>) nounwind readnone alwaysinline {
+  reduce8(i32, @__min_varying_int32, @__min_uniform_int32)
+}
+
+define i32 @__reduce_max_int32(<8 x i32>) nounwind readnone alwaysinline {
+  reduce8(i32, @__max_varying_int32, @__max_uniform_int32)
+}
+
+define i32 @__reduce_min_uint32(<8 x i32>) nounwind readnone alwaysinline {
+  reduce8(i32, @__min_varying_uint32, @__min_uniform_uint32)
+}
+
+define i32 @__reduce_max_uint32(<8 x i32>) nounwind readnone alwaysinline {
+  reduce8(i32, @__max_varying_uint32, @__max_uniform_uint32)
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; horizontal double ops
+
+declare <4 x double> @llvm.x86.avx.hadd.pd.256(<4 x double>, <4 x double>) nounwind readnone
+
+define double @__reduce_add_double(<8 x double>) nounwind readonly alwaysinline {
+  %va = shufflevector <8 x double> %0, <8 x double> undef,
+         <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %vb = shufflevector <8 x double> %0, <8 x double> undef,
+         <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+  %sum0 = call <4 x double> @llvm.x86.avx.hadd.pd.256(<4 x double> %va, <4 x double> %vb)
+  %sum1 = call <4 x double> @llvm.x86.avx.hadd.pd.256(<4 x double> %sum0, <4 x double> %sum0)
+  %final0 = extractelement <4 x double> %sum1, i32 0
+  %final1 = extractelement <4 x double> %sum1, i32 2
+  %sum = fadd double %final0, %final1
+  ret double %sum
+}
+
+define double @__reduce_min_double(<8 x double>) nounwind readnone alwaysinline {
+  reduce8(double, @__min_varying_double, @__min_uniform_double)
+}
+
+define double @__reduce_max_double(<8 x double>) nounwind readnone alwaysinline {
+  reduce8(double, @__max_varying_double, @__max_uniform_double)
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; horizontal int64 ops
+
+define internal <8 x i64> @__add_varying_int64(<8 x i64>,
+                                               <8 x i64>) nounwind readnone alwaysinline {
+  %s = add <8 x i64> %0, %1
+  ret <8 x i64> %s
+}
+
+define internal i64 @__add_uniform_int64(i64, i64) nounwind readnone alwaysinline {
+  %s = add i64 %0, %1
+  ret i64 %s
+}
+
+define i64 @__reduce_add_int64(<8 x i64>) nounwind readnone alwaysinline {
+  reduce8(i64, @__add_varying_int64, @__add_uniform_int64)
+}
+
+define i64 @__reduce_min_int64(<8 x i64>) nounwind readnone alwaysinline {
+  reduce8(i64, @__min_varying_int64, @__min_uniform_int64)
+}
+
+define i64 @__reduce_max_int64(<8 x i64>) nounwind readnone alwaysinline {
+  reduce8(i64, @__max_varying_int64, @__max_uniform_int64)
+}
+
+define i64 @__reduce_min_uint64(<8 x i64>) nounwind readnone alwaysinline {
+  reduce8(i64, @__min_varying_uint64, @__min_uniform_uint64)
+}
+
+define i64 @__reduce_max_uint64(<8 x i64>) nounwind readnone alwaysinline {
+  reduce8(i64, @__max_varying_uint64, @__max_uniform_uint64)
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unaligned loads/loads+broadcasts
+
+masked_load(i8,  1)
+masked_load(i16, 2)
+
+declare <8 x i32> @llvm.x86.avx512.mask.loadu.d.256(i8*, <8 x i32>, i8)
+define <8 x i32> @__masked_load_i32(i8 * %ptr, <WIDTH x MASK> %mask) nounwind alwaysinline {
+  %mask_i8 = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %res = call <8 x i32> @llvm.x86.avx512.mask.loadu.d.256(i8* %ptr, <8 x i32> zeroinitializer, i8 %mask_i8)
+  ret <8 x i32> %res
+}
+
+declare <8 x float> @llvm.x86.avx512.mask.loadu.ps.256(i8*, <8 x float>, i8)
+define <8 x float> @__masked_load_float(i8 * %ptr, <WIDTH x MASK> %mask) readonly alwaysinline {
+  %mask_i8 = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %res = call <8 x float> @llvm.x86.avx512.mask.loadu.ps.256(i8* %ptr, <8 x float> zeroinitializer, i8 %mask_i8)
+  ret <8 x float> %res
+}
+
+;; 64-bit elements take two ymm registers; each half uses its own nibble
+;; of the mask.
+
+define(`masked_load_64_vl', `
+declare <4 x $1> @llvm.x86.avx512.mask.loadu.$2.256(i8*, <4 x $1>, i8)
+define <8 x $1> @__masked_load_$3(i8 * %ptr, <WIDTH x MASK> %mask) nounwind alwaysinline {
+  %mask_lo_i8 = call i8 @__extract_mask_low (<WIDTH x MASK> %mask)
+  %mask_hi_i8 = call i8 @__extract_mask_hi (<WIDTH x MASK> %mask)
+
+  %ptr_d = bitcast i8* %ptr to <8 x $1>*
+  %ptr_hi = getelementptr PTR_OP_ARGS(`<8 x $1>') %ptr_d, i32 0, i32 4
+  %ptr_hi_i8 = bitcast $1* %ptr_hi to i8*
+
+  %r0 = call <4 x $1> @llvm.x86.avx512.mask.loadu.$2.256(i8* %ptr, <4 x $1> zeroinitializer, i8 %mask_lo_i8)
+  %r1 = call <4 x $1> @llvm.x86.avx512.mask.loadu.$2.256(i8* %ptr_hi_i8, <4 x $1> zeroinitializer, i8 %mask_hi_i8)
+
+  %res = shufflevector <4 x $1> %r0, <4 x $1> %r1,
+                       <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  ret <8 x $1> %res
+}
+')
+
+masked_load_64_vl(i64, q, i64)
+masked_load_64_vl(double, pd, double)
+
+gen_masked_store(i8)
+gen_masked_store(i16)
+
+declare void @llvm.x86.avx512.mask.storeu.d.256(i8*, <8 x i32>, i8)
+define void @__masked_store_i32(<8 x i32>* nocapture, <8 x i32> %v, <WIDTH x MASK> %mask) nounwind alwaysinline {
+  %mask_i8 = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %ptr_i8 = bitcast <8 x i32>* %0 to i8*
+  call void @llvm.x86.avx512.mask.storeu.d.256(i8* %ptr_i8, <8 x i32> %v, i8 %mask_i8)
+  ret void
+}
+
+declare void @llvm.x86.avx512.mask.storeu.ps.256(i8*, <8 x float>, i8)
+define void @__masked_store_float(<8 x float>* nocapture, <8 x float> %v, <WIDTH x MASK> %mask) nounwind alwaysinline {
+  %mask_i8 = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %mask)
+  %ptr_i8 = bitcast <8 x float>* %0 to i8*
+  call void @llvm.x86.avx512.mask.storeu.ps.256(i8* %ptr_i8, <8 x float> %v, i8 %mask_i8)
+  ret void
+}
+
+define(`masked_store_64_vl', `
+declare void @llvm.x86.avx512.mask.storeu.$2.256(i8*, <4 x $1>, i8)
+define void @__masked_store_$3(<8 x $1>* nocapture, <8 x $1> %v, <WIDTH x MASK> %mask) nounwind alwaysinline {
+  %mask_lo_i8 = call i8 @__extract_mask_low (<WIDTH x MASK> %mask)
+  %mask_hi_i8 = call i8 @__extract_mask_hi (<WIDTH x MASK> %mask)
+
+  %ptr_i8 = bitcast <8 x $1>* %0 to i8*
+  %ptr_hi = getelementptr PTR_OP_ARGS(`<8 x $1>') %0, i32 0, i32 4
+  %ptr_hi_i8 = bitcast $1* %ptr_hi to i8*
+
+  %v_lo = shufflevector <8 x $1> %v, <8 x $1> undef, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %v_hi = shufflevector <8 x $1> %v, <8 x $1> undef, <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+
+  call void @llvm.x86.avx512.mask.storeu.$2.256(i8* %ptr_i8, <4 x $1> %v_lo, i8 %mask_lo_i8)
+  call void @llvm.x86.avx512.mask.storeu.$2.256(i8* %ptr_hi_i8, <4 x $1> %v_hi, i8 %mask_hi_i8)
+  ret void
+}
+')
+
+masked_store_64_vl(i64, q, i64)
+masked_store_64_vl(double, pd, double)
+
+define(`masked_store_blend_vl', `
+define void @__masked_store_blend_$1(<8 x $1>* nocapture, <8 x $1>,
+                                     <WIDTH x MASK>) nounwind alwaysinline {
+  %v = load PTR_OP_ARGS(`<8 x $1> ')  %0
+  %mask_vec_i1 = call <WIDTH x i1> @__cast_mask_to_i1 (<WIDTH x MASK> %2)
+  %v1 = select <WIDTH x i1> %mask_vec_i1, <8 x $1> %1, <8 x $1> %v
+  store <8 x $1> %v1, <8 x $1> * %0
+  ret void
+}
+')
+
+masked_store_blend_vl(i8)
+masked_store_blend_vl(i16)
+masked_store_blend_vl(i32)
+masked_store_blend_vl(float)
+masked_store_blend_vl(i64)
+masked_store_blend_vl(double)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; gather/scatter
+
+;; gather - i8
+gen_gather(i8)
+
+;; gather - i16
+gen_gather(i16)
+
+;; gather - i32, float: vpgatherdd/vgatherdps with a k-register mask for
+;; 32-bit offsets; 64-bit offsets need two 4-wide vpgatherqd/vgatherqps.
+
+define(`gather_32_vl', `
+declare <8 x $1> @llvm.x86.avx512.gather3siv8.$2(<8 x $1>, i8*, <8 x i32>, i8, i32)
+define <8 x $1>
+@__gather_base_offsets32_$1(i8 * %ptr, i32 %offset_scale, <8 x i32> %offsets, <WIDTH x MASK> %vecmask) nounwind readonly alwaysinline {
+  %mask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %vecmask)
+  %res = call <8 x $1> @llvm.x86.avx512.gather3siv8.$2 (<8 x $1> undef, i8* %ptr, <8 x i32> %offsets, i8 %mask, i32 %offset_scale)
+  ret <8 x $1> %res
+}
+
+declare <4 x $1> @llvm.x86.avx512.gather3div8.$2(<4 x $1>, i8*, <4 x i64>, i8, i32)
+define <8 x $1>
+@__gather_base_offsets64_$1(i8 * %ptr, i32 %offset_scale, <8 x i64> %offsets, <WIDTH x MASK> %vecmask) nounwind readonly alwaysinline {
+  %mask_lo = call i8 @__extract_mask_low (<WIDTH x MASK> %vecmask)
+  %mask_hi = call i8 @__extract_mask_hi (<WIDTH x MASK> %vecmask)
+  %offsets_lo = shufflevector <8 x i64> %offsets, <8 x i64> undef, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %offsets_hi = shufflevector <8 x i64> %offsets, <8 x i64> undef, <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+  %res_lo = call <4 x $1> @llvm.x86.avx512.gather3div8.$2 (<4 x $1> undef, i8* %ptr, <4 x i64> %offsets_lo, i8 %mask_lo, i32 %offset_scale)
+  %res_hi = call <4 x $1> @llvm.x86.avx512.gather3div8.$2 (<4 x $1> undef, i8* %ptr, <4 x i64> %offsets_hi, i8 %mask_hi, i32 %offset_scale)
+  %res = shufflevector <4 x $1> %res_lo, <4 x $1> %res_hi, <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  ret <8 x $1> %res
+}
+
+define <8 x $1>
+@__gather32_$1(<8 x i32> %ptrs, <WIDTH x MASK> %vecmask) nounwind readonly alwaysinline {
+  %res = call <8 x $1> @__gather_base_offsets32_$1(i8 * zeroinitializer, i32 1, <8 x i32> %ptrs, <WIDTH x MASK> %vecmask)
+  ret <8 x $1> %res
+}
+
+define <8 x $1>
+@__gather64_$1(<8 x i64> %ptrs, <WIDTH x MASK> %vecmask) nounwind readonly alwaysinline {
+  %res = call <8 x $1> @__gather_base_offsets64_$1(i8 * zeroinitializer, i32 1, <8 x i64> %ptrs, <WIDTH x MASK> %vecmask)
+  ret <8 x $1> %res
+}
+')
+
+gather_32_vl(i32, si)
+gather_32_vl(float, sf)
+
+;; gather - i64
+gen_gather(i64)
+
+;; gather - double
+gen_gather(double)
+
+define(`scatterbo32_64', `
+define void @__scatter_base_offsets32_$1(i8* %ptr, i32 %scale, <WIDTH x i32> %offsets,
+                                         <WIDTH x $1> %vals, <WIDTH x MASK> %mask) nounwind {
+  call void @__scatter_factored_base_offsets32_$1(i8* %ptr, <8 x i32> %offsets,
+      i32 %scale, <8 x i32> zeroinitializer, <8 x $1> %vals, <WIDTH x MASK> %mask)
+  ret void
+}
+
+define void @__scatter_base_offsets64_$1(i8* %ptr, i32 %scale, <WIDTH x i64> %offsets,
+                                         <WIDTH x $1> %vals, <WIDTH x MASK> %mask) nounwind {
+  call void @__scatter_factored_base_offsets64_$1(i8* %ptr, <8 x i64> %offsets,
+      i32 %scale, <8 x i64> zeroinitializer, <8 x $1> %vals, <WIDTH x MASK> %mask)
+  ret void
+}
+')
+
+;; scatter - i8
+scatterbo32_64(i8)
+gen_scatter(i8)
+
+;; scatter - i16
+scatterbo32_64(i16)
+gen_scatter(i16)
+
+;; scatter - i32, float
+
+define(`scatter_32_vl', `
+declare void @llvm.x86.avx512.scattersiv8.$2(i8*, i8, <8 x i32>, <8 x $1>, i32)
+define void
+@__scatter_base_offsets32_$1(i8* %ptr, i32 %offset_scale, <8 x i32> %offsets, <8 x $1> %vals, <WIDTH x MASK> %vecmask) nounwind {
+  %mask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %vecmask)
+  call void @llvm.x86.avx512.scattersiv8.$2 (i8* %ptr, i8 %mask, <8 x i32> %offsets, <8 x $1> %vals, i32 %offset_scale)
+  ret void
+}
+
+declare void @llvm.x86.avx512.scatterdiv8.$2(i8*, i8, <4 x i64>, <4 x $1>, i32)
+define void
+@__scatter_base_offsets64_$1(i8* %ptr, i32 %offset_scale, <8 x i64> %offsets, <8 x $1> %vals, <WIDTH x MASK> %vecmask) nounwind {
+  %mask_lo = call i8 @__extract_mask_low (<WIDTH x MASK> %vecmask)
+  %mask_hi = call i8 @__extract_mask_hi (<WIDTH x MASK> %vecmask)
+  %offsets_lo = shufflevector <8 x i64> %offsets, <8 x i64> undef, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %offsets_hi = shufflevector <8 x i64> %offsets, <8 x i64> undef, <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+  %vals_lo = shufflevector <8 x $1> %vals, <8 x $1> undef, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %vals_hi = shufflevector <8 x $1> %vals, <8 x $1> undef, <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+  call void @llvm.x86.avx512.scatterdiv8.$2 (i8* %ptr, i8 %mask_lo, <4 x i64> %offsets_lo, <4 x $1> %vals_lo, i32 %offset_scale)
+  call void @llvm.x86.avx512.scatterdiv8.$2 (i8* %ptr, i8 %mask_hi, <4 x i64> %offsets_hi, <4 x $1> %vals_hi, i32 %offset_scale)
+  ret void
+}
+
+define void
+@__scatter32_$1(<8 x i32> %ptrs, <8 x $1> %values, <WIDTH x MASK> %vecmask) nounwind alwaysinline {
+  call void @__scatter_base_offsets32_$1(i8 * zeroinitializer, i32 1, <8 x i32> %ptrs, <8 x $1> %values, <WIDTH x MASK> %vecmask)
+  ret void
+}
+
+define void
+@__scatter64_$1(<8 x i64> %ptrs, <8 x $1> %values, <WIDTH x MASK> %vecmask) nounwind alwaysinline {
+  call void @__scatter_base_offsets64_$1(i8 * zeroinitializer, i32 1, <8 x i64> %ptrs, <8 x $1> %values, <WIDTH x MASK> %vecmask)
+  ret void
+}
+')
+
+scatter_32_vl(i32, si)
+scatter_32_vl(float, sf)
+
+;; scatter - i64
+scatterbo32_64(i64)
+gen_scatter(i64)
+
+;; scatter - double
+scatterbo32_64(double)
+gen_scatter(double)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; packed_load/store
+
+declare <8 x i32> @llvm.x86.avx512.mask.expand.load.d.256(i8* %addr, <8 x i32> %data, i8 %mask)
+
+define i32 @__packed_load_active(i32 * %startptr, <8 x i32> * %val_ptr,
+                                 <WIDTH x MASK> %full_mask) nounwind alwaysinline {
+  %addr = bitcast i32* %startptr to i8*
+  %data = load PTR_OP_ARGS(`<8 x i32> ') %val_ptr
+  %mask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %full_mask)
+  %store_val = call <8 x i32> @llvm.x86.avx512.mask.expand.load.d.256(i8* %addr, <8 x i32> %data, i8 %mask)
+  store <8 x i32> %store_val, <8 x i32> * %val_ptr
+  %mask_i32 = zext i8 %mask to i32
+  %res = call i32 @llvm.ctpop.i32(i32 %mask_i32)
+  ret i32 %res
+}
+
+declare void @llvm.x86.avx512.mask.compress.store.d.256(i8* %addr, <8 x i32> %data, i8 %mask)
+
+define i32 @__packed_store_active(i32 * %startptr, <8 x i32> %vals,
+                                   <WIDTH x MASK> %full_mask) nounwind alwaysinline {
+  %addr = bitcast i32* %startptr to i8*
+  %mask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %full_mask)
+  call void @llvm.x86.avx512.mask.compress.store.d.256(i8* %addr, <8 x i32> %vals, i8 %mask)
+  %mask_i32 = zext i8 %mask to i32
+  %res = call i32 @llvm.ctpop.i32(i32 %mask_i32)
+  ret i32 %res
+}
+
+define i32 @__packed_store_active2(i32 * %startptr, <8 x i32> %vals,
+                                   <WIDTH x MASK> %full_mask) nounwind alwaysinline {
+  %res = call i32 @__packed_store_active(i32 * %startptr, <8 x i32> %vals,
+                                   <WIDTH x MASK> %full_mask)
+  ret i32 %res
+}
+
+;; 64-bit elements: the two halves of the vector are expanded or compressed
+;; separately, with the upper half starting after the elements for the
+;; lower one.
+
+declare <4 x i64> @llvm.x86.avx512.mask.expand.load.q.256(i8* %addr, <4 x i64> %data, i8 %mask)
+declare void @llvm.x86.avx512.mask.compress.store.q.256(i8* %addr, <4 x i64> %data, i8 %mask)
+
+define i32 @__packed_load_active_i64(i64 * %startptr, <8 x i64> * %val_ptr,
+                                     <WIDTH x MASK> %full_mask) nounwind alwaysinline {
+  %data = load PTR_OP_ARGS(`<8 x i64> ') %val_ptr
+  %mask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %full_mask)
+  %mask_lo = call i8 @__extract_mask_low (<WIDTH x MASK> %full_mask)
+  %mask_hi = call i8 @__extract_mask_hi (<WIDTH x MASK> %full_mask)
+  %data_lo = shufflevector <8 x i64> %data, <8 x i64> undef,
+      <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %data_hi = shufflevector <8 x i64> %data, <8 x i64> undef,
+      <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+  %addr_lo = bitcast i64* %startptr to i8*
+  %val_lo = call <4 x i64> @llvm.x86.avx512.mask.expand.load.q.256(i8* %addr_lo, <4 x i64> %data_lo, i8 %mask_lo)
+  %mask_lo_i32 = zext i8 %mask_lo to i32
+  %count_lo = call i32 @llvm.ctpop.i32(i32 %mask_lo_i32)
+  %ptr_hi = getelementptr PTR_OP_ARGS(`i64') %startptr, i32 %count_lo
+  %addr_hi = bitcast i64* %ptr_hi to i8*
+  %val_hi = call <4 x i64> @llvm.x86.avx512.mask.expand.load.q.256(i8* %addr_hi, <4 x i64> %data_hi, i8 %mask_hi)
+  %val = shufflevector <4 x i64> %val_lo, <4 x i64> %val_hi,
+      <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  store <8 x i64> %val, <8 x i64> * %val_ptr
+  %mask_i32 = zext i8 %mask to i32
+  %res = call i32 @llvm.ctpop.i32(i32 %mask_i32)
+  ret i32 %res
+}
+
+define i32 @__packed_store_active_i64(i64 * %startptr, <8 x i64> %vals,
+                                      <WIDTH x MASK> %full_mask) nounwind alwaysinline {
+  %mask = call i8 @__cast_mask_to_i8 (<WIDTH x MASK> %full_mask)
+  %mask_lo = call i8 @__extract_mask_low (<WIDTH x MASK> %full_mask)
+  %mask_hi = call i8 @__extract_mask_hi (<WIDTH x MASK> %full_mask)
+  %vals_lo = shufflevector <8 x i64> %vals, <8 x i64> undef,
+      <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %vals_hi = shufflevector <8 x i64> %vals, <8 x i64> undef,
+      <4 x i32> <i32 4, i32 5, i32 6, i32 7>
+  %addr_lo = bitcast i64* %startptr to i8*
+  call void @llvm.x86.avx512.mask.compress.store.q.256(i8* %addr_lo, <4 x i64> %vals_lo, i8 %mask_lo)
+  %mask_lo_i32 = zext i8 %mask_lo to i32
+  %count_lo = call i32 @llvm.ctpop.i32(i32 %mask_lo_i32)
+  %ptr_hi = getelementptr PTR_OP_ARGS(`i64') %startptr, i32 %count_lo
+  %addr_hi = bitcast i64* %ptr_hi to i8*
+  call void @llvm.x86.avx512.mask.compress.store.q.256(i8* %addr_hi, <4 x i64> %vals_hi, i8 %mask_hi)
+  %mask_i32 = zext i8 %mask to i32
+  %res = call i32 @llvm.ctpop.i32(i32 %mask_i32)
+  ret i32 %res
+}
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; prefetch
+
+define_prefetches()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; int8/int16 builtins
+
+define_avgs()
+declare_nvptx()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; reciprocals in double precision, if supported
+
+rsqrtd_decl()
+rcpd_decl()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unrefined rcp/rsqrt estimates, for rcp_fast() and rsqrt_fast()
+
+rcp_rsqrt_fast_float(8, @llvm.x86.avx512.rcp14.ps.256, @llvm.x86.avx512.rsqrt14.ps.256,
+                     `, <8 x float> undef, i8 -1')
+
+transcendetals_decl()
+trigonometry_decl()
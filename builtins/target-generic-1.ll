@@ -34,6 +34,7 @@
 ;; Define the standard library builtins for the NOVEC target
 define(`MASK',`i32')
 define(`WIDTH',`1')
+define(`SCALAR_POPCNT',`1')
 include(`util.m4')
 rdrand_decls()
 ; Define some basics for a 1-wide target
@@ -1032,5 +1033,10 @@ define_avgs()
 rsqrtd_decl()
 rcpd_decl()
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unrefined rcp/rsqrt estimates, for rcp_fast() and rsqrt_fast()
+
+rcp_rsqrt_fast_float_fallback()
+
 transcendetals_decl()
 trigonometry_decl()
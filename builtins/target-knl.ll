@@ -30,6 +30,7 @@
 ;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
 
 define(`WIDTH',`16')
+define(`HAVE_GATHER_PREFETCH',`1')
 
 ifelse(LLVM_VERSION, LLVM_3_7,
     `include(`target-avx512-common.ll')',
@@ -67,4 +68,52 @@ ifelse(LLVM_VERSION, LLVM_3_7,
     rcp_rsqrt_varying_float_knl()
   )
 
-;;saturation_arithmetic_novec()
+;; The 28-bit rcp28/rsqrt28 estimates above need no refinement, so there's
+;; nothing cheaper for rcp_fast() and rsqrt_fast() to use.
+
+rcp_rsqrt_fast_float_fallback()
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; varying prefetches
+
+;; AVX-512PF gather prefetches: vgatherpf0qps (hint 0) fetches into L1,
+;; vgatherpf1qps (hint 1) into L2.  The addresses are absolute, so they're
+;; passed as 64-bit offsets from a null base, one half of the gang at a
+;; time.
+
+define(`prefetch_read_varying_knl',`
+define void @__prefetch_read_varying_$1(<WIDTH x i64> %addr, <WIDTH x MASK> %mask) alwaysinline {
+  %mask_lo = call i8 @__extract_mask_low(<WIDTH x MASK> %mask)
+  %mask_hi = call i8 @__extract_mask_hi(<WIDTH x MASK> %mask)
+  %addr_lo = shufflevector <16 x i64> %addr, <16 x i64> undef,
+                           <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  %addr_hi = shufflevector <16 x i64> %addr, <16 x i64> undef,
+                           <8 x i32> <i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  call void @llvm.x86.avx512.gatherpf.qps.512(i8 %mask_lo, <8 x i64> %addr_lo,
+                                              i8* null, i32 1, i32 $2)
+  call void @llvm.x86.avx512.gatherpf.qps.512(i8 %mask_hi, <8 x i64> %addr_hi,
+                                              i8* null, i32 1, i32 $2)
+  ret void
+}
+')
+
+define(`prefetches_varying_knl',`
+declare void @llvm.x86.avx512.gatherpf.qps.512(i8, <8 x i64>, i8*, i32, i32) nounwind
+
+prefetch_read_varying_knl(1, 0)
+prefetch_read_varying_knl(2, 1)
+prefetch_read_varying_knl(3, 1)
+prefetch_read_varying_knl(nt, 1)
+')
+
+ifelse(LLVM_VERSION, LLVM_3_7,
+    `prefetches_varying_knl()',
+         LLVM_VERSION, LLVM_3_8,
+    `prefetches_varying_knl()',
+         LLVM_VERSION, LLVM_3_9,
+    `prefetches_varying_knl()',
+         LLVM_VERSION, LLVM_4_0,
+    `prefetches_varying_knl()'
+  )
+
+saturation_arithmetic()
@@ -44,12 +44,12 @@ include(`target-neon-common.ll')
 ;; half conversion routines
 
 define <4 x float> @__half_to_float_varying(<4 x i16> %v) nounwind readnone alwaysinline {
-  %r = call <4 x float> @llvm.arm.neon.vcvthf2fp(<4 x i16> %v)
+  %r = call <4 x float> @NEON_PREFIX.vcvthf2fp(<4 x i16> %v)
   ret <4 x float> %r
 }
 
 define <4 x i16> @__float_to_half_varying(<4 x float> %v) nounwind readnone alwaysinline {
-  %r = call <4 x i16> @llvm.arm.neon.vcvtfp2hf(<4 x float> %v)
+  %r = call <4 x i16> @NEON_PREFIX.vcvtfp2hf(<4 x float> %v)
   ret <4 x i16> %r
 }
 
@@ -58,6 +58,14 @@ define <4 x i16> @__float_to_half_varying(<4 x float> %v) nounwind readnone alwa
 
 ;; round/floor/ceil
 
+ifelse(RUNTIME, `64', `
+neon_round_varying(round, nearbyint, float, v4f32)
+neon_round_varying(floor, floor, float, v4f32)
+neon_round_varying(ceil, ceil, float, v4f32)
+neon_round_varying(round, nearbyint, double, v4f64)
+neon_round_varying(floor, floor, double, v4f64)
+neon_round_varying(ceil, ceil, double, v4f64)
+', `
 ;; FIXME: grabbed these from the sse2 target, which does not have native
 ;; instructions for these.  Is there a better approach for NEON?
 
@@ -98,74 +106,75 @@ define <4 x float> @__ceil_varying_float(<4 x float>) nounwind readonly alwaysin
 declare <WIDTH x double> @__round_varying_double(<WIDTH x double>) nounwind readnone 
 declare <WIDTH x double> @__floor_varying_double(<WIDTH x double>) nounwind readnone 
 declare <WIDTH x double> @__ceil_varying_double(<WIDTH x double>) nounwind readnone 
+')
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; min/max
 
-declare <4 x float> @llvm.arm.neon.vmins.v4f32(<4 x float>, <4 x float>) nounwind readnone
-declare <4 x float> @llvm.arm.neon.vmaxs.v4f32(<4 x float>, <4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vmins, v4f32)(<4 x float>, <4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vmaxs, v4f32)(<4 x float>, <4 x float>) nounwind readnone
 
 define <WIDTH x float> @__max_varying_float(<WIDTH x float>,
                                             <WIDTH x float>) nounwind readnone alwaysinline {
-  %r = call <4 x float> @llvm.arm.neon.vmaxs.v4f32(<4 x float> %0, <4 x float> %1)
+  %r = call <4 x float> @NEON_OP(vmaxs, v4f32)(<4 x float> %0, <4 x float> %1)
   ret <WIDTH x float> %r
 }
 
 define <WIDTH x float> @__min_varying_float(<WIDTH x float>,
                                             <WIDTH x float>) nounwind readnone alwaysinline {
-  %r = call <4 x float> @llvm.arm.neon.vmins.v4f32(<4 x float> %0, <4 x float> %1)
+  %r = call <4 x float> @NEON_OP(vmins, v4f32)(<4 x float> %0, <4 x float> %1)
   ret <WIDTH x float> %r
 }
 
-declare <4 x i32> @llvm.arm.neon.vmins.v4i32(<4 x i32>, <4 x i32>) nounwind readnone
-declare <4 x i32> @llvm.arm.neon.vminu.v4i32(<4 x i32>, <4 x i32>) nounwind readnone
-declare <4 x i32> @llvm.arm.neon.vmaxs.v4i32(<4 x i32>, <4 x i32>) nounwind readnone
-declare <4 x i32> @llvm.arm.neon.vmaxu.v4i32(<4 x i32>, <4 x i32>) nounwind readnone
+declare <4 x i32> @NEON_OP(vmins, v4i32)(<4 x i32>, <4 x i32>) nounwind readnone
+declare <4 x i32> @NEON_OP(vminu, v4i32)(<4 x i32>, <4 x i32>) nounwind readnone
+declare <4 x i32> @NEON_OP(vmaxs, v4i32)(<4 x i32>, <4 x i32>) nounwind readnone
+declare <4 x i32> @NEON_OP(vmaxu, v4i32)(<4 x i32>, <4 x i32>) nounwind readnone
 
 define <WIDTH x i32> @__min_varying_int32(<WIDTH x i32>, <WIDTH x i32>) nounwind readnone alwaysinline {
-  %r = call <4 x i32> @llvm.arm.neon.vmins.v4i32(<4 x i32> %0, <4 x i32> %1)
+  %r = call <4 x i32> @NEON_OP(vmins, v4i32)(<4 x i32> %0, <4 x i32> %1)
   ret <4 x i32> %r
 }
 
 define <WIDTH x i32> @__max_varying_int32(<WIDTH x i32>, <WIDTH x i32>) nounwind readnone alwaysinline {
-  %r = call <4 x i32> @llvm.arm.neon.vmaxs.v4i32(<4 x i32> %0, <4 x i32> %1)
+  %r = call <4 x i32> @NEON_OP(vmaxs, v4i32)(<4 x i32> %0, <4 x i32> %1)
   ret <4 x i32> %r
 }
 
 define <WIDTH x i32> @__min_varying_uint32(<WIDTH x i32>, <WIDTH x i32>) nounwind readnone alwaysinline {
-  %r = call <4 x i32> @llvm.arm.neon.vminu.v4i32(<4 x i32> %0, <4 x i32> %1)
+  %r = call <4 x i32> @NEON_OP(vminu, v4i32)(<4 x i32> %0, <4 x i32> %1)
   ret <4 x i32> %r
 }
 
 define <WIDTH x i32> @__max_varying_uint32(<WIDTH x i32>, <WIDTH x i32>) nounwind readnone alwaysinline {
-  %r = call <4 x i32> @llvm.arm.neon.vmaxu.v4i32(<4 x i32> %0, <4 x i32> %1)
+  %r = call <4 x i32> @NEON_OP(vmaxu, v4i32)(<4 x i32> %0, <4 x i32> %1)
   ret <4 x i32> %r
 }
 
 ;; sqrt/rsqrt/rcp
 
-declare <4 x float> @llvm.arm.neon.vrecpe.v4f32(<4 x float>) nounwind readnone
-declare <4 x float> @llvm.arm.neon.vrecps.v4f32(<4 x float>, <4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vrecpe, v4f32)(<4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vrecps, v4f32)(<4 x float>, <4 x float>) nounwind readnone
 
 define <WIDTH x float> @__rcp_varying_float(<WIDTH x float> %d) nounwind readnone alwaysinline {
-  %x0 = call <4 x float> @llvm.arm.neon.vrecpe.v4f32(<4 x float> %d)
-  %x0_nr = call <4 x float> @llvm.arm.neon.vrecps.v4f32(<4 x float> %d, <4 x float> %x0)
+  %x0 = call <4 x float> @NEON_OP(vrecpe, v4f32)(<4 x float> %d)
+  %x0_nr = call <4 x float> @NEON_OP(vrecps, v4f32)(<4 x float> %d, <4 x float> %x0)
   %x1 = fmul <4 x float> %x0, %x0_nr
-  %x1_nr = call <4 x float> @llvm.arm.neon.vrecps.v4f32(<4 x float> %d, <4 x float> %x1)
+  %x1_nr = call <4 x float> @NEON_OP(vrecps, v4f32)(<4 x float> %d, <4 x float> %x1)
   %x2 = fmul <4 x float> %x1, %x1_nr
   ret <4 x float> %x2
 }
 
-declare <4 x float> @llvm.arm.neon.vrsqrte.v4f32(<4 x float>) nounwind readnone
-declare <4 x float> @llvm.arm.neon.vrsqrts.v4f32(<4 x float>, <4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vrsqrte, v4f32)(<4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vrsqrts, v4f32)(<4 x float>, <4 x float>) nounwind readnone
 
 define <WIDTH x float> @__rsqrt_varying_float(<WIDTH x float> %d) nounwind readnone alwaysinline {
-  %x0 = call <4 x float> @llvm.arm.neon.vrsqrte.v4f32(<4 x float> %d)
+  %x0 = call <4 x float> @NEON_OP(vrsqrte, v4f32)(<4 x float> %d)
   %x0_2 = fmul <4 x float> %x0, %x0
-  %x0_nr = call <4 x float> @llvm.arm.neon.vrsqrts.v4f32(<4 x float> %d, <4 x float> %x0_2)
+  %x0_nr = call <4 x float> @NEON_OP(vrsqrts, v4f32)(<4 x float> %d, <4 x float> %x0_2)
   %x1 = fmul <4 x float> %x0, %x0_nr
   %x1_2 = fmul <4 x float> %x1, %x1
-  %x1_nr = call <4 x float> @llvm.arm.neon.vrsqrts.v4f32(<4 x float> %d, <4 x float> %x1_2)
+  %x1_nr = call <4 x float> @NEON_OP(vrsqrts, v4f32)(<4 x float> %d, <4 x float> %x1_2)
   %x2 = fmul <4 x float> %x1, %x1_nr
   ret <4 x float> %x2
 }
@@ -251,18 +260,22 @@ define i1 @__none(<4 x i32>) nounwind readnone alwaysinline {
 ;; $1: scalar type
 ;; $2: vector reduce function (2 x <2 x vec> -> <2 x vec>)
 ;; $3 scalar reduce function
+;; $4: across-lanes reduction of the final <4 x vec> (AArch64 only)
 
 define(`neon_reduce', `
+ifelse(RUNTIME, `64', `
+  %r = call $1 $4(<4 x $1> %0)
+  ret $1 %r', `
   %v0 = shufflevector <4 x $1> %0, <4 x $1> undef, <2 x i32> <i32 0, i32 1>
   %v1 = shufflevector <4 x $1> %0, <4 x $1> undef, <2 x i32> <i32 2, i32 3>
   %vh = call <2 x $1> $2(<2 x $1> %v0, <2 x $1> %v1)
   %vh0 = extractelement <2 x $1> %vh, i32 0
   %vh1 = extractelement <2 x $1> %vh, i32 1
   %r = call $1$3 ($1 %vh0, $1 %vh1)
-  ret $1 %r
+  ret $1 %r')
 ')
 
-declare <2 x float> @llvm.arm.neon.vpadd.v2f32(<2 x float>, <2 x float>) nounwind readnone
+declare <2 x float> @NEON_OP(vpadd, v2f32)(<2 x float>, <2 x float>) nounwind readnone
 
 define internal float @add_f32(float, float) nounwind readnone alwaysinline {
   %r = fadd float %0, %1
@@ -270,10 +283,10 @@ define internal float @add_f32(float, float) nounwind readnone alwaysinline {
 }
 
 define float @__reduce_add_float(<4 x float>) nounwind readnone alwaysinline {
-  neon_reduce(float, @llvm.arm.neon.vpadd.v2f32, @add_f32)
+  neon_reduce(float, @NEON_OP(vpadd, v2f32), @add_f32, @NEON_ACROSS(faddv, f32, v4f32))
 }
 
-declare <2 x float> @llvm.arm.neon.vpmins.v2f32(<2 x float>, <2 x float>) nounwind readnone
+declare <2 x float> @NEON_OP(vpmins, v2f32)(<2 x float>, <2 x float>) nounwind readnone
 
 define internal float @min_f32(float, float) nounwind readnone alwaysinline {
   %cmp = fcmp olt float %0, %1
@@ -282,10 +295,10 @@ define internal float @min_f32(float, float) nounwind readnone alwaysinline {
 }
 
 define float @__reduce_min_float(<4 x float>) nounwind readnone alwaysinline {
-  neon_reduce(float, @llvm.arm.neon.vpmins.v2f32, @min_f32)
+  neon_reduce(float, @NEON_OP(vpmins, v2f32), @min_f32, @NEON_ACROSS(fminv, f32, v4f32))
 }
 
-declare <2 x float> @llvm.arm.neon.vpmaxs.v2f32(<2 x float>, <2 x float>) nounwind readnone
+declare <2 x float> @NEON_OP(vpmaxs, v2f32)(<2 x float>, <2 x float>) nounwind readnone
 
 define internal float @max_f32(float, float) nounwind readnone alwaysinline {
   %cmp = fcmp ugt float %0, %1
@@ -294,16 +307,16 @@ define internal float @max_f32(float, float) nounwind readnone alwaysinline {
 }
 
 define float @__reduce_max_float(<4 x float>) nounwind readnone alwaysinline {
-  neon_reduce(float, @llvm.arm.neon.vpmaxs.v2f32, @max_f32)
+  neon_reduce(float, @NEON_OP(vpmaxs, v2f32), @max_f32, @NEON_ACROSS(fmaxv, f32, v4f32))
 }
 
-declare <4 x i16> @llvm.arm.neon.vpaddls.v4i16.v8i8(<8 x i8>) nounwind readnone
+declare <4 x i16> @NEON_OP(vpaddls, v4i16.v8i8)(<8 x i8>) nounwind readnone
 
 define i16 @__reduce_add_int8(<WIDTH x i8>) nounwind readnone alwaysinline {
   %v8 = shufflevector <4 x i8> %0, <4 x i8> zeroinitializer,
            <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 4, i32 4, i32 4>
-  %a16 = call <4 x i16> @llvm.arm.neon.vpaddls.v4i16.v8i8(<8 x i8> %v8)
-  %a32 = call <2 x i32> @llvm.arm.neon.vpaddlu.v2i32.v4i16(<4 x i16> %a16)
+  %a16 = call <4 x i16> @NEON_OP(vpaddls, v4i16.v8i8)(<8 x i8> %v8)
+  %a32 = call <2 x i32> @NEON_OP(vpaddlu, v2i32.v4i16)(<4 x i16> %a16)
   %a0 = extractelement <2 x i32> %a32, i32 0
   %a1 = extractelement <2 x i32> %a32, i32 1
   %r = add i32 %a0, %a1
@@ -311,27 +324,30 @@ define i16 @__reduce_add_int8(<WIDTH x i8>) nounwind readnone alwaysinline {
   ret i16 %r16
 }
 
-declare <2 x i32> @llvm.arm.neon.vpaddlu.v2i32.v4i16(<4 x i16>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpaddlu, v2i32.v4i16)(<4 x i16>) nounwind readnone
 
 define i32 @__reduce_add_int16(<WIDTH x i16>) nounwind readnone alwaysinline {
-  %a32 = call <2 x i32> @llvm.arm.neon.vpaddlu.v2i32.v4i16(<4 x i16> %0)
+  %a32 = call <2 x i32> @NEON_OP(vpaddlu, v2i32.v4i16)(<4 x i16> %0)
   %a0 = extractelement <2 x i32> %a32, i32 0
   %a1 = extractelement <2 x i32> %a32, i32 1
   %r = add i32 %a0, %a1
   ret i32 %r
 }
 
-declare <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32>) nounwind readnone
+declare <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32>) nounwind readnone
 
 define i64 @__reduce_add_int32(<WIDTH x i32>) nounwind readnone alwaysinline {
-  %a64 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %0)
+ifelse(RUNTIME, `64', `
+  %r = call i64 @NEON_ACROSS(uaddlv, i64, v4i32)(<4 x i32> %0)
+  ret i64 %r', `
+  %a64 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %0)
   %a0 = extractelement <2 x i64> %a64, i32 0
   %a1 = extractelement <2 x i64> %a64, i32 1
   %r = add i64 %a0, %a1
-  ret i64 %r
+  ret i64 %r')
 }
 
-declare <2 x i32> @llvm.arm.neon.vpmins.v2i32(<2 x i32>, <2 x i32>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpmins, v2i32)(<2 x i32>, <2 x i32>) nounwind readnone
 
 define internal i32 @min_si32(i32, i32) nounwind readnone alwaysinline {
   %cmp = icmp slt i32 %0, %1
@@ -340,10 +356,10 @@ define internal i32 @min_si32(i32, i32) nounwind readnone alwaysinline {
 }
 
 define i32 @__reduce_min_int32(<4 x i32>) nounwind readnone alwaysinline {
-  neon_reduce(i32, @llvm.arm.neon.vpmins.v2i32, @min_si32)
+  neon_reduce(i32, @NEON_OP(vpmins, v2i32), @min_si32, @NEON_ACROSS(sminv, i32, v4i32))
 }
 
-declare <2 x i32> @llvm.arm.neon.vpmaxs.v2i32(<2 x i32>, <2 x i32>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpmaxs, v2i32)(<2 x i32>, <2 x i32>) nounwind readnone
 
 define internal i32 @max_si32(i32, i32) nounwind readnone alwaysinline {
   %cmp = icmp sgt i32 %0, %1
@@ -352,10 +368,10 @@ define internal i32 @max_si32(i32, i32) nounwind readnone alwaysinline {
 }
 
 define i32 @__reduce_max_int32(<4 x i32>) nounwind readnone alwaysinline {
-  neon_reduce(i32, @llvm.arm.neon.vpmaxs.v2i32, @max_si32)
+  neon_reduce(i32, @NEON_OP(vpmaxs, v2i32), @max_si32, @NEON_ACROSS(smaxv, i32, v4i32))
 }
 
-declare <2 x i32> @llvm.arm.neon.vpminu.v2i32(<2 x i32>, <2 x i32>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpminu, v2i32)(<2 x i32>, <2 x i32>) nounwind readnone
 
 define internal i32 @min_ui32(i32, i32) nounwind readnone alwaysinline {
   %cmp = icmp ult i32 %0, %1
@@ -364,10 +380,10 @@ define internal i32 @min_ui32(i32, i32) nounwind readnone alwaysinline {
 }
 
 define i32 @__reduce_min_uint32(<4 x i32>) nounwind readnone alwaysinline {
-  neon_reduce(i32, @llvm.arm.neon.vpmins.v2i32, @min_ui32)
+  neon_reduce(i32, @NEON_OP(vpminu, v2i32), @min_ui32, @NEON_ACROSS(uminv, i32, v4i32))
 }
 
-declare <2 x i32> @llvm.arm.neon.vpmaxu.v2i32(<2 x i32>, <2 x i32>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpmaxu, v2i32)(<2 x i32>, <2 x i32>) nounwind readnone
 
 define internal i32 @max_ui32(i32, i32) nounwind readnone alwaysinline {
   %cmp = icmp ugt i32 %0, %1
@@ -376,7 +392,7 @@ define internal i32 @max_ui32(i32, i32) nounwind readnone alwaysinline {
 }
 
 define i32 @__reduce_max_uint32(<4 x i32>) nounwind readnone alwaysinline {
-  neon_reduce(i32, @llvm.arm.neon.vpmaxs.v2i32, @max_ui32)
+  neon_reduce(i32, @NEON_OP(vpmaxu, v2i32), @max_ui32, @NEON_ACROSS(umaxv, i32, v4i32))
 }
 
 define double @__reduce_add_double(<4 x double>) nounwind readnone alwaysinline {
@@ -430,59 +446,53 @@ define i64 @__reduce_max_uint64(<4 x i64>) nounwind readnone alwaysinline {
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; int8/int16
 
-declare <4 x i8> @llvm.arm.neon.vrhaddu.v4i8(<4 x i8>, <4 x i8>) nounwind readnone
-
-define <4 x i8> @__avg_up_uint8(<4 x i8>, <4 x i8>) nounwind readnone alwaysinline {
-  %r = call <4 x i8> @llvm.arm.neon.vrhaddu.v4i8(<4 x i8> %0, <4 x i8> %1)
-  ret <4 x i8> %r
-}
-
-declare <4 x i8> @llvm.arm.neon.vrhadds.v4i8(<4 x i8>, <4 x i8>) nounwind readnone
-
-define <4 x i8> @__avg_up_int8(<4 x i8>, <4 x i8>) nounwind readnone alwaysinline {
-  %r = call <4 x i8> @llvm.arm.neon.vrhadds.v4i8(<4 x i8> %0, <4 x i8> %1)
-  ret <4 x i8> %r
-}
+;; <4 x i8> is not a legal NEON vector type, so compute these with the
+;; 8-wide instructions and only keep the first four results.
 
-declare <4 x i8> @llvm.arm.neon.vhaddu.v4i8(<4 x i8>, <4 x i8>) nounwind readnone
+define(`neon_avg_int8', `
+declare <8 x i8> @NEON_OP($2, v8i8)(<8 x i8>, <8 x i8>) nounwind readnone
 
-define <4 x i8> @__avg_down_uint8(<4 x i8>, <4 x i8>) nounwind readnone alwaysinline {
-  %r = call <4 x i8> @llvm.arm.neon.vhaddu.v4i8(<4 x i8> %0, <4 x i8> %1)
+define <4 x i8> @__avg_$1(<4 x i8>, <4 x i8>) nounwind readnone alwaysinline {
+  %a = shufflevector <4 x i8> %0, <4 x i8> undef,
+         <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 undef, i32 undef, i32 undef, i32 undef>
+  %b = shufflevector <4 x i8> %1, <4 x i8> undef,
+         <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 undef, i32 undef, i32 undef, i32 undef>
+  %r8 = call <8 x i8> @NEON_OP($2, v8i8)(<8 x i8> %a, <8 x i8> %b)
+  %r = shufflevector <8 x i8> %r8, <8 x i8> undef, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
   ret <4 x i8> %r
 }
+')
 
-declare <4 x i8> @llvm.arm.neon.vhadds.v4i8(<4 x i8>, <4 x i8>) nounwind readnone
-
-define <4 x i8> @__avg_down_int8(<4 x i8>, <4 x i8>) nounwind readnone alwaysinline {
-  %r = call <4 x i8> @llvm.arm.neon.vhadds.v4i8(<4 x i8> %0, <4 x i8> %1)
-  ret <4 x i8> %r
-}
+neon_avg_int8(up_uint8, vrhaddu)
+neon_avg_int8(up_int8, vrhadds)
+neon_avg_int8(down_uint8, vhaddu)
+neon_avg_int8(down_int8, vhadds)
 
-declare <4 x i16> @llvm.arm.neon.vrhaddu.v4i16(<4 x i16>, <4 x i16>) nounwind readnone
+declare <4 x i16> @NEON_OP(vrhaddu, v4i16)(<4 x i16>, <4 x i16>) nounwind readnone
 
 define <4 x i16> @__avg_up_uint16(<4 x i16>, <4 x i16>) nounwind readnone alwaysinline {
-  %r = call <4 x i16> @llvm.arm.neon.vrhaddu.v4i16(<4 x i16> %0, <4 x i16> %1)
+  %r = call <4 x i16> @NEON_OP(vrhaddu, v4i16)(<4 x i16> %0, <4 x i16> %1)
   ret <4 x i16> %r
 }
 
-declare <4 x i16> @llvm.arm.neon.vrhadds.v4i16(<4 x i16>, <4 x i16>) nounwind readnone
+declare <4 x i16> @NEON_OP(vrhadds, v4i16)(<4 x i16>, <4 x i16>) nounwind readnone
 
 define <4 x i16> @__avg_up_int16(<4 x i16>, <4 x i16>) nounwind readnone alwaysinline {
-  %r = call <4 x i16> @llvm.arm.neon.vrhadds.v4i16(<4 x i16> %0, <4 x i16> %1)
+  %r = call <4 x i16> @NEON_OP(vrhadds, v4i16)(<4 x i16> %0, <4 x i16> %1)
   ret <4 x i16> %r
 }
 
-declare <4 x i16> @llvm.arm.neon.vhaddu.v4i16(<4 x i16>, <4 x i16>) nounwind readnone
+declare <4 x i16> @NEON_OP(vhaddu, v4i16)(<4 x i16>, <4 x i16>) nounwind readnone
 
 define <4 x i16> @__avg_down_uint16(<4 x i16>, <4 x i16>) nounwind readnone alwaysinline {
-  %r = call <4 x i16> @llvm.arm.neon.vhaddu.v4i16(<4 x i16> %0, <4 x i16> %1)
+  %r = call <4 x i16> @NEON_OP(vhaddu, v4i16)(<4 x i16> %0, <4 x i16> %1)
   ret <4 x i16> %r
 }
 
-declare <4 x i16> @llvm.arm.neon.vhadds.v4i16(<4 x i16>, <4 x i16>) nounwind readnone
+declare <4 x i16> @NEON_OP(vhadds, v4i16)(<4 x i16>, <4 x i16>) nounwind readnone
 
 define <4 x i16> @__avg_down_int16(<4 x i16>, <4 x i16>) nounwind readnone alwaysinline {
-  %r = call <4 x i16> @llvm.arm.neon.vhadds.v4i16(<4 x i16> %0, <4 x i16> %1)
+  %r = call <4 x i16> @NEON_OP(vhadds, v4i16)(<4 x i16> %0, <4 x i16> %1)
   ret <4 x i16> %r
 }
 
@@ -492,6 +502,11 @@ define <4 x i16> @__avg_down_int16(<4 x i16>, <4 x i16>) nounwind readnone alway
 rsqrtd_decl()
 rcpd_decl()
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unrefined rcp/rsqrt estimates, for rcp_fast() and rsqrt_fast()
+
+rcp_rsqrt_fast_float(4, @NEON_OP(vrecpe, v4f32), @NEON_OP(vrsqrte, v4f32))
+
 transcendetals_decl()
 trigonometry_decl()
-saturation_arithmetic()
+saturation_arithmetic_neon()
@@ -43,12 +43,12 @@ include(`target-neon-common.ll')
 ;; half conversion routines
 
 define <16 x float> @__half_to_float_varying(<16 x i16> %v) nounwind readnone alwaysinline {
-  unary4to16conv(r, i16, float, @llvm.arm.neon.vcvthf2fp, %v)
+  unary4to16conv(r, i16, float, @NEON_PREFIX.vcvthf2fp, %v)
   ret <16 x float> %r
 }
 
 define <16 x i16> @__float_to_half_varying(<16 x float> %v) nounwind readnone alwaysinline {
-  unary4to16conv(r, float, i16, @llvm.arm.neon.vcvtfp2hf, %v)
+  unary4to16conv(r, float, i16, @NEON_PREFIX.vcvtfp2hf, %v)
   ret <16 x i16> %r
 }
 
@@ -57,6 +57,14 @@ define <16 x i16> @__float_to_half_varying(<16 x float> %v) nounwind readnone al
 
 ;; round/floor/ceil
 
+ifelse(RUNTIME, `64', `
+neon_round_varying(round, nearbyint, float, v16f32)
+neon_round_varying(floor, floor, float, v16f32)
+neon_round_varying(ceil, ceil, float, v16f32)
+neon_round_varying(round, nearbyint, double, v16f64)
+neon_round_varying(floor, floor, double, v16f64)
+neon_round_varying(ceil, ceil, double, v16f64)
+', `
 ;; FIXME: grabbed these from the sse2 target, which does not have native
 ;; instructions for these.  Is there a better approach for NEON?
 
@@ -117,74 +125,75 @@ define <16 x float> @__ceil_varying_float(<16 x float>) nounwind readonly always
 declare <WIDTH x double> @__round_varying_double(<WIDTH x double>) nounwind readnone 
 declare <WIDTH x double> @__floor_varying_double(<WIDTH x double>) nounwind readnone 
 declare <WIDTH x double> @__ceil_varying_double(<WIDTH x double>) nounwind readnone 
+')
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; min/max
 
-declare <4 x float> @llvm.arm.neon.vmins.v4f32(<4 x float>, <4 x float>) nounwind readnone
-declare <4 x float> @llvm.arm.neon.vmaxs.v4f32(<4 x float>, <4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vmins, v4f32)(<4 x float>, <4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vmaxs, v4f32)(<4 x float>, <4 x float>) nounwind readnone
 
 define <WIDTH x float> @__max_varying_float(<WIDTH x float>,
                                             <WIDTH x float>) nounwind readnone alwaysinline {
-  binary4to16(r, float, @llvm.arm.neon.vmaxs.v4f32, %0, %1)
+  binary4to16(r, float, @NEON_OP(vmaxs, v4f32), %0, %1)
   ret <WIDTH x float> %r
 }
 
 define <WIDTH x float> @__min_varying_float(<WIDTH x float>,
                                             <WIDTH x float>) nounwind readnone alwaysinline {
-  binary4to16(r, float, @llvm.arm.neon.vmins.v4f32, %0, %1)
+  binary4to16(r, float, @NEON_OP(vmins, v4f32), %0, %1)
   ret <WIDTH x float> %r
 }
 
-declare <4 x i32> @llvm.arm.neon.vmins.v4i32(<4 x i32>, <4 x i32>) nounwind readnone
-declare <4 x i32> @llvm.arm.neon.vminu.v4i32(<4 x i32>, <4 x i32>) nounwind readnone
-declare <4 x i32> @llvm.arm.neon.vmaxs.v4i32(<4 x i32>, <4 x i32>) nounwind readnone
-declare <4 x i32> @llvm.arm.neon.vmaxu.v4i32(<4 x i32>, <4 x i32>) nounwind readnone
+declare <4 x i32> @NEON_OP(vmins, v4i32)(<4 x i32>, <4 x i32>) nounwind readnone
+declare <4 x i32> @NEON_OP(vminu, v4i32)(<4 x i32>, <4 x i32>) nounwind readnone
+declare <4 x i32> @NEON_OP(vmaxs, v4i32)(<4 x i32>, <4 x i32>) nounwind readnone
+declare <4 x i32> @NEON_OP(vmaxu, v4i32)(<4 x i32>, <4 x i32>) nounwind readnone
 
 define <WIDTH x i32> @__min_varying_int32(<WIDTH x i32>, <WIDTH x i32>) nounwind readnone alwaysinline {
-  binary4to16(r, i32, @llvm.arm.neon.vmins.v4i32, %0, %1)
+  binary4to16(r, i32, @NEON_OP(vmins, v4i32), %0, %1)
   ret <WIDTH x i32> %r
 }
 
 define <WIDTH x i32> @__max_varying_int32(<WIDTH x i32>, <WIDTH x i32>) nounwind readnone alwaysinline {
-  binary4to16(r, i32, @llvm.arm.neon.vmaxs.v4i32, %0, %1)
+  binary4to16(r, i32, @NEON_OP(vmaxs, v4i32), %0, %1)
   ret <WIDTH x i32> %r
 }
 
 define <WIDTH x i32> @__min_varying_uint32(<WIDTH x i32>, <WIDTH x i32>) nounwind readnone alwaysinline {
-  binary4to16(r, i32, @llvm.arm.neon.vminu.v4i32, %0, %1)
+  binary4to16(r, i32, @NEON_OP(vminu, v4i32), %0, %1)
   ret <WIDTH x i32> %r
 }
 
 define <WIDTH x i32> @__max_varying_uint32(<WIDTH x i32>, <WIDTH x i32>) nounwind readnone alwaysinline {
-  binary4to16(r, i32, @llvm.arm.neon.vmaxu.v4i32, %0, %1)
+  binary4to16(r, i32, @NEON_OP(vmaxu, v4i32), %0, %1)
   ret <WIDTH x i32> %r
 }
 
 ;; sqrt/rsqrt/rcp
 
-declare <4 x float> @llvm.arm.neon.vrecpe.v4f32(<4 x float>) nounwind readnone
-declare <4 x float> @llvm.arm.neon.vrecps.v4f32(<4 x float>, <4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vrecpe, v4f32)(<4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vrecps, v4f32)(<4 x float>, <4 x float>) nounwind readnone
 
 define <WIDTH x float> @__rcp_varying_float(<WIDTH x float> %d) nounwind readnone alwaysinline {
-  unary4to16(x0, float, @llvm.arm.neon.vrecpe.v4f32, %d)
-  binary4to16(x0_nr, float, @llvm.arm.neon.vrecps.v4f32, %d, %x0)
+  unary4to16(x0, float, @NEON_OP(vrecpe, v4f32), %d)
+  binary4to16(x0_nr, float, @NEON_OP(vrecps, v4f32), %d, %x0)
   %x1 = fmul <WIDTH x float> %x0, %x0_nr
-  binary4to16(x1_nr, float, @llvm.arm.neon.vrecps.v4f32, %d, %x1)
+  binary4to16(x1_nr, float, @NEON_OP(vrecps, v4f32), %d, %x1)
   %x2 = fmul <WIDTH x float> %x1, %x1_nr
   ret <WIDTH x float> %x2
 }
 
-declare <4 x float> @llvm.arm.neon.vrsqrte.v4f32(<4 x float>) nounwind readnone
-declare <4 x float> @llvm.arm.neon.vrsqrts.v4f32(<4 x float>, <4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vrsqrte, v4f32)(<4 x float>) nounwind readnone
+declare <4 x float> @NEON_OP(vrsqrts, v4f32)(<4 x float>, <4 x float>) nounwind readnone
 
 define <WIDTH x float> @__rsqrt_varying_float(<WIDTH x float> %d) nounwind readnone alwaysinline {
-  unary4to16(x0, float, @llvm.arm.neon.vrsqrte.v4f32, %d)
+  unary4to16(x0, float, @NEON_OP(vrsqrte, v4f32), %d)
   %x0_2 = fmul <WIDTH x float> %x0, %x0
-  binary4to16(x0_nr, float, @llvm.arm.neon.vrsqrts.v4f32, %d, %x0_2)
+  binary4to16(x0_nr, float, @NEON_OP(vrsqrts, v4f32), %d, %x0_2)
   %x1 = fmul <WIDTH x float> %x0, %x0_nr
   %x1_2 = fmul <WIDTH x float> %x1, %x1
-  binary4to16(x1_nr, float, @llvm.arm.neon.vrsqrts.v4f32, %d, %x1_2)
+  binary4to16(x1_nr, float, @NEON_OP(vrsqrts, v4f32), %d, %x1_2)
   %x2 = fmul <WIDTH x float> %x1, %x1_nr
   ret <WIDTH x float> %x2
 }
@@ -237,9 +246,9 @@ define i64 @__movmsk(<WIDTH x MASK>) nounwind readnone alwaysinline {
   %and_mask = and <WIDTH x i8> %0,
     <i8 1, i8 2, i8 4, i8 8, i8 16, i8 32, i8 64, i8 128,
      i8 1, i8 2, i8 4, i8 8, i8 16, i8 32, i8 64, i8 128>
-  %v8 = call <8 x i16> @llvm.arm.neon.vpaddlu.v8i16.v16i8(<16 x i8> %and_mask)
-  %v4 = call <4 x i32> @llvm.arm.neon.vpaddlu.v4i32.v8i16(<8 x i16> %v8)
-  %v2 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %v4)
+  %v8 = call <8 x i16> @NEON_OP(vpaddlu, v8i16.v16i8)(<16 x i8> %and_mask)
+  %v4 = call <4 x i32> @NEON_OP(vpaddlu, v4i32.v8i16)(<8 x i16> %v8)
+  %v2 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %v4)
   %va = extractelement <2 x i64> %v2, i32 0
   %vb = extractelement <2 x i64> %v2, i32 1
   %vbshift = shl i64 %vb, 8
@@ -289,6 +298,7 @@ define i1 @__none(<WIDTH x MASK>) nounwind readnone alwaysinline {
 ;; $2: vector/vector reduce function (2 x <WIDTH x vec> -> <WIDTH x vec>)
 ;; $3: pairwise vector reduce function (2 x <2 x vec> -> <2 x vec>)
 ;; $4: scalar reduce function
+;; $5: across-lanes reduction of the final <4 x vec> (AArch64 only)
 
 define(`neon_reduce', `
   v16tov8($1, %0, %va, %vb)
@@ -317,15 +327,18 @@ define(`neon_reduce', `
 
   %vfirst_4 = shufflevector <16 x $1> %v4, <16 x $1> undef,
     <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+ifelse(RUNTIME, `64', `
+  %r = call $1 $5(<4 x $1> %vfirst_4)
+  ret $1 %r', `
   v4tov2($1, %vfirst_4, %v0, %v1)
   %vh = call <2 x $1> $3(<2 x $1> %v0, <2 x $1> %v1)
   %vh0 = extractelement <2 x $1> %vh, i32 0
   %vh1 = extractelement <2 x $1> %vh, i32 1
   %r = call $1 $4($1 %vh0, $1 %vh1)
-  ret $1 %r
+  ret $1 %r')
 ')
 
-declare <2 x float> @llvm.arm.neon.vpadd.v2f32(<2 x float>, <2 x float>) nounwind readnone
+declare <2 x float> @NEON_OP(vpadd, v2f32)(<2 x float>, <2 x float>) nounwind readnone
 
 define internal float @add_f32(float, float) nounwind readnone alwaysinline {
   %r = fadd float %0, %1
@@ -338,10 +351,10 @@ define internal <WIDTH x float> @__add_varying_float(<WIDTH x float>, <WIDTH x f
 }
 
 define float @__reduce_add_float(<WIDTH x float>) nounwind readnone alwaysinline {
-  neon_reduce(float, @__add_varying_float, @llvm.arm.neon.vpadd.v2f32, @add_f32)
+  neon_reduce(float, @__add_varying_float, @NEON_OP(vpadd, v2f32), @add_f32, @NEON_ACROSS(faddv, f32, v4f32))
 }
 
-declare <2 x float> @llvm.arm.neon.vpmins.v2f32(<2 x float>, <2 x float>) nounwind readnone
+declare <2 x float> @NEON_OP(vpmins, v2f32)(<2 x float>, <2 x float>) nounwind readnone
 
 define internal float @min_f32(float, float) nounwind readnone alwaysinline {
   %cmp = fcmp olt float %0, %1
@@ -350,10 +363,10 @@ define internal float @min_f32(float, float) nounwind readnone alwaysinline {
 }
 
 define float @__reduce_min_float(<WIDTH x float>) nounwind readnone alwaysinline {
-  neon_reduce(float, @__min_varying_float, @llvm.arm.neon.vpmins.v2f32, @min_f32)
+  neon_reduce(float, @__min_varying_float, @NEON_OP(vpmins, v2f32), @min_f32, @NEON_ACROSS(fminv, f32, v4f32))
 }
 
-declare <2 x float> @llvm.arm.neon.vpmaxs.v2f32(<2 x float>, <2 x float>) nounwind readnone
+declare <2 x float> @NEON_OP(vpmaxs, v2f32)(<2 x float>, <2 x float>) nounwind readnone
 
 define internal float @max_f32(float, float) nounwind readnone alwaysinline {
   %cmp = fcmp ugt float %0, %1
@@ -362,17 +375,17 @@ define internal float @max_f32(float, float) nounwind readnone alwaysinline {
 }
 
 define float @__reduce_max_float(<WIDTH x float>) nounwind readnone alwaysinline {
-  neon_reduce(float, @__max_varying_float, @llvm.arm.neon.vpmaxs.v2f32, @max_f32)
+  neon_reduce(float, @__max_varying_float, @NEON_OP(vpmaxs, v2f32), @max_f32, @NEON_ACROSS(fmaxv, f32, v4f32))
 }
 
-declare <8 x i16> @llvm.arm.neon.vpaddlu.v8i16.v16i8(<16 x i8>) nounwind readnone
-declare <4 x i32> @llvm.arm.neon.vpaddlu.v4i32.v8i16(<8 x i16>) nounwind readnone
-declare <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32>) nounwind readnone
+declare <8 x i16> @NEON_OP(vpaddlu, v8i16.v16i8)(<16 x i8>) nounwind readnone
+declare <4 x i32> @NEON_OP(vpaddlu, v4i32.v8i16)(<8 x i16>) nounwind readnone
+declare <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32>) nounwind readnone
 
 define i64 @__reduce_add_int8(<WIDTH x i8>) nounwind readnone alwaysinline {
-  %a16 = call <8 x i16> @llvm.arm.neon.vpaddlu.v8i16.v16i8(<16 x i8> %0)
-  %a32 = call <4 x i32> @llvm.arm.neon.vpaddlu.v4i32.v8i16(<8 x i16> %a16)
-  %a64 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %a32)
+  %a16 = call <8 x i16> @NEON_OP(vpaddlu, v8i16.v16i8)(<16 x i8> %0)
+  %a32 = call <4 x i32> @NEON_OP(vpaddlu, v4i32.v8i16)(<8 x i16> %a16)
+  %a64 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %a32)
   %a0 = extractelement <2 x i64> %a64, i32 0
   %a1 = extractelement <2 x i64> %a64, i32 1
   %r = add i64 %a0, %a1
@@ -381,10 +394,10 @@ define i64 @__reduce_add_int8(<WIDTH x i8>) nounwind readnone alwaysinline {
 
 define i64 @__reduce_add_int16(<WIDTH x i16>) nounwind readnone alwaysinline {
   v16tov8(i16, %0, %va, %vb)
-  %a32 = call <4 x i32> @llvm.arm.neon.vpaddlu.v4i32.v8i16(<8 x i16> %va)
-  %b32 = call <4 x i32> @llvm.arm.neon.vpaddlu.v4i32.v8i16(<8 x i16> %vb)
-  %a64 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %a32)
-  %b64 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %b32)
+  %a32 = call <4 x i32> @NEON_OP(vpaddlu, v4i32.v8i16)(<8 x i16> %va)
+  %b32 = call <4 x i32> @NEON_OP(vpaddlu, v4i32.v8i16)(<8 x i16> %vb)
+  %a64 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %a32)
+  %b64 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %b32)
   %sum = add <2 x i64> %a64, %b64
   %a0 = extractelement <2 x i64> %sum, i32 0
   %a1 = extractelement <2 x i64> %sum, i32 1
@@ -394,20 +407,29 @@ define i64 @__reduce_add_int16(<WIDTH x i16>) nounwind readnone alwaysinline {
 
 define i64 @__reduce_add_int32(<WIDTH x i32>) nounwind readnone alwaysinline {
   v16tov4(i32, %0, %va, %vb, %vc, %vd)
-  %a64 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %va)
-  %b64 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %vb)
-  %c64 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %vc)
-  %d64 = call <2 x i64> @llvm.arm.neon.vpaddlu.v2i64.v4i32(<4 x i32> %vd)
+ifelse(RUNTIME, `64', `
+  %s0 = call i64 @NEON_ACROSS(uaddlv, i64, v4i32)(<4 x i32> %va)
+  %s1 = call i64 @NEON_ACROSS(uaddlv, i64, v4i32)(<4 x i32> %vb)
+  %s2 = call i64 @NEON_ACROSS(uaddlv, i64, v4i32)(<4 x i32> %vc)
+  %s3 = call i64 @NEON_ACROSS(uaddlv, i64, v4i32)(<4 x i32> %vd)
+  %s01 = add i64 %s0, %s1
+  %s23 = add i64 %s2, %s3
+  %r = add i64 %s01, %s23
+  ret i64 %r', `
+  %a64 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %va)
+  %b64 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %vb)
+  %c64 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %vc)
+  %d64 = call <2 x i64> @NEON_OP(vpaddlu, v2i64.v4i32)(<4 x i32> %vd)
   %ab = add <2 x i64> %a64, %b64
   %cd = add <2 x i64> %c64, %d64
   %sum = add <2 x i64> %ab, %cd
   %a0 = extractelement <2 x i64> %sum, i32 0
   %a1 = extractelement <2 x i64> %sum, i32 1
   %r = add i64 %a0, %a1
-  ret i64 %r
+  ret i64 %r')
 }
 
-declare <2 x i32> @llvm.arm.neon.vpmins.v2i32(<2 x i32>, <2 x i32>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpmins, v2i32)(<2 x i32>, <2 x i32>) nounwind readnone
 
 define internal i32 @min_si32(i32, i32) nounwind readnone alwaysinline {
   %cmp = icmp slt i32 %0, %1
@@ -416,10 +438,10 @@ define internal i32 @min_si32(i32, i32) nounwind readnone alwaysinline {
 }
 
 define i32 @__reduce_min_int32(<WIDTH x i32>) nounwind readnone alwaysinline {
-  neon_reduce(i32, @__min_varying_int32, @llvm.arm.neon.vpmins.v2i32, @min_si32)
+  neon_reduce(i32, @__min_varying_int32, @NEON_OP(vpmins, v2i32), @min_si32, @NEON_ACROSS(sminv, i32, v4i32))
 }
 
-declare <2 x i32> @llvm.arm.neon.vpmaxs.v2i32(<2 x i32>, <2 x i32>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpmaxs, v2i32)(<2 x i32>, <2 x i32>) nounwind readnone
 
 define internal i32 @max_si32(i32, i32) nounwind readnone alwaysinline {
   %cmp = icmp sgt i32 %0, %1
@@ -428,10 +450,10 @@ define internal i32 @max_si32(i32, i32) nounwind readnone alwaysinline {
 }
 
 define i32 @__reduce_max_int32(<WIDTH x i32>) nounwind readnone alwaysinline {
-  neon_reduce(i32, @__max_varying_int32, @llvm.arm.neon.vpmaxs.v2i32, @max_si32)
+  neon_reduce(i32, @__max_varying_int32, @NEON_OP(vpmaxs, v2i32), @max_si32, @NEON_ACROSS(smaxv, i32, v4i32))
 }
 
-declare <2 x i32> @llvm.arm.neon.vpminu.v2i32(<2 x i32>, <2 x i32>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpminu, v2i32)(<2 x i32>, <2 x i32>) nounwind readnone
 
 define internal i32 @min_ui32(i32, i32) nounwind readnone alwaysinline {
   %cmp = icmp ult i32 %0, %1
@@ -440,10 +462,10 @@ define internal i32 @min_ui32(i32, i32) nounwind readnone alwaysinline {
 }
 
 define i32 @__reduce_min_uint32(<WIDTH x i32>) nounwind readnone alwaysinline {
-  neon_reduce(i32, @__min_varying_uint32, @llvm.arm.neon.vpmins.v2i32, @min_ui32)
+  neon_reduce(i32, @__min_varying_uint32, @NEON_OP(vpminu, v2i32), @min_ui32, @NEON_ACROSS(uminv, i32, v4i32))
 }
 
-declare <2 x i32> @llvm.arm.neon.vpmaxu.v2i32(<2 x i32>, <2 x i32>) nounwind readnone
+declare <2 x i32> @NEON_OP(vpmaxu, v2i32)(<2 x i32>, <2 x i32>) nounwind readnone
 
 define internal i32 @max_ui32(i32, i32) nounwind readnone alwaysinline {
   %cmp = icmp ugt i32 %0, %1
@@ -452,7 +474,7 @@ define internal i32 @max_ui32(i32, i32) nounwind readnone alwaysinline {
 }
 
 define i32 @__reduce_max_uint32(<WIDTH x i32>) nounwind readnone alwaysinline {
-  neon_reduce(i32, @__max_varying_uint32, @llvm.arm.neon.vpmaxs.v2i32, @max_ui32)
+  neon_reduce(i32, @__max_varying_uint32, @NEON_OP(vpmaxu, v2i32), @max_ui32, @NEON_ACROSS(umaxv, i32, v4i32))
 }
 
 define internal double @__add_uniform_double(double, double) nounwind readnone alwaysinline {
@@ -510,74 +532,74 @@ define i64 @__reduce_max_uint64(<WIDTH x i64>) nounwind readnone alwaysinline {
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; int8/int16 builtins
 
-declare <16 x i8> @llvm.arm.neon.vrhaddu.v16i8(<16 x i8>, <16 x i8>) nounwind readnone
+declare <16 x i8> @NEON_OP(vrhaddu, v16i8)(<16 x i8>, <16 x i8>) nounwind readnone
 
 define <16 x i8> @__avg_up_uint8(<16 x i8>, <16 x i8>) nounwind readnone alwaysinline {
-  %r = call <16 x i8> @llvm.arm.neon.vrhaddu.v16i8(<16 x i8> %0, <16 x i8> %1)
+  %r = call <16 x i8> @NEON_OP(vrhaddu, v16i8)(<16 x i8> %0, <16 x i8> %1)
   ret <16 x i8> %r
 }
 
-declare <16 x i8> @llvm.arm.neon.vrhadds.v16i8(<16 x i8>, <16 x i8>) nounwind readnone
+declare <16 x i8> @NEON_OP(vrhadds, v16i8)(<16 x i8>, <16 x i8>) nounwind readnone
 
 define <16 x i8> @__avg_up_int8(<16 x i8>, <16 x i8>) nounwind readnone alwaysinline {
-  %r = call <16 x i8> @llvm.arm.neon.vrhadds.v16i8(<16 x i8> %0, <16 x i8> %1)
+  %r = call <16 x i8> @NEON_OP(vrhadds, v16i8)(<16 x i8> %0, <16 x i8> %1)
   ret <16 x i8> %r
 }
 
-declare <16 x i8> @llvm.arm.neon.vhaddu.v16i8(<16 x i8>, <16 x i8>) nounwind readnone
+declare <16 x i8> @NEON_OP(vhaddu, v16i8)(<16 x i8>, <16 x i8>) nounwind readnone
 
 define <16 x i8> @__avg_down_uint8(<16 x i8>, <16 x i8>) nounwind readnone alwaysinline {
-  %r = call <16 x i8> @llvm.arm.neon.vhaddu.v16i8(<16 x i8> %0, <16 x i8> %1)
+  %r = call <16 x i8> @NEON_OP(vhaddu, v16i8)(<16 x i8> %0, <16 x i8> %1)
   ret <16 x i8> %r
 }
 
-declare <16 x i8> @llvm.arm.neon.vhadds.v16i8(<16 x i8>, <16 x i8>) nounwind readnone
+declare <16 x i8> @NEON_OP(vhadds, v16i8)(<16 x i8>, <16 x i8>) nounwind readnone
 
 define <16 x i8> @__avg_down_int8(<16 x i8>, <16 x i8>) nounwind readnone alwaysinline {
-  %r = call <16 x i8> @llvm.arm.neon.vhadds.v16i8(<16 x i8> %0, <16 x i8> %1)
+  %r = call <16 x i8> @NEON_OP(vhadds, v16i8)(<16 x i8> %0, <16 x i8> %1)
   ret <16 x i8> %r
 }
 
-declare <8 x i16> @llvm.arm.neon.vrhaddu.v8i16(<8 x i16>, <8 x i16>) nounwind readnone
+declare <8 x i16> @NEON_OP(vrhaddu, v8i16)(<8 x i16>, <8 x i16>) nounwind readnone
 
 define <16 x i16> @__avg_up_uint16(<16 x i16>, <16 x i16>) nounwind readnone alwaysinline {
   v16tov8(i16, %0, %a0, %b0)
   v16tov8(i16, %1, %a1, %b1)
-  %r0 = call <8 x i16> @llvm.arm.neon.vrhaddu.v8i16(<8 x i16> %a0, <8 x i16> %a1)
-  %r1 = call <8 x i16> @llvm.arm.neon.vrhaddu.v8i16(<8 x i16> %b0, <8 x i16> %b1)
+  %r0 = call <8 x i16> @NEON_OP(vrhaddu, v8i16)(<8 x i16> %a0, <8 x i16> %a1)
+  %r1 = call <8 x i16> @NEON_OP(vrhaddu, v8i16)(<8 x i16> %b0, <8 x i16> %b1)
   v8tov16(i16, %r0, %r1, %r)
   ret <16 x i16> %r
 }
 
-declare <8 x i16> @llvm.arm.neon.vrhadds.v8i16(<8 x i16>, <8 x i16>) nounwind readnone
+declare <8 x i16> @NEON_OP(vrhadds, v8i16)(<8 x i16>, <8 x i16>) nounwind readnone
 
 define <16 x i16> @__avg_up_int16(<16 x i16>, <16 x i16>) nounwind readnone alwaysinline {
   v16tov8(i16, %0, %a0, %b0)
   v16tov8(i16, %1, %a1, %b1)
-  %r0 = call <8 x i16> @llvm.arm.neon.vrhadds.v8i16(<8 x i16> %a0, <8 x i16> %a1)
-  %r1 = call <8 x i16> @llvm.arm.neon.vrhadds.v8i16(<8 x i16> %b0, <8 x i16> %b1)
+  %r0 = call <8 x i16> @NEON_OP(vrhadds, v8i16)(<8 x i16> %a0, <8 x i16> %a1)
+  %r1 = call <8 x i16> @NEON_OP(vrhadds, v8i16)(<8 x i16> %b0, <8 x i16> %b1)
   v8tov16(i16, %r0, %r1, %r)
   ret <16 x i16> %r
 }
 
-declare <8 x i16> @llvm.arm.neon.vhaddu.v8i16(<8 x i16>, <8 x i16>) nounwind readnone
+declare <8 x i16> @NEON_OP(vhaddu, v8i16)(<8 x i16>, <8 x i16>) nounwind readnone
 
 define <16 x i16> @__avg_down_uint16(<16 x i16>, <16 x i16>) nounwind readnone alwaysinline {
   v16tov8(i16, %0, %a0, %b0)
   v16tov8(i16, %1, %a1, %b1)
-  %r0 = call <8 x i16> @llvm.arm.neon.vhaddu.v8i16(<8 x i16> %a0, <8 x i16> %a1)
-  %r1 = call <8 x i16> @llvm.arm.neon.vhaddu.v8i16(<8 x i16> %b0, <8 x i16> %b1)
+  %r0 = call <8 x i16> @NEON_OP(vhaddu, v8i16)(<8 x i16> %a0, <8 x i16> %a1)
+  %r1 = call <8 x i16> @NEON_OP(vhaddu, v8i16)(<8 x i16> %b0, <8 x i16> %b1)
   v8tov16(i16, %r0, %r1, %r)
   ret <16 x i16> %r
 }
 
-declare <8 x i16> @llvm.arm.neon.vhadds.v8i16(<8 x i16>, <8 x i16>) nounwind readnone
+declare <8 x i16> @NEON_OP(vhadds, v8i16)(<8 x i16>, <8 x i16>) nounwind readnone
 
 define <16 x i16> @__avg_down_int16(<16 x i16>, <16 x i16>) nounwind readnone alwaysinline {
   v16tov8(i16, %0, %a0, %b0)
   v16tov8(i16, %1, %a1, %b1)
-  %r0 = call <8 x i16> @llvm.arm.neon.vhadds.v8i16(<8 x i16> %a0, <8 x i16> %a1)
-  %r1 = call <8 x i16> @llvm.arm.neon.vhadds.v8i16(<8 x i16> %b0, <8 x i16> %b1)
+  %r0 = call <8 x i16> @NEON_OP(vhadds, v8i16)(<8 x i16> %a0, <8 x i16> %a1)
+  %r1 = call <8 x i16> @NEON_OP(vhadds, v8i16)(<8 x i16> %b0, <8 x i16> %b1)
   v8tov16(i16, %r0, %r1, %r)
   ret <16 x i16> %r
 }
@@ -588,6 +610,11 @@ define <16 x i16> @__avg_down_int16(<16 x i16>, <16 x i16>) nounwind readnone al
 rsqrtd_decl()
 rcpd_decl()
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unrefined rcp/rsqrt estimates, for rcp_fast() and rsqrt_fast()
+
+rcp_rsqrt_fast_float(4, @NEON_OP(vrecpe, v4f32), @NEON_OP(vrsqrte, v4f32))
+
 transcendetals_decl()
 trigonometry_decl()
-saturation_arithmetic()
+saturation_arithmetic_neon()
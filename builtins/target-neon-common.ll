@@ -33,7 +33,65 @@
 ;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 ;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
 
-target datalayout = "e-p:32:32:32-S32-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:32:64-f16:16:16-f32:32:32-f64:32:64-f128:128:128-v64:32:64-v128:32:128-a0:0:64-n32"
+ifelse(RUNTIME, `64',
+`target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"',
+`target datalayout = "e-p:32:32:32-S32-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:32:64-f16:16:16-f32:32:32-f64:32:64-f128:128:128-v64:32:64-v128:32:128-a0:0:64-n32"')
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; The 32-bit runtime builtins target ARMv7 (AArch32) and the 64-bit ones
+;; target ARMv8 (AArch64).  The two instruction sets provide mostly the same
+;; NEON operations, but the LLVM intrinsics are named differently; the
+;; target files refer to them with the ARMv7 names through NEON_OP(), which
+;; maps them to their AArch64 equivalent when needed.
+
+ifelse(RUNTIME, `64',
+`define(`NEON_PREFIX', `llvm.aarch64.neon')',
+`define(`NEON_PREFIX', `llvm.arm.neon')')
+
+;; $1: ARMv7 operation name
+;; $2: vector type suffix, used to choose between integer and FP versions
+
+define(`neon_aarch64_op',
+`ifelse(regexp(`$2', `f'), `-1',
+`ifelse($1, `vmaxs', `smax', $1, `vmins', `smin',
+        $1, `vpmaxs', `smaxp', $1, `vpmins', `sminp', $1, `vpadd', `addp',
+        $1, `vmaxu', `umax', $1, `vminu', `umin',
+        $1, `vpmaxu', `umaxp', $1, `vpminu', `uminp',
+        $1, `vpaddls', `saddlp', $1, `vpaddlu', `uaddlp',
+        $1, `vrhadds', `srhadd', $1, `vrhaddu', `urhadd',
+        $1, `vhadds', `shadd', $1, `vhaddu', `uhadd',
+        $1, `vqadds', `sqadd', $1, `vqaddu', `uqadd',
+        $1, `vqsubs', `sqsub', $1, `vqsubu', `uqsub',
+        $1, `vqmovns', `sqxtn', $1, `vqmovnsu', `sqxtun',
+        $1, `vqmovnu', `uqxtn',
+        `errprint(`unknown NEON operation $1.$2')')',
+`ifelse($1, `vmaxs', `fmax', $1, `vmins', `fmin',
+        $1, `vpmaxs', `fmaxp', $1, `vpmins', `fminp', $1, `vpadd', `faddp',
+        $1, `vrecpe', `frecpe', $1, `vrecps', `frecps',
+        $1, `vrsqrte', `frsqrte', $1, `vrsqrts', `frsqrts',
+        `errprint(`unknown NEON operation $1.$2')')')')
+
+define(`NEON_OP',
+`ifelse(RUNTIME, `64', `NEON_PREFIX.neon_aarch64_op($1, $2).$2', `NEON_PREFIX.$1.$2')')
+
+;; AArch64 adds reductions across all of the lanes of a vector; on ARMv7 the
+;; target files fall back to a sequence of pairwise operations.
+;; $1: reduction (fminv, smaxv, uaddlv, ...)
+;; $2: scalar result type suffix
+;; $3: vector type suffix
+
+define(`NEON_ACROSS', `llvm.aarch64.neon.$1.$2.$3')
+
+ifelse(RUNTIME, `64', `
+declare float @NEON_ACROSS(faddv, f32, v4f32)(<4 x float>) nounwind readnone
+declare float @NEON_ACROSS(fminv, f32, v4f32)(<4 x float>) nounwind readnone
+declare float @NEON_ACROSS(fmaxv, f32, v4f32)(<4 x float>) nounwind readnone
+declare i32 @NEON_ACROSS(sminv, i32, v4i32)(<4 x i32>) nounwind readnone
+declare i32 @NEON_ACROSS(smaxv, i32, v4i32)(<4 x i32>) nounwind readnone
+declare i32 @NEON_ACROSS(uminv, i32, v4i32)(<4 x i32>) nounwind readnone
+declare i32 @NEON_ACROSS(umaxv, i32, v4i32)(<4 x i32>) nounwind readnone
+declare i64 @NEON_ACROSS(uaddlv, i64, v4i32)(<4 x i32>) nounwind readnone
+')
 
 stdlib_core()
 scans()
@@ -43,17 +101,85 @@ define_shuffles()
 aossoa()
 ctlztz()
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; saturating arithmetic
+;;
+;; Targets narrower than the NEON vectors for a type compute with the
+;; 64-bit instructions and only keep the first results; wider ones split
+;; their vectors across several instructions.
+
+;; $1: function name
+;; $2: element type
+;; $3: NEON operation
+;; $4: number of elements in the NEON vectors used
+
+define(`neon_saturating_binary', `
+declare <$4 x $2> @NEON_OP($3, v$4$2)(<$4 x $2>, <$4 x $2>) nounwind readnone
+
+define <WIDTH x $2> @$1(<WIDTH x $2>, <WIDTH x $2>) nounwind readnone alwaysinline {
+ifelse(eval(WIDTH < $4), 1, `
+  %a = shufflevector <WIDTH x $2> %0, <WIDTH x $2> undef,
+         <$4 x i32> <widen_seq(WIDTH, $4)>
+  %b = shufflevector <WIDTH x $2> %1, <WIDTH x $2> undef,
+         <$4 x i32> <widen_seq(WIDTH, $4)>
+  %r_native = call <$4 x $2> @NEON_OP($3, v$4$2)(<$4 x $2> %a, <$4 x $2> %b)
+  %r = shufflevector <$4 x $2> %r_native, <$4 x $2> undef,
+         <WIDTH x i32> <split_seq(0, WIDTH)>',
+  `binary_split(r, WIDTH, $4, $2, $2, @NEON_OP($3, v$4$2), %0, %1)')
+  ret <WIDTH x $2> %r
+}
+')
+
+;; $1: function name suffix
+;; $2: source element type
+;; $3: destination element type
+;; $4: NEON operation
+;; $5: number of elements in the NEON vectors used
+
+define(`neon_saturating_narrow', `
+declare <$5 x $3> @NEON_OP($4, v$5$3)(<$5 x $2>) nounwind readnone
+
+define <WIDTH x $3> @__sat_trunc_$1(<WIDTH x $2>) nounwind readnone alwaysinline {
+ifelse(eval(WIDTH < $5), 1, `
+  %v = shufflevector <WIDTH x $2> %0, <WIDTH x $2> undef,
+         <$5 x i32> <widen_seq(WIDTH, $5)>
+  %r_native = call <$5 x $3> @NEON_OP($4, v$5$3)(<$5 x $2> %v)
+  %r = shufflevector <$5 x $3> %r_native, <$5 x $3> undef,
+         <WIDTH x i32> <split_seq(0, WIDTH)>',
+  `unary_split(r, WIDTH, $5, $2, $3, @NEON_OP($4, v$5$3), %0)')
+  ret <WIDTH x $3> %r
+}
+')
+
+define(`saturation_arithmetic_neon', `
+neon_saturating_binary(__padds_vi8, i8, vqadds, ifelse(WIDTH, `4', `8', WIDTH))
+neon_saturating_binary(__paddus_vi8, i8, vqaddu, ifelse(WIDTH, `4', `8', WIDTH))
+neon_saturating_binary(__psubs_vi8, i8, vqsubs, ifelse(WIDTH, `4', `8', WIDTH))
+neon_saturating_binary(__psubus_vi8, i8, vqsubu, ifelse(WIDTH, `4', `8', WIDTH))
+neon_saturating_binary(__padds_vi16, i16, vqadds, ifelse(WIDTH, `16', `8', WIDTH))
+neon_saturating_binary(__paddus_vi16, i16, vqaddu, ifelse(WIDTH, `16', `8', WIDTH))
+neon_saturating_binary(__psubs_vi16, i16, vqsubs, ifelse(WIDTH, `16', `8', WIDTH))
+neon_saturating_binary(__psubus_vi16, i16, vqsubu, ifelse(WIDTH, `16', `8', WIDTH))
+
+neon_saturating_narrow(int16_int8, i16, i8, vqmovns, 8)
+neon_saturating_narrow(int16_uint8, i16, i8, vqmovnsu, 8)
+neon_saturating_narrow(uint16_uint8, i16, i8, vqmovnu, 8)
+neon_saturating_narrow(int32_int16, i32, i16, vqmovns, 4)
+neon_saturating_narrow(int32_uint16, i32, i16, vqmovnsu, 4)
+neon_saturating_narrow(uint32_uint16, i32, i16, vqmovnu, 4)
+')
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; half conversion routines
 
-declare <4 x i16> @llvm.arm.neon.vcvtfp2hf(<4 x float>) nounwind readnone
-declare <4 x float> @llvm.arm.neon.vcvthf2fp(<4 x i16>) nounwind readnone
+declare <4 x i16> @NEON_PREFIX.vcvtfp2hf(<4 x float>) nounwind readnone
+declare <4 x float> @NEON_PREFIX.vcvthf2fp(<4 x i16>) nounwind readnone
 
 define float @__half_to_float_uniform(i16 %v) nounwind readnone alwaysinline {
   %v1 = bitcast i16 %v to <1 x i16>
   %vec = shufflevector <1 x i16> %v1, <1 x i16> undef, 
            <4 x i32> <i32 0, i32 0, i32 0, i32 0>
-  %h = call <4 x float> @llvm.arm.neon.vcvthf2fp(<4 x i16> %vec)
+  %h = call <4 x float> @NEON_PREFIX.vcvthf2fp(<4 x i16> %vec)
   %r = extractelement <4 x float> %h, i32 0
   ret float %r
 }
@@ -62,7 +188,7 @@ define i16 @__float_to_half_uniform(float %v) nounwind readnone alwaysinline {
   %v1 = bitcast float %v to <1 x float>
   %vec = shufflevector <1 x float> %v1, <1 x float> undef, 
            <4 x i32> <i32 0, i32 0, i32 0, i32 0>
-  %h = call <4 x i16> @llvm.arm.neon.vcvtfp2hf(<4 x float> %vec)
+  %h = call <4 x i16> @NEON_PREFIX.vcvtfp2hf(<4 x float> %vec)
   %r = extractelement <4 x i16> %h, i32 0
   ret i16 %r
 }
@@ -70,6 +196,15 @@ define i16 @__float_to_half_uniform(float %v) nounwind readnone alwaysinline {
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; math
 
+ifelse(RUNTIME, `64', `
+define void @__fastmath() nounwind alwaysinline {
+  %x = call i64 asm sideeffect "mrs $0, fpcr", "=r"() nounwind
+  ; Turn on FTZ (bit 24) and default NaN (bit 25)
+  %y = or i64 %x, 50331648
+  call void asm sideeffect "msr fpcr, $0", "r"(i64 %y) nounwind
+  ret void
+}
+', `
 declare i32 @llvm.arm.get.fpscr() nounwind
 declare void @llvm.arm.set.fpscr(i32) nounwind
 
@@ -80,10 +215,64 @@ define void @__fastmath() nounwind alwaysinline {
   call void @llvm.arm.set.fpscr(i32 %y)
   ret void
 }
+')
 
 ;; round/floor/ceil
 
-;; FIXME: grabbed these from the sse2 target, which does not have native
+ifelse(RUNTIME, `64', `
+;; AArch64 has native instructions for these (frintn, frintm, frintp)
+
+declare float @llvm.nearbyint.f32(float) nounwind readnone
+declare float @llvm.floor.f32(float) nounwind readnone
+declare float @llvm.ceil.f32(float) nounwind readnone
+declare double @llvm.nearbyint.f64(double) nounwind readnone
+declare double @llvm.floor.f64(double) nounwind readnone
+declare double @llvm.ceil.f64(double) nounwind readnone
+
+define float @__round_uniform_float(float) nounwind readonly alwaysinline {
+  %r = call float @llvm.nearbyint.f32(float %0)
+  ret float %r
+}
+
+define float @__floor_uniform_float(float) nounwind readonly alwaysinline {
+  %r = call float @llvm.floor.f32(float %0)
+  ret float %r
+}
+
+define float @__ceil_uniform_float(float) nounwind readonly alwaysinline {
+  %r = call float @llvm.ceil.f32(float %0)
+  ret float %r
+}
+
+define double @__round_uniform_double(double) nounwind readonly alwaysinline {
+  %r = call double @llvm.nearbyint.f64(double %0)
+  ret double %r
+}
+
+define double @__floor_uniform_double(double) nounwind readonly alwaysinline {
+  %r = call double @llvm.floor.f64(double %0)
+  ret double %r
+}
+
+define double @__ceil_uniform_double(double) nounwind readonly alwaysinline {
+  %r = call double @llvm.ceil.f64(double %0)
+  ret double %r
+}
+
+;; $1: round/floor/ceil
+;; $2: LLVM intrinsic implementing it
+;; $3: element type
+;; $4: vector type suffix
+
+define(`neon_round_varying', `
+declare <WIDTH x $3> @llvm.$2.$4(<WIDTH x $3>) nounwind readnone
+
+define <WIDTH x $3> @__$1_varying_$3(<WIDTH x $3>) nounwind readonly alwaysinline {
+  %r = call <WIDTH x $3> @llvm.$2.$4(<WIDTH x $3> %0)
+  ret <WIDTH x $3> %r
+}
+')
+', `;; FIXME: grabbed these from the sse2 target, which does not have native
 ;; instructions for these.  Is there a better approach for NEON?
 
 define float @__round_uniform_float(float) nounwind readonly alwaysinline {
@@ -123,6 +312,7 @@ define float @__ceil_uniform_float(float) nounwind readonly alwaysinline {
 declare double @__round_uniform_double(double) nounwind readnone 
 declare double @__floor_uniform_double(double) nounwind readnone 
 declare double @__ceil_uniform_double(double) nounwind readnone 
+')
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; min/max
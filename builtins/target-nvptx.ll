@@ -308,6 +308,13 @@ if.end:
   ret i8* %ptr
 }
 
+;; every launch gets its own non-blocking stream, so that the kernels of
+;; launches without a sync in between can run concurrently; ISPCSync's
+;; cudaDeviceSynchronize() waits for the work in all of them.  Destroying
+;; a stream right after the launch only releases it once its work is done.
+declare i32 @cudaStreamCreateWithFlags(i64*, i32) nounwind
+declare i32 @cudaStreamDestroy(i64) nounwind
+
 ;; this actually launches kernel a kernel
 module asm "
 .extern .func  (.param .b32 func_retval0) cudaLaunchDevice
@@ -338,6 +345,7 @@ entry:
   br i1 %cmp, label %if.then, label %if.end
 
 if.then:
+  %stream = call i64 @__launch_stream_create()
 
  %res_tmp = call i32 asm sideeffect "{
      .param .b64 param0;
@@ -374,7 +382,12 @@ if.then:
 "=r, l,l, r,r,r, r,r,r, r,l"(
           i64 %func_i64,i64 %args_i64, 
           i32 %nbx,i32 %nty,i32 %ntz, 
-          i32 128,i32 1,i32 1, i32 0,i64 0);
+          i32 128,i32 1,i32 1, i32 0,i64 %stream);
+  %stream_nonnull = icmp ne i64 %stream, 0
+  br i1 %stream_nonnull, label %destroy.stream, label %if.end
+
+destroy.stream:
+  %destroy_res = call i32 @cudaStreamDestroy(i64 %stream)
   br label %if.end
 
 if.end:                                           ; preds = %if.then, %entry
@@ -398,6 +411,17 @@ define void @ISPCSync(i8*) nounwind alwaysinline
 
 include(`util-nvptx.m4')
 
+;; creates the stream for ISPCLaunch (cudaStreamNonBlocking = 1); returns
+;; the default stream (0) if that fails
+define i64 @__launch_stream_create() nounwind alwaysinline
+{
+  %stream_ptr = alloca i64
+  store i64 0, i64* %stream_ptr
+  %res = call i32 @cudaStreamCreateWithFlags(i64* %stream_ptr, i32 1)
+  %stream = load PTR_OP_ARGS(`i64')  %stream_ptr
+  ret i64 %stream
+}
+
 stdlib_core()
 packed_load_and_store()
 int64minmax()
@@ -772,6 +796,28 @@ define <WIDTH x double> @__rsqrt_varying_double(<WIDTH x double>) nounwind readn
   %rv = insertelement <1 x double> undef, double %r, i32 0 
   ret <WIDTH x double> %rv
 }
+
+;; rcp_fast() and rsqrt_fast(): nothing cheaper than the above
+define <WIDTH x float> @__rcp_fast_varying_float(<WIDTH x float>) nounwind readnone alwaysinline
+{
+  %r = call <WIDTH x float> @__rcp_varying_float(<WIDTH x float> %0)
+  ret <WIDTH x float> %r
+}
+define <WIDTH x float> @__rsqrt_fast_varying_float(<WIDTH x float>) nounwind readnone alwaysinline
+{
+  %r = call <WIDTH x float> @__rsqrt_varying_float(<WIDTH x float> %0)
+  ret <WIDTH x float> %r
+}
+define float @__rcp_fast_uniform_float(float) nounwind readnone alwaysinline
+{
+  %r = call float @__rcp_uniform_float(float %0)
+  ret float %r
+}
+define float @__rsqrt_fast_uniform_float(float) nounwind readnone alwaysinline
+{
+  %r = call float @__rsqrt_uniform_float(float %0)
+  ret float %r
+}
 define <WIDTH x float> @__sqrt_varying_float(<WIDTH x float>) nounwind readnone alwaysinline
 {
   %v = extractelement <1 x float> %0, i32 0
@@ -1531,6 +1577,67 @@ define <1 x i64> @__exclusive_scan_$1_i64(<1 x i64>, <1 x i1>) nounwind readnone
 exclusive_scan_i64(or)
 exclusive_scan_i64(and)
 
+;; mul/min/max scans are done with log2(32) steps of shfl.idx from
+;; program index - 2^i; the combining function is passed as $4.
+define internal i32 @__mul_i32_nvptx(i32, i32) nounwind readnone alwaysinline {
+  %r = mul i32 %0, %1
+  ret i32 %r
+}
+define internal i64 @__mul_i64_nvptx(i64, i64) nounwind readnone alwaysinline {
+  %r = mul i64 %0, %1
+  ret i64 %r
+}
+define internal float @__mul_float_nvptx(float, float) nounwind readnone alwaysinline {
+  %r = fmul float %0, %1
+  ret float %r
+}
+define internal double @__mul_double_nvptx(double, double) nounwind readnone alwaysinline {
+  %r = fmul double %0, %1
+  ret double %r
+}
+
+;; $1: element type, $2: identity value, $3: function suffix,
+;; $4: combining function
+define(`exclusive_scan_shfl',`
+define <1 x $1> @__exclusive_scan_$3(<1 x $1>, <1 x i1>) nounwind readnone alwaysinline
+{
+  %v0   = extractelement <1 x $1> %0, i32 0
+  %mask = extractelement <1 x i1 > %1, i32 0
+  %s0   = select i1 %mask, $1 %v0, $1 $2
+  %lane = call i32 @__program_index()
+  forloop(i, 0, 4, `
+  %src`'i = sub i32 %lane, eval(1<<i)
+  %sh`'i  = tail call $1 @__shfl_$1_nvptx($1 %s`'i, i32 %src`'i)
+  %op`'i  = tail call $1 @$4($1 %sh`'i, $1 %s`'i)
+  %has`'i = icmp sge i32 %src`'i, 0
+  %s`'eval(i+1) = select i1 %has`'i, $1 %op`'i, $1 %s`'i')
+
+  ;; move the inclusive scan up by one lane for the exclusive scan
+  %prev  = sub i32 %lane, 1
+  %ex0   = tail call $1 @__shfl_$1_nvptx($1 %s5, i32 %prev)
+  %first = icmp eq i32 %lane, 0
+  %ex    = select i1 %first, $1 $2, $1 %ex0
+  %retv  = insertelement <1 x $1> undef, $1 %ex, i32 0
+  ret <1 x $1> %retv
+}
+')
+exclusive_scan_shfl(i32, 1, mul_i32, __mul_i32_nvptx)
+exclusive_scan_shfl(i64, 1, mul_i64, __mul_i64_nvptx)
+exclusive_scan_shfl(float, 1.0, mul_float, __mul_float_nvptx)
+exclusive_scan_shfl(double, 1.0, mul_double, __mul_double_nvptx)
+exclusive_scan_shfl(i32, 2147483647, min_i32, __min_i32_signed)
+exclusive_scan_shfl(i32, -1, min_uint32, __min_i32_unsigned)
+exclusive_scan_shfl(i32, -2147483648, max_i32, __max_i32_signed)
+exclusive_scan_shfl(i32, 0, max_uint32, __max_i32_unsigned)
+exclusive_scan_shfl(i64, 9223372036854775807, min_i64, __min_i64_signed)
+exclusive_scan_shfl(i64, -1, min_uint64, __min_i64_unsigned)
+exclusive_scan_shfl(i64, -9223372036854775808, max_i64, __max_i64_signed)
+exclusive_scan_shfl(i64, 0, max_uint64, __max_i64_unsigned)
+exclusive_scan_shfl(float, 0x7FF0000000000000, min_float, __min_float)
+exclusive_scan_shfl(float, 0xFFF0000000000000, max_float, __max_float)
+exclusive_scan_shfl(double, 0x7FF0000000000000, min_double, __min_double)
+exclusive_scan_shfl(double, 0xFFF0000000000000, max_double, __max_double)
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; unaligned loads/loads+broadcasts
 
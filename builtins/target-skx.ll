@@ -87,4 +87,18 @@ ifelse(LLVM_VERSION, LLVM_3_8,
     rcp_rsqrt_varying_float_skx()
   )
 
-;;saturation_arithmetic_novec()
+;; rcp_fast() and rsqrt_fast() use the 14-bit estimates directly.
+
+define(`rcp_rsqrt_fast_float_skx', `rcp_rsqrt_fast_float(16,
+    @llvm.x86.avx512.rcp14.ps.512, @llvm.x86.avx512.rsqrt14.ps.512,
+    `, <16 x float> undef, i16 -1')')
+
+ifelse(LLVM_VERSION, LLVM_3_8,
+    `rcp_rsqrt_fast_float_skx()',
+         LLVM_VERSION, LLVM_3_9,
+    `rcp_rsqrt_fast_float_skx()',
+         LLVM_VERSION, LLVM_4_0,
+    `rcp_rsqrt_fast_float_skx()'
+  )
+
+saturation_arithmetic()
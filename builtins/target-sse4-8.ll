@@ -494,5 +494,10 @@ define_down_avgs()
 rsqrtd_decl()
 rcpd_decl()
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; unrefined rcp/rsqrt estimates, for rcp_fast() and rsqrt_fast()
+
+rcp_rsqrt_fast_float(4, @llvm.x86.sse.rcp.ps, @llvm.x86.sse.rsqrt.ps)
+
 transcendetals_decl()
 trigonometry_decl()
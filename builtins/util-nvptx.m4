@@ -1043,6 +1043,28 @@ declare void
 declare void
 @__soa_to_aos3_float(<WIDTH x float> %v0, <WIDTH x float> %v1, <WIDTH x float> %v2,
                      float * noalias %p) nounwind alwaysinline ;
+
+aossoa_more_decl(float, 2)
+aossoa_more_decl(float, 6)
+aossoa_more_decl(float, 8)
+aossoa_more_decl(double, 2)
+aossoa_more_decl(double, 3)
+aossoa_more_decl(double, 4)
+aossoa_more_decl(double, 6)
+aossoa_more_decl(double, 8)
+')
+
+;; $1: element type, $2: number of fields
+
+define(`aossoa_more_decl', `
+declare void
+@__aos_to_soa$2_$1($1 * noalias %p,
+        forloop(k, 0, eval($2-2), `<WIDTH x $1> * noalias %out`'k, ')<WIDTH x $1> * noalias %out`'eval($2-1))
+        nounwind alwaysinline ;
+
+declare void
+@__soa_to_aos$2_$1(forloop(k, 0, eval($2-1), `<WIDTH x $1> %v`'k, ')$1 * noalias %p)
+        nounwind alwaysinline ;
 ')
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -1105,11 +1127,143 @@ define void @__masked_store_blend_double(<WIDTH x double> * nocapture, <WIDTH x
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; conflict detection
+;;
+;; For each lane, returns a bitmask of the earlier active lanes that hold
+;; the same value as it does; this matches the semantics of vpconflictd
+;; and vpconflictq from AVX-512CD, which targets that have them use
+;; instead.  Only the first 32 lanes can be represented in the result.
+;; $1: element type (i32 or i64)
+
+define(`conflict_detect', `
+define <WIDTH x i32> @__conflict_$1(<WIDTH x $1> %v,
+                                     <WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %acc_0 = bitcast <WIDTH x i32> zeroinitializer to <WIDTH x i32>
+forloop(k, 0, ifelse(eval(WIDTH > 32), `1', `31', `eval(WIDTH-1)'), `
+  %e_`'k = extractelement <WIDTH x $1> %v, i32 k
+  %ins_`'k = insertelement <WIDTH x $1> undef, $1 %e_`'k, i32 0
+  %b_`'k = shufflevector <WIDTH x $1> %ins_`'k, <WIDTH x $1> undef,
+             <WIDTH x i32> zeroinitializer
+  %eq_`'k = icmp eq <WIDTH x $1> %v, %b_`'k
+  %bit_`'k = select <WIDTH x i1> %eq_`'k,
+             <WIDTH x i32> <forloop(i, 0, eval(WIDTH-2), `i32 ifelse(eval(i > k), `1', eval(1 << k), `0'), ')i32 ifelse(eval(WIDTH-1 > k), `1', eval(1 << k), `0')>,
+             <WIDTH x i32> zeroinitializer
+  %acc_`'eval(k+1) = or <WIDTH x i32> %acc_`'k, %bit_`'k
+')
+  %mm = call i64 @__movmsk(<WIDTH x MASK> %mask)
+  %mm32 = trunc i64 %mm to i32
+  %mmi = insertelement <WIDTH x i32> undef, i32 %mm32, i32 0
+  %mmb = shufflevector <WIDTH x i32> %mmi, <WIDTH x i32> undef,
+             <WIDTH x i32> zeroinitializer
+  %r = and <WIDTH x i32> %acc_`'ifelse(eval(WIDTH > 32), `1', `32', `WIDTH'), %mmb
+  ret <WIDTH x i32> %r
+}
+')
+
+;; varying population count, using the target's scalar __popcnt_int32/64
+;; for each lane.
+
+define(`popcnt_varying_type', `
+define <WIDTH x $2> @__popcnt_varying_$1(<WIDTH x $2>) nounwind readnone alwaysinline {
+  %r_0 = bitcast <WIDTH x $2> undef to <WIDTH x $2>
+forloop(i, 0, eval(WIDTH-1), `
+  %v_`'i = extractelement <WIDTH x $2> %0, i32 i
+  %c_`'i = call $2 @__popcnt_$1($2 %v_`'i)
+  %r_`'eval(i+1) = insertelement <WIDTH x $2> %r_`'i, $2 %c_`'i, i32 i
+')
+  ret <WIDTH x $2> %r_`'WIDTH
+}
+')
+
+define(`popcnt_varying', `
+popcnt_varying_type(int32, i32)
+popcnt_varying_type(int64, i64)
+')
+
+;; parallel bit deposit/extract, looping over the set bits of the mask.
+;; $1: function name suffix, $2: integer type
+
+define(`pdep_generic', `
+define $2 @__pdep_$1($2 %src, $2 %mask) nounwind readnone alwaysinline {
+entry:
+  br label %loop_test
+
+loop_test:
+  %m = phi $2 [ %mask, %entry ], [ %m_next, %loop ]
+  %bit = phi $2 [ 1, %entry ], [ %bit_next, %loop ]
+  %r = phi $2 [ 0, %entry ], [ %r_next, %loop ]
+  %done = icmp eq $2 %m, 0
+  br i1 %done, label %exit, label %loop
+
+loop:
+  ;; deposit the next bit of src at the lowest remaining set bit of mask
+  %neg_m = sub $2 0, %m
+  %lowest = and $2 %m, %neg_m
+  %src_bit = and $2 %src, %bit
+  %is_set = icmp ne $2 %src_bit, 0
+  %r_or = or $2 %r, %lowest
+  %r_next = select i1 %is_set, $2 %r_or, $2 %r
+  %m_minus_1 = sub $2 %m, 1
+  %m_next = and $2 %m, %m_minus_1
+  %bit_next = shl $2 %bit, 1
+  br label %loop_test
+
+exit:
+  ret $2 %r
+}
+')
+
+define(`pext_generic', `
+define $2 @__pext_$1($2 %src, $2 %mask) nounwind readnone alwaysinline {
+entry:
+  br label %loop_test
+
+loop_test:
+  %m = phi $2 [ %mask, %entry ], [ %m_next, %loop ]
+  %bit = phi $2 [ 1, %entry ], [ %bit_next, %loop ]
+  %r = phi $2 [ 0, %entry ], [ %r_next, %loop ]
+  %done = icmp eq $2 %m, 0
+  br i1 %done, label %exit, label %loop
+
+loop:
+  ;; gather the bit of src at the lowest remaining set bit of mask
+  %neg_m = sub $2 0, %m
+  %lowest = and $2 %m, %neg_m
+  %src_bit = and $2 %src, %lowest
+  %is_set = icmp ne $2 %src_bit, 0
+  %r_or = or $2 %r, %bit
+  %r_next = select i1 %is_set, $2 %r_or, $2 %r
+  %m_minus_1 = sub $2 %m, 1
+  %m_next = and $2 %m, %m_minus_1
+  %bit_next = shl $2 %bit, 1
+  br label %loop_test
+
+exit:
+  ret $2 %r
+}
+')
+
+define(`pdep_pext', `
+pdep_generic(u32, i32)
+pdep_generic(u64, i64)
+pext_generic(u32, i32)
+pext_generic(u64, i64)
+')
+
 define(`stdlib_core', `
 
 declare i32 @__fast_masked_vload()
+declare i32 @__sparse_gather_threshold()
+
+ifelse(HAVE_CONFLICT, `1', `', `conflict_detect(i32)')
+ifelse(HAVE_CONFLICT_I64, `1', `', `conflict_detect(i64)')
+popcnt_varying()
+pdep_pext()
 
 declare void @ISPCInstrument(i8*, i8*, i32, i64) nounwind
+declare void @ISPCOccupancyRegister(i8*, i64*) nounwind
+declare void @ISPCTraceMemory(i8*, i32, i32, i32, i32, i64*, i64) nounwind
 
 declare i1 @__is_compile_time_constant_mask(<WIDTH x MASK> %mask)
 declare i1 @__is_compile_time_constant_uniform_int32(i32)
@@ -3482,6 +3636,38 @@ define <WIDTH x i16> @__p$1us_vi16(<WIDTH x i16>, <WIDTH x i16>) {
 define(`saturation_arithmetic_novec', `
 saturation_arithmetic_novec_universal(sub)
 saturation_arithmetic_novec_universal(add)
+saturating_narrowing_novec()
+')
+
+;; saturating narrowing conversions
+;;
+;; __sat_trunc_<from>_<to>() clamps each element to the range of the
+;; narrower type and then truncates it.
+;; $1: function name suffix
+;; $2: source element type
+;; $3: destination element type
+;; $4: {sgt,ugt} comparison for the upper bound
+;; $5: lower bound
+;; $6: upper bound
+
+define(`saturating_narrow_universal', `
+define <WIDTH x $3> @__sat_trunc_$1(<WIDTH x $2>) nounwind readnone alwaysinline {
+  %over_mask = icmp $4 <WIDTH x $2> %0, const_vector($2, $6)
+  %over_res = select <WIDTH x i1> %over_mask, <WIDTH x $2> const_vector($2, $6), <WIDTH x $2> %0
+  %under_mask = icmp slt <WIDTH x $2> %over_res, const_vector($2, $5)
+  %ret_wide = select <WIDTH x i1> %under_mask, <WIDTH x $2> const_vector($2, $5), <WIDTH x $2> %over_res
+  %ret = trunc <WIDTH x $2> %ret_wide to <WIDTH x $3>
+  ret <WIDTH x $3> %ret
+}
+')
+
+define(`saturating_narrowing_novec', `
+saturating_narrow_universal(int16_int8, i16, i8, sgt, -128, 127)
+saturating_narrow_universal(int16_uint8, i16, i8, sgt, 0, 255)
+saturating_narrow_universal(uint16_uint8, i16, i8, ugt, 0, 255)
+saturating_narrow_universal(int32_int16, i32, i16, sgt, -32768, 32767)
+saturating_narrow_universal(int32_uint16, i32, i16, sgt, 0, 65535)
+saturating_narrow_universal(uint32_uint16, i32, i16, ugt, 0, 65535)
 ')
 
 declare void @__pseudo_prefetch_read_varying_1(<WIDTH x i64>, <WIDTH x MASK>) nounwind
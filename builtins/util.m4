@@ -220,9 +220,11 @@ define(`saturation_arithmetic',
 `ifelse(WIDTH,  `4', `saturation_arithmetic_vec4()', 
         WIDTH,  `8', `saturation_arithmetic_vec8()',
         WIDTH, `16', `saturation_arithmetic_vec16() ',
+        WIDTH, `32', `saturation_arithmetic_vec32() ',
                      `errprint(`ERROR: saturation_arithmetic() macro called with unsupported width = 'WIDTH
 )
                       m4exit(`1')')
+saturating_narrowing_sse()
 ')
 
 ;; create vector constant. Used by saturation_arithmetic_novec_universal below.
@@ -305,6 +307,7 @@ define <WIDTH x i16> @__p$1us_vi16(<WIDTH x i16>, <WIDTH x i16>) {
 define(`saturation_arithmetic_novec', `
 saturation_arithmetic_novec_universal(sub)
 saturation_arithmetic_novec_universal(add)
+saturating_narrowing_novec()
 ')
 
 ;;4-wide vector saturation arithmetic
@@ -499,6 +502,148 @@ define <16 x i16> @__psubus_vi16(<16 x i16> %a0, <16 x i16> %a1) {
 }
 ')
 
+define(`saturation_arithmetic_vec32', `
+declare <32 x i8> @llvm.x86.avx2.padds.b(<32 x i8>, <32 x i8>) nounwind readnone
+define <32 x i8> @__padds_vi8(<32 x i8> %a0, <32 x i8> %a1) {
+  %res = call <32 x i8> @llvm.x86.avx2.padds.b(<32 x i8> %a0, <32 x i8> %a1)
+  ret <32 x i8> %res
+}
+
+declare <16 x i16> @llvm.x86.avx2.padds.w(<16 x i16>, <16 x i16>) nounwind readnone
+define <32 x i16> @__padds_vi16(<32 x i16> %a0, <32 x i16> %a1) {
+  binary_split(ret, 32, 16, i16, i16, @llvm.x86.avx2.padds.w, %a0, %a1)
+  ret <32 x i16> %ret
+}
+
+declare <32 x i8> @llvm.x86.avx2.paddus.b(<32 x i8>, <32 x i8>) nounwind readnone
+define <32 x i8> @__paddus_vi8(<32 x i8> %a0, <32 x i8> %a1) {
+  %res = call <32 x i8> @llvm.x86.avx2.paddus.b(<32 x i8> %a0, <32 x i8> %a1)
+  ret <32 x i8> %res
+}
+
+declare <16 x i16> @llvm.x86.avx2.paddus.w(<16 x i16>, <16 x i16>) nounwind readnone
+define <32 x i16> @__paddus_vi16(<32 x i16> %a0, <32 x i16> %a1) {
+  binary_split(ret, 32, 16, i16, i16, @llvm.x86.avx2.paddus.w, %a0, %a1)
+  ret <32 x i16> %ret
+}
+
+declare <32 x i8> @llvm.x86.avx2.psubs.b(<32 x i8>, <32 x i8>) nounwind readnone
+define <32 x i8> @__psubs_vi8(<32 x i8> %a0, <32 x i8> %a1) {
+  %res = call <32 x i8> @llvm.x86.avx2.psubs.b(<32 x i8> %a0, <32 x i8> %a1)
+  ret <32 x i8> %res
+}
+
+declare <16 x i16> @llvm.x86.avx2.psubs.w(<16 x i16>, <16 x i16>) nounwind readnone
+define <32 x i16> @__psubs_vi16(<32 x i16> %a0, <32 x i16> %a1) {
+  binary_split(ret, 32, 16, i16, i16, @llvm.x86.avx2.psubs.w, %a0, %a1)
+  ret <32 x i16> %ret
+}
+
+declare <32 x i8> @llvm.x86.avx2.psubus.b(<32 x i8>, <32 x i8>) nounwind readnone
+define <32 x i8> @__psubus_vi8(<32 x i8> %a0, <32 x i8> %a1) {
+  %res = call <32 x i8> @llvm.x86.avx2.psubus.b(<32 x i8> %a0, <32 x i8> %a1)
+  ret <32 x i8> %res
+}
+
+declare <16 x i16> @llvm.x86.avx2.psubus.w(<16 x i16>, <16 x i16>) nounwind readnone
+define <32 x i16> @__psubus_vi16(<32 x i16> %a0, <32 x i16> %a1) {
+  binary_split(ret, 32, 16, i16, i16, @llvm.x86.avx2.psubus.w, %a0, %a1)
+  ret <32 x i16> %ret
+}
+')
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; saturating narrowing conversions
+;;
+;; __sat_trunc_<from>_<to>() clamps each element to the range of the
+;; narrower type and then truncates it.
+
+;; utility function used by saturating_narrowing_novec and
+;; saturating_narrowing_sse below.
+;; $1: function name suffix
+;; $2: source element type
+;; $3: destination element type
+;; $4: {sgt,ugt} comparison for the upper bound
+;; $5: lower bound
+;; $6: upper bound
+
+define(`saturating_narrow_universal', `
+define <WIDTH x $3> @__sat_trunc_$1(<WIDTH x $2>) nounwind readnone alwaysinline {
+  %over_mask = icmp $4 <WIDTH x $2> %0, const_vector($2, $6)
+  %over_res = select <WIDTH x i1> %over_mask, <WIDTH x $2> const_vector($2, $6), <WIDTH x $2> %0
+  %under_mask = icmp slt <WIDTH x $2> %over_res, const_vector($2, $5)
+  %ret_wide = select <WIDTH x i1> %under_mask, <WIDTH x $2> const_vector($2, $5), <WIDTH x $2> %over_res
+  %ret = trunc <WIDTH x $2> %ret_wide to <WIDTH x $3>
+  ret <WIDTH x $3> %ret
+}
+')
+
+define(`saturating_narrowing_novec', `
+saturating_narrow_universal(int16_int8, i16, i8, sgt, -128, 127)
+saturating_narrow_universal(int16_uint8, i16, i8, sgt, 0, 255)
+saturating_narrow_universal(uint16_uint8, i16, i8, ugt, 0, 255)
+saturating_narrow_universal(int32_int16, i32, i16, sgt, -32768, 32767)
+saturating_narrow_universal(int32_uint16, i32, i16, sgt, 0, 65535)
+saturating_narrow_universal(uint32_uint16, i32, i16, ugt, 0, 65535)
+')
+
+;; Calls an SSE pack instruction, which narrows the elements of two 128-bit
+;; vectors into one, for each pair of 128-bit parts of the source vector,
+;; and assembles the results.
+;; $1: name of variable to put the final value in
+;; $2: vector width of the target
+;; $3: number of source elements in 128 bits
+;; $4: source element type
+;; $5: destination element type
+;; $6: pack intrinsic
+;; $7: source vector
+
+define(`pack_split', `forloop(k, 0, eval($2/(2*$3)-1), `
+  %$1_a`'k = shufflevector <$2 x $4> $7, <$2 x $4> undef,
+      <$3 x i32> <split_seq(eval(2*k*$3), $3)>
+  %$1_b`'k = shufflevector <$2 x $4> $7, <$2 x $4> undef,
+      <$3 x i32> <split_seq(eval(2*k*$3+$3), $3)>
+  %$1_r`'k = call <eval(2*$3) x $5> $6(<$3 x $4> %$1_a`'k, <$3 x $4> %$1_b`'k)
+  split_merge($1, $2, eval(2*$3), $4, $5)')
+')
+
+;; $1: function name suffix
+;; $2: source element type
+;; $3: destination element type
+;; $4: pack intrinsic
+;; $5: number of source elements in 128 bits
+
+define(`saturating_narrow_pack', `
+define <WIDTH x $3> @__sat_trunc_$1(<WIDTH x $2>) nounwind readnone alwaysinline {
+ifelse(eval(WIDTH <= $5), 1, `
+  %v = shufflevector <WIDTH x $2> %0, <WIDTH x $2> undef,
+      <$5 x i32> <widen_seq(WIDTH, $5)>
+  %p = call <eval(2*$5) x $3> $4(<$5 x $2> %v, <$5 x $2> undef)
+  %ret = shufflevector <eval(2*$5) x $3> %p, <eval(2*$5) x $3> undef,
+      <WIDTH x i32> <split_seq(0, WIDTH)>',
+  `pack_split(ret, WIDTH, $5, $2, $3, $4, %0)')
+  ret <WIDTH x $3> %ret
+}
+')
+
+;; The conversions from signed types map to packsswb, packuswb and
+;; packssdw; packusdw needs SSE4.1, so the conversion from int32 to uint16
+;; and the ones from unsigned types, which the pack instructions don't
+;; handle, are left to the code generator.
+
+define(`saturating_narrowing_sse', `
+declare <16 x i8> @llvm.x86.sse2.packsswb.128(<8 x i16>, <8 x i16>) nounwind readnone
+declare <16 x i8> @llvm.x86.sse2.packuswb.128(<8 x i16>, <8 x i16>) nounwind readnone
+declare <8 x i16> @llvm.x86.sse2.packssdw.128(<4 x i32>, <4 x i32>) nounwind readnone
+
+saturating_narrow_pack(int16_int8, i16, i8, @llvm.x86.sse2.packsswb.128, 8)
+saturating_narrow_pack(int16_uint8, i16, i8, @llvm.x86.sse2.packuswb.128, 8)
+saturating_narrow_pack(int32_int16, i32, i16, @llvm.x86.sse2.packssdw.128, 4)
+saturating_narrow_universal(uint16_uint8, i16, i8, ugt, 0, 255)
+saturating_narrow_universal(int32_uint16, i32, i16, sgt, 0, 65535)
+saturating_narrow_universal(uint32_uint16, i32, i16, ugt, 0, 65535)
+')
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
 ;; vector deconstruction utilities
@@ -656,6 +801,31 @@ define(`reduce16', `
 '
 )
 
+define(`reduce32', `
+  %v1 = shufflevector <32 x $1> %0, <32 x $1> undef,
+        <32 x i32> <i32 16, i32 17, i32 18, i32 19, i32 20, i32 21, i32 22, i32 23,
+                    i32 24, i32 25, i32 26, i32 27, i32 28, i32 29, i32 30, i32 31,
+                    forloop(i, 0, 14, `i32 undef, ')i32 undef>
+  %m1 = call <32 x $1> $2(<32 x $1> %v1, <32 x $1> %0)
+  %v2 = shufflevector <32 x $1> %m1, <32 x $1> undef,
+        <32 x i32> <i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15,
+                    forloop(i, 0, 22, `i32 undef, ')i32 undef>
+  %m2 = call <32 x $1> $2(<32 x $1> %v2, <32 x $1> %m1)
+  %v3 = shufflevector <32 x $1> %m2, <32 x $1> undef,
+        <32 x i32> <i32 4, i32 5, i32 6, i32 7,
+                    forloop(i, 0, 26, `i32 undef, ')i32 undef>
+  %m3 = call <32 x $1> $2(<32 x $1> %v3, <32 x $1> %m2)
+  %v4 = shufflevector <32 x $1> %m3, <32 x $1> undef,
+        <32 x i32> <i32 2, i32 3, forloop(i, 0, 28, `i32 undef, ')i32 undef>
+  %m4 = call <32 x $1> $2(<32 x $1> %v4, <32 x $1> %m3)
+
+  %m4a = extractelement <32 x $1> %m4, i32 0
+  %m4b = extractelement <32 x $1> %m4, i32 1
+  %m = call $1 $3($1 %m4a, $1 %m4b)
+  ret $1 %m
+'
+)
+
 ;; Do an reduction over an 8-wide vector, using a vector reduction function
 ;; that only takes 4-wide vectors
 ;; $1: type of final scalar result
@@ -1221,6 +1391,66 @@ ret <16 x double> %ret
 '
 )
 
+;; Generic helpers for targets whose gang is wider than the native vector
+;; width: split the operands into native-width pieces, apply the native
+;; function to each piece, and stitch the pieces back together.
+;; $1: name of variable into which the final result should go
+;; $2: total vector width of the operands
+;; $3: native vector width of the function
+;; $4: scalar type of the operand elements
+;; $5: scalar type of the result elements
+;; $6: native-width vector function to apply
+;; $7: operand value (for binary_split, $7 and $8 are the two operands)
+;; $8: (unary_split only) extra trailing call arguments, e.g. `, i32 8'
+
+define(`split_seq', `forloop(j, $1, eval($1+$2-2), `i32 j, ')i32 eval($1+$2-1)')
+
+define(`widen_seq', `forloop(j, 0, eval($2-1),
+  `i32 ifelse(eval(j < $1), 1, j, undef)`'ifelse(eval(j < $2-1), 1, `, ')')')
+
+define(`merge_seq', `forloop(j, 0, eval($3-1),
+  `i32 ifelse(eval(j >= ($1) && j < ($1)+($2)), 1, eval($3+j-($1)), j)`'ifelse(eval(j < $3-1), 1, `, ')')')
+
+define(`split_merge', `
+  %$1_wide`'k = shufflevector <$3 x $5> %$1_r`'k, <$3 x $5> undef,
+      <$2 x i32> <widen_seq($3, $2)>
+  ifelse(eval(k == $2/$3-1), 1, `%$1', `%$1_acc`'k') = shufflevector
+      <$2 x $5> ifelse(k, 0, `undef', `%$1_acc`'eval(k-1)'), <$2 x $5> %$1_wide`'k,
+      <$2 x i32> <merge_seq(eval(k*$3), $3, $2)>')
+
+define(`unary_split', `forloop(k, 0, eval($2/$3-1), `
+  %$1_v`'k = shufflevector <$2 x $4> $7, <$2 x $4> undef,
+      <$3 x i32> <split_seq(eval(k*$3), $3)>
+  %$1_r`'k = call <$3 x $5> $6(<$3 x $4> %$1_v`'k $8)
+  split_merge($1, $2, $3, $4, $5)')
+')
+
+define(`binary_split', `forloop(k, 0, eval($2/$3-1), `
+  %$1_a`'k = shufflevector <$2 x $4> $7, <$2 x $4> undef,
+      <$3 x i32> <split_seq(eval(k*$3), $3)>
+  %$1_b`'k = shufflevector <$2 x $4> $8, <$2 x $4> undef,
+      <$3 x i32> <split_seq(eval(k*$3), $3)>
+  %$1_r`'k = call <$3 x $5> $6(<$3 x $4> %$1_a`'k, <$3 x $4> %$1_b`'k)
+  split_merge($1, $2, $3, $4, $5)')
+')
+
+;; 32-wide versions of the `unary8to16' family, in terms of the above.
+
+define(`unary4to32', `unary_split($1, 32, 4, $2, $2, $3, $4)')
+define(`unary8to32', `unary_split($1, 32, 8, $2, $2, $3, $4)')
+define(`binary4to32', `binary_split($1, 32, 4, $2, $2, $3, $4, $5)')
+define(`binary8to32', `binary_split($1, 32, 8, $2, $2, $3, $4, $5)')
+
+define(`round8to32', `
+unary_split(ret, 32, 8, float, float, @llvm.x86.avx.round.ps.256, $1, `, i32 $2')
+ret <32 x float> %ret
+')
+
+define(`round4to32double', `
+unary_split(ret, 32, 4, double, double, @llvm.x86.avx.round.pd.256, $1, `, i32 $2')
+ret <32 x double> %ret
+')
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; forloop macro
 
@@ -1302,7 +1532,7 @@ define <WIDTH x $1> @__shift_$1(<WIDTH x $1>, i32) nounwind readnone alwaysinlin
   ret <WIDTH x $1> %result
 }
 
-
+ifelse(`$3', `', `
 define <WIDTH x $1> @__shuffle_$1(<WIDTH x $1>, <WIDTH x i32>) nounwind readnone alwaysinline {
 forloop(i, 0, eval(WIDTH-1), `  
   %index_`'i = extractelement <WIDTH x i32> %1, i32 i')
@@ -1355,17 +1585,68 @@ forloop(i, 1, eval(WIDTH-1), `
 
   ret <WIDTH x $1> %result_`'eval(WIDTH-1)
 }
+', `shuffles_$3($1, $2)')
 ')
 
 define(`define_shuffles',`
 shuffles(i8, 1)
 shuffles(i16, 2)
+ifelse(HAVE_PERMD, `1', `ifelse(WIDTH, `8', `
+shuffles(float, 4, permd)
+shuffles(i32, 4, permd)', `
 shuffles(float, 4)
-shuffles(i32, 4)
+shuffles(i32, 4)')', `
+shuffles(float, 4)
+shuffles(i32, 4)')
 shuffles(double, 8)
 shuffles(i64, 8)
 ')
 
+;; Variable permutes of 32-bit values for 8-wide AVX2 targets: a single
+;; vpermd handles the one-vector case, and the two-vector case does one
+;; vpermd per input and selects between them with the bit of the index
+;; above the low three, rather than going through memory.  (vpermd is
+;; declared with the AVX2 packed load and store functions, which are always
+;; used along with these on these targets.)
+
+define(`shuffles_permd', `
+define <8 x $1> @__shuffle_$1(<8 x $1>, <8 x i32>) nounwind readnone alwaysinline {
+  %vi = bitcast <8 x $1> %0 to <8 x i32>
+  %ri = call <8 x i32> @llvm.x86.avx2.permd(<8 x i32> %vi, <8 x i32> %1)
+  %r = bitcast <8 x i32> %ri to <8 x $1>
+  ret <8 x $1> %r
+}
+
+define <8 x $1> @__shuffle2_$1(<8 x $1>, <8 x $1>, <8 x i32>) nounwind readnone alwaysinline {
+  %isc = call i1 @__is_compile_time_constant_varying_int32(<8 x i32> %2)
+  br i1 %isc, label %is_const, label %not_const
+
+is_const:
+  %v2 = shufflevector <8 x $1> %0, <8 x $1> %1, <16 x i32> <
+      forloop(i, 0, 14, `i32 i, ') i32 15
+  >
+forloop(i, 0, 7, `
+  %index_`'i = extractelement <8 x i32> %2, i32 i
+  %v_`'i = extractelement <16 x $1> %v2, i32 %index_`'i')
+
+  %ret_0 = insertelement <8 x $1> undef, $1 %v_0, i32 0
+forloop(i, 1, 7, `  %ret_`'i = insertelement <8 x $1> %ret_`'eval(i-1), $1 %v_`'i, i32 i
+')
+  ret <8 x $1> %ret_7
+
+not_const:
+  %v0i = bitcast <8 x $1> %0 to <8 x i32>
+  %v1i = bitcast <8 x $1> %1 to <8 x i32>
+  %r0 = call <8 x i32> @llvm.x86.avx2.permd(<8 x i32> %v0i, <8 x i32> %2)
+  %r1 = call <8 x i32> @llvm.x86.avx2.permd(<8 x i32> %v1i, <8 x i32> %2)
+  %hibit = and <8 x i32> %2, <i32 8, i32 8, i32 8, i32 8, i32 8, i32 8, i32 8, i32 8>
+  %second = icmp ne <8 x i32> %hibit, zeroinitializer
+  %ri = select <8 x i1> %second, <8 x i32> %r1, <8 x i32> %r0
+  %r = bitcast <8 x i32> %ri to <8 x $1>
+  ret <8 x $1> %r
+}
+')
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; global_atomic_associative
 ;; More efficient implementation for atomics that are associative (e.g.,
@@ -1660,9 +1941,162 @@ define i64 @__count_leading_zeros_i64(i64) nounwind readnone alwaysinline {
 }
 ')
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; varying population count
+;;
+;; llvm.ctpop on a vector is lowered to vpopcnt where the target has it,
+;; to a pshufb nibble lookup on targets with SSSE3 or AVX2, and to vcnt
+;; on NEON.  Targets that go through the C++ backend (SCALAR_POPCNT) call
+;; their scalar __popcnt_int32/64 for each lane instead.
+
+define(`popcnt_varying_type', `
+ifelse(SCALAR_POPCNT, `1', `
+define <WIDTH x $2> @__popcnt_varying_$1(<WIDTH x $2>) nounwind readnone alwaysinline {
+  %r_0 = bitcast <WIDTH x $2> undef to <WIDTH x $2>
+forloop(i, 0, eval(WIDTH-1), `
+  %v_`'i = extractelement <WIDTH x $2> %0, i32 i
+  %c_`'i = call $2 @__popcnt_$1($2 %v_`'i)
+  %r_`'eval(i+1) = insertelement <WIDTH x $2> %r_`'i, $2 %c_`'i, i32 i
+')
+  ret <WIDTH x $2> %r_`'WIDTH
+}
+', `
+declare <WIDTH x $2> @llvm.ctpop.v`'WIDTH`'$2(<WIDTH x $2>) nounwind readnone
+
+define <WIDTH x $2> @__popcnt_varying_$1(<WIDTH x $2>) nounwind readnone alwaysinline {
+  %c = call <WIDTH x $2> @llvm.ctpop.v`'WIDTH`'$2(<WIDTH x $2> %0)
+  ret <WIDTH x $2> %c
+}
+')
+')
+
+define(`popcnt_varying', `
+popcnt_varying_type(int32, i32)
+popcnt_varying_type(int64, i64)
+')
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; parallel bit deposit/extract
+;;
+;; Targets with BMI2 (HAVE_BMI2) map these directly to pdep and pext;
+;; elsewhere they loop over the set bits of the mask.
+
+define(`pdep_pext_bmi2', `
+declare i32 @llvm.x86.bmi.pdep.32(i32, i32) nounwind readnone
+declare i64 @llvm.x86.bmi.pdep.64(i64, i64) nounwind readnone
+declare i32 @llvm.x86.bmi.pext.32(i32, i32) nounwind readnone
+declare i64 @llvm.x86.bmi.pext.64(i64, i64) nounwind readnone
+
+define i32 @__pdep_u32(i32, i32) nounwind readnone alwaysinline {
+  %r = call i32 @llvm.x86.bmi.pdep.32(i32 %0, i32 %1)
+  ret i32 %r
+}
+
+define i64 @__pdep_u64(i64, i64) nounwind readnone alwaysinline {
+  %r = call i64 @llvm.x86.bmi.pdep.64(i64 %0, i64 %1)
+  ret i64 %r
+}
+
+define i32 @__pext_u32(i32, i32) nounwind readnone alwaysinline {
+  %r = call i32 @llvm.x86.bmi.pext.32(i32 %0, i32 %1)
+  ret i32 %r
+}
+
+define i64 @__pext_u64(i64, i64) nounwind readnone alwaysinline {
+  %r = call i64 @llvm.x86.bmi.pext.64(i64 %0, i64 %1)
+  ret i64 %r
+}
+')
+
+;; $1: function name suffix, $2: integer type
+
+define(`pdep_generic', `
+define $2 @__pdep_$1($2 %src, $2 %mask) nounwind readnone alwaysinline {
+entry:
+  br label %loop_test
+
+loop_test:
+  %m = phi $2 [ %mask, %entry ], [ %m_next, %loop ]
+  %bit = phi $2 [ 1, %entry ], [ %bit_next, %loop ]
+  %r = phi $2 [ 0, %entry ], [ %r_next, %loop ]
+  %done = icmp eq $2 %m, 0
+  br i1 %done, label %exit, label %loop
+
+loop:
+  ;; deposit the next bit of src at the lowest remaining set bit of mask
+  %neg_m = sub $2 0, %m
+  %lowest = and $2 %m, %neg_m
+  %src_bit = and $2 %src, %bit
+  %is_set = icmp ne $2 %src_bit, 0
+  %r_or = or $2 %r, %lowest
+  %r_next = select i1 %is_set, $2 %r_or, $2 %r
+  %m_minus_1 = sub $2 %m, 1
+  %m_next = and $2 %m, %m_minus_1
+  %bit_next = shl $2 %bit, 1
+  br label %loop_test
+
+exit:
+  ret $2 %r
+}
+')
+
+define(`pext_generic', `
+define $2 @__pext_$1($2 %src, $2 %mask) nounwind readnone alwaysinline {
+entry:
+  br label %loop_test
+
+loop_test:
+  %m = phi $2 [ %mask, %entry ], [ %m_next, %loop ]
+  %bit = phi $2 [ 1, %entry ], [ %bit_next, %loop ]
+  %r = phi $2 [ 0, %entry ], [ %r_next, %loop ]
+  %done = icmp eq $2 %m, 0
+  br i1 %done, label %exit, label %loop
+
+loop:
+  ;; gather the bit of src at the lowest remaining set bit of mask
+  %neg_m = sub $2 0, %m
+  %lowest = and $2 %m, %neg_m
+  %src_bit = and $2 %src, %lowest
+  %is_set = icmp ne $2 %src_bit, 0
+  %r_or = or $2 %r, %bit
+  %r_next = select i1 %is_set, $2 %r_or, $2 %r
+  %m_minus_1 = sub $2 %m, 1
+  %m_next = and $2 %m, %m_minus_1
+  %bit_next = shl $2 %bit, 1
+  br label %loop_test
+
+exit:
+  ret $2 %r
+}
+')
+
+define(`pdep_pext', `
+ifelse(HAVE_BMI2, `1', `pdep_pext_bmi2()', `
+pdep_generic(u32, i32)
+pdep_generic(u64, i64)
+pext_generic(u32, i32)
+pext_generic(u64, i64)
+')
+')
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; prefetching
 
+;; Per-lane varying prefetch: $1 is the suffix of the function name, $2
+;; the locality argument to llvm.prefetch.  Targets with vector prefetch
+;; instructions define HAVE_GATHER_PREFETCH and provide their own.
+
+define(`prefetch_read_varying', `
+define void @__prefetch_read_varying_$1(<WIDTH x i64> %addr, <WIDTH x MASK> %mask) alwaysinline {
+  per_lane(WIDTH, <WIDTH x MASK> %mask, `
+  %iptr_LANE_ID = extractelement <WIDTH x i64> %addr, i32 LANE
+  %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8*
+  call void @llvm.prefetch(i8 * %ptr_LANE_ID, i32 0, i32 $2, i32 1)
+  ')
+  ret void
+}
+')
+
 define(`define_prefetches', `
 declare void @llvm.prefetch(i8* nocapture %ptr, i32 %readwrite, i32 %locality,
                             i32 %cachetype) ; cachetype == 1 is dcache
@@ -1687,48 +2121,16 @@ define void @__prefetch_read_uniform_nt(i8 *) alwaysinline {
   ret void
 }
 
-define void @__prefetch_read_varying_1(<WIDTH x i64> %addr, <WIDTH x MASK> %mask) alwaysinline {
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-  %iptr_LANE_ID = extractelement <WIDTH x i64> %addr, i32 LANE
-  %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8*
-  call void @llvm.prefetch(i8 * %ptr_LANE_ID, i32 0, i32 3, i32 1)
-  ')
-  ret void
-}
+ifelse(HAVE_GATHER_PREFETCH, `1', `', `
+prefetch_read_varying(1, 3)
+prefetch_read_varying(2, 2)
+prefetch_read_varying(3, 1)
+prefetch_read_varying(nt, 0)
+')
 
 declare void @__prefetch_read_varying_1_native(i8 * %base, i32 %scale, <WIDTH x i32> %offsets, <WIDTH x MASK> %mask) nounwind
-
-define void @__prefetch_read_varying_2(<WIDTH x i64> %addr, <WIDTH x MASK> %mask) alwaysinline {
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-  %iptr_LANE_ID = extractelement <WIDTH x i64> %addr, i32 LANE
-  %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8*
-  call void @llvm.prefetch(i8 * %ptr_LANE_ID, i32 0, i32 2, i32 1)
-  ')
-  ret void
-}
-
 declare void @__prefetch_read_varying_2_native(i8 * %base, i32 %scale, <WIDTH x i32> %offsets, <WIDTH x MASK> %mask) nounwind
-
-define void @__prefetch_read_varying_3(<WIDTH x i64> %addr, <WIDTH x MASK> %mask) alwaysinline {
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-  %iptr_LANE_ID = extractelement <WIDTH x i64> %addr, i32 LANE
-  %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8*
-  call void @llvm.prefetch(i8 * %ptr_LANE_ID, i32 0, i32 1, i32 1)
-  ')
-  ret void
-}
-
 declare void @__prefetch_read_varying_3_native(i8 * %base, i32 %scale, <WIDTH x i32> %offsets, <WIDTH x MASK> %mask) nounwind
-
-define void @__prefetch_read_varying_nt(<WIDTH x i64> %addr, <WIDTH x MASK> %mask) alwaysinline {
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-  %iptr_LANE_ID = extractelement <WIDTH x i64> %addr, i32 LANE
-  %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8*
-  call void @llvm.prefetch(i8 * %ptr_LANE_ID, i32 0, i32 0, i32 1)
-  ')
-  ret void
-}
-
 declare void @__prefetch_read_varying_nt_native(i8 * %base, i32 %scale, <WIDTH x i32> %offsets, <WIDTH x MASK> %mask) nounwind
 ')
 
@@ -2275,6 +2677,142 @@ define void
   ret void
 }
 
+;; 32-wide versions operate on two 16-wide halves
+
+ifelse(WIDTH, `32', `
+define void
+@__aos_to_soa4_float32(<32 x float> %v0, <32 x float> %v1, <32 x float> %v2, <32 x float> %v3,
+        <32 x float> * noalias %out0, <32 x float> * noalias %out1, <32 x float> * noalias %out2, <32 x float> * noalias %out3) nounwind alwaysinline {
+  %v0lo = shufflevector <32 x float> %v0, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v0hi = shufflevector <32 x float> %v0, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v1lo = shufflevector <32 x float> %v1, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v1hi = shufflevector <32 x float> %v1, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v2lo = shufflevector <32 x float> %v2, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v2hi = shufflevector <32 x float> %v2, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v3lo = shufflevector <32 x float> %v3, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v3hi = shufflevector <32 x float> %v3, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+
+  %out0a = bitcast <32 x float> * %out0 to <16 x float> *
+  %out0b = getelementptr PTR_OP_ARGS(`<16 x float>') %out0a, i32 1
+  %out1a = bitcast <32 x float> * %out1 to <16 x float> *
+  %out1b = getelementptr PTR_OP_ARGS(`<16 x float>') %out1a, i32 1
+  %out2a = bitcast <32 x float> * %out2 to <16 x float> *
+  %out2b = getelementptr PTR_OP_ARGS(`<16 x float>') %out2a, i32 1
+  %out3a = bitcast <32 x float> * %out3 to <16 x float> *
+  %out3b = getelementptr PTR_OP_ARGS(`<16 x float>') %out3a, i32 1
+
+  call void @__aos_to_soa4_float16(<16 x float> %v0lo, <16 x float> %v0hi, <16 x float> %v1lo, <16 x float> %v1hi,
+         <16 x float> * %out0a, <16 x float> * %out1a, <16 x float> * %out2a, <16 x float> * %out3a)
+  call void @__aos_to_soa4_float16(<16 x float> %v2lo, <16 x float> %v2hi, <16 x float> %v3lo, <16 x float> %v3hi,
+         <16 x float> * %out0b, <16 x float> * %out1b, <16 x float> * %out2b, <16 x float> * %out3b)
+  ret void
+}
+
+define void
+@__soa_to_aos4_float32(<32 x float> %v0, <32 x float> %v1, <32 x float> %v2, <32 x float> %v3,
+        <32 x float> * noalias %out0, <32 x float> * noalias %out1, <32 x float> * noalias %out2, <32 x float> * noalias %out3) nounwind alwaysinline {
+  %v0lo = shufflevector <32 x float> %v0, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v0hi = shufflevector <32 x float> %v0, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v1lo = shufflevector <32 x float> %v1, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v1hi = shufflevector <32 x float> %v1, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v2lo = shufflevector <32 x float> %v2, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v2hi = shufflevector <32 x float> %v2, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v3lo = shufflevector <32 x float> %v3, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v3hi = shufflevector <32 x float> %v3, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+
+  %out0a = bitcast <32 x float> * %out0 to <16 x float> *
+  %out0b = getelementptr PTR_OP_ARGS(`<16 x float>') %out0a, i32 1
+  %out1a = bitcast <32 x float> * %out1 to <16 x float> *
+  %out1b = getelementptr PTR_OP_ARGS(`<16 x float>') %out1a, i32 1
+  %out2a = bitcast <32 x float> * %out2 to <16 x float> *
+  %out2b = getelementptr PTR_OP_ARGS(`<16 x float>') %out2a, i32 1
+  %out3a = bitcast <32 x float> * %out3 to <16 x float> *
+  %out3b = getelementptr PTR_OP_ARGS(`<16 x float>') %out3a, i32 1
+
+  call void @__soa_to_aos4_float16(<16 x float> %v0lo, <16 x float> %v1lo, <16 x float> %v2lo, <16 x float> %v3lo,
+         <16 x float> * %out0a, <16 x float> * %out0b, <16 x float> * %out1a, <16 x float> * %out1b)
+  call void @__soa_to_aos4_float16(<16 x float> %v0hi, <16 x float> %v1hi, <16 x float> %v2hi, <16 x float> %v3hi,
+         <16 x float> * %out2a, <16 x float> * %out2b, <16 x float> * %out3a, <16 x float> * %out3b)
+  ret void
+}
+
+define void
+@__aos_to_soa3_float32(<32 x float> %v0, <32 x float> %v1, <32 x float> %v2,
+        <32 x float> * noalias %out0, <32 x float> * noalias %out1, <32 x float> * noalias %out2) nounwind alwaysinline {
+  %v0lo = shufflevector <32 x float> %v0, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v0hi = shufflevector <32 x float> %v0, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v1lo = shufflevector <32 x float> %v1, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v1hi = shufflevector <32 x float> %v1, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v2lo = shufflevector <32 x float> %v2, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v2hi = shufflevector <32 x float> %v2, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+
+  %out0a = bitcast <32 x float> * %out0 to <16 x float> *
+  %out0b = getelementptr PTR_OP_ARGS(`<16 x float>') %out0a, i32 1
+  %out1a = bitcast <32 x float> * %out1 to <16 x float> *
+  %out1b = getelementptr PTR_OP_ARGS(`<16 x float>') %out1a, i32 1
+  %out2a = bitcast <32 x float> * %out2 to <16 x float> *
+  %out2b = getelementptr PTR_OP_ARGS(`<16 x float>') %out2a, i32 1
+
+  call void @__aos_to_soa3_float16(<16 x float> %v0lo, <16 x float> %v0hi, <16 x float> %v1lo,
+         <16 x float> * %out0a, <16 x float> * %out1a, <16 x float> * %out2a)
+  call void @__aos_to_soa3_float16(<16 x float> %v1hi, <16 x float> %v2lo, <16 x float> %v2hi,
+         <16 x float> * %out0b, <16 x float> * %out1b, <16 x float> * %out2b)
+  ret void
+}
+
+define void
+@__soa_to_aos3_float32(<32 x float> %v0, <32 x float> %v1, <32 x float> %v2,
+        <32 x float> * noalias %out0, <32 x float> * noalias %out1, <32 x float> * noalias %out2) nounwind alwaysinline {
+  %v0lo = shufflevector <32 x float> %v0, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v0hi = shufflevector <32 x float> %v0, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v1lo = shufflevector <32 x float> %v1, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v1hi = shufflevector <32 x float> %v1, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+  %v2lo = shufflevector <32 x float> %v2, <32 x float> undef,
+         <16 x i32> <forloop(i, 0, 14, `i32 i, ')i32 15>
+  %v2hi = shufflevector <32 x float> %v2, <32 x float> undef,
+         <16 x i32> <forloop(i, 16, 30, `i32 i, ')i32 31>
+
+  %out0a = bitcast <32 x float> * %out0 to <16 x float> *
+  %out0b = getelementptr PTR_OP_ARGS(`<16 x float>') %out0a, i32 1
+  %out1a = bitcast <32 x float> * %out1 to <16 x float> *
+  %out1b = getelementptr PTR_OP_ARGS(`<16 x float>') %out1a, i32 1
+  %out2a = bitcast <32 x float> * %out2 to <16 x float> *
+  %out2b = getelementptr PTR_OP_ARGS(`<16 x float>') %out2a, i32 1
+
+  call void @__soa_to_aos3_float16(<16 x float> %v0lo, <16 x float> %v1lo, <16 x float> %v2lo,
+         <16 x float> * %out0a, <16 x float> * %out0b, <16 x float> * %out1a)
+  call void @__soa_to_aos3_float16(<16 x float> %v0hi, <16 x float> %v1hi, <16 x float> %v2hi,
+         <16 x float> * %out1b, <16 x float> * %out2a, <16 x float> * %out2b)
+  ret void
+}
+')
+
 ;; versions to be called from stdlib
 
 define void
@@ -2339,6 +2877,129 @@ define void
          <WIDTH x float> * %out2)
   ret void
 }
+
+aossoa_more(`aossoa_fields')
+')
+
+;; AOS/SOA conversions for other numbers of fields and for 64-bit types.
+;; The N input vectors are concatenated (padded with undef up to a power
+;; of two), and each output vector is then a single strided shuffle of the
+;; result; the target's shuffle lowering turns these into the appropriate
+;; sequence of unpack, blend and permute instructions.
+;;
+;; $1: element type (float or double)
+;; $2: number of fields (2, 3, 4, 6 or 8)
+;; $3: alignment of elements of type $1
+
+define(`aossoa_padded', `ifelse($1, `2', `2', $1, `3', `4', $1, `4', `4', `8')')
+
+define(`aossoa_seq', `forloop(j, 0, eval($1-2), `i32 j, ') i32 eval($1-1)')
+
+define(`aossoa_concat', `ifelse(aossoa_padded($2), `2', `
+  %all = shufflevector <WIDTH x $1> %v0, <WIDTH x $1> %v1,
+           <eval(2*WIDTH) x i32> <aossoa_seq(eval(2*WIDTH))>', aossoa_padded($2), `4', `
+  %c0 = shufflevector <WIDTH x $1> %v0, <WIDTH x $1> %v1,
+           <eval(2*WIDTH) x i32> <aossoa_seq(eval(2*WIDTH))>
+  %c1 = shufflevector <WIDTH x $1> %v2, <WIDTH x $1> ifelse($2, `4', `%v3', `undef'),
+           <eval(2*WIDTH) x i32> <aossoa_seq(eval(2*WIDTH))>
+  %all = shufflevector <eval(2*WIDTH) x $1> %c0, <eval(2*WIDTH) x $1> %c1,
+           <eval(4*WIDTH) x i32> <aossoa_seq(eval(4*WIDTH))>', `
+  %c0 = shufflevector <WIDTH x $1> %v0, <WIDTH x $1> %v1,
+           <eval(2*WIDTH) x i32> <aossoa_seq(eval(2*WIDTH))>
+  %c1 = shufflevector <WIDTH x $1> %v2, <WIDTH x $1> %v3,
+           <eval(2*WIDTH) x i32> <aossoa_seq(eval(2*WIDTH))>
+  %c2 = shufflevector <WIDTH x $1> %v4, <WIDTH x $1> %v5,
+           <eval(2*WIDTH) x i32> <aossoa_seq(eval(2*WIDTH))>
+  %d0 = shufflevector <eval(2*WIDTH) x $1> %c0, <eval(2*WIDTH) x $1> %c1,
+           <eval(4*WIDTH) x i32> <aossoa_seq(eval(4*WIDTH))>
+ifelse($2, `8', `
+  %c3 = shufflevector <WIDTH x $1> %v6, <WIDTH x $1> %v7,
+           <eval(2*WIDTH) x i32> <aossoa_seq(eval(2*WIDTH))>
+  %d1 = shufflevector <eval(2*WIDTH) x $1> %c2, <eval(2*WIDTH) x $1> %c3,
+           <eval(4*WIDTH) x i32> <aossoa_seq(eval(4*WIDTH))>', `
+  %d1 = shufflevector <eval(2*WIDTH) x $1> %c2, <eval(2*WIDTH) x $1> undef,
+           <eval(4*WIDTH) x i32> <aossoa_seq(eval(4*WIDTH))>')
+  %all = shufflevector <eval(4*WIDTH) x $1> %d0, <eval(4*WIDTH) x $1> %d1,
+           <eval(8*WIDTH) x i32> <aossoa_seq(eval(8*WIDTH))>')
+')
+
+define(`aossoa_fields', `
+define void
+@__aos_to_soa$2_$1($1 * noalias %p,
+        forloop(k, 0, eval($2-2), `<WIDTH x $1> * noalias %out`'k, ')<WIDTH x $1> * noalias %out`'eval($2-1))
+        nounwind alwaysinline {
+  %p0 = bitcast $1 * %p to <WIDTH x $1> *
+forloop(k, 0, eval($2-1), `
+  %pv`'k = getelementptr PTR_OP_ARGS(`<WIDTH x $1>') %p0, i32 k
+  %v`'k = load PTR_OP_ARGS(`<WIDTH x $1> ') %pv`'k, align $3
+')
+aossoa_concat($1, $2)
+forloop(k, 0, eval($2-1), `
+  %r`'k = shufflevector <eval(aossoa_padded($2)*WIDTH) x $1> %all,
+                      <eval(aossoa_padded($2)*WIDTH) x $1> undef,
+           <WIDTH x i32> <forloop(i, 0, eval(WIDTH-2), `i32 eval(k+$2*i), ')i32 eval(k+$2*(WIDTH-1))>
+  store <WIDTH x $1> %r`'k, <WIDTH x $1> * %out`'k
+')
+  ret void
+}
+
+define void
+@__soa_to_aos$2_$1(forloop(k, 0, eval($2-1), `<WIDTH x $1> %v`'k, ')$1 * noalias %p)
+        nounwind alwaysinline {
+  %p0 = bitcast $1 * %p to <WIDTH x $1> *
+aossoa_concat($1, $2)
+forloop(k, 0, eval($2-1), `
+  %r`'k = shufflevector <eval(aossoa_padded($2)*WIDTH) x $1> %all,
+                      <eval(aossoa_padded($2)*WIDTH) x $1> undef,
+           <WIDTH x i32> <forloop(i, 0, eval(WIDTH-2), `i32 eval(((k*WIDTH+i)%$2)*WIDTH+(k*WIDTH+i)/$2), ')i32 eval(((k*WIDTH+WIDTH-1)%$2)*WIDTH+(k*WIDTH+WIDTH-1)/$2)>
+  %pr`'k = getelementptr PTR_OP_ARGS(`<WIDTH x $1>') %p0, i32 k
+  store <WIDTH x $1> %r`'k, <WIDTH x $1> * %pr`'k, align $3
+')
+  ret void
+}
+')
+
+;; Element-by-element versions of the above, for the generic targets.
+
+define(`aossoa_fields_scalar', `
+define void
+@__aos_to_soa$2_$1($1 * noalias %p,
+        forloop(k, 0, eval($2-2), `<WIDTH x $1> * noalias %out`'k, ')<WIDTH x $1> * noalias %out`'eval($2-1))
+        nounwind alwaysinline {
+forloop(k, 0, eval($2-1), `
+  %r`'k`'_0 = bitcast <WIDTH x $1> undef to <WIDTH x $1>
+forloop(i, 0, eval(WIDTH-1), `
+  %p`'k`'_`'i = getelementptr PTR_OP_ARGS(`$1') %p, i32 eval(i*$2+k)
+  %e`'k`'_`'i = load PTR_OP_ARGS(`$1 ') %p`'k`'_`'i
+  %r`'k`'_`'eval(i+1) = insertelement <WIDTH x $1> %r`'k`'_`'i, $1 %e`'k`'_`'i, i32 i')
+  store <WIDTH x $1> %r`'k`'_`'WIDTH, <WIDTH x $1> * %out`'k
+')
+  ret void
+}
+
+define void
+@__soa_to_aos$2_$1(forloop(k, 0, eval($2-1), `<WIDTH x $1> %v`'k, ')$1 * noalias %p)
+        nounwind alwaysinline {
+forloop(k, 0, eval($2-1), `forloop(i, 0, eval(WIDTH-1), `
+  %e`'k`'_`'i = extractelement <WIDTH x $1> %v`'k, i32 i
+  %p`'k`'_`'i = getelementptr PTR_OP_ARGS(`$1') %p, i32 eval(i*$2+k)
+  store $1 %e`'k`'_`'i, $1 * %p`'k`'_`'i')
+')
+  ret void
+}
+')
+
+;; $1: the vector or the element-by-element field macro above
+
+define(`aossoa_more', `
+$1(float, 2, 4)
+$1(float, 6, 4)
+$1(float, 8, 4)
+$1(double, 2, 8)
+$1(double, 3, 8)
+$1(double, 4, 8)
+$1(double, 6, 8)
+$1(double, 8, 8)
 ')
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -2401,14 +3062,102 @@ define void @__masked_store_blend_double(<WIDTH x double> * nocapture, <WIDTH x
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; conflict detection
+;;
+;; For each lane, returns a bitmask of the earlier active lanes that hold
+;; the same value as it does; this matches the semantics of vpconflictd
+;; and vpconflictq from AVX-512CD, which targets that have them use
+;; instead.  Only the first 32 lanes can be represented in the result.
+;; $1: element type (i32 or i64)
+
+define(`conflict_detect', `
+define <WIDTH x i32> @__conflict_$1(<WIDTH x $1> %v,
+                                     <WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %acc_0 = bitcast <WIDTH x i32> zeroinitializer to <WIDTH x i32>
+forloop(k, 0, ifelse(eval(WIDTH > 32), `1', `31', `eval(WIDTH-1)'), `
+  %e_`'k = extractelement <WIDTH x $1> %v, i32 k
+  %ins_`'k = insertelement <WIDTH x $1> undef, $1 %e_`'k, i32 0
+  %b_`'k = shufflevector <WIDTH x $1> %ins_`'k, <WIDTH x $1> undef,
+             <WIDTH x i32> zeroinitializer
+  %eq_`'k = icmp eq <WIDTH x $1> %v, %b_`'k
+  %bit_`'k = select <WIDTH x i1> %eq_`'k,
+             <WIDTH x i32> <forloop(i, 0, eval(WIDTH-2), `i32 ifelse(eval(i > k), `1', eval(1 << k), `0'), ')i32 ifelse(eval(WIDTH-1 > k), `1', eval(1 << k), `0')>,
+             <WIDTH x i32> zeroinitializer
+  %acc_`'eval(k+1) = or <WIDTH x i32> %acc_`'k, %bit_`'k
+')
+  %mm = call i64 @__movmsk(<WIDTH x MASK> %mask)
+  %mm32 = trunc i64 %mm to i32
+  %mmi = insertelement <WIDTH x i32> undef, i32 %mm32, i32 0
+  %mmb = shufflevector <WIDTH x i32> %mmi, <WIDTH x i32> undef,
+             <WIDTH x i32> zeroinitializer
+  %r = and <WIDTH x i32> %acc_`'ifelse(eval(WIDTH > 32), `1', `32', `WIDTH'), %mmb
+  ret <WIDTH x i32> %r
+}
+')
+
+;; __conflict_i64 for the AVX-512 targets, where a vector of WIDTH 64-bit
+;; elements takes two registers: vpconflictq handles the lanes within each
+;; half, and each lane of the upper half is then compared against the
+;; lanes of the lower half.
+;; $1: vpconflictq intrinsic
+;; $2: number of lanes in each half (WIDTH/2)
+
+define(`conflict_detect_i64_avx512', `
+declare <$2 x i64> $1(<$2 x i64>, <$2 x i64>, i8) nounwind readnone
+
+define <WIDTH x i32> @__conflict_i64(<WIDTH x i64> %v,
+                                     <WIDTH x MASK> %mask) nounwind readnone alwaysinline {
+  %lo = shufflevector <WIDTH x i64> %v, <WIDTH x i64> undef,
+          <$2 x i32> <split_seq(0, $2)>
+  %hi = shufflevector <WIDTH x i64> %v, <WIDTH x i64> undef,
+          <$2 x i32> <split_seq($2, $2)>
+  %c_lo = call <$2 x i64> $1(<$2 x i64> %lo, <$2 x i64> zeroinitializer, i8 -1)
+  %c_hi_self = call <$2 x i64> $1(<$2 x i64> %hi, <$2 x i64> zeroinitializer, i8 -1)
+  %c_hi_0 = shl <$2 x i64> %c_hi_self, <forloop(i, 0, eval($2-2), `i64 $2, ')i64 $2>
+forloop(k, 0, eval($2-1), `
+  %e_`'k = extractelement <$2 x i64> %lo, i32 k
+  %ins_`'k = insertelement <$2 x i64> undef, i64 %e_`'k, i32 0
+  %b_`'k = shufflevector <$2 x i64> %ins_`'k, <$2 x i64> undef,
+             <$2 x i32> zeroinitializer
+  %eq_`'k = icmp eq <$2 x i64> %hi, %b_`'k
+  %bit_`'k = select <$2 x i1> %eq_`'k,
+             <$2 x i64> <forloop(i, 0, eval($2-2), `i64 eval(1 << k), ')i64 eval(1 << k)>,
+             <$2 x i64> zeroinitializer
+  %c_hi_`'eval(k+1) = or <$2 x i64> %c_hi_`'k, %bit_`'k
+')
+  %c64 = shufflevector <$2 x i64> %c_lo, <$2 x i64> %c_hi_$2,
+           <WIDTH x i32> <split_seq(0, WIDTH)>
+  %c = trunc <WIDTH x i64> %c64 to <WIDTH x i32>
+  ; drop the bits of inactive lanes
+  %mm = call i64 @__movmsk(<WIDTH x MASK> %mask)
+  %mm32 = trunc i64 %mm to i32
+  %mmi = insertelement <WIDTH x i32> undef, i32 %mm32, i32 0
+  %mmb = shufflevector <WIDTH x i32> %mmi, <WIDTH x i32> undef,
+             <WIDTH x i32> zeroinitializer
+  %r = and <WIDTH x i32> %c, %mmb
+  ret <WIDTH x i32> %r
+}
+')
+
 define(`stdlib_core', `
 
 declare i32 @__fast_masked_vload()
+declare i32 @__sparse_gather_threshold()
+
+ifelse(HAVE_CONFLICT, `1', `', `conflict_detect(i32)')
+ifelse(HAVE_CONFLICT_I64, `1', `', `conflict_detect(i64)')
+popcnt_varying()
+pdep_pext()
 
 declare i8* @ISPCAlloc(i8**, i64, i32) nounwind
 declare void @ISPCLaunch(i8**, i8*, i8*, i32, i32, i32) nounwind
 declare void @ISPCSync(i8*) nounwind
+declare void @ISPCSyncLaunch(i8*, i32) nounwind
+declare void @ISPCLaunchAfter(i8**, i8*, i8*, i32, i32, i32, i32, i32*) nounwind
 declare void @ISPCInstrument(i8*, i8*, i32, i64) nounwind
+declare void @ISPCOccupancyRegister(i8*, i64*) nounwind
+declare void @ISPCTraceMemory(i8*, i32, i32, i32, i32, i64*, i64) nounwind
 
 declare i1 @__is_compile_time_constant_mask(<WIDTH x MASK> %mask)
 declare i1 @__is_compile_time_constant_uniform_int32(i32)
@@ -3205,6 +3954,20 @@ ifelse(HAVE_SCATTER, `1',
                                                     <WIDTH x double> %vd, <WIDTH x MASK> %mask)
 ')
 
+  ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+  ;; variable permutes, for gathers from small tables
+
+  %sh32 = call <WIDTH x i32> @__shuffle_i32(<WIDTH x i32> %v32, <WIDTH x i32> %v32)
+  call void @__use32(<WIDTH x i32> %sh32)
+  %sh2_32 = call <WIDTH x i32> @__shuffle2_i32(<WIDTH x i32> %v32, <WIDTH x i32> %v32,
+                                               <WIDTH x i32> %v32)
+  call void @__use32(<WIDTH x i32> %sh2_32)
+  %shf = call <WIDTH x float> @__shuffle_float(<WIDTH x float> %vf, <WIDTH x i32> %v32)
+  call void @__usefloat(<WIDTH x float> %shf)
+  %sh2_f = call <WIDTH x float> @__shuffle2_float(<WIDTH x float> %vf, <WIDTH x float> %vf,
+                                                  <WIDTH x i32> %v32)
+  call void @__usefloat(<WIDTH x float> %sh2_f)
+
   ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
   ;; prefetchs
 
@@ -3450,216 +4213,58 @@ ok:
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; new/delete
 
-;; Set of functions for 32 bit runtime.
-;; They are different for Windows and Unix (Linux/MacOS),
-;; on Windows we have to use _aligned_malloc/_aligned_free,
-;; while on Unix we use posix_memalign/free
-;;
-;; Note that this should be really two different libraries for 32 and 64
-;; environment and it should happen sooner or later
+;; The new and delete builtins are thin wrappers around __do_new_uniform(),
+;; __do_new_varying(), __do_delete_uniform() and __do_delete_varying() in
+;; builtins.c.  A varying new makes a single allocation for all of the
+;; active program instances, and the matching varying delete frees it with
+;; a single call; see the comments there for the details.  The C functions
+;; use _aligned_malloc/_aligned_free on Windows and posix_memalign/free
+;; elsewhere, unless the application provides allocation hooks.
 
 ifelse(WIDTH, 1, `define(`ALIGNMENT', `16')', `define(`ALIGNMENT', `eval(WIDTH*4)')')
 
 @memory_alignment = internal constant i32 ALIGNMENT
 
-ifelse(BUILD_OS, `UNIX', 
-`
+declare i8 * @__do_new_uniform(i64, i32)
+declare void @__do_new_varying(i32, i64, i64 *, i32, i64 *)
+declare void @__do_delete_uniform(i8 *)
+declare void @__do_delete_varying(i32, i64, i64 *)
 
 ifelse(RUNTIME, `32',
 `
 
-;; Unix 32 bit environment.
-;; Use: posix_memalign and free
+;; 32 bit environment.
 ;; Define:
 ;; - __new_uniform_32rt
 ;; - __new_varying32_32rt
 ;; - __delete_uniform_32rt
 ;; - __delete_varying_32rt
 
-declare i32 @posix_memalign(i8**, i32, i32)
-declare void @free(i8 *)
-
 define noalias i8 * @__new_uniform_32rt(i64 %size) {
-  %ptr = alloca i8*
-  %conv = trunc i64 %size to i32
   %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-  %call1 = call i32 @posix_memalign(i8** %ptr, i32 %alignment, i32 %conv)
-  %ptr_val = load PTR_OP_ARGS(`i8*')  %ptr
-  ret i8* %ptr_val
-}
-
-define <WIDTH x i64> @__new_varying32_32rt(<WIDTH x i32> %size, <WIDTH x MASK> %mask) {
-  %ret = alloca <WIDTH x i64>
-  store <WIDTH x i64> zeroinitializer, <WIDTH x i64> * %ret
-  %ret64 = bitcast <WIDTH x i64> * %ret to i64 *
-  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-    %sz_LANE_ID = extractelement <WIDTH x i32> %size, i32 LANE
-    %store_LANE_ID = getelementptr PTR_OP_ARGS(`i64') %ret64, i32 LANE
-    %ptr_LANE_ID = bitcast i64* %store_LANE_ID to i8**
-    %call_LANE_ID = call i32 @posix_memalign(i8** %ptr_LANE_ID, i32 %alignment, i32 %sz_LANE_ID)')
-
-  %r = load PTR_OP_ARGS(`<WIDTH x i64> ')  %ret
-  ret <WIDTH x i64> %r
-}
-
-define void @__delete_uniform_32rt(i8 * %ptr) {
-  call void @free(i8 * %ptr)
-  ret void
-}
-
-define void @__delete_varying_32rt(<WIDTH x i64> %ptr, <WIDTH x MASK> %mask) {
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-      %iptr_LANE_ID = extractelement <WIDTH x i64> %ptr, i32 LANE
-      %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8 *
-      call void @free(i8 * %ptr_LANE_ID)
-  ')
-  ret void
-}
-
-',
-RUNTIME, `64',
-`
-
-;; Unix 64 bit environment.
-;; Use: posix_memalign and free
-;; Define:
-;; - __new_uniform_64rt
-;; - __new_varying32_64rt
-;; - __new_varying64_64rt
-;; - __delete_uniform_64rt
-;; - __delete_varying_64rt
-
-declare i32 @posix_memalign(i8**, i64, i64)
-declare void @free(i8 *)
-
-define noalias i8 * @__new_uniform_64rt(i64 %size) {
-  %ptr = alloca i8*
-  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-  %alignment64 = sext i32 %alignment to i64
-  %call1 = call i32 @posix_memalign(i8** %ptr, i64 %alignment64, i64 %size)
-  %ptr_val = load PTR_OP_ARGS(`i8*') %ptr
-  ret i8* %ptr_val
-}
-
-define <WIDTH x i64> @__new_varying32_64rt(<WIDTH x i32> %size, <WIDTH x MASK> %mask) {
-  %ret = alloca <WIDTH x i64>
-  store <WIDTH x i64> zeroinitializer, <WIDTH x i64> * %ret
-  %ret64 = bitcast <WIDTH x i64> * %ret to i64 *
-  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-  %alignment64 = sext i32 %alignment to i64
-
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-    %sz_LANE_ID = extractelement <WIDTH x i32> %size, i32 LANE
-    %sz64_LANE_ID = zext i32 %sz_LANE_ID to i64
-    %store_LANE_ID = getelementptr PTR_OP_ARGS(`i64') %ret64, i32 LANE
-    %ptr_LANE_ID = bitcast i64* %store_LANE_ID to i8**
-    %call_LANE_ID = call i32 @posix_memalign(i8** %ptr_LANE_ID, i64 %alignment64, i64 %sz64_LANE_ID)')
-
-  %r = load PTR_OP_ARGS(`<WIDTH x i64> ')  %ret
-  ret <WIDTH x i64> %r
-}
-
-define <WIDTH x i64> @__new_varying64_64rt(<WIDTH x i64> %size, <WIDTH x MASK> %mask) {
-  %ret = alloca <WIDTH x i64>
-  store <WIDTH x i64> zeroinitializer, <WIDTH x i64> * %ret
-  %ret64 = bitcast <WIDTH x i64> * %ret to i64 *
-  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-  %alignment64 = sext i32 %alignment to i64
-
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-    %sz64_LANE_ID = extractelement <WIDTH x i64> %size, i32 LANE
-    %store_LANE_ID = getelementptr PTR_OP_ARGS(`i64') %ret64, i32 LANE
-    %ptr_LANE_ID = bitcast i64* %store_LANE_ID to i8**
-    %call_LANE_ID = call i32 @posix_memalign(i8** %ptr_LANE_ID, i64 %alignment64, i64 %sz64_LANE_ID)')
-
-  %r = load PTR_OP_ARGS(`<WIDTH x i64> ')  %ret
-  ret <WIDTH x i64> %r
-}
-
-define void @__delete_uniform_64rt(i8 * %ptr) {
-  call void @free(i8 * %ptr)
-  ret void
-}
-
-define void @__delete_varying_64rt(<WIDTH x i64> %ptr, <WIDTH x MASK> %mask) {
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-      %iptr_LANE_ID = extractelement <WIDTH x i64> %ptr, i32 LANE
-      %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8 *
-      call void @free(i8 * %ptr_LANE_ID)
-  ')
-  ret void
-}
-
-', `
-errprint(`RUNTIME should be defined to either 32 or 64
-')
-m4exit(`1')
-')
-
-',
-BUILD_OS, `WINDOWS',
-`
-
-ifelse(RUNTIME, `32',
-`
-
-;; Windows 32 bit environment.
-;; Use: _aligned_malloc and _aligned_free
-;; Define:
-;; - __new_uniform_32rt
-;; - __new_varying32_32rt
-;; - __delete_uniform_32rt
-;; - __delete_varying_32rt
-
-declare i8* @_aligned_malloc(i32, i32)
-declare void @_aligned_free(i8 *)
-
-define noalias i8 * @__new_uniform_32rt(i64 %size) {
-  %conv = trunc i64 %size to i32
-  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-  %ptr = tail call i8* @_aligned_malloc(i32 %conv, i32 %alignment)
+  %ptr = call i8 * @__do_new_uniform(i64 %size, i32 %alignment)
   ret i8* %ptr
 }
 
 define <WIDTH x i64> @__new_varying32_32rt(<WIDTH x i32> %size, <WIDTH x MASK> %mask) {
-  %ret = alloca <WIDTH x i64>
-  store <WIDTH x i64> zeroinitializer, <WIDTH x i64> * %ret
-  %ret64 = bitcast <WIDTH x i64> * %ret to i64 *
-  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-    %sz_LANE_ID = extractelement <WIDTH x i32> %size, i32 LANE
-    %ptr_LANE_ID = call noalias i8 * @_aligned_malloc(i32 %sz_LANE_ID, i32 %alignment)
-    %ptr_int_LANE_ID = ptrtoint i8 * %ptr_LANE_ID to i64
-    %store_LANE_ID = getelementptr PTR_OP_ARGS(`i64') %ret64, i32 LANE
-    store i64 %ptr_int_LANE_ID, i64 * %store_LANE_ID')
-
-  %r = load PTR_OP_ARGS(`<WIDTH x i64> ')  %ret
-  ret <WIDTH x i64> %r
+  %size64 = zext <WIDTH x i32> %size to <WIDTH x i64>
+  new_varying_i64(`%size64', `%mask')
 }
 
 define void @__delete_uniform_32rt(i8 * %ptr) {
-  call void @_aligned_free(i8 * %ptr)
+  call void @__do_delete_uniform(i8 * %ptr)
   ret void
 }
 
 define void @__delete_varying_32rt(<WIDTH x i64> %ptr, <WIDTH x MASK> %mask) {
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-      %iptr_LANE_ID = extractelement <WIDTH x i64> %ptr, i32 LANE
-      %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8 *
-      call void @_aligned_free(i8 * %ptr_LANE_ID)
-  ')
-  ret void
+  delete_varying(`%ptr', `%mask')
 }
 
 ',
 RUNTIME, `64',
 `
 
-;; Windows 64 bit environment.
-;; Use: _aligned_malloc and _aligned_free
+;; 64 bit environment.
 ;; Define:
 ;; - __new_uniform_64rt
 ;; - __new_varying32_64rt
@@ -3667,65 +4272,28 @@ RUNTIME, `64',
 ;; - __delete_uniform_64rt
 ;; - __delete_varying_64rt
 
-declare i8* @_aligned_malloc(i64, i64)
-declare void @_aligned_free(i8 *)
-
 define noalias i8 * @__new_uniform_64rt(i64 %size) {
   %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-  %alignment64 = sext i32 %alignment to i64
-  %ptr = tail call i8* @_aligned_malloc(i64 %size, i64 %alignment64)
+  %ptr = call i8 * @__do_new_uniform(i64 %size, i32 %alignment)
   ret i8* %ptr
 }
 
 define <WIDTH x i64> @__new_varying32_64rt(<WIDTH x i32> %size, <WIDTH x MASK> %mask) {
-  %ret = alloca <WIDTH x i64>
-  store <WIDTH x i64> zeroinitializer, <WIDTH x i64> * %ret
-  %ret64 = bitcast <WIDTH x i64> * %ret to i64 *
-  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-  %alignment64 = sext i32 %alignment to i64
-
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-    %sz_LANE_ID = extractelement <WIDTH x i32> %size, i32 LANE
-    %sz64_LANE_ID = zext i32 %sz_LANE_ID to i64
-    %ptr_LANE_ID = call noalias i8 * @_aligned_malloc(i64 %sz64_LANE_ID, i64 %alignment64)
-    %ptr_int_LANE_ID = ptrtoint i8 * %ptr_LANE_ID to i64
-    %store_LANE_ID = getelementptr PTR_OP_ARGS(`i64') %ret64, i32 LANE
-    store i64 %ptr_int_LANE_ID, i64 * %store_LANE_ID')
-
-  %r = load PTR_OP_ARGS(`<WIDTH x i64> ')  %ret
-  ret <WIDTH x i64> %r
+  %size64 = zext <WIDTH x i32> %size to <WIDTH x i64>
+  new_varying_i64(`%size64', `%mask')
 }
 
 define <WIDTH x i64> @__new_varying64_64rt(<WIDTH x i64> %size, <WIDTH x MASK> %mask) {
-  %ret = alloca <WIDTH x i64>
-  store <WIDTH x i64> zeroinitializer, <WIDTH x i64> * %ret
-  %ret64 = bitcast <WIDTH x i64> * %ret to i64 *
-  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
-  %alignment64 = sext i32 %alignment to i64
-
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-    %sz64_LANE_ID = extractelement <WIDTH x i64> %size, i32 LANE
-    %ptr_LANE_ID = call noalias i8 * @_aligned_malloc(i64 %sz64_LANE_ID, i64 %alignment64)
-    %ptr_int_LANE_ID = ptrtoint i8 * %ptr_LANE_ID to i64
-    %store_LANE_ID = getelementptr PTR_OP_ARGS(`i64') %ret64, i32 LANE
-    store i64 %ptr_int_LANE_ID, i64 * %store_LANE_ID')
-
-  %r = load PTR_OP_ARGS(`<WIDTH x i64> ')  %ret
-  ret <WIDTH x i64> %r
+  new_varying_i64(`%size', `%mask')
 }
 
 define void @__delete_uniform_64rt(i8 * %ptr) {
-  call void @_aligned_free(i8 * %ptr)
+  call void @__do_delete_uniform(i8 * %ptr)
   ret void
 }
 
 define void @__delete_varying_64rt(<WIDTH x i64> %ptr, <WIDTH x MASK> %mask) {
-  per_lane(WIDTH, <WIDTH x MASK> %mask, `
-      %iptr_LANE_ID = extractelement <WIDTH x i64> %ptr, i32 LANE
-      %ptr_LANE_ID = inttoptr i64 %iptr_LANE_ID to i8 *
-      call void @_aligned_free(i8 * %ptr_LANE_ID)
-  ')
-  ret void
+  delete_varying(`%ptr', `%mask')
 }
 
 ', `
@@ -3734,12 +4302,10 @@ errprint(`RUNTIME should be defined to either 32 or 64
 m4exit(`1')
 ')
 
-',
-`
-errprint(`BUILD_OS should be defined to either UNIX or WINDOWS
-')
-m4exit(`1')
-')
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; streaming loads and stores
+
+streaming_load_store()
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; read hw clock
@@ -4044,6 +4610,82 @@ i64minmax(WIDTH,min,uint64,ult)
 i64minmax(WIDTH,max,uint64,ugt)
 ')
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Non-temporal (streaming) loads and stores of a full vector's worth of
+;; values starting at a uniform pointer.  When all of the lanes are on and
+;; the pointer is aligned to the size of the vector, a single vector load or
+;; store with !nontemporal metadata is emitted, which the code generator
+;; turns into movntdqa/movntps/vmovntdq and the like, depending on the
+;; target.  Otherwise, stores are done per active lane, still with
+;; !nontemporal (e.g. movnti for 32 and 64-bit integers), and loads fall
+;; back to a regular masked load.
+;; $1: element type (i32, float, ...) (and suffix for function name)
+;; $2: size of elements of type $1 in bytes
+
+define(`gen_streaming_load_store', `
+define <WIDTH x $1> @__streaming_load_$1($1 * %ptr, <WIDTH x MASK> %mask) nounwind alwaysinline {
+entry:
+  %mm = call i64 @__movmsk(<WIDTH x MASK> %mask)
+  %allon = icmp eq i64 %mm, ALL_ON_MASK
+  %ptr_int = ptrtoint $1 * %ptr to i64
+  %misalign = and i64 %ptr_int, eval(WIDTH*$2-1)
+  %aligned = icmp eq i64 %misalign, 0
+  %can_vload = and i1 %allon, %aligned
+  br i1 %can_vload, label %load, label %masked
+
+load:
+  %vptr = bitcast $1 * %ptr to <WIDTH x $1> *
+  %val = load PTR_OP_ARGS(`<WIDTH x $1> ')  %vptr, align eval(WIDTH*$2), !nontemporal !NONTEMPORAL_MD_ID
+  ret <WIDTH x $1> %val
+
+masked:
+  %ptr8 = bitcast $1 * %ptr to i8 *
+  %mval = call <WIDTH x $1> @__masked_load_$1(i8 * %ptr8, <WIDTH x MASK> %mask)
+  ret <WIDTH x $1> %mval
+}
+
+define void @__streaming_store_$1($1 * %ptr, <WIDTH x $1> %val, <WIDTH x MASK> %mask) nounwind alwaysinline {
+entry:
+  %mm = call i64 @__movmsk(<WIDTH x MASK> %mask)
+  %allon = icmp eq i64 %mm, ALL_ON_MASK
+  %ptr_int = ptrtoint $1 * %ptr to i64
+  %misalign = and i64 %ptr_int, eval(WIDTH*$2-1)
+  %aligned = icmp eq i64 %misalign, 0
+  %can_vstore = and i1 %allon, %aligned
+  br i1 %can_vstore, label %store, label %lanes
+
+store:
+  %vptr = bitcast $1 * %ptr to <WIDTH x $1> *
+  store <WIDTH x $1> %val, <WIDTH x $1> * %vptr, align eval(WIDTH*$2), !nontemporal !NONTEMPORAL_MD_ID
+  ret void
+
+lanes:
+  per_lane(WIDTH, <WIDTH x MASK> %mask, `
+      %ptr_LANE_ID = getelementptr PTR_OP_ARGS(`$1') %ptr, i32 LANE
+      %storeval_LANE_ID = extractelement <WIDTH x $1> %val, i32 LANE
+      store $1 %storeval_LANE_ID, $1 * %ptr_LANE_ID, align $2, !nontemporal !NONTEMPORAL_MD_ID')
+  ret void
+}
+')
+
+;; Metadata node referenced by all of the !nontemporal loads and stores.
+define(`NONTEMPORAL_MD_ID', `1000')
+
+define(`streaming_load_store', `
+ifelse(LLVM_VERSION, LLVM_3_2, `!NONTEMPORAL_MD_ID = metadata !{i32 1}',
+       LLVM_VERSION, LLVM_3_3, `!NONTEMPORAL_MD_ID = metadata !{i32 1}',
+       LLVM_VERSION, LLVM_3_4, `!NONTEMPORAL_MD_ID = metadata !{i32 1}',
+       LLVM_VERSION, LLVM_3_5, `!NONTEMPORAL_MD_ID = metadata !{i32 1}',
+                               `!NONTEMPORAL_MD_ID = !{i32 1}')
+
+gen_streaming_load_store(i8, 1)
+gen_streaming_load_store(i16, 2)
+gen_streaming_load_store(i32, 4)
+gen_streaming_load_store(float, 4)
+gen_streaming_load_store(i64, 8)
+gen_streaming_load_store(double, 8)
+')
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; Emit general-purpose code to do a masked load for targets that dont have
 ;; an instruction to do that.  Parameters:
@@ -4062,7 +4704,17 @@ entry:
   %mm_and_high_shift = lshr i64 %mm_and_high, eval(WIDTH-1)
   %mm_and_low_i1 = trunc i64 %mm_and_low to i1
   %mm_and_high_shift_i1 = trunc i64 %mm_and_high_shift to i1
-  %can_vload = and i1 %mm_and_low_i1, %mm_and_high_shift_i1
+  %can_vload_ends = and i1 %mm_and_low_i1, %mm_and_high_shift_i1
+
+  ; it is also safe if any lane is on and the vector does not cross a page
+  ; boundary: the page holding the element of an active lane is then
+  ; mapped, and it holds all of the vector
+  %any_on = icmp ne i64 %mm, 0
+  %ptr_int = ptrtoint i8 * %0 to i64
+  %page_offset = and i64 %ptr_int, 4095
+  %in_page = icmp ule i64 %page_offset, eval(4096 - WIDTH * $2)
+  %page_safe = and i1 %any_on, %in_page
+  %can_vload = or i1 %can_vload_ends, %page_safe
 
   %fast32 = call i32 @__fast_masked_vload()
   %fast_i1 = trunc i32 %fast32 to i1
@@ -4231,13 +4883,15 @@ define void @__masked_store_blend_i16(<16 x i16>* nocapture, <16 x i16>,
 ;; destination array.  For packed load, each lane that has an active mask
 ;; loads a sequential value from the array.
 ;;
-;; $1: vector width of the target
-;;
 ;; FIXME: use the per_lane macro, defined below, to implement these!
 
-define(`packed_load_and_store', `
+;; packed_load_and_store_type:
+;; $1: element type (i32 or i64)
+;; $2: suffix for the function names
+;; $3: alignment of elements of type $1
 
-define i32 @__packed_load_active(i32 * %startptr, <WIDTH x i32> * %val_ptr,
+define(`packed_load_and_store_type', `
+define i32 @__packed_load_active$2($1 * %startptr, <WIDTH x $1> * %val_ptr,
                                  <WIDTH x MASK> %full_mask) nounwind alwaysinline {
 entry:
   %mask = call i64 @__movmsk(<WIDTH x MASK> %full_mask)
@@ -4251,9 +4905,9 @@ known_mask:
 all_on:
   ;; everyone wants to load, so just load an entire vector width in a single
   ;; vector load
-  %vecptr = bitcast i32 *%startptr to <WIDTH x i32> *
-  %vec_load = load PTR_OP_ARGS(`<WIDTH x i32> ') %vecptr, align 4
-  store <WIDTH x i32> %vec_load, <WIDTH x i32> * %val_ptr, align 4
+  %vecptr = bitcast $1 *%startptr to <WIDTH x $1> *
+  %vec_load = load PTR_OP_ARGS(`<WIDTH x $1> ') %vecptr, align $3
+  store <WIDTH x $1> %vec_load, <WIDTH x $1> * %val_ptr, align $3
   ret i32 WIDTH
 
 unknown_mask:
@@ -4270,11 +4924,11 @@ loop:
   br i1 %do_load, label %load, label %loopend 
 
 load:
-  %loadptr = getelementptr PTR_OP_ARGS(`i32') %startptr, i32 %offset
-  %loadval = load PTR_OP_ARGS(`i32 ') %loadptr
-  %val_ptr_i32 = bitcast <WIDTH x i32> * %val_ptr to i32 *
-  %storeptr = getelementptr PTR_OP_ARGS(`i32') %val_ptr_i32, i32 %lane
-  store i32 %loadval, i32 *%storeptr
+  %loadptr = getelementptr PTR_OP_ARGS(`$1') %startptr, i32 %offset
+  %loadval = load PTR_OP_ARGS(`$1 ') %loadptr
+  %val_ptr_elt = bitcast <WIDTH x $1> * %val_ptr to $1 *
+  %storeptr = getelementptr PTR_OP_ARGS(`$1') %val_ptr_elt, i32 %lane
+  store $1 %loadval, $1 *%storeptr
   %offset1 = add i32 %offset, 1
   br label %loopend
 
@@ -4291,7 +4945,7 @@ done:
   ret i32 %nextoffset
 }
 
-define i32 @__packed_store_active(i32 * %startptr, <WIDTH x i32> %vals,
+define i32 @__packed_store_active$2($1 * %startptr, <WIDTH x $1> %vals,
                                    <WIDTH x MASK> %full_mask) nounwind alwaysinline {
 entry:
   %mask = call i64 @__movmsk(<WIDTH x MASK> %full_mask)
@@ -4303,8 +4957,8 @@ known_mask:
   br i1 %allon, label %all_on, label %unknown_mask
 
 all_on:
-  %vecptr = bitcast i32 *%startptr to <WIDTH x i32> *
-  store <WIDTH x i32> %vals, <WIDTH x i32> * %vecptr, align 4
+  %vecptr = bitcast $1 *%startptr to <WIDTH x $1> *
+  store <WIDTH x $1> %vals, <WIDTH x $1> * %vecptr, align $3
   ret i32 WIDTH
 
 unknown_mask:
@@ -4321,9 +4975,9 @@ loop:
   br i1 %do_store, label %store, label %loopend 
 
 store:
-  %storeval = extractelement <WIDTH x i32> %vals, i32 %lane
-  %storeptr = getelementptr PTR_OP_ARGS(`i32') %startptr, i32 %offset
-  store i32 %storeval, i32 *%storeptr
+  %storeval = extractelement <WIDTH x $1> %vals, i32 %lane
+  %storeptr = getelementptr PTR_OP_ARGS(`$1') %startptr, i32 %offset
+  store $1 %storeval, $1 *%storeptr
   %offset1 = add i32 %offset, 1
   br label %loopend
 
@@ -4340,6 +4994,9 @@ done:
   ret i32 %nextoffset
 }
 
+')
+
+define(`packed_store_active2_i32', `
 define MASK @__packed_store_active2(i32 * %startptr, <WIDTH x i32> %vals,
                                    <WIDTH x MASK> %full_mask) nounwind alwaysinline {
 entry:
@@ -4386,6 +5043,226 @@ done:
 }
 ')
 
+define(`packed_load_and_store', `
+packed_load_and_store_type(i32, `', 4)
+packed_load_and_store_type(i64, `_i64', 8)
+packed_store_active2_i32()
+')
+
+;; Versions of the 32-bit packed load and store for AVX2, for 8 and 16-wide
+;; targets.  Each group of 8 lanes is compacted (or expanded) with a single
+;; vpermd, using a permutation that is looked up in a table indexed by the
+;; 8 bits of the mask; each table entry packs 8 3-bit lane indices into
+;; 4-bit fields.  The memory side is accessed with vpmaskmovd, so that only
+;; the elements for the active lanes are read or written.
+
+define(`packed_load_and_store_permd', `
+@__packed_store_lut8 = internal constant [256 x i32] [
+  i32 0, i32 0, i32 1, i32 16, i32 2, i32 32, i32 33, i32 528,
+  i32 3, i32 48, i32 49, i32 784, i32 50, i32 800, i32 801, i32 12816,
+  i32 4, i32 64, i32 65, i32 1040, i32 66, i32 1056, i32 1057, i32 16912,
+  i32 67, i32 1072, i32 1073, i32 17168, i32 1074, i32 17184, i32 17185, i32 274960,
+  i32 5, i32 80, i32 81, i32 1296, i32 82, i32 1312, i32 1313, i32 21008,
+  i32 83, i32 1328, i32 1329, i32 21264, i32 1330, i32 21280, i32 21281, i32 340496,
+  i32 84, i32 1344, i32 1345, i32 21520, i32 1346, i32 21536, i32 21537, i32 344592,
+  i32 1347, i32 21552, i32 21553, i32 344848, i32 21554, i32 344864, i32 344865, i32 5517840,
+  i32 6, i32 96, i32 97, i32 1552, i32 98, i32 1568, i32 1569, i32 25104,
+  i32 99, i32 1584, i32 1585, i32 25360, i32 1586, i32 25376, i32 25377, i32 406032,
+  i32 100, i32 1600, i32 1601, i32 25616, i32 1602, i32 25632, i32 25633, i32 410128,
+  i32 1603, i32 25648, i32 25649, i32 410384, i32 25650, i32 410400, i32 410401, i32 6566416,
+  i32 101, i32 1616, i32 1617, i32 25872, i32 1618, i32 25888, i32 25889, i32 414224,
+  i32 1619, i32 25904, i32 25905, i32 414480, i32 25906, i32 414496, i32 414497, i32 6631952,
+  i32 1620, i32 25920, i32 25921, i32 414736, i32 25922, i32 414752, i32 414753, i32 6636048,
+  i32 25923, i32 414768, i32 414769, i32 6636304, i32 414770, i32 6636320, i32 6636321, i32 106181136,
+  i32 7, i32 112, i32 113, i32 1808, i32 114, i32 1824, i32 1825, i32 29200,
+  i32 115, i32 1840, i32 1841, i32 29456, i32 1842, i32 29472, i32 29473, i32 471568,
+  i32 116, i32 1856, i32 1857, i32 29712, i32 1858, i32 29728, i32 29729, i32 475664,
+  i32 1859, i32 29744, i32 29745, i32 475920, i32 29746, i32 475936, i32 475937, i32 7614992,
+  i32 117, i32 1872, i32 1873, i32 29968, i32 1874, i32 29984, i32 29985, i32 479760,
+  i32 1875, i32 30000, i32 30001, i32 480016, i32 30002, i32 480032, i32 480033, i32 7680528,
+  i32 1876, i32 30016, i32 30017, i32 480272, i32 30018, i32 480288, i32 480289, i32 7684624,
+  i32 30019, i32 480304, i32 480305, i32 7684880, i32 480306, i32 7684896, i32 7684897, i32 122958352,
+  i32 118, i32 1888, i32 1889, i32 30224, i32 1890, i32 30240, i32 30241, i32 483856,
+  i32 1891, i32 30256, i32 30257, i32 484112, i32 30258, i32 484128, i32 484129, i32 7746064,
+  i32 1892, i32 30272, i32 30273, i32 484368, i32 30274, i32 484384, i32 484385, i32 7750160,
+  i32 30275, i32 484400, i32 484401, i32 7750416, i32 484402, i32 7750432, i32 7750433, i32 124006928,
+  i32 1893, i32 30288, i32 30289, i32 484624, i32 30290, i32 484640, i32 484641, i32 7754256,
+  i32 30291, i32 484656, i32 484657, i32 7754512, i32 484658, i32 7754528, i32 7754529, i32 124072464,
+  i32 30292, i32 484672, i32 484673, i32 7754768, i32 484674, i32 7754784, i32 7754785, i32 124076560,
+  i32 484675, i32 7754800, i32 7754801, i32 124076816, i32 7754802, i32 124076832, i32 124076833, i32 1985229328
+]
+
+@__packed_load_lut8 = internal constant [256 x i32] [
+  i32 0, i32 0, i32 0, i32 16, i32 0, i32 256, i32 256, i32 528,
+  i32 0, i32 4096, i32 4096, i32 8208, i32 4096, i32 8448, i32 8448, i32 12816,
+  i32 0, i32 65536, i32 65536, i32 131088, i32 65536, i32 131328, i32 131328, i32 197136,
+  i32 65536, i32 135168, i32 135168, i32 204816, i32 135168, i32 205056, i32 205056, i32 274960,
+  i32 0, i32 1048576, i32 1048576, i32 2097168, i32 1048576, i32 2097408, i32 2097408, i32 3146256,
+  i32 1048576, i32 2101248, i32 2101248, i32 3153936, i32 2101248, i32 3154176, i32 3154176, i32 4207120,
+  i32 1048576, i32 2162688, i32 2162688, i32 3276816, i32 2162688, i32 3277056, i32 3277056, i32 4391440,
+  i32 2162688, i32 3280896, i32 3280896, i32 4399120, i32 3280896, i32 4399360, i32 4399360, i32 5517840,
+  i32 0, i32 16777216, i32 16777216, i32 33554448, i32 16777216, i32 33554688, i32 33554688, i32 50332176,
+  i32 16777216, i32 33558528, i32 33558528, i32 50339856, i32 33558528, i32 50340096, i32 50340096, i32 67121680,
+  i32 16777216, i32 33619968, i32 33619968, i32 50462736, i32 33619968, i32 50462976, i32 50462976, i32 67306000,
+  i32 33619968, i32 50466816, i32 50466816, i32 67313680, i32 50466816, i32 67313920, i32 67313920, i32 84161040,
+  i32 16777216, i32 34603008, i32 34603008, i32 52428816, i32 34603008, i32 52429056, i32 52429056, i32 70255120,
+  i32 34603008, i32 52432896, i32 52432896, i32 70262800, i32 52432896, i32 70263040, i32 70263040, i32 88093200,
+  i32 34603008, i32 52494336, i32 52494336, i32 70385680, i32 52494336, i32 70385920, i32 70385920, i32 88277520,
+  i32 52494336, i32 70389760, i32 70389760, i32 88285200, i32 70389760, i32 88285440, i32 88285440, i32 106181136,
+  i32 0, i32 268435456, i32 268435456, i32 536870928, i32 268435456, i32 536871168, i32 536871168, i32 805306896,
+  i32 268435456, i32 536875008, i32 536875008, i32 805314576, i32 536875008, i32 805314816, i32 805314816, i32 1073754640,
+  i32 268435456, i32 536936448, i32 536936448, i32 805437456, i32 536936448, i32 805437696, i32 805437696, i32 1073938960,
+  i32 536936448, i32 805441536, i32 805441536, i32 1073946640, i32 805441536, i32 1073946880, i32 1073946880, i32 1342452240,
+  i32 268435456, i32 537919488, i32 537919488, i32 807403536, i32 537919488, i32 807403776, i32 807403776, i32 1076888080,
+  i32 537919488, i32 807407616, i32 807407616, i32 1076895760, i32 807407616, i32 1076896000, i32 1076896000, i32 1346384400,
+  i32 537919488, i32 807469056, i32 807469056, i32 1077018640, i32 807469056, i32 1077018880, i32 1077018880, i32 1346568720,
+  i32 807469056, i32 1077022720, i32 1077022720, i32 1346576400, i32 1077022720, i32 1346576640, i32 1346576640, i32 1616130576,
+  i32 268435456, i32 553648128, i32 553648128, i32 838860816, i32 553648128, i32 838861056, i32 838861056, i32 1124074000,
+  i32 553648128, i32 838864896, i32 838864896, i32 1124081680, i32 838864896, i32 1124081920, i32 1124081920, i32 1409298960,
+  i32 553648128, i32 838926336, i32 838926336, i32 1124204560, i32 838926336, i32 1124204800, i32 1124204800, i32 1409483280,
+  i32 838926336, i32 1124208640, i32 1124208640, i32 1409490960, i32 1124208640, i32 1409491200, i32 1409491200, i32 1694773776,
+  i32 553648128, i32 839909376, i32 839909376, i32 1126170640, i32 839909376, i32 1126170880, i32 1126170880, i32 1412432400,
+  i32 839909376, i32 1126174720, i32 1126174720, i32 1412440080, i32 1126174720, i32 1412440320, i32 1412440320, i32 1698705936,
+  i32 839909376, i32 1126236160, i32 1126236160, i32 1412562960, i32 1126236160, i32 1412563200, i32 1412563200, i32 1698890256,
+  i32 1126236160, i32 1412567040, i32 1412567040, i32 1698897936, i32 1412567040, i32 1698898176, i32 1698898176, i32 1985229328
+]
+
+declare <8 x i32> @llvm.x86.avx2.permd(<8 x i32>, <8 x i32>) nounwind readnone
+declare <8 x i32> @llvm.x86.avx2.maskload.d.256(i8 *, <8 x i32>) nounwind readonly
+declare void @llvm.x86.avx2.maskstore.d.256(i8 *, <8 x i32>, <8 x i32>) nounwind
+
+;; Returns the permutation for the given 8 bits of the mask from the table.
+define internal <8 x i32> @__packed_permutation8([256 x i32] * %table, i64 %bits) nounwind readonly alwaysinline {
+  %entryptr = getelementptr PTR_OP_ARGS(`[256 x i32]') %table, i64 0, i64 %bits
+  %entry = load PTR_OP_ARGS(`i32 ') %entryptr
+  %entry1 = insertelement <8 x i32> undef, i32 %entry, i32 0
+  %entryv = shufflevector <8 x i32> %entry1, <8 x i32> undef, <8 x i32> zeroinitializer
+  %fields = lshr <8 x i32> %entryv, <i32 0, i32 4, i32 8, i32 12, i32 16, i32 20, i32 24, i32 28>
+  %perm = and <8 x i32> %fields, <i32 7, i32 7, i32 7, i32 7, i32 7, i32 7, i32 7, i32 7>
+  ret <8 x i32> %perm
+}
+
+;; Returns a vpmaskmovd mask for the first %count elements.
+define internal <8 x i32> @__packed_first_n_mask8(i32 %count) nounwind readnone alwaysinline {
+  %count1 = insertelement <8 x i32> undef, i32 %count, i32 0
+  %countv = shufflevector <8 x i32> %count1, <8 x i32> undef, <8 x i32> zeroinitializer
+  %cmp = icmp ult <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>, %countv
+  %mask = sext <8 x i1> %cmp to <8 x i32>
+  ret <8 x i32> %mask
+}
+
+;; Stores the values from the lanes given by the 8 bits in %bits
+;; contiguously at %startptr, returning the number stored.
+define internal i32 @__packed_store8(i32 * %startptr, <8 x i32> %vals, i64 %bits) nounwind alwaysinline {
+  %perm = call <8 x i32> @__packed_permutation8([256 x i32] * @__packed_store_lut8, i64 %bits)
+  %packed = call <8 x i32> @llvm.x86.avx2.permd(<8 x i32> %vals, <8 x i32> %perm)
+  %count64 = call i64 @__popcnt_int64(i64 %bits)
+  %count = trunc i64 %count64 to i32
+  %storemask = call <8 x i32> @__packed_first_n_mask8(i32 %count)
+  %ptr = bitcast i32 * %startptr to i8 *
+  call void @llvm.x86.avx2.maskstore.d.256(i8 * %ptr, <8 x i32> %storemask, <8 x i32> %packed)
+  ret i32 %count
+}
+
+;; Loads consecutive values from %startptr into the lanes given by the 8
+;; bits in %bits; the other lanes get the corresponding value from %old.
+;; The number of values loaded is stored in %count.
+define internal <8 x i32> @__packed_load8(i32 * %startptr, <8 x i32> %old, i64 %bits,
+                                          i32 * %countptr) nounwind alwaysinline {
+  %count64 = call i64 @__popcnt_int64(i64 %bits)
+  %count = trunc i64 %count64 to i32
+  store i32 %count, i32 * %countptr
+  %loadmask = call <8 x i32> @__packed_first_n_mask8(i32 %count)
+  %ptr = bitcast i32 * %startptr to i8 *
+  %packed = call <8 x i32> @llvm.x86.avx2.maskload.d.256(i8 * %ptr, <8 x i32> %loadmask)
+  %perm = call <8 x i32> @__packed_permutation8([256 x i32] * @__packed_load_lut8, i64 %bits)
+  %expanded = call <8 x i32> @llvm.x86.avx2.permd(<8 x i32> %packed, <8 x i32> %perm)
+  %bits32 = trunc i64 %bits to i32
+  %bits1 = insertelement <8 x i32> undef, i32 %bits32, i32 0
+  %bitsv = shufflevector <8 x i32> %bits1, <8 x i32> undef, <8 x i32> zeroinitializer
+  %lanebits = and <8 x i32> %bitsv, <i32 1, i32 2, i32 4, i32 8, i32 16, i32 32, i32 64, i32 128>
+  %active = icmp ne <8 x i32> %lanebits, zeroinitializer
+  %result = select <8 x i1> %active, <8 x i32> %expanded, <8 x i32> %old
+  ret <8 x i32> %result
+}
+
+ifelse(WIDTH, `8', `
+define i32 @__packed_store_active(i32 * %startptr, <8 x i32> %vals,
+                                  <8 x MASK> %full_mask) nounwind alwaysinline {
+  %mask = call i64 @__movmsk(<8 x MASK> %full_mask)
+  %count = call i32 @__packed_store8(i32 * %startptr, <8 x i32> %vals, i64 %mask)
+  ret i32 %count
+}
+
+define i32 @__packed_load_active(i32 * %startptr, <8 x i32> * %val_ptr,
+                                 <8 x MASK> %full_mask) nounwind alwaysinline {
+  %mask = call i64 @__movmsk(<8 x MASK> %full_mask)
+  %old = load PTR_OP_ARGS(`<8 x i32> ') %val_ptr, align 4
+  %countptr = alloca i32
+  %vals = call <8 x i32> @__packed_load8(i32 * %startptr, <8 x i32> %old, i64 %mask,
+                                         i32 * %countptr)
+  store <8 x i32> %vals, <8 x i32> * %val_ptr, align 4
+  %count = load PTR_OP_ARGS(`i32 ') %countptr
+  ret i32 %count
+}
+', WIDTH, `16', `
+define i32 @__packed_store_active(i32 * %startptr, <16 x i32> %vals,
+                                  <16 x MASK> %full_mask) nounwind alwaysinline {
+  %mask = call i64 @__movmsk(<16 x MASK> %full_mask)
+  %mask_lo = and i64 %mask, 255
+  %mask_hi = lshr i64 %mask, 8
+  %vals_lo = shufflevector <16 x i32> %vals, <16 x i32> undef,
+      <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  %vals_hi = shufflevector <16 x i32> %vals, <16 x i32> undef,
+      <8 x i32> <i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  %count_lo = call i32 @__packed_store8(i32 * %startptr, <8 x i32> %vals_lo, i64 %mask_lo)
+  %ptr_hi = getelementptr PTR_OP_ARGS(`i32') %startptr, i32 %count_lo
+  %count_hi = call i32 @__packed_store8(i32 * %ptr_hi, <8 x i32> %vals_hi, i64 %mask_hi)
+  %count = add i32 %count_lo, %count_hi
+  ret i32 %count
+}
+
+define i32 @__packed_load_active(i32 * %startptr, <16 x i32> * %val_ptr,
+                                 <16 x MASK> %full_mask) nounwind alwaysinline {
+  %mask = call i64 @__movmsk(<16 x MASK> %full_mask)
+  %mask_lo = and i64 %mask, 255
+  %mask_hi = lshr i64 %mask, 8
+  %old = load PTR_OP_ARGS(`<16 x i32> ') %val_ptr, align 4
+  %old_lo = shufflevector <16 x i32> %old, <16 x i32> undef,
+      <8 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>
+  %old_hi = shufflevector <16 x i32> %old, <16 x i32> undef,
+      <8 x i32> <i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  %countptr = alloca i32
+  %vals_lo = call <8 x i32> @__packed_load8(i32 * %startptr, <8 x i32> %old_lo,
+                                            i64 %mask_lo, i32 * %countptr)
+  %count_lo = load PTR_OP_ARGS(`i32 ') %countptr
+  %ptr_hi = getelementptr PTR_OP_ARGS(`i32') %startptr, i32 %count_lo
+  %vals_hi = call <8 x i32> @__packed_load8(i32 * %ptr_hi, <8 x i32> %old_hi,
+                                            i64 %mask_hi, i32 * %countptr)
+  %count_hi = load PTR_OP_ARGS(`i32 ') %countptr
+  %vals = shufflevector <8 x i32> %vals_lo, <8 x i32> %vals_hi,
+      <16 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7,
+                  i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15>
+  store <16 x i32> %vals, <16 x i32> * %val_ptr, align 4
+  %count = add i32 %count_lo, %count_hi
+  ret i32 %count
+}
+', `
+errprint(`packed_load_and_store_permd() only supports 8 and 16-wide targets
+')
+m4exit(`1')
+')
+
+define MASK @__packed_store_active2(i32 * %startptr, <WIDTH x i32> %vals,
+                                    <WIDTH x MASK> %full_mask) nounwind alwaysinline {
+  %count = call i32 @__packed_store_active(i32 * %startptr, <WIDTH x i32> %vals,
+                                           <WIDTH x MASK> %full_mask)
+  ret MASK %count
+}
+
+packed_load_and_store_type(i64, `_i64', 8)
+')
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; reduce_equal
 
@@ -4536,12 +5413,73 @@ define <$1 x $2> @__exclusive_scan_$6(<$1 x $2> %v,
 }
 ')
 
+; Like the prefix sum above, but for min/max, where each step is a compare and
+; a select.
+; $1: vector width (e.g. 4)
+; $2: vector element type (e.g. float)
+; $3: bit width of vector element type (e.g. 32)
+; $4: compare instruction and predicate that is true if the first operand
+;     should be kept (e.g. fcmp olt)
+; $5: identity element value (e.g. 0x7FF0000000000000)
+; $6: suffix for function (e.g. min_float)
+
+define(`exclusive_scan_select', `
+define <$1 x $2> @__exclusive_scan_$6(<$1 x $2> %v,
+                                  <$1 x MASK> %mask) nounwind alwaysinline {
+  ; first, set the value of any off lanes to the identity value
+  %ptr = alloca <$1 x $2>
+  %idvec1 = bitcast $2 $5 to <1 x $2>
+  %idvec = shufflevector <1 x $2> %idvec1, <1 x $2> undef,
+      <$1 x i32> < forloop(i, 0, eval($1-2), `i32 0, ') i32 0 >
+  store <$1 x $2> %idvec, <$1 x $2> * %ptr
+  %ptr`'$3 = bitcast <$1 x $2> * %ptr to <$1 x i`'$3> *
+  %vi = bitcast <$1 x $2> %v to <$1 x i`'$3>
+  call void @__masked_store_blend_i$3(<$1 x i`'$3> * %ptr`'$3, <$1 x i`'$3> %vi,
+                                      <$1 x MASK> %mask)
+  %v_id = load PTR_OP_ARGS(`<$1 x $2> ')  %ptr
+
+  forloop(i, 0, eval($1-1), `
+  %v`'i = extractelement <$1 x $2> %v_id, i32 i')
+
+  ; the 1st element is just the 0th element of the original vector, since
+  ; the identity never wins the comparison against it
+  %s1 = bitcast $2 %v0 to $2
+  forloop(i, 2, eval($1-1), `
+  %c`'i = $4 $2 %s`'eval(i-1), %v`'eval(i-1)
+  %s`'i = select i1 %c`'i, $2 %s`'eval(i-1), $2 %v`'eval(i-1)')
+
+  %r0 = insertelement <$1 x $2> undef, $2 $5, i32 0  ; 0th element gets identity
+  forloop(i, 1, eval($1-1), `
+  %r`'i = insertelement <$1 x $2> %r`'eval(i-1), $2 %s`'i, i32 i')
+
+  ret <$1 x $2> %r`'eval($1-1)
+}
+')
+
 define(`scans', `
 exclusive_scan(WIDTH, i32, 32, add, 0, add_i32)
 exclusive_scan(WIDTH, float, 32, fadd, zeroinitializer, add_float)
 exclusive_scan(WIDTH, i64, 64, add, 0, add_i64)
 exclusive_scan(WIDTH, double, 64, fadd, zeroinitializer, add_double)
 
+exclusive_scan(WIDTH, i32, 32, mul, 1, mul_i32)
+exclusive_scan(WIDTH, float, 32, fmul, 1.0, mul_float)
+exclusive_scan(WIDTH, i64, 64, mul, 1, mul_i64)
+exclusive_scan(WIDTH, double, 64, fmul, 1.0, mul_double)
+
+exclusive_scan_select(WIDTH, i32, 32, icmp slt, 2147483647, min_i32)
+exclusive_scan_select(WIDTH, i32, 32, icmp ult, -1, min_uint32)
+exclusive_scan_select(WIDTH, i32, 32, icmp sgt, -2147483648, max_i32)
+exclusive_scan_select(WIDTH, i32, 32, icmp ugt, 0, max_uint32)
+exclusive_scan_select(WIDTH, float, 32, fcmp olt, 0x7FF0000000000000, min_float)
+exclusive_scan_select(WIDTH, float, 32, fcmp ogt, 0xFFF0000000000000, max_float)
+exclusive_scan_select(WIDTH, i64, 64, icmp slt, 9223372036854775807, min_i64)
+exclusive_scan_select(WIDTH, i64, 64, icmp ult, -1, min_uint64)
+exclusive_scan_select(WIDTH, i64, 64, icmp sgt, -9223372036854775808, max_i64)
+exclusive_scan_select(WIDTH, i64, 64, icmp ugt, 0, max_uint64)
+exclusive_scan_select(WIDTH, double, 64, fcmp olt, 0x7FF0000000000000, min_double)
+exclusive_scan_select(WIDTH, double, 64, fcmp ogt, 0xFFF0000000000000, max_double)
+
 exclusive_scan(WIDTH, i32, 32, and, -1, and_i32)
 exclusive_scan(WIDTH, i64, 64, and, -1, and_i64)
 
@@ -4550,6 +5488,42 @@ exclusive_scan(WIDTH, i64, 64, or, 0, or_i64)
 ')
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; new_varying_i64
+;;
+;; Body of the varying new builtins: calls __do_new_varying() and returns
+;; the per-lane pointers.
+;; $1: <WIDTH x i64> vector of allocation sizes
+;; $2: variable that holds the mask
+
+define(`new_varying_i64', `
+  %sizes = alloca <WIDTH x i64>
+  store <WIDTH x i64> $1, <WIDTH x i64> * %sizes
+  %sizes64 = bitcast <WIDTH x i64> * %sizes to i64 *
+  %ret = alloca <WIDTH x i64>
+  %ret64 = bitcast <WIDTH x i64> * %ret to i64 *
+  %alignment = load PTR_OP_ARGS(`i32')  @memory_alignment
+  %mm = call i64 @__movmsk(<WIDTH x MASK> $2)
+  call void @__do_new_varying(i32 WIDTH, i64 %mm, i64 * %sizes64, i32 %alignment,
+                              i64 * %ret64)
+  %r = load PTR_OP_ARGS(`<WIDTH x i64> ')  %ret
+  ret <WIDTH x i64> %r
+')
+
+;; delete_varying
+;;
+;; Body of the varying delete builtins: calls __do_delete_varying().
+;; $1: <WIDTH x i64> vector of pointers to free
+;; $2: variable that holds the mask
+
+define(`delete_varying', `
+  %ptrs = alloca <WIDTH x i64>
+  store <WIDTH x i64> $1, <WIDTH x i64> * %ptrs
+  %ptrs64 = bitcast <WIDTH x i64> * %ptrs to i64 *
+  %mm = call i64 @__movmsk(<WIDTH x MASK> $2)
+  call void @__do_delete_varying(i32 WIDTH, i64 %mm, i64 * %ptrs64)
+  ret void
+')
+
 ;; per_lane
 ;;
 ;; The scary macro below encapsulates the 'scalarization' idiom--i.e. we have
@@ -4619,6 +5593,92 @@ pl_loopend:
 pl_done:
 ')
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; sparse gather/scatter
+;;
+;; Hardware gathers and scatters take about as long with one active lane
+;; as with all of them.  These macros go at the start of the functions that
+;; use them: if at most __sparse_gather_threshold() lanes of the mask are
+;; on, the active lanes are loaded (stored) one at a time with scalar
+;; instructions and the function returns; otherwise execution continues
+;; at the sg_vector label with the hardware instruction.
+;;
+;; $1: element type
+;; $2: offset type, i32 or i64
+;; $3: i8 * base pointer (null for vectors of pointers)
+;; $4: i32 scale that the offsets are multiplied by
+;; $5: vector of offsets
+;; $6: (sparse_gather) execution mask
+;; $6, $7: (sparse_scatter) vector of values to store, execution mask
+
+define(`sparse_gs_address', `
+  %sg_lane64 = call i64 @__count_trailing_zeros_i64(i64 %sg_bits)
+  %sg_lane = trunc i64 %sg_lane64 to i32
+  %sg_off = extractelement <WIDTH x $2> $5, i32 %sg_lane
+  ifelse($2, `i64', `%sg_off64 = add i64 %sg_off, 0',
+                    `%sg_off64 = sext $2 %sg_off to i64')
+  %sg_scaled = mul i64 %sg_off64, %sg_scale
+  %sg_addr = add i64 %sg_base, %sg_scaled
+  %sg_ptr = inttoptr i64 %sg_addr to $1 *
+  %sg_lowbit = sub i64 %sg_bits, 1
+  %sg_nextbits = and i64 %sg_bits, %sg_lowbit
+')
+
+define(`sparse_gs_check', `
+  %sg_bits0 = call i64 @__movmsk(<WIDTH x MASK> $1)
+  %sg_count = call i64 @__popcnt_int64(i64 %sg_bits0)
+  %sg_threshold32 = call i32 @__sparse_gather_threshold()
+  %sg_threshold = zext i32 %sg_threshold32 to i64
+  %sg_sparse = icmp ule i64 %sg_count, %sg_threshold
+  br i1 %sg_sparse, label %sg_scalar, label %sg_vector
+
+sg_scalar:
+  %sg_base = ptrtoint i8 * $2 to i64
+  %sg_scale = sext i32 $3 to i64
+  br label %sg_loop
+')
+
+define(`sparse_gather', `
+  sparse_gs_check($6, $3, $4)
+
+sg_loop:
+  %sg_bits = phi i64 [ %sg_bits0, %sg_scalar ], [ %sg_nextbits, %sg_body ]
+  %sg_acc = phi <WIDTH x $1> [ undef, %sg_scalar ], [ %sg_newacc, %sg_body ]
+  %sg_done = icmp eq i64 %sg_bits, 0
+  br i1 %sg_done, label %sg_exit, label %sg_body
+
+sg_body:
+  sparse_gs_address($1, $2, $3, $4, $5)
+  %sg_val = load PTR_OP_ARGS(`$1 ') %sg_ptr
+  %sg_newacc = insertelement <WIDTH x $1> %sg_acc, $1 %sg_val, i32 %sg_lane
+  br label %sg_loop
+
+sg_exit:
+  ret <WIDTH x $1> %sg_acc
+
+sg_vector:
+')
+
+define(`sparse_scatter', `
+  sparse_gs_check($7, $3, $4)
+
+sg_loop:
+  %sg_bits = phi i64 [ %sg_bits0, %sg_scalar ], [ %sg_nextbits, %sg_body ]
+  %sg_done = icmp eq i64 %sg_bits, 0
+  br i1 %sg_done, label %sg_exit, label %sg_body
+
+sg_body:
+  sparse_gs_address($1, $2, $3, $4, $5)
+  %sg_val = extractelement <WIDTH x $1> $6, i32 %sg_lane
+  store $1 %sg_val, $1 * %sg_ptr
+  br label %sg_loop
+
+sg_exit:
+  ret void
+
+sg_vector:
+')
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; gather
 ;;
@@ -5066,6 +6126,65 @@ declare  double @__rcp_uniform_double(double)
 declare <WIDTH x double> @__rcp_varying_double(<WIDTH x double>)
 ')
 
+;; rcp_fast() and rsqrt_fast(): the raw hardware reciprocal and reciprocal
+;; square root estimates, without the Newton-Raphson refinement that
+;; __rcp_varying_float() and friends apply to them.
+;; $1: native vector width of the estimate instructions
+;; $2: reciprocal estimate function
+;; $3: reciprocal square root estimate function
+;; $4: extra trailing call arguments, e.g. `, <16 x float> undef, i16 -1'
+
+define(`rcp_rsqrt_fast_float', `
+define <WIDTH x float> @__rcp_fast_varying_float(<WIDTH x float>) nounwind readnone alwaysinline {
+  unary_split(r, WIDTH, $1, float, float, $2, %0, `$4')
+  ret <WIDTH x float> %r
+}
+
+define <WIDTH x float> @__rsqrt_fast_varying_float(<WIDTH x float>) nounwind readnone alwaysinline {
+  unary_split(r, WIDTH, $1, float, float, $3, %0, `$4')
+  ret <WIDTH x float> %r
+}
+
+define float @__rcp_fast_uniform_float(float) nounwind readnone alwaysinline {
+  %v = insertelement <$1 x float> undef, float %0, i32 0
+  %rv = call <$1 x float> $2(<$1 x float> %v $4)
+  %r = extractelement <$1 x float> %rv, i32 0
+  ret float %r
+}
+
+define float @__rsqrt_fast_uniform_float(float) nounwind readnone alwaysinline {
+  %v = insertelement <$1 x float> undef, float %0, i32 0
+  %rv = call <$1 x float> $3(<$1 x float> %v $4)
+  %r = extractelement <$1 x float> %rv, i32 0
+  ret float %r
+}
+')
+
+;; For targets with no cheaper estimate than rcp() and rsqrt() themselves,
+;; rcp_fast() and rsqrt_fast() are just those.
+
+define(`rcp_rsqrt_fast_float_fallback', `
+define <WIDTH x float> @__rcp_fast_varying_float(<WIDTH x float>) nounwind readnone alwaysinline {
+  %r = call <WIDTH x float> @__rcp_varying_float(<WIDTH x float> %0)
+  ret <WIDTH x float> %r
+}
+
+define <WIDTH x float> @__rsqrt_fast_varying_float(<WIDTH x float>) nounwind readnone alwaysinline {
+  %r = call <WIDTH x float> @__rsqrt_varying_float(<WIDTH x float> %0)
+  ret <WIDTH x float> %r
+}
+
+define float @__rcp_fast_uniform_float(float) nounwind readnone alwaysinline {
+  %r = call float @__rcp_uniform_float(float %0)
+  ret float %r
+}
+
+define float @__rsqrt_fast_uniform_float(float) nounwind readnone alwaysinline {
+  %r = call float @__rsqrt_uniform_float(float %0)
+  ret float %r
+}
+')
+
 define(`declare_nvptx',
 `
 declare i32 @__program_index()  nounwind readnone alwaysinline
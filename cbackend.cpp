@@ -397,6 +397,29 @@ static bool is_vec16_i64_ty(llvm::Type *Ty) {
 }
 
 namespace {
+  /// SplitOutputStream - The stream that CWriter writes to when the output
+  /// is split across several files (see --c++-split); it collects the
+  /// text for the shared header (part 0) and for each of the translation
+  /// units, appending to whichever part is currently selected.
+  class SplitOutputStream : public llvm::raw_ostream {
+  public:
+    SplitOutputStream(int numFiles)
+        : llvm::raw_ostream(true), Contents(numFiles), Current(0) { }
+
+    int getNumFiles() const { return (int)Contents.size(); }
+    void setCurrent(int file) { Current = file; }
+    const std::string &getContents(int file) const { return Contents[file]; }
+
+  private:
+    virtual void write_impl(const char *ptr, size_t size) {
+      Contents[Current].append(ptr, size);
+    }
+    virtual uint64_t current_pos() const { return Contents[Current].size(); }
+
+    std::vector<std::string> Contents;
+    int Current;
+  };
+
   class CBEMCAsmInfo : public llvm::MCAsmInfo {
   public:
     CBEMCAsmInfo() {
@@ -439,6 +462,16 @@ namespace {
     std::string includeName;
     int vectorWidth;
 
+    /// When the output is split across several translation units (see
+    /// --c++-split), the stream that Out writes through, the name the
+    /// units use to #include the shared header, the unit that each defined
+    /// function and global variable is written to, and the unit currently
+    /// being written (-1 means the header).
+    SplitOutputStream *splitOut;
+    std::string splitHeaderName;
+    std::map<const llvm::GlobalValue *, int> splitPart;
+    int currentPart;
+
     /// UnnamedStructIDs - This contains a unique ID for each struct that is
     /// either anonymous or has no name.
     llvm::DenseMap<llvm::StructType*, unsigned> UnnamedStructIDs;
@@ -447,12 +480,14 @@ namespace {
   public:
     static char ID;
       explicit CWriter(llvm::formatted_raw_ostream &o, const char *incname,
-                       int vecwidth)
+                       int vecwidth, SplitOutputStream *splitout = NULL,
+                       const std::string &splitheader = "")
           : FunctionPass(ID), Out(o), IL(0), /* Mang(0), */ LI(0),
         TheModule(0), TAsm(0), MRI(0), MOFI(0), TCtx(0), TD(0),
         OpaqueCounter(0), NextAnonValueNumber(0),
         includeName(incname ? incname : "generic_defs.h"),
-        vectorWidth(vecwidth) {
+        vectorWidth(vecwidth), splitOut(splitout),
+        splitHeaderName(splitheader), currentPart(-1) {
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_6 // <= 3.6
       initializeLoopInfoPass(*llvm::PassRegistry::getPassRegistry());
 #else // LLVM 3.7+
@@ -491,6 +526,9 @@ namespace {
      LI = &getAnalysis<llvm::LoopInfoWrapperPass>().getLoopInfo();
 #endif
 
+      if (isSplit())
+        switchToPart(splitPart[&F]);
+
       // Get rid of intrinsics we can't handle.
       lowerIntrinsics(F);
 
@@ -520,6 +558,7 @@ namespace {
       intrinsicPrototypesAlreadyGenerated.clear();
       UnnamedStructIDs.clear();
       ArrayIDs.clear();
+      splitPart.clear();
       return false;
     }
 
@@ -573,6 +612,11 @@ namespace {
                            bool IsVolatile, unsigned Alignment);
 
   private :
+    bool isSplit() const { return splitOut != NULL; }
+    int getNumParts() const { return splitOut->getNumFiles() - 1; }
+    void computeSplitParts(llvm::Module &M);
+    void switchToPart(int part);
+
     void lowerIntrinsics(llvm::Function &F);
     /// Prints the definition of the intrinsic function F. Supports the
     /// intrinsics which need to be explicitly defined in the CBackend.
@@ -585,6 +629,10 @@ namespace {
     void printFloatingPointConstants(const llvm::Constant *C);
     void printVectorConstants(llvm::Function &F);
     void printFunctionSignature(const llvm::Function *F, bool Prototype);
+    void printFunctionDeclaration(llvm::Function *F,
+                                  const std::set<llvm::Function*> &StaticCtors,
+                                  const std::set<llvm::Function*> &StaticDtors);
+    void printGlobalVariableDefinitions(llvm::Module &M, int part);
 
     void printFunction(llvm::Function &);
     void printBasicBlock(llvm::BasicBlock *BB);
@@ -2215,6 +2263,24 @@ static void generateCompilerSpecificCode(llvm::formatted_raw_ostream& Out,
       << "#define __HIDDEN__ __attribute__((visibility(\"hidden\")))\n"
       << "#endif\n\n";
 
+  // Aliasing, alignment and scheduling hints for the C++ compiler: noalias
+  // pointer parameters become restrict-qualified, scalar accesses that
+  // LLVM knows to be over-aligned assert that alignment, and externally
+  // visible functions are marked hot.
+  Out << "#if defined(__GNUC__) || defined(__clang__) || defined(__INTEL_COMPILER)\n"
+      << "#define __ISPC_RESTRICT__ __restrict__\n"
+      << "#define __ISPC_HOT__ __attribute__((hot))\n"
+      << "#define __ISPC_ASSUME_ALIGNED__(P, A) __builtin_assume_aligned(P, A)\n"
+      << "#elif defined(_MSC_VER)\n"
+      << "#define __ISPC_RESTRICT__ __restrict\n"
+      << "#define __ISPC_HOT__\n"
+      << "#define __ISPC_ASSUME_ALIGNED__(P, A) (P)\n"
+      << "#else\n"
+      << "#define __ISPC_RESTRICT__\n"
+      << "#define __ISPC_HOT__\n"
+      << "#define __ISPC_ASSUME_ALIGNED__(P, A) (P)\n"
+      << "#endif\n\n";
+
   // Define NaN and Inf as GCC builtins if using GCC, as 0 otherwise
   // From the GCC documentation:
   //
@@ -2378,6 +2444,140 @@ static void PrintEscapedString(const std::string &Str, llvm::raw_ostream &Out) {
   PrintEscapedString(Str.c_str(), Str.size(), Out);
 }
 
+static void PrintGeneratedFileBanner(llvm::raw_ostream &Out) {
+  Out << "/*******************************************************************\n";
+  Out << "  This file has been automatically generated by ispc\n";
+  Out << "  DO NOT EDIT THIS FILE DIRECTLY\n";
+  Out << " *******************************************************************/\n\n";
+}
+
+/// CollectReferencedGlobals - Add the global values that V refers to,
+/// directly or through constant expressions and aggregates, to Refs.
+static void CollectReferencedGlobals(const llvm::Value *V,
+                                     std::set<const llvm::GlobalValue *> &Refs,
+                                     std::set<const llvm::Constant *> &Visited) {
+  if (const llvm::GlobalValue *GV = llvm::dyn_cast<llvm::GlobalValue>(V)) {
+    Refs.insert(GV);
+    return;
+  }
+  const llvm::Constant *C = llvm::dyn_cast<llvm::Constant>(V);
+  if (C == NULL || !Visited.insert(C).second)
+    return;
+  for (unsigned i = 0; i < C->getNumOperands(); ++i)
+    CollectReferencedGlobals(C->getOperand(i), Refs, Visited);
+}
+
+static const llvm::GlobalValue *
+FindSplitRoot(std::map<const llvm::GlobalValue *, const llvm::GlobalValue *> &Parent,
+              const llvm::GlobalValue *GV) {
+  while (Parent[GV] != GV)
+    GV = Parent[GV] = Parent[Parent[GV]];
+  return GV;
+}
+
+/// computeSplitParts - Assign each function and global variable that is
+/// defined in the module to one of the translation units.  Everything that
+/// refers to an internal function or variable goes to the same unit as
+/// it, so that nothing needs to change linkage; the groups formed that
+/// way are then assigned to units by a hash of their names, so that a
+/// change to one function only changes the file that holds it.
+void CWriter::computeSplitParts(llvm::Module &M) {
+  std::map<const llvm::GlobalValue *, const llvm::GlobalValue *> Parent;
+  std::vector<const llvm::GlobalValue *> Defined;
+  for (llvm::Module::iterator I = M.begin(), E = M.end(); I != E; ++I)
+    if (!I->isDeclaration() && !I->hasAvailableExternallyLinkage()) {
+      Parent[&*I] = &*I;
+      Defined.push_back(&*I);
+    }
+  for (llvm::Module::global_iterator I = M.global_begin(), E = M.global_end();
+       I != E; ++I)
+    if (!I->isDeclaration() && !getGlobalVariableClass(&*I)) {
+      Parent[&*I] = &*I;
+      Defined.push_back(&*I);
+    }
+
+  for (unsigned i = 0; i < Defined.size(); ++i) {
+    std::set<const llvm::GlobalValue *> Refs;
+    std::set<const llvm::Constant *> Visited;
+    if (const llvm::Function *F = llvm::dyn_cast<llvm::Function>(Defined[i])) {
+      for (llvm::Function::const_iterator BB = F->begin(), BE = F->end();
+           BB != BE; ++BB)
+        for (llvm::BasicBlock::const_iterator I = BB->begin(), IE = BB->end();
+             I != IE; ++I)
+          for (unsigned j = 0; j < I->getNumOperands(); ++j)
+            CollectReferencedGlobals(I->getOperand(j), Refs, Visited);
+    }
+    else
+      CollectReferencedGlobals(
+          llvm::cast<llvm::GlobalVariable>(Defined[i])->getInitializer(),
+          Refs, Visited);
+
+    for (std::set<const llvm::GlobalValue *>::iterator R = Refs.begin();
+         R != Refs.end(); ++R)
+      if ((*R)->hasLocalLinkage() && Parent.count(*R))
+        Parent[FindSplitRoot(Parent, *R)] = FindSplitRoot(Parent, Defined[i]);
+  }
+
+  // Name each group after the alphabetically first of its members.
+  std::map<const llvm::GlobalValue *, std::string> GroupName;
+  for (unsigned i = 0; i < Defined.size(); ++i) {
+    std::string name = Defined[i]->getName().str();
+    const llvm::GlobalValue *root = FindSplitRoot(Parent, Defined[i]);
+    if (GroupName.count(root) == 0 || name < GroupName[root])
+      GroupName[root] = name;
+  }
+
+  for (unsigned i = 0; i < Defined.size(); ++i) {
+    // FNV-1a, so that the assignment doesn't depend on the host's
+    // std::hash.
+    const std::string &name = GroupName[FindSplitRoot(Parent, Defined[i])];
+    uint32_t hash = 2166136261u;
+    for (unsigned j = 0; j < name.size(); ++j)
+      hash = (hash ^ (unsigned char)name[j]) * 16777619u;
+    splitPart[Defined[i]] = (int)(hash % (uint32_t)getNumParts());
+  }
+}
+
+/// switchToPart - Direct the output to the given translation unit, or to
+/// the shared header if part is -1.
+void CWriter::switchToPart(int part) {
+  if (part == currentPart)
+    return;
+  Out.flush();
+  splitOut->setCurrent(part + 1);
+  currentPart = part;
+
+  // The constants and prototypes that are emitted ahead of the functions
+  // that use them are static to each translation unit.
+  FPConstantMap.clear();
+  VectorConstantMap.clear();
+  intrinsicPrototypesAlreadyGenerated.clear();
+}
+
+void CWriter::printFunctionDeclaration(llvm::Function *F,
+                                       const std::set<llvm::Function*> &StaticCtors,
+                                       const std::set<llvm::Function*> &StaticDtors) {
+  if (F->hasExternalWeakLinkage())
+    Out << "extern ";
+  printFunctionSignature(F, true);
+  if (F->hasWeakLinkage() || F->hasLinkOnceLinkage())
+    Out << " __ATTRIBUTE_WEAK__";
+  if (F->hasExternalWeakLinkage())
+    Out << " __EXTERNAL_WEAK__";
+  if (StaticCtors.count(F))
+    Out << " __ATTRIBUTE_CTOR__";
+  if (StaticDtors.count(F))
+    Out << " __ATTRIBUTE_DTOR__";
+  if (F->hasHiddenVisibility())
+    Out << " __HIDDEN__";
+
+  // This is MacOS specific feature, this should not appear on other platforms.
+  if (F->hasName() && F->getName()[0] == 1)
+    Out << " LLVM_ASM(\"" << F->getName().substr(1) << "\")";
+
+  Out << ";\n";
+}
+
 bool CWriter::doInitialization(llvm::Module &M) {
   llvm::FunctionPass::doInitialization(M);
 
@@ -2426,10 +2626,10 @@ bool CWriter::doInitialization(llvm::Module &M) {
     }
   }
 
-  Out << "/*******************************************************************\n";
-  Out << "  This file has been automatically generated by ispc\n";
-  Out << "  DO NOT EDIT THIS FILE DIRECTLY\n";
-  Out << " *******************************************************************/\n\n";
+  if (isSplit())
+    computeSplitParts(M);
+
+  PrintGeneratedFileBanner(Out);
 
   Out << "/* Provide Declarations */\n";
   Out << "#include <stdarg.h>\n";      // Varargs support
@@ -2590,6 +2790,8 @@ bool CWriter::doInitialization(llvm::Module &M) {
 
   // Store the intrinsics which will be declared/defined below.
   llvm::SmallVector<const llvm::Function*, 8> intrinsicsToDefine;
+  std::vector<std::vector<llvm::Function*> > localPrototypes(
+      isSplit() ? getNumParts() : 0);
 
   for (llvm::Module::iterator I = M.begin(), E = M.end(); I != E; ++I) {
     // Don't print declarations for intrinsic functions.
@@ -2631,35 +2833,14 @@ bool CWriter::doInitialization(llvm::Module &M) {
     if (name.size() > 2 && name[0] == '_' && name[1] == '_')
         continue;
 
-    if (I->hasExternalWeakLinkage())
-      Out << "extern ";
-#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_7 /* 3.2, 3.3, 3.4, 3.5, 3.6, 3.7 */
-    printFunctionSignature(I, true);
-#else /* LLVM 3.8+ */
-    printFunctionSignature(&*I, true);
-#endif
-    if (I->hasWeakLinkage() || I->hasLinkOnceLinkage())
-      Out << " __ATTRIBUTE_WEAK__";
-    if (I->hasExternalWeakLinkage())
-      Out << " __EXTERNAL_WEAK__";
-#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_7 /* 3.2, 3.3, 3.4, 3.5, 3.6, 3.7 */
-    if (StaticCtors.count(I))
-      Out << " __ATTRIBUTE_CTOR__";
-    if (StaticDtors.count(I))
-#else /* LLVM 3.8+ */
-    if (StaticCtors.count(&*I))
-      Out << " __ATTRIBUTE_CTOR__";
-    if (StaticDtors.count(&*I))
-#endif
-      Out << " __ATTRIBUTE_DTOR__";
-    if (I->hasHiddenVisibility())
-      Out << " __HIDDEN__";
-
-    // This is MacOS specific feature, this should not appear on other platforms.
-    if (I->hasName() && I->getName()[0] == 1)
-      Out << " LLVM_ASM(\"" << I->getName().substr(1) << "\")";
+    // When splitting, internal functions are declared in the translation
+    // unit that defines them rather than in the shared header.
+    if (isSplit() && I->hasLocalLinkage()) {
+      localPrototypes[splitPart[&*I]].push_back(&*I);
+      continue;
+    }
 
-    Out << ";\n";
+    printFunctionDeclaration(&*I, StaticCtors, StaticDtors);
   }
   Out << "}\n\n";
 
@@ -2706,6 +2887,36 @@ bool CWriter::doInitialization(llvm::Module &M) {
     printIntrinsicDefinition(**I, Out);
   }
 
+  if (!isSplit())
+    printGlobalVariableDefinitions(M, -1);
+  else {
+    for (int part = 0; part < getNumParts(); ++part) {
+      switchToPart(part);
+      PrintGeneratedFileBanner(Out);
+      Out << "#include \"" << splitHeaderName << "\"\n";
+
+      if (!localPrototypes[part].empty()) {
+        Out << "\n/* Function Declarations */\n";
+        Out << "extern \"C\" {\n";
+        for (unsigned i = 0; i < localPrototypes[part].size(); ++i)
+          printFunctionDeclaration(localPrototypes[part][i], StaticCtors,
+                                   StaticDtors);
+        Out << "}\n";
+      }
+
+      printGlobalVariableDefinitions(M, part);
+      Out << "\n\n/* Function Bodies */\n";
+    }
+  }
+
+  return false;
+}
+
+
+/// printGlobalVariableDefinitions - Output the definitions and contents of
+/// the global variables; if part isn't -1, only of those that were
+/// assigned to that translation unit.
+void CWriter::printGlobalVariableDefinitions(llvm::Module &M, int part) {
   // Output the global variable definitions and contents...
   if (!M.global_empty()) {
     Out << "\n\n/* Global Variable Definitions and Initialization */\n";
@@ -2720,6 +2931,9 @@ bool CWriter::doInitialization(llvm::Module &M) {
 #endif
           continue;
 
+        if (part >= 0 && splitPart[&*I] != part)
+          continue;
+
         if (I->hasLocalLinkage())
           Out << "static ";
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
@@ -2790,8 +3004,6 @@ bool CWriter::doInitialization(llvm::Module &M) {
         Out << ";\n";
       }
   }
-
-  return false;
 }
 
 
@@ -3128,6 +3340,7 @@ void CWriter::printFunctionSignature(const llvm::Function *F, bool Prototype) {
   if (F->hasDLLImportLinkage()) Out << "__declspec(dllimport) ";
   if (F->hasDLLExportLinkage()) Out << "__declspec(dllexport) ";
 #endif
+  if (!F->isDeclaration() && !F->hasLocalLinkage()) Out << "__ISPC_HOT__ ";
   switch (F->getCallingConv()) {
    case llvm::CallingConv::X86_StdCall:
     Out << "__attribute__((stdcall)) ";
@@ -3194,6 +3407,10 @@ void CWriter::printFunctionSignature(const llvm::Function *F, bool Prototype) {
           ByValParams.insert(&*I);
 #endif
         }
+        else if (ArgTy->isPointerTy() && I->hasNoAliasAttr())
+          // printType() prints pointers as "T *" followed by the name, so
+          // this gives "T *__ISPC_RESTRICT__ name".
+          ArgName = "__ISPC_RESTRICT__ " + ArgName;
         printType(FunctionInnards, ArgTy,
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
                   PAL.getParamAttributes(Idx).hasAttribute(llvm::Attributes::SExt),
@@ -4632,6 +4849,19 @@ void CWriter::writeMemoryAccess(llvm::Value *Operand, llvm::Type *OperandType,
   bool IsUnaligned = Alignment &&
     Alignment < TD->getABITypeAlignment(OperandType);
 
+  // If the access is known to be more aligned than the type requires,
+  // pass that on to the C++ compiler.
+  bool IsOverAligned = !IsVolatile && Alignment >= 16 &&
+    Alignment > TD->getABITypeAlignment(OperandType);
+  if (IsOverAligned) {
+    Out << "*((";
+    printType(Out, OperandType, false, "*");
+    Out << ")__ISPC_ASSUME_ALIGNED__(";
+    writeOperand(Operand);
+    Out << ", " << Alignment << "))";
+    return;
+  }
+
   llvm::IntegerType *ITy = llvm::dyn_cast<llvm::IntegerType>(OperandType);
   if (!IsUnaligned)
     Out << '*';
@@ -5385,10 +5615,10 @@ MaskOpsCleanupPass::runOnBasicBlock(llvm::BasicBlock &bb) {
 //                       External Interface declaration
 //===----------------------------------------------------------------------===//
 
-bool
-WriteCXXFile(llvm::Module *module, const char *fn, int vectorWidth,
-             const char *includeName) {
-
+static void
+RunCWriter(llvm::Module *module, llvm::formatted_raw_ostream &fos,
+           int vectorWidth, const char *includeName,
+           SplitOutputStream *splitOut, const std::string &splitHeaderName) {
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_6 // 3.2, 3.3, 3.4, 3.5, 3.6
     llvm::PassManager pm;
 #else // LLVM 3.7+
@@ -5401,6 +5631,106 @@ WriteCXXFile(llvm::Module *module, const char *fn, int vectorWidth,
         pm.add(new llvm::TargetData(module));
 #endif
 
+    pm.add(llvm::createGCLoweringPass());
+    pm.add(llvm::createLowerInvokePass());
+    pm.add(llvm::createCFGSimplificationPass());   // clean up after lower invoke.
+    pm.add(new SmearCleanupPass(module, vectorWidth));
+    pm.add(new AndCmpCleanupPass());
+    pm.add(new MaskOpsCleanupPass(module));
+    pm.add(llvm::createDeadCodeEliminationPass()); // clean up after smear pass
+//CO    pm.add(llvm::createPrintModulePass(&fos));
+    pm.add(new CWriter(fos, includeName, vectorWidth, splitOut,
+                       splitHeaderName));
+#if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
+    // This interface is depricated for 3.3+
+    pm.add(llvm::createGCInfoDeleter());
+#endif
+//CO    pm.add(llvm::createVerifierPass());
+
+    pm.run(*module);
+}
+
+
+/// WriteFileIfChanged - Write the given contents to the file, unless it
+/// already holds exactly them; leaving the file untouched keeps build
+/// systems from recompiling translation units that didn't change.
+static bool
+WriteFileIfChanged(const std::string &fn, const std::string &contents) {
+    FILE *f = fopen(fn.c_str(), "rb");
+    if (f != NULL) {
+        std::string existing;
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            existing.append(buf, n);
+        fclose(f);
+        if (existing == contents)
+            return true;
+    }
+
+    f = fopen(fn.c_str(), "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Error opening output file \"%s\".\n", fn.c_str());
+        return false;
+    }
+    bool ok = (fwrite(contents.data(), 1, contents.size(), f) ==
+               contents.size());
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "Error writing output file \"%s\".\n", fn.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/// WriteSplitCXXFiles - Emit the module as numParts translation units: fn
+/// itself and <stem>_1<ext> through <stem>_<numParts-1><ext>, which all
+/// include the types, declarations and prototypes from <stem>_shared.h.
+static bool
+WriteSplitCXXFiles(llvm::Module *module, const char *fn, int vectorWidth,
+                   const char *includeName, int numParts) {
+    std::string fileName = fn, stem = fn, ext;
+    size_t dot = fileName.rfind('.');
+    size_t slash = fileName.find_last_of("/\\");
+    if (dot != std::string::npos &&
+        (slash == std::string::npos || dot > slash)) {
+        stem = fileName.substr(0, dot);
+        ext = fileName.substr(dot);
+    }
+
+    std::vector<std::string> fileNames;
+    fileNames.push_back(stem + "_shared.h");
+    fileNames.push_back(fileName);
+    for (int i = 1; i < numParts; ++i) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "_%d", i);
+        fileNames.push_back(stem + buf + ext);
+    }
+    std::string headerName = (slash == std::string::npos) ? fileNames[0] :
+        fileNames[0].substr(slash + 1);
+
+    SplitOutputStream splitOut(fileNames.size());
+    {
+        llvm::formatted_raw_ostream fos(splitOut);
+        RunCWriter(module, fos, vectorWidth, includeName, &splitOut,
+                   headerName);
+    }
+
+    bool ok = true;
+    for (unsigned i = 0; i < fileNames.size(); ++i)
+        if (!WriteFileIfChanged(fileNames[i], splitOut.getContents(i)))
+            ok = false;
+    return ok;
+}
+
+
+bool
+WriteCXXFile(llvm::Module *module, const char *fn, int vectorWidth,
+             const char *includeName, int numParts) {
+    if (numParts > 1)
+        return WriteSplitCXXFiles(module, fn, vectorWidth, includeName,
+                                  numParts);
+
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_3 // 3.2, 3.3
     int flags = 0;
 #else // LLVM 3.4+
@@ -5425,23 +5755,7 @@ WriteCXXFile(llvm::Module *module, const char *fn, int vectorWidth,
     }
 
     llvm::formatted_raw_ostream fos(of->os());
-
-    pm.add(llvm::createGCLoweringPass());
-    pm.add(llvm::createLowerInvokePass());
-    pm.add(llvm::createCFGSimplificationPass());   // clean up after lower invoke.
-    pm.add(new SmearCleanupPass(module, vectorWidth));
-    pm.add(new AndCmpCleanupPass());
-    pm.add(new MaskOpsCleanupPass(module));
-    pm.add(llvm::createDeadCodeEliminationPass()); // clean up after smear pass
-//CO    pm.add(llvm::createPrintModulePass(&fos));
-    pm.add(new CWriter(fos, includeName, vectorWidth));
-#if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
-    // This interface is depricated for 3.3+
-    pm.add(llvm::createGCInfoDeleter());
-#endif
-//CO    pm.add(llvm::createVerifierPass());
-
-    pm.run(*module);
+    RunCWriter(module, fos, vectorWidth, includeName, NULL, "");
 
     return true;
 }
@@ -46,7 +46,7 @@
 #include <intrin.h>
 #endif
 
-#if !defined (__arm__)
+#if !defined (__arm__) && !defined (__aarch64__)
 #if !defined(ISPC_IS_WINDOWS)
 static void __cpuid(int info[4], int infoType) {
     __asm__ __volatile__ ("cpuid"
@@ -99,7 +99,7 @@ static bool __os_has_avx512_support() {
 
 static const char *
 lGetSystemISA() {
-#ifdef __arm__
+#if defined (__arm__) || defined (__aarch64__)
     return "ARM NEON";
 #else
     int info[4];
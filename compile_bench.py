@@ -0,0 +1,240 @@
+#!/usr/bin/python
+#
+#  Copyright (c) 2017, Intel Corporation
+#  All rights reserved.
+# 
+#  Redistribution and use in source and binary forms, with or without
+#  modification, are permitted provided that the following conditions are
+#  met:
+# 
+#    * Redistributions of source code must retain the above copyright
+#      notice, this list of conditions and the following disclaimer.
+# 
+#    * Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+# 
+#    * Neither the name of Intel Corporation nor the names of its
+#      contributors may be used to endorse or promote products derived from
+#      this software without specific prior written permission.
+# 
+# 
+#   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+#   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+#   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+#   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+#   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+#   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+#   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+#   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+#   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+#   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+#   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Measures how long ispc takes to compile a representative corpus: the
+# examples, the tests that use the standard library most heavily and a
+# large generated file with many functions.  Each file is compiled for
+# each of the given targets at -O0 and -O2 with --time-report, recording
+# the wall clock time, the peak memory use and the time of each phase.
+#
+#   ./compile_bench.py --save=base.json
+#   (rebuild ispc)
+#   ./compile_bench.py --save=new.json --baseline=base.json
+#
+# The script exits with status 1 when the total compile time for some
+# target and optimization level got slower than the baseline by more than
+# --threshold percent.
+
+from optparse import OptionParser
+import sys
+import os
+import re
+import glob
+import json
+import time
+import socket
+import tempfile
+import subprocess
+
+def stdlib_functions(path):
+    names = set()
+    for line in open(os.path.join(path, "stdlib.ispc")):
+        m = re.match(r"static\s+(?:inline\s+)?[\w\s*]*?(\w+)\s*\(", line)
+        if m and not m.group(1).startswith("__"):
+            names.add(m.group(1))
+    return names
+
+def heaviest_tests(path, count):
+    # Ranks the tests by the number of calls to standard library functions.
+    names = stdlib_functions(path)
+    ranked = []
+    for f in glob.glob(os.path.join(path, "tests", "*.ispc")):
+        calls = 0
+        for word in re.findall(r"(\w+)\s*\(", open(f).read()):
+            if word in names:
+                calls += 1
+        ranked.append((calls, f))
+    ranked.sort(reverse=True)
+    return [f for (calls, f) in ranked[:count]]
+
+def generate_synthetic(filename, functions):
+    # A mix of varying control flow, loops, memory accesses and calls to
+    # the standard library, so that all of the phases get some work.
+    f = open(filename, "w")
+    for i in range(functions):
+        f.write("""
+static float f%d(uniform float a[], int n, float x) {
+    float sum = 0;
+    for (int i = 0; i < n; ++i) {
+        float v = a[i * %d + programIndex];
+        if (v > x)
+            sum += sqrt(v) * %d.5f;
+        else
+            sum -= exp(v - x);
+    }
+    return sum + reduce_add(x);
+}
+""" % (i, i % 7 + 1, i))
+        if i > 0:
+            f.write("""
+export void e%d(uniform float a[], uniform int n, uniform float out[]) {
+    foreach (i = 0 ... n)
+        out[i] = f%d(a, n, a[i]) + f%d(a, n, out[i]);
+}
+""" % (i, i, i - 1))
+    f.close()
+
+def corpus(options):
+    files = []
+    for f in sorted(glob.glob(os.path.join(options.path, "examples", "*", "*.ispc"))):
+        files.append(("example", f))
+    for f in heaviest_tests(options.path, int(options.tests)):
+        files.append(("test", f))
+    if int(options.functions) > 0:
+        synthetic = os.path.join(tempfile.gettempdir(), "ispc_compile_bench.ispc")
+        generate_synthetic(synthetic, int(options.functions))
+        files.append(("synthetic", synthetic))
+    return files
+
+def compile_one(options, filename, target, opt):
+    # Returns (seconds, peak RSS in kilobytes, {phase: seconds}) for the
+    # fastest of the repeated compiles, or None if compilation failed.
+    report = os.path.join(tempfile.gettempdir(), "ispc_compile_bench_report.json")
+    cmd = [options.ispc, "--woff", "--target=" + target, opt,
+           "-I" + os.path.dirname(filename), "-I" + os.path.join(options.path, "examples"),
+           "--time-report=" + report, "-o", os.devnull, filename]
+    best = None
+    for r in range(int(options.repeat)):
+        null = open(os.devnull, "w")
+        start = time.time()
+        p = subprocess.Popen(cmd, stdout=null, stderr=null)
+        rss = -1
+        if hasattr(os, "wait4"):
+            (pid, status, usage) = os.wait4(p.pid, 0)
+            # ru_maxrss is in bytes on OS X and in kilobytes elsewhere.
+            rss = usage.ru_maxrss // 1024 if sys.platform == "darwin" else usage.ru_maxrss
+            p.returncode = status
+        else:
+            p.wait()
+        seconds = time.time() - start
+        if p.returncode != 0:
+            return None
+        phases = {}
+        if os.path.exists(report):
+            for e in json.load(open(report)):
+                # Optimization passes are counted in "optimization".
+                if e["stage"] == -1:
+                    phases[e["phase"]] = phases.get(e["phase"], 0.0) + e["seconds"]
+                    rss = max(rss, e.get("peak_rss_kb", -1))
+            os.remove(report)
+        if best == None or seconds < best[0]:
+            best = (seconds, rss, phases)
+    return best
+
+def run(options):
+    results = {}
+    files = corpus(options)
+    for target in options.targets.split(","):
+        for opt in options.opts.split(","):
+            key = target + " " + opt
+            entry = {"seconds": 0.0, "peak_rss_kb": -1, "phases": {}, "files": {}}
+            for (kind, filename) in files:
+                r = compile_one(options, filename, target, opt)
+                name = kind + ":" + os.path.basename(filename)
+                if r == None:
+                    sys.stderr.write("%s: compiling %s failed\n" % (key, name))
+                    continue
+                (seconds, rss, phases) = r
+                entry["files"][name] = {"seconds": seconds, "peak_rss_kb": rss}
+                entry["seconds"] += seconds
+                entry["peak_rss_kb"] = max(entry["peak_rss_kb"], rss)
+                for phase in phases:
+                    entry["phases"][phase] = entry["phases"].get(phase, 0.0) + phases[phase]
+            results[key] = entry
+            sys.stdout.write("%-28s %10.3f s %10.1f MB peak  (%d files)\n" %
+                             (key, entry["seconds"], entry["peak_rss_kb"] / 1024.0,
+                              len(entry["files"])))
+    return results
+
+def compare(results, baseline, options):
+    regressions = 0
+    sys.stdout.write("\n%-28s %12s %12s %8s\n" % ("target", "baseline", "current", "change"))
+    for key in sorted(results.keys()):
+        if not key in baseline:
+            continue
+        a = baseline[key]["seconds"]
+        b = results[key]["seconds"]
+        change = 100.0 * (b - a) / a if a > 0 else 0.0
+        mark = ""
+        if change > float(options.threshold):
+            mark = " <- regression"
+            regressions += 1
+        sys.stdout.write("%-28s %11.3fs %11.3fs %7.2f%%%s\n" % (key, a, b, change, mark))
+        # Show which phases got slower.
+        if mark != "":
+            for phase in sorted(results[key]["phases"].keys()):
+                p_a = baseline[key]["phases"].get(phase, 0.0)
+                p_b = results[key]["phases"][phase]
+                if p_a > 0:
+                    sys.stdout.write("    %-32s %11.3fs %11.3fs %7.2f%%\n" %
+                                     (phase, p_a, p_b, 100.0 * (p_b - p_a) / p_a))
+    return regressions
+
+if __name__ == "__main__":
+    parser = OptionParser()
+    parser.add_option('-p', '--path', dest='path',
+        help='path to ispc root', default=".")
+    parser.add_option('--ispc', dest='ispc',
+        help='ispc executable to measure', default="ispc")
+    parser.add_option('-t', '--targets', dest='targets',
+        help='comma-separated targets to compile for',
+        default="sse2-i32x4,sse4-i32x4,sse4-i16x8,sse4-i8x16,avx1-i32x8,avx2-i32x8,avx2-i32x16,avx512skx-i32x16")
+    parser.add_option('-O', '--opts', dest='opts',
+        help='comma-separated optimization levels', default="-O0,-O2")
+    parser.add_option('--tests', dest='tests',
+        help='number of the most stdlib-heavy tests to include', default="50")
+    parser.add_option('--functions', dest='functions',
+        help='number of functions in the generated file (0 to skip it)', default="2000")
+    parser.add_option('-n', '--repeat', dest='repeat',
+        help='compile each file this many times and keep the fastest', default="3")
+    parser.add_option('-s', '--save', dest='save',
+        help='save the results to this JSON file', default="")
+    parser.add_option('-b', '--baseline', dest='baseline',
+        help='JSON file with results to compare against', default="")
+    parser.add_option('--threshold', dest='threshold',
+        help='minimal slowdown of the total time, in percent, reported as a regression', default="10")
+    (options, args) = parser.parse_args()
+
+    results = run(options)
+    if options.save != "":
+        version = subprocess.Popen([options.ispc, "--version"],
+                                   stdout=subprocess.PIPE).communicate()[0].decode().strip()
+        out = {"ispc": version, "host": socket.gethostname(),
+               "date": time.strftime("%Y-%m-%d %H:%M:%S"), "results": results}
+        f = open(options.save, "w")
+        json.dump(out, f, indent=1, sort_keys=True)
+        f.close()
+    if options.baseline != "":
+        baseline = json.load(open(options.baseline))["results"]
+        if compare(results, baseline, options) > 0:
+            sys.exit(1)
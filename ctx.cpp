@@ -45,16 +45,19 @@
 #include "module.h"
 #include "sym.h"
 #include <map>
+#include <algorithm>
 #include <llvm/Support/Dwarf.h>
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
   #include <llvm/Metadata.h>
   #include <llvm/Module.h>
   #include <llvm/Instructions.h>
+  #include <llvm/Intrinsics.h>
   #include <llvm/DerivedTypes.h>
 #else
   #include <llvm/IR/Metadata.h>
   #include <llvm/IR/Module.h>
   #include <llvm/IR/Instructions.h>
+  #include <llvm/IR/Intrinsics.h>
   #include <llvm/IR/DerivedTypes.h>
 #endif
 #ifdef ISPC_NVPTX_ENABLED
@@ -62,6 +65,29 @@
 #include <llvm/Support/FormattedStream.h>
 #endif /* ISPC_NVPTX_ENABLED */
 
+/** State for a varying "switch" statement in which each program
+    instance's value is mapped to the position of the label that it
+    selects with a table lookup at entry; whenever the mask is all off at a
+    label, the code goes directly to the first label after it that some
+    program instance selects rather than testing each of the labels in
+    between.
+*/
+struct SwitchDispatch {
+    /** Position of each program instance's label in the order of the
+        labels in the switch, or INT32_MAX for program instances that
+        don't run any of them. */
+    llvm::Value *labelPositions;
+    /** Memory that holds the position of the label that was just skipped
+        over when branching to the dispatch block. */
+    llvm::Value *positionPtr;
+    /** Block that branches to the first label after the position in
+        positionPtr that some program instance selects. */
+    llvm::BasicBlock *dispatchBlock;
+    /** Position of each label's basic block. */
+    std::map<llvm::BasicBlock *, int> blockPositions;
+};
+
+
 /** This is a small utility structure that records information related to one
     level of nested control flow.  It's mostly used in correctly restoring
     the mask and other state as we exit control flow nesting levels.
@@ -95,7 +121,7 @@ struct CFInfo {
                              llvm::BasicBlock *bbDefault,
                              const std::vector<std::pair<int, llvm::BasicBlock *> > *bbCases,
                              const std::map<llvm::BasicBlock *, llvm::BasicBlock *> *bbNext,
-                             bool scUniform);
+                             bool scUniform, SwitchDispatch *sd);
 
     bool IsIf() { return type == If; }
     bool IsLoop() { return type == Loop; }
@@ -118,6 +144,7 @@ struct CFInfo {
     const std::vector<std::pair<int, llvm::BasicBlock *> > *savedCaseBlocks;
     const std::map<llvm::BasicBlock *, llvm::BasicBlock *> *savedNextBlocks;
     bool savedSwitchConditionWasUniform;
+    SwitchDispatch *savedSwitchDispatch;
 
 private:
     CFInfo(CFType t, bool uniformIf, llvm::Value *sm) {
@@ -131,6 +158,7 @@ private:
         savedDefaultBlock = NULL;
         savedCaseBlocks = NULL;
         savedNextBlocks = NULL;
+        savedSwitchDispatch = NULL;
     }
     CFInfo(CFType t, bool iu, llvm::BasicBlock *bt, llvm::BasicBlock *ct,
            llvm::Value *sb, llvm::Value *sc, llvm::Value *sm,
@@ -152,6 +180,7 @@ private:
         savedCaseBlocks = bbc;
         savedNextBlocks = bbn;
         savedSwitchConditionWasUniform = scu;
+        savedSwitchDispatch = NULL;
     }
     CFInfo(CFType t, llvm::BasicBlock *bt, llvm::BasicBlock *ct,
            llvm::Value *sb, llvm::Value *sc, llvm::Value *sm,
@@ -169,6 +198,7 @@ private:
         savedDefaultBlock = NULL;
         savedCaseBlocks = NULL;
         savedNextBlocks = NULL;
+        savedSwitchDispatch = NULL;
     }
 };
 
@@ -229,11 +259,15 @@ CFInfo::GetSwitch(bool isUniform, llvm::BasicBlock *breakTarget,
                   llvm::BasicBlock *savedDefaultBlock,
                   const std::vector<std::pair<int, llvm::BasicBlock *> > *savedCases,
                   const std::map<llvm::BasicBlock *, llvm::BasicBlock *> *savedNext,
-                  bool savedSwitchConditionUniform) {
-    return new CFInfo(Switch, isUniform, breakTarget, continueTarget,
-                      savedBreakLanesPtr, savedContinueLanesPtr,
-                      savedMask, savedBlockEntryMask, savedSwitchExpr, savedDefaultBlock,
-                      savedCases, savedNext, savedSwitchConditionUniform);
+                  bool savedSwitchConditionUniform,
+                  SwitchDispatch *savedSwitchDispatch) {
+    CFInfo *ci = new CFInfo(Switch, isUniform, breakTarget, continueTarget,
+                            savedBreakLanesPtr, savedContinueLanesPtr,
+                            savedMask, savedBlockEntryMask, savedSwitchExpr,
+                            savedDefaultBlock, savedCases, savedNext,
+                            savedSwitchConditionUniform);
+    ci->savedSwitchDispatch = savedSwitchDispatch;
+    return ci;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -268,17 +302,28 @@ FunctionEmitContext::FunctionEmitContext(Function *func, Symbol *funSym,
     caseBlocks = NULL;
     defaultBlock = NULL;
     nextBlocks = NULL;
+    switchDispatch = NULL;
 
     returnedLanesPtr = AllocaInst(LLVMTypes::MaskType, "returned_lanes_memory");
     StoreInst(LLVMMaskAllOff, returnedLanesPtr);
 
+    memoryTraceAddressesPtr = NULL;
+
     launchedTasks = false;
     launchGroupHandlePtr = AllocaInst(LLVMTypes::VoidPointerType, "launch_group_handle");
     StoreInst(llvm::Constant::getNullValue(LLVMTypes::VoidPointerType),
               launchGroupHandlePtr);
+    launchIndexPtr = AllocaInst(LLVMTypes::Int32Type, "launch_index");
+    StoreInst(LLVMInt32(0), launchIndexPtr);
 
     disableGSWarningCount = 0;
 
+    const FunctionType *funcType = CastType<FunctionType>(funSym->type);
+    if (funcType != NULL && funcType->fpContract != -1)
+        fpContract = (funcType->fpContract == 1);
+    else
+        fpContract = (g->opt.disableFMA == false);
+
     const Type *returnType = function->GetReturnType();
     if (!returnType || returnType->IsVoidType())
         returnValuePtr = NULL;
@@ -1004,7 +1049,8 @@ FunctionEmitContext::StartSwitch(bool cfIsUniform, llvm::BasicBlock *bbBreak) {
                                                 continueLanesPtr, oldMask,
                                                 blockEntryMask, switchExpr, defaultBlock,
                                                 caseBlocks, nextBlocks,
-                                                switchConditionWasUniform));
+                                                switchConditionWasUniform,
+                                                switchDispatch));
 
     breakLanesPtr = AllocaInst(LLVMTypes::MaskType, "break_lanes_memory");
     StoreInst(LLVMMaskAllOff, breakLanesPtr);
@@ -1019,6 +1065,7 @@ FunctionEmitContext::StartSwitch(bool cfIsUniform, llvm::BasicBlock *bbBreak) {
     defaultBlock = NULL;
     caseBlocks = NULL;
     nextBlocks = NULL;
+    switchDispatch = NULL;
 }
 
 
@@ -1046,6 +1093,21 @@ FunctionEmitContext::addSwitchMaskCheck(llvm::Value *mask) {
     AssertPos(currentPos, nextBlocks->find(bblock) != nextBlocks->end());
     llvm::BasicBlock *bbNext = nextBlocks->find(bblock)->second;
 
+    if (switchDispatch != NULL) {
+        // Rather than go to the next label, go to the first one after
+        // this one that any program instance selects.
+        std::map<llvm::BasicBlock *, int>::const_iterator iter =
+            switchDispatch->blockPositions.find(bblock);
+        AssertPos(currentPos, iter != switchDispatch->blockPositions.end());
+
+        llvm::BasicBlock *bbCurrent = bblock;
+        bbNext = CreateBasicBlock("case_default_skip");
+        SetCurrentBasicBlock(bbNext);
+        StoreInst(LLVMInt32(iter->second), switchDispatch->positionPtr);
+        BranchInst(switchDispatch->dispatchBlock);
+        SetCurrentBasicBlock(bbCurrent);
+    }
+
     // Jump to the next one of the mask is all off; otherwise jump to the
     // newly created block that will hold the actual code for this label.
     BranchInst(bbNext, bbSome, allOff);
@@ -1099,7 +1161,18 @@ FunctionEmitContext::EmitDefaultLabel(bool checkMask, SourcePos pos) {
     // expression to the value associated with each of the "case"
     // statements such that the surviving lanes didn't match any of them.
     llvm::Value *matchesDefault = getMaskAtSwitchEntry();
-    for (int i = 0; i < (int)caseBlocks->size(); ++i) {
+    if (switchDispatch != NULL) {
+        // The program instances that run the default code already have
+        // its position from the table lookup.
+        int position = switchDispatch->blockPositions[defaultBlock];
+        llvm::Value *isDefault =
+            CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                    switchDispatch->labelPositions, LLVMInt32Vector(position),
+                    "is_default");
+        matchesDefault = I1VecToBoolVec(isDefault);
+    }
+    for (int i = 0; switchDispatch == NULL &&
+                    i < (int)caseBlocks->size(); ++i) {
         int value = (*caseBlocks)[i].first;
         llvm::Value *valueVec = (switchExpr->getType() == LLVMTypes::Int32VectorType) ?
             LLVMInt32Vector(value) : LLVMInt64Vector(value);
@@ -1124,7 +1197,7 @@ FunctionEmitContext::EmitDefaultLabel(bool checkMask, SourcePos pos) {
                                           matchesDefault, "old_mask|matches_default");
     SetInternalMask(newMask);
 
-    if (checkMask)
+    if (checkMask || switchDispatch != NULL)
         addSwitchMaskCheck(newMask);
 }
 
@@ -1176,11 +1249,43 @@ FunctionEmitContext::EmitCaseLabel(int value, bool checkMask, SourcePos pos) {
                                           matchesCaseValue, "mask|case_match");
     SetInternalMask(newMask);
 
-    if (checkMask)
+    if (checkMask || switchDispatch != NULL)
         addSwitchMaskCheck(newMask);
 }
 
 
+/** Returns true if a varying switch with the given case labels should be
+    emitted with a table lookup of the label that each program instance
+    selects, so that labels that no program instance selects can be
+    skipped.  This is done for switches with enough labels that testing
+    each of them in turn is expensive, and whose case values are dense
+    enough to make a reasonably-sized table.
+ */
+static bool
+lUseSwitchDispatch(const std::vector<std::pair<int, llvm::BasicBlock *> > &bbCases,
+                   int *minValue, int *range) {
+    const int minCases = 8, maxRange = 1024;
+    if (g->opt.disableSwitchDispatch || (int)bbCases.size() < minCases)
+        return false;
+#ifdef ISPC_NVPTX_ENABLED
+    if (g->target->getISA() == Target::NVPTX)
+        return false;
+#endif /* ISPC_NVPTX_ENABLED */
+
+    int64_t lo = bbCases[0].first, hi = bbCases[0].first;
+    for (int i = 1; i < (int)bbCases.size(); ++i) {
+        lo = std::min(lo, (int64_t)bbCases[i].first);
+        hi = std::max(hi, (int64_t)bbCases[i].first);
+    }
+    if (hi - lo + 1 > maxRange || hi - lo + 1 > 4 * (int64_t)bbCases.size())
+        return false;
+
+    *minValue = (int)lo;
+    *range = (int)(hi - lo + 1);
+    return true;
+}
+
+
 void
 FunctionEmitContext::SwitchInst(llvm::Value *expr, llvm::BasicBlock *bbDefault,
                 const std::vector<std::pair<int, llvm::BasicBlock *> > &bbCases,
@@ -1216,10 +1321,23 @@ FunctionEmitContext::SwitchInst(llvm::Value *expr, llvm::BasicBlock *bbDefault,
         bblock = NULL;
     }
     else {
+        int minValue, range;
+        if (nextBlocks->size() > 0 &&
+            lUseSwitchDispatch(bbCases, &minValue, &range))
+            // Look up the labels for each program instance's value while
+            // the mask is still the one at entry to the switch.
+            emitSwitchDispatch(minValue, range);
+
         // For a varying switch, we first turn off all lanes of the mask
         SetInternalMask(LLVMMaskAllOff);
 
-        if (nextBlocks->size() > 0) {
+        if (switchDispatch != NULL) {
+            // Start with the first label that's selected.
+            StoreInst(LLVMInt32(-1), switchDispatch->positionPtr);
+            BranchInst(switchDispatch->dispatchBlock);
+            bblock = NULL;
+        }
+        else if (nextBlocks->size() > 0) {
             // If there are any labels inside the switch, jump to the first
             // one; any code before the first label won't be executed by
             // anyone.
@@ -1234,6 +1352,110 @@ FunctionEmitContext::SwitchInst(llvm::Value *expr, llvm::BasicBlock *bbDefault,
 }
 
 
+/** Emits the table lookup of the position of the label that each program
+    instance's value of the switch expression selects, and the dispatch
+    block that goes to the first label after a given position that some
+    program instance selects (see the SwitchDispatch declaration).  The
+    case values are given by the range [minValue, minValue+range).
+ */
+void
+FunctionEmitContext::emitSwitchDispatch(int minValue, int range) {
+    switchDispatch = new SwitchDispatch;
+
+    // Number the labels in the order that they appear in the switch.
+    std::vector<llvm::BasicBlock *> labelBlocks;
+    std::map<llvm::BasicBlock *, llvm::BasicBlock *>::const_iterator iter =
+        nextBlocks->find(NULL);
+    while (iter != nextBlocks->end()) {
+        switchDispatch->blockPositions[iter->second] = (int)labelBlocks.size();
+        labelBlocks.push_back(iter->second);
+        iter = nextBlocks->find(iter->second);
+    }
+
+    const int noLabel = 0x7fffffff;
+    int defaultPosition = noLabel;
+    if (defaultBlock != NULL) {
+        AssertPos(currentPos, switchDispatch->blockPositions.find(defaultBlock) !=
+                  switchDispatch->blockPositions.end());
+        defaultPosition = switchDispatch->blockPositions[defaultBlock];
+    }
+
+    std::vector<llvm::Constant *> table(range, LLVMInt32(defaultPosition));
+    for (int i = 0; i < (int)caseBlocks->size(); ++i)
+        table[(*caseBlocks)[i].first - minValue] =
+            LLVMInt32(switchDispatch->blockPositions[(*caseBlocks)[i].second]);
+
+    llvm::ArrayType *tableType =
+        llvm::ArrayType::get(LLVMTypes::Int32Type, range);
+    llvm::GlobalVariable *tableGlobal =
+        new llvm::GlobalVariable(*m->module, tableType, true,
+                                 llvm::GlobalValue::PrivateLinkage,
+                                 llvm::ConstantArray::get(tableType, table),
+                                 "switch_label_positions");
+    llvm::Value *tablePtr = BitCastInst(tableGlobal, LLVMTypes::Int32PointerType,
+                                        "switch_table_ptr");
+
+    // offset = value - minValue; values outside of the table's range
+    // select the default label.
+    bool is64 = (switchExpr->getType() == LLVMTypes::Int64VectorType);
+    llvm::Value *offset =
+        BinaryOperator(llvm::Instruction::Sub, switchExpr,
+                       is64 ? LLVMInt64Vector((int64_t)minValue) :
+                              LLVMInt32Vector(minValue), "switch_offset");
+    llvm::Value *inRange =
+        CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_ULT, offset,
+                is64 ? LLVMInt64Vector((int64_t)range) : LLVMInt32Vector(range),
+                "switch_in_range");
+    if (is64)
+        offset = TruncInst(offset, LLVMTypes::Int32VectorType, "switch_offset");
+    offset = SelectInst(inRange, offset, LLVMInt32Vector(0), "switch_offset");
+
+    const PointerType *tablePtrType =
+        PointerType::GetUniform(AtomicType::UniformInt32);
+    llvm::Value *entryPtrs = GetElementPtrInst(tablePtr, offset, tablePtrType,
+                                               "switch_table_entry");
+    llvm::Value *mask = GetFullMask();
+    llvm::Value *positions =
+        LoadInst(entryPtrs, mask, PointerType::GetVarying(AtomicType::UniformInt32),
+                 "switch_label_position");
+    positions = SelectInst(inRange, positions, LLVMInt32Vector(defaultPosition),
+                           "switch_label_position");
+    llvm::Value *active = CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_NE,
+                                  mask, LLVMMaskAllOff, "switch_active");
+    switchDispatch->labelPositions =
+        SelectInst(active, positions, LLVMInt32Vector(noLabel),
+                   "switch_label_position");
+
+    switchDispatch->positionPtr = AllocaInst(LLVMTypes::Int32Type,
+                                             "switch_position");
+    switchDispatch->dispatchBlock = CreateBasicBlock("switch_dispatch");
+
+    // The dispatch block finds the first label after the current position
+    // that some program instance selects and goes there, or leaves the
+    // switch if there's none.
+    llvm::BasicBlock *bbCurrent = bblock;
+    SetCurrentBasicBlock(switchDispatch->dispatchBlock);
+    llvm::Value *position = LoadInst(switchDispatch->positionPtr, "position");
+    llvm::Value *isLater =
+        CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SGT,
+                switchDispatch->labelPositions,
+                BroadcastValue(position, LLVMTypes::Int32VectorType),
+                "is_later_label");
+    llvm::Value *later = SelectInst(isLater, switchDispatch->labelPositions,
+                                    LLVMInt32Vector(noLabel), "later_label");
+    llvm::Function *reduceMin = m->module->getFunction("__reduce_min_int32");
+    AssertPos(currentPos, reduceMin != NULL);
+    llvm::Value *next = CallInst(reduceMin, NULL, later, "next_label");
+
+    llvm::SwitchInst *s = llvm::SwitchInst::Create(next, breakTarget,
+                                                   labelBlocks.size(), bblock);
+    for (int i = 0; i < (int)labelBlocks.size(); ++i)
+        s->addCase(LLVMInt32(i), labelBlocks[i]);
+    AddDebugPos(s);
+    SetCurrentBasicBlock(bbCurrent);
+}
+
+
 int
 FunctionEmitContext::VaryingCFDepth() const {
     int sum = 0;
@@ -1265,6 +1487,16 @@ FunctionEmitContext::EnableGatherScatterWarnings() {
 }
 
 
+bool
+FunctionEmitContext::GetUnswitchedIf(const Stmt *ifStmt, bool *value) const {
+    std::map<const Stmt *, bool>::const_iterator iter = unswitchedIfs.find(ifStmt);
+    if (iter == unswitchedIfs.end())
+        return false;
+    *value = iter->second;
+    return true;
+}
+
+
 
 bool
 FunctionEmitContext::initLabelBBlocks(ASTNode *node, void *data) {
@@ -1652,6 +1884,10 @@ lGetStringAsValue(llvm::BasicBlock *bblock, const char *s) {
 void
 FunctionEmitContext::AddInstrumentationPoint(const char *note) {
     AssertPos(currentPos, note != NULL);
+    if (g->emitOccupancyProfile) {
+        AddOccupancyPoint(note, GetFullMask());
+        return;
+    }
     if (!g->emitInstrumentation)
         return;
 
@@ -1670,6 +1906,165 @@ FunctionEmitContext::AddInstrumentationPoint(const char *note) {
 }
 
 
+void
+FunctionEmitContext::AddOccupancyPoint(const char *note, llvm::Value *mask) {
+    if (!g->emitOccupancyProfile)
+        return;
+
+    // Rather than calling out, just bump the counter for this site and
+    // the number of lanes that are on in the mask:
+    // counters[site * (programCount + 1) + popcnt(mask)] += 1
+    int site = m->AddOccupancySite(note, currentPos);
+    llvm::Function *ctpop =
+        llvm::Intrinsic::getDeclaration(m->module, llvm::Intrinsic::ctpop,
+                                        LLVMTypes::Int64Type);
+    llvm::Value *laneCount =
+        CallInst(ctpop, NULL, LaneMask(mask), "lane_count");
+    llvm::Value *index =
+        BinaryOperator(llvm::Instruction::Add, laneCount,
+                       LLVMInt64((int64_t)site * (g->target->getVectorWidth() + 1)),
+                       "occupancy_index");
+    const PointerType *counterPtrType =
+        PointerType::GetUniform(AtomicType::UniformUInt64);
+    llvm::Value *counterPtr =
+        GetElementPtrInst(m->GetOccupancyCounters(), index, counterPtrType,
+                          "occupancy_counter");
+    llvm::Value *count = LoadInst(counterPtr, "occupancy_count");
+    count = BinaryOperator(llvm::Instruction::Add, count, LLVMInt64(1),
+                           "occupancy_count_inc");
+    StoreInst(count, counterPtr);
+}
+
+
+void
+FunctionEmitContext::RegisterOccupancyCounters() {
+    if (!g->emitOccupancyProfile)
+        return;
+
+    // The first time each thread runs a function from this module, hand
+    // its counter table to the application.
+    llvm::Value *flagPtr = m->GetOccupancyRegisteredFlag();
+    llvm::Value *flag = LoadInst(flagPtr, "occupancy_registered");
+    llvm::Value *notRegistered =
+        CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ, flag,
+                LLVMInt32(0), "occupancy_not_registered");
+    llvm::BasicBlock *bbRegister = CreateBasicBlock("occupancy_register");
+    llvm::BasicBlock *bbDone = CreateBasicBlock("occupancy_register_done");
+    BranchInst(bbRegister, bbDone, notRegistered);
+
+    SetCurrentBasicBlock(bbRegister);
+    std::vector<llvm::Value *> args;
+    args.push_back(m->GetOccupancyModuleInfo());
+    args.push_back(m->GetOccupancyCounters());
+    llvm::Function *fregister = m->module->getFunction("ISPCOccupancyRegister");
+    AssertPos(currentPos, fregister != NULL);
+    CallInst(fregister, NULL, args, "");
+    StoreInst(LLVMInt32(1), flagPtr);
+    BranchInst(bbDone);
+
+    SetCurrentBasicBlock(bbDone);
+}
+
+
+/** Returns true if the given pointer (or vector of pointers) is computed
+    from the address of a stack allocation, looking through address
+    arithmetic and casts. */
+static bool
+lIsStackAddress(llvm::Value *v, int depth = 0) {
+    if (v == NULL || depth > 8)
+        return false;
+    if (llvm::isa<llvm::AllocaInst>(v))
+        return true;
+    if (llvm::GetElementPtrInst *gep = llvm::dyn_cast<llvm::GetElementPtrInst>(v))
+        return lIsStackAddress(gep->getPointerOperand(), depth + 1);
+    if (llvm::CastInst *ci = llvm::dyn_cast<llvm::CastInst>(v))
+        return lIsStackAddress(ci->getOperand(0), depth + 1);
+    if (llvm::BinaryOperator *bop = llvm::dyn_cast<llvm::BinaryOperator>(v))
+        return (bop->getOpcode() == llvm::Instruction::Add &&
+                (lIsStackAddress(bop->getOperand(0), depth + 1) ||
+                 lIsStackAddress(bop->getOperand(1), depth + 1)));
+    if (llvm::InsertElementInst *ie = llvm::dyn_cast<llvm::InsertElementInst>(v))
+        return lIsStackAddress(ie->getOperand(1), depth + 1);
+    if (llvm::ShuffleVectorInst *sv = llvm::dyn_cast<llvm::ShuffleVectorInst>(v))
+        return lIsStackAddress(sv->getOperand(0), depth + 1);
+    return false;
+}
+
+
+void
+FunctionEmitContext::AddMemoryTracePoint(MemoryTraceKind kind, llvm::Value *ptr,
+                                         llvm::Type *type, llvm::Value *mask) {
+    if (!g->emitMemoryTrace || ptr == NULL || type == NULL)
+        return;
+    // Loads and stores of local variables would swamp the trace (and
+    // taking their addresses would keep them from being promoted to
+    // registers), so leave them out.
+    if (lIsStackAddress(ptr))
+        return;
+
+    int width = g->target->getVectorWidth();
+    int count = 1;
+    llvm::Type *eltType = type;
+    llvm::VectorType *vt = llvm::dyn_cast<llvm::VectorType>(type);
+    if (vt != NULL && (int)vt->getNumElements() == width) {
+        count = width;
+        eltType = vt->getElementType();
+    }
+    int eltSize = (int)g->target->getDataLayout()->getTypeStoreSize(eltType);
+
+    llvm::Value *addresses;
+    if (llvm::isa<llvm::VectorType>(ptr->getType())) {
+        // Gather or scatter: we already have a vector of addresses
+        AssertPos(currentPos, count == width);
+        addresses = ptr;
+        if (addresses->getType() == LLVMTypes::Int32VectorType)
+            addresses = ZExtInst(addresses, LLVMTypes::Int64VectorType,
+                                 "trace_addr64");
+    }
+    else {
+        llvm::Value *base = PtrToIntInst(ptr, LLVMTypes::Int64Type, "trace_addr");
+        if (count == 1)
+            addresses = base;
+        else {
+            // A vector load or store through a uniform pointer; each
+            // program instance accesses the element after the previous
+            // one's.
+            llvm::Value *offsets =
+                BinaryOperator(llvm::Instruction::Mul, ProgramIndexVector(false),
+                               LLVMInt64Vector((int64_t)eltSize), "trace_offsets");
+            addresses = BinaryOperator(llvm::Instruction::Add,
+                                       SmearUniform(base, "trace_base"),
+                                       offsets, "trace_addrs");
+        }
+    }
+
+    if (memoryTraceAddressesPtr == NULL)
+        memoryTraceAddressesPtr =
+            AllocaInst(llvm::ArrayType::get(LLVMTypes::Int64Type, width),
+                       "trace_addresses", 8);
+    llvm::Value *addressesPtr =
+        BitCastInst(memoryTraceAddressesPtr, LLVMTypes::Int64PointerType);
+    if (count == 1)
+        StoreInst(addresses, addressesPtr, 8);
+    else
+        StoreInst(addresses, BitCastInst(memoryTraceAddressesPtr,
+                                         LLVMTypes::Int64VectorPointerType), 8);
+
+    std::vector<llvm::Value *> args;
+    args.push_back(lGetStringAsValue(bblock, currentPos.name));
+    args.push_back(LLVMInt32(currentPos.first_line));
+    args.push_back(LLVMInt32((int32_t)kind));
+    args.push_back(LLVMInt32(eltSize));
+    args.push_back(LLVMInt32(count));
+    args.push_back(addressesPtr);
+    args.push_back(LaneMask(mask));
+
+    llvm::Function *ftrace = m->module->getFunction("ISPCTraceMemory");
+    AssertPos(currentPos, ftrace != NULL);
+    CallInst(ftrace, NULL, args, "");
+}
+
+
 void
 FunctionEmitContext::SetDebugPos(SourcePos pos) {
     currentPos = pos;
@@ -1712,6 +2107,12 @@ FunctionEmitContext::AddDebugPos(llvm::Value *value, const SourcePos *pos,
 void
 FunctionEmitContext::StartScope() {
     if (m->diBuilder != NULL) {
+        if (g->debugLineTablesOnly && debugScopes.size() > 0) {
+            // Line tables only need the function's outermost scope, so
+            // nested scopes just reuse it.
+            debugScopes.push_back(debugScopes.back());
+            return;
+        }
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_6 /* 3.2, 3.3, 3.4, 3.5, 3.6 */
         llvm::DIScope parentScope;
         llvm::DILexicalBlock lexicalBlock;
@@ -1773,7 +2174,7 @@ FunctionEmitContext::GetDIScope() const {
 
 void
 FunctionEmitContext::EmitVariableDebugInfo(Symbol *sym) {
-    if (m->diBuilder == NULL)
+    if (m->diBuilder == NULL || g->debugLineTablesOnly)
         return;
 
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_6 /* 3.2, 3.3, 3.4, 3.5, 3.6 */
@@ -1831,7 +2232,7 @@ FunctionEmitContext::EmitVariableDebugInfo(Symbol *sym) {
 
 void
 FunctionEmitContext::EmitFunctionParameterDebugInfo(Symbol *sym, int argNum) {
-    if (m->diBuilder == NULL)
+    if (m->diBuilder == NULL || g->debugLineTablesOnly)
         return;
 
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
@@ -2657,10 +3058,10 @@ FunctionEmitContext::AddElementOffset(llvm::Value *fullBasePtr, int elementNum,
         const CollectionType *ct =
             CastType<CollectionType>(ptrType->GetBaseType());
         AssertPos(currentPos, ct != NULL);
-        *resultPtrType = new PointerType(ct->GetElementType(elementNum),
-                                         ptrType->GetVariability(),
-                                         ptrType->IsConstType(),
-                                         ptrType->IsSlice());
+        *resultPtrType = PointerType::Get(ct->GetElementType(elementNum),
+                                          ptrType->GetVariability(),
+                                          ptrType->IsConstType(),
+                                          ptrType->IsSlice());
     }
 
     llvm::Value *resultPtr = NULL;
@@ -2723,6 +3124,17 @@ FunctionEmitContext::AddElementOffset(llvm::Value *fullBasePtr, int elementNum,
 }
 
 
+/** Returns the alignment that --opt=force-aligned-memory lets us assume
+    for loads and stores of the given vector type: the target's native
+    vector alignment, or less for vectors that are smaller than that, like
+    uniform short vectors. */
+static int
+lForcedVectorAlignment(llvm::Type *type) {
+    int size = (int)g->target->getDataLayout()->getTypeStoreSize(type);
+    return std::min(g->target->getNativeVectorAlignment(), (int)RoundUpPow2(size));
+}
+
+
 llvm::Value *
 FunctionEmitContext::LoadInst(llvm::Value *ptr, const char *name) {
     if (ptr == NULL) {
@@ -2741,7 +3153,7 @@ FunctionEmitContext::LoadInst(llvm::Value *ptr, const char *name) {
 
     if (g->opt.forceAlignedMemory &&
         llvm::dyn_cast<llvm::VectorType>(pt->getElementType())) {
-        inst->setAlignment(g->target->getNativeVectorAlignment());
+        inst->setAlignment(lForcedVectorAlignment(pt->getElementType()));
     }
 
     AddDebugPos(inst);
@@ -2870,6 +3282,11 @@ FunctionEmitContext::LoadInst(llvm::Value *ptr, llvm::Value *mask,
                 // it's totally unaligned.  (This shouldn't make any difference
                 // vs the proper alignment in practice.)
                 align = 1;
+            // An "aligned" qualifier on the pointer tells us better.
+            if (ptrType->GetAlignment() > align)
+                align = ptrType->GetAlignment();
+            AddMemoryTracePoint(MemoryTraceLoad, ptr,
+                                PTYPE(ptr), GetFullMask());
             llvm::Instruction *inst = new llvm::LoadInst(ptr, name,
                                                          false /* not volatile */,
                                                          align, bblock);
@@ -2992,6 +3409,8 @@ FunctionEmitContext::gather(llvm::Value *ptr, const PointerType *ptrType,
     llvm::Function *gatherFunc = m->module->getFunction(funcName);
     AssertPos(currentPos, gatherFunc != NULL);
 
+    AddMemoryTracePoint(MemoryTraceGather, ptr, llvmReturnType, mask);
+
     llvm::Value *gatherCall = CallInst(gatherFunc, NULL, ptr, mask, name);
 
     // Add metadata about the source file location so that the
@@ -3143,6 +3562,9 @@ FunctionEmitContext::maskedStore(llvm::Value *value, llvm::Value *ptr,
     llvm::Type *llvmValueType = value->getType();
 
     const PointerType *pt = CastType<PointerType>(valueType);
+    if (pt == NULL || !pt->IsSlice())
+        AddMemoryTracePoint(MemoryTraceStore, ptr, llvmValueType, mask);
+
     if (pt != NULL) {
         if (pt->IsSlice()) {
             // Masked store of (varying) slice pointer.
@@ -3325,6 +3747,7 @@ FunctionEmitContext::scatter(llvm::Value *value, llvm::Value *ptr,
     AssertPos(currentPos, scatterFunc != NULL);
 
     AddInstrumentationPoint("scatter");
+    AddMemoryTracePoint(MemoryTraceScatter, ptr, type, mask);
 
     std::vector<llvm::Value *> args;
     args.push_back(ptr);
@@ -3338,7 +3761,8 @@ FunctionEmitContext::scatter(llvm::Value *value, llvm::Value *ptr,
 
 
 void
-FunctionEmitContext::StoreInst(llvm::Value *value, llvm::Value *ptr) {
+FunctionEmitContext::StoreInst(llvm::Value *value, llvm::Value *ptr,
+                               int align) {
     if (value == NULL || ptr == NULL) {
         // may happen due to error elsewhere
         AssertPos(currentPos, m->errorCount > 0);
@@ -3353,8 +3777,10 @@ FunctionEmitContext::StoreInst(llvm::Value *value, llvm::Value *ptr) {
 
     if (g->opt.forceAlignedMemory &&
         llvm::dyn_cast<llvm::VectorType>(pt->getElementType())) {
-        inst->setAlignment(g->target->getNativeVectorAlignment());
+        inst->setAlignment(lForcedVectorAlignment(pt->getElementType()));
     }
+    else if (align > 0)
+        inst->setAlignment(align);
 
     AddDebugPos(inst);
 }
@@ -3389,13 +3815,18 @@ FunctionEmitContext::StoreInst(llvm::Value *value, llvm::Value *ptr,
         if (ptrType->IsSlice())
             // storing a uniform value to a single slice of a SOA type
             storeUniformToSOA(value, ptr, mask, valueType, ptrType);
-        else if (ptrType->GetBaseType()->IsUniformType())
+        else if (ptrType->GetBaseType()->IsUniformType()) {
             // the easy case
-            StoreInst(value, ptr);
-        else if (mask == LLVMMaskAllOn && !g->opt.disableMaskAllOnOptimizations)
+            AddMemoryTracePoint(MemoryTraceStore, ptr, value->getType(),
+                                GetFullMask());
+            StoreInst(value, ptr, ptrType->GetAlignment());
+        }
+        else if (mask == LLVMMaskAllOn && !g->opt.disableMaskAllOnOptimizations) {
             // Otherwise it is a masked store unless we can determine that the
             // mask is all on...  (Unclear if this check is actually useful.)
-            StoreInst(value, ptr);
+            AddMemoryTracePoint(MemoryTraceStore, ptr, value->getType(), mask);
+            StoreInst(value, ptr, ptrType->GetAlignment());
+        }
         else
             maskedStore(value, ptr, ptrType, mask);
     }
@@ -3435,6 +3866,7 @@ FunctionEmitContext::storeUniformToSOA(llvm::Value *value, llvm::Value *ptr,
         // then we can do a final regular store
         AssertPos(currentPos, Type::IsBasicType(valueType));
         ptr = lFinalSliceOffset(this, ptr, &ptrType);
+        AddMemoryTracePoint(MemoryTraceStore, ptr, value->getType(), mask);
         StoreInst(value, ptr);
     }
 }
@@ -3725,9 +4157,51 @@ FunctionEmitContext::CallInst(llvm::Value *func, const FunctionType *funcType,
         llvm::Value *maskPtr = AllocaInst(LLVMTypes::MaskType);
         StoreInst(GetFullMask(), maskPtr);
 
-        // And now we branch to the test to see if there's more work to be
-        // done.
-        BranchInst(bbTest);
+        // Most of the time, all of the running program instances have the
+        // same function pointer; check for that first and make a single
+        // call with the current mask if so, without going through the
+        // loop below.
+        llvm::BasicBlock *bbCheckSingle =
+            CreateBasicBlock("varying_funcall_check_single");
+        llvm::BasicBlock *bbSingle = CreateBasicBlock("varying_funcall_single");
+        BranchInst(bbCheckSingle, bbDone, Any(GetFullMask()));
+
+        SetCurrentBasicBlock(bbCheckSingle); {
+            llvm::Value *fullMask = GetFullMask();
+            llvm::Function *cttz =
+                m->module->getFunction("__count_trailing_zeros_i64");
+            AssertPos(currentPos, cttz != NULL);
+            llvm::Value *laneMask = LaneMask(fullMask);
+            llvm::Value *firstLane =
+                TruncInst(CallInst(cttz, NULL, laneMask, "first_lane64"),
+                          LLVMTypes::Int32Type, "first_lane32");
+            llvm::Value *fptr =
+                llvm::ExtractElementInst::Create(func, firstLane,
+                                                 "extract_fptr", bblock);
+            llvm::Value *fpOverlap =
+                CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                        SmearUniform(fptr, "func_ptr"), func);
+            fpOverlap = I1VecToBoolVec(fpOverlap);
+            llvm::Value *sameMask =
+                BinaryOperator(llvm::Instruction::And, fullMask, fpOverlap,
+                               "same_fptr_mask");
+            llvm::Value *single =
+                CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                        LaneMask(sameMask), laneMask, "single_fptr");
+            BranchInst(bbSingle, bbTest, single);
+
+            SetCurrentBasicBlock(bbSingle);
+            llvm::Type *llvmFuncType = funcType->LLVMFunctionType(g->ctx);
+            llvm::Type *llvmFPtrType = llvm::PointerType::get(llvmFuncType, 0);
+            llvm::Value *callResult =
+                CallInst(IntToPtrInst(fptr, llvmFPtrType), funcType, args, name);
+            // No need for a masked store here; the inactive lanes'
+            // values are undefined anyway.
+            if (callResult != NULL &&
+                callResult->getType() != LLVMTypes::VoidType)
+                StoreInst(callResult, resultPtr);
+            BranchInst(bbDone);
+        }
 
         // bbTest: are any lanes of the mask still on?  If so, jump to
         // bbCall
@@ -3855,6 +4329,11 @@ FunctionEmitContext::ReturnInst() {
         // We have value(s) to return; load them from their storage
         // location
         llvm::Value *retVal = LoadInst(returnValuePtr, "return_value");
+        // Varying bools returned through the native vector ABI are
+        // returned as an integer bitmask.
+        if (retVal->getType() != llvmFunction->getReturnType())
+            retVal = BitCastInst(retVal, llvmFunction->getReturnType(),
+                                 "return_value_abi");
         rinst = llvm::ReturnInst::Create(*g->ctx, retVal, bblock);
     }
     else {
@@ -3871,7 +4350,9 @@ FunctionEmitContext::ReturnInst() {
 llvm::Value *
 FunctionEmitContext::LaunchInst(llvm::Value *callee,
                                 std::vector<llvm::Value *> &argVals,
-                                llvm::Value *launchCount[3]){
+                                llvm::Value *launchCount[3],
+                                int serialTaskCost,
+                                const std::vector<llvm::Value *> *launchAfter) {
 #ifdef ISPC_NVPTX_ENABLED
     if (g->target->getISA() == Target::NVPTX)
     {
@@ -3879,6 +4360,10 @@ FunctionEmitContext::LaunchInst(llvm::Value *callee,
         AssertPos(currentPos, m->errorCount > 0);
         return NULL;
       }
+      // Individual launches can't be waited for here, so wait for all of
+      // the earlier ones.
+      if (launchAfter != NULL && launchAfter->size() > 0)
+        SyncInst();
       launchedTasks = true;
 
       AssertPos(currentPos, llvm::isa<llvm::Function>(callee));
@@ -3953,8 +4438,10 @@ FunctionEmitContext::LaunchInst(llvm::Value *callee,
       args.push_back(launchCount[0]);
       args.push_back(launchCount[1]);
       args.push_back(launchCount[2]);
-      llvm::Value *ret =  CallInst(flaunch, NULL, args, "");
-      return ret;
+      CallInst(flaunch, NULL, args, "");
+      // Syncing individual launches isn't supported here; their handles
+      // just make SyncInst() wait for everything.
+      return LLVMInt32(-1);
     }
 #endif /* ISPC_NVPTX_ENABLED */
 
@@ -3975,6 +4462,52 @@ FunctionEmitContext::LaunchInst(llvm::Value *callee,
     llvm::StructType *argStructType =
       static_cast<llvm::StructType *>(pt->getElementType());
 
+    // If the whole launch is cheap enough that the task system's overhead
+    // would dominate, check the number of tasks at runtime and run them
+    // right here if there are few enough of them.
+    llvm::BasicBlock *bPostLaunch = NULL, *bSerialEnd = NULL;
+    llvm::Value *serialHandle = NULL;
+    int maxSerialTasks =
+        (serialTaskCost >= 0) ? SERIAL_LAUNCH_COST / std::max(serialTaskCost, 1) : 0;
+    if (maxSerialTasks > 0) {
+      llvm::Value *limit = LLVMInt32(maxSerialTasks);
+      // Checking each of the counts first ensures that their product
+      // can't overflow.
+      llvm::Value *serial = NULL;
+      for (int i = 0; i < 3; ++i) {
+        llvm::Value *small = CmpInst(llvm::Instruction::ICmp,
+                                     llvm::CmpInst::ICMP_SLE,
+                                     launchCount[i], limit, "small_count");
+        serial = (serial == NULL) ? small :
+          BinaryOperator(llvm::Instruction::And, serial, small, "small_counts");
+      }
+      llvm::Value *total =
+        BinaryOperator(llvm::Instruction::Mul,
+                       BinaryOperator(llvm::Instruction::Mul, launchCount[0],
+                                      launchCount[1], "count01"),
+                       launchCount[2], "total_count");
+      serial = BinaryOperator(llvm::Instruction::And, serial,
+                              CmpInst(llvm::Instruction::ICmp,
+                                      llvm::CmpInst::ICMP_SLE, total, limit,
+                                      "small_total"), "serial_launch");
+
+      llvm::BasicBlock *bSerial = CreateBasicBlock("serial_launch");
+      llvm::BasicBlock *bLaunch = CreateBasicBlock("task_launch");
+      bPostLaunch = CreateBasicBlock("post_launch");
+      BranchInst(bSerial, bLaunch, serial);
+
+      SetCurrentBasicBlock(bSerial);
+      serialLaunch(llvm::dyn_cast<llvm::Function>(callee), argStructType,
+                   argVals, launchCount);
+      // The tasks have already finished, so there's nothing for a sync
+      // of their handle to wait for.
+      serialHandle = LLVMInt32(-1);
+      bSerialEnd = bblock;
+      BranchInst(bPostLaunch);
+
+      SetCurrentBasicBlock(bLaunch);
+    }
+
     llvm::Function *falloc = m->module->getFunction("ISPCAlloc");
     AssertPos(currentPos, falloc != NULL);
     llvm::Value *structSize = g->target->SizeOf(argStructType, bblock);
@@ -4012,7 +4545,9 @@ FunctionEmitContext::LaunchInst(llvm::Value *callee,
     // a pointer to the task function being called and a pointer to the
     // argument block we just filled in
     llvm::Value *fptr = BitCastInst(callee, LLVMTypes::VoidPointerType);
-    llvm::Function *flaunch = m->module->getFunction("ISPCLaunch");
+    bool hasDeps = (launchAfter != NULL && launchAfter->size() > 0);
+    llvm::Function *flaunch =
+      m->module->getFunction(hasDeps ? "ISPCLaunchAfter" : "ISPCLaunch");
     AssertPos(currentPos, flaunch != NULL);
     std::vector<llvm::Value *> args;
     args.push_back(launchGroupHandlePtr);
@@ -4021,12 +4556,111 @@ FunctionEmitContext::LaunchInst(llvm::Value *callee,
     args.push_back(launchCount[0]);
     args.push_back(launchCount[1]);
     args.push_back(launchCount[2]);
-    return CallInst(flaunch, NULL, args, "");
+    if (hasDeps) {
+      // The handles of the launches to wait for are passed as an array.
+      int numDeps = (int)launchAfter->size();
+      llvm::Type *depsType =
+        llvm::ArrayType::get(LLVMTypes::Int32Type, numDeps);
+      llvm::Value *deps = AllocaInst(depsType, "launch_after");
+      for (int i = 0; i < numDeps; ++i)
+        StoreInst((*launchAfter)[i],
+                  AddElementOffset(deps, i, NULL, "launch_after_elt"));
+      args.push_back(LLVMInt32(numDeps));
+      args.push_back(BitCastInst(deps, LLVMTypes::Int32PointerType,
+                                 "launch_after_ptr"));
+    }
+    CallInst(flaunch, NULL, args, "");
+
+    // The handle of this launch is its index among the launches since
+    // the last sync.
+    llvm::Value *handle = LoadInst(launchIndexPtr, "launch_handle");
+    StoreInst(BinaryOperator(llvm::Instruction::Add, handle, LLVMInt32(1),
+                             "next_launch_index"), launchIndexPtr);
+
+    if (bPostLaunch != NULL) {
+      llvm::BasicBlock *bLaunchEnd = bblock;
+      BranchInst(bPostLaunch);
+      SetCurrentBasicBlock(bPostLaunch);
+      llvm::PHINode *phi = PhiNode(LLVMTypes::Int32Type, 2, "launch_handle");
+      phi->addIncoming(serialHandle, bSerialEnd);
+      phi->addIncoming(handle, bLaunchEnd);
+      handle = phi;
+    }
+    return handle;
 }
 
 
 void
-FunctionEmitContext::SyncInst() {
+FunctionEmitContext::serialLaunch(llvm::Function *callee,
+                                  llvm::StructType *argStructType,
+                                  std::vector<llvm::Value *> &argVals,
+                                  llvm::Value *launchCount[3]) {
+    // The argument block is set up just as it is for the task system,
+    // though on the stack.
+    llvm::Value *argmem = AllocaInst(argStructType, "serial_task_args");
+    for (unsigned int i = 0; i < argVals.size(); ++i) {
+      llvm::Value *ptr = AddElementOffset(argmem, i, NULL, "funarg");
+      StoreInst(argVals[i], ptr);
+    }
+    if (argStructType->getNumElements() == argVals.size() + 1) {
+      llvm::Value *ptr = AddElementOffset(argmem, argVals.size(), NULL,
+                                          "funarg_mask");
+      StoreInst(GetFullMask(), ptr);
+    }
+
+    llvm::Value *count01 = BinaryOperator(llvm::Instruction::Mul, launchCount[0],
+                                          launchCount[1], "count01");
+    llvm::Value *total = BinaryOperator(llvm::Instruction::Mul, count01,
+                                        launchCount[2], "total_count");
+    llvm::Value *indexPtr = AllocaInst(LLVMTypes::Int32Type, "serial_task_index");
+    StoreInst(LLVMInt32(0), indexPtr);
+
+    llvm::BasicBlock *bTest = CreateBasicBlock("serial_task_test");
+    llvm::BasicBlock *bBody = CreateBasicBlock("serial_task_body");
+    llvm::BasicBlock *bExit = CreateBasicBlock("serial_task_exit");
+    BranchInst(bTest);
+
+    SetCurrentBasicBlock(bTest);
+    llvm::Value *index = LoadInst(indexPtr, "task_index");
+    BranchInst(bBody, bExit,
+               CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLT,
+                       index, total, "more_tasks"));
+
+    // Call the task function for this task, with the same arguments that
+    // the task system would pass, running as thread 0 of 1.  (Tasks that
+    // use threadIndex or threadCount are never run serially.)
+    SetCurrentBasicBlock(bBody);
+    llvm::Value *index0 = BinaryOperator(llvm::Instruction::SRem, index,
+                                         launchCount[0], "task_index0");
+    llvm::Value *rest = BinaryOperator(llvm::Instruction::SDiv, index,
+                                       launchCount[0], "task_index12");
+    llvm::Value *index1 = BinaryOperator(llvm::Instruction::SRem, rest,
+                                         launchCount[1], "task_index1");
+    llvm::Value *index2 = BinaryOperator(llvm::Instruction::SDiv, index,
+                                         count01, "task_index2");
+    std::vector<llvm::Value *> args;
+    args.push_back(argmem);
+    args.push_back(LLVMInt32(0));
+    args.push_back(LLVMInt32(1));
+    args.push_back(index);
+    args.push_back(total);
+    args.push_back(index0);
+    args.push_back(index1);
+    args.push_back(index2);
+    args.push_back(launchCount[0]);
+    args.push_back(launchCount[1]);
+    args.push_back(launchCount[2]);
+    CallInst(callee, NULL, args, "");
+    StoreInst(BinaryOperator(llvm::Instruction::Add, index, LLVMInt32(1),
+                             "next_task_index"), indexPtr);
+    BranchInst(bTest);
+
+    SetCurrentBasicBlock(bExit);
+}
+
+
+void
+FunctionEmitContext::SyncInst(llvm::Value *launchHandle) {
 #ifdef ISPC_NVPTX_ENABLED 
     if (g->target->getISA() == Target::NVPTX)
     {
@@ -4050,6 +4684,27 @@ FunctionEmitContext::SyncInst() {
                                    launchGroupHandle, nullPtrValue);
     llvm::BasicBlock *bSync = CreateBasicBlock("call_sync");
     llvm::BasicBlock *bPostSync = CreateBasicBlock("post_sync");
+
+    if (launchHandle != NULL) {
+        // Launches that ran serially have negative handles.
+        llvm::Value *launched =
+            CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SGE,
+                    launchHandle, LLVMInt32(0), "launched");
+        nonNull = BinaryOperator(llvm::Instruction::And, nonNull, launched,
+                                 "sync_launch");
+        BranchInst(bSync, bPostSync, nonNull);
+
+        SetCurrentBasicBlock(bSync);
+        llvm::Function *fsync = m->module->getFunction("ISPCSyncLaunch");
+        if (fsync == NULL)
+            FATAL("Couldn't find ISPCSyncLaunch declaration?!");
+        CallInst(fsync, NULL, launchGroupHandle, launchHandle, "");
+        BranchInst(bPostSync);
+
+        SetCurrentBasicBlock(bPostSync);
+        return;
+    }
+
     BranchInst(bSync, bPostSync, nonNull);
 
     SetCurrentBasicBlock(bSync);
@@ -4061,6 +4716,7 @@ FunctionEmitContext::SyncInst() {
     // zero out the handle so that if ISPCLaunch is called again in this
     // function, it knows it's starting out from scratch
     StoreInst(nullPtrValue, launchGroupHandlePtr);
+    StoreInst(LLVMInt32(0), launchIndexPtr);
 
     BranchInst(bPostSync);
 
@@ -4128,6 +4784,10 @@ FunctionEmitContext::popCFState() {
         caseBlocks = ci->savedCaseBlocks;
         nextBlocks = ci->savedNextBlocks;
         switchConditionWasUniform = ci->savedSwitchConditionWasUniform;
+        // The dispatch state is only needed while the switch's code is
+        // being emitted.
+        delete switchDispatch;
+        switchDispatch = ci->savedSwitchDispatch;
     }
     else if (ci->IsLoop() || ci->IsForeach()) {
         breakTarget = ci->savedBreakTarget;
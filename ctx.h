@@ -56,6 +56,7 @@
 #endif
 
 struct CFInfo;
+struct SwitchDispatch;
 
 /** FunctionEmitContext is one of the key classes in ispc; it is used to
     help with emitting the intermediate representation of a function during
@@ -255,6 +256,23 @@ public:
     /** Reenables emission of gather/scatter performance warnings. */
     void EnableGatherScatterWarnings();
 
+    /** Indicates whether floating-point multiplies and adds in the code
+        being emitted may be contracted into fused multiply-adds.  This
+        starts out from the function's __declspec(fp_contract_on/off), or
+        from --opt=disable-fma, and "#pragma fp_contract" changes it for
+        the statements it covers. */
+    bool GetFPContract() const { return fpContract; }
+    void SetFPContract(bool c) { fpContract = c; }
+
+    /** While the code for one of the copies of an unswitched foreach loop
+        is being emitted, these record the value that the test of the
+        hoisted uniform "if" statement has in that copy; see
+        ForeachStmt::EmitCode(). */
+    bool GetUnswitchedIf(const Stmt *ifStmt, bool *value) const;
+    void SetUnswitchedIf(const Stmt *ifStmt, bool value) { unswitchedIfs[ifStmt] = value; }
+    void ClearUnswitchedIf(const Stmt *ifStmt) { unswitchedIfs.erase(ifStmt); }
+    int GetNumUnswitchedIfs() const { return (int)unswitchedIfs.size(); }
+
     void SetContinueTarget(llvm::BasicBlock *bb) { continueTarget = bb; }
 
     /** Step through the code and find label statements; create a basic
@@ -331,6 +349,33 @@ public:
         this inserts a callback to the user-supplied instrumentation
         function at the current point in the code. */
     void AddInstrumentationPoint(const char *note);
+
+    /** If the program is being compiled with --instrument=occupancy, this
+        inserts code that counts the number of lanes that are on in the
+        given mask, under the given note for the current source position. */
+    void AddOccupancyPoint(const char *note, llvm::Value *mask);
+
+    /** If the program is being compiled with --instrument=occupancy, this
+        emits code that passes the current thread's counter table to
+        ISPCOccupancyRegister() the first time that it gets here. */
+    void RegisterOccupancyCounters();
+
+    /** Kinds of memory accesses reported to ISPCTraceMemory(); these
+        match the ISPC_TRACE_* values declared in the generated header. */
+    enum MemoryTraceKind {
+        MemoryTraceLoad = 0,
+        MemoryTraceStore = 1,
+        MemoryTraceGather = 2,
+        MemoryTraceScatter = 3
+    };
+
+    /** If the program is being compiled with --trace-memory, this emits a
+        call to ISPCTraceMemory() for an access of a value of the given
+        type through the given pointer (or, for gathers and scatters,
+        through the given vector of pointers), under the given mask.
+        Accesses to stack memory aren't reported. */
+    void AddMemoryTracePoint(MemoryTraceKind kind, llvm::Value *ptr,
+                             llvm::Type *type, llvm::Value *mask);
     /** @} */
 
     /** @name Debugging support
@@ -497,8 +542,9 @@ public:
                             bool atEntryBlock = true);
 
     /** Standard store instruction; for this variant, the lvalue must be a
-        single pointer, not a varying lvalue. */
-    void StoreInst(llvm::Value *value, llvm::Value *ptr);
+        single pointer, not a varying lvalue.  A non-zero alignment gives
+        the known alignment of the pointer in bytes. */
+    void StoreInst(llvm::Value *value, llvm::Value *ptr, int align = 0);
 
     /** In this variant of StoreInst(), the lvalue may be varying.  If so,
         this corresponds to a scatter.  Whether the lvalue is uniform of
@@ -564,17 +610,35 @@ public:
                           const char *name = NULL);
 
     /** Launch an asynchronous task to run the given function, passing it
-        he given argument values. */
+        he given argument values.  If \c serialTaskCost is non-negative, it
+        gives the estimated cost of running one of the tasks; code is then
+        emitted to run the tasks one after the other in the current thread
+        instead if the total cost of the launch is small enough.  If
+        \c launchAfter is non-NULL, it gives the handles of earlier
+        launches that must finish before any of this launch's tasks
+        start.  Returns the launch's handle, which can be passed to
+        SyncInst(). */
     llvm::Value *LaunchInst(llvm::Value *callee,
                             std::vector<llvm::Value *> &argVals,
-                            llvm::Value *launchCount[3]);
+                            llvm::Value *launchCount[3],
+                            int serialTaskCost = -1,
+                            const std::vector<llvm::Value *> *launchAfter = NULL);
 
-    void SyncInst();
+    /** Waits for the tasks of the launch with the given handle to finish,
+        or, if \c launchHandle is NULL, for all of the tasks launched from
+        the current function. */
+    void SyncInst(llvm::Value *launchHandle = NULL);
 
     llvm::Instruction *ReturnInst();
     /** @} */
 
 private:
+    /** Runs the tasks of a launch serially, as LaunchInst() does for
+        small launches. */
+    void serialLaunch(llvm::Function *callee, llvm::StructType *argStructType,
+                      std::vector<llvm::Value *> &argVals,
+                      llvm::Value *launchCount[3]);
+
     /** Pointer to the Function for which we're currently generating code. */
     Function *function;
 
@@ -666,6 +730,12 @@ private:
         uniform switch condition if there is a 'break' inside the switch
         that's under varying control flow. */
     bool switchConditionWasUniform;
+
+    /** For a varying switch with enough labels, the state used to go
+        directly to the next label that some program instance's value
+        selects when the mask is all off (see SwitchInst()); NULL
+        otherwise. */
+    SwitchDispatch *switchDispatch;
     /** @} */
 
     /** A pointer to memory that records which of the program instances
@@ -719,10 +789,27 @@ private:
         tasks launched from the current function. */
     llvm::Value *launchGroupHandlePtr;
 
+    /** Stack memory that holds the addresses passed to ISPCTraceMemory();
+        allocated the first time it is needed in a function. */
+    llvm::Value *memoryTraceAddressesPtr;
+
+    /** Pointer to the number of calls to ISPCLaunch() since the last
+        ISPCSync(); the task system numbers launches the same way, so this
+        is the handle of the next launch. */
+    llvm::Value *launchIndexPtr;
+
     /** Nesting count of the number of times calling code has disabled (and
         not yet reenabled) gather/scatter performance warnings. */
     int disableGSWarningCount;
 
+    /** Whether floating-point contraction is allowed in the code being
+        emitted; see GetFPContract(). */
+    bool fpContract;
+
+    /** "if" statements that have been hoisted out of the foreach loops
+        being emitted, with the value of their test. */
+    std::map<const Stmt *, bool> unswitchedIfs;
+
     std::map<std::string, llvm::BasicBlock *> labelMap;
 
     static bool initLabelBBlocks(ASTNode *node, void *data);
@@ -738,6 +825,7 @@ private:
 
     void restoreMaskGivenReturns(llvm::Value *oldMask);
     void addSwitchMaskCheck(llvm::Value *mask);
+    void emitSwitchDispatch(int minValue, int range);
     bool inSwitchStatement() const;
     llvm::Value *getMaskAtSwitchEntry();
 
@@ -58,6 +58,9 @@ lPrintTypeQualifiers(int typeQualifiers) {
     if (typeQualifiers & TYPEQUAL_UNSIGNED)  printf("unsigned ");
     if (typeQualifiers & TYPEQUAL_EXPORT)    printf("export ");
     if (typeQualifiers & TYPEQUAL_UNMASKED)  printf("unmasked ");
+    if (typeQualifiers & TYPEQUAL_NOALIAS)   printf("noalias ");
+    if (typeQualifiers & TYPEQUAL_ALIGN_MASK)
+        printf("aligned(%d) ", TYPEQUAL_ALIGNMENT(typeQualifiers));
 }
 
 
@@ -112,6 +115,27 @@ lApplyTypeQualifiers(int typeQualifiers, const Type *type, SourcePos pos) {
         }
     }
 
+    if ((typeQualifiers & TYPEQUAL_NOALIAS) != 0) {
+        // This can only happen via a typedef of a pointer type; otherwise
+        // "noalias" follows the '*' and is handled by the Declarator.
+        const PointerType *pt = CastType<PointerType>(type);
+        if (pt != NULL)
+            type = pt->GetAsNoAliasType();
+        else
+            Error(pos, "\"noalias\" qualifier is only legal with pointer "
+                  "types.");
+    }
+
+    if ((typeQualifiers & TYPEQUAL_ALIGN_MASK) != 0) {
+        // Similarly, "aligned(N)" may be applied to a typedef'ed pointer.
+        const PointerType *pt = CastType<PointerType>(type);
+        if (pt != NULL)
+            type = pt->GetAsAlignedType(TYPEQUAL_ALIGNMENT(typeQualifiers));
+        else
+            Error(pos, "\"aligned\" qualifier is only legal with pointer "
+                  "types.");
+    }
+
     if ((typeQualifiers & TYPEQUAL_SIGNED) != 0 && type->IsIntType() == false) {
         const Type *resolvedType =
             type->ResolveUnboundVariability(Variability::Varying);
@@ -165,9 +189,19 @@ DeclSpecs::GetBaseType(SourcePos pos) const {
         retType = new VectorType(atomicType, vectorSize);
     }
 
-    retType = lApplyTypeQualifiers(typeQualifiers, retType, pos);
+    // A typedef of an soa<> struct type keeps its layout wherever the
+    // typedef is used.  Since soa data is always uniform, an explicit
+    // "uniform" qualifier is allowed (and is redundant) in that case.
+    int quals = typeQualifiers;
+    int width = soaWidth;
+    if (width == 0 && retType->GetSOAWidth() > 0) {
+        width = retType->GetSOAWidth();
+        quals &= ~TYPEQUAL_UNIFORM;
+    }
+
+    retType = lApplyTypeQualifiers(quals, retType, pos);
 
-    if (soaWidth > 0) {
+    if (width > 0) {
 #ifdef ISPC_NVPTX_ENABLED
 #if 0  /* see stmt.cpp in DeclStmt::EmitCode for work-around of SOAType Declaration */
         if (g->target->getISA() == Target::NVPTX)
@@ -181,32 +215,32 @@ DeclSpecs::GetBaseType(SourcePos pos) const {
 
         if (st == NULL) {
             Error(pos, "Illegal to provide soa<%d> qualifier with non-struct "
-                  "type \"%s\".", soaWidth, retType->GetString().c_str());
+                  "type \"%s\".", width, retType->GetString().c_str());
             return NULL;
         }
-        else if (soaWidth <= 0 || (soaWidth & (soaWidth - 1)) != 0) {
+        else if (width <= 0 || (width & (width - 1)) != 0) {
             Error(pos, "soa<%d> width illegal. Value must be positive power "
-                  "of two.", soaWidth);
+                  "of two.", width);
             return NULL;
         }
 
         if (st->IsUniformType()) {
             Error(pos, "\"uniform\" qualifier and \"soa<%d>\" qualifier can't "
-                  "both be used in a type declaration.", soaWidth);
+                  "both be used in a type declaration.", width);
             return NULL;
         }
         else if (st->IsVaryingType()) {
             Error(pos, "\"varying\" qualifier and \"soa<%d>\" qualifier can't "
-                  "both be used in a type declaration.", soaWidth);
+                  "both be used in a type declaration.", width);
             return NULL;
         }
         else
-            retType = st->GetAsSOAType(soaWidth);
+            retType = st->GetAsSOAType(width);
 
-        if (soaWidth < g->target->getVectorWidth())
+        if (soaWidth > 0 && width < g->target->getVectorWidth())
             PerformanceWarning(pos, "soa<%d> width smaller than gang size %d "
                                "currently leads to inefficient code to access "
-                               "soa types.", soaWidth, g->target->getVectorWidth());
+                               "soa types.", width, g->target->getVectorWidth());
     }
 
     return retType;
@@ -221,6 +255,7 @@ lGetStorageClassName(StorageClass storageClass) {
     case SC_EXTERN_C: return "extern \"C\"";
     case SC_STATIC:   return "static";
     case SC_TYPEDEF:  return "typedef";
+    case SC_TASK_LOCAL: return "task_local";
     default:          FATAL("Unhandled storage class in lGetStorageClassName");
                       return "";
     }
@@ -327,6 +362,8 @@ Declarator::InitFromType(const Type *baseType, DeclSpecs *ds) {
     bool isExported =     ((typeQualifiers & TYPEQUAL_EXPORT) != 0);
     bool isConst =        ((typeQualifiers & TYPEQUAL_CONST) != 0);
     bool isUnmasked =     ((typeQualifiers & TYPEQUAL_UNMASKED) != 0);
+    bool isNoAlias =      ((typeQualifiers & TYPEQUAL_NOALIAS) != 0);
+    int alignment =       TYPEQUAL_ALIGNMENT(typeQualifiers);
 
     if (hasUniformQual && hasVaryingQual) {
         Error(pos, "Can't provide both \"uniform\" and \"varying\" qualifiers.");
@@ -362,8 +399,9 @@ Declarator::InitFromType(const Type *baseType, DeclSpecs *ds) {
         /* For now, any pointer to an SOA type gets the slice property; if
            we add the capability to declare pointers as slices or not,
            we'll want to set this based on a type qualifier here. */
-        const Type *ptrType = new PointerType(baseType, variability, isConst,
-                                              baseType->IsSOAType());
+        const Type *ptrType = PointerType::Get(baseType, variability, isConst,
+                                               baseType->IsSOAType(), false,
+                                               isNoAlias, alignment);
         if (child != NULL) {
             child->InitFromType(ptrType, ds);
             type = child->type;
@@ -391,7 +429,7 @@ Declarator::InitFromType(const Type *baseType, DeclSpecs *ds) {
             return;
         }
 
-        const Type *refType = new ReferenceType(baseType);
+        const Type *refType = ReferenceType::Get(baseType);
         if (child != NULL) {
             child->InitFromType(refType, ds);
             type = child->type;
@@ -420,7 +458,7 @@ Declarator::InitFromType(const Type *baseType, DeclSpecs *ds) {
         }
 #endif
 #endif /* ISPC_NVPTX_ENABLED */
-        const Type *arrayType = new ArrayType(baseType, arraySize);
+        const Type *arrayType = ArrayType::Get(baseType, arraySize);
         if (child != NULL) {
             child->InitFromType(arrayType, ds);
             type = child->type;
@@ -589,6 +627,29 @@ Declarator::InitFromType(const Type *baseType, DeclSpecs *ds) {
 
                 if (str == "safe")
                     (const_cast<FunctionType *>(functionType))->isSafe = true;
+                else if (str == "vector_abi") {
+                    if (isExported == false)
+                        Error(pos, "__declspec(vector_abi) is only allowed for "
+                              "\"export\" functions.");
+                    (const_cast<FunctionType *>(functionType))->isVectorABI = true;
+                }
+                else if (str == "fastmath")
+                    (const_cast<FunctionType *>(functionType))->isFastMath = true;
+                else if (str == "fp_contract_on")
+                    (const_cast<FunctionType *>(functionType))->fpContract = 1;
+                else if (str == "fp_contract_off") {
+                    (const_cast<FunctionType *>(functionType))->fpContract = 0;
+                    m->noFPContract = true;
+                }
+                else if (!strncmp(str.c_str(), "width", 5)) {
+                    int width = atoi(str.c_str() + 5);
+                    if (width != 1 && width != 4 && width != 8 &&
+                        width != 16 && width != 32 && width != 64)
+                        Error(pos, "No target has the gang size %d requested "
+                              "by __declspec(%s).", width, str.c_str());
+                    else
+                        (const_cast<FunctionType *>(functionType))->gangWidth = width;
+                }
                 else if (!strncmp(str.c_str(), "cost", 4)) {
                     int cost = atoi(str.c_str() + 4);
                     if (cost < 0)
@@ -75,6 +75,13 @@ class Declarator;
 #define TYPEQUAL_INLINE     (1<<6)
 #define TYPEQUAL_EXPORT     (1<<7)
 #define TYPEQUAL_UNMASKED   (1<<8)
+#define TYPEQUAL_NOALIAS    (1<<9)
+/* The "aligned(N)" qualifier stores log2(N) in these bits. */
+#define TYPEQUAL_ALIGN_SHIFT    16
+#define TYPEQUAL_ALIGN_MASK     (0x1f << TYPEQUAL_ALIGN_SHIFT)
+#define TYPEQUAL_ALIGNMENT(tq) \
+    ((((tq) & TYPEQUAL_ALIGN_MASK) != 0) ? \
+     (1 << (((tq) & TYPEQUAL_ALIGN_MASK) >> TYPEQUAL_ALIGN_SHIFT)) : 0)
 
 /** @brief Representation of the declaration specifiers in a declaration.
 
@@ -54,7 +54,7 @@
 #include "ao_ispc.h"
 using namespace ispc;
 
-#include "../timing.h"
+#include "../benchmark.h"
 
 #define NSUBSAMPLES        2
 
@@ -130,17 +130,16 @@ int main(int argc, char **argv)
     // Run the ispc path, test_iterations times, and report the minimum
     // time for any of them.
     //
-    double minTimeISPC = 1e30;
-    for (unsigned int i = 0; i < test_iterations[0]; i++) {
+    Benchmark ispcBench("aobench ispc", test_iterations[0]);
+    while (ispcBench.next()) {
         memset((void *)fimg, 0, sizeof(float) * width * height * 3);
         assert(NSUBSAMPLES == 2);
 
-        reset_and_start_timer();
+        ispcBench.start();
         ao_ispc(width, height, NSUBSAMPLES, fimg);
-        double t = get_elapsed_mcycles();
-        printf("@time of ISPC run:\t\t\t[%.3f] million cycles\n", t);
-        minTimeISPC = std::min(minTimeISPC, t);
+        ispcBench.stop();
     }
+    double minTimeISPC = ispcBench.min();
 
     // Report results and save image
     printf("[aobench ispc]:\t\t\t[%.3f] million cycles (%d x %d image)\n", 
@@ -151,17 +150,16 @@ int main(int argc, char **argv)
     // Run the ispc + tasks path, test_iterations times, and report the
     // minimum time for any of them.
     //
-    double minTimeISPCTasks = 1e30;
-    for (unsigned int i = 0; i < test_iterations[1]; i++) {
+    Benchmark tasksBench("aobench ispc + tasks", test_iterations[1]);
+    while (tasksBench.next()) {
         memset((void *)fimg, 0, sizeof(float) * width * height * 3);
         assert(NSUBSAMPLES == 2);
 
-        reset_and_start_timer();
+        tasksBench.start();
         ao_ispc_tasks(width, height, NSUBSAMPLES, fimg);
-        double t = get_elapsed_mcycles();
-        printf("@time of ISPC + TASKS run:\t\t\t[%.3f] million cycles\n", t);
-        minTimeISPCTasks = std::min(minTimeISPCTasks, t);
+        tasksBench.stop();
     }
+    double minTimeISPCTasks = tasksBench.min();
 
     // Report results and save image
     printf("[aobench ispc + tasks]:\t\t[%.3f] million cycles (%d x %d image)\n", 
@@ -172,15 +170,14 @@ int main(int argc, char **argv)
     // Run the serial path, again test_iteration times, and report the
     // minimum time.
     //
-    double minTimeSerial = 1e30;
-    for (unsigned int i = 0; i < test_iterations[2]; i++) {
+    Benchmark serialBench("aobench serial", test_iterations[2]);
+    while (serialBench.next()) {
         memset((void *)fimg, 0, sizeof(float) * width * height * 3);
-        reset_and_start_timer();
+        serialBench.start();
         ao_serial(width, height, NSUBSAMPLES, fimg);
-        double t = get_elapsed_mcycles();
-        printf("@time of serial run:\t\t\t\t[%.3f] million cycles\n", t);
-        minTimeSerial = std::min(minTimeSerial, t);
+        serialBench.stop();
     }
+    double minTimeSerial = serialBench.min();
 
     // Report more results, save another image...
     printf("[aobench serial]:\t\t[%.3f] million cycles (%d x %d image)\n", minTimeSerial, 
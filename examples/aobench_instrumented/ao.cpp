@@ -127,7 +127,14 @@ int main(int argc, char **argv)
 
     savePPM("ao-ispc.ppm", width, height); 
 
+#ifdef ISPC_OCCUPANCY_PROFILE
+    ISPCPrintOccupancy();
+    ISPCWriteOccupancyProfile("ao.prof");
+#elif defined(ISPC_MEMORY_TRACE)
+    ISPCPrintMemoryTrace();
+#else
     ISPCPrintInstrument();
+#endif
 
     return 0;
 }
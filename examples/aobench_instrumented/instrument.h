@@ -36,10 +36,31 @@
 
 #include <stdint.h>
 
+struct ISPCOccupancyModule;
+
 extern "C" {
     void ISPCInstrument(const char *fn, const char *note, int line, uint64_t mask);
+    void ISPCOccupancyRegister(const struct ISPCOccupancyModule *module,
+                               uint64_t *counts);
+#ifndef ISPC_MEMORY_TRACE
+    enum { ISPC_TRACE_LOAD = 0, ISPC_TRACE_STORE = 1, ISPC_TRACE_GATHER = 2, ISPC_TRACE_SCATTER = 3 };
+#endif // ISPC_MEMORY_TRACE
+    void ISPCTraceMemory(const char *fn, int line, int kind, int elementSize,
+                         int count, const uint64_t *addresses, uint64_t mask);
 }
 
 void ISPCPrintInstrument();
 
+// Prints the per-site SIMD utilization gathered in programs compiled with
+// --instrument=occupancy (see occupancy.cpp).
+void ISPCPrintOccupancy();
+
+// Writes the data gathered with --instrument=occupancy to the given file,
+// in the format expected by ispc's --profile-use option.
+bool ISPCWriteOccupancyProfile(const char *filename);
+
+// Prints the cache hits and misses of each memory access in programs
+// compiled with --trace-memory (see memtrace.cpp).
+void ISPCPrintMemoryTrace();
+
 #endif // INSTRUMENT_H
@@ -0,0 +1,211 @@
+/*
+  Copyright (c) 2016, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+// Runtime support for programs compiled with --trace-memory.
+// ISPCTraceMemory() is called with the addresses accessed by each active
+// program instance at every load, store, gather and scatter.  Here they're
+// run through a simple model of a set-associative cache with LRU
+// replacement, and the hits and misses are tallied for each access in the
+// source.  The cache geometry can be set with the ISPC_CACHE_KB,
+// ISPC_CACHE_WAYS and ISPC_CACHE_LINE environment variables.  If
+// ISPC_TRACE_FILE is set, each address is also written to the given file,
+// one access per line, for use with an external cache simulator.
+
+#include "instrument.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const char *lKindNames[] = { "load", "store", "gather", "scatter" };
+
+struct TraceSiteKey {
+    std::string file;
+    int line, kind;
+    bool operator<(const TraceSiteKey &k) const {
+        if (file != k.file) return file < k.file;
+        if (line != k.line) return line < k.line;
+        return kind < k.kind;
+    }
+};
+
+struct TraceSiteStats {
+    TraceSiteStats() : calls(0), accesses(0), lines(0), misses(0) { }
+    uint64_t calls, accesses, lines, misses;
+};
+
+
+class CacheModel {
+public:
+    CacheModel() {
+        const char *kb = getenv("ISPC_CACHE_KB");
+        const char *ways = getenv("ISPC_CACHE_WAYS");
+        const char *line = getenv("ISPC_CACHE_LINE");
+        lineSize = line ? atoi(line) : 64;
+        numWays = ways ? atoi(ways) : 8;
+        int size = (kb ? atoi(kb) : 32) * 1024;
+        if (lineSize <= 0 || numWays <= 0 || size < lineSize * numWays) {
+            fprintf(stderr, "Invalid cache geometry; using 32kB, 8-way, "
+                    "64-byte lines.\n");
+            lineSize = 64;
+            numWays = 8;
+            size = 32 * 1024;
+        }
+        numSets = size / (lineSize * numWays);
+        tags.resize(numSets * numWays, ~0ull);
+        lastUse.resize(numSets * numWays, 0);
+        time = 0;
+    }
+
+    // Returns true if the cache line holding the given address is
+    // present, and brings it in (evicting the least recently used line in
+    // its set) if not.
+    bool access(uint64_t address) {
+        uint64_t tag = address / lineSize;
+        int set = (int)(tag % numSets);
+        uint64_t *setTags = &tags[set * numWays];
+        uint64_t *setUse = &lastUse[set * numWays];
+        ++time;
+        int victim = 0;
+        for (int i = 0; i < numWays; ++i) {
+            if (setTags[i] == tag) {
+                setUse[i] = time;
+                return true;
+            }
+            if (setUse[i] < setUse[victim])
+                victim = i;
+        }
+        setTags[victim] = tag;
+        setUse[victim] = time;
+        return false;
+    }
+
+    int lineSize, numWays, numSets;
+
+private:
+    std::vector<uint64_t> tags, lastUse;
+    uint64_t time;
+};
+
+
+static std::mutex traceMutex;
+static CacheModel *cache;
+static FILE *traceFile;
+static std::map<TraceSiteKey, TraceSiteStats> siteStats;
+
+
+void
+ISPCTraceMemory(const char *fn, int line, int kind, int elementSize,
+                int count, const uint64_t *addresses, uint64_t mask) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (cache == NULL) {
+        cache = new CacheModel;
+        const char *name = getenv("ISPC_TRACE_FILE");
+        if (name != NULL && (traceFile = fopen(name, "w")) == NULL)
+            perror(name);
+    }
+
+    TraceSiteKey key;
+    key.file = fn;
+    key.line = line;
+    key.kind = kind;
+    TraceSiteStats &stats = siteStats[key];
+    ++stats.calls;
+
+    for (int i = 0; i < count; ++i) {
+        // Uniform accesses (count == 1) happen regardless of the mask.
+        if (count > 1 && (mask & (1ull << i)) == 0)
+            continue;
+        ++stats.accesses;
+        if (traceFile != NULL)
+            fprintf(traceFile, "%c 0x%llx %d\n",
+                    (kind == ISPC_TRACE_STORE || kind == ISPC_TRACE_SCATTER) ?
+                    'W' : 'R', (unsigned long long)addresses[i], elementSize);
+
+        // An element may straddle two cache lines.
+        uint64_t first = addresses[i] / cache->lineSize;
+        uint64_t last = (addresses[i] + elementSize - 1) / cache->lineSize;
+        for (uint64_t l = first; l <= last; ++l) {
+            ++stats.lines;
+            if (!cache->access(l * cache->lineSize))
+                ++stats.misses;
+        }
+    }
+}
+
+
+static bool
+lMoreMisses(const std::pair<TraceSiteKey, TraceSiteStats> &a,
+            const std::pair<TraceSiteKey, TraceSiteStats> &b) {
+    return a.second.misses > b.second.misses;
+}
+
+
+void
+ISPCPrintMemoryTrace() {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (cache == NULL) {
+        printf("No memory accesses were traced.\n");
+        return;
+    }
+    if (traceFile != NULL)
+        fflush(traceFile);
+
+    std::vector<std::pair<TraceSiteKey, TraceSiteStats> > sites(siteStats.begin(),
+                                                                siteStats.end());
+    std::sort(sites.begin(), sites.end(), lMoreMisses);
+
+    printf("Cache model: %d kB, %d-way, %d-byte lines\n",
+           cache->lineSize * cache->numWays * cache->numSets / 1024,
+           cache->numWays, cache->lineSize);
+    uint64_t totalLines = 0, totalMisses = 0;
+    for (size_t i = 0; i < sites.size(); ++i) {
+        const TraceSiteKey &key = sites[i].first;
+        const TraceSiteStats &stats = sites[i].second;
+        totalLines += stats.lines;
+        totalMisses += stats.misses;
+        printf("%s(%04d) - %s: %llu calls, %.2f lanes/call, %.2f lines/call, "
+               "%llu misses (%.2f%%)\n", key.file.c_str(), key.line,
+               lKindNames[key.kind], (unsigned long long)stats.calls,
+               double(stats.accesses) / stats.calls,
+               double(stats.lines) / stats.calls,
+               (unsigned long long)stats.misses,
+               stats.lines ? 100. * stats.misses / stats.lines : 0.);
+    }
+    printf("Total: %llu cache line accesses, %llu misses (%.2f%%)\n",
+           (unsigned long long)totalLines, (unsigned long long)totalMisses,
+           totalLines ? 100. * totalMisses / totalLines : 0.);
+}
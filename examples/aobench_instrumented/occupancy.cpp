@@ -0,0 +1,202 @@
+/*
+  Copyright (c) 2016, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+// Runtime support for programs compiled with --instrument=occupancy.
+// Each thread's counters live in thread-local tables in the ispc
+// modules; they're handed to ISPCOccupancyRegister() the first time a
+// thread runs code from a module, and are added into the totals below
+// when the thread exits or when ISPCPrintOccupancy() is called.
+
+#include "instrument.h"
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ISPCOccupancySite {
+    const char *file;
+    const char *note;
+    int32_t line;
+};
+
+struct ISPCOccupancyModule {
+    int32_t numSites;
+    int32_t width;
+    const ISPCOccupancySite *sites;
+};
+
+struct SiteKey {
+    std::string file, note;
+    int line;
+    bool operator<(const SiteKey &k) const {
+        if (file != k.file) return file < k.file;
+        if (line != k.line) return line < k.line;
+        return note < k.note;
+    }
+};
+
+// Lane-count histogram for a site: hist[i] is the number of times that
+// the site was reached with i program instances active.
+typedef std::vector<uint64_t> Histogram;
+
+static std::mutex totalsMutex;
+static std::map<SiteKey, Histogram> totals;
+
+struct ThreadTables;
+static std::vector<ThreadTables *> liveThreads;
+
+static void
+lAccumulate(const ISPCOccupancyModule *module, const uint64_t *counts) {
+    const int nBuckets = module->width + 1;
+    for (int i = 0; i < module->numSites; ++i) {
+        const ISPCOccupancySite &site = module->sites[i];
+        SiteKey key;
+        key.file = site.file;
+        key.note = site.note;
+        key.line = site.line;
+        Histogram &hist = totals[key];
+        if (hist.size() < (size_t)nBuckets)
+            hist.resize(nBuckets, 0);
+        for (int j = 0; j < nBuckets; ++j)
+            hist[j] += counts[i * nBuckets + j];
+    }
+}
+
+// The tables that have been registered by one thread.
+struct ThreadTables {
+    ThreadTables() {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        liveThreads.push_back(this);
+    }
+    ~ThreadTables() {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        flush();
+        for (size_t i = 0; i < liveThreads.size(); ++i)
+            if (liveThreads[i] == this) {
+                liveThreads.erase(liveThreads.begin() + i);
+                break;
+            }
+    }
+    // Adds the counts to the totals and resets them; totalsMutex must be
+    // held.
+    void flush() {
+        for (size_t i = 0; i < tables.size(); ++i) {
+            const ISPCOccupancyModule *module = tables[i].first;
+            uint64_t *counts = tables[i].second;
+            lAccumulate(module, counts);
+            memset(counts, 0,
+                   module->numSites * (module->width + 1) * sizeof(uint64_t));
+        }
+    }
+    std::vector<std::pair<const ISPCOccupancyModule *, uint64_t *> > tables;
+};
+
+static thread_local ThreadTables threadTables;
+
+
+void
+ISPCOccupancyRegister(const ISPCOccupancyModule *module, uint64_t *counts) {
+    threadTables.tables.push_back(std::make_pair(module, counts));
+}
+
+
+// Adds in the counts from the threads that are still running; totalsMutex
+// must be held.  Their counts may be updated while they're being read
+// here; this is only a problem if the program is still running ispc code.
+static void
+lFlushLiveThreads() {
+    for (size_t i = 0; i < liveThreads.size(); ++i)
+        liveThreads[i]->flush();
+}
+
+
+void
+ISPCPrintOccupancy() {
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    lFlushLiveThreads();
+
+    std::map<SiteKey, Histogram>::iterator iter;
+    for (iter = totals.begin(); iter != totals.end(); ++iter) {
+        const SiteKey &key = iter->first;
+        const Histogram &hist = iter->second;
+        uint64_t count = 0, lanes = 0;
+        for (size_t j = 0; j < hist.size(); ++j) {
+            count += hist[j];
+            lanes += j * hist[j];
+        }
+        if (count == 0)
+            continue;
+        int width = (int)hist.size() - 1;
+        printf("%s(%04d) - %s: %llu times (%.2f%% all off), %.2f%% active lanes\n   ",
+               key.file.c_str(), key.line, key.note.c_str(),
+               (unsigned long long)count, 100. * hist[0] / count,
+               100. * lanes / ((double)count * width));
+        // And the distribution of the number of active lanes.
+        for (size_t j = 0; j < hist.size(); ++j)
+            printf(" %d:%.1f%%", (int)j, 100. * hist[j] / count);
+        printf("\n");
+    }
+}
+
+
+bool
+ISPCWriteOccupancyProfile(const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        perror(filename);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    lFlushLiveThreads();
+
+    // The format read by ispc's --profile-use option: the file, line, and
+    // note of each point, separated by tabs, and then the lane counts.
+    fprintf(f, "# ispc lane occupancy profile\n");
+    std::map<SiteKey, Histogram>::iterator iter;
+    for (iter = totals.begin(); iter != totals.end(); ++iter) {
+        const SiteKey &key = iter->first;
+        const Histogram &hist = iter->second;
+        fprintf(f, "%s\t%d\t%s\t", key.file.c_str(), key.line,
+                key.note.c_str());
+        for (size_t j = 0; j < hist.size(); ++j)
+            fprintf(f, "%s%llu", j > 0 ? " " : "",
+                    (unsigned long long)hist[j]);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return true;
+}
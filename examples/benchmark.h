@@ -0,0 +1,263 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+/* A small harness for timing the examples in a statistically meaningful
+   way, on top of timing.h.  Each Benchmark does a number of untimed warmup
+   runs followed by the measured ones, and then reports the median and the
+   median absolute deviation (MAD) of the measurements along with the
+   minimum that the examples have traditionally printed.  Typical use:
+
+       Benchmark bench("mandelbrot ispc", test_iterations[0]);
+       while (bench.next()) {
+           bench.start();
+           mandelbrot_ispc(...);
+           bench.stop();
+       }
+       double minISPC = bench.min();
+
+   Code between next() and start() (clearing output buffers and the like)
+   isn't included in the times.  The following environment variables
+   control the runs, so that scripts like bench.py can run all of the
+   examples the same way without changing their command lines:
+
+       ISPC_BENCH_WARMUP   number of warmup runs (default 1)
+       ISPC_BENCH_RUNS     number of measured runs, overriding the example's
+       ISPC_BENCH_CPUS     CPUs to run on, e.g. "2" or "0-3,8" (Linux only);
+                           threads started afterwards, like the ones of the
+                           task system, are restricted to them as well
+       ISPC_BENCH_JSON     file that a JSON record of each benchmark, with
+                           all of its samples, is appended to (one per line)
+       ISPC_BENCH_COUNTERS hardware counters to collect for each run as
+                           well; see perf_counters.h
+ */
+
+#ifndef ISPC_EXAMPLES_BENCHMARK_H
+#define ISPC_EXAMPLES_BENCHMARK_H
+
+#include "timing.h"
+#include "perf_counters.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+static inline int lBenchmarkEnvInt(const char *name, int defaultValue) {
+    const char *value = getenv(name);
+    return (value != NULL && *value != '\0') ? atoi(value) : defaultValue;
+}
+
+/* Restricts the process to the CPUs given in ISPC_BENCH_CPUS, the first
+   time that it's called. */
+static inline void lBenchmarkSetAffinity() {
+    static bool done = false;
+    if (done)
+        return;
+    done = true;
+
+    const char *cpus = getenv("ISPC_BENCH_CPUS");
+    if (cpus == NULL || *cpus == '\0')
+        return;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    const char *p = cpus;
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10), last = first;
+        if (end == p)
+            break;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (long c = first; c <= last && c < CPU_SETSIZE; ++c)
+            CPU_SET((int)c, &set);
+        p = (*end == ',') ? end + 1 : end;
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        fprintf(stderr, "Warning: unable to set CPU affinity to \"%s\"\n", cpus);
+#else
+    fprintf(stderr, "Warning: ISPC_BENCH_CPUS is only supported on Linux\n");
+#endif
+}
+
+class Benchmark {
+public:
+    Benchmark(const char *name, int runs)
+        : name(name), iteration(0), reported(false),
+          counters(PerfCounters::get()) {
+        lBenchmarkSetAffinity();
+        counterSamples.resize(counters.count());
+        warmup = std::max(lBenchmarkEnvInt("ISPC_BENCH_WARMUP", 1), 0);
+        measured = std::max(lBenchmarkEnvInt("ISPC_BENCH_RUNS", runs), 1);
+    }
+
+    ~Benchmark() {
+        if (iteration > 0 && !reported)
+            report();
+    }
+
+    /* Returns true if there's another run to do. */
+    bool next() {
+        if (iteration == warmup + measured) {
+            report();
+            return false;
+        }
+        ++iteration;
+        return true;
+    }
+
+    void start() {
+        counters.start();
+        reset_and_start_timer();
+    }
+
+    /* Ends the current run, returning its time in millions of cycles.
+       Runs that repeat the work (e.g. render several frames) can give the
+       number of repetitions, so that the time of one is recorded. */
+    double stop(int repetitions = 1) {
+        double dt = get_elapsed_mcycles() / repetitions;
+        std::vector<double> values(counters.count());
+        if (!values.empty())
+            counters.stop(&values[0]);
+        if (iteration > warmup) {
+            samples.push_back(dt);
+            for (size_t i = 0; i < values.size(); ++i)
+                counterSamples[i].push_back(values[i]);
+            printf("@time of %s run:\t\t\t[%.3f] million cycles\n", name, dt);
+        }
+        return dt;
+    }
+
+    /* Number of runs, including the warmup ones. */
+    int runs() const {
+        return warmup + measured;
+    }
+
+    /* Sum of the times of the measured runs. */
+    double total() const {
+        double sum = 0.;
+        for (size_t i = 0; i < samples.size(); ++i)
+            sum += samples[i];
+        return sum;
+    }
+
+    double min() const {
+        return samples.empty() ? 0. :
+            *std::min_element(samples.begin(), samples.end());
+    }
+
+    double median() const {
+        return lMedian(samples);
+    }
+
+    /* Median absolute deviation from the median. */
+    double mad() const {
+        std::vector<double> dev(samples.size());
+        double m = median();
+        for (size_t i = 0; i < samples.size(); ++i)
+            dev[i] = fabs(samples[i] - m);
+        return lMedian(dev);
+    }
+
+private:
+    static double lMedian(std::vector<double> v) {
+        if (v.empty())
+            return 0.;
+        std::sort(v.begin(), v.end());
+        size_t n = v.size();
+        return (n & 1) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+    }
+
+    void report() {
+        if (reported)
+            return;
+        reported = true;
+        if (samples.empty())
+            return;
+
+        fprintf(stderr, "[%s]: median %.3f, MAD %.3f (%.1f%%), min %.3f "
+                "million cycles over %d runs\n", name, median(), mad(),
+                100. * mad() / median(), min(), (int)samples.size());
+        for (int i = 0; i < counters.count(); ++i)
+            fprintf(stderr, "    %-16s median %.0f\n", counters.name(i),
+                    lMedian(counterSamples[i]));
+
+        const char *fn = getenv("ISPC_BENCH_JSON");
+        if (fn == NULL || *fn == '\0')
+            return;
+        FILE *fp = fopen(fn, "a");
+        if (fp == NULL) {
+            fprintf(stderr, "Warning: unable to open \"%s\"\n", fn);
+            return;
+        }
+        fprintf(fp, "{\"benchmark\": \"");
+        for (const char *c = name; *c != '\0'; ++c) {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', fp);
+            fputc(*c, fp);
+        }
+        fprintf(fp, "\", \"unit\": \"Mcycles\", \"warmup\": %d, "
+                "\"median\": %.6f, \"mad\": %.6f, \"min\": %.6f, \"samples\": [",
+                warmup, median(), mad(), min());
+        for (size_t i = 0; i < samples.size(); ++i)
+            fprintf(fp, "%s%.6f", (i > 0) ? ", " : "", samples[i]);
+        fprintf(fp, "]");
+        if (counters.count() > 0) {
+            fprintf(fp, ", \"counters\": {");
+            for (int i = 0; i < counters.count(); ++i) {
+                fprintf(fp, "%s\"%s\": [", (i > 0) ? ", " : "",
+                        counters.name(i));
+                for (size_t j = 0; j < counterSamples[i].size(); ++j)
+                    fprintf(fp, "%s%.0f", (j > 0) ? ", " : "",
+                            counterSamples[i][j]);
+                fprintf(fp, "]");
+            }
+            fprintf(fp, "}");
+        }
+        fprintf(fp, "}\n");
+        fclose(fp);
+    }
+
+    const char *name;
+    int warmup, measured, iteration;
+    bool reported;
+    PerfCounters &counters;
+    std::vector<double> samples;
+    std::vector<std::vector<double> > counterSamples;
+};
+
+#endif // ISPC_EXAMPLES_BENCHMARK_H
@@ -66,7 +66,7 @@ OBJS=$(CPP_OBJS) $(CC_OBJS) $(TASK_OBJ) $(ISPC_OBJS)
 
 default: $(EXAMPLE)
 
-all: $(EXAMPLE) $(EXAMPLE)-sse4 $(EXAMPLE)-generic16 $(EXAMPLE)-scalar
+all: $(EXAMPLE) $(EXAMPLE)-sse4 $(EXAMPLE)-avx2 $(EXAMPLE)-skx $(EXAMPLE)-generic16 $(EXAMPLE)-scalar
 
 .PHONY: dirs clean
 
@@ -76,7 +76,7 @@ dirs:
 objs/%.cpp objs/%.o objs/%.h: dirs
 
 clean:
-	/bin/rm -rf objs *~ $(EXAMPLE) $(EXAMPLE)-sse4 $(EXAMPLE)-generic16 ref test
+	/bin/rm -rf objs *~ $(EXAMPLE) $(EXAMPLE)-sse4 $(EXAMPLE)-avx2 $(EXAMPLE)-skx $(EXAMPLE)-generic16 ref test
 
 $(EXAMPLE): $(OBJS)
 	$(CXX) $(CXXFLAGS) -o $@ $^ $(LIBS)
@@ -104,6 +104,24 @@ objs/$(ISPC_SRC:.ispc=)_sse4.o: objs/$(ISPC_SRC:.ispc=)_sse4.cpp
 $(EXAMPLE)-sse4: $(CPP_OBJS) objs/$(ISPC_SRC:.ispc=)_sse4.o
 	$(CXX) $(CXXFLAGS) -o $@ $^ $(LIBS)
 
+objs/$(ISPC_SRC:.ispc=)_avx2.cpp: $(ISPC_SRC)
+	$(ISPC) $(ISPC_FLAGS) $< -o $@ --target=generic-8 --emit-c++ --c++-include-file=avx2.h
+
+objs/$(ISPC_SRC:.ispc=)_avx2.o: objs/$(ISPC_SRC:.ispc=)_avx2.cpp
+	$(CXX) -I../intrinsics -mavx2 -mfma -mf16c -mbmi2 -ffp-contract=fast $< $(CXXFLAGS) -c -o $@
+
+$(EXAMPLE)-avx2: $(CPP_OBJS) objs/$(ISPC_SRC:.ispc=)_avx2.o
+	$(CXX) $(CXXFLAGS) -o $@ $^ $(LIBS)
+
+objs/$(ISPC_SRC:.ispc=)_skx.cpp: $(ISPC_SRC)
+	$(ISPC) $(ISPC_FLAGS) $< -o $@ --target=generic-16 --emit-c++ --c++-include-file=skx.h
+
+objs/$(ISPC_SRC:.ispc=)_skx.o: objs/$(ISPC_SRC:.ispc=)_skx.cpp
+	$(CXX) -I../intrinsics -mavx512f -mavx512bw -mavx512dq -mavx512vl -mfma -mf16c -ffp-contract=fast $< $(CXXFLAGS) -c -o $@
+
+$(EXAMPLE)-skx: $(CPP_OBJS) objs/$(ISPC_SRC:.ispc=)_skx.o
+	$(CXX) $(CXXFLAGS) -o $@ $^ $(LIBS)
+
 objs/$(ISPC_SRC:.ispc=)_generic16.cpp: $(ISPC_SRC)
 	$(ISPC) $(ISPC_FLAGS) $< -o $@ --target=generic-16 --emit-c++ --c++-include-file=generic-16.h
 
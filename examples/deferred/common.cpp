@@ -50,6 +50,7 @@
 #include <stdint.h>
 #include <algorithm>
 #include <assert.h>
+#include <string>
 #include <vector>
 #ifdef ISPC_IS_WINDOWS
   #define WIN32_LEAN_AND_MEAN
@@ -60,6 +61,7 @@
 #endif
 #include "deferred.h"
 #include "../timing.h"
+#include "../mapped_file.h"
 
 ///////////////////////////////////////////////////////////////////////////
 
@@ -119,27 +121,119 @@ Framebuffer::clear() {
 }
 
 
-InputData *
-CreateInputDataFromFile(const char *path) {
-    FILE *in = fopen(path, "rb");
-    if (!in) return 0;
+/* The input files are an InputHeader followed by the data chunk, whose
+   arrays are at inputDataArrayOffsets[] from the start of the chunk.  The
+   header's size isn't a multiple of ALIGNMENT_BYTES, though, so the first
+   time an input file is loaded, an aligned copy of it is written next to
+   it: the header, the stamp of the input file, and then the chunk,
+   starting at a multiple of ALIGNMENT_BYTES from the start of the file.
+   From then on, that copy is mapped and its arrays are used in place,
+   until the input file changes. */
+static const size_t alignedChunkOffset =
+    (sizeof(ispc::InputHeader) + sizeof(FileStamp) + ALIGNMENT_BYTES - 1) &
+    ~(size_t)(ALIGNMENT_BYTES - 1);
 
-    InputData *input = new InputData;
+
+static bool
+lMapAlignedInput(const char *path, const FileStamp *source, InputData *input) {
+    MappedFile *file = new MappedFile;
+    if (!file->Open(path) || file->Size() < alignedChunkOffset) {
+        delete file;
+        return false;
+    }
+    memcpy(&input->header, file->Data(), sizeof(ispc::InputHeader));
+    FileStamp stamp;
+    memcpy(&stamp, (const char *)file->Data() + sizeof(ispc::InputHeader),
+           sizeof(stamp));
+    if (source != NULL && !(stamp == *source)) {
+        // The input file has changed since the copy was written.
+        delete file;
+        return false;
+    }
+    if (file->Size() != alignedChunkOffset + (size_t)input->header.inputDataChunkSize) {
+        fprintf(stderr, "Ignoring \"%s\", which doesn't match the input file\n", path);
+        delete file;
+        return false;
+    }
+    input->file = file;
+    input->chunk = (uint8_t *)file->Data() + alignedChunkOffset;
+    return true;
+}
+
+
+static bool
+lReadInput(const char *path, InputData *input) {
+    FILE *in = fopen(path, "rb");
+    if (!in) return false;
 
     // Load header
     if (fread(&input->header, sizeof(ispc::InputHeader), 1, in) != 1) {
         fprintf(stderr, "Preumature EOF reading file \"%s\"\n", path);
-        return NULL;
+        fclose(in);
+        return false;
     }
 
-    // Load data chunk and update pointers
+    // Load data chunk
     input->chunk = (uint8_t *)lAlignedMalloc(input->header.inputDataChunkSize, 
                                              ALIGNMENT_BYTES);
     if (fread(input->chunk, input->header.inputDataChunkSize, 1, in) != 1) {
         fprintf(stderr, "Preumature EOF reading file \"%s\"\n", path);
+        lAlignedFree(input->chunk);
+        input->chunk = NULL;
+        fclose(in);
+        return false;
+    }
+
+    fclose(in);
+    return true;
+}
+
+
+static void
+lWriteAlignedInput(const char *path, const FileStamp &source,
+                   const InputData *input) {
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "Warning: couldn't write \"%s\"\n", path);
+        return;
+    }
+    char pad[ALIGNMENT_BYTES];
+    memset(pad, 0, sizeof(pad));
+    bool ok =
+        fwrite(&input->header, sizeof(ispc::InputHeader), 1, out) == 1 &&
+        fwrite(&source, sizeof(source), 1, out) == 1 &&
+        fwrite(pad, alignedChunkOffset - sizeof(ispc::InputHeader) -
+               sizeof(source), 1, out) == 1 &&
+        fwrite(input->chunk, input->header.inputDataChunkSize, 1, out) == 1;
+    if (fclose(out) != 0 || !ok) {
+        fprintf(stderr, "Warning: couldn't write \"%s\"\n", path);
+        remove(path);
+    }
+}
+
+
+InputData *
+CreateInputDataFromFile(const char *path) {
+    InputData *input = new InputData;
+    input->chunk = NULL;
+    input->file = NULL;
+
+    std::string alignedPath = std::string(path) + ".aligned";
+    FileStamp stamp;
+    bool haveInput = GetFileStamp(path, &stamp);
+    reset_and_start_timer();
+    bool mapped = lMapAlignedInput(alignedPath.c_str(),
+                                   haveInput ? &stamp : NULL, input);
+    if (!mapped && !lReadInput(path, input)) {
+        delete input;
         return NULL;
     }
-    
+    printf("[deferred input load, %s]:\t[%.3f] million cycles\n",
+           mapped ? "mapped" : "read", get_elapsed_mcycles());
+    if (!mapped)
+        lWriteAlignedInput(alignedPath.c_str(), stamp, input);
+
+    // Update pointers
     input->arrays.zBuffer =
         (float *)&input->chunk[input->header.inputDataArrayOffsets[idaZBuffer]];
     input->arrays.normalEncoded_x =
@@ -173,13 +267,16 @@ CreateInputDataFromFile(const char *path) {
     input->arrays.lightAttenuationEnd =
         (float *)&input->chunk[input->header.inputDataArrayOffsets[idaLightAttenuationEnd]];
 
-    fclose(in);
     return input;
 }
 
 
 void DeleteInputData(InputData *input) {
-    lAlignedFree(input->chunk);
+    if (input->file != NULL)
+        delete input->file;
+    else
+        lAlignedFree(input->chunk);
+    delete input;
 }
 
 
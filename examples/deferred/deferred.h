@@ -38,6 +38,10 @@
 #define MIN_TILE_WIDTH 16
 #define MIN_TILE_HEIGHT 16
 #define MAX_LIGHTS 1024
+// Number of view-space depth slices each tile is split into by the
+// clustered renderer.  Slices are spaced exponentially between the near
+// and far planes.
+#define CLUSTER_DEPTH_SLICES 16
 
 enum InputDataArraysEnum {
     idaZBuffer = 0,
@@ -71,11 +75,17 @@ enum InputDataArraysEnum {
 
 #define VISUALIZE_LIGHT_COUNT 0
 
+class MappedFile;
+
 struct InputData
 {
     ispc::InputHeader header;
     ispc::InputDataArrays arrays;
+    // The data chunk that the arrays point into: either read into memory
+    // from the input file, or mapped from its aligned copy (see
+    // CreateInputDataFromFile())
     uint8_t *chunk;
+    MappedFile *file;
 };
 
 
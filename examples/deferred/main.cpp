@@ -57,7 +57,7 @@
 #endif
 #include "deferred.h"
 #include "kernels_ispc.h"
-#include "../timing.h"
+#include "../benchmark.h"
 
 ///////////////////////////////////////////////////////////////////////////
 
@@ -88,59 +88,75 @@ int main(int argc, char** argv) {
 #endif // __cilk
 
     int nframes = test_iterations[2];
-    double ispcCycles = 1e30;
-    for (unsigned int i = 0; i < test_iterations[0]; ++i) {
+    Benchmark staticBench("ispc static + tasks", test_iterations[0]);
+    while (staticBench.next()) {
         framebuffer.clear();
-        reset_and_start_timer();
+        staticBench.start();
         for (int j = 0; j < nframes; ++j)
             ispc::RenderStatic(input->header, input->arrays,
                                VISUALIZE_LIGHT_COUNT,
                                framebuffer.r, framebuffer.g, framebuffer.b);
-        double mcycles = get_elapsed_mcycles() / nframes;
-        printf("@time of ISPC + TASKS run:\t\t\t[%.3f] million cycles\n", mcycles);
-        ispcCycles = std::min(ispcCycles, mcycles);
+        staticBench.stop(nframes);
     }
+    double ispcCycles = staticBench.min();
     printf("[ispc static + tasks]:\t\t[%.3f] million cycles to render "
            "%d x %d image\n", ispcCycles,
            input->header.framebufferWidth, input->header.framebufferHeight);
     WriteFrame("deferred-ispc-static.ppm", input, framebuffer);
 
+    Benchmark clusteredBench("ispc clustered + tasks", test_iterations[0]);
+    while (clusteredBench.next()) {
+        framebuffer.clear();
+        clusteredBench.start();
+        for (int j = 0; j < nframes; ++j)
+            ispc::RenderClustered(input->header, input->arrays,
+                                  VISUALIZE_LIGHT_COUNT,
+                                  framebuffer.r, framebuffer.g, framebuffer.b);
+        clusteredBench.stop(nframes);
+    }
+    double clusteredCycles = clusteredBench.min();
+    printf("[ispc clustered + tasks]:\t[%.3f] million cycles to render "
+           "%d x %d image (%.2fx vs. static)\n", clusteredCycles,
+           input->header.framebufferWidth, input->header.framebufferHeight,
+           ispcCycles/clusteredCycles);
+    WriteFrame("deferred-ispc-clustered.ppm", input, framebuffer);
+
     nframes = 3;
 #ifdef __cilk
-    double dynamicCilkCycles = 1e30;
-    for (int i = 0; i < test_iterations[1]; ++i) {
+    Benchmark cilkBench("ispc + Cilk dynamic", test_iterations[1]);
+    while (cilkBench.next()) {
         framebuffer.clear();
-        reset_and_start_timer();
+        cilkBench.start();
         for (int j = 0; j < nframes; ++j)
             DispatchDynamicCilk(input, &framebuffer);
-        double mcycles = get_elapsed_mcycles() / nframes;
-        printf("@time of serial run:\t\t\t[%.3f] million cycles\n", mcycles);
-        dynamicCilkCycles = std::min(dynamicCilkCycles, mcycles);
+        cilkBench.stop(nframes);
     }
+    double dynamicCilkCycles = cilkBench.min();
     printf("[ispc + Cilk dynamic]:\t\t[%.3f] million cycles to render image\n", 
            dynamicCilkCycles);
     WriteFrame("deferred-ispc-dynamic.ppm", input, framebuffer);
 #endif // __cilk
 
-    double serialCycles = 1e30;
-    for (unsigned int i = 0; i < test_iterations[1]; ++i) {
+    Benchmark serialBench("C++ serial dynamic, 1 core", test_iterations[1]);
+    while (serialBench.next()) {
         framebuffer.clear();
-        reset_and_start_timer();
+        serialBench.start();
         for (int j = 0; j < nframes; ++j)
             DispatchDynamicC(input, &framebuffer);
-        double mcycles = get_elapsed_mcycles() / nframes;
-        printf("@time of serial run:\t\t\t[%.3f] million cycles\n", mcycles);
-        serialCycles = std::min(serialCycles, mcycles);
+        serialBench.stop(nframes);
     }
+    double serialCycles = serialBench.min();
     printf("[C++ serial dynamic, 1 core]:\t[%.3f] million cycles to render image\n", 
            serialCycles);
     WriteFrame("deferred-serial-dynamic.ppm", input, framebuffer);
 
 #ifdef __cilk
-    printf("\t\t\t\t(%.2fx speedup from static ISPC, %.2fx from Cilk+ISPC)\n", 
-           serialCycles/ispcCycles, serialCycles/dynamicCilkCycles);
+    printf("\t\t\t\t(%.2fx speedup from static ISPC, %.2fx from clustered ISPC, "
+           "%.2fx from Cilk+ISPC)\n", serialCycles/ispcCycles,
+           serialCycles/clusteredCycles, serialCycles/dynamicCilkCycles);
 #else
-    printf("\t\t\t\t(%.2fx speedup from ISPC + tasks)\n", serialCycles/ispcCycles);
+    printf("\t\t\t\t(%.2fx speedup from ISPC + tasks, %.2fx from clustered ISPC)\n",
+           serialCycles/ispcCycles, serialCycles/clusteredCycles);
 #endif // __cilk
 
     DeleteInputData(input);
@@ -182,6 +182,7 @@ void gmres (const Matrix &A, const Vector &b, Vector &x, int num_iters, double m
 
     int iter = 0;
     Vector temp(A.rows(), false);
+    Vector next(A.rows(), false);
     double rel_err;
 
     while (iter < num_iters) 
@@ -190,16 +191,25 @@ void gmres (const Matrix &A, const Vector &b, Vector &x, int num_iters, double m
         Qstar.row(iter, temp);
         A.multiply(temp, w);
 
-        // construct ith column of H, i+1th row of Qstar:        
+        // construct ith column of H, i+1th row of Qstar (modified
+        // Gram-Schmidt, with each update of w fused with the dot product
+        // for the next row, and the last one with the norm of w):
+        Qstar.row(0, temp);
+        double h = temp.dot(w), norm2 = 0;
         for (int row = 0; row <= iter; row++) {
-            Qstar.row(row, temp);
-            H(row, iter) = temp.dot(w);
-            w.add_ax(-H(row, iter), temp);
+            H(row, iter) = h;
+            if (row < iter) {
+                Qstar.row(row + 1, next);
+                h = w.add_ax_dot(-h, temp, next);
+                Qstar.row(row + 1, temp);
+            }
+            else
+                norm2 = w.add_ax_norm2(-h, temp);
         }
 
-        H(iter+1, iter) = w.norm();
-        w.divide(H(iter+1, iter));
-        Qstar.set_row(iter+1, w);
+        H(iter+1, iter) = sqrt(norm2);
+        Qstar.row(iter+1, temp);
+        temp.copy_divided(w, H(iter+1, iter));
 
         update_qr_decomp (H, G, iter, Cn, Sn);
 
@@ -36,22 +36,78 @@
 #include "algorithm.h"
 #include "util.h"
 #include <cmath>
+#include <cstring>
 #include "../timing.h"
 
 
+#define SPMV_ITERATIONS 50
+
+/* Times the serial CSR, ispc CSR and ispc SELL-C-sigma SpMV kernels on
+   each of the given matrices. */
+static int spmv_bench (int count, char **paths)
+{
+    for (int m = 0; m < count; m++) {
+        CRSMatrix *A = CRSMatrix::matrix_from_mtf(paths[m]);
+        if (A == NULL)
+            return -1;
+        SellMatrix S(*A);
+
+        Vector x(A->cols()), r_csr(A->rows()), r(A->rows());
+        for (size_t i = 0; i < x.size(); i++)
+            x[i] = 1. + (double)(i % 17) / 17.;
+
+        double csr = 1e30, csr_ispc = 1e30, sell = 1e30;
+        for (int i = 0; i < SPMV_ITERATIONS; i++) {
+            reset_and_start_timer();
+            A->multiply(x, r_csr);
+            csr = std::min(csr, get_elapsed_mcycles());
+        }
+        for (int i = 0; i < SPMV_ITERATIONS; i++) {
+            reset_and_start_timer();
+            A->multiply_ispc(x, r);
+            csr_ispc = std::min(csr_ispc, get_elapsed_mcycles());
+        }
+        for (int i = 0; i < SPMV_ITERATIONS; i++) {
+            reset_and_start_timer();
+            S.multiply(x, r);
+            sell = std::min(sell, get_elapsed_mcycles());
+        }
+
+        // The kernels sum each row in the same order, up to contraction
+        // into fused multiply-adds.
+        double scale = r_csr.norm();
+        r.subtract(r_csr);
+        printf("%s: %lu rows, %lu nonzeroes, SELL fill %.2f%s\n", paths[m],
+               A->rows(), A->nonzeroes(),
+               (double)S.stored_entries() / (double)A->nonzeroes(),
+               r.norm() > 1e-12 * scale ? " (MISMATCH)" : "");
+        printf("  CSR serial:      %.3f Mcycles\n", csr);
+        printf("  CSR ispc:        %.3f Mcycles (%.2fx)\n", csr_ispc, csr / csr_ispc);
+        printf("  SELL-C-sigma:    %.3f Mcycles (%.2fx)\n", sell, csr / sell);
+        delete A;
+    }
+    return 0;
+}
+
 int main (int argc, char **argv) 
 {
+    if (argc >= 3 && strcmp(argv[1], "--spmv-bench") == 0)
+        return spmv_bench(argc - 2, argv + 2);
+
     if (argc < 4) {
         printf("usage: %s <input-matrix> <input-rhs> <output-file>\n", argv[0]);
+        printf("       %s --spmv-bench <input-matrix>...\n", argv[0]);
         return -1;
     }
 
     double gmres_cycles;
 
     DEBUG_PRINT("Loading A...\n");
-    Matrix *A = CRSMatrix::matrix_from_mtf(argv[1]);
-    if (A == NULL) 
+    CRSMatrix *A_csr = CRSMatrix::matrix_from_mtf(argv[1]);
+    if (A_csr == NULL) 
         return -1;
+    Matrix *A = new SellMatrix(*A_csr);
+    delete A_csr;
     DEBUG_PRINT("... size: %lu\n", A->cols());
 
     DEBUG_PRINT("Loading b...\n");
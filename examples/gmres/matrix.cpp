@@ -144,6 +144,9 @@ CRSMatrix *CRSMatrix::matrix_from_mtf (char *path) {
         M->entries[i] = entries[i].val;
         M->columns[i] = entries[i].col;
     }
+    // Trailing empty rows
+    while (cur_row + 1 < m)
+        M->row_offsets[++cur_row] = nz;
 
     return M;
 }
@@ -225,8 +228,8 @@ void CRSMatrix::multiply (const Vector &v, Vector &r) const
 
     for (int row = 0; row < rows(); row++) 
     {
-        int row_offset = row_offsets[row];
-        int next_offset = ((row + 1 == rows()) ? _nonzeroes : row_offsets[row + 1]);
+        int row_offset, next_offset;
+        row_range(row, row_offset, next_offset);
 
         double sum = 0;
         for (int i = row_offset; i < next_offset; i++)
@@ -237,6 +240,21 @@ void CRSMatrix::multiply (const Vector &v, Vector &r) const
     }
 }
 
+void CRSMatrix::multiply_ispc (const Vector &v, Vector &r) const
+{
+    ASSERT(v.size() == cols());
+    ASSERT(r.size() == rows());
+
+    ispc::sparse_multiply(&entries[0], &columns[0], &row_offsets[0],
+                          rows(), cols(), _nonzeroes, v.entries, r.entries);
+}
+
+void CRSMatrix::row_range (size_t row, int &begin, int &end) const
+{
+    begin = row_offsets[row];
+    end = ((row + 1 == rows()) ? _nonzeroes : row_offsets[row + 1]);
+}
+
 void CRSMatrix::zero ( ) 
 {
     entries.clear();
@@ -244,3 +262,84 @@ void CRSMatrix::zero ( )
     columns.clear();
     _nonzeroes = 0;
 }
+
+
+/**************************************************************\
+| SellMatrix Methods
+\**************************************************************/
+struct row_length {
+    int row;
+    int length;
+};
+
+bool compare_row_lengths(struct row_length i, struct row_length j) {
+    return i.length > j.length;
+}
+
+SellMatrix::SellMatrix (const CRSMatrix &A, int sigma)
+    : Matrix(A.rows(), A.cols())
+{
+    chunk = ispc::sell_chunk_size();
+    slices = (A.rows() + chunk - 1) / chunk;
+
+    // Sorting windows are a whole number of slices.
+    if (sigma < chunk)
+        sigma = chunk;
+    sigma -= sigma % chunk;
+
+    std::vector<struct row_length> order(A.rows());
+    for (size_t row = 0; row < A.rows(); row++) {
+        int begin, end;
+        A.row_range(row, begin, end);
+        order[row].row = row;
+        order[row].length = end - begin;
+    }
+    for (size_t w = 0; w < A.rows(); w += sigma) {
+        size_t w_end = std::min(w + sigma, A.rows());
+        std::stable_sort(order.begin() + w, order.begin() + w_end,
+                         compare_row_lengths);
+    }
+
+    slice_rows.resize(slices * chunk, -1);
+    slice_offsets.resize(slices + 1);
+    slice_offsets[0] = 0;
+    for (int s = 0; s < slices; s++) {
+        // Rows are sorted by decreasing length, so the first row of a
+        // slice is the longest one.
+        int width = order[s * chunk].length;
+        slice_offsets[s + 1] = slice_offsets[s] + width * chunk;
+    }
+
+    // Padding entries are zeroes with a valid column index.
+    entries.resize(slice_offsets[slices], 0.);
+    columns.resize(slice_offsets[slices], 0);
+    for (size_t i = 0; i < A.rows(); i++) {
+        int s = i / chunk, lane = i % chunk;
+        int row = order[i].row;
+        slice_rows[i] = row;
+
+        int begin, end;
+        A.row_range(row, begin, end);
+        for (int k = 0; k < end - begin; k++) {
+            int j = slice_offsets[s] + k * chunk + lane;
+            entries[j] = A.entries[begin + k];
+            columns[j] = A.columns[begin + k];
+        }
+    }
+}
+
+void SellMatrix::multiply (const Vector &v, Vector &r) const
+{
+    ASSERT(v.size() == cols());
+    ASSERT(r.size() == rows());
+
+    ispc::sell_multiply(&entries[0], &columns[0], &slice_offsets[0],
+                        &slice_rows[0], slices, v.entries, r.entries);
+}
+
+void SellMatrix::zero ( )
+{
+    entries.clear();
+    columns.clear();
+    slice_offsets.assign(slices + 1, 0);
+}
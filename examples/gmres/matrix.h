@@ -159,6 +159,25 @@ class Vector {
         ispc::vector_add_ax(entries, a, x.entries, size());
     }
 
+    // add_ax(a, x), returning the dot product of the result with y, in
+    // a single pass over the vectors
+    double add_ax_dot (double a, const Vector &x, const Vector &y) {
+        ASSERT(x.size() >= size() && y.size() >= size());
+        return ispc::vector_add_ax_dot(entries, a, x.entries, y.entries, size());
+    }
+
+    // add_ax(a, x), returning the squared norm of the result
+    double add_ax_norm2 (double a, const Vector &x) {
+        ASSERT(x.size() >= size());
+        return ispc::vector_add_ax_dot(entries, a, x.entries, entries, size());
+    }
+
+    // Same as copy(other) followed by divide(scalar)
+    void copy_divided (const Vector &other, double scalar) {
+        ASSERT(other.size() >= size());
+        ispc::vector_div_copy(entries, other.entries, scalar, size());
+    }
+
     // Note that copy only copies the first size() elements of the
     // supplied vector, i.e. the supplied vector can be longer than
     // this one.  This is useful in least squares calculations.
@@ -168,6 +187,8 @@ class Vector {
     }
 
     friend class DenseMatrix;
+    friend class CRSMatrix;
+    friend class SellMatrix;
 
  private:
     size_t  _size;
@@ -253,6 +274,8 @@ class DenseMatrix : public Matrix {
 | CSRMatrix (compressed row storage, a sparse matrix format)
 \**************************************************************/
 class CRSMatrix : public Matrix { 
+    friend class SellMatrix;
+
  public:
     CRSMatrix (size_t size_r, size_t size_c, size_t nonzeroes) :
     Matrix(size_r, size_c) 
@@ -265,15 +288,54 @@ class CRSMatrix : public Matrix {
 
     virtual void multiply(const Vector &v, Vector &r) const;
 
+    // Same as multiply(), with one row per program instance in ispc
+    void multiply_ispc(const Vector &v, Vector &r) const;
+
     virtual void zero();
 
+    size_t nonzeroes() const { return _nonzeroes; }
+
     static CRSMatrix *matrix_from_mtf (char *path);
 
  private:
+    // Range [begin, end) of the row's entries
+    void row_range(size_t row, int &begin, int &end) const;
+
     unsigned int        _nonzeroes;
     std::vector<double>  entries;
     std::vector<int>     row_offsets;
     std::vector<int>     columns;
 };
 
+/**************************************************************\
+| SellMatrix (SELL-C-sigma, sliced ELLPACK storage)
+|
+| The rows are grouped into slices of C rows, where C is the
+| ispc gang size, and each slice is stored in column-major
+| order, padded to the length of its longest row.  To keep the
+| padding small, the rows are sorted by length within windows
+| of sigma rows first.
+\**************************************************************/
+class SellMatrix : public Matrix {
+ public:
+    SellMatrix (const CRSMatrix &A, int sigma = 256);
+
+    virtual void multiply(const Vector &v, Vector &r) const;
+
+    virtual void zero();
+
+    // Number of stored entries, including the padding
+    size_t stored_entries() const { return entries.size(); }
+
+ private:
+    int                  chunk;
+    int                  slices;
+    std::vector<double>  entries;
+    std::vector<int>     columns;
+    // Start of each slice in entries, plus the end of the last one
+    std::vector<int>     slice_offsets;
+    // Row of the matrix for each row of each slice, or -1 for padding
+    std::vector<int>     slice_rows;
+};
+
 #endif
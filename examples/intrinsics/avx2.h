@@ -0,0 +1,3105 @@
+/*
+  Copyright (c) 2010-2016, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+  Implementation of the "generic-8" target's vector types and operations
+  in terms of AVX2 intrinsics, for use with "ispc --target=generic-8
+  --emit-c++ --c++-include-file=avx2.h".
+
+  Masks are stored with one 32-bit lane per program instance, so that they
+  can be passed directly to the AVX2 masked load/store and gather
+  instructions.  Gathers use the hardware gather instructions; scatters
+  (which AVX2 lacks) loop over the active lanes only.  The header doesn't
+  call FMA instructions explicitly for general arithmetic, since the C++
+  code generated by ispc expresses a*b+c as separate __mul() and __add()
+  calls; compile with -mfma -ffp-contract=fast (or /fp:fast with MSVC) to
+  have the C++ compiler fuse them.
+*/
+
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+#include <immintrin.h>
+
+#if !defined(__AVX2__) && !defined(_MSC_VER)
+#error "AVX2 must be enabled in the C++ compiler to use this header."
+#endif // !__AVX2__ && !msvc
+
+#ifdef _MSC_VER
+#define FORCEINLINE __forceinline
+#else
+#define FORCEINLINE __attribute__((always_inline)) inline
+#endif
+
+typedef float __vec1_f;
+typedef double __vec1_d;
+typedef int8_t __vec1_i8;
+typedef int16_t __vec1_i16;
+typedef int32_t __vec1_i32;
+typedef int64_t __vec1_i64;
+
+struct __vec8_i1 {
+    FORCEINLINE __vec8_i1() { }
+    FORCEINLINE __vec8_i1(__m256 vv) : v(vv) { }
+    FORCEINLINE __vec8_i1(__m256i vv) : v(_mm256_castsi256_ps(vv)) { }
+    FORCEINLINE __vec8_i1(int a, int b, int c, int d,
+                          int e, int f, int g, int h) {
+        v = _mm256_castsi256_ps(_mm256_setr_epi32(a ? -1 : 0, b ? -1 : 0,
+                                                  c ? -1 : 0, d ? -1 : 0,
+                                                  e ? -1 : 0, f ? -1 : 0,
+                                                  g ? -1 : 0, h ? -1 : 0));
+    }
+
+    __m256 v;
+};
+
+struct __vec8_f {
+    FORCEINLINE __vec8_f() { }
+    FORCEINLINE __vec8_f(__m256 vv) : v(vv) { }
+    FORCEINLINE __vec8_f(float a, float b, float c, float d,
+                         float e, float f, float g, float h) {
+        v = _mm256_setr_ps(a, b, c, d, e, f, g, h);
+    }
+    FORCEINLINE __vec8_f(const float *p) {
+        v = _mm256_loadu_ps(p);
+    }
+
+    __m256 v;
+};
+
+struct __vec8_d {
+    FORCEINLINE __vec8_d() { }
+    FORCEINLINE __vec8_d(__m256d a, __m256d b) { v[0] = a; v[1] = b; }
+    FORCEINLINE __vec8_d(double a, double b, double c, double d,
+                         double e, double f, double g, double h) {
+        v[0] = _mm256_setr_pd(a, b, c, d);
+        v[1] = _mm256_setr_pd(e, f, g, h);
+    }
+    FORCEINLINE __vec8_d(const double *p) {
+        v[0] = _mm256_loadu_pd(p);
+        v[1] = _mm256_loadu_pd(p + 4);
+    }
+
+    __m256d v[2];
+};
+
+struct __vec8_i32 {
+    FORCEINLINE __vec8_i32() { }
+    FORCEINLINE __vec8_i32(__m256i vv) : v(vv) { }
+    FORCEINLINE __vec8_i32(int32_t a, int32_t b, int32_t c, int32_t d,
+                           int32_t e, int32_t f, int32_t g, int32_t h) {
+        v = _mm256_setr_epi32(a, b, c, d, e, f, g, h);
+    }
+    FORCEINLINE __vec8_i32(const int32_t *p) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+    }
+
+    __m256i v;
+};
+
+struct __vec8_i64 {
+    FORCEINLINE __vec8_i64() { }
+    FORCEINLINE __vec8_i64(__m256i a, __m256i b) { v[0] = a; v[1] = b; }
+    FORCEINLINE __vec8_i64(int64_t a, int64_t b, int64_t c, int64_t d,
+                           int64_t e, int64_t f, int64_t g, int64_t h) {
+        v[0] = _mm256_setr_epi64x(a, b, c, d);
+        v[1] = _mm256_setr_epi64x(e, f, g, h);
+    }
+    FORCEINLINE __vec8_i64(const int64_t *p) {
+        v[0] = _mm256_loadu_si256((const __m256i *)p);
+        v[1] = _mm256_loadu_si256((const __m256i *)(p + 4));
+    }
+
+    __m256i v[2];
+};
+
+struct __vec8_i16 {
+    FORCEINLINE __vec8_i16() { }
+    FORCEINLINE __vec8_i16(__m128i vv) : v(vv) { }
+    FORCEINLINE __vec8_i16(int16_t a, int16_t b, int16_t c, int16_t d,
+                           int16_t e, int16_t f, int16_t g, int16_t h) {
+        v = _mm_setr_epi16(a, b, c, d, e, f, g, h);
+    }
+    FORCEINLINE __vec8_i16(const int16_t *p) {
+        v = _mm_loadu_si128((const __m128i *)p);
+    }
+
+    __m128i v;
+};
+
+// Only the low 8 bytes of v are meaningful.
+struct __vec8_i8 {
+    FORCEINLINE __vec8_i8() { }
+    FORCEINLINE __vec8_i8(__m128i vv) : v(vv) { }
+    FORCEINLINE __vec8_i8(int8_t a, int8_t b, int8_t c, int8_t d,
+                          int8_t e, int8_t f, int8_t g, int8_t h) {
+        v = _mm_setr_epi8(a, b, c, d, e, f, g, h, 0, 0, 0, 0, 0, 0, 0, 0);
+    }
+    FORCEINLINE __vec8_i8(const int8_t *p) {
+        v = _mm_loadl_epi64((const __m128i *)p);
+    }
+
+    __m128i v;
+};
+
+
+///////////////////////////////////////////////////////////////////////////
+// Utility functions for converting between the different mask and
+// element widths.
+
+// Widen the 8 32-bit mask lanes to two vectors of 4 64-bit mask lanes.
+static FORCEINLINE __m256i lMaskLo64(__m256 m) {
+    return _mm256_cvtepi32_epi64(_mm256_castsi256_si128(_mm256_castps_si256(m)));
+}
+
+static FORCEINLINE __m256i lMaskHi64(__m256 m) {
+    return _mm256_cvtepi32_epi64(_mm256_extracti128_si256(_mm256_castps_si256(m), 1));
+}
+
+// Narrow the mask to 8 16-bit or 8 8-bit lanes.
+static FORCEINLINE __m128i lMask16(__m256 m) {
+    __m256i mi = _mm256_castps_si256(m);
+    return _mm_packs_epi32(_mm256_castsi256_si128(mi),
+                           _mm256_extracti128_si256(mi, 1));
+}
+
+static FORCEINLINE __m128i lMask8(__m256 m) {
+    __m128i m16 = lMask16(m);
+    return _mm_packs_epi16(m16, m16);
+}
+
+// Take the low 32 bits of each of the 64-bit elements of a and b.
+static FORCEINLINE __m256i lPack64To32(__m256i a, __m256i b) {
+    const __m256i perm = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    a = _mm256_permutevar8x32_epi32(a, perm);
+    b = _mm256_permutevar8x32_epi32(b, perm);
+    return _mm256_permute2x128_si256(a, b, 0x20);
+}
+
+static FORCEINLINE __m128i lTrunc32To16(__m256i v) {
+    const __m256i shuf = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13,
+                                          -1, -1, -1, -1, -1, -1, -1, -1,
+                                          0, 1, 4, 5, 8, 9, 12, 13,
+                                          -1, -1, -1, -1, -1, -1, -1, -1);
+    v = _mm256_shuffle_epi8(v, shuf);
+    v = _mm256_permute4x64_epi64(v, 0x08);
+    return _mm256_castsi256_si128(v);
+}
+
+static FORCEINLINE __m128i lTrunc32To8(__m256i v) {
+    const __m256i shuf = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+                                          -1, -1, -1, -1, -1, -1, -1, -1,
+                                          0, 4, 8, 12, -1, -1, -1, -1,
+                                          -1, -1, -1, -1, -1, -1, -1, -1);
+    v = _mm256_shuffle_epi8(v, shuf);
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 2, 3, 1, 5, 6, 7));
+    return _mm256_castsi256_si128(v);
+}
+
+static FORCEINLINE __m128i lTrunc16To8(__m128i v) {
+    const __m128i shuf = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                                       -1, -1, -1, -1, -1, -1, -1, -1);
+    return _mm_shuffle_epi8(v, shuf);
+}
+
+static FORCEINLINE __m256i lCombine128(__m128i lo, __m128i hi) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+static FORCEINLINE __m256 lCombine128(__m128 lo, __m128 hi) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+// 64-bit multiply; AVX2 only provides 32x32->64 bit multiplies.
+static FORCEINLINE __m256i lMul64(__m256i a, __m256i b) {
+    __m256i ahi = _mm256_srli_epi64(a, 32);
+    __m256i bhi = _mm256_srli_epi64(b, 32);
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(ahi, b),
+                                     _mm256_mul_epu32(a, bhi));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+static FORCEINLINE __m256 lAllOn() {
+    return _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+}
+
+static FORCEINLINE float __floatbits(int v) {
+    union {
+        int i;
+        float f;
+    } u;
+    u.i = v;
+    return u.f;
+}
+
+static FORCEINLINE int __intbits(float v) {
+    union {
+        float f;
+        int i;
+    } u;
+    u.f = v;
+    return u.i;
+}
+
+template <typename T>
+static FORCEINLINE T __select(bool test, T a, T b) {
+    return test ? a : b;
+}
+
+#define INSERT_EXTRACT(VTYPE, STYPE)                                  \
+static FORCEINLINE STYPE __extract_element(VTYPE v, int index) {      \
+    return ((STYPE *)&v)[index];                                      \
+}                                                                     \
+static FORCEINLINE void __insert_element(VTYPE *v, int index, STYPE val) { \
+    ((STYPE *)v)[index] = val;                                        \
+}
+
+INSERT_EXTRACT(__vec1_i8, int8_t)
+INSERT_EXTRACT(__vec1_i16, int16_t)
+INSERT_EXTRACT(__vec1_i32, int32_t)
+INSERT_EXTRACT(__vec1_i64, int64_t)
+INSERT_EXTRACT(__vec1_f, float)
+INSERT_EXTRACT(__vec1_d, double)
+
+// Access individual lanes through memcpy() rather than by casting the
+// vector's address, so that the accesses are valid under strict aliasing.
+template <typename STYPE, typename VTYPE>
+static FORCEINLINE STYPE lExtractLane(const VTYPE *v, int index) {
+    STYPE ret;
+    memcpy(&ret, (const char *)v + index * sizeof(STYPE), sizeof(STYPE));
+    return ret;
+}
+
+template <typename STYPE, typename VTYPE>
+static FORCEINLINE void lInsertLane(VTYPE *v, int index, STYPE val) {
+    memcpy((char *)v + index * sizeof(STYPE), &val, sizeof(STYPE));
+}
+
+static FORCEINLINE bool __extract_element(const __vec8_i1 &v, int index) {
+    return lExtractLane<int32_t>(&v, index) ? true : false;
+}
+
+static FORCEINLINE void __insert_element(__vec8_i1 *v, int index, bool val) {
+    lInsertLane(v, index, (int32_t)(val ? -1 : 0));
+}
+
+static FORCEINLINE int8_t __extract_element(const __vec8_i8 &v, int index) {
+    return lExtractLane<int8_t>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec8_i8 *v, int index, int8_t val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE int16_t __extract_element(const __vec8_i16 &v, int index) {
+    return lExtractLane<int16_t>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec8_i16 *v, int index, int16_t val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE int32_t __extract_element(const __vec8_i32 &v, int index) {
+    return lExtractLane<int32_t>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec8_i32 *v, int index, int32_t val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE int64_t __extract_element(const __vec8_i64 &v, int index) {
+    return lExtractLane<int64_t>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec8_i64 *v, int index, int64_t val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE float __extract_element(const __vec8_f &v, int index) {
+    return lExtractLane<float>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec8_f *v, int index, float val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE double __extract_element(const __vec8_d &v, int index) {
+    return lExtractLane<double>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec8_d *v, int index, double val) {
+    lInsertLane(v, index, val);
+}
+
+#define CAST_BITS_SCALAR(TO, FROM)                  \
+static FORCEINLINE TO __cast_bits(TO, FROM v) {     \
+    union {                                         \
+    TO to;                                          \
+    FROM from;                                      \
+    } u;                                            \
+    u.from = v;                                     \
+    return u.to;                                    \
+}
+
+CAST_BITS_SCALAR(uint32_t, float)
+CAST_BITS_SCALAR(int32_t, float)
+CAST_BITS_SCALAR(float, uint32_t)
+CAST_BITS_SCALAR(float, int32_t)
+CAST_BITS_SCALAR(uint64_t, double)
+CAST_BITS_SCALAR(int64_t, double)
+CAST_BITS_SCALAR(double, uint64_t)
+CAST_BITS_SCALAR(double, int64_t)
+
+#define CAST_BITS_TRIVIAL(TYPE)                  \
+static FORCEINLINE TYPE __cast_bits(TYPE, TYPE v) { return v; }
+
+CAST_BITS_TRIVIAL(float)
+CAST_BITS_TRIVIAL(double)
+CAST_BITS_TRIVIAL(int8_t)
+CAST_BITS_TRIVIAL(uint8_t)
+CAST_BITS_TRIVIAL(int16_t)
+CAST_BITS_TRIVIAL(uint16_t)
+CAST_BITS_TRIVIAL(int32_t)
+CAST_BITS_TRIVIAL(uint32_t)
+CAST_BITS_TRIVIAL(int64_t)
+CAST_BITS_TRIVIAL(uint64_t)
+CAST_BITS_TRIVIAL(__vec8_f)
+CAST_BITS_TRIVIAL(__vec8_d)
+CAST_BITS_TRIVIAL(__vec8_i8)
+CAST_BITS_TRIVIAL(__vec8_i16)
+CAST_BITS_TRIVIAL(__vec8_i32)
+CAST_BITS_TRIVIAL(__vec8_i64)
+
+static FORCEINLINE __vec8_f __cast_bits(__vec8_f, __vec8_i32 v) {
+    return _mm256_castsi256_ps(v.v);
+}
+
+static FORCEINLINE __vec8_i32 __cast_bits(__vec8_i32, __vec8_f v) {
+    return _mm256_castps_si256(v.v);
+}
+
+static FORCEINLINE __vec8_d __cast_bits(__vec8_d, __vec8_i64 v) {
+    return __vec8_d(_mm256_castsi256_pd(v.v[0]), _mm256_castsi256_pd(v.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __cast_bits(__vec8_i64, __vec8_d v) {
+    return __vec8_i64(_mm256_castpd_si256(v.v[0]), _mm256_castpd_si256(v.v[1]));
+}
+
+#define CMP_AND_MASK_ONE(FUNC, TYPE)                                        \
+static FORCEINLINE __vec8_i1 FUNC##_and_mask(TYPE a, TYPE b, __vec8_i1 m) { \
+    return __and(FUNC(a, b), m);                                        \
+}
+
+#define CMP_AND_MASK_INT(TYPE, SUFFIX)           \
+CMP_AND_MASK_ONE(__equal_##SUFFIX, TYPE)         \
+CMP_AND_MASK_ONE(__not_equal_##SUFFIX, TYPE)              \
+CMP_AND_MASK_ONE(__unsigned_less_equal_##SUFFIX, TYPE)    \
+CMP_AND_MASK_ONE(__unsigned_greater_equal_##SUFFIX, TYPE) \
+CMP_AND_MASK_ONE(__unsigned_less_than_##SUFFIX, TYPE)     \
+CMP_AND_MASK_ONE(__unsigned_greater_than_##SUFFIX, TYPE)  \
+CMP_AND_MASK_ONE(__signed_less_equal_##SUFFIX, TYPE)      \
+CMP_AND_MASK_ONE(__signed_greater_equal_##SUFFIX, TYPE)   \
+CMP_AND_MASK_ONE(__signed_less_than_##SUFFIX, TYPE)       \
+CMP_AND_MASK_ONE(__signed_greater_than_##SUFFIX, TYPE)
+
+#define CMP_AND_MASK_FLOAT(TYPE, SUFFIX)           \
+CMP_AND_MASK_ONE(__equal_##SUFFIX, TYPE)         \
+CMP_AND_MASK_ONE(__not_equal_##SUFFIX, TYPE)              \
+CMP_AND_MASK_ONE(__less_equal_##SUFFIX, TYPE)      \
+CMP_AND_MASK_ONE(__greater_equal_##SUFFIX, TYPE)   \
+CMP_AND_MASK_ONE(__less_than_##SUFFIX, TYPE)       \
+CMP_AND_MASK_ONE(__greater_than_##SUFFIX, TYPE)    \
+CMP_AND_MASK_ONE(__ordered_##SUFFIX, TYPE)         \
+CMP_AND_MASK_ONE(__unordered_##SUFFIX, TYPE)
+
+///////////////////////////////////////////////////////////////////////////
+// mask ops
+
+static FORCEINLINE uint64_t __movmsk(__vec8_i1 mask) {
+    return (uint64_t)_mm256_movemask_ps(mask.v);
+}
+
+static FORCEINLINE bool __any(__vec8_i1 mask) {
+    return _mm256_testz_ps(mask.v, mask.v) == 0;
+}
+
+static FORCEINLINE bool __all(__vec8_i1 mask) {
+    return _mm256_movemask_ps(mask.v) == 0xff;
+}
+
+static FORCEINLINE bool __none(__vec8_i1 mask) {
+    return _mm256_testz_ps(mask.v, mask.v) != 0;
+}
+
+static FORCEINLINE __vec8_i1 __equal_i1(__vec8_i1 a, __vec8_i1 b) {
+    return _mm256_cmpeq_epi32(_mm256_castps_si256(a.v), _mm256_castps_si256(b.v));
+}
+
+static FORCEINLINE __vec8_i1 __and(__vec8_i1 a, __vec8_i1 b) {
+    return _mm256_and_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i1 __xor(__vec8_i1 a, __vec8_i1 b) {
+    return _mm256_xor_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i1 __or(__vec8_i1 a, __vec8_i1 b) {
+    return _mm256_or_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i1 __not(__vec8_i1 a) {
+    return _mm256_xor_ps(a.v, lAllOn());
+}
+
+static FORCEINLINE __vec8_i1 __and_not1(__vec8_i1 a, __vec8_i1 b) {
+    return _mm256_andnot_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i1 __and_not2(__vec8_i1 a, __vec8_i1 b) {
+    return _mm256_andnot_ps(b.v, a.v);
+}
+
+static FORCEINLINE __vec8_i1 __select(__vec8_i1 mask, __vec8_i1 a, __vec8_i1 b) {
+    return _mm256_blendv_ps(b.v, a.v, mask.v);
+}
+
+template <int ALIGN> static FORCEINLINE __vec8_i1 __load(const __vec8_i1 *v) {
+    return _mm256_loadu_ps((const float *)(&v->v));
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec8_i1 *p, __vec8_i1 value) {
+    _mm256_storeu_ps((float *)(&p->v), value.v);
+}
+
+template <class RetVecType> __vec8_i1 __smear_i1(int v);
+template <> FORCEINLINE __vec8_i1 __smear_i1<__vec8_i1>(int v) {
+    return _mm256_set1_epi32(v ? -1 : 0);
+}
+
+template <class RetVecType> __vec8_i1 __setzero_i1();
+template <> FORCEINLINE __vec8_i1 __setzero_i1<__vec8_i1>() {
+    return _mm256_setzero_ps();
+}
+
+template <class RetVecType> __vec8_i1 __undef_i1();
+template <> FORCEINLINE __vec8_i1 __undef_i1<__vec8_i1>() {
+    return __vec8_i1();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// int8
+
+static FORCEINLINE __vec8_i1 lMaskFrom8(__m128i m) {
+    return _mm256_cvtepi8_epi32(m);
+}
+
+static FORCEINLINE __vec8_i8 __add(__vec8_i8 a, __vec8_i8 b) {
+    return _mm_add_epi8(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i8 __sub(__vec8_i8 a, __vec8_i8 b) {
+    return _mm_sub_epi8(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i8 __mul(__vec8_i8 a, __vec8_i8 b) {
+    return lTrunc16To8(_mm_mullo_epi16(_mm_cvtepi8_epi16(a.v),
+                                       _mm_cvtepi8_epi16(b.v)));
+}
+
+static FORCEINLINE __vec8_i8 __or(__vec8_i8 a, __vec8_i8 b) {
+    return _mm_or_si128(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i8 __and(__vec8_i8 a, __vec8_i8 b) {
+    return _mm_and_si128(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i8 __xor(__vec8_i8 a, __vec8_i8 b) {
+    return _mm_xor_si128(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i8 __shl(__vec8_i8 a, __vec8_i8 b) {
+    return lTrunc32To8(_mm256_sllv_epi32(_mm256_cvtepu8_epi32(a.v),
+                                         _mm256_cvtepu8_epi32(b.v)));
+}
+
+static FORCEINLINE __vec8_i8 __shl(__vec8_i8 a, int32_t b) {
+    return lTrunc16To8(_mm_sll_epi16(_mm_cvtepu8_epi16(a.v), _mm_cvtsi32_si128(b)));
+}
+
+static FORCEINLINE __vec8_i8 __lshr(__vec8_i8 a, __vec8_i8 b) {
+    return lTrunc32To8(_mm256_srlv_epi32(_mm256_cvtepu8_epi32(a.v),
+                                         _mm256_cvtepu8_epi32(b.v)));
+}
+
+static FORCEINLINE __vec8_i8 __lshr(__vec8_i8 a, int32_t b) {
+    return lTrunc16To8(_mm_srl_epi16(_mm_cvtepu8_epi16(a.v), _mm_cvtsi32_si128(b)));
+}
+
+static FORCEINLINE __vec8_i8 __ashr(__vec8_i8 a, __vec8_i8 b) {
+    return lTrunc32To8(_mm256_srav_epi32(_mm256_cvtepi8_epi32(a.v),
+                                         _mm256_cvtepu8_epi32(b.v)));
+}
+
+static FORCEINLINE __vec8_i8 __ashr(__vec8_i8 a, int32_t b) {
+    return lTrunc16To8(_mm_sra_epi16(_mm_cvtepi8_epi16(a.v), _mm_cvtsi32_si128(b)));
+}
+
+// There's no integer division instruction; small integers can be divided
+// exactly with single-precision floating point instead.
+static FORCEINLINE __vec8_i8 __udiv(__vec8_i8 a, __vec8_i8 b) {
+    __m256 fa = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(a.v));
+    __m256 fb = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b.v));
+    return lTrunc32To8(_mm256_cvttps_epi32(_mm256_div_ps(fa, fb)));
+}
+
+static FORCEINLINE __vec8_i8 __sdiv(__vec8_i8 a, __vec8_i8 b) {
+    __m256 fa = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(a.v));
+    __m256 fb = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b.v));
+    return lTrunc32To8(_mm256_cvttps_epi32(_mm256_div_ps(fa, fb)));
+}
+
+static FORCEINLINE __vec8_i8 __urem(__vec8_i8 a, __vec8_i8 b) {
+    return __sub(a, __mul(__udiv(a, b), b));
+}
+
+static FORCEINLINE __vec8_i8 __srem(__vec8_i8 a, __vec8_i8 b) {
+    return __sub(a, __mul(__sdiv(a, b), b));
+}
+
+static FORCEINLINE __vec8_i1 __equal_i8(__vec8_i8 a, __vec8_i8 b) {
+    return lMaskFrom8(_mm_cmpeq_epi8(a.v, b.v));
+}
+
+static FORCEINLINE __vec8_i1 __not_equal_i8(__vec8_i8 a, __vec8_i8 b) {
+    return __not(__equal_i8(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_greater_equal_i8(__vec8_i8 a, __vec8_i8 b) {
+    return lMaskFrom8(_mm_cmpeq_epi8(_mm_max_epu8(a.v, b.v), a.v));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_less_equal_i8(__vec8_i8 a, __vec8_i8 b) {
+    return __unsigned_greater_equal_i8(b, a);
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_less_than_i8(__vec8_i8 a, __vec8_i8 b) {
+    return __not(__unsigned_greater_equal_i8(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_greater_than_i8(__vec8_i8 a, __vec8_i8 b) {
+    return __not(__unsigned_greater_equal_i8(b, a));
+}
+
+static FORCEINLINE __vec8_i1 __signed_greater_than_i8(__vec8_i8 a, __vec8_i8 b) {
+    return lMaskFrom8(_mm_cmpgt_epi8(a.v, b.v));
+}
+
+static FORCEINLINE __vec8_i1 __signed_less_than_i8(__vec8_i8 a, __vec8_i8 b) {
+    return __signed_greater_than_i8(b, a);
+}
+
+static FORCEINLINE __vec8_i1 __signed_less_equal_i8(__vec8_i8 a, __vec8_i8 b) {
+    return __not(__signed_greater_than_i8(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __signed_greater_equal_i8(__vec8_i8 a, __vec8_i8 b) {
+    return __not(__signed_greater_than_i8(b, a));
+}
+
+CMP_AND_MASK_INT(__vec8_i8, i8)
+
+static FORCEINLINE __vec8_i8 __select(__vec8_i1 mask, __vec8_i8 a, __vec8_i8 b) {
+    return _mm_blendv_epi8(b.v, a.v, lMask8(mask.v));
+}
+
+template <class RetVecType> __vec8_i8 __smear_i8(int8_t v);
+template <> FORCEINLINE __vec8_i8 __smear_i8<__vec8_i8>(int8_t v) {
+    return _mm_set1_epi8(v);
+}
+
+template <class RetVecType> __vec8_i8 __setzero_i8();
+template <> FORCEINLINE __vec8_i8 __setzero_i8<__vec8_i8>() {
+    return _mm_setzero_si128();
+}
+
+template <class RetVecType> __vec8_i8 __undef_i8();
+template <> FORCEINLINE __vec8_i8 __undef_i8<__vec8_i8>() {
+    return __vec8_i8();
+}
+
+static FORCEINLINE __vec8_i8 __broadcast_i8(__vec8_i8 v, int index) {
+    return _mm_set1_epi8(__extract_element(v, index & 7));
+}
+
+static FORCEINLINE __vec8_i8 __rotate_i8(__vec8_i8 v, int delta) {
+    __m128i idx = _mm_and_si128(_mm_add_epi8(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                                           0, 0, 0, 0, 0, 0, 0, 0),
+                                             _mm_set1_epi8((int8_t)(delta & 7))),
+                                _mm_set1_epi8(7));
+    return _mm_shuffle_epi8(v.v, idx);
+}
+
+static FORCEINLINE __vec8_i8 __shift_i8(__vec8_i8 v, int delta) {
+    int8_t r[16];
+    for (int i = 0; i < 8; ++i) {
+        int s = i + delta;
+        r[i] = (s >= 0 && s < 8) ? __extract_element(v, s) : 0;
+    }
+    return __vec8_i8(r);
+}
+
+static FORCEINLINE __vec8_i8 __shuffle_i8(__vec8_i8 v, __vec8_i32 index) {
+    __m128i idx = lTrunc32To8(_mm256_and_si256(index.v, _mm256_set1_epi32(7)));
+    return _mm_shuffle_epi8(v.v, idx);
+}
+
+static FORCEINLINE __vec8_i8 __shuffle2_i8(__vec8_i8 v0, __vec8_i8 v1,
+                                           __vec8_i32 index) {
+    __m128i idx = lTrunc32To8(_mm256_and_si256(index.v, _mm256_set1_epi32(15)));
+    return _mm_shuffle_epi8(_mm_unpacklo_epi64(v0.v, v1.v), idx);
+}
+
+template <int ALIGN> static FORCEINLINE __vec8_i8 __load(const __vec8_i8 *v) {
+    return _mm_loadl_epi64((const __m128i *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec8_i8 *p, __vec8_i8 value) {
+    _mm_storel_epi64((__m128i *)p, value.v);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// int16
+
+static FORCEINLINE __vec8_i1 lMaskFrom16(__m128i m) {
+    return _mm256_cvtepi16_epi32(m);
+}
+
+static FORCEINLINE __vec8_i16 __add(__vec8_i16 a, __vec8_i16 b) {
+    return _mm_add_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i16 __sub(__vec8_i16 a, __vec8_i16 b) {
+    return _mm_sub_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i16 __mul(__vec8_i16 a, __vec8_i16 b) {
+    return _mm_mullo_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i16 __or(__vec8_i16 a, __vec8_i16 b) {
+    return _mm_or_si128(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i16 __and(__vec8_i16 a, __vec8_i16 b) {
+    return _mm_and_si128(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i16 __xor(__vec8_i16 a, __vec8_i16 b) {
+    return _mm_xor_si128(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i16 __shl(__vec8_i16 a, __vec8_i16 b) {
+    return lTrunc32To16(_mm256_sllv_epi32(_mm256_cvtepu16_epi32(a.v),
+                                          _mm256_cvtepu16_epi32(b.v)));
+}
+
+static FORCEINLINE __vec8_i16 __shl(__vec8_i16 a, int32_t b) {
+    return _mm_sll_epi16(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec8_i16 __lshr(__vec8_i16 a, __vec8_i16 b) {
+    return lTrunc32To16(_mm256_srlv_epi32(_mm256_cvtepu16_epi32(a.v),
+                                          _mm256_cvtepu16_epi32(b.v)));
+}
+
+static FORCEINLINE __vec8_i16 __lshr(__vec8_i16 a, int32_t b) {
+    return _mm_srl_epi16(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec8_i16 __ashr(__vec8_i16 a, __vec8_i16 b) {
+    return lTrunc32To16(_mm256_srav_epi32(_mm256_cvtepi16_epi32(a.v),
+                                          _mm256_cvtepu16_epi32(b.v)));
+}
+
+static FORCEINLINE __vec8_i16 __ashr(__vec8_i16 a, int32_t b) {
+    return _mm_sra_epi16(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec8_i16 __udiv(__vec8_i16 a, __vec8_i16 b) {
+    __m256 fa = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(a.v));
+    __m256 fb = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(b.v));
+    return lTrunc32To16(_mm256_cvttps_epi32(_mm256_div_ps(fa, fb)));
+}
+
+static FORCEINLINE __vec8_i16 __sdiv(__vec8_i16 a, __vec8_i16 b) {
+    __m256 fa = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a.v));
+    __m256 fb = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b.v));
+    return lTrunc32To16(_mm256_cvttps_epi32(_mm256_div_ps(fa, fb)));
+}
+
+static FORCEINLINE __vec8_i16 __urem(__vec8_i16 a, __vec8_i16 b) {
+    return __sub(a, __mul(__udiv(a, b), b));
+}
+
+static FORCEINLINE __vec8_i16 __srem(__vec8_i16 a, __vec8_i16 b) {
+    return __sub(a, __mul(__sdiv(a, b), b));
+}
+
+static FORCEINLINE __vec8_i1 __equal_i16(__vec8_i16 a, __vec8_i16 b) {
+    return lMaskFrom16(_mm_cmpeq_epi16(a.v, b.v));
+}
+
+static FORCEINLINE __vec8_i1 __not_equal_i16(__vec8_i16 a, __vec8_i16 b) {
+    return __not(__equal_i16(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_greater_equal_i16(__vec8_i16 a, __vec8_i16 b) {
+    return lMaskFrom16(_mm_cmpeq_epi16(_mm_max_epu16(a.v, b.v), a.v));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_less_equal_i16(__vec8_i16 a, __vec8_i16 b) {
+    return __unsigned_greater_equal_i16(b, a);
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_less_than_i16(__vec8_i16 a, __vec8_i16 b) {
+    return __not(__unsigned_greater_equal_i16(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_greater_than_i16(__vec8_i16 a, __vec8_i16 b) {
+    return __not(__unsigned_greater_equal_i16(b, a));
+}
+
+static FORCEINLINE __vec8_i1 __signed_greater_than_i16(__vec8_i16 a, __vec8_i16 b) {
+    return lMaskFrom16(_mm_cmpgt_epi16(a.v, b.v));
+}
+
+static FORCEINLINE __vec8_i1 __signed_less_than_i16(__vec8_i16 a, __vec8_i16 b) {
+    return __signed_greater_than_i16(b, a);
+}
+
+static FORCEINLINE __vec8_i1 __signed_less_equal_i16(__vec8_i16 a, __vec8_i16 b) {
+    return __not(__signed_greater_than_i16(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __signed_greater_equal_i16(__vec8_i16 a, __vec8_i16 b) {
+    return __not(__signed_greater_than_i16(b, a));
+}
+
+CMP_AND_MASK_INT(__vec8_i16, i16)
+
+static FORCEINLINE __vec8_i16 __select(__vec8_i1 mask, __vec8_i16 a, __vec8_i16 b) {
+    return _mm_blendv_epi8(b.v, a.v, lMask16(mask.v));
+}
+
+template <class RetVecType> __vec8_i16 __smear_i16(int16_t v);
+template <> FORCEINLINE __vec8_i16 __smear_i16<__vec8_i16>(int16_t v) {
+    return _mm_set1_epi16(v);
+}
+
+template <class RetVecType> __vec8_i16 __setzero_i16();
+template <> FORCEINLINE __vec8_i16 __setzero_i16<__vec8_i16>() {
+    return _mm_setzero_si128();
+}
+
+template <class RetVecType> __vec8_i16 __undef_i16();
+template <> FORCEINLINE __vec8_i16 __undef_i16<__vec8_i16>() {
+    return __vec8_i16();
+}
+
+static FORCEINLINE __vec8_i16 __broadcast_i16(__vec8_i16 v, int index) {
+    return _mm_set1_epi16(__extract_element(v, index & 7));
+}
+
+// Turn per-element 16-bit indices into a pshufb control that moves both
+// bytes of each element.
+static FORCEINLINE __m128i lShuffleControl16(__m128i idx16) {
+    idx16 = _mm_and_si128(idx16, _mm_set1_epi16(7));
+    return _mm_add_epi16(_mm_mullo_epi16(idx16, _mm_set1_epi16(0x0202)),
+                         _mm_set1_epi16(0x0100));
+}
+
+static FORCEINLINE __vec8_i16 __rotate_i16(__vec8_i16 v, int delta) {
+    __m128i idx = _mm_add_epi16(_mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7),
+                                _mm_set1_epi16((int16_t)(delta & 7)));
+    return _mm_shuffle_epi8(v.v, lShuffleControl16(idx));
+}
+
+static FORCEINLINE __vec8_i16 __shift_i16(__vec8_i16 v, int delta) {
+    int16_t r[8];
+    for (int i = 0; i < 8; ++i) {
+        int s = i + delta;
+        r[i] = (s >= 0 && s < 8) ? __extract_element(v, s) : 0;
+    }
+    return __vec8_i16(r);
+}
+
+static FORCEINLINE __vec8_i16 __shuffle_i16(__vec8_i16 v, __vec8_i32 index) {
+    return _mm_shuffle_epi8(v.v, lShuffleControl16(lTrunc32To16(index.v)));
+}
+
+static FORCEINLINE __vec8_i16 __shuffle2_i16(__vec8_i16 v0, __vec8_i16 v1,
+                                             __vec8_i32 index) {
+    __m128i idx = lTrunc32To16(index.v);
+    __m128i ctrl = lShuffleControl16(idx);
+    __m128i r0 = _mm_shuffle_epi8(v0.v, ctrl);
+    __m128i r1 = _mm_shuffle_epi8(v1.v, ctrl);
+    __m128i useSecond = _mm_cmpeq_epi16(_mm_and_si128(idx, _mm_set1_epi16(8)),
+                                        _mm_set1_epi16(8));
+    return _mm_blendv_epi8(r0, r1, useSecond);
+}
+
+template <int ALIGN> static FORCEINLINE __vec8_i16 __load(const __vec8_i16 *v) {
+    return _mm_loadu_si128((const __m128i *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec8_i16 *p, __vec8_i16 value) {
+    _mm_storeu_si128((__m128i *)p, value.v);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// int32
+
+static FORCEINLINE __vec8_i32 __add(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_add_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __sub(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_sub_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __mul(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_mullo_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __or(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_or_si256(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __and(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_and_si256(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __xor(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_xor_si256(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __shl(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_sllv_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __shl(__vec8_i32 a, int32_t b) {
+    return _mm256_sll_epi32(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec8_i32 __lshr(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_srlv_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __lshr(__vec8_i32 a, int32_t b) {
+    return _mm256_srl_epi32(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec8_i32 __ashr(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_srav_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __ashr(__vec8_i32 a, int32_t b) {
+    return _mm256_sra_epi32(a.v, _mm_cvtsi32_si128(b));
+}
+
+// 32-bit integers are exactly representable as doubles and the quotient
+// of two of them is never close enough to an integer for the rounding of
+// the double-precision division to change its truncated value.
+static FORCEINLINE __m256d lU32ToDouble(__m128i v) {
+    __m256d d = _mm256_cvtepi32_pd(_mm_xor_si128(v, _mm_set1_epi32(0x80000000)));
+    return _mm256_add_pd(d, _mm256_set1_pd(2147483648.));
+}
+
+static FORCEINLINE __m128i lTruncDoubleToU32(__m256d d) {
+    d = _mm256_round_pd(d, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m128i r = _mm256_cvttpd_epi32(_mm256_sub_pd(d, _mm256_set1_pd(2147483648.)));
+    return _mm_xor_si128(r, _mm_set1_epi32(0x80000000));
+}
+
+static FORCEINLINE __vec8_i32 __udiv(__vec8_i32 a, __vec8_i32 b) {
+    __m128i alo = _mm256_castsi256_si128(a.v), ahi = _mm256_extracti128_si256(a.v, 1);
+    __m128i blo = _mm256_castsi256_si128(b.v), bhi = _mm256_extracti128_si256(b.v, 1);
+    __m128i qlo = lTruncDoubleToU32(_mm256_div_pd(lU32ToDouble(alo), lU32ToDouble(blo)));
+    __m128i qhi = lTruncDoubleToU32(_mm256_div_pd(lU32ToDouble(ahi), lU32ToDouble(bhi)));
+    return lCombine128(qlo, qhi);
+}
+
+static FORCEINLINE __vec8_i32 __sdiv(__vec8_i32 a, __vec8_i32 b) {
+    __m128i alo = _mm256_castsi256_si128(a.v), ahi = _mm256_extracti128_si256(a.v, 1);
+    __m128i blo = _mm256_castsi256_si128(b.v), bhi = _mm256_extracti128_si256(b.v, 1);
+    __m128i qlo = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(alo),
+                                                    _mm256_cvtepi32_pd(blo)));
+    __m128i qhi = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(ahi),
+                                                    _mm256_cvtepi32_pd(bhi)));
+    return lCombine128(qlo, qhi);
+}
+
+static FORCEINLINE __vec8_i32 __urem(__vec8_i32 a, __vec8_i32 b) {
+    return __sub(a, __mul(__udiv(a, b), b));
+}
+
+static FORCEINLINE __vec8_i32 __srem(__vec8_i32 a, __vec8_i32 b) {
+    return __sub(a, __mul(__sdiv(a, b), b));
+}
+
+static FORCEINLINE __vec8_i1 __equal_i32(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_cmpeq_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i1 __not_equal_i32(__vec8_i32 a, __vec8_i32 b) {
+    return __not(__equal_i32(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_greater_equal_i32(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_cmpeq_epi32(_mm256_max_epu32(a.v, b.v), a.v);
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_less_equal_i32(__vec8_i32 a, __vec8_i32 b) {
+    return __unsigned_greater_equal_i32(b, a);
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_less_than_i32(__vec8_i32 a, __vec8_i32 b) {
+    return __not(__unsigned_greater_equal_i32(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_greater_than_i32(__vec8_i32 a, __vec8_i32 b) {
+    return __not(__unsigned_greater_equal_i32(b, a));
+}
+
+static FORCEINLINE __vec8_i1 __signed_greater_than_i32(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_cmpgt_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i1 __signed_less_than_i32(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_cmpgt_epi32(b.v, a.v);
+}
+
+static FORCEINLINE __vec8_i1 __signed_less_equal_i32(__vec8_i32 a, __vec8_i32 b) {
+    return __not(__signed_greater_than_i32(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __signed_greater_equal_i32(__vec8_i32 a, __vec8_i32 b) {
+    return __not(__signed_less_than_i32(a, b));
+}
+
+CMP_AND_MASK_INT(__vec8_i32, i32)
+
+static FORCEINLINE __vec8_i32 __select(__vec8_i1 mask, __vec8_i32 a, __vec8_i32 b) {
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v),
+                                                _mm256_castsi256_ps(a.v), mask.v));
+}
+
+template <class RetVecType> __vec8_i32 __smear_i32(int32_t v);
+template <> FORCEINLINE __vec8_i32 __smear_i32<__vec8_i32>(int32_t v) {
+    return _mm256_set1_epi32(v);
+}
+
+template <class RetVecType> __vec8_i32 __setzero_i32();
+template <> FORCEINLINE __vec8_i32 __setzero_i32<__vec8_i32>() {
+    return _mm256_setzero_si256();
+}
+
+template <class RetVecType> __vec8_i32 __undef_i32();
+template <> FORCEINLINE __vec8_i32 __undef_i32<__vec8_i32>() {
+    return __vec8_i32();
+}
+
+static FORCEINLINE __vec8_i32 __broadcast_i32(__vec8_i32 v, int index) {
+    return _mm256_permutevar8x32_epi32(v.v, _mm256_set1_epi32(index & 7));
+}
+
+static FORCEINLINE __vec8_i32 __rotate_i32(__vec8_i32 v, int delta) {
+    __m256i idx = _mm256_add_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                   _mm256_set1_epi32(delta & 7));
+    return _mm256_permutevar8x32_epi32(v.v, idx);
+}
+
+// Mask of the lanes i for which i + delta is a valid lane index.
+static FORCEINLINE __m256i lShiftMask(__m256i idx) {
+    return _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), idx),
+                               _mm256_cmpgt_epi32(_mm256_set1_epi32(8), idx));
+}
+
+static FORCEINLINE __vec8_i32 __shift_i32(__vec8_i32 v, int delta) {
+    __m256i idx = _mm256_add_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                   _mm256_set1_epi32(delta));
+    return _mm256_and_si256(_mm256_permutevar8x32_epi32(v.v, idx), lShiftMask(idx));
+}
+
+static FORCEINLINE __vec8_i32 __shuffle_i32(__vec8_i32 v, __vec8_i32 index) {
+    return _mm256_permutevar8x32_epi32(v.v, index.v);
+}
+
+static FORCEINLINE __vec8_i32 __shuffle2_i32(__vec8_i32 v0, __vec8_i32 v1,
+                                             __vec8_i32 index) {
+    __m256 r0 = _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(v0.v, index.v));
+    __m256 r1 = _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(v1.v, index.v));
+    // Move bit 3 of the index, which selects the second vector, up to
+    // the sign bit for the blend.
+    __m256 sel = _mm256_castsi256_ps(_mm256_slli_epi32(index.v, 28));
+    return _mm256_castps_si256(_mm256_blendv_ps(r0, r1, sel));
+}
+
+template <int ALIGN> static FORCEINLINE __vec8_i32 __load(const __vec8_i32 *v) {
+    return _mm256_loadu_si256((const __m256i *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec8_i32 *p, __vec8_i32 value) {
+    _mm256_storeu_si256((__m256i *)p, value.v);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// int64
+
+static FORCEINLINE __vec8_i64 __add(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(_mm256_add_epi64(a.v[0], b.v[0]), _mm256_add_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __sub(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(_mm256_sub_epi64(a.v[0], b.v[0]), _mm256_sub_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __mul(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(lMul64(a.v[0], b.v[0]), lMul64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __or(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(_mm256_or_si256(a.v[0], b.v[0]), _mm256_or_si256(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __and(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(_mm256_and_si256(a.v[0], b.v[0]), _mm256_and_si256(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __xor(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(_mm256_xor_si256(a.v[0], b.v[0]), _mm256_xor_si256(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __shl(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(_mm256_sllv_epi64(a.v[0], b.v[0]), _mm256_sllv_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __shl(__vec8_i64 a, int32_t b) {
+    __m128i count = _mm_cvtsi32_si128(b);
+    return __vec8_i64(_mm256_sll_epi64(a.v[0], count), _mm256_sll_epi64(a.v[1], count));
+}
+
+static FORCEINLINE __vec8_i64 __lshr(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(_mm256_srlv_epi64(a.v[0], b.v[0]), _mm256_srlv_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __lshr(__vec8_i64 a, int32_t b) {
+    __m128i count = _mm_cvtsi32_si128(b);
+    return __vec8_i64(_mm256_srl_epi64(a.v[0], count), _mm256_srl_epi64(a.v[1], count));
+}
+
+// There's no 64-bit arithmetic shift; flip negative values so that a
+// logical shift shifts in the right bits, then flip them back.
+static FORCEINLINE __m256i lSra64(__m256i a, __m256i b) {
+    __m256i sign = _mm256_cmpgt_epi64(_mm256_setzero_si256(), a);
+    return _mm256_xor_si256(_mm256_srlv_epi64(_mm256_xor_si256(a, sign), b), sign);
+}
+
+static FORCEINLINE __vec8_i64 __ashr(__vec8_i64 a, __vec8_i64 b) {
+    return __vec8_i64(lSra64(a.v[0], b.v[0]), lSra64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i64 __ashr(__vec8_i64 a, int32_t b) {
+    __m256i count = _mm256_set1_epi64x(b);
+    return __vec8_i64(lSra64(a.v[0], count), lSra64(a.v[1], count));
+}
+
+#define INT64_BINARY_OP_SCALAR(NAME, TYPE, OP)                         \
+static FORCEINLINE __vec8_i64 NAME(__vec8_i64 a, __vec8_i64 b) {      \
+    int64_t r[8];                                                     \
+    for (int i = 0; i < 8; ++i)                                       \
+        r[i] = (int64_t)((TYPE)__extract_element(a, i) OP             \
+                         (TYPE)__extract_element(b, i));              \
+    return __vec8_i64(r);                                             \
+}
+
+INT64_BINARY_OP_SCALAR(__udiv, uint64_t, /)
+INT64_BINARY_OP_SCALAR(__sdiv, int64_t, /)
+INT64_BINARY_OP_SCALAR(__urem, uint64_t, %)
+INT64_BINARY_OP_SCALAR(__srem, int64_t, %)
+
+static FORCEINLINE __vec8_i1 __equal_i64(__vec8_i64 a, __vec8_i64 b) {
+    return lPack64To32(_mm256_cmpeq_epi64(a.v[0], b.v[0]),
+                       _mm256_cmpeq_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i1 __not_equal_i64(__vec8_i64 a, __vec8_i64 b) {
+    return __not(__equal_i64(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __signed_greater_than_i64(__vec8_i64 a, __vec8_i64 b) {
+    return lPack64To32(_mm256_cmpgt_epi64(a.v[0], b.v[0]),
+                       _mm256_cmpgt_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i1 __signed_less_than_i64(__vec8_i64 a, __vec8_i64 b) {
+    return __signed_greater_than_i64(b, a);
+}
+
+static FORCEINLINE __vec8_i1 __signed_less_equal_i64(__vec8_i64 a, __vec8_i64 b) {
+    return __not(__signed_greater_than_i64(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __signed_greater_equal_i64(__vec8_i64 a, __vec8_i64 b) {
+    return __not(__signed_greater_than_i64(b, a));
+}
+
+// Unsigned comparisons are signed ones with the sign bits flipped.
+static FORCEINLINE __vec8_i1 __unsigned_greater_than_i64(__vec8_i64 a, __vec8_i64 b) {
+    __m256i bias = _mm256_set1_epi64x((int64_t)0x8000000000000000ULL);
+    return lPack64To32(_mm256_cmpgt_epi64(_mm256_xor_si256(a.v[0], bias),
+                                          _mm256_xor_si256(b.v[0], bias)),
+                       _mm256_cmpgt_epi64(_mm256_xor_si256(a.v[1], bias),
+                                          _mm256_xor_si256(b.v[1], bias)));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_less_than_i64(__vec8_i64 a, __vec8_i64 b) {
+    return __unsigned_greater_than_i64(b, a);
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_less_equal_i64(__vec8_i64 a, __vec8_i64 b) {
+    return __not(__unsigned_greater_than_i64(a, b));
+}
+
+static FORCEINLINE __vec8_i1 __unsigned_greater_equal_i64(__vec8_i64 a, __vec8_i64 b) {
+    return __not(__unsigned_greater_than_i64(b, a));
+}
+
+CMP_AND_MASK_INT(__vec8_i64, i64)
+
+static FORCEINLINE __vec8_i64 __select(__vec8_i1 mask, __vec8_i64 a, __vec8_i64 b) {
+    __m256d m0 = _mm256_castsi256_pd(lMaskLo64(mask.v));
+    __m256d m1 = _mm256_castsi256_pd(lMaskHi64(mask.v));
+    return __vec8_i64(_mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(b.v[0]),
+                                                           _mm256_castsi256_pd(a.v[0]), m0)),
+                      _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(b.v[1]),
+                                                           _mm256_castsi256_pd(a.v[1]), m1)));
+}
+
+template <class RetVecType> __vec8_i64 __smear_i64(int64_t v);
+template <> FORCEINLINE __vec8_i64 __smear_i64<__vec8_i64>(int64_t v) {
+    __m256i s = _mm256_set1_epi64x(v);
+    return __vec8_i64(s, s);
+}
+
+template <class RetVecType> __vec8_i64 __setzero_i64();
+template <> FORCEINLINE __vec8_i64 __setzero_i64<__vec8_i64>() {
+    return __vec8_i64(_mm256_setzero_si256(), _mm256_setzero_si256());
+}
+
+template <class RetVecType> __vec8_i64 __undef_i64();
+template <> FORCEINLINE __vec8_i64 __undef_i64<__vec8_i64>() {
+    return __vec8_i64();
+}
+
+static FORCEINLINE __vec8_i64 __broadcast_i64(__vec8_i64 v, int index) {
+    return __smear_i64<__vec8_i64>(__extract_element(v, index & 7));
+}
+
+static FORCEINLINE __vec8_i64 __rotate_i64(__vec8_i64 v, int delta) {
+    int64_t r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = __extract_element(v, (i + delta) & 7);
+    return __vec8_i64(r);
+}
+
+static FORCEINLINE __vec8_i64 __shift_i64(__vec8_i64 v, int delta) {
+    int64_t r[8];
+    for (int i = 0; i < 8; ++i) {
+        int s = i + delta;
+        r[i] = (s >= 0 && s < 8) ? __extract_element(v, s) : 0;
+    }
+    return __vec8_i64(r);
+}
+
+static FORCEINLINE __vec8_i64 __shuffle_i64(__vec8_i64 v, __vec8_i32 index) {
+    int64_t r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = __extract_element(v, __extract_element(index, i) & 7);
+    return __vec8_i64(r);
+}
+
+static FORCEINLINE __vec8_i64 __shuffle2_i64(__vec8_i64 v0, __vec8_i64 v1,
+                                             __vec8_i32 index) {
+    int64_t r[8];
+    for (int i = 0; i < 8; ++i) {
+        int ii = __extract_element(index, i) & 15;
+        r[i] = (ii < 8) ? __extract_element(v0, ii) : __extract_element(v1, ii - 8);
+    }
+    return __vec8_i64(r);
+}
+
+template <int ALIGN> static FORCEINLINE __vec8_i64 __load(const __vec8_i64 *v) {
+    return __vec8_i64((const int64_t *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec8_i64 *p, __vec8_i64 value) {
+    _mm256_storeu_si256((__m256i *)p, value.v[0]);
+    _mm256_storeu_si256((__m256i *)p + 1, value.v[1]);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// float
+
+static FORCEINLINE __vec8_f __add(__vec8_f a, __vec8_f b) {
+    return _mm256_add_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_f __sub(__vec8_f a, __vec8_f b) {
+    return _mm256_sub_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_f __mul(__vec8_f a, __vec8_f b) {
+    return _mm256_mul_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_f __div(__vec8_f a, __vec8_f b) {
+    return _mm256_div_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i1 __equal_float(__vec8_f a, __vec8_f b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ);
+}
+
+static FORCEINLINE __vec8_i1 __not_equal_float(__vec8_f a, __vec8_f b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ);
+}
+
+static FORCEINLINE __vec8_i1 __less_than_float(__vec8_f a, __vec8_f b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);
+}
+
+static FORCEINLINE __vec8_i1 __less_equal_float(__vec8_f a, __vec8_f b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ);
+}
+
+static FORCEINLINE __vec8_i1 __greater_than_float(__vec8_f a, __vec8_f b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ);
+}
+
+static FORCEINLINE __vec8_i1 __greater_equal_float(__vec8_f a, __vec8_f b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ);
+}
+
+static FORCEINLINE __vec8_i1 __ordered_float(__vec8_f a, __vec8_f b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_ORD_Q);
+}
+
+static FORCEINLINE __vec8_i1 __unordered_float(__vec8_f a, __vec8_f b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_UNORD_Q);
+}
+
+CMP_AND_MASK_FLOAT(__vec8_f, float)
+
+static FORCEINLINE __vec8_f __select(__vec8_i1 mask, __vec8_f a, __vec8_f b) {
+    return _mm256_blendv_ps(b.v, a.v, mask.v);
+}
+
+template <class RetVecType> __vec8_f __smear_float(float v);
+template <> FORCEINLINE __vec8_f __smear_float<__vec8_f>(float v) {
+    return _mm256_set1_ps(v);
+}
+
+template <class RetVecType> __vec8_f __setzero_float();
+template <> FORCEINLINE __vec8_f __setzero_float<__vec8_f>() {
+    return _mm256_setzero_ps();
+}
+
+template <class RetVecType> __vec8_f __undef_float();
+template <> FORCEINLINE __vec8_f __undef_float<__vec8_f>() {
+    return __vec8_f();
+}
+
+static FORCEINLINE __vec8_f __broadcast_float(__vec8_f v, int index) {
+    return _mm256_permutevar8x32_ps(v.v, _mm256_set1_epi32(index & 7));
+}
+
+static FORCEINLINE __vec8_f __rotate_float(__vec8_f v, int delta) {
+    return __cast_bits(__vec8_f(), __rotate_i32(__cast_bits(__vec8_i32(), v), delta));
+}
+
+static FORCEINLINE __vec8_f __shift_float(__vec8_f v, int delta) {
+    return __cast_bits(__vec8_f(), __shift_i32(__cast_bits(__vec8_i32(), v), delta));
+}
+
+static FORCEINLINE __vec8_f __shuffle_float(__vec8_f v, __vec8_i32 index) {
+    return _mm256_permutevar8x32_ps(v.v, index.v);
+}
+
+static FORCEINLINE __vec8_f __shuffle2_float(__vec8_f v0, __vec8_f v1,
+                                             __vec8_i32 index) {
+    return __cast_bits(__vec8_f(), __shuffle2_i32(__cast_bits(__vec8_i32(), v0),
+                                                  __cast_bits(__vec8_i32(), v1), index));
+}
+
+template <int ALIGN> static FORCEINLINE __vec8_f __load(const __vec8_f *v) {
+    return _mm256_loadu_ps((const float *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec8_f *p, __vec8_f value) {
+    _mm256_storeu_ps((float *)p, value.v);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// double
+
+static FORCEINLINE __vec8_d __add(__vec8_d a, __vec8_d b) {
+    return __vec8_d(_mm256_add_pd(a.v[0], b.v[0]), _mm256_add_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_d __sub(__vec8_d a, __vec8_d b) {
+    return __vec8_d(_mm256_sub_pd(a.v[0], b.v[0]), _mm256_sub_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_d __mul(__vec8_d a, __vec8_d b) {
+    return __vec8_d(_mm256_mul_pd(a.v[0], b.v[0]), _mm256_mul_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_d __div(__vec8_d a, __vec8_d b) {
+    return __vec8_d(_mm256_div_pd(a.v[0], b.v[0]), _mm256_div_pd(a.v[1], b.v[1]));
+}
+
+#define DOUBLE_CMP(NAME, PRED)                                          \
+static FORCEINLINE __vec8_i1 NAME(__vec8_d a, __vec8_d b) {             \
+    __m256d c0 = _mm256_cmp_pd(a.v[0], b.v[0], PRED);                   \
+    __m256d c1 = _mm256_cmp_pd(a.v[1], b.v[1], PRED);                   \
+    return lPack64To32(_mm256_castpd_si256(c0), _mm256_castpd_si256(c1)); \
+}
+
+DOUBLE_CMP(__equal_double, _CMP_EQ_OQ)
+DOUBLE_CMP(__not_equal_double, _CMP_NEQ_UQ)
+DOUBLE_CMP(__less_than_double, _CMP_LT_OQ)
+DOUBLE_CMP(__less_equal_double, _CMP_LE_OQ)
+DOUBLE_CMP(__greater_than_double, _CMP_GT_OQ)
+DOUBLE_CMP(__greater_equal_double, _CMP_GE_OQ)
+DOUBLE_CMP(__ordered_double, _CMP_ORD_Q)
+DOUBLE_CMP(__unordered_double, _CMP_UNORD_Q)
+
+CMP_AND_MASK_FLOAT(__vec8_d, double)
+
+static FORCEINLINE __vec8_d __select(__vec8_i1 mask, __vec8_d a, __vec8_d b) {
+    __m256d m0 = _mm256_castsi256_pd(lMaskLo64(mask.v));
+    __m256d m1 = _mm256_castsi256_pd(lMaskHi64(mask.v));
+    return __vec8_d(_mm256_blendv_pd(b.v[0], a.v[0], m0),
+                    _mm256_blendv_pd(b.v[1], a.v[1], m1));
+}
+
+template <class RetVecType> __vec8_d __smear_double(double v);
+template <> FORCEINLINE __vec8_d __smear_double<__vec8_d>(double v) {
+    __m256d s = _mm256_set1_pd(v);
+    return __vec8_d(s, s);
+}
+
+template <class RetVecType> __vec8_d __setzero_double();
+template <> FORCEINLINE __vec8_d __setzero_double<__vec8_d>() {
+    return __vec8_d(_mm256_setzero_pd(), _mm256_setzero_pd());
+}
+
+template <class RetVecType> __vec8_d __undef_double();
+template <> FORCEINLINE __vec8_d __undef_double<__vec8_d>() {
+    return __vec8_d();
+}
+
+static FORCEINLINE __vec8_d __broadcast_double(__vec8_d v, int index) {
+    return __smear_double<__vec8_d>(__extract_element(v, index & 7));
+}
+
+static FORCEINLINE __vec8_d __rotate_double(__vec8_d v, int delta) {
+    return __cast_bits(__vec8_d(), __rotate_i64(__cast_bits(__vec8_i64(), v), delta));
+}
+
+static FORCEINLINE __vec8_d __shift_double(__vec8_d v, int delta) {
+    return __cast_bits(__vec8_d(), __shift_i64(__cast_bits(__vec8_i64(), v), delta));
+}
+
+static FORCEINLINE __vec8_d __shuffle_double(__vec8_d v, __vec8_i32 index) {
+    return __cast_bits(__vec8_d(), __shuffle_i64(__cast_bits(__vec8_i64(), v), index));
+}
+
+static FORCEINLINE __vec8_d __shuffle2_double(__vec8_d v0, __vec8_d v1,
+                                              __vec8_i32 index) {
+    return __cast_bits(__vec8_d(), __shuffle2_i64(__cast_bits(__vec8_i64(), v0),
+                                                  __cast_bits(__vec8_i64(), v1), index));
+}
+
+template <int ALIGN> static FORCEINLINE __vec8_d __load(const __vec8_d *v) {
+    return __vec8_d((const double *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec8_d *p, __vec8_d value) {
+    _mm256_storeu_pd((double *)p, value.v[0]);
+    _mm256_storeu_pd((double *)p + 4, value.v[1]);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// casts
+
+// sign extension conversions
+
+static FORCEINLINE __vec8_i64 __cast_sext(__vec8_i64, __vec8_i32 val) {
+    return __vec8_i64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(val.v)),
+                      _mm256_cvtepi32_epi64(_mm256_extracti128_si256(val.v, 1)));
+}
+
+static FORCEINLINE __vec8_i64 __cast_sext(__vec8_i64, __vec8_i16 val) {
+    return __vec8_i64(_mm256_cvtepi16_epi64(val.v),
+                      _mm256_cvtepi16_epi64(_mm_srli_si128(val.v, 8)));
+}
+
+static FORCEINLINE __vec8_i64 __cast_sext(__vec8_i64, __vec8_i8 val) {
+    return __vec8_i64(_mm256_cvtepi8_epi64(val.v),
+                      _mm256_cvtepi8_epi64(_mm_srli_si128(val.v, 4)));
+}
+
+static FORCEINLINE __vec8_i32 __cast_sext(__vec8_i32, __vec8_i16 val) {
+    return _mm256_cvtepi16_epi32(val.v);
+}
+
+static FORCEINLINE __vec8_i32 __cast_sext(__vec8_i32, __vec8_i8 val) {
+    return _mm256_cvtepi8_epi32(val.v);
+}
+
+static FORCEINLINE __vec8_i16 __cast_sext(__vec8_i16, __vec8_i8 val) {
+    return _mm_cvtepi8_epi16(val.v);
+}
+
+static FORCEINLINE __vec8_i8 __cast_sext(__vec8_i8, __vec8_i1 v) {
+    return lMask8(v.v);
+}
+
+static FORCEINLINE __vec8_i16 __cast_sext(__vec8_i16, __vec8_i1 v) {
+    return lMask16(v.v);
+}
+
+static FORCEINLINE __vec8_i32 __cast_sext(__vec8_i32, __vec8_i1 v) {
+    return _mm256_castps_si256(v.v);
+}
+
+static FORCEINLINE __vec8_i64 __cast_sext(__vec8_i64, __vec8_i1 v) {
+    return __vec8_i64(lMaskLo64(v.v), lMaskHi64(v.v));
+}
+
+// zero extension
+
+static FORCEINLINE __vec8_i64 __cast_zext(__vec8_i64, __vec8_i32 val) {
+    return __vec8_i64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(val.v)),
+                      _mm256_cvtepu32_epi64(_mm256_extracti128_si256(val.v, 1)));
+}
+
+static FORCEINLINE __vec8_i64 __cast_zext(__vec8_i64, __vec8_i16 val) {
+    return __vec8_i64(_mm256_cvtepu16_epi64(val.v),
+                      _mm256_cvtepu16_epi64(_mm_srli_si128(val.v, 8)));
+}
+
+static FORCEINLINE __vec8_i64 __cast_zext(__vec8_i64, __vec8_i8 val) {
+    return __vec8_i64(_mm256_cvtepu8_epi64(val.v),
+                      _mm256_cvtepu8_epi64(_mm_srli_si128(val.v, 4)));
+}
+
+static FORCEINLINE __vec8_i32 __cast_zext(__vec8_i32, __vec8_i16 val) {
+    return _mm256_cvtepu16_epi32(val.v);
+}
+
+static FORCEINLINE __vec8_i32 __cast_zext(__vec8_i32, __vec8_i8 val) {
+    return _mm256_cvtepu8_epi32(val.v);
+}
+
+static FORCEINLINE __vec8_i16 __cast_zext(__vec8_i16, __vec8_i8 val) {
+    return _mm_cvtepu8_epi16(val.v);
+}
+
+static FORCEINLINE __vec8_i8 __cast_zext(__vec8_i8, __vec8_i1 v) {
+    return _mm_and_si128(lMask8(v.v), _mm_set1_epi8(1));
+}
+
+static FORCEINLINE __vec8_i16 __cast_zext(__vec8_i16, __vec8_i1 v) {
+    return _mm_and_si128(lMask16(v.v), _mm_set1_epi16(1));
+}
+
+static FORCEINLINE __vec8_i32 __cast_zext(__vec8_i32, __vec8_i1 v) {
+    return _mm256_and_si256(_mm256_castps_si256(v.v), _mm256_set1_epi32(1));
+}
+
+static FORCEINLINE __vec8_i64 __cast_zext(__vec8_i64, __vec8_i1 v) {
+    __m256i one = _mm256_set1_epi64x(1);
+    return __vec8_i64(_mm256_and_si256(lMaskLo64(v.v), one),
+                      _mm256_and_si256(lMaskHi64(v.v), one));
+}
+
+// truncations
+
+static FORCEINLINE __vec8_i32 __cast_trunc(__vec8_i32, __vec8_i64 val) {
+    return lPack64To32(val.v[0], val.v[1]);
+}
+
+static FORCEINLINE __vec8_i16 __cast_trunc(__vec8_i16, __vec8_i64 val) {
+    return lTrunc32To16(lPack64To32(val.v[0], val.v[1]));
+}
+
+static FORCEINLINE __vec8_i8 __cast_trunc(__vec8_i8, __vec8_i64 val) {
+    return lTrunc32To8(lPack64To32(val.v[0], val.v[1]));
+}
+
+static FORCEINLINE __vec8_i16 __cast_trunc(__vec8_i16, __vec8_i32 val) {
+    return lTrunc32To16(val.v);
+}
+
+static FORCEINLINE __vec8_i8 __cast_trunc(__vec8_i8, __vec8_i32 val) {
+    return lTrunc32To8(val.v);
+}
+
+static FORCEINLINE __vec8_i8 __cast_trunc(__vec8_i8, __vec8_i16 val) {
+    return lTrunc16To8(val.v);
+}
+
+// signed int to float/double
+
+static FORCEINLINE __vec8_f __cast_sitofp(__vec8_f, __vec8_i8 val) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(val.v));
+}
+
+static FORCEINLINE __vec8_f __cast_sitofp(__vec8_f, __vec8_i16 val) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(val.v));
+}
+
+static FORCEINLINE __vec8_f __cast_sitofp(__vec8_f, __vec8_i32 val) {
+    return _mm256_cvtepi32_ps(val.v);
+}
+
+static FORCEINLINE __vec8_f __cast_sitofp(__vec8_f, __vec8_i64 val) {
+    float r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = (float)__extract_element(val, i);
+    return __vec8_f(r);
+}
+
+static FORCEINLINE __vec8_d __cast_sitofp(__vec8_d, __vec8_i32 val) {
+    return __vec8_d(_mm256_cvtepi32_pd(_mm256_castsi256_si128(val.v)),
+                    _mm256_cvtepi32_pd(_mm256_extracti128_si256(val.v, 1)));
+}
+
+static FORCEINLINE __vec8_d __cast_sitofp(__vec8_d, __vec8_i8 val) {
+    return __cast_sitofp(__vec8_d(), __cast_sext(__vec8_i32(), val));
+}
+
+static FORCEINLINE __vec8_d __cast_sitofp(__vec8_d, __vec8_i16 val) {
+    return __cast_sitofp(__vec8_d(), __cast_sext(__vec8_i32(), val));
+}
+
+static FORCEINLINE __vec8_d __cast_sitofp(__vec8_d, __vec8_i64 val) {
+    double r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = (double)__extract_element(val, i);
+    return __vec8_d(r);
+}
+
+// unsigned int to float/double
+
+static FORCEINLINE __vec8_f __cast_uitofp(__vec8_f, __vec8_i8 val) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(val.v));
+}
+
+static FORCEINLINE __vec8_f __cast_uitofp(__vec8_f, __vec8_i16 val) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(val.v));
+}
+
+static FORCEINLINE __vec8_f __cast_uitofp(__vec8_f, __vec8_i32 val) {
+    // Convert the high and low 16 bits separately; both conversions and
+    // the scaling by 2^16 are exact, so only the final add rounds.
+    __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(val.v, 16));
+    __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(val.v, _mm256_set1_epi32(0xffff)));
+    return _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.f)), lo);
+}
+
+static FORCEINLINE __vec8_f __cast_uitofp(__vec8_f, __vec8_i64 val) {
+    float r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = (float)(uint64_t)__extract_element(val, i);
+    return __vec8_f(r);
+}
+
+static FORCEINLINE __vec8_f __cast_uitofp(__vec8_f, __vec8_i1 v) {
+    return _mm256_and_ps(v.v, _mm256_set1_ps(1.f));
+}
+
+static FORCEINLINE __vec8_d __cast_uitofp(__vec8_d, __vec8_i8 val) {
+    return __cast_sitofp(__vec8_d(), __cast_zext(__vec8_i32(), val));
+}
+
+static FORCEINLINE __vec8_d __cast_uitofp(__vec8_d, __vec8_i16 val) {
+    return __cast_sitofp(__vec8_d(), __cast_zext(__vec8_i32(), val));
+}
+
+static FORCEINLINE __vec8_d __cast_uitofp(__vec8_d, __vec8_i32 val) {
+    return __vec8_d(lU32ToDouble(_mm256_castsi256_si128(val.v)),
+                    lU32ToDouble(_mm256_extracti128_si256(val.v, 1)));
+}
+
+static FORCEINLINE __vec8_d __cast_uitofp(__vec8_d, __vec8_i64 val) {
+    double r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = (double)(uint64_t)__extract_element(val, i);
+    return __vec8_d(r);
+}
+
+static FORCEINLINE __vec8_d __cast_uitofp(__vec8_d, __vec8_i1 v) {
+    __m256d one = _mm256_set1_pd(1.);
+    return __vec8_d(_mm256_and_pd(_mm256_castsi256_pd(lMaskLo64(v.v)), one),
+                    _mm256_and_pd(_mm256_castsi256_pd(lMaskHi64(v.v)), one));
+}
+
+// float/double to signed int
+
+static FORCEINLINE __vec8_i32 __cast_fptosi(__vec8_i32, __vec8_f val) {
+    return _mm256_cvttps_epi32(val.v);
+}
+
+static FORCEINLINE __vec8_i16 __cast_fptosi(__vec8_i16, __vec8_f val) {
+    return lTrunc32To16(_mm256_cvttps_epi32(val.v));
+}
+
+static FORCEINLINE __vec8_i8 __cast_fptosi(__vec8_i8, __vec8_f val) {
+    return lTrunc32To8(_mm256_cvttps_epi32(val.v));
+}
+
+static FORCEINLINE __vec8_i64 __cast_fptosi(__vec8_i64, __vec8_f val) {
+    int64_t r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = (int64_t)__extract_element(val, i);
+    return __vec8_i64(r);
+}
+
+static FORCEINLINE __vec8_i32 __cast_fptosi(__vec8_i32, __vec8_d val) {
+    return lCombine128(_mm256_cvttpd_epi32(val.v[0]), _mm256_cvttpd_epi32(val.v[1]));
+}
+
+static FORCEINLINE __vec8_i16 __cast_fptosi(__vec8_i16, __vec8_d val) {
+    return lTrunc32To16(__cast_fptosi(__vec8_i32(), val).v);
+}
+
+static FORCEINLINE __vec8_i8 __cast_fptosi(__vec8_i8, __vec8_d val) {
+    return lTrunc32To8(__cast_fptosi(__vec8_i32(), val).v);
+}
+
+static FORCEINLINE __vec8_i64 __cast_fptosi(__vec8_i64, __vec8_d val) {
+    int64_t r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = (int64_t)__extract_element(val, i);
+    return __vec8_i64(r);
+}
+
+// float/double to unsigned int
+
+static FORCEINLINE __vec8_i32 __cast_fptoui(__vec8_i32, __vec8_f val) {
+    // Values >= 2^31 don't fit in a signed 32-bit integer: bias them down
+    // before the conversion and set the high bit afterward.
+    __m256 two31 = _mm256_set1_ps(2147483648.f);
+    __m256 big = _mm256_cmp_ps(val.v, two31, _CMP_GE_OQ);
+    __m256i r = _mm256_cvttps_epi32(_mm256_sub_ps(val.v, _mm256_and_ps(big, two31)));
+    return _mm256_xor_si256(r, _mm256_slli_epi32(_mm256_castps_si256(big), 31));
+}
+
+static FORCEINLINE __vec8_i16 __cast_fptoui(__vec8_i16, __vec8_f val) {
+    return lTrunc32To16(_mm256_cvttps_epi32(val.v));
+}
+
+static FORCEINLINE __vec8_i8 __cast_fptoui(__vec8_i8, __vec8_f val) {
+    return lTrunc32To8(_mm256_cvttps_epi32(val.v));
+}
+
+static FORCEINLINE __vec8_i64 __cast_fptoui(__vec8_i64, __vec8_f val) {
+    int64_t r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = (int64_t)(uint64_t)__extract_element(val, i);
+    return __vec8_i64(r);
+}
+
+static FORCEINLINE __vec8_i32 __cast_fptoui(__vec8_i32, __vec8_d val) {
+    return lCombine128(lTruncDoubleToU32(val.v[0]), lTruncDoubleToU32(val.v[1]));
+}
+
+static FORCEINLINE __vec8_i16 __cast_fptoui(__vec8_i16, __vec8_d val) {
+    return lTrunc32To16(__cast_fptosi(__vec8_i32(), val).v);
+}
+
+static FORCEINLINE __vec8_i8 __cast_fptoui(__vec8_i8, __vec8_d val) {
+    return lTrunc32To8(__cast_fptosi(__vec8_i32(), val).v);
+}
+
+static FORCEINLINE __vec8_i64 __cast_fptoui(__vec8_i64, __vec8_d val) {
+    int64_t r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = (int64_t)(uint64_t)__extract_element(val, i);
+    return __vec8_i64(r);
+}
+
+// float/double conversions
+
+static FORCEINLINE __vec8_f __cast_fptrunc(__vec8_f, __vec8_d val) {
+    return lCombine128(_mm256_cvtpd_ps(val.v[0]), _mm256_cvtpd_ps(val.v[1]));
+}
+
+static FORCEINLINE __vec8_d __cast_fpext(__vec8_d, __vec8_f val) {
+    return __vec8_d(_mm256_cvtps_pd(_mm256_castps256_ps128(val.v)),
+                    _mm256_cvtps_pd(_mm256_extractf128_ps(val.v, 1)));
+}
+
+///////////////////////////////////////////////////////////////////////////
+// various math functions
+
+static FORCEINLINE void __fastmath() {
+    // Set the flush-to-zero and denormals-are-zero bits.
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+}
+
+static FORCEINLINE float __round_uniform_float(float v) {
+    __m128 r = _mm_set_ss(v);
+    r = _mm_round_ss(r, r, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE float __floor_uniform_float(float v) {
+    __m128 r = _mm_set_ss(v);
+    r = _mm_round_ss(r, r, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE float __ceil_uniform_float(float v) {
+    __m128 r = _mm_set_ss(v);
+    r = _mm_round_ss(r, r, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE double __round_uniform_double(double v) {
+    __m128d r = _mm_set_sd(v);
+    r = _mm_round_sd(r, r, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    return _mm_cvtsd_f64(r);
+}
+
+static FORCEINLINE double __floor_uniform_double(double v) {
+    __m128d r = _mm_set_sd(v);
+    r = _mm_round_sd(r, r, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    return _mm_cvtsd_f64(r);
+}
+
+static FORCEINLINE double __ceil_uniform_double(double v) {
+    __m128d r = _mm_set_sd(v);
+    r = _mm_round_sd(r, r, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+    return _mm_cvtsd_f64(r);
+}
+
+static FORCEINLINE __vec8_f __round_varying_float(__vec8_f v) {
+    return _mm256_round_ps(v.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+static FORCEINLINE __vec8_f __floor_varying_float(__vec8_f v) {
+    return _mm256_round_ps(v.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+
+static FORCEINLINE __vec8_f __ceil_varying_float(__vec8_f v) {
+    return _mm256_round_ps(v.v, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+}
+
+static FORCEINLINE __vec8_d __round_varying_double(__vec8_d v) {
+    return __vec8_d(_mm256_round_pd(v.v[0], _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC),
+                    _mm256_round_pd(v.v[1], _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+}
+
+static FORCEINLINE __vec8_d __floor_varying_double(__vec8_d v) {
+    return __vec8_d(_mm256_round_pd(v.v[0], _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC),
+                    _mm256_round_pd(v.v[1], _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+}
+
+static FORCEINLINE __vec8_d __ceil_varying_double(__vec8_d v) {
+    return __vec8_d(_mm256_round_pd(v.v[0], _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC),
+                    _mm256_round_pd(v.v[1], _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC));
+}
+
+// min/max
+
+static FORCEINLINE float __min_uniform_float(float a, float b) { return (a<b) ? a : b; }
+static FORCEINLINE float __max_uniform_float(float a, float b) { return (a>b) ? a : b; }
+static FORCEINLINE double __min_uniform_double(double a, double b) { return (a<b) ? a : b; }
+static FORCEINLINE double __max_uniform_double(double a, double b) { return (a>b) ? a : b; }
+
+static FORCEINLINE int32_t __min_uniform_int32(int32_t a, int32_t b) { return (a<b) ? a : b; }
+static FORCEINLINE int32_t __max_uniform_int32(int32_t a, int32_t b) { return (a>b) ? a : b; }
+static FORCEINLINE int32_t __min_uniform_uint32(uint32_t a, uint32_t b) { return (a<b) ? a : b; }
+static FORCEINLINE int32_t __max_uniform_uint32(uint32_t a, uint32_t b) { return (a>b) ? a : b; }
+
+static FORCEINLINE int64_t __min_uniform_int64(int64_t a, int64_t b) { return (a<b) ? a : b; }
+static FORCEINLINE int64_t __max_uniform_int64(int64_t a, int64_t b) { return (a>b) ? a : b; }
+static FORCEINLINE int64_t __min_uniform_uint64(uint64_t a, uint64_t b) { return (a<b) ? a : b; }
+static FORCEINLINE int64_t __max_uniform_uint64(uint64_t a, uint64_t b) { return (a>b) ? a : b; }
+
+static FORCEINLINE __vec8_f __max_varying_float(__vec8_f a, __vec8_f b) {
+    return _mm256_max_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_f __min_varying_float(__vec8_f a, __vec8_f b) {
+    return _mm256_min_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_d __max_varying_double(__vec8_d a, __vec8_d b) {
+    return __vec8_d(_mm256_max_pd(a.v[0], b.v[0]), _mm256_max_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_d __min_varying_double(__vec8_d a, __vec8_d b) {
+    return __vec8_d(_mm256_min_pd(a.v[0], b.v[0]), _mm256_min_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec8_i32 __max_varying_int32(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_max_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __min_varying_int32(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_min_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __max_varying_uint32(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_max_epu32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i32 __min_varying_uint32(__vec8_i32 a, __vec8_i32 b) {
+    return _mm256_min_epu32(a.v, b.v);
+}
+
+static FORCEINLINE __vec8_i64 __max_varying_int64(__vec8_i64 a, __vec8_i64 b) {
+    return __select(__signed_greater_than_i64(a, b), a, b);
+}
+
+static FORCEINLINE __vec8_i64 __min_varying_int64(__vec8_i64 a, __vec8_i64 b) {
+    return __select(__signed_less_than_i64(a, b), a, b);
+}
+
+static FORCEINLINE __vec8_i64 __max_varying_uint64(__vec8_i64 a, __vec8_i64 b) {
+    return __select(__unsigned_greater_than_i64(a, b), a, b);
+}
+
+static FORCEINLINE __vec8_i64 __min_varying_uint64(__vec8_i64 a, __vec8_i64 b) {
+    return __select(__unsigned_less_than_i64(a, b), a, b);
+}
+
+// sqrt/rsqrt/rcp
+
+static FORCEINLINE float __rsqrt_uniform_float(float v) {
+    __m128 vv = _mm_set_ss(v);
+    __m128 rsqrt = _mm_rsqrt_ss(vv);
+    // Newton-Raphson iteration to improve precision
+    // return 0.5 * rsqrt * (3. - (v * rsqrt) * rsqrt);
+    __m128 v_rsqrt = _mm_mul_ss(rsqrt, vv);
+    __m128 v_r_r = _mm_mul_ss(v_rsqrt, rsqrt);
+    __m128 three_sub = _mm_sub_ss(_mm_set_ss(3.f), v_r_r);
+    __m128 rs_mul = _mm_mul_ss(rsqrt, three_sub);
+    __m128 half_scale = _mm_mul_ss(_mm_set_ss(0.5), rs_mul);
+    return _mm_cvtss_f32(half_scale);
+}
+
+static FORCEINLINE float __rcp_uniform_float(float v) {
+    __m128 rcp = _mm_rcp_ss(_mm_set_ss(v));
+    // N-R iteration:
+    __m128 m = _mm_mul_ss(_mm_set_ss(v), rcp);
+    __m128 twominus = _mm_sub_ss(_mm_set_ss(2.f), m);
+    __m128 r = _mm_mul_ss(rcp, twominus);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE float __sqrt_uniform_float(float v) {
+    __m128 r = _mm_set_ss(v);
+    r = _mm_sqrt_ss(r);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE double __rsqrt_uniform_double(double v) {
+    return 1. / sqrt(v);
+}
+
+static FORCEINLINE double __rcp_uniform_double(double v) {
+    return 1. / v;
+}
+
+static FORCEINLINE double __sqrt_uniform_double(double v) {
+    __m128d r = _mm_set_sd(v);
+    r = _mm_sqrt_sd(r, r);
+    return _mm_cvtsd_f64(r);
+}
+
+static FORCEINLINE __vec8_f __rcp_varying_float(__vec8_f v) {
+    __m256 rcp = _mm256_rcp_ps(v.v);
+    // N-R iteration: rcp + rcp * (1 - v * rcp)
+#ifdef __FMA__
+    __m256 e = _mm256_fnmadd_ps(v.v, rcp, _mm256_set1_ps(1.f));
+    return _mm256_fmadd_ps(rcp, e, rcp);
+#else
+    __m256 m = _mm256_mul_ps(v.v, rcp);
+    __m256 twominus = _mm256_sub_ps(_mm256_set1_ps(2.f), m);
+    return _mm256_mul_ps(rcp, twominus);
+#endif // __FMA__
+}
+
+static FORCEINLINE __vec8_f __rsqrt_varying_float(__vec8_f v) {
+    __m256 rsqrt = _mm256_rsqrt_ps(v.v);
+    // Newton-Raphson iteration to improve precision
+    // return 0.5 * rsqrt * (3. - (v * rsqrt) * rsqrt);
+    __m256 v_rsqrt = _mm256_mul_ps(rsqrt, v.v);
+#ifdef __FMA__
+    __m256 three_sub = _mm256_fnmadd_ps(v_rsqrt, rsqrt, _mm256_set1_ps(3.f));
+#else
+    __m256 three_sub = _mm256_sub_ps(_mm256_set1_ps(3.f), _mm256_mul_ps(v_rsqrt, rsqrt));
+#endif // __FMA__
+    __m256 rs_mul = _mm256_mul_ps(rsqrt, three_sub);
+    return _mm256_mul_ps(_mm256_set1_ps(0.5f), rs_mul);
+}
+
+static FORCEINLINE __vec8_f __sqrt_varying_float(__vec8_f v) {
+    return _mm256_sqrt_ps(v.v);
+}
+
+static FORCEINLINE __vec8_d __rcp_varying_double(__vec8_d v) {
+    return __div(__smear_double<__vec8_d>(1.), v);
+}
+
+static FORCEINLINE __vec8_d __sqrt_varying_double(__vec8_d v) {
+    return __vec8_d(_mm256_sqrt_pd(v.v[0]), _mm256_sqrt_pd(v.v[1]));
+}
+
+static FORCEINLINE __vec8_d __rsqrt_varying_double(__vec8_d v) {
+    return __rcp_varying_double(__sqrt_varying_double(v));
+}
+
+// half<->float : this one passes the tests
+// source :
+// http://stackoverflow.com/questions/1659440/32-bit-to-16-bit-floating-point-conversion
+
+static FORCEINLINE float __half_to_float_uniform(int16_t h) {
+#ifdef __F16C__
+    return _cvtsh_ss((unsigned short)h);
+#else
+    static const uint32_t shifted_exp = 0x7c00 << 13; // exponent mask after shift
+
+    int32_t o = ((int32_t)(h & 0x7fff)) << 13;     // exponent/mantissa bits
+    uint32_t exp = shifted_exp & o;   // just the exponent
+    o += (127 - 15) << 23;        // exponent adjust
+
+    // handle exponent special cases
+    if (exp == shifted_exp) // Inf/NaN?
+        o += (128 - 16) << 23;    // extra exp adjust
+    else if (exp == 0) { // Zero/Denormal?
+        o += 1 << 23;             // extra exp adjust
+        o = __intbits(__floatbits(o) - __floatbits(113 << 23)); // renormalize
+    }
+
+    o |= ((int32_t)(h & 0x8000)) << 16;    // sign bit
+    return __floatbits(o);
+#endif // __F16C__
+}
+
+static FORCEINLINE __vec8_f __half_to_float_varying(__vec8_i16 v) {
+#ifdef __F16C__
+    return _mm256_cvtph_ps(v.v);
+#else
+    float ret[8];
+    for (int i = 0; i < 8; ++i)
+        ret[i] = __half_to_float_uniform(__extract_element(v, i));
+    return __vec8_f(ret);
+#endif // __F16C__
+}
+
+static FORCEINLINE int16_t __float_to_half_uniform(float f) {
+#ifdef __F16C__
+    return (int16_t)_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t sign_mask = 0x80000000u;
+    int32_t o;
+
+    int32_t fint = __intbits(f);
+    int32_t sign = fint & sign_mask;
+    fint ^= sign;
+
+    int32_t f32infty = 255 << 23;
+    o = (fint > f32infty) ? 0x7e00 : 0x7c00;
+
+    // (De)normalized number or zero
+    // update fint unconditionally to save the blending; we don't need it
+    // anymore for the Inf/NaN case anyway.
+    const uint32_t round_mask = ~0xfffu;
+    const int32_t magic = 15 << 23;
+    const int32_t f16infty = 31 << 23;
+
+    int32_t fint2 = __intbits(__floatbits(fint & round_mask) * __floatbits(magic)) - round_mask;
+    fint2 = (fint2 > f16infty) ? f16infty : fint2; // Clamp to signed infinity if overflowed
+
+    if (fint < f32infty)
+        o = fint2 >> 13; // Take the bits!
+
+    return (o | (sign >> 16));
+#endif // __F16C__
+}
+
+static FORCEINLINE __vec8_i16 __float_to_half_varying(__vec8_f v) {
+#ifdef __F16C__
+    return _mm256_cvtps_ph(v.v, _MM_FROUND_TO_NEAREST_INT);
+#else
+    int16_t ret[8];
+    for (int i = 0; i < 8; ++i)
+        ret[i] = __float_to_half_uniform(__extract_element(v, i));
+    return __vec8_i16(ret);
+#endif // __F16C__
+}
+
+///////////////////////////////////////////////////////////////////////////
+// bit ops
+
+static FORCEINLINE int32_t __popcnt_int32(uint32_t v) {
+    return _mm_popcnt_u32(v);
+}
+
+static FORCEINLINE int32_t __popcnt_int64(uint64_t v) {
+#if defined(__x86_64__) || defined(_M_X64)
+    return (int32_t)_mm_popcnt_u64(v);
+#else
+    return _mm_popcnt_u32((uint32_t)v) + _mm_popcnt_u32((uint32_t)(v >> 32));
+#endif
+}
+
+static FORCEINLINE int32_t __count_trailing_zeros_i32(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return i;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+static FORCEINLINE int64_t __count_trailing_zeros_i64(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return i;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+static FORCEINLINE int32_t __count_leading_zeros_i32(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse(&i, v);
+    return 31 - i;
+#else
+    return __builtin_clz(v);
+#endif
+}
+
+static FORCEINLINE int64_t __count_leading_zeros_i64(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return 63 - i;
+#else
+    return __builtin_clzll(v);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////
+// reductions
+
+static FORCEINLINE int32_t lReduceAdd(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+static FORCEINLINE int64_t lReduceAdd64(__m256i v) {
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+    return _mm_extract_epi64(s, 0);
+}
+
+static FORCEINLINE int16_t __reduce_add_int8(__vec8_i8 v) {
+    return (int16_t)lReduceAdd(_mm256_cvtepi8_epi32(v.v));
+}
+
+static FORCEINLINE int32_t __reduce_add_int16(__vec8_i16 v) {
+    return lReduceAdd(_mm256_cvtepi16_epi32(v.v));
+}
+
+static FORCEINLINE int64_t __reduce_add_int32(__vec8_i32 v) {
+    __vec8_i64 v64 = __cast_sext(__vec8_i64(), v);
+    return lReduceAdd64(_mm256_add_epi64(v64.v[0], v64.v[1]));
+}
+
+static FORCEINLINE uint32_t __reduce_add_uint32(__vec8_i32 v) {
+    return (uint32_t)lReduceAdd(v.v);
+}
+
+#define REDUCE_MINMAX_32(TYPE, NAME, OP)                                     \
+static FORCEINLINE TYPE NAME(__vec8_i32 v) {                                 \
+    __m128i s = OP(_mm256_castsi256_si128(v.v), _mm256_extracti128_si256(v.v, 1)); \
+    s = OP(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));                \
+    s = OP(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));                \
+    return (TYPE)_mm_cvtsi128_si32(s);                                       \
+}
+
+REDUCE_MINMAX_32(int32_t, __reduce_min_int32, _mm_min_epi32)
+REDUCE_MINMAX_32(int32_t, __reduce_max_int32, _mm_max_epi32)
+REDUCE_MINMAX_32(uint32_t, __reduce_min_uint32, _mm_min_epu32)
+REDUCE_MINMAX_32(uint32_t, __reduce_max_uint32, _mm_max_epu32)
+
+#define REDUCE_FLOAT(NAME, OP)                                               \
+static FORCEINLINE float NAME(__vec8_f v) {                                  \
+    __m128 s = OP(_mm256_castps256_ps128(v.v), _mm256_extractf128_ps(v.v, 1)); \
+    s = OP(s, _mm_movehl_ps(s, s));                                          \
+    s = OP(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));                \
+    return _mm_cvtss_f32(s);                                                 \
+}
+
+REDUCE_FLOAT(__reduce_add_float, _mm_add_ps)
+REDUCE_FLOAT(__reduce_min_float, _mm_min_ps)
+REDUCE_FLOAT(__reduce_max_float, _mm_max_ps)
+
+#define REDUCE_DOUBLE(NAME, OP, OP256)                                       \
+static FORCEINLINE double NAME(__vec8_d v) {                                 \
+    __m256d s4 = OP256(v.v[0], v.v[1]);                                      \
+    __m128d s = OP(_mm256_castpd256_pd128(s4), _mm256_extractf128_pd(s4, 1)); \
+    s = OP(s, _mm_unpackhi_pd(s, s));                                        \
+    return _mm_cvtsd_f64(s);                                                 \
+}
+
+REDUCE_DOUBLE(__reduce_add_double, _mm_add_pd, _mm256_add_pd)
+REDUCE_DOUBLE(__reduce_min_double, _mm_min_pd, _mm256_min_pd)
+REDUCE_DOUBLE(__reduce_max_double, _mm_max_pd, _mm256_max_pd)
+
+static FORCEINLINE int64_t __reduce_add_int64(__vec8_i64 v) {
+    return lReduceAdd64(_mm256_add_epi64(v.v[0], v.v[1]));
+}
+
+static FORCEINLINE uint64_t __reduce_add_uint64(__vec8_i64 v) {
+    return (uint64_t)__reduce_add_int64(v);
+}
+
+#define REDUCE_MINMAX_64(TYPE, NAME, FUNC)                              \
+static FORCEINLINE TYPE NAME(__vec8_i64 v) {                            \
+    __vec8_i64 r = FUNC(v, __rotate_i64(v, 4));                         \
+    r = FUNC(r, __rotate_i64(r, 2));                                    \
+    r = FUNC(r, __rotate_i64(r, 1));                                    \
+    return (TYPE)__extract_element(r, 0);                               \
+}
+
+REDUCE_MINMAX_64(int64_t, __reduce_min_int64, __min_varying_int64)
+REDUCE_MINMAX_64(int64_t, __reduce_max_int64, __max_varying_int64)
+REDUCE_MINMAX_64(uint64_t, __reduce_min_uint64, __min_varying_uint64)
+REDUCE_MINMAX_64(uint64_t, __reduce_max_uint64, __max_varying_uint64)
+
+///////////////////////////////////////////////////////////////////////////
+// masked load/store
+
+// AVX2 only has masked loads and stores of 32- and 64-bit elements; 8-
+// and 16-bit elements are handled one active lane at a time.
+#define MASKED_LOAD_SMALL(VTYPE, STYPE, FUNC)                           \
+static FORCEINLINE VTYPE FUNC(void *p, __vec8_i1 mask) {                \
+    const STYPE *ptr = (const STYPE *)p;                                \
+    uint32_t m = _mm256_movemask_ps(mask.v);                            \
+    if (m == 0xff)                                                      \
+        return __load<1>((const VTYPE *)p);                             \
+    VTYPE ret = __setzero_##STYPE##_vec();                              \
+    while (m != 0) {                                                    \
+        int i = __count_trailing_zeros_i32(m);                          \
+        m &= m - 1;                                                     \
+        __insert_element(&ret, i, ptr[i]);                              \
+    }                                                                   \
+    return ret;                                                         \
+}
+
+static FORCEINLINE __vec8_i8 __setzero_int8_t_vec() { return __setzero_i8<__vec8_i8>(); }
+static FORCEINLINE __vec8_i16 __setzero_int16_t_vec() { return __setzero_i16<__vec8_i16>(); }
+
+MASKED_LOAD_SMALL(__vec8_i8, int8_t, __masked_load_i8)
+MASKED_LOAD_SMALL(__vec8_i16, int16_t, __masked_load_i16)
+
+static FORCEINLINE __vec8_i32 __masked_load_i32(void *p, __vec8_i1 mask) {
+    return _mm256_maskload_epi32((const int *)p, _mm256_castps_si256(mask.v));
+}
+
+static FORCEINLINE __vec8_f __masked_load_float(void *p, __vec8_i1 mask) {
+    return _mm256_maskload_ps((const float *)p, _mm256_castps_si256(mask.v));
+}
+
+static FORCEINLINE __vec8_i64 __masked_load_i64(void *p, __vec8_i1 mask) {
+    const long long *ptr = (const long long *)p;
+    return __vec8_i64(_mm256_maskload_epi64(ptr, lMaskLo64(mask.v)),
+                      _mm256_maskload_epi64(ptr + 4, lMaskHi64(mask.v)));
+}
+
+static FORCEINLINE __vec8_d __masked_load_double(void *p, __vec8_i1 mask) {
+    const double *ptr = (const double *)p;
+    return __vec8_d(_mm256_maskload_pd(ptr, lMaskLo64(mask.v)),
+                    _mm256_maskload_pd(ptr + 4, lMaskHi64(mask.v)));
+}
+
+#define MASKED_STORE_SMALL(VTYPE, STYPE, FUNC)                          \
+static FORCEINLINE void FUNC(void *p, VTYPE val, __vec8_i1 mask) {      \
+    STYPE *ptr = (STYPE *)p;                                            \
+    uint32_t m = _mm256_movemask_ps(mask.v);                            \
+    if (m == 0xff) {                                                    \
+        __store<1>((VTYPE *)p, val);                                    \
+        return;                                                         \
+    }                                                                   \
+    while (m != 0) {                                                    \
+        int i = __count_trailing_zeros_i32(m);                          \
+        m &= m - 1;                                                     \
+        ptr[i] = __extract_element(val, i);                             \
+    }                                                                   \
+}
+
+MASKED_STORE_SMALL(__vec8_i8, int8_t, __masked_store_i8)
+MASKED_STORE_SMALL(__vec8_i16, int16_t, __masked_store_i16)
+
+static FORCEINLINE void __masked_store_i32(void *p, __vec8_i32 val, __vec8_i1 mask) {
+    _mm256_maskstore_epi32((int *)p, _mm256_castps_si256(mask.v), val.v);
+}
+
+static FORCEINLINE void __masked_store_float(void *p, __vec8_f val, __vec8_i1 mask) {
+    _mm256_maskstore_ps((float *)p, _mm256_castps_si256(mask.v), val.v);
+}
+
+static FORCEINLINE void __masked_store_i64(void *p, __vec8_i64 val, __vec8_i1 mask) {
+    long long *ptr = (long long *)p;
+    _mm256_maskstore_epi64(ptr, lMaskLo64(mask.v), val.v[0]);
+    _mm256_maskstore_epi64(ptr + 4, lMaskHi64(mask.v), val.v[1]);
+}
+
+static FORCEINLINE void __masked_store_double(void *p, __vec8_d val, __vec8_i1 mask) {
+    double *ptr = (double *)p;
+    _mm256_maskstore_pd(ptr, lMaskLo64(mask.v), val.v[0]);
+    _mm256_maskstore_pd(ptr + 4, lMaskHi64(mask.v), val.v[1]);
+}
+
+// The "blend" variants are allowed to write back the original values of
+// the inactive lanes, which turns the small-element stores into a load, a
+// blend and a store.
+static FORCEINLINE void __masked_store_blend_i8(void *p, __vec8_i8 val,
+                                                __vec8_i1 mask) {
+    __vec8_i8 old = __load<1>((const __vec8_i8 *)p);
+    __store<1>((__vec8_i8 *)p, __select(mask, val, old));
+}
+
+static FORCEINLINE void __masked_store_blend_i16(void *p, __vec8_i16 val,
+                                                 __vec8_i1 mask) {
+    __vec8_i16 old = __load<1>((const __vec8_i16 *)p);
+    __store<1>((__vec8_i16 *)p, __select(mask, val, old));
+}
+
+static FORCEINLINE void __masked_store_blend_i32(void *p, __vec8_i32 val,
+                                                 __vec8_i1 mask) {
+    __masked_store_i32(p, val, mask);
+}
+
+static FORCEINLINE void __masked_store_blend_float(void *p, __vec8_f val,
+                                                   __vec8_i1 mask) {
+    __masked_store_float(p, val, mask);
+}
+
+static FORCEINLINE void __masked_store_blend_i64(void *p, __vec8_i64 val,
+                                                 __vec8_i1 mask) {
+    __masked_store_i64(p, val, mask);
+}
+
+static FORCEINLINE void __masked_store_blend_double(void *p, __vec8_d val,
+                                                    __vec8_i1 mask) {
+    __masked_store_double(p, val, mask);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// gather/scatter
+
+// The gather instructions only take scales of 1, 2, 4 or 8 as
+// immediates; anything else is folded into 64-bit offsets up front.
+static FORCEINLINE bool lIsGatherScale(uint32_t scale) {
+    return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+static FORCEINLINE __vec8_i64 lScaleOffsets(__vec8_i32 offsets, uint32_t scale) {
+    return __mul(__cast_sext(__vec8_i64(), offsets),
+                 __smear_i64<__vec8_i64>((int64_t)scale));
+}
+
+static FORCEINLINE __vec8_i64 lScaleOffsets(__vec8_i64 offsets, uint32_t scale) {
+    return __mul(offsets, __smear_i64<__vec8_i64>((int64_t)scale));
+}
+
+#define GATHER_SCALED(INTRIN, SRC, BASE, OFFSETS, MASK, SCALE)          \
+    ((SCALE) == 8 ? INTRIN(SRC, BASE, OFFSETS, MASK, 8) :               \
+     (SCALE) == 4 ? INTRIN(SRC, BASE, OFFSETS, MASK, 4) :               \
+     (SCALE) == 2 ? INTRIN(SRC, BASE, OFFSETS, MASK, 2) :               \
+                    INTRIN(SRC, BASE, OFFSETS, MASK, 1))
+
+static FORCEINLINE __vec8_i32
+__gather_base_offsets64_i32(unsigned char *p, uint32_t scale, __vec8_i64 offsets,
+                            __vec8_i1 mask) {
+    if (!lIsGatherScale(scale)) {
+        offsets = lScaleOffsets(offsets, scale);
+        scale = 1;
+    }
+    __m128i mlo = _mm256_castsi256_si128(_mm256_castps_si256(mask.v));
+    __m128i mhi = _mm256_extracti128_si256(_mm256_castps_si256(mask.v), 1);
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = GATHER_SCALED(_mm256_mask_i64gather_epi32, zero, (const int *)p,
+                               offsets.v[0], mlo, scale);
+    __m128i hi = GATHER_SCALED(_mm256_mask_i64gather_epi32, zero, (const int *)p,
+                               offsets.v[1], mhi, scale);
+    return lCombine128(lo, hi);
+}
+
+static FORCEINLINE __vec8_i32
+__gather_base_offsets32_i32(uint8_t *p, uint32_t scale, __vec8_i32 offsets,
+                            __vec8_i1 mask) {
+    if (!lIsGatherScale(scale))
+        return __gather_base_offsets64_i32(p, 1, lScaleOffsets(offsets, scale), mask);
+    return GATHER_SCALED(_mm256_mask_i32gather_epi32, _mm256_setzero_si256(),
+                         (const int *)p, offsets.v, _mm256_castps_si256(mask.v), scale);
+}
+
+static FORCEINLINE __vec8_f
+__gather_base_offsets64_float(unsigned char *p, uint32_t scale, __vec8_i64 offsets,
+                              __vec8_i1 mask) {
+    return __cast_bits(__vec8_f(), __gather_base_offsets64_i32(p, scale, offsets, mask));
+}
+
+static FORCEINLINE __vec8_f
+__gather_base_offsets32_float(uint8_t *p, uint32_t scale, __vec8_i32 offsets,
+                              __vec8_i1 mask) {
+    if (!lIsGatherScale(scale))
+        return __gather_base_offsets64_float(p, 1, lScaleOffsets(offsets, scale), mask);
+    return GATHER_SCALED(_mm256_mask_i32gather_ps, _mm256_setzero_ps(),
+                         (const float *)p, offsets.v, mask.v, scale);
+}
+
+static FORCEINLINE __vec8_i64
+__gather_base_offsets64_i64(unsigned char *p, uint32_t scale, __vec8_i64 offsets,
+                            __vec8_i1 mask) {
+    if (!lIsGatherScale(scale)) {
+        offsets = lScaleOffsets(offsets, scale);
+        scale = 1;
+    }
+    __m256i zero = _mm256_setzero_si256();
+    const long long *base = (const long long *)p;
+    return __vec8_i64(GATHER_SCALED(_mm256_mask_i64gather_epi64, zero, base,
+                                    offsets.v[0], lMaskLo64(mask.v), scale),
+                      GATHER_SCALED(_mm256_mask_i64gather_epi64, zero, base,
+                                    offsets.v[1], lMaskHi64(mask.v), scale));
+}
+
+static FORCEINLINE __vec8_i64
+__gather_base_offsets32_i64(unsigned char *p, uint32_t scale, __vec8_i32 offsets,
+                            __vec8_i1 mask) {
+    if (!lIsGatherScale(scale))
+        return __gather_base_offsets64_i64(p, 1, lScaleOffsets(offsets, scale), mask);
+    __m256i zero = _mm256_setzero_si256();
+    const long long *base = (const long long *)p;
+    __m128i olo = _mm256_castsi256_si128(offsets.v);
+    __m128i ohi = _mm256_extracti128_si256(offsets.v, 1);
+    return __vec8_i64(GATHER_SCALED(_mm256_mask_i32gather_epi64, zero, base,
+                                    olo, lMaskLo64(mask.v), scale),
+                      GATHER_SCALED(_mm256_mask_i32gather_epi64, zero, base,
+                                    ohi, lMaskHi64(mask.v), scale));
+}
+
+static FORCEINLINE __vec8_d
+__gather_base_offsets64_double(unsigned char *p, uint32_t scale, __vec8_i64 offsets,
+                               __vec8_i1 mask) {
+    return __cast_bits(__vec8_d(), __gather_base_offsets64_i64(p, scale, offsets, mask));
+}
+
+static FORCEINLINE __vec8_d
+__gather_base_offsets32_double(unsigned char *p, uint32_t scale, __vec8_i32 offsets,
+                               __vec8_i1 mask) {
+    return __cast_bits(__vec8_d(), __gather_base_offsets32_i64(p, scale, offsets, mask));
+}
+
+// There are no 8- or 16-bit gathers, and gathering 32-bit values instead
+// could read past the end of a page, so these go one lane at a time.
+#define GATHER_BASE_OFFSETS_SMALL(VTYPE, STYPE, OTYPE, FUNC)            \
+static FORCEINLINE VTYPE FUNC(unsigned char *b, uint32_t scale,         \
+                              OTYPE offset, __vec8_i1 mask) {           \
+    VTYPE ret = __setzero_##STYPE##_vec();                              \
+    uint32_t m = _mm256_movemask_ps(mask.v);                            \
+    while (m != 0) {                                                    \
+        int i = __count_trailing_zeros_i32(m);                          \
+        m &= m - 1;                                                     \
+        STYPE *ptr = (STYPE *)(b + scale * (int64_t)__extract_element(offset, i)); \
+        __insert_element(&ret, i, *ptr);                                \
+    }                                                                   \
+    return ret;                                                         \
+}
+
+GATHER_BASE_OFFSETS_SMALL(__vec8_i8,  int8_t,  __vec8_i32, __gather_base_offsets32_i8)
+GATHER_BASE_OFFSETS_SMALL(__vec8_i8,  int8_t,  __vec8_i64, __gather_base_offsets64_i8)
+GATHER_BASE_OFFSETS_SMALL(__vec8_i16, int16_t, __vec8_i32, __gather_base_offsets32_i16)
+GATHER_BASE_OFFSETS_SMALL(__vec8_i16, int16_t, __vec8_i64, __gather_base_offsets64_i16)
+
+// General gathers take a full pointer per lane.  32-bit pointers are
+// zero-extended and gathered with 64-bit indices off of a NULL base.
+#define GATHER_GENERAL(VTYPE, SUFFIX)                                   \
+static FORCEINLINE VTYPE __gather64_##SUFFIX(__vec8_i64 ptrs, __vec8_i1 mask) { \
+    return __gather_base_offsets64_##SUFFIX(NULL, 1, ptrs, mask);       \
+}                                                                       \
+static FORCEINLINE VTYPE __gather32_##SUFFIX(__vec8_i32 ptrs, __vec8_i1 mask) { \
+    return __gather64_##SUFFIX(__cast_zext(__vec8_i64(), ptrs), mask);  \
+}
+
+GATHER_GENERAL(__vec8_i8, i8)
+GATHER_GENERAL(__vec8_i16, i16)
+GATHER_GENERAL(__vec8_i32, i32)
+GATHER_GENERAL(__vec8_f, float)
+GATHER_GENERAL(__vec8_i64, i64)
+GATHER_GENERAL(__vec8_d, double)
+
+// scatter
+
+#define SCATTER_BASE_OFFSETS(VTYPE, STYPE, OTYPE, FUNC)                 \
+static FORCEINLINE void FUNC(unsigned char *b, uint32_t scale,          \
+                             OTYPE offset, VTYPE val,                   \
+                             __vec8_i1 mask) {                          \
+    uint32_t m = _mm256_movemask_ps(mask.v);                            \
+    while (m != 0) {                                                    \
+        int i = __count_trailing_zeros_i32(m);                          \
+        m &= m - 1;                                                     \
+        STYPE *ptr = (STYPE *)(b + scale * (int64_t)__extract_element(offset, i)); \
+        *ptr = __extract_element(val, i);                               \
+    }                                                                   \
+}
+
+SCATTER_BASE_OFFSETS(__vec8_i8,  int8_t,  __vec8_i32, __scatter_base_offsets32_i8)
+SCATTER_BASE_OFFSETS(__vec8_i8,  int8_t,  __vec8_i64, __scatter_base_offsets64_i8)
+SCATTER_BASE_OFFSETS(__vec8_i16, int16_t, __vec8_i32, __scatter_base_offsets32_i16)
+SCATTER_BASE_OFFSETS(__vec8_i16, int16_t, __vec8_i64, __scatter_base_offsets64_i16)
+SCATTER_BASE_OFFSETS(__vec8_i32, int32_t, __vec8_i32, __scatter_base_offsets32_i32)
+SCATTER_BASE_OFFSETS(__vec8_i32, int32_t, __vec8_i64, __scatter_base_offsets64_i32)
+SCATTER_BASE_OFFSETS(__vec8_f,   float,   __vec8_i32, __scatter_base_offsets32_float)
+SCATTER_BASE_OFFSETS(__vec8_f,   float,   __vec8_i64, __scatter_base_offsets64_float)
+SCATTER_BASE_OFFSETS(__vec8_i64, int64_t, __vec8_i32, __scatter_base_offsets32_i64)
+SCATTER_BASE_OFFSETS(__vec8_i64, int64_t, __vec8_i64, __scatter_base_offsets64_i64)
+SCATTER_BASE_OFFSETS(__vec8_d,   double,  __vec8_i32, __scatter_base_offsets32_double)
+SCATTER_BASE_OFFSETS(__vec8_d,   double,  __vec8_i64, __scatter_base_offsets64_double)
+
+#define SCATTER_GENERAL(VTYPE, STYPE, PTYPE, FUNC)                      \
+static FORCEINLINE void FUNC(PTYPE ptrs, VTYPE val, __vec8_i1 mask) {   \
+    uint32_t m = _mm256_movemask_ps(mask.v);                            \
+    while (m != 0) {                                                    \
+        int i = __count_trailing_zeros_i32(m);                          \
+        m &= m - 1;                                                     \
+        STYPE *ptr = (STYPE *)(uintptr_t)__extract_element(ptrs, i);    \
+        *ptr = __extract_element(val, i);                               \
+    }                                                                   \
+}
+
+SCATTER_GENERAL(__vec8_i8,  int8_t,  __vec8_i32, __scatter32_i8)
+SCATTER_GENERAL(__vec8_i8,  int8_t,  __vec8_i64, __scatter64_i8)
+SCATTER_GENERAL(__vec8_i16, int16_t, __vec8_i32, __scatter32_i16)
+SCATTER_GENERAL(__vec8_i16, int16_t, __vec8_i64, __scatter64_i16)
+SCATTER_GENERAL(__vec8_i32, int32_t, __vec8_i32, __scatter32_i32)
+SCATTER_GENERAL(__vec8_i32, int32_t, __vec8_i64, __scatter64_i32)
+SCATTER_GENERAL(__vec8_f,   float,   __vec8_i32, __scatter32_float)
+SCATTER_GENERAL(__vec8_f,   float,   __vec8_i64, __scatter64_float)
+SCATTER_GENERAL(__vec8_i64, int64_t, __vec8_i32, __scatter32_i64)
+SCATTER_GENERAL(__vec8_i64, int64_t, __vec8_i64, __scatter64_i64)
+SCATTER_GENERAL(__vec8_d,   double,  __vec8_i32, __scatter32_double)
+SCATTER_GENERAL(__vec8_d,   double,  __vec8_i64, __scatter64_double)
+
+///////////////////////////////////////////////////////////////////////////
+// packed load/store
+
+// Mask of the first count lanes.
+static FORCEINLINE __m256i lFirstLanes(int count) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(count),
+                              _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+static FORCEINLINE int32_t __packed_load_active(int32_t *ptr, __vec8_i32 *val,
+                                                __vec8_i1 mask) {
+    uint32_t m = _mm256_movemask_ps(mask.v);
+    int count = _mm_popcnt_u32(m);
+#if defined(__BMI2__) && (defined(__x86_64__) || defined(_M_X64))
+    // Load the first count values and then permute them out to the
+    // active lanes: depositing the byte sequence 0, 1, 2, ... into the
+    // bytes of the active lanes gives each one the index of its value.
+    __m256i loaded = _mm256_maskload_epi32((const int *)ptr, lFirstLanes(count));
+    uint64_t laneBytes = _pdep_u64(m, 0x0101010101010101ULL) * 0xff;
+    uint64_t indices = _pdep_u64(0x0706050403020100ULL, laneBytes);
+    __m256i perm = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128((int64_t)indices));
+    __m256i expanded = _mm256_permutevar8x32_epi32(loaded, perm);
+    val->v = __select(mask, __vec8_i32(expanded), *val).v;
+#else
+    int n = 0;
+    while (m != 0) {
+        int i = __count_trailing_zeros_i32(m);
+        m &= m - 1;
+        __insert_element(val, i, ptr[n++]);
+    }
+#endif
+    return count;
+}
+
+static FORCEINLINE int32_t __packed_store_active(int32_t *ptr, __vec8_i32 val,
+                                                 __vec8_i1 mask) {
+    uint32_t m = _mm256_movemask_ps(mask.v);
+    int count = _mm_popcnt_u32(m);
+#if defined(__BMI2__) && (defined(__x86_64__) || defined(_M_X64))
+    // Compress the indices of the active lanes down to the first count
+    // bytes, permute the values accordingly, and store only those.
+    uint64_t laneBytes = _pdep_u64(m, 0x0101010101010101ULL) * 0xff;
+    uint64_t indices = _pext_u64(0x0706050403020100ULL, laneBytes);
+    __m256i perm = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128((int64_t)indices));
+    __m256i packed = _mm256_permutevar8x32_epi32(val.v, perm);
+    _mm256_maskstore_epi32((int *)ptr, lFirstLanes(count), packed);
+#else
+    int n = 0;
+    while (m != 0) {
+        int i = __count_trailing_zeros_i32(m);
+        m &= m - 1;
+        ptr[n++] = __extract_element(val, i);
+    }
+#endif
+    return count;
+}
+
+static FORCEINLINE int32_t __packed_store_active2(int32_t *ptr, __vec8_i32 val,
+                                                  __vec8_i1 mask) {
+    return __packed_store_active(ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_load_active(uint32_t *ptr, __vec8_i32 *val,
+                                                __vec8_i1 mask) {
+    return __packed_load_active((int32_t *)ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_store_active(uint32_t *ptr, __vec8_i32 val,
+                                                 __vec8_i1 mask) {
+    return __packed_store_active((int32_t *)ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_store_active2(uint32_t *ptr, __vec8_i32 val,
+                                                  __vec8_i1 mask) {
+    return __packed_store_active2((int32_t *)ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_load_active_i64(int64_t *ptr, __vec8_i64 *val,
+                                                    __vec8_i1 mask) {
+    uint32_t m = _mm256_movemask_ps(mask.v);
+    int count = 0;
+    while (m != 0) {
+        int i = __count_trailing_zeros_i32(m);
+        m &= m - 1;
+        __insert_element(val, i, ptr[count++]);
+    }
+    return count;
+}
+
+static FORCEINLINE int32_t __packed_store_active_i64(int64_t *ptr, __vec8_i64 val,
+                                                     __vec8_i1 mask) {
+    uint32_t m = _mm256_movemask_ps(mask.v);
+    int count = 0;
+    while (m != 0) {
+        int i = __count_trailing_zeros_i32(m);
+        m &= m - 1;
+        ptr[count++] = __extract_element(val, i);
+    }
+    return count;
+}
+
+static FORCEINLINE int32_t __packed_load_active_i64(uint64_t *ptr, __vec8_i64 *val,
+                                                    __vec8_i1 mask) {
+    return __packed_load_active_i64((int64_t *)ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_store_active_i64(uint64_t *ptr, __vec8_i64 val,
+                                                     __vec8_i1 mask) {
+    return __packed_store_active_i64((int64_t *)ptr, val, mask);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// aos/soa
+
+static FORCEINLINE void __soa_to_aos3_float(__vec8_f v0, __vec8_f v1, __vec8_f v2,
+                                            float *ptr) {
+    for (int i = 0; i < 8; ++i) {
+        *ptr++ = __extract_element(v0, i);
+        *ptr++ = __extract_element(v1, i);
+        *ptr++ = __extract_element(v2, i);
+    }
+}
+
+static FORCEINLINE void __aos_to_soa3_float(float *ptr, __vec8_f *out0,
+                                            __vec8_f *out1, __vec8_f *out2) {
+    const __m256i idx = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    out0->v = _mm256_i32gather_ps(ptr, idx, 4);
+    out1->v = _mm256_i32gather_ps(ptr + 1, idx, 4);
+    out2->v = _mm256_i32gather_ps(ptr + 2, idx, 4);
+}
+
+static FORCEINLINE void __soa_to_aos4_float(__vec8_f v0, __vec8_f v1, __vec8_f v2,
+                                            __vec8_f v3, float *ptr) {
+    // 4x4 transpose within each 128-bit half, then reassemble the halves.
+    __m256 t0 = _mm256_unpacklo_ps(v0.v, v1.v);
+    __m256 t1 = _mm256_unpackhi_ps(v0.v, v1.v);
+    __m256 t2 = _mm256_unpacklo_ps(v2.v, v3.v);
+    __m256 t3 = _mm256_unpackhi_ps(v2.v, v3.v);
+    __m256 b0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 b1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 b2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 b3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    _mm256_storeu_ps(ptr, _mm256_permute2f128_ps(b0, b1, 0x20));
+    _mm256_storeu_ps(ptr + 8, _mm256_permute2f128_ps(b2, b3, 0x20));
+    _mm256_storeu_ps(ptr + 16, _mm256_permute2f128_ps(b0, b1, 0x31));
+    _mm256_storeu_ps(ptr + 24, _mm256_permute2f128_ps(b2, b3, 0x31));
+}
+
+static FORCEINLINE void __aos_to_soa4_float(float *ptr, __vec8_f *out0, __vec8_f *out1,
+                                            __vec8_f *out2, __vec8_f *out3) {
+    __m256 a0 = _mm256_loadu_ps(ptr);
+    __m256 a1 = _mm256_loadu_ps(ptr + 8);
+    __m256 a2 = _mm256_loadu_ps(ptr + 16);
+    __m256 a3 = _mm256_loadu_ps(ptr + 24);
+    __m256 b0 = _mm256_permute2f128_ps(a0, a2, 0x20);
+    __m256 b1 = _mm256_permute2f128_ps(a0, a2, 0x31);
+    __m256 b2 = _mm256_permute2f128_ps(a1, a3, 0x20);
+    __m256 b3 = _mm256_permute2f128_ps(a1, a3, 0x31);
+    __m256 t0 = _mm256_unpacklo_ps(b0, b1);
+    __m256 t1 = _mm256_unpackhi_ps(b0, b1);
+    __m256 t2 = _mm256_unpacklo_ps(b2, b3);
+    __m256 t3 = _mm256_unpackhi_ps(b2, b3);
+    out0->v = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    out1->v = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    out2->v = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    out3->v = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+///////////////////////////////////////////////////////////////////////////
+// prefetch
+
+static FORCEINLINE void __prefetch_read_uniform_1(unsigned char *ptr) {
+    _mm_prefetch((char *)ptr, _MM_HINT_T0);
+}
+
+static FORCEINLINE void __prefetch_read_uniform_2(unsigned char *ptr) {
+    _mm_prefetch((char *)ptr, _MM_HINT_T1);
+}
+
+static FORCEINLINE void __prefetch_read_uniform_3(unsigned char *ptr) {
+    _mm_prefetch((char *)ptr, _MM_HINT_T2);
+}
+
+static FORCEINLINE void __prefetch_read_uniform_nt(unsigned char *ptr) {
+    _mm_prefetch((char *)ptr, _MM_HINT_NTA);
+}
+
+#define PREFETCH_READ_VARYING(CACHE_NUM, HINT)                                                      \
+static FORCEINLINE void __prefetch_read_varying_##CACHE_NUM##_native(uint8_t *base, uint32_t scale, \
+                                                                   __vec8_i32 offsets, __vec8_i1 mask) { \
+    uint32_t m = _mm256_movemask_ps(mask.v);                                                        \
+    while (m != 0) {                                                                                \
+        int i = __count_trailing_zeros_i32(m);                                                      \
+        m &= m - 1;                                                                                 \
+        _mm_prefetch((char *)(base + scale * (int64_t)__extract_element(offsets, i)), HINT);        \
+    }                                                                                               \
+}                                                                                                   \
+static FORCEINLINE void __prefetch_read_varying_##CACHE_NUM(__vec8_i64 addr, __vec8_i1 mask) {      \
+    uint32_t m = _mm256_movemask_ps(mask.v);                                                        \
+    while (m != 0) {                                                                                \
+        int i = __count_trailing_zeros_i32(m);                                                      \
+        m &= m - 1;                                                                                 \
+        _mm_prefetch((char *)(uintptr_t)__extract_element(addr, i), HINT);                          \
+    }                                                                                               \
+}
+
+PREFETCH_READ_VARYING(1, _MM_HINT_T0)
+PREFETCH_READ_VARYING(2, _MM_HINT_T1)
+PREFETCH_READ_VARYING(3, _MM_HINT_T2)
+PREFETCH_READ_VARYING(nt, _MM_HINT_NTA)
+
+///////////////////////////////////////////////////////////////////////////
+// atomics
+
+static FORCEINLINE uint32_t __atomic_add(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedAdd((LONG volatile *)p, v) - v;
+#else
+    return __sync_fetch_and_add(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_sub(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedAdd((LONG volatile *)p, -v) + v;
+#else
+    return __sync_fetch_and_sub(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_and(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedAnd((LONG volatile *)p, v);
+#else
+    return __sync_fetch_and_and(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_or(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedOr((LONG volatile *)p, v);
+#else
+    return __sync_fetch_and_or(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_xor(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedXor((LONG volatile *)p, v);
+#else
+    return __sync_fetch_and_xor(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_min(uint32_t *p, uint32_t v) {
+    int32_t old, min;
+    do {
+        old = *((volatile int32_t *)p);
+        min = (old < (int32_t)v) ? old : (int32_t)v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange((LONG volatile *)p, min, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, min) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint32_t __atomic_max(uint32_t *p, uint32_t v) {
+    int32_t old, max;
+    do {
+        old = *((volatile int32_t *)p);
+        max = (old > (int32_t)v) ? old : (int32_t)v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange((LONG volatile *)p, max, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, max) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint32_t __atomic_umin(uint32_t *p, uint32_t v) {
+    uint32_t old, min;
+    do {
+        old = *((volatile uint32_t *)p);
+        min = (old < v) ? old : v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange((LONG volatile *)p, min, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, min) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint32_t __atomic_umax(uint32_t *p, uint32_t v) {
+    uint32_t old, max;
+    do {
+        old = *((volatile uint32_t *)p);
+        max = (old > v) ? old : v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange((LONG volatile *)p, max, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, max) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint32_t __atomic_xchg(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedExchange((LONG volatile *)p, v);
+#else
+    return __sync_lock_test_and_set(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_cmpxchg(uint32_t *p, uint32_t cmpval,
+                                             uint32_t newval) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange((LONG volatile *)p, newval, cmpval);
+#else
+    return __sync_val_compare_and_swap(p, cmpval, newval);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_add(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedAdd64((LONGLONG volatile *)p, v) - v;
+#else
+    return __sync_fetch_and_add(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_sub(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedAdd64((LONGLONG volatile *)p, -v) + v;
+#else
+    return __sync_fetch_and_sub(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_and(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedAnd64((LONGLONG volatile *)p, v);
+#else
+    return __sync_fetch_and_and(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_or(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedOr64((LONGLONG volatile *)p, v);
+#else
+    return __sync_fetch_and_or(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_xor(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedXor64((LONGLONG volatile *)p, v);
+#else
+    return __sync_fetch_and_xor(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_min(uint64_t *p, uint64_t v) {
+    int64_t old, min;
+    do {
+        old = *((volatile int64_t *)p);
+        min = (old < (int64_t)v) ? old : (int64_t)v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange64((LONGLONG volatile *)p, min, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, min) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint64_t __atomic_max(uint64_t *p, uint64_t v) {
+    int64_t old, max;
+    do {
+        old = *((volatile int64_t *)p);
+        max = (old > (int64_t)v) ? old : (int64_t)v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange64((LONGLONG volatile *)p, max, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, max) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint64_t __atomic_umin(uint64_t *p, uint64_t v) {
+    uint64_t old, min;
+    do {
+        old = *((volatile uint64_t *)p);
+        min = (old < v) ? old : v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange64((LONGLONG volatile *)p, min, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, min) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint64_t __atomic_umax(uint64_t *p, uint64_t v) {
+    uint64_t old, max;
+    do {
+        old = *((volatile uint64_t *)p);
+        max = (old > v) ? old : v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange64((LONGLONG volatile *)p, max, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, max) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint64_t __atomic_xchg(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedExchange64((LONGLONG volatile *)p, v);
+#else
+    return __sync_lock_test_and_set(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_cmpxchg(uint64_t *p, uint64_t cmpval,
+                                             uint64_t newval) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange64((LONGLONG volatile *)p, newval, cmpval);
+#else
+    return __sync_val_compare_and_swap(p, cmpval, newval);
+#endif
+}
+
+#ifdef WIN32
+#include <windows.h>
+#define __clock __rdtsc
+#else // WIN32
+static FORCEINLINE uint64_t __clock() {
+  uint32_t low, high;
+#ifdef __x86_64
+  __asm__ __volatile__ ("xorl %%eax,%%eax \n    cpuid"
+                        ::: "%rax", "%rbx", "%rcx", "%rdx" );
+#else
+  __asm__ __volatile__ ("xorl %%eax,%%eax \n    cpuid"
+                        ::: "%eax", "%ebx", "%ecx", "%edx" );
+#endif
+  __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+  return (uint64_t)high << 32 | low;
+}
+#endif // !WIN32
+
+///////////////////////////////////////////////////////////////////////////
+// Transcendentals
+
+#define TRANSCENDENTALS(op) \
+static FORCEINLINE __vec8_f __##op##_varying_float(__vec8_f a) {\
+    float r[8];\
+    for (int i = 0; i < 8; ++i)\
+        r[i] = op##f(__extract_element(a, i));\
+    return __vec8_f(r);\
+}\
+static FORCEINLINE float __##op##_uniform_float(float a) {\
+    return op##f(a);\
+}\
+static FORCEINLINE __vec8_d __##op##_varying_double(__vec8_d a) {\
+    double r[8];\
+    for (int i = 0; i < 8; ++i)\
+        r[i] = op(__extract_element(a, i));\
+    return __vec8_d(r);\
+}\
+static FORCEINLINE double __##op##_uniform_double(double a) {\
+    return op(a);\
+}
+
+TRANSCENDENTALS(log)
+TRANSCENDENTALS(exp)
+
+static FORCEINLINE __vec8_f __pow_varying_float(__vec8_f a, __vec8_f b) {
+    float r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = powf(__extract_element(a, i), __extract_element(b, i));
+    return __vec8_f(r);
+}
+static FORCEINLINE float __pow_uniform_float(float a, float b) {
+    return powf(a, b);
+}
+static FORCEINLINE __vec8_d __pow_varying_double(__vec8_d a, __vec8_d b) {
+    double r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = pow(__extract_element(a, i), __extract_element(b, i));
+    return __vec8_d(r);
+}
+static FORCEINLINE double __pow_uniform_double(double a, double b) {
+    return pow(a, b);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Trigonometry
+
+TRANSCENDENTALS(sin)
+TRANSCENDENTALS(asin)
+TRANSCENDENTALS(cos)
+TRANSCENDENTALS(acos)
+TRANSCENDENTALS(tan)
+TRANSCENDENTALS(atan)
+
+static FORCEINLINE __vec8_f __atan2_varying_float(__vec8_f a, __vec8_f b) {
+    float r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = atan2f(__extract_element(a, i), __extract_element(b, i));
+    return __vec8_f(r);
+}
+static FORCEINLINE float __atan2_uniform_float(float a, float b) {
+    return atan2f(a, b);
+}
+static FORCEINLINE __vec8_d __atan2_varying_double(__vec8_d a, __vec8_d b) {
+    double r[8];
+    for (int i = 0; i < 8; ++i)
+        r[i] = atan2(__extract_element(a, i), __extract_element(b, i));
+    return __vec8_d(r);
+}
+static FORCEINLINE double __atan2_uniform_double(double a, double b) {
+    return atan2(a, b);
+}
+
+static FORCEINLINE void __sincos_varying_float(__vec8_f x, __vec8_f * _sin, __vec8_f * _cos) {
+    float s[8], c[8];
+    for (int i = 0; i < 8; ++i)
+        sincosf(__extract_element(x, i), s + i, c + i);
+    *_sin = __vec8_f(s);
+    *_cos = __vec8_f(c);
+}
+static FORCEINLINE void __sincos_uniform_float(float x, float *_sin, float *_cos) {
+    sincosf(x, _sin, _cos);
+}
+static FORCEINLINE void __sincos_varying_double(__vec8_d x, __vec8_d * _sin, __vec8_d * _cos) {
+    double s[8], c[8];
+    for (int i = 0; i < 8; ++i)
+        sincos(__extract_element(x, i), s + i, c + i);
+    *_sin = __vec8_d(s);
+    *_cos = __vec8_d(c);
+}
+static FORCEINLINE void __sincos_uniform_double(double x, double *_sin, double *_cos) {
+    sincos(x, _sin, _cos);
+}
+
+#undef FORCEINLINE
@@ -1701,6 +1701,46 @@ static FORCEINLINE int32_t __packed_store_active2(uint32_t *ptr,
 }
 
 
+static FORCEINLINE int32_t __packed_load_active_i64(int64_t *ptr, __vec64_i64 *val,
+                                                    __vec64_i1 mask) {
+    int count = 0;
+    for (int i = 0; i < 64; ++i) {
+        if ((mask.v & (1ull << i)) != 0) {
+            val->v[i] = *ptr++;
+            ++count;
+        }
+    }
+    return count;
+}
+
+
+static FORCEINLINE int32_t __packed_store_active_i64(int64_t *ptr, __vec64_i64 val,
+                                                     __vec64_i1 mask) {
+    int count = 0;
+    for (int i = 0; i < 64; ++i) {
+        if ((mask.v & (1ull << i)) != 0) {
+            *ptr++ = val.v[i];
+            ++count;
+        }
+    }
+    return count;
+}
+
+
+static FORCEINLINE int32_t __packed_load_active_i64(uint64_t *ptr,
+                                                    __vec64_i64 *val,
+                                                    __vec64_i1 mask) {
+    return __packed_load_active_i64((int64_t *)ptr, val, mask);
+}
+
+
+static FORCEINLINE int32_t __packed_store_active_i64(uint64_t *ptr,
+                                                     __vec64_i64 val,
+                                                     __vec64_i1 mask) {
+    return __packed_store_active_i64((int64_t *)ptr, val, mask);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 // aos/soa
 
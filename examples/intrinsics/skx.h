@@ -0,0 +1,2729 @@
+/*
+  Copyright (c) 2010-2016, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+  Implementation of the "generic-16" target's vector types and operations
+  in terms of the AVX-512 intrinsics supported by Skylake-SP and later
+  processors (AVX512F, AVX512BW, AVX512DQ and AVX512VL), for use with
+  "ispc --target=generic-16 --emit-c++ --c++-include-file=skx.h".
+
+  Masks are kept in the AVX-512 mask registers, with one bit per program
+  instance, so that comparisons produce them and selects, masked loads and
+  stores, gathers and scatters consume them directly.  8- and 16-bit
+  elements live in SSE and AVX registers and use the AVX512BW/VL masked
+  instructions; 64-bit integers get native multiplies, arithmetic shifts,
+  min/max and conversions to and from floating point; and the packed loads
+  and stores used by ispc's packed_load_active() and packed_store_active()
+  use the expand and compress instructions.
+*/
+
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+#include <immintrin.h>
+
+#if !(defined(__AVX512F__) && defined(__AVX512BW__) && \
+      defined(__AVX512DQ__) && defined(__AVX512VL__)) && !defined(_MSC_VER)
+#error "AVX-512 (F, BW, DQ and VL) must be enabled in the C++ compiler to use this header."
+#endif // !AVX-512 && !msvc
+
+#ifdef _MSC_VER
+#define FORCEINLINE __forceinline
+#else
+#define FORCEINLINE __attribute__((always_inline)) inline
+#endif
+
+typedef float __vec1_f;
+typedef double __vec1_d;
+typedef int8_t __vec1_i8;
+typedef int16_t __vec1_i16;
+typedef int32_t __vec1_i32;
+typedef int64_t __vec1_i64;
+
+struct __vec16_i1 {
+    FORCEINLINE __vec16_i1() { }
+    FORCEINLINE __vec16_i1(__mmask16 vv) : v(vv) { }
+    FORCEINLINE __vec16_i1(int v0, int v1, int v2, int v3,
+                           int v4, int v5, int v6, int v7,
+                           int v8, int v9, int v10, int v11,
+                           int v12, int v13, int v14, int v15) {
+        v = (__mmask16)((v0 ? 1 : 0) | (v1 ? 2 : 0) |
+                        (v2 ? 4 : 0) | (v3 ? 8 : 0) |
+                        (v4 ? 0x10 : 0) | (v5 ? 0x20 : 0) |
+                        (v6 ? 0x40 : 0) | (v7 ? 0x80 : 0) |
+                        (v8 ? 0x100 : 0) | (v9 ? 0x200 : 0) |
+                        (v10 ? 0x400 : 0) | (v11 ? 0x800 : 0) |
+                        (v12 ? 0x1000 : 0) | (v13 ? 0x2000 : 0) |
+                        (v14 ? 0x4000 : 0) | (v15 ? 0x8000 : 0));
+    }
+
+    __mmask16 v;
+};
+
+struct __vec16_f {
+    FORCEINLINE __vec16_f() { }
+    FORCEINLINE __vec16_f(__m512 vv) : v(vv) { }
+    FORCEINLINE __vec16_f(float v0, float v1, float v2, float v3,
+                          float v4, float v5, float v6, float v7,
+                          float v8, float v9, float v10, float v11,
+                          float v12, float v13, float v14, float v15) {
+        v = _mm512_setr_ps(v0, v1, v2, v3, v4, v5, v6, v7,
+                           v8, v9, v10, v11, v12, v13, v14, v15);
+    }
+    FORCEINLINE __vec16_f(const float *p) {
+        v = _mm512_loadu_ps(p);
+    }
+
+    __m512 v;
+};
+
+struct __vec16_d {
+    FORCEINLINE __vec16_d() { }
+    FORCEINLINE __vec16_d(__m512d a, __m512d b) { v[0] = a; v[1] = b; }
+    FORCEINLINE __vec16_d(double v0, double v1, double v2, double v3,
+                          double v4, double v5, double v6, double v7,
+                          double v8, double v9, double v10, double v11,
+                          double v12, double v13, double v14, double v15) {
+        v[0] = _mm512_setr_pd(v0, v1, v2, v3, v4, v5, v6, v7);
+        v[1] = _mm512_setr_pd(v8, v9, v10, v11, v12, v13, v14, v15);
+    }
+    FORCEINLINE __vec16_d(const double *p) {
+        v[0] = _mm512_loadu_pd(p);
+        v[1] = _mm512_loadu_pd(p + 8);
+    }
+
+    __m512d v[2];
+};
+
+struct __vec16_i32 {
+    FORCEINLINE __vec16_i32() { }
+    FORCEINLINE __vec16_i32(__m512i vv) : v(vv) { }
+    FORCEINLINE __vec16_i32(int32_t v0, int32_t v1, int32_t v2, int32_t v3,
+                            int32_t v4, int32_t v5, int32_t v6, int32_t v7,
+                            int32_t v8, int32_t v9, int32_t v10, int32_t v11,
+                            int32_t v12, int32_t v13, int32_t v14, int32_t v15) {
+        v = _mm512_setr_epi32(v0, v1, v2, v3, v4, v5, v6, v7,
+                              v8, v9, v10, v11, v12, v13, v14, v15);
+    }
+    FORCEINLINE __vec16_i32(const int32_t *p) {
+        v = _mm512_loadu_si512((const void *)p);
+    }
+
+    __m512i v;
+};
+
+struct __vec16_i64 {
+    FORCEINLINE __vec16_i64() { }
+    FORCEINLINE __vec16_i64(__m512i a, __m512i b) { v[0] = a; v[1] = b; }
+    FORCEINLINE __vec16_i64(int64_t v0, int64_t v1, int64_t v2, int64_t v3,
+                            int64_t v4, int64_t v5, int64_t v6, int64_t v7,
+                            int64_t v8, int64_t v9, int64_t v10, int64_t v11,
+                            int64_t v12, int64_t v13, int64_t v14, int64_t v15) {
+        v[0] = _mm512_setr_epi64(v0, v1, v2, v3, v4, v5, v6, v7);
+        v[1] = _mm512_setr_epi64(v8, v9, v10, v11, v12, v13, v14, v15);
+    }
+    FORCEINLINE __vec16_i64(const int64_t *p) {
+        v[0] = _mm512_loadu_si512((const void *)p);
+        v[1] = _mm512_loadu_si512((const void *)(p + 8));
+    }
+
+    __m512i v[2];
+};
+
+struct __vec16_i16 {
+    FORCEINLINE __vec16_i16() { }
+    FORCEINLINE __vec16_i16(__m256i vv) : v(vv) { }
+    FORCEINLINE __vec16_i16(int16_t v0, int16_t v1, int16_t v2, int16_t v3,
+                            int16_t v4, int16_t v5, int16_t v6, int16_t v7,
+                            int16_t v8, int16_t v9, int16_t v10, int16_t v11,
+                            int16_t v12, int16_t v13, int16_t v14, int16_t v15) {
+        v = _mm256_setr_epi16(v0, v1, v2, v3, v4, v5, v6, v7,
+                              v8, v9, v10, v11, v12, v13, v14, v15);
+    }
+    FORCEINLINE __vec16_i16(const int16_t *p) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+    }
+
+    __m256i v;
+};
+
+struct __vec16_i8 {
+    FORCEINLINE __vec16_i8() { }
+    FORCEINLINE __vec16_i8(__m128i vv) : v(vv) { }
+    FORCEINLINE __vec16_i8(int8_t v0, int8_t v1, int8_t v2, int8_t v3,
+                           int8_t v4, int8_t v5, int8_t v6, int8_t v7,
+                           int8_t v8, int8_t v9, int8_t v10, int8_t v11,
+                           int8_t v12, int8_t v13, int8_t v14, int8_t v15) {
+        v = _mm_setr_epi8(v0, v1, v2, v3, v4, v5, v6, v7,
+                          v8, v9, v10, v11, v12, v13, v14, v15);
+    }
+    FORCEINLINE __vec16_i8(const int8_t *p) {
+        v = _mm_loadu_si128((const __m128i *)p);
+    }
+
+    __m128i v;
+};
+
+
+///////////////////////////////////////////////////////////////////////////
+// Utility functions
+
+// The halves of a mask that go with the two vectors of 64-bit elements.
+static FORCEINLINE __mmask8 lMaskLo(__vec16_i1 m) {
+    return (__mmask8)m.v;
+}
+
+static FORCEINLINE __mmask8 lMaskHi(__vec16_i1 m) {
+    return (__mmask8)(m.v >> 8);
+}
+
+static FORCEINLINE __vec16_i1 lMaskCombine(__mmask8 lo, __mmask8 hi) {
+    return (__mmask16)(lo | (hi << 8));
+}
+
+static FORCEINLINE __m512i lCombine256(__m256i lo, __m256i hi) {
+    return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+}
+
+static FORCEINLINE __m512 lCombine256(__m256 lo, __m256 hi) {
+    return _mm512_insertf32x8(_mm512_castps256_ps512(lo), hi, 1);
+}
+
+static FORCEINLINE __m256i lCombine128(__m128i lo, __m128i hi) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+static FORCEINLINE __m256i lLo256(__m512i v) {
+    return _mm512_castsi512_si256(v);
+}
+
+static FORCEINLINE __m256i lHi256(__m512i v) {
+    return _mm512_extracti64x4_epi64(v, 1);
+}
+
+static FORCEINLINE __m512i lIota32() {
+    return _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                             8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+static FORCEINLINE float __floatbits(int v) {
+    union {
+        int i;
+        float f;
+    } u;
+    u.i = v;
+    return u.f;
+}
+
+static FORCEINLINE int __intbits(float v) {
+    union {
+        float f;
+        int i;
+    } u;
+    u.f = v;
+    return u.i;
+}
+
+template <typename T>
+static FORCEINLINE T __select(bool test, T a, T b) {
+    return test ? a : b;
+}
+
+#define INSERT_EXTRACT(VTYPE, STYPE)                                  \
+static FORCEINLINE STYPE __extract_element(VTYPE v, int index) {      \
+    return ((STYPE *)&v)[index];                                      \
+}                                                                     \
+static FORCEINLINE void __insert_element(VTYPE *v, int index, STYPE val) { \
+    ((STYPE *)v)[index] = val;                                        \
+}
+
+INSERT_EXTRACT(__vec1_i8, int8_t)
+INSERT_EXTRACT(__vec1_i16, int16_t)
+INSERT_EXTRACT(__vec1_i32, int32_t)
+INSERT_EXTRACT(__vec1_i64, int64_t)
+INSERT_EXTRACT(__vec1_f, float)
+INSERT_EXTRACT(__vec1_d, double)
+
+// Access individual lanes through memcpy() rather than by casting the
+// vector's address, so that the accesses are valid under strict aliasing.
+template <typename STYPE, typename VTYPE>
+static FORCEINLINE STYPE lExtractLane(const VTYPE *v, int index) {
+    STYPE ret;
+    memcpy(&ret, (const char *)v + index * sizeof(STYPE), sizeof(STYPE));
+    return ret;
+}
+
+template <typename STYPE, typename VTYPE>
+static FORCEINLINE void lInsertLane(VTYPE *v, int index, STYPE val) {
+    memcpy((char *)v + index * sizeof(STYPE), &val, sizeof(STYPE));
+}
+
+static FORCEINLINE bool __extract_element(const __vec16_i1 &v, int index) {
+    return (v.v & (1 << index)) ? true : false;
+}
+
+static FORCEINLINE void __insert_element(__vec16_i1 *v, int index, bool val) {
+    if (val)
+        v->v = (__mmask16)(v->v | (1 << index));
+    else
+        v->v = (__mmask16)(v->v & ~(1 << index));
+}
+
+static FORCEINLINE int8_t __extract_element(const __vec16_i8 &v, int index) {
+    return lExtractLane<int8_t>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec16_i8 *v, int index, int8_t val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE int16_t __extract_element(const __vec16_i16 &v, int index) {
+    return lExtractLane<int16_t>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec16_i16 *v, int index, int16_t val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE int32_t __extract_element(const __vec16_i32 &v, int index) {
+    return lExtractLane<int32_t>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec16_i32 *v, int index, int32_t val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE int64_t __extract_element(const __vec16_i64 &v, int index) {
+    return lExtractLane<int64_t>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec16_i64 *v, int index, int64_t val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE float __extract_element(const __vec16_f &v, int index) {
+    return lExtractLane<float>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec16_f *v, int index, float val) {
+    lInsertLane(v, index, val);
+}
+
+static FORCEINLINE double __extract_element(const __vec16_d &v, int index) {
+    return lExtractLane<double>(&v, index);
+}
+
+static FORCEINLINE void __insert_element(__vec16_d *v, int index, double val) {
+    lInsertLane(v, index, val);
+}
+
+#define CAST_BITS_SCALAR(TO, FROM)                  \
+static FORCEINLINE TO __cast_bits(TO, FROM v) {     \
+    union {                                         \
+    TO to;                                          \
+    FROM from;                                      \
+    } u;                                            \
+    u.from = v;                                     \
+    return u.to;                                    \
+}
+
+CAST_BITS_SCALAR(uint32_t, float)
+CAST_BITS_SCALAR(int32_t, float)
+CAST_BITS_SCALAR(float, uint32_t)
+CAST_BITS_SCALAR(float, int32_t)
+CAST_BITS_SCALAR(uint64_t, double)
+CAST_BITS_SCALAR(int64_t, double)
+CAST_BITS_SCALAR(double, uint64_t)
+CAST_BITS_SCALAR(double, int64_t)
+
+#define CAST_BITS_TRIVIAL(TYPE)                  \
+static FORCEINLINE TYPE __cast_bits(TYPE, TYPE v) { return v; }
+
+CAST_BITS_TRIVIAL(float)
+CAST_BITS_TRIVIAL(double)
+CAST_BITS_TRIVIAL(int8_t)
+CAST_BITS_TRIVIAL(uint8_t)
+CAST_BITS_TRIVIAL(int16_t)
+CAST_BITS_TRIVIAL(uint16_t)
+CAST_BITS_TRIVIAL(int32_t)
+CAST_BITS_TRIVIAL(uint32_t)
+CAST_BITS_TRIVIAL(int64_t)
+CAST_BITS_TRIVIAL(uint64_t)
+CAST_BITS_TRIVIAL(__vec16_f)
+CAST_BITS_TRIVIAL(__vec16_d)
+CAST_BITS_TRIVIAL(__vec16_i8)
+CAST_BITS_TRIVIAL(__vec16_i16)
+CAST_BITS_TRIVIAL(__vec16_i32)
+CAST_BITS_TRIVIAL(__vec16_i64)
+
+static FORCEINLINE __vec16_f __cast_bits(__vec16_f, __vec16_i32 v) {
+    return _mm512_castsi512_ps(v.v);
+}
+
+static FORCEINLINE __vec16_i32 __cast_bits(__vec16_i32, __vec16_f v) {
+    return _mm512_castps_si512(v.v);
+}
+
+static FORCEINLINE __vec16_d __cast_bits(__vec16_d, __vec16_i64 v) {
+    return __vec16_d(_mm512_castsi512_pd(v.v[0]), _mm512_castsi512_pd(v.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __cast_bits(__vec16_i64, __vec16_d v) {
+    return __vec16_i64(_mm512_castpd_si512(v.v[0]), _mm512_castpd_si512(v.v[1]));
+}
+
+// Comparisons map directly to the AVX-512 compare-into-mask instructions,
+// and the "_and_mask" variants to their masked forms.
+#define CMP_OP(TYPE, NAME, CMP, MASK_CMP, PRED)                             \
+static FORCEINLINE __vec16_i1 NAME(TYPE a, TYPE b) {                        \
+    return CMP(a.v, b.v, PRED);                                             \
+}                                                                           \
+static FORCEINLINE __vec16_i1 NAME##_and_mask(TYPE a, TYPE b, __vec16_i1 m) { \
+    return MASK_CMP(m.v, a.v, b.v, PRED);                                   \
+}
+
+// OP is CMP_OP, or CMP_OP64 below for the types split across two vectors.
+#define CMP_INT(OP, TYPE, SUFFIX, CMP_S, MASK_CMP_S, CMP_U, MASK_CMP_U)         \
+OP(TYPE, __equal_##SUFFIX, CMP_S, MASK_CMP_S, _MM_CMPINT_EQ)                    \
+OP(TYPE, __not_equal_##SUFFIX, CMP_S, MASK_CMP_S, _MM_CMPINT_NE)                \
+OP(TYPE, __signed_less_than_##SUFFIX, CMP_S, MASK_CMP_S, _MM_CMPINT_LT)         \
+OP(TYPE, __signed_less_equal_##SUFFIX, CMP_S, MASK_CMP_S, _MM_CMPINT_LE)        \
+OP(TYPE, __signed_greater_than_##SUFFIX, CMP_S, MASK_CMP_S, _MM_CMPINT_NLE)     \
+OP(TYPE, __signed_greater_equal_##SUFFIX, CMP_S, MASK_CMP_S, _MM_CMPINT_NLT)    \
+OP(TYPE, __unsigned_less_than_##SUFFIX, CMP_U, MASK_CMP_U, _MM_CMPINT_LT)       \
+OP(TYPE, __unsigned_less_equal_##SUFFIX, CMP_U, MASK_CMP_U, _MM_CMPINT_LE)      \
+OP(TYPE, __unsigned_greater_than_##SUFFIX, CMP_U, MASK_CMP_U, _MM_CMPINT_NLE)   \
+OP(TYPE, __unsigned_greater_equal_##SUFFIX, CMP_U, MASK_CMP_U, _MM_CMPINT_NLT)
+
+#define CMP_FLOAT(OP, TYPE, SUFFIX, CMP, MASK_CMP)                              \
+OP(TYPE, __equal_##SUFFIX, CMP, MASK_CMP, _CMP_EQ_OQ)                           \
+OP(TYPE, __not_equal_##SUFFIX, CMP, MASK_CMP, _CMP_NEQ_UQ)                      \
+OP(TYPE, __less_than_##SUFFIX, CMP, MASK_CMP, _CMP_LT_OQ)                       \
+OP(TYPE, __less_equal_##SUFFIX, CMP, MASK_CMP, _CMP_LE_OQ)                      \
+OP(TYPE, __greater_than_##SUFFIX, CMP, MASK_CMP, _CMP_GT_OQ)                    \
+OP(TYPE, __greater_equal_##SUFFIX, CMP, MASK_CMP, _CMP_GE_OQ)                   \
+OP(TYPE, __ordered_##SUFFIX, CMP, MASK_CMP, _CMP_ORD_Q)                         \
+OP(TYPE, __unordered_##SUFFIX, CMP, MASK_CMP, _CMP_UNORD_Q)
+
+// The 64-bit types are split across two vectors, so their comparisons
+// produce two 8-bit masks.
+
+#define CMP_OP64(TYPE, NAME, CMP, MASK_CMP, PRED)                           \
+static FORCEINLINE __vec16_i1 NAME(TYPE a, TYPE b) {                        \
+    return lMaskCombine(CMP(a.v[0], b.v[0], PRED), CMP(a.v[1], b.v[1], PRED)); \
+}                                                                           \
+static FORCEINLINE __vec16_i1 NAME##_and_mask(TYPE a, TYPE b, __vec16_i1 m) { \
+    return lMaskCombine(MASK_CMP(lMaskLo(m), a.v[0], b.v[0], PRED),         \
+                        MASK_CMP(lMaskHi(m), a.v[1], b.v[1], PRED));        \
+}
+
+///////////////////////////////////////////////////////////////////////////
+// mask ops
+
+static FORCEINLINE uint64_t __movmsk(__vec16_i1 mask) {
+    return (uint64_t)mask.v;
+}
+
+static FORCEINLINE bool __any(__vec16_i1 mask) {
+    return mask.v != 0;
+}
+
+static FORCEINLINE bool __all(__vec16_i1 mask) {
+    return mask.v == 0xffff;
+}
+
+static FORCEINLINE bool __none(__vec16_i1 mask) {
+    return mask.v == 0;
+}
+
+static FORCEINLINE __vec16_i1 __equal_i1(__vec16_i1 a, __vec16_i1 b) {
+    return (__mmask16)~(a.v ^ b.v);
+}
+
+static FORCEINLINE __vec16_i1 __and(__vec16_i1 a, __vec16_i1 b) {
+    return (__mmask16)(a.v & b.v);
+}
+
+static FORCEINLINE __vec16_i1 __xor(__vec16_i1 a, __vec16_i1 b) {
+    return (__mmask16)(a.v ^ b.v);
+}
+
+static FORCEINLINE __vec16_i1 __or(__vec16_i1 a, __vec16_i1 b) {
+    return (__mmask16)(a.v | b.v);
+}
+
+static FORCEINLINE __vec16_i1 __not(__vec16_i1 a) {
+    return (__mmask16)~a.v;
+}
+
+static FORCEINLINE __vec16_i1 __and_not1(__vec16_i1 a, __vec16_i1 b) {
+    return (__mmask16)(~a.v & b.v);
+}
+
+static FORCEINLINE __vec16_i1 __and_not2(__vec16_i1 a, __vec16_i1 b) {
+    return (__mmask16)(a.v & ~b.v);
+}
+
+static FORCEINLINE __vec16_i1 __select(__vec16_i1 mask, __vec16_i1 a, __vec16_i1 b) {
+    return (__mmask16)((a.v & mask.v) | (b.v & ~mask.v));
+}
+
+template <int ALIGN> static FORCEINLINE __vec16_i1 __load(const __vec16_i1 *v) {
+    return *(const uint16_t *)v;
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec16_i1 *p, __vec16_i1 value) {
+    *(uint16_t *)p = value.v;
+}
+
+template <class RetVecType> __vec16_i1 __smear_i1(int v);
+template <> FORCEINLINE __vec16_i1 __smear_i1<__vec16_i1>(int v) {
+    return (__mmask16)(v ? 0xffff : 0);
+}
+
+template <class RetVecType> __vec16_i1 __setzero_i1();
+template <> FORCEINLINE __vec16_i1 __setzero_i1<__vec16_i1>() {
+    return (__mmask16)0;
+}
+
+template <class RetVecType> __vec16_i1 __undef_i1();
+template <> FORCEINLINE __vec16_i1 __undef_i1<__vec16_i1>() {
+    return __vec16_i1();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// int8
+
+static FORCEINLINE __vec16_i8 __add(__vec16_i8 a, __vec16_i8 b) {
+    return _mm_add_epi8(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i8 __sub(__vec16_i8 a, __vec16_i8 b) {
+    return _mm_sub_epi8(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i8 __mul(__vec16_i8 a, __vec16_i8 b) {
+    return _mm256_cvtepi16_epi8(_mm256_mullo_epi16(_mm256_cvtepi8_epi16(a.v),
+                                                   _mm256_cvtepi8_epi16(b.v)));
+}
+
+static FORCEINLINE __vec16_i8 __or(__vec16_i8 a, __vec16_i8 b) {
+    return _mm_or_si128(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i8 __and(__vec16_i8 a, __vec16_i8 b) {
+    return _mm_and_si128(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i8 __xor(__vec16_i8 a, __vec16_i8 b) {
+    return _mm_xor_si128(a.v, b.v);
+}
+
+// There are no 8-bit shifts; shift the elements widened to 16 bits.
+static FORCEINLINE __vec16_i8 __shl(__vec16_i8 a, __vec16_i8 b) {
+    return _mm256_cvtepi16_epi8(_mm256_sllv_epi16(_mm256_cvtepu8_epi16(a.v),
+                                                  _mm256_cvtepu8_epi16(b.v)));
+}
+
+static FORCEINLINE __vec16_i8 __shl(__vec16_i8 a, int32_t b) {
+    return _mm256_cvtepi16_epi8(_mm256_sll_epi16(_mm256_cvtepu8_epi16(a.v),
+                                                 _mm_cvtsi32_si128(b)));
+}
+
+static FORCEINLINE __vec16_i8 __lshr(__vec16_i8 a, __vec16_i8 b) {
+    return _mm256_cvtepi16_epi8(_mm256_srlv_epi16(_mm256_cvtepu8_epi16(a.v),
+                                                  _mm256_cvtepu8_epi16(b.v)));
+}
+
+static FORCEINLINE __vec16_i8 __lshr(__vec16_i8 a, int32_t b) {
+    return _mm256_cvtepi16_epi8(_mm256_srl_epi16(_mm256_cvtepu8_epi16(a.v),
+                                                 _mm_cvtsi32_si128(b)));
+}
+
+static FORCEINLINE __vec16_i8 __ashr(__vec16_i8 a, __vec16_i8 b) {
+    return _mm256_cvtepi16_epi8(_mm256_srav_epi16(_mm256_cvtepi8_epi16(a.v),
+                                                  _mm256_cvtepu8_epi16(b.v)));
+}
+
+static FORCEINLINE __vec16_i8 __ashr(__vec16_i8 a, int32_t b) {
+    return _mm256_cvtepi16_epi8(_mm256_sra_epi16(_mm256_cvtepi8_epi16(a.v),
+                                                 _mm_cvtsi32_si128(b)));
+}
+
+// There's no integer division instruction; small integers can be divided
+// exactly with single-precision floating point instead.
+static FORCEINLINE __vec16_i8 __udiv(__vec16_i8 a, __vec16_i8 b) {
+    __m512 fa = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(a.v));
+    __m512 fb = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(b.v));
+    return _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(_mm512_div_ps(fa, fb)));
+}
+
+static FORCEINLINE __vec16_i8 __sdiv(__vec16_i8 a, __vec16_i8 b) {
+    __m512 fa = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(a.v));
+    __m512 fb = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(b.v));
+    return _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(_mm512_div_ps(fa, fb)));
+}
+
+static FORCEINLINE __vec16_i8 __urem(__vec16_i8 a, __vec16_i8 b) {
+    return __sub(a, __mul(__udiv(a, b), b));
+}
+
+static FORCEINLINE __vec16_i8 __srem(__vec16_i8 a, __vec16_i8 b) {
+    return __sub(a, __mul(__sdiv(a, b), b));
+}
+
+CMP_INT(CMP_OP, __vec16_i8, i8, _mm_cmp_epi8_mask, _mm_mask_cmp_epi8_mask,
+                _mm_cmp_epu8_mask, _mm_mask_cmp_epu8_mask)
+
+static FORCEINLINE __vec16_i8 __select(__vec16_i1 mask, __vec16_i8 a, __vec16_i8 b) {
+    return _mm_mask_blend_epi8(mask.v, b.v, a.v);
+}
+
+template <class RetVecType> __vec16_i8 __smear_i8(int8_t v);
+template <> FORCEINLINE __vec16_i8 __smear_i8<__vec16_i8>(int8_t v) {
+    return _mm_set1_epi8(v);
+}
+
+template <class RetVecType> __vec16_i8 __setzero_i8();
+template <> FORCEINLINE __vec16_i8 __setzero_i8<__vec16_i8>() {
+    return _mm_setzero_si128();
+}
+
+template <class RetVecType> __vec16_i8 __undef_i8();
+template <> FORCEINLINE __vec16_i8 __undef_i8<__vec16_i8>() {
+    return __vec16_i8();
+}
+
+static FORCEINLINE __vec16_i8 __broadcast_i8(__vec16_i8 v, int index) {
+    return _mm_shuffle_epi8(v.v, _mm_set1_epi8((int8_t)(index & 15)));
+}
+
+static FORCEINLINE __m128i lIota8() {
+    return _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+static FORCEINLINE __vec16_i8 __rotate_i8(__vec16_i8 v, int delta) {
+    __m128i idx = _mm_and_si128(_mm_add_epi8(lIota8(), _mm_set1_epi8((int8_t)(delta & 15))),
+                                _mm_set1_epi8(15));
+    return _mm_shuffle_epi8(v.v, idx);
+}
+
+static FORCEINLINE __vec16_i8 __shift_i8(__vec16_i8 v, int delta) {
+    if (delta <= -16 || delta >= 16)
+        return _mm_setzero_si128();
+    __m128i idx = _mm_add_epi8(lIota8(), _mm_set1_epi8((int8_t)delta));
+    __mmask16 valid = _mm_cmplt_epu8_mask(idx, _mm_set1_epi8(16));
+    return _mm_maskz_shuffle_epi8(valid, v.v, idx);
+}
+
+static FORCEINLINE __vec16_i8 __shuffle_i8(__vec16_i8 v, __vec16_i32 index) {
+    __m128i idx = _mm512_cvtepi32_epi8(_mm512_and_si512(index.v, _mm512_set1_epi32(15)));
+    return _mm_shuffle_epi8(v.v, idx);
+}
+
+// Without AVX512VBMI there's no two-source byte permute; use the 16-bit
+// one on the elements widened to 16 bits.
+static FORCEINLINE __vec16_i8 __shuffle2_i8(__vec16_i8 v0, __vec16_i8 v1,
+                                            __vec16_i32 index) {
+    __m256i idx = _mm512_cvtepi32_epi16(index.v);
+    __m256i r = _mm256_permutex2var_epi16(_mm256_cvtepu8_epi16(v0.v), idx,
+                                          _mm256_cvtepu8_epi16(v1.v));
+    return _mm256_cvtepi16_epi8(r);
+}
+
+template <int ALIGN> static FORCEINLINE __vec16_i8 __load(const __vec16_i8 *v) {
+    return _mm_loadu_si128((const __m128i *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec16_i8 *p, __vec16_i8 value) {
+    _mm_storeu_si128((__m128i *)p, value.v);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// int16
+
+static FORCEINLINE __vec16_i16 __add(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_add_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __sub(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_sub_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __mul(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_mullo_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __or(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_or_si256(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __and(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_and_si256(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __xor(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_xor_si256(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __shl(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_sllv_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __shl(__vec16_i16 a, int32_t b) {
+    return _mm256_sll_epi16(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec16_i16 __lshr(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_srlv_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __lshr(__vec16_i16 a, int32_t b) {
+    return _mm256_srl_epi16(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec16_i16 __ashr(__vec16_i16 a, __vec16_i16 b) {
+    return _mm256_srav_epi16(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i16 __ashr(__vec16_i16 a, int32_t b) {
+    return _mm256_sra_epi16(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec16_i16 __udiv(__vec16_i16 a, __vec16_i16 b) {
+    __m512 fa = _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(a.v));
+    __m512 fb = _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(b.v));
+    return _mm512_cvtepi32_epi16(_mm512_cvttps_epi32(_mm512_div_ps(fa, fb)));
+}
+
+static FORCEINLINE __vec16_i16 __sdiv(__vec16_i16 a, __vec16_i16 b) {
+    __m512 fa = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(a.v));
+    __m512 fb = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(b.v));
+    return _mm512_cvtepi32_epi16(_mm512_cvttps_epi32(_mm512_div_ps(fa, fb)));
+}
+
+static FORCEINLINE __vec16_i16 __urem(__vec16_i16 a, __vec16_i16 b) {
+    return __sub(a, __mul(__udiv(a, b), b));
+}
+
+static FORCEINLINE __vec16_i16 __srem(__vec16_i16 a, __vec16_i16 b) {
+    return __sub(a, __mul(__sdiv(a, b), b));
+}
+
+CMP_INT(CMP_OP, __vec16_i16, i16, _mm256_cmp_epi16_mask, _mm256_mask_cmp_epi16_mask,
+                _mm256_cmp_epu16_mask, _mm256_mask_cmp_epu16_mask)
+
+static FORCEINLINE __vec16_i16 __select(__vec16_i1 mask, __vec16_i16 a, __vec16_i16 b) {
+    return _mm256_mask_blend_epi16(mask.v, b.v, a.v);
+}
+
+template <class RetVecType> __vec16_i16 __smear_i16(int16_t v);
+template <> FORCEINLINE __vec16_i16 __smear_i16<__vec16_i16>(int16_t v) {
+    return _mm256_set1_epi16(v);
+}
+
+template <class RetVecType> __vec16_i16 __setzero_i16();
+template <> FORCEINLINE __vec16_i16 __setzero_i16<__vec16_i16>() {
+    return _mm256_setzero_si256();
+}
+
+template <class RetVecType> __vec16_i16 __undef_i16();
+template <> FORCEINLINE __vec16_i16 __undef_i16<__vec16_i16>() {
+    return __vec16_i16();
+}
+
+static FORCEINLINE __vec16_i16 __broadcast_i16(__vec16_i16 v, int index) {
+    return _mm256_permutexvar_epi16(_mm256_set1_epi16((int16_t)(index & 15)), v.v);
+}
+
+static FORCEINLINE __m256i lIota16() {
+    return _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+static FORCEINLINE __vec16_i16 __rotate_i16(__vec16_i16 v, int delta) {
+    __m256i idx = _mm256_add_epi16(lIota16(), _mm256_set1_epi16((int16_t)(delta & 15)));
+    return _mm256_permutexvar_epi16(idx, v.v);
+}
+
+static FORCEINLINE __vec16_i16 __shift_i16(__vec16_i16 v, int delta) {
+    if (delta <= -16 || delta >= 16)
+        return _mm256_setzero_si256();
+    __m256i idx = _mm256_add_epi16(lIota16(), _mm256_set1_epi16((int16_t)delta));
+    __mmask16 valid = _mm256_cmplt_epu16_mask(idx, _mm256_set1_epi16(16));
+    return _mm256_maskz_permutexvar_epi16(valid, idx, v.v);
+}
+
+static FORCEINLINE __vec16_i16 __shuffle_i16(__vec16_i16 v, __vec16_i32 index) {
+    return _mm256_permutexvar_epi16(_mm512_cvtepi32_epi16(index.v), v.v);
+}
+
+static FORCEINLINE __vec16_i16 __shuffle2_i16(__vec16_i16 v0, __vec16_i16 v1,
+                                              __vec16_i32 index) {
+    return _mm256_permutex2var_epi16(v0.v, _mm512_cvtepi32_epi16(index.v), v1.v);
+}
+
+template <int ALIGN> static FORCEINLINE __vec16_i16 __load(const __vec16_i16 *v) {
+    return _mm256_loadu_si256((const __m256i *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec16_i16 *p, __vec16_i16 value) {
+    _mm256_storeu_si256((__m256i *)p, value.v);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// int32
+
+static FORCEINLINE __vec16_i32 __add(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_add_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __sub(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_sub_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __mul(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_mullo_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __or(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_or_si512(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __and(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_and_si512(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __xor(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_xor_si512(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __shl(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_sllv_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __shl(__vec16_i32 a, int32_t b) {
+    return _mm512_sll_epi32(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec16_i32 __lshr(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_srlv_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __lshr(__vec16_i32 a, int32_t b) {
+    return _mm512_srl_epi32(a.v, _mm_cvtsi32_si128(b));
+}
+
+static FORCEINLINE __vec16_i32 __ashr(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_srav_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __ashr(__vec16_i32 a, int32_t b) {
+    return _mm512_sra_epi32(a.v, _mm_cvtsi32_si128(b));
+}
+
+// 32-bit integers are exactly representable as doubles and the quotient
+// of two of them is never close enough to an integer for the rounding of
+// the double-precision division to change its truncated value.
+static FORCEINLINE __vec16_i32 __udiv(__vec16_i32 a, __vec16_i32 b) {
+    __m256i qlo = _mm512_cvttpd_epu32(_mm512_div_pd(_mm512_cvtepu32_pd(lLo256(a.v)),
+                                                    _mm512_cvtepu32_pd(lLo256(b.v))));
+    __m256i qhi = _mm512_cvttpd_epu32(_mm512_div_pd(_mm512_cvtepu32_pd(lHi256(a.v)),
+                                                    _mm512_cvtepu32_pd(lHi256(b.v))));
+    return lCombine256(qlo, qhi);
+}
+
+static FORCEINLINE __vec16_i32 __sdiv(__vec16_i32 a, __vec16_i32 b) {
+    __m256i qlo = _mm512_cvttpd_epi32(_mm512_div_pd(_mm512_cvtepi32_pd(lLo256(a.v)),
+                                                    _mm512_cvtepi32_pd(lLo256(b.v))));
+    __m256i qhi = _mm512_cvttpd_epi32(_mm512_div_pd(_mm512_cvtepi32_pd(lHi256(a.v)),
+                                                    _mm512_cvtepi32_pd(lHi256(b.v))));
+    return lCombine256(qlo, qhi);
+}
+
+static FORCEINLINE __vec16_i32 __urem(__vec16_i32 a, __vec16_i32 b) {
+    return __sub(a, __mul(__udiv(a, b), b));
+}
+
+static FORCEINLINE __vec16_i32 __srem(__vec16_i32 a, __vec16_i32 b) {
+    return __sub(a, __mul(__sdiv(a, b), b));
+}
+
+CMP_INT(CMP_OP, __vec16_i32, i32, _mm512_cmp_epi32_mask, _mm512_mask_cmp_epi32_mask,
+                _mm512_cmp_epu32_mask, _mm512_mask_cmp_epu32_mask)
+
+static FORCEINLINE __vec16_i32 __select(__vec16_i1 mask, __vec16_i32 a, __vec16_i32 b) {
+    return _mm512_mask_blend_epi32(mask.v, b.v, a.v);
+}
+
+template <class RetVecType> __vec16_i32 __smear_i32(int32_t v);
+template <> FORCEINLINE __vec16_i32 __smear_i32<__vec16_i32>(int32_t v) {
+    return _mm512_set1_epi32(v);
+}
+
+template <class RetVecType> __vec16_i32 __setzero_i32();
+template <> FORCEINLINE __vec16_i32 __setzero_i32<__vec16_i32>() {
+    return _mm512_setzero_si512();
+}
+
+template <class RetVecType> __vec16_i32 __undef_i32();
+template <> FORCEINLINE __vec16_i32 __undef_i32<__vec16_i32>() {
+    return __vec16_i32();
+}
+
+static FORCEINLINE __vec16_i32 __broadcast_i32(__vec16_i32 v, int index) {
+    return _mm512_permutexvar_epi32(_mm512_set1_epi32(index & 15), v.v);
+}
+
+static FORCEINLINE __vec16_i32 __rotate_i32(__vec16_i32 v, int delta) {
+    __m512i idx = _mm512_add_epi32(lIota32(), _mm512_set1_epi32(delta & 15));
+    return _mm512_permutexvar_epi32(idx, v.v);
+}
+
+// Lanes whose source index is out of range (including negative ones,
+// which are huge as unsigned values) are zeroed.
+static FORCEINLINE __vec16_i32 __shift_i32(__vec16_i32 v, int delta) {
+    __m512i idx = _mm512_add_epi32(lIota32(), _mm512_set1_epi32(delta));
+    __mmask16 valid = _mm512_cmplt_epu32_mask(idx, _mm512_set1_epi32(16));
+    return _mm512_maskz_permutexvar_epi32(valid, idx, v.v);
+}
+
+static FORCEINLINE __vec16_i32 __shuffle_i32(__vec16_i32 v, __vec16_i32 index) {
+    return _mm512_permutexvar_epi32(index.v, v.v);
+}
+
+static FORCEINLINE __vec16_i32 __shuffle2_i32(__vec16_i32 v0, __vec16_i32 v1,
+                                              __vec16_i32 index) {
+    return _mm512_permutex2var_epi32(v0.v, index.v, v1.v);
+}
+
+template <int ALIGN> static FORCEINLINE __vec16_i32 __load(const __vec16_i32 *v) {
+    return _mm512_loadu_si512((const void *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec16_i32 *p, __vec16_i32 value) {
+    _mm512_storeu_si512((void *)p, value.v);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// int64
+
+static FORCEINLINE __vec16_i64 __add(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_add_epi64(a.v[0], b.v[0]), _mm512_add_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __sub(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_sub_epi64(a.v[0], b.v[0]), _mm512_sub_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __mul(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_mullo_epi64(a.v[0], b.v[0]), _mm512_mullo_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __or(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_or_si512(a.v[0], b.v[0]), _mm512_or_si512(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __and(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_and_si512(a.v[0], b.v[0]), _mm512_and_si512(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __xor(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_xor_si512(a.v[0], b.v[0]), _mm512_xor_si512(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __shl(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_sllv_epi64(a.v[0], b.v[0]), _mm512_sllv_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __shl(__vec16_i64 a, int32_t b) {
+    __m128i count = _mm_cvtsi32_si128(b);
+    return __vec16_i64(_mm512_sll_epi64(a.v[0], count), _mm512_sll_epi64(a.v[1], count));
+}
+
+static FORCEINLINE __vec16_i64 __lshr(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_srlv_epi64(a.v[0], b.v[0]), _mm512_srlv_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __lshr(__vec16_i64 a, int32_t b) {
+    __m128i count = _mm_cvtsi32_si128(b);
+    return __vec16_i64(_mm512_srl_epi64(a.v[0], count), _mm512_srl_epi64(a.v[1], count));
+}
+
+static FORCEINLINE __vec16_i64 __ashr(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_srav_epi64(a.v[0], b.v[0]), _mm512_srav_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __ashr(__vec16_i64 a, int32_t b) {
+    __m128i count = _mm_cvtsi32_si128(b);
+    return __vec16_i64(_mm512_sra_epi64(a.v[0], count), _mm512_sra_epi64(a.v[1], count));
+}
+
+#define INT64_BINARY_OP_SCALAR(NAME, TYPE, OP)                         \
+static FORCEINLINE __vec16_i64 NAME(__vec16_i64 a, __vec16_i64 b) {   \
+    int64_t r[16];                                                    \
+    for (int i = 0; i < 16; ++i)                                      \
+        r[i] = (int64_t)((TYPE)__extract_element(a, i) OP             \
+                         (TYPE)__extract_element(b, i));              \
+    return __vec16_i64(r);                                            \
+}
+
+INT64_BINARY_OP_SCALAR(__udiv, uint64_t, /)
+INT64_BINARY_OP_SCALAR(__sdiv, int64_t, /)
+INT64_BINARY_OP_SCALAR(__urem, uint64_t, %)
+INT64_BINARY_OP_SCALAR(__srem, int64_t, %)
+
+CMP_INT(CMP_OP64, __vec16_i64, i64, _mm512_cmp_epi64_mask, _mm512_mask_cmp_epi64_mask,
+        _mm512_cmp_epu64_mask, _mm512_mask_cmp_epu64_mask)
+
+static FORCEINLINE __vec16_i64 __select(__vec16_i1 mask, __vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_mask_blend_epi64(lMaskLo(mask), b.v[0], a.v[0]),
+                       _mm512_mask_blend_epi64(lMaskHi(mask), b.v[1], a.v[1]));
+}
+
+template <class RetVecType> __vec16_i64 __smear_i64(int64_t v);
+template <> FORCEINLINE __vec16_i64 __smear_i64<__vec16_i64>(int64_t v) {
+    __m512i s = _mm512_set1_epi64(v);
+    return __vec16_i64(s, s);
+}
+
+template <class RetVecType> __vec16_i64 __setzero_i64();
+template <> FORCEINLINE __vec16_i64 __setzero_i64<__vec16_i64>() {
+    return __vec16_i64(_mm512_setzero_si512(), _mm512_setzero_si512());
+}
+
+template <class RetVecType> __vec16_i64 __undef_i64();
+template <> FORCEINLINE __vec16_i64 __undef_i64<__vec16_i64>() {
+    return __vec16_i64();
+}
+
+// A two-source permute over both halves of a vector of 64-bit elements
+// selects any of its 16 lanes; the lanes not set in valid are zeroed.
+static FORCEINLINE __vec16_i64 lPermute64(__vec16_i64 v, __vec16_i32 index,
+                                          __vec16_i1 valid) {
+    __m512i idxLo = _mm512_cvtepi32_epi64(lLo256(index.v));
+    __m512i idxHi = _mm512_cvtepi32_epi64(lHi256(index.v));
+    return __vec16_i64(_mm512_maskz_permutex2var_epi64(lMaskLo(valid), v.v[0], idxLo, v.v[1]),
+                       _mm512_maskz_permutex2var_epi64(lMaskHi(valid), v.v[0], idxHi, v.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __broadcast_i64(__vec16_i64 v, int index) {
+    return __smear_i64<__vec16_i64>(__extract_element(v, index & 15));
+}
+
+static FORCEINLINE __vec16_i64 __rotate_i64(__vec16_i64 v, int delta) {
+    __m512i idx = _mm512_add_epi32(lIota32(), _mm512_set1_epi32(delta & 15));
+    return lPermute64(v, idx, (__mmask16)0xffff);
+}
+
+static FORCEINLINE __vec16_i64 __shift_i64(__vec16_i64 v, int delta) {
+    __m512i idx = _mm512_add_epi32(lIota32(), _mm512_set1_epi32(delta));
+    return lPermute64(v, idx, _mm512_cmplt_epu32_mask(idx, _mm512_set1_epi32(16)));
+}
+
+static FORCEINLINE __vec16_i64 __shuffle_i64(__vec16_i64 v, __vec16_i32 index) {
+    return lPermute64(v, index, (__mmask16)0xffff);
+}
+
+static FORCEINLINE __vec16_i64 __shuffle2_i64(__vec16_i64 v0, __vec16_i64 v1,
+                                              __vec16_i32 index) {
+    __vec16_i1 fromV1 = _mm512_test_epi32_mask(index.v, _mm512_set1_epi32(16));
+    return __select(fromV1, lPermute64(v1, index, (__mmask16)0xffff),
+                    lPermute64(v0, index, (__mmask16)0xffff));
+}
+
+template <int ALIGN> static FORCEINLINE __vec16_i64 __load(const __vec16_i64 *v) {
+    return __vec16_i64((const int64_t *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec16_i64 *p, __vec16_i64 value) {
+    _mm512_storeu_si512((void *)p, value.v[0]);
+    _mm512_storeu_si512((void *)((int64_t *)p + 8), value.v[1]);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// float
+
+static FORCEINLINE __vec16_f __add(__vec16_f a, __vec16_f b) {
+    return _mm512_add_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_f __sub(__vec16_f a, __vec16_f b) {
+    return _mm512_sub_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_f __mul(__vec16_f a, __vec16_f b) {
+    return _mm512_mul_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_f __div(__vec16_f a, __vec16_f b) {
+    return _mm512_div_ps(a.v, b.v);
+}
+
+CMP_FLOAT(CMP_OP, __vec16_f, float, _mm512_cmp_ps_mask, _mm512_mask_cmp_ps_mask)
+
+static FORCEINLINE __vec16_f __select(__vec16_i1 mask, __vec16_f a, __vec16_f b) {
+    return _mm512_mask_blend_ps(mask.v, b.v, a.v);
+}
+
+template <class RetVecType> __vec16_f __smear_float(float v);
+template <> FORCEINLINE __vec16_f __smear_float<__vec16_f>(float v) {
+    return _mm512_set1_ps(v);
+}
+
+template <class RetVecType> __vec16_f __setzero_float();
+template <> FORCEINLINE __vec16_f __setzero_float<__vec16_f>() {
+    return _mm512_setzero_ps();
+}
+
+template <class RetVecType> __vec16_f __undef_float();
+template <> FORCEINLINE __vec16_f __undef_float<__vec16_f>() {
+    return __vec16_f();
+}
+
+static FORCEINLINE __vec16_f __broadcast_float(__vec16_f v, int index) {
+    return _mm512_permutexvar_ps(_mm512_set1_epi32(index & 15), v.v);
+}
+
+static FORCEINLINE __vec16_f __rotate_float(__vec16_f v, int delta) {
+    return __cast_bits(__vec16_f(), __rotate_i32(__cast_bits(__vec16_i32(), v), delta));
+}
+
+static FORCEINLINE __vec16_f __shift_float(__vec16_f v, int delta) {
+    return __cast_bits(__vec16_f(), __shift_i32(__cast_bits(__vec16_i32(), v), delta));
+}
+
+static FORCEINLINE __vec16_f __shuffle_float(__vec16_f v, __vec16_i32 index) {
+    return _mm512_permutexvar_ps(index.v, v.v);
+}
+
+static FORCEINLINE __vec16_f __shuffle2_float(__vec16_f v0, __vec16_f v1,
+                                              __vec16_i32 index) {
+    return _mm512_permutex2var_ps(v0.v, index.v, v1.v);
+}
+
+template <int ALIGN> static FORCEINLINE __vec16_f __load(const __vec16_f *v) {
+    return _mm512_loadu_ps((const float *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec16_f *p, __vec16_f value) {
+    _mm512_storeu_ps((float *)p, value.v);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// double
+
+static FORCEINLINE __vec16_d __add(__vec16_d a, __vec16_d b) {
+    return __vec16_d(_mm512_add_pd(a.v[0], b.v[0]), _mm512_add_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_d __sub(__vec16_d a, __vec16_d b) {
+    return __vec16_d(_mm512_sub_pd(a.v[0], b.v[0]), _mm512_sub_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_d __mul(__vec16_d a, __vec16_d b) {
+    return __vec16_d(_mm512_mul_pd(a.v[0], b.v[0]), _mm512_mul_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_d __div(__vec16_d a, __vec16_d b) {
+    return __vec16_d(_mm512_div_pd(a.v[0], b.v[0]), _mm512_div_pd(a.v[1], b.v[1]));
+}
+
+CMP_FLOAT(CMP_OP64, __vec16_d, double, _mm512_cmp_pd_mask, _mm512_mask_cmp_pd_mask)
+
+static FORCEINLINE __vec16_d __select(__vec16_i1 mask, __vec16_d a, __vec16_d b) {
+    return __vec16_d(_mm512_mask_blend_pd(lMaskLo(mask), b.v[0], a.v[0]),
+                     _mm512_mask_blend_pd(lMaskHi(mask), b.v[1], a.v[1]));
+}
+
+template <class RetVecType> __vec16_d __smear_double(double v);
+template <> FORCEINLINE __vec16_d __smear_double<__vec16_d>(double v) {
+    __m512d s = _mm512_set1_pd(v);
+    return __vec16_d(s, s);
+}
+
+template <class RetVecType> __vec16_d __setzero_double();
+template <> FORCEINLINE __vec16_d __setzero_double<__vec16_d>() {
+    return __vec16_d(_mm512_setzero_pd(), _mm512_setzero_pd());
+}
+
+template <class RetVecType> __vec16_d __undef_double();
+template <> FORCEINLINE __vec16_d __undef_double<__vec16_d>() {
+    return __vec16_d();
+}
+
+static FORCEINLINE __vec16_d __broadcast_double(__vec16_d v, int index) {
+    return __smear_double<__vec16_d>(__extract_element(v, index & 15));
+}
+
+static FORCEINLINE __vec16_d __rotate_double(__vec16_d v, int delta) {
+    return __cast_bits(__vec16_d(), __rotate_i64(__cast_bits(__vec16_i64(), v), delta));
+}
+
+static FORCEINLINE __vec16_d __shift_double(__vec16_d v, int delta) {
+    return __cast_bits(__vec16_d(), __shift_i64(__cast_bits(__vec16_i64(), v), delta));
+}
+
+static FORCEINLINE __vec16_d __shuffle_double(__vec16_d v, __vec16_i32 index) {
+    return __cast_bits(__vec16_d(), __shuffle_i64(__cast_bits(__vec16_i64(), v), index));
+}
+
+static FORCEINLINE __vec16_d __shuffle2_double(__vec16_d v0, __vec16_d v1,
+                                               __vec16_i32 index) {
+    return __cast_bits(__vec16_d(), __shuffle2_i64(__cast_bits(__vec16_i64(), v0),
+                                                   __cast_bits(__vec16_i64(), v1), index));
+}
+
+template <int ALIGN> static FORCEINLINE __vec16_d __load(const __vec16_d *v) {
+    return __vec16_d((const double *)v);
+}
+
+template <int ALIGN> static FORCEINLINE void __store(__vec16_d *p, __vec16_d value) {
+    _mm512_storeu_pd((double *)p, value.v[0]);
+    _mm512_storeu_pd((double *)p + 8, value.v[1]);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// casts
+
+// sign extension conversions
+
+static FORCEINLINE __vec16_i64 __cast_sext(__vec16_i64, __vec16_i32 val) {
+    return __vec16_i64(_mm512_cvtepi32_epi64(lLo256(val.v)),
+                       _mm512_cvtepi32_epi64(lHi256(val.v)));
+}
+
+static FORCEINLINE __vec16_i64 __cast_sext(__vec16_i64, __vec16_i16 val) {
+    return __vec16_i64(_mm512_cvtepi16_epi64(_mm256_castsi256_si128(val.v)),
+                       _mm512_cvtepi16_epi64(_mm256_extracti128_si256(val.v, 1)));
+}
+
+static FORCEINLINE __vec16_i64 __cast_sext(__vec16_i64, __vec16_i8 val) {
+    return __vec16_i64(_mm512_cvtepi8_epi64(val.v),
+                       _mm512_cvtepi8_epi64(_mm_srli_si128(val.v, 8)));
+}
+
+static FORCEINLINE __vec16_i32 __cast_sext(__vec16_i32, __vec16_i16 val) {
+    return _mm512_cvtepi16_epi32(val.v);
+}
+
+static FORCEINLINE __vec16_i32 __cast_sext(__vec16_i32, __vec16_i8 val) {
+    return _mm512_cvtepi8_epi32(val.v);
+}
+
+static FORCEINLINE __vec16_i16 __cast_sext(__vec16_i16, __vec16_i8 val) {
+    return _mm256_cvtepi8_epi16(val.v);
+}
+
+static FORCEINLINE __vec16_i8 __cast_sext(__vec16_i8, __vec16_i1 v) {
+    return _mm_movm_epi8(v.v);
+}
+
+static FORCEINLINE __vec16_i16 __cast_sext(__vec16_i16, __vec16_i1 v) {
+    return _mm256_movm_epi16(v.v);
+}
+
+static FORCEINLINE __vec16_i32 __cast_sext(__vec16_i32, __vec16_i1 v) {
+    return _mm512_movm_epi32(v.v);
+}
+
+static FORCEINLINE __vec16_i64 __cast_sext(__vec16_i64, __vec16_i1 v) {
+    return __vec16_i64(_mm512_movm_epi64(lMaskLo(v)), _mm512_movm_epi64(lMaskHi(v)));
+}
+
+// zero extension
+
+static FORCEINLINE __vec16_i64 __cast_zext(__vec16_i64, __vec16_i32 val) {
+    return __vec16_i64(_mm512_cvtepu32_epi64(lLo256(val.v)),
+                       _mm512_cvtepu32_epi64(lHi256(val.v)));
+}
+
+static FORCEINLINE __vec16_i64 __cast_zext(__vec16_i64, __vec16_i16 val) {
+    return __vec16_i64(_mm512_cvtepu16_epi64(_mm256_castsi256_si128(val.v)),
+                       _mm512_cvtepu16_epi64(_mm256_extracti128_si256(val.v, 1)));
+}
+
+static FORCEINLINE __vec16_i64 __cast_zext(__vec16_i64, __vec16_i8 val) {
+    return __vec16_i64(_mm512_cvtepu8_epi64(val.v),
+                       _mm512_cvtepu8_epi64(_mm_srli_si128(val.v, 8)));
+}
+
+static FORCEINLINE __vec16_i32 __cast_zext(__vec16_i32, __vec16_i16 val) {
+    return _mm512_cvtepu16_epi32(val.v);
+}
+
+static FORCEINLINE __vec16_i32 __cast_zext(__vec16_i32, __vec16_i8 val) {
+    return _mm512_cvtepu8_epi32(val.v);
+}
+
+static FORCEINLINE __vec16_i16 __cast_zext(__vec16_i16, __vec16_i8 val) {
+    return _mm256_cvtepu8_epi16(val.v);
+}
+
+static FORCEINLINE __vec16_i8 __cast_zext(__vec16_i8, __vec16_i1 v) {
+    return _mm_maskz_set1_epi8(v.v, 1);
+}
+
+static FORCEINLINE __vec16_i16 __cast_zext(__vec16_i16, __vec16_i1 v) {
+    return _mm256_maskz_set1_epi16(v.v, 1);
+}
+
+static FORCEINLINE __vec16_i32 __cast_zext(__vec16_i32, __vec16_i1 v) {
+    return _mm512_maskz_set1_epi32(v.v, 1);
+}
+
+static FORCEINLINE __vec16_i64 __cast_zext(__vec16_i64, __vec16_i1 v) {
+    return __vec16_i64(_mm512_maskz_set1_epi64(lMaskLo(v), 1),
+                       _mm512_maskz_set1_epi64(lMaskHi(v), 1));
+}
+
+// truncations
+
+static FORCEINLINE __vec16_i32 __cast_trunc(__vec16_i32, __vec16_i64 val) {
+    return lCombine256(_mm512_cvtepi64_epi32(val.v[0]), _mm512_cvtepi64_epi32(val.v[1]));
+}
+
+static FORCEINLINE __vec16_i16 __cast_trunc(__vec16_i16, __vec16_i64 val) {
+    return lCombine128(_mm512_cvtepi64_epi16(val.v[0]), _mm512_cvtepi64_epi16(val.v[1]));
+}
+
+static FORCEINLINE __vec16_i8 __cast_trunc(__vec16_i8, __vec16_i64 val) {
+    return _mm_unpacklo_epi64(_mm512_cvtepi64_epi8(val.v[0]), _mm512_cvtepi64_epi8(val.v[1]));
+}
+
+static FORCEINLINE __vec16_i16 __cast_trunc(__vec16_i16, __vec16_i32 val) {
+    return _mm512_cvtepi32_epi16(val.v);
+}
+
+static FORCEINLINE __vec16_i8 __cast_trunc(__vec16_i8, __vec16_i32 val) {
+    return _mm512_cvtepi32_epi8(val.v);
+}
+
+static FORCEINLINE __vec16_i8 __cast_trunc(__vec16_i8, __vec16_i16 val) {
+    return _mm256_cvtepi16_epi8(val.v);
+}
+
+// signed int to float/double
+
+static FORCEINLINE __vec16_f __cast_sitofp(__vec16_f, __vec16_i8 val) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(val.v));
+}
+
+static FORCEINLINE __vec16_f __cast_sitofp(__vec16_f, __vec16_i16 val) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(val.v));
+}
+
+static FORCEINLINE __vec16_f __cast_sitofp(__vec16_f, __vec16_i32 val) {
+    return _mm512_cvtepi32_ps(val.v);
+}
+
+static FORCEINLINE __vec16_f __cast_sitofp(__vec16_f, __vec16_i64 val) {
+    return lCombine256(_mm512_cvtepi64_ps(val.v[0]), _mm512_cvtepi64_ps(val.v[1]));
+}
+
+static FORCEINLINE __vec16_d __cast_sitofp(__vec16_d, __vec16_i32 val) {
+    return __vec16_d(_mm512_cvtepi32_pd(lLo256(val.v)), _mm512_cvtepi32_pd(lHi256(val.v)));
+}
+
+static FORCEINLINE __vec16_d __cast_sitofp(__vec16_d, __vec16_i8 val) {
+    return __cast_sitofp(__vec16_d(), __cast_sext(__vec16_i32(), val));
+}
+
+static FORCEINLINE __vec16_d __cast_sitofp(__vec16_d, __vec16_i16 val) {
+    return __cast_sitofp(__vec16_d(), __cast_sext(__vec16_i32(), val));
+}
+
+static FORCEINLINE __vec16_d __cast_sitofp(__vec16_d, __vec16_i64 val) {
+    return __vec16_d(_mm512_cvtepi64_pd(val.v[0]), _mm512_cvtepi64_pd(val.v[1]));
+}
+
+// unsigned int to float/double
+
+static FORCEINLINE __vec16_f __cast_uitofp(__vec16_f, __vec16_i8 val) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(val.v));
+}
+
+static FORCEINLINE __vec16_f __cast_uitofp(__vec16_f, __vec16_i16 val) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(val.v));
+}
+
+static FORCEINLINE __vec16_f __cast_uitofp(__vec16_f, __vec16_i32 val) {
+    return _mm512_cvtepu32_ps(val.v);
+}
+
+static FORCEINLINE __vec16_f __cast_uitofp(__vec16_f, __vec16_i64 val) {
+    return lCombine256(_mm512_cvtepu64_ps(val.v[0]), _mm512_cvtepu64_ps(val.v[1]));
+}
+
+static FORCEINLINE __vec16_f __cast_uitofp(__vec16_f, __vec16_i1 v) {
+    return _mm512_maskz_mov_ps(v.v, _mm512_set1_ps(1.f));
+}
+
+static FORCEINLINE __vec16_d __cast_uitofp(__vec16_d, __vec16_i8 val) {
+    return __cast_sitofp(__vec16_d(), __cast_zext(__vec16_i32(), val));
+}
+
+static FORCEINLINE __vec16_d __cast_uitofp(__vec16_d, __vec16_i16 val) {
+    return __cast_sitofp(__vec16_d(), __cast_zext(__vec16_i32(), val));
+}
+
+static FORCEINLINE __vec16_d __cast_uitofp(__vec16_d, __vec16_i32 val) {
+    return __vec16_d(_mm512_cvtepu32_pd(lLo256(val.v)), _mm512_cvtepu32_pd(lHi256(val.v)));
+}
+
+static FORCEINLINE __vec16_d __cast_uitofp(__vec16_d, __vec16_i64 val) {
+    return __vec16_d(_mm512_cvtepu64_pd(val.v[0]), _mm512_cvtepu64_pd(val.v[1]));
+}
+
+static FORCEINLINE __vec16_d __cast_uitofp(__vec16_d, __vec16_i1 v) {
+    __m512d one = _mm512_set1_pd(1.);
+    return __vec16_d(_mm512_maskz_mov_pd(lMaskLo(v), one), _mm512_maskz_mov_pd(lMaskHi(v), one));
+}
+
+// float/double to signed int
+
+static FORCEINLINE __vec16_i32 __cast_fptosi(__vec16_i32, __vec16_f val) {
+    return _mm512_cvttps_epi32(val.v);
+}
+
+static FORCEINLINE __vec16_i16 __cast_fptosi(__vec16_i16, __vec16_f val) {
+    return _mm512_cvtepi32_epi16(_mm512_cvttps_epi32(val.v));
+}
+
+static FORCEINLINE __vec16_i8 __cast_fptosi(__vec16_i8, __vec16_f val) {
+    return _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(val.v));
+}
+
+static FORCEINLINE __vec16_i64 __cast_fptosi(__vec16_i64, __vec16_f val) {
+    return __vec16_i64(_mm512_cvttps_epi64(_mm512_castps512_ps256(val.v)),
+                       _mm512_cvttps_epi64(_mm512_extractf32x8_ps(val.v, 1)));
+}
+
+static FORCEINLINE __vec16_i32 __cast_fptosi(__vec16_i32, __vec16_d val) {
+    return lCombine256(_mm512_cvttpd_epi32(val.v[0]), _mm512_cvttpd_epi32(val.v[1]));
+}
+
+static FORCEINLINE __vec16_i16 __cast_fptosi(__vec16_i16, __vec16_d val) {
+    return _mm512_cvtepi32_epi16(__cast_fptosi(__vec16_i32(), val).v);
+}
+
+static FORCEINLINE __vec16_i8 __cast_fptosi(__vec16_i8, __vec16_d val) {
+    return _mm512_cvtepi32_epi8(__cast_fptosi(__vec16_i32(), val).v);
+}
+
+static FORCEINLINE __vec16_i64 __cast_fptosi(__vec16_i64, __vec16_d val) {
+    return __vec16_i64(_mm512_cvttpd_epi64(val.v[0]), _mm512_cvttpd_epi64(val.v[1]));
+}
+
+// float/double to unsigned int
+
+static FORCEINLINE __vec16_i32 __cast_fptoui(__vec16_i32, __vec16_f val) {
+    return _mm512_cvttps_epu32(val.v);
+}
+
+static FORCEINLINE __vec16_i16 __cast_fptoui(__vec16_i16, __vec16_f val) {
+    return _mm512_cvtepi32_epi16(_mm512_cvttps_epi32(val.v));
+}
+
+static FORCEINLINE __vec16_i8 __cast_fptoui(__vec16_i8, __vec16_f val) {
+    return _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(val.v));
+}
+
+static FORCEINLINE __vec16_i64 __cast_fptoui(__vec16_i64, __vec16_f val) {
+    return __vec16_i64(_mm512_cvttps_epu64(_mm512_castps512_ps256(val.v)),
+                       _mm512_cvttps_epu64(_mm512_extractf32x8_ps(val.v, 1)));
+}
+
+static FORCEINLINE __vec16_i32 __cast_fptoui(__vec16_i32, __vec16_d val) {
+    return lCombine256(_mm512_cvttpd_epu32(val.v[0]), _mm512_cvttpd_epu32(val.v[1]));
+}
+
+static FORCEINLINE __vec16_i16 __cast_fptoui(__vec16_i16, __vec16_d val) {
+    return _mm512_cvtepi32_epi16(__cast_fptosi(__vec16_i32(), val).v);
+}
+
+static FORCEINLINE __vec16_i8 __cast_fptoui(__vec16_i8, __vec16_d val) {
+    return _mm512_cvtepi32_epi8(__cast_fptosi(__vec16_i32(), val).v);
+}
+
+static FORCEINLINE __vec16_i64 __cast_fptoui(__vec16_i64, __vec16_d val) {
+    return __vec16_i64(_mm512_cvttpd_epu64(val.v[0]), _mm512_cvttpd_epu64(val.v[1]));
+}
+
+// float/double conversions
+
+static FORCEINLINE __vec16_f __cast_fptrunc(__vec16_f, __vec16_d val) {
+    return lCombine256(_mm512_cvtpd_ps(val.v[0]), _mm512_cvtpd_ps(val.v[1]));
+}
+
+static FORCEINLINE __vec16_d __cast_fpext(__vec16_d, __vec16_f val) {
+    return __vec16_d(_mm512_cvtps_pd(_mm512_castps512_ps256(val.v)),
+                     _mm512_cvtps_pd(_mm512_extractf32x8_ps(val.v, 1)));
+}
+
+///////////////////////////////////////////////////////////////////////////
+// various math functions
+
+static FORCEINLINE void __fastmath() {
+    // Set the flush-to-zero and denormals-are-zero bits.
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+}
+
+static FORCEINLINE float __round_uniform_float(float v) {
+    __m128 r = _mm_set_ss(v);
+    r = _mm_round_ss(r, r, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE float __floor_uniform_float(float v) {
+    __m128 r = _mm_set_ss(v);
+    r = _mm_round_ss(r, r, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE float __ceil_uniform_float(float v) {
+    __m128 r = _mm_set_ss(v);
+    r = _mm_round_ss(r, r, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE double __round_uniform_double(double v) {
+    __m128d r = _mm_set_sd(v);
+    r = _mm_round_sd(r, r, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    return _mm_cvtsd_f64(r);
+}
+
+static FORCEINLINE double __floor_uniform_double(double v) {
+    __m128d r = _mm_set_sd(v);
+    r = _mm_round_sd(r, r, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    return _mm_cvtsd_f64(r);
+}
+
+static FORCEINLINE double __ceil_uniform_double(double v) {
+    __m128d r = _mm_set_sd(v);
+    r = _mm_round_sd(r, r, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+    return _mm_cvtsd_f64(r);
+}
+
+static FORCEINLINE __vec16_f __round_varying_float(__vec16_f v) {
+    return _mm512_roundscale_ps(v.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+static FORCEINLINE __vec16_f __floor_varying_float(__vec16_f v) {
+    return _mm512_roundscale_ps(v.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+
+static FORCEINLINE __vec16_f __ceil_varying_float(__vec16_f v) {
+    return _mm512_roundscale_ps(v.v, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+}
+
+static FORCEINLINE __vec16_d __round_varying_double(__vec16_d v) {
+    return __vec16_d(_mm512_roundscale_pd(v.v[0], _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC),
+                     _mm512_roundscale_pd(v.v[1], _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+}
+
+static FORCEINLINE __vec16_d __floor_varying_double(__vec16_d v) {
+    return __vec16_d(_mm512_roundscale_pd(v.v[0], _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC),
+                     _mm512_roundscale_pd(v.v[1], _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+}
+
+static FORCEINLINE __vec16_d __ceil_varying_double(__vec16_d v) {
+    return __vec16_d(_mm512_roundscale_pd(v.v[0], _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC),
+                     _mm512_roundscale_pd(v.v[1], _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC));
+}
+
+// min/max
+
+static FORCEINLINE float __min_uniform_float(float a, float b) { return (a<b) ? a : b; }
+static FORCEINLINE float __max_uniform_float(float a, float b) { return (a>b) ? a : b; }
+static FORCEINLINE double __min_uniform_double(double a, double b) { return (a<b) ? a : b; }
+static FORCEINLINE double __max_uniform_double(double a, double b) { return (a>b) ? a : b; }
+
+static FORCEINLINE int32_t __min_uniform_int32(int32_t a, int32_t b) { return (a<b) ? a : b; }
+static FORCEINLINE int32_t __max_uniform_int32(int32_t a, int32_t b) { return (a>b) ? a : b; }
+static FORCEINLINE int32_t __min_uniform_uint32(uint32_t a, uint32_t b) { return (a<b) ? a : b; }
+static FORCEINLINE int32_t __max_uniform_uint32(uint32_t a, uint32_t b) { return (a>b) ? a : b; }
+
+static FORCEINLINE int64_t __min_uniform_int64(int64_t a, int64_t b) { return (a<b) ? a : b; }
+static FORCEINLINE int64_t __max_uniform_int64(int64_t a, int64_t b) { return (a>b) ? a : b; }
+static FORCEINLINE int64_t __min_uniform_uint64(uint64_t a, uint64_t b) { return (a<b) ? a : b; }
+static FORCEINLINE int64_t __max_uniform_uint64(uint64_t a, uint64_t b) { return (a>b) ? a : b; }
+
+static FORCEINLINE __vec16_f __max_varying_float(__vec16_f a, __vec16_f b) {
+    return _mm512_max_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_f __min_varying_float(__vec16_f a, __vec16_f b) {
+    return _mm512_min_ps(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_d __max_varying_double(__vec16_d a, __vec16_d b) {
+    return __vec16_d(_mm512_max_pd(a.v[0], b.v[0]), _mm512_max_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_d __min_varying_double(__vec16_d a, __vec16_d b) {
+    return __vec16_d(_mm512_min_pd(a.v[0], b.v[0]), _mm512_min_pd(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i32 __max_varying_int32(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_max_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __min_varying_int32(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_min_epi32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __max_varying_uint32(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_max_epu32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i32 __min_varying_uint32(__vec16_i32 a, __vec16_i32 b) {
+    return _mm512_min_epu32(a.v, b.v);
+}
+
+static FORCEINLINE __vec16_i64 __max_varying_int64(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_max_epi64(a.v[0], b.v[0]), _mm512_max_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __min_varying_int64(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_min_epi64(a.v[0], b.v[0]), _mm512_min_epi64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __max_varying_uint64(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_max_epu64(a.v[0], b.v[0]), _mm512_max_epu64(a.v[1], b.v[1]));
+}
+
+static FORCEINLINE __vec16_i64 __min_varying_uint64(__vec16_i64 a, __vec16_i64 b) {
+    return __vec16_i64(_mm512_min_epu64(a.v[0], b.v[0]), _mm512_min_epu64(a.v[1], b.v[1]));
+}
+
+// sqrt/rsqrt/rcp
+
+static FORCEINLINE float __rsqrt_uniform_float(float v) {
+    __m128 vv = _mm_set_ss(v);
+    __m128 rsqrt = _mm_rsqrt_ss(vv);
+    // Newton-Raphson iteration to improve precision
+    // return 0.5 * rsqrt * (3. - (v * rsqrt) * rsqrt);
+    __m128 v_rsqrt = _mm_mul_ss(rsqrt, vv);
+    __m128 v_r_r = _mm_mul_ss(v_rsqrt, rsqrt);
+    __m128 three_sub = _mm_sub_ss(_mm_set_ss(3.f), v_r_r);
+    __m128 rs_mul = _mm_mul_ss(rsqrt, three_sub);
+    __m128 half_scale = _mm_mul_ss(_mm_set_ss(0.5), rs_mul);
+    return _mm_cvtss_f32(half_scale);
+}
+
+static FORCEINLINE float __rcp_uniform_float(float v) {
+    __m128 rcp = _mm_rcp_ss(_mm_set_ss(v));
+    // N-R iteration:
+    __m128 m = _mm_mul_ss(_mm_set_ss(v), rcp);
+    __m128 twominus = _mm_sub_ss(_mm_set_ss(2.f), m);
+    __m128 r = _mm_mul_ss(rcp, twominus);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE float __sqrt_uniform_float(float v) {
+    __m128 r = _mm_set_ss(v);
+    r = _mm_sqrt_ss(r);
+    return _mm_cvtss_f32(r);
+}
+
+static FORCEINLINE double __rsqrt_uniform_double(double v) {
+    return 1. / sqrt(v);
+}
+
+static FORCEINLINE double __rcp_uniform_double(double v) {
+    return 1. / v;
+}
+
+static FORCEINLINE double __sqrt_uniform_double(double v) {
+    __m128d r = _mm_set_sd(v);
+    r = _mm_sqrt_sd(r, r);
+    return _mm_cvtsd_f64(r);
+}
+
+static FORCEINLINE __vec16_f __rcp_varying_float(__vec16_f v) {
+    __m512 rcp = _mm512_rcp14_ps(v.v);
+    // N-R iteration: rcp + rcp * (1 - v * rcp)
+    __m512 e = _mm512_fnmadd_ps(v.v, rcp, _mm512_set1_ps(1.f));
+    return _mm512_fmadd_ps(rcp, e, rcp);
+}
+
+static FORCEINLINE __vec16_f __rsqrt_varying_float(__vec16_f v) {
+    __m512 rsqrt = _mm512_rsqrt14_ps(v.v);
+    // Newton-Raphson iteration to improve precision
+    // return 0.5 * rsqrt * (3. - (v * rsqrt) * rsqrt);
+    __m512 v_rsqrt = _mm512_mul_ps(rsqrt, v.v);
+    __m512 three_sub = _mm512_fnmadd_ps(v_rsqrt, rsqrt, _mm512_set1_ps(3.f));
+    __m512 rs_mul = _mm512_mul_ps(rsqrt, three_sub);
+    return _mm512_mul_ps(_mm512_set1_ps(0.5f), rs_mul);
+}
+
+static FORCEINLINE __vec16_f __sqrt_varying_float(__vec16_f v) {
+    return _mm512_sqrt_ps(v.v);
+}
+
+static FORCEINLINE __vec16_d __rcp_varying_double(__vec16_d v) {
+    return __div(__smear_double<__vec16_d>(1.), v);
+}
+
+static FORCEINLINE __vec16_d __sqrt_varying_double(__vec16_d v) {
+    return __vec16_d(_mm512_sqrt_pd(v.v[0]), _mm512_sqrt_pd(v.v[1]));
+}
+
+static FORCEINLINE __vec16_d __rsqrt_varying_double(__vec16_d v) {
+    return __rcp_varying_double(__sqrt_varying_double(v));
+}
+
+// half<->float: the uniform variants use the 16-wide AVX-512F
+// conversions when F16C isn't enabled separately.
+
+static FORCEINLINE float __half_to_float_uniform(int16_t h) {
+#ifdef __F16C__
+    return _cvtsh_ss((unsigned short)h);
+#else
+    return _mm512_cvtss_f32(_mm512_cvtph_ps(_mm256_set1_epi16(h)));
+#endif // __F16C__
+}
+
+static FORCEINLINE __vec16_f __half_to_float_varying(__vec16_i16 v) {
+    return _mm512_cvtph_ps(v.v);
+}
+
+static FORCEINLINE int16_t __float_to_half_uniform(float f) {
+#ifdef __F16C__
+    return (int16_t)_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    __m256i h = _mm512_cvtps_ph(_mm512_set1_ps(f), _MM_FROUND_TO_NEAREST_INT);
+    return (int16_t)_mm256_extract_epi16(h, 0);
+#endif // __F16C__
+}
+
+static FORCEINLINE __vec16_i16 __float_to_half_varying(__vec16_f v) {
+    return _mm512_cvtps_ph(v.v, _MM_FROUND_TO_NEAREST_INT);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// bit ops
+
+static FORCEINLINE int32_t __popcnt_int32(uint32_t v) {
+    return _mm_popcnt_u32(v);
+}
+
+static FORCEINLINE int32_t __popcnt_int64(uint64_t v) {
+#if defined(__x86_64__) || defined(_M_X64)
+    return (int32_t)_mm_popcnt_u64(v);
+#else
+    return _mm_popcnt_u32((uint32_t)v) + _mm_popcnt_u32((uint32_t)(v >> 32));
+#endif
+}
+
+static FORCEINLINE int32_t __count_trailing_zeros_i32(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return i;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+static FORCEINLINE int64_t __count_trailing_zeros_i64(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return i;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+static FORCEINLINE int32_t __count_leading_zeros_i32(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse(&i, v);
+    return 31 - i;
+#else
+    return __builtin_clz(v);
+#endif
+}
+
+static FORCEINLINE int64_t __count_leading_zeros_i64(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return 63 - i;
+#else
+    return __builtin_clzll(v);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////
+// reductions
+
+static FORCEINLINE int16_t __reduce_add_int8(__vec16_i8 v) {
+    return (int16_t)_mm512_reduce_add_epi32(_mm512_cvtepi8_epi32(v.v));
+}
+
+static FORCEINLINE int32_t __reduce_add_int16(__vec16_i16 v) {
+    return _mm512_reduce_add_epi32(_mm512_cvtepi16_epi32(v.v));
+}
+
+static FORCEINLINE int64_t __reduce_add_int32(__vec16_i32 v) {
+    __vec16_i64 v64 = __cast_sext(__vec16_i64(), v);
+    return _mm512_reduce_add_epi64(_mm512_add_epi64(v64.v[0], v64.v[1]));
+}
+
+static FORCEINLINE uint32_t __reduce_add_uint32(__vec16_i32 v) {
+    return (uint32_t)_mm512_reduce_add_epi32(v.v);
+}
+
+static FORCEINLINE int32_t __reduce_min_int32(__vec16_i32 v) {
+    return _mm512_reduce_min_epi32(v.v);
+}
+
+static FORCEINLINE int32_t __reduce_max_int32(__vec16_i32 v) {
+    return _mm512_reduce_max_epi32(v.v);
+}
+
+static FORCEINLINE uint32_t __reduce_min_uint32(__vec16_i32 v) {
+    return _mm512_reduce_min_epu32(v.v);
+}
+
+static FORCEINLINE uint32_t __reduce_max_uint32(__vec16_i32 v) {
+    return _mm512_reduce_max_epu32(v.v);
+}
+
+static FORCEINLINE float __reduce_add_float(__vec16_f v) {
+    return _mm512_reduce_add_ps(v.v);
+}
+
+static FORCEINLINE float __reduce_min_float(__vec16_f v) {
+    return _mm512_reduce_min_ps(v.v);
+}
+
+static FORCEINLINE float __reduce_max_float(__vec16_f v) {
+    return _mm512_reduce_max_ps(v.v);
+}
+
+// The 64-bit types first combine their two halves and then reduce the
+// resulting 8 lanes.
+#define REDUCE_64(TYPE, VTYPE, NAME, OP, REDUCE)                        \
+static FORCEINLINE TYPE NAME(VTYPE v) {                                 \
+    return (TYPE)REDUCE(OP(v.v[0], v.v[1]));                            \
+}
+
+REDUCE_64(double, __vec16_d, __reduce_add_double, _mm512_add_pd, _mm512_reduce_add_pd)
+REDUCE_64(double, __vec16_d, __reduce_min_double, _mm512_min_pd, _mm512_reduce_min_pd)
+REDUCE_64(double, __vec16_d, __reduce_max_double, _mm512_max_pd, _mm512_reduce_max_pd)
+
+REDUCE_64(int64_t, __vec16_i64, __reduce_add_int64, _mm512_add_epi64, _mm512_reduce_add_epi64)
+REDUCE_64(uint64_t, __vec16_i64, __reduce_add_uint64, _mm512_add_epi64, _mm512_reduce_add_epi64)
+REDUCE_64(int64_t, __vec16_i64, __reduce_min_int64, _mm512_min_epi64, _mm512_reduce_min_epi64)
+REDUCE_64(int64_t, __vec16_i64, __reduce_max_int64, _mm512_max_epi64, _mm512_reduce_max_epi64)
+REDUCE_64(uint64_t, __vec16_i64, __reduce_min_uint64, _mm512_min_epu64, _mm512_reduce_min_epu64)
+REDUCE_64(uint64_t, __vec16_i64, __reduce_max_uint64, _mm512_max_epu64, _mm512_reduce_max_epu64)
+
+///////////////////////////////////////////////////////////////////////////
+// masked load/store
+
+// AVX-512 has masked loads and stores for all of the element widths, and
+// the inactive lanes never fault.
+
+static FORCEINLINE __vec16_i8 __masked_load_i8(void *p, __vec16_i1 mask) {
+    return _mm_maskz_loadu_epi8(mask.v, p);
+}
+
+static FORCEINLINE __vec16_i16 __masked_load_i16(void *p, __vec16_i1 mask) {
+    return _mm256_maskz_loadu_epi16(mask.v, p);
+}
+
+static FORCEINLINE __vec16_i32 __masked_load_i32(void *p, __vec16_i1 mask) {
+    return _mm512_maskz_loadu_epi32(mask.v, p);
+}
+
+static FORCEINLINE __vec16_f __masked_load_float(void *p, __vec16_i1 mask) {
+    return _mm512_maskz_loadu_ps(mask.v, p);
+}
+
+static FORCEINLINE __vec16_i64 __masked_load_i64(void *p, __vec16_i1 mask) {
+    const int64_t *ptr = (const int64_t *)p;
+    return __vec16_i64(_mm512_maskz_loadu_epi64(lMaskLo(mask), ptr),
+                       _mm512_maskz_loadu_epi64(lMaskHi(mask), ptr + 8));
+}
+
+static FORCEINLINE __vec16_d __masked_load_double(void *p, __vec16_i1 mask) {
+    const double *ptr = (const double *)p;
+    return __vec16_d(_mm512_maskz_loadu_pd(lMaskLo(mask), ptr),
+                     _mm512_maskz_loadu_pd(lMaskHi(mask), ptr + 8));
+}
+
+static FORCEINLINE void __masked_store_i8(void *p, __vec16_i8 val, __vec16_i1 mask) {
+    _mm_mask_storeu_epi8(p, mask.v, val.v);
+}
+
+static FORCEINLINE void __masked_store_i16(void *p, __vec16_i16 val, __vec16_i1 mask) {
+    _mm256_mask_storeu_epi16(p, mask.v, val.v);
+}
+
+static FORCEINLINE void __masked_store_i32(void *p, __vec16_i32 val, __vec16_i1 mask) {
+    _mm512_mask_storeu_epi32(p, mask.v, val.v);
+}
+
+static FORCEINLINE void __masked_store_float(void *p, __vec16_f val, __vec16_i1 mask) {
+    _mm512_mask_storeu_ps(p, mask.v, val.v);
+}
+
+static FORCEINLINE void __masked_store_i64(void *p, __vec16_i64 val, __vec16_i1 mask) {
+    int64_t *ptr = (int64_t *)p;
+    _mm512_mask_storeu_epi64(ptr, lMaskLo(mask), val.v[0]);
+    _mm512_mask_storeu_epi64(ptr + 8, lMaskHi(mask), val.v[1]);
+}
+
+static FORCEINLINE void __masked_store_double(void *p, __vec16_d val, __vec16_i1 mask) {
+    double *ptr = (double *)p;
+    _mm512_mask_storeu_pd(ptr, lMaskLo(mask), val.v[0]);
+    _mm512_mask_storeu_pd(ptr + 8, lMaskHi(mask), val.v[1]);
+}
+
+// A masked store is as cheap as a load, blend and store would be, so the
+// "blend" variants just use it.
+static FORCEINLINE void __masked_store_blend_i8(void *p, __vec16_i8 val,
+                                                __vec16_i1 mask) {
+    __masked_store_i8(p, val, mask);
+}
+
+static FORCEINLINE void __masked_store_blend_i16(void *p, __vec16_i16 val,
+                                                 __vec16_i1 mask) {
+    __masked_store_i16(p, val, mask);
+}
+
+static FORCEINLINE void __masked_store_blend_i32(void *p, __vec16_i32 val,
+                                                 __vec16_i1 mask) {
+    __masked_store_i32(p, val, mask);
+}
+
+static FORCEINLINE void __masked_store_blend_float(void *p, __vec16_f val,
+                                                   __vec16_i1 mask) {
+    __masked_store_float(p, val, mask);
+}
+
+static FORCEINLINE void __masked_store_blend_i64(void *p, __vec16_i64 val,
+                                                 __vec16_i1 mask) {
+    __masked_store_i64(p, val, mask);
+}
+
+static FORCEINLINE void __masked_store_blend_double(void *p, __vec16_d val,
+                                                    __vec16_i1 mask) {
+    __masked_store_double(p, val, mask);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// gather/scatter
+
+// The gather and scatter instructions only take scales of 1, 2, 4 or 8 as
+// immediates; anything else is folded into 64-bit offsets up front.
+static FORCEINLINE bool lIsGatherScale(uint32_t scale) {
+    return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+static FORCEINLINE __vec16_i64 lScaleOffsets(__vec16_i32 offsets, uint32_t scale) {
+    return __mul(__cast_sext(__vec16_i64(), offsets),
+                 __smear_i64<__vec16_i64>((int64_t)scale));
+}
+
+static FORCEINLINE __vec16_i64 lScaleOffsets(__vec16_i64 offsets, uint32_t scale) {
+    return __mul(offsets, __smear_i64<__vec16_i64>((int64_t)scale));
+}
+
+#define GATHER_SCALED(INTRIN, SRC, MASK, OFFSETS, BASE, SCALE)          \
+    ((SCALE) == 8 ? INTRIN(SRC, MASK, OFFSETS, BASE, 8) :               \
+     (SCALE) == 4 ? INTRIN(SRC, MASK, OFFSETS, BASE, 4) :               \
+     (SCALE) == 2 ? INTRIN(SRC, MASK, OFFSETS, BASE, 2) :               \
+                    INTRIN(SRC, MASK, OFFSETS, BASE, 1))
+
+static FORCEINLINE __vec16_i32
+__gather_base_offsets64_i32(unsigned char *p, uint32_t scale, __vec16_i64 offsets,
+                            __vec16_i1 mask) {
+    if (!lIsGatherScale(scale)) {
+        offsets = lScaleOffsets(offsets, scale);
+        scale = 1;
+    }
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = GATHER_SCALED(_mm512_mask_i64gather_epi32, zero, lMaskLo(mask),
+                               offsets.v[0], p, scale);
+    __m256i hi = GATHER_SCALED(_mm512_mask_i64gather_epi32, zero, lMaskHi(mask),
+                               offsets.v[1], p, scale);
+    return lCombine256(lo, hi);
+}
+
+static FORCEINLINE __vec16_i32
+__gather_base_offsets32_i32(uint8_t *p, uint32_t scale, __vec16_i32 offsets,
+                            __vec16_i1 mask) {
+    if (!lIsGatherScale(scale))
+        return __gather_base_offsets64_i32(p, 1, lScaleOffsets(offsets, scale), mask);
+    return GATHER_SCALED(_mm512_mask_i32gather_epi32, _mm512_setzero_si512(),
+                         mask.v, offsets.v, p, scale);
+}
+
+static FORCEINLINE __vec16_f
+__gather_base_offsets64_float(unsigned char *p, uint32_t scale, __vec16_i64 offsets,
+                              __vec16_i1 mask) {
+    return __cast_bits(__vec16_f(), __gather_base_offsets64_i32(p, scale, offsets, mask));
+}
+
+static FORCEINLINE __vec16_f
+__gather_base_offsets32_float(uint8_t *p, uint32_t scale, __vec16_i32 offsets,
+                              __vec16_i1 mask) {
+    return __cast_bits(__vec16_f(), __gather_base_offsets32_i32(p, scale, offsets, mask));
+}
+
+static FORCEINLINE __vec16_i64
+__gather_base_offsets64_i64(unsigned char *p, uint32_t scale, __vec16_i64 offsets,
+                            __vec16_i1 mask) {
+    if (!lIsGatherScale(scale)) {
+        offsets = lScaleOffsets(offsets, scale);
+        scale = 1;
+    }
+    __m512i zero = _mm512_setzero_si512();
+    return __vec16_i64(GATHER_SCALED(_mm512_mask_i64gather_epi64, zero, lMaskLo(mask),
+                                     offsets.v[0], p, scale),
+                       GATHER_SCALED(_mm512_mask_i64gather_epi64, zero, lMaskHi(mask),
+                                     offsets.v[1], p, scale));
+}
+
+static FORCEINLINE __vec16_i64
+__gather_base_offsets32_i64(unsigned char *p, uint32_t scale, __vec16_i32 offsets,
+                            __vec16_i1 mask) {
+    if (!lIsGatherScale(scale))
+        return __gather_base_offsets64_i64(p, 1, lScaleOffsets(offsets, scale), mask);
+    __m512i zero = _mm512_setzero_si512();
+    return __vec16_i64(GATHER_SCALED(_mm512_mask_i32gather_epi64, zero, lMaskLo(mask),
+                                     lLo256(offsets.v), p, scale),
+                       GATHER_SCALED(_mm512_mask_i32gather_epi64, zero, lMaskHi(mask),
+                                     lHi256(offsets.v), p, scale));
+}
+
+static FORCEINLINE __vec16_d
+__gather_base_offsets64_double(unsigned char *p, uint32_t scale, __vec16_i64 offsets,
+                               __vec16_i1 mask) {
+    return __cast_bits(__vec16_d(), __gather_base_offsets64_i64(p, scale, offsets, mask));
+}
+
+static FORCEINLINE __vec16_d
+__gather_base_offsets32_double(unsigned char *p, uint32_t scale, __vec16_i32 offsets,
+                               __vec16_i1 mask) {
+    return __cast_bits(__vec16_d(), __gather_base_offsets32_i64(p, scale, offsets, mask));
+}
+
+// There are no 8- or 16-bit gathers, and gathering 32-bit values instead
+// could read past the end of a page, so these go one lane at a time.
+#define GATHER_BASE_OFFSETS_SMALL(VTYPE, STYPE, OTYPE, FUNC)            \
+static FORCEINLINE VTYPE FUNC(unsigned char *b, uint32_t scale,         \
+                              OTYPE offset, __vec16_i1 mask) {          \
+    VTYPE ret = __setzero_##STYPE##_vec();                              \
+    uint32_t m = mask.v;                                                \
+    while (m != 0) {                                                    \
+        int i = __count_trailing_zeros_i32(m);                          \
+        m &= m - 1;                                                     \
+        STYPE *ptr = (STYPE *)(b + scale * (int64_t)__extract_element(offset, i)); \
+        __insert_element(&ret, i, *ptr);                                \
+    }                                                                   \
+    return ret;                                                         \
+}
+
+static FORCEINLINE __vec16_i8 __setzero_int8_t_vec() { return __setzero_i8<__vec16_i8>(); }
+static FORCEINLINE __vec16_i16 __setzero_int16_t_vec() { return __setzero_i16<__vec16_i16>(); }
+
+GATHER_BASE_OFFSETS_SMALL(__vec16_i8,  int8_t,  __vec16_i32, __gather_base_offsets32_i8)
+GATHER_BASE_OFFSETS_SMALL(__vec16_i8,  int8_t,  __vec16_i64, __gather_base_offsets64_i8)
+GATHER_BASE_OFFSETS_SMALL(__vec16_i16, int16_t, __vec16_i32, __gather_base_offsets32_i16)
+GATHER_BASE_OFFSETS_SMALL(__vec16_i16, int16_t, __vec16_i64, __gather_base_offsets64_i16)
+
+// General gathers take a full pointer per lane.  32-bit pointers are
+// zero-extended and gathered with 64-bit indices off of a NULL base.
+#define GATHER_GENERAL(VTYPE, SUFFIX)                                   \
+static FORCEINLINE VTYPE __gather64_##SUFFIX(__vec16_i64 ptrs, __vec16_i1 mask) { \
+    return __gather_base_offsets64_##SUFFIX(NULL, 1, ptrs, mask);       \
+}                                                                       \
+static FORCEINLINE VTYPE __gather32_##SUFFIX(__vec16_i32 ptrs, __vec16_i1 mask) { \
+    return __gather64_##SUFFIX(__cast_zext(__vec16_i64(), ptrs), mask); \
+}
+
+GATHER_GENERAL(__vec16_i8, i8)
+GATHER_GENERAL(__vec16_i16, i16)
+GATHER_GENERAL(__vec16_i32, i32)
+GATHER_GENERAL(__vec16_f, float)
+GATHER_GENERAL(__vec16_i64, i64)
+GATHER_GENERAL(__vec16_d, double)
+
+// scatter
+
+// The scatter instructions write the active lanes in order, so lanes that
+// share an address leave the value of the highest one, as the scalar loop
+// would.
+#define SCATTER_SCALED(INTRIN, BASE, MASK, OFFSETS, VAL, SCALE)         \
+    ((SCALE) == 8 ? INTRIN(BASE, MASK, OFFSETS, VAL, 8) :               \
+     (SCALE) == 4 ? INTRIN(BASE, MASK, OFFSETS, VAL, 4) :               \
+     (SCALE) == 2 ? INTRIN(BASE, MASK, OFFSETS, VAL, 2) :               \
+                    INTRIN(BASE, MASK, OFFSETS, VAL, 1))
+
+static FORCEINLINE void
+__scatter_base_offsets64_i32(unsigned char *b, uint32_t scale, __vec16_i64 offsets,
+                             __vec16_i32 val, __vec16_i1 mask) {
+    if (!lIsGatherScale(scale)) {
+        offsets = lScaleOffsets(offsets, scale);
+        scale = 1;
+    }
+    SCATTER_SCALED(_mm512_mask_i64scatter_epi32, b, lMaskLo(mask), offsets.v[0],
+                   lLo256(val.v), scale);
+    SCATTER_SCALED(_mm512_mask_i64scatter_epi32, b, lMaskHi(mask), offsets.v[1],
+                   lHi256(val.v), scale);
+}
+
+static FORCEINLINE void
+__scatter_base_offsets32_i32(unsigned char *b, uint32_t scale, __vec16_i32 offsets,
+                             __vec16_i32 val, __vec16_i1 mask) {
+    if (!lIsGatherScale(scale)) {
+        __scatter_base_offsets64_i32(b, 1, lScaleOffsets(offsets, scale), val, mask);
+        return;
+    }
+    SCATTER_SCALED(_mm512_mask_i32scatter_epi32, b, mask.v, offsets.v, val.v, scale);
+}
+
+static FORCEINLINE void
+__scatter_base_offsets64_float(unsigned char *b, uint32_t scale, __vec16_i64 offsets,
+                               __vec16_f val, __vec16_i1 mask) {
+    __scatter_base_offsets64_i32(b, scale, offsets, __cast_bits(__vec16_i32(), val), mask);
+}
+
+static FORCEINLINE void
+__scatter_base_offsets32_float(unsigned char *b, uint32_t scale, __vec16_i32 offsets,
+                               __vec16_f val, __vec16_i1 mask) {
+    __scatter_base_offsets32_i32(b, scale, offsets, __cast_bits(__vec16_i32(), val), mask);
+}
+
+static FORCEINLINE void
+__scatter_base_offsets64_i64(unsigned char *b, uint32_t scale, __vec16_i64 offsets,
+                             __vec16_i64 val, __vec16_i1 mask) {
+    if (!lIsGatherScale(scale)) {
+        offsets = lScaleOffsets(offsets, scale);
+        scale = 1;
+    }
+    SCATTER_SCALED(_mm512_mask_i64scatter_epi64, b, lMaskLo(mask), offsets.v[0],
+                   val.v[0], scale);
+    SCATTER_SCALED(_mm512_mask_i64scatter_epi64, b, lMaskHi(mask), offsets.v[1],
+                   val.v[1], scale);
+}
+
+static FORCEINLINE void
+__scatter_base_offsets32_i64(unsigned char *b, uint32_t scale, __vec16_i32 offsets,
+                             __vec16_i64 val, __vec16_i1 mask) {
+    if (!lIsGatherScale(scale)) {
+        __scatter_base_offsets64_i64(b, 1, lScaleOffsets(offsets, scale), val, mask);
+        return;
+    }
+    SCATTER_SCALED(_mm512_mask_i32scatter_epi64, b, lMaskLo(mask), lLo256(offsets.v),
+                   val.v[0], scale);
+    SCATTER_SCALED(_mm512_mask_i32scatter_epi64, b, lMaskHi(mask), lHi256(offsets.v),
+                   val.v[1], scale);
+}
+
+static FORCEINLINE void
+__scatter_base_offsets64_double(unsigned char *b, uint32_t scale, __vec16_i64 offsets,
+                                __vec16_d val, __vec16_i1 mask) {
+    __scatter_base_offsets64_i64(b, scale, offsets, __cast_bits(__vec16_i64(), val), mask);
+}
+
+static FORCEINLINE void
+__scatter_base_offsets32_double(unsigned char *b, uint32_t scale, __vec16_i32 offsets,
+                                __vec16_d val, __vec16_i1 mask) {
+    __scatter_base_offsets32_i64(b, scale, offsets, __cast_bits(__vec16_i64(), val), mask);
+}
+
+#define SCATTER_BASE_OFFSETS_SMALL(VTYPE, STYPE, OTYPE, FUNC)           \
+static FORCEINLINE void FUNC(unsigned char *b, uint32_t scale,          \
+                             OTYPE offset, VTYPE val,                   \
+                             __vec16_i1 mask) {                         \
+    uint32_t m = mask.v;                                                \
+    while (m != 0) {                                                    \
+        int i = __count_trailing_zeros_i32(m);                          \
+        m &= m - 1;                                                     \
+        STYPE *ptr = (STYPE *)(b + scale * (int64_t)__extract_element(offset, i)); \
+        *ptr = __extract_element(val, i);                               \
+    }                                                                   \
+}
+
+SCATTER_BASE_OFFSETS_SMALL(__vec16_i8,  int8_t,  __vec16_i32, __scatter_base_offsets32_i8)
+SCATTER_BASE_OFFSETS_SMALL(__vec16_i8,  int8_t,  __vec16_i64, __scatter_base_offsets64_i8)
+SCATTER_BASE_OFFSETS_SMALL(__vec16_i16, int16_t, __vec16_i32, __scatter_base_offsets32_i16)
+SCATTER_BASE_OFFSETS_SMALL(__vec16_i16, int16_t, __vec16_i64, __scatter_base_offsets64_i16)
+
+#define SCATTER_GENERAL(VTYPE, SUFFIX)                                  \
+static FORCEINLINE void __scatter64_##SUFFIX(__vec16_i64 ptrs, VTYPE val, \
+                                             __vec16_i1 mask) {         \
+    __scatter_base_offsets64_##SUFFIX(NULL, 1, ptrs, val, mask);        \
+}                                                                       \
+static FORCEINLINE void __scatter32_##SUFFIX(__vec16_i32 ptrs, VTYPE val, \
+                                             __vec16_i1 mask) {         \
+    __scatter64_##SUFFIX(__cast_zext(__vec16_i64(), ptrs), val, mask);  \
+}
+
+SCATTER_GENERAL(__vec16_i8, i8)
+SCATTER_GENERAL(__vec16_i16, i16)
+SCATTER_GENERAL(__vec16_i32, i32)
+SCATTER_GENERAL(__vec16_f, float)
+SCATTER_GENERAL(__vec16_i64, i64)
+SCATTER_GENERAL(__vec16_d, double)
+
+///////////////////////////////////////////////////////////////////////////
+// packed load/store
+
+static FORCEINLINE int32_t __packed_load_active(int32_t *ptr, __vec16_i32 *val,
+                                                __vec16_i1 mask) {
+    val->v = _mm512_mask_expandloadu_epi32(val->v, mask.v, ptr);
+    return _mm_popcnt_u32(mask.v);
+}
+
+// Compressing in a register and storing the first count lanes is faster
+// than a compressing store to memory.
+static FORCEINLINE int32_t __packed_store_active(int32_t *ptr, __vec16_i32 val,
+                                                 __vec16_i1 mask) {
+    int count = _mm_popcnt_u32(mask.v);
+    __m512i packed = _mm512_maskz_compress_epi32(mask.v, val.v);
+    _mm512_mask_storeu_epi32(ptr, (__mmask16)((1u << count) - 1), packed);
+    return count;
+}
+
+static FORCEINLINE int32_t __packed_store_active2(int32_t *ptr, __vec16_i32 val,
+                                                  __vec16_i1 mask) {
+    return __packed_store_active(ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_load_active(uint32_t *ptr, __vec16_i32 *val,
+                                                __vec16_i1 mask) {
+    return __packed_load_active((int32_t *)ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_store_active(uint32_t *ptr, __vec16_i32 val,
+                                                 __vec16_i1 mask) {
+    return __packed_store_active((int32_t *)ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_store_active2(uint32_t *ptr, __vec16_i32 val,
+                                                  __vec16_i1 mask) {
+    return __packed_store_active2((int32_t *)ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_load_active_i64(int64_t *ptr, __vec16_i64 *val,
+                                                    __vec16_i1 mask) {
+    __mmask8 lo = lMaskLo(mask), hi = lMaskHi(mask);
+    int countLo = _mm_popcnt_u32(lo);
+    val->v[0] = _mm512_mask_expandloadu_epi64(val->v[0], lo, ptr);
+    val->v[1] = _mm512_mask_expandloadu_epi64(val->v[1], hi, ptr + countLo);
+    return countLo + _mm_popcnt_u32(hi);
+}
+
+static FORCEINLINE int32_t __packed_store_active_i64(int64_t *ptr, __vec16_i64 val,
+                                                     __vec16_i1 mask) {
+    __mmask8 lo = lMaskLo(mask), hi = lMaskHi(mask);
+    int countLo = _mm_popcnt_u32(lo), countHi = _mm_popcnt_u32(hi);
+    _mm512_mask_storeu_epi64(ptr, (__mmask8)((1u << countLo) - 1),
+                             _mm512_maskz_compress_epi64(lo, val.v[0]));
+    _mm512_mask_storeu_epi64(ptr + countLo, (__mmask8)((1u << countHi) - 1),
+                             _mm512_maskz_compress_epi64(hi, val.v[1]));
+    return countLo + countHi;
+}
+
+static FORCEINLINE int32_t __packed_load_active_i64(uint64_t *ptr, __vec16_i64 *val,
+                                                    __vec16_i1 mask) {
+    return __packed_load_active_i64((int64_t *)ptr, val, mask);
+}
+
+static FORCEINLINE int32_t __packed_store_active_i64(uint64_t *ptr, __vec16_i64 val,
+                                                     __vec16_i1 mask) {
+    return __packed_store_active_i64((int64_t *)ptr, val, mask);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// aos/soa
+
+// These are all done with two-source permutes of full vectors: lane i of
+// an output comes from element idx[i] of the concatenation of the two
+// inputs, and a blend picks between two such permutes where the output
+// mixes more than two of the input vectors.
+
+static FORCEINLINE void __soa_to_aos3_float(__vec16_f v0, __vec16_f v1, __vec16_f v2,
+                                            float *ptr) {
+    const __m512i idx0 = _mm512_setr_epi32(0, 16, 0, 1, 17, 1, 2, 18,
+                                           2, 3, 19, 3, 4, 20, 4, 5);
+    const __m512i idx1 = _mm512_setr_epi32(21, 5, 6, 22, 6, 7, 23, 7,
+                                           8, 24, 8, 9, 25, 9, 10, 26);
+    const __m512i idx2 = _mm512_setr_epi32(10, 11, 27, 11, 12, 28, 12, 13,
+                                           29, 13, 14, 30, 14, 15, 31, 15);
+    // The lanes of each output that come from v2.
+    _mm512_storeu_ps(ptr, _mm512_mask_permutexvar_ps(
+        _mm512_permutex2var_ps(v0.v, idx0, v1.v), 0x4924, idx0, v2.v));
+    _mm512_storeu_ps(ptr + 16, _mm512_mask_permutexvar_ps(
+        _mm512_permutex2var_ps(v0.v, idx1, v1.v), 0x2492, idx1, v2.v));
+    _mm512_storeu_ps(ptr + 32, _mm512_mask_permutexvar_ps(
+        _mm512_permutex2var_ps(v0.v, idx2, v1.v), 0x9249, idx2, v2.v));
+}
+
+static FORCEINLINE void __aos_to_soa3_float(float *ptr, __vec16_f *out0,
+                                            __vec16_f *out1, __vec16_f *out2) {
+    __m512 a0 = _mm512_loadu_ps(ptr);
+    __m512 a1 = _mm512_loadu_ps(ptr + 16);
+    __m512 a2 = _mm512_loadu_ps(ptr + 32);
+    __m512i idx = _mm512_mullo_epi32(lIota32(), _mm512_set1_epi32(3));
+    __vec16_f *out[3] = { out0, out1, out2 };
+    for (int k = 0; k < 3; ++k) {
+        // Indices 32 and up are in a2.
+        __mmask16 fromA2 = _mm512_cmpge_epi32_mask(idx, _mm512_set1_epi32(32));
+        out[k]->v = _mm512_mask_permutexvar_ps(_mm512_permutex2var_ps(a0, idx, a1),
+                                               fromA2, idx, a2);
+        idx = _mm512_add_epi32(idx, _mm512_set1_epi32(1));
+    }
+}
+
+static FORCEINLINE void __soa_to_aos4_float(__vec16_f v0, __vec16_f v1, __vec16_f v2,
+                                            __vec16_f v3, float *ptr) {
+    // Even lanes of each group of four come from v0 or v2, odd ones from
+    // v1 or v3.
+    __m512i idx = _mm512_setr_epi32(0, 16, 0, 16, 1, 17, 1, 17,
+                                    2, 18, 2, 18, 3, 19, 3, 19);
+    for (int j = 0; j < 4; ++j) {
+        __m512 r = _mm512_mask_blend_ps(0xcccc, _mm512_permutex2var_ps(v0.v, idx, v1.v),
+                                        _mm512_permutex2var_ps(v2.v, idx, v3.v));
+        _mm512_storeu_ps(ptr + 16 * j, r);
+        idx = _mm512_add_epi32(idx, _mm512_set1_epi32(4));
+    }
+}
+
+static FORCEINLINE void __aos_to_soa4_float(float *ptr, __vec16_f *out0, __vec16_f *out1,
+                                            __vec16_f *out2, __vec16_f *out3) {
+    __m512 a0 = _mm512_loadu_ps(ptr);
+    __m512 a1 = _mm512_loadu_ps(ptr + 16);
+    __m512 a2 = _mm512_loadu_ps(ptr + 32);
+    __m512 a3 = _mm512_loadu_ps(ptr + 48);
+    __m512i idx = _mm512_slli_epi32(lIota32(), 2);
+    __vec16_f *out[4] = { out0, out1, out2, out3 };
+    for (int k = 0; k < 4; ++k) {
+        // The first 8 lanes come from a0 and a1, the rest from a2 and a3.
+        out[k]->v = _mm512_mask_blend_ps(0xff00, _mm512_permutex2var_ps(a0, idx, a1),
+                                         _mm512_permutex2var_ps(a2, idx, a3));
+        idx = _mm512_add_epi32(idx, _mm512_set1_epi32(1));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// prefetch
+
+static FORCEINLINE void __prefetch_read_uniform_1(unsigned char *ptr) {
+    _mm_prefetch((char *)ptr, _MM_HINT_T0);
+}
+
+static FORCEINLINE void __prefetch_read_uniform_2(unsigned char *ptr) {
+    _mm_prefetch((char *)ptr, _MM_HINT_T1);
+}
+
+static FORCEINLINE void __prefetch_read_uniform_3(unsigned char *ptr) {
+    _mm_prefetch((char *)ptr, _MM_HINT_T2);
+}
+
+static FORCEINLINE void __prefetch_read_uniform_nt(unsigned char *ptr) {
+    _mm_prefetch((char *)ptr, _MM_HINT_NTA);
+}
+
+#define PREFETCH_READ_VARYING(CACHE_NUM, HINT)                                                      \
+static FORCEINLINE void __prefetch_read_varying_##CACHE_NUM##_native(uint8_t *base, uint32_t scale, \
+                                                                   __vec16_i32 offsets, __vec16_i1 mask) { \
+    uint32_t m = mask.v;                                                                            \
+    while (m != 0) {                                                                                \
+        int i = __count_trailing_zeros_i32(m);                                                      \
+        m &= m - 1;                                                                                 \
+        _mm_prefetch((char *)(base + scale * (int64_t)__extract_element(offsets, i)), HINT);        \
+    }                                                                                               \
+}                                                                                                   \
+static FORCEINLINE void __prefetch_read_varying_##CACHE_NUM(__vec16_i64 addr, __vec16_i1 mask) {      \
+    uint32_t m = mask.v;                                                                            \
+    while (m != 0) {                                                                                \
+        int i = __count_trailing_zeros_i32(m);                                                      \
+        m &= m - 1;                                                                                 \
+        _mm_prefetch((char *)(uintptr_t)__extract_element(addr, i), HINT);                          \
+    }                                                                                               \
+}
+
+PREFETCH_READ_VARYING(1, _MM_HINT_T0)
+PREFETCH_READ_VARYING(2, _MM_HINT_T1)
+PREFETCH_READ_VARYING(3, _MM_HINT_T2)
+PREFETCH_READ_VARYING(nt, _MM_HINT_NTA)
+
+///////////////////////////////////////////////////////////////////////////
+// atomics
+
+static FORCEINLINE uint32_t __atomic_add(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedAdd((LONG volatile *)p, v) - v;
+#else
+    return __sync_fetch_and_add(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_sub(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedAdd((LONG volatile *)p, -v) + v;
+#else
+    return __sync_fetch_and_sub(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_and(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedAnd((LONG volatile *)p, v);
+#else
+    return __sync_fetch_and_and(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_or(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedOr((LONG volatile *)p, v);
+#else
+    return __sync_fetch_and_or(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_xor(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedXor((LONG volatile *)p, v);
+#else
+    return __sync_fetch_and_xor(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_min(uint32_t *p, uint32_t v) {
+    int32_t old, min;
+    do {
+        old = *((volatile int32_t *)p);
+        min = (old < (int32_t)v) ? old : (int32_t)v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange((LONG volatile *)p, min, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, min) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint32_t __atomic_max(uint32_t *p, uint32_t v) {
+    int32_t old, max;
+    do {
+        old = *((volatile int32_t *)p);
+        max = (old > (int32_t)v) ? old : (int32_t)v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange((LONG volatile *)p, max, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, max) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint32_t __atomic_umin(uint32_t *p, uint32_t v) {
+    uint32_t old, min;
+    do {
+        old = *((volatile uint32_t *)p);
+        min = (old < v) ? old : v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange((LONG volatile *)p, min, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, min) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint32_t __atomic_umax(uint32_t *p, uint32_t v) {
+    uint32_t old, max;
+    do {
+        old = *((volatile uint32_t *)p);
+        max = (old > v) ? old : v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange((LONG volatile *)p, max, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, max) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint32_t __atomic_xchg(uint32_t *p, uint32_t v) {
+#ifdef _MSC_VER
+    return InterlockedExchange((LONG volatile *)p, v);
+#else
+    return __sync_lock_test_and_set(p, v);
+#endif
+}
+
+static FORCEINLINE uint32_t __atomic_cmpxchg(uint32_t *p, uint32_t cmpval,
+                                             uint32_t newval) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange((LONG volatile *)p, newval, cmpval);
+#else
+    return __sync_val_compare_and_swap(p, cmpval, newval);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_add(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedAdd64((LONGLONG volatile *)p, v) - v;
+#else
+    return __sync_fetch_and_add(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_sub(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedAdd64((LONGLONG volatile *)p, -v) + v;
+#else
+    return __sync_fetch_and_sub(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_and(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedAnd64((LONGLONG volatile *)p, v);
+#else
+    return __sync_fetch_and_and(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_or(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedOr64((LONGLONG volatile *)p, v);
+#else
+    return __sync_fetch_and_or(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_xor(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedXor64((LONGLONG volatile *)p, v);
+#else
+    return __sync_fetch_and_xor(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_min(uint64_t *p, uint64_t v) {
+    int64_t old, min;
+    do {
+        old = *((volatile int64_t *)p);
+        min = (old < (int64_t)v) ? old : (int64_t)v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange64((LONGLONG volatile *)p, min, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, min) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint64_t __atomic_max(uint64_t *p, uint64_t v) {
+    int64_t old, max;
+    do {
+        old = *((volatile int64_t *)p);
+        max = (old > (int64_t)v) ? old : (int64_t)v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange64((LONGLONG volatile *)p, max, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, max) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint64_t __atomic_umin(uint64_t *p, uint64_t v) {
+    uint64_t old, min;
+    do {
+        old = *((volatile uint64_t *)p);
+        min = (old < v) ? old : v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange64((LONGLONG volatile *)p, min, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, min) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint64_t __atomic_umax(uint64_t *p, uint64_t v) {
+    uint64_t old, max;
+    do {
+        old = *((volatile uint64_t *)p);
+        max = (old > v) ? old : v;
+#ifdef _MSC_VER
+    } while (InterlockedCompareExchange64((LONGLONG volatile *)p, max, old) != old);
+#else
+    } while (__sync_bool_compare_and_swap(p, old, max) == false);
+#endif
+    return old;
+}
+
+static FORCEINLINE uint64_t __atomic_xchg(uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+    return InterlockedExchange64((LONGLONG volatile *)p, v);
+#else
+    return __sync_lock_test_and_set(p, v);
+#endif
+}
+
+static FORCEINLINE uint64_t __atomic_cmpxchg(uint64_t *p, uint64_t cmpval,
+                                             uint64_t newval) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange64((LONGLONG volatile *)p, newval, cmpval);
+#else
+    return __sync_val_compare_and_swap(p, cmpval, newval);
+#endif
+}
+
+#ifdef WIN32
+#include <windows.h>
+#define __clock __rdtsc
+#else // WIN32
+static FORCEINLINE uint64_t __clock() {
+  uint32_t low, high;
+#ifdef __x86_64
+  __asm__ __volatile__ ("xorl %%eax,%%eax \n    cpuid"
+                        ::: "%rax", "%rbx", "%rcx", "%rdx" );
+#else
+  __asm__ __volatile__ ("xorl %%eax,%%eax \n    cpuid"
+                        ::: "%eax", "%ebx", "%ecx", "%edx" );
+#endif
+  __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+  return (uint64_t)high << 32 | low;
+}
+#endif // !WIN32
+
+///////////////////////////////////////////////////////////////////////////
+// Transcendentals
+
+#define TRANSCENDENTALS(op) \
+static FORCEINLINE __vec16_f __##op##_varying_float(__vec16_f a) {\
+    float r[16];\
+    for (int i = 0; i < 16; ++i)\
+        r[i] = op##f(__extract_element(a, i));\
+    return __vec16_f(r);\
+}\
+static FORCEINLINE float __##op##_uniform_float(float a) {\
+    return op##f(a);\
+}\
+static FORCEINLINE __vec16_d __##op##_varying_double(__vec16_d a) {\
+    double r[16];\
+    for (int i = 0; i < 16; ++i)\
+        r[i] = op(__extract_element(a, i));\
+    return __vec16_d(r);\
+}\
+static FORCEINLINE double __##op##_uniform_double(double a) {\
+    return op(a);\
+}
+
+TRANSCENDENTALS(log)
+TRANSCENDENTALS(exp)
+
+static FORCEINLINE __vec16_f __pow_varying_float(__vec16_f a, __vec16_f b) {
+    float r[16];
+    for (int i = 0; i < 16; ++i)
+        r[i] = powf(__extract_element(a, i), __extract_element(b, i));
+    return __vec16_f(r);
+}
+static FORCEINLINE float __pow_uniform_float(float a, float b) {
+    return powf(a, b);
+}
+static FORCEINLINE __vec16_d __pow_varying_double(__vec16_d a, __vec16_d b) {
+    double r[16];
+    for (int i = 0; i < 16; ++i)
+        r[i] = pow(__extract_element(a, i), __extract_element(b, i));
+    return __vec16_d(r);
+}
+static FORCEINLINE double __pow_uniform_double(double a, double b) {
+    return pow(a, b);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Trigonometry
+
+TRANSCENDENTALS(sin)
+TRANSCENDENTALS(asin)
+TRANSCENDENTALS(cos)
+TRANSCENDENTALS(acos)
+TRANSCENDENTALS(tan)
+TRANSCENDENTALS(atan)
+
+static FORCEINLINE __vec16_f __atan2_varying_float(__vec16_f a, __vec16_f b) {
+    float r[16];
+    for (int i = 0; i < 16; ++i)
+        r[i] = atan2f(__extract_element(a, i), __extract_element(b, i));
+    return __vec16_f(r);
+}
+static FORCEINLINE float __atan2_uniform_float(float a, float b) {
+    return atan2f(a, b);
+}
+static FORCEINLINE __vec16_d __atan2_varying_double(__vec16_d a, __vec16_d b) {
+    double r[16];
+    for (int i = 0; i < 16; ++i)
+        r[i] = atan2(__extract_element(a, i), __extract_element(b, i));
+    return __vec16_d(r);
+}
+static FORCEINLINE double __atan2_uniform_double(double a, double b) {
+    return atan2(a, b);
+}
+
+static FORCEINLINE void __sincos_varying_float(__vec16_f x, __vec16_f * _sin, __vec16_f * _cos) {
+    float s[16], c[16];
+    for (int i = 0; i < 16; ++i)
+        sincosf(__extract_element(x, i), s + i, c + i);
+    *_sin = __vec16_f(s);
+    *_cos = __vec16_f(c);
+}
+static FORCEINLINE void __sincos_uniform_float(float x, float *_sin, float *_cos) {
+    sincosf(x, _sin, _cos);
+}
+static FORCEINLINE void __sincos_varying_double(__vec16_d x, __vec16_d * _sin, __vec16_d * _cos) {
+    double s[16], c[16];
+    for (int i = 0; i < 16; ++i)
+        sincos(__extract_element(x, i), s + i, c + i);
+    *_sin = __vec16_d(s);
+    *_cos = __vec16_d(c);
+}
+static FORCEINLINE void __sincos_uniform_double(double x, double *_sin, double *_cos) {
+    sincos(x, _sin, _cos);
+}
+
+#undef FORCEINLINE
@@ -40,7 +40,7 @@
 
 #include <stdio.h>
 #include <algorithm>
-#include "../timing.h"
+#include "../benchmark.h"
 #include "mandelbrot_ispc.h"
 #include <string.h>
 #include <cstdlib>
@@ -98,14 +98,13 @@ int main(int argc, char *argv[]) {
     // Compute the image using the ispc implementation; report the minimum
     // time of three runs.
     //
-    double minISPC = 1e30;
-    for (unsigned int i = 0; i < test_iterations[0]; ++i) {
-        reset_and_start_timer();
+    Benchmark ispcBench("mandelbrot ispc", test_iterations[0]);
+    while (ispcBench.next()) {
+        ispcBench.start();
         mandelbrot_ispc(x0, y0, x1, y1, width, height, maxIterations, buf);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC run:\t\t\t[%.3f] million cycles\n", dt);
-        minISPC = std::min(minISPC, dt);
+        ispcBench.stop();
     }
+    double minISPC = ispcBench.min();
 
     printf("[mandelbrot ispc]:\t\t[%.3f] million cycles\n", minISPC);
     writePPM(buf, width, height, "mandelbrot-ispc.ppm");
@@ -118,14 +117,13 @@ int main(int argc, char *argv[]) {
     // And run the serial implementation 3 times, again reporting the
     // minimum time.
     //
-    double minSerial = 1e30;
-    for (unsigned int i = 0; i < test_iterations[1]; ++i) {
-        reset_and_start_timer();
+    Benchmark serialBench("mandelbrot serial", test_iterations[1]);
+    while (serialBench.next()) {
+        serialBench.start();
         mandelbrot_serial(x0, y0, x1, y1, width, height, maxIterations, buf);
-        double dt = get_elapsed_mcycles();
-        printf("@time of serial run:\t\t\t[%.3f] million cycles\n", dt);
-        minSerial = std::min(minSerial, dt);
+        serialBench.stop();
     }
+    double minSerial = serialBench.min();
 
     printf("[mandelbrot serial]:\t\t[%.3f] million cycles\n", minSerial);
     writePPM(buf, width, height, "mandelbrot-serial.ppm");
@@ -42,7 +42,7 @@
 #include <cstdlib>
 #include <algorithm>
 #include <string.h>
-#include "../timing.h"
+#include "../benchmark.h"
 #include "mandelbrot_tasks_ispc.h"
 using namespace ispc;
 
@@ -109,17 +109,16 @@ int main(int argc, char *argv[]) {
     // Compute the image using the ispc implementation; report the minimum
     // time of three runs.
     //
-    double minISPC = 1e30;
-    for (unsigned int i = 0; i < test_iterations[0]; ++i) {
+    Benchmark ispcBench("mandelbrot ispc+tasks", test_iterations[0]);
+    while (ispcBench.next()) {
         // Clear out the buffer
         for (unsigned int i = 0; i < width * height; ++i)
             buf[i] = 0;
-        reset_and_start_timer();
+        ispcBench.start();
         mandelbrot_ispc(x0, y0, x1, y1, width, height, maxIterations, buf);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC + TASKS run:\t\t\t[%.3f] million cycles\n", dt);
-        minISPC = std::min(minISPC, dt);
+        ispcBench.stop();
     }
+    double minISPC = ispcBench.min();
 
     printf("[mandelbrot ispc+tasks]:\t[%.3f] million cycles\n", minISPC);
     writePPM(buf, width, height, "mandelbrot-ispc.ppm");
@@ -129,17 +128,16 @@ int main(int argc, char *argv[]) {
     // And run the serial implementation 3 times, again reporting the
     // minimum time.
     //
-    double minSerial = 1e30;
-    for (unsigned int i = 0; i < test_iterations[1]; ++i) {
+    Benchmark serialBench("mandelbrot serial", test_iterations[1]);
+    while (serialBench.next()) {
         // Clear out the buffer
         for (unsigned int i = 0; i < width * height; ++i)
             buf[i] = 0;
-        reset_and_start_timer();
+        serialBench.start();
         mandelbrot_serial(x0, y0, x1, y1, width, height, maxIterations, buf);
-        double dt = get_elapsed_mcycles();
-        printf("@time of serial run:\t\t\t[%.3f] million cycles\n", dt);
-        minSerial = std::min(minSerial, dt);
+        serialBench.stop();
     }
+    double minSerial = serialBench.min();
 
     printf("[mandelbrot serial]:\t\t[%.3f] million cycles\n", minSerial);
     writePPM(buf, width, height, "mandelbrot-serial.ppm");
@@ -0,0 +1,177 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+#ifndef ISPC_EXAMPLES_MAPPED_FILE_H
+#define ISPC_EXAMPLES_MAPPED_FILE_H
+
+/* Maps a whole file into memory, for examples that load data sets that
+   are already laid out the way their ispc kernels use them: the kernels
+   can then read the arrays in the file in place, and loading the data
+   only takes as long as paging in the parts of it that are used.
+
+   The mapping is private and writable: pages that are written to are
+   copied, and the file itself is never changed. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef _WIN32
+  #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+class MappedFile {
+public:
+    MappedFile() : data(NULL), size(0) { }
+    ~MappedFile() { Close(); }
+
+    /* Maps the given file; returns false if it can't be opened or
+       mapped, or is empty. */
+    bool Open(const char *path);
+    void Close();
+
+    void *Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    void *data;
+    size_t size;
+};
+
+
+inline bool
+MappedFile::Open(const char *path) {
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return false;
+    // The view keeps the mapping alive.
+    data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL)
+        return false;
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void *ptr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+    data = ptr;
+    size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+
+inline void
+MappedFile::Close() {
+    if (data == NULL)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+    data = NULL;
+    size = 0;
+}
+
+
+/* The size and modification time of a file.  Files derived from another
+   one, like copies of it laid out for mapping, record the source file's
+   stamp so that they can be rebuilt when it changes. */
+struct FileStamp {
+    uint64_t size;
+    int64_t mtime;
+};
+
+
+/* Gets the stamp of the given file; returns false if it doesn't exist. */
+inline bool
+GetFileStamp(const char *path, FileStamp *stamp) {
+    memset(stamp, 0, sizeof(*stamp));
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+        return false;
+    stamp->size = ((uint64_t)attributes.nFileSizeHigh << 32) |
+        attributes.nFileSizeLow;
+    stamp->mtime = (int64_t)(((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) |
+                             attributes.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+    stamp->size = (uint64_t)st.st_size;
+    stamp->mtime = (int64_t)st.st_mtime;
+#endif
+    return true;
+}
+
+
+inline bool
+operator==(const FileStamp &a, const FileStamp &b) {
+    return a.size == b.size && a.mtime == b.mtime;
+}
+
+#endif // ISPC_EXAMPLES_MAPPED_FILE_H
@@ -0,0 +1,141 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+/* Runs the microbenchmarks in microbench.ispc and prints a table of the
+   cycles per gang-wide operation for each of them, measuring throughput
+   (independent operations) and latency (dependent ones).  "make tables"
+   builds this once per target and prints the table for each ISA; the
+   optional command line argument is the label to print in the header. */
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#define NOMINMAX
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "../timing.h"
+
+#include "microbench_ispc.h"
+
+typedef void (FuncType)(int, float *, int *, int, float *);
+
+struct MicroBench {
+    const char *name;
+    FuncType *tput;
+    FuncType *lat;
+};
+
+#define BENCH(NAME) { #NAME, ispc::NAME##_tput, ispc::NAME##_lat }
+
+static MicroBench benchmarks[] = {
+    BENCH(gather),
+    BENCH(scatter),
+    BENCH(masked_load),
+    BENCH(masked_store),
+    BENCH(reduce_add_float),
+    BENCH(reduce_add_int32),
+    BENCH(reduce_min_float),
+    BENCH(reduce_max_int32),
+    BENCH(reduce_add_double),
+    BENCH(packed_store_active),
+    BENCH(sqrt),
+    BENCH(rcp),
+    BENCH(rsqrt),
+    BENCH(sin),
+    BENCH(cos),
+    BENCH(tan),
+    BENCH(atan),
+    BENCH(exp),
+    BENCH(log),
+    BENCH(pow),
+    BENCH(any),
+    BENCH(all),
+    BENCH(movmsk),
+    BENCH(popcnt),
+};
+
+// Small enough for the tables to stay in the L1 cache, so that the
+// gathers and scatters measure the instructions rather than the memory
+// system; it must be a power of two.
+static const int tableSize = 2048;
+static const int iterations = 64 * 1024;
+
+/* Returns the minimum over a few runs of the cycles per iteration of the
+   given benchmark. */
+static double
+lRun(FuncType *func, float *ftable, int *itable, float *out) {
+    double best = 1e30;
+    for (int run = 0; run < 5; ++run) {
+        for (int i = 0; i < tableSize; ++i)
+            ftable[i] = float(i) / float(tableSize);
+        reset_and_start_timer();
+        func(iterations, ftable, itable, tableSize, out);
+        double mcycles = get_elapsed_mcycles();
+        best = std::min(best, mcycles);
+    }
+    return best * (1024. * 1024.) / iterations;
+}
+
+int main(int argc, char *argv[]) {
+    float *ftable = new float[tableSize];
+    int *itable = new int[tableSize];
+    float *out = new float[tableSize];
+
+    // A single random cycle through all of the elements (Sattolo's
+    // algorithm), so that the chased indices don't settle in a short loop.
+    for (int i = 0; i < tableSize; ++i)
+        itable[i] = i;
+    srand(1);
+    for (int i = tableSize - 1; i > 0; --i)
+        std::swap(itable[i], itable[rand() % i]);
+
+    int width = ispc::targetWidth();
+    printf("%s, %d-wide: cycles per gang operation\n",
+           argc > 1 ? argv[1] : "ispc", width);
+    printf("%-24s %12s %12s %14s\n", "builtin", "throughput", "latency",
+           "tput/element");
+    int nBenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    for (int i = 0; i < nBenchmarks; ++i) {
+        double tput = lRun(benchmarks[i].tput, ftable, itable, out);
+        double lat = lRun(benchmarks[i].lat, ftable, itable, out);
+        printf("%-24s %12.2f %12.2f %14.3f\n", benchmarks[i].name, tput, lat,
+               tput / width);
+    }
+
+    delete[] ftable;
+    delete[] itable;
+    delete[] out;
+    return 0;
+}
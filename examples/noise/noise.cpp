@@ -41,7 +41,7 @@
 #include <cstdlib>
 #include <stdio.h>
 #include <algorithm>
-#include "../timing.h"
+#include "../benchmark.h"
 #include "noise_ispc.h"
 #include <string.h>
 using namespace ispc;
@@ -94,14 +94,13 @@ int main(int argc, char *argv[]) {
     // Compute the image using the ispc implementation; report the minimum
     // time of three runs.
     //
-    double minISPC = 1e30;
-    for (unsigned int i = 0; i < test_iterations[0]; ++i) {
-        reset_and_start_timer();
+    Benchmark ispcBench("noise ispc", test_iterations[0]);
+    while (ispcBench.next()) {
+        ispcBench.start();
         noise_ispc(x0, y0, x1, y1, width, height, buf);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC run:\t\t\t[%.3f] million cycles\n", dt);
-        minISPC = std::min(minISPC, dt);
+        ispcBench.stop();
     }
+    double minISPC = ispcBench.min();
 
     printf("[noise ispc]:\t\t\t[%.3f] million cycles\n", minISPC);
     writePPM(buf, width, height, "noise-ispc.ppm");
@@ -114,14 +113,13 @@ int main(int argc, char *argv[]) {
     // And run the serial implementation 3 times, again reporting the
     // minimum time.
     //
-    double minSerial = 1e30;
-    for (unsigned int i = 0; i < test_iterations[1]; ++i) {
-        reset_and_start_timer();
+    Benchmark serialBench("noise serial", test_iterations[1]);
+    while (serialBench.next()) {
+        serialBench.start();
         noise_serial(x0, y0, x1, y1, width, height, buf);
-        double dt = get_elapsed_mcycles();
-        printf("@time of serial run:\t\t\t[%.3f] million cycles\n", dt);
-        minSerial = std::min(minSerial, dt);
+        serialBench.stop();
     }
+    double minSerial = serialBench.min();
 
     printf("[noise serial]:\t\t\t[%.3f] million cycles\n", minSerial);
     writePPM(buf, width, height, "noise-serial.ppm");
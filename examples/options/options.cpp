@@ -42,7 +42,7 @@
 using std::max;
 
 #include "options_defs.h"
-#include "../timing.h"
+#include "../benchmark.h"
 
 #include "options_ispc.h"
 using namespace ispc;
@@ -93,48 +93,48 @@ int main(int argc, char *argv[]) {
     //
     // Binomial options pricing model, ispc implementation
     //
-    double binomial_ispc = 1e30;
-    for (int i = 0; i < 3; ++i) {
-        reset_and_start_timer();
+    Benchmark binomialBench("binomial ispc, 1 thread", 3);
+    while (binomialBench.next()) {
+        binomialBench.start();
         binomial_put_ispc(S, X, T, r, v, result, nOptions);
-        double dt = get_elapsed_mcycles();
+        binomialBench.stop();
         sum = 0.;
         for (int i = 0; i < nOptions; ++i)
             sum += result[i];
-        binomial_ispc = std::min(binomial_ispc, dt);
     }
+    double binomial_ispc = binomialBench.min();
     printf("[binomial ispc, 1 thread]:\t[%.3f] million cycles (avg %f)\n", 
            binomial_ispc, sum / nOptions);
 
     //
     // Binomial options pricing model, ispc implementation, tasks
     //
-    double binomial_tasks = 1e30;
-    for (int i = 0; i < 3; ++i) {
-        reset_and_start_timer();
+    Benchmark binomialTasksBench("binomial ispc, tasks", 3);
+    while (binomialTasksBench.next()) {
+        binomialTasksBench.start();
         binomial_put_ispc_tasks(S, X, T, r, v, result, nOptions);
-        double dt = get_elapsed_mcycles();
+        binomialTasksBench.stop();
         sum = 0.;
         for (int i = 0; i < nOptions; ++i)
             sum += result[i];
-        binomial_tasks = std::min(binomial_tasks, dt);
     }
+    double binomial_tasks = binomialTasksBench.min();
     printf("[binomial ispc, tasks]:\t\t[%.3f] million cycles (avg %f)\n", 
            binomial_tasks, sum / nOptions);
 
     //
     // Binomial options, serial implementation
     //
-    double binomial_serial = 1e30;
-    for (int i = 0; i < 3; ++i) {
-        reset_and_start_timer();
+    Benchmark binomialSerialBench("binomial serial", 3);
+    while (binomialSerialBench.next()) {
+        binomialSerialBench.start();
         binomial_put_serial(S, X, T, r, v, result, nOptions);
-        double dt = get_elapsed_mcycles();
+        binomialSerialBench.stop();
         sum = 0.;
         for (int i = 0; i < nOptions; ++i)
             sum += result[i];
-        binomial_serial = std::min(binomial_serial, dt);
     }
+    double binomial_serial = binomialSerialBench.min();
     printf("[binomial serial]:\t\t[%.3f] million cycles (avg %f)\n", 
            binomial_serial, sum / nOptions);
 
@@ -144,48 +144,48 @@ int main(int argc, char *argv[]) {
     //
     // Black-Scholes options pricing model, ispc implementation, 1 thread
     //
-    double bs_ispc = 1e30;
-    for (int i = 0; i < 3; ++i) {
-        reset_and_start_timer();
+    Benchmark bsBench("black-scholes ispc, 1 thread", 3);
+    while (bsBench.next()) {
+        bsBench.start();
         black_scholes_ispc(S, X, T, r, v, result, nOptions);
-        double dt = get_elapsed_mcycles();
+        bsBench.stop();
         sum = 0.;
         for (int i = 0; i < nOptions; ++i)
             sum += result[i];
-        bs_ispc = std::min(bs_ispc, dt);
     }
+    double bs_ispc = bsBench.min();
     printf("[black-scholes ispc, 1 thread]:\t[%.3f] million cycles (avg %f)\n", 
            bs_ispc, sum / nOptions);
 
     //
     // Black-Scholes options pricing model, ispc implementation, tasks
     //
-    double bs_ispc_tasks = 1e30;
-    for (int i = 0; i < 3; ++i) {
-        reset_and_start_timer();
+    Benchmark bsTasksBench("black-scholes ispc, tasks", 3);
+    while (bsTasksBench.next()) {
+        bsTasksBench.start();
         black_scholes_ispc_tasks(S, X, T, r, v, result, nOptions);
-        double dt = get_elapsed_mcycles();
+        bsTasksBench.stop();
         sum = 0.;
         for (int i = 0; i < nOptions; ++i)
             sum += result[i];
-        bs_ispc_tasks = std::min(bs_ispc_tasks, dt);
     }
+    double bs_ispc_tasks = bsTasksBench.min();
     printf("[black-scholes ispc, tasks]:\t[%.3f] million cycles (avg %f)\n", 
            bs_ispc_tasks, sum / nOptions);
 
     //
     // Black-Scholes options pricing model, serial implementation
     //
-    double bs_serial = 1e30;
-    for (int i = 0; i < 3; ++i) {
-        reset_and_start_timer();
+    Benchmark bsSerialBench("black-scholes serial", 3);
+    while (bsSerialBench.next()) {
+        bsSerialBench.start();
         black_scholes_serial(S, X, T, r, v, result, nOptions);
-        double dt = get_elapsed_mcycles();
+        bsSerialBench.stop();
         sum = 0.;
         for (int i = 0; i < nOptions; ++i)
             sum += result[i];
-        bs_serial = std::min(bs_serial, dt);
     }
+    double bs_serial = bsSerialBench.min();
     printf("[black-scholes serial]:\t\t[%.3f] million cycles (avg %f)\n", bs_serial, 
            sum / nOptions);
 
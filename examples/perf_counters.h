@@ -0,0 +1,212 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+/* Optional hardware performance counters for the benchmark harness in
+   benchmark.h.  They're read through perf_event_open(2) and so are only
+   available on Linux; elsewhere, or if the kernel doesn't allow access to
+   them, no counters are reported and the timings work as before.
+
+   The counters to collect are given by the ISPC_BENCH_COUNTERS
+   environment variable, as a comma-separated list of:
+
+       default          cycles,instructions,l1d-misses,llc-misses
+       cycles           core cycles (unlike rdtsc, these follow turbo)
+       instructions     retired instructions
+       l1d-misses       L1 data cache read misses
+       llc-misses       last level cache misses
+       branch-misses    mispredicted branches
+       name=0xNNNN      a raw, model-specific event; for example the gather
+                        uops of the CPU at hand, from its event tables
+
+   Counters are per process and include the threads that are started after
+   they're opened, so the first Benchmark has to be created before the task
+   system spins up its threads for the task counts to be complete.
+
+   Only runs timed with Benchmark report counters.  All of the examples in
+   perf.ini are; the others (microbench, perfbench, gmres and so on) still
+   time themselves with timing.h alone and ignore ISPC_BENCH_COUNTERS.
+ */
+
+#ifndef ISPC_EXAMPLES_PERF_COUNTERS_H
+#define ISPC_EXAMPLES_PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+class PerfCounters {
+public:
+    /* The process-wide set of counters, opened on first use. */
+    static PerfCounters &get() {
+        static PerfCounters counters;
+        return counters;
+    }
+
+    int count() const { return (int)names.size(); }
+    const char *name(int i) const { return names[i].c_str(); }
+
+    void start() {
+#ifdef __linux__
+        for (size_t i = 0; i < fds.size(); ++i)
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        for (size_t i = 0; i < fds.size(); ++i)
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    /* Stops counting and stores the count() values, scaled up if the
+       kernel had to multiplex the counters, to the given array. */
+    void stop(double *values) {
+#ifdef __linux__
+        for (size_t i = 0; i < fds.size(); ++i)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        for (size_t i = 0; i < fds.size(); ++i) {
+            uint64_t data[3] = { 0, 0, 0 };
+            values[i] = 0.;
+            if (read(fds[i], data, sizeof(data)) == (ssize_t)sizeof(data) &&
+                data[2] > 0)
+                values[i] = (double)data[0] * ((double)data[1] / (double)data[2]);
+        }
+#endif
+    }
+
+private:
+    PerfCounters() {
+        const char *spec = getenv("ISPC_BENCH_COUNTERS");
+        if (spec == NULL || *spec == '\0')
+            return;
+#ifndef __linux__
+        fprintf(stderr, "Warning: ISPC_BENCH_COUNTERS is only supported "
+                "on Linux\n");
+        return;
+#endif
+        std::string list(spec);
+        size_t pos = 0;
+        while (pos <= list.size()) {
+            size_t comma = list.find(',', pos);
+            if (comma == std::string::npos)
+                comma = list.size();
+            std::string item = list.substr(pos, comma - pos);
+            if (item == "default" || item == "1") {
+                add("cycles");
+                add("instructions");
+                add("l1d-misses");
+                add("llc-misses");
+            }
+            else if (!item.empty())
+                add(item);
+            pos = comma + 1;
+        }
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (size_t i = 0; i < fds.size(); ++i)
+            close(fds[i]);
+#endif
+    }
+
+    void add(const std::string &item) {
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        std::string name = item;
+        size_t eq = item.find('=');
+        if (eq != std::string::npos) {
+            name = item.substr(0, eq);
+            attr.type = PERF_TYPE_RAW;
+            attr.config = strtoull(item.c_str() + eq + 1, NULL, 0);
+        }
+        else if (item == "cycles") {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        }
+        else if (item == "instructions") {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        }
+        else if (item == "l1d-misses") {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        else if (item == "llc-misses") {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        }
+        else if (item == "branch-misses") {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        }
+        else {
+            fprintf(stderr, "Warning: unknown counter \"%s\" in "
+                    "ISPC_BENCH_COUNTERS\n", item.c_str());
+            return;
+        }
+
+        int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd < 0) {
+            fprintf(stderr, "Warning: counter \"%s\" isn't available\n",
+                    item.c_str());
+            return;
+        }
+        fds.push_back(fd);
+        names.push_back(name);
+#else
+        (void)item;
+#endif
+    }
+
+    std::vector<std::string> names;
+    std::vector<int> fds;
+};
+
+#endif // ISPC_EXAMPLES_PERF_COUNTERS_H
@@ -104,6 +104,27 @@ int main() {
 #endif
     }
 
+    // The overhead of a launch and the sync that waits for it, with the
+    // task system that ../tasksys.cpp was built with ("make tasksys"
+    // builds this with several of them).
+    static const int taskCounts[] = { 1, 16, 256, 4096 };
+    int *threads = new int[4096];
+    for (unsigned int i = 0; i < sizeof(taskCounts) / sizeof(taskCounts[0]); ++i) {
+        int nTasks = taskCounts[i];
+        int iterations = 1024 * 1024 / nTasks;
+        ispc::launchSync(nTasks, threads);
+        reset_and_start_timer();
+        for (int j = 0; j < iterations; ++j)
+            ispc::launchSync(nTasks, threads);
+        double time = get_elapsed_mcycles();
+
+        char name[64];
+        sprintf(name, "Task launch and sync (%d tasks)", nTasks);
+        printf("%-40s: [%.2f] K cycles per launch, [%.3f] K cycles per task.\n",
+               name, 1e3 * time / iterations, 1e3 * time / (iterations * nTasks));
+    }
+    delete[] threads;
+
     return 0;
 }
 
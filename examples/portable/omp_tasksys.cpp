@@ -89,6 +89,9 @@ extern "C" {
     void ISPCLaunch(void **handlePtr, void *f, void *data, int countx, int county, int countz);
     void *ISPCAlloc(void **handlePtr, int64_t size, int32_t alignment);
     void ISPCSync(void *handle);
+    void ISPCSyncLaunch(void *handle, int32_t launch);
+    void ISPCLaunchAfter(void **handlePtr, void *f, void *data, int countx, int county, int countz,
+                         int32_t numDeps, const int32_t *deps);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -392,6 +395,23 @@ ISPCSync(void *h)
 }
 
 
+  void
+ISPCSyncLaunch(void *h, int32_t launch)
+{
+  // Launch() doesn't return until all of the tasks have run.
+}
+
+
+  void
+ISPCLaunchAfter(void **taskGroupPtr, void *func, void *data, int count0, int count1, int count2,
+                int32_t numDeps, const int32_t *deps)
+{
+  // The launches the tasks depend on have all finished already; see
+  // ISPCSyncLaunch().
+  ISPCLaunch(taskGroupPtr, func, data, count0, count1, count2);
+}
+
+
   void *
 ISPCAlloc(void **taskGroupPtr, int64_t size, int32_t alignment)
 {
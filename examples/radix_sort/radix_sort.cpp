@@ -0,0 +1,120 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include "../timing.h"
+#include "radix_sort_ispc.h"
+using namespace ispc;
+
+/* Sorts random key/value pairs with the radix sort in
+   ../util/radix_sort.isph, checks the result against std::stable_sort
+   and reports the time taken by each. */
+
+static int nErrors = 0;
+
+template <typename K>
+struct PairLess {
+    bool operator()(const std::pair<K, int32_t> &a,
+                    const std::pair<K, int32_t> &b) const {
+        return a.first < b.first;
+    }
+};
+
+template <typename K> static void
+run(const char *name, const K *input, int count,
+    void (*sort)(K keys[], int32_t values[], int count)) {
+    std::vector<K> keys(count);
+    std::vector<int32_t> values(count);
+    double ispcCycles = 1e30;
+    for (int run = 0; run < 3; ++run) {
+        std::copy(input, input + count, keys.begin());
+        for (int i = 0; i < count; ++i)
+            values[i] = i;
+        reset_and_start_timer();
+        sort(&keys[0], &values[0], count);
+        ispcCycles = std::min(ispcCycles, get_elapsed_mcycles());
+    }
+
+    std::vector<std::pair<K, int32_t> > ref(count);
+    for (int i = 0; i < count; ++i)
+        ref[i] = std::make_pair(input[i], i);
+    reset_and_start_timer();
+    std::stable_sort(ref.begin(), ref.end(), PairLess<K>());
+    double serialCycles = get_elapsed_mcycles();
+
+    printf("%s: [%.3f] million cycles ispc + tasks, [%.3f] std::stable_sort "
+           "(%.2fx speedup)\n", name, ispcCycles, serialCycles,
+           serialCycles / ispcCycles);
+
+    for (int i = 0; i < count; ++i) {
+        if (keys[i] != ref[i].first || values[i] != ref[i].second) {
+            printf("%s: mismatch at element %d\n", name, i);
+            ++nErrors;
+            return;
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    int count = 1 << 24;
+    if (argc == 2)
+        count = atoi(argv[1]);
+    if (count <= 0) {
+        fprintf(stderr, "usage: radix_sort [count]\n");
+        return 1;
+    }
+
+    std::vector<uint32_t> keys32(count), small32(count);
+    std::vector<uint64_t> keys64(count);
+    srand(1);
+    for (int i = 0; i < count; ++i) {
+        uint64_t r = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+        keys32[i] = (uint32_t)r;
+        // Only the low bits vary, so most passes can be skipped
+        small32[i] = (uint32_t)(r & 0xffff);
+        keys64[i] = r;
+    }
+
+    run("32-bit keys       ", &keys32[0], count, radix_sort_keys32);
+    run("32-bit keys < 2^16", &small32[0], count, radix_sort_keys32);
+    run("64-bit keys       ", &keys64[0], count, radix_sort_keys64);
+
+    if (nErrors == 0)
+        printf("All results match.\n");
+    return nErrors ? 1 : 0;
+}
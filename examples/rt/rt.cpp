@@ -43,8 +43,11 @@
 #include <algorithm>
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/types.h>
-#include "../timing.h"
+#include <vector>
+#include "../benchmark.h"
+#include "../mapped_file.h"
 #include "rt_ispc.h"
 
 using namespace ispc;
@@ -95,65 +98,294 @@ static void writeImage(int *idImage, float *depthImage, int width, int height,
 }
 
 
-static void usage() {
-    fprintf(stderr, "rt <scene name base> [--scale=<factor>] [ispc iterations] [tasks iterations] [serial iterations]\n");
-    exit(1);
+static float surfaceArea(const float bounds[2][3]) {
+    float dx = bounds[1][0] - bounds[0][0];
+    float dy = bounds[1][1] - bounds[0][1];
+    float dz = bounds[1][2] - bounds[0][2];
+    return 2.f * (dx * dy + dy * dz + dz * dx);
 }
 
 
-int main(int argc, char *argv[]) {
-    static unsigned int test_iterations[] = {3, 7, 1};
-    float scale = 1.f;
-    const char *filename = NULL;
-    if (argc < 2) usage();
-    filename = argv[1];
-    if (argc > 2) {
-        if (strncmp(argv[2], "--scale=", 8) == 0) {
-            scale = atof(argv[2] + 8);
+// Collapses the binary BVH into a 4-wide one: starting with the children
+// of a binary node, the interior child with the largest surface area is
+// replaced with its own two children, until there are four of them.
+// Returns the index of the new node in nodes4.
+static int buildBVH4(const LinearBVHNode nodes[], int nodeNum,
+                     std::vector<BVH4Node> &nodes4) {
+    int children[4], nChildren = 0;
+    if (nodes[nodeNum].nPrimitives > 0)
+        // single leaf BVH
+        children[nChildren++] = nodeNum;
+    else {
+        children[nChildren++] = nodeNum + 1;
+        children[nChildren++] = nodes[nodeNum].offset;
+    }
+    while (nChildren < 4) {
+        int best = -1;
+        for (int i = 0; i < nChildren; ++i)
+            if (nodes[children[i]].nPrimitives == 0 &&
+                (best < 0 || surfaceArea(nodes[children[i]].bounds) >
+                             surfaceArea(nodes[children[best]].bounds)))
+                best = i;
+        if (best < 0)
+            break;
+        int n = children[best];
+        children[best] = n + 1;
+        children[nChildren++] = nodes[n].offset;
+    }
+
+    int index = (int)nodes4.size();
+    BVH4Node node4;
+    memset(&node4, 0, sizeof(node4));
+    node4.nChildren = nChildren;
+    nodes4.push_back(node4);
+
+    for (int c = 0; c < nChildren; ++c) {
+        const LinearBVHNode &child = nodes[children[c]];
+        // Note that nodes4 may be reallocated by the recursive calls.
+        int offset = child.nPrimitives > 0 ? (int)child.offset :
+            buildBVH4(nodes, children[c], nodes4);
+        BVH4Node &n = nodes4[index];
+        for (int a = 0; a < 3; ++a) {
+            n.bounds[0][a][c] = child.bounds[0][a];
+            n.bounds[1][a][c] = child.bounds[1][a];
         }
+        n.offset[c] = offset;
+        n.nPrimitives[c] = child.nPrimitives;
     }
-    if ((argc == 6) || (argc == 5)) {
-        for (int i = 0; i < 3; i++) {
-            test_iterations[i] = atoi(argv[argc - 3 + i]);
+    return index;
+}
+
+
+static inline uint32_t randomBits(uint32_t x) {
+    // integer hash, from Thomas Wang
+    x = (x ^ 61) ^ (x >> 16);
+    x *= 9;
+    x = x ^ (x >> 4);
+    x *= 0x27d4eb2d;
+    x = x ^ (x >> 15);
+    return x;
+}
+
+
+// Generates a secondary ray for each primary ray that hit something:
+// from the hit point, in a random direction in the hemisphere around the
+// triangle's normal, like the rays of a diffuse bounce.  The rays are
+// stored as origin and direction, 6 floats each; returns their number.
+static int makeSecondaryRays(int width, int height, int baseWidth, int baseHeight,
+                             const float raster2camera[4][4], 
+                             const float camera2world[4][4],
+                             const float image[], const int id[],
+                             const Triangle triangles[], float eps,
+                             float rays[]) {
+    float widthScale = float(baseWidth) / float(width);
+    float heightScale = float(baseHeight) / float(height);
+    float camera[3];
+    for (int i = 0; i < 3; ++i)
+        camera[i] = camera2world[i][3] / camera2world[3][3];
+
+    int nRays = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int offset = y * width + x;
+            if (id[offset] == 0)
+                continue;
+
+            // Direction of the primary ray, as in generateRay()
+            float camx = raster2camera[0][0] * x * widthScale + 
+                raster2camera[0][1] * y * heightScale + raster2camera[0][3];
+            float camy = raster2camera[1][0] * x * widthScale + 
+                raster2camera[1][1] * y * heightScale + raster2camera[1][3];
+            float camz = raster2camera[2][3];
+            float camw = raster2camera[3][3];
+            camx /= camw;
+            camy /= camw;
+            camz /= camw;
+            float dir[3];
+            for (int i = 0; i < 3; ++i)
+                dir[i] = camera2world[i][0] * camx + camera2world[i][1] * camy +
+                    camera2world[i][2] * camz;
+
+            // Normal of the hit triangle, facing the camera
+            const Triangle &tri = triangles[id[offset] - 1];
+            float e1[3], e2[3], n[3];
+            for (int i = 0; i < 3; ++i) {
+                e1[i] = tri.p[1][i] - tri.p[0][i];
+                e2[i] = tri.p[2][i] - tri.p[0][i];
+            }
+            n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+            n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+            n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+            float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (n[0] * dir[0] + n[1] * dir[1] + n[2] * dir[2] > 0)
+                len = -len;
+            for (int i = 0; i < 3; ++i)
+                n[i] /= len;
+
+            // Uniformly distributed direction on the sphere, flipped into
+            // the hemisphere
+            uint32_t bits = randomBits(offset);
+            float u = (bits & 0xffff) / 65536.f, v = (bits >> 16) / 65536.f;
+            float z = 1.f - 2.f * u, r = sqrtf(std::max(0.f, 1.f - z * z));
+            float phi = 6.2831853f * v;
+            float d[3] = { r * cosf(phi), r * sinf(phi), z };
+            if (d[0] * n[0] + d[1] * n[1] + d[2] * n[2] < 0)
+                for (int i = 0; i < 3; ++i)
+                    d[i] = -d[i];
+
+            float *ray = rays + 6 * nRays++;
+            for (int i = 0; i < 3; ++i) {
+                ray[i] = camera[i] + image[offset] * dir[i] + eps * n[i];
+                ray[3+i] = d[i];
+            }
+        }
+    }
+    return nRays;
+}
+
+
+static inline uint32_t spreadBits(uint32_t x) {
+    // 8 bits in, every third bit out
+    x = (x | (x << 8)) & 0x0f00f;
+    x = (x | (x << 4)) & 0xc30c3;
+    x = (x | (x << 2)) & 0x249249;
+    return x;
+}
+
+
+// Sorts the rays by the octant of their direction, and then by the cell
+// of a 256^3 grid over the scene bounds that holds their origin, in Morton
+// order, so that the rays traced together by a gang or by a task follow
+// similar paths through the BVH.  order[i] gives the original index of the
+// i-th sorted ray.
+static void sortRays(const float rays[], int nRays, const float bounds[2][3],
+                     float sortedRays[], int order[]) {
+    std::vector<uint32_t> keys(nRays), sortedKeys(nRays);
+    std::vector<int> indices(nRays);
+    for (int i = 0; i < nRays; ++i) {
+        const float *ray = rays + 6 * i;
+        uint32_t key = 0;
+        for (int a = 0; a < 3; ++a) {
+            float extent = bounds[1][a] - bounds[0][a];
+            int cell = extent > 0 ? int(255.f * (ray[a] - bounds[0][a]) / extent) : 0;
+            cell = std::min(std::max(cell, 0), 255);
+            key |= spreadBits(cell) << a;
+            if (ray[3+a] < 0)
+                key |= 1u << (24 + a);
+        }
+        keys[i] = key;
+        order[i] = i;
+    }
+
+    // Radix sort of the 27-bit keys, 9 bits at a time
+    for (int shift = 0; shift < 27; shift += 9) {
+        int count[513] = { 0 };
+        for (int i = 0; i < nRays; ++i)
+            ++count[((keys[i] >> shift) & 511) + 1];
+        for (int b = 0; b < 512; ++b)
+            count[b + 1] += count[b];
+        for (int i = 0; i < nRays; ++i) {
+            int j = count[(keys[i] >> shift) & 511]++;
+            sortedKeys[j] = keys[i];
+            indices[j] = order[i];
         }
+        keys.swap(sortedKeys);
+        memcpy(order, &indices[0], nRays * sizeof(int));
+    }
+
+    for (int i = 0; i < nRays; ++i)
+        memcpy(sortedRays + 6 * i, rays + 6 * order[i], 6 * sizeof(float));
+}
+
+
+// Traces the rays with the given function, and returns the minimum time of
+// the given number of runs, which are reported as the named benchmark;
+// results are stored in tHit[order[i]] and hitId[order[i]] for the i-th ray
+// (that is, in the original order of the rays).
+template <typename Node>
+static double traceRays(const char *name,
+                        void (*trace)(const float [], int, float [], int [],
+                                      const Node [], const Triangle []),
+                        const float rays[], const int order[], int nRays,
+                        float tHit[], int hitId[], const Node nodes[],
+                        const Triangle triangles[], uint iterations) {
+    std::vector<float> t(nRays);
+    std::vector<int> ids(nRays);
+    Benchmark bench(name, iterations);
+    while (bench.next()) {
+        bench.start();
+        trace(rays, nRays, &t[0], &ids[0], nodes, triangles);
+        bench.stop();
+    }
+    double minTime = bench.min();
+    for (int i = 0; i < nRays; ++i) {
+        tHit[order[i]] = t[i];
+        hitId[order[i]] = ids[i];
     }
+    return minTime;
+}
+
+
+static void usage() {
+    fprintf(stderr, "rt <scene name base> [--scale=<factor>] [ispc iterations] [tasks iterations] [serial iterations]\n");
+    exit(1);
+}
+
+
+// The scene's BVHs and triangles, as the ispc code uses them.  When the
+// scene is loaded from a .rtscene file, the arrays point into the mapped
+// file; otherwise, they point into the vectors here.
+struct Scene {
+    uint nNodes, nTris, nNodes4;
+    const LinearBVHNode *nodes;
+    const Triangle *triangles;
+    const BVH4Node *nodes4;
+
+    std::vector<LinearBVHNode> nodeStorage;
+    std::vector<Triangle> triangleStorage;
+    std::vector<BVH4Node> nodes4Storage;
+    MappedFile file;
+};
+
+
+// A .rtscene file starts with this header, followed by the arrays of
+// LinearBVHNodes, Triangles and BVH4Nodes, each starting at a multiple of
+// RTSCENE_ALIGNMENT bytes from the start of the file.  The structure
+// sizes are recorded so that files written by a build with a different
+// layout are rejected, and the stamp of the .bvh file that the scene was
+// converted from, so that the scene is converted again when it changes.
+#define RTSCENE_MAGIC "ISPCRT02"
+#define RTSCENE_ALIGNMENT 64
+
+struct RTSceneHeader {
+    char magic[8];
+    uint32_t nodeSize, triangleSize, node4Size;
+    uint32_t nNodes, nTris, nNodes4;
+    uint64_t nodesOffset, trianglesOffset, nodes4Offset;
+    FileStamp source;
+};
+
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + RTSCENE_ALIGNMENT - 1) & ~(uint64_t)(RTSCENE_ALIGNMENT - 1);
+}
+
 
 #define READ(var, n)                                            \
     if (fread(&(var), sizeof(var), n, f) != (unsigned int)n) {  \
         fprintf(stderr, "Unexpected EOF reading scene file\n"); \
-        return 1;                                               \
+        fclose(f);                                              \
+        return false;                                           \
     } else /* eat ; */                                                     
 
-    //
-    // Read the camera specification information from the camera file
-    //
-    char fnbuf[1024];
-    sprintf(fnbuf, "%s.camera", filename);
-    FILE *f = fopen(fnbuf, "rb");
-    if (!f) {
-        perror(fnbuf);
-        return 1;
-    }
 
-    //
-    // Nothing fancy, and trouble if we run on a big-endian system, just
-    // fread in the bits
-    //
-    int baseWidth, baseHeight;
-    float camera2world[4][4], raster2camera[4][4];
-    READ(baseWidth, 1);
-    READ(baseHeight, 1);
-    READ(camera2world[0][0], 16);
-    READ(raster2camera[0][0], 16);
-
-    //
-    // Read in the serialized BVH 
-    //
-    sprintf(fnbuf, "%s.bvh", filename);
-    f = fopen(fnbuf, "rb");
+// Reads the serialized BVH in the given .bvh file, converting its nodes
+// and triangles to the ispc structures, and builds the 4-wide BVH.
+static bool readBVHFile(const char *fn, Scene *scene) {
+    FILE *f = fopen(fn, "rb");
     if (!f) {
-        perror(fnbuf);
-        return 1;
+        perror(fn);
+        return false;
     }
 
     // The BVH file starts with an int that gives the total number of BVH
@@ -161,7 +393,8 @@ int main(int argc, char *argv[]) {
     uint nNodes;
     READ(nNodes, 1);
 
-    LinearBVHNode *nodes = new LinearBVHNode[nNodes];
+    std::vector<LinearBVHNode> &nodes = scene->nodeStorage;
+    nodes.resize(nNodes);
     for (unsigned int i = 0; i < nNodes; ++i) {
         // Each node is 6x floats for a boox, then an integer for an offset
         // to the second child node, then an integer that encodes the type
@@ -183,12 +416,14 @@ int main(int argc, char *argv[]) {
     // And then read the triangles 
     uint nTris;
     READ(nTris, 1);
-    Triangle *triangles = new Triangle[nTris];
+    std::vector<Triangle> &triangles = scene->triangleStorage;
+    triangles.resize(nTris);
     for (uint i = 0; i < nTris; ++i) {
         // 9x floats for the 3 vertices
         float v[9];
         READ(v[0], 9);
         float *vp = v;
+        memset(&triangles[i], 0, sizeof(Triangle));
         for (int j = 0; j < 3; ++j) {
             triangles[i].p[j][0] = *vp++;
             triangles[i].p[j][1] = *vp++;
@@ -199,6 +434,173 @@ int main(int argc, char *argv[]) {
     }
     fclose(f);
 
+    buildBVH4(&nodes[0], 0, scene->nodes4Storage);
+
+    scene->nNodes = nNodes;
+    scene->nTris = nTris;
+    scene->nNodes4 = (uint)scene->nodes4Storage.size();
+    scene->nodes = &nodes[0];
+    scene->triangles = &triangles[0];
+    scene->nodes4 = &scene->nodes4Storage[0];
+    return true;
+}
+
+#undef READ
+
+
+static bool writeArray(FILE *f, uint64_t offset, const void *data, size_t size) {
+    return fseek(f, (long)offset, SEEK_SET) == 0 &&
+        fwrite(data, 1, size, f) == size;
+}
+
+
+// Writes the scene's arrays to a .rtscene file that mapSceneFile() can
+// use in place; source is the stamp of the .bvh file it came from.
+static bool writeSceneFile(const char *fn, const Scene &scene,
+                           const FileStamp &source) {
+    RTSceneHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RTSCENE_MAGIC, sizeof(header.magic));
+    header.source = source;
+    header.nodeSize = sizeof(LinearBVHNode);
+    header.triangleSize = sizeof(Triangle);
+    header.node4Size = sizeof(BVH4Node);
+    header.nNodes = scene.nNodes;
+    header.nTris = scene.nTris;
+    header.nNodes4 = scene.nNodes4;
+    header.nodesOffset = alignOffset(sizeof(header));
+    header.trianglesOffset =
+        alignOffset(header.nodesOffset + (uint64_t)scene.nNodes * sizeof(LinearBVHNode));
+    header.nodes4Offset =
+        alignOffset(header.trianglesOffset + (uint64_t)scene.nTris * sizeof(Triangle));
+
+    FILE *f = fopen(fn, "wb");
+    if (!f)
+        return false;
+    bool ok = writeArray(f, 0, &header, sizeof(header)) &&
+        writeArray(f, header.nodesOffset, scene.nodes,
+                   scene.nNodes * sizeof(LinearBVHNode)) &&
+        writeArray(f, header.trianglesOffset, scene.triangles,
+                   scene.nTris * sizeof(Triangle)) &&
+        writeArray(f, header.nodes4Offset, scene.nodes4,
+                   scene.nNodes4 * sizeof(BVH4Node));
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        remove(fn);
+    return ok;
+}
+
+
+// Maps the given .rtscene file and points the scene's arrays into it;
+// returns false if there's no such file, it doesn't match this build's
+// structure layout, or it was converted from a .bvh file other than the
+// one with the given stamp (if there is one).
+static bool mapSceneFile(const char *fn, const FileStamp *source,
+                         Scene *scene) {
+    MappedFile &file = scene->file;
+    if (!file.Open(fn))
+        return false;
+
+    const char *base = (const char *)file.Data();
+    RTSceneHeader header;
+    if (file.Size() < sizeof(header)) {
+        file.Close();
+        return false;
+    }
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, RTSCENE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.nodeSize != sizeof(LinearBVHNode) ||
+        header.triangleSize != sizeof(Triangle) ||
+        header.node4Size != sizeof(BVH4Node) ||
+        (source != NULL && !(header.source == *source)) ||
+        header.nodesOffset + (uint64_t)header.nNodes * sizeof(LinearBVHNode) > file.Size() ||
+        header.trianglesOffset + (uint64_t)header.nTris * sizeof(Triangle) > file.Size() ||
+        header.nodes4Offset + (uint64_t)header.nNodes4 * sizeof(BVH4Node) > file.Size()) {
+        file.Close();
+        return false;
+    }
+
+    scene->nNodes = header.nNodes;
+    scene->nTris = header.nTris;
+    scene->nNodes4 = header.nNodes4;
+    scene->nodes = (const LinearBVHNode *)(base + header.nodesOffset);
+    scene->triangles = (const Triangle *)(base + header.trianglesOffset);
+    scene->nodes4 = (const BVH4Node *)(base + header.nodes4Offset);
+    return true;
+}
+
+
+int main(int argc, char *argv[]) {
+    static unsigned int test_iterations[] = {3, 7, 1};
+    float scale = 1.f;
+    const char *filename = NULL;
+    if (argc < 2) usage();
+    filename = argv[1];
+    if (argc > 2) {
+        if (strncmp(argv[2], "--scale=", 8) == 0) {
+            scale = atof(argv[2] + 8);
+        }
+    }
+    if ((argc == 6) || (argc == 5)) {
+        for (int i = 0; i < 3; i++) {
+            test_iterations[i] = atoi(argv[argc - 3 + i]);
+        }
+    }
+
+    //
+    // Read the camera specification information from the camera file
+    //
+    char fnbuf[1024];
+    sprintf(fnbuf, "%s.camera", filename);
+    FILE *f = fopen(fnbuf, "rb");
+    if (!f) {
+        perror(fnbuf);
+        return 1;
+    }
+
+    //
+    // Nothing fancy, and trouble if we run on a big-endian system, just
+    // fread in the bits
+    //
+    int baseWidth, baseHeight;
+    float camera2world[4][4], raster2camera[4][4];
+    if (fread(&baseWidth, sizeof(int), 1, f) != 1 ||
+        fread(&baseHeight, sizeof(int), 1, f) != 1 ||
+        fread(&camera2world[0][0], sizeof(float), 16, f) != 16 ||
+        fread(&raster2camera[0][0], sizeof(float), 16, f) != 16) {
+        fprintf(stderr, "Unexpected EOF reading camera file\n");
+        return 1;
+    }
+    fclose(f);
+
+    //
+    // Map the scene's .rtscene file, which holds the BVHs and triangles
+    // laid out as the ispc code uses them.  If there isn't one yet, read
+    // and convert the serialized BVH, and write the .rtscene file for the
+    // next run.  The .rtscene file is also converted again if the .bvh file
+    // has changed since.
+    //
+    Scene scene;
+    char scenefn[1024];
+    sprintf(scenefn, "%s.rtscene", filename);
+    sprintf(fnbuf, "%s.bvh", filename);
+    FileStamp bvhStamp;
+    bool haveBVH = GetFileStamp(fnbuf, &bvhStamp);
+    reset_and_start_timer();
+    bool mapped = mapSceneFile(scenefn, haveBVH ? &bvhStamp : NULL, &scene);
+    if (!mapped && !readBVHFile(fnbuf, &scene))
+        return 1;
+    double loadTime = get_elapsed_mcycles();
+    printf("[rt scene load, %s]:\t[%.3f] million cycles for %u nodes, %u triangles\n",
+           mapped ? "mapped .rtscene" : "converted .bvh", loadTime,
+           scene.nNodes, scene.nTris);
+    if (!mapped && !writeSceneFile(scenefn, scene, bvhStamp))
+        fprintf(stderr, "Warning: couldn't write %s\n", scenefn);
+
+    const LinearBVHNode *nodes = scene.nodes;
+    const Triangle *triangles = scene.triangles;
+
     int height = int(baseHeight * scale);
     int width = int(baseWidth * scale);
 
@@ -210,15 +612,14 @@ int main(int argc, char *argv[]) {
     //
     // Run 3 iterations with ispc + 1 core, record the minimum time
     //
-    double minTimeISPC = 1e30;
-    for (uint i = 0; i < test_iterations[0]; ++i) {
-        reset_and_start_timer();
+    Benchmark ispcBench("rt ispc, 1 core", test_iterations[0]);
+    while (ispcBench.next()) {
+        ispcBench.start();
         raytrace_ispc(width, height, baseWidth, baseHeight, raster2camera, 
                       camera2world, image, id, nodes, triangles);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC run:\t\t\t[%.3f] million cycles\n", dt);
-        minTimeISPC = std::min(dt, minTimeISPC);
+        ispcBench.stop();
     }
+    double minTimeISPC = ispcBench.min();
     printf("[rt ispc, 1 core]:\t\t[%.3f] million cycles for %d x %d image\n", 
            minTimeISPC, width, height);
 
@@ -230,20 +631,75 @@ int main(int argc, char *argv[]) {
     //
     // Run 3 iterations with ispc + 1 core, record the minimum time
     //
-    double minTimeISPCtasks = 1e30;
-    for (uint i = 0; i < test_iterations[1]; ++i) {
-        reset_and_start_timer();
+    Benchmark tasksBench("rt ispc + tasks", test_iterations[1]);
+    while (tasksBench.next()) {
+        tasksBench.start();
         raytrace_ispc_tasks(width, height, baseWidth, baseHeight, raster2camera,
                             camera2world, image, id, nodes, triangles);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC + TASKS run:\t\t\t[%.3f] million cycles\n", dt);
-        minTimeISPCtasks = std::min(dt, minTimeISPCtasks);
+        tasksBench.stop();
     }
+    double minTimeISPCtasks = tasksBench.min();
     printf("[rt ispc + tasks]:\t\t[%.3f] million cycles for %d x %d image\n", 
            minTimeISPCtasks, width, height);
 
     writeImage(id, image, width, height, "rt-ispc-tasks.ppm");
 
+    //
+    // Trace secondary rays from the hit points, with one ray per program
+    // instance through the binary BVH, and with one ray per gang through
+    // the 4-wide BVH, both as generated and after sorting them.
+    //
+    {
+        float eps = 1e-4f * sqrtf(surfaceArea(nodes[0].bounds));
+        std::vector<float> rays(6 * width * height), sortedRays(6 * width * height);
+        int nRays = makeSecondaryRays(width, height, baseWidth, baseHeight,
+                                      raster2camera, camera2world, image, id,
+                                      triangles, eps, &rays[0]);
+        std::vector<int> identity(nRays), order(nRays);
+        for (int i = 0; i < nRays; ++i)
+            identity[i] = i;
+        reset_and_start_timer();
+        sortRays(&rays[0], nRays, nodes[0].bounds, &sortedRays[0], &order[0]);
+        double sortTime = get_elapsed_mcycles();
+
+        const char *names[4] = { "binary BVH", "binary BVH, sorted", 
+                                 "BVH4", "BVH4, sorted" };
+        std::vector<float> tHit[4];
+        std::vector<int> hitId[4];
+        double time[4];
+        for (int m = 0; m < 4; ++m) {
+            tHit[m].resize(nRays + 1);
+            hitId[m].resize(nRays + 1);
+            const float *r = (m & 1) ? &sortedRays[0] : &rays[0];
+            const int *o = (m & 1) ? &order[0] : &identity[0];
+            char name[64];
+            sprintf(name, "rt secondary rays, %s", names[m]);
+            if (m < 2)
+                time[m] = traceRays(name, trace_rays_ispc_tasks, r, o, nRays,
+                                    &tHit[m][0], &hitId[m][0], nodes,
+                                    triangles, test_iterations[1]);
+            else
+                time[m] = traceRays(name, trace_rays_bvh4_ispc_tasks, r, o,
+                                    nRays, &tHit[m][0], &hitId[m][0],
+                                    scene.nodes4, triangles,
+                                    test_iterations[1]);
+
+            // Check for agreement; different triangles may be hit at the
+            // same distance.
+            int nDiffer = 0;
+            for (int i = 0; i < nRays; ++i)
+                if (hitId[m][i] != hitId[0][i] && 
+                    fabsf(tHit[m][i] - tHit[0][i]) > 1e-4f * tHit[0][i])
+                    ++nDiffer;
+            printf("[rt secondary rays, %s]:\t[%.3f] million cycles for %d rays", 
+                   names[m], time[m], nRays);
+            if (nDiffer > 0)
+                printf(" (%d rays differ)", nDiffer);
+            printf("\n");
+        }
+        printf("\t\t\t\t(sorting the rays takes [%.3f] million cycles)\n", sortTime);
+    }
+
     memset(id, 0, width*height*sizeof(int));
     memset(image, 0, width*height*sizeof(float));
 
@@ -251,15 +707,14 @@ int main(int argc, char *argv[]) {
     // And 3 iterations with the serial implementation, reporting the
     // minimum time.
     //
-    double minTimeSerial = 1e30;
-    for (uint i = 0; i < test_iterations[2]; ++i) {
-        reset_and_start_timer();
+    Benchmark serialBench("rt serial", test_iterations[2]);
+    while (serialBench.next()) {
+        serialBench.start();
         raytrace_serial(width, height, baseWidth, baseHeight, raster2camera, 
                         camera2world, image, id, nodes, triangles);
-        double dt = get_elapsed_mcycles();
-        printf("@time of serial run:\t\t\t[%.3f] million cycles\n", dt);
-        minTimeSerial = std::min(dt, minTimeSerial);
+        serialBench.stop();
     }
+    double minTimeSerial = serialBench.min();
     printf("[rt serial]:\t\t\t[%.3f] million cycles for %d x %d image\n", 
            minTimeSerial, width, height);
     printf("\t\t\t\t(%.2fx speedup from ISPC, %.2fx speedup from ISPC + tasks)\n", 
@@ -0,0 +1,139 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <stdint.h>
+#include "../timing.h"
+#include "scan_ispc.h"
+using namespace ispc;
+
+/* Checks the parallel reductions and scans in ../util/parallel.isph
+   against serial implementations and reports the time taken by each. */
+
+static int nErrors = 0;
+
+template <typename T> static void
+check(const char *name, const T *result, const T *expected, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (result[i] != expected[i]) {
+            printf("%s: mismatch at element %d: got %g, expected %g\n", name,
+                   i, (double)result[i], (double)expected[i]);
+            ++nErrors;
+            return;
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    int count = 1 << 24;
+    if (argc == 2)
+        count = atoi(argv[1]);
+    if (count <= 0) {
+        fprintf(stderr, "usage: scan [count]\n");
+        return 1;
+    }
+
+    int *ia = new int[count], *iout = new int[count], *iref = new int[count];
+    int8_t *flags = new int8_t[count];
+    double *da = new double[count], *dout = new double[count],
+        *dref = new double[count];
+    float *fa = new float[count];
+    srand(1);
+    for (int i = 0; i < count; ++i) {
+        ia[i] = (rand() % 64) - 32;
+        flags[i] = (rand() % 1000) == 0;
+        da[i] = rand() / (double)RAND_MAX;
+        fa[i] = (float)da[i];
+    }
+
+    // Reductions
+    reset_and_start_timer();
+    int sum = sum_int(ia, count);
+    double t = get_elapsed_mcycles();
+    int sumRef = 0;
+    for (int i = 0; i < count; ++i)
+        sumRef += ia[i];
+    printf("reduce add int:            %8.2f Mcycles\n", t);
+    check("reduce add int", &sum, &sumRef, 1);
+
+    reset_and_start_timer();
+    float fmax = max_float(fa, count);
+    t = get_elapsed_mcycles();
+    float fmaxRef = *std::max_element(fa, fa + count);
+    printf("reduce max float:          %8.2f Mcycles\n", t);
+    check("reduce max float", &fmax, &fmaxRef, 1);
+
+    // Scans
+    reset_and_start_timer();
+    inclusive_scan_add_int(ia, iout, count);
+    t = get_elapsed_mcycles();
+    iref[0] = ia[0];
+    for (int i = 1; i < count; ++i)
+        iref[i] = iref[i-1] + ia[i];
+    printf("inclusive scan add int:    %8.2f Mcycles\n", t);
+    check("inclusive scan add int", iout, iref, count);
+
+    reset_and_start_timer();
+    exclusive_scan_add_int(ia, iout, count);
+    t = get_elapsed_mcycles();
+    iref[0] = 0;
+    for (int i = 1; i < count; ++i)
+        iref[i] = iref[i-1] + ia[i-1];
+    printf("exclusive scan add int:    %8.2f Mcycles\n", t);
+    check("exclusive scan add int", iout, iref, count);
+
+    reset_and_start_timer();
+    inclusive_scan_min_double(da, dout, count);
+    t = get_elapsed_mcycles();
+    dref[0] = da[0];
+    for (int i = 1; i < count; ++i)
+        dref[i] = std::min(dref[i-1], da[i]);
+    printf("inclusive scan min double: %8.2f Mcycles\n", t);
+    check("inclusive scan min double", dout, dref, count);
+
+    reset_and_start_timer();
+    segmented_scan_add_int(ia, flags, iout, count);
+    t = get_elapsed_mcycles();
+    iref[0] = ia[0];
+    for (int i = 1; i < count; ++i)
+        iref[i] = flags[i] ? ia[i] : iref[i-1] + ia[i];
+    printf("segmented scan add int:    %8.2f Mcycles\n", t);
+    check("segmented scan add int", iout, iref, count);
+
+    if (nErrors == 0)
+        printf("All results match.\n");
+    return nErrors ? 1 : 0;
+}
@@ -41,7 +41,7 @@
 #include <sstream>
 #include <cassert>
 #include <iomanip>
-#include "../timing.h"
+#include "../benchmark.h"
 #include "sort_ispc.h"
 
 using namespace ispc;
@@ -75,61 +75,66 @@ static void progressBar(const int x, const int n, const int width = 50)
 int main (int argc, char *argv[])
 {
   int i, j, n = argc == 1 ? 1000000 : atoi(argv[1]), m = n < 100 ? 1 : 50, l = n < 100 ? n : RAND_MAX;
-  double tISPC1 = 0.0, tISPC2 = 0.0, tSerial = 0.0;
   unsigned int *code = new unsigned int [n];
   int *order = new int [n];
 
   srand (0);
 
-  for (i = 0; i < m; i ++)
+  Benchmark ispcBench("sort ispc", m);
+  for (i = 0; ispcBench.next(); i ++)
   {
     for (j = 0; j < n; j ++) code [j] = rand() % l;
 
-    reset_and_start_timer();
+    ispcBench.start();
 
     sort_ispc (n, code, order, 1);
 
-    tISPC1 += get_elapsed_mcycles();
+    ispcBench.stop();
 
     if (argc != 3)
-        progressBar (i, m);
+        progressBar (i, ispcBench.runs());
   }
+  double tISPC1 = ispcBench.total();
 
   printf("[sort ispc]:\t[%.3f] million cycles\n", tISPC1);
 
   srand (0);
 
-  for (i = 0; i < m; i ++)
+  Benchmark tasksBench("sort ispc + tasks", m);
+  for (i = 0; tasksBench.next(); i ++)
   {
     for (j = 0; j < n; j ++) code [j] = rand() % l;
 
-    reset_and_start_timer();
+    tasksBench.start();
 
     sort_ispc (n, code, order, 0);
 
-    tISPC2 += get_elapsed_mcycles();
+    tasksBench.stop();
 
     if (argc != 3)
-        progressBar (i, m);
+        progressBar (i, tasksBench.runs());
   }
+  double tISPC2 = tasksBench.total();
 
   printf("[sort ispc + tasks]:\t[%.3f] million cycles\n", tISPC2);
 
   srand (0);
 
-  for (i = 0; i < m; i ++)
+  Benchmark serialBench("sort serial", m);
+  for (i = 0; serialBench.next(); i ++)
   {
     for (j = 0; j < n; j ++) code [j] = rand() % l;
 
-    reset_and_start_timer();
+    serialBench.start();
 
     sort_serial (n, code, order);
 
-    tSerial += get_elapsed_mcycles();
+    serialBench.stop();
 
     if (argc != 3)
-        progressBar (i, m);
+        progressBar (i, serialBench.runs());
   }
+  double tSerial = serialBench.total();
 
   printf("[sort serial]:\t\t[%.3f] million cycles\n", tSerial);
 
@@ -43,7 +43,7 @@
 #include <algorithm>
 #include <string.h>
 #include <math.h>
-#include "../timing.h"
+#include "../benchmark.h"
 #include "stencil_ispc.h"
 using namespace ispc;
 
@@ -56,6 +56,26 @@ extern void loop_stencil_serial(int t0, int t1, int x0, int x1,
                                 float Aeven[], float Aodd[]);
 
 
+// Floating-point operations per point and timestep, and the memory
+// traffic if the volumes are streamed from memory on every timestep (read
+// Ain, vsq and Aout, write Aout); for the temporally blocked version, the
+// resulting bandwidth is the effective one.
+#define STENCIL_FLOPS 26
+#define STENCIL_BYTES (4 * sizeof(float))
+
+
+static void PrintRates(const char *name, double msec, int nSteps,
+                       int Nx, int Ny, int Nz, int width) {
+#ifndef WIN32
+    double points = double(Nx - 2 * width) * double(Ny - 2 * width) *
+        double(Nz - 2 * width) * nSteps;
+    printf("[%s]:\t%.2f GB/s, %.2f GFLOP/s\n", name,
+           points * STENCIL_BYTES / (msec * 1e6), 
+           points * STENCIL_FLOPS / (msec * 1e6));
+#endif
+}
+
+
 void InitData(int Nx, int Ny, int Nz, float *A[2], float *vsq) {
     int offset = 0;
     for (int z = 0; z < Nz; ++z)
@@ -72,6 +92,10 @@ int main(int argc, char *argv[]) {
     static unsigned int test_iterations[] = {3, 3, 3};//the last two numbers must be equal here
     int Nx = 256, Ny = 256, Nz = 256;
     int width = 4;
+    // Timesteps and (y, z) extent of the tiles of the temporally blocked
+    // version; three timesteps of an 8x8 tile touch at most 20x20 rows
+    // of the volumes.
+    int tTile = 3, yTile = 8, zTile = 8;
 
     if (argc > 1) {
         if (strncmp(argv[1], "--scale=", 8) == 0) {
@@ -101,16 +125,15 @@ int main(int argc, char *argv[]) {
     // Compute the image using the ispc implementation on one core; report
     // the minimum time of three runs.
     //
-    double minTimeISPC = 1e30;
-    for (unsigned int i = 0; i < test_iterations[0]; ++i) {
-        reset_and_start_timer();
+    Benchmark ispcBench("stencil ispc 1 core", test_iterations[0]);
+    while (ispcBench.next()) {
+        ispcBench.start();
         loop_stencil_ispc(0, 6, width, Nx - width, width, Ny - width,
                           width, Nz - width, Nx, Ny, Nz, coeff, vsq,
                           Aispc[0], Aispc[1]);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC run:\t\t\t[%.3f] million cycles\n", dt);
-        minTimeISPC = std::min(minTimeISPC, dt);
+        ispcBench.stop();
     }
+    double minTimeISPC = ispcBench.min();
 
     printf("[stencil ispc 1 core]:\t\t[%.3f] million cycles\n", minTimeISPC);
 
@@ -120,18 +143,45 @@ int main(int argc, char *argv[]) {
     // Compute the image using the ispc implementation with tasks; report
     // the minimum time of three runs.
     //
-    double minTimeISPCTasks = 1e30;
-    for (unsigned int i = 0; i < test_iterations[1]; ++i) {
-        reset_and_start_timer();
+    double minMsecISPCTasks = 1e30;
+    Benchmark tasksBench("stencil ispc + tasks", test_iterations[1]);
+    while (tasksBench.next()) {
+        tasksBench.start();
         loop_stencil_ispc_tasks(0, 6, width, Nx - width, width, Ny - width,
                                 width, Nz - width, Nx, Ny, Nz, coeff, vsq,
                                 Aispc[0], Aispc[1]);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC + TASKS run:\t\t\t[%.3f] million cycles\n", dt);
-        minTimeISPCTasks = std::min(minTimeISPCTasks, dt);
+        tasksBench.stop();
+#ifndef WIN32
+        minMsecISPCTasks = std::min(minMsecISPCTasks, get_elapsed_msec());
+#endif
     }
+    double minTimeISPCTasks = tasksBench.min();
 
     printf("[stencil ispc + tasks]:\t\t[%.3f] million cycles\n", minTimeISPCTasks);
+    PrintRates("stencil ispc + tasks", minMsecISPCTasks, 6, Nx, Ny, Nz, width);
+
+    InitData(Nx, Ny, Nz, Aispc, vsq);
+
+    //
+    // And with tasks and temporal blocking.  This is the version whose
+    // results are checked against the serial implementation below.
+    //
+    double minMsecISPCTiled = 1e30;
+    Benchmark tiledBench("stencil ispc + tasks + tiles", test_iterations[1]);
+    while (tiledBench.next()) {
+        tiledBench.start();
+        loop_stencil_ispc_tasks_tiled(0, 6, width, Nx - width, width, Ny - width,
+                                      width, Nz - width, Nx, Ny, Nz, coeff, vsq,
+                                      Aispc[0], Aispc[1], tTile, yTile, zTile);
+        tiledBench.stop();
+#ifndef WIN32
+        minMsecISPCTiled = std::min(minMsecISPCTiled, get_elapsed_msec());
+#endif
+    }
+    double minTimeISPCTiled = tiledBench.min();
+
+    printf("[stencil ispc + tasks + tiles]:\t[%.3f] million cycles\n", minTimeISPCTiled);
+    PrintRates("stencil ispc + tasks + tiles", minMsecISPCTiled, 6, Nx, Ny, Nz, width);
 
     InitData(Nx, Ny, Nz, Aserial, vsq);
 
@@ -139,21 +189,22 @@ int main(int argc, char *argv[]) {
     // And run the serial implementation 3 times, again reporting the
     // minimum time.
     //
-    double minTimeSerial = 1e30;
-    for (unsigned int i = 0; i < test_iterations[2]; ++i) {
-        reset_and_start_timer();
+    Benchmark serialBench("stencil serial", test_iterations[2]);
+    while (serialBench.next()) {
+        serialBench.start();
         loop_stencil_serial(0, 6, width, Nx-width, width, Ny - width,
                             width, Nz - width, Nx, Ny, Nz, coeff, vsq,
                             Aserial[0], Aserial[1]);
-        double dt = get_elapsed_mcycles();
-        printf("@time of serial run:\t\t\t[%.3f] million cycles\n", dt);
-        minTimeSerial = std::min(minTimeSerial, dt);
+        serialBench.stop();
     }
+    double minTimeSerial = serialBench.min();
 
     printf("[stencil serial]:\t\t[%.3f] million cycles\n", minTimeSerial);
 
-    printf("\t\t\t\t(%.2fx speedup from ISPC, %.2fx speedup from ISPC + tasks)\n", 
-           minTimeSerial / minTimeISPC, minTimeSerial / minTimeISPCTasks);
+    printf("\t\t\t\t(%.2fx speedup from ISPC, %.2fx speedup from ISPC + tasks, "
+           "%.2fx speedup from ISPC + tasks + tiles)\n", 
+           minTimeSerial / minTimeISPC, minTimeSerial / minTimeISPCTasks,
+           minTimeSerial / minTimeISPCTiled);
 
     // Check for agreement
     int offset = 0;
@@ -0,0 +1,98 @@
+/*
+  Copyright (c) 2010-2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string.h>
+#include "../timing.h"
+#include "tasks_scaling_ispc.h"
+using namespace ispc;
+
+/* Measures the time per task for launching many short tasks, both from a
+   single launch statement and from nested launches.  Build this with each
+   of the task systems in ../tasksys.cpp ("make scaling" does that for the
+   pthreads-based ones) to compare their overhead. */
+
+static void usage() {
+    fprintf(stderr, "usage: tasks_scaling [iterations]\n");
+    exit(1);
+}
+
+
+int main(int argc, char *argv[]) {
+    int runs = 5;
+    if (argc == 2) {
+        runs = atoi(argv[1]);
+        if (runs <= 0)
+            usage();
+    }
+    else if (argc > 2)
+        usage();
+
+    const int maxTasks = 1 << 16;
+    float *result = new float[maxTasks];
+
+    // Iteration counts of the loop in each task; the smallest ones give
+    // tasks of roughly a microsecond, the largest of roughly 100us.
+    static const int taskSizes[] = { 100, 1000, 10000, 100000 };
+    static const int taskCounts[] = { 64, 1024, 16384, 65536 };
+
+    printf("%-10s %-10s %16s %16s\n", "work", "tasks", "flat (us/task)",
+           "nested (us/task)");
+    for (unsigned int i = 0; i < sizeof(taskSizes) / sizeof(taskSizes[0]); ++i) {
+        for (unsigned int j = 0; j < sizeof(taskCounts) / sizeof(taskCounts[0]); ++j) {
+            int size = taskSizes[i], count = taskCounts[j];
+            if ((double)size * count > 2e9)
+                // Skip the configurations that would take too long
+                continue;
+
+            double minFlat = 1e30, minNested = 1e30;
+            for (int r = 0; r < runs; ++r) {
+                reset_and_start_timer();
+                launch_flat(count, size, result);
+                minFlat = std::min(minFlat, get_elapsed_msec());
+
+                reset_and_start_timer();
+                launch_nested(count / 64, 64, size, result);
+                minNested = std::min(minNested, get_elapsed_msec());
+            }
+
+            printf("%-10d %-10d %16.3f %16.3f\n", size, count,
+                   1e3 * minFlat / count, 1e3 * minNested / count);
+        }
+    }
+
+    delete[] result;
+    return 0;
+}
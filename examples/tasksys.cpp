@@ -43,24 +43,30 @@
   There are several task systems in this file, built using:
     - Microsoft's Concurrency Runtime (ISPC_USE_CONCRT)
     - Apple's Grand Central Dispatch (ISPC_USE_GCD)
-    - bare pthreads (ISPC_USE_PTHREADS, ISPC_USE_PTHREADS_FULLY_SUBSCRIBED)
+    - bare pthreads (ISPC_USE_PTHREADS, ISPC_USE_PTHREADS_FULLY_SUBSCRIBED,
+      ISPC_USE_PTHREADS_WORK_STEALING)
+    - C++11 std::thread (ISPC_USE_STDTHREAD)
     - Cilk Plus (ISPC_USE_CILK)
     - TBB (ISPC_USE_TBB_TASK_GROUP, ISPC_USE_TBB_PARALLEL_FOR)
-    - OpenMP (ISPC_USE_OMP)
+    - OpenMP (ISPC_USE_OMP, ISPC_USE_OMP_TASKLOOP)
     - HPX (ISPC_USE_HPX)
 
   The task system implementation can be selected at compile time, by defining 
   the appropriate preprocessor symbol on the command line (for e.g.: -D ISPC_USE_TBB).
   Not all combinations of platform and task system are meaningful.
-  If no task system is requested, a reasonable default task system for the platform
-  is selected.  Here are the task systems that can be selected:
+  If no task system is requested, ISPC_USE_STDTHREAD is used when the file is
+  compiled as C++11 or later, and otherwise a reasonable default task system for
+  the platform is selected.  Here are the task systems that can be selected:
 
 #define ISPC_USE_GCD
 #define ISPC_USE_CONCRT
 #define ISPC_USE_PTHREADS
 #define ISPC_USE_PTHREADS_FULLY_SUBSCRIBED
+#define ISPC_USE_PTHREADS_WORK_STEALING
+#define ISPC_USE_STDTHREAD
 #define ISPC_USE_CILK
 #define ISPC_USE_OMP
+#define ISPC_USE_OMP_TASKLOOP
 #define ISPC_USE_TBB_TASK_GROUP
 #define ISPC_USE_TBB_PARALLEL_FOR
 
@@ -69,6 +75,52 @@
   for task management.  This model is useful for KNC where tasks can take over 
   the machine, but less so when there are other tasks that need running on the machine.
 
+  The ISPC_USE_PTHREADS_WORK_STEALING model gives each worker thread its own
+  lock-free double-ended queue of ranges of tasks; idle threads steal the
+  oldest (and thus largest) range from another thread's queue, splitting it
+  in half as they go.  Task launches and task completion never take a global
+  lock, which makes this model a good fit for large numbers of short tasks on
+  machines with many cores.
+
+  The ISPC_USE_STDTHREAD model uses the same work-stealing scheme, built only
+  on std::thread, std::atomic and std::condition_variable, so that it works
+  the same way on every platform.  It doesn't pin threads or place tasks on
+  NUMA nodes.
+
+  With ISPC_USE_STDTHREAD, setting the ISPC_TASK_AFFINITY environment
+  variable to a non-zero value makes launches that are repeated, like the
+  per-frame launches of a renderer, run each part of their taskIndex range
+  on the same worker thread as the last time, so that the data those tasks
+  touched is still in that core's caches.  A launch is recognized by its
+  task function and its task count.  Workers that run out of work still
+  steal those parts from each other, and a part that is stolen is run by
+  the thief the next time around as well.
+
+  Both TBB models run their tasks in the arena of the thread that launches
+  them, unless ISPCSetTBBArena() selects a tbb::task_arena of the host
+  application's, or ISPCCreateTBBArena() (or the ISPC_TBB_CONCURRENCY and
+  ISPC_TBB_NUMA_NODE environment variables) has the task system create one
+  with a limited concurrency, bound to a NUMA node.  With
+  ISPC_USE_TBB_PARALLEL_FOR, ISPC_TASK_AFFINITY makes repeated launches
+  use one tbb::affinity_partitioner for each task function and task count.
+
+  The ISPC_USE_OMP_TASKLOOP model requires OpenMP 4.5.  Launches made inside
+  an OpenMP parallel region (the application's own, or that of the tasks of
+  an earlier launch) become taskloops that run on that region's team, so
+  that nested launches and launches from code that's already running in
+  parallel share its threads.  Launches from outside any parallel region
+  start one of their own and only return once their tasks have run.  The
+  ISPC_OMP_GRAINSIZE environment variable gives the number of tasks that
+  each OpenMP task runs; by default, the OpenMP runtime chooses.
+
+  With either ISPC_USE_PTHREADS or ISPC_USE_PTHREADS_WORK_STEALING, setting
+  the ISPC_PIN_THREADS environment variable to a non-zero value pins the
+  worker threads to cores, one NUMA node at a time.  The work-stealing model
+  then also gives each NUMA node a contiguous part of the taskIndex range of
+  each launch.  ISPCAllocNodeLocal() allocates memory on the calling
+  thread's NUMA node, so that tasks can set up data that they'll later use
+  from the same node.
+
 #define ISPC_USE_CREW
 #define ISPC_USE_HPX
   The HPX model requires the HPX runtime environment to be set up. This can be
@@ -81,21 +133,26 @@
 
 #if !(defined ISPC_USE_CONCRT          || defined ISPC_USE_GCD              || \
       defined ISPC_USE_PTHREADS        || defined ISPC_USE_PTHREADS_FULLY_SUBSCRIBED || \
+      defined ISPC_USE_PTHREADS_WORK_STEALING || defined ISPC_USE_STDTHREAD || \
       defined ISPC_USE_TBB_TASK_GROUP  || defined ISPC_USE_TBB_PARALLEL_FOR || \
-      defined ISPC_USE_OMP             || defined ISPC_USE_CILK             || \
+      defined ISPC_USE_OMP             || defined ISPC_USE_OMP_TASKLOOP     || \
+      defined ISPC_USE_CILK            || \
       defined ISPC_USE_HPX)
 
-    // If no task model chosen from the compiler cmdline, pick a reasonable default
-    #if defined(_WIN32) || defined(_WIN64)
+    // If no task model chosen from the compiler cmdline, pick a reasonable
+    // default: the C++11 one if the compiler supports it, and otherwise
+    // the platform's native one
+    #if defined(__KNC__)
+      #define ISPC_USE_PTHREADS
+    #elif __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+      #define ISPC_USE_STDTHREAD
+    #elif defined(_WIN32) || defined(_WIN64)
       #define ISPC_USE_CONCRT
     #elif defined(__linux__)
-    #define ISPC_USE_PTHREADS
+      #define ISPC_USE_PTHREADS
     #elif defined(__APPLE__)
       #define ISPC_USE_GCD
     #endif
-    #if defined(__KNC__)
-      #define ISPC_USE_PTHREADS
-    #endif
 
 #endif // No task model specified on compiler cmdline
 
@@ -110,6 +167,12 @@
 #define ISPC_IS_KNC
 #endif
 
+#ifdef _MSC_VER
+#define ISPC_TLS __declspec(thread)
+#else
+#define ISPC_TLS __thread
+#endif
+
 
 #define DBG(x) 
 
@@ -124,6 +187,7 @@
 #ifdef ISPC_USE_GCD
   #include <dispatch/dispatch.h>
   #include <pthread.h>
+  #include <sched.h>
 #endif // ISPC_USE_GCD
 #ifdef ISPC_USE_PTHREADS
   #include <pthread.h>
@@ -153,21 +217,55 @@
 //#include <stdexcept>
 #include <stack>
 #endif // ISPC_USE_PTHREADS_FULLY_SUBSCRIBED
+#ifdef ISPC_USE_PTHREADS_WORK_STEALING
+  #include <pthread.h>
+  #include <sched.h>
+  #include <unistd.h>
+  #include <vector>
+#endif // ISPC_USE_PTHREADS_WORK_STEALING
+#if (defined ISPC_USE_PTHREADS || defined ISPC_USE_PTHREADS_WORK_STEALING) && \
+    defined ISPC_IS_LINUX
+  #include <sched.h>
+  #include <dirent.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+#endif
+#ifdef ISPC_USE_STDTHREAD
+  #include <thread>
+  #include <atomic>
+  #include <mutex>
+  #include <condition_variable>
+  #include <map>
+  #include <vector>
+#endif // ISPC_USE_STDTHREAD
 #ifdef ISPC_USE_TBB_PARALLEL_FOR
   #include <tbb/parallel_for.h>
+  #include <map>
 #endif // ISPC_USE_TBB_PARALLEL_FOR
 #ifdef ISPC_USE_TBB_TASK_GROUP
   #include <tbb/task_group.h>
 #endif // ISPC_USE_TBB_TASK_GROUP
+#if defined(ISPC_USE_TBB_PARALLEL_FOR) || defined(ISPC_USE_TBB_TASK_GROUP)
+  #include <tbb/task_arena.h>
+  #include <atomic>
+  #include <mutex>
+#endif // ISPC_USE_TBB_PARALLEL_FOR || ISPC_USE_TBB_TASK_GROUP
 #ifdef ISPC_USE_CILK
   #include <cilk/cilk.h>
 #endif // ISPC_USE_TBB
 #ifdef ISPC_USE_OMP
   #include <omp.h>
 #endif // ISPC_USE_OMP
+#ifdef ISPC_USE_OMP_TASKLOOP
+  #include <omp.h>
+  #if !defined(_OPENMP) || _OPENMP < 201511
+    #error "ISPC_USE_OMP_TASKLOOP requires OpenMP 4.5 or later"
+  #endif
+#endif // ISPC_USE_OMP_TASKLOOP
 #ifdef ISPC_USE_HPX
 #include <hpx/include/async.hpp>
 #include <hpx/lcos/wait_all.hpp>
+#include <hpx/include/threads.hpp>
 #endif // ISPC_USE_HPX
 #ifdef ISPC_IS_LINUX
   #include <malloc.h>
@@ -178,7 +276,13 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 #include <algorithm>
+#include <vector>
+#ifndef ISPC_IS_WINDOWS
+  #include <sys/time.h>
+  #include <pthread.h>
+#endif // !ISPC_IS_WINDOWS
 
 // Signature of ispc-generated 'task' functions
 typedef void (*TaskFuncType)(void *data, int threadIndex, int threadCount,
@@ -186,15 +290,19 @@ typedef void (*TaskFuncType)(void *data, int threadIndex, int threadCount,
                              int taskIndex0, int taskIndex1, int taskIndex2,
                              int taskCount0, int taskCount1, int taskCount2);
 
+struct LaunchInfo;
+
 // Small structure used to hold the data for each task
 #ifdef _MSC_VER
-__declspec(align(16))
+__declspec(align(32))
 #endif
 struct TaskInfo {
     TaskFuncType func;
     void *data;
     int taskIndex;
     int taskCount3d[3];
+    // The launch that the task is a part of
+    LaunchInfo *launch;
 #if defined(  ISPC_USE_CONCRT)
     event taskEvent;
 #endif
@@ -224,22 +332,55 @@ __attribute__((aligned(32)));
 // ispc expects these functions to have C linkage / not be mangled
 extern "C" { 
     void ISPCLaunch(void **handlePtr, void *f, void *data, int countx, int county, int countz);
+    void ISPCLaunchAfter(void **handlePtr, void *f, void *data, int countx, int county,
+                         int countz, int32_t numDeps, const int32_t *deps);
     void *ISPCAlloc(void **handlePtr, int64_t size, int32_t alignment);
     void ISPCSync(void *handle);
+    void ISPCSyncLaunch(void *handle, int32_t launch);
+
+    /* These aren't called by ispc-generated code; they report the largest
+       amount of ISPCAlloc() memory that was used by all of the launches
+       from a single function between two syncs, which is useful for
+       sizing the task groups' arenas. */
+    int64_t ISPCGetPeakArenaUsage();
+    void ISPCResetPeakArenaUsage();
 }
 
 ///////////////////////////////////////////////////////////////////////////
 // TaskGroupBase
 
 #define LOG_TASK_QUEUE_CHUNK_SIZE 14
-#define MAX_TASK_QUEUE_CHUNKS 8
+#define INITIAL_TASK_QUEUE_CHUNKS 8
 #define TASK_QUEUE_CHUNK_SIZE (1<<LOG_TASK_QUEUE_CHUNK_SIZE)
 
-#define MAX_LAUNCHED_TASKS (MAX_TASK_QUEUE_CHUNKS * TASK_QUEUE_CHUNK_SIZE)
+class TaskGroup;
 
-#define NUM_MEM_BUFFERS 16
+static inline void lMemFence();
+static void lUpdatePeakArenaUsage(int64_t used);
 
-class TaskGroup;
+struct LaunchSuccessor;
+
+/** The bookkeeping for each ISPCLaunch() call.  It's allocated in the task
+    group's arena, on a cache line of its own, since its counts are
+    updated by tasks running on other threads.
+ */
+struct LaunchInfo {
+    // Count of the tasks of this launch that haven't finished yet
+    volatile int32_t numUnfinishedTasks;
+    // Count of the launches that this one has to wait for before its
+    // tasks can start, plus one while ISPCLaunchAfter() is setting it up
+    volatile int32_t numPendingDeps;
+    int baseIndex, count;
+    TaskGroup *group;
+    // The launches that are waiting for this one; guarded by the task
+    // group's launchLock
+    LaunchSuccessor *successors;
+};
+
+struct LaunchSuccessor {
+    LaunchInfo *launch;
+    LaunchSuccessor *next;
+};
 
 /** The TaskGroupBase structure provides common functionality for "task
     groups"; a task group is the set of tasks launched from within a single
@@ -255,28 +396,70 @@ public:
 
     void *AllocMemory(int64_t size, int32_t alignment);
 
+    /* Launches are numbered in the order of the ISPCLaunch() calls since
+       the last Reset(); that number is the launch's handle on the ispc
+       side, which ISPCSyncLaunch() is given to wait for just that
+       launch's tasks, and which ISPCLaunchAfter() is given for the
+       launches that a new one depends on. */
+    LaunchInfo *AddLaunch(int baseIndex, int count);
+    bool LaunchFinished(int launch) const;
+
+    /* Makes the given launch wait for the one numbered predecessor,
+       unless that one has already finished. */
+    void AddDependency(int predecessor, LaunchInfo *launch);
+
+    /* Takes the list of launches waiting for the given one, which has
+       just finished. */
+    LaunchSuccessor *TakeSuccessors(LaunchInfo *launch);
+
 protected:
     TaskGroupBase();
     ~TaskGroupBase();
 
     int nextTaskInfoIndex;
 
+    std::vector<LaunchInfo *> launches;
+    volatile int32_t launchLock;
+
 private:
+    void GrowTaskInfo(int numChunks);
+
     /* We allocate blocks of TASK_QUEUE_CHUNK_SIZE TaskInfo structures as
-       needed by the calling function.  We hold up to MAX_TASK_QUEUE_CHUNKS
-       of these (and then exit at runtime if more than this many tasks are
-       launched.)
+       needed by the calling function; taskInfo points to the array of
+       pointers to them.  That array starts out as initialTaskInfo and is
+       doubled in size whenever more chunks are needed.  Tasks that are
+       already running may still be reading the old array at that point,
+       so it's kept in oldTaskInfo until the next Reset().  The chunks
+       themselves are kept for the lifetime of the task group, which is
+       recycled through the task group pool below.
      */
-    TaskInfo *taskInfo[MAX_TASK_QUEUE_CHUNKS];
-
-    /* We also allocate chunks of memory to service ISPCAlloc() calls.  The
-       memBuffers[] array holds pointers to this memory.  The first element
-       of this array is initialized to point to mem and then any subsequent
-       elements required are initialized with dynamic allocation.
+    TaskInfo ** volatile taskInfo;
+    int numTaskInfoChunks, maxTaskInfoChunks;
+    TaskInfo *initialTaskInfo[INITIAL_TASK_QUEUE_CHUNKS];
+    TaskInfo **oldTaskInfo[32];
+    int numOldTaskInfo;
+
+    /* ISPCAlloc() calls are served from a bump arena, arena, which
+       starts out pointing to the mem member.  When an allocation doesn't
+       fit in what's left of the current block, a new block is allocated
+       and added to the overflowBlocks list; earlier blocks may still be
+       in use, so they can't be resized.  At Reset() time, the overflow
+       blocks are freed and the arena is replaced with one that is big
+       enough for everything that was allocated since the last Reset().
+       Since task groups are pooled, the next set of launches from the
+       thread generally doesn't need to allocate any memory at all.
      */
-    int curMemBuffer, curMemBufferOffset;
-    int memBufferSize[NUM_MEM_BUFFERS];
-    char *memBuffers[NUM_MEM_BUFFERS];
+    struct MemBlock {
+        MemBlock *next;
+    };
+    char *arena;
+    int64_t arenaSize;
+    char *curBlock;
+    int64_t curBlockSize, curBlockOffset;
+    MemBlock *overflowBlocks;
+    // Upper bound of the memory used since the last Reset(), assuming
+    // worst-case padding for alignment.
+    int64_t memoryUsed;
     char mem[256];
 };
 
@@ -284,33 +467,103 @@ private:
 inline TaskGroupBase::TaskGroupBase() { 
     nextTaskInfoIndex = 0; 
 
-    curMemBuffer = 0; 
-    curMemBufferOffset = 0;
-    memBuffers[0] = mem;
-    memBufferSize[0] = sizeof(mem) / sizeof(mem[0]);
-    for (int i = 1; i < NUM_MEM_BUFFERS; ++i) {
-        memBuffers[i] = NULL;
-        memBufferSize[i] = 0;
-    }
+    arena = curBlock = mem;
+    arenaSize = curBlockSize = sizeof(mem) / sizeof(mem[0]);
+    curBlockOffset = 0;
+    overflowBlocks = NULL;
+    memoryUsed = 0;
+
+    taskInfo = initialTaskInfo;
+    numTaskInfoChunks = 0;
+    maxTaskInfoChunks = INITIAL_TASK_QUEUE_CHUNKS;
+    numOldTaskInfo = 0;
 
-    for (int i = 0; i < MAX_TASK_QUEUE_CHUNKS; ++i)
-        taskInfo[i] = NULL;
+    launches.reserve(16);
+    launchLock = 0;
 }
 
 
 inline TaskGroupBase::~TaskGroupBase() {
-    // Note: don't delete memBuffers[0], since it points to the start of
-    // the "mem" member!
-    for (int i = 1; i < NUM_MEM_BUFFERS; ++i)
-        delete[](memBuffers[i]);
+    while (overflowBlocks != NULL) {
+        MemBlock *next = overflowBlocks->next;
+        delete[]((char *)overflowBlocks);
+        overflowBlocks = next;
+    }
+    // Note: don't delete the arena if it's the "mem" member!
+    if (arena != mem)
+        delete[](arena);
+
+    for (int i = 0; i < numTaskInfoChunks; ++i)
+        delete[](taskInfo[i]);
+    for (int i = 0; i < numOldTaskInfo; ++i)
+        delete[](oldTaskInfo[i]);
+    if (taskInfo != initialTaskInfo)
+        delete[](taskInfo);
 }
 
 
 inline void
 TaskGroupBase::Reset() {
     nextTaskInfoIndex = 0; 
-    curMemBuffer = 0; 
-    curMemBufferOffset = 0;
+    // The LaunchInfos are in the arena, which is recycled below.
+    launches.clear();
+
+    if (overflowBlocks != NULL) {
+        while (overflowBlocks != NULL) {
+            MemBlock *next = overflowBlocks->next;
+            delete[]((char *)overflowBlocks);
+            overflowBlocks = next;
+        }
+
+        // Grow the arena to the high-water mark, rounded up to a multiple
+        // of 4k.
+        if (arena != mem)
+            delete[](arena);
+        arenaSize = (memoryUsed + 4095) & ~int64_t(4095);
+        arena = new char[arenaSize];
+    }
+    if (memoryUsed > 0)
+        lUpdatePeakArenaUsage(memoryUsed);
+    curBlock = arena;
+    curBlockSize = arenaSize;
+    curBlockOffset = 0;
+    memoryUsed = 0;
+
+    // All of the tasks have finished, so nothing can be looking at the
+    // old chunk pointer arrays any more.
+    for (int i = 0; i < numOldTaskInfo; ++i)
+        delete[](oldTaskInfo[i]);
+    numOldTaskInfo = 0;
+}
+
+
+/* Makes sure that there are at least numChunks chunks of TaskInfo
+   structures available.  This is only called from the thread that is
+   launching tasks, but tasks on other threads may be calling
+   GetTaskInfo() concurrently. */
+inline void
+TaskGroupBase::GrowTaskInfo(int numChunks) {
+    if (numChunks > maxTaskInfoChunks) {
+        int newMax = maxTaskInfoChunks;
+        while (newMax < numChunks)
+            newMax *= 2;
+        TaskInfo **newTaskInfo = new TaskInfo *[newMax];
+        for (int i = 0; i < numTaskInfoChunks; ++i)
+            newTaskInfo[i] = taskInfo[i];
+
+        // Each doubling is at least one more bit of the task index, so
+        // 32 entries of old arrays are always enough.
+        if (taskInfo != initialTaskInfo) {
+            assert(numOldTaskInfo < 32);
+            oldTaskInfo[numOldTaskInfo++] = taskInfo;
+        }
+        lMemFence();
+        taskInfo = newTaskInfo;
+        maxTaskInfoChunks = newMax;
+    }
+
+    while (numTaskInfoChunks < numChunks)
+        taskInfo[numTaskInfoChunks++] = new TaskInfo[TASK_QUEUE_CHUNK_SIZE];
 }
 
 
@@ -318,6 +571,11 @@ inline int
 TaskGroupBase::AllocTaskInfo(int count) {
     int ret = nextTaskInfoIndex;
     nextTaskInfoIndex += count;
+
+    int numChunks = (nextTaskInfoIndex + TASK_QUEUE_CHUNK_SIZE - 1) >>
+        LOG_TASK_QUEUE_CHUNK_SIZE;
+    if (numChunks > numTaskInfoChunks)
+        GrowTaskInfo(numChunks);
     return ret;
 }
 
@@ -326,44 +584,62 @@ inline TaskInfo *
 TaskGroupBase::GetTaskInfo(int index) {
     int chunk = (index >> LOG_TASK_QUEUE_CHUNK_SIZE);
     int offset = index & (TASK_QUEUE_CHUNK_SIZE-1);
-
-    if (chunk == MAX_TASK_QUEUE_CHUNKS) {
-        fprintf(stderr, "A total of %d tasks have been launched from the "
-                "current function--the simple built-in task system can handle "
-                "no more. You can increase the values of TASK_QUEUE_CHUNK_SIZE "
-                "and LOG_TASK_QUEUE_CHUNK_SIZE to work around this limitation.  "
-                "Sorry!  Exiting.\n", index);
-        exit(1);
-    }
-
-    if (taskInfo[chunk] == NULL)
-        taskInfo[chunk] = new TaskInfo[TASK_QUEUE_CHUNK_SIZE];
     return &taskInfo[chunk][offset];
 }
 
 
 inline void *
 TaskGroupBase::AllocMemory(int64_t size, int32_t alignment) {
-    char *basePtr = memBuffers[curMemBuffer];
-    intptr_t iptr = (intptr_t)(basePtr + curMemBufferOffset);
-    iptr = (iptr + (alignment-1)) & ~(alignment-1);
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    memoryUsed += size + alignment - 1;
+
+    intptr_t iptr = (intptr_t)(curBlock + curBlockOffset);
+    iptr = (iptr + (alignment-1)) & ~intptr_t(alignment-1);
 
-    int newOffset = int(iptr - (intptr_t)basePtr + size);
-    if (newOffset < memBufferSize[curMemBuffer]) {
-        curMemBufferOffset = newOffset;
+    int64_t newOffset = int64_t(iptr - (intptr_t)curBlock) + size;
+    if (newOffset <= curBlockSize) {
+        curBlockOffset = newOffset;
         return (char *)iptr;
     }
 
-    ++curMemBuffer;
-    curMemBufferOffset = 0;
-    assert(curMemBuffer < NUM_MEM_BUFFERS);
+    // Start a new block that's at least twice as big as the last one and
+    // that has room for this allocation at any alignment.  The MemBlock
+    // header for the overflow list goes at the start of it.
+    int64_t blockSize = std::max(2 * curBlockSize, size + alignment);
+    char *newBlock = new char[sizeof(MemBlock) + blockSize];
+    ((MemBlock *)newBlock)->next = overflowBlocks;
+    overflowBlocks = (MemBlock *)newBlock;
+
+    curBlock = newBlock + sizeof(MemBlock);
+    curBlockSize = blockSize;
+    iptr = (intptr_t)curBlock;
+    iptr = (iptr + (alignment-1)) & ~intptr_t(alignment-1);
+    curBlockOffset = int64_t(iptr - (intptr_t)curBlock) + size;
+    return (char *)iptr;
+}
+
 
-    int allocSize = 1 << (12 + curMemBuffer);
-    allocSize = std::max(int(size+alignment), allocSize);
-    char *newBuf = new char[allocSize];
-    memBufferSize[curMemBuffer] = allocSize;
-    memBuffers[curMemBuffer] = newBuf;
-    return AllocMemory(size, alignment);
+inline LaunchInfo *
+TaskGroupBase::AddLaunch(int baseIndex, int count) {
+    LaunchInfo *launch = (LaunchInfo *)AllocMemory(64, 64);
+    launch->numUnfinishedTasks = count;
+    launch->numPendingDeps = 0;
+    launch->baseIndex = baseIndex;
+    launch->count = count;
+    launch->group = NULL;
+    launch->successors = NULL;
+    launches.push_back(launch);
+    return launch;
+}
+
+
+inline bool
+TaskGroupBase::LaunchFinished(int launch) const {
+    // Handles from before the last sync may be out of range; the tasks of
+    // those launches have all finished.
+    if (launch < 0 || launch >= (int)launches.size())
+        return true;
+    return launches[launch]->numUnfinishedTasks == 0;
 }
 
 
@@ -379,7 +655,7 @@ lMemFence() {
 #endif
 }
 
-static void *
+static inline void *
 lAtomicCompareAndSwapPointer(void **v, void *newValue, void *oldValue) {
 #ifdef ISPC_IS_WINDOWS
     return InterlockedCompareExchangePointer(v, newValue, oldValue);
@@ -401,6 +677,17 @@ lAtomicCompareAndSwap32(volatile int32_t *v, int32_t newValue, int32_t oldValue)
 #endif // ISPC_IS_WINDOWS
 }
 
+static int64_t
+lAtomicCompareAndSwap64(volatile int64_t *v, int64_t newValue, int64_t oldValue) {
+#ifdef ISPC_IS_WINDOWS
+    return InterlockedCompareExchange64((volatile LONGLONG *)v, newValue, oldValue);
+#else
+    int64_t result = __sync_val_compare_and_swap(v, oldValue, newValue);
+    lMemFence();
+    return result;
+#endif // ISPC_IS_WINDOWS
+}
+
 static inline int32_t 
 lAtomicAdd(volatile int32_t *v, int32_t delta) {
 #ifdef ISPC_IS_WINDOWS
@@ -410,6 +697,541 @@ lAtomicAdd(volatile int32_t *v, int32_t delta) {
 #endif
 }
 
+
+/* Unlike lAtomicAdd(), which returns the old value on some platforms
+   and the new one on others, this always returns the new value. */
+static inline int32_t
+lAtomicDecrement(volatile int32_t *v) {
+    int32_t old;
+    do {
+        old = *v;
+    } while (lAtomicCompareAndSwap32(v, old - 1, old) != old);
+    return old - 1;
+}
+
+
+static inline void
+lLock(volatile int32_t *lock) {
+    while (lAtomicCompareAndSwap32(lock, 1, 0) != 0)
+        ;
+}
+
+
+static inline void
+lUnlock(volatile int32_t *lock) {
+    lMemFence();
+    *lock = 0;
+}
+
+
+inline void
+TaskGroupBase::AddDependency(int predecessor, LaunchInfo *launch) {
+    // Only earlier launches can be waited for; handles from before the
+    // last sync have finished by now.
+    if (predecessor < 0 || predecessor >= (int)launches.size() - 1)
+        return;
+
+    LaunchInfo *pred = launches[predecessor];
+    LaunchSuccessor *succ =
+        (LaunchSuccessor *)AllocMemory(sizeof(LaunchSuccessor),
+                                       sizeof(void *));
+    // The last task of pred to finish decrements its count before it
+    // takes the lock to look at its successors, so if the count isn't
+    // zero here, that will see this successor.
+    lLock(&launchLock);
+    if (pred->numUnfinishedTasks > 0) {
+        lAtomicAdd(&launch->numPendingDeps, 1);
+        succ->launch = launch;
+        succ->next = pred->successors;
+        pred->successors = succ;
+    }
+    lUnlock(&launchLock);
+}
+
+
+inline LaunchSuccessor *
+TaskGroupBase::TakeSuccessors(LaunchInfo *launch) {
+    lLock(&launchLock);
+    LaunchSuccessor *succ = launch->successors;
+    launch->successors = NULL;
+    lUnlock(&launchLock);
+    return succ;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Arena usage statistics
+
+static volatile int64_t peakArenaUsage = 0;
+
+static void
+lUpdatePeakArenaUsage(int64_t used) {
+    int64_t peak = peakArenaUsage;
+    while (used > peak) {
+        int64_t old = lAtomicCompareAndSwap64(&peakArenaUsage, used, peak);
+        if (old == peak)
+            break;
+        peak = old;
+    }
+}
+
+
+int64_t
+ISPCGetPeakArenaUsage() {
+    return peakArenaUsage;
+}
+
+
+void
+ISPCResetPeakArenaUsage() {
+    peakArenaUsage = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Tracing
+
+/* If the ISPC_TASK_TRACE environment variable is set to a file name, the
+   task system records each ISPCLaunch() and ISPCSync() call, each task
+   that runs, and the time the pthreads-based systems' workers spend
+   idle.  At exit, these are written to that file in the Chrome trace
+   event format, which can be viewed with chrome://tracing or
+   https://ui.perfetto.dev.  Each thread records into its own ring buffer
+   of ISPC_TASK_TRACE_EVENTS (default 65536) events and keeps the most
+   recent ones if it fills up.
+ */
+
+enum TraceEventType {
+    TRACE_LAUNCH,
+    TRACE_TASK,
+    TRACE_SYNC,
+    TRACE_IDLE
+};
+
+struct TraceEvent {
+    int64_t start, end;  // in nanoseconds
+    int32_t type, arg0, arg1;
+};
+
+struct TraceBuffer {
+    int thread;
+    // Total number of events recorded; the most recent one is in
+    // events[(numEvents-1) % traceCapacity].
+    int64_t numEvents;
+    TraceEvent *events;
+};
+
+#define MAX_TRACE_THREADS 1024
+
+// 0: not initialized yet, 1: tracing, -1: not tracing, 2: being initialized
+static bool traceEnabled = false;
+#ifdef ISPC_IS_WINDOWS
+static INIT_ONCE traceOnce = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_once_t traceOnce = PTHREAD_ONCE_INIT;
+#endif // ISPC_IS_WINDOWS
+static const char *traceFileName = NULL;
+static int64_t traceCapacity = 65536;
+static int64_t traceStartTime = 0;
+static TraceBuffer * volatile traceBuffers[MAX_TRACE_THREADS];
+static volatile int32_t numTraceBuffers = 0;
+// Threads beyond the first MAX_TRACE_THREADS don't record anything; they
+// point to this.
+static TraceBuffer traceOverflowBuffer;
+static ISPC_TLS TraceBuffer *threadTraceBuffer = NULL;
+
+
+// Returns a monotonic timestamp, in nanoseconds.
+static inline int64_t
+lCurrentTimeNs() {
+#if defined(ISPC_IS_WINDOWS)
+    LARGE_INTEGER t, freq;
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&freq);
+    return (int64_t)(t.QuadPart * (1e9 / freq.QuadPart));
+#elif defined(ISPC_IS_LINUX)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000000 + (int64_t)tv.tv_usec * 1000;
+#endif
+}
+
+
+static void
+lTraceFlush() {
+    FILE *f = fopen(traceFileName, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open task trace file \"%s\".\n", traceFileName);
+        return;
+    }
+
+    static const char *names[] = { "launch", "task", "sync", "idle" };
+    fprintf(f, "{\"traceEvents\":[");
+    const char *sep = "\n";
+    for (int i = 0; i < numTraceBuffers; ++i) {
+        TraceBuffer *buf = traceBuffers[i];
+        if (buf == NULL)
+            continue;
+
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", sep,
+                buf->thread, buf->thread);
+        sep = ",\n";
+
+        // Worker threads may still be running, in which case the last few
+        // events may be missing or incomplete; that's fine for a trace.
+        int64_t end = buf->numEvents;
+        int64_t begin = std::max(int64_t(0), end - traceCapacity);
+        for (int64_t j = begin; j < end; ++j) {
+            const TraceEvent &e = buf->events[j % traceCapacity];
+            fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"ispc\",\"ph\":\"X\","
+                    "\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", sep,
+                    names[e.type], buf->thread, (e.start - traceStartTime) * 1e-3,
+                    (e.end - e.start) * 1e-3);
+            if (e.type == TRACE_LAUNCH)
+                fprintf(f, ",\"args\":{\"count\":%d}", e.arg0);
+            else if (e.type == TRACE_TASK)
+                fprintf(f, ",\"args\":{\"taskIndex\":%d,\"taskCount\":%d}",
+                        e.arg0, e.arg1);
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+}
+
+
+static void
+lTraceInit() {
+    const char *fileName = getenv("ISPC_TASK_TRACE");
+    if (fileName == NULL || *fileName == '\0')
+        return;
+    traceFileName = fileName;
+    const char *events = getenv("ISPC_TASK_TRACE_EVENTS");
+    if (events != NULL && atoll(events) > 0)
+        traceCapacity = atoll(events);
+    traceStartTime = lCurrentTimeNs();
+    atexit(lTraceFlush);
+    traceEnabled = true;
+}
+
+
+#ifdef ISPC_IS_WINDOWS
+static BOOL CALLBACK
+lTraceInitOnce(PINIT_ONCE, PVOID, PVOID *) {
+    lTraceInit();
+    return TRUE;
+}
+#endif // ISPC_IS_WINDOWS
+
+
+/* The one-time initialization also orders the writes that lTraceInit()
+   makes before any thread's reads of them. */
+static inline bool
+lTraceEnabled() {
+#ifdef ISPC_IS_WINDOWS
+    InitOnceExecuteOnce(&traceOnce, lTraceInitOnce, NULL, NULL);
+#else
+    pthread_once(&traceOnce, lTraceInit);
+#endif // ISPC_IS_WINDOWS
+    return traceEnabled;
+}
+
+
+static void
+lTraceRecord(TraceEventType type, int64_t start, int64_t end, int arg0, int arg1) {
+    TraceBuffer *buf = threadTraceBuffer;
+    if (buf == NULL) {
+        int32_t index;
+        do {
+            index = numTraceBuffers;
+        } while (index < MAX_TRACE_THREADS &&
+                 lAtomicCompareAndSwap32(&numTraceBuffers, index + 1, index) != index);
+
+        if (index < MAX_TRACE_THREADS) {
+            buf = new TraceBuffer;
+            buf->thread = index;
+            buf->numEvents = 0;
+            buf->events = new TraceEvent[traceCapacity];
+            lMemFence();
+            traceBuffers[index] = buf;
+        }
+        else
+            buf = &traceOverflowBuffer;
+        threadTraceBuffer = buf;
+    }
+    if (buf == &traceOverflowBuffer)
+        return;
+
+    TraceEvent &e = buf->events[buf->numEvents % traceCapacity];
+    e.start = start;
+    e.end = end;
+    e.type = type;
+    e.arg0 = arg0;
+    e.arg1 = arg1;
+    ++buf->numEvents;
+}
+
+
+/** Records an event covering the lifetime of the TraceScope object, if
+    tracing is enabled. */
+class TraceScope {
+public:
+    TraceScope(TraceEventType t, int a0 = 0, int a1 = 0)
+        : active(lTraceEnabled()), type(t), arg0(a0), arg1(a1), start(0) {
+        if (active)
+            start = lCurrentTimeNs();
+    }
+    ~TraceScope() {
+        if (active)
+            lTraceRecord(type, start, lCurrentTimeNs(), arg0, arg1);
+    }
+
+private:
+    bool active;
+    TraceEventType type;
+    int arg0, arg1;
+    int64_t start;
+};
+
+///////////////////////////////////////////////////////////////////////////
+// Thread placement for the pthreads-based task systems
+
+#if defined(ISPC_USE_PTHREADS) || defined(ISPC_USE_PTHREADS_WORK_STEALING)
+
+extern "C" {
+    void *ISPCAllocNodeLocal(int64_t size, int32_t alignment);
+    void ISPCFreeNodeLocal(void *ptr);
+}
+
+/* The machine's NUMA topology: numNodes nodes, with nodeIds giving the
+   operating system's number for each one and cpuNodes the index into
+   nodeIds for each CPU.  If the topology isn't available, everything is
+   on a single node.
+
+   When threads are pinned, workerCpus and workerNodes give the CPU and
+   node of each worker thread, and numTaskNodes == numNodes.  Otherwise,
+   threads may migrate between nodes, so the task systems treat all of
+   the workers as being on node 0 and numTaskNodes is 1.
+ */
+static int numNodes = 1, numTaskNodes = 1;
+static std::vector<int> nodeIds;
+static std::vector<int> cpuNodes;
+static std::vector<int> workerCpus;
+static std::vector<int> workerNodes;
+
+
+#ifdef ISPC_IS_LINUX
+// Parses a CPU list from sysfs, like "0-7,16-23".
+static void
+lParseCpuList(const char *str, std::vector<int> *cpus) {
+    while (*str != '\0' && *str != '\n') {
+        char *end;
+        int first = (int)strtol(str, &end, 10);
+        if (end == str)
+            return;
+        int last = first;
+        if (*end == '-')
+            last = (int)strtol(end + 1, &end, 10);
+        for (int i = first; i <= last; ++i)
+            cpus->push_back(i);
+        str = (*end == ',') ? end + 1 : end;
+    }
+}
+#endif // ISPC_IS_LINUX
+
+
+/** Reads the NUMA topology and, if requested, decides which CPU each of
+    the nWorkers workers will run on.  This is called once, from
+    InitTaskSystem(). */
+static void
+lInitThreadPlacement(int nWorkers) {
+    workerCpus.assign(nWorkers > 0 ? nWorkers : 1, -1);
+    workerNodes.assign(nWorkers > 0 ? nWorkers : 1, 0);
+    nodeIds.assign(1, 0);
+
+#ifdef ISPC_IS_LINUX
+    // (node id, cpu) for each of the CPUs we're allowed to run on
+    std::vector<std::pair<int, int> > cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveAffinity = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            int node;
+            if (sscanf(entry->d_name, "node%d", &node) != 1)
+                continue;
+
+            char path[128], buf[4096];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+                     node);
+            FILE *f = fopen(path, "r");
+            if (f == NULL)
+                continue;
+            std::vector<int> nodeCpus;
+            if (fgets(buf, sizeof(buf), f) != NULL)
+                lParseCpuList(buf, &nodeCpus);
+            fclose(f);
+
+            for (unsigned int i = 0; i < nodeCpus.size(); ++i)
+                if (!haveAffinity || (nodeCpus[i] < CPU_SETSIZE &&
+                                      CPU_ISSET(nodeCpus[i], &allowed)))
+                    cpus.push_back(std::make_pair(node, nodeCpus[i]));
+        }
+        closedir(dir);
+    }
+    if (cpus.size() == 0)
+        return;
+
+    // Sorting by node and then CPU gives us the order in which we hand out
+    // CPUs to workers, and lets us number the nodes densely.
+    std::sort(cpus.begin(), cpus.end());
+    nodeIds.clear();
+    for (unsigned int i = 0; i < cpus.size(); ++i) {
+        if (nodeIds.size() == 0 || nodeIds.back() != cpus[i].first)
+            nodeIds.push_back(cpus[i].first);
+        int cpu = cpus[i].second;
+        if (cpu >= (int)cpuNodes.size())
+            cpuNodes.resize(cpu + 1, 0);
+        cpuNodes[cpu] = (int)nodeIds.size() - 1;
+    }
+    numNodes = (int)nodeIds.size();
+
+    const char *pin = getenv("ISPC_PIN_THREADS");
+    if (pin == NULL || atoi(pin) == 0)
+        return;
+
+    // The first CPU is left for the application's thread that launches
+    // tasks (which we don't pin); workers get the following ones.
+    for (int i = 0; i < nWorkers; ++i) {
+        const std::pair<int, int> &c = cpus[(i + 1) % cpus.size()];
+        workerCpus[i] = c.second;
+        workerNodes[i] = cpuNodes[c.second];
+    }
+    numTaskNodes = numNodes;
+#endif // ISPC_IS_LINUX
+}
+
+
+/** Pins the calling thread to the given CPU (if it's not -1). */
+static void
+lPinCurrentThread(int cpu) {
+#ifdef ISPC_IS_LINUX
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+        fprintf(stderr, "Error pinning thread to CPU %d: %s\n", cpu, strerror(err));
+#endif // ISPC_IS_LINUX
+}
+
+
+/** Returns the index of the NUMA node that the calling thread is currently
+    running on. */
+static int
+lCurrentNode() {
+#ifdef ISPC_IS_LINUX
+    if (numNodes > 1) {
+        int cpu = sched_getcpu();
+        if (cpu >= 0 && cpu < (int)cpuNodes.size())
+            return cpuNodes[cpu];
+    }
+#endif // ISPC_IS_LINUX
+    return 0;
+}
+
+#endif // ISPC_USE_PTHREADS || ISPC_USE_PTHREADS_WORK_STEALING
+
+///////////////////////////////////////////////////////////////////////////
+// Spin-then-sleep waiting
+
+#if defined(ISPC_USE_PTHREADS) || defined(ISPC_USE_PTHREADS_WORK_STEALING) || \
+    defined(ISPC_USE_GCD) || defined(ISPC_USE_STDTHREAD)
+
+/* Idle worker threads and threads waiting in TaskGroup::Sync() first spin
+   for spinTimeNs, looking for work, before they block; for short tasks
+   launched at high frequency, this avoids paying for a sleep and wakeup
+   around each launch.  The spin time can be set in microseconds with the
+   ISPC_SPIN_USEC environment variable; 0 disables spinning.
+ */
+static int64_t spinTimeNs = 50000;
+
+
+static void
+lInitSpinTime() {
+    const char *spin = getenv("ISPC_SPIN_USEC");
+    if (spin != NULL)
+        spinTimeNs = std::max(0LL, atoll(spin)) * 1000;
+}
+
+
+/** Spins briefly, letting the other hyper-thread on the core run. */
+static inline void
+lSpinPause() {
+    for (int i = 0; i < 32; ++i) {
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#elif defined(ISPC_IS_WINDOWS)
+        YieldProcessor();
+#endif
+    }
+}
+
+#endif // ISPC_USE_PTHREADS || ISPC_USE_PTHREADS_WORK_STEALING || ISPC_USE_GCD ||
+       // ISPC_USE_STDTHREAD
+
+#if defined(ISPC_USE_PTHREADS) || defined(ISPC_USE_PTHREADS_WORK_STEALING)
+
+/* Threads that have to block in Sync() wait on syncCond.  It's signaled
+   whenever a task finishes or more tasks are launched while any thread
+   is waiting there; numSyncWaiters lets everyone else skip the mutex. */
+static pthread_mutex_t syncMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t syncCond = PTHREAD_COND_INITIALIZER;
+static volatile int32_t numSyncWaiters = 0;
+static volatile int32_t syncWakeCount = 0;
+
+
+static inline void
+lWakeSyncWaiters() {
+    // Pairs with the fence in lBlockInSync() between incrementing
+    // numSyncWaiters and checking whether it still needs to wait.
+    __sync_synchronize();
+    if (numSyncWaiters > 0) {
+        pthread_mutex_lock(&syncMutex);
+        ++syncWakeCount;
+        pthread_cond_broadcast(&syncCond);
+        pthread_mutex_unlock(&syncMutex);
+    }
+}
+
+
+/** Blocks the calling thread in TaskGroup::Sync() until a task finishes
+    or more tasks are launched, unless there are no unfinished tasks left
+    in its group or workAvailable() says there's something to run. */
+static void
+lBlockInSync(volatile int32_t *numUnfinishedTasks, bool (*workAvailable)()) {
+    pthread_mutex_lock(&syncMutex);
+    int32_t count = syncWakeCount;
+    lAtomicAdd(&numSyncWaiters, 1);
+    __sync_synchronize();
+    if (*numUnfinishedTasks > 0 && !workAvailable()) {
+        while (count == syncWakeCount)
+            pthread_cond_wait(&syncCond, &syncMutex);
+    }
+    lAtomicAdd(&numSyncWaiters, -1);
+    pthread_mutex_unlock(&syncMutex);
+}
+
+#endif // ISPC_USE_PTHREADS || ISPC_USE_PTHREADS_WORK_STEALING
+
 ///////////////////////////////////////////////////////////////////////////
 
 #ifdef ISPC_USE_CONCRT
@@ -418,6 +1240,7 @@ class TaskGroup : public TaskGroupBase {
 public:
     void Launch(int baseIndex, int count);
     void Sync();
+    void SyncLaunch(int launch);
 };
 #endif // ISPC_USE_CONCRT
 
@@ -434,6 +1257,7 @@ public:
 
     void Launch(int baseIndex, int count);
     void Sync();
+    void SyncLaunch(int launch);
 
 private:
     dispatch_group_t gcdGroup;
@@ -459,11 +1283,22 @@ public:
     }
 
     void Launch(int baseIndex, int count);
-    void Sync();
+    void Sync() { SyncUntil(&numUnfinishedTasks, 0, nextTaskInfoIndex); }
+    void SyncLaunch(int launch) {
+        LaunchInfo *li = launches[launch];
+        SyncUntil(&li->numUnfinishedTasks, li->baseIndex,
+                  li->baseIndex + li->count);
+    }
 
 private:
     friend void *lTaskEntry(void *arg);
 
+    /* Runs tasks, preferring the ones in [firstTask, endTask), until the
+       given count of unfinished tasks (the group's or one launch's) is
+       zero. */
+    void SyncUntil(volatile int32_t *unfinishedTasks, int firstTask,
+                   int endTask);
+
     int32_t numUnfinishedTasks;
     int32_t pad[3];
     std::vector<int> waitingTasks;
@@ -472,16 +1307,85 @@ private:
 
 #endif // ISPC_USE_PTHREADS
 
-#ifdef ISPC_USE_CILK
+#ifdef ISPC_USE_PTHREADS_WORK_STEALING
+struct TaskRange;
+static void lRunTaskRange(TaskRange range, int threadIndex);
 
 class TaskGroup : public TaskGroupBase {
 public:
-    void Launch(int baseIndex, int count);
-    void Sync();
-
-};
+    TaskGroup() {
+        numUnfinishedTasks = 0;
+    }
 
-#endif // ISPC_USE_CILK
+    void Reset() {
+        TaskGroupBase::Reset();
+        numUnfinishedTasks = 0;
+        lMemFence();
+    }
+
+    void Launch(int baseIndex, int count);
+    void Sync() { SyncUntil(&numUnfinishedTasks); }
+    void SyncLaunch(int launch) {
+        SyncUntil(&launches[launch]->numUnfinishedTasks);
+    }
+
+private:
+    friend void lRunTaskRange(TaskRange range, int threadIndex);
+
+    /* Runs tasks until the given count of unfinished tasks (the group's
+       or one launch's) is zero. */
+    void SyncUntil(volatile int32_t *unfinishedTasks);
+
+    volatile int32_t numUnfinishedTasks;
+};
+
+#endif // ISPC_USE_PTHREADS_WORK_STEALING
+
+#ifdef ISPC_USE_STDTHREAD
+struct TaskRange;
+static void lRunTaskRange(TaskRange range, int threadIndex);
+
+class TaskGroup : public TaskGroupBase {
+public:
+    TaskGroup() {
+        numUnfinishedTasks = 0;
+    }
+
+    void Reset() {
+        TaskGroupBase::Reset();
+        numUnfinishedTasks = 0;
+        lMemFence();
+    }
+
+    void Launch(int baseIndex, int count);
+    void Sync() { SyncUntil(&numUnfinishedTasks); }
+    void SyncLaunch(int launch) {
+        SyncUntil(&launches[launch]->numUnfinishedTasks);
+    }
+
+private:
+    friend void lRunTaskRange(TaskRange range, int threadIndex);
+
+    /* Runs tasks until the given count of unfinished tasks (the group's
+       or one launch's) is zero. */
+    void SyncUntil(volatile int32_t *unfinishedTasks);
+
+    volatile int32_t numUnfinishedTasks;
+};
+
+#endif // ISPC_USE_STDTHREAD
+
+#ifdef ISPC_USE_CILK
+
+class TaskGroup : public TaskGroupBase {
+public:
+    void Launch(int baseIndex, int count);
+    void Sync();
+    void SyncLaunch(int launch);
+
+};
+
+#endif // ISPC_USE_CILK
 
 #ifdef ISPC_USE_OMP
 
@@ -489,17 +1393,37 @@ class TaskGroup : public TaskGroupBase {
 public:
     void Launch(int baseIndex, int count);
     void Sync();
+    void SyncLaunch(int launch);
 
 };
 
 #endif // ISPC_USE_OMP
 
+#ifdef ISPC_USE_OMP_TASKLOOP
+
+class TaskGroup : public TaskGroupBase {
+public:
+    void Launch(int baseIndex, int count) { LaunchAfter(baseIndex, count, 0, NULL); }
+    /* The launch's dependencies are passed on to the OpenMP runtime,
+       rather than being tracked by lFinishTask(). */
+    void LaunchAfter(int baseIndex, int count, int32_t numDeps,
+                     const int32_t *deps);
+    void Sync();
+    void SyncLaunch(int launch);
+
+private:
+    void RunTasks(int baseIndex, int count);
+};
+
+#endif // ISPC_USE_OMP_TASKLOOP
+
 #ifdef ISPC_USE_TBB_PARALLEL_FOR
 
 class TaskGroup : public TaskGroupBase {
 public:
     void Launch(int baseIndex, int count);
     void Sync();
+    void SyncLaunch(int launch);
 
 };
 
@@ -509,10 +1433,21 @@ public:
 
 class TaskGroup : public TaskGroupBase {
 public:
+    TaskGroup() : arena(NULL) { }
+
+    void Reset() {
+        TaskGroupBase::Reset();
+        arena = NULL;
+    }
+
     void Launch(int baseIndex, int count);
     void Sync();
+    void SyncLaunch(int launch);
 private:
     tbb::task_group tbbTaskGroup;
+    // The arena that the tasks since the last Reset() were launched in,
+    // which is also the one that has to wait for them
+    tbb::task_arena *arena;
 };
 
 #endif // ISPC_USE_TBB_TASK_GROUP
@@ -523,14 +1458,41 @@ class TaskGroup : public TaskGroupBase {
 public:
     void Launch(int baseIndex, int count);
     void Sync();
+    void SyncLaunch(int launch);
 private:
     std::vector<hpx::future<void>> futures;
+    volatile int32_t futuresLock = 0;
 };
 
 #endif // ISPC_USE_HPX
 
 ///////////////////////////////////////////////////////////////////////////
 
+/** Called after each task has run, so that ISPCSyncLaunch() can tell
+    when all of the tasks of its launch are done.  When the last one
+    finishes, the launches that were waiting for it start, if they
+    aren't waiting for anything else.  This must happen before the task
+    is counted as finished in its task group, which may be reset (and
+    its arena reused) at that point; the same goes for the tasks started
+    here, which are counted as unfinished before then.
+ */
+#ifndef ISPC_USE_PTHREADS_FULLY_SUBSCRIBED
+static inline void
+lFinishTask(TaskInfo *ti) {
+    lMemFence();
+    LaunchInfo *launch = ti->launch;
+    if (lAtomicDecrement(&launch->numUnfinishedTasks) > 0)
+        return;
+
+    LaunchSuccessor *succ = launch->group->TakeSuccessors(launch);
+    for (; succ != NULL; succ = succ->next) {
+        LaunchInfo *next = succ->launch;
+        if (lAtomicDecrement(&next->numPendingDeps) == 0)
+            next->group->Launch(next->baseIndex, next->count);
+    }
+}
+#endif // !ISPC_USE_PTHREADS_FULLY_SUBSCRIBED
+
 ///////////////////////////////////////////////////////////////////////////
 // Grand Central Dispatch
 
@@ -550,6 +1512,7 @@ InitTaskSystem() {
     while (1) {
         if (lAtomicCompareAndSwap32(&lock, 1, 0) == 0) {
             if (gcdQueue == NULL) {
+                lInitSpinTime();
                 gcdQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
                 assert(gcdQueue != NULL);
                 lMemFence();
@@ -570,10 +1533,12 @@ lRunTask(void *ti) {
     int threadCount = 1;
 
     // Actually run the task
+    TraceScope trace(TRACE_TASK, taskInfo->taskIndex, taskInfo->taskCount());
     taskInfo->func(taskInfo->data, threadIndex, threadCount, 
                    taskInfo->taskIndex, taskInfo->taskCount(),
             taskInfo->taskIndex0(), taskInfo->taskIndex1(), taskInfo->taskIndex2(),
             taskInfo->taskCount0(), taskInfo->taskCount1(), taskInfo->taskCount2());
+    lFinishTask(taskInfo);
 }
 
 
@@ -588,9 +1553,35 @@ TaskGroup::Launch(int baseIndex, int count) {
 
 inline void
 TaskGroup::Sync() {
+    // GCD doesn't let us run the group's tasks here ourselves, but we can
+    // at least poll for a while before blocking.
+    if (spinTimeNs > 0) {
+        int64_t deadline = lCurrentTimeNs() + spinTimeNs;
+        do {
+            if (dispatch_group_wait(gcdGroup, DISPATCH_TIME_NOW) == 0)
+                return;
+            lSpinPause();
+        } while (lCurrentTimeNs() < deadline);
+    }
     dispatch_group_wait(gcdGroup, DISPATCH_TIME_FOREVER);
 }
 
+
+inline void
+TaskGroup::SyncLaunch(int launch) {
+    // There's no way to wait for some of a dispatch group's work, so we
+    // poll the launch's count of unfinished tasks instead, giving up the
+    // CPU once we've spun for a while.
+    int64_t deadline = lCurrentTimeNs() + spinTimeNs;
+    while (!LaunchFinished(launch)) {
+        if (lCurrentTimeNs() < deadline)
+            lSpinPause();
+        else
+            sched_yield();
+    }
+    lMemFence();
+}
+
 #endif // ISPC_USE_GCD
 
 ///////////////////////////////////////////////////////////////////////////
@@ -614,9 +1605,11 @@ lRunTask(LPVOID param) {
     // will cause bugs in code that uses those.
     int threadIndex = 0;
     int threadCount = 1;
+    TraceScope trace(TRACE_TASK, ti->taskIndex, ti->taskCount());
     ti->func(ti->data, threadIndex, threadCount, ti->taskIndex, ti->taskCount(),
             ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
             ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+    lFinishTask(ti);
 
     // Signal the event that this task is done
     ti->taskEvent.set();
@@ -639,6 +1632,16 @@ TaskGroup::Sync() {
     }
 }
 
+
+inline void
+TaskGroup::SyncLaunch(int launch) {
+    // The events are left set, so that Sync() can still wait on them
+    // before it resets them.
+    LaunchInfo *li = launches[launch];
+    for (int i = 0; i < li->count; ++i)
+        GetTaskInfo(li->baseIndex + i)->taskEvent.wait();
+}
+
 #endif // ISPC_USE_CONCRT
 
 ///////////////////////////////////////////////////////////////////////////
@@ -659,6 +1662,7 @@ static void *
 lTaskEntry(void *arg) {
     int threadIndex = (int)((int64_t)arg);
     int threadCount = nThreads;
+    lPinCurrentThread(workerCpus[threadIndex]);
 
     while (1) {
         int err;
@@ -666,9 +1670,19 @@ lTaskEntry(void *arg) {
         // Wait on the semaphore until we're woken up due to the arrival of
         // more work.
         //
-        if ((err = sem_wait(workerSemaphore)) != 0) {
-            fprintf(stderr, "Error from sem_wait: %s\n", strerror(err));
-            exit(1);
+        {
+            TraceScope trace(TRACE_IDLE);
+            bool gotWork = false;
+            if (spinTimeNs > 0) {
+                int64_t deadline = lCurrentTimeNs() + spinTimeNs;
+                while (!(gotWork = (sem_trywait(workerSemaphore) == 0)) &&
+                       lCurrentTimeNs() < deadline)
+                    lSpinPause();
+            }
+            if (!gotWork && (err = sem_wait(workerSemaphore)) != 0) {
+                fprintf(stderr, "Error from sem_wait: %s\n", strerror(err));
+                exit(1);
+            }
         }
 
         //
@@ -716,10 +1730,12 @@ lTaskEntry(void *arg) {
         //
         DBG(fprintf(stderr, "running task %d from group %p\n", taskNumber, tg));
         TaskInfo *myTask = tg->GetTaskInfo(taskNumber);
+        TraceScope trace(TRACE_TASK, myTask->taskIndex, myTask->taskCount());
         myTask->func(myTask->data, threadIndex, threadCount, myTask->taskIndex,
                      myTask->taskCount(),
             myTask->taskIndex0(), myTask->taskIndex1(), myTask->taskIndex2(),
             myTask->taskCount0(), myTask->taskCount1(), myTask->taskCount2());
+        lFinishTask(myTask);
 
         //
         // Decrement the "number of unfinished tasks" counter in the task
@@ -727,6 +1743,7 @@ lTaskEntry(void *arg) {
         //
         lMemFence();
         lAtomicAdd(&tg->numUnfinishedTasks, -1);
+        lWakeSyncWaiters();
     }
 
     pthread_exit(NULL);
@@ -744,6 +1761,8 @@ InitTaskSystem() {
                     // since the main thread here will also grab jobs from
                     // the task queue itself.
                     nThreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+                    lInitThreadPlacement(nThreads);
+                    lInitSpinTime();
 
                     int err;
                     if ((err = pthread_mutex_init(&taskSysMutex, NULL)) != 0) {
@@ -841,14 +1860,30 @@ TaskGroup::Launch(int baseCoord, int count) {
             fprintf(stderr, "Error from sem_post: %s\n", strerror(err));
             exit(1);
         }
+
+    // Threads blocked in Sync() can help out, too.
+    lWakeSyncWaiters();
 }
 
 
-inline void
-TaskGroup::Sync() {
-    DBG(fprintf(stderr, "syncing %p - %d unfinished\n", tg, numUnfinishedTasks));
+static bool
+lTaskGroupsActive() {
+    pthread_mutex_lock(&taskSysMutex);
+    bool active = (activeTaskGroups.size() > 0);
+    pthread_mutex_unlock(&taskSysMutex);
+    return active;
+}
+
 
-    while (numUnfinishedTasks > 0) {
+inline void
+TaskGroup::SyncUntil(volatile int32_t *unfinishedTasks, int firstTask,
+                     int endTask) {
+    DBG(fprintf(stderr, "syncing %p - %d unfinished\n", tg, *unfinishedTasks));
+
+    // When we run out of tasks to run, we spin until spinDeadline before
+    // blocking.
+    int64_t spinDeadline = 0;
+    while (*unfinishedTasks > 0) {
         // All of the tasks in this group aren't finished yet.  We'll try
         // to help out here since we don't have anything else to do...
 
@@ -867,8 +1902,14 @@ TaskGroup::Sync() {
         TaskInfo *myTask = NULL;
         TaskGroup *runtg = this;
         if (waitingTasks.size() > 0) {
-            int taskNumber = waitingTasks.back();
-            waitingTasks.pop_back();
+            // Run the tasks that we're waiting for first; when syncing a
+            // single launch, later launches' tasks are at the back.
+            int slot = (int)waitingTasks.size() - 1;
+            while (slot > 0 && (waitingTasks[slot] < firstTask ||
+                                waitingTasks[slot] >= endTask))
+                --slot;
+            int taskNumber = waitingTasks[slot];
+            waitingTasks.erase(waitingTasks.begin() + slot);
 
             if (waitingTasks.size() == 0) {
                 // There's nothing left to start running from this group,
@@ -891,59 +1932,1024 @@ TaskGroup::Sync() {
                     fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
                     exit(1);
                 }
-                // FIXME: We basically end up busy-waiting here, which is
-                // extra wasteful in a world with hyper-threading.  It would
-                // be much better to put this thread to sleep on a
-                // condition variable that was signaled when the last task
-                // in this group was finished.
+                if (spinDeadline == 0)
+                    spinDeadline = lCurrentTimeNs() + spinTimeNs;
+                if (lCurrentTimeNs() < spinDeadline) {
 #ifndef ISPC_IS_KNC
-                usleep(1);
+                    lSpinPause();
 #else
-                _mm_delay_32(8);
+                    _mm_delay_32(8);
 #endif
+                }
+                else
+                    lBlockInSync(unfinishedTasks, lTaskGroupsActive);
                 continue;
             }
 
-            // Get a task to run from another task group.
-            runtg = activeTaskGroups.back();
-            assert(runtg->waitingTasks.size() > 0);
+            // Get a task to run from another task group.
+            runtg = activeTaskGroups.back();
+            assert(runtg->waitingTasks.size() > 0);
+
+            int taskNumber = runtg->waitingTasks.back();
+            runtg->waitingTasks.pop_back();
+            if (runtg->waitingTasks.size() == 0) {
+                // There's left to start running from this group, so remove
+                // it from the active task list.
+                activeTaskGroups.pop_back();
+                runtg->inActiveList = false;
+            }
+            myTask = runtg->GetTaskInfo(taskNumber);
+            DBG(fprintf(stderr, "running task %d from other group %p in sync\n", 
+                        taskNumber, runtg));
+        }
+
+        if ((err = pthread_mutex_unlock(&taskSysMutex)) != 0) {
+            fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
+            exit(1);
+        }
+    
+        //
+        // Do work for _myTask_
+        //
+        // FIXME: bogus values for thread index/thread count here as well..
+        TraceScope trace(TRACE_TASK, myTask->taskIndex, myTask->taskCount());
+        myTask->func(myTask->data, 0, 1, myTask->taskIndex, myTask->taskCount(),
+            myTask->taskIndex0(), myTask->taskIndex1(), myTask->taskIndex2(),
+            myTask->taskCount0(), myTask->taskCount1(), myTask->taskCount2());
+        lFinishTask(myTask);
+
+        //
+        // Decrement the number of unfinished tasks counter
+        //
+        lMemFence();
+        lAtomicAdd(&runtg->numUnfinishedTasks, -1);
+        lWakeSyncWaiters();
+        spinDeadline = 0;
+    }
+    lMemFence();
+    DBG(fprintf(stderr, "sync for %p done!n", tg));
+}
+
+#endif // ISPC_USE_PTHREADS
+
+///////////////////////////////////////////////////////////////////////////
+// pthreads with work stealing
+
+#ifdef ISPC_USE_PTHREADS_WORK_STEALING
+
+/* A contiguous range of tasks [begin, end) from a task group that haven't
+   started running yet. */
+struct TaskRange {
+    TaskGroup *group;
+    int32_t begin, end;
+};
+
+#define LOG_WORK_QUEUE_SIZE 12
+#define WORK_QUEUE_SIZE (1 << LOG_WORK_QUEUE_SIZE)
+
+/** A Chase-Lev work-stealing deque of task ranges.  Only the thread that
+    owns the queue calls Push() and Pop(), which work on the bottom end;
+    other threads call Steal() to take ranges from the top end.  The queue
+    has a fixed size; Push() returns false if it's full, in which case the
+    caller just runs the range itself.
+ */
+class WorkQueue {
+public:
+    WorkQueue() : top(0), bottom(0) { }
+
+    bool Push(const TaskRange &range);
+    bool Pop(TaskRange *range);
+    bool Steal(TaskRange *range);
+
+    bool Empty() const { return bottom <= top; }
+
+private:
+    // top and bottom are kept on separate cache lines, since the owner
+    // mostly updates bottom and thieves update top.
+    volatile int64_t top;
+    char pad0[64 - sizeof(int64_t)];
+    volatile int64_t bottom;
+    char pad1[64 - sizeof(int64_t)];
+    TaskRange ranges[WORK_QUEUE_SIZE];
+};
+
+
+inline bool
+WorkQueue::Push(const TaskRange &range) {
+    int64_t b = bottom;
+    if (b - top >= WORK_QUEUE_SIZE)
+        return false;
+
+    ranges[b & (WORK_QUEUE_SIZE-1)] = range;
+    // Make sure the range is visible before thieves can see the new bottom
+    lMemFence();
+    bottom = b + 1;
+    return true;
+}
+
+
+inline bool
+WorkQueue::Pop(TaskRange *range) {
+    int64_t b = bottom - 1;
+    bottom = b;
+    // The store to bottom must be visible before we read top, so that a
+    // thief and the owner can't both take the last range.
+    __sync_synchronize();
+    int64_t t = top;
+
+    if (t > b) {
+        // Empty
+        bottom = t;
+        return false;
+    }
+
+    *range = ranges[b & (WORK_QUEUE_SIZE-1)];
+    if (t < b)
+        return true;
+
+    // This is the last range in the queue; race with any thieves for it.
+    bool won = __sync_bool_compare_and_swap(&top, t, t + 1);
+    bottom = t + 1;
+    return won;
+}
+
+
+inline bool
+WorkQueue::Steal(TaskRange *range) {
+    int64_t t = top;
+    __sync_synchronize();
+    int64_t b = bottom;
+    if (t >= b)
+        return false;
+
+    // Read the range before trying to claim it; if the CAS fails, someone
+    // else got it first (and the range we read may be stale), so we give
+    // up and let the caller look elsewhere.
+    TaskRange r = ranges[t & (WORK_QUEUE_SIZE-1)];
+    if (!__sync_bool_compare_and_swap(&top, t, t + 1))
+        return false;
+    *range = r;
+    return true;
+}
+
+
+static volatile int32_t lock = 0;
+
+static int nWorkers;
+static pthread_t *threads = NULL;
+static WorkQueue *workQueues = NULL;
+
+/* Worker threads run with their index in workerIndex; other threads that
+   launch tasks (typically the application's main thread) have -1 there.
+   Those don't have a work queue of their own, so the ranges they launch
+   go into the injected ranges list for their NUMA node instead.  Those
+   lists are also used to hand parts of large launches to the workers on
+   other nodes. */
+static ISPC_TLS int workerIndex = -1;
+static ISPC_TLS uint32_t stealSeed = 0;
+
+struct InjectedRanges {
+    pthread_mutex_t mutex;
+    std::vector<TaskRange> ranges;
+    volatile int32_t count;
+};
+static InjectedRanges *injectedRanges = NULL;
+static volatile int32_t numInjectedRanges = 0;
+
+/* Idle workers sleep on sleepCond; numSleeping lets threads that make
+   more work available skip the mutex when no one is sleeping. */
+static pthread_mutex_t sleepMutex;
+static pthread_cond_t sleepCond;
+static volatile int32_t numSleeping = 0;
+static volatile int32_t wakeCount = 0;
+
+
+static inline void
+lWakeWorkers() {
+    // Pairs with the fence in lWorkerEntry() between incrementing
+    // numSleeping and checking for work.
+    __sync_synchronize();
+    if (numSleeping > 0) {
+        pthread_mutex_lock(&sleepMutex);
+        ++wakeCount;
+        pthread_cond_broadcast(&sleepCond);
+        pthread_mutex_unlock(&sleepMutex);
+    }
+    lWakeSyncWaiters();
+}
+
+
+static inline int
+lThreadNode(int threadIndex) {
+    if (numTaskNodes == 1)
+        return 0;
+    return (threadIndex >= 0) ? workerNodes[threadIndex] : lCurrentNode();
+}
+
+
+static void
+lInjectTaskRange(const TaskRange &range, int node) {
+    InjectedRanges &inj = injectedRanges[node];
+    pthread_mutex_lock(&inj.mutex);
+    inj.ranges.push_back(range);
+    inj.count = (int32_t)inj.ranges.size();
+    pthread_mutex_unlock(&inj.mutex);
+    lAtomicAdd(&numInjectedRanges, 1);
+}
+
+
+static bool
+lTakeInjectedRange(TaskRange *range, int node) {
+    InjectedRanges &inj = injectedRanges[node];
+    if (inj.count == 0)
+        return false;
+
+    bool found = false;
+    pthread_mutex_lock(&inj.mutex);
+    if (inj.ranges.size() > 0) {
+        *range = inj.ranges.back();
+        inj.ranges.pop_back();
+        inj.count = (int32_t)inj.ranges.size();
+        found = true;
+    }
+    pthread_mutex_unlock(&inj.mutex);
+    if (found)
+        lAtomicAdd(&numInjectedRanges, -1);
+    return found;
+}
+
+
+static void
+lPushTaskRange(const TaskRange &range, int threadIndex) {
+    if (threadIndex >= 0) {
+        if (!workQueues[threadIndex].Push(range)) {
+            // The queue is full; there's plenty of work around, so just
+            // run these tasks ourselves.
+            lRunTaskRange(range, threadIndex);
+            return;
+        }
+    }
+    else
+        lInjectTaskRange(range, lThreadNode(threadIndex));
+    lWakeWorkers();
+}
+
+
+/** Finds a range of tasks to run: first from the calling thread's own
+    queue, then from the ranges injected for its NUMA node, and then by
+    trying to steal from the other workers on the node, starting from a
+    random one.  Only after that do we look at other nodes' injected
+    ranges and workers. */
+static bool
+lFindWork(TaskRange *range, int threadIndex) {
+    if (threadIndex >= 0 && workQueues[threadIndex].Pop(range))
+        return true;
+
+    int node = lThreadNode(threadIndex);
+    if (numInjectedRanges > 0 && lTakeInjectedRange(range, node))
+        return true;
+
+    if (nWorkers == 0)
+        return false;
+
+    // xorshift to pick the first victim
+    uint32_t x = stealSeed ? stealSeed : (uint32_t)(uintptr_t)&x | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    stealSeed = x;
+
+    int start = (int)(x % nWorkers);
+    for (int i = 0; i < nWorkers; ++i) {
+        int victim = (start + i) % nWorkers;
+        if (victim != threadIndex && lThreadNode(victim) == node &&
+            workQueues[victim].Steal(range))
+            return true;
+    }
+
+    if (numTaskNodes == 1)
+        return false;
+
+    for (int i = 1; i < numTaskNodes; ++i)
+        if (numInjectedRanges > 0 &&
+            lTakeInjectedRange(range, (node + i) % numTaskNodes))
+            return true;
+    for (int i = 0; i < nWorkers; ++i) {
+        int victim = (start + i) % nWorkers;
+        if (lThreadNode(victim) != node && workQueues[victim].Steal(range))
+            return true;
+    }
+    return false;
+}
+
+
+static bool
+lWorkAvailable() {
+    if (numInjectedRanges > 0)
+        return true;
+    for (int i = 0; i < nWorkers; ++i)
+        if (!workQueues[i].Empty())
+            return true;
+    return false;
+}
+
+
+/** Runs the given range of tasks.  Ranges of more than one task are split
+    in half repeatedly, with the upper halves going to the calling
+    thread's queue where they're available for other threads to steal,
+    until a single task is left to run here. */
+static void
+lRunTaskRange(TaskRange range, int threadIndex) {
+    while (range.end - range.begin > 1) {
+        TaskRange upper = range;
+        upper.begin = range.begin + (range.end - range.begin) / 2;
+        range.end = upper.begin;
+        lPushTaskRange(upper, threadIndex);
+    }
+
+    TaskGroup *tg = range.group;
+    for (int i = range.begin; i < range.end; ++i) {
+        DBG(fprintf(stderr, "running task %d from group %p\n", i, tg));
+        TaskInfo *myTask = tg->GetTaskInfo(i);
+        TraceScope trace(TRACE_TASK, myTask->taskIndex, myTask->taskCount());
+        myTask->func(myTask->data, (threadIndex >= 0) ? threadIndex : nWorkers,
+                     nWorkers + 1, myTask->taskIndex, myTask->taskCount(),
+            myTask->taskIndex0(), myTask->taskIndex1(), myTask->taskIndex2(),
+            myTask->taskCount0(), myTask->taskCount1(), myTask->taskCount2());
+        lFinishTask(myTask);
+    }
+
+    // This must be the last access to the task group, since it may be
+    // reused as soon as this brings its count of unfinished tasks to zero.
+    lMemFence();
+    lAtomicAdd(&tg->numUnfinishedTasks, -(range.end - range.begin));
+    lWakeSyncWaiters();
+}
+
+
+static void *
+lWorkerEntry(void *arg) {
+    int threadIndex = (int)((int64_t)arg);
+    workerIndex = threadIndex;
+    lPinCurrentThread(workerCpus[threadIndex]);
+
+    while (1) {
+        TaskRange range;
+        if (lFindWork(&range, threadIndex)) {
+            lRunTaskRange(range, threadIndex);
+            continue;
+        }
+
+        // Nothing to do; keep looking for a while before going to sleep.
+        TraceScope trace(TRACE_IDLE);
+        bool found = false;
+        int64_t deadline = lCurrentTimeNs() + spinTimeNs;
+        while (!found && lCurrentTimeNs() < deadline) {
+            lSpinPause();
+            found = lWorkAvailable();
+        }
+        if (found)
+            continue;
+
+        pthread_mutex_lock(&sleepMutex);
+        int32_t count = wakeCount;
+        lAtomicAdd(&numSleeping, 1);
+        __sync_synchronize();
+        // Check once more now that anyone who makes work available will
+        // see that we're sleeping and wake us up.
+        if (!lWorkAvailable()) {
+            while (count == wakeCount)
+                pthread_cond_wait(&sleepCond, &sleepMutex);
+        }
+        lAtomicAdd(&numSleeping, -1);
+        pthread_mutex_unlock(&sleepMutex);
+    }
+
+    pthread_exit(NULL);
+    return 0;
+}
+
+
+static void
+InitTaskSystem() {
+    if (threads == NULL) {
+        while (1) {
+            if (lAtomicCompareAndSwap32(&lock, 1, 0) == 0) {
+                if (threads == NULL) {
+                    // As with ISPC_USE_PTHREADS, the thread that syncs also
+                    // runs tasks, so we launch one fewer worker than there
+                    // are cores.
+                    nWorkers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+                    if (nWorkers < 0)
+                        nWorkers = 0;
+                    lInitThreadPlacement(nWorkers);
+                    lInitSpinTime();
+
+                    int err;
+                    if ((err = pthread_mutex_init(&sleepMutex, NULL)) != 0 ||
+                        (err = pthread_cond_init(&sleepCond, NULL)) != 0) {
+                        fprintf(stderr, "Error creating mutex: %s\n", strerror(err));
+                        exit(1);
+                    }
+                    injectedRanges = new InjectedRanges[numTaskNodes];
+                    for (int i = 0; i < numTaskNodes; ++i) {
+                        if ((err = pthread_mutex_init(&injectedRanges[i].mutex, NULL)) != 0) {
+                            fprintf(stderr, "Error creating mutex: %s\n", strerror(err));
+                            exit(1);
+                        }
+                        injectedRanges[i].ranges.reserve(64);
+                        injectedRanges[i].count = 0;
+                    }
+
+                    workQueues = new WorkQueue[nWorkers > 0 ? nWorkers : 1];
+                    pthread_t *t = (pthread_t *)malloc((nWorkers > 0 ? nWorkers : 1) *
+                                                       sizeof(pthread_t));
+                    for (int i = 0; i < nWorkers; ++i) {
+                        err = pthread_create(&t[i], NULL, &lWorkerEntry, (void *)((long long)i));
+                        if (err != 0) {
+                            fprintf(stderr, "Error creating pthread %d: %s\n", i, strerror(err));
+                            exit(1);
+                        }
+                    }
+
+                    // Make sure all of the above goes to memory before
+                    // other threads can see a non-NULL threads pointer.
+                    lMemFence();
+                    threads = t;
+                }
+
+                lMemFence();
+                lock = 0;
+                break;
+            }
+        }
+    }
+}
+
+
+inline void
+TaskGroup::Launch(int baseIndex, int count) {
+    // Account for the tasks before anyone can run (and finish) them.
+    lAtomicAdd(&numUnfinishedTasks, count);
+
+    TaskRange range;
+    range.group = this;
+    range.begin = baseIndex;
+    range.end = baseIndex + count;
+
+    int threadIndex = workerIndex;
+    if (numTaskNodes == 1 || count < numTaskNodes) {
+        lPushTaskRange(range, threadIndex);
+        return;
+    }
+
+    // Give each NUMA node a contiguous part of the range, so that tasks
+    // with nearby taskIndex values (which typically work on nearby data)
+    // run on the same node.  Our own node's part goes to our queue.
+    int node = lThreadNode(threadIndex);
+    for (int i = 0; i < numTaskNodes; ++i) {
+        TaskRange part = range;
+        part.begin = baseIndex + (int)((int64_t)count * i / numTaskNodes);
+        part.end = baseIndex + (int)((int64_t)count * (i + 1) / numTaskNodes);
+        if (i != node)
+            lInjectTaskRange(part, i);
+    }
+    TaskRange mine = range;
+    mine.begin = baseIndex + (int)((int64_t)count * node / numTaskNodes);
+    mine.end = baseIndex + (int)((int64_t)count * (node + 1) / numTaskNodes);
+    lPushTaskRange(mine, threadIndex);
+}
+
+
+inline void
+TaskGroup::SyncUntil(volatile int32_t *unfinishedTasks) {
+    DBG(fprintf(stderr, "syncing %p - %d unfinished\n", this, *unfinishedTasks));
+
+    int threadIndex = workerIndex;
+    int64_t spinDeadline = 0;
+    while (*unfinishedTasks > 0) {
+        // Help out with whatever work is available (from this group or
+        // another one) while we wait.
+        TaskRange range;
+        if (lFindWork(&range, threadIndex)) {
+            lRunTaskRange(range, threadIndex);
+            spinDeadline = 0;
+        }
+        else if (spinDeadline == 0)
+            spinDeadline = lCurrentTimeNs() + spinTimeNs;
+        else if (lCurrentTimeNs() < spinDeadline)
+            lSpinPause();
+        else
+            lBlockInSync(unfinishedTasks, lWorkAvailable);
+    }
+    lMemFence();
+    DBG(fprintf(stderr, "sync for %p done!\n", this));
+}
+
+#endif // ISPC_USE_PTHREADS_WORK_STEALING
+
+///////////////////////////////////////////////////////////////////////////
+// C++11 threads with work stealing
+
+#ifdef ISPC_USE_STDTHREAD
+
+/* This task system works like ISPC_USE_PTHREADS_WORK_STEALING, but only
+   uses the C++11 thread support library, so that the same code runs on
+   all platforms.  It doesn't place threads or tasks on NUMA nodes. */
+
+/* A contiguous range of tasks [begin, end) from a task group that haven't
+   started running yet.  For the parts of launches that are run with task
+   affinity (see below), affinity points to where the index of the worker
+   that runs the part is recorded for the next launch; it's NULL
+   otherwise. */
+struct TaskRange {
+    TaskGroup *group;
+    int32_t begin, end;
+    std::atomic<int32_t> *affinity;
+};
+
+#define LOG_WORK_QUEUE_SIZE 12
+#define WORK_QUEUE_SIZE (1 << LOG_WORK_QUEUE_SIZE)
+
+/** A Chase-Lev work-stealing deque of task ranges.  Only the thread that
+    owns the queue calls Push() and Pop(), which work on the bottom end;
+    other threads call Steal() to take ranges from the top end.  The queue
+    has a fixed size; Push() returns false if it's full, in which case the
+    caller just runs the range itself.
+ */
+class WorkQueue {
+public:
+    WorkQueue() : top(0), bottom(0) { }
+
+    bool Push(const TaskRange &range);
+    bool Pop(TaskRange *range);
+    bool Steal(TaskRange *range);
+
+    bool Empty() const {
+        return bottom.load(std::memory_order_relaxed) <=
+            top.load(std::memory_order_relaxed);
+    }
+
+private:
+    // top and bottom are kept on separate cache lines, since the owner
+    // mostly updates bottom and thieves update top.
+    std::atomic<int64_t> top;
+    char pad0[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom;
+    char pad1[64 - sizeof(std::atomic<int64_t>)];
+    TaskRange ranges[WORK_QUEUE_SIZE];
+};
+
+
+inline bool
+WorkQueue::Push(const TaskRange &range) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    if (b - top.load(std::memory_order_acquire) >= WORK_QUEUE_SIZE)
+        return false;
+
+    ranges[b & (WORK_QUEUE_SIZE-1)] = range;
+    // Make sure the range is visible before thieves can see the new bottom
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+
+inline bool
+WorkQueue::Pop(TaskRange *range) {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    // The store to bottom must be visible before we read top, so that a
+    // thief and the owner can't both take the last range.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // Empty
+        bottom.store(t, std::memory_order_relaxed);
+        return false;
+    }
+
+    *range = ranges[b & (WORK_QUEUE_SIZE-1)];
+    if (t < b)
+        return true;
+
+    // This is the last range in the queue; race with any thieves for it.
+    int64_t expected = t;
+    bool won = top.compare_exchange_strong(expected, t + 1,
+                                           std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    bottom.store(t + 1, std::memory_order_relaxed);
+    return won;
+}
+
+
+inline bool
+WorkQueue::Steal(TaskRange *range) {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return false;
+
+    // Read the range before trying to claim it; if the CAS fails, someone
+    // else got it first (and the range we read may be stale), so we give
+    // up and let the caller look elsewhere.
+    TaskRange r = ranges[t & (WORK_QUEUE_SIZE-1)];
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+        return false;
+    *range = r;
+    return true;
+}
+
+
+/** Threads that have nothing to do wait on one of these until another
+    thread calls WakeAll(); numWaiting lets WakeAll() skip the mutex when
+    no one is waiting. */
+struct WaitList {
+    WaitList() : numWaiting(0), wakeCount(0) { }
+
+    void WakeAll();
+
+    /* Blocks until the next WakeAll(), unless done() returns true once
+       the calling thread is counted as waiting. */
+    template <typename Pred> void WaitUnless(Pred done);
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::atomic<int32_t> numWaiting;
+    int64_t wakeCount;
+};
+
+
+inline void
+WaitList::WakeAll() {
+    // Pairs with the fence in WaitUnless() between incrementing
+    // numWaiting and calling done().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (numWaiting.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> guard(mutex);
+        ++wakeCount;
+        cond.notify_all();
+    }
+}
+
+
+template <typename Pred> inline void
+WaitList::WaitUnless(Pred done) {
+    std::unique_lock<std::mutex> guard(mutex);
+    int64_t count = wakeCount;
+    numWaiting.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!done()) {
+        while (count == wakeCount)
+            cond.wait(guard);
+    }
+    numWaiting.fetch_sub(1);
+}
+
+
+static std::mutex initMutex;
+static std::atomic<bool> initialized(false);
+
+static int nWorkers;
+static WorkQueue *workQueues = NULL;
+
+/* Worker threads run with their index in workerIndex; other threads that
+   launch tasks (typically the application's main thread) have -1 there.
+   Those don't have a work queue of their own, so the ranges they launch
+   go into the injected ranges list instead. */
+static thread_local int workerIndex = -1;
+static thread_local uint32_t stealSeed = 0;
+
+/** A list of task ranges that any thread may add to or take from. */
+struct RangeList {
+    RangeList() : count(0) { }
+
+    void Add(const TaskRange &range);
+    bool Take(TaskRange *range);
+    bool Empty() const { return count.load(std::memory_order_relaxed) == 0; }
+
+    std::mutex mutex;
+    std::vector<TaskRange> ranges;
+    std::atomic<int32_t> count;
+};
+
+
+inline void
+RangeList::Add(const TaskRange &range) {
+    std::lock_guard<std::mutex> guard(mutex);
+    ranges.push_back(range);
+    count.fetch_add(1);
+}
+
+
+inline bool
+RangeList::Take(TaskRange *range) {
+    if (Empty())
+        return false;
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (ranges.empty())
+        return false;
+    *range = ranges.back();
+    ranges.pop_back();
+    count.fetch_sub(1);
+    return true;
+}
+
+
+static RangeList *injectedRanges = NULL;
+
+/* With task affinity, each worker has a mailbox for the parts of repeated
+   launches that it ran the last time; see TaskGroup::Launch(). */
+static bool taskAffinity = false;
+static RangeList *mailboxes = NULL;
+
+/** The workers that ran each part of the last launch of a given task
+    function with a given task count, or -1 for parts that were run by a
+    thread that isn't a worker. */
+struct LaunchAffinity {
+    int numParts;
+    std::atomic<int32_t> *workers;
+};
+typedef std::pair<void *, int> LaunchAffinityKey;
+static std::mutex launchAffinityMutex;
+static std::map<LaunchAffinityKey, LaunchAffinity *> *launchAffinities = NULL;
+
+/* Idle workers wait in idleWorkers; threads that have to block in
+   TaskGroup::Sync() wait in syncWaiters, which is woken whenever a task
+   finishes or more tasks are launched.  These, injectedRanges, the
+   mailboxes and the launch affinities are allocated by InitTaskSystem()
+   and never freed, since the workers may still be using them when the
+   process exits. */
+static WaitList *idleWorkers = NULL, *syncWaiters = NULL;
+
+
+static void
+lPushTaskRange(const TaskRange &range, int threadIndex) {
+    if (threadIndex >= 0) {
+        if (!workQueues[threadIndex].Push(range)) {
+            // The queue is full; there's plenty of work around, so just
+            // run these tasks ourselves.
+            lRunTaskRange(range, threadIndex);
+            return;
+        }
+    }
+    else
+        injectedRanges->Add(range);
+    idleWorkers->WakeAll();
+    syncWaiters->WakeAll();
+}
+
+
+/** Finds a range of tasks to run: first from the calling thread's own
+    queue and mailbox, then from the injected ranges, and then by trying
+    to steal from the other workers' queues and mailboxes, starting from a
+    random one. */
+static bool
+lFindWork(TaskRange *range, int threadIndex) {
+    if (threadIndex >= 0 && workQueues[threadIndex].Pop(range))
+        return true;
+
+    if (taskAffinity && threadIndex >= 0 && mailboxes[threadIndex].Take(range))
+        return true;
+
+    if (injectedRanges->Take(range))
+        return true;
+
+    if (nWorkers == 0)
+        return false;
+
+    // xorshift to pick the first victim
+    uint32_t x = stealSeed ? stealSeed : (uint32_t)(uintptr_t)&x | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    stealSeed = x;
+
+    int start = (int)(x % nWorkers);
+    for (int i = 0; i < nWorkers; ++i) {
+        int victim = (start + i) % nWorkers;
+        if (victim != threadIndex && workQueues[victim].Steal(range))
+            return true;
+    }
+
+    // Only take another worker's affine ranges once there's nothing else
+    // left to do; that worker is most likely still busy with its own.
+    if (taskAffinity) {
+        for (int i = 0; i < nWorkers; ++i) {
+            int victim = (start + i) % nWorkers;
+            if (victim != threadIndex && mailboxes[victim].Take(range))
+                return true;
+        }
+    }
+    return false;
+}
+
+
+static bool
+lWorkAvailable() {
+    if (!injectedRanges->Empty())
+        return true;
+    for (int i = 0; i < nWorkers; ++i)
+        if (!workQueues[i].Empty() || (taskAffinity && !mailboxes[i].Empty()))
+            return true;
+    return false;
+}
+
+
+/** Runs the given range of tasks.  Ranges of more than one task are split
+    in half repeatedly, with the upper halves going to the calling
+    thread's queue where they're available for other threads to steal,
+    until a single task is left to run here. */
+static void
+lRunTaskRange(TaskRange range, int threadIndex) {
+    if (range.affinity != NULL) {
+        // Whoever starts on an affine part gets it the next time, too.
+        range.affinity->store(threadIndex, std::memory_order_relaxed);
+        range.affinity = NULL;
+    }
+
+    while (range.end - range.begin > 1) {
+        TaskRange upper = range;
+        upper.begin = range.begin + (range.end - range.begin) / 2;
+        range.end = upper.begin;
+        lPushTaskRange(upper, threadIndex);
+    }
 
-            int taskNumber = runtg->waitingTasks.back();
-            runtg->waitingTasks.pop_back();
-            if (runtg->waitingTasks.size() == 0) {
-                // There's left to start running from this group, so remove
-                // it from the active task list.
-                activeTaskGroups.pop_back();
-                runtg->inActiveList = false;
-            }
-            myTask = runtg->GetTaskInfo(taskNumber);
-            DBG(fprintf(stderr, "running task %d from other group %p in sync\n", 
-                        taskNumber, runtg));
+    TaskGroup *tg = range.group;
+    for (int i = range.begin; i < range.end; ++i) {
+        DBG(fprintf(stderr, "running task %d from group %p\n", i, tg));
+        TaskInfo *myTask = tg->GetTaskInfo(i);
+        TraceScope trace(TRACE_TASK, myTask->taskIndex, myTask->taskCount());
+        myTask->func(myTask->data, (threadIndex >= 0) ? threadIndex : nWorkers,
+                     nWorkers + 1, myTask->taskIndex, myTask->taskCount(),
+            myTask->taskIndex0(), myTask->taskIndex1(), myTask->taskIndex2(),
+            myTask->taskCount0(), myTask->taskCount1(), myTask->taskCount2());
+        lFinishTask(myTask);
+    }
+
+    // This must be the last access to the task group, since it may be
+    // reused as soon as this brings its count of unfinished tasks to zero.
+    lMemFence();
+    lAtomicAdd(&tg->numUnfinishedTasks, -(range.end - range.begin));
+    syncWaiters->WakeAll();
+}
+
+
+static void
+lWorkerEntry(int threadIndex) {
+    workerIndex = threadIndex;
+
+    while (1) {
+        TaskRange range;
+        if (lFindWork(&range, threadIndex)) {
+            lRunTaskRange(range, threadIndex);
+            continue;
         }
 
-        if ((err = pthread_mutex_unlock(&taskSysMutex)) != 0) {
-            fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
-            exit(1);
+        // Nothing to do; keep looking for a while before going to sleep.
+        TraceScope trace(TRACE_IDLE);
+        bool found = false;
+        int64_t deadline = lCurrentTimeNs() + spinTimeNs;
+        while (!found && lCurrentTimeNs() < deadline) {
+            lSpinPause();
+            found = lWorkAvailable();
         }
-    
-        //
-        // Do work for _myTask_
-        //
-        // FIXME: bogus values for thread index/thread count here as well..
-        myTask->func(myTask->data, 0, 1, myTask->taskIndex, myTask->taskCount(),
-            myTask->taskIndex0(), myTask->taskIndex1(), myTask->taskIndex2(),
-            myTask->taskCount0(), myTask->taskCount1(), myTask->taskCount2());
+        if (!found)
+            // Check once more after we're counted as waiting, so that
+            // anyone who makes work available will wake us up.
+            idleWorkers->WaitUnless(lWorkAvailable);
+    }
+}
 
-        //
-        // Decrement the number of unfinished tasks counter
-        //
-        lMemFence();
-        lAtomicAdd(&runtg->numUnfinishedTasks, -1);
+
+static void
+InitTaskSystem() {
+    if (initialized.load(std::memory_order_acquire))
+        return;
+
+    std::lock_guard<std::mutex> guard(initMutex);
+    if (initialized.load(std::memory_order_relaxed))
+        return;
+
+    // As with the other task systems, the thread that syncs also runs
+    // tasks, so we start one fewer worker than there are hardware
+    // threads.  hardware_concurrency() may return 0 if it doesn't know.
+    nWorkers = (int)std::thread::hardware_concurrency() - 1;
+    if (nWorkers < 0)
+        nWorkers = 0;
+    lInitSpinTime();
+
+    const char *affinity = getenv("ISPC_TASK_AFFINITY");
+    taskAffinity = (affinity != NULL && atoi(affinity) != 0 && nWorkers > 0);
+
+    injectedRanges = new RangeList;
+    injectedRanges->ranges.reserve(64);
+    idleWorkers = new WaitList;
+    syncWaiters = new WaitList;
+    workQueues = new WorkQueue[nWorkers > 0 ? nWorkers : 1];
+    if (taskAffinity) {
+        mailboxes = new RangeList[nWorkers];
+        launchAffinities = new std::map<LaunchAffinityKey, LaunchAffinity *>;
     }
-    DBG(fprintf(stderr, "sync for %p done!n", tg));
+    for (int i = 0; i < nWorkers; ++i) {
+        // The workers run until the process exits.
+        std::thread worker(lWorkerEntry, i);
+        worker.detach();
+    }
+
+    initialized.store(true, std::memory_order_release);
 }
 
-#endif // ISPC_USE_PTHREADS
+
+/** Returns the affinity record for launches of count tasks of func,
+    creating it the first time around. */
+static LaunchAffinity *
+lGetLaunchAffinity(void *func, int count) {
+    std::lock_guard<std::mutex> guard(launchAffinityMutex);
+    LaunchAffinity *&la = (*launchAffinities)[LaunchAffinityKey(func, count)];
+    if (la == NULL) {
+        la = new LaunchAffinity;
+        // One part for each thread that runs tasks, including the one
+        // that syncs
+        la->numParts = std::min(count, nWorkers + 1);
+        la->workers = new std::atomic<int32_t>[la->numParts];
+        for (int i = 0; i < la->numParts; ++i)
+            la->workers[i].store(-1, std::memory_order_relaxed);
+    }
+    return la;
+}
+
+
+inline void
+TaskGroup::Launch(int baseIndex, int count) {
+    // Account for the tasks before anyone can run (and finish) them.
+    lAtomicAdd(&numUnfinishedTasks, count);
+
+    TaskRange range;
+    range.group = this;
+    range.begin = baseIndex;
+    range.end = baseIndex + count;
+    range.affinity = NULL;
+
+    if (!taskAffinity || count < 2) {
+        lPushTaskRange(range, workerIndex);
+        return;
+    }
+
+    // Split the launch into one contiguous part per thread, like the
+    // first levels of lRunTaskRange() would, and send each part to the
+    // mailbox of the worker that ran it the last time.  Parts that
+    // haven't been run by a worker yet go to the injected ranges, where
+    // whichever thread is free first picks them up.
+    LaunchAffinity *la = lGetLaunchAffinity((void *)GetTaskInfo(baseIndex)->func,
+                                            count);
+    for (int i = 0; i < la->numParts; ++i) {
+        TaskRange part = range;
+        part.begin = baseIndex + (int)((int64_t)count * i / la->numParts);
+        part.end = baseIndex + (int)((int64_t)count * (i + 1) / la->numParts);
+        part.affinity = &la->workers[i];
+        int worker = la->workers[i].load(std::memory_order_relaxed);
+        if (worker >= 0)
+            mailboxes[worker].Add(part);
+        else
+            injectedRanges->Add(part);
+    }
+    idleWorkers->WakeAll();
+    syncWaiters->WakeAll();
+}
+
+
+inline void
+TaskGroup::SyncUntil(volatile int32_t *unfinishedTasks) {
+    DBG(fprintf(stderr, "syncing %p - %d unfinished\n", this, *unfinishedTasks));
+
+    int threadIndex = workerIndex;
+    int64_t spinDeadline = 0;
+    while (*unfinishedTasks > 0) {
+        // Help out with whatever work is available (from this group or
+        // another one) while we wait.
+        TaskRange range;
+        if (lFindWork(&range, threadIndex)) {
+            lRunTaskRange(range, threadIndex);
+            spinDeadline = 0;
+        }
+        else if (spinDeadline == 0)
+            spinDeadline = lCurrentTimeNs() + spinTimeNs;
+        else if (lCurrentTimeNs() < spinDeadline)
+            lSpinPause();
+        else
+            syncWaiters->WaitUnless([unfinishedTasks]() {
+                    return *unfinishedTasks == 0 || lWorkAvailable();
+                });
+    }
+    lMemFence();
+    DBG(fprintf(stderr, "sync for %p done!\n", this));
+}
+
+#endif // ISPC_USE_STDTHREAD
 
 ///////////////////////////////////////////////////////////////////////////
 // Cilk Plus
@@ -962,9 +2968,11 @@ TaskGroup::Launch(int baseIndex, int count) {
 
         // Actually run the task. 
         // Cilk does not expose the task -> thread mapping so we pretend it's 1:1
+        TraceScope trace(TRACE_TASK, ti->taskIndex, ti->taskCount());
         ti->func(ti->data, ti->taskIndex, ti->taskCount(),
             ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
             ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+        lFinishTask(ti);
     }
 }
 
@@ -972,6 +2980,12 @@ inline void
 TaskGroup::Sync() {
 }
 
+inline void
+TaskGroup::SyncLaunch(int launch) {
+    // Launch() doesn't return until all of the tasks have run.
+    (void)launch;
+}
+
 #endif // ISPC_USE_CILK
 
 ///////////////////////////////////////////////////////////////////////////
@@ -997,9 +3011,11 @@ TaskGroup::Launch(int baseIndex, int count) {
         TaskInfo *ti = GetTaskInfo(baseIndex + i);
 
         // Actually run the task. 
+        TraceScope trace(TRACE_TASK, ti->taskIndex, ti->taskCount());
         ti->func(ti->data, threadIndex, threadCount, ti->taskIndex, ti->taskCount(),
             ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
             ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+        lFinishTask(ti);
     }
   }
 }
@@ -1008,22 +3024,253 @@ inline void
 TaskGroup::Sync() {
 }
 
+inline void
+TaskGroup::SyncLaunch(int launch) {
+    // Launch() doesn't return until all of the tasks have run.
+    (void)launch;
+}
+
 #endif // ISPC_USE_OMP
 
+///////////////////////////////////////////////////////////////////////////
+// OpenMP taskloop
+
+#ifdef ISPC_USE_OMP_TASKLOOP
+
+static volatile int32_t taskSystemInitialized = 0;
+static int taskloopGrainSize = 0;
+
+static void
+InitTaskSystem() {
+    if (taskSystemInitialized)
+        return;
+
+    const char *grain = getenv("ISPC_OMP_GRAINSIZE");
+    if (grain != NULL)
+        taskloopGrainSize = std::max(0, atoi(grain));
+    lMemFence();
+    taskSystemInitialized = 1;
+}
+
+
+inline void
+TaskGroup::RunTasks(int baseIndex, int count) {
+    // grainsize() needs a positive value, so there are two versions of
+    // the loop.
+    if (taskloopGrainSize > 0) {
+#pragma omp taskloop grainsize(taskloopGrainSize)
+        for (int i = 0; i < count; i++) {
+            TaskInfo *ti = GetTaskInfo(baseIndex + i);
+            TraceScope trace(TRACE_TASK, ti->taskIndex, ti->taskCount());
+            ti->func(ti->data, omp_get_thread_num(), omp_get_num_threads(),
+                ti->taskIndex, ti->taskCount(),
+                ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
+                ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+            lFinishTask(ti);
+        }
+    }
+    else {
+#pragma omp taskloop
+        for (int i = 0; i < count; i++) {
+            TaskInfo *ti = GetTaskInfo(baseIndex + i);
+            TraceScope trace(TRACE_TASK, ti->taskIndex, ti->taskCount());
+            ti->func(ti->data, omp_get_thread_num(), omp_get_num_threads(),
+                ti->taskIndex, ti->taskCount(),
+                ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
+                ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+            lFinishTask(ti);
+        }
+    }
+}
+
+
+inline void
+TaskGroup::LaunchAfter(int baseIndex, int count, int32_t numDeps,
+                       const int32_t *deps) {
+    if (!omp_in_parallel()) {
+        // Tasks created outside of a parallel region would just run right
+        // away in this thread, so start a region for them.  Since it ends
+        // once they've all run, any launches that these ones depend on
+        // have finished already.
+#pragma omp parallel
+#pragma omp single
+        RunTasks(baseIndex, count);
+        return;
+    }
+
+    // Each launch is an OpenMP task around the taskloop, which finishes
+    // with the taskloop's tasks.  The launches from a task group are all
+    // created by the same task, so they're siblings, and depend clauses
+    // on their LaunchInfo can order them.  An empty task that waits for
+    // each of the dependencies in turn holds this launch back until
+    // they've all finished.
+    // GCC doesn't count the uses in depend clauses as uses of launch and
+    // pred.
+    LaunchInfo *launch = GetTaskInfo(baseIndex)->launch;
+    (void)launch;
+    for (int i = 0; i < numDeps; ++i) {
+        // Only earlier launches can be waited for; handles from before
+        // the last sync have finished by now.
+        if (deps[i] < 0 || deps[i] >= (int)launches.size() - 1)
+            continue;
+        LaunchInfo *pred = launches[deps[i]];
+        (void)pred;
+#pragma omp task depend(in: pred[0]) depend(inout: launch[0])
+        { }
+    }
+
+#pragma omp task depend(inout: launch[0]) firstprivate(baseIndex, count)
+    RunTasks(baseIndex, count);
+}
+
+
+inline void
+TaskGroup::Sync() {
+#pragma omp taskwait
+}
+
+
+inline void
+TaskGroup::SyncLaunch(int launch) {
+#if _OPENMP >= 201811
+    LaunchInfo *li = launches[launch];
+#pragma omp taskwait depend(in: li[0])
+#else
+    // Before OpenMP 5.0, we can only wait for all of the launches.
+    (void)launch;
+#pragma omp taskwait
+#endif
+}
+
+#endif // ISPC_USE_OMP_TASKLOOP
+
 ///////////////////////////////////////////////////////////////////////////
 // Thread Building Blocks
 
+#if defined(ISPC_USE_TBB_PARALLEL_FOR) || defined(ISPC_USE_TBB_TASK_GROUP)
+
+extern "C" {
+    /* Makes subsequent launches run their tasks in the given
+       tbb::task_arena, which the caller keeps ownership of; NULL goes
+       back to running them in the arena of the launching thread. */
+    void ISPCSetTBBArena(void *arena);
+
+    /* Creates an arena with at most maxConcurrency threads (or TBB's
+       default, if it's zero or less), bound to the given NUMA node (or
+       not bound at all, if it's negative), and makes subsequent launches
+       run their tasks in it.  Returns false if this TBB can't bind arenas
+       to NUMA nodes or there's no such node. */
+    bool ISPCCreateTBBArena(int maxConcurrency, int numaNode);
+}
+
+/* Neither of these may be called while tasks are running, so the
+   selected arena doesn't change under a launch and the arena that the
+   task system created itself can be freed when another one is
+   selected. */
+static std::atomic<tbb::task_arena *> tbbArena(NULL);
+static tbb::task_arena *ownedTBBArena = NULL;
+static std::once_flag tbbInitFlag;
 #ifdef ISPC_USE_TBB_PARALLEL_FOR
+static bool taskAffinity = false;
+#endif // ISPC_USE_TBB_PARALLEL_FOR
+
+
+void
+ISPCSetTBBArena(void *arena) {
+    tbbArena.store((tbb::task_arena *)arena);
+    delete ownedTBBArena;
+    ownedTBBArena = NULL;
+}
+
+
+bool
+ISPCCreateTBBArena(int maxConcurrency, int numaNode) {
+    int concurrency = (maxConcurrency > 0) ? maxConcurrency :
+        (int)tbb::task_arena::automatic;
+    tbb::task_arena *arena;
+    if (numaNode < 0)
+        arena = new tbb::task_arena(concurrency);
+    else {
+#if TBB_INTERFACE_VERSION >= 12000 && __TBB_ARENA_BINDING
+        std::vector<tbb::numa_node_id> nodes = tbb::info::numa_nodes();
+        if (std::find(nodes.begin(), nodes.end(), numaNode) == nodes.end())
+            return false;
+        arena = new tbb::task_arena(tbb::task_arena::constraints(numaNode, concurrency));
+#else
+        return false;
+#endif
+    }
+
+    ISPCSetTBBArena(arena);
+    ownedTBBArena = arena;
+    return true;
+}
+
 
 static void
 InitTaskSystem() {
-    // No initialization needed by default
-    //tbb::task_scheduler_init();
+    std::call_once(tbbInitFlag, []() {
+        const char *concurrency = getenv("ISPC_TBB_CONCURRENCY");
+        const char *node = getenv("ISPC_TBB_NUMA_NODE");
+        if ((concurrency != NULL || node != NULL) && tbbArena.load() == NULL) {
+            if (!ISPCCreateTBBArena(concurrency ? atoi(concurrency) : 0,
+                                    node ? atoi(node) : -1))
+                fprintf(stderr, "Warning: can't create a TBB arena on NUMA node %s; "
+                        "using the default arena.\n", node);
+        }
+#ifdef ISPC_USE_TBB_PARALLEL_FOR
+        const char *affinity = getenv("ISPC_TASK_AFFINITY");
+        taskAffinity = (affinity != NULL && atoi(affinity) != 0);
+#endif // ISPC_USE_TBB_PARALLEL_FOR
+    });
+}
+
+
+/** Runs f in the selected arena, or in the calling thread's arena if
+    there isn't one. */
+template <typename F> static inline void
+lRunInArena(tbb::task_arena *arena, const F &f) {
+    if (arena != NULL)
+        arena->execute(f);
+    else
+        f();
+}
+
+#endif // ISPC_USE_TBB_PARALLEL_FOR || ISPC_USE_TBB_TASK_GROUP
+
+#ifdef ISPC_USE_TBB_PARALLEL_FOR
+
+/** The affinity_partitioner for repeated launches of a given task
+    function with a given task count.  An affinity_partitioner can only be
+    used by one parallel_for at a time; concurrent launches of the same
+    tasks fall back to TBB's default partitioner. */
+struct LaunchPartitioner {
+    LaunchPartitioner() : busy(false) { }
+    tbb::affinity_partitioner partitioner;
+    std::atomic<bool> busy;
+};
+typedef std::pair<void *, int> LaunchPartitionerKey;
+static std::mutex launchPartitionerMutex;
+static std::map<LaunchPartitionerKey, LaunchPartitioner *> launchPartitioners;
+
+
+static LaunchPartitioner *
+lAcquireLaunchPartitioner(void *func, int count) {
+    LaunchPartitioner *lp;
+    {
+        std::lock_guard<std::mutex> guard(launchPartitionerMutex);
+        LaunchPartitioner *&entry = launchPartitioners[LaunchPartitionerKey(func, count)];
+        if (entry == NULL)
+            entry = new LaunchPartitioner;
+        lp = entry;
+    }
+    return lp->busy.exchange(true) ? NULL : lp;
 }
 
+
 inline void
 TaskGroup::Launch(int baseIndex, int count) {
-    tbb::parallel_for(0, count, [=](int i) {
+    auto body = [=](int i) {
         TaskInfo *ti = GetTaskInfo(baseIndex + i);
 
         // Actually run the task. 
@@ -1031,45 +3278,77 @@ TaskGroup::Launch(int baseIndex, int count) {
         int threadIndex = ti->taskIndex;
         int threadCount = ti->taskCount();
 
+        TraceScope trace(TRACE_TASK, ti->taskIndex, ti->taskCount());
         ti->func(ti->data, threadIndex, threadCount, ti->taskIndex, ti->taskCount(),
             ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
             ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+        lFinishTask(ti);
+    };
+
+    LaunchPartitioner *lp = NULL;
+    if (taskAffinity && count > 1)
+        lp = lAcquireLaunchPartitioner((void *)GetTaskInfo(baseIndex)->func, count);
+
+    lRunInArena(tbbArena.load(), [&]() {
+        if (lp != NULL)
+            tbb::parallel_for(0, count, body, lp->partitioner);
+        else
+            tbb::parallel_for(0, count, body);
     });
+
+    if (lp != NULL)
+        lp->busy.store(false);
 }
 
 inline void
 TaskGroup::Sync() {
 }
 
+inline void
+TaskGroup::SyncLaunch(int launch) {
+    // Launch() doesn't return until all of the tasks have run.
+    (void)launch;
+}
+
 #endif // ISPC_USE_TBB_PARALLEL_FOR
 
 #ifdef ISPC_USE_TBB_TASK_GROUP
 
-static void
-InitTaskSystem() {
-    // No initialization needed by default
-    //tbb::task_scheduler_init();
-}
-
 inline void
 TaskGroup::Launch(int baseIndex, int count) {
-    for (int i = 0; i < count; i++) {
-        tbbTaskGroup.run([=]() {
-            TaskInfo *ti = GetTaskInfo(baseIndex + i);
-
-            // TBB does not expose the task -> thread mapping so we pretend it's 1:1
-            int threadIndex = ti->taskIndex;
-            int threadCount = ti->taskCount();
-            ti->func(ti->data, threadIndex, threadCount, ti->taskIndex, ti->taskCount(),
-            ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
-            ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
-        });
-    }
+    if (arena == NULL)
+        arena = tbbArena.load();
+
+    lRunInArena(arena, [&]() {
+        for (int i = 0; i < count; i++) {
+            tbbTaskGroup.run([=]() {
+                TaskInfo *ti = GetTaskInfo(baseIndex + i);
+
+                // TBB does not expose the task -> thread mapping so we pretend it's 1:1
+                int threadIndex = ti->taskIndex;
+                int threadCount = ti->taskCount();
+                TraceScope trace(TRACE_TASK, ti->taskIndex, ti->taskCount());
+                ti->func(ti->data, threadIndex, threadCount, ti->taskIndex, ti->taskCount(),
+                ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
+                ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+                lFinishTask(ti);
+            });
+        }
+    });
 }
 
 inline void
 TaskGroup::Sync() {
-    tbbTaskGroup.wait();
+    lRunInArena(arena, [this]() { tbbTaskGroup.wait(); });
+}
+
+inline void
+TaskGroup::SyncLaunch(int launch) {
+    // A task_group can't wait for just some of its tasks, and if there
+    // are no worker threads, its tasks only run in wait(); so this waits
+    // for all of them.
+    (void)launch;
+    Sync();
 }
 
 #endif // ISPC_USE_TBB_TASK_GROUP
@@ -1085,40 +3364,88 @@ InitTaskSystem() {
 
 inline void
 TaskGroup::Launch(int baseIndex, int count) {
+    // Launches that depend on others are started by the tasks that they
+    // were waiting for, so this may be called from any thread.
+    lLock(&futuresLock);
     for (int i = 0; i < count; ++i) {
         TaskInfo *ti = GetTaskInfo(baseIndex + i);
         int threadIndex = i;
         int threadCount = count;
-        futures.push_back(hpx::async(ti->func, ti->data, threadIndex, threadCount, ti->taskIndex, ti->taskCount(),
-            ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
-            ti->taskCount0(), ti->taskCount1(), ti->taskCount2()));
+        futures.push_back(hpx::async([=]() {
+            TraceScope trace(TRACE_TASK, ti->taskIndex, ti->taskCount());
+            ti->func(ti->data, threadIndex, threadCount, ti->taskIndex, ti->taskCount(),
+                ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
+                ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+            lFinishTask(ti);
+        }));
     }
+    lUnlock(&futuresLock);
 }
 
 inline void
 TaskGroup::Sync() {
-    hpx::wait_all(futures);
-    futures.clear();
+    // The tasks we're waiting for may add more futures before they
+    // finish, so keep going until there aren't any new ones.
+    while (1) {
+        std::vector<hpx::future<void>> pending;
+        lLock(&futuresLock);
+        pending.swap(futures);
+        lUnlock(&futuresLock);
+        if (pending.empty())
+            break;
+        hpx::wait_all(pending);
+    }
+}
+
+inline void
+TaskGroup::SyncLaunch(int launch) {
+    while (!LaunchFinished(launch))
+        hpx::this_thread::yield();
+    lMemFence();
 }
 #endif
 ///////////////////////////////////////////////////////////////////////////
 
 #ifndef ISPC_USE_PTHREADS_FULLY_SUBSCRIBED
 
-#define MAX_FREE_TASK_GROUPS 64
-static TaskGroup *freeTaskGroups[MAX_FREE_TASK_GROUPS];
+/* Each thread keeps a small pool of task groups that it has finished
+   with, so that functions that launch tasks over and over again don't go
+   through new and delete each time.  A task group is only ever used by
+   the thread that is running the function that launched its tasks (or,
+   with some task systems, by whichever thread continues running that
+   function after ISPCSync()), so the pool doesn't need any locking.
+ */
+#define MAX_FREE_TASK_GROUPS 16
+
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+  #define ISPC_HAVE_THREAD_LOCAL
+#endif
+
+#ifdef ISPC_HAVE_THREAD_LOCAL
+  // With C++11 thread_local, the pooled task groups are freed when the
+  // thread exits.
+  struct TaskGroupPool {
+      TaskGroup *groups[MAX_FREE_TASK_GROUPS];
+      int count;
+      TaskGroupPool() : count(0) { }
+      ~TaskGroupPool();
+  };
+  static thread_local TaskGroupPool taskGroupPool;
+#else
+  // Otherwise, up to MAX_FREE_TASK_GROUPS task groups are leaked for each
+  // thread that exits after launching tasks.
+  struct TaskGroupPool {
+      TaskGroup *groups[MAX_FREE_TASK_GROUPS];
+      int count;
+  };
+  static ISPC_TLS TaskGroupPool taskGroupPool;
+#endif
+
 
 static inline TaskGroup *
 AllocTaskGroup() {
-    for (int i = 0; i < MAX_FREE_TASK_GROUPS; ++i) {
-        TaskGroup *tg = freeTaskGroups[i];
-        if (tg != NULL) {
-            void *ptr = lAtomicCompareAndSwapPointer((void **)(&freeTaskGroups[i]), NULL, tg);
-            if (ptr != NULL) {
-                return (TaskGroup *)ptr;
-            }
-        }
-    }
+    if (taskGroupPool.count > 0)
+        return taskGroupPool.groups[--taskGroupPool.count];
 
     return new TaskGroup;
 }
@@ -1128,22 +3455,33 @@ static inline void
 FreeTaskGroup(TaskGroup *tg) {
     tg->Reset();
 
-    for (int i = 0; i < MAX_FREE_TASK_GROUPS; ++i) {
-        if (freeTaskGroups[i] == NULL) {
-            void *ptr = lAtomicCompareAndSwapPointer((void **)&freeTaskGroups[i], tg, NULL);
-            if (ptr == NULL)
-                return;
-        }
-    }
+    if (taskGroupPool.count < MAX_FREE_TASK_GROUPS)
+        taskGroupPool.groups[taskGroupPool.count++] = tg;
+    else
+        delete tg;
+}
+
 
-    delete tg;
+#ifdef ISPC_HAVE_THREAD_LOCAL
+TaskGroupPool::~TaskGroupPool() {
+    for (int i = 0; i < count; ++i)
+        delete groups[i];
 }
+#endif
 
 ///////////////////////////////////////////////////////////////////////////
 
 void
 ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count0, int count1, int count2) {
+    ISPCLaunchAfter(taskGroupPtr, func, data, count0, count1, count2, 0, NULL);
+}
+
+
+void
+ISPCLaunchAfter(void **taskGroupPtr, void *func, void *data, int count0, int count1,
+                int count2, int32_t numDeps, const int32_t *deps) {
     const int count = count0*count1*count2;
+    TraceScope trace(TRACE_LAUNCH, count);
     TaskGroup *taskGroup;
     if (*taskGroupPtr == NULL) {
         InitTaskSystem();
@@ -1154,6 +3492,8 @@ ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count0, int count1,
         taskGroup = (TaskGroup *)(*taskGroupPtr);
 
     int baseIndex = taskGroup->AllocTaskInfo(count);
+    LaunchInfo *launch = taskGroup->AddLaunch(baseIndex, count);
+    launch->group = taskGroup;
     for (int i = 0; i < count; ++i) {
         TaskInfo *ti = taskGroup->GetTaskInfo(baseIndex+i);
         ti->func = (TaskFuncType)func;
@@ -1162,8 +3502,22 @@ ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count0, int count1,
         ti->taskCount3d[0] = count0;
         ti->taskCount3d[1] = count1;
         ti->taskCount3d[2] = count2;
+        ti->launch = launch;
     }
-    taskGroup->Launch(baseIndex, count);
+
+#ifdef ISPC_USE_OMP_TASKLOOP
+    // The OpenMP runtime orders the launch after its dependencies.
+    taskGroup->LaunchAfter(baseIndex, count, numDeps, deps);
+#else
+    // Hold off the start of the tasks until all of the dependencies have
+    // been recorded; if any of them are still running, the task that
+    // finishes last starts this launch instead.
+    launch->numPendingDeps = 1;
+    for (int i = 0; i < numDeps; ++i)
+        taskGroup->AddDependency(deps[i], launch);
+    if (lAtomicDecrement(&launch->numPendingDeps) == 0)
+        taskGroup->Launch(baseIndex, count);
+#endif // ISPC_USE_OMP_TASKLOOP
 }
 
 
@@ -1171,12 +3525,23 @@ void
 ISPCSync(void *h) {
     TaskGroup *taskGroup = (TaskGroup *)h;
     if (taskGroup != NULL) {
+        TraceScope trace(TRACE_SYNC);
         taskGroup->Sync();
         FreeTaskGroup(taskGroup);
     }
 }
 
 
+void
+ISPCSyncLaunch(void *h, int32_t launch) {
+    TaskGroup *taskGroup = (TaskGroup *)h;
+    if (taskGroup != NULL && !taskGroup->LaunchFinished(launch)) {
+        TraceScope trace(TRACE_SYNC);
+        taskGroup->SyncLaunch(launch);
+    }
+}
+
+
 void *
 ISPCAlloc(void **taskGroupPtr, int64_t size, int32_t alignment) {
     TaskGroup *taskGroup;
@@ -1191,6 +3556,76 @@ ISPCAlloc(void **taskGroupPtr, int64_t size, int32_t alignment) {
     return taskGroup->AllocMemory(size, alignment);
 }
 
+
+#if defined(ISPC_USE_PTHREADS) || defined(ISPC_USE_PTHREADS_WORK_STEALING)
+
+/* Allocations from ISPCAllocNodeLocal() are preceded by this header,
+   which records the mapping they came from. */
+struct NodeLocalHeader {
+    void *base;
+    size_t length;
+};
+
+void *
+ISPCAllocNodeLocal(int64_t size, int32_t alignment) {
+    InitTaskSystem();
+
+#ifdef ISPC_IS_LINUX
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t align = std::max((size_t)alignment, pageSize);
+    // One extra page for the header, plus enough to align the result.
+    size_t length = (size_t)size + pageSize + (align - pageSize);
+    char *base = (char *)mmap(NULL, length, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == (char *)MAP_FAILED)
+        return NULL;
+    char *ptr = (char *)(((uintptr_t)base + pageSize + align - 1) & ~(uintptr_t)(align - 1));
+
+#ifdef SYS_mbind
+    // None of these pages have been touched yet, so asking for them to
+    // preferably come from the current node places them there no matter
+    // which thread first touches them.
+    if (numNodes > 1) {
+        const int MPOL_PREFERRED_MODE = 1;
+        unsigned long nodeMask[16];
+        memset(nodeMask, 0, sizeof(nodeMask));
+        int node = nodeIds[lCurrentNode()];
+        const int bitsPerLong = 8 * sizeof(unsigned long);
+        if (node < 16 * bitsPerLong) {
+            nodeMask[node / bitsPerLong] |= 1UL << (node % bitsPerLong);
+            syscall(SYS_mbind, ptr, (size_t)size, MPOL_PREFERRED_MODE, nodeMask,
+                    (unsigned long)(16 * bitsPerLong + 1), 0);
+        }
+    }
+#endif // SYS_mbind
+
+    NodeLocalHeader *header = (NodeLocalHeader *)ptr - 1;
+    header->base = base;
+    header->length = length;
+    return ptr;
+#else
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, std::max((size_t)alignment, sizeof(void *)), size) != 0)
+        return NULL;
+    return ptr;
+#endif // ISPC_IS_LINUX
+}
+
+
+void
+ISPCFreeNodeLocal(void *ptr) {
+    if (ptr == NULL)
+        return;
+#ifdef ISPC_IS_LINUX
+    NodeLocalHeader *header = (NodeLocalHeader *)ptr - 1;
+    munmap(header->base, header->length);
+#else
+    free(ptr);
+#endif // ISPC_IS_LINUX
+}
+
+#endif // ISPC_USE_PTHREADS || ISPC_USE_PTHREADS_WORK_STEALING
+
 #else  // ISPC_USE_PTHREADS_FULLY_SUBSCRIBED
 
 #define MAX_LIVE_TASKS 1024
@@ -1364,6 +3799,7 @@ void TaskSys::threadFct()
 
 
 inline void Task::run(int idx, int threadIdx) {
+    TraceScope trace(TRACE_TASK, idx, taskCount);
     (*this->func)(data,threadIdx,TaskSys::global->nThreads,idx,taskCount);
     markOneDone();
 }
@@ -1412,6 +3848,7 @@ int TaskSys::numThreadsRunning = 0;
 
 void ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count) 
 {
+    TraceScope trace(TRACE_LAUNCH, count);
     Task *ti = *(Task**)taskGroupPtr;
     ti->func = (TaskFuncType)func;
     ti->data = data;
@@ -1424,9 +3861,30 @@ void ISPCSync(void *h)
 {
     Task *task = (Task *)h; 
     assert(task);
+    TraceScope trace(TRACE_SYNC);
     TaskSys::global->sync(task);
 }
 
+void ISPCLaunchAfter(void **taskGroupPtr, void *func, void *data, int count0,
+                     int count1, int count2, int32_t numDeps, const int32_t *deps)
+{
+    // There's a single launch for each handle here, so there's nothing
+    // for it to wait for.
+    (void)numDeps;
+    (void)deps;
+    ISPCLaunch(taskGroupPtr, func, data, count0*count1*count2);
+}
+
+void ISPCSyncLaunch(void *h, int32_t launch)
+{
+    // There's a single launch for each handle here; its Task is recycled
+    // by ISPCSync(), so only wait for its jobs to finish.
+    (void)launch;
+    Task *task = (Task *)h;
+    if (task != NULL)
+        task->wait();
+}
+
 void *ISPCAlloc(void **taskGroupPtr, int64_t size, int32_t alignment) 
 {
     TaskSys::init();
@@ -40,8 +40,12 @@
 
 #include <cstdlib>
 #include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
 #include <algorithm>
-#include "../timing.h"
+#include <vector>
+#include "../benchmark.h"
 #include "volume_ispc.h"
 using namespace ispc;
 
@@ -135,6 +139,87 @@ loadVolume(const char *fn, int n[3]) {
 }
 
 
+// Must match volume.ispc
+#define BRICK_SIZE 8
+#define BRICK_VOXELS (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+
+static inline uint32_t spreadBits(uint32_t x) {
+    // 10 bits in, every third bit out
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8))  & 0x0300f00f;
+    x = (x | (x << 4))  & 0x030c30c3;
+    x = (x | (x << 2))  & 0x09249249;
+    return x;
+}
+
+
+/* Copies the densities into bricks of BRICK_SIZE^3 voxels, stored in the
+   Morton order of the bricks, and computes the minimum and maximum
+   density of each brick and the voxels next to it (which are used by the
+   trilinear interpolation close to the brick's boundary) for empty space
+   skipping; see struct Volume in volume.ispc. */
+static void
+makeBrickedVolume(const float density[], int n[3], std::vector<float> &bricks,
+                  std::vector<int> &brickIndex, std::vector<float> &macrocells,
+                  Volume &vol) {
+    int nb[3];
+    for (int i = 0; i < 3; ++i)
+        nb[i] = (n[i] + BRICK_SIZE - 1) / BRICK_SIZE;
+    int nBricks = nb[0] * nb[1] * nb[2];
+
+    std::vector<std::pair<uint32_t, int> > order(nBricks);
+    for (int bz = 0, b = 0; bz < nb[2]; ++bz)
+        for (int by = 0; by < nb[1]; ++by)
+            for (int bx = 0; bx < nb[0]; ++bx, ++b)
+                order[b] = std::make_pair(spreadBits(bx) | (spreadBits(by) << 1) |
+                                          (spreadBits(bz) << 2), b);
+    std::sort(order.begin(), order.end());
+    brickIndex.resize(nBricks);
+    for (int i = 0; i < nBricks; ++i)
+        brickIndex[order[i].second] = i;
+
+    bricks.assign(nBricks * BRICK_VOXELS, 0.f);
+    macrocells.resize(2 * nBricks);
+    for (int bz = 0, b = 0; bz < nb[2]; ++bz)
+        for (int by = 0; by < nb[1]; ++by)
+            for (int bx = 0; bx < nb[0]; ++bx, ++b) {
+                float *brick = &bricks[brickIndex[b] * BRICK_VOXELS];
+                float dMin = 1e30f, dMax = -1e30f;
+                int x0 = bx * BRICK_SIZE, y0 = by * BRICK_SIZE, z0 = bz * BRICK_SIZE;
+                for (int z = z0; z <= std::min(z0 + BRICK_SIZE, n[2] - 1); ++z)
+                    for (int y = y0; y <= std::min(y0 + BRICK_SIZE, n[1] - 1); ++y)
+                        for (int x = x0; x <= std::min(x0 + BRICK_SIZE, n[0] - 1); ++x) {
+                            float d = density[(z * n[1] + y) * n[0] + x];
+                            dMin = std::min(dMin, d);
+                            dMax = std::max(dMax, d);
+                            if (x < x0 + BRICK_SIZE && y < y0 + BRICK_SIZE &&
+                                z < z0 + BRICK_SIZE)
+                                brick[((z - z0) * BRICK_SIZE + (y - y0)) * BRICK_SIZE +
+                                      (x - x0)] = d;
+                        }
+                macrocells[2*b] = dMin;
+                macrocells[2*b+1] = dMax;
+            }
+
+    vol.density = &bricks[0];
+    vol.brickIndex = &brickIndex[0];
+    vol.macrocells = &macrocells[0];
+    for (int i = 0; i < 3; ++i) {
+        vol.nVoxels[i] = n[i];
+        vol.nBricks[i] = nb[i];
+    }
+}
+
+
+static float
+maxDifference(const float a[], const float b[], int count) {
+    float diff = 0;
+    for (int i = 0; i < count; ++i)
+        diff = std::max(diff, fabsf(a[i] - b[i]));
+    return diff;
+}
+
+
 int main(int argc, char *argv[]) {
     static unsigned int test_iterations[] = {3, 7, 1};
     if (argc < 3) {
@@ -162,15 +247,14 @@ int main(int argc, char *argv[]) {
     // Compute the image using the ispc implementation; report the minimum
     // time of three runs.
     //
-    double minISPC = 1e30;
-    for (unsigned int i = 0; i < test_iterations[0]; ++i) {
-        reset_and_start_timer();
+    Benchmark ispcBench("volume ispc 1 core", test_iterations[0]);
+    while (ispcBench.next()) {
+        ispcBench.start();
         volume_ispc(density, n, raster2camera, camera2world,
                     width, height, image);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC run:\t\t\t[%.3f] million cycles\n", dt);
-        minISPC = std::min(minISPC, dt);
+        ispcBench.stop();
     }
+    double minISPC = ispcBench.min();
 
     printf("[volume ispc 1 core]:\t\t[%.3f] million cycles\n", minISPC);
     writePPM(image, width, height, "volume-ispc-1core.ppm");
@@ -183,19 +267,48 @@ int main(int argc, char *argv[]) {
     // Compute the image using the ispc implementation that also uses
     // tasks; report the minimum time of three runs.
     //
-    double minISPCtasks = 1e30;
-    for (unsigned int i = 0; i < test_iterations[1]; ++i) {
-        reset_and_start_timer();
+    Benchmark tasksBench("volume ispc + tasks", test_iterations[1]);
+    while (tasksBench.next()) {
+        tasksBench.start();
         volume_ispc_tasks(density, n, raster2camera, camera2world,
                           width, height, image);
-        double dt = get_elapsed_mcycles();
-        printf("@time of ISPC + TASKS run:\t\t\t[%.3f] million cycles\n", dt);
-        minISPCtasks = std::min(minISPCtasks, dt);
+        tasksBench.stop();
     }
+    double minISPCtasks = tasksBench.min();
 
     printf("[volume ispc + tasks]:\t\t[%.3f] million cycles\n", minISPCtasks);
     writePPM(image, width, height, "volume-ispc-tasks.ppm");
 
+    //
+    // And with the volume stored in bricks, without and with empty space
+    // skipping; the results are compared to the linear layout's.
+    //
+    std::vector<float> bricks, macrocells;
+    std::vector<int> brickIndex;
+    Volume bricked;
+    makeBrickedVolume(density, n, bricks, brickIndex, macrocells, bricked);
+    Volume brickedNoSkipping = bricked;
+    brickedNoSkipping.macrocells = NULL;
+
+    std::vector<float> brickedImage(width * height);
+    for (int m = 0; m < 2; ++m) {
+        Benchmark bench(m == 0 ? "volume ispc + tasks, bricks" :
+                        "volume ispc + tasks, bricks + skipping",
+                        test_iterations[1]);
+        while (bench.next()) {
+            bench.start();
+            volume_ispc_tasks_layout(m == 0 ? &brickedNoSkipping : &bricked,
+                                     raster2camera, camera2world,
+                                     width, height, &brickedImage[0]);
+            bench.stop();
+        }
+        double minTime = bench.min();
+        printf("[volume ispc + tasks, bricks%s]:\t[%.3f] million cycles "
+               "(%.2fx speedup, max difference %g)\n",
+               m == 0 ? "" : " + skipping", minTime, minISPCtasks / minTime,
+               maxDifference(image, &brickedImage[0], width * height));
+    }
+
     // Clear out the buffer
     for (int i = 0; i < width * height; ++i)
         image[i] = 0.;
@@ -204,15 +317,14 @@ int main(int argc, char *argv[]) {
     // And run the serial implementation 3 times, again reporting the
     // minimum time.
     //
-    double minSerial = 1e30;
-    for (unsigned int i = 0; i < test_iterations[2]; ++i) {
-        reset_and_start_timer();
+    Benchmark serialBench("volume serial", test_iterations[2]);
+    while (serialBench.next()) {
+        serialBench.start();
         volume_serial(density, n, raster2camera, camera2world,
                       width, height, image);
-        double dt = get_elapsed_mcycles();
-        printf("@time of serial run:\t\t\t[%.3f] million cycles\n", dt);
-        minSerial = std::min(minSerial, dt);
+        serialBench.stop();
     }
+    double minSerial = serialBench.min();
 
     printf("[volume serial]:\t\t[%.3f] million cycles\n", minSerial);
     writePPM(image, width, height, "volume-serial.ppm");
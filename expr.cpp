@@ -43,6 +43,7 @@
 #include "module.h"
 #include "util.h"
 #include "llvmutil.h"
+#include "func.h"
 #ifndef _MSC_VER
 #include <inttypes.h>
 #endif
@@ -73,6 +74,11 @@
   #include <llvm/IR/LLVMContext.h>
   #include <llvm/IR/CallingConv.h>
 #endif
+#if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
+  #include <llvm/Intrinsics.h>
+#else
+  #include <llvm/IR/Intrinsics.h>
+#endif
 #include <llvm/ExecutionEngine/GenericValue.h>
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
   #include <llvm/IR/InstIterator.h>
@@ -291,9 +297,10 @@ lDoTypeConv(const Type *fromType, const Type *toType, Expr **expr,
         if (toPointerType->GetBaseType()->IsConstType())
             eltType = eltType->GetAsConstType();
 
-        PointerType pt(eltType, toPointerType->GetVariability(),
-                       toPointerType->IsConstType());
-        if (Type::Equal(toPointerType, &pt))
+        const PointerType *pt =
+            PointerType::Get(eltType, toPointerType->GetVariability(),
+                             toPointerType->IsConstType());
+        if (Type::Equal(toPointerType, pt))
             goto typecast_ok;
         else {
             if (!failureOk)
@@ -469,8 +476,8 @@ lDoTypeConv(const Type *fromType, const Type *toType, Expr **expr,
             return false;
         }
         else {
-            ReferenceType rt(fromType);
-            return lDoTypeConv(&rt, toType, NULL, failureOk, errorMsgBase, pos);
+            const ReferenceType *rt = ReferenceType::Get(fromType);
+            return lDoTypeConv(rt, toType, NULL, failureOk, errorMsgBase, pos);
         }
     }
     else if (Type::Equal(toType, fromType->GetAsNonConstType()))
@@ -970,7 +977,8 @@ lMaskForSymbol(Symbol *baseSym, FunctionEmitContext *ctx) {
         return ctx->GetFullMask();
 
     llvm::Value *mask = (baseSym->parentFunction == ctx->GetFunction() &&
-                         baseSym->storageClass != SC_STATIC) ?
+                         baseSym->storageClass != SC_STATIC &&
+                         baseSym->storageClass != SC_TASK_LOCAL) ?
         ctx->GetInternalMask() : ctx->GetFullMask();
     return mask;
 }
@@ -989,6 +997,7 @@ lStoreAssignResult(llvm::Value *value, llvm::Value *ptr, const Type *valueType,
         baseSym != NULL &&
         baseSym->varyingCFDepth == ctx->VaryingCFDepth() &&
         baseSym->storageClass != SC_STATIC &&
+        baseSym->storageClass != SC_TASK_LOCAL &&
         CastType<ReferenceType>(baseSym->type) == NULL &&
         CastType<PointerType>(baseSym->type) == NULL) {
         // If the variable is declared at the same varying control flow
@@ -1605,6 +1614,79 @@ lEmitBinaryArith(BinaryExpr::Op op, llvm::Value *value0, llvm::Value *value1,
 }
 
 
+/** Returns the multiply operand of "a * b + c", "c + a * b", "a * b - c"
+    or "c - a * b", of float or double type, or NULL if the given
+    addition or subtraction isn't of that form.  *mulFirst is set to
+    indicate whether the multiply is the first operand.
+ */
+static const BinaryExpr *
+lFMulAddMultiply(BinaryExpr::Op op, const Expr *arg0, const Expr *arg1,
+                 bool *mulFirst) {
+    if (op != BinaryExpr::Add && op != BinaryExpr::Sub)
+        return NULL;
+
+    const AtomicType *type = CastType<AtomicType>(arg0->GetType());
+    if (type == NULL ||
+        (type->basicType != AtomicType::TYPE_FLOAT &&
+         type->basicType != AtomicType::TYPE_DOUBLE) ||
+        !Type::EqualIgnoringConst(type, arg1->GetType()))
+        return NULL;
+
+    const BinaryExpr *mul = llvm::dyn_cast<BinaryExpr>(arg0);
+    *mulFirst = true;
+    if (mul == NULL || mul->op != BinaryExpr::Mul) {
+        mul = llvm::dyn_cast<BinaryExpr>(arg1);
+        *mulFirst = false;
+    }
+    if (mul == NULL || mul->op != BinaryExpr::Mul ||
+        mul->arg0 == NULL || mul->arg1 == NULL)
+        return NULL;
+    return mul;
+}
+
+
+/** Emits a contractable multiply-add (see lFMulAddMultiply()) as a call to
+    llvm.fmuladd, which LLVM's "standard" floating-point contraction may
+    fuse while leaving separate multiplies and adds alone.
+ */
+static llvm::Value *
+lEmitFMulAdd(BinaryExpr::Op op, const BinaryExpr *mul, bool mulFirst,
+             Expr *addend, FunctionEmitContext *ctx, SourcePos pos) {
+    llvm::Value *c = mulFirst ? NULL : addend->GetValue(ctx);
+    llvm::Value *a = mul->arg0->GetValue(ctx);
+    llvm::Value *b = mul->arg1->GetValue(ctx);
+    if (mulFirst)
+        c = addend->GetValue(ctx);
+    if (a == NULL || b == NULL || c == NULL) {
+        AssertPos(pos, m->errorCount > 0);
+        return NULL;
+    }
+
+    ctx->SetDebugPos(pos);
+    const Type *type = addend->GetType();
+    if (op == BinaryExpr::Sub) {
+        // a * b - c is fmuladd(a, b, -c), and c - a * b is
+        // fmuladd(-a, b, c).
+        llvm::Value *zero = lLLVMConstantValue(type, g->ctx, 0.);
+        if (mulFirst)
+            c = ctx->BinaryOperator(llvm::Instruction::FSub, zero, c,
+                                    LLVMGetName(c, "_negate"));
+        else
+            a = ctx->BinaryOperator(llvm::Instruction::FSub, zero, a,
+                                    LLVMGetName(a, "_negate"));
+    }
+
+    llvm::Function *fmuladd =
+        llvm::Intrinsic::getDeclaration(m->module, llvm::Intrinsic::fmuladd,
+                                        type->LLVMType(g->ctx));
+    std::vector<llvm::Value *> args;
+    args.push_back(a);
+    args.push_back(b);
+    args.push_back(c);
+    return ctx->CallInst(fmuladd, NULL, args, "fmuladd");
+}
+
+
 /** Utility routine to emit a binary comparison operator based on the given
     BinaryExpr::Op.
  */
@@ -2024,6 +2106,16 @@ BinaryExpr::GetValue(FunctionEmitContext *ctx) const {
     if (op == LogicalAnd || op == LogicalOr)
         return lEmitLogicalOp(op, arg0, arg1, ctx, pos);
 
+    // When some code in the module has floating-point contraction turned
+    // off (or it's off globally and this code turns it on), the multiply-
+    // adds that may be fused are marked explicitly.
+    bool mulFirst;
+    const BinaryExpr *mul;
+    if (ctx->GetFPContract() && (g->opt.disableFMA || m->noFPContract) &&
+        (mul = lFMulAddMultiply(op, arg0, arg1, &mulFirst)) != NULL)
+        return lEmitFMulAdd(op, mul, mulFirst, mulFirst ? arg1 : arg0,
+                            ctx, pos);
+
     llvm::Value *value0 = arg0->GetValue(ctx);
     llvm::Value *value1 = arg1->GetValue(ctx);
     if (value0 == NULL || value1 == NULL) {
@@ -2087,10 +2179,12 @@ BinaryExpr::GetType() const {
     if (op == Comma)
         return arg1->GetType();
 
-    if (CastType<PointerType>(type0) != NULL) {
+    if (const PointerType *pt0 = CastType<PointerType>(type0)) {
+        // The result of pointer arithmetic isn't known to have the
+        // alignment that may have been declared for the original pointer.
         if (op == Add)
             // ptr + int -> ptr
-            return type0;
+            return pt0->GetAsAlignedType(0);
         else if (op == Sub) {
             if (CastType<PointerType>(type1) != NULL) {
                 // ptr - ptr -> ~ptrdiff_t
@@ -2103,7 +2197,7 @@ BinaryExpr::GetType() const {
             }
             else
                 // ptr - int -> ptr
-                return type0;
+                return pt0->GetAsAlignedType(0);
         }
 
         // otherwise fall through for these...
@@ -2359,7 +2453,7 @@ BinaryExpr::Optimize() {
     ConstExpr *constArg0 = llvm::dyn_cast<ConstExpr>(arg0);
     ConstExpr *constArg1 = llvm::dyn_cast<ConstExpr>(arg1);
 
-    if (g->opt.fastMath) {
+    if (g->opt.fastMathRcpApprox) {
         // optimizations related to division by floats..
 
         // transform x / const -> x * (1/const)
@@ -2380,16 +2474,19 @@ BinaryExpr::Optimize() {
             }
         }
 
-        // transform x / y -> x * rcp(y)
+        // transform x / y -> x * rcp(y), or x * rcp_fast(y) if the raw
+        // estimate was asked for
         if (op == Div) {
             const Type *type1 = arg1->GetType();
             if (Type::EqualIgnoringConst(type1, AtomicType::UniformFloat) ||
                 Type::EqualIgnoringConst(type1, AtomicType::VaryingFloat)) {
+                const char *rcpName =
+                    (g->opt.fastMathRcpSteps == 0) ? "rcp_fast" : "rcp";
                 // Get the symbol for the appropriate builtin
                 std::vector<Symbol *> rcpFuns;
-                m->symbolTable->LookupFunction("rcp", &rcpFuns);
+                m->symbolTable->LookupFunction(rcpName, &rcpFuns);
                 if (rcpFuns.size() > 0) {
-                    Expr *rcpSymExpr = new FunctionSymbolExpr("rcp", rcpFuns, pos);
+                    Expr *rcpSymExpr = new FunctionSymbolExpr(rcpName, rcpFuns, pos);
                     ExprList *args = new ExprList(arg1, arg1->pos);
                     Expr *rcpCall = new FunctionCallExpr(rcpSymExpr, args,
                                                          arg1->pos);
@@ -2407,8 +2504,8 @@ BinaryExpr::Optimize() {
                     return ::Optimize(ret);
                 }
                 else
-                    Warning(pos, "rcp() not found from stdlib.  Can't apply "
-                            "fast-math rcp optimization.");
+                    Warning(pos, "%s() not found from stdlib.  Can't apply "
+                            "fast-math rcp optimization.", rcpName);
             }
         }
     }
@@ -3553,10 +3650,11 @@ SelectExpr::Print() const {
 // FunctionCallExpr
 
 FunctionCallExpr::FunctionCallExpr(Expr *f, ExprList *a, SourcePos p,
-                                   bool il, Expr *lce[3])
+                                   bool il, Expr *lce[3], ExprList *la)
     : Expr(p, FunctionCallExprID), isLaunch(il) {
     func = f;
     args = a;
+    launchAfter = la;
     if (lce != NULL)
     {
       launchCountExpr[0] = lce[0];
@@ -3688,8 +3786,37 @@ FunctionCallExpr::GetValue(FunctionEmitContext *ctx) const {
           launchCountExpr[1]->GetValue(ctx),
           launchCountExpr[2]->GetValue(ctx) };
 
+        // Small launches of tasks defined in this file may be run
+        // serially, if their cost can be estimated.
+        int serialTaskCost = -1;
+        FunctionSymbolExpr *fse = llvm::dyn_cast<FunctionSymbolExpr>(func);
+        if (fse != NULL && fse->GetMatchingFunction() != NULL) {
+            const Function *taskFunc =
+                m->GetFunctionDefinition(fse->GetMatchingFunction());
+            if (taskFunc != NULL)
+                serialTaskCost = taskFunc->GetSerialTaskCost();
+        }
+
+        // Launches that depend on earlier ones are always handed to the
+        // task system, which starts them once their predecessors finish.
+        std::vector<llvm::Value *> afterVals;
+        if (launchAfter != NULL) {
+            for (unsigned int i = 0; i < launchAfter->exprs.size(); ++i) {
+                if (launchAfter->exprs[i] == NULL)
+                    return NULL;
+                llvm::Value *h = launchAfter->exprs[i]->GetValue(ctx);
+                if (h == NULL)
+                    return NULL;
+                afterVals.push_back(h);
+            }
+            serialTaskCost = -1;
+        }
+
         if (launchCount[0] != NULL)
-            ctx->LaunchInst(callee, argVals, launchCount);
+            retVal = ctx->LaunchInst(callee, argVals, launchCount,
+                                     serialTaskCost,
+                                     afterVals.size() > 0 ? &afterVals : NULL);
+        return retVal;
     }
     else
         retVal = ctx->CallInst(callee, ft, argVals,
@@ -3745,6 +3872,9 @@ FunctionCallExpr::GetType() const {
         }
     }
     const FunctionType *ftype = lGetFunctionType(func);
+    if (ftype != NULL && ftype->isTask && isLaunch)
+        // The value of a launch is its launch_handle.
+        return AtomicType::UniformInt32;
     return ftype ? ftype->GetReturnType() : NULL;
 }
 
@@ -3807,6 +3937,15 @@ FunctionCallExpr::TypeCheck() {
             return NULL;
         }
 
+        if (ft->gangWidth > 0 &&
+            ft->gangWidth != g->target->getVectorWidth()) {
+            Error(pos, "Can't call function compiled with __declspec(width%d) "
+                  "from code with a gang size of %d.  Call it from the "
+                  "application through an \"export\" function instead.",
+                  ft->gangWidth, g->target->getVectorWidth());
+            return NULL;
+        }
+
         if (ft->isTask) {
             if (!isLaunch)
                 Error(pos, "\"launch\" expression needed to call function "
@@ -3822,6 +3961,18 @@ FunctionCallExpr::TypeCheck() {
               if (launchCountExpr[k] == NULL)
                 return NULL;
             }
+            if (launchAfter != NULL) {
+                for (unsigned int i = 0; i < launchAfter->exprs.size(); ++i) {
+                    if (launchAfter->exprs[i] == NULL)
+                        return NULL;
+                    launchAfter->exprs[i] =
+                        TypeConvertExpr(launchAfter->exprs[i],
+                                        AtomicType::UniformInt32,
+                                        "\"after\" launch handle");
+                    if (launchAfter->exprs[i] == NULL)
+                        return NULL;
+                }
+            }
         }
         else {
             if (isLaunch) {
@@ -4071,23 +4222,10 @@ ExprList::GetConstant(const Type *type) const {
                 llvm::dyn_cast<llvm::VectorType>(lt);
             AssertPos(pos, lvt != NULL);
 
-            // Uniform short vectors are stored as vectors of length
-            // rounded up to the native vector width.  So we add additional
+            // Uniform short vectors may be stored as longer vectors (see
+            // VectorType::getVectorMemoryCount()).  So we add additional
             // undef values here until we get the right size.
-            int vectorWidth = g->target->getNativeVectorWidth();
-            const VectorType *vt = CastType<VectorType>(type);
-            const AtomicType *bt = vt->GetElementType();
-
-            if (Type::Equal(bt->GetAsUniformType(), AtomicType::UniformInt64) ||
-                Type::Equal(bt->GetAsUniformType(), AtomicType::UniformUInt64) ||
-                Type::Equal(bt->GetAsUniformType(), AtomicType::UniformDouble)) {
-                // target.nativeVectorWidth should be in terms of 32-bit
-                // values, so for the 64-bit guys, it takes half as many of
-                // them to fill the native width
-                vectorWidth /= 2;
-            }
-
-            while ((cv.size() % vectorWidth) != 0) {
+            while (cv.size() < lvt->getNumElements()) {
                 cv.push_back(llvm::UndefValue::get(lvt->getElementType()));
             }
 
@@ -5004,7 +5142,7 @@ VectorMemberExpr::GetLValueType() const {
         // but a pointer to a float, etc.
         const Type *elementType = vt->GetElementType();
         if (CastType<ReferenceType>(exprLValueType) != NULL)
-            lvalueType = new ReferenceType(elementType);
+            lvalueType = ReferenceType::Get(elementType);
         else {
             const PointerType *ptrType = exprLValueType->IsUniformType() ?
                 PointerType::GetUniform(elementType) :
@@ -7152,8 +7290,8 @@ static const Type *
 lDeconstifyType(const Type *t) {
     const PointerType *pt = CastType<PointerType>(t);
     if (pt != NULL)
-        return new PointerType(lDeconstifyType(pt->GetBaseType()),
-                               pt->GetVariability(), false);
+        return PointerType::Get(lDeconstifyType(pt->GetBaseType()),
+                                pt->GetVariability(), false);
     else
         return t->GetAsNonConstType();
 }
@@ -7460,7 +7598,7 @@ ReferenceExpr::GetType() const {
     if (!type)
         return NULL;
 
-    return new ReferenceType(type);
+    return ReferenceType::Get(type);
 }
 
 
@@ -8477,8 +8615,17 @@ SyncExpr::GetType() const {
 
 llvm::Value *
 SyncExpr::GetValue(FunctionEmitContext *ctx) const {
+    llvm::Value *handleValue = NULL;
+    if (handle != NULL) {
+        handleValue = handle->GetValue(ctx);
+        if (handleValue == NULL) {
+            AssertPos(pos, m->errorCount > 0);
+            return NULL;
+        }
+    }
+
     ctx->SetDebugPos(pos);
-    ctx->SyncInst();
+    ctx->SyncInst(handleValue);
     return NULL;
 }
 
@@ -8492,12 +8639,22 @@ SyncExpr::EstimateCost() const {
 void
 SyncExpr::Print() const {
     printf("sync");
+    if (handle != NULL) {
+        printf(" ");
+        handle->Print();
+    }
     pos.Print();
 }
 
 
 Expr *
 SyncExpr::TypeCheck() {
+    if (handle != NULL) {
+        handle = TypeConvertExpr(handle, AtomicType::UniformInt32,
+                                 "\"sync\" launch handle");
+        if (handle == NULL)
+            return NULL;
+    }
     return this;
 }
 
@@ -277,7 +277,8 @@ class FunctionCallExpr : public Expr {
 public:
     FunctionCallExpr(Expr *func, ExprList *args, SourcePos p,
                      bool isLaunch = false, 
-                     Expr *launchCountExpr[3] = NULL);
+                     Expr *launchCountExpr[3] = NULL,
+                     ExprList *launchAfter = NULL);
 
     static inline bool classof(FunctionCallExpr const*) { return true; }
     static inline bool classof(ASTNode const* N) {
@@ -298,6 +299,10 @@ public:
     ExprList *args;
     bool isLaunch;
     Expr *launchCountExpr[3];
+    /** For a launch, the handles of the earlier launches given with
+        "after(...)" that must finish before this one's tasks start;
+        NULL otherwise. */
+    ExprList *launchAfter;
 };
 
 
@@ -756,7 +761,10 @@ private:
     proceeding). */
 class SyncExpr : public Expr {
 public:
-    SyncExpr(SourcePos p) : Expr(p, SyncExprID) { }
+    /** If \c handle is non-NULL, the sync only waits for the tasks of the
+        launch that it gives the launch_handle of. */
+    SyncExpr(SourcePos p, Expr *handle = NULL)
+        : Expr(p, SyncExprID), handle(handle) { }
 
     static inline bool classof(SyncExpr const*) { return true; }
     static inline bool classof(ASTNode const* N) {
@@ -769,6 +777,8 @@ public:
     Expr *Optimize();
     void Print() const;
     int EstimateCost() const;
+
+    Expr *handle;
 };
 
 
@@ -45,6 +45,8 @@
 #include "sym.h"
 #include "util.h"
 #include <stdio.h>
+#include <math.h>
+#include <algorithm>
 
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_2 // 3.2
 #ifdef ISPC_NVPTX_ENABLED
@@ -78,6 +80,7 @@
 #include <llvm/Support/FileUtilities.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
+#include <llvm/ADT/Triple.h>
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
     #include <llvm/IR/Verifier.h>
     #include <llvm/IR/IRPrintingPasses.h>
@@ -97,6 +100,7 @@ Function::Function(Symbol *s, Stmt *c) {
     Assert(maskSymbol != NULL);
 
     if (code != NULL) {
+        TimeReportScope timer("type checking", sym->name);
         code = TypeCheck(code);
 
         if (code != NULL && g->debugPrint) {
@@ -107,7 +111,14 @@ Function::Function(Symbol *s, Stmt *c) {
         }
 
         if (code != NULL) {
+            // __declspec(fastmath) turns on the fast-math expression
+            // transformations for this function's body only.
+            const FunctionType *ft = CastType<FunctionType>(sym->type);
+            bool savedRcpApprox = g->opt.fastMathRcpApprox;
+            if (ft != NULL && ft->isFastMath)
+                g->opt.fastMathRcpApprox = true;
             code = Optimize(code);
+            g->opt.fastMathRcpApprox = savedRcpApprox;
             if (g->debugPrint) {
                 printf("After optimizing function \"%s\":\n",
                         sym->name.c_str());
@@ -192,6 +203,37 @@ Function::GetType() const {
 }
 
 
+/** If the given parameter is a uniform pointer declared with the
+    "aligned" qualifier, tell LLVM about its alignment with an
+    llvm.assume() call, which is preserved when the function is inlined
+    and is picked up by the alignment-from-assumptions pass.
+ */
+static void
+lEmitAlignmentAssumption(FunctionEmitContext *ctx, const Symbol *sym,
+                         llvm::Value *value) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+    const PointerType *pt = CastType<PointerType>(sym->type);
+    if (pt == NULL || pt->GetAlignment() == 0 || pt->IsUniformType() == false ||
+        pt->IsSlice())
+        return;
+
+    llvm::Value *ptrInt = ctx->PtrToIntInst(value, LLVMGetName(value, "_int"));
+    llvm::Value *misalign =
+        ctx->BinaryOperator(llvm::Instruction::And, ptrInt,
+                            llvm::ConstantInt::get(ptrInt->getType(),
+                                                   pt->GetAlignment() - 1),
+                            LLVMGetName(value, "_misalign"));
+    llvm::Value *isAligned =
+        ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ, misalign,
+                     llvm::ConstantInt::get(ptrInt->getType(), 0),
+                     LLVMGetName(value, "_is_aligned"));
+    llvm::Function *assumeFunc =
+        llvm::Intrinsic::getDeclaration(m->module, llvm::Intrinsic::assume);
+    ctx->CallInst(assumeFunc, NULL, isAligned);
+#endif
+}
+
+
 /** Parameters for tasks are stored in a big structure; this utility
     function emits code to copy those values out of the task structure into
     local stack-allocated variables.  (Which we expect that LLVM's
@@ -228,6 +270,7 @@ lCopyInTaskParameter(int i, llvm::Value *structArgPtr, const
     // memory
     llvm::Value *ptrval = ctx->LoadInst(ptr, sym->name.c_str());
     ctx->StoreInst(ptrval, sym->storagePtr);
+    lEmitAlignmentAssumption(ctx, sym, ptrval);
     ctx->EmitFunctionParameterDebugInfo(sym, i);
 }
 
@@ -251,6 +294,8 @@ Function::emitCode(FunctionEmitContext *ctx, llvm::Function *function,
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_7 // LLVM 3.7+
     if (g->NoOmitFramePointer)
         function->addFnAttr("no-frame-pointer-elim", "true");
+    if (CastType<FunctionType>(sym->type)->isFastMath)
+        function->addFnAttr("unsafe-fp-math", "true");
 #endif
 
 #if 0
@@ -348,14 +393,23 @@ Function::emitCode(FunctionEmitContext *ctx, llvm::Function *function,
 
             argIter->setName(sym->name.c_str());
 
-            // Allocate stack storage for the parameter and emit code
-            // to store the its value there.
-            sym->storagePtr = ctx->AllocaInst(argIter->getType(), sym->name.c_str());
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_7 /* 3.2, 3.3, 3.4, 3.5, 3.6, 3.7 */
-            ctx->StoreInst(argIter, sym->storagePtr);
+            llvm::Value *argValue = argIter;
 #else /* LLVM 3.8+ */
-            ctx->StoreInst(&*argIter, sym->storagePtr);
+            llvm::Value *argValue = &*argIter;
 #endif
+            // Varying bools passed through the native vector ABI arrive
+            // as an integer bitmask; turn them back into an i1 vector.
+            if (type->isVectorABI && argValue->getType()->isIntegerTy() &&
+                sym->type->IsVaryingType() && sym->type->IsBoolType())
+                argValue = ctx->BitCastInst(argValue, LLVMTypes::BoolVectorType,
+                                            sym->name.c_str());
+
+            // Allocate stack storage for the parameter and emit code
+            // to store the its value there.
+            sym->storagePtr = ctx->AllocaInst(argValue->getType(), sym->name.c_str());
+            ctx->StoreInst(argValue, sym->storagePtr);
+            lEmitAlignmentAssumption(ctx, sym, argValue);
             ctx->EmitFunctionParameterDebugInfo(sym, i);
         }
 
@@ -406,6 +460,7 @@ Function::emitCode(FunctionEmitContext *ctx, llvm::Function *function,
     // Finally, we can generate code for the function
     if (code != NULL) {
         ctx->SetDebugPos(code->pos);
+        ctx->RegisterOccupancyCounters();
         ctx->AddInstrumentationPoint("function entry");
 
         int costEstimate = EstimateCost(code);
@@ -504,6 +559,505 @@ Function::emitCode(FunctionEmitContext *ctx, llvm::Function *function,
 }
 
 
+bool
+Function::IsStdlibFunction() const {
+    if (sym == NULL || sym->function == NULL)
+        return false;
+    return (strcmp(sym->pos.name, "stdlib.ispc") == 0 &&
+            sym->function->hasLocalLinkage());
+}
+
+
+bool
+Function::IsReferenced() const {
+    return (sym != NULL && sym->function != NULL &&
+            sym->function->use_empty() == false);
+}
+
+
+void
+Function::EraseDeclaration() {
+    Assert(sym != NULL && sym->function != NULL &&
+           sym->function->use_empty());
+    sym->function->eraseFromParent();
+    sym->function = NULL;
+}
+
+
+const Symbol *
+Function::GetSymbol() const {
+    return sym;
+}
+
+
+Stmt *
+Function::GetCode() const {
+    return code;
+}
+
+
+struct SerialTaskInfo {
+    const Function *func;
+    Symbol *threadIndexSym, *threadCountSym;
+    bool usesThreadIndex, hasLoop;
+};
+
+
+static bool
+lCheckSerialTask(ASTNode *node, void *d) {
+    SerialTaskInfo *info = (SerialTaskInfo *)d;
+    if (SymbolExpr *se = llvm::dyn_cast<SymbolExpr>(node)) {
+        if (se->GetBaseSymbol() == info->threadIndexSym ||
+            se->GetBaseSymbol() == info->threadCountSym)
+            info->usesThreadIndex = true;
+    }
+    else if (llvm::dyn_cast<ForStmt>(node) != NULL ||
+             llvm::dyn_cast<DoStmt>(node) != NULL ||
+             llvm::dyn_cast<ForeachStmt>(node) != NULL ||
+             llvm::dyn_cast<ForeachActiveStmt>(node) != NULL ||
+             llvm::dyn_cast<ForeachUniqueStmt>(node) != NULL ||
+             llvm::dyn_cast<ForeachCompactStmt>(node) != NULL ||
+             llvm::dyn_cast<GotoStmt>(node) != NULL)
+        info->hasLoop = true;
+    return true;
+}
+
+
+int
+Function::GetSerialTaskCost() const {
+    const FunctionType *type = GetType();
+    if (type->isTask == false || code == NULL || threadIndexSym == NULL)
+        return -1;
+
+    SerialTaskInfo info;
+    info.func = this;
+    info.threadIndexSym = threadIndexSym;
+    info.threadCountSym = threadCountSym;
+    info.usesThreadIndex = info.hasLoop = false;
+    WalkAST(code, lCheckSerialTask, NULL, &info);
+    if (info.usesThreadIndex)
+        return -1;
+    if (type->costOverride > -1)
+        return type->costOverride;
+    return info.hasLoop ? -1 : EstimateCost(code);
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// Compile-time evaluation
+
+/** Maximum number of statements executed and function calls made,
+    together, and maximum depth of nested calls that compile-time
+    evaluation of a single function call may reach before giving up. */
+#define EVAL_MAX_STEPS (1 << 20)
+#define EVAL_MAX_DEPTH 64
+
+/** The values of the local variables of a function being evaluated by
+    Function::Evaluate() along with its return value, once set. */
+struct EvalState {
+    EvalState() : returnValue(NULL) { }
+
+    std::map<const Symbol *, ConstExpr *> values;
+    ConstExpr *returnValue;
+};
+
+enum EvalResult {
+    EVAL_NORMAL, EVAL_BREAK, EVAL_CONTINUE, EVAL_RETURN, EVAL_FAIL
+};
+
+static int evalSteps, evalDepth;
+
+static ConstExpr *lEvalExpr(Expr *expr, EvalState &state);
+
+
+/** Types that ConstExpr can represent and that the evaluator thus handles:
+    uniform atomic and enum types. */
+static bool
+lIsEvaluableType(const Type *type) {
+    return (type != NULL && type->IsUniformType() &&
+            (CastType<AtomicType>(type) != NULL ||
+             CastType<EnumType>(type) != NULL) &&
+            !type->IsVoidType());
+}
+
+
+/** Type checks and optimizes the given expression, whose operands are all
+    ConstExprs, which folds it to a ConstExpr if possible. */
+static ConstExpr *
+lFold(Expr *expr) {
+    expr = ::TypeCheck(expr);
+    if (expr == NULL)
+        return NULL;
+    expr = ::Optimize(expr);
+    return (expr != NULL) ? llvm::dyn_cast<ConstExpr>(expr) : NULL;
+}
+
+
+static ConstExpr *
+lConvert(ConstExpr *value, const Type *type) {
+    if (value == NULL || !lIsEvaluableType(type))
+        return NULL;
+    type = type->GetAsNonConstType();
+    if (Type::Equal(value->GetType()->GetAsNonConstType(), type))
+        return value;
+    return lFold(new TypeCastExpr(type, value, value->pos));
+}
+
+
+static bool
+lGetBool(ConstExpr *value, bool *result) {
+    if (value == NULL || value->Count() != 1)
+        return false;
+    value->GetValues(result);
+    return true;
+}
+
+
+/** Evaluates calls to the standard library's uniform float/double math
+    functions, which are implemented with target builtins that the
+    evaluator can't interpret. */
+static ConstExpr *
+lEvalStdlibCall(const Symbol *func, const std::vector<ConstExpr *> &args,
+                SourcePos pos) {
+    const FunctionType *ftype = CastType<FunctionType>(func->type);
+    const Type *retType = ftype->GetReturnType();
+    bool isFloat = Type::EqualIgnoringConst(retType, AtomicType::UniformFloat);
+    bool isDouble = Type::EqualIgnoringConst(retType, AtomicType::UniformDouble);
+    if ((!isFloat && !isDouble) || args.size() < 1 || args.size() > 2)
+        return NULL;
+
+    double v[2];
+    for (unsigned int i = 0; i < args.size(); ++i) {
+        ConstExpr *arg = lConvert(args[i], retType);
+        if (arg == NULL)
+            return NULL;
+        arg->GetValues(&v[i]);
+    }
+
+    const std::string &name = func->name;
+    double result;
+    if (args.size() == 1) {
+        if (name == "sqrt")        result = sqrt(v[0]);
+        else if (name == "sin")    result = sin(v[0]);
+        else if (name == "cos")    result = cos(v[0]);
+        else if (name == "tan")    result = tan(v[0]);
+        else if (name == "asin")   result = asin(v[0]);
+        else if (name == "acos")   result = acos(v[0]);
+        else if (name == "atan")   result = atan(v[0]);
+        else if (name == "exp")    result = exp(v[0]);
+        else if (name == "log")    result = log(v[0]);
+        else if (name == "floor")  result = floor(v[0]);
+        else if (name == "ceil")   result = ceil(v[0]);
+        else if (name == "round")  result = rint(v[0]);
+        else if (name == "abs")    result = fabs(v[0]);
+        else
+            return NULL;
+    }
+    else {
+        if (name == "pow")         result = pow(v[0], v[1]);
+        else if (name == "atan2")  result = atan2(v[0], v[1]);
+        else if (name == "min")    result = std::min(v[0], v[1]);
+        else if (name == "max")    result = std::max(v[0], v[1]);
+        else
+            return NULL;
+    }
+
+    if (isFloat)
+        return new ConstExpr(retType->GetAsNonConstType(), (float)result, pos);
+    else
+        return new ConstExpr(retType->GetAsNonConstType(), result, pos);
+}
+
+
+static ConstExpr *
+lEvalCall(FunctionCallExpr *call, EvalState &state) {
+    FunctionSymbolExpr *fse = llvm::dyn_cast<FunctionSymbolExpr>(call->func);
+    if (fse == NULL || call->isLaunch || call->args == NULL)
+        return NULL;
+    Symbol *funcSym = fse->GetMatchingFunction();
+    if (funcSym == NULL)
+        return NULL;
+
+    std::vector<ConstExpr *> args;
+    for (unsigned int i = 0; i < call->args->exprs.size(); ++i) {
+        ConstExpr *arg = lEvalExpr(call->args->exprs[i], state);
+        if (arg == NULL)
+            return NULL;
+        args.push_back(arg);
+    }
+
+    const Function *func = m->GetFunctionDefinition(funcSym);
+    return (func != NULL) ? func->Evaluate(args, call->pos) : NULL;
+}
+
+
+/** Returns the local variable that the given lvalue expression refers to,
+    if it is one whose value is known to the evaluator. */
+static const Symbol *
+lEvalLValue(Expr *lvalue, EvalState &state) {
+    SymbolExpr *se = llvm::dyn_cast<SymbolExpr>(lvalue);
+    if (se == NULL)
+        return NULL;
+    const Symbol *sym = se->GetBaseSymbol();
+    return (state.values.find(sym) != state.values.end()) ? sym : NULL;
+}
+
+
+static ConstExpr *
+lEvalExpr(Expr *expr, EvalState &state) {
+    if (expr == NULL)
+        return NULL;
+
+    if (ConstExpr *ce = llvm::dyn_cast<ConstExpr>(expr))
+        return ce->GetType()->IsUniformType() ? ce : NULL;
+    else if (SymbolExpr *se = llvm::dyn_cast<SymbolExpr>(expr)) {
+        const Symbol *sym = se->GetBaseSymbol();
+        std::map<const Symbol *, ConstExpr *>::iterator iter =
+            state.values.find(sym);
+        if (iter != state.values.end())
+            return iter->second;
+        // Global constants can be used as well.
+        if (sym->constValue != NULL && sym->parentFunction == NULL &&
+            sym->constValue->Count() == 1)
+            return sym->constValue;
+        return NULL;
+    }
+    else if (TypeCastExpr *tce = llvm::dyn_cast<TypeCastExpr>(expr)) {
+        ConstExpr *value = lEvalExpr(tce->expr, state);
+        return value ? lConvert(value, tce->GetType()) : NULL;
+    }
+    else if (UnaryExpr *ue = llvm::dyn_cast<UnaryExpr>(expr)) {
+        if (ue->op == UnaryExpr::Negate || ue->op == UnaryExpr::LogicalNot ||
+            ue->op == UnaryExpr::BitNot) {
+            ConstExpr *value = lEvalExpr(ue->expr, state);
+            return value ? lFold(new UnaryExpr(ue->op, value, ue->pos)) : NULL;
+        }
+
+        // Increments and decrements of local variables
+        const Symbol *sym = lEvalLValue(ue->expr, state);
+        if (sym == NULL)
+            return NULL;
+        ConstExpr *oldValue = state.values[sym];
+        ConstExpr *one = lConvert(new ConstExpr(AtomicType::UniformInt32, (int32_t)1,
+                                                ue->pos), oldValue->GetType());
+        if (one == NULL)
+            return NULL;
+        bool isInc = (ue->op == UnaryExpr::PreInc || ue->op == UnaryExpr::PostInc);
+        ConstExpr *newValue =
+            lFold(new BinaryExpr(isInc ? BinaryExpr::Add : BinaryExpr::Sub,
+                                 oldValue, one, ue->pos));
+        newValue = lConvert(newValue, oldValue->GetType());
+        if (newValue == NULL)
+            return NULL;
+        state.values[sym] = newValue;
+        return (ue->op == UnaryExpr::PreInc || ue->op == UnaryExpr::PreDec) ?
+            newValue : oldValue;
+    }
+    else if (BinaryExpr *be = llvm::dyn_cast<BinaryExpr>(expr)) {
+        ConstExpr *arg0 = lEvalExpr(be->arg0, state);
+        if (arg0 == NULL)
+            return NULL;
+        if (be->op == BinaryExpr::LogicalAnd || be->op == BinaryExpr::LogicalOr) {
+            // Short-circuit evaluation
+            bool v0, v1;
+            if (!lGetBool(arg0, &v0))
+                return NULL;
+            if (v0 == (be->op == BinaryExpr::LogicalOr))
+                return new ConstExpr(AtomicType::UniformBool, v0, be->pos);
+            if (!lGetBool(lEvalExpr(be->arg1, state), &v1))
+                return NULL;
+            return new ConstExpr(AtomicType::UniformBool, v1, be->pos);
+        }
+        ConstExpr *arg1 = lEvalExpr(be->arg1, state);
+        if (arg1 == NULL)
+            return NULL;
+        if (be->op == BinaryExpr::Comma)
+            return arg1;
+        return lFold(new BinaryExpr(be->op, arg0, arg1, be->pos));
+    }
+    else if (AssignExpr *ae = llvm::dyn_cast<AssignExpr>(expr)) {
+        const Symbol *sym = lEvalLValue(ae->lvalue, state);
+        ConstExpr *value = lEvalExpr(ae->rvalue, state);
+        if (sym == NULL || value == NULL)
+            return NULL;
+        if (ae->op != AssignExpr::Assign) {
+            BinaryExpr::Op op;
+            switch (ae->op) {
+            case AssignExpr::MulAssign: op = BinaryExpr::Mul;    break;
+            case AssignExpr::DivAssign: op = BinaryExpr::Div;    break;
+            case AssignExpr::ModAssign: op = BinaryExpr::Mod;    break;
+            case AssignExpr::AddAssign: op = BinaryExpr::Add;    break;
+            case AssignExpr::SubAssign: op = BinaryExpr::Sub;    break;
+            case AssignExpr::ShlAssign: op = BinaryExpr::Shl;    break;
+            case AssignExpr::ShrAssign: op = BinaryExpr::Shr;    break;
+            case AssignExpr::AndAssign: op = BinaryExpr::BitAnd; break;
+            case AssignExpr::XorAssign: op = BinaryExpr::BitXor; break;
+            case AssignExpr::OrAssign:  op = BinaryExpr::BitOr;  break;
+            default:
+                return NULL;
+            }
+            value = lFold(new BinaryExpr(op, state.values[sym], value, ae->pos));
+        }
+        value = lConvert(value, sym->type);
+        if (value == NULL)
+            return NULL;
+        state.values[sym] = value;
+        return value;
+    }
+    else if (SelectExpr *se = llvm::dyn_cast<SelectExpr>(expr)) {
+        bool test;
+        if (!lGetBool(lEvalExpr(se->test, state), &test))
+            return NULL;
+        ConstExpr *value = lEvalExpr(test ? se->expr1 : se->expr2, state);
+        return value ? lConvert(value, se->GetType()) : NULL;
+    }
+    else if (FunctionCallExpr *fce = llvm::dyn_cast<FunctionCallExpr>(expr))
+        return lEvalCall(fce, state);
+    else
+        return NULL;
+}
+
+
+static EvalResult
+lEvalStmt(Stmt *stmt, EvalState &state) {
+    // Empty statements count too, so that loops with an empty body are
+    // bounded.
+    if (++evalSteps > EVAL_MAX_STEPS)
+        return EVAL_FAIL;
+    if (stmt == NULL)
+        return EVAL_NORMAL;
+
+    if (StmtList *sl = llvm::dyn_cast<StmtList>(stmt)) {
+        for (unsigned int i = 0; i < sl->stmts.size(); ++i) {
+            EvalResult result = lEvalStmt(sl->stmts[i], state);
+            if (result != EVAL_NORMAL)
+                return result;
+        }
+        return EVAL_NORMAL;
+    }
+    else if (ExprStmt *es = llvm::dyn_cast<ExprStmt>(stmt)) {
+        if (es->expr == NULL)
+            return EVAL_NORMAL;
+        return lEvalExpr(es->expr, state) ? EVAL_NORMAL : EVAL_FAIL;
+    }
+    else if (DeclStmt *ds = llvm::dyn_cast<DeclStmt>(stmt)) {
+        for (unsigned int i = 0; i < ds->vars.size(); ++i) {
+            Symbol *sym = ds->vars[i].sym;
+            if (sym == NULL || !lIsEvaluableType(sym->type) ||
+                sym->storageClass == SC_STATIC ||
+                sym->storageClass == SC_TASK_LOCAL)
+                return EVAL_FAIL;
+            ConstExpr *value;
+            if (ds->vars[i].init != NULL)
+                value = lEvalExpr(ds->vars[i].init, state);
+            else
+                value = new ConstExpr(AtomicType::UniformInt32, (int32_t)0,
+                                      ds->pos);
+            value = lConvert(value, sym->type);
+            if (value == NULL)
+                return EVAL_FAIL;
+            state.values[sym] = value;
+        }
+        return EVAL_NORMAL;
+    }
+    else if (IfStmt *is = llvm::dyn_cast<IfStmt>(stmt)) {
+        bool test;
+        if (!lGetBool(lEvalExpr(is->test, state), &test))
+            return EVAL_FAIL;
+        return lEvalStmt(test ? is->trueStmts : is->falseStmts, state);
+    }
+    else if (ForStmt *fs = llvm::dyn_cast<ForStmt>(stmt)) {
+        EvalResult result = lEvalStmt(fs->init, state);
+        if (result != EVAL_NORMAL)
+            return result;
+        while (true) {
+            bool test = true;
+            if (fs->test != NULL && !lGetBool(lEvalExpr(fs->test, state), &test))
+                return EVAL_FAIL;
+            if (!test)
+                return EVAL_NORMAL;
+            result = lEvalStmt(fs->stmts, state);
+            if (result == EVAL_BREAK)
+                return EVAL_NORMAL;
+            if (result == EVAL_RETURN || result == EVAL_FAIL)
+                return result;
+            if (lEvalStmt(fs->step, state) != EVAL_NORMAL)
+                return EVAL_FAIL;
+        }
+    }
+    else if (DoStmt *ds = llvm::dyn_cast<DoStmt>(stmt)) {
+        while (true) {
+            EvalResult result = lEvalStmt(ds->bodyStmts, state);
+            if (result == EVAL_BREAK)
+                return EVAL_NORMAL;
+            if (result == EVAL_RETURN || result == EVAL_FAIL)
+                return result;
+            bool test;
+            if (!lGetBool(lEvalExpr(ds->testExpr, state), &test))
+                return EVAL_FAIL;
+            if (!test)
+                return EVAL_NORMAL;
+        }
+    }
+    else if (llvm::dyn_cast<BreakStmt>(stmt) != NULL)
+        return EVAL_BREAK;
+    else if (llvm::dyn_cast<ContinueStmt>(stmt) != NULL)
+        return EVAL_CONTINUE;
+    else if (ReturnStmt *rs = llvm::dyn_cast<ReturnStmt>(stmt)) {
+        state.returnValue = lEvalExpr(rs->expr, state);
+        return state.returnValue ? EVAL_RETURN : EVAL_FAIL;
+    }
+    else
+        return EVAL_FAIL;
+}
+
+
+ConstExpr *
+Function::Evaluate(const std::vector<ConstExpr *> &argValues,
+                   SourcePos pos) const {
+    const FunctionType *type = GetType();
+    if (code == NULL || type->isTask || type->isExternC ||
+        argValues.size() != args.size() ||
+        !lIsEvaluableType(type->GetReturnType()) ||
+        evalDepth >= EVAL_MAX_DEPTH)
+        return NULL;
+
+    if (sym->pos.name != NULL && !strcmp(sym->pos.name, "stdlib.ispc")) {
+        ConstExpr *value = lEvalStdlibCall(sym, argValues, pos);
+        if (value != NULL)
+            return value;
+    }
+
+    if (evalDepth == 0)
+        evalSteps = 0;
+    if (++evalSteps > EVAL_MAX_STEPS)
+        return NULL;
+
+    EvalState state;
+    for (unsigned int i = 0; i < args.size(); ++i) {
+        ConstExpr *value = lConvert(argValues[i], type->GetParameterType(i));
+        if (value == NULL)
+            return NULL;
+        if (args[i] != NULL)
+            state.values[args[i]] = value;
+    }
+
+    ++evalDepth;
+    EvalResult result = lEvalStmt(code, state);
+    --evalDepth;
+
+    if (evalDepth == 0 && evalSteps > EVAL_MAX_STEPS)
+        Warning(pos, "Compile-time evaluation of \"%s\" was stopped after "
+                "%d statements and function calls.", sym->name.c_str(),
+                EVAL_MAX_STEPS);
+
+    if (result != EVAL_RETURN)
+        return NULL;
+    ConstExpr *value = lConvert(state.returnValue, type->GetReturnType());
+    return value ? new ConstExpr(value, pos) : NULL;
+}
+
+
 void
 Function::GenerateIR() {
     if (sym == NULL)
@@ -544,7 +1098,20 @@ Function::GenerateIR() {
         // the application can call it
         const FunctionType *type = CastType<FunctionType>(sym->type);
         Assert(type != NULL);
-        if (type->isExported) {
+        if (g->perfReportFile != NULL && type->isTask) {
+            Module::PerfReportFunction rf;
+            rf.llvmName = function->getName().str();
+            rf.name = sym->name;
+            rf.kind = "task";
+            rf.pos = sym->pos;
+            m->perfReportFunctions.push_back(rf);
+        }
+        // Targets that are additional gang size variants of an ISA only
+        // export the functions declared for their gang size, unless
+        // --opt=select-width asks for all of the variants to compete.
+        if (type->isExported &&
+            (g->target->isWidthVariant() == false || type->gangWidth > 0 ||
+             g->opt.selectWidth)) {
             if (!type->isTask) {
                 llvm::FunctionType *ftype = type->LLVMFunctionType(g->ctx, true);
                 llvm::GlobalValue::LinkageTypes linkage = llvm::GlobalValue::ExternalLinkage;
@@ -555,7 +1122,8 @@ Function::GenerateIR() {
                         !g->target->getTreatGenericAsSmth().empty())
                         functionName += std::string("_") + g->target->getTreatGenericAsSmth();
                     else
-                        functionName += std::string("_") + g->target->GetISAString();
+                        functionName += std::string("_") + g->target->GetISAString() +
+                            g->target->GetVariantSuffix();
                 }
 #ifdef ISPC_NVPTX_ENABLED
                 if (g->target->getISA() == Target::NVPTX)
@@ -575,6 +1143,13 @@ Function::GenerateIR() {
                 llvm::Function *appFunction =
                     llvm::Function::Create(ftype, linkage, functionName.c_str(), m->module);
                 appFunction->setDoesNotThrow();
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6
+                // MSVC only passes __m128 and friends in registers with
+                // __vectorcall; other x86 ABIs already do so by default.
+                if (type->isVectorABI &&
+                    llvm::Triple(m->module->getTargetTriple()).isOSWindows())
+                    appFunction->setCallingConv(llvm::CallingConv::X86_VectorCall);
+#endif
 
                 // We should iterate from 1 because zero parameter is return.
                 // We should iterate till getNumParams instead of getNumParams+1 because new
@@ -597,6 +1172,14 @@ Function::GenerateIR() {
                     emitCode(&ec, appFunction, firstStmtPos);
                     if (m->errorCount == 0) {
                         sym->exportedFunction = appFunction;
+                        if (g->perfReportFile != NULL) {
+                            Module::PerfReportFunction rf;
+                            rf.llvmName = functionName;
+                            rf.name = sym->name;
+                            rf.kind = "export";
+                            rf.pos = sym->pos;
+                            m->perfReportFunctions.push_back(rf);
+                        }
                     }
 #ifdef ISPC_NVPTX_ENABLED
                     if (g->target->getISA() == Target::NVPTX)
@@ -51,6 +51,47 @@ public:
     /** Generate LLVM IR for the function into the current module. */
     void GenerateIR();
 
+    /** Returns true if this is one of the static functions defined in the
+        standard library; IR for these only needs to be generated if
+        something in the module refers to them. */
+    bool IsStdlibFunction() const;
+
+    /** Returns true if the function's llvm::Function is used anywhere in
+        the module. */
+    bool IsReferenced() const;
+
+    /** Removes the (unused) declaration of the function from the module;
+        this should only be called for functions for which IR generation
+        was skipped. */
+    void EraseDeclaration();
+
+    /** Returns the symbol for the function. */
+    const Symbol *GetSymbol() const;
+
+    /** Returns the function's body. */
+    Stmt *GetCode() const;
+
+    /** For task functions, returns the estimated cost of running one of
+        its tasks, for deciding whether small launches of it should be run
+        serially in the launching thread.  This is the cost given with
+        __declspec(cost<N>), if any, or the estimated cost of the body, if
+        it has no loops.  Returns -1 if the cost isn't known, or if the
+        task uses threadIndex or threadCount, in which case launches must
+        always go through the task system. */
+    int GetSerialTaskCost() const;
+
+    /** Tries to evaluate a call to the function with the given argument
+        values at compile time by interpreting its (type checked and
+        optimized) body.  Only functions with uniform atomic or enum
+        parameter and return types whose bodies compute their result
+        using local uniform scalar variables, arithmetic, control flow,
+        and calls to other such functions can be evaluated; NULL is
+        returned if the function uses anything else (pointers, memory,
+        varying values, output, etc.), which also guarantees that the
+        evaluated functions are free of side effects. */
+    ConstExpr *Evaluate(const std::vector<ConstExpr *> &argValues,
+                        SourcePos pos) const;
+
 private:
     void emitCode(FunctionEmitContext *ctx, llvm::Function *function,
                   SourcePos firstStmtPos);
@@ -91,7 +91,7 @@ Module *m;
 ///////////////////////////////////////////////////////////////////////////
 // Target
 
-#if !defined(ISPC_IS_WINDOWS) && !defined(__arm__)
+#if !defined(ISPC_IS_WINDOWS) && !defined(__arm__) && !defined(__aarch64__)
 static void __cpuid(int info[4], int infoType) {
     __asm__ __volatile__ ("cpuid"
                           : "=a" (info[0]), "=b" (info[1]), "=c" (info[2]), "=d" (info[3])
@@ -108,7 +108,7 @@ static void __cpuidex(int info[4], int level, int count) {
 }
 #endif // !ISPC_IS_WINDOWS && !__ARM__
 
-#if !defined(__arm__)
+#if !defined(__arm__) && !defined(__aarch64__)
 static bool __os_has_avx_support() {
 #if defined(ISPC_IS_WINDOWS)
     // Check if the OS will save the YMM registers
@@ -143,7 +143,7 @@ static bool __os_has_avx512_support() {
 
 static const char *
 lGetSystemISA() {
-#ifdef __arm__
+#if defined(__arm__) || defined(__aarch64__)
     return "neon-i32x4";
 #else
     int info[4];
@@ -262,6 +262,12 @@ typedef enum {
     CPU_Silvermont,
 #endif
 
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_4_0 // LLVM 4.0+
+    // AMD Zen. Supports AVX 2, but its 256-bit operations and gathers are
+    // split into 128-bit micro-ops.
+    CPU_ZNVER1,
+#endif
+
     // FIXME: LLVM supports a ton of different ARM CPU variants--not just
     // cortex-a9 and a15.  We should be able to handle any of them that also
     // have NEON support.
@@ -271,6 +277,10 @@ typedef enum {
 
     // ARM Cortex A9. Supports NEON VFPv3.
     CPU_CortexA9,
+
+    // ARM Cortex A57 and A53. ARMv8 CPUs, which also support AArch64.
+    CPU_CortexA57,
+    CPU_CortexA53,
 #endif
 
 #ifdef ISPC_NVPTX_ENABLED
@@ -345,10 +355,18 @@ public:
          names[CPU_SKX].push_back("skx");
 #endif
 
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_4_0 // LLVM 4.0+
+        names[CPU_ZNVER1].push_back("znver1");
+#endif
+
 #ifdef ISPC_ARM_ENABLED
         names[CPU_CortexA15].push_back("cortex-a15");
 
         names[CPU_CortexA9].push_back("cortex-a9");
+
+        names[CPU_CortexA57].push_back("cortex-a57");
+
+        names[CPU_CortexA53].push_back("cortex-a53");
 #endif
 
 #ifdef ISPC_NVPTX_ENABLED
@@ -378,6 +396,13 @@ public:
                                       CPU_Haswell, CPU_Broadwell, CPU_None);
 #endif
 
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_4_0 // LLVM 4.0+
+        compat[CPU_ZNVER1]      = Set(CPU_ZNVER1, CPU_Generic, CPU_Bonnell, CPU_Penryn,
+                                      CPU_Core2, CPU_Nehalem, CPU_Silvermont,
+                                      CPU_SandyBridge, CPU_IvyBridge,
+                                      CPU_Haswell, CPU_Broadwell, CPU_None);
+#endif
+
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_5 // LLVM 3.2, 3.3, 3.4 or 3.5
         #define CPU_Broadwell CPU_Haswell
 #else /* LLVM 3.6+ */
@@ -413,6 +438,11 @@ public:
         compat[CPU_CortexA15]   = Set(CPU_Generic, CPU_CortexA9, CPU_CortexA15,
                                       CPU_None);
         compat[CPU_CortexA9]    = Set(CPU_Generic, CPU_CortexA9, CPU_None);
+        compat[CPU_CortexA57]   = Set(CPU_Generic, CPU_CortexA9, CPU_CortexA15,
+                                      CPU_CortexA53, CPU_CortexA57,
+                                      CPU_None);
+        compat[CPU_CortexA53]   = Set(CPU_Generic, CPU_CortexA9, CPU_CortexA15,
+                                      CPU_CortexA53, CPU_None);
 #endif
 
 #ifdef ISPC_NVPTX_ENABLED
@@ -489,7 +519,11 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
     m_hasTrigonometry(false),
     m_hasRsqrtd(false),
     m_hasRcpd(false),
-    m_hasVecPrefetch(false)
+    m_hasVecPrefetch(false),
+    m_hasConflictDetection(false),
+    m_sparseGatherThreshold(0),
+    m_isWidthVariant(false),
+    m_isTunedVariant(false)
 {
     CPUtype CPUID = CPU_None, CPUfromISA = CPU_None;
     AllCPUs a;
@@ -528,6 +562,8 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
 #ifdef ISPC_ARM_ENABLED
             case CPU_CortexA9:
             case CPU_CortexA15:
+            case CPU_CortexA57:
+            case CPU_CortexA53:
                 isa = "neon-i32x4";
                 break;
 #endif
@@ -584,8 +620,15 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
 
     if (arch == NULL) {
 #ifdef ISPC_ARM_ENABLED
-        if (!strncmp(isa, "neon", 4))
-            arch = "arm";
+        if (!strncmp(isa, "neon", 4)) {
+#if defined(__aarch64__)
+            arch = "aarch64";
+#else
+            // The ARMv8 CPUs default to their 64-bit AArch64 mode
+            arch = (CPUID == CPU_CortexA57 || CPUID == CPU_CortexA53) ?
+                "aarch64" : "arm";
+#endif
+        }
         else
 #endif
 #ifdef ISPC_NVPTX_ENABLED
@@ -897,6 +940,7 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         this->m_hasHalf = true;
         this->m_hasRand = true;
         this->m_hasGather = true;
+        this->m_sparseGatherThreshold = 2;
         CPUfromISA = CPU_Haswell;
     }
     else if (!strcasecmp(isa, "avx2-x2") ||
@@ -926,6 +970,30 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         this->m_hasGather = true;
         CPUfromISA = CPU_Haswell;
     }
+    else if (!strcasecmp(isa, "avx2-i8x32")) {
+        this->m_isa = Target::AVX2;
+        this->m_nativeVectorWidth = 32;
+        this->m_nativeVectorAlignment = 32;
+        this->m_dataTypeWidth = 8;
+        this->m_vectorWidth = 32;
+        this->m_maskingIsFree = false;
+        this->m_maskBitCount = 8;
+        this->m_hasHalf = true;
+        this->m_hasRand = true;
+        CPUfromISA = CPU_Haswell;
+    }
+    else if (!strcasecmp(isa, "avx2-i16x16")) {
+        this->m_isa = Target::AVX2;
+        this->m_nativeVectorWidth = 16;
+        this->m_nativeVectorAlignment = 32;
+        this->m_dataTypeWidth = 16;
+        this->m_vectorWidth = 16;
+        this->m_maskingIsFree = false;
+        this->m_maskBitCount = 16;
+        this->m_hasHalf = true;
+        this->m_hasRand = true;
+        CPUfromISA = CPU_Haswell;
+    }
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_7 // LLVM 3.7+
     else if (!strcasecmp(isa, "avx512knl-i32x16")) {
         this->m_isa = Target::KNL_AVX512;
@@ -943,6 +1011,8 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         this->m_hasTrigonometry = false;
         this->m_hasRsqrtd = this->m_hasRcpd = false;
         this->m_hasVecPrefetch = false;
+        this->m_hasConflictDetection = true;
+        this->m_sparseGatherThreshold = 3;
         CPUfromISA = CPU_KNL;
     }
 #endif
@@ -963,6 +1033,28 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         this->m_hasTrigonometry = false;
         this->m_hasRsqrtd = this->m_hasRcpd = false;
         this->m_hasVecPrefetch = false;
+        this->m_hasConflictDetection = true;
+        this->m_sparseGatherThreshold = 3;
+        CPUfromISA = CPU_SKX;
+    }
+    else if (!strcasecmp(isa, "avx512skx-i32x8")) {
+        // 256-bit vectors with the AVX-512VL encodings: k-register masks,
+        // scatter, compress/expand and conflict detection, without the
+        // frequency penalty of the 512-bit units.
+        this->m_isa = Target::SKX_AVX512;
+        this->m_nativeVectorWidth = 8;
+        this->m_nativeVectorAlignment = 32;
+        this->m_vectorWidth = 8;
+        this->m_maskingIsFree = true;
+        this->m_maskBitCount = 8;
+        this->m_hasHalf = true;
+        this->m_hasRand = true;
+        this->m_hasGather = this->m_hasScatter = true;
+        this->m_hasTranscendentals = false;
+        this->m_hasTrigonometry = false;
+        this->m_hasRsqrtd = this->m_hasRcpd = false;
+        this->m_hasVecPrefetch = false;
+        this->m_hasConflictDetection = true;
         CPUfromISA = CPU_SKX;
     }
 #endif
@@ -973,7 +1065,7 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         this->m_nativeVectorAlignment = 16;
         this->m_dataTypeWidth = 8;
         this->m_vectorWidth = 16;
-        this->m_attributes = "+neon,+fp16";
+        this->m_attributes = (m_arch == "aarch64") ? "+neon" : "+neon,+fp16";
         this->m_hasHalf = true; // ??
         this->m_maskingIsFree = false;
         this->m_maskBitCount = 8;
@@ -984,7 +1076,7 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         this->m_nativeVectorAlignment = 16;
         this->m_dataTypeWidth = 16;
         this->m_vectorWidth = 8;
-        this->m_attributes = "+neon,+fp16";
+        this->m_attributes = (m_arch == "aarch64") ? "+neon" : "+neon,+fp16";
         this->m_hasHalf = true; // ??
         this->m_maskingIsFree = false;
         this->m_maskBitCount = 16;
@@ -996,7 +1088,18 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         this->m_nativeVectorAlignment = 16;
         this->m_dataTypeWidth = 32;
         this->m_vectorWidth = 4;
-        this->m_attributes = "+neon,+fp16";
+        this->m_attributes = (m_arch == "aarch64") ? "+neon" : "+neon,+fp16";
+        this->m_hasHalf = true; // ??
+        this->m_maskingIsFree = false;
+        this->m_maskBitCount = 32;
+    }
+    else if (!strcasecmp(isa, "neon-i32x8")) {
+        this->m_isa = Target::NEON32;
+        this->m_nativeVectorWidth = 4;
+        this->m_nativeVectorAlignment = 16;
+        this->m_dataTypeWidth = 32;
+        this->m_vectorWidth = 8;
+        this->m_attributes = (m_arch == "aarch64") ? "+neon" : "+neon,+fp16";
         this->m_hasHalf = true; // ??
         this->m_maskingIsFree = false;
         this->m_maskBitCount = 32;
@@ -1024,9 +1127,9 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         error = true;
     }
 
-#if defined(ISPC_ARM_ENABLED) && !defined(__arm__)
+#if defined(ISPC_ARM_ENABLED) && !defined(__arm__) && !defined(__aarch64__)
     if ((CPUID == CPU_None) && !strncmp(isa, "neon", 4))
-        CPUID = CPU_CortexA9;
+        CPUID = (m_arch == "aarch64") ? CPU_CortexA57 : CPU_CortexA9;
 #endif
 
     if (CPUID == CPU_None) {
@@ -1059,6 +1162,13 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
     }
     this->m_cpu = cpu;
 
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_4_0 // LLVM 4.0+
+    // Zen's gathers are microcoded and aren't faster than doing the loads
+    // one at a time, so the builtins' scalar path is always used.
+    if (CPUID == CPU_ZNVER1 && m_sparseGatherThreshold > 0)
+        m_sparseGatherThreshold = m_vectorWidth;
+#endif
+
     if (!error) {
         // Create TargetMachine
         std::string triple = GetTripleString();
@@ -1075,8 +1185,8 @@ Target::Target(const char *arch, const char *cpu, const char *isa, bool pic, boo
         std::string featuresString = m_attributes;
         llvm::TargetOptions options;
 #ifdef ISPC_ARM_ENABLED
-        if (m_isa == Target::NEON8 || m_isa == Target::NEON16 ||
-            m_isa == Target::NEON32)
+        if ((m_isa == Target::NEON8 || m_isa == Target::NEON16 ||
+             m_isa == Target::NEON32) && m_arch == "arm")
             options.FloatABIType = llvm::FloatABI::Hard;
 #endif
         if (g->opt.disableFMA == false)
@@ -1192,7 +1302,7 @@ const char *
 Target::SupportedArchs() {
     return
 #ifdef ISPC_ARM_ENABLED
-        "arm, "
+        "arm, aarch64, "
 #endif
         "x86, x86-64";
 }
@@ -1206,17 +1316,17 @@ Target::SupportedTargets() {
         "avx1-i32x4, "
         "avx1-i32x8, avx1-i32x16, avx1-i64x4, "
         "avx1.1-i32x8, avx1.1-i32x16, avx1.1-i64x4, "
-        "avx2-i32x8, avx2-i32x16, avx2-i64x4, "
+        "avx2-i32x8, avx2-i32x16, avx2-i64x4, avx2-i16x16, avx2-i8x32, "
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_7 // LLVM 3.7+
         "avx512knl-i32x16, "
 #endif
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_8 // LLVM 3.8+
-        "avx512skx-i32x16, "
+        "avx512skx-i32x8, avx512skx-i32x16, "
 #endif
         "generic-x1, generic-x4, generic-x8, generic-x16, "
         "generic-x32, generic-x64, *-generic-x16"
 #ifdef ISPC_ARM_ENABLED
-        ", neon-i8x16, neon-i16x8, neon-i32x4"
+        ", neon-i8x16, neon-i16x8, neon-i32x4, neon-i32x8"
 #endif
 #ifdef ISPC_NVPTX_ENABLED
         ", nvptx"
@@ -1233,6 +1343,9 @@ Target::GetTripleString() const {
     if (m_arch == "arm") {
         triple.setTriple("armv7-eabi");
     }
+    else if (m_arch == "aarch64") {
+        triple.setTriple("aarch64-eabi");
+    }
     else
 #endif
     {
@@ -1360,6 +1473,22 @@ Target::GetISATargetString() const {
 }
 
 
+std::string
+Target::GetVariantSuffix() const {
+    if (m_isTunedVariant) {
+        // CPU names like "core-avx2" need to be valid in C identifiers.
+        std::string suffix = std::string("_") + m_cpu;
+        std::replace(suffix.begin(), suffix.end(), '-', '_');
+        return suffix;
+    }
+    if (m_isWidthVariant == false)
+        return "";
+    char buf[16];
+    snprintf(buf, sizeof(buf), "_x%d", m_vectorWidth);
+    return buf;
+}
+
+
 static bool
 lGenericTypeLayoutIndeterminate(llvm::Type *type) {
     if (type->isFloatingPointTy() || type->isX86_MMXTy() || type->isVoidTy() ||
@@ -1488,7 +1617,11 @@ void Target::markFuncWithTargetAttr(llvm::Function* func) {
 
 Opt::Opt() {
     level = 1;
+    sizeLevel = 0;
     fastMath = false;
+    fastMathReassoc = false;
+    fastMathRcpApprox = false;
+    fastMathRcpSteps = 1;
     fastMaskedVload = false;
     force32BitAddressing = true;
     unrollLoops = true;
@@ -1505,6 +1638,20 @@ Opt::Opt() {
     disableGatherScatterFlattening = false;
     disableUniformMemoryOptimizations = false;
     disableCoalescing = false;
+    disableStridedMemoryOps = false;
+    disableGatherToPermute = false;
+    disableFunctionSpecialization = false;
+    disableAllOnClones = false;
+    disableUniformScalarization = false;
+    disableReductionVectorization = false;
+    disableSwitchDispatch = false;
+    disableForeachUnswitching = false;
+    disableVectorDivision = false;
+    prefetchGatherDistance = 0;
+    scratchLocalsThreshold = 0;
+    sparseGatherThreshold = -1;
+    pointersMayAlias = false;
+    selectWidth = false;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -1512,8 +1659,14 @@ Opt::Opt() {
 
 Globals::Globals() {
     mathLib = Globals::Math_ISPC;
+    dispatchMode = Globals::Dispatch_Check;
+    autotuneCalls = 8;
+    fatObject = false;
+    cxxSplitCount = 1;
+    reuseBuiltinBitcode = false;
 
     includeStdlib = true;
+    emitThinLTOSummary = false;
     runCPP = true;
     debugPrint = false;
     printTarget = false;
@@ -1526,7 +1679,10 @@ Globals::Globals() {
     disableLineWrap = false;
     emitPerfWarnings = true;
     emitInstrumentation = false;
+    emitOccupancyProfile = false;
+    emitMemoryTrace = false;
     generateDebuggingSymbols = false;
+    debugLineTablesOnly = false;
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5
     generateDWARFVersion = 0;
 #endif
@@ -1544,6 +1700,11 @@ Globals::Globals() {
 #endif
     forceAlignment = -1;
     dllExport = false;
+    numJobs = 1;
+    timeReport = false;
+    timeReportFile = NULL;
+    perfReportFile = NULL;
+    cacheDir = NULL;
 }
 
 ///////////////////////////////////////////////////////////////////////////
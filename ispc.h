@@ -102,6 +102,7 @@ class ArrayType;
 class AST;
 class ASTNode;
 class AtomicType;
+class ConstExpr;
 class FunctionEmitContext;
 class Expr;
 class ExprList;
@@ -120,7 +121,8 @@ enum StorageClass {
     SC_EXTERN,
     SC_STATIC,
     SC_TYPEDEF,
-    SC_EXTERN_C
+    SC_EXTERN_C,
+    SC_TASK_LOCAL
 };
 
 
@@ -242,6 +244,13 @@ public:
         This may be used for Target initialization. */
     const char *GetISATargetString() const;
 
+    /** Returns a string like "_x16" if this target is an additional gang
+        size variant of an ISA that a multi-target compilation already
+        compiles to, "_znver1" if it's a variant tuned for another CPU, or an
+        empty string otherwise.  It's appended to the ISA name in mangled
+        function names and in the names of output files. */
+    std::string GetVariantSuffix() const;
+
     /** Returns the size of the given type */
     llvm::Value *SizeOf(llvm::Type *type,
                         llvm::BasicBlock *insertAtEnd);
@@ -306,6 +315,18 @@ public:
 
     bool hasVecPrefetch() const {return m_hasVecPrefetch;}
 
+    bool hasConflictDetection() const {return m_hasConflictDetection;}
+
+    int getSparseGatherThreshold() const {return m_sparseGatherThreshold;}
+
+    bool isWidthVariant() const {return m_isWidthVariant;}
+
+    void setWidthVariant(bool v) {m_isWidthVariant = v;}
+
+    bool isTunedVariant() const {return m_isTunedVariant;}
+
+    void setTunedVariant(bool v) {m_isTunedVariant = v;}
+
 private:
 
     /** llvm Target object representing this target. */
@@ -414,6 +435,26 @@ private:
 
     /** Indicates whether the target has hardware instruction for vector prefetch. */
     bool m_hasVecPrefetch;
+
+    /** Indicates whether the target has a hardware instruction to detect
+        lanes holding equal values (AVX-512CD vpconflictd). */
+    bool m_hasConflictDetection;
+
+    /** Gathers (and scatters, where the target has them) with at most this
+        many active lanes are done with scalar loads and stores rather than
+        the hardware instruction; zero if the target never does so. */
+    int m_sparseGatherThreshold;
+
+    /** Indicates whether this target is an additional gang size variant of
+        an ISA in a multi-target compilation; only functions declared with
+        __declspec(width<N>) for its gang size are exported from it. */
+    bool m_isWidthVariant;
+
+    /** Indicates whether this target is an additional variant of an ISA and
+        gang size in a multi-target compilation that's compiled for the CPU
+        given with it (e.g. "avx2:znver1"); the dispatch functions call it
+        on systems with that CPU. */
+    bool m_isTunedVariant;
 };
 
 
@@ -430,10 +471,30 @@ struct Opt {
         optimization as possible. */
     int level;
 
+    /** Code size optimization level: 0 optimizes for speed, 1 (-Os)
+        avoids optimizations that mostly increase code size, and 2 (-Oz)
+        reduces code size further at a greater cost in speed.  Only
+        meaningful when \c level is 1. */
+    int sizeLevel;
+
     /** Indicates whether "fast and loose" numerically unsafe optimizations
         should be performed.  This is false by default. */
     bool fastMath;
 
+    /** The individual parts of fastMath, which --opt=fast-math=<list> can
+        enable selectively: fastMathReassoc allows floating-point
+        reductions to be reassociated into per-program-instance partial
+        sums, and fastMathRcpApprox allows divisions to be replaced with
+        multiplication by an approximate reciprocal.  Both are also enabled
+        while optimizing functions declared with __declspec(fastmath). */
+    bool fastMathReassoc;
+    bool fastMathRcpApprox;
+
+    /** Number of Newton-Raphson steps applied to the approximate
+        reciprocal used by fastMathRcpApprox: 0 uses the raw hardware
+        estimate (rcp_fast()), 1 the target's refined rcp(). */
+    int fastMathRcpSteps;
+
     /** Indicates whether an vector load should be issued for masked loads
         on platforms that don't have a native masked vector load.  (This may
         lead to accessing memory up to programCount-1 elements past the end of
@@ -524,6 +585,77 @@ struct Opt {
     /** Disables optimizations that coalesce incoherent scalar memory
         access from gathers into wider vector operations, when possible. */
     bool disableCoalescing;
+
+    /** Disables turning gathers and scatters with small constant strides
+        between the program instances' elements into vector loads and
+        stores plus shuffles. */
+    bool disableStridedMemoryOps;
+
+    /** Disables turning gathers of 32-bit values from small tables into
+        vector loads of the table and permutes of its elements. */
+    bool disableGatherToPermute;
+
+    /** Disables making copies of functions that are specialized for
+        the compile-time constant uniform arguments that they're called
+        with. */
+    bool disableFunctionSpecialization;
+
+    /** Disables making copies of functions that assume that the mask is
+        all on, for calls made with all of the program instances
+        active. */
+    bool disableAllOnClones;
+
+    /** Disables computing varying values that are provably the same for
+        all of the program instances with scalar instructions. */
+    bool disableUniformScalarization;
+
+    /** Disables replacing uniform accumulators that are updated with
+        reductions of varying values in loops with vector accumulators. */
+    bool disableReductionVectorization;
+
+    /** Disables running only the labels that some program instance's
+        value selects, found through a table lookup, in large "switch"
+        statements with varying conditions. */
+    bool disableSwitchDispatch;
+
+    /** Disables emitting a separate copy of foreach loops for each value
+        of loop-invariant uniform "if" conditions in their bodies. */
+    bool disableForeachUnswitching;
+
+    /** Disables computing varying integer divisions and remainders with
+        vector multiplies (for uniform divisors) or floating-point
+        divides (for varying ones) rather than per-lane divides. */
+    bool disableVectorDivision;
+
+    /** If non-zero, software prefetches are inserted for gathers whose
+        indices are loaded from memory in a loop, this many loop
+        iterations ahead; a negative value selects a distance based on
+        the target's vector width. */
+    int prefetchGatherDistance;
+
+    /** If non-zero, local variables larger than this many bytes are
+        stored in thread-local scratch memory that is reused across calls
+        rather than on the stack, in functions that can't be re-entered
+        while they're running. */
+    int scratchLocalsThreshold;
+
+    /** If non-negative, overrides the target's threshold for doing
+        gathers and scatters with few active lanes with scalar memory
+        operations instead of the hardware gather/scatter instructions;
+        zero disables this. */
+    int sparseGatherThreshold;
+
+    /** By default, uniform pointer and reference parameters are assumed
+        not to alias each other.  When this is true, only pointers that
+        are explicitly declared "noalias" are assumed to be distinct. */
+    bool pointersMayAlias;
+
+    /** When compiling to several variants of a target ISA with different
+        gang sizes (e.g. avx2-i32x8,avx2-i32x16), compile every exported
+        function for all of them and have the dispatch function call the
+        variant that's estimated to be fastest, taking register pressure
+        into account. */
+    bool selectWidth;
 };
 
 /** @brief This structure collects together a number of global variables.
@@ -547,10 +679,48 @@ struct Globals {
     enum MathLib { Math_ISPC, Math_ISPCFast, Math_SVML, Math_System };
     MathLib mathLib;
 
+    /** Ways that the dispatch functions generated for multi-target
+        compilation can choose which target's variant of an exported
+        function to call: by checking the system's ISA on every call, by
+        doing so once on the first call and calling through a cached
+        function pointer after that, or by having the dynamic linker do
+        so when the program is loaded, via an ELF "ifunc", or by timing
+        each variant that can run on the system on the first calls and
+        then calling the fastest one. */
+    enum DispatchMode { Dispatch_Check, Dispatch_Table, Dispatch_IFunc,
+                        Dispatch_Autotune };
+    DispatchMode dispatchMode;
+
+    /** With --dispatch=autotune, the number of calls that each variant of
+        an exported function is timed for before the fastest is chosen. */
+    int autotuneCalls;
+
+    /** When compiling for multiple targets, indicates that the code for
+        all of the targets and the dispatch functions should be emitted to
+        a single output file, with the data and the code that are the same
+        for all of the targets only emitted once. */
+    bool fatObject;
+
+    /** With --emit-c++, the number of translation units that the emitted
+        function definitions are distributed across; the types, global
+        declarations and prototypes are written to a header that all of
+        them include.  (Default is 1, a single file.) */
+    int cxxSplitCount;
+
+    /** Indicates that several source files are being compiled in one run,
+        so that the target's builtins bitcode is only parsed once and
+        copies of it are linked into each file's module. */
+    bool reuseBuiltinBitcode;
+
     /** Records whether the ispc standard library should be made available
         to the program during compilations. (Default is true.) */
     bool includeStdlib;
 
+    /** When \c true, bitcode output includes a ThinLTO module summary, so
+        that exported functions can be imported into and inlined in C/C++
+        code when linking with "clang -flto=thin". */
+    bool emitThinLTOSummary;
+
     /** Indicates whether the C pre-processor should be run over the
         program source before compiling it.  (Default is true.) */
     bool runCPP;
@@ -602,10 +772,29 @@ struct Globals {
         manual.) */
     bool emitInstrumentation;
 
+    /** Indicates whether the program should keep a thread-local histogram
+        of the number of active program instances at each of the points
+        where --instrument would call ISPCInstrument(), rather than calling
+        out of the program.  (See the "Instrumenting ISPC Programs To
+        Understand Runtime Behavior" section of the performance guide.) */
+    bool emitOccupancyProfile;
+
+    /** Indicates whether calls to the externally-defined ISPCTraceMemory()
+        function should be emitted at each load, store, gather and scatter
+        in the program, passing the addresses accessed by each active
+        program instance.  (Accesses to stack variables aren't traced.) */
+    bool emitMemoryTrace;
+
     /** Indicates whether ispc should generate debugging symbols for the
         program in its output. */
     bool generateDebuggingSymbols;
 
+    /** With generateDebuggingSymbols, indicates that only the line tables
+        and the functions' scopes should be described (-gline-tables-only),
+        which is enough for stack traces and profilers, but not the
+        variables and their types. */
+    bool debugLineTablesOnly;
+
     /** Require generation of DWARF of certain version (2, 3, 4). For
         default version, this field is set to 0. */
     // Hint: to verify dwarf version in the object file, run on Linux:
@@ -649,6 +838,55 @@ struct Globals {
 
     /** When true, flag non-static functions with dllexport attribute on Windows. */
     bool dllExport;
+
+    /** Maximum number of targets that are optimized and compiled to
+        native code concurrently when compiling for multiple targets.  With
+        a value greater than one, each target's module is handed off to a
+        separate worker process after it has been parsed.  It's also the
+        number of parts that native object file generation for a module is
+        split into (with LLVM 3.9 and later).  (Not supported on Windows,
+        where everything is compiled in a single process.) */
+    int numJobs;
+
+    /** Indicates whether a report of the time spent in each phase of
+        compilation (and in each optimization pass, for each function)
+        should be generated. */
+    bool timeReport;
+
+    /** If non-NULL, the file to which the --time-report data is written in
+        JSON format.  Otherwise, a summary is printed to stderr. */
+    const char *timeReportFile;
+
+    /** If non-NULL, the file to which a report of the gathers, scatters,
+        masked memory operations, calls and estimated cost of each
+        exported and task function is appended (--emit-perf-report). */
+    const char *perfReportFile;
+
+    /** If non-NULL, the directory that holds the compilation cache; the
+        outputs of each compilation are stored there and reused by later
+        compilations of identical preprocessed source with the same
+        options. */
+    const char *cacheDir;
+
+    /** The compiler version and the command-line options, as they go into
+        the compilation cache key. */
+    std::string cacheFlags;
+
+    /** A constant value for one of the parameters of
+        \c specializedFunction. */
+    struct SpecializedParam {
+        int index;
+        bool isFloat;
+        int64_t intValue;
+        double floatValue;
+    };
+
+    /** Used for runtime specialization (ispc::Specialize()): if non-empty,
+        the name of an exported function whose parameters that are listed
+        in \c specializedParams are replaced with the given constant values
+        before the program is optimized. */
+    std::string specializedFunction;
+    std::vector<SpecializedParam> specializedParams;
 };
 
 enum {
@@ -678,9 +916,20 @@ enum {
     COST_UNIFORM_SWITCH = 4,
     COST_VARYING_SWITCH = 12,
     COST_ASSERT = 8,
+    COST_ASSUME = 0,
 
     CHECK_MASK_AT_FUNCTION_START_COST = 16,
     PREDICATE_SAFE_IF_STATEMENT_COST = 6,
+
+    /* Estimated cost of the work that each of the tasks that a
+       "parallel_foreach" loop is split into should do, so that the
+       overhead of launching them is small in comparison. */
+    PARALLEL_FOREACH_TASK_COST = 4096,
+
+    /* Launches of tasks whose total estimated cost is below this are run
+       serially in the launching thread, without going through the task
+       system. */
+    SERIAL_LAUNCH_COST = 256,
 };
 
 extern Globals *g;
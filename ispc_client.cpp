@@ -0,0 +1,175 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This file is a standalone program that takes the same command line as     //
+// ispc and has a compile server started with "ispc --server" do the         //
+// compilation; if no server is running, it runs ispc itself instead.        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ispc_server.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+static bool
+lWriteFully(int fd, const void *buf, size_t size) {
+    const char *ptr = (const char *)buf;
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+
+/** Runs ispc directly, for when there's no server to connect to. */
+static int
+lRunIspc(char *argv[]) {
+    const char *ispc = getenv("ISPC_EXECUTABLE");
+    if (ispc == NULL || *ispc == '\0')
+        ispc = "ispc";
+    argv[0] = (char *)ispc;
+    execvp(ispc, argv);
+    fprintf(stderr, "Unable to run \"%s\": %s\n", ispc, strerror(errno));
+    return 1;
+}
+
+
+int main(int argc, char *argv[]) {
+    std::string socketString, error;
+    if (!lGetServerSocket(&socketString, &error)) {
+        fprintf(stderr, "Warning: not using the ispc server: %s.\n",
+                error.c_str());
+        return lRunIspc(argv);
+    }
+    const char *socketPath = socketString.c_str();
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path))
+        return lRunIspc(argv);
+    strcpy(addr.sun_path, socketPath);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 ||
+        connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        return lRunIspc(argv);
+    if (!lPeerIsCurrentUser(sock)) {
+        fprintf(stderr, "Warning: not using the ispc server on \"%s\", which "
+                "is run by another user.\n", socketPath);
+        close(sock);
+        return lRunIspc(argv);
+    }
+
+    // The request is the working directory, ISPC_ARGS and the command
+    // line, as NUL-terminated strings; its length is sent first, along
+    // with our standard input, output and error, which the compilation
+    // reads from and writes to directly.
+    std::string request;
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "Unable to get the current directory: %s\n",
+                strerror(errno));
+        return 1;
+    }
+    request.append(cwd, strlen(cwd) + 1);
+    const char *ispcArgs = getenv("ISPC_ARGS");
+    if (ispcArgs != NULL)
+        request.append(ispcArgs);
+    request.append(1, '\0');
+    for (int i = 0; i < argc; ++i)
+        request.append(argv[i], strlen(argv[i]) + 1);
+
+    if (request.size() > ISPC_SERVER_MAX_REQUEST) {
+        close(sock);
+        return lRunIspc(argv);
+    }
+    uint32_t length = (uint32_t)request.size();
+    int fds[3] = { 0, 1, 2 };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov;
+    iov.iov_base = &length;
+    iov.iov_len = sizeof(length);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, 0) != sizeof(length) ||
+        !lWriteFully(sock, request.data(), request.size())) {
+        fprintf(stderr, "Unable to send the request to the ispc server on "
+                "\"%s\": %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+
+    int32_t result;
+    size_t got = 0;
+    while (got < sizeof(result)) {
+        ssize_t n = read(sock, (char *)&result + got, sizeof(result) - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            fprintf(stderr, "The ispc server on \"%s\" didn't report the "
+                    "result of the compilation.\n", socketPath);
+            return 1;
+        }
+        got += n;
+    }
+    return result;
+}
@@ -0,0 +1,128 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** @file ispc_server.h
+
+    @brief Where the compile server's socket is and who may use it; this
+    is shared by "ispc --server" and ispc-client, which doesn't use any of
+    the rest of the compiler.
+*/
+
+#ifndef ISPC_SERVER_H
+#define ISPC_SERVER_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/** The largest request, in bytes, that the server accepts. */
+#define ISPC_SERVER_MAX_REQUEST (16 * 1024 * 1024)
+
+
+/** Returns true if the given path is a directory (and not a symbolic link
+    to one) that belongs to the current user and that no one else has any
+    access to. */
+static inline bool
+lIsPrivateDirectory(const char *path) {
+    struct stat st;
+    return (lstat(path, &st) == 0 && S_ISDIR(st.st_mode) &&
+            st.st_uid == getuid() && (st.st_mode & 077) == 0);
+}
+
+
+/** Gets the socket that "ispc --server" listens on and that ispc-client
+    connects to when no other one is given: the one named by the
+    ISPC_SERVER_SOCKET environment variable, or otherwise "ispc-server" in
+    $XDG_RUNTIME_DIR, or otherwise in a directory "ispc-<uid>" in /tmp that
+    is created if needed.  The client sends the server its standard file
+    descriptors, so anyone who could replace the socket could read and
+    write the user's files; if the directory isn't private to the user,
+    false is returned with the reason in *error. */
+static inline bool
+lGetServerSocket(std::string *path, std::string *error) {
+    const char *env = getenv("ISPC_SERVER_SOCKET");
+    if (env != NULL && *env != '\0') {
+        *path = env;
+        return true;
+    }
+
+    std::string dir;
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir != NULL && *runtimeDir != '\0')
+        dir = runtimeDir;
+    else {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "/tmp/ispc-%u", (unsigned)getuid());
+        dir = buf;
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            *error = "unable to create \"" + dir + "\": " + strerror(errno);
+            return false;
+        }
+    }
+    if (!lIsPrivateDirectory(dir.c_str())) {
+        *error = "\"" + dir + "\" isn't a directory that only the current "
+            "user can access";
+        return false;
+    }
+    *path = dir + "/ispc-server";
+    return true;
+}
+
+
+/** Returns true if the process on the other end of the given connected
+    Unix domain socket runs as the current user. */
+static inline bool
+lPeerIsCurrentUser(int sock) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t length = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0 ||
+        length != sizeof(cred))
+        return false;
+    return cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(sock, &uid, &gid) != 0)
+        return false;
+    return uid == getuid();
+#endif // SO_PEERCRED
+}
+
+#endif // ISPC_SERVER_H
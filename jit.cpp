@@ -0,0 +1,446 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** @file jit.cpp
+    @brief Implementation of the libispc runtime compilation interface.
+*/
+
+#include "jit.h"
+#include "ispc.h"
+#include "module.h"
+#include "util.h"
+#include <stdio.h>
+#include <string.h>
+#include <map>
+
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+#include <mutex>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#endif
+
+#ifdef ISPC_IS_WINDOWS
+#include <process.h>
+#include <io.h>
+#define getpid _getpid
+#define close _close
+#else
+#include <unistd.h>
+#endif
+
+#ifndef BUILD_DATE
+#define BUILD_DATE __DATE__
+#endif
+
+namespace ispc {
+
+JITOptions::JITOptions() {
+    optLevel = 1;
+    fastMath = false;
+}
+
+
+Program::Program(const std::string &s, const JITOptions &o,
+                 llvm::ExecutionEngine *e)
+    : source(s), options(o), engine(e) {
+}
+
+
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+
+/** Compilation uses the global compiler state (::g, ::m), so only one
+    thread at a time may be in here. */
+static std::mutex lJITMutex;
+
+/** All of the programs compiled so far, indexed by their cache key. */
+static std::map<std::string, Program *> lPrograms;
+
+/** Context for the (empty) modules that the execution engines are created
+    with; the programs' code is always loaded from object files. */
+static llvm::LLVMContext *lJITContext = NULL;
+
+
+/** Does the one-time setup of LLVM and the compiler's global state. */
+static void
+lInitialize() {
+    if (lJITContext != NULL)
+        return;
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+    LLVMLinkInMCJIT();
+
+    // Make the symbols of the calling process (ISPCLaunch() and friends,
+    // the C library) available to the programs.
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(NULL);
+
+    if (g == NULL)
+        g = new Globals;
+    lJITContext = new llvm::LLVMContext;
+}
+
+
+/** Sets up the compiler's global state for compiling a program with the
+    given options (and with the given function specialized, if \c
+    function isn't empty), as the command-line options would. */
+static void
+lSetUpGlobals(const JITOptions &options, const std::string &function,
+              const std::map<int, SpecializedValue> &values) {
+    g->opt = Opt();
+    g->opt.level = options.optLevel;
+    g->opt.fastMath = options.fastMath;
+    g->opt.fastMathReassoc = options.fastMath;
+    g->opt.fastMathRcpApprox = options.fastMath;
+    g->cppArgs.clear();
+    for (unsigned int i = 0; i < options.defines.size(); ++i)
+        g->cppArgs.push_back("-D" + options.defines[i]);
+    g->includePath = options.includePaths;
+    g->mangleFunctionsWithTarget = false;
+    g->cacheDir = NULL;
+    g->numJobs = 1;
+    g->specializedFunction = function;
+    g->specializedParams.clear();
+    for (std::map<int, SpecializedValue>::const_iterator iter = values.begin();
+         iter != values.end(); ++iter) {
+        Globals::SpecializedParam param;
+        param.index = iter->first;
+        param.isFloat = iter->second.isFloat;
+        param.intValue = iter->second.intValue;
+        param.floatValue = iter->second.floatValue;
+        g->specializedParams.push_back(param);
+    }
+}
+
+
+/** Computes the key that identifies a compiled program: the compiler
+    version, the options that affect code generation, the target, CPU and
+    CPU features that the target resolves to on this system, the function
+    specialization, if any, and the program's source after preprocessing,
+    so that changes to the headers it includes are noticed.  The source
+    must be in \c srcFile and lSetUpGlobals() must have been called.
+    Returns false if the target is invalid. */
+static bool
+lProgramKey(const std::string &srcFile, const JITOptions &options,
+            std::string *key) {
+    const char *targetName = options.target.empty() ? NULL : options.target.c_str();
+    Target *target = new Target(NULL /* arch */, NULL /* cpu */, targetName,
+                                true /* PIC */, false);
+    if (!target->isValid()) {
+        delete target;
+        return false;
+    }
+
+    *key = std::string("ispc-jit ") + ISPC_VERSION + " " + BUILD_DATE +
+        " LLVM " + ISPC_LLVM_VERSION_STRING + "\n";
+    *key += std::string("target ") + target->GetISATargetString() + " cpu " +
+        target->getCPU() + " features " +
+        target->GetTargetMachine()->getTargetFeatureString().str() + "\n";
+    char buf[64];
+    sprintf(buf, "opt %d fast-math %d\n", options.optLevel,
+            (int)options.fastMath);
+    *key += buf;
+    if (!g->specializedFunction.empty()) {
+        *key += "specialize " + g->specializedFunction + "\n";
+        for (unsigned int i = 0; i < g->specializedParams.size(); ++i) {
+            const Globals::SpecializedParam &param = g->specializedParams[i];
+            if (param.isFloat)
+                sprintf(buf, "%d float %a\n", param.index, param.floatValue);
+            else
+                sprintf(buf, "%d int %lld\n", param.index,
+                        (long long)param.intValue);
+            *key += buf;
+        }
+    }
+
+    // The macro definitions and include paths only matter through their
+    // effect on the preprocessed source.
+    g->target = target;
+    m = new Module(srcFile.c_str());
+    std::string preprocessed;
+    llvm::raw_string_ostream os(preprocessed);
+    m->execPreprocessor(srcFile.c_str(), &os);
+    os.flush();
+    delete m;
+    m = NULL;
+    g->target = NULL;
+    delete target;
+
+    // The line markers name the temporary file that the source was
+    // written to, which differs from one compilation to the next.
+    std::string::size_type pos = 0;
+    while ((pos = preprocessed.find(srcFile, pos)) != std::string::npos) {
+        preprocessed.replace(pos, srcFile.size(), "<source>");
+        pos += strlen("<source>");
+    }
+    *key += preprocessed;
+    return true;
+}
+
+
+static bool
+lReadFile(const std::string &fn, std::string *contents) {
+    FILE *f = fopen(fn.c_str(), "rb");
+    if (f == NULL)
+        return false;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        contents->append(buf, n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+
+static bool
+lWriteFile(const std::string &fn, const std::string &contents) {
+    FILE *f = fopen(fn.c_str(), "wb");
+    if (f == NULL)
+        return false;
+    bool ok = (fwrite(contents.data(), 1, contents.size(), f) == contents.size());
+    return (fclose(f) == 0) && ok;
+}
+
+
+/** Compiles the source in srcFile to a native object file with position
+    independent code, going through the same path as the command-line
+    compiler does.  lSetUpGlobals() must have been called. */
+static bool
+lCompileToObject(const std::string &srcFile, const JITOptions &options,
+                 const std::string &objFile) {
+    const char *target = options.target.empty() ? NULL : options.target.c_str();
+    int err = Module::CompileAndOutput(srcFile.c_str(), NULL /* arch */,
+                                       NULL /* cpu */, target, true /* PIC */,
+                                       Module::Object, objFile.c_str(),
+                                       NULL, NULL, NULL, NULL, NULL);
+    return (err == 0);
+}
+
+
+/** Creates an execution engine and loads the given object file into it. */
+static llvm::ExecutionEngine *
+lLoadObjectFile(const std::string &objFile) {
+    std::unique_ptr<llvm::Module> module(new llvm::Module("ispc-jit", *lJITContext));
+    std::string error;
+    llvm::ExecutionEngine *engine =
+        llvm::EngineBuilder(std::move(module))
+            .setEngineKind(llvm::EngineKind::JIT)
+            .setErrorStr(&error)
+            .create();
+    if (engine == NULL) {
+        Error(SourcePos(), "Unable to create JIT execution engine: %s",
+              error.c_str());
+        return NULL;
+    }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    llvm::ErrorOr<llvm::object::OwningBinary<llvm::object::ObjectFile> > obj =
+        llvm::object::ObjectFile::createObjectFile(objFile);
+    if (!obj) {
+        Error(SourcePos(), "Unable to load \"%s\": %s", objFile.c_str(),
+              obj.getError().message().c_str());
+        delete engine;
+        return NULL;
+    }
+#else // LLVM 4.0+
+    llvm::Expected<llvm::object::OwningBinary<llvm::object::ObjectFile> > obj =
+        llvm::object::ObjectFile::createObjectFile(objFile);
+    if (!obj) {
+        Error(SourcePos(), "Unable to load \"%s\": %s", objFile.c_str(),
+              llvm::toString(obj.takeError()).c_str());
+        delete engine;
+        return NULL;
+    }
+#endif
+
+    engine->addObjectFile(std::move(*obj));
+    engine->finalizeObject();
+    return engine;
+}
+
+
+/** Compiles the program in srcFile and loads it into a new execution
+    engine, going through the cache directory if there is one. */
+static llvm::ExecutionEngine *
+lCompileAndLoad(const std::string &srcFile, const JITOptions &options,
+                const std::string &key) {
+    std::string objFile;
+    if (!options.cacheDir.empty()) {
+        char suffix[32];
+        sprintf(suffix, ".tmp%d", (int)getpid());
+        std::string base = options.cacheDir + "/jit-" + HashString(key);
+        objFile = base + ".o";
+
+        // The key file is written last (and compared in full, so hash
+        // collisions don't matter), so a matching key means that the
+        // object file is complete.
+        std::string storedKey;
+        if (!(lReadFile(base + ".key", &storedKey) && storedKey == key)) {
+            std::string tmpObjFile = base + suffix + ".o";
+            if (!lCompileToObject(srcFile, options, tmpObjFile) ||
+                rename(tmpObjFile.c_str(), objFile.c_str()) != 0) {
+                remove(tmpObjFile.c_str());
+                return NULL;
+            }
+            std::string tmpKeyFile = base + suffix + ".key";
+            if (!lWriteFile(tmpKeyFile, key) ||
+                rename(tmpKeyFile.c_str(), (base + ".key").c_str()) != 0)
+                remove(tmpKeyFile.c_str());
+        }
+    }
+    else {
+        objFile = srcFile + ".o";
+        if (!lCompileToObject(srcFile, options, objFile)) {
+            remove(objFile.c_str());
+            return NULL;
+        }
+    }
+
+    llvm::ExecutionEngine *engine = lLoadObjectFile(objFile);
+    if (options.cacheDir.empty())
+        remove(objFile.c_str());
+    return engine;
+}
+
+
+const Program *
+Program::Get(const std::string &source, const JITOptions &options,
+             const std::string &function,
+             const std::map<int, SpecializedValue> &values) {
+    // The source is written to a temporary file, which is both
+    // preprocessed to compute the key and compiled on a cache miss.
+    llvm::SmallString<128> path;
+    int fd;
+    if (llvm::sys::fs::createTemporaryFile("ispc-jit", "ispc", fd, path)) {
+        Error(SourcePos(), "Unable to create a temporary file.");
+        return NULL;
+    }
+    close(fd);
+    std::string srcFile(path.begin(), path.end());
+    if (!lWriteFile(srcFile, source)) {
+        Error(SourcePos(), "Unable to write ispc source to \"%s\".",
+              srcFile.c_str());
+        remove(srcFile.c_str());
+        return NULL;
+    }
+
+    lSetUpGlobals(options, function, values);
+    Program *program = NULL;
+    std::string key;
+    if (!lProgramKey(srcFile, options, &key))
+        Error(SourcePos(), "Invalid target \"%s\".", options.target.c_str());
+    else {
+        std::map<std::string, Program *>::iterator iter = lPrograms.find(key);
+        if (iter != lPrograms.end())
+            program = iter->second;
+        else {
+            llvm::ExecutionEngine *engine =
+                lCompileAndLoad(srcFile, options, key);
+            if (engine != NULL) {
+                program = new Program(source, options, engine);
+                lPrograms[key] = program;
+            }
+        }
+    }
+
+    g->specializedFunction.clear();
+    g->specializedParams.clear();
+    remove(srcFile.c_str());
+    return program;
+}
+
+
+const Program *
+Compile(const std::string &source, const JITOptions &options) {
+    std::lock_guard<std::mutex> lock(lJITMutex);
+    lInitialize();
+
+    if (options.target.find(',') != std::string::npos) {
+        Error(SourcePos(), "Only a single target can be used when compiling "
+              "at runtime.");
+        return NULL;
+    }
+
+    return Program::Get(source, options, "", std::map<int, SpecializedValue>());
+}
+
+
+const Program *
+Specialize(const Program *program, const std::string &function,
+           const std::map<int, SpecializedValue> &values) {
+    if (program == NULL)
+        return NULL;
+
+    std::lock_guard<std::mutex> lock(lJITMutex);
+    return Program::Get(program->source, program->options, function, values);
+}
+
+
+void *
+Program::GetFunction(const std::string &name) const {
+    std::lock_guard<std::mutex> lock(lJITMutex);
+    return (void *)engine->getFunctionAddress(name);
+}
+
+#else // LLVM 3.2 - 3.5
+
+const Program *
+Compile(const std::string &source, const JITOptions &options) {
+    Error(SourcePos(), "Compiling at runtime requires ispc to be built with "
+          "LLVM 3.6 or later.");
+    return NULL;
+}
+
+
+const Program *
+Specialize(const Program *program, const std::string &function,
+           const std::map<int, SpecializedValue> &values) {
+    return NULL;
+}
+
+
+void *
+Program::GetFunction(const std::string &name) const {
+    return NULL;
+}
+
+#endif // LLVM 3.6+
+
+} // namespace ispc
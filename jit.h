@@ -0,0 +1,196 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** @file jit.h
+    @brief Interface for compiling ispc programs at runtime and calling
+    them from the same process.
+
+    This is the public interface of the libispc library (built with "make
+    libispc"); it doesn't depend on any of the other ispc headers.
+*/
+
+#ifndef ISPC_JIT_H
+#define ISPC_JIT_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace llvm {
+    class ExecutionEngine;
+}
+
+namespace ispc {
+
+/** @brief Options that control how a program is compiled at runtime.
+
+    These correspond to the command-line options of the same names.
+ */
+struct JITOptions {
+    JITOptions();
+
+    /** Compilation target, as given to the --target option.  If empty, the
+        best target supported by the host system is used.  Only a single
+        target may be given. */
+    std::string target;
+
+    /** Optimization level: 0 disables optimization (as with -O0), 1 enables
+        it. */
+    int optLevel;
+
+    /** Indicates whether fast-and-loose floating-point optimizations
+        (--opt=fast-math) should be performed. */
+    bool fastMath;
+
+    /** Preprocessor definitions, in the form "NAME" or "NAME=VALUE". */
+    std::vector<std::string> defines;
+
+    /** Directories to search for #include files. */
+    std::vector<std::string> includePaths;
+
+    /** If non-empty, a directory where compiled programs are stored, so
+        that later runs (of this or other processes) that compile the same
+        source with the same options can load them without compiling
+        again.  The directory must already exist. */
+    std::string cacheDir;
+};
+
+
+/** @brief A constant value for a parameter of a specialized function;
+    see ispc::Specialize().
+ */
+struct SpecializedValue {
+    SpecializedValue(bool v) : isFloat(false), intValue(v), floatValue(0) { }
+    SpecializedValue(int v) : isFloat(false), intValue(v), floatValue(0) { }
+    SpecializedValue(unsigned int v) : isFloat(false), intValue(v), floatValue(0) { }
+    SpecializedValue(long v) : isFloat(false), intValue(v), floatValue(0) { }
+    SpecializedValue(unsigned long v) : isFloat(false), intValue((long long)v), floatValue(0) { }
+    SpecializedValue(long long v) : isFloat(false), intValue(v), floatValue(0) { }
+    SpecializedValue(unsigned long long v) : isFloat(false), intValue((long long)v), floatValue(0) { }
+    SpecializedValue(float v) : isFloat(true), intValue(0), floatValue(v) { }
+    SpecializedValue(double v) : isFloat(true), intValue(0), floatValue(v) { }
+
+    bool isFloat;
+    long long intValue;
+    double floatValue;
+};
+
+
+/** @brief A program that has been compiled at runtime.
+
+    Programs are returned by ispc::Compile() and are never freed; the code
+    for their exported functions remains valid until the process exits.
+ */
+class Program {
+public:
+    /** Returns a pointer to the "export"ed function with the given name, or
+        NULL if the program has no such function.  The caller must cast the
+        result to the appropriate function pointer type; the function has
+        the same signature as the one in the header file that "ispc -h"
+        would generate for the program. */
+    void *GetFunction(const std::string &name) const;
+
+    /** Returns the source code that the program was compiled from. */
+    const std::string &GetSource() const { return source; }
+
+    /** Returns the options that the program was compiled with. */
+    const JITOptions &GetOptions() const { return options; }
+
+private:
+    friend const Program *Compile(const std::string &source,
+                                  const JITOptions &options);
+    friend const Program *Specialize(const Program *program,
+                                     const std::string &function,
+                                     const std::map<int, SpecializedValue> &values);
+
+    /** Returns the program for the given source and options (with the
+        given function specialized, if \c function isn't empty), from the
+        in-process cache or by compiling it. */
+    static const Program *Get(const std::string &source,
+                              const JITOptions &options,
+                              const std::string &function,
+                              const std::map<int, SpecializedValue> &values);
+
+    Program(const std::string &source, const JITOptions &options,
+            llvm::ExecutionEngine *engine);
+    Program(const Program &);
+    Program &operator=(const Program &);
+
+    std::string source;
+    JITOptions options;
+    llvm::ExecutionEngine *engine;
+};
+
+
+/** Compiles the given ispc source code for the host system and loads it
+    into the calling process.  Compiling the same source with the same
+    options again returns the same Program without recompiling it.
+
+    Errors and warnings are reported on the standard error output, just as
+    they are by the ispc command-line compiler.  Tasks launched by the
+    program call the ISPCLaunch(), ISPCLaunchAfter(), ISPCAlloc(),
+    ISPCSync() and ISPCSyncLaunch() functions of the calling process, which must thus
+    make them visible to the dynamic linker (e.g. by linking with
+    -rdynamic on Linux).
+
+    This function may be called from multiple threads, but compilations
+    are done one at a time, since the compiler's state is global.
+
+    @return The compiled program, or NULL if there were errors.
+ */
+const Program *Compile(const std::string &source,
+                       const JITOptions &options = JITOptions());
+
+/** Compiles the given program again, with some of the parameters of the
+    exported function \c function replaced with constants: \c values maps
+    the (zero-based) indices of the parameters to their values.  Only
+    parameters with uniform atomic or enum types can be specialized; the
+    others keep being passed as usual, and the specialized function has
+    the same signature as the original one, though the arguments for
+    specialized parameters are ignored.
+
+    The constants are seen by the optimizer, so that, for example, loops
+    with a specialized trip count can be fully unrolled, and code that
+    depends on a specialized flag is removed.  Specializing the same
+    function with the same values again returns the same Program.
+
+    @return The specialized program, from which the specialized function
+            (and the other exported functions, unchanged) can be obtained
+            with Program::GetFunction(), or NULL if there were errors.
+ */
+const Program *Specialize(const Program *program, const std::string &function,
+                          const std::map<int, SpecializedValue> &values);
+
+} // namespace ispc
+
+#endif // ISPC_JIT_H
@@ -41,16 +41,23 @@
 #include "parse.hh"
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <ctype.h>
 
 static uint64_t lParseBinary(const char *ptr, SourcePos pos, char **endPtr);
 static int lParseInteger(bool dotdotdot);
 static void lCComment(SourcePos *);
 static void lCppComment(SourcePos *);
 static void lHandleCppHash(SourcePos *);
+static int lHandlePragma(SourcePos *);
 static void lStringConst(YYSTYPE *, SourcePos *);
 static double lParseHexFloat(const char *ptr);
 extern void RegisterDependency(const std::string &fileName);
 
+/* The scanner generated from the rules below is wrapped by yylex(), which
+   records and replays the tokens of function templates. */
+#define YY_DECL static int lScanToken()
+
 #define YY_USER_ACTION \
     yylloc.first_line = yylloc.last_line; \
     yylloc.first_column = yylloc.last_column; \
@@ -63,17 +70,18 @@ inline int isatty(int) { return 0; }
 #endif // ISPC_IS_WINDOWS
 
 static int allTokens[] = {
-  TOKEN_ASSERT, TOKEN_BOOL, TOKEN_BREAK, TOKEN_CASE,
+  TOKEN_AFTER, TOKEN_ALIGNED, TOKEN_ASSERT, TOKEN_ASSUME, TOKEN_BOOL, TOKEN_BREAK, TOKEN_CASE,
   TOKEN_CDO, TOKEN_CFOR, TOKEN_CIF, TOKEN_CWHILE,
   TOKEN_CONST, TOKEN_CONTINUE, TOKEN_DEFAULT, TOKEN_DO,
   TOKEN_DELETE, TOKEN_DOUBLE, TOKEN_ELSE, TOKEN_ENUM,
   TOKEN_EXPORT, TOKEN_EXTERN, TOKEN_FALSE, TOKEN_FLOAT, TOKEN_FOR,
-  TOKEN_FOREACH, TOKEN_FOREACH_ACTIVE, TOKEN_FOREACH_TILED,
+  TOKEN_FOREACH, TOKEN_FOREACH_ACTIVE, TOKEN_FOREACH_COMPACT, TOKEN_FOREACH_TILED,
   TOKEN_FOREACH_UNIQUE, TOKEN_GOTO, TOKEN_IF, TOKEN_IN, TOKEN_INLINE,
   TOKEN_INT, TOKEN_INT8, TOKEN_INT16, TOKEN_INT, TOKEN_INT64, TOKEN_LAUNCH,
-  TOKEN_NEW, TOKEN_NULL, TOKEN_PRINT, TOKEN_RETURN, TOKEN_SOA, TOKEN_SIGNED,
+  TOKEN_NEW, TOKEN_NOALIAS, TOKEN_NULL, TOKEN_PARALLEL_FOREACH, TOKEN_PRINT, TOKEN_RETURN, TOKEN_SOA, TOKEN_SIGNED,
   TOKEN_SIZEOF, TOKEN_STATIC, TOKEN_STRUCT, TOKEN_SWITCH, TOKEN_SYNC,
-  TOKEN_TASK, TOKEN_TRUE, TOKEN_TYPEDEF, TOKEN_UNIFORM, TOKEN_UNMASKED,
+  TOKEN_TASK, TOKEN_TASK_LOCAL, TOKEN_TEMPLATE, TOKEN_TRUE, TOKEN_TYPEDEF, TOKEN_TYPENAME,
+  TOKEN_UNIFORM, TOKEN_UNMASKED,
   TOKEN_UNSIGNED, TOKEN_VARYING, TOKEN_VOID, TOKEN_WHILE,
   TOKEN_STRING_C_LITERAL, TOKEN_DOTDOTDOT,
   TOKEN_FLOAT_CONSTANT, TOKEN_DOUBLE_CONSTANT,
@@ -93,8 +101,17 @@ static int allTokens[] = {
 std::map<int, std::string> tokenToName;
 std::map<std::string, std::string> tokenNameRemap;
 
+static void lResetTemplateTokens();
+static void lResetLaunchContext();
+
 void ParserInit() {
+    lResetTemplateTokens();
+    lResetLaunchContext();
+
+    tokenToName[TOKEN_AFTER] = "after";
+    tokenToName[TOKEN_ALIGNED] = "aligned";
     tokenToName[TOKEN_ASSERT] = "assert";
+    tokenToName[TOKEN_ASSUME] = "assume";
     tokenToName[TOKEN_BOOL] = "bool";
     tokenToName[TOKEN_BREAK] = "break";
     tokenToName[TOKEN_CASE] = "case";
@@ -117,6 +134,7 @@ void ParserInit() {
     tokenToName[TOKEN_FOR] = "for";
     tokenToName[TOKEN_FOREACH] = "foreach";
     tokenToName[TOKEN_FOREACH_ACTIVE] = "foreach_active";
+    tokenToName[TOKEN_FOREACH_COMPACT] = "foreach_compact";
     tokenToName[TOKEN_FOREACH_TILED] = "foreach_tiled";
     tokenToName[TOKEN_FOREACH_UNIQUE] = "foreach_unique";
     tokenToName[TOKEN_GOTO] = "goto";
@@ -130,7 +148,9 @@ void ParserInit() {
     tokenToName[TOKEN_INT64] = "int64";
     tokenToName[TOKEN_LAUNCH] = "launch";
     tokenToName[TOKEN_NEW] = "new";
+    tokenToName[TOKEN_NOALIAS] = "noalias";
     tokenToName[TOKEN_NULL] = "NULL";
+    tokenToName[TOKEN_PARALLEL_FOREACH] = "parallel_foreach";
     tokenToName[TOKEN_PRINT] = "print";
     tokenToName[TOKEN_RETURN] = "return";
     tokenToName[TOKEN_SOA] = "soa";
@@ -141,8 +161,11 @@ void ParserInit() {
     tokenToName[TOKEN_SWITCH] = "switch";
     tokenToName[TOKEN_SYNC] = "sync";
     tokenToName[TOKEN_TASK] = "task";
+    tokenToName[TOKEN_TASK_LOCAL] = "task_local";
+    tokenToName[TOKEN_TEMPLATE] = "template";
     tokenToName[TOKEN_TRUE] = "true";
     tokenToName[TOKEN_TYPEDEF] = "typedef";
+    tokenToName[TOKEN_TYPENAME] = "typename";
     tokenToName[TOKEN_UNIFORM] = "uniform";
     tokenToName[TOKEN_UNMASKED] = "unmasked";
     tokenToName[TOKEN_UNSIGNED] = "unsigned";
@@ -208,7 +231,10 @@ void ParserInit() {
     tokenToName['?'] = "?";
     tokenToName[';'] = ";";
 
+    tokenNameRemap["TOKEN_AFTER"] = "\'after\'";
+    tokenNameRemap["TOKEN_ALIGNED"] = "\'aligned\'";
     tokenNameRemap["TOKEN_ASSERT"] = "\'assert\'";
+    tokenNameRemap["TOKEN_ASSUME"] = "\'assume\'";
     tokenNameRemap["TOKEN_BOOL"] = "\'bool\'";
     tokenNameRemap["TOKEN_BREAK"] = "\'break\'";
     tokenNameRemap["TOKEN_CASE"] = "\'case\'";
@@ -231,10 +257,12 @@ void ParserInit() {
     tokenNameRemap["TOKEN_FOR"] = "\'for\'";
     tokenNameRemap["TOKEN_FOREACH"] = "\'foreach\'";
     tokenNameRemap["TOKEN_FOREACH_ACTIVE"] = "\'foreach_active\'";
+    tokenNameRemap["TOKEN_FOREACH_COMPACT"] = "\'foreach_compact\'";
     tokenNameRemap["TOKEN_FOREACH_TILED"] = "\'foreach_tiled\'";
     tokenNameRemap["TOKEN_FOREACH_UNIQUE"] = "\'foreach_unique\'";
     tokenNameRemap["TOKEN_GOTO"] = "\'goto\'";
     tokenNameRemap["TOKEN_IDENTIFIER"] = "identifier";
+    tokenNameRemap["TOKEN_TEMPLATE_NAME"] = "template name";
     tokenNameRemap["TOKEN_IF"] = "\'if\'";
     tokenNameRemap["TOKEN_IN"] = "\'in\'";
     tokenNameRemap["TOKEN_INLINE"] = "\'inline\'";
@@ -245,7 +273,9 @@ void ParserInit() {
     tokenNameRemap["TOKEN_INT64"] = "\'int64\'";
     tokenNameRemap["TOKEN_LAUNCH"] = "\'launch\'";
     tokenNameRemap["TOKEN_NEW"] = "\'new\'";
+    tokenNameRemap["TOKEN_NOALIAS"] = "\'noalias\'";
     tokenNameRemap["TOKEN_NULL"] = "\'NULL\'";
+    tokenNameRemap["TOKEN_PARALLEL_FOREACH"] = "\'parallel_foreach\'";
     tokenNameRemap["TOKEN_PRINT"] = "\'print\'";
     tokenNameRemap["TOKEN_RETURN"] = "\'return\'";
     tokenNameRemap["TOKEN_SOA"] = "\'soa\'";
@@ -256,8 +286,11 @@ void ParserInit() {
     tokenNameRemap["TOKEN_SWITCH"] = "\'switch\'";
     tokenNameRemap["TOKEN_SYNC"] = "\'sync\'";
     tokenNameRemap["TOKEN_TASK"] = "\'task\'";
+    tokenNameRemap["TOKEN_TASK_LOCAL"] = "\'task_local\'";
+    tokenNameRemap["TOKEN_TEMPLATE"] = "\'template\'";
     tokenNameRemap["TOKEN_TRUE"] = "\'true\'";
     tokenNameRemap["TOKEN_TYPEDEF"] = "\'typedef\'";
+    tokenNameRemap["TOKEN_TYPENAME"] = "\'typename\'";
     tokenNameRemap["TOKEN_UNIFORM"] = "\'uniform\'";
     tokenNameRemap["TOKEN_UNMASKED"] = "\'unmasked\'";
     tokenNameRemap["TOKEN_UNSIGNED"] = "\'unsigned\'";
@@ -297,6 +330,10 @@ void ParserInit() {
     tokenNameRemap["TOKEN_XOR_ASSIGN"] = "\'^=\'";
     tokenNameRemap["TOKEN_OR_ASSIGN"] = "\'|=\'";
     tokenNameRemap["TOKEN_PTR_OP"] = "\'->\'";
+    tokenNameRemap["TOKEN_PRAGMA_UNROLL"] = "\'#pragma unroll\'";
+    tokenNameRemap["TOKEN_PRAGMA_ALIGN"] = "\'#pragma align\'";
+    tokenNameRemap["TOKEN_PRAGMA_TILE"] = "\'#pragma tile\'";
+    tokenNameRemap["TOKEN_PRAGMA_FP_CONTRACT"] = "\'#pragma fp_contract\'";
     tokenNameRemap["$end"] = "end of file";
 }
 
@@ -356,7 +393,9 @@ ZO_SWIZZLE ([01]+[w-z]+)+|([01]+[rgba]+)+|([01]+[uv]+)+
 "/*"            { lCComment(&yylloc); }
 "//"            { lCppComment(&yylloc); }
 
+aligned { RT; return TOKEN_ALIGNED; }
 __assert { RT; return TOKEN_ASSERT; }
+__assume { RT; return TOKEN_ASSUME; }
 bool { RT; return TOKEN_BOOL; }
 break { RT; return TOKEN_BREAK; }
 case { RT; return TOKEN_CASE; }
@@ -384,6 +423,7 @@ float { RT; return TOKEN_FLOAT; }
 for { RT; return TOKEN_FOR; }
 foreach { RT; return TOKEN_FOREACH; }
 foreach_active { RT; return TOKEN_FOREACH_ACTIVE; }
+foreach_compact { RT; return TOKEN_FOREACH_COMPACT; }
 foreach_tiled { RT; return TOKEN_FOREACH_TILED; }
 foreach_unique { RT; return TOKEN_FOREACH_UNIQUE; }
 goto { RT; return TOKEN_GOTO; }
@@ -397,7 +437,9 @@ int32 { RT; return TOKEN_INT; }
 int64 { RT; return TOKEN_INT64; }
 launch { RT; return TOKEN_LAUNCH; }
 new { RT; return TOKEN_NEW; }
+noalias { RT; return TOKEN_NOALIAS; }
 NULL { RT; return TOKEN_NULL; }
+parallel_foreach { RT; return TOKEN_PARALLEL_FOREACH; }
 print { RT; return TOKEN_PRINT; }
 return { RT; return TOKEN_RETURN; }
 soa { RT; return TOKEN_SOA; }
@@ -408,8 +450,11 @@ struct { RT; return TOKEN_STRUCT; }
 switch { RT; return TOKEN_SWITCH; }
 sync { RT; return TOKEN_SYNC; }
 task { RT; return TOKEN_TASK; }
+task_local { RT; return TOKEN_TASK_LOCAL; }
+template { RT; return TOKEN_TEMPLATE; }
 true { RT; return TOKEN_TRUE; }
 typedef { RT; return TOKEN_TYPEDEF; }
+typename { RT; return TOKEN_TYPENAME; }
 uniform { RT; return TOKEN_UNIFORM; }
 unmasked { RT; return TOKEN_UNMASKED; }
 unsigned { RT; return TOKEN_UNSIGNED; }
@@ -436,6 +481,10 @@ L?\"(\\.|[^\\"])*\" { lStringConst(&yylval, &yylloc); return TOKEN_STRING_LITERA
     yylval.stringVal = new std::string(yytext);
     if (m->symbolTable->LookupType(yytext) != NULL)
         return TOKEN_TYPE_NAME;
+    else if (m->symbolTable->LookupVariable(yytext) == NULL &&
+             m->symbolTable->LookupFunctionTemplate(yytext) != NULL)
+        /* A function template, unless a variable hides it. */
+        return TOKEN_TEMPLATE_NAME;
     else
         return TOKEN_IDENTIFIER;
 }
@@ -533,6 +582,12 @@ L?\"(\\.|[^\\"])*\" { lStringConst(&yylval, &yylloc); return TOKEN_STRING_LITERA
     lHandleCppHash(&yylloc);
 }
 
+^[ \t]*#[ \t]*pragma[^\n]* {
+    int token = lHandlePragma(&yylloc);
+    if (token != 0)
+        return token;
+}
+
 . {
     Error(yylloc, "Illegal character: %c (0x%x)", yytext[0], int(yytext[0]));
     YY_USER_ACTION
@@ -739,6 +794,88 @@ static void lHandleCppHash(SourcePos *pos) {
 }
 
 
+/** Handles a "#pragma" line that the preprocessor passed through.  The
+    loop unrolling pragmas, "#pragma unroll", "#pragma unroll(N)" (or
+    "#pragma unroll N") and "#pragma nounroll", are returned as a
+    TOKEN_PRAGMA_UNROLL token with the unroll count in yylval.intVal: zero
+    for a full unroll, one to disable unrolling, and N otherwise.
+    "#pragma align(ptr, ...)" and "#pragma tile(...)" are returned as
+    TOKEN_PRAGMA_ALIGN and TOKEN_PRAGMA_TILE tokens, respectively, with
+    the text between the parentheses in yylval.stringVal.
+    "#pragma fp_contract(on)" and "#pragma fp_contract(off)" are returned
+    as TOKEN_PRAGMA_FP_CONTRACT with one or zero, respectively, in
+    yylval.intVal.  Other pragmas are ignored with a warning, and zero is
+    returned.
+ */
+static int lHandlePragma(SourcePos *pos) {
+    char *ptr = strchr(yytext, '#') + 1;
+    while (*ptr == ' ' || *ptr == '\t')
+        ++ptr;
+    Assert(!strncmp(ptr, "pragma", 6));
+    ptr += 6;
+    while (*ptr == ' ' || *ptr == '\t')
+        ++ptr;
+
+    std::string name;
+    while (isalnum(*ptr) || *ptr == '_')
+        name.push_back(*ptr++);
+
+    if (name == "nounroll") {
+        yylval.intVal = 1;
+        return TOKEN_PRAGMA_UNROLL;
+    }
+    else if (name == "align" || name == "tile") {
+        while (*ptr == ' ' || *ptr == '\t')
+            ++ptr;
+        const char *end = strrchr(ptr, ')');
+        if (*ptr != '(' || end == NULL) {
+            Error(*pos, "Expected a parenthesized list after \"#pragma %s\".",
+                  name.c_str());
+            return 0;
+        }
+        yylval.stringVal = new std::string(ptr + 1, end);
+        return (name == "align") ? TOKEN_PRAGMA_ALIGN : TOKEN_PRAGMA_TILE;
+    }
+    else if (name == "fp_contract") {
+        while (*ptr == ' ' || *ptr == '\t' || *ptr == '(')
+            ++ptr;
+        std::string state;
+        while (isalpha(*ptr))
+            state.push_back(*ptr++);
+        if (state != "on" && state != "off") {
+            Error(*pos, "Expected \"on\" or \"off\" in \"#pragma fp_contract\".");
+            return 0;
+        }
+        yylval.intVal = (state == "on") ? 1 : 0;
+        return TOKEN_PRAGMA_FP_CONTRACT;
+    }
+    else if (name != "unroll") {
+        Warning(*pos, "Ignoring unknown pragma \"%s\".", name.c_str());
+        return 0;
+    }
+
+    while (*ptr == ' ' || *ptr == '\t' || *ptr == '(')
+        ++ptr;
+    if (*ptr == '\0' || *ptr == '\r') {
+        // "#pragma unroll" without a count: unroll completely
+        yylval.intVal = 0;
+        return TOKEN_PRAGMA_UNROLL;
+    }
+
+    char *endPtr;
+    long count = strtol(ptr, &endPtr, 10);
+    while (*endPtr == ' ' || *endPtr == '\t' || *endPtr == ')' || *endPtr == '\r')
+        ++endPtr;
+    if (endPtr == ptr || *endPtr != '\0' || count < 1 || count > 1024) {
+        Error(*pos, "Unroll count in \"#pragma unroll\" must be an integer "
+              "constant between 1 and 1024.");
+        return 0;
+    }
+    yylval.intVal = (uint64_t)count;
+    return TOKEN_PRAGMA_UNROLL;
+}
+
+
 /** Given a pointer to a position in a string, return the character that it
     represents, accounting for the escape characters supported in string
     constants.  (i.e. given the literal string "\\", return the character
@@ -883,3 +1020,191 @@ lParseHexFloat(const char *ptr) {
     // so let's be sure.
     return mantissa * ipow2(exponent);
 }
+
+
+/** The tokens of the definition of each function template are recorded
+    as they're returned to the parser: after "template", the template
+    parameter list is skipped, and then all of the tokens up to and
+    including the closing brace of the function body are saved.  (A
+    semicolon ends the recording early if there's no function body.) */
+enum TemplateRecordState {
+    TEMPLATE_IDLE,
+    TEMPLATE_PARAMETERS,
+    TEMPLATE_DEFINITION
+};
+
+static TemplateRecordState templateRecordState;
+/** Nesting depth of angle brackets in the template parameter list, then
+    of braces in the function definition. */
+static int templateNesting;
+static std::vector<TemplateToken> templateTokens;
+/** Tokens of the most recently completed template definition, waiting to
+    be picked up by TakeTemplateTokens(). */
+static std::vector<TemplateToken> finishedTemplateTokens;
+
+/** When non-NULL, yylex() returns these tokens rather than scanning the
+    input. */
+static const std::vector<TemplateToken> *replayTokens;
+static unsigned int replayIndex;
+
+
+static void
+lResetTemplateTokens() {
+    templateRecordState = TEMPLATE_IDLE;
+    templateNesting = 0;
+    templateTokens.clear();
+    finishedTemplateTokens.clear();
+    replayTokens = NULL;
+    replayIndex = 0;
+}
+
+
+/** Returns true if the semantic value of the given token is a string. */
+static bool
+lTokenHasString(int token) {
+    return (token == TOKEN_IDENTIFIER || token == TOKEN_TYPE_NAME ||
+            token == TOKEN_TEMPLATE_NAME || token == TOKEN_STRING_LITERAL ||
+            token == TOKEN_PRAGMA_ALIGN || token == TOKEN_PRAGMA_TILE);
+}
+
+
+static void
+lRecordToken(int token) {
+    TemplateToken t;
+    t.token = token;
+    t.text = yytext;
+    t.pos = yylloc;
+    t.intVal = 0;
+    t.floatVal = 0.;
+    if (token == TOKEN_STRING_LITERAL || token == TOKEN_PRAGMA_ALIGN ||
+        token == TOKEN_PRAGMA_TILE)
+        t.stringVal = *yylval.stringVal;
+    else if (lTokenHasString(token))
+        // (The "operator" identifiers don't set yylval.)
+        t.stringVal = yytext;
+    else if (token == TOKEN_FLOAT_CONSTANT)
+        t.floatVal = yylval.floatVal;
+    else if (token == TOKEN_DOUBLE_CONSTANT)
+        t.floatVal = yylval.doubleVal;
+    else
+        t.intVal = yylval.intVal;
+    templateTokens.push_back(t);
+}
+
+
+/** Moves the tokens of the function template definition that was just
+    parsed into the given vector. */
+void
+TakeTemplateTokens(std::vector<TemplateToken> *tokens) {
+    tokens->swap(finishedTemplateTokens);
+    finishedTemplateTokens.clear();
+}
+
+
+/** Makes yylex() return the given tokens, followed by the end of the
+    input, rather than scanning the input; replay stops when this is
+    called with NULL. */
+void
+ReplayTemplateTokens(const std::vector<TemplateToken> *tokens) {
+    replayTokens = tokens;
+    replayIndex = 0;
+}
+
+
+/** "after" is only a keyword where a launch's dependencies can go: right
+    after "launch" or after its bracketed task counts.  This is the
+    nesting depth of square brackets after the most recent "launch", or
+    -1 if the last token can't be followed by "after". */
+static int launchBracketDepth;
+
+
+static void
+lResetLaunchContext() {
+    launchBracketDepth = -1;
+}
+
+
+/** Returns TOKEN_AFTER if the given token is the identifier "after" in a
+    position where it introduces the dependencies of a launch, and the
+    token unchanged otherwise. */
+static int
+lContextualKeyword(int token) {
+    if (token == TOKEN_LAUNCH) {
+        launchBracketDepth = 0;
+        return token;
+    }
+    if (launchBracketDepth == -1)
+        return token;
+
+    if (token == '[')
+        ++launchBracketDepth;
+    else if (token == ']' && launchBracketDepth > 0)
+        --launchBracketDepth;
+    else if (launchBracketDepth == 0) {
+        launchBracketDepth = -1;
+        if ((token == TOKEN_IDENTIFIER || token == TOKEN_TYPE_NAME ||
+             token == TOKEN_TEMPLATE_NAME) && strcmp(yytext, "after") == 0) {
+            delete yylval.stringVal;
+            return TOKEN_AFTER;
+        }
+    }
+    return token;
+}
+
+
+int
+yylex() {
+    if (replayTokens != NULL) {
+        if (replayIndex == replayTokens->size()) {
+            yytext = (char *)"";
+            return 0;
+        }
+        const TemplateToken &t = (*replayTokens)[replayIndex++];
+        yytext = (char *)t.text.c_str();
+        yylloc = t.pos;
+        if (lTokenHasString(t.token))
+            yylval.stringVal = new std::string(t.stringVal);
+        else if (t.token == TOKEN_FLOAT_CONSTANT)
+            yylval.floatVal = (float)t.floatVal;
+        else if (t.token == TOKEN_DOUBLE_CONSTANT)
+            yylval.doubleVal = t.floatVal;
+        else
+            yylval.intVal = t.intVal;
+        return t.token;
+    }
+
+    int token = lContextualKeyword(lScanToken());
+
+    switch (templateRecordState) {
+    case TEMPLATE_IDLE:
+        if (token == TOKEN_TEMPLATE) {
+            templateRecordState = TEMPLATE_PARAMETERS;
+            templateNesting = 0;
+        }
+        break;
+    case TEMPLATE_PARAMETERS:
+        if (token == '<')
+            ++templateNesting;
+        else if (token == '>' && --templateNesting == 0) {
+            templateRecordState = TEMPLATE_DEFINITION;
+            templateTokens.clear();
+        }
+        else if (token == 0 || token == ';' || token == '{')
+            // Malformed parameter list; the parser reports the error.
+            templateRecordState = TEMPLATE_IDLE;
+        break;
+    case TEMPLATE_DEFINITION:
+        if (token != 0)
+            lRecordToken(token);
+        if (token == '{')
+            ++templateNesting;
+        else if (token == 0 || (token == '}' && --templateNesting == 0) ||
+                 (token == ';' && templateNesting == 0)) {
+            finishedTemplateTokens.swap(templateTokens);
+            templateTokens.clear();
+            templateRecordState = TEMPLATE_IDLE;
+        }
+        break;
+    }
+    return token;
+}
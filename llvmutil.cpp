@@ -1506,6 +1506,243 @@ LLVMVectorIsLinear(llvm::Value *v, int stride) {
 }
 
 
+/** The largest power of two that lUniformMultiple() will report; it is
+    returned for zero values, which are multiples of everything. */
+static const int64_t kMaxMultiple = (int64_t)1 << 40;
+
+
+/** Returns a power of two that the given integer value (or, for vectors,
+    each of its elements, which are required to be equal) is known to be a
+    multiple of.  Returns 1 if nothing is known.
+ */
+static int64_t
+lUniformMultiple(llvm::Value *v, std::vector<llvm::PHINode *> &seenPhis,
+                 int depth = 0) {
+    if (depth > 16)
+        return 1;
+
+    if (llvm::ConstantInt *ci = llvm::dyn_cast<llvm::ConstantInt>(v)) {
+        int64_t value = ci->getSExtValue();
+        if (value == 0)
+            return kMaxMultiple;
+        return std::min(value & -value, kMaxMultiple);
+    }
+
+    if (llvm::isa<llvm::VectorType>(v->getType())) {
+        int64_t vals[ISPC_MAX_NVEC];
+        int nElts;
+        if (LLVMExtractVectorInts(v, vals, &nElts)) {
+            if (vals[0] == 0)
+                return kMaxMultiple;
+            return std::min(vals[0] & -vals[0], kMaxMultiple);
+        }
+        if (llvm::isa<llvm::InsertElementInst>(v) ||
+            llvm::isa<llvm::ShuffleVectorInst>(v)) {
+            llvm::Value *element =
+                LLVMFlattenInsertChain(v, g->target->getVectorWidth());
+            return element ? lUniformMultiple(element, seenPhis, depth + 1) : 1;
+        }
+    }
+
+    if (llvm::PHINode *phi = llvm::dyn_cast<llvm::PHINode>(v)) {
+        for (unsigned int i = 0; i < seenPhis.size(); ++i)
+            if (phi == seenPhis[i])
+                return kMaxMultiple;
+        seenPhis.push_back(phi);
+        int64_t mult = kMaxMultiple;
+        for (unsigned int i = 0; i < phi->getNumIncomingValues(); ++i)
+            mult = std::min(mult, lUniformMultiple(phi->getIncomingValue(i),
+                                                   seenPhis, depth + 1));
+        seenPhis.pop_back();
+        return mult;
+    }
+
+    if (llvm::CastInst *ci = llvm::dyn_cast<llvm::CastInst>(v)) {
+        if (ci->getOpcode() == llvm::Instruction::SExt ||
+            ci->getOpcode() == llvm::Instruction::ZExt)
+            return lUniformMultiple(ci->getOperand(0), seenPhis, depth + 1);
+        return 1;
+    }
+
+    llvm::BinaryOperator *bop = llvm::dyn_cast<llvm::BinaryOperator>(v);
+    if (bop == NULL)
+        return 1;
+    llvm::Value *op0 = bop->getOperand(0), *op1 = bop->getOperand(1);
+    switch (bop->getOpcode()) {
+    case llvm::Instruction::Add:
+    case llvm::Instruction::Sub:
+        return std::min(lUniformMultiple(op0, seenPhis, depth + 1),
+                        lUniformMultiple(op1, seenPhis, depth + 1));
+    case llvm::Instruction::Mul:
+    case llvm::Instruction::And: {
+        // For an and, the result has (at least) the low zero bits of
+        // either operand.
+        int64_t m0 = lUniformMultiple(op0, seenPhis, depth + 1);
+        int64_t m1 = lUniformMultiple(op1, seenPhis, depth + 1);
+        if (bop->getOpcode() == llvm::Instruction::And)
+            return std::max(m0, m1);
+        return (m0 >= kMaxMultiple / m1) ? kMaxMultiple : m0 * m1;
+    }
+    case llvm::Instruction::Shl: {
+        int64_t shift[ISPC_MAX_NVEC];
+        int nElts = 1;
+        llvm::ConstantInt *ci = llvm::dyn_cast<llvm::ConstantInt>(op1);
+        if (ci != NULL)
+            shift[0] = ci->getSExtValue();
+        else if (!LLVMExtractVectorInts(op1, shift, &nElts))
+            return 1;
+        if (shift[0] < 0 || shift[0] >= 40)
+            return 1;
+        int64_t m = lUniformMultiple(op0, seenPhis, depth + 1);
+        return (m >= (kMaxMultiple >> shift[0])) ? kMaxMultiple : (m << shift[0]);
+    }
+    default:
+        return 1;
+    }
+}
+
+
+/** Returns the value of the given operand if it's a vector with the same
+    constant integer value in all of its elements. */
+static bool
+lGetSplatInt(llvm::Value *v, int vectorLength, int64_t *value) {
+    int64_t vals[ISPC_MAX_NVEC];
+    int nElts;
+    if (!LLVMExtractVectorInts(v, vals, &nElts) || nElts != vectorLength)
+        return false;
+    for (int i = 1; i < nElts; ++i)
+        if (vals[i] != vals[0])
+            return false;
+    *value = vals[0];
+    return true;
+}
+
+
+/** Tries to express each element i of the given integer vector as U+c[i],
+    where U is a value that is the same in all elements and is a multiple
+    of *multiple (a power of two) and the c[i] are compile-time constants.
+    This handles the shifts and masks that come from indexing into soa<>
+    arrays, where (U+c[i])>>n is (U>>n)+(c[i]>>n) as long as U is a
+    multiple of 2^n and the c[i] aren't negative, and similarly for
+    (U+c[i])&(2^n-1).
+ */
+static bool
+lGetLaneOffsets(llvm::Value *v, int vectorLength, int64_t c[],
+                int64_t *multiple, int depth) {
+    if (depth > 16)
+        return false;
+
+    int nElts;
+    if (LLVMExtractVectorInts(v, c, &nElts)) {
+        *multiple = kMaxMultiple;
+        return (nElts == vectorLength);
+    }
+
+    if (LLVMVectorValuesAllEqual(v)) {
+        for (int i = 0; i < vectorLength; ++i)
+            c[i] = 0;
+        std::vector<llvm::PHINode *> seenPhis;
+        *multiple = lUniformMultiple(v, seenPhis);
+        return true;
+    }
+
+    if (llvm::CastInst *ci = llvm::dyn_cast<llvm::CastInst>(v)) {
+        if (ci->getOpcode() != llvm::Instruction::SExt &&
+            ci->getOpcode() != llvm::Instruction::ZExt &&
+            ci->getOpcode() != llvm::Instruction::Trunc)
+            return false;
+        return lGetLaneOffsets(ci->getOperand(0), vectorLength, c, multiple,
+                               depth + 1);
+    }
+
+    llvm::BinaryOperator *bop = llvm::dyn_cast<llvm::BinaryOperator>(v);
+    if (bop == NULL)
+        return false;
+    llvm::Value *op0 = bop->getOperand(0), *op1 = bop->getOperand(1);
+    int64_t c1[ISPC_MAX_NVEC], m1, k;
+
+    switch (bop->getOpcode()) {
+    case llvm::Instruction::Add:
+    case llvm::Instruction::Sub:
+        if (!lGetLaneOffsets(op0, vectorLength, c, multiple, depth + 1) ||
+            !lGetLaneOffsets(op1, vectorLength, c1, &m1, depth + 1))
+            return false;
+        for (int i = 0; i < vectorLength; ++i)
+            c[i] = (bop->getOpcode() == llvm::Instruction::Add) ?
+                (c[i] + c1[i]) : (c[i] - c1[i]);
+        *multiple = std::min(*multiple, m1);
+        return true;
+    case llvm::Instruction::Mul:
+        if (lGetSplatInt(op0, vectorLength, &k))
+            std::swap(op0, op1);
+        else if (!lGetSplatInt(op1, vectorLength, &k))
+            return false;
+        if (k <= 0 || !lGetLaneOffsets(op0, vectorLength, c, multiple, depth + 1))
+            return false;
+        for (int i = 0; i < vectorLength; ++i)
+            c[i] *= k;
+        *multiple = (*multiple >= kMaxMultiple / (k & -k)) ? kMaxMultiple :
+            *multiple * (k & -k);
+        return true;
+    case llvm::Instruction::Shl:
+        if (!lGetSplatInt(op1, vectorLength, &k) || k < 0 || k >= 32 ||
+            !lGetLaneOffsets(op0, vectorLength, c, multiple, depth + 1))
+            return false;
+        for (int i = 0; i < vectorLength; ++i)
+            c[i] <<= k;
+        *multiple = (*multiple >= (kMaxMultiple >> k)) ? kMaxMultiple :
+            (*multiple << k);
+        return true;
+    case llvm::Instruction::AShr:
+    case llvm::Instruction::LShr:
+        if (!lGetSplatInt(op1, vectorLength, &k) || k < 0 || k >= 32 ||
+            !lGetLaneOffsets(op0, vectorLength, c, multiple, depth + 1) ||
+            *multiple < ((int64_t)1 << k))
+            return false;
+        for (int i = 0; i < vectorLength; ++i) {
+            if (c[i] < 0)
+                return false;
+            c[i] >>= k;
+        }
+        if (*multiple < kMaxMultiple)
+            *multiple >>= k;
+        return true;
+    case llvm::Instruction::And:
+        if (lGetSplatInt(op0, vectorLength, &k))
+            std::swap(op0, op1);
+        else if (!lGetSplatInt(op1, vectorLength, &k))
+            return false;
+        // Only masks of the low bits, 2^n-1.
+        if (k < 0 || (k & (k + 1)) != 0 ||
+            !lGetLaneOffsets(op0, vectorLength, c, multiple, depth + 1) ||
+            *multiple < k + 1)
+            return false;
+        for (int i = 0; i < vectorLength; ++i)
+            c[i] &= k;
+        *multiple = kMaxMultiple;
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+bool
+LLVMVectorLaneOffsets(llvm::Value *v, int64_t offsets[]) {
+    llvm::VectorType *vt =
+        llvm::dyn_cast<llvm::VectorType>(v->getType());
+    Assert(vt != NULL);
+    int vectorLength = vt->getNumElements();
+
+    int64_t multiple;
+    if (!lGetLaneOffsets(v, vectorLength, offsets, &multiple, 0))
+        return false;
+    for (int i = vectorLength - 1; i >= 0; --i)
+        offsets[i] -= offsets[0];
+    return true;
+}
+
+
 static void
 lDumpValue(llvm::Value *v, std::set<llvm::Value *> &done) {
     if (done.find(v) != done.end())
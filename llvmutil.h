@@ -244,6 +244,16 @@ extern bool LLVMVectorValuesAllEqual(llvm::Value *v,
     */
 extern bool LLVMVectorIsLinear(llvm::Value *v, int stride);
 
+/** Given a vector of integer-typed values, this function returns true if
+    it can determine that the difference between each element and the
+    first one is a compile-time constant, which is then stored in
+    offsets[i].  (Thus offsets[0] is always zero.)  This handles the
+    index computations for accessing soa<> data with a linear sequence of
+    indices, which are piecewise linear when the soa width is smaller than
+    the vector width.
+    */
+extern bool LLVMVectorLaneOffsets(llvm::Value *v, int64_t offsets[]);
+
 /** Given a vector-typed value v, if the vector is a vector with constant
     element values, this function extracts those element values into the
     ret[] array and returns the number of elements (i.e. the vector type's
@@ -41,10 +41,18 @@
 #include "type.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #ifdef ISPC_IS_WINDOWS
   #include <time.h>
 #else
+  #include <errno.h>
+  #include <signal.h>
   #include <unistd.h>
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/un.h>
+  #include <sys/wait.h>
+  #include "ispc_server.h"
 #endif // ISPC_IS_WINDOWS
 #include <llvm/Support/Signals.h>
 #include <llvm/Support/TargetRegistry.h>
@@ -81,6 +89,29 @@ lPrintVersion() {
 }
 
 
+/** Returns the given output file name with each "%" replaced by the name
+    of the source file, less its directory and its extension. */
+static std::string
+lExpandOutputName(const char *pattern, const char *srcFile) {
+    std::string base = srcFile;
+    size_t slash = base.find_last_of("/\\");
+    if (slash != std::string::npos)
+        base = base.substr(slash + 1);
+    size_t dot = base.rfind('.');
+    if (dot != std::string::npos && dot > 0)
+        base = base.substr(0, dot);
+
+    std::string name;
+    for (const char *p = pattern; *p != '\0'; ++p) {
+        if (*p == '%')
+            name += base;
+        else
+            name += *p;
+    }
+    return name;
+}
+
+
 static void
 usage(int ret) {
     lPrintVersion();
@@ -90,7 +121,9 @@ usage(int ret) {
     printf("                          \t\ton 64-bit target architectures.)\n");
     printf("    [--arch={%s}]\t\tSelect target architecture\n",
            Target::SupportedArchs());
+    printf("    [--cache-dir=<dir>]\t\t\tReuse the outputs of identical earlier compilations stored in <dir>\n");
     printf("    [--c++-include-file=<name>]\t\tSpecify name of file to emit in #include statement in generated C++ code.\n");
+    printf("    [--c++-split=<n>]\t\tDistribute emitted C++ function definitions across <n> files sharing one header\n");
 #ifndef ISPC_IS_WINDOWS
     printf("    [--colored-output]\t\tAlways use terminal colors in error/warning messages.\n");
 #endif
@@ -101,6 +134,12 @@ usage(int ret) {
     PrintWithWordBreaks(cpuHelp, 16, TerminalWidth(), stdout);
     printf("    [-D<foo>]\t\t\t\t#define given value when running preprocessor\n");
     printf("    [--dev-stub <filename>]\t\tEmit device-side offload stub functions to file\n");
+    printf("    [--dispatch=<option>]\t\tSelect how multi-target exported functions pick a target\n");
+    printf("        check\t\t\t\tCheck the system's ISA on every call (default)\n");
+    printf("        table\t\t\t\tResolve each function on its first call and cache the choice\n");
+    printf("        ifunc\t\t\t\tResolve each function when the program is loaded (ELF only)\n");
+    printf("        autotune[=<n>]\t\t\tTime each runnable target on the first <n> calls (default 8),\n");
+    printf("        \t\t\t\tthen call the fastest; cached in $ISPC_AUTOTUNE_CACHE if set\n");
 #ifdef ISPC_IS_WINDOWS
     printf("    [--dllexport]\t\t\tMake non-static functions DLL exported.  Windows only.\n");
 #endif
@@ -110,15 +149,30 @@ usage(int ret) {
     printf("    [--emit-asm]\t\t\tGenerate assembly language file as output\n");
     printf("    [--emit-c++]\t\t\tEmit a C++ source file as output\n");
     printf("    [--emit-llvm]\t\t\tEmit LLVM bitode file as output\n");
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9
+    printf("    [--emit-llvm-thinlto]\t\tEmit LLVM bitcode with a ThinLTO summary, for \"clang -flto=thin\"\n");
+#endif
     printf("    [--emit-obj]\t\t\tGenerate object file file as output (default)\n");
+    printf("    [--emit-perf-report=<file>]\t\tWrite the gathers, scatters, masked stores, calls and estimated cost of each exported function to <file>\n");
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9
+    printf("    [--fat-object]\t\t\tEmit the code for all of the targets to a single output file\n");
+#endif
     printf("    [--force-alignment=<value>]\t\tForce alignment in memory allocations routine to be <value>\n");
     printf("    [-g]\t\t\t\tGenerate source-level debug information\n");
+    printf("    [-gline-tables-only]\t\tGenerate only line number and function debug information\n");
     printf("    [--help]\t\t\t\tPrint help\n");
     printf("    [--help-dev]\t\t\tPrint help for developer options\n");
     printf("    [--host-stub <filename>]\t\tEmit host-side offload stub functions to file\n");
     printf("    [-h <name>/--header-outfile=<name>]\tOutput filename for header\n");
     printf("    [-I <path>]\t\t\t\tAdd <path> to #include file search path\n");
     printf("    [--instrument]\t\t\tEmit instrumentation to gather performance data\n");
+    printf("    [--instrument=occupancy]\t\tKeep per-thread histograms of active program instances at instrumentation points\n");
+#ifndef ISPC_IS_WINDOWS
+    printf("    [--jobs=<n>]\t\t\tOptimize and compile up to <n> targets in parallel in multi-target compilation\n");
+    printf("                \t\t\tand split object file generation into up to <n> parallel parts\n");
+    printf("                \t\t\t(native objects only; uses the host's \"ld -r\")\n");
+#endif
+
     printf("    [--math-lib=<option>]\t\tSelect math library\n");
     printf("        default\t\t\t\tUse ispc's built-in math functions\n");
     printf("        fast\t\t\t\tUse high-performance but lower-accuracy math functions\n");
@@ -130,27 +184,46 @@ usage(int ret) {
     printf("    [--nocpp]\t\t\t\tDon't run the C preprocessor\n");
     printf("    [-o <name>/--outfile=<name>]\tOutput filename (may be \"-\" for standard output)\n");
     printf("    [-O0/-O(1/2/3)]\t\t\tSet optimization level (off or on). Optimizations are on by default.\n");
+    printf("    [-Os/-Oz]\t\t\t\tOptimize, favoring smaller code (-Oz: even smaller, at some cost in speed)\n");
     printf("    [--opt=<option>]\t\t\tSet optimization option\n");
     printf("        disable-assertions\t\tRemove assertion statements from final code.\n");
     printf("        disable-fma\t\t\tDisable 'fused multiply-add' instructions (on targets that support them)\n");
     printf("        disable-loop-unroll\t\tDisable loop unrolling.\n");
     printf("        fast-masked-vload\t\tFaster masked vector loads on SSE (may go past end of array)\n");
     printf("        fast-math\t\t\tPerform non-IEEE-compliant optimizations of numeric expressions\n");
+    printf("        fast-math=<list>\t\tOnly the listed parts of fast-math: reassoc, contract, rcp-approx[=<steps>]\n");
     printf("        force-aligned-memory\t\tAlways issue \"aligned\" vector load and store instructions\n");
+    printf("        pointers-may-alias\t\tOnly assume that pointer parameters declared \"noalias\" don't alias\n");
+    printf("        prefetch-gathers[=<n>]\t\tPrefetch for gathers with indices loaded in loops, <n> iterations ahead\n");
+    printf("        scratch-locals=<n>\t\tKeep local variables over <n> bytes in reused thread-local storage, not on the stack\n");
+    printf("        select-width\t\t\tWith several gang sizes of one target, dispatch each function to the fastest\n");
+    printf("        sparse-gathers=<n>\t\tUse scalar loads/stores for hardware gathers/scatters with at most <n> active lanes\n");
+    printf("    [--opt-remarks=<file>]\t\tWrite YAML remarks about gather/scatter optimizations and performance warnings to <file>\n");
+    printf("    [--profile-use=<file>]\t\tChoose coherent or non-coherent code for varying \"if\"s using an --instrument=occupancy profile\n");
 #ifndef ISPC_IS_WINDOWS
     printf("    [--pic]\t\t\t\tGenerate position-independent code\n");
 #endif // !ISPC_IS_WINDOWS
     printf("    [--quiet]\t\t\t\tSuppress all output\n");
+#ifndef ISPC_IS_WINDOWS
+    printf("    [--server[=<socket>]]\t\tRun a compile server for ispc-client, with the given target(s) preloaded\n");
+#endif // !ISPC_IS_WINDOWS
     printf("    ");
     char targetHelp[2048];
-    sprintf(targetHelp, "[--target=<t>]\t\t\tSelect target ISA and width.\n"
+    sprintf(targetHelp, "[--target=<t>]\t\t\tSelect target ISA and width.  "
+            "A comma-separated list compiles a variant for each, and with "
+            "<t>:<cpu>, a variant is tuned for that CPU.\n"
             "<t>={%s}", Target::SupportedTargets());
     PrintWithWordBreaks(targetHelp, 24, TerminalWidth(), stdout);
+    printf("    [--time-report[=<file>]]\t\tReport time spent in each compilation phase and optimization pass\n");
+    printf("        \t\t\t\t\t(summary to stderr, or per-function details as JSON to <file>)\n");
+    printf("    [--trace-memory]\t\t\tCall ISPCTraceMemory() with the addresses of each load, store, gather and scatter\n");
     printf("    [--version]\t\t\t\tPrint ispc version\n");
     printf("    [--werror]\t\t\t\tTreat warnings as errors\n");
     printf("    [--woff]\t\t\t\tDisable warnings\n");
     printf("    [--wno-perf]\t\t\tDon't issue warnings related to performance-related issues\n");
     printf("    <file to compile or \"-\" for stdin>\n");
+    printf("    (Several files may be compiled at once; then each output file name must contain\n");
+    printf("     \"%%\", which is replaced by the source file's name without its directory or extension)\n");
     exit(ret);
 }
 
@@ -164,16 +237,25 @@ devUsage(int ret) {
     printf("    [--fuzz-test]\t\t\tRandomly perturb program input to test error conditions\n");
     printf("    [--fuzz-seed=<value>]\t\tSeed value for RNG for fuzz testing\n");
     printf("    [--opt=<option>]\t\t\tSet optimization option\n");
+    printf("        disable-all-on-clones\t\t\tDisable copying functions for calls with an \"all on\" mask\n");
     printf("        disable-all-on-optimizations\t\tDisable optimizations that take advantage of \"all on\" mask\n");
     printf("        disable-blended-masked-stores\t\tScalarize masked stores on SSE (vs. using vblendps)\n");
     printf("        disable-blending-removal\t\tDisable eliminating blend at same scope\n");
     printf("        disable-coalescing\t\t\tDisable gather coalescing\n");
     printf("        disable-coherent-control-flow\t\tDisable coherent control flow optimizations\n");
+    printf("        disable-foreach-unswitching\t\tDisable hoisting uniform \"if\" tests out of foreach loops\n");
+    printf("        disable-function-specialization\tDisable copying functions for calls with constant uniform arguments\n");
     printf("        disable-gather-scatter-flattening\tDisable flattening when all lanes are on\n");
     printf("        disable-gather-scatter-optimizations\tDisable improvements to gather/scatter\n");
+    printf("        disable-gather-to-permute\t\tDisable vector loads and permutes for gathers from small tables\n");
     printf("        disable-handle-pseudo-memory-ops\tLeave __pseudo_* calls for gather/scatter/etc. in final IR\n");
+    printf("        disable-reduction-vectorization\tDisable vector accumulators for reductions in loops\n");
+    printf("        disable-strided-memory-ops\t\tDisable vector loads/stores for strided gathers/scatters\n");
+    printf("        disable-switch-dispatch\t\tDisable skipping to the labels in use in varying \"switch\" statements\n");
     printf("        disable-uniform-control-flow\t\tDisable uniform control flow optimizations\n");
     printf("        disable-uniform-memory-optimizations\tDisable uniform-based coherent memory access\n");
+    printf("        disable-uniform-scalarization\t\tDisable scalar computation of varying values that are the same for all program instances\n");
+    printf("        disable-vector-division		Disable vector code for varying integer divisions and remainders\n");
     printf("    [--yydebug]\t\t\t\tPrint debugging information during parsing\n");
     printf("    [--debug-phase=<value>]\t\tSet optimization phases to dump. --debug-phase=first,210:220,300,305,310:last\n");
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_4 || ISPC_LLVM_VERSION == ISPC_LLVM_3_5 // 3.4, 3.5
@@ -188,11 +270,10 @@ devUsage(int ret) {
     ISPC_ARGS environment variable.  This function returns a new set of
     arguments representing the ones from those two sources merged together.
 */
-static void lGetAllArgs(int Argc, char *Argv[], int &argc, char *argv[128]) {
+static void lGetAllArgs(int Argc, char *Argv[], std::vector<char *> &argv) {
     // Copy over the command line arguments (passed in)
     for (int i = 0; i < Argc; ++i)
-        argv[i] = Argv[i];
-    argc = Argc;
+        argv.push_back(Argv[i]);
 
     // See if we have any set via the environment variable
     const char *env = getenv("ISPC_ARGS");
@@ -213,7 +294,7 @@ static void lGetAllArgs(int Argc, char *Argv[], int &argc, char *argv[128]) {
         ptr[len] = '\0';
 
         // Add it to the args array and get out of here
-        argv[argc++] = ptr;
+        argv.push_back(ptr);
         if (*end == '\0')
             break;
 
@@ -300,15 +381,267 @@ lParseInclude(const char *path) {
 }
 
 
-int main(int Argc, char *Argv[]) {
-    int argc;
-    char *argv[128];
-    lGetAllArgs(Argc, Argv, argc, argv);
+/** Handles the comma-separated list given to --opt=fast-math=. */
+static void
+lParseFastMath(const char *list) {
+    std::string str_list(list);
+    size_t pos = 0, pos_end;
+    do {
+        pos_end = str_list.find(',', pos);
+        std::string item = str_list.substr(pos, (pos_end == std::string::npos) ?
+                                           std::string::npos : (pos_end - pos));
+        if (item == "reassoc")
+            g->opt.fastMathReassoc = true;
+        else if (item == "contract")
+            // Fused multiply-adds are formed unless --opt=disable-fma is
+            // given, so this just undoes an earlier one.
+            g->opt.disableFMA = false;
+        else if (item == "rcp-approx")
+            g->opt.fastMathRcpApprox = true;
+        else if (!strncmp(item.c_str(), "rcp-approx=", 11)) {
+            g->opt.fastMathRcpApprox = true;
+            g->opt.fastMathRcpSteps = atoi(item.c_str() + 11);
+            if (g->opt.fastMathRcpSteps != 0 && g->opt.fastMathRcpSteps != 1) {
+                fprintf(stderr, "Invalid number of Newton-Raphson steps \"%s\" "
+                        "for --opt=fast-math=rcp-approx (must be 0 or 1).\n",
+                        item.c_str() + 11);
+                usage(1);
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown --opt=fast-math= item \"%s\".\n",
+                    item.c_str());
+            usage(1);
+        }
+        pos = pos_end + 1;
+    } while (pos_end != std::string::npos);
+}
+
+
+static int lCompile(int Argc, char *Argv[]);
+
+
+/** Returns the socket that "ispc --server" listens on when no other one is
+    given, or NULL (after reporting why) if there's no safe default; see
+    lGetServerSocket() in ispc_server.h, which ispc-client also uses. */
+static const char *
+lDefaultServerSocket() {
+#ifdef ISPC_IS_WINDOWS
+    return "ispc-server";
+#else
+    static std::string path;
+    std::string error;
+    if (!lGetServerSocket(&path, &error)) {
+        fprintf(stderr, "Unable to choose a socket for the server: %s.\n",
+                error.c_str());
+        return NULL;
+    }
+    return path.c_str();
+#endif // ISPC_IS_WINDOWS
+}
+
+
+#ifndef ISPC_IS_WINDOWS
+/** In the processes that a compile server starts for its requests, the
+    LLVM context of the server, which they use so that they can link in the
+    builtins bitcode that the server has already parsed. */
+static llvm::LLVMContext *lServerContext = NULL;
+
+
+static bool
+lReadFully(int fd, void *buf, size_t size) {
+    char *ptr = (char *)buf;
+    while (size > 0) {
+        ssize_t n = read(fd, ptr, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+
+/** Handles a single request to a compile server, in a process of its own.
+    The client sends the length of the rest of the request along with its
+    standard input, output and error file descriptors, and then its
+    working directory, its ISPC_ARGS environment variable and its command
+    line as NUL-terminated strings; once the compilation is done, the exit
+    status is sent back as a 32-bit integer.  The compilation itself runs
+    in a further child process, so that it can exit() (e.g. on a command
+    line error) or crash without the request going unanswered. */
+static int
+lServeRequest(int conn) {
+    signal(SIGCHLD, SIG_DFL);
+
+    uint32_t length;
+    int fds[3];
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov;
+    iov.iov_base = &length;
+    iov.iov_len = sizeof(length);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (recvmsg(conn, &msg, MSG_WAITALL) != sizeof(length) ||
+        length > ISPC_SERVER_MAX_REQUEST)
+        return 1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+        return 1;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    std::vector<char> request(length + 1, '\0');
+    if (!lReadFully(conn, &request[0], length))
+        return 1;
+    std::vector<char *> strings;
+    for (uint32_t pos = 0; pos < length; pos += strlen(&request[pos]) + 1)
+        strings.push_back(&request[pos]);
+    if (strings.size() < 3)
+        return 1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(conn);
+        for (int i = 0; i < 3; ++i) {
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+        if (chdir(strings[0]) != 0) {
+            fprintf(stderr, "Unable to change to directory \"%s\": %s\n",
+                    strings[0], strerror(errno));
+            exit(1);
+        }
+        if (*strings[1] != '\0')
+            setenv("ISPC_ARGS", strings[1], 1);
+        else
+            unsetenv("ISPC_ARGS");
+        lServerContext = g->ctx;
+        exit(lCompile((int)strings.size() - 2, &strings[2]));
+    }
+    for (int i = 0; i < 3; ++i)
+        close(fds[i]);
+
+    int32_t result = 1;
+    int status;
+    if (pid > 0) {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        if (WIFEXITED(status))
+            result = WEXITSTATUS(status);
+        else if (WIFSIGNALED(status))
+            result = 128 + WTERMSIG(status);
+    }
+    if (write(conn, &result, sizeof(result)) != sizeof(result))
+        return 1;
+    return 0;
+}
+
+
+/** Runs a compile server (--server): after compiling an empty program for
+    the targets given on its command line, so that their builtins bitcode
+    is parsed and kept in memory, it listens on the given Unix domain
+    socket for compilation requests from ispc-client and handles each one
+    in a process forked from it, so that they start with everything that
+    was set up already and can run concurrently. */
+static int
+lRunServer(const char *socketPath, const char *arch, const char *cpu,
+           const char *target, bool generatePIC) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path \"%s\" is too long.\n", socketPath);
+        return 1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "An ispc server is already listening on \"%s\".\n",
+                socketPath);
+        return 1;
+    }
+    close(sock);
+
+    g->reuseBuiltinBitcode = true;
+    char warmUpFile[] = "/tmp/ispc-server-XXXXXX.ispc";
+    int fd = mkstemps(warmUpFile, 5);
+    if (fd < 0) {
+        perror("mkstemps");
+        return 1;
+    }
+    close(fd);
+    int ret = Module::CompileAndOutput(warmUpFile, arch, cpu, target,
+                                       generatePIC, Module::Bitcode, NULL,
+                                       NULL, NULL, NULL, NULL, NULL);
+    unlink(warmUpFile);
+    if (ret != 0)
+        return ret;
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath);
+    // Only this user may connect.
+    mode_t mask = umask(0077);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(sock, 64) != 0) {
+        umask(mask);
+        fprintf(stderr, "Unable to listen on \"%s\": %s\n", socketPath,
+                strerror(errno));
+        return 1;
+    }
+    umask(mask);
+
+    // The processes that handle the requests are reaped automatically.
+    signal(SIGCHLD, SIG_IGN);
+    if (!g->quiet)
+        fprintf(stderr, "ispc server listening on \"%s\".\n", socketPath);
+
+    while (true) {
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            return 1;
+        }
+        // Only requests from the user that runs the server are handled.
+        if (!lPeerIsCurrentUser(conn)) {
+            close(conn);
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sock);
+            exit(lServeRequest(conn));
+        }
+        else if (pid < 0)
+            perror("fork");
+        close(conn);
+    }
+}
+#endif // !ISPC_IS_WINDOWS
+
 
+int main(int Argc, char *Argv[]) {
     llvm::sys::AddSignalHandler(lSignal, NULL);
 
     // initialize available LLVM targets
-#ifndef __arm__
+#if !defined(__arm__) && !defined(__aarch64__)
     // FIXME: LLVM build on ARM doesn't build the x86 targets by default.
     // It's not clear that anyone's going to want to generate x86 from an
     // ARM host, though...
@@ -328,6 +661,13 @@ int main(int Argc, char *Argv[]) {
     LLVMInitializeARMAsmParser();
     LLVMInitializeARMDisassembler();
     LLVMInitializeARMTargetMC();
+
+    LLVMInitializeAArch64TargetInfo();
+    LLVMInitializeAArch64Target();
+    LLVMInitializeAArch64AsmPrinter();
+    LLVMInitializeAArch64AsmParser();
+    LLVMInitializeAArch64Disassembler();
+    LLVMInitializeAArch64TargetMC();
 #endif
 
 #ifdef ISPC_NVPTX_ENABLED
@@ -337,16 +677,39 @@ int main(int Argc, char *Argv[]) {
     LLVMInitializeNVPTXTargetMC();
 #endif /* ISPC_NVPTX_ENABLED */
 
-    char *file = NULL;
+    return lCompile(Argc, Argv);
+}
+
+
+/** Parses the command line and does the compilation that it describes;
+    called by main() and, with each request's command line, by the
+    processes that a compile server (see --server) starts. */
+static int
+lCompile(int Argc, char *Argv[]) {
+    std::vector<char *> allArgs;
+    lGetAllArgs(Argc, Argv, allArgs);
+    int argc = (int)allArgs.size();
+    char **argv = &allArgs[0];
+
+    std::vector<char *> files;
     const char *headerFileName = NULL;
     const char *outFileName = NULL;
     const char *includeFileName = NULL;
     const char *depsFileName = NULL;
     const char *hostStubFileName = NULL;
     const char *devStubFileName = NULL;
+    const char *serverSocket = NULL;
     // Initiailize globals early so that we can set various option values
     // as we're parsing below
     g = new Globals;
+#ifndef ISPC_IS_WINDOWS
+    if (lServerContext != NULL) {
+        // Use the server's context, which its parsed builtins belong to.
+        delete g->ctx;
+        g->ctx = lServerContext;
+        g->reuseBuiltinBitcode = true;
+    }
+#endif // !ISPC_IS_WINDOWS
 
     Module::OutputType ot = Module::Object;
     bool generatePIC = false;
@@ -375,6 +738,8 @@ int main(int Argc, char *Argv[]) {
             arch = argv[i] + 7;
         else if (!strncmp(argv[i], "--cpu=", 6))
             cpu = argv[i] + 6;
+        else if (!strncmp(argv[i], "--cache-dir=", 12))
+            g->cacheDir = argv[i] + 12;
         else if (!strcmp(argv[i], "--fast-math")) {
             fprintf(stderr, "--fast-math option has been renamed to --opt=fast-math!\n");
             usage(1);
@@ -409,8 +774,31 @@ int main(int Argc, char *Argv[]) {
             g->NoOmitFramePointer = true;
         else if (!strcmp(argv[i], "--instrument"))
             g->emitInstrumentation = true;
+        else if (!strcmp(argv[i], "--instrument=occupancy"))
+            g->emitOccupancyProfile = true;
+        else if (!strcmp(argv[i], "--trace-memory"))
+            g->emitMemoryTrace = true;
+        else if (!strncmp(argv[i], "--opt-remarks=", 14)) {
+            if (!OpenOptRemarksFile(argv[i] + 14))
+                return 1;
+        }
+        else if (!strncmp(argv[i], "--profile-use=", 14)) {
+            if (!ReadOccupancyProfile(argv[i] + 14))
+                return 1;
+        }
+        else if (!strcmp(argv[i], "--time-report"))
+            g->timeReport = true;
+        else if (!strncmp(argv[i], "--time-report=", 14)) {
+            g->timeReport = true;
+            g->timeReportFile = argv[i] + 14;
+        }
         else if (!strcmp(argv[i], "-g")) {
             g->generateDebuggingSymbols = true;
+            g->debugLineTablesOnly = false;
+        }
+        else if (!strcmp(argv[i], "-gline-tables-only")) {
+            g->generateDebuggingSymbols = true;
+            g->debugLineTablesOnly = true;
         }
         else if (!strcmp(argv[i], "--emit-asm"))
             ot = Module::Asm;
@@ -418,8 +806,28 @@ int main(int Argc, char *Argv[]) {
             ot = Module::CXX;
         else if (!strcmp(argv[i], "--emit-llvm"))
             ot = Module::Bitcode;
+        else if (!strcmp(argv[i], "--emit-llvm-thinlto")) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9
+            ot = Module::Bitcode;
+            g->emitThinLTOSummary = true;
+#else
+            fprintf(stderr, "--emit-llvm-thinlto requires LLVM 3.9 or later.\n");
+            usage(1);
+#endif
+        }
         else if (!strcmp(argv[i], "--emit-obj"))
             ot = Module::Object;
+        else if (!strncmp(argv[i], "--emit-perf-report=", 19)) {
+            // Each target appends its part of the report, so start with
+            // an empty file.
+            g->perfReportFile = argv[i] + 19;
+            FILE *f = fopen(g->perfReportFile, "w");
+            if (f == NULL) {
+                perror(g->perfReportFile);
+                return 1;
+            }
+            fclose(f);
+        }
         else if (!strcmp(argv[i], "-I")) {
             if (++i == argc) {
                 fprintf(stderr, "No path specified after -I option.\n");
@@ -443,6 +851,32 @@ int main(int Argc, char *Argv[]) {
         }
         else if (!strncmp(argv[i], "--target=", 9))
             target = argv[i] + 9;
+        else if (!strcmp(argv[i], "--fat-object"))
+            g->fatObject = true;
+        else if (!strncmp(argv[i], "--dispatch=", 11)) {
+            const char *mode = argv[i] + 11;
+            if (!strcmp(mode, "check"))
+                g->dispatchMode = Globals::Dispatch_Check;
+            else if (!strcmp(mode, "table"))
+                g->dispatchMode = Globals::Dispatch_Table;
+            else if (!strcmp(mode, "ifunc"))
+                g->dispatchMode = Globals::Dispatch_IFunc;
+            else if (!strcmp(mode, "autotune"))
+                g->dispatchMode = Globals::Dispatch_Autotune;
+            else if (!strncmp(mode, "autotune=", 9)) {
+                g->dispatchMode = Globals::Dispatch_Autotune;
+                g->autotuneCalls = atoi(mode + 9);
+                if (g->autotuneCalls <= 0) {
+                    fprintf(stderr, "Invalid number of calls \"%s\" for "
+                            "--dispatch=autotune.\n", mode + 9);
+                    usage(1);
+                }
+            }
+            else {
+                fprintf(stderr, "Unknown --dispatch= option \"%s\".\n", mode);
+                usage(1);
+            }
+        }
         else if (!strncmp(argv[i], "--math-lib=", 11)) {
             const char *lib = argv[i] + 11;
             if (!strcmp(lib, "default"))
@@ -461,7 +895,10 @@ int main(int Argc, char *Argv[]) {
         else if (!strncmp(argv[i], "--opt=", 6)) {
             const char *opt = argv[i] + 6;
             if (!strcmp(opt, "fast-math"))
-                g->opt.fastMath = true;
+                g->opt.fastMath = g->opt.fastMathReassoc =
+                    g->opt.fastMathRcpApprox = true;
+            else if (!strncmp(opt, "fast-math=", 10))
+                lParseFastMath(opt + 10);
             else if (!strcmp(opt, "fast-masked-vload"))
                 g->opt.fastMaskedVload = true;
             else if (!strcmp(opt, "disable-assertions"))
@@ -472,13 +909,48 @@ int main(int Argc, char *Argv[]) {
                 g->opt.disableFMA = true;
             else if (!strcmp(opt, "force-aligned-memory"))
                 g->opt.forceAlignedMemory = true;
+            else if (!strcmp(opt, "pointers-may-alias"))
+                g->opt.pointersMayAlias = true;
+            else if (!strcmp(opt, "prefetch-gathers"))
+                g->opt.prefetchGatherDistance = -1;
+            else if (!strncmp(opt, "scratch-locals=", 15))
+                g->opt.scratchLocalsThreshold = atoi(opt + 15);
+            else if (!strncmp(opt, "prefetch-gathers=", 17)) {
+                g->opt.prefetchGatherDistance = atoi(opt + 17);
+                if (g->opt.prefetchGatherDistance < 1) {
+                    fprintf(stderr, "Invalid prefetch distance \"%s\".\n", opt + 17);
+                    usage(1);
+                }
+            }
+            else if (!strcmp(opt, "select-width"))
+                g->opt.selectWidth = true;
+            else if (!strncmp(opt, "sparse-gathers=", 15))
+                g->opt.sparseGatherThreshold = atoi(opt + 15);
 
             // These are only used for performance tests of specific
             // optimizations
             else if (!strcmp(opt, "disable-all-on-optimizations"))
                 g->opt.disableMaskAllOnOptimizations = true;
+            else if (!strcmp(opt, "disable-all-on-clones"))
+                g->opt.disableAllOnClones = true;
             else if (!strcmp(opt, "disable-coalescing"))
                 g->opt.disableCoalescing = true;
+            else if (!strcmp(opt, "disable-function-specialization"))
+                g->opt.disableFunctionSpecialization = true;
+            else if (!strcmp(opt, "disable-strided-memory-ops"))
+                g->opt.disableStridedMemoryOps = true;
+            else if (!strcmp(opt, "disable-gather-to-permute"))
+                g->opt.disableGatherToPermute = true;
+            else if (!strcmp(opt, "disable-uniform-scalarization"))
+                g->opt.disableUniformScalarization = true;
+            else if (!strcmp(opt, "disable-reduction-vectorization"))
+                g->opt.disableReductionVectorization = true;
+            else if (!strcmp(opt, "disable-switch-dispatch"))
+                g->opt.disableSwitchDispatch = true;
+            else if (!strcmp(opt, "disable-foreach-unswitching"))
+                g->opt.disableForeachUnswitching = true;
+            else if (!strcmp(opt, "disable-vector-division"))
+                g->opt.disableVectorDivision = true;
             else if (!strcmp(opt, "disable-handle-pseudo-memory-ops"))
                 g->opt.disableHandlePseudoMemoryOps = true;
             else if (!strcmp(opt, "disable-blended-masked-stores"))
@@ -503,6 +975,15 @@ int main(int Argc, char *Argv[]) {
         else if (!strncmp(argv[i], "--force-alignment=", 18)) {
             g->forceAlignment = atoi(argv[i] + 18);
         }
+#ifndef ISPC_IS_WINDOWS
+        else if (!strncmp(argv[i], "--jobs=", 7)) {
+            g->numJobs = atoi(argv[i] + 7);
+            if (g->numJobs < 1) {
+                fprintf(stderr, "Invalid number of jobs \"%s\".\n", argv[i] + 7);
+                usage(1);
+            }
+        }
+#endif // !ISPC_IS_WINDOWS
         else if (!strcmp(argv[i], "--woff") || !strcmp(argv[i], "-woff")) {
             g->disableWarnings = true;
             g->emitPerfWarnings = false;
@@ -535,12 +1016,25 @@ int main(int Argc, char *Argv[]) {
         else if (!strncmp(argv[i], "--c++-include-file=", 19)) {
             includeFileName = argv[i] + strlen("--c++-include-file=");
         }
+        else if (!strncmp(argv[i], "--c++-split=", 12)) {
+            g->cxxSplitCount = atoi(argv[i] + 12);
+            if (g->cxxSplitCount <= 0) {
+                fprintf(stderr, "Invalid number of files \"%s\" for "
+                        "--c++-split.\n", argv[i] + 12);
+                usage(1);
+            }
+        }
         else if (!strcmp(argv[i], "-O0")) {
             g->opt.level = 0;
         }
         else if (!strcmp(argv[i], "-O") ||  !strcmp(argv[i], "-O1") ||
                  !strcmp(argv[i], "-O2") || !strcmp(argv[i], "-O3")) {
             g->opt.level = 1;
+            g->opt.sizeLevel = 0;
+        }
+        else if (!strcmp(argv[i], "-Os") || !strcmp(argv[i], "-Oz")) {
+            g->opt.level = 1;
+            g->opt.sizeLevel = (argv[i][2] == 's') ? 1 : 2;
         }
         else if (!strcmp(argv[i], "-"))
             ;
@@ -556,6 +1050,13 @@ int main(int Argc, char *Argv[]) {
 #endif // !ISPC_IS_WINDOWS
         else if (!strcmp(argv[i], "--quiet"))
             g->quiet = true;
+        else if (!strcmp(argv[i], "--server")) {
+            serverSocket = lDefaultServerSocket();
+            if (serverSocket == NULL)
+                return 1;
+        }
+        else if (!strncmp(argv[i], "--server=", 9))
+            serverSocket = argv[i] + 9;
         else if (!strcmp(argv[i], "--yydebug")) {
             extern int yydebug;
             yydebug = 1;
@@ -604,15 +1105,37 @@ int main(int Argc, char *Argv[]) {
             fprintf(stderr, "Unknown option \"%s\".\n", argv[i]);
             usage(1);
         }
-        else {
-            if (file != NULL) {
+        else
+            files.push_back(argv[i]);
+    }
+
+    const char *outputNames[] = { outFileName, headerFileName, depsFileName,
+                                  hostStubFileName, devStubFileName };
+    if (files.size() > 1) {
+        for (int i = 0; i < 5; ++i)
+            if (outputNames[i] != NULL && strchr(outputNames[i], '%') == NULL) {
                 fprintf(stderr, "Multiple input files specified on command "
-                        "line: \"%s\" and \"%s\".\n", file, argv[i]);
+                        "line, but the output file name \"%s\" doesn't "
+                        "contain \"%%\".\n", outputNames[i]);
                 usage(1);
             }
-            else
-                file = argv[i];
+        g->reuseBuiltinBitcode = true;
+    }
+    else if (files.empty())
+        files.push_back(NULL);
+
+    if (serverSocket != NULL) {
+#ifdef ISPC_IS_WINDOWS
+        fprintf(stderr, "\"--server\" isn't supported on Windows.\n");
+        return 1;
+#else
+        if (lServerContext != NULL) {
+            fprintf(stderr, "\"--server\" can't be used in a request to a "
+                    "compile server.\n");
+            return 1;
         }
+        return lRunServer(serverSocket, arch, cpu, target, generatePIC);
+#endif // ISPC_IS_WINDOWS
     }
 
     if (g->enableFuzzTest) {
@@ -633,6 +1156,36 @@ int main(int Argc, char *Argv[]) {
 #endif
     }
 
+    if (g->cacheDir != NULL) {
+        // The cache key starts with the compiler version and all of the
+        // options other than the ones that only affect how (rather than
+        // what) we compile; the preprocessed source and the target are
+        // added to it for each compilation.  Fuzz testing randomizes the
+        // program, so it can't be cached.
+        if (g->enableFuzzTest || !g->runCPP)
+            g->cacheDir = NULL;
+        else {
+            g->cacheFlags = std::string("ispc ") + ISPC_VERSION +
+#ifndef ISPC_IS_WINDOWS
+                " " + BUILD_VERSION +
+#endif
+                " " + BUILD_DATE + " LLVM " + ISPC_LLVM_VERSION_STRING + "\n";
+            for (int i = 1; i < argc; ++i) {
+                if (!strncmp(argv[i], "--cache-dir=", 12) ||
+                    !strncmp(argv[i], "--jobs=", 7) ||
+                    !strncmp(argv[i], "--time-report", 13))
+                    continue;
+                // The source files are identified by the line markers in
+                // the preprocessed program, which is part of the key.
+                if (std::find(files.begin(), files.end(), argv[i]) !=
+                    files.end())
+                    continue;
+                g->cacheFlags += argv[i];
+                g->cacheFlags += "\n";
+            }
+        }
+    }
+
     if (outFileName == NULL &&
         headerFileName == NULL &&
         depsFileName == NULL &&
@@ -642,12 +1195,33 @@ int main(int Argc, char *Argv[]) {
               "Program will be compiled and warnings/errors will "
               "be issued, but no output will be generated.");
 
-    return Module::CompileAndOutput(file, arch, cpu, target, generatePIC,
-                                    ot,
-                                    outFileName,
-                                    headerFileName,
-                                    includeFileName,
-                                    depsFileName,
-                                    hostStubFileName,
-                                    devStubFileName);
+    // All of the files are compiled in this process one after the other,
+    // so that the LLVM and option setup is only done once for them.  (The
+    // "%" in output file names is only expanded when there's more than one
+    // file, so that a single file's output names are used as given.)
+    int ret = 0;
+    for (unsigned f = 0; f < files.size(); ++f) {
+        std::string names[5];
+        const char *fileOutputNames[5];
+        for (int i = 0; i < 5; ++i) {
+            if (outputNames[i] == NULL || files.size() == 1)
+                fileOutputNames[i] = outputNames[i];
+            else {
+                names[i] = lExpandOutputName(outputNames[i], files[f]);
+                fileOutputNames[i] = names[i].c_str();
+            }
+        }
+
+        if (Module::CompileAndOutput(files[f], arch, cpu, target, generatePIC,
+                                     ot,
+                                     fileOutputNames[0],
+                                     fileOutputNames[1],
+                                     includeFileName,
+                                     fileOutputNames[2],
+                                     fileOutputNames[3],
+                                     fileOutputNames[4]) != 0)
+            ret = 1;
+    }
+    WriteTimeReport();
+    return ret;
 }
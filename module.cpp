@@ -50,6 +50,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <errno.h>
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -64,7 +65,12 @@
 #ifdef ISPC_IS_WINDOWS
 #include <windows.h>
 #include <io.h>
+#include <direct.h>
 #define strcasecmp stricmp
+#else
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
 #endif
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
   #include <llvm/LLVMContext.h>
@@ -114,6 +120,8 @@
     #include <llvm/IR/IRPrintingPasses.h>
     #include <llvm/IR/InstIterator.h>
     #include <llvm/IR/CFG.h>
+    #include <llvm/IR/Dominators.h>
+    #include <llvm/Analysis/LoopInfo.h>
 #else
     #include <llvm/Analysis/Verifier.h>
     #include <llvm/Assembly/PrintModulePass.h>
@@ -127,12 +135,19 @@
 #include <clang/Lex/PreprocessorOptions.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/Host.h>
+#include <llvm/ADT/Triple.h>
 #include <llvm/Support/raw_ostream.h>
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
     #include <llvm/Bitcode/ReaderWriter.h>
 #else
     #include <llvm/Bitcode/BitcodeWriter.h>
 #endif
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+    #include <llvm/Bitcode/BitcodeWriterPass.h>
+    #include <llvm/Transforms/Utils/Cloning.h>
+    #include <llvm/Transforms/Utils/SplitModule.h>
+    #include <llvm/Linker/Linker.h>
+#endif
 
 /*! list of files encountered by the parser. this allows emitting of
     the module file's dependencies via the -MMM option */
@@ -161,6 +176,10 @@ lDeclareSizeAndPtrIntTypes(SymbolTable *symbolTable) {
         AtomicType::VaryingUInt32 : AtomicType::VaryingUInt64;
     sizeType = sizeType->GetAsUnboundVariabilityType();
     symbolTable->AddType("size_t", sizeType, SourcePos());
+
+    // The value of a "launch" expression, which "sync" can wait on.
+    symbolTable->AddType("launch_handle", AtomicType::UniformInt32,
+                         SourcePos());
 }
 
 
@@ -394,8 +413,10 @@ Module::Module(const char *fn) {
 
     filename = fn;
     errorCount = 0;
+    noFPContract = false;
     symbolTable = new SymbolTable;
     ast = new AST;
+    occupancyCounters = occupancyModuleInfo = occupancyRegistered = NULL;
 
     lDeclareSizeAndPtrIntTypes(symbolTable);
 
@@ -439,8 +460,21 @@ Module::Module(const char *fn) {
                                          directory, /* directory */
                                          producerString, /* producer */
                                          g->opt.level > 0 /* is optimized */,
-                                         "-g", /* command line args */
-                                         0 /* run time version */);
+                                         g->debugLineTablesOnly ?
+                                             "-gline-tables-only" : "-g", /* command line args */
+                                         0 /* run time version */
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+                                         , "" /* split name */,
+                                         g->debugLineTablesOnly ?
+                                             llvm::DICompileUnit::LineTablesOnly :
+                                             llvm::DICompileUnit::FullDebug
+#elif ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5 - 3.8
+                                         , "" /* split name */,
+                                         g->debugLineTablesOnly ?
+                                             llvm::DIBuilder::LineTablesOnly :
+                                             llvm::DIBuilder::FullDebug
+#endif
+                                         );
         }
     }
     else
@@ -456,19 +490,74 @@ extern YY_BUFFER_STATE yy_scan_string(const char *);
 extern YY_BUFFER_STATE yy_create_buffer(FILE *, int);
 extern void yy_delete_buffer(YY_BUFFER_STATE);
 
+void
+Module::specializeExportedFunction() {
+    std::vector<Symbol *> funcs;
+    symbolTable->LookupFunction(g->specializedFunction.c_str(), &funcs);
+    Symbol *sym = NULL;
+    for (unsigned int i = 0; i < funcs.size(); ++i)
+        if (funcs[i]->exportedFunction != NULL)
+            sym = funcs[i];
+    if (sym == NULL) {
+        Error(SourcePos(), "Can't specialize \"%s\": no exported function "
+              "with that name.", g->specializedFunction.c_str());
+        return;
+    }
+
+    const FunctionType *ft = CastType<FunctionType>(sym->type);
+    llvm::Function *func = sym->exportedFunction;
+    for (unsigned int i = 0; i < g->specializedParams.size(); ++i) {
+        const Globals::SpecializedParam &param = g->specializedParams[i];
+        if (param.index < 0 || param.index >= ft->GetNumParameters() ||
+            param.index >= (int)func->arg_size()) {
+            Error(sym->pos, "Can't specialize parameter %d of \"%s\": the "
+                  "function only has %d parameters.", param.index,
+                  sym->name.c_str(), ft->GetNumParameters());
+            continue;
+        }
+
+        // Only uniform values of the atomic and enumerant types have a
+        // single scalar value that can be substituted.
+        const Type *paramType = ft->GetParameterType(param.index);
+        if (!paramType->IsUniformType() ||
+            (CastType<AtomicType>(paramType) == NULL &&
+             CastType<EnumType>(paramType) == NULL)) {
+            Error(sym->pos, "Can't specialize parameter \"%s\" of \"%s\": "
+                  "only parameters with uniform atomic or enum types can be "
+                  "specialized.", ft->GetParameterName(param.index).c_str(),
+                  sym->name.c_str());
+            continue;
+        }
+
+        llvm::Function::arg_iterator arg = func->arg_begin();
+        for (int j = 0; j < param.index; ++j)
+            ++arg;
+        llvm::Type *llvmType = arg->getType();
+        llvm::Constant *value;
+        if (llvmType->isFloatingPointTy())
+            value = llvm::ConstantFP::get(llvmType, param.isFloat ?
+                                          param.floatValue : (double)param.intValue);
+        else
+            value = llvm::ConstantInt::get(llvmType, param.isFloat ?
+                                           (int64_t)param.floatValue : param.intValue,
+                                           true /* signed */);
+        arg->replaceAllUsesWith(value);
+    }
+}
+
+
 int
-Module::CompileFile() {
+Module::CompileFile(bool optimize, bool parseOnCacheHit) {
     extern void ParserInit();
     ParserInit();
 
-    // FIXME: it'd be nice to do this in the Module constructor, but this
-    // function ends up calling into routines that expect the global
-    // variable 'm' to be initialized and available (which it isn't until
-    // the Module constructor returns...)
-    DefineStdlib(symbolTable, g->ctx, module, g->includeStdlib);
-
     bool runPreprocessor = g->runCPP;
 
+    // Preprocess first, so that we can skip everything else (including
+    // setting up the standard library) if the compilation cache already
+    // has the outputs for this source.
+    std::string buffer;
+    llvm::raw_string_ostream os(buffer);
     if (runPreprocessor) {
         if (filename != NULL) {
             // Try to open the file first, since otherwise we crash in the
@@ -481,9 +570,31 @@ Module::CompileFile() {
             fclose(f);
         }
 
-        std::string buffer;
-        llvm::raw_string_ostream os(buffer);
-        execPreprocessor((filename != NULL) ? filename : "-", &os);
+        {
+            TimeReportScope timer("preprocessing");
+            execPreprocessor((filename != NULL) ? filename : "-", &os);
+        }
+
+        // (The --emit-perf-report output is written while optimizing, so
+        // it can't come from the cache.)
+        if (g->cacheDir != NULL && g->perfReportFile == NULL) {
+            lookupCacheEntry(os.str());
+            if (!cacheEntry.empty() && !parseOnCacheHit)
+                return errorCount;
+        }
+    }
+
+    // FIXME: it'd be nice to do this in the Module constructor, but this
+    // function ends up calling into routines that expect the global
+    // variable 'm' to be initialized and available (which it isn't until
+    // the Module constructor returns...)
+    {
+        TimeReportScope timer("builtins and stdlib");
+        DefineStdlib(symbolTable, g->ctx, module, g->includeStdlib);
+    }
+
+    if (runPreprocessor) {
+        TimeReportScope timer("parsing");
         YY_BUFFER_STATE strbuf = yy_scan_string(os.str().c_str());
         yyparse();
         yy_delete_buffer(strbuf);
@@ -500,24 +611,51 @@ Module::CompileFile() {
                 return 1;
             }
         }
+        TimeReportScope timer("parsing");
         yyin = f;
         yy_switch_to_buffer(yy_create_buffer(yyin, 4096));
         yyparse();
         fclose(f);
     }
 
+    {
+        // The definitions of the function templates that were used are
+        // parsed once the whole file has been, so that they can refer to
+        // any of the file's declarations.
+        TimeReportScope timer("template instantiation");
+        extern void InstantiateFunctionTemplates();
+        InstantiateFunctionTemplates();
+    }
+
 #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_7 // LLVM 3.7+
     if (g->NoOmitFramePointer)
         for (llvm::Function& f : *module)
             f.addFnAttr("no-frame-pointer-elim", "true");
 #endif
 
-    ast->GenerateIR();
+    {
+        TimeReportScope timer("IR generation");
+        ast->GenerateIR();
+    }
+
+    if (errorCount == 0 && !g->specializedFunction.empty())
+        specializeExportedFunction();
+
+    if (g->emitOccupancyProfile && errorCount == 0)
+        finalizeOccupancyProfile();
 
     if (diBuilder)
         diBuilder->finalize();
     if (errorCount == 0)
+        RemoveUnusedBuiltins(module);
+    // There's no need to optimize if the cached native code is going to
+    // be used instead, unless --opt=select-width needs the optimized code
+    // to choose the gang size.
+    if (errorCount == 0 && optimize &&
+        (cacheEntry.empty() || g->opt.selectWidth)) {
+        TimeReportScope timer("optimization");
         Optimize(module, g->opt.level);
+    }
 
     return errorCount;
 }
@@ -532,6 +670,213 @@ Module::AddTypeDef(const std::string &name, const Type *type,
 }
 
 
+void
+Module::AddExportedTypeDef(const std::string &name, const Type *type,
+                           SourcePos pos) {
+    const StructType *st = CastType<StructType>(type);
+    if (st == NULL || st->IsVaryingType()) {
+        Error(pos, "Only uniform and soa<> struct types, not \"%s\", can be "
+              "used with \"export typedef\".", type->GetString().c_str());
+        return;
+    }
+    if (st->GetSOAWidth() == 0)
+        st = st->GetAsUniformType();
+    exportedTypeDefs.push_back(std::make_pair(name, st));
+}
+
+
+int
+Module::AddOccupancySite(const char *note, SourcePos pos) {
+    OccupancySite site;
+    site.file = pos.name ? pos.name : "";
+    site.note = note;
+    site.line = pos.first_line;
+    occupancySites.push_back(site);
+    return (int)occupancySites.size() - 1;
+}
+
+
+llvm::Value *
+Module::GetOccupancyCounters() {
+    if (occupancyCounters == NULL)
+        occupancyCounters =
+            new llvm::GlobalVariable(*module, LLVMTypes::Int64Type, false,
+                                     llvm::GlobalValue::InternalLinkage,
+                                     LLVMInt64(0), "__occupancy_counters_tmp");
+    return occupancyCounters;
+}
+
+
+llvm::Value *
+Module::GetOccupancyModuleInfo() {
+    if (occupancyModuleInfo == NULL)
+        occupancyModuleInfo =
+            new llvm::GlobalVariable(*module, LLVMTypes::Int8Type, true,
+                                     llvm::GlobalValue::InternalLinkage,
+                                     LLVMInt8(0), "__occupancy_module_tmp");
+    return occupancyModuleInfo;
+}
+
+
+llvm::Value *
+Module::GetOccupancyRegisteredFlag() {
+    if (occupancyRegistered == NULL) {
+        occupancyRegistered =
+            new llvm::GlobalVariable(*module, LLVMTypes::Int32Type, false,
+                                     llvm::GlobalValue::InternalLinkage,
+                                     LLVMInt32(0), "__occupancy_registered");
+        occupancyRegistered->setThreadLocal(true);
+    }
+    return occupancyRegistered;
+}
+
+
+/** Returns a constant char * pointer to a copy of the given string in the
+    module. */
+static llvm::Constant *
+lOccupancyString(llvm::Module *module, const std::string &s) {
+    llvm::Constant *sConstant =
+        llvm::ConstantDataArray::getString(*g->ctx, s, true);
+    llvm::GlobalVariable *sGlobal =
+        new llvm::GlobalVariable(*module, sConstant->getType(), true,
+                                 llvm::GlobalValue::InternalLinkage,
+                                 sConstant, "__occupancy_str");
+    return llvm::ConstantExpr::getBitCast(sGlobal, LLVMTypes::VoidPointerType);
+}
+
+
+/** Now that all of the instrumentation points are known, create the
+    counter table and the ISPCOccupancyModule structure that describes
+    them, and replace the placeholders with them.  The layout of the
+    structures must match the declarations of ISPCOccupancySite and
+    ISPCOccupancyModule that are emitted in the header file. */
+void
+Module::finalizeOccupancyProfile() {
+    int width = g->target->getVectorWidth();
+    int numSites = (int)occupancySites.size();
+
+    if (occupancyCounters != NULL) {
+        llvm::ArrayType *countersType =
+            llvm::ArrayType::get(LLVMTypes::Int64Type,
+                                 std::max(1, numSites * (width + 1)));
+        llvm::GlobalVariable *counters =
+            new llvm::GlobalVariable(*module, countersType, false,
+                                     llvm::GlobalValue::InternalLinkage,
+                                     llvm::Constant::getNullValue(countersType),
+                                     "__occupancy_counters");
+        counters->setThreadLocal(true);
+        occupancyCounters->replaceAllUsesWith(
+            llvm::ConstantExpr::getBitCast(counters, LLVMTypes::Int64PointerType));
+        occupancyCounters->eraseFromParent();
+        occupancyCounters = counters;
+    }
+
+    if (occupancyModuleInfo != NULL) {
+        // struct ISPCOccupancySite { const char *file, *note; int32_t line; };
+        std::vector<llvm::Type *> siteElements;
+        siteElements.push_back(LLVMTypes::VoidPointerType);
+        siteElements.push_back(LLVMTypes::VoidPointerType);
+        siteElements.push_back(LLVMTypes::Int32Type);
+        llvm::StructType *siteType =
+            llvm::StructType::get(*g->ctx, siteElements);
+
+        std::vector<llvm::Constant *> sites;
+        for (int i = 0; i < numSites; ++i) {
+            std::vector<llvm::Constant *> fields;
+            fields.push_back(lOccupancyString(module, occupancySites[i].file));
+            fields.push_back(lOccupancyString(module, occupancySites[i].note));
+            fields.push_back(LLVMInt32(occupancySites[i].line));
+            sites.push_back(llvm::ConstantStruct::get(siteType, fields));
+        }
+        llvm::ArrayType *sitesType = llvm::ArrayType::get(siteType, numSites);
+        llvm::GlobalVariable *sitesGlobal =
+            new llvm::GlobalVariable(*module, sitesType, true,
+                                     llvm::GlobalValue::InternalLinkage,
+                                     llvm::ConstantArray::get(sitesType, sites),
+                                     "__occupancy_sites");
+
+        // struct ISPCOccupancyModule { int32_t numSites, width;
+        //                              const ISPCOccupancySite *sites; };
+        std::vector<llvm::Type *> moduleElements;
+        moduleElements.push_back(LLVMTypes::Int32Type);
+        moduleElements.push_back(LLVMTypes::Int32Type);
+        moduleElements.push_back(llvm::PointerType::get(siteType, 0));
+        llvm::StructType *moduleType =
+            llvm::StructType::get(*g->ctx, moduleElements);
+        std::vector<llvm::Constant *> moduleFields;
+        moduleFields.push_back(LLVMInt32(numSites));
+        moduleFields.push_back(LLVMInt32(width));
+        moduleFields.push_back(
+            llvm::ConstantExpr::getBitCast(sitesGlobal,
+                                           llvm::PointerType::get(siteType, 0)));
+        llvm::GlobalVariable *info =
+            new llvm::GlobalVariable(*module, moduleType, true,
+                                     llvm::GlobalValue::InternalLinkage,
+                                     llvm::ConstantStruct::get(moduleType, moduleFields),
+                                     "__occupancy_module");
+        occupancyModuleInfo->replaceAllUsesWith(
+            llvm::ConstantExpr::getBitCast(info, LLVMTypes::VoidPointerType));
+        occupancyModuleInfo->eraseFromParent();
+        occupancyModuleInfo = info;
+    }
+}
+
+
+/** Given the name of a function as the initializer of a global array,
+    returns an initializer list where each element of the array is
+    initialized with a call to the function with the element's indices as
+    arguments. */
+static Expr *
+lGeneratorInitializer(FunctionSymbolExpr *func, const ArrayType *arrayType,
+                      std::vector<int> &indices, SourcePos pos) {
+    const ArrayType *elementArrayType =
+        CastType<ArrayType>(arrayType->GetElementType());
+    ExprList *list = new ExprList(pos);
+    for (int i = 0; i < arrayType->GetElementCount(); ++i) {
+        indices.push_back(i);
+        if (elementArrayType != NULL)
+            list->exprs.push_back(lGeneratorInitializer(func, elementArrayType,
+                                                        indices, pos));
+        else {
+            ExprList *args = new ExprList(pos);
+            for (unsigned int j = 0; j < indices.size(); ++j)
+                args->exprs.push_back(new ConstExpr(AtomicType::UniformInt32,
+                                                    (int32_t)indices[j], pos));
+            list->exprs.push_back(new FunctionCallExpr(func, args, pos));
+        }
+        indices.pop_back();
+    }
+    return list;
+}
+
+
+/** AST walk callback that replaces calls to functions with constant
+    arguments with the function's value, computed at compile time, if
+    the function can be evaluated (see Function::Evaluate()). */
+static ASTNode *
+lEvaluateConstantCall(ASTNode *node, void *) {
+    FunctionCallExpr *fce = llvm::dyn_cast<FunctionCallExpr>(node);
+    if (fce == NULL || fce->isLaunch || fce->args == NULL)
+        return node;
+    FunctionSymbolExpr *fse = llvm::dyn_cast<FunctionSymbolExpr>(fce->func);
+    Symbol *funcSym = fse ? fse->GetMatchingFunction() : NULL;
+    const Function *func = funcSym ? m->GetFunctionDefinition(funcSym) : NULL;
+    if (func == NULL)
+        return node;
+
+    std::vector<ConstExpr *> args;
+    for (unsigned int i = 0; i < fce->args->exprs.size(); ++i) {
+        ConstExpr *arg = llvm::dyn_cast<ConstExpr>(fce->args->exprs[i]);
+        if (arg == NULL)
+            return node;
+        args.push_back(arg);
+    }
+
+    ConstExpr *value = func->Evaluate(args, fce->pos);
+    return value ? value : node;
+}
+
+
 void
 Module::AddGlobalVariable(const std::string &name, const Type *type, Expr *initExpr,
                           bool isConst, StorageClass storageClass, SourcePos pos) {
@@ -554,6 +899,26 @@ Module::AddGlobalVariable(const std::string &name, const Type *type, Expr *initE
         return;
     }
 
+    if (storageClass == SC_TASK_LOCAL) {
+#ifdef ISPC_NVPTX_ENABLED
+        if (g->target->getISA() == Target::NVPTX) {
+            Error(pos, "\"task_local\" variable \"%s\" is not supported "
+                  "with \"nvptx\" target.", name.c_str());
+            return;
+        }
+#endif /* ISPC_NVPTX_ENABLED */
+        if (type->IsConstType()) {
+            Error(pos, "\"task_local\" variable \"%s\" can't be \"const\".",
+                  name.c_str());
+            return;
+        }
+        if (initExpr != NULL) {
+            Error(pos, "Initializer can't be provided with \"task_local\" "
+                  "variable \"%s\".", name.c_str());
+            return;
+        }
+    }
+
     if (type->IsVoidType()) {
         Error(pos, "\"void\" type global variable is illegal.");
         return;
@@ -596,10 +961,10 @@ Module::AddGlobalVariable(const std::string &name, const Type *type, Expr *initE
            */
           nel *= at->GetElementCount();
           assert (!type->IsSOAType());
-          type = new ArrayType(at->GetElementType()->GetAsUniformType(), nel);
+          type = ArrayType::Get(at->GetElementType()->GetAsUniformType(), nel);
         }
         else
-          type = new ArrayType(type->GetAsUniformType(), nel);
+          type = ArrayType::Get(type->GetAsUniformType(), nel);
 #endif
     }
 #endif /* ISPC_NVPTX_ENABLED */
@@ -618,6 +983,16 @@ Module::AddGlobalVariable(const std::string &name, const Type *type, Expr *initE
                   "global variable \"%s\".", name.c_str());
     }
     else {
+        // A function name as the initializer of an array initializes each
+        // element with the function's value for the element's indices.
+        FunctionSymbolExpr *generator =
+            llvm::dyn_cast_or_null<FunctionSymbolExpr>(initExpr);
+        if (generator != NULL && at != NULL) {
+            std::vector<int> indices;
+            initExpr = lGeneratorInitializer(generator, at, indices,
+                                             initExpr->pos);
+        }
+
         if (initExpr != NULL) {
             initExpr = TypeCheck(initExpr);
             if (initExpr != NULL) {
@@ -630,6 +1005,16 @@ Module::AddGlobalVariable(const std::string &name, const Type *type, Expr *initE
 
                 if (initExpr != NULL) {
                     initExpr = Optimize(initExpr);
+                    // Calls to functions that can be evaluated at compile
+                    // time are replaced with their values.
+                    if (initExpr != NULL) {
+                        initExpr = (Expr *)WalkAST(initExpr, NULL,
+                                                   lEvaluateConstantCall, NULL);
+                        initExpr = Optimize(initExpr);
+                    }
+                }
+
+                if (initExpr != NULL) {
                     // Fingers crossed, now let's see if we've got a
                     // constant value..
                     llvmInitializer = initExpr->GetConstant(type);
@@ -698,15 +1083,25 @@ Module::AddGlobalVariable(const std::string &name, const Type *type, Expr *initE
     sym->constValue = constValue;
 
     llvm::GlobalValue::LinkageTypes linkage =
-        (sym->storageClass == SC_STATIC) ? llvm::GlobalValue::InternalLinkage :
+        (sym->storageClass == SC_STATIC ||
+         sym->storageClass == SC_TASK_LOCAL) ?
+        llvm::GlobalValue::InternalLinkage :
         llvm::GlobalValue::ExternalLinkage;
 
     // Note that the NULL llvmInitializer is what leads to "extern"
     // declarations coming up extern and not defining storage (a bit
     // subtle)...
-    sym->storagePtr = new llvm::GlobalVariable(*module, llvmType, isConst,
-                                               linkage, llvmInitializer,
-                                               sym->name.c_str());
+    llvm::GlobalVariable *newGV =
+        new llvm::GlobalVariable(*module, llvmType, isConst,
+                                 linkage, llvmInitializer,
+                                 sym->name.c_str());
+    // task_local variables get one copy per worker thread; align them to
+    // a cache line so that copies of different threads never share one.
+    if (sym->storageClass == SC_TASK_LOCAL) {
+        newGV->setThreadLocal(true);
+        newGV->setAlignment(64);
+    }
+    sym->storagePtr = newGV;
 
     // Patch up any references to the previous GlobalVariable (e.g. from a
     // declaration of a global that was later defined.)
@@ -716,7 +1111,7 @@ Module::AddGlobalVariable(const std::string &name, const Type *type, Expr *initE
         sym->storagePtr->setName(sym->name.c_str());
     }
 
-    if (diBuilder) {
+    if (diBuilder && !g->debugLineTablesOnly) {
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_5 // 3.2, 3.3, 3.4, 3.5
         llvm::DIFile file = pos.GetDIFile();
         llvm::DIGlobalVariable var = diBuilder->createGlobalVariable(
@@ -898,6 +1293,12 @@ Module::AddFunctionDeclaration(const std::string &name,
                                SourcePos pos) {
     Assert(functionType != NULL);
 
+    if (storageClass == SC_TASK_LOCAL) {
+        Error(pos, "\"task_local\" qualifier can only be used for "
+              "variables.");
+        return;
+    }
+
     // If a global variable with the same name has already been declared
     // issue an error.
     if (symbolTable->LookupVariable(name.c_str()) != NULL) {
@@ -907,6 +1308,12 @@ Module::AddFunctionDeclaration(const std::string &name,
         return;
     }
 
+    if (symbolTable->LookupFunctionTemplate(name.c_str()) != NULL) {
+        Error(pos, "Function \"%s\" has the same name as a function template. "
+              "Ignoring this definition.", name.c_str());
+        return;
+    }
+
     std::vector<Symbol *> overloadFuncs;
     symbolTable->LookupFunction(name.c_str(), &overloadFuncs);
     if (overloadFuncs.size() > 0) {
@@ -1013,7 +1420,8 @@ Module::AddFunctionDeclaration(const std::string &name,
                 !g->target->getTreatGenericAsSmth().empty())
                 functionName += g->target->getTreatGenericAsSmth();
             else
-                functionName += g->target->GetISAString();
+                functionName += g->target->GetISAString() +
+                    g->target->GetVariantSuffix();
         }
     }
     llvm::Function *function =
@@ -1048,8 +1456,20 @@ Module::AddFunctionDeclaration(const std::string &name,
     g->target->markFuncWithTargetAttr(function);
 
     // Make sure that the return type isn't 'varying' or vector typed if
-    // the function is 'export'ed.
-    if (functionType->isExported &&
+    // the function is 'export'ed.  Functions using the native vector ABI
+    // may return varying values that map directly onto a SIMD register.
+    if (functionType->isVectorABI) {
+        if (g->mangleFunctionsWithTarget)
+            Error(pos, "__declspec(vector_abi) function \"%s\" can't be "
+                  "compiled for multiple targets.", name.c_str());
+        const Type *retType = functionType->GetReturnType();
+        if (retType->IsVaryingType() &&
+            FunctionType::GetVectorABICType(retType) == "")
+            Error(pos, "Return type \"%s\" of __declspec(vector_abi) function "
+                  "\"%s\" has no native vector type on this target.",
+                  retType->GetString().c_str(), name.c_str());
+    }
+    else if (functionType->isExported &&
         lRecursiveCheckValidParamType(functionType->GetReturnType(), false) == false)
         Error(pos, "Illegal to return a \"varying\" or vector type from "
               "exported function \"%s\"", name.c_str());
@@ -1083,7 +1503,13 @@ Module::AddFunctionDeclaration(const std::string &name,
         // If the function is exported, make sure that the parameter
         // doesn't have any funky stuff going on in it.
         // JCB nomosoa - Varying is now a-ok.
-        if (functionType->isExported) {
+        if (functionType->isVectorABI && argType->IsVaryingType()) {
+          if (FunctionType::GetVectorABICType(argType) == "")
+            Error(argPos, "Parameter \"%s\" of type \"%s\" has no native "
+                  "vector type on this target.", argName.c_str(),
+                  argType->GetString().c_str());
+        }
+        else if (functionType->isExported) {
           lCheckExportedParameterTypes(argType, argName, argPos);
         }
 
@@ -1093,19 +1519,24 @@ Module::AddFunctionDeclaration(const std::string &name,
         }
 #endif /* ISPC_NVPTX_ENABLED */
 
-        // ISPC assumes that no pointers alias.  (It should be possible to
-        // specify when this is not the case, but this should be the
-        // default.)  Set parameter attributes accordingly.  (Only for
-        // uniform pointers, since varying pointers are int vectors...)
+        // ISPC assumes that no pointers alias unless --opt=pointers-may-alias
+        // is given, in which case only pointers declared "noalias" are
+        // assumed to be distinct.  Set parameter attributes accordingly.
+        // (Only for uniform pointers, since varying pointers are int
+        // vectors...)  When such a function is inlined, LLVM turns these
+        // attributes into scoped alias metadata on the inlined accesses.
+        const PointerType *argPtrType = CastType<PointerType>(argType);
         if (!functionType->isTask &&
-            ((CastType<PointerType>(argType) != NULL &&
+            ((argPtrType != NULL &&
               argType->IsUniformType() &&
               // Exclude SOA argument because it is a pair {struct *, int}
               // instead of pointer
-              !CastType<PointerType>(argType)->IsSlice())
+              !argPtrType->IsSlice() &&
+              (!g->opt.pointersMayAlias || argPtrType->IsNoAlias()))
              ||
 
-             CastType<ReferenceType>(argType) != NULL)) {
+             (CastType<ReferenceType>(argType) != NULL &&
+              !g->opt.pointersMayAlias))) {
 
             // NOTE: LLVM indexes function parameters starting from 1.
             // This is unintuitive.
@@ -1160,6 +1591,20 @@ Module::AddFunctionDefinition(const std::string &name, const FunctionType *type,
 
     sym->pos = code->pos;
 
+    // Functions declared with __declspec(width<N>) are only compiled for
+    // targets with that gang size; when compiling for multiple targets,
+    // the other targets just don't get a definition of them.
+    if (type->gangWidth > 0 &&
+        type->gangWidth != g->target->getVectorWidth()) {
+        if (g->mangleFunctionsWithTarget == false)
+            Error(code->pos, "Function \"%s\" is declared with "
+                  "__declspec(width%d) but the gang size of target \"%s\" "
+                  "is %d.", name.c_str(), type->gangWidth,
+                  g->target->GetISATargetString(),
+                  g->target->getVectorWidth());
+        return;
+    }
+
     // FIXME: because we encode the parameter names in the function type,
     // we need to override the function type here in case the function had
     // earlier been declared with anonymous parameter names but is now
@@ -1171,6 +1616,12 @@ Module::AddFunctionDefinition(const std::string &name, const FunctionType *type,
 }
 
 
+const Function *
+Module::GetFunctionDefinition(const Symbol *sym) const {
+    return ast->LookupFunction(sym);
+}
+
+
 void
 Module::AddExportedTypes(const std::vector<std::pair<const Type *,
                                                      SourcePos> > &types) {
@@ -1190,6 +1641,7 @@ Module::AddExportedTypes(const std::vector<std::pair<const Type *,
 bool
 Module::writeOutput(OutputType outputType, const char *outFileName,
                     const char *includeFileName, DispatchHeaderInfo *DHI) {
+    TimeReportScope timer("output");
     if (diBuilder && (outputType != Header) && (outputType != Deps))
         lStripUnusedDebugInfo(module);
 
@@ -1299,9 +1751,15 @@ Module::writeOutput(OutputType outputType, const char *outFileName,
             return false;
         }
         extern bool WriteCXXFile(llvm::Module *module, const char *fn,
-                                 int vectorWidth, const char *includeName);
+                                 int vectorWidth, const char *includeName,
+                                 int numParts);
+        if (g->cxxSplitCount > 1 && !strcmp(outFileName, "-")) {
+            Error(SourcePos(), "\"--c++-split\" requires an output file "
+                  "name.");
+            return false;
+        }
         return WriteCXXFile(module, outFileName, g->target->getVectorWidth(),
-                            includeFileName);
+                            includeFileName, g->cxxSplitCount);
     }
     else
         return writeObjectFileOrAssembly(outputType, outFileName);
@@ -1453,15 +1911,237 @@ Module::writeBitcode(llvm::Module *module, const char *outFileName) {
     }
     else
 #endif /* ISPC_NVPTX_ENABLED */
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+    if (g->emitThinLTOSummary) {
+        // The bitcode writer pass computes the module summary that
+        // ThinLTO uses to decide what to import into other modules, and a
+        // hash of the module for ThinLTO's incremental build cache.
+        llvm::legacy::PassManager writePM;
+        writePM.add(llvm::createBitcodeWriterPass(fos, false, true, true));
+        writePM.run(*module);
+    }
+    else
+#endif
       llvm::WriteBitcodeToFile(module, fos);
 
     return true;
 }
 
 
+#ifndef ISPC_IS_WINDOWS
+// Worker process that is optimizing and emitting code for one target of a
+// multi-target compilation, or for one part of a module whose code
+// generation has been split by Module::writeSplitObjectFile().
+struct TargetJob {
+    pid_t pid;
+    std::string isaName;
+    // File that the worker is writing, which is removed if the worker is
+    // stopped before it finishes.
+    std::string outFileName;
+};
+
+
+// Wait for one of the given worker processes to exit and remove it from
+// the list of running jobs.  Returns false if the worker didn't complete
+// successfully.
+static bool
+lWaitForTargetJob(std::vector<TargetJob> &jobs) {
+    while (true) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("waitpid");
+            jobs.clear();
+            return false;
+        }
+
+        for (unsigned int i = 0; i < jobs.size(); ++i) {
+            if (jobs[i].pid != pid)
+                continue;
+
+            std::string isaName = jobs[i].isaName;
+            jobs.erase(jobs.begin() + i);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                Error(SourcePos(), "Compilation for target \"%s\" failed.",
+                      isaName.c_str());
+                return false;
+            }
+            return true;
+        }
+    }
+}
+
+
+// Stops all of the given worker processes after an error in the parent
+// (e.g. when a later fork() fails), so that none of them are left running
+// once it exits, and removes the files that they were writing.
+static void
+lAbortTargetJobs(std::vector<TargetJob> &jobs) {
+    for (unsigned int i = 0; i < jobs.size(); ++i)
+        kill(jobs[i].pid, SIGTERM);
+    for (unsigned int i = 0; i < jobs.size(); ++i) {
+        int status;
+        while (waitpid(jobs[i].pid, &status, 0) == -1 && errno == EINTR)
+            ;
+        if (!jobs[i].outFileName.empty())
+            remove(jobs[i].outFileName.c_str());
+    }
+    jobs.clear();
+}
+#endif // !ISPC_IS_WINDOWS
+
+
+#if !defined(ISPC_IS_WINDOWS) && ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+// Runs the given command and waits for it to finish; returns true if it
+// exited successfully.
+static bool
+lRunCommand(const std::vector<std::string> &args) {
+    std::vector<char *> argv;
+    for (unsigned int i = 0; i < args.size(); ++i)
+        argv.push_back(const_cast<char *>(args[i].c_str()));
+    argv.push_back(NULL);
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return false;
+    }
+    else if (pid == 0) {
+        execvp(argv[0], &argv[0]);
+        perror(argv[0]);
+        _exit(1);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+// Generates an object file for the given module using up to g->numJobs
+// worker processes.  Once Optimize() has run, all of the remaining work
+// in the code generator is done one function at a time, so the module is
+// split into that many parts (keeping each internal symbol in the same
+// part as its users, so that none of them need to be made visible outside
+// of the object file), each part is compiled to a temporary object file
+// by a separate process, and the results are combined with "ld -r".
+// Returns false if there's too little code to split, or if the parts can't
+// be combined by the host's linker, in which case the caller just
+// generates the object file directly.
+bool
+Module::writeSplitObjectFile(llvm::TargetMachine *targetMachine,
+                             llvm::Module *module, const char *outFileName,
+                             bool *failed) {
+    // The host's "ld -r" can only be relied on to combine ELF or Mach-O
+    // objects for the host's own architecture and OS, so cross-compiling
+    // (including to 32-bit x86 on a 64-bit host) doesn't split.
+    llvm::Triple triple(module->getTargetTriple());
+    llvm::Triple hostTriple(llvm::sys::getDefaultTargetTriple());
+    if (triple.getArch() != hostTriple.getArch() ||
+        triple.getOS() != hostTriple.getOS() ||
+        (triple.getObjectFormat() != llvm::Triple::ELF &&
+         triple.getObjectFormat() != llvm::Triple::MachO))
+        return false;
+
+    int nFunctions = 0;
+    for (llvm::Module::iterator f = module->begin(); f != module->end(); ++f)
+        if (!f->isDeclaration())
+            ++nFunctions;
+    int nParts = std::min(g->numJobs, nFunctions);
+    if (nParts < 2)
+        return false;
+
+    std::vector<std::unique_ptr<llvm::Module> > parts;
+    llvm::SplitModule(llvm::CloneModule(module), nParts,
+                      [&](std::unique_ptr<llvm::Module> part) {
+                          parts.push_back(std::move(part));
+                      }, true /* preserve locals */);
+
+    std::vector<std::string> partFileNames;
+    std::vector<TargetJob> jobs;
+    bool ok = true;
+    for (unsigned int i = 0; i < parts.size() && ok; ++i) {
+        char suffix[32];
+        sprintf(suffix, ".part%d-%d.o", i, (int)getpid());
+        partFileNames.push_back(std::string(outFileName) + suffix);
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            lAbortTargetJobs(jobs);
+            ok = false;
+            break;
+        }
+        else if (pid == 0) {
+            // Child: generate code for this part only.
+            g->numJobs = 1;
+            bool partOk = writeObjectFileOrAssembly(targetMachine,
+                              parts[i].get(), Object,
+                              partFileNames[i].c_str());
+            fflush(stdout);
+            fflush(stderr);
+            _exit(partOk ? 0 : 1);
+        }
+
+        TargetJob job;
+        job.pid = pid;
+        char desc[64];
+        sprintf(desc, " (part %d of %d)", i + 1, (int)parts.size());
+        job.isaName = std::string(g->target->GetISATargetString()) + desc;
+        job.outFileName = partFileNames[i];
+        jobs.push_back(job);
+
+        while ((int)jobs.size() >= g->numJobs)
+            if (!lWaitForTargetJob(jobs))
+                ok = false;
+    }
+    while (!jobs.empty())
+        if (!lWaitForTargetJob(jobs))
+            ok = false;
+
+    if (ok) {
+        std::vector<std::string> args;
+        args.push_back("ld");
+        args.push_back("-r");
+        args.push_back("-o");
+        args.push_back(outFileName);
+        args.insert(args.end(), partFileNames.begin(), partFileNames.end());
+        ok = lRunCommand(args);
+        if (!ok)
+            // e.g. "ld" isn't installed; fall back to generating the
+            // object file in this process.
+            Warning(SourcePos(), "Unable to combine the object files from "
+                    "parallel code generation with \"ld -r\"; generating "
+                    "\"%s\" serially.", outFileName);
+    }
+    else
+        *failed = true;
+
+    for (unsigned int i = 0; i < partFileNames.size(); ++i)
+        remove(partFileNames[i].c_str());
+    return ok || *failed;
+}
+#endif // !ISPC_IS_WINDOWS && LLVM 3.9+
+
+
 bool
 Module::writeObjectFileOrAssembly(OutputType outputType, const char *outFileName) {
     llvm::TargetMachine *targetMachine = g->target->GetTargetMachine();
+    if (noFPContract)
+        // Leave fusing to the llvm.fmuladd calls; see
+        // FunctionEmitContext::GetFPContract().
+        targetMachine->Options.AllowFPOpFusion = llvm::FPOpFusion::Standard;
     return writeObjectFileOrAssembly(targetMachine, module, outputType,
                                      outFileName);
 }
@@ -1471,6 +2151,16 @@ bool
 Module::writeObjectFileOrAssembly(llvm::TargetMachine *targetMachine,
                                   llvm::Module *module, OutputType outputType,
                                   const char *outFileName) {
+#if !defined(ISPC_IS_WINDOWS) && ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+    // With more than one job, object file generation is split across
+    // multiple processes.
+    if (outputType == Object && g->numJobs > 1 && strcmp(outFileName, "-") != 0) {
+        bool failed = false;
+        if (writeSplitObjectFile(targetMachine, module, outFileName, &failed))
+            return !failed;
+    }
+#endif // !ISPC_IS_WINDOWS && LLVM 3.9+
+
     // Figure out if we're generating object file or assembly output, and
     // set binary output for object files
     llvm::TargetMachine::CodeGenFileType fileType = (outputType == Object) ?
@@ -1610,10 +2300,17 @@ lEmitStructDecl(const StructType *st, std::vector<const StructType *> *emittedSt
     // And now it's safe to declare this one
     emittedStructs->push_back(st);
     
-    fprintf(file, "#ifndef __ISPC_STRUCT_%s__\n",st->GetCStructName().c_str());
-    fprintf(file, "#define __ISPC_STRUCT_%s__\n",st->GetCStructName().c_str());
-
     char sSOA[48];
+    if (st->GetSOAWidth() > 0)
+        // This has to match the naming scheme in
+        // StructType::GetCDeclaration().
+        sprintf(sSOA, "_SOA%d", st->GetSOAWidth());
+    else
+        *sSOA = '\0';
+
+    fprintf(file, "#ifndef __ISPC_STRUCT_%s%s__\n",st->GetCStructName().c_str(), sSOA);
+    fprintf(file, "#define __ISPC_STRUCT_%s%s__\n",st->GetCStructName().c_str(), sSOA);
+
     bool pack, needsAlign = false;
     llvm::Type *stype = st->LLVMType(g->ctx);
     const llvm::DataLayout *DL = g->target->getDataLayout();
@@ -1624,12 +2321,6 @@ lEmitStructDecl(const StructType *st, std::vector<const StructType *> *emittedSt
             needsAlign |= ftype->IsVaryingType()
                        && (CastType<StructType>(ftype) == NULL);
         }
-    if (st->GetSOAWidth() > 0)
-        // This has to match the naming scheme in
-        // StructType::GetCDeclaration().
-        sprintf(sSOA, "_SOA%d", st->GetSOAWidth());
-    else
-        *sSOA = '\0';
     if (!needsAlign)
         fprintf(file, "%sstruct %s%s {\n", (pack)? "packed " : "",
                       st->GetCStructName().c_str(), sSOA);
@@ -1688,6 +2379,85 @@ lEmitStructDecls(std::vector<const StructType *> &structTypes, FILE *file, bool
 }
 
 
+/** Emit the typedefs declared with "export typedef" to the generated
+    header file.  For C++, each typedef "T" also gets a "T_Array" type that
+    wraps a pointer to an array of T and gives access to its elements with
+    the usual array[i].field syntax, whether T has a regular (AOS) layout
+    or an soa<n> layout.  Its Blocks() method gives the number of T
+    objects to allocate for a given number of elements.  Application code
+    written in terms of these is thus unchanged when the layout of T is
+    changed in the ispc source.
+ */
+static void
+lEmitLayoutTypeDefs(const std::vector<std::pair<std::string, const StructType *> > &typeDefs,
+                    FILE *file) {
+    if (typeDefs.size() == 0)
+        return;
+
+    fprintf(file, "///////////////////////////////////////////////////////////////////////////\n");
+    fprintf(file, "// Data layouts exported from ispc code\n");
+    fprintf(file, "///////////////////////////////////////////////////////////////////////////\n\n");
+
+    for (unsigned int i = 0; i < typeDefs.size(); ++i) {
+        const char *name = typeDefs[i].first.c_str();
+        const StructType *st = typeDefs[i].second;
+        int soaWidth = st->GetSOAWidth();
+
+        fprintf(file, "#ifndef __ISPC_LAYOUT_%s__\n", name);
+        fprintf(file, "#define __ISPC_LAYOUT_%s__\n", name);
+        fprintf(file, "typedef %s;\n", st->GetCDeclaration(name).c_str());
+        fprintf(file, "#ifdef __cplusplus\n");
+        if (soaWidth == 0)
+            fprintf(file, "typedef %s &%s_Ref;\n", name, name);
+        else {
+            // A reference to each of the members of one element of the
+            // soa array.  Members that are themselves arrays or structs
+            // are spread across the soa block and can't be referred to
+            // this way, so are only accessible through the block.
+            const StructType *ust = st->GetAsUniformType();
+            fprintf(file, "struct %s_Ref {\n", name);
+            for (int j = 0; j < ust->GetElementCount(); ++j) {
+                const Type *ftype = ust->GetElementType(j);
+                if (!Type::IsBasicType(ftype))
+                    continue;
+                std::string ref = std::string("&") + ust->GetElementName(j);
+                fprintf(file, "    %s;\n", ftype->GetCDeclaration(ref).c_str());
+            }
+            fprintf(file, "};\n");
+        }
+        fprintf(file, "struct %s_Array {\n", name);
+        fprintf(file, "    static const int blockSize = %d;\n", soaWidth > 0 ? soaWidth : 1);
+        fprintf(file, "    %s *data;\n", name);
+        fprintf(file, "    %s_Array(%s *d) : data(d) { }\n", name, name);
+        fprintf(file, "    static uint64_t Blocks(uint64_t count) { return (count + blockSize - 1) / blockSize; }\n");
+        if (soaWidth == 0)
+            fprintf(file, "    %s_Ref operator[](uint64_t i) const { return data[i]; }\n", name);
+        else {
+            fprintf(file, "    %s_Ref operator[](uint64_t i) const {\n", name);
+            fprintf(file, "        %s &b = data[i / blockSize];\n", name);
+            fprintf(file, "        int j = (int)(i %% blockSize);\n");
+            fprintf(file, "        %s_Ref r = {", name);
+            const StructType *ust = st->GetAsUniformType();
+            bool first = true;
+            for (int j = 0; j < ust->GetElementCount(); ++j) {
+                const Type *ftype = ust->GetElementType(j);
+                if (!Type::IsBasicType(ftype))
+                    continue;
+                fprintf(file, "%s b.%s[j]", first ? "" : ",",
+                        ust->GetElementName(j).c_str());
+                first = false;
+            }
+            fprintf(file, " };\n");
+            fprintf(file, "        return r;\n");
+            fprintf(file, "    }\n");
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "#endif // __cplusplus\n");
+        fprintf(file, "#endif\n\n");
+    }
+}
+
+
 /** Emit C declarations of enumerator types to the generated header file.
  */
 static void
@@ -1739,8 +2509,6 @@ lEmitVectorTypedefs(const std::vector<const VectorType *> &types, FILE *file) {
     fprintf(file, "// Vector types with external visibility from ispc code\n");
     fprintf(file, "///////////////////////////////////////////////////////////////////////////\n\n");
 
-    int align = g->target->getNativeVectorWidth() * 4;
-
     for (unsigned int i = 0; i < types.size(); ++i) {
         std::string baseDecl;
         const VectorType *vt = types[i]->GetAsNonConstType();
@@ -1751,6 +2519,9 @@ lEmitVectorTypedefs(const std::vector<const VectorType *> &types, FILE *file) {
             continue;
 
         int size = vt->GetElementCount();
+        // Match the alignment (and thus the padded size) of the LLVM
+        // vector type that the ispc side uses.
+        int align = (int)g->target->getDataLayout()->getABITypeAlignment(vt->LLVMType(g->ctx));
 
         baseDecl = vt->GetBaseType()->GetCDeclaration("");
         fprintf(file, "#ifndef __ISPC_VECTOR_%s%d__\n",baseDecl.c_str(), size);
@@ -1903,6 +2674,14 @@ lIsExternC(const Symbol *sym) {
 }
 
 
+static bool
+lIsVectorABI(const Symbol *sym) {
+    const FunctionType *ft = CastType<FunctionType>(sym->type);
+    Assert(ft);
+    return ft->isExported && ft->isVectorABI;
+}
+
+
 bool
 Module::writeDeps(const char *fn) {
   std::cout << "writing dependencies to file " << fn << std::endl;
@@ -2094,6 +2873,36 @@ Module::writeDevStub(const char *fn)
 
 
 
+/** Emits the handle type used by the "_async" host stubs, along with
+    ispc_offload_pipeline(), which keeps a bounded number of asynchronous
+    offload calls in flight so that transferring the data for one chunk
+    of work overlaps with the computation on the previous one. */
+static void
+lEmitOffloadAsyncDeclarations(FILE *file) {
+  fprintf(file, "#if defined(__cplusplus) && __cplusplus >= 201103L\n");
+  fprintf(file, "#ifndef ISPC_OFFLOAD_ASYNC\n");
+  fprintf(file, "#define ISPC_OFFLOAD_ASYNC 1\n");
+  fprintf(file, "#include <deque>\n");
+  fprintf(file, "#include <future>\n\n");
+  fprintf(file, "typedef std::shared_future<void> ispc_offload_handle_t;\n\n");
+  fprintf(file, "// Calls launchChunk(i) for each of the numChunks chunks; launchChunk\n");
+  fprintf(file, "// starts an \"_async\" call and returns its handle.  At most \"depth\"\n");
+  fprintf(file, "// calls are in flight at once (2 for double buffering, 3 for triple\n");
+  fprintf(file, "// buffering), so the transfer for chunk i+1 overlaps chunk i's compute.\n");
+  fprintf(file, "template <typename F>\n");
+  fprintf(file, "inline void ispc_offload_pipeline(int numChunks, int depth, F launchChunk) {\n");
+  fprintf(file, "  std::deque<ispc_offload_handle_t> inFlight;\n");
+  fprintf(file, "  for (int i = 0; i < numChunks; ++i) {\n");
+  fprintf(file, "    if ((int)inFlight.size() >= depth) { inFlight.front().wait(); inFlight.pop_front(); }\n");
+  fprintf(file, "    inFlight.push_back(launchChunk(i));\n");
+  fprintf(file, "  }\n");
+  fprintf(file, "  while (!inFlight.empty()) { inFlight.front().wait(); inFlight.pop_front(); }\n");
+  fprintf(file, "}\n");
+  fprintf(file, "#endif // ISPC_OFFLOAD_ASYNC\n");
+  fprintf(file, "#endif // __cplusplus >= 201103L\n\n");
+}
+
+
 bool
 Module::writeHostStub(const char *fn)
 {
@@ -2105,6 +2914,7 @@ Module::writeHostStub(const char *fn)
   fprintf(file, "//\n// %s\n// (device stubs automatically generated by the ispc compiler.)\n", fn);
   fprintf(file, "// DO NOT EDIT THIS FILE.\n//\n\n");
   fprintf(file,"#include \"ispc/host/offload.h\"\n\n");
+  lEmitOffloadAsyncDeclarations(file);
   fprintf(file,"// note(iw): Host stubs do not get extern C linkage -- dev-side already uses that for the same symbols.\n\n");
   //fprintf(file,"#ifdef __cplusplus\nextern \"C\" {\n#endif // __cplusplus\n");
 
@@ -2201,6 +3011,30 @@ Module::writeHostStub(const char *fn)
             "                        ptr_args,%i);\n",
             numPointers);
     fprintf(file,"}\n\n");
+
+    // ------------------------------------------------------------------
+    // asynchronous variant: runs the synchronous stub above on another
+    // thread once the "after" handle (if any) has completed, and returns
+    // a handle that can be waited on or passed to a later call.
+    // ------------------------------------------------------------------
+    std::string asyncName = sym->name + "_async";
+    std::string asyncDecl = fct->GetCDeclaration(asyncName);
+    std::string asyncParams =
+      asyncDecl.substr(asyncDecl.find(asyncName + "(") + asyncName.size() + 1);
+    asyncParams.erase(asyncParams.size() - 1);
+    std::stringstream callArgs;
+    for (int i=0;i<fct->GetNumParameters();i++)
+      callArgs << (i ? ", " : "") << fct->GetParameterName(i);
+    fprintf(file,"#ifdef ISPC_OFFLOAD_ASYNC\n");
+    fprintf(file,"extern ispc_offload_handle_t %s(%s%sispc_offload_handle_t __after) {\n",
+            asyncName.c_str(), asyncParams.c_str(),
+            fct->GetNumParameters() ? ", " : "");
+    fprintf(file,"  return std::async(std::launch::async, [=]() {\n");
+    fprintf(file,"      if (__after.valid()) __after.wait();\n");
+    fprintf(file,"      %s(%s);\n", sym->name.c_str(), callArgs.str().c_str());
+    fprintf(file,"    }).share();\n");
+    fprintf(file,"}\n");
+    fprintf(file,"#endif // ISPC_OFFLOAD_ASYNC\n\n");
   }
 
   // end extern "C"
@@ -2216,6 +3050,36 @@ Module::writeHostStub(const char *fn)
 }
 
 
+/** Emits the declarations of the structures and the function that are
+    used to hand the counters from --instrument=occupancy to the
+    application. */
+static void
+lEmitOccupancyDeclarations(FILE *f) {
+    fprintf(f, "#ifndef ISPC_OCCUPANCY_PROFILE\n");
+    fprintf(f, "#define ISPC_OCCUPANCY_PROFILE 1\n");
+    fprintf(f, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\nextern \"C\" {\n#endif // __cplusplus\n");
+    fprintf(f, "  struct ISPCOccupancySite { const char *file; const char *note; int32_t line; };\n");
+    fprintf(f, "  struct ISPCOccupancyModule { int32_t numSites; int32_t width; const struct ISPCOccupancySite *sites; };\n");
+    fprintf(f, "  void ISPCOccupancyRegister(const struct ISPCOccupancyModule *module, uint64_t *counts);\n");
+    fprintf(f, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\n} /* end extern C */\n#endif // __cplusplus\n");
+    fprintf(f, "#endif // ISPC_OCCUPANCY_PROFILE\n");
+}
+
+
+/** Emits the declaration of the function that --trace-memory calls at each
+    memory access, along with the values of its "kind" parameter. */
+static void
+lEmitMemoryTraceDeclarations(FILE *f) {
+    fprintf(f, "#ifndef ISPC_MEMORY_TRACE\n");
+    fprintf(f, "#define ISPC_MEMORY_TRACE 1\n");
+    fprintf(f, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\nextern \"C\" {\n#endif // __cplusplus\n");
+    fprintf(f, "  enum { ISPC_TRACE_LOAD = 0, ISPC_TRACE_STORE = 1, ISPC_TRACE_GATHER = 2, ISPC_TRACE_SCATTER = 3 };\n");
+    fprintf(f, "  void ISPCTraceMemory(const char *fn, int line, int kind, int elementSize, int count, const uint64_t *addresses, uint64_t mask);\n");
+    fprintf(f, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\n} /* end extern C */\n#endif // __cplusplus\n");
+    fprintf(f, "#endif // ISPC_MEMORY_TRACE\n");
+}
+
+
 bool
 Module::writeHeader(const char *fn) {
     FILE *f = fopen(fn, "w");
@@ -2243,6 +3107,21 @@ Module::writeHeader(const char *fn) {
 
     fprintf(f, "#include <stdint.h>\n\n");
 
+    // Functions using the native vector ABI take and return the SIMD
+    // register types declared by the intrinsics headers.
+    std::vector<Symbol *> vectorABIFuncs;
+    m->symbolTable->GetMatchingFunctions(lIsVectorABI, &vectorABIFuncs);
+    if (vectorABIFuncs.size() > 0) {
+        fprintf(f, "#include <immintrin.h>\n\n");
+        fprintf(f, "#ifndef ISPC_VECTOR_ABI\n");
+        fprintf(f, "#if defined(_MSC_VER)\n");
+        fprintf(f, "#define ISPC_VECTOR_ABI __vectorcall\n");
+        fprintf(f, "#else\n");
+        fprintf(f, "#define ISPC_VECTOR_ABI\n");
+        fprintf(f, "#endif\n");
+        fprintf(f, "#endif // ISPC_VECTOR_ABI\n\n");
+    }
+
     if (g->emitInstrumentation) {
         fprintf(f, "#define ISPC_INSTRUMENTATION 1\n");
         fprintf(f, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\nextern \"C\" {\n#endif // __cplusplus\n");
@@ -2250,6 +3129,12 @@ Module::writeHeader(const char *fn) {
         fprintf(f, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\n} /* end extern C */\n#endif // __cplusplus\n");
     }
 
+    if (g->emitOccupancyProfile)
+        lEmitOccupancyDeclarations(f);
+
+    if (g->emitMemoryTrace)
+        lEmitMemoryTraceDeclarations(f);
+
     // end namespace
     fprintf(f, "\n");
     fprintf(f, "\n#ifdef __cplusplus\nnamespace ispc { /* namespace */\n#endif // __cplusplus\n");
@@ -2282,11 +3167,15 @@ Module::writeHeader(const char *fn) {
         else
             FATAL("Unexpected type in export list");
     }
+    for (int i = 0; i < (int)exportedTypeDefs.size(); ++i)
+        lGetExportedTypes(exportedTypeDefs[i].second, &exportedStructTypes,
+                          &exportedEnumTypes, &exportedVectorTypes);
 
     // And print them
     lEmitVectorTypedefs(exportedVectorTypes, f);
     lEmitEnumDecls(exportedEnumTypes, f);
     lEmitStructDecls(exportedStructTypes, f);
+    lEmitLayoutTypeDefs(exportedTypeDefs, f);
 
     // emit function declarations for exported stuff...
     if (exportedFuncs.size() > 0) {
@@ -2327,24 +3216,143 @@ struct DispatchHeaderInfo {
   bool Emit16;
   FILE *file;
   const char *fn;
+  // Names of the targets whose variants have been declared so far, and
+  // the ispc::select<>() specializations for them, which can only be
+  // written out once the ISA enum is complete.
+  std::vector<std::string> isaNames;
+  std::string selectTables;
 };
 
-bool
-Module::writeDispatchHeader(DispatchHeaderInfo *DHI) {
-  FILE *f = DHI->file;
-  
-  if (DHI->EmitFrontMatter) {
-    fprintf(f, "//\n// %s\n// (Header automatically generated by the ispc compiler.)\n", DHI->fn);
-    fprintf(f, "// DO NOT EDIT THIS FILE.\n//\n\n");
-  }
-    // Create a nice guard string from the filename, turning any
-    // non-number/letter characters into underbars
-    std::string guard = "ISPC_";
-    const char *p = DHI->fn;
-    while (*p) {
-        if (isdigit(*p))
-            guard += *p;
-        else if (isalpha(*p))
+
+/** Returns the name that the exported functions compiled for the current
+    target have appended to them (e.g. "avx2" for foo_avx2()). */
+static std::string
+lGetTargetFunctionSuffix() {
+    if (g->target->getISA() == Target::GENERIC &&
+        !g->target->getTreatGenericAsSmth().empty())
+        return g->target->getTreatGenericAsSmth();
+    return std::string(g->target->GetISAString()) +
+        g->target->GetVariantSuffix();
+}
+
+
+/** Turns the given target name into a valid C identifier. */
+static std::string
+lGetTargetIdentifier(const std::string &name) {
+    std::string ident = name;
+    for (unsigned int i = 0; i < ident.size(); ++i)
+        if (!isalnum(ident[i]))
+            ident[i] = '_';
+    return ident;
+}
+
+
+/** Returns true if the current target provides its own definition of the
+    given exported function; targets that are additional gang size
+    variants only export the functions declared for their gang size, and
+    those are only compiled for targets with that gang size. */
+static bool
+lTargetDefinesFunction(const FunctionType *ftype) {
+    if (ftype->gangWidth > 0 &&
+        ftype->gangWidth != g->target->getVectorWidth())
+        return false;
+    return g->target->isWidthVariant() == false || ftype->gangWidth > 0 ||
+        g->opt.selectWidth;
+}
+
+
+/** Prints declarations of the current target's variants of the exported
+    functions, along with C++ inline wrappers for them in a namespace named
+    after the target, and adds the target's ispc::select<>() table to the
+    ones to be printed with the back matter. */
+static void
+lPrintTargetFunctionDeclarations(FILE *file, const std::vector<Symbol *> &funcs,
+                                 DispatchHeaderInfo *DHI) {
+    std::string suffix = lGetTargetFunctionSuffix();
+    std::string ident = lGetTargetIdentifier(suffix);
+
+    std::vector<Symbol *> targetFuncs;
+    for (unsigned int i = 0; i < funcs.size(); ++i)
+        if (lTargetDefinesFunction(CastType<FunctionType>(funcs[i]->type)))
+            targetFuncs.push_back(funcs[i]);
+
+    std::string table = "template <> inline const FunctionTable &select<ISA_" +
+        ident + ">() {\n    static const FunctionTable table = {\n";
+    for (unsigned int i = 0; i < funcs.size(); ++i) {
+        bool defined = std::find(targetFuncs.begin(), targetFuncs.end(),
+                                 funcs[i]) != targetFuncs.end();
+        table += "        " + (defined ? (ident + "::" + funcs[i]->name) :
+                                 std::string("0"));
+        table += (i != funcs.size() - 1) ? ",\n" : "\n";
+    }
+    table += "    };\n    return table;\n}\n";
+    DHI->isaNames.push_back(ident);
+    DHI->selectTables += table;
+
+    if (targetFuncs.size() == 0)
+        return;
+
+    fprintf(file, "\n");
+    fprintf(file, "///////////////////////////////////////////////////////////////////////////\n");
+    fprintf(file, "// Variants compiled for the %s target\n", suffix.c_str());
+    fprintf(file, "///////////////////////////////////////////////////////////////////////////\n");
+    fprintf(file, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\nextern \"C\" {\n#endif // __cplusplus\n");
+    for (unsigned int i = 0; i < targetFuncs.size(); ++i) {
+        const FunctionType *ftype = CastType<FunctionType>(targetFuncs[i]->type);
+        std::string decl = ftype->GetCDeclarationForDispatch(targetFuncs[i]->name +
+                                                             "_" + suffix);
+        fprintf(file, "    extern %s;\n", decl.c_str());
+    }
+    fprintf(file, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\n} /* end extern C */\n#endif // __cplusplus\n");
+
+    // The wrappers need names for all of the parameters to forward them.
+    fprintf(file, "\n#ifdef __cplusplus\nnamespace %s {\n", ident.c_str());
+    for (unsigned int i = 0; i < targetFuncs.size(); ++i) {
+        const FunctionType *ftype = CastType<FunctionType>(targetFuncs[i]->type);
+        llvm::SmallVector<const Type *, 8> argTypes;
+        llvm::SmallVector<std::string, 8> argNames;
+        llvm::SmallVector<Expr *, 8> argDefaults;
+        llvm::SmallVector<SourcePos, 8> argPos;
+        std::string args;
+        for (int j = 0; j < ftype->GetNumParameters(); ++j) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "_arg%d", j);
+            std::string name = ftype->GetParameterName(j);
+            if (name == "")
+                name = buf;
+            argTypes.push_back(ftype->GetParameterType(j));
+            argNames.push_back(name);
+            argDefaults.push_back(NULL);
+            argPos.push_back(ftype->GetParameterSourcePos(j));
+            args += (j == 0) ? name : (", " + name);
+        }
+        FunctionType namedType(ftype->GetReturnType(), argTypes, argNames,
+                               argDefaults, argPos, false, true, false,
+                               ftype->isUnmasked);
+        std::string decl = namedType.GetCDeclarationForDispatch(targetFuncs[i]->name);
+        fprintf(file, "    static inline %s {\n        return %s_%s(%s);\n    }\n",
+                decl.c_str(), targetFuncs[i]->name.c_str(), suffix.c_str(),
+                args.c_str());
+    }
+    fprintf(file, "} /* namespace %s */\n#endif // __cplusplus\n", ident.c_str());
+}
+
+bool
+Module::writeDispatchHeader(DispatchHeaderInfo *DHI) {
+  FILE *f = DHI->file;
+  
+  if (DHI->EmitFrontMatter) {
+    fprintf(f, "//\n// %s\n// (Header automatically generated by the ispc compiler.)\n", DHI->fn);
+    fprintf(f, "// DO NOT EDIT THIS FILE.\n//\n\n");
+  }
+    // Create a nice guard string from the filename, turning any
+    // non-number/letter characters into underbars
+    std::string guard = "ISPC_";
+    const char *p = DHI->fn;
+    while (*p) {
+        if (isdigit(*p))
+            guard += *p;
+        else if (isalpha(*p))
             guard += toupper(*p);
         else
             guard += "_";
@@ -2363,6 +3371,12 @@ Module::writeDispatchHeader(DispatchHeaderInfo *DHI) {
         fprintf(f, "#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )\n} /* end extern C */\n#endif // __cplusplus\n");
       }
 
+      if (g->emitOccupancyProfile)
+        lEmitOccupancyDeclarations(f);
+
+      if (g->emitMemoryTrace)
+        lEmitMemoryTraceDeclarations(f);
+
       // end namespace
       fprintf(f, "\n");
       fprintf(f, "\n#ifdef __cplusplus\nnamespace ispc { /* namespace */\n#endif // __cplusplus\n\n");
@@ -2402,6 +3416,9 @@ Module::writeDispatchHeader(DispatchHeaderInfo *DHI) {
           else
             FATAL("Unexpected type in export list");
         }
+        for (int i = 0; i < (int)exportedTypeDefs.size(); ++i)
+          lGetExportedTypes(exportedTypeDefs[i].second, &exportedStructTypes,
+                            &exportedEnumTypes, &exportedVectorTypes);
 
         
         // And print them
@@ -2410,6 +3427,8 @@ Module::writeDispatchHeader(DispatchHeaderInfo *DHI) {
           lEmitEnumDecls(exportedEnumTypes, f);
         }
         lEmitStructDecls(exportedStructTypes, f, DHI->EmitUnifs);
+        if (DHI->EmitUnifs)
+          lEmitLayoutTypeDefs(exportedTypeDefs, f);
         
         // Update flags
         DHI->EmitUnifs = false;
@@ -2432,11 +3451,52 @@ Module::writeDispatchHeader(DispatchHeaderInfo *DHI) {
         fprintf(f, "///////////////////////////////////////////////////////////////////////////\n");
         lPrintFunctionDeclarations(f, exportedFuncs, 1, true);
         fprintf(f, "\n");
+
+        // The table of pointers to one target's variants of them that
+        // ispc::select<>() returns.
+        fprintf(f, "#ifdef __cplusplus\nstruct FunctionTable {\n");
+        for (unsigned int i = 0; i < exportedFuncs.size(); ++i) {
+          const FunctionType *ftype = CastType<FunctionType>(exportedFuncs[i]->type);
+          std::string decl = ftype->GetCDeclarationForDispatch("(*" +
+                                                               exportedFuncs[i]->name + ")");
+          fprintf(f, "    %s;\n", decl.c_str());
+        }
+        fprintf(f, "};\n#endif // __cplusplus\n");
       }
       DHI->EmitFuncs = false;
     }
 
+    if (exportedFuncs.size() > 0)
+      lPrintTargetFunctionDeclarations(f, exportedFuncs, DHI);
+
     if (DHI->EmitBackMatter) {
+      if (exportedFuncs.size() > 0) {
+        // ispc::select<ISA_avx2>() returns the table of the avx2 variants,
+        // so that callers that already know which target to use can look
+        // them up once rather than going through the dispatch functions
+        // every time.
+        fprintf(f, "\n");
+        fprintf(f, "///////////////////////////////////////////////////////////////////////////\n");
+        fprintf(f, "// Per-target function tables\n");
+        fprintf(f, "///////////////////////////////////////////////////////////////////////////\n");
+        fprintf(f, "#ifdef __cplusplus\nenum ISA {\n");
+        for (unsigned int i = 0; i < DHI->isaNames.size(); ++i)
+          fprintf(f, "    ISA_%s%s\n", DHI->isaNames[i].c_str(),
+                  (i != DHI->isaNames.size() - 1) ? "," : "");
+        fprintf(f, "};\n\ntemplate <ISA isa> const FunctionTable &select();\n\n");
+        fprintf(f, "%s", DHI->selectTables.c_str());
+        fprintf(f, "\nstatic inline const FunctionTable &select(ISA isa) {\n");
+        fprintf(f, "    switch (isa) {\n");
+        for (unsigned int i = 0; i < DHI->isaNames.size(); ++i) {
+          if (i != DHI->isaNames.size() - 1)
+            fprintf(f, "    case ISA_%s:\n", DHI->isaNames[i].c_str());
+          else
+            fprintf(f, "    default:\n");
+          fprintf(f, "        return select<ISA_%s>();\n", DHI->isaNames[i].c_str());
+        }
+        fprintf(f, "    }\n}\n#endif // __cplusplus\n");
+      }
+
       // end namespace
       fprintf(f, "\n");
       fprintf(f, "\n#ifdef __cplusplus\n} /* namespace */\n#endif // __cplusplus\n");
@@ -2563,6 +3623,7 @@ Module::execPreprocessor(const char *infilename, llvm::raw_string_ostream *ostre
             opts.addMacroDef("assert(x)=");
         else
             opts.addMacroDef("assert(x)=__assert(#x, x)");
+        opts.addMacroDef("assume(x)=__assume(x)");
     }
 
     for (unsigned int i = 0; i < g->cppArgs.size(); ++i) {
@@ -2673,6 +3734,21 @@ lSymbolIsExported(const Symbol *s) {
 }
 
 
+static bool
+lHasGangWidth(const Symbol *s) {
+    const FunctionType *ft = CastType<FunctionType>(s->type);
+    return ft != NULL && ft->gangWidth > 0;
+}
+
+
+// A variant of an exported function compiled for a target ISA that was
+// given a CPU to tune for, as in "avx2:znver1".
+struct TunedFunctionVariant {
+    llvm::Function *func;
+    std::string cpu;
+};
+
+
 // Small structure to hold pointers to the various different versions of a
 // llvm::Function that were compiled for different compilation target ISAs.
 struct FunctionTargetVariants {
@@ -2680,6 +3756,8 @@ struct FunctionTargetVariants {
       for (int i = 0; i < Target::NUM_ISAS; ++i) {
             func[i] = NULL;
             FTs[i] = NULL;
+            cost[i] = 0.;
+            width[i] = 0;
       }
     }
     // The func array is indexed with the Target::ISA enumerant.  Some
@@ -2687,9 +3765,198 @@ struct FunctionTargetVariants {
     // compiled to the corresponding target ISA.
     llvm::Function *func[Target::NUM_ISAS];
     const FunctionType *FTs[Target::NUM_ISAS];
+    // For --opt=select-width, the estimated cost per program instance of
+    // each variant in func[] and the gang size it was compiled with.
+    double cost[Target::NUM_ISAS];
+    int width[Target::NUM_ISAS];
+    // Variants of func[] that were tuned for particular CPUs; the dispatch
+    // functions call them instead on systems with those CPUs.
+    std::vector<TunedFunctionVariant> tuned[Target::NUM_ISAS];
 };
 
 
+/** Returns the number of vector registers of the current target that a
+    value of the given type occupies; scalars and <N x i1> masks on
+    AVX-512 (which live in the mask registers) don't count. */
+static int
+lVectorRegisterCount(llvm::Type *type) {
+    llvm::VectorType *vt = llvm::dyn_cast<llvm::VectorType>(type);
+    if (vt == NULL)
+        return 0;
+
+    llvm::Type *eltType = vt->getElementType();
+    int eltBits = eltType->isPointerTy() ? (g->target->is32Bit() ? 32 : 64) :
+        (int)eltType->getPrimitiveSizeInBits();
+    if (eltBits == 1 && (g->target->getISA() == Target::KNL_AVX512 ||
+                         g->target->getISA() == Target::SKX_AVX512))
+        return 0;
+
+    int regBits = g->target->getNativeVectorWidth() *
+        g->target->getDataTypeWidth();
+    if (regBits <= 0)
+        regBits = 128;
+    int bits = (int)vt->getNumElements() * eltBits;
+    return std::max(1, (bits + regBits - 1) / regBits);
+}
+
+
+/** Number of vector registers available to the register allocator on the
+    current target. */
+static int
+lAvailableVectorRegisters() {
+    switch (g->target->getISA()) {
+    case Target::KNL_AVX512:
+    case Target::SKX_AVX512:
+        return 32;
+#ifdef ISPC_ARM_ENABLED
+    case Target::NEON32:
+    case Target::NEON16:
+    case Target::NEON8:
+        return (g->target->getArch() == "aarch64") ? 32 : 16;
+#endif
+    default:
+        return g->target->is32Bit() ? 8 : 16;
+    }
+}
+
+
+/** Returns the largest number of vector registers needed at once for the
+    values that are live in the given basic block: the vector values
+    defined elsewhere and used in it, and those defined in it that are
+    needed in other blocks. */
+static int
+lMaxRegisterPressure(llvm::BasicBlock *bb) {
+    // Vector values defined here that are needed in other blocks are
+    // live at the end of the block.
+    std::set<llvm::Value *> live;
+    int pressure = 0, maxPressure = 0;
+    for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end();
+         ++iter) {
+        llvm::Instruction *inst = &*iter;
+        if (lVectorRegisterCount(inst->getType()) == 0)
+            continue;
+        for (llvm::Value::use_iterator ui = inst->use_begin();
+             ui != inst->use_end(); ++ui) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // 3.5+
+            llvm::Instruction *user = llvm::dyn_cast<llvm::Instruction>(ui->getUser());
+#else
+            llvm::Instruction *user = llvm::dyn_cast<llvm::Instruction>(*ui);
+#endif
+            if (user != NULL && user->getParent() != bb) {
+                live.insert(inst);
+                pressure += lVectorRegisterCount(inst->getType());
+                break;
+            }
+        }
+    }
+    maxPressure = pressure;
+
+    for (llvm::BasicBlock::iterator iter = bb->end(); iter != bb->begin(); ) {
+        --iter;
+        llvm::Instruction *inst = &*iter;
+
+        if (live.erase(inst) > 0)
+            pressure -= lVectorRegisterCount(inst->getType());
+        if (llvm::isa<llvm::PHINode>(inst) == false)
+            for (unsigned int j = 0; j < inst->getNumOperands(); ++j) {
+                llvm::Value *op = inst->getOperand(j);
+                if ((llvm::isa<llvm::Instruction>(op) ||
+                     llvm::isa<llvm::Argument>(op)) &&
+                    live.insert(op).second)
+                    pressure += lVectorRegisterCount(op->getType());
+            }
+        maxPressure = std::max(maxPressure, pressure);
+    }
+    return maxPressure;
+}
+
+
+/** Adds the estimated cost of executing the given function (and the ispc
+    functions that it calls and that weren't inlined) to *cost.  Each
+    instruction costs the number of vector registers its result occupies,
+    blocks in loops are weighted by an assumed trip count, and every value
+    that's live beyond the available vector registers at the point of
+    highest pressure in a block is charged as a spill and a reload. */
+static void
+lEstimateFunctionCost(llvm::Function *func, std::set<llvm::Function *> &visited,
+                      double *cost) {
+    if (func->isDeclaration() || visited.find(func) != visited.end())
+        return;
+    visited.insert(func);
+
+    const double loopTripCount = 8.;
+    const double spillCost = 4.;
+    int numRegs = lAvailableVectorRegisters();
+
+    // Blocks in loops are weighted by the assumed trip count once for
+    // each loop that they're nested in.  (With LLVM 3.4 and earlier,
+    // where the loop analysis can't be run outside of a pass manager,
+    // loops aren't taken into account.)
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
+    llvm::DominatorTree domTree;
+    domTree.recalculate(*func);
+  #if ISPC_LLVM_VERSION >= ISPC_LLVM_3_7 // LLVM 3.7+
+    llvm::LoopInfo loopInfo;
+    loopInfo.analyze(domTree);
+  #else
+    llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop> loopInfo;
+    loopInfo.Analyze(domTree);
+  #endif
+#endif
+
+    std::vector<llvm::Function *> callees;
+    for (llvm::Function::iterator bbIter = func->begin();
+         bbIter != func->end(); ++bbIter) {
+        llvm::BasicBlock *bb = &*bbIter;
+        double weight = 1.;
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
+        for (unsigned int depth = loopInfo.getLoopDepth(bb); depth > 0; --depth)
+            weight *= loopTripCount;
+#endif
+
+        double blockCost = 0.;
+        for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end();
+             ++iter) {
+            llvm::Instruction *inst = &*iter;
+            blockCost += std::max(1, lVectorRegisterCount(inst->getType()));
+
+            if (llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(inst))
+                if (llvm::Function *callee = call->getCalledFunction())
+                    callees.push_back(callee);
+        }
+        int maxPressure = lMaxRegisterPressure(bb);
+        if (maxPressure > numRegs)
+            blockCost += spillCost * (maxPressure - numRegs);
+
+        *cost += weight * blockCost;
+    }
+
+    for (unsigned int i = 0; i < callees.size(); ++i)
+        lEstimateFunctionCost(callees[i], visited, cost);
+}
+
+
+int
+EstimateSpilledVectorValues(llvm::Function *func) {
+    int numRegs = lAvailableVectorRegisters(), spills = 0;
+    for (llvm::Function::iterator bb = func->begin(); bb != func->end(); ++bb)
+        spills += std::max(0, lMaxRegisterPressure(&*bb) - numRegs);
+    return spills;
+}
+
+
+/** Returns the estimated cost of running the given function, compiled for
+    the current target, divided by the target's gang size: i.e. the cost
+    of the work done for a single program instance. */
+static double
+lEstimatePerInstanceCost(llvm::Function *func) {
+    std::set<llvm::Function *> visited;
+    double cost = 0.;
+    lEstimateFunctionCost(func, visited, &cost);
+    return cost / g->target->getVectorWidth();
+}
+
+
 // Given the symbol table for a module, return a map from function names to
 // FunctionTargetVariants for each function that was defined with the
 // 'export' qualifier in ispc.
@@ -2700,8 +3967,41 @@ lGetExportedFunctions(SymbolTable *symbolTable,
     symbolTable->GetMatchingFunctions(lSymbolIsExported, &syms);
     for (unsigned int i = 0; i < syms.size(); ++i) {
         FunctionTargetVariants &ftv = functions[syms[i]->name];
-        ftv.func[g->target->getISA()] = syms[i]->exportedFunction;
-        ftv.FTs[g->target->getISA()] = CastType<FunctionType>(syms[i]->type);
+        int isa = g->target->getISA();
+        if (g->target->isTunedVariant()) {
+            TunedFunctionVariant tfv;
+            tfv.func = syms[i]->exportedFunction;
+            tfv.cpu = g->target->getCPU();
+            ftv.tuned[isa].push_back(tfv);
+            continue;
+        }
+        double cost = 0.;
+        if (g->opt.selectWidth) {
+            // Another gang size variant of this ISA may have already
+            // provided this function; keep whichever of the two is
+            // estimated to be faster.
+            cost = lEstimatePerInstanceCost(syms[i]->exportedFunction);
+            if (ftv.func[isa] != NULL) {
+                bool better = (cost < ftv.cost[isa]);
+                int width = g->target->getVectorWidth();
+                OptRemark(OptRemarkAnalysis, syms[i]->pos, "SelectWidth",
+                          "GangSizeChoice", syms[i]->name.c_str(),
+                          "Using gang size %d for function \"%s\" on %s "
+                          "(estimated cost per program instance %.2f, vs. "
+                          "%.2f with gang size %d).",
+                          better ? width : ftv.width[isa], syms[i]->name.c_str(),
+                          g->target->GetISAString(),
+                          better ? cost : ftv.cost[isa],
+                          better ? ftv.cost[isa] : cost,
+                          better ? ftv.width[isa] : width);
+                if (!better)
+                    continue;
+            }
+        }
+        ftv.func[isa] = syms[i]->exportedFunction;
+        ftv.FTs[isa] = CastType<FunctionType>(syms[i]->type);
+        ftv.cost[isa] = cost;
+        ftv.width[isa] = g->target->getVectorWidth();
     }
 }
 
@@ -2751,6 +4051,484 @@ lGetVaryingDispatchType(FunctionTargetVariants &funcs) {
   return resultFuncTy;
 }
 
+/** Values of __get_system_cpu_model() (defined in builtins/dispatch.ll)
+    for the CPUs that variants of a target ISA can be tuned for: a system
+    has the CPU if its model, and'ed with mask, is equal to value. */
+static const struct {
+    const char *cpu;
+    int mask, value;
+} lCPUModels[] = {
+    // Intel: (1 << 16) | (family 6 << 8) | model
+    { "corei7", 0xffffff, 0x1061a }, { "corei7", 0xffffff, 0x1061e },
+    { "corei7", 0xffffff, 0x1061f }, { "corei7", 0xffffff, 0x1062e },
+    { "corei7", 0xffffff, 0x10625 }, { "corei7", 0xffffff, 0x1062c },
+    { "corei7", 0xffffff, 0x1062f },
+    { "corei7-avx", 0xffffff, 0x1062a }, { "corei7-avx", 0xffffff, 0x1062d },
+    { "core-avx-i", 0xffffff, 0x1063a }, { "core-avx-i", 0xffffff, 0x1063e },
+    { "core-avx2", 0xffffff, 0x1063c }, { "core-avx2", 0xffffff, 0x1063f },
+    { "core-avx2", 0xffffff, 0x10645 }, { "core-avx2", 0xffffff, 0x10646 },
+    { "broadwell", 0xffffff, 0x1063d }, { "broadwell", 0xffffff, 0x10647 },
+    { "broadwell", 0xffffff, 0x1064f }, { "broadwell", 0xffffff, 0x10656 },
+    { "slm", 0xffffff, 0x10637 }, { "slm", 0xffffff, 0x1064a },
+    { "slm", 0xffffff, 0x1064d }, { "slm", 0xffffff, 0x1065a },
+    { "knl", 0xffffff, 0x10657 }, { "knl", 0xffffff, 0x10685 },
+    { "skx", 0xffffff, 0x10655 },
+    // AMD: (2 << 16) | (family << 8), for any model of the family
+    { "znver1", 0xffff00, 0x21700 },
+};
+
+
+/** Returns true if the dispatch functions can tell whether the system has
+    the given CPU (using its canonical name, as given by
+    Target::getCPU()). */
+static bool
+lCanDispatchOnCPU(const std::string &cpu) {
+    for (unsigned int i = 0; i < sizeof(lCPUModels) / sizeof(lCPUModels[0]); ++i)
+        if (cpu == lCPUModels[i].cpu)
+            return true;
+    return false;
+}
+
+
+/** Emits code at the end of *bblock that checks whether the system's CPU
+    is one of the ones that the given CPU-tuned variants of a function were
+    compiled for.  For each variant, a block is created and returned in
+    tunedBBlocks that's branched to if the system has its CPU; *bblock is
+    updated to the block that follows if it has none of them.
+
+    @param module      Module in which the dispatch code is being emitted.
+    @param func        Function in which the dispatch code is being emitted.
+    @param tuned       CPU-tuned variants to check for.
+    @param bblock      Basic block at the end of which to emit the checks.
+    @param tunedBBlocks Returns the blocks for calling each of the tuned
+                       variants.
+*/
+static void
+lEmitTunedVariantChecks(llvm::Module *module, llvm::Function *func,
+                        const std::vector<TunedFunctionVariant> &tuned,
+                        llvm::BasicBlock **bblock,
+                        std::vector<llvm::BasicBlock *> *tunedBBlocks) {
+    if (tuned.empty())
+        return;
+
+    llvm::Function *setCPUFunc = module->getFunction("__set_system_cpu_model");
+    llvm::Value *systemCPUPtr =
+        module->getGlobalVariable("__system_cpu_model", true);
+    Assert(setCPUFunc != NULL && systemCPUPtr != NULL);
+
+    llvm::CallInst::Create(setCPUFunc, "", *bblock);
+    llvm::Value *systemCPU =
+        new llvm::LoadInst(systemCPUPtr, "system_cpu", *bblock);
+
+    for (unsigned int i = 0; i < tuned.size(); ++i) {
+        llvm::Value *match = NULL;
+        for (unsigned int j = 0; j < sizeof(lCPUModels) / sizeof(lCPUModels[0]); ++j) {
+            if (tuned[i].cpu != lCPUModels[j].cpu)
+                continue;
+            llvm::Value *model =
+                llvm::BinaryOperator::Create(llvm::Instruction::And, systemCPU,
+                                             LLVMInt32(lCPUModels[j].mask),
+                                             "cpu_model", *bblock);
+            llvm::Value *eq =
+                llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                                      model, LLVMInt32(lCPUModels[j].value),
+                                      "cpu_eq", *bblock);
+            match = (match == NULL) ? eq :
+                llvm::BinaryOperator::Create(llvm::Instruction::Or, match, eq,
+                                             "cpu_match", *bblock);
+        }
+        Assert(match != NULL);
+
+        llvm::BasicBlock *tunedBBlock =
+            llvm::BasicBlock::Create(*g->ctx, "do_tuned_call", func);
+        llvm::BasicBlock *nextBBlock =
+            llvm::BasicBlock::Create(*g->ctx, "next_tuned_try", func);
+        llvm::BranchInst::Create(tunedBBlock, nextBBlock, match, *bblock);
+        tunedBBlocks->push_back(tunedBBlock);
+        *bblock = nextBBlock;
+    }
+}
+
+
+/** Returns the value of the Target::ISA enumerant that the system's ISA
+    must be at least for the variant compiled for the given ISA to run. */
+static int
+lDispatchISANumber(int isa) {
+    // This is needed to separate generic from *-generic target
+    if ((Target::ISA)(isa == Target::GENERIC) &&
+        !g->target->getTreatGenericAsSmth().empty()) {
+        if (g->target->getTreatGenericAsSmth() == "knl_generic")
+            return Target::KNL_AVX512;
+        else {
+            Error(SourcePos(), "*-generic target can be called only with knl");
+            exit(1);
+        }
+    }
+    return isa;
+}
+
+
+/** Create a function that returns a pointer to the variant of an exported
+    function that's best for the system the code is running on, for the
+    --dispatch=table and --dispatch=ifunc modes.  The checks are the same
+    as the ones that lCreateDispatchFunction() emits inline for the
+    default mode; if none of the variants can run on the system, the
+    function calls abort().
+
+    @param module      Module in which to create the function.
+    @param setISAFunc  Pointer to the __set_system_isa() function.
+    @param systemBestISAPtr  Pointer to the __system_best_isa variable.
+    @param name        Name of the exported function.
+    @param targetFuncs Declarations of the target-specific variants in
+                       this module, indexed by Target::ISA.
+    @param tunedFuncs  Declarations of the CPU-tuned variants of each of
+                       them.
+    @param ftype       Type of the dispatch function.
+*/
+static llvm::Function *
+lCreateDispatchResolver(llvm::Module *module, llvm::Function *setISAFunc,
+                        llvm::Value *systemBestISAPtr, const std::string &name,
+                        llvm::Function *targetFuncs[],
+                        std::vector<TunedFunctionVariant> tunedFuncs[],
+                        llvm::FunctionType *ftype) {
+    llvm::PointerType *funcPtrType = llvm::PointerType::get(ftype, 0);
+    llvm::FunctionType *resolverType =
+        llvm::FunctionType::get(funcPtrType, false);
+    llvm::Function *resolver =
+        llvm::Function::Create(resolverType, llvm::GlobalValue::InternalLinkage,
+                               (name + "___resolve").c_str(), module);
+    resolver->setDoesNotThrow();
+    llvm::BasicBlock *bblock =
+        llvm::BasicBlock::Create(*g->ctx, "entry", resolver);
+
+    llvm::CallInst::Create(setISAFunc, "", bblock);
+    llvm::Value *systemISA =
+        new llvm::LoadInst(systemBestISAPtr, "system_isa", bblock);
+
+    for (int i = Target::NUM_ISAS-1; i >= 0; --i) {
+        if (targetFuncs[i] == NULL)
+            continue;
+
+        llvm::Value *ok =
+            llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SGE,
+                                  systemISA, LLVMInt32(lDispatchISANumber(i)),
+                                  "isa_ok", bblock);
+        llvm::BasicBlock *retBBlock =
+            llvm::BasicBlock::Create(*g->ctx, "found", resolver);
+        llvm::BasicBlock *nextBBlock =
+            llvm::BasicBlock::Create(*g->ctx, "next_try", resolver);
+        llvm::BranchInst::Create(retBBlock, nextBBlock, ok, bblock);
+
+        std::vector<llvm::BasicBlock *> tunedBBlocks;
+        lEmitTunedVariantChecks(module, resolver, tunedFuncs[i], &retBBlock,
+                                &tunedBBlocks);
+        for (unsigned int j = 0; j < tunedBBlocks.size(); ++j)
+            llvm::ReturnInst::Create(*g->ctx, tunedFuncs[i][j].func,
+                                     tunedBBlocks[j]);
+        llvm::ReturnInst::Create(*g->ctx, targetFuncs[i], retBBlock);
+        bblock = nextBBlock;
+    }
+
+    llvm::Function *abortFunc = module->getFunction("abort");
+    Assert(abortFunc);
+    llvm::CallInst::Create(abortFunc, "", bblock);
+    llvm::ReturnInst::Create(*g->ctx, llvm::Constant::getNullValue(funcPtrType),
+                             bblock);
+    return resolver;
+}
+
+
+/** Emit the body of a --dispatch=table dispatch function: the variant to
+    call is looked up with the resolver function on the first call and
+    cached in a module-local function pointer, so later calls cost a load,
+    a well-predicted branch, and an indirect call.  Threads that race on
+    the first call all store the same value. */
+static void
+lEmitTableDispatch(llvm::Module *module, llvm::Function *dispatchFunc,
+                   llvm::Function *resolver, const std::string &name) {
+    llvm::FunctionType *ftype = dispatchFunc->getFunctionType();
+    llvm::PointerType *funcPtrType = llvm::PointerType::get(ftype, 0);
+    llvm::GlobalVariable *funcPtr =
+        new llvm::GlobalVariable(*module, funcPtrType, false,
+                                 llvm::GlobalValue::InternalLinkage,
+                                 llvm::Constant::getNullValue(funcPtrType),
+                                 name + "___dispatch_ptr");
+    int ptrAlign = g->target->is32Bit() ? 4 : 8;
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_8
+    llvm::AtomicOrdering unordered = llvm::Unordered;
+#else // LLVM 3.9+
+    llvm::AtomicOrdering unordered = llvm::AtomicOrdering::Unordered;
+#endif
+
+    llvm::BasicBlock *entryBBlock =
+        llvm::BasicBlock::Create(*g->ctx, "entry", dispatchFunc);
+    llvm::BasicBlock *resolveBBlock =
+        llvm::BasicBlock::Create(*g->ctx, "resolve", dispatchFunc);
+    llvm::BasicBlock *callBBlock =
+        llvm::BasicBlock::Create(*g->ctx, "do_call", dispatchFunc);
+
+    llvm::LoadInst *cached =
+        new llvm::LoadInst(funcPtr, "cached_func", entryBBlock);
+    cached->setAlignment(ptrAlign);
+    cached->setAtomic(unordered);
+    llvm::Value *isNull =
+        llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                              cached, llvm::Constant::getNullValue(funcPtrType),
+                              "is_null", entryBBlock);
+    llvm::BranchInst::Create(resolveBBlock, callBBlock, isNull, entryBBlock);
+
+    llvm::Value *resolved =
+        llvm::CallInst::Create(resolver, "resolved_func", resolveBBlock);
+    llvm::StoreInst *store = new llvm::StoreInst(resolved, funcPtr, resolveBBlock);
+    store->setAlignment(ptrAlign);
+    store->setAtomic(unordered);
+    llvm::BranchInst::Create(callBBlock, resolveBBlock);
+
+    llvm::PHINode *func = llvm::PHINode::Create(funcPtrType, 2, "func", callBBlock);
+    func->addIncoming(cached, entryBBlock);
+    func->addIncoming(resolved, resolveBBlock);
+
+    std::vector<llvm::Value *> args;
+    for (llvm::Function::arg_iterator argIter = dispatchFunc->arg_begin();
+         argIter != dispatchFunc->arg_end(); ++argIter)
+        args.push_back(&*argIter);
+    if (ftype->getReturnType()->isVoidTy()) {
+        llvm::CallInst *call = llvm::CallInst::Create(func, args, "", callBBlock);
+        call->setTailCall();
+        llvm::ReturnInst::Create(*g->ctx, callBBlock);
+    }
+    else {
+        llvm::CallInst *call =
+            llvm::CallInst::Create(func, args, "ret_value", callBBlock);
+        call->setTailCall();
+        llvm::ReturnInst::Create(*g->ctx, call, callBBlock);
+    }
+}
+
+
+/** Emit a call from the dispatch function to one of the target-specific
+    variants of the function at the end of the given basic block, passing
+    through all of the dispatch function's arguments.  Returns the call,
+    or NULL if the function returns void. */
+static llvm::Value *
+lEmitDispatchCallInst(llvm::Function *dispatchFunc, llvm::Function *targetFunc,
+                      llvm::BasicBlock *callBBlock) {
+    std::vector<llvm::Value *> args;
+    llvm::Function::arg_iterator argIter = dispatchFunc->arg_begin();
+    llvm::Function::arg_iterator targsIter = targetFunc->arg_begin();
+    for (; argIter != dispatchFunc->arg_end(); ++argIter, ++targsIter) {
+      // Check to see if we rewrote any types in the dispatch function.
+      // If so, create bitcasts for the appropriate pointer types.
+      if (argIter->getType() == targsIter->getType()) {
+        args.push_back(&*argIter);
+      }
+      else {
+        llvm::CastInst *argCast = 
+          llvm::CastInst::CreatePointerCast(&*argIter, targsIter->getType(),
+                                            "dpatch_arg_bitcast", callBBlock);
+        args.push_back(argCast);
+      }
+    }
+    if (dispatchFunc->getReturnType()->isVoidTy()) {
+        llvm::CallInst::Create(targetFunc, args, "", callBBlock);
+        return NULL;
+    }
+    else
+        return llvm::CallInst::Create(targetFunc, args, "ret_value", callBBlock);
+}
+
+
+/** Emit a call from the dispatch function to one of the target-specific
+    variants of the function at the end of the given basic block and
+    return what the call returns. */
+static void
+lEmitDispatchCall(llvm::Function *dispatchFunc, llvm::Function *targetFunc,
+                  llvm::BasicBlock *callBBlock) {
+    llvm::Value *retValue =
+        lEmitDispatchCallInst(dispatchFunc, targetFunc, callBBlock);
+    if (retValue == NULL)
+        llvm::ReturnInst::Create(*g->ctx, callBBlock);
+    else
+        llvm::ReturnInst::Create(*g->ctx, retValue, callBBlock);
+}
+
+
+/** Emit the body of a --dispatch=autotune dispatch function.  Until a
+    variant has been chosen, each call goes to the next of the variants
+    that can run on the system in turn and is timed with the CPU's cycle
+    counter; once each one has been called g->autotuneCalls times, the
+    fastest is chosen and called from then on.  The bookkeeping is done by
+    __autotune_next() and __autotune_record() in builtins/dispatch.ll,
+    which also look up and store the choices in the cache file named by
+    the ISPC_AUTOTUNE_CACHE environment variable, if it's set. */
+static void
+lEmitAutotuneDispatch(llvm::Module *module, llvm::Function *dispatchFunc,
+                      llvm::Function *setISAFunc, llvm::Value *systemBestISAPtr,
+                      const std::string &name, llvm::Function *targetFuncs[],
+                      std::vector<TunedFunctionVariant> tunedFuncs[]) {
+    Assert(Target::NUM_ISAS < 32);
+    llvm::Function *nextFunc = module->getFunction("__autotune_next");
+    llvm::Function *recordFunc = module->getFunction("__autotune_record");
+    llvm::Function *abortFunc = module->getFunction("abort");
+    Assert(nextFunc != NULL && recordFunc != NULL && abortFunc != NULL);
+    llvm::Function *cycleFunc =
+        llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::readcyclecounter);
+
+    // The state that __autotune_next() and __autotune_record() keep for
+    // the function: the chosen ISA (-1 until there is one), the number of
+    // calls so far, and the cycles spent in the variant for each ISA.
+    llvm::ArrayType *stateType =
+        llvm::ArrayType::get(LLVMTypes::Int64Type, 2 + Target::NUM_ISAS);
+    std::vector<llvm::Constant *> initState(2 + Target::NUM_ISAS, LLVMInt64(0));
+    initState[0] = LLVMInt64(-1);
+    llvm::GlobalVariable *state =
+        new llvm::GlobalVariable(*module, stateType, false,
+                                 llvm::GlobalValue::InternalLinkage,
+                                 llvm::ConstantArray::get(stateType, initState),
+                                 name + "___autotune_state");
+    llvm::Constant *nameInit =
+        llvm::ConstantDataArray::getString(*g->ctx, name);
+    llvm::GlobalVariable *nameVar =
+        new llvm::GlobalVariable(*module, nameInit->getType(), true,
+                                 llvm::GlobalValue::InternalLinkage,
+                                 nameInit, name + "___autotune_name");
+    llvm::Constant *statePtr =
+        llvm::ConstantExpr::getBitCast(state, LLVMTypes::Int64PointerType);
+    llvm::Constant *namePtr =
+        llvm::ConstantExpr::getBitCast(nameVar, LLVMTypes::VoidPointerType);
+
+    llvm::BasicBlock *bblock =
+        llvm::BasicBlock::Create(*g->ctx, "entry", dispatchFunc);
+    llvm::CallInst::Create(setISAFunc, "", bblock);
+    llvm::Value *systemISA =
+        new llvm::LoadInst(systemBestISAPtr, "system_isa", bblock);
+
+    // Find the set of variants that can run on the system, with bit i set
+    // for the variant for Target::ISA i.
+    llvm::Value *runnable = LLVMInt32(0);
+    for (int i = 0; i < Target::NUM_ISAS; ++i) {
+        if (targetFuncs[i] == NULL)
+            continue;
+        llvm::Value *ok =
+            llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SGE,
+                                  systemISA, LLVMInt32(lDispatchISANumber(i)),
+                                  "isa_ok", bblock);
+        llvm::Value *bit =
+            llvm::SelectInst::Create(ok, LLVMInt32(1 << i), LLVMInt32(0),
+                                     "isa_bit", bblock);
+        runnable = llvm::BinaryOperator::Create(llvm::Instruction::Or, runnable,
+                                                bit, "runnable", bblock);
+    }
+
+    llvm::BasicBlock *chosenBBlock =
+        llvm::BasicBlock::Create(*g->ctx, "call_chosen", dispatchFunc);
+    llvm::BasicBlock *checkBBlock =
+        llvm::BasicBlock::Create(*g->ctx, "check_runnable", dispatchFunc);
+    llvm::BasicBlock *tuneBBlock =
+        llvm::BasicBlock::Create(*g->ctx, "tune", dispatchFunc);
+    llvm::BasicBlock *abortBBlock =
+        llvm::BasicBlock::Create(*g->ctx, "no_variant", dispatchFunc);
+    llvm::BasicBlock *timedBBlock =
+        llvm::BasicBlock::Create(*g->ctx, "timed_done", dispatchFunc);
+
+    llvm::Value *choice = new llvm::LoadInst(statePtr, "choice", bblock);
+    llvm::Value *decided =
+        llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SGE,
+                              choice, LLVMInt64(0), "decided", bblock);
+    llvm::BranchInst::Create(chosenBBlock, checkBBlock, decided, bblock);
+
+    // If none of the variants can run on the system, call abort(), as the
+    // other dispatch modes do.
+    llvm::Value *none =
+        llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                              runnable, LLVMInt32(0), "none_runnable", checkBBlock);
+    llvm::BranchInst::Create(abortBBlock, tuneBBlock, none, checkBBlock);
+    llvm::CallInst::Create(abortFunc, "", abortBBlock);
+    if (dispatchFunc->getReturnType()->isVoidTy())
+        llvm::ReturnInst::Create(*g->ctx, abortBBlock);
+    else
+        llvm::ReturnInst::Create(*g->ctx,
+            llvm::UndefValue::get(dispatchFunc->getReturnType()), abortBBlock);
+
+    // Once a variant has been chosen, call it directly.  (An unexpected
+    // choice, which can't happen, goes back to tuning.)
+    llvm::Value *choice32 =
+        new llvm::TruncInst(choice, LLVMTypes::Int32Type, "choice32", chosenBBlock);
+    llvm::SwitchInst *chosenSwitch =
+        llvm::SwitchInst::Create(choice32, checkBBlock, Target::NUM_ISAS,
+                                 chosenBBlock);
+
+    // Otherwise get the variant to time next and call it between reads of
+    // the cycle counter.
+    std::vector<llvm::Value *> nextArgs;
+    nextArgs.push_back(statePtr);
+    nextArgs.push_back(namePtr);
+    nextArgs.push_back(runnable);
+    llvm::Value *isa =
+        llvm::CallInst::Create(nextFunc, nextArgs, "isa", tuneBBlock);
+    llvm::Value *startCycles =
+        llvm::CallInst::Create(cycleFunc, "start_cycles", tuneBBlock);
+    llvm::SwitchInst *tuneSwitch =
+        llvm::SwitchInst::Create(isa, abortBBlock, Target::NUM_ISAS, tuneBBlock);
+
+    llvm::PHINode *timedRet = NULL;
+    if (!dispatchFunc->getReturnType()->isVoidTy())
+        timedRet = llvm::PHINode::Create(dispatchFunc->getReturnType(),
+                                         Target::NUM_ISAS, "timed_ret",
+                                         timedBBlock);
+
+    for (int i = 0; i < Target::NUM_ISAS; ++i) {
+        if (targetFuncs[i] == NULL)
+            continue;
+
+        llvm::BasicBlock *callBBlock =
+            llvm::BasicBlock::Create(*g->ctx, "do_call", dispatchFunc);
+        chosenSwitch->addCase(LLVMInt32(i), callBBlock);
+        std::vector<llvm::BasicBlock *> tunedBBlocks;
+        lEmitTunedVariantChecks(module, dispatchFunc, tunedFuncs[i],
+                                &callBBlock, &tunedBBlocks);
+        for (unsigned int j = 0; j < tunedBBlocks.size(); ++j)
+            lEmitDispatchCall(dispatchFunc, tunedFuncs[i][j].func,
+                              tunedBBlocks[j]);
+        lEmitDispatchCall(dispatchFunc, targetFuncs[i], callBBlock);
+
+        llvm::BasicBlock *timedCallBBlock =
+            llvm::BasicBlock::Create(*g->ctx, "do_timed_call", dispatchFunc);
+        tuneSwitch->addCase(LLVMInt32(i), timedCallBBlock);
+        tunedBBlocks.clear();
+        lEmitTunedVariantChecks(module, dispatchFunc, tunedFuncs[i],
+                                &timedCallBBlock, &tunedBBlocks);
+        tunedBBlocks.push_back(timedCallBBlock);
+        for (unsigned int j = 0; j < tunedBBlocks.size(); ++j) {
+            llvm::Function *func = (j < tunedFuncs[i].size()) ?
+                tunedFuncs[i][j].func : targetFuncs[i];
+            llvm::Value *retValue =
+                lEmitDispatchCallInst(dispatchFunc, func, tunedBBlocks[j]);
+            if (timedRet != NULL)
+                timedRet->addIncoming(retValue, tunedBBlocks[j]);
+            llvm::BranchInst::Create(timedBBlock, tunedBBlocks[j]);
+        }
+    }
+
+    llvm::Value *endCycles =
+        llvm::CallInst::Create(cycleFunc, "end_cycles", timedBBlock);
+    std::vector<llvm::Value *> recordArgs;
+    recordArgs.push_back(statePtr);
+    recordArgs.push_back(namePtr);
+    recordArgs.push_back(isa);
+    recordArgs.push_back(llvm::BinaryOperator::Create(llvm::Instruction::Sub,
+                                                      endCycles, startCycles,
+                                                      "cycles", timedBBlock));
+    recordArgs.push_back(runnable);
+    recordArgs.push_back(LLVMInt32(g->autotuneCalls));
+    llvm::CallInst::Create(recordFunc, recordArgs, "", timedBBlock);
+    if (timedRet == NULL)
+        llvm::ReturnInst::Create(*g->ctx, timedBBlock);
+    else
+        llvm::ReturnInst::Create(*g->ctx, timedRet, timedBBlock);
+}
+
+
 /** Create the dispatch function for an exported ispc function.
     This function checks to see which vector ISAs the system the
     code is running on supports and calls out to the best available
@@ -2788,6 +4566,7 @@ lCreateDispatchFunction(llvm::Module *module, llvm::Function *setISAFunc,
     // type is the same across all architectures, however in different
     // modules it may have dissimilar names. The loop below works this
     // around.
+    std::vector<TunedFunctionVariant> tunedFuncs[Target::NUM_ISAS];
     for (int i = 0; i < Target::NUM_ISAS; ++i) {
         if (funcs.func[i])
             targetFuncs[i] =
@@ -2795,10 +4574,46 @@ lCreateDispatchFunction(llvm::Module *module, llvm::Function *setISAFunc,
                                        funcs.func[i]->getName(), module);
         else
             targetFuncs[i] = NULL;
+        for (unsigned int j = 0; j < funcs.tuned[i].size(); ++j) {
+            TunedFunctionVariant tfv = funcs.tuned[i][j];
+            tfv.func =
+                llvm::Function::Create(ftype, llvm::GlobalValue::ExternalLinkage,
+                                       funcs.tuned[i][j].func->getName(), module);
+            tunedFuncs[i].push_back(tfv);
+        }
     }
 
     bool voidReturn = ftype->getReturnType()->isVoidTy();
 
+    if (g->dispatchMode == Globals::Dispatch_Autotune) {
+        llvm::Function *dispatchFunc =
+            llvm::Function::Create(ftype, llvm::GlobalValue::ExternalLinkage,
+                                   name.c_str(), module);
+        lEmitAutotuneDispatch(module, dispatchFunc, setISAFunc, systemBestISAPtr,
+                              name, targetFuncs, tunedFuncs);
+        return;
+    }
+
+    if (g->dispatchMode != Globals::Dispatch_Check) {
+        llvm::Function *resolver =
+            lCreateDispatchResolver(module, setISAFunc, systemBestISAPtr, name,
+                                    targetFuncs, tunedFuncs, ftype);
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+        if (g->dispatchMode == Globals::Dispatch_IFunc) {
+            // The dynamic linker calls the resolver when the program is
+            // loaded and binds the exported symbol to what it returns.
+            llvm::GlobalIFunc::create(ftype, 0, llvm::GlobalValue::ExternalLinkage,
+                                      name, resolver, module);
+            return;
+        }
+#endif
+        llvm::Function *dispatchFunc =
+            llvm::Function::Create(ftype, llvm::GlobalValue::ExternalLinkage,
+                                   name.c_str(), module);
+        lEmitTableDispatch(module, dispatchFunc, resolver, name);
+        return;
+    }
+
     // Now we can emit the definition of the dispatch function..
     llvm::Function *dispatchFunc =
         llvm::Function::Create(ftype, llvm::GlobalValue::ExternalLinkage,
@@ -2828,56 +4643,25 @@ lCreateDispatchFunction(llvm::Module *module, llvm::Function *setISAFunc,
         // variant successfully--"is the system's ISA enumerant value >=
         // the enumerant value of the current candidate?"
 
-        // dispatchNum is needed to separate generic from *-generic target
-        int dispatchNum = i;
-        if ((Target::ISA)(i == Target::GENERIC) && 
-            !g->target->getTreatGenericAsSmth().empty()) {
-            if (g->target->getTreatGenericAsSmth() == "knl_generic")
-                dispatchNum = Target::KNL_AVX512;
-            else {
-                Error(SourcePos(), "*-generic target can be called only with knl");
-                exit(1);
-            }
-        }
-
         llvm::Value *ok =
             llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SGE,
-                                  systemISA, LLVMInt32(dispatchNum), "isa_ok", bblock);
+                                  systemISA, LLVMInt32(lDispatchISANumber(i)),
+                                  "isa_ok", bblock);
         llvm::BasicBlock *callBBlock =
             llvm::BasicBlock::Create(*g->ctx, "do_call", dispatchFunc);
         llvm::BasicBlock *nextBBlock =
             llvm::BasicBlock::Create(*g->ctx, "next_try", dispatchFunc);
         llvm::BranchInst::Create(callBBlock, nextBBlock, ok, bblock);
 
-        // Emit the code to make the call call in callBBlock.
-        // Just pass through all of the args from the dispatch function to
-        // the target-specific function.
-        std::vector<llvm::Value *> args;
-        llvm::Function::arg_iterator argIter = dispatchFunc->arg_begin();
-        llvm::Function::arg_iterator targsIter = targetFuncs[i]->arg_begin();
-        for (; argIter != dispatchFunc->arg_end(); ++argIter, ++targsIter) {
-          // Check to see if we rewrote any types in the dispatch function.
-          // If so, create bitcasts for the appropriate pointer types.
-          if (argIter->getType() == targsIter->getType()) {
-            args.push_back(&*argIter);
-          }
-          else {
-            llvm::CastInst *argCast = 
-              llvm::CastInst::CreatePointerCast(&*argIter, targsIter->getType(),
-                                                "dpatch_arg_bitcast", callBBlock);
-            args.push_back(argCast);
-          }
-        }
-        if (voidReturn) {
-            llvm::CallInst::Create(targetFuncs[i], args, "", callBBlock);
-            llvm::ReturnInst::Create(*g->ctx, callBBlock);
-        }
-        else {
-            llvm::Value *retValue =
-                llvm::CallInst::Create(targetFuncs[i], args, "ret_value",
-                                       callBBlock);
-            llvm::ReturnInst::Create(*g->ctx, retValue, callBBlock);
-        }
+        // If there are variants of this ISA tuned for particular CPUs,
+        // check for those first.
+        std::vector<llvm::BasicBlock *> tunedBBlocks;
+        lEmitTunedVariantChecks(module, dispatchFunc, tunedFuncs[i],
+                                &callBBlock, &tunedBBlocks);
+        for (unsigned int j = 0; j < tunedBBlocks.size(); ++j)
+            lEmitDispatchCall(dispatchFunc, tunedFuncs[i][j].func,
+                              tunedBBlocks[j]);
+        lEmitDispatchCall(dispatchFunc, targetFuncs[i], callBBlock);
 
         // Otherwise we'll go on to the next candidate and see about that
         // one...
@@ -2929,6 +4713,20 @@ static llvm::Module *lInitDispatchModule() {
 // appropriate compiled variant of the function.
 static void lEmitDispatchModule(llvm::Module *module,
                                 std::map<std::string, FunctionTargetVariants> &functions) {
+    if (g->dispatchMode == Globals::Dispatch_IFunc) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+        if (llvm::Triple(module->getTargetTriple()).isOSBinFormatELF() == false) {
+            Warning(SourcePos(), "\"--dispatch=ifunc\" is only supported for "
+                    "ELF targets; using \"--dispatch=table\" instead.");
+            g->dispatchMode = Globals::Dispatch_Table;
+        }
+#else
+        Warning(SourcePos(), "\"--dispatch=ifunc\" requires LLVM 3.9 or later; "
+                "using \"--dispatch=table\" instead.");
+        g->dispatchMode = Globals::Dispatch_Table;
+#endif
+    }
+
     // Get pointers to things we need below
     llvm::Function *setFunc = module->getFunction("__set_system_isa");
     Assert(setFunc != NULL);
@@ -3035,6 +4833,325 @@ lExtractOrCheckGlobals(llvm::Module *msrc, llvm::Module *mdst, bool check) {
     }
 }
 
+
+// Turn the external global variable definitions in the given module into
+// declarations, just as lExtractOrCheckGlobals() does, but without
+// touching the dispatch module.  This is used by the worker processes in
+// parallel multi-target compilation; the definitions themselves are moved
+// to the dispatch module by the parent process.
+static void
+lStripGlobalDefinitions(llvm::Module *module) {
+    llvm::Module::global_iterator iter;
+
+    for (iter = module->global_begin(); iter != module->global_end(); ++iter) {
+        llvm::GlobalVariable *gv = &*iter;
+        if (gv->getLinkage() == llvm::GlobalValue::ExternalLinkage &&
+            gv->hasInitializer())
+            gv->setInitializer(NULL);
+    }
+}
+
+
+
+
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+// Links the given module into the fat object's module; the module is
+// left alone and a copy of it is linked if \c clone is true (as is the
+// case for the targets' modules, since their functions are still needed
+// for the dispatch functions), and it's consumed otherwise.  The targets'
+// modules are linked in one after the other, so that each target's code
+// ends up together in the output.
+static bool
+lLinkIntoFatModule(llvm::Module *fatModule, llvm::Module *module, bool clone) {
+    std::unique_ptr<llvm::Module> M;
+    if (clone)
+        M = llvm::CloneModule(module);
+    else
+        M.reset(module);
+    if (llvm::Linker::linkModules(*fatModule, std::move(M))) {
+        Error(SourcePos(), "Error linking the targets' code into a single "
+              "output file.");
+        return false;
+    }
+    return true;
+}
+
+
+// Returns true if the given function's code doesn't depend on the target
+// it was compiled for: it's scalar code that doesn't use any
+// target-specific intrinsics, so it can just as well be compiled for the
+// least capable of the targets.
+static bool
+lIsTargetIndependentFunction(llvm::Function *func) {
+    if (func->isDeclaration() || !func->hasLocalLinkage() ||
+        func->getReturnType()->isVectorTy())
+        return false;
+    for (llvm::Function::arg_iterator arg = func->arg_begin();
+         arg != func->arg_end(); ++arg)
+        if (arg->getType()->isVectorTy())
+            return false;
+
+    for (llvm::Function::iterator bb = func->begin(); bb != func->end(); ++bb)
+        for (llvm::BasicBlock::iterator inst = bb->begin(); inst != bb->end(); ++inst) {
+            if (inst->getType()->isVectorTy())
+                return false;
+            for (unsigned int i = 0; i < inst->getNumOperands(); ++i)
+                if (inst->getOperand(i)->getType()->isVectorTy())
+                    return false;
+            if (llvm::CallInst *ci = llvm::dyn_cast<llvm::CallInst>(&*inst)) {
+                llvm::Function *callee = ci->getCalledFunction();
+                if (callee == NULL || callee->isIntrinsic())
+                    return false;
+            }
+        }
+    return true;
+}
+
+
+// Removes the duplication between the targets in the fat object's module:
+// globals are already only defined once (by the dispatch module), and
+// here the functions that don't depend on the target are compiled for the
+// dispatch module's target (that of the least capable target), so that
+// the identical copies of them from the different targets can be merged,
+// as are identical constant tables.
+static void
+lDeduplicateFatModule(llvm::Module *fatModule) {
+    for (llvm::Module::iterator func = fatModule->begin();
+         func != fatModule->end(); ++func) {
+        if (lIsTargetIndependentFunction(&*func)) {
+            func->removeFnAttr("target-cpu");
+            func->removeFnAttr("target-features");
+            g->target->markFuncWithTargetAttr(&*func);
+        }
+    }
+
+    llvm::legacy::PassManager optPM;
+    optPM.add(llvm::createMergeFunctionsPass());
+    optPM.add(llvm::createConstantMergePass());
+    optPM.add(llvm::createGlobalDCEPass());
+    optPM.add(llvm::createVerifierPass());
+    optPM.run(*fatModule);
+}
+#endif // LLVM 3.9+
+
+
+///////////////////////////////////////////////////////////////////////////
+// Compilation cache
+//
+// Each cache entry is a directory under g->cacheDir, named after a hash of
+// the full cache key.  It holds one file for each of the outputs of the
+// compilation and a "key" file with the full key, which is written last
+// and is compared against the key of the current compilation before the
+// entry is used, so that hash collisions and partially-written entries
+// are never mistaken for a hit.
+
+/** Names of the files in a cache entry for each of the outputs that
+    CompileAndOutput() can generate, in the order of the arguments to
+    fetchCachedOutputs() and storeCachedOutputs(). */
+static const char *lCacheOutputNames[] = {
+    "output", "header", "deps", "host-stub", "dev-stub"
+};
+
+
+static bool
+lMakeDirectory(const std::string &path) {
+#ifdef ISPC_IS_WINDOWS
+    int err = _mkdir(path.c_str());
+#else
+    int err = mkdir(path.c_str(), 0777);
+#endif
+    return (err == 0 || errno == EEXIST);
+}
+
+
+static bool
+lReadFile(const std::string &fn, std::string *contents) {
+    FILE *f = fopen(fn.c_str(), "rb");
+    if (f == NULL)
+        return false;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        contents->append(buf, n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+
+/** Copies the file \c from to \c to.  The copy is first written to a
+    temporary file next to \c to and then renamed, so that concurrent
+    compilations never see a partially-written file. */
+static bool
+lCopyFile(const std::string &from, const std::string &to) {
+    FILE *in = fopen(from.c_str(), "rb");
+    if (in == NULL)
+        return false;
+
+    char suffix[32];
+#ifdef ISPC_IS_WINDOWS
+    sprintf(suffix, ".tmp%d", (int)GetCurrentProcessId());
+#else
+    sprintf(suffix, ".tmp%d", (int)getpid());
+#endif
+    std::string tmp = to + suffix;
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (out == NULL) {
+        fclose(in);
+        return false;
+    }
+
+    char buf[65536];
+    size_t n;
+    bool ok = true;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+        ok = (fwrite(buf, 1, n, out) == n);
+    ok = ok && !ferror(in);
+    fclose(in);
+    ok = (fclose(out) == 0) && ok;
+
+#ifdef ISPC_IS_WINDOWS
+    // rename() doesn't replace existing files on Windows.
+    if (ok)
+        remove(to.c_str());
+#endif
+    if (!ok || rename(tmp.c_str(), to.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/** Computes the cache key for compiling the given preprocessed source for
+    the current target and looks for a matching entry in the cache. */
+void
+Module::lookupCacheEntry(const std::string &preprocessed) {
+    char *cwd = NULL;
+    char cwdBuf[4096];
+#ifdef ISPC_IS_WINDOWS
+    cwd = _getcwd(cwdBuf, sizeof(cwdBuf));
+#else
+    cwd = getcwd(cwdBuf, sizeof(cwdBuf));
+#endif
+
+    // The working directory matters since it ends up in the debugging
+    // information and relative paths in the outputs.
+    cacheKey = g->cacheFlags;
+    cacheKey += std::string("target ") + g->target->GetISATargetString() +
+        g->target->GetVariantSuffix() + "\n";
+    cacheKey += std::string("cwd ") + (cwd ? cwd : "") + "\n";
+    cacheKey += preprocessed;
+
+    cacheEntry.clear();
+    std::string entry = std::string(g->cacheDir) + "/" + HashString(cacheKey);
+    std::string storedKey;
+    if (lReadFile(entry + "/key", &storedKey) && storedKey == cacheKey)
+        cacheEntry = entry;
+}
+
+
+/** Copies the outputs of the cached compilation to the given files, any
+    of which may be NULL if that output isn't wanted. */
+bool
+Module::fetchCachedOutputs(const char *outFileName, const char *headerFileName,
+                           const char *depsFileName, const char *hostStubFileName,
+                           const char *devStubFileName) const {
+    const char *fileNames[] = { outFileName, headerFileName, depsFileName,
+                                hostStubFileName, devStubFileName };
+    for (int i = 0; i < 5; ++i) {
+        if (fileNames[i] == NULL)
+            continue;
+        std::string cached = cacheEntry + "/" + lCacheOutputNames[i];
+        if (!lCopyFile(cached, fileNames[i])) {
+            Error(SourcePos(), "Unable to copy \"%s\" from the compilation "
+                  "cache to \"%s\".", cached.c_str(), fileNames[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** Adds the given outputs of the current compilation to the cache.
+    Failures are silently ignored; the outputs just won't be cached. */
+void
+Module::storeCachedOutputs(const char *outFileName, const char *headerFileName,
+                           const char *depsFileName, const char *hostStubFileName,
+                           const char *devStubFileName) const {
+    if (cacheKey.empty() || errorCount > 0)
+        return;
+
+    std::string entry = std::string(g->cacheDir) + "/" + HashString(cacheKey);
+    if (!lMakeDirectory(g->cacheDir) || !lMakeDirectory(entry))
+        return;
+
+    const char *fileNames[] = { outFileName, headerFileName, depsFileName,
+                                hostStubFileName, devStubFileName };
+    for (int i = 0; i < 5; ++i) {
+        if (fileNames[i] == NULL)
+            continue;
+        if (!lCopyFile(fileNames[i], entry + "/" + lCacheOutputNames[i]))
+            return;
+    }
+
+    // Finally, write the key to mark the entry as complete.
+    std::string keyFile = entry + "/key.new";
+    FILE *f = fopen(keyFile.c_str(), "wb");
+    if (f == NULL)
+        return;
+    bool ok = (fwrite(cacheKey.data(), 1, cacheKey.size(), f) == cacheKey.size());
+    ok = (fclose(f) == 0) && ok;
+    if (ok)
+        ok = lCopyFile(keyFile, entry + "/key");
+    remove(keyFile.c_str());
+}
+
+
+/** Returns the name of the file that writeTargetOutput() writes the
+    current target's code to in a multi-target compilation. */
+static std::string
+lTargetOutputFileName(const char *outFileName) {
+    if (g->target->getISA() == Target::GENERIC &&
+        !g->target->getTreatGenericAsSmth().empty())
+        return lGetTargetFileName(outFileName,
+                                  g->target->getTreatGenericAsSmth().c_str(), true);
+
+    std::string isaName = std::string(g->target->GetISAString()) +
+        g->target->GetVariantSuffix();
+    return lGetTargetFileName(outFileName, isaName.c_str(), false);
+}
+
+
+/** The per-target entries of multi-target compilations only hold the
+    target's native code; the headers and the dispatch module are always
+    regenerated, since doing so requires the parsed program in any case. */
+bool
+Module::fetchCachedTargetOutput(const char *outFileName) const {
+    return fetchCachedOutputs(lTargetOutputFileName(outFileName).c_str(),
+                              NULL, NULL, NULL, NULL);
+}
+
+
+void
+Module::storeCachedTargetOutput(const char *outFileName) const {
+    storeCachedOutputs(lTargetOutputFileName(outFileName).c_str(),
+                       NULL, NULL, NULL, NULL);
+}
+
+
+bool
+Module::writeTargetOutput(OutputType outputType, const char *outFileName,
+                          const char *includeFileName) {
+    std::string targetOutFileName = lTargetOutputFileName(outFileName);
+    // We always generate cpp file for *-generic target during multitarget compilation
+    if (g->target->getISA() == Target::GENERIC &&
+        !g->target->getTreatGenericAsSmth().empty())
+        return writeOutput(CXX, targetOutFileName.c_str(), includeFileName);
+    else
+        return writeOutput(outputType, targetOutFileName.c_str());
+}
+
 #ifdef ISPC_NVPTX_ENABLED
 static std::string lCBEMangle(const std::string &S) 
 {
@@ -3075,6 +5192,16 @@ Module::CompileAndOutput(const char *srcFile,
                          const char *hostStubFileName,
                          const char *devStubFileName)
 {
+    // Outputs written to stdout can't be copied to or from the cache.
+    const char *outputFileNames[] = { outFileName, headerFileName, depsFileName,
+                                      hostStubFileName, devStubFileName };
+    for (int i = 0; i < 5; ++i)
+        if (outputFileNames[i] != NULL && !strcmp(outputFileNames[i], "-"))
+            g->cacheDir = NULL;
+    // Nor can the several files that split C++ output is written to.
+    if (outputType == CXX && g->cxxSplitCount > 1)
+        g->cacheDir = NULL;
+
     if (target == NULL || strchr(target, ',') == NULL) {
         // We're only compiling to a single target
         g->target = new Target(arch, cpu, target, generatePIC, g->printTarget);
@@ -3127,21 +5254,33 @@ Module::CompileAndOutput(const char *srcFile,
                 }
             }
 
-            if (outFileName != NULL)
-                if (!m->writeOutput(outputType, outFileName, includeFileName))
+            if (!m->cacheEntry.empty()) {
+                // An identical compilation has already been done; just
+                // copy its outputs.
+                if (!m->fetchCachedOutputs(outFileName, headerFileName,
+                                           depsFileName, hostStubFileName,
+                                           devStubFileName))
                     return 1;
-            if (headerFileName != NULL)
-                if (!m->writeOutput(Module::Header, headerFileName))
+            }
+            else {
+                if (outFileName != NULL)
+                    if (!m->writeOutput(outputType, outFileName, includeFileName))
+                        return 1;
+                if (headerFileName != NULL)
+                    if (!m->writeOutput(Module::Header, headerFileName))
+                        return 1;
+                if (depsFileName != NULL)
+                  if (!m->writeOutput(Module::Deps,depsFileName))
                     return 1;
-            if (depsFileName != NULL)
-              if (!m->writeOutput(Module::Deps,depsFileName))
-                return 1;
-            if (hostStubFileName != NULL)
-              if (!m->writeOutput(Module::HostStub,hostStubFileName))
-                return 1;
-            if (devStubFileName != NULL)
-              if (!m->writeOutput(Module::DevStub,devStubFileName))
-                return 1;
+                if (hostStubFileName != NULL)
+                  if (!m->writeOutput(Module::HostStub,hostStubFileName))
+                    return 1;
+                if (devStubFileName != NULL)
+                  if (!m->writeOutput(Module::DevStub,devStubFileName))
+                    return 1;
+                m->storeCachedOutputs(outFileName, headerFileName, depsFileName,
+                                      hostStubFileName, devStubFileName);
+            }
         }
         else
             ++m->errorCount;
@@ -3183,6 +5322,22 @@ Module::CompileAndOutput(const char *srcFile,
             return 1;
         }
 
+        if (g->fatObject) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+            if (outputType != Object && outputType != Asm && outputType != Bitcode) {
+                Error(SourcePos(), "\"--fat-object\" can only be used when "
+                      "generating object files, assembly or LLVM bitcode.");
+                return 1;
+            }
+            // The optimized code of all of the targets is needed for the
+            // single output, while the cache only has their native code.
+            g->cacheDir = NULL;
+#else
+            Error(SourcePos(), "\"--fat-object\" requires LLVM 3.9 or later.");
+            return 1;
+#endif
+        }
+
         // Make sure that the function names for 'export'ed functions have
         // the target ISA appended to them.
         g->mangleFunctionsWithTarget = true;
@@ -3190,8 +5345,18 @@ Module::CompileAndOutput(const char *srcFile,
         llvm::TargetMachine *targetMachines[Target::NUM_ISAS];
         for (int i = 0; i < Target::NUM_ISAS; ++i)
             targetMachines[i] = NULL;
+        // Gang sizes compiled to for each ISA and overall
+        std::set<int> isaVectorWidths[Target::NUM_ISAS];
+        std::set<int> targetVectorWidths;
+        // The first gang size listed for each ISA, and the CPUs that it
+        // has been compiled for
+        int isaFirstVectorWidths[Target::NUM_ISAS];
+        std::set<std::string> isaCPUs[Target::NUM_ISAS];
 
         llvm::Module *dispatchModule = NULL;
+        // With --fat-object, all of the targets' code is linked together
+        // with the dispatch module into this one.
+        llvm::Module *fatModule = NULL;
 
         std::map<std::string, FunctionTargetVariants> exportedFunctions;
         int errorCount = 0;
@@ -3220,26 +5385,150 @@ Module::CompileAndOutput(const char *srcFile,
         // It indicates if we have *-generic target. 
         std::string treatGenericAsSmth = "";
 
+#ifndef ISPC_IS_WINDOWS
+        // When more than one job is allowed, each target's module is
+        // parsed here but then optimized and written out by a child
+        // process, so that the expensive part of the compilation runs
+        // concurrently for all of the targets.  The parent keeps its
+        // unoptimized copy of the module around for generating the
+        // headers and the dispatch module, neither of which depend on the
+        // optimized code.
+        // (The time report only covers the work done in this process, and
+        // --opt=select-width needs the optimized code to compare the gang
+        // sizes, so in those cases the targets are compiled one at a
+        // time.)
+        // (With --fat-object, the single output file is written by
+        // this process, though its code generation can still be split
+        // between multiple processes by writeObjectFileOrAssembly().)
+        bool parallelTargets = (g->numJobs > 1) && (outFileName != NULL) &&
+            !g->timeReport && !g->opt.selectWidth && !g->fatObject;
+        std::vector<TargetJob> targetJobs;
+#else
+        bool parallelTargets = false;
+#endif // !ISPC_IS_WINDOWS
+
+        // The Module for each target, which are all deleted once the
+        // dispatch module has been emitted.
+        std::vector<Module *> targetModules;
+
         for (unsigned int i = 0; i < targets.size(); ++i) {
-            g->target = new Target(arch, cpu, targets[i].c_str(), generatePIC, g->printTarget);
+            // Each target may be given a CPU to compile for, as in
+            // "avx2:znver1".
+            std::string isaString = targets[i], tuneCPU;
+            size_t colon = isaString.find(':');
+            if (colon != std::string::npos) {
+                tuneCPU = isaString.substr(colon + 1);
+                isaString = isaString.substr(0, colon);
+            }
+            g->target = new Target(arch, tuneCPU.empty() ? cpu : tuneCPU.c_str(),
+                                   isaString.c_str(), generatePIC, g->printTarget);
             if (!g->target->isValid())
                 return 1;
 
             if (!g->target->getTreatGenericAsSmth().empty())
                 treatGenericAsSmth = g->target->getTreatGenericAsSmth();
+            if (g->fatObject && g->target->getISA() == Target::GENERIC) {
+                Error(SourcePos(), "\"--fat-object\" can't be used with "
+                      "generic targets.");
+                return 1;
+            }
 
             // Issue an error if we've already compiled to a variant of
-            // this target ISA.  (It doesn't make sense to compile to both
-            // avx and avx-x2, for example.)
-            if (targetMachines[g->target->getISA()] != NULL) {
-                Error(SourcePos(), "Can't compile to multiple variants of %s "
-                      "target!\n", g->target->GetISAString());
-                return 1;
+            // this target ISA with the same gang size, unless the new one
+            // is tuned for a different CPU (e.g. avx2:haswell and
+            // avx2:znver1); those are complete variants that the dispatch
+            // functions choose between with the system's CPU model.
+            // Variants with other gang sizes (e.g. avx2-i32x8 and
+            // avx2-i32x16) are only useful for the functions declared with
+            // __declspec(width<N>) for their gang size, so those are the
+            // only ones they export and the rest of the program comes from
+            // the first variant.
+            int isa = g->target->getISA();
+            if (targetMachines[isa] != NULL) {
+                if (isaVectorWidths[isa].count(g->target->getVectorWidth()) == 0)
+                    g->target->setWidthVariant(true);
+                else if (!tuneCPU.empty() &&
+                         g->target->getVectorWidth() == isaFirstVectorWidths[isa] &&
+                         isaCPUs[isa].count(g->target->getCPU()) == 0) {
+                    if (!lCanDispatchOnCPU(g->target->getCPU())) {
+                        Error(SourcePos(), "The dispatch functions can't "
+                              "identify \"%s\" CPUs, so variants of the %s "
+                              "target can't be tuned for them.",
+                              g->target->getCPU().c_str(),
+                              g->target->GetISAString());
+                        return 1;
+                    }
+                    g->target->setTunedVariant(true);
+                    isaCPUs[isa].insert(g->target->getCPU());
+                }
+                else {
+                    Error(SourcePos(), "Can't compile to multiple variants of %s "
+                          "target with the same gang size!\n",
+                          g->target->GetISAString());
+                    return 1;
+                }
             }
-            targetMachines[g->target->getISA()] = g->target->GetTargetMachine();
+            else {
+                targetMachines[isa] = g->target->GetTargetMachine();
+                isaFirstVectorWidths[isa] = g->target->getVectorWidth();
+                isaCPUs[isa].insert(g->target->getCPU());
+            }
+            isaVectorWidths[g->target->getISA()].insert(g->target->getVectorWidth());
+            targetVectorWidths.insert(g->target->getVectorWidth());
 
             m = new Module(srcFile);
-            if (m->CompileFile() == 0) {
+            targetModules.push_back(m);
+            if (m->CompileFile(!parallelTargets, true) == 0) {
+                // If the cache has this target's native code, the module
+                // is still needed for the headers and the dispatch
+                // functions, but it doesn't need to be compiled further.
+                bool cached = !m->cacheEntry.empty() && outFileName != NULL;
+#ifndef ISPC_IS_WINDOWS
+                if (parallelTargets && !cached) {
+                    // Don't have more than the requested number of
+                    // workers running at once.
+                    while ((int)targetJobs.size() >= g->numJobs)
+                        if (!lWaitForTargetJob(targetJobs))
+                            ++errorCount;
+
+                    // Make sure that any pending output isn't written
+                    // twice, once by us and once by the child.
+                    fflush(stdout);
+                    fflush(stderr);
+
+                    pid_t pid = fork();
+                    if (pid == -1) {
+                        perror("fork");
+                        lAbortTargetJobs(targetJobs);
+                        return 1;
+                    }
+                    else if (pid == 0) {
+                        // Child: finish compiling this target and exit;
+                        // everything else is left to the parent.  (The
+                        // other workers are already using the remaining
+                        // jobs, so its code generation isn't split.)
+                        g->numJobs = 1;
+                        Optimize(m->module, g->opt.level);
+                        lStripGlobalDefinitions(m->module);
+                        bool ok = (m->errorCount == 0) &&
+                            m->writeTargetOutput(outputType, outFileName,
+                                                 includeFileName) &&
+                            (m->errorCount == 0);
+                        if (ok)
+                            m->storeCachedTargetOutput(outFileName);
+                        fflush(stdout);
+                        fflush(stderr);
+                        _exit(ok ? 0 : 1);
+                    }
+
+                    TargetJob job;
+                    job.pid = pid;
+                    job.isaName = g->target->GetISATargetString();
+                    job.outFileName = lTargetOutputFileName(outFileName);
+                    targetJobs.push_back(job);
+                }
+#endif // !ISPC_IS_WINDOWS
+
                 // Create the dispatch module, unless already created;
                 // in the latter case, just do the checking
                 bool check = (dispatchModule != NULL);
@@ -3252,26 +5541,33 @@ Module::CompileAndOutput(const char *srcFile,
                 // later.
                 lGetExportedFunctions(m->symbolTable, exportedFunctions);
 
-                if (outFileName != NULL) {
-                    std::string targetOutFileName;
-                    // We always generate cpp file for *-generic target during multitarget compilation
-                    if (g->target->getISA() == Target::GENERIC && 
-                        !g->target->getTreatGenericAsSmth().empty()) {
-                        targetOutFileName = lGetTargetFileName(outFileName, 
-                                                g->target->getTreatGenericAsSmth().c_str(), true);
-                        if (!m->writeOutput(CXX, targetOutFileName.c_str(), includeFileName))
-                            return 1;
-                    }
-                    else {
-                        const char *isaName = g->target->GetISAString();
-                        targetOutFileName = lGetTargetFileName(outFileName, isaName, false);
-                        if (!m->writeOutput(outputType, targetOutFileName.c_str()))
-                            return 1;
+                if (g->fatObject) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+                    if (fatModule == NULL) {
+                        fatModule = new llvm::Module("fat_module", *g->ctx);
+                        fatModule->setTargetTriple(m->module->getTargetTriple());
+                        fatModule->setDataLayout(m->module->getDataLayout());
                     }
+                    if (!lLinkIntoFatModule(fatModule, m->module, true))
+                        return 1;
+#endif // LLVM 3.9+
+                }
+                else if (cached) {
+                    if (!m->fetchCachedTargetOutput(outFileName))
+                        return 1;
+                }
+                else if (outFileName != NULL && !parallelTargets) {
+                    if (!m->writeTargetOutput(outputType, outFileName,
+                                              includeFileName))
+                        return 1;
+                    m->storeCachedTargetOutput(outFileName);
                 }
             }
             errorCount += m->errorCount;
             if (errorCount != 0) {
+#ifndef ISPC_IS_WINDOWS
+                lAbortTargetJobs(targetJobs);
+#endif // !ISPC_IS_WINDOWS
                 return 1;
             }
 
@@ -3283,14 +5579,15 @@ Module::CompileAndOutput(const char *srcFile,
                 DHI.EmitBackMatter = true;
               }
               
-              const char *isaName;
+              std::string isaName;
               if (g->target->getISA() == Target::GENERIC &&
                         !g->target->getTreatGenericAsSmth().empty())
-                  isaName = g->target->getTreatGenericAsSmth().c_str();
+                  isaName = g->target->getTreatGenericAsSmth();
               else 
-                  isaName = g->target->GetISAString();
+                  isaName = std::string(g->target->GetISAString()) +
+                      g->target->GetVariantSuffix();
               std::string targetHeaderFileName = 
-                lGetTargetFileName(headerFileName, isaName, false);
+                lGetTargetFileName(headerFileName, isaName.c_str(), false);
               // write out a header w/o target name for the first target only
               if (!m->writeOutput(Module::Header, headerFileName, "", &DHI)) {
                 return 1;
@@ -3311,6 +5608,34 @@ Module::CompileAndOutput(const char *srcFile,
             // we generate the dispatch module's functions...
         }
 
+#ifndef ISPC_IS_WINDOWS
+        // Wait for all of the per-target workers to finish before emitting
+        // the dispatch module.
+        while (!targetJobs.empty())
+            if (!lWaitForTargetJob(targetJobs))
+                ++errorCount;
+        if (errorCount != 0)
+            return 1;
+#endif // !ISPC_IS_WINDOWS
+
+        // Make sure that the functions declared for a particular gang size
+        // were compiled for at least one of the targets.
+        std::vector<Symbol *> gangWidthFuncs;
+        m->symbolTable->GetMatchingFunctions(lHasGangWidth, &gangWidthFuncs);
+        for (unsigned int j = 0; j < gangWidthFuncs.size(); ++j) {
+            const FunctionType *ft =
+                CastType<FunctionType>(gangWidthFuncs[j]->type);
+            if (targetVectorWidths.count(ft->gangWidth) == 0) {
+                Error(gangWidthFuncs[j]->pos, "Function \"%s\" is declared "
+                      "with __declspec(width%d) but none of the targets has "
+                      "that gang size.", gangWidthFuncs[j]->name.c_str(),
+                      ft->gangWidth);
+                ++errorCount;
+            }
+        }
+        if (errorCount != 0)
+            return 1;
+
         // Find the first non-NULL target machine from the targets we
         // compiled to above.  We'll use this as the target machine for
         // compiling the dispatch module--this is safe in that it is the
@@ -3331,6 +5656,15 @@ Module::CompileAndOutput(const char *srcFile,
 
         lEmitDispatchModule(dispatchModule, exportedFunctions);
 
+        if (fatModule != NULL) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_9 // LLVM 3.9+
+            if (!lLinkIntoFatModule(fatModule, dispatchModule, false))
+                return 1;
+            lDeduplicateFatModule(fatModule);
+            dispatchModule = fatModule;
+#endif // LLVM 3.9+
+        }
+
         if (outFileName != NULL) {
             if (outputType == Bitcode)
                 writeBitcode(dispatchModule, outFileName);
@@ -3343,6 +5677,10 @@ Module::CompileAndOutput(const char *srcFile,
             if (!m->writeOutput(Module::Deps, depsFileName))
                 return 1;
 
+        for (unsigned int j = 0; j < targetModules.size(); ++j)
+            delete targetModules[j];
+        m = NULL;
+
         delete g->target;
         g->target = NULL;
 
@@ -41,6 +41,7 @@
 
 #include "ispc.h"
 #include "ast.h"
+#include "util.h"
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_4
   #include <llvm/DebugInfo.h>
 #elif ISPC_LLVM_VERSION >= ISPC_LLVM_3_5
@@ -52,6 +53,7 @@ namespace llvm
     class raw_string_ostream;
 }
 
+class StructType;
 struct DispatchHeaderInfo;
 
 class Module {
@@ -62,13 +64,35 @@ public:
 
     /** Compiles the source file passed to the Module constructor, adding
         its global variables and functions to both the llvm::Module and
-        SymbolTable.  Returns the number of errors during compilation.  */
-    int CompileFile();
+        SymbolTable.  If \c optimize is false, the generated IR is left
+        unoptimized and the caller is responsible for running Optimize()
+        on the module before emitting any output.
+
+        When a compilation cache is in use (--cache-dir), the preprocessed
+        source is used to look for the outputs of an identical earlier
+        compilation.  If one is found, optimization is skipped and, unless
+        \c parseOnCacheHit is true, so is parsing; the caller then fetches
+        the outputs with fetchCachedOutputs() or
+        fetchCachedTargetOutput().  Returns the number of errors during
+        compilation.  */
+    int CompileFile(bool optimize = true, bool parseOnCacheHit = false);
+
+    /** Runs the C preprocessor on the given file, with the include paths
+        and macro definitions of the current compilation and target, and
+        writes its output to \c ostream. */
+    void execPreprocessor(const char *infilename, llvm::raw_string_ostream* ostream) const;
 
     /** Add a named type definition to the module. */
     void AddTypeDef(const std::string &name, const Type *type,
                     SourcePos pos);
 
+    /** Add a typedef declared with "export typedef" to the module.  The
+        type must be a struct type (possibly with an soa<> layout).  The
+        typedef, along with C++ types for accessing arrays of it that
+        don't depend on its layout, is emitted in the header file. */
+    void AddExportedTypeDef(const std::string &name, const Type *type,
+                            SourcePos pos);
+
     /** Add a new global variable corresponding to the given Symbol to the
         module.  If non-NULL, initExpr gives the initiailizer expression
         for the global's inital value. */
@@ -87,6 +111,29 @@ public:
     void AddFunctionDefinition(const std::string &name,
                                const FunctionType *ftype, Stmt *code);
 
+    /** Returns the definition of the given function symbol, or NULL if it
+        hasn't been defined (yet). */
+    const Function *GetFunctionDefinition(const Symbol *sym) const;
+
+    /** When compiling with --instrument=occupancy, allocates the counters
+        for a new instrumentation point and returns its index. */
+    int AddOccupancySite(const char *note, SourcePos pos);
+
+    /** Returns a pointer (of type int64 *) to this module's thread-local
+        table of occupancy counters; the counters for site i start at
+        element i * (programCount + 1), and are indexed by the number of
+        active program instances. */
+    llvm::Value *GetOccupancyCounters();
+
+    /** Returns a pointer (of type int8 *) to the ISPCOccupancyModule
+        structure that describes this module's instrumentation points. */
+    llvm::Value *GetOccupancyModuleInfo();
+
+    /** Returns a pointer to the thread-local int32 flag that records
+        whether the current thread's counters have been passed to
+        ISPCOccupancyRegister(). */
+    llvm::Value *GetOccupancyRegisteredFlag();
+
     /** Adds the given type to the set of types that have their definitions
         included in automatically generated header files. */
     void AddExportedTypes(const std::vector<std::pair<const Type *,
@@ -150,10 +197,31 @@ public:
     /** Total number of errors encountered during compilation. */
     int errorCount;
 
+    /** Set during parsing if a function or block turns floating-point
+        contraction off.  The module is then compiled with LLVM's
+        "standard" contraction, which only fuses the llvm.fmuladd calls
+        that are emitted for contractable expressions everywhere else. */
+    bool noFPContract;
+
+    /** An exported or task function to describe in the
+        --emit-perf-report output. */
+    struct PerfReportFunction {
+        std::string llvmName, name;
+        const char *kind;
+        SourcePos pos;
+    };
+    /** The functions for --emit-perf-report, in the order in which they
+        were defined. */
+    std::vector<PerfReportFunction> perfReportFunctions;
+
     /** Symbol table to hold symbols visible in the current scope during
         compilation. */
     SymbolTable *symbolTable;
 
+    /** Memory for the module's AST nodes and Symbols; they're destroyed
+        and their memory is released when the Module is deleted. */
+    MemoryArena arena;
+
     /** llvm Module object into which globals and functions are added. */
     llvm::Module *module;
 
@@ -171,6 +239,21 @@ private:
     AST *ast;
 
     std::vector<std::pair<const Type *, SourcePos> > exportedTypes;
+    std::vector<std::pair<std::string, const StructType *> > exportedTypeDefs;
+
+    /** Instrumentation points for --instrument=occupancy.  The counter
+        table and the module information are referred to through
+        placeholder globals while the functions are being compiled, and
+        are replaced with the real ones, once the number of points is
+        known, by finalizeOccupancyProfile(). */
+    struct OccupancySite {
+        std::string file, note;
+        int line;
+    };
+    std::vector<OccupancySite> occupancySites;
+    llvm::GlobalVariable *occupancyCounters, *occupancyModuleInfo;
+    llvm::GlobalVariable *occupancyRegistered;
+    void finalizeOccupancyProfile();
 
     /** Write the corresponding output type to the given file.  Returns
         true on success, false if there has been an error.  The given
@@ -184,13 +267,50 @@ private:
     bool writeDeps(const char *filename);
     bool writeDevStub(const char *filename);
     bool writeHostStub(const char *filename);
+    bool writeTargetOutput(OutputType outputType, const char *outFileName,
+                           const char *includeFileName);
     bool writeObjectFileOrAssembly(OutputType outputType, const char *filename);
     static bool writeObjectFileOrAssembly(llvm::TargetMachine *targetMachine,
                                           llvm::Module *module, OutputType outputType,
                                           const char *outFileName);
     static bool writeBitcode(llvm::Module *module, const char *outFileName);
+    /** Generates the object file for \c module with multiple processes
+        when --jobs is used.  Returns false if the module wasn't split (in
+        which case nothing has been written); otherwise \c *failed is set
+        if the object file couldn't be generated. */
+    static bool writeSplitObjectFile(llvm::TargetMachine *targetMachine,
+                                     llvm::Module *module, const char *outFileName,
+                                     bool *failed);
 
-    void execPreprocessor(const char *infilename, llvm::raw_string_ostream* ostream) const;
+    /** Replaces the parameters of Globals::specializedFunction that are
+        listed in Globals::specializedParams with constants. */
+    void specializeExportedFunction();
+
+    /** Compilation cache support; the outputs of a compilation are stored
+        in a directory under Globals::cacheDir that is named after a hash
+        of \c cacheKey. */
+    void lookupCacheEntry(const std::string &preprocessed);
+    bool fetchCachedOutputs(const char *outFileName, const char *headerFileName,
+                            const char *depsFileName, const char *hostStubFileName,
+                            const char *devStubFileName) const;
+    void storeCachedOutputs(const char *outFileName, const char *headerFileName,
+                            const char *depsFileName, const char *hostStubFileName,
+                            const char *devStubFileName) const;
+    bool fetchCachedTargetOutput(const char *outFileName) const;
+    void storeCachedTargetOutput(const char *outFileName) const;
+
+    /** The full key for this compilation in the compilation cache, or an
+        empty string if the cache isn't being used. */
+    std::string cacheKey;
+
+    /** The directory of the cache entry with the outputs for \c cacheKey,
+        if there is one; empty otherwise. */
+    std::string cacheEntry;
 };
 
+/** Returns an estimate of the number of vector values in the given
+    function that don't fit in the target's vector registers and so have
+    to be spilled, summed over its basic blocks. */
+int EstimateSpilledVectorValues(llvm::Function *func);
+
 #endif // ISPC_MODULE_H
@@ -45,6 +45,7 @@
 
 #include <stdio.h>
 #include <map>
+#include <algorithm>
 #include <set>
 
 #include <llvm/Pass.h>
@@ -83,6 +84,8 @@
     #include <llvm/IR/IRPrintingPasses.h>
     #include <llvm/IR/PatternMatch.h>
     #include <llvm/IR/DebugInfo.h>
+    #include <llvm/IR/Dominators.h>
+    #include <llvm/IR/CFG.h>
 #else // < 3.5
     #include <llvm/Analysis/Verifier.h>
     #include <llvm/Assembly/PrintModulePass.h>
@@ -97,9 +100,11 @@
 #endif
 #include <llvm/ADT/Triple.h>
 #include <llvm/ADT/SmallSet.h>
+#include <llvm/ADT/SCCIterator.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/IPO.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/Target/TargetOptions.h>
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
   #include <llvm/DataLayout.h>
@@ -139,15 +144,31 @@
 #endif
 
 static llvm::Pass *CreateIntrinsicsOptPass();
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+static llvm::Pass *CreateMaskAssumptionsPass();
+#endif
 static llvm::Pass *CreateInstructionSimplifyPass();
+static llvm::Pass *CreateScalarizeUniformPass();
+static llvm::Pass *CreateVectorizeReductionsPass();
 static llvm::Pass *CreatePeepholePass();
+static llvm::Pass *CreateVectorDivisionPass();
 
-static llvm::Pass *CreateImproveMemoryOpsPass();
+static llvm::Pass *CreateImproveMemoryOpsPass(bool lowerStrided = false);
 static llvm::Pass *CreateGatherCoalescePass();
+static llvm::Pass *CreateScatterCoalescePass();
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
+static llvm::Pass *CreatePrefetchGathersPass();
+#endif
 static llvm::Pass *CreateReplacePseudoMemoryOpsPass();
 
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_3 // LLVM 3.3+
+static llvm::Pass *CreateSpecializeConstantArgsPass();
+static llvm::Pass *CreateAllOnClonesPass();
+#endif
 static llvm::Pass *CreateIsCompileTimeConstantPass(bool isLastTry);
 static llvm::Pass *CreateMakeInternalFuncsStaticPass();
+static llvm::Pass *CreateLocalsToScratchPass();
+static llvm::Pass *CreatePerfReportPass();
 
 static llvm::Pass *CreateDebugPass(char * output);
 
@@ -284,6 +305,14 @@ lGetSourcePosFromMetadata(const llvm::Instruction *inst, SourcePos *pos) {
 }
 
 
+/** Returns the name of the function that the given instruction is in, for
+    use in optimization remarks. */
+static std::string
+lFunctionName(const llvm::Instruction *inst) {
+    return inst->getParent()->getParent()->getName().str();
+}
+
+
 static llvm::Instruction *
 lCallInst(llvm::Function *func, llvm::Value *arg0, llvm::Value *arg1,
           const char *name, llvm::Instruction *insertBefore = NULL) {
@@ -462,6 +491,146 @@ lGetMaskStatus(llvm::Value *mask, int vecWidth = -1) {
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+// FunctionTimeReportPass, ModuleTimeReportPass
+
+/** When --time-report is used, DebugPassManager brackets each pass that it
+    adds with a pair of these passes: the first one records the current
+    time and the instruction and basic block counts, and the second one
+    adds an entry for the pass to the time report.  Function, loop and
+    basic block passes are measured separately for each function; for
+    module and call graph passes, the entry covers the whole module.
+ */
+struct TimeReportStart {
+    double time;
+    int insts, blocks;
+};
+
+// Passes are always run in the order start/pass/end for a given function
+// (or for the module), so a single start record is sufficient.
+static TimeReportStart lTimeReportStart;
+
+
+static void
+lCountInstructions(const llvm::Function &func, int *insts, int *blocks) {
+    for (llvm::Function::const_iterator bb = func.begin(); bb != func.end(); ++bb) {
+        *insts += (int)bb->size();
+        ++*blocks;
+    }
+}
+
+
+static void
+lTimeReportBegin(int insts, int blocks) {
+    lTimeReportStart.insts = insts;
+    lTimeReportStart.blocks = blocks;
+    lTimeReportStart.time = GetWallClockTime();
+}
+
+
+static void
+lTimeReportEnd(const std::string &passName, const std::string &funcName,
+               int stage, int insts, int blocks) {
+    TimeReportEntry entry(passName, funcName, stage,
+                          GetWallClockTime() - lTimeReportStart.time);
+    entry.instsBefore = lTimeReportStart.insts;
+    entry.blocksBefore = lTimeReportStart.blocks;
+    entry.instsAfter = insts;
+    entry.blocksAfter = blocks;
+    AddTimeReportEntry(entry);
+}
+
+
+class FunctionTimeReportPass : public llvm::FunctionPass {
+public:
+    static char ID;
+    FunctionTimeReportPass(bool start, int st, const std::string &name)
+        : FunctionPass(ID), isStart(start), stage(st), passName(name) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Time Report"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Time Report"; }
+#endif
+    void getAnalysisUsage(llvm::AnalysisUsage &AU) const { AU.setPreservesAll(); }
+    bool runOnFunction(llvm::Function &func);
+
+private:
+    bool isStart;
+    int stage;
+    std::string passName;
+};
+
+char FunctionTimeReportPass::ID = 0;
+
+bool
+FunctionTimeReportPass::runOnFunction(llvm::Function &func) {
+    int insts = 0, blocks = 0;
+    lCountInstructions(func, &insts, &blocks);
+    if (isStart)
+        lTimeReportBegin(insts, blocks);
+    else
+        lTimeReportEnd(passName, func.getName().str(), stage, insts, blocks);
+    return false;
+}
+
+
+class ModuleTimeReportPass : public llvm::ModulePass {
+public:
+    static char ID;
+    ModuleTimeReportPass(bool start, int st, const std::string &name)
+        : ModulePass(ID), isStart(start), stage(st), passName(name) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Time Report"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Time Report"; }
+#endif
+    void getAnalysisUsage(llvm::AnalysisUsage &AU) const { AU.setPreservesAll(); }
+    bool runOnModule(llvm::Module &module);
+
+private:
+    bool isStart;
+    int stage;
+    std::string passName;
+};
+
+char ModuleTimeReportPass::ID = 0;
+
+bool
+ModuleTimeReportPass::runOnModule(llvm::Module &module) {
+    int insts = 0, blocks = 0;
+    for (llvm::Module::const_iterator func = module.begin(); func != module.end(); ++func)
+        lCountInstructions(*func, &insts, &blocks);
+    if (isStart)
+        lTimeReportBegin(insts, blocks);
+    else
+        lTimeReportEnd(passName, "", stage, insts, blocks);
+    return false;
+}
+
+
+/** Returns a pass that starts (if isStart is true) or ends the time
+    report measurement for the given pass. */
+static llvm::Pass *
+CreateTimeReportPass(bool isStart, int stage, llvm::Pass *pass) {
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    std::string passName = pass->getPassName();
+#else // LLVM 4.0+
+    std::string passName = pass->getPassName().str();
+#endif
+    switch (pass->getPassKind()) {
+    case llvm::PT_BasicBlock:
+    case llvm::PT_Loop:
+    case llvm::PT_Region:
+    case llvm::PT_Function:
+        return new FunctionTimeReportPass(isStart, stage, passName);
+    default:
+        return new ModuleTimeReportPass(isStart, stage, passName);
+    }
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 // This is a wrap over class llvm::PassManager. This duplicates PassManager function run()
 //   and change PassManager function add by adding some checks and debug passes.
@@ -499,7 +668,15 @@ DebugPassManager::add(llvm::Pass * P, int stage = -1) {
     }
     if (g->off_stages.find(number) == g->off_stages.end()) {
         // adding optimization (not switched off)
+        // (Immutable passes only provide information to other passes and
+        // don't do anything when they're "run", so there's no point in
+        // timing them.)
+        bool timePass = g->timeReport && P->getAsImmutablePass() == NULL;
+        if (timePass)
+            PM.add(CreateTimeReportPass(true, number, P));
         PM.add(P);
+        if (timePass)
+            PM.add(CreateTimeReportPass(false, number, P));
         if (g->debug_stages.find(number) != g->debug_stages.end()) {
             // adding dump of LLVM IR after optimization
             char buf[100];
@@ -525,6 +702,70 @@ DebugPassManager::add(llvm::Pass * P, int stage = -1) {
 }
 ///////////////////////////////////////////////////////////////////////////
 
+/** Returns a function inlining pass with a threshold appropriate for the
+    selected code size optimization level; the thresholds match the ones
+    that clang uses for -Os and -Oz. */
+static llvm::Pass *
+lCreateFunctionInliningPass() {
+    if (g->opt.sizeLevel == 1)
+        return llvm::createFunctionInliningPass(75);
+    else if (g->opt.sizeLevel >= 2)
+        return llvm::createFunctionInliningPass(25);
+    return llvm::createFunctionInliningPass();
+}
+
+
+/** Returns true if calls to the given builtin can safely be left out of
+    line.  The gathers and scatters that take a base pointer and offsets
+    pass the scale through to target intrinsics that require it to be a
+    compile-time constant, so they must always be inlined. */
+static bool
+lIsOutlinableMemoryBuiltin(const llvm::Function *func) {
+    llvm::StringRef name = func->getName();
+    if (name.startswith("__masked_store_"))
+        return true;
+    return (name.startswith("__gather32_") || name.startswith("__gather64_") ||
+            name.startswith("__scatter32_") || name.startswith("__scatter64_"));
+}
+
+
+/** When optimizing for size, mark all of the functions in the module as
+    such (so that both the LLVM optimization passes and the code
+    generator take that into account), and keep the gather, scatter and
+    masked store builtins out of line, so that a single copy of each one is
+    shared by all of its callers instead of being inlined at each one. */
+static void
+lApplySizeOptimizationAttributes(llvm::Module *module) {
+    for (llvm::Module::iterator iter = module->begin(); iter != module->end();
+         ++iter) {
+        llvm::Function *func = &*iter;
+        if (func->isDeclaration())
+            continue;
+
+#if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
+        func->addFnAttr(llvm::Attributes::OptimizeForSize);
+        if (g->opt.sizeLevel >= 2)
+            func->addFnAttr(llvm::Attributes::MinSize);
+#else // LLVM 3.3+
+        func->addFnAttr(llvm::Attribute::OptimizeForSize);
+        if (g->opt.sizeLevel >= 2)
+            func->addFnAttr(llvm::Attribute::MinSize);
+#endif
+
+        if (lIsOutlinableMemoryBuiltin(func)) {
+#if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
+            llvm::Attributes::AttrVal alwaysInline[] = { llvm::Attributes::AlwaysInline };
+            func->removeFnAttr(llvm::Attributes::get(*g->ctx, alwaysInline));
+            func->addFnAttr(llvm::Attributes::NoInline);
+#else // LLVM 3.3+
+            func->removeFnAttr(llvm::Attribute::AlwaysInline);
+            func->addFnAttr(llvm::Attribute::NoInline);
+#endif
+        }
+    }
+}
+
+
 void
 Optimize(llvm::Module *module, int optLevel) {
     if (g->debugPrint) {
@@ -582,6 +823,8 @@ Optimize(llvm::Module *module, int optLevel) {
             optPM.add(CreateReplacePseudoMemoryOpsPass());
 
         optPM.add(CreateIntrinsicsOptPass(), 102);
+        if (g->perfReportFile != NULL)
+            optPM.add(CreatePerfReportPass());
         optPM.add(CreateIsCompileTimeConstantPass(true));
         optPM.add(llvm::createFunctionInliningPass());
         optPM.add(CreateMakeInternalFuncsStaticPass());
@@ -589,6 +832,9 @@ Optimize(llvm::Module *module, int optLevel) {
         optPM.add(llvm::createGlobalDCEPass());
     }
     else {
+        if (g->opt.sizeLevel > 0)
+            lApplySizeOptimizationAttributes(module);
+
         llvm::PassRegistry *registry = llvm::PassRegistry::getPassRegistry();
         llvm::initializeCore(*registry);
         llvm::initializeScalarOpts(*registry);
@@ -690,10 +936,33 @@ Optimize(llvm::Module *module, int optLevel) {
 #else // 3.7 and earlier
         optPM.add(llvm::createFunctionAttrsPass());
 #endif
-        optPM.add(llvm::createFunctionInliningPass());
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_3 // LLVM 3.3+
+        // Copy functions for calls with constant uniform arguments before
+        // the inliner decides what's left as a call.  Copies of functions
+        // that share debugging information would confuse the debugger.
+        if (g->opt.disableFunctionSpecialization == false &&
+            g->generateDebuggingSymbols == false)
+            optPM.add(CreateSpecializeConstantArgsPass());
+        // Likewise for the copies of functions for calls with the mask all
+        // on; this has to run before the mask-all-on optimizations in
+        // IntrinsicsOpt below.
+        if (g->opt.disableAllOnClones == false &&
+            g->opt.disableMaskAllOnOptimizations == false &&
+            g->generateDebuggingSymbols == false)
+            optPM.add(CreateAllOnClonesPass());
+#endif
+        if (g->opt.disableReductionVectorization == false &&
+            g->target->getVectorWidth() > 1)
+            // This has to run before the calls to the reduction
+            // functions are inlined.
+            optPM.add(CreateVectorizeReductionsPass());
+        optPM.add(lCreateFunctionInliningPass());
         optPM.add(llvm::createConstantPropagationPass());
         optPM.add(llvm::createDeadInstEliminationPass());
         optPM.add(llvm::createCFGSimplificationPass());
+        if (g->opt.disableUniformScalarization == false &&
+            g->target->getVectorWidth() > 1)
+            optPM.add(CreateScalarizeUniformPass());
 
         optPM.add(llvm::createArgumentPromotionPass());
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_3
@@ -714,6 +983,9 @@ Optimize(llvm::Module *module, int optLevel) {
         optPM.add(llvm::createTailCallEliminationPass());
 
         if (!g->opt.disableMaskAllOnOptimizations) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+            optPM.add(CreateMaskAssumptionsPass());
+#endif
             optPM.add(CreateIntrinsicsOptPass(), 250);
             optPM.add(CreateInstructionSimplifyPass());
         }
@@ -729,18 +1001,30 @@ Optimize(llvm::Module *module, int optLevel) {
                 // finding matching gathers we can coalesce..
                 optPM.add(llvm::createEarlyCSEPass(), 260);
                 optPM.add(CreateGatherCoalescePass());
+                optPM.add(CreateScatterCoalescePass());
             }
         }
 
-        optPM.add(llvm::createFunctionInliningPass(), 265);
+        optPM.add(lCreateFunctionInliningPass(), 265);
         optPM.add(llvm::createConstantPropagationPass());
+        if (g->opt.disableUniformScalarization == false &&
+            g->target->getVectorWidth() > 1)
+            optPM.add(CreateScalarizeUniformPass());
         optPM.add(CreateIntrinsicsOptPass());
         optPM.add(CreateInstructionSimplifyPass());
 
         if (g->opt.disableGatherScatterOptimizations == false &&
             g->target->getVectorWidth() > 1) {
             optPM.add(llvm::createInstructionCombiningPass(), 270);
-            optPM.add(CreateImproveMemoryOpsPass());
+            optPM.add(CreateImproveMemoryOpsPass(true));
+
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
+            // Now that the gathers are in their final form and the loads
+            // of their indices have been improved, prefetch ahead of them.
+            if (g->opt.prefetchGatherDistance != 0 &&
+                g->target->getISA() != Target::GENERIC)
+                optPM.add(CreatePrefetchGathersPass());
+#endif
         }
 
         optPM.add(llvm::createIPSCCPPass(), 275);
@@ -755,7 +1039,16 @@ Optimize(llvm::Module *module, int optLevel) {
         optPM.add(CreateIntrinsicsOptPass(),281);
         optPM.add(CreateInstructionSimplifyPass());
 
-        optPM.add(llvm::createFunctionInliningPass());
+        if (g->opt.scratchLocalsThreshold > 0)
+            optPM.add(CreateLocalsToScratchPass());
+
+        // The gathers, scatters and masked memory operations are now in
+        // their final form, but they're still calls to the builtins
+        // rather than having been inlined, so they can be counted.
+        if (g->perfReportFile != NULL)
+            optPM.add(CreatePerfReportPass());
+
+        optPM.add(lCreateFunctionInliningPass());
         optPM.add(llvm::createArgumentPromotionPass());
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_6
         optPM.add(llvm::createScalarReplAggregatesPass(sr_threshold, false));
@@ -766,18 +1059,29 @@ Optimize(llvm::Module *module, int optLevel) {
         optPM.add(CreateInstructionSimplifyPass());
         optPM.add(llvm::createCFGSimplificationPass());
         optPM.add(llvm::createReassociatePass());
+        if (g->opt.disableVectorDivision == false &&
+            g->target->getVectorWidth() > 1)
+            optPM.add(CreateVectorDivisionPass());
         optPM.add(llvm::createLoopRotatePass());
         optPM.add(llvm::createLICMPass());
-        optPM.add(llvm::createLoopUnswitchPass(false));
+        // Loop unswitching duplicates the loop body; when optimizing for
+        // size, only the trivial cases that don't do so are handled.
+        optPM.add(llvm::createLoopUnswitchPass(g->opt.sizeLevel > 0));
         optPM.add(llvm::createInstructionCombiningPass());
         optPM.add(CreateInstructionSimplifyPass());
         optPM.add(llvm::createIndVarSimplifyPass());
         optPM.add(llvm::createLoopIdiomPass());
         optPM.add(llvm::createLoopDeletionPass());
-        if (g->opt.unrollLoops) {
+        if (g->opt.unrollLoops && g->opt.sizeLevel == 0) {
             optPM.add(llvm::createLoopUnrollPass(), 300);
         }
         optPM.add(llvm::createGVNPass(), 301);
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+        // Use the alignment of "aligned" pointer parameters for the loads
+        // and stores (including those from the masked load/store builtins)
+        // that are now in their final form.
+        optPM.add(llvm::createAlignmentFromAssumptionsPass());
+#endif
 
         optPM.add(CreateIsCompileTimeConstantPass(true));
         optPM.add(CreateIntrinsicsOptPass());
@@ -795,7 +1099,7 @@ Optimize(llvm::Module *module, int optLevel) {
         optPM.add(llvm::createInstructionCombiningPass());
         optPM.add(CreateInstructionSimplifyPass());
         optPM.add(CreatePeepholePass());
-        optPM.add(llvm::createFunctionInliningPass());
+        optPM.add(lCreateFunctionInliningPass());
         optPM.add(llvm::createAggressiveDCEPass());
         optPM.add(llvm::createStripDeadPrototypesPass());
         optPM.add(CreateMakeInternalFuncsStaticPass());
@@ -1252,6 +1556,138 @@ CreateIntrinsicsOptPass() {
 }
 
 
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+///////////////////////////////////////////////////////////////////////////
+// MaskAssumptionsPass
+
+/** A program can use assume() to state that all of the program instances
+    are running at some point, e.g. with "assume(lanemask() == ~0ull >>
+    (64 - programCount))".  The resulting llvm.assume() call compares a
+    movmsk of the execution mask with the "all on" value; this pass
+    replaces the uses of that mask that are dominated by the assumption
+    with an "all on" mask, so that the remaining mask all-on optimizations
+    apply to them.
+ */
+class MaskAssumptionsPass : public llvm::FunctionPass {
+public:
+    static char ID;
+    MaskAssumptionsPass() : FunctionPass(ID) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Apply Mask Assumptions"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Apply Mask Assumptions"; }
+#endif
+    bool runOnFunction(llvm::Function &F);
+};
+
+char MaskAssumptionsPass::ID = 0;
+
+
+/** If the given value is the movmsk of an execution mask, with one bit
+    for each program instance, return the mask; otherwise return NULL.
+ */
+static llvm::Value *
+lGetMovmskMask(llvm::Value *v) {
+    if (llvm::ZExtInst *zext = llvm::dyn_cast<llvm::ZExtInst>(v))
+        v = zext->getOperand(0);
+
+    llvm::Value *op = NULL;
+    if (llvm::BitCastInst *bc = llvm::dyn_cast<llvm::BitCastInst>(v)) {
+        // With one-bit masks, movmsk is just a bitcast to an integer.
+        if (g->target->getMaskBitCount() != 1)
+            return NULL;
+        op = bc->getOperand(0);
+    }
+    else {
+        llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(v);
+        if (call == NULL || call->getCalledFunction() == NULL)
+            return NULL;
+        llvm::Function *callee = call->getCalledFunction();
+        if (callee->getName() != "__movmsk" &&
+            callee->getIntrinsicID() != llvm::Intrinsic::x86_sse_movmsk_ps &&
+            callee->getIntrinsicID() != llvm::Intrinsic::x86_avx_movmsk_ps_256 &&
+            callee->getIntrinsicID() != llvm::Intrinsic::x86_sse2_pmovmskb_128)
+            return NULL;
+        op = call->getArgOperand(0);
+    }
+
+    // The movmsk has to give one bit per program instance.
+    llvm::VectorType *vt = llvm::dyn_cast<llvm::VectorType>(op->getType());
+    if (vt == NULL || (int)vt->getNumElements() != g->target->getVectorWidth())
+        return NULL;
+
+    while (llvm::BitCastInst *bc = llvm::dyn_cast<llvm::BitCastInst>(op))
+        op = bc->getOperand(0);
+    if (op->getType() != LLVMTypes::MaskType || llvm::isa<llvm::Constant>(op))
+        return NULL;
+    return op;
+}
+
+
+bool
+MaskAssumptionsPass::runOnFunction(llvm::Function &F) {
+    int width = g->target->getVectorWidth();
+    uint64_t allOnBits = (width == 64) ? ~0ull : ((1ull << width) - 1);
+
+    std::vector<std::pair<llvm::Instruction *, llvm::Value *> > assumptions;
+    for (llvm::Function::iterator bb = F.begin(); bb != F.end(); ++bb) {
+        for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end();
+             ++iter) {
+            llvm::IntrinsicInst *ii = llvm::dyn_cast<llvm::IntrinsicInst>(&*iter);
+            if (ii == NULL || ii->getIntrinsicID() != llvm::Intrinsic::assume)
+                continue;
+
+            llvm::ICmpInst *cmp = llvm::dyn_cast<llvm::ICmpInst>(ii->getArgOperand(0));
+            if (cmp == NULL || cmp->getPredicate() != llvm::CmpInst::ICMP_EQ)
+                continue;
+            llvm::Value *movmsk = cmp->getOperand(0);
+            llvm::ConstantInt *ci =
+                llvm::dyn_cast<llvm::ConstantInt>(cmp->getOperand(1));
+            if (ci == NULL) {
+                movmsk = cmp->getOperand(1);
+                ci = llvm::dyn_cast<llvm::ConstantInt>(cmp->getOperand(0));
+            }
+            if (ci == NULL || ci->getZExtValue() != allOnBits)
+                continue;
+
+            llvm::Value *mask = lGetMovmskMask(movmsk);
+            if (mask != NULL)
+                assumptions.push_back(std::make_pair((llvm::Instruction *)ii, mask));
+        }
+    }
+    if (assumptions.size() == 0)
+        return false;
+
+    llvm::DominatorTree domTree;
+    domTree.recalculate(F);
+
+    bool modifiedAny = false;
+    for (unsigned int i = 0; i < assumptions.size(); ++i) {
+        llvm::Instruction *assume = assumptions[i].first;
+        llvm::Value *mask = assumptions[i].second;
+
+        std::vector<llvm::Use *> uses;
+        for (llvm::Value::use_iterator ui = mask->use_begin();
+             ui != mask->use_end(); ++ui)
+            if (domTree.dominates(assume, *ui))
+                uses.push_back(&*ui);
+
+        for (unsigned int j = 0; j < uses.size(); ++j)
+            uses[j]->set(LLVMMaskAllOn);
+        modifiedAny |= (uses.size() > 0);
+    }
+    return modifiedAny;
+}
+
+
+static llvm::Pass *
+CreateMaskAssumptionsPass() {
+    return new MaskAssumptionsPass;
+}
+#endif // LLVM 3.6+
+
+
 ///////////////////////////////////////////////////////////////////////////
 
 /** This simple optimization pass looks for a vector select instruction
@@ -1422,108 +1858,888 @@ CreateInstructionSimplifyPass() {
 
 
 ///////////////////////////////////////////////////////////////////////////
-// ImproveMemoryOpsPass
-
-/** When the front-end emits gathers and scatters, it generates an array of
-    vector-width pointers to represent the set of addresses to read from or
-    write to.  This optimization detects cases when the base pointer is a
-    uniform pointer or when the indexing is into an array that can be
-    converted into scatters/gathers from a single base pointer and an array
-    of offsets.
-
-    See for example the comments discussing the __pseudo_gather functions
-    in builtins.cpp for more information about this.
+// ScalarizeUniformPass
+
+/** Varying values often hold the same value for all of the program
+    instances, for example when uniform values are passed to functions
+    with varying parameters; after inlining, they are computed with vector
+    instructions from broadcasts of the uniform values.  This pass finds
+    the vector computations that are provably uniform and computes them
+    with scalar instructions instead, broadcasting only the final results.
+
+    The analysis is optimistic: it starts by assuming that all arithmetic,
+    comparison, cast, select and phi instructions with gang-width vector
+    results are uniform and then removes the ones with operands that
+    aren't, until nothing changes.  This handles values that are carried
+    around loops.  Since all branches in the IR are taken by all of the
+    program instances together, phis of uniform values are uniform.
+
+    Gathers from uniform addresses are then handled as scalar loads and
+    broadcasts by ImproveMemoryOpsPass, and __movmsk() calls on uniform
+    conditions (as are issued for 'varying' if statements and loops on
+    them) are rewritten in terms of the scalar condition, so that the
+    branches on them become uniform branches.
  */
-class ImproveMemoryOpsPass : public llvm::BasicBlockPass {
+class ScalarizeUniformPass : public llvm::FunctionPass {
 public:
     static char ID;
-    ImproveMemoryOpsPass() : BasicBlockPass(ID) { }
+    ScalarizeUniformPass() : FunctionPass(ID) { }
 
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
-    const char *getPassName() const { return "Improve Memory Ops"; }
+    const char *getPassName() const { return "Scalarize Uniform Values"; }
 #else // LLVM 4.0+
-    llvm::StringRef getPassName() const { return "Improve Memory Ops"; }
+    llvm::StringRef getPassName() const { return "Scalarize Uniform Values"; }
 #endif
-    bool runOnBasicBlock(llvm::BasicBlock &BB);
+    bool runOnFunction(llvm::Function &F);
+
+private:
+    llvm::Value *getBroadcastScalar(llvm::Value *v);
+    llvm::Value *getScalar(llvm::Value *v);
+    bool simplifyMovmsk(llvm::CallInst *callInst);
+
+    /** Instructions that are being assumed to be uniform. */
+    std::set<llvm::Instruction *> uniformInsts;
+    /** Scalar values for the uniform vector values found so far. */
+    std::map<llvm::Value *, llvm::Value *> scalars;
 };
 
-char ImproveMemoryOpsPass::ID = 0;
+char ScalarizeUniformPass::ID = 0;
 
 
+/** Returns true if the given type is a vector with an element for each
+    program instance. */
+static bool
+lIsGangVectorType(llvm::Type *type) {
+    llvm::VectorType *vt = llvm::dyn_cast<llvm::VectorType>(type);
+    return (vt != NULL &&
+            (int)vt->getNumElements() == g->target->getVectorWidth());
+}
 
-/** Check to make sure that this value is actually a pointer in the end.
-    We need to make sure that given an expression like vec(offset) +
-    ptr2int(ptr), lGetBasePointer() doesn't return vec(offset) for the base
-    pointer such that we then treat ptr2int(ptr) as an offset.  This ends
-    up being important so that we don't generate LLVM GEP instructions like
-    "gep inttoptr 8, i64 %ptr", which in turn can lead to incorrect code
-    since LLVM's pointer aliasing analysis assumes that operands after the
-    first one to a GEP aren't pointers.
- */
+
+/** Broadcasts the given scalar value across a gang-width vector. */
 static llvm::Value *
-lCheckForActualPointer(llvm::Value *v) {
-    if (v == NULL) {
-        return NULL;
-    }
-    else if (llvm::isa<llvm::PointerType>(v->getType())) {
+lSmearScalar(llvm::Value *scalar, llvm::Instruction *insertBefore) {
+    llvm::Type *vecType =
+        llvm::VectorType::get(scalar->getType(), g->target->getVectorWidth());
+    llvm::Value *insertVec =
+        llvm::InsertElementInst::Create(llvm::UndefValue::get(vecType), scalar,
+                                        LLVMInt32(0),
+                                        LLVMGetName(scalar, "_smear_init"),
+                                        insertBefore);
+    llvm::Constant *zeroMask = llvm::ConstantVector::getSplat(
+        g->target->getVectorWidth(),
+        llvm::Constant::getNullValue(llvm::Type::getInt32Ty(*g->ctx)));
+    return new llvm::ShuffleVectorInst(insertVec, llvm::UndefValue::get(vecType),
+                                       zeroMask, LLVMGetName(scalar, "_smear"),
+                                       insertBefore);
+}
+
+
+/** If the given value is a broadcast of a scalar value (either a constant
+    with the same value in all elements or an insertelement/shufflevector
+    sequence), returns the scalar value; returns NULL otherwise. */
+llvm::Value *
+ScalarizeUniformPass::getBroadcastScalar(llvm::Value *v) {
+    std::map<llvm::Value *, llvm::Value *>::iterator iter = scalars.find(v);
+    if (iter != scalars.end())
+        return iter->second;
+
+    llvm::Value *scalar = NULL;
+    llvm::Type *eltType = v->getType()->getVectorElementType();
+    if (llvm::isa<llvm::UndefValue>(v))
+        scalar = llvm::UndefValue::get(eltType);
+    else if (llvm::isa<llvm::ConstantAggregateZero>(v))
+        scalar = llvm::Constant::getNullValue(eltType);
+    else if (llvm::ConstantDataVector *cdv =
+             llvm::dyn_cast<llvm::ConstantDataVector>(v))
+        scalar = cdv->getSplatValue();
+    else if (llvm::ConstantVector *cv = llvm::dyn_cast<llvm::ConstantVector>(v))
+        scalar = cv->getSplatValue();
+    else if (llvm::isa<llvm::InsertElementInst>(v) ||
+             llvm::isa<llvm::ShuffleVectorInst>(v))
+        scalar = LLVMFlattenInsertChain(v, g->target->getVectorWidth());
+
+    if (scalar != NULL)
+        scalars[v] = scalar;
+    return scalar;
+}
+
+
+/** Returns the scalar value that is equivalent to the given uniform
+    vector value, emitting scalar instructions for the ones in
+    uniformInsts as needed. */
+llvm::Value *
+ScalarizeUniformPass::getScalar(llvm::Value *v) {
+    if (!lIsGangVectorType(v->getType()))
+        // Scalar select conditions are used as is.
         return v;
+    llvm::Value *scalar = getBroadcastScalar(v);
+    if (scalar != NULL)
+        return scalar;
+
+    llvm::Instruction *inst = llvm::dyn_cast<llvm::Instruction>(v);
+    Assert(inst != NULL && uniformInsts.find(inst) != uniformInsts.end());
+    llvm::Type *eltType = inst->getType()->getVectorElementType();
+    std::string name = inst->getName().str() + "_scalar";
+
+    if (llvm::PHINode *phi = llvm::dyn_cast<llvm::PHINode>(inst)) {
+        // Record the new phi before getting the incoming values, which
+        // may depend on it.
+        llvm::PHINode *scalarPhi =
+            llvm::PHINode::Create(eltType, phi->getNumIncomingValues(),
+                                  name.c_str(), phi);
+        scalars[inst] = scalarPhi;
+        for (unsigned int i = 0; i < phi->getNumIncomingValues(); ++i)
+            scalarPhi->addIncoming(getScalar(phi->getIncomingValue(i)),
+                                   phi->getIncomingBlock(i));
+        return scalarPhi;
     }
-    else if (llvm::isa<llvm::PtrToIntInst>(v)) {
-        return v;
+
+    llvm::Instruction *scalarInst = NULL;
+    if (llvm::BinaryOperator *bop = llvm::dyn_cast<llvm::BinaryOperator>(inst)) {
+        llvm::Value *op0 = getScalar(bop->getOperand(0));
+        llvm::Value *op1 = getScalar(bop->getOperand(1));
+        scalarInst = llvm::BinaryOperator::Create(bop->getOpcode(), op0, op1,
+                                                  name.c_str(), inst);
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_7 // LLVM 3.7+
+        scalarInst->copyIRFlags(bop);
+#endif
     }
-    else if (llvm::CastInst *ci = llvm::dyn_cast<llvm::CastInst>(v)) {
-        llvm::Value *t = lCheckForActualPointer(ci->getOperand(0));
-        if (t == NULL) {
-            return NULL;
-        }
-        else {
-            return v;
-        }
+    else if (llvm::CmpInst *cmp = llvm::dyn_cast<llvm::CmpInst>(inst)) {
+        llvm::Value *op0 = getScalar(cmp->getOperand(0));
+        llvm::Value *op1 = getScalar(cmp->getOperand(1));
+        scalarInst = llvm::CmpInst::Create(cmp->getOpcode(), cmp->getPredicate(),
+                                           op0, op1, name.c_str(), inst);
+    }
+    else if (llvm::CastInst *cast = llvm::dyn_cast<llvm::CastInst>(inst)) {
+        scalarInst = llvm::CastInst::Create(cast->getOpcode(),
+                                            getScalar(cast->getOperand(0)),
+                                            eltType, name.c_str(), inst);
     }
     else {
-        llvm::ConstantExpr *uce =
-            llvm::dyn_cast<llvm::ConstantExpr>(v);
-        if (uce != NULL &&
-            uce->getOpcode() == llvm::Instruction::PtrToInt)
-            return v;
-        return NULL;
+        llvm::SelectInst *select = llvm::dyn_cast<llvm::SelectInst>(inst);
+        Assert(select != NULL);
+        scalarInst = llvm::SelectInst::Create(getScalar(select->getCondition()),
+                                              getScalar(select->getTrueValue()),
+                                              getScalar(select->getFalseValue()),
+                                              name.c_str(), inst);
     }
+    lCopyMetadata(scalarInst, inst);
+    scalars[inst] = scalarInst;
+    return scalarInst;
 }
 
 
-/** Given a llvm::Value representing a varying pointer, this function
-    checks to see if all of the elements of the vector have the same value
-    (i.e. there's a common base pointer).  If so, it returns the common
-    pointer value; otherwise it returns NULL.
- */
-static llvm::Value *
-lGetBasePointer(llvm::Value *v, llvm::Instruction *insertBefore) {
-    if (llvm::isa<llvm::InsertElementInst>(v) ||
-        llvm::isa<llvm::ShuffleVectorInst>(v)) {
-        llvm::Value *element = LLVMFlattenInsertChain
-            (v, g->target->getVectorWidth(), true, false);
-        // TODO: it's probably ok to allow undefined elements and return
-        // the base pointer if all of the other elements have the same
-        // value.
-        if (element != NULL) {
-            //all elements are the same and not NULLs
-            return lCheckForActualPointer(element);
-        }
-        else {
-            return NULL;
+/** Rewrites a movmsk of a broadcast value, or of the AND of a broadcast
+    value with another vector, in terms of the broadcast scalar value:
+    all of the bits are set if the scalar's sign bit is, and none are
+    otherwise.  Returns true if the call was replaced. */
+bool
+ScalarizeUniformPass::simplifyMovmsk(llvm::CallInst *callInst) {
+    llvm::Function *callee = callInst->getCalledFunction();
+    if (callee == NULL || callInst->getNumArgOperands() != 1 ||
+        (callee->getName() != "__movmsk" &&
+         callee->getIntrinsicID() != llvm::Intrinsic::x86_sse_movmsk_ps &&
+         callee->getIntrinsicID() != llvm::Intrinsic::x86_sse2_movmsk_pd &&
+         callee->getIntrinsicID() != llvm::Intrinsic::x86_avx_movmsk_ps_256 &&
+         callee->getIntrinsicID() != llvm::Intrinsic::x86_avx_movmsk_pd_256 &&
+         callee->getIntrinsicID() != llvm::Intrinsic::x86_sse2_pmovmskb_128))
+        return false;
+
+    llvm::Value *arg = callInst->getArgOperand(0);
+    if (!lIsGangVectorType(arg->getType()))
+        return false;
+
+    // For an AND, the movmsk of the other operand is taken if the
+    // scalar's sign bit is set.
+    llvm::Value *other = NULL;
+    llvm::Value *scalar = getBroadcastScalar(arg);
+    llvm::BinaryOperator *bop = llvm::dyn_cast<llvm::BinaryOperator>(arg);
+    if (scalar == NULL && bop != NULL &&
+        bop->getOpcode() == llvm::Instruction::And) {
+        for (int i = 0; i < 2 && scalar == NULL; ++i) {
+            scalar = getBroadcastScalar(bop->getOperand(i));
+            other = bop->getOperand(1 - i);
         }
     }
+    if (scalar == NULL || llvm::isa<llvm::UndefValue>(scalar))
+        return false;
 
-    // This case comes up with global/static arrays
-    if (llvm::ConstantVector *cv = llvm::dyn_cast<llvm::ConstantVector>(v)) {
-        return lCheckForActualPointer(cv->getSplatValue());
+    llvm::Type *eltType = scalar->getType();
+    if (!eltType->isIntegerTy()) {
+        if (!eltType->isFloatingPointTy())
+            return false;
+        eltType = llvm::IntegerType::get(*g->ctx,
+                                         eltType->getPrimitiveSizeInBits());
+        scalar = new llvm::BitCastInst(scalar, eltType,
+                                       LLVMGetName(scalar, "_int"), callInst);
     }
-    else if (llvm::ConstantDataVector *cdv = llvm::dyn_cast<llvm::ConstantDataVector>(v)) {
-        return lCheckForActualPointer(cdv->getSplatValue());
+    llvm::Value *signSet =
+        new llvm::ICmpInst(callInst, llvm::CmpInst::ICMP_SLT, scalar,
+                           llvm::Constant::getNullValue(eltType),
+                           LLVMGetName(scalar, "_sign"));
+
+    llvm::Type *resultType = callInst->getType();
+    llvm::Value *bits = NULL;
+    if (other != NULL)
+        bits = llvm::CallInst::Create(callee, other,
+                                      LLVMGetName(other, "_movmsk"), callInst);
+    else {
+        int nElts = g->target->getVectorWidth();
+        uint64_t allOn = (nElts == 64) ? ~0ull : ((1ull << nElts) - 1);
+        bits = llvm::ConstantInt::get(resultType, allOn);
     }
-    // It is a little bit tricky to use operations with pointers, casted to int with another bit size
-    // but sometimes it is useful, so we handle this case here.
-    else if (llvm::CastInst *ci = llvm::dyn_cast<llvm::CastInst>(v)) {
+    llvm::Instruction *result =
+        llvm::SelectInst::Create(signSet, bits,
+                                 llvm::Constant::getNullValue(resultType),
+                                 callInst->getName(), callInst);
+    callInst->replaceAllUsesWith(result);
+    callInst->eraseFromParent();
+    return true;
+}
+
+
+bool
+ScalarizeUniformPass::runOnFunction(llvm::Function &F) {
+    uniformInsts.clear();
+    scalars.clear();
+
+    // Start with all of the candidate instructions.
+    std::vector<llvm::Instruction *> candidates;
+    for (llvm::Function::iterator bb = F.begin(); bb != F.end(); ++bb) {
+        for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end();
+             ++iter) {
+            llvm::Instruction *inst = &*iter;
+            if (!lIsGangVectorType(inst->getType()) ||
+                getBroadcastScalar(inst) != NULL)
+                continue;
+            if (llvm::isa<llvm::BinaryOperator>(inst) ||
+                llvm::isa<llvm::CmpInst>(inst) ||
+                llvm::isa<llvm::SelectInst>(inst) ||
+                llvm::isa<llvm::PHINode>(inst) ||
+                (llvm::isa<llvm::CastInst>(inst) &&
+                 lIsGangVectorType(inst->getOperand(0)->getType()))) {
+                candidates.push_back(inst);
+                uniformInsts.insert(inst);
+            }
+        }
+    }
+
+    // Remove the ones with operands that aren't uniform until nothing
+    // changes.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned int i = 0; i < candidates.size(); ++i) {
+            llvm::Instruction *inst = candidates[i];
+            if (uniformInsts.find(inst) == uniformInsts.end())
+                continue;
+            for (unsigned int j = 0; j < inst->getNumOperands(); ++j) {
+                llvm::Value *op = inst->getOperand(j);
+                if (!lIsGangVectorType(op->getType()) ||
+                    getBroadcastScalar(op) != NULL)
+                    continue;
+                llvm::Instruction *opInst = llvm::dyn_cast<llvm::Instruction>(op);
+                if (opInst == NULL ||
+                    uniformInsts.find(opInst) == uniformInsts.end()) {
+                    uniformInsts.erase(inst);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Compute the uniform values with scalar instructions and broadcast
+    // the results for the remaining vector uses.  The original vector
+    // instructions are then dead.
+    std::vector<llvm::Instruction *> replaced;
+    for (unsigned int i = 0; i < candidates.size(); ++i) {
+        llvm::Instruction *inst = candidates[i];
+        if (uniformInsts.find(inst) == uniformInsts.end())
+            continue;
+        llvm::Value *scalar = getScalar(inst);
+
+        bool hasOtherUses = false;
+        for (llvm::Value::user_iterator ui = inst->user_begin();
+             ui != inst->user_end(); ++ui) {
+            llvm::Instruction *user = llvm::dyn_cast<llvm::Instruction>(*ui);
+            if (user == NULL || uniformInsts.find(user) == uniformInsts.end())
+                hasOtherUses = true;
+        }
+        if (hasOtherUses) {
+            llvm::Instruction *insertBefore = inst;
+            if (llvm::isa<llvm::PHINode>(inst))
+                insertBefore = inst->getParent()->getFirstNonPHI();
+            llvm::Value *smear = lSmearScalar(scalar, insertBefore);
+            lCopyMetadata(smear, inst);
+            scalars[smear] = scalar;
+            inst->replaceAllUsesWith(smear);
+        }
+        replaced.push_back(inst);
+    }
+    for (unsigned int i = 0; i < replaced.size(); ++i) {
+        replaced[i]->replaceAllUsesWith(llvm::UndefValue::get(replaced[i]->getType()));
+        scalars.erase(replaced[i]);
+    }
+    for (unsigned int i = 0; i < replaced.size(); ++i)
+        replaced[i]->eraseFromParent();
+    bool modifiedAny = (replaced.size() > 0);
+
+    // Now look for movmsks of uniform values.
+    std::vector<llvm::CallInst *> calls;
+    for (llvm::Function::iterator bb = F.begin(); bb != F.end(); ++bb)
+        for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end();
+             ++iter)
+            if (llvm::CallInst *callInst = llvm::dyn_cast<llvm::CallInst>(&*iter))
+                calls.push_back(callInst);
+    for (unsigned int i = 0; i < calls.size(); ++i)
+        modifiedAny |= simplifyMovmsk(calls[i]);
+
+    if (modifiedAny)
+        Debug(SourcePos(), "ScalarizeUniformPass: scalarized %d instructions "
+              "in \"%s\".", (int)replaced.size(), F.getName().str().c_str());
+
+    return modifiedAny;
+}
+
+
+static llvm::Pass *
+CreateScalarizeUniformPass() {
+    return new ScalarizeUniformPass;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// VectorizeReductionsPass
+
+/** Loops like "foreach (i = 0 ... n) sum += reduce_add(a[i] * b[i]);"
+    do a horizontal reduction across the program instances in each
+    iteration, which is both expensive in itself and puts it on the loop's
+    critical path.  This pass finds uniform accumulators in loops that are
+    updated only with the result of a reduce_add(), reduce_min() or
+    reduce_max() call and replaces them with vector accumulators that
+    hold a partial result for each program instance; the horizontal
+    reduction is then done only where the accumulator's value is used
+    outside of the loop.
+
+    Floating-point sums are only transformed with --opt=fast-math, since
+    the additions are done in a different order.  For floating-point
+    values, two vector accumulators are used in alternating iterations,
+    so that each iteration's update doesn't have to wait for the previous
+    one's.
+
+    The pass runs before inlining, so that the calls to the standard
+    library's reduction functions (and to min() and max() for the
+    accumulator updates) can still be recognized.
+ */
+class VectorizeReductionsPass : public llvm::FunctionPass {
+public:
+    static char ID;
+    VectorizeReductionsPass() : FunctionPass(ID) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Vectorize Reductions"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Vectorize Reductions"; }
+#endif
+    bool runOnFunction(llvm::Function &F);
+};
+
+char VectorizeReductionsPass::ID = 0;
+
+
+/** The kinds of reductions that VectorizeReductionsPass handles. */
+enum ReductionOp { REDUCE_ADD, REDUCE_MIN, REDUCE_MAX };
+
+
+/** Information about a uniform accumulator that is updated in a loop
+    with the result of a reduction of a varying value. */
+struct ReductionInfo {
+    /** The accumulator's phi in the loop header and its updated value. */
+    llvm::PHINode *phi;
+    llvm::Instruction *update;
+    /** The call to the reduction function and its varying operand. */
+    llvm::CallInst *reduce;
+    llvm::Value *varyingValue;
+    /** The accumulator's value on entry to the loop and the index of the
+        phi's incoming value from the loop's back edge. */
+    llvm::Value *initial;
+    unsigned int backEdge;
+    ReductionOp op;
+    /** The mangled type of the reduction's elements, e.g. 'f' for
+        float. */
+    char typeCode;
+};
+
+
+/** If the given function is one of the standard library's reduce_add(),
+    reduce_min() or reduce_max() functions with a varying parameter of a
+    32-bit or 64-bit type, returns true and the reduction's operation and
+    the element type's code. */
+static bool
+lIsReductionFunction(llvm::Function *func, ReductionOp *op, char *typeCode) {
+    if (func == NULL)
+        return false;
+    std::string name = func->getName().str();
+    const char *prefix[3] = { "reduce_add___vy", "reduce_min___vy",
+                              "reduce_max___vy" };
+    for (int i = 0; i < 3; ++i) {
+        int len = strlen(prefix[i]);
+        if (name.size() == (size_t)len + 1 && !strncmp(name.c_str(), prefix[i], len) &&
+            strchr("fdiuIU", name[len]) != NULL) {
+            *op = (ReductionOp)i;
+            *typeCode = name[len];
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** Returns true if the given instruction combines the two given values
+    with the given reduction operation: an add for REDUCE_ADD or a call to
+    the standard library's uniform min() or max() functions with the
+    given element type for the others. */
+static bool
+lIsReductionUpdate(llvm::Instruction *inst, llvm::Value *a, llvm::Value *b,
+                   ReductionOp op, char typeCode) {
+    if (op == REDUCE_ADD) {
+        llvm::BinaryOperator *bop = llvm::dyn_cast<llvm::BinaryOperator>(inst);
+        return (bop != NULL &&
+                (bop->getOpcode() == llvm::Instruction::Add ||
+                 bop->getOpcode() == llvm::Instruction::FAdd) &&
+                ((bop->getOperand(0) == a && bop->getOperand(1) == b) ||
+                 (bop->getOperand(0) == b && bop->getOperand(1) == a)));
+    }
+
+    llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(inst);
+    if (call == NULL || call->getCalledFunction() == NULL ||
+        call->getNumArgOperands() < 2)
+        return false;
+    char name[32];
+    snprintf(name, sizeof(name), "%s___un%cun%c",
+             (op == REDUCE_MIN) ? "min" : "max", typeCode, typeCode);
+    return (call->getCalledFunction()->getName() == name &&
+            ((call->getArgOperand(0) == a && call->getArgOperand(1) == b) ||
+             (call->getArgOperand(0) == b && call->getArgOperand(1) == a)));
+}
+
+
+/** Returns the value that doesn't affect the result of the given
+    reduction of elements of the given type. */
+static llvm::Constant *
+lReductionIdentity(ReductionOp op, char typeCode, llvm::Type *type) {
+    if (op == REDUCE_ADD)
+        return llvm::Constant::getNullValue(type);
+    if (type->isFloatingPointTy())
+        return llvm::ConstantFP::getInfinity(type, op == REDUCE_MAX);
+
+    int bits = type->getPrimitiveSizeInBits();
+    bool isSigned = (typeCode == 'i' || typeCode == 'I');
+    llvm::APInt value = (op == REDUCE_MIN) ?
+        (isSigned ? llvm::APInt::getSignedMaxValue(bits) :
+         llvm::APInt::getMaxValue(bits)) :
+        (isSigned ? llvm::APInt::getSignedMinValue(bits) :
+         llvm::APInt::getMinValue(bits));
+    return llvm::ConstantInt::get(type, value);
+}
+
+
+/** Emits the per-program-instance combination of the two given vectors
+    for the given reduction. */
+static llvm::Value *
+lCombineVectors(ReductionOp op, char typeCode, llvm::Value *a, llvm::Value *b,
+                llvm::Instruction *insertBefore) {
+    bool isFloat = a->getType()->getVectorElementType()->isFloatingPointTy();
+    if (op == REDUCE_ADD)
+        return llvm::BinaryOperator::Create(isFloat ? llvm::Instruction::FAdd :
+                                            llvm::Instruction::Add,
+                                            a, b, "vec_sum", insertBefore);
+
+    llvm::Value *cmp = NULL;
+    if (isFloat)
+        cmp = new llvm::FCmpInst(insertBefore, (op == REDUCE_MIN) ?
+                                 llvm::CmpInst::FCMP_OLT : llvm::CmpInst::FCMP_OGT,
+                                 a, b, "vec_cmp");
+    else {
+        bool isSigned = (typeCode == 'i' || typeCode == 'I');
+        llvm::CmpInst::Predicate pred = (op == REDUCE_MIN) ?
+            (isSigned ? llvm::CmpInst::ICMP_SLT : llvm::CmpInst::ICMP_ULT) :
+            (isSigned ? llvm::CmpInst::ICMP_SGT : llvm::CmpInst::ICMP_UGT);
+        cmp = new llvm::ICmpInst(insertBefore, pred, a, b, "vec_cmp");
+    }
+    return llvm::SelectInst::Create(cmp, a, b,
+                                    (op == REDUCE_MIN) ? "vec_min" : "vec_max",
+                                    insertBefore);
+}
+
+
+/** Emits the code that computes the accumulator's value from its initial
+    value and the given vector accumulators: the vectors are combined,
+    reduced with the original reduction function and then combined with
+    the initial value in the same way as the original update. */
+static llvm::Value *
+lEmitFinalReduction(const ReductionInfo &info,
+                    const std::vector<llvm::Value *> &accumulators,
+                    llvm::Instruction *insertBefore) {
+    llvm::Value *vec = accumulators[0];
+    for (unsigned int i = 1; i < accumulators.size(); ++i)
+        vec = lCombineVectors(info.op, info.typeCode, vec, accumulators[i],
+                              insertBefore);
+
+    std::vector<llvm::Value *> args;
+    args.push_back(vec);
+    for (unsigned int i = 1; i < info.reduce->getNumArgOperands(); ++i)
+        // The remaining arguments are the execution mask.
+        args.push_back(LLVMMaskAllOn);
+    llvm::Value *reduced =
+        llvm::CallInst::Create(info.reduce->getCalledFunction(), args,
+                               "reduced", insertBefore);
+
+    if (info.op == REDUCE_ADD)
+        return llvm::BinaryOperator::Create(
+            llvm::dyn_cast<llvm::BinaryOperator>(info.update)->getOpcode(),
+            info.initial, reduced, "final_reduction", insertBefore);
+
+    llvm::CallInst *update = llvm::dyn_cast<llvm::CallInst>(info.update);
+    args.clear();
+    args.push_back(info.initial);
+    args.push_back(reduced);
+    for (unsigned int i = 2; i < update->getNumArgOperands(); ++i)
+        args.push_back(LLVMMaskAllOn);
+    return llvm::CallInst::Create(update->getCalledFunction(), args,
+                                  "final_reduction", insertBefore);
+}
+
+
+/** Returns true if the accumulator described by the given
+    ReductionInfo, whose loop has the given blocks, can be replaced: the
+    phi has to be used only by the update and outside of the loop, and
+    the update only by the phi and outside of the loop. */
+static bool
+lReductionUsesOk(const ReductionInfo &info,
+                 const std::set<llvm::BasicBlock *> &loopBlocks) {
+    if (!info.reduce->hasOneUse())
+        return false;
+
+    llvm::Instruction *values[2] = { info.phi, info.update };
+    for (int i = 0; i < 2; ++i) {
+        for (llvm::Value::use_iterator ui = values[i]->use_begin();
+             ui != values[i]->use_end(); ++ui) {
+            llvm::Use &use = *ui;
+            llvm::Instruction *user = llvm::dyn_cast<llvm::Instruction>(use.getUser());
+            if (user == values[1 - i])
+                continue;
+            if (user == NULL)
+                return false;
+            llvm::BasicBlock *useBlock = user->getParent();
+            if (llvm::PHINode *phi = llvm::dyn_cast<llvm::PHINode>(user))
+                useBlock = phi->getIncomingBlock(use);
+            if (loopBlocks.find(useBlock) != loopBlocks.end())
+                return false;
+        }
+    }
+    return true;
+}
+
+
+/** Replaces the accumulator described by the given ReductionInfo with
+    vector accumulators. */
+static void
+lVectorizeReduction(const ReductionInfo &info) {
+    llvm::Type *vecType = info.varyingValue->getType();
+    llvm::Type *eltType = vecType->getVectorElementType();
+    llvm::Constant *identity =
+        lReductionIdentity(info.op, info.typeCode, eltType);
+    llvm::Constant *identityVec =
+        llvm::ConstantVector::getSplat(g->target->getVectorWidth(), identity);
+    int nAccumulators = eltType->isFloatingPointTy() ? 2 : 1;
+
+    // Create the vector accumulators' phis; the first one gets the
+    // updated value from the back edge and each of the others gets the
+    // value of the one before it.
+    llvm::BasicBlock *header = info.phi->getParent();
+    llvm::BasicBlock *latch = info.phi->getIncomingBlock(info.backEdge);
+    llvm::BasicBlock *preheader = info.phi->getIncomingBlock(1 - info.backEdge);
+    std::vector<llvm::PHINode *> phis;
+    for (int i = 0; i < nAccumulators; ++i) {
+        llvm::PHINode *phi =
+            llvm::PHINode::Create(vecType, 2, "vec_accum", &*header->begin());
+        phi->addIncoming(identityVec, preheader);
+        phis.push_back(phi);
+    }
+
+    // Add the values of the active program instances to the last one.
+    llvm::Value *mask = info.reduce->getArgOperand(1);
+    llvm::Value *active = mask;
+    if (mask->getType()->getVectorElementType() != LLVMTypes::BoolType)
+        active = new llvm::ICmpInst(info.reduce, llvm::CmpInst::ICMP_NE, mask,
+                                    llvm::Constant::getNullValue(mask->getType()),
+                                    "active");
+    llvm::Value *contribution =
+        llvm::SelectInst::Create(active, info.varyingValue, identityVec,
+                                 "reduce_contribution", info.reduce);
+    llvm::Value *updated =
+        lCombineVectors(info.op, info.typeCode, phis.back(), contribution,
+                        info.reduce);
+
+    phis[0]->addIncoming(updated, latch);
+    for (int i = 1; i < nAccumulators; ++i)
+        phis[i]->addIncoming(phis[i - 1], latch);
+
+    // The uses outside the loop get the result of reducing the vector
+    // accumulators, as of the start of the iteration for the phi and its
+    // end for the updated value.
+    std::vector<llvm::Value *> atStart(phis.begin(), phis.end());
+    std::vector<llvm::Value *> atEnd;
+    atEnd.push_back(updated);
+    for (int i = 0; i < nAccumulators - 1; ++i)
+        atEnd.push_back(phis[i]);
+
+    llvm::Instruction *values[2] = { info.phi, info.update };
+    for (int i = 0; i < 2; ++i) {
+        std::vector<llvm::Use *> uses;
+        for (llvm::Value::use_iterator ui = values[i]->use_begin();
+             ui != values[i]->use_end(); ++ui)
+            if ((*ui).getUser() != values[1 - i])
+                uses.push_back(&*ui);
+
+        for (unsigned int j = 0; j < uses.size(); ++j) {
+            llvm::Instruction *user = llvm::dyn_cast<llvm::Instruction>(uses[j]->getUser());
+            llvm::Instruction *insertBefore = user;
+            if (llvm::PHINode *phi = llvm::dyn_cast<llvm::PHINode>(user))
+                insertBefore = phi->getIncomingBlock(*uses[j])->getTerminator();
+            uses[j]->set(lEmitFinalReduction(info, (i == 0) ? atStart : atEnd,
+                                             insertBefore));
+        }
+    }
+
+    info.update->replaceAllUsesWith(llvm::UndefValue::get(info.update->getType()));
+    info.update->eraseFromParent();
+    info.reduce->eraseFromParent();
+    info.phi->eraseFromParent();
+}
+
+
+bool
+VectorizeReductionsPass::runOnFunction(llvm::Function &F) {
+    std::vector<ReductionInfo> reductions;
+    llvm::DominatorTree domTree;
+    bool haveDomTree = false;
+
+    // Floating-point sums may only be reassociated under
+    // --opt=fast-math[=reassoc] or in __declspec(fastmath) functions,
+    // which are marked "unsafe-fp-math".
+    bool reassocFloat = g->opt.fastMathReassoc;
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_7 // LLVM 3.7+
+    if (F.getFnAttribute("unsafe-fp-math").getValueAsString() == "true")
+        reassocFloat = true;
+#endif
+
+    for (llvm::Function::iterator bb = F.begin(); bb != F.end(); ++bb) {
+        for (llvm::BasicBlock::iterator iter = bb->begin();
+             llvm::isa<llvm::PHINode>(&*iter); ++iter) {
+            llvm::PHINode *phi = llvm::dyn_cast<llvm::PHINode>(&*iter);
+            if (phi->getNumIncomingValues() != 2 ||
+                phi->getType()->isVectorTy())
+                continue;
+
+            for (unsigned int e = 0; e < 2; ++e) {
+                ReductionInfo info;
+                info.phi = phi;
+                info.backEdge = e;
+                info.initial = phi->getIncomingValue(1 - e);
+                info.update = llvm::dyn_cast<llvm::Instruction>(phi->getIncomingValue(e));
+                if (info.update == NULL || info.update->getNumOperands() < 2)
+                    continue;
+
+                // Find the reduction call among the update's operands.
+                info.reduce = NULL;
+                for (int i = 0; i < 2 && info.reduce == NULL; ++i) {
+                    llvm::CallInst *call =
+                        llvm::dyn_cast<llvm::CallInst>(info.update->getOperand(i));
+                    if (call != NULL && call->getNumArgOperands() == 2 &&
+                        lIsReductionFunction(call->getCalledFunction(), &info.op,
+                                             &info.typeCode))
+                        info.reduce = call;
+                }
+                if (info.reduce == NULL ||
+                    !lIsReductionUpdate(info.update, phi, info.reduce, info.op,
+                                        info.typeCode))
+                    continue;
+                info.varyingValue = info.reduce->getArgOperand(0);
+                if (!lIsGangVectorType(info.varyingValue->getType()) ||
+                    info.varyingValue->getType()->getVectorElementType() !=
+                    phi->getType())
+                    continue;
+                if (info.op == REDUCE_ADD && phi->getType()->isFloatingPointTy() &&
+                    reassocFloat == false)
+                    continue;
+
+                // The phi's block has to be the header of a natural loop
+                // that the back edge is from.
+                if (!haveDomTree) {
+                    domTree.recalculate(F);
+                    haveDomTree = true;
+                }
+                llvm::BasicBlock *header = phi->getParent();
+                llvm::BasicBlock *latch = phi->getIncomingBlock(e);
+                if (!domTree.dominates(header, latch) ||
+                    domTree.dominates(header, phi->getIncomingBlock(1 - e)))
+                    continue;
+                std::set<llvm::BasicBlock *> loopBlocks;
+                std::vector<llvm::BasicBlock *> worklist;
+                loopBlocks.insert(header);
+                worklist.push_back(latch);
+                while (worklist.size() > 0) {
+                    llvm::BasicBlock *block = worklist.back();
+                    worklist.pop_back();
+                    if (loopBlocks.insert(block).second == false)
+                        continue;
+                    for (llvm::pred_iterator pi = llvm::pred_begin(block);
+                         pi != llvm::pred_end(block); ++pi)
+                        worklist.push_back(*pi);
+                }
+
+                if (loopBlocks.find(info.update->getParent()) != loopBlocks.end() &&
+                    lReductionUsesOk(info, loopBlocks))
+                    reductions.push_back(info);
+                break;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < reductions.size(); ++i) {
+        SourcePos pos;
+        lGetSourcePosFromMetadata(reductions[i].reduce, &pos);
+        Debug(pos, "Vectorized reduction accumulator \"%s\".",
+              reductions[i].phi->getName().str().c_str());
+        OptRemark(OptRemarkPassed, pos, "VectorizeReductions",
+                  "ReductionAccumulator", F.getName().str().c_str(),
+                  "Uniform accumulator updated with a reduction in a loop "
+                  "turned into a vector accumulator reduced after the loop.");
+        lVectorizeReduction(reductions[i]);
+    }
+    return (reductions.size() > 0);
+}
+
+
+static llvm::Pass *
+CreateVectorizeReductionsPass() {
+    return new VectorizeReductionsPass;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// ImproveMemoryOpsPass
+
+/** When the front-end emits gathers and scatters, it generates an array of
+    vector-width pointers to represent the set of addresses to read from or
+    write to.  This optimization detects cases when the base pointer is a
+    uniform pointer or when the indexing is into an array that can be
+    converted into scatters/gathers from a single base pointer and an array
+    of offsets.
+
+    See for example the comments discussing the __pseudo_gather functions
+    in builtins.cpp for more information about this.
+ */
+class ImproveMemoryOpsPass : public llvm::BasicBlockPass {
+public:
+    static char ID;
+    ImproveMemoryOpsPass(bool ls = false)
+        : BasicBlockPass(ID), lowerStrided(ls) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Improve Memory Ops"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Improve Memory Ops"; }
+#endif
+    bool runOnBasicBlock(llvm::BasicBlock &BB);
+
+private:
+    /** Whether strided gathers and scatters should be turned into
+        vector loads and stores (see lGSToLoadStore()). */
+    bool lowerStrided;
+};
+
+char ImproveMemoryOpsPass::ID = 0;
+
+
+
+/** Check to make sure that this value is actually a pointer in the end.
+    We need to make sure that given an expression like vec(offset) +
+    ptr2int(ptr), lGetBasePointer() doesn't return vec(offset) for the base
+    pointer such that we then treat ptr2int(ptr) as an offset.  This ends
+    up being important so that we don't generate LLVM GEP instructions like
+    "gep inttoptr 8, i64 %ptr", which in turn can lead to incorrect code
+    since LLVM's pointer aliasing analysis assumes that operands after the
+    first one to a GEP aren't pointers.
+ */
+static llvm::Value *
+lCheckForActualPointer(llvm::Value *v) {
+    if (v == NULL) {
+        return NULL;
+    }
+    else if (llvm::isa<llvm::PointerType>(v->getType())) {
+        return v;
+    }
+    else if (llvm::isa<llvm::PtrToIntInst>(v)) {
+        return v;
+    }
+    else if (llvm::CastInst *ci = llvm::dyn_cast<llvm::CastInst>(v)) {
+        llvm::Value *t = lCheckForActualPointer(ci->getOperand(0));
+        if (t == NULL) {
+            return NULL;
+        }
+        else {
+            return v;
+        }
+    }
+    else {
+        llvm::ConstantExpr *uce =
+            llvm::dyn_cast<llvm::ConstantExpr>(v);
+        if (uce != NULL &&
+            uce->getOpcode() == llvm::Instruction::PtrToInt)
+            return v;
+        return NULL;
+    }
+}
+
+
+/** Given a llvm::Value representing a varying pointer, this function
+    checks to see if all of the elements of the vector have the same value
+    (i.e. there's a common base pointer).  If so, it returns the common
+    pointer value; otherwise it returns NULL.
+ */
+static llvm::Value *
+lGetBasePointer(llvm::Value *v, llvm::Instruction *insertBefore) {
+    if (llvm::isa<llvm::InsertElementInst>(v) ||
+        llvm::isa<llvm::ShuffleVectorInst>(v)) {
+        llvm::Value *element = LLVMFlattenInsertChain
+            (v, g->target->getVectorWidth(), true, false);
+        // TODO: it's probably ok to allow undefined elements and return
+        // the base pointer if all of the other elements have the same
+        // value.
+        if (element != NULL) {
+            //all elements are the same and not NULLs
+            return lCheckForActualPointer(element);
+        }
+        else {
+            return NULL;
+        }
+    }
+
+    // This case comes up with global/static arrays
+    if (llvm::ConstantVector *cv = llvm::dyn_cast<llvm::ConstantVector>(v)) {
+        return lCheckForActualPointer(cv->getSplatValue());
+    }
+    else if (llvm::ConstantDataVector *cdv = llvm::dyn_cast<llvm::ConstantDataVector>(v)) {
+        return lCheckForActualPointer(cdv->getSplatValue());
+    }
+    // It is a little bit tricky to use operations with pointers, casted to int with another bit size
+    // but sometimes it is useful, so we handle this case here.
+    else if (llvm::CastInst *ci = llvm::dyn_cast<llvm::CastInst>(v)) {
         llvm::Value *t = lGetBasePointer(ci->getOperand(0), insertBefore);
         if (t == NULL) {
             return NULL;
@@ -2120,29 +3336,148 @@ lVectorIs32BitInts(llvm::Value *v) {
 }
 
 
-/** Check to see if the two offset vectors can safely be represented with
-    32-bit values.  If so, return true and update the pointed-to
-    llvm::Value *s to be the 32-bit equivalents. */
+/** If the given pointer points to the start of a global variable or of a
+    local variable, returns true and the size of the variable in bytes in
+    *size.  Returns false if it isn't known what it points to.
+ */
 static bool
-lOffsets32BitSafe(llvm::Value **variableOffsetPtr,
-                  llvm::Value **constOffsetPtr,
-                  llvm::Instruction *insertBefore) {
-    llvm::Value *variableOffset = *variableOffsetPtr;
-    llvm::Value *constOffset = *constOffsetPtr;
+lGetPointeeObjectSize(llvm::Value *ptr, uint64_t *size) {
+    const llvm::DataLayout *dl = g->target->getDataLayout();
+    llvm::Value *obj = ptr->stripPointerCasts();
 
-    if (variableOffset->getType() != LLVMTypes::Int32VectorType) {
-        llvm::SExtInst *sext = llvm::dyn_cast<llvm::SExtInst>(variableOffset);
-        if (sext != NULL &&
-            sext->getOperand(0)->getType() == LLVMTypes::Int32VectorType)
-            // sext of a 32-bit vector -> the 32-bit vector is good
-            variableOffset = sext->getOperand(0);
-        else if (lVectorIs32BitInts(variableOffset))
-            // The only constant vector we should have here is a vector of
-            // all zeros (i.e. a ConstantAggregateZero, but just in case,
-            // do the more general check with lVectorIs32BitInts().
-            variableOffset =
-                new llvm::TruncInst(variableOffset, LLVMTypes::Int32VectorType,
-                                    LLVMGetName(variableOffset, "_trunc"),
+    if (llvm::GlobalVariable *gv = llvm::dyn_cast<llvm::GlobalVariable>(obj)) {
+        *size = dl->getTypeAllocSize(gv->getType()->getElementType());
+        return true;
+    }
+    if (llvm::AllocaInst *ai = llvm::dyn_cast<llvm::AllocaInst>(obj)) {
+        if (ai->isArrayAllocation())
+            return false;
+        *size = dl->getTypeAllocSize(ai->getAllocatedType());
+        return true;
+    }
+    return false;
+}
+
+
+/** Largest variable for which it's assumed that all of the offsets used to
+    access it fit in 32 bits, with room to spare for constant offsets. */
+static const uint64_t lMaxSmallObjectSize = 1 << 30;
+
+
+/** With 64-bit addressing, the 32-bit variants of the gathers and scatters
+    can still be used for accesses where doing so gives exactly the same
+    addresses: they compute base + sext(offset) * scale with 64-bit
+    arithmetic.  This is the case if the offsets are sign-extended 32-bit
+    values (as with int32 indices), or if the base pointer points to a
+    variable that is small enough that all in-bounds offsets fit in 32
+    bits (as with fixed-size arrays).  If so, returns true and updates the
+    pointed-to llvm::Value * to be the 32-bit equivalent.
+ */
+static bool
+lOffsets32BitExact(llvm::Value *basePtr, llvm::Value **offsetPtr,
+                   llvm::Instruction *insertBefore) {
+    llvm::Value *offset = *offsetPtr;
+
+    if (offset->getType() == LLVMTypes::Int32VectorType)
+        return true;
+
+    llvm::SExtInst *sext = llvm::dyn_cast<llvm::SExtInst>(offset);
+    if (sext != NULL &&
+        sext->getOperand(0)->getType() == LLVMTypes::Int32VectorType) {
+        *offsetPtr = sext->getOperand(0);
+        return true;
+    }
+
+    uint64_t size;
+    if (lVectorIs32BitInts(offset) ||
+        (lGetPointeeObjectSize(basePtr, &size) && size <= lMaxSmallObjectSize)) {
+        *offsetPtr =
+            new llvm::TruncInst(offset, LLVMTypes::Int32VectorType,
+                                LLVMGetName(offset, "_trunc"), insertBefore);
+        return true;
+    }
+    return false;
+}
+
+
+/** The equivalent of lOffsets32BitExact() for a variable offset vector and
+    a constant one, which is added with the same 64-bit arithmetic.  For
+    the small variable case, the constant offsets have to be within the
+    variable as well, so that the variable offsets fit by themselves.
+ */
+static bool
+lOffsets32BitExact(llvm::Value *basePtr, llvm::Value **variableOffsetPtr,
+                   llvm::Value **constOffsetPtr, llvm::Instruction *insertBefore) {
+    llvm::Value *variableOffset = *variableOffsetPtr;
+    llvm::Value *constOffset = *constOffsetPtr;
+    if (variableOffset->getType() == LLVMTypes::Int32VectorType &&
+        constOffset->getType() == LLVMTypes::Int32VectorType)
+        return true;
+
+    int nElts;
+    int64_t elts[ISPC_MAX_NVEC];
+    if (!LLVMExtractVectorInts(constOffset, elts, &nElts))
+        return false;
+
+    bool constInSmallObject = true;
+    for (int i = 0; i < nElts; ++i) {
+        if ((int32_t)elts[i] != elts[i])
+            return false;
+        if (elts[i] < 0 || (uint64_t)elts[i] > lMaxSmallObjectSize)
+            constInSmallObject = false;
+    }
+
+    if (variableOffset->getType() != LLVMTypes::Int32VectorType) {
+        llvm::SExtInst *sext = llvm::dyn_cast<llvm::SExtInst>(variableOffset);
+        uint64_t size;
+        if (sext != NULL &&
+            sext->getOperand(0)->getType() == LLVMTypes::Int32VectorType)
+            variableOffset = sext->getOperand(0);
+        else if (lVectorIs32BitInts(variableOffset) ||
+                 (constInSmallObject && lGetPointeeObjectSize(basePtr, &size) &&
+                  size <= lMaxSmallObjectSize))
+            variableOffset =
+                new llvm::TruncInst(variableOffset, LLVMTypes::Int32VectorType,
+                                    LLVMGetName(variableOffset, "_trunc"),
+                                    insertBefore);
+        else
+            return false;
+    }
+
+    if (constOffset->getType() != LLVMTypes::Int32VectorType)
+        constOffset =
+            new llvm::TruncInst(constOffset, LLVMTypes::Int32VectorType,
+                                LLVMGetName(constOffset, "_trunc"), insertBefore);
+
+    *variableOffsetPtr = variableOffset;
+    *constOffsetPtr = constOffset;
+    return true;
+}
+
+
+/** Check to see if the two offset vectors can safely be represented with
+    32-bit values.  If so, return true and update the pointed-to
+    llvm::Value *s to be the 32-bit equivalents. */
+static bool
+lOffsets32BitSafe(llvm::Value **variableOffsetPtr,
+                  llvm::Value **constOffsetPtr,
+                  llvm::Instruction *insertBefore) {
+    llvm::Value *variableOffset = *variableOffsetPtr;
+    llvm::Value *constOffset = *constOffsetPtr;
+
+    if (variableOffset->getType() != LLVMTypes::Int32VectorType) {
+        llvm::SExtInst *sext = llvm::dyn_cast<llvm::SExtInst>(variableOffset);
+        if (sext != NULL &&
+            sext->getOperand(0)->getType() == LLVMTypes::Int32VectorType)
+            // sext of a 32-bit vector -> the 32-bit vector is good
+            variableOffset = sext->getOperand(0);
+        else if (lVectorIs32BitInts(variableOffset))
+            // The only constant vector we should have here is a vector of
+            // all zeros (i.e. a ConstantAggregateZero, but just in case,
+            // do the more general check with lVectorIs32BitInts().
+            variableOffset =
+                new llvm::TruncInst(variableOffset, LLVMTypes::Int32VectorType,
+                                    LLVMGetName(variableOffset, "_trunc"),
                                     insertBefore);
         else
             return false;
@@ -2481,6 +3816,11 @@ lGSToGSBaseOffsets(llvm::CallInst *callInst) {
             lOffsets32BitSafe(&offsetVector, callInst)) {
             gatherScatterFunc = info->baseOffsets32Func;
         }
+        else if (lOffsets32BitExact(basePtr, &offsetVector, callInst)) {
+            // Otherwise, use them if the results are the same, which
+            // avoids 64-bit offset vectors with 64-bit addressing.
+            gatherScatterFunc = info->baseOffsets32Func;
+        }
 
         if (info->isGather || info->isPrefetch) {
             llvm::Value *mask = callInst->getArgOperand(1);
@@ -2538,6 +3878,10 @@ lGSToGSBaseOffsets(llvm::CallInst *callInst) {
             lOffsets32BitSafe(&variableOffset, &constOffset, callInst)) {
             gatherScatterFunc = info->baseOffsets32Func;
         }
+        else if (lOffsets32BitExact(basePtr, &variableOffset, &constOffset,
+                                    callInst)) {
+            gatherScatterFunc = info->baseOffsets32Func;
+        }
 
         if (info->isGather || info->isPrefetch) {
             llvm::Value *mask = callInst->getArgOperand(1);
@@ -2779,6 +4123,457 @@ lGetOffsetScaleVec(llvm::Value *offsetScale, llvm::Type *vecType) {
 }
 
 
+/** Returns the mask to use for the given chunk of a strided access that
+    is being implemented with vector-width memory operations: element j
+    of chunk c is accessed by the program instance (c*width + j) / stride
+    if (c*width + j) is a multiple of the stride.  If 'spanOnly' is true
+    (which is only valid for loads with an "all on" mask), the gaps
+    between the accessed elements are enabled as well, which allows
+    regular vector loads for all but the last chunk.
+ */
+static llvm::Value *
+lStridedChunkMask(llvm::Value *mask, int stride, int chunk, bool spanOnly,
+                  llvm::Instruction *insertBefore) {
+    int width = g->target->getVectorWidth();
+    int span = stride * (width - 1) + 1;
+
+    if (spanOnly) {
+        bool on[ISPC_MAX_NVEC];
+        for (int j = 0; j < width; ++j)
+            on[j] = (chunk * width + j) < span;
+        return LLVMBoolVector(on);
+    }
+
+    int32_t shuf[ISPC_MAX_NVEC];
+    for (int j = 0; j < width; ++j) {
+        int elt = chunk * width + j;
+        // Take the lane's mask value for accessed elements and a zero
+        // from the second operand for the rest.
+        shuf[j] = ((elt % stride) == 0 && elt < span) ? (elt / stride) :
+            (width + j);
+    }
+    return LLVMShuffleVectors(mask, llvm::Constant::getNullValue(mask->getType()),
+                              shuf, width, insertBefore);
+}
+
+
+/** Implements a gather or scatter that accesses every stride-th element
+    starting from the given pointer with vector-width masked loads or
+    stores of the memory region it covers and shuffles to move the
+    values between those vectors and the program instances.  For a
+    gather, loadMaskedFunc gives the masked load function to use; for a
+    scatter, storeValue, maskedStoreFunc and vecPtrType give the value to
+    store, the masked store to use and its pointer type.
+
+    Only the elements actually accessed by the active program instances
+    are stored to, so that the values in the gaps are left unchanged.
+    Loads with an "all on" mask may read the gaps as well, since they are
+    contained in the memory between the first and last elements accessed.
+ */
+static void
+lStridedLoadStore(llvm::CallInst *callInst, llvm::Value *ptr,
+                  llvm::Value *mask, int stride, int elementSize,
+                  llvm::Function *loadMaskedFunc, llvm::Value *storeValue,
+                  llvm::Function *maskedStoreFunc, llvm::Type *vecPtrType) {
+    int width = g->target->getVectorWidth();
+    int span = stride * (width - 1) + 1;
+    int nChunks = (span + width - 1) / width;
+    bool allOn = (lGetMaskStatus(mask) == ALL_ON);
+
+    llvm::Value *result = NULL;
+    if (loadMaskedFunc != NULL)
+        result = llvm::UndefValue::get(callInst->getType());
+
+    for (int c = 0; c < nChunks; ++c) {
+        llvm::Value *chunkPtr =
+            lGEPInst(ptr, LLVMInt64((int64_t)c * width * elementSize),
+                     "strided_ptr", callInst);
+        lCopyMetadata(chunkPtr, callInst);
+
+        if (loadMaskedFunc != NULL) {
+            llvm::Value *chunkMask =
+                lStridedChunkMask(mask, stride, c, allOn, callInst);
+            llvm::Instruction *chunk =
+                lCallInst(loadMaskedFunc, chunkPtr, chunkMask,
+                          "strided_load", callInst);
+            lCopyMetadata(chunk, callInst);
+
+            // Move the elements of this chunk that are in the result
+            // into place.
+            int32_t shuf[ISPC_MAX_NVEC];
+            for (int i = 0; i < width; ++i) {
+                int elt = stride * i - c * width;
+                shuf[i] = (elt >= 0 && elt < width) ? (width + elt) : i;
+            }
+            result = LLVMShuffleVectors(result, chunk, shuf, width, callInst);
+        }
+        else {
+            int32_t shuf[ISPC_MAX_NVEC];
+            for (int j = 0; j < width; ++j) {
+                int elt = c * width + j;
+                shuf[j] = ((elt % stride) == 0) ? (elt / stride) : -1;
+            }
+            llvm::Value *chunkValue =
+                LLVMShuffleVectors(storeValue, storeValue, shuf, width, callInst);
+            llvm::Value *chunkMask =
+                lStridedChunkMask(mask, stride, c, false, callInst);
+            chunkPtr = new llvm::BitCastInst(chunkPtr, vecPtrType, "ptrcast",
+                                             callInst);
+            llvm::Instruction *store =
+                lCallInst(maskedStoreFunc, chunkPtr, chunkValue, chunkMask,
+                          "", callInst);
+            lCopyMetadata(store, callInst);
+        }
+    }
+
+    if (result != NULL)
+        callInst->replaceAllUsesWith(result);
+    callInst->eraseFromParent();
+}
+
+
+/** Returns the largest power-of-two number of consecutive program
+    instances, n, such that each group of n instances starting at a
+    multiple of n accesses consecutive elements of the given size, as
+    happens for linear indexing into soa<n> data.  The offset of each
+    instance's element from the first instance's is returned in
+    laneOffsets.  Zero is returned if the offsets can't be analyzed.
+ */
+static int
+lLinearBlockSize(llvm::Value *fullOffsets, int elementSize,
+                 int64_t laneOffsets[]) {
+    if (!LLVMVectorLaneOffsets(fullOffsets, laneOffsets))
+        return 0;
+
+    int width = g->target->getVectorWidth();
+    int blockSize = width;
+    for (int i = 1; i < width; ++i) {
+        // Shrink the blocks until the ones that lane i is in doesn't
+        // start with it or it follows the previous lane.
+        while ((i % blockSize) != 0 &&
+               laneOffsets[i] != laneOffsets[i - 1] + elementSize)
+            blockSize /= 2;
+    }
+    return blockSize;
+}
+
+
+/** Implements a gather or scatter where each group of blockSize program
+    instances accesses consecutive elements with a masked vector load or
+    store per group, using shuffles to move the group's values between the
+    program instances and the first elements of the vector.  laneOffsets
+    gives the offset of each program instance's element from the given
+    pointer, and the remaining parameters are as for lStridedLoadStore().
+ */
+static void
+lBlockedLoadStore(llvm::CallInst *callInst, llvm::Value *ptr,
+                  llvm::Value *mask, int blockSize,
+                  const int64_t laneOffsets[],
+                  llvm::Function *loadMaskedFunc, llvm::Value *storeValue,
+                  llvm::Function *maskedStoreFunc, llvm::Type *vecPtrType) {
+    int width = g->target->getVectorWidth();
+
+    llvm::Value *result = NULL;
+    if (loadMaskedFunc != NULL)
+        result = llvm::UndefValue::get(callInst->getType());
+
+    for (int b = 0; b < width / blockSize; ++b) {
+        int first = b * blockSize;
+        llvm::Value *blockPtr =
+            lGEPInst(ptr, LLVMInt64(laneOffsets[first]), "block_ptr", callInst);
+        lCopyMetadata(blockPtr, callInst);
+
+        // The block's mask values go in the first blockSize elements of
+        // the mask for the vector operation; the rest are off.
+        int32_t shuf[ISPC_MAX_NVEC];
+        for (int j = 0; j < width; ++j)
+            shuf[j] = (j < blockSize) ? (first + j) : (width + j);
+        llvm::Value *blockMask =
+            LLVMShuffleVectors(mask, llvm::Constant::getNullValue(mask->getType()),
+                               shuf, width, callInst);
+
+        if (loadMaskedFunc != NULL) {
+            llvm::Instruction *block =
+                lCallInst(loadMaskedFunc, blockPtr, blockMask, "block_load",
+                          callInst);
+            lCopyMetadata(block, callInst);
+
+            for (int i = 0; i < width; ++i)
+                shuf[i] = (i >= first && i < first + blockSize) ?
+                    (width + i - first) : i;
+            result = LLVMShuffleVectors(result, block, shuf, width, callInst);
+        }
+        else {
+            for (int j = 0; j < width; ++j)
+                shuf[j] = (j < blockSize) ? (first + j) : -1;
+            llvm::Value *blockValue =
+                LLVMShuffleVectors(storeValue, storeValue, shuf, width, callInst);
+            blockPtr = new llvm::BitCastInst(blockPtr, vecPtrType, "ptrcast",
+                                             callInst);
+            llvm::Instruction *store =
+                lCallInst(maskedStoreFunc, blockPtr, blockValue, blockMask,
+                          "", callInst);
+            lCopyMetadata(store, callInst);
+        }
+    }
+
+    if (result != NULL)
+        callInst->replaceAllUsesWith(result);
+    callInst->eraseFromParent();
+}
+
+
+/** Merges the range of values given by the second set of bounds into the
+    first, as computed by lGetValueRange(). */
+static void
+lMergeValueRange(uint64_t *minValue, uint64_t *maxValue, uint64_t *multiple,
+                 uint64_t min2, uint64_t max2, uint64_t multiple2) {
+    *minValue = std::min(*minValue, min2);
+    *maxValue = std::max(*maxValue, max2);
+    *multiple = std::min(*multiple, multiple2);
+}
+
+
+/** Conservatively bounds the elements of the given integer vector (or
+    scalar): on success, all of them are known to be between *minValue and
+    *maxValue and to be multiples of *multiple, which is a power of two.
+    Only values that are known to be non-negative and less than 2^31 are
+    handled, and only the operations that typically come up in computing
+    indices into small tables (masking, shifts, remainders, and small
+    multiplies and adds) are understood; false is returned otherwise.
+ */
+static bool
+lGetValueRange(llvm::Value *v, uint64_t *minValue, uint64_t *maxValue,
+               uint64_t *multiple, int depth = 0) {
+    const uint64_t maxRange = 0x7fffffff;
+    const uint64_t maxMultiple = 1 << 30;
+    if (depth > 8)
+        return false;
+
+    if (llvm::isa<llvm::UndefValue>(v)) {
+        // We're free to pick any value for undefined elements.
+        *minValue = *maxValue = 0;
+        *multiple = maxMultiple;
+        return true;
+    }
+    if (llvm::ConstantInt *ci = llvm::dyn_cast<llvm::ConstantInt>(v)) {
+        int64_t value = ci->getSExtValue();
+        if (value < 0 || (uint64_t)value > maxRange)
+            return false;
+        *minValue = *maxValue = (uint64_t)value;
+        *multiple = (value == 0) ? maxMultiple : (uint64_t)(value & -value);
+        *multiple = std::min(*multiple, maxMultiple);
+        return true;
+    }
+    if (llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(v)) {
+        if (!c->getType()->isVectorTy())
+            return false;
+        int n = c->getType()->getVectorNumElements();
+        for (int i = 0; i < n; ++i) {
+            llvm::Constant *elt = c->getAggregateElement(i);
+            uint64_t eltMin, eltMax, eltMultiple;
+            if (elt == NULL ||
+                !lGetValueRange(elt, &eltMin, &eltMax, &eltMultiple, depth + 1))
+                return false;
+            if (i == 0) {
+                *minValue = eltMin;
+                *maxValue = eltMax;
+                *multiple = eltMultiple;
+            }
+            else
+                lMergeValueRange(minValue, maxValue, multiple,
+                                 eltMin, eltMax, eltMultiple);
+        }
+        return n > 0;
+    }
+
+    uint64_t min0, max0, mult0, min1, max1, mult1;
+    llvm::BinaryOperator *bop = llvm::dyn_cast<llvm::BinaryOperator>(v);
+    if (bop != NULL) {
+        llvm::Value *op0 = bop->getOperand(0), *op1 = bop->getOperand(1);
+        bool known0 = lGetValueRange(op0, &min0, &max0, &mult0, depth + 1);
+        bool known1 = lGetValueRange(op1, &min1, &max1, &mult1, depth + 1);
+
+        switch (bop->getOpcode()) {
+        case llvm::Instruction::Add:
+            if (!known0 || !known1 || max0 + max1 > maxRange)
+                return false;
+            *minValue = min0 + min1;
+            *maxValue = max0 + max1;
+            *multiple = std::min(mult0, mult1);
+            return true;
+        case llvm::Instruction::Mul:
+            if (!known0 || !known1 || (max0 != 0 && max1 > maxRange / max0))
+                return false;
+            *minValue = min0 * min1;
+            *maxValue = max0 * max1;
+            *multiple = std::min(mult0 * mult1, maxMultiple);
+            return true;
+        case llvm::Instruction::Shl:
+            if (!known0 || !known1 || max1 >= 31 ||
+                max0 > (maxRange >> max1))
+                return false;
+            *minValue = min0 << min1;
+            *maxValue = max0 << max1;
+            *multiple = std::min(mult0 << min1, maxMultiple);
+            return true;
+        case llvm::Instruction::LShr:
+            if (!known1)
+                return false;
+            if (!known0) {
+                // Shifting down any value leaves a bounded result.
+                int bits = op0->getType()->getScalarSizeInBits();
+                if (bits > 32 || max1 >= (uint64_t)bits)
+                    return false;
+                min0 = 0;
+                max0 = (bits == 32) ? 0xffffffffull : ((1ull << bits) - 1);
+                mult0 = 1;
+            }
+            *minValue = (max1 >= 32) ? 0 : (min0 >> max1);
+            *maxValue = max0 >> min1;
+            *multiple = std::max((max1 >= 32) ? 0 : (mult0 >> max1), (uint64_t)1);
+            return *maxValue <= maxRange;
+        case llvm::Instruction::And:
+            // Masking with a known non-negative value bounds the result
+            // regardless of the other operand.
+            if (!known0 && !known1)
+                return false;
+            *minValue = 0;
+            *maxValue = std::min(known0 ? max0 : maxRange, known1 ? max1 : maxRange);
+            *multiple = std::max(known0 ? mult0 : 1, known1 ? mult1 : 1);
+            return true;
+        case llvm::Instruction::URem:
+            if (!known1 || min1 == 0)
+                return false;
+            *minValue = 0;
+            *maxValue = known0 ? std::min(max0, max1 - 1) : (max1 - 1);
+            *multiple = known0 ? std::min(mult0, mult1) : 1;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    if (llvm::CastInst *ci = llvm::dyn_cast<llvm::CastInst>(v)) {
+        llvm::Value *op = ci->getOperand(0);
+        bool known = lGetValueRange(op, minValue, maxValue, multiple, depth + 1);
+        switch (ci->getOpcode()) {
+        case llvm::Instruction::ZExt:
+            if (!known) {
+                int bits = op->getType()->getScalarSizeInBits();
+                if (bits > 16)
+                    return false;
+                *minValue = 0;
+                *maxValue = (1ull << bits) - 1;
+                *multiple = 1;
+            }
+            return true;
+        case llvm::Instruction::SExt:
+            return known;
+        case llvm::Instruction::Trunc:
+            return known &&
+                (*maxValue >> (ci->getType()->getScalarSizeInBits() - 1)) == 0;
+        default:
+            return false;
+        }
+    }
+
+    // Combining elements from two vectors (as is done to broadcast
+    // uniform values) or choosing between them gives values from either.
+    llvm::Value *ops[2] = { NULL, NULL };
+    if (llvm::isa<llvm::InsertElementInst>(v) ||
+        llvm::isa<llvm::ShuffleVectorInst>(v)) {
+        ops[0] = llvm::cast<llvm::Instruction>(v)->getOperand(0);
+        ops[1] = llvm::cast<llvm::Instruction>(v)->getOperand(1);
+    }
+    else if (llvm::SelectInst *si = llvm::dyn_cast<llvm::SelectInst>(v)) {
+        ops[0] = si->getTrueValue();
+        ops[1] = si->getFalseValue();
+    }
+    else
+        return false;
+
+    if (!lGetValueRange(ops[0], minValue, maxValue, multiple, depth + 1) ||
+        !lGetValueRange(ops[1], &min1, &max1, &mult1, depth + 1))
+        return false;
+    lMergeValueRange(minValue, maxValue, multiple, min1, max1, mult1);
+    return true;
+}
+
+
+/** Gathers of 32-bit values where all of the offsets are provably within
+    the first one or two vectors' worth of elements of a variable are
+    implemented by loading those elements with regular vector loads and
+    then permuting them into place with __shuffle_*() or __shuffle2_*().
+    This is only a win on targets where those are done in registers
+    (with vpermd on 8-wide AVX2) rather than through memory, and the
+    variable has to be large enough that the vector loads don't read past
+    its end.  Returns true if the gather was replaced.
+ */
+static bool
+lGatherFromTableToPermute(llvm::CallInst *callInst, llvm::Value *base,
+                          llvm::Value *fullOffsets, llvm::Type *scalarType) {
+    int width = g->target->getVectorWidth();
+    if (g->target->getISA() != Target::AVX2 || width != 8)
+        return false;
+
+    uint64_t minOffset, maxOffset, multiple, objectSize;
+    if (!lGetValueRange(fullOffsets, &minOffset, &maxOffset, &multiple) ||
+        multiple < 4)
+        return false;
+
+    int nVectors = (int)(maxOffset / 4) / width + 1;
+    if (nVectors > 2 || !lGetPointeeObjectSize(base, &objectSize) ||
+        objectSize < (uint64_t)(nVectors * width * 4))
+        return false;
+
+    llvm::Type *vecPtrType = llvm::PointerType::get(callInst->getType(), 0);
+    llvm::Value *table[2];
+    for (int i = 0; i < nVectors; ++i) {
+        llvm::Value *ptr =
+            lGEPInst(base, LLVMInt64((int64_t)i * width * 4), "table_ptr",
+                     callInst);
+        ptr = new llvm::BitCastInst(ptr, vecPtrType, "table_ptr_cast", callInst);
+        table[i] = new llvm::LoadInst(ptr, "table", false /* not volatile */,
+                                      4, callInst);
+        lCopyMetadata(table[i], callInst);
+    }
+
+    // Element indices from the byte offsets.
+    llvm::Value *index;
+    if (fullOffsets->getType() == LLVMTypes::Int64VectorType) {
+        index = llvm::BinaryOperator::Create(llvm::Instruction::LShr, fullOffsets,
+                                             LLVMInt64Vector((int64_t)2),
+                                             "table_index64", callInst);
+        index = new llvm::TruncInst(index, LLVMTypes::Int32VectorType,
+                                    "table_index", callInst);
+    }
+    else
+        index = llvm::BinaryOperator::Create(llvm::Instruction::LShr, fullOffsets,
+                                             LLVMInt32Vector(2), "table_index",
+                                             callInst);
+
+    bool isFloat = (scalarType == LLVMTypes::FloatType);
+    llvm::Instruction *newCall;
+    if (nVectors == 1) {
+        llvm::Function *shuffleFunc =
+            m->module->getFunction(isFloat ? "__shuffle_float" : "__shuffle_i32");
+        Assert(shuffleFunc != NULL);
+        newCall = lCallInst(shuffleFunc, table[0], index, "table_gather");
+    }
+    else {
+        llvm::Function *shuffleFunc =
+            m->module->getFunction(isFloat ? "__shuffle2_float" : "__shuffle2_i32");
+        Assert(shuffleFunc != NULL);
+        newCall = lCallInst(shuffleFunc, table[0], table[1], index,
+                            "table_gather");
+    }
+    lCopyMetadata(newCall, callInst);
+    llvm::ReplaceInstWithInst(callInst, newCall);
+    return true;
+}
+
+
 /** After earlier optimization passes have run, we are sometimes able to
     determine that gathers/scatters are actually accessing memory in a more
     regular fashion and then change the operation to something simpler and
@@ -2787,15 +4582,18 @@ lGetOffsetScaleVec(llvm::Value *offsetScale, llvm::Type *vecType) {
     broadcast.  This pass examines gathers and scatters and tries to
     simplify them if at all possible.
 
-    @todo Currently, this only looks for all program instances going to the
-    same location and all going to a linear sequence of locations in
-    memory.  There are a number of other cases that might make sense to
-    look for, including things that could be handled with a vector load +
-    shuffle or things that could be handled with hybrids of e.g. 2 4-wide
-    vector loads with AVX, etc.
+    If lowerStrided is true, accesses to every 2nd, 3rd, 4th or 8th element
+    of memory (as come up with arrays of small structures, RGB(A) pixels,
+    etc.) are also implemented with vector loads or stores and shuffles.
+    This is only requested after the gather coalescing pass has had a
+    chance to combine such gathers with each other.
+
+    @todo There are a number of other cases that might make sense to look
+    for, including things that could be handled with hybrids of e.g. 2
+    4-wide vector loads with AVX, etc.
 */
 static bool
-lGSToLoadStore(llvm::CallInst *callInst) {
+lGSToLoadStore(llvm::CallInst *callInst, bool lowerStrided) {
     struct GatherImpInfo {
         GatherImpInfo(const char *pName, const char *lmName, llvm::Type *st,
                       int a)
@@ -2986,6 +4784,9 @@ lGSToLoadStore(llvm::CallInst *callInst) {
             // A gather with everyone going to the same location is
             // handled as a scalar load and broadcast across the lanes.
             Debug(pos, "Transformed gather to scalar load and broadcast!");
+            OptRemark(OptRemarkPassed, pos, "ImproveMemoryOps", "GatherToBroadcast",
+                      lFunctionName(callInst).c_str(), "Gather from a single "
+                      "location turned into a scalar load and broadcast.");
 
             ptr = new llvm::BitCastInst(ptr, llvm::PointerType::get(gatherInfo->scalarType, 0),
                                         ptr->getName(), callInst);
@@ -3014,9 +4815,14 @@ lGSToLoadStore(llvm::CallInst *callInst) {
             // A scatter with everyone going to the same location is
             // undefined (if there's more than one program instance in
             // the gang).  Issue a warning.
-            if (g->target->getVectorWidth() > 1)
+            if (g->target->getVectorWidth() > 1) {
                 Warning(pos, "Undefined behavior: all program instances are "
                         "writing to the same location!");
+                OptRemark(OptRemarkMissed, pos, "ImproveMemoryOps",
+                          "ScatterToSameLocation", lFunctionName(callInst).c_str(),
+                          "Scatter not turned into a store: all program "
+                          "instances write to the same location.");
+            }
 
             // We could do something similar to the gather case, where
             // we arbitrarily write one of the values, but we need to
@@ -3030,8 +4836,21 @@ lGSToLoadStore(llvm::CallInst *callInst) {
     }
     else {
         int step = gatherInfo ? gatherInfo->align : scatterInfo->align;
+        int width = g->target->getVectorWidth();
+        bool isLinear = (step > 0 && LLVMVectorIsLinear(fullOffsets, step));
+
+        // Linear indexing into soa<> data gives offsets that are linear
+        // within each soa block; if the blocks are at least as large as
+        // the gang, the access is linear even though LLVMVectorIsLinear()
+        // can't see through the index computations.
+        int64_t laneOffsets[ISPC_MAX_NVEC];
+        int blockSize = 0;
+        if (step > 0 && !isLinear) {
+            blockSize = lLinearBlockSize(fullOffsets, step, laneOffsets);
+            isLinear = (blockSize == width);
+        }
 
-        if (step > 0 && LLVMVectorIsLinear(fullOffsets, step)) {
+        if (isLinear) {
             // We have a linear sequence of memory locations being accessed
             // starting with the location given by the offset from
             // offsetElements[0], with stride of 4 or 8 bytes (for 32 bit
@@ -3041,6 +4860,10 @@ lGSToLoadStore(llvm::CallInst *callInst) {
 
             if (gatherInfo != NULL) {
                 Debug(pos, "Transformed gather to unaligned vector load!");
+                OptRemark(OptRemarkPassed, pos, "ImproveMemoryOps",
+                          "GatherToVectorLoad", lFunctionName(callInst).c_str(),
+                          "Gather from consecutive locations turned into a "
+                          "vector load.");
                 llvm::Instruction *newCall =
                     lCallInst(gatherInfo->loadMaskedFunc, ptr, mask,
                               LLVMGetName(ptr, "_masked_load"));
@@ -3050,6 +4873,10 @@ lGSToLoadStore(llvm::CallInst *callInst) {
             }
             else {
                 Debug(pos, "Transformed scatter to unaligned vector store!");
+                OptRemark(OptRemarkPassed, pos, "ImproveMemoryOps",
+                          "ScatterToVectorStore", lFunctionName(callInst).c_str(),
+                          "Scatter to consecutive locations turned into a "
+                          "vector store.");
                 ptr = new llvm::BitCastInst(ptr, scatterInfo->vecPtrType, "ptrcast",
                                             callInst);
                 llvm::Instruction *newCall =
@@ -3060,6 +4887,93 @@ lGSToLoadStore(llvm::CallInst *callInst) {
                 return true;
             }
         }
+
+        // Masked stores of 8 and 16-bit values are scalarized on all of
+        // the targets, so don't bother for those.
+        if (lowerStrided && step > 0 &&
+            g->opt.disableStridedMemoryOps == false &&
+            (gatherInfo != NULL || step >= 4)) {
+            const int strides[] = { 2, 3, 4, 8 };
+            for (unsigned int i = 0; i < sizeof(strides) / sizeof(strides[0]); ++i) {
+                if (!LLVMVectorIsLinear(fullOffsets, step * strides[i]))
+                    continue;
+
+                llvm::Value *ptr = lComputeCommonPointer(base, fullOffsets, callInst);
+                lCopyMetadata(ptr, callInst);
+
+                if (gatherInfo != NULL) {
+                    Debug(pos, "Transformed stride-%d gather to vector loads!",
+                          strides[i]);
+                    OptRemark(OptRemarkPassed, pos, "ImproveMemoryOps",
+                              "GatherToStridedLoads", lFunctionName(callInst).c_str(),
+                              "Gather with stride %d turned into vector loads "
+                              "and shuffles.", strides[i]);
+                    lStridedLoadStore(callInst, ptr, mask, strides[i], step,
+                                      gatherInfo->loadMaskedFunc, NULL, NULL, NULL);
+                }
+                else {
+                    Debug(pos, "Transformed stride-%d scatter to vector stores!",
+                          strides[i]);
+                    OptRemark(OptRemarkPassed, pos, "ImproveMemoryOps",
+                              "ScatterToStridedStores", lFunctionName(callInst).c_str(),
+                              "Scatter with stride %d turned into shuffles and "
+                              "masked vector stores.", strides[i]);
+                    lStridedLoadStore(callInst, ptr, mask, strides[i], step,
+                                      NULL, storeValue, scatterInfo->maskedStoreFunc,
+                                      scatterInfo->vecPtrType);
+                }
+                return true;
+            }
+        }
+
+        // Otherwise, if the soa blocks are smaller than the gang, issue a
+        // vector load or store for each one.
+        if (lowerStrided && blockSize >= 2 && blockSize < width &&
+            width / blockSize <= 4 && g->opt.disableStridedMemoryOps == false &&
+            (gatherInfo != NULL || step >= 4)) {
+            llvm::Value *ptr = lComputeCommonPointer(base, fullOffsets, callInst);
+            lCopyMetadata(ptr, callInst);
+
+            if (gatherInfo != NULL) {
+                Debug(pos, "Transformed gather to %d-wide block vector loads!",
+                      blockSize);
+                OptRemark(OptRemarkPassed, pos, "ImproveMemoryOps",
+                          "GatherToBlockLoads", lFunctionName(callInst).c_str(),
+                          "Gather from %d blocks of %d consecutive locations "
+                          "turned into vector loads and shuffles.",
+                          width / blockSize, blockSize);
+                lBlockedLoadStore(callInst, ptr, mask, blockSize, laneOffsets,
+                                  gatherInfo->loadMaskedFunc, NULL, NULL, NULL);
+            }
+            else {
+                Debug(pos, "Transformed scatter to %d-wide block vector stores!",
+                      blockSize);
+                OptRemark(OptRemarkPassed, pos, "ImproveMemoryOps",
+                          "ScatterToBlockStores", lFunctionName(callInst).c_str(),
+                          "Scatter to %d blocks of %d consecutive locations "
+                          "turned into shuffles and masked vector stores.",
+                          width / blockSize, blockSize);
+                lBlockedLoadStore(callInst, ptr, mask, blockSize, laneOffsets,
+                                  NULL, storeValue, scatterInfo->maskedStoreFunc,
+                                  scatterInfo->vecPtrType);
+            }
+            return true;
+        }
+
+        if (lowerStrided && step == 4 && gatherInfo != NULL &&
+            g->opt.disableGatherToPermute == false) {
+            // Grab the function name before the gather is replaced.
+            std::string funcName = lFunctionName(callInst);
+            if (lGatherFromTableToPermute(callInst, base, fullOffsets,
+                                          gatherInfo->scalarType)) {
+                Debug(pos, "Transformed gather from small table to permute!");
+                OptRemark(OptRemarkPassed, pos, "ImproveMemoryOps",
+                          "GatherToTablePermute", funcName.c_str(),
+                          "Gather from a small table turned into vector "
+                          "loads and a permute.");
+                return true;
+            }
+        }
         return false;
     }
 }
@@ -3153,18 +5067,72 @@ lImproveMaskedStore(llvm::CallInst *callInst) {
 }
 
 
+/** If the given pointer is a constant offset from the start of a global
+    or local variable, returns true, the offset in bytes in *offset and
+    the size of the variable in *size.
+ */
 static bool
-lImproveMaskedLoad(llvm::CallInst *callInst,
-                   llvm::BasicBlock::iterator iter) {
-    struct MLInfo {
-        MLInfo(const char *name, const int a)
-            : align(a) {
-            func = m->module->getFunction(name);
-            Assert(func != NULL);
-        }
-        llvm::Function *func;
-        const int align;
-    };
+lGetConstantOffsetInObject(llvm::Value *ptr, int64_t *offset, uint64_t *size) {
+    const llvm::DataLayout *dl = g->target->getDataLayout();
+    *offset = 0;
+    ptr = ptr->stripPointerCasts();
+    while (llvm::GetElementPtrInst *gep =
+           llvm::dyn_cast<llvm::GetElementPtrInst>(ptr)) {
+        llvm::Type *type = gep->getPointerOperand()->getType();
+        for (unsigned int i = 1; i < gep->getNumOperands(); ++i) {
+            llvm::ConstantInt *ci =
+                llvm::dyn_cast<llvm::ConstantInt>(gep->getOperand(i));
+            if (ci == NULL)
+                return false;
+            int64_t index = ci->getSExtValue();
+            if (llvm::StructType *st = llvm::dyn_cast<llvm::StructType>(type)) {
+                *offset += dl->getStructLayout(st)->getElementOffset((unsigned)index);
+                type = st->getElementType((unsigned)index);
+                continue;
+            }
+            if (llvm::PointerType *pt = llvm::dyn_cast<llvm::PointerType>(type))
+                type = pt->getElementType();
+            else if (llvm::ArrayType *at = llvm::dyn_cast<llvm::ArrayType>(type))
+                type = at->getElementType();
+            else if (llvm::VectorType *vt = llvm::dyn_cast<llvm::VectorType>(type))
+                type = vt->getElementType();
+            else
+                return false;
+            *offset += index * (int64_t)dl->getTypeAllocSize(type);
+        }
+        ptr = gep->getPointerOperand()->stripPointerCasts();
+    }
+
+    return lGetPointeeObjectSize(ptr, size);
+}
+
+
+/** Returns true if the given pointer is a constant offset from the start
+    of a global or local variable and loading loadSize bytes from it stays
+    within the variable, in which case the load can't fault, regardless of
+    which program instances are active.
+ */
+static bool
+lFullLoadInBounds(llvm::Value *ptr, uint64_t loadSize) {
+    int64_t offset;
+    uint64_t size;
+    return (lGetConstantOffsetInObject(ptr, &offset, &size) && offset >= 0 &&
+            (uint64_t)offset + loadSize <= size);
+}
+
+
+static bool
+lImproveMaskedLoad(llvm::CallInst *callInst,
+                   llvm::BasicBlock::iterator iter) {
+    struct MLInfo {
+        MLInfo(const char *name, const int a)
+            : align(a) {
+            func = m->module->getFunction(name);
+            Assert(func != NULL);
+        }
+        llvm::Function *func;
+        const int align;
+    };
 
     MLInfo mlInfo[] = {
         MLInfo("__masked_load_i8",  1),
@@ -3199,8 +5167,12 @@ lImproveMaskedLoad(llvm::CallInst *callInst,
                                    iter, llvm::UndefValue::get(callInst->getType()));
         return true;
     }
-    else if (maskStatus == ALL_ON) {
-        // The mask is all on, so turn this into a regular load
+    else if (maskStatus == ALL_ON ||
+             lFullLoadInBounds(ptr, g->target->getDataLayout()->getTypeStoreSize(
+                                        callInst->getType()))) {
+        // The mask is all on, or loading all of the lanes is known to be
+        // safe, so turn this into a regular load; the values loaded for
+        // inactive lanes are undefined either way.
         llvm::Type *ptrType = llvm::PointerType::get(callInst->getType(), 0);
         ptr = new llvm::BitCastInst(ptr, ptrType, "ptr_cast_for_load",
                                     callInst);
@@ -3242,7 +5214,7 @@ ImproveMemoryOpsPass::runOnBasicBlock(llvm::BasicBlock &bb) {
             modifiedAny = true;
             goto restart;
         }
-        if (lGSToLoadStore(callInst)) {
+        if (lGSToLoadStore(callInst, lowerStrided)) {
             modifiedAny = true;
             goto restart;
         }
@@ -3263,8 +5235,8 @@ ImproveMemoryOpsPass::runOnBasicBlock(llvm::BasicBlock &bb) {
 
 
 static llvm::Pass *
-CreateImproveMemoryOpsPass() {
-    return new ImproveMemoryOpsPass;
+CreateImproveMemoryOpsPass(bool lowerStrided) {
+    return new ImproveMemoryOpsPass(lowerStrided);
 }
 
 
@@ -3289,18 +5261,24 @@ CreateImproveMemoryOpsPass() {
 //  it's specifically helpful when data with AOS layout is being accessed;
 //  in this case, we're often able to generate wide vector loads and
 //  appropriate shuffles automatically.
+//
+//  Gathers from the basic blocks dominated by the one with the first gather
+//  of a group (e.g. in the arms of an 'if' after it or in later iterations
+//  of a small loop that has been unrolled) are also considered, as long as
+//  there are no writes to memory on any path between them.
 
-class GatherCoalescePass : public llvm::BasicBlockPass {
+class GatherCoalescePass : public llvm::FunctionPass {
 public:
     static char ID;
-    GatherCoalescePass() : BasicBlockPass(ID) { }
+    GatherCoalescePass() : FunctionPass(ID) { }
 
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
     const char *getPassName() const { return "Gather Coalescing"; }
 #else // LLVM 4.0+
     llvm::StringRef getPassName() const { return "Gather Coalescing"; }
 #endif
-    bool runOnBasicBlock(llvm::BasicBlock &BB);
+    void getAnalysisUsage(llvm::AnalysisUsage &AU) const { AU.setPreservesCFG(); }
+    bool runOnFunction(llvm::Function &F);
 };
 
 char GatherCoalescePass::ID = 0;
@@ -3542,15 +5520,18 @@ lCoalescePerfInfo(const std::vector<llvm::CallInst *> &coalesceGroup,
             strcat(loadOpsInfo, ", ");
     }
 
+    std::string funcName = lFunctionName(coalesceGroup[0]);
     if (coalesceGroup.size() == 1)
-        PerformanceWarning(pos, "Coalesced gather into %d load%s (%s).",
-                           (int)loadOps.size(),
-                           (loadOps.size() > 1) ? "s" : "", loadOpsInfo);
+        PerformanceRemark(OptRemarkPassed, pos, "GatherCoalesce", "CoalescedGather",
+                          funcName.c_str(), "Coalesced gather into %d load%s (%s).",
+                          (int)loadOps.size(),
+                          (loadOps.size() > 1) ? "s" : "", loadOpsInfo);
     else
-        PerformanceWarning(pos, "Coalesced %d gathers starting here %sinto %d "
-                           "load%s (%s).", (int)coalesceGroup.size(),
-                           otherPositions,(int)loadOps.size(),
-                           (loadOps.size() > 1) ? "s" : "", loadOpsInfo);
+        PerformanceRemark(OptRemarkPassed, pos, "GatherCoalesce", "CoalescedGather",
+                          funcName.c_str(), "Coalesced %d gathers starting here %sinto %d "
+                          "load%s (%s).", (int)coalesceGroup.size(),
+                          otherPositions,(int)loadOps.size(),
+                          (loadOps.size() > 1) ? "s" : "", loadOpsInfo);
 }
 
 
@@ -4039,7 +6020,7 @@ lComputeBasePtr(llvm::CallInst *gatherInst, llvm::Instruction *insertBefore) {
     llvm::Value *offsetScale = gatherInst->getArgOperand(2);
 
     // All of the variable offsets values should be the same, due to
-    // checking for this in GatherCoalescePass::runOnBasicBlock().  Thus,
+    // checking for this in lCoalesceGathersInBlock().  Thus,
     // extract the first value and use that as a scalar.
     llvm::Value *variable = LLVMExtractFirstVectorElement(variableOffsets);
     if (variable->getType() == LLVMTypes::Int64Type)
@@ -4193,8 +6174,268 @@ lInstructionMayWriteToMemory(llvm::Instruction *inst) {
 }
 
 
-bool
-GatherCoalescePass::runOnBasicBlock(llvm::BasicBlock &bb) {
+/** Returns true if the given gather has the same base pointer, varying
+    offsets, offset scale and mask as the initial gather in a coalescing
+    group (and can thus be coalesced with it). */
+static bool
+lGathersMatch(llvm::CallInst *first, llvm::CallInst *candidate) {
+    SourcePos candidatePos;
+    bool ok = lGetSourcePosFromMetadata(candidate, &candidatePos);
+    Assert(ok);
+
+    llvm::Value *base = first->getArgOperand(0);
+    llvm::Value *variableOffsets = first->getArgOperand(1);
+    llvm::Value *offsetScale = first->getArgOperand(2);
+    llvm::Value *mask = first->getArgOperand(4);
+
+    if (g->debugPrint) {
+        if (base != candidate->getArgOperand(0)) {
+            Debug(candidatePos, "base pointers mismatch");
+            LLVMDumpValue(base);
+            LLVMDumpValue(candidate->getArgOperand(0));
+        }
+        if (variableOffsets != candidate->getArgOperand(1)) {
+            Debug(candidatePos, "varying offsets mismatch");
+            LLVMDumpValue(variableOffsets);
+            LLVMDumpValue(candidate->getArgOperand(1));
+        }
+        if (offsetScale != candidate->getArgOperand(2)) {
+            Debug(candidatePos, "offset scales mismatch");
+            LLVMDumpValue(offsetScale);
+            LLVMDumpValue(candidate->getArgOperand(2));
+        }
+        if (mask != candidate->getArgOperand(4)) {
+            Debug(candidatePos, "masks mismatch");
+            LLVMDumpValue(mask);
+            LLVMDumpValue(candidate->getArgOperand(4));
+        }
+    }
+
+    if (base == candidate->getArgOperand(0) &&
+        variableOffsets == candidate->getArgOperand(1) &&
+        offsetScale == candidate->getArgOperand(2) &&
+        mask == candidate->getArgOperand(4)) {
+        Debug(candidatePos, "This gather can be coalesced.");
+        return true;
+    }
+    else {
+        Debug(candidatePos, "This gather doesn't match the initial one.");
+        return false;
+    }
+}
+
+
+// FIXME: untested heuristic: don't try to coalesce over a window of more
+// than 4 gathers, so that we don't cause too much register pressure and
+// end up spilling to memory anyway.
+static const int MAX_COALESCE_GROUP_SIZE = 4;
+
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
+
+/** When a gather from another basic block is coalesced with the initial
+    gather, its loads are issued where the initial gather is, even on
+    paths where the other gather wouldn't have executed, so they must not
+    be able to fault there.  This returns true if every element that the
+    candidate gather reads lies within the range of memory spanned by the
+    gathers in the initial gather's block (from the lowest constant offset
+    to the end of the element at the highest one; these all read from the
+    same base pointer, so the range is within the object they access), or
+    if the gathers' addresses are constant offsets into a global or local
+    variable and all of the candidate's elements are inside it.
+ */
+static bool
+lSpeculativeGatherIsSafe(const std::vector<llvm::CallInst *> &blockGathers,
+                         llvm::CallInst *candidate) {
+    const llvm::DataLayout *dl = g->target->getDataLayout();
+    llvm::Type *elementType =
+        llvm::cast<llvm::VectorType>(candidate->getType())->getElementType();
+    int64_t elementSize = (int64_t)dl->getTypeStoreSize(elementType);
+
+    int64_t candidateOffsets[ISPC_MAX_NVEC];
+    int nCandidate;
+    if (!LLVMExtractVectorInts(candidate->getArgOperand(3), candidateOffsets,
+                               &nCandidate))
+        return false;
+    int64_t candidateMin = candidateOffsets[0];
+    int64_t candidateMax = candidateOffsets[0];
+    for (int i = 1; i < nCandidate; ++i) {
+        candidateMin = std::min(candidateMin, candidateOffsets[i]);
+        candidateMax = std::max(candidateMax, candidateOffsets[i]);
+    }
+
+    bool haveRange = false;
+    int64_t coveredMin = 0, coveredMax = 0;
+    for (unsigned int i = 0; i < blockGathers.size(); ++i) {
+        int64_t offsets[ISPC_MAX_NVEC];
+        int nOffsets;
+        if (!LLVMExtractVectorInts(blockGathers[i]->getArgOperand(3), offsets,
+                                   &nOffsets))
+            continue;
+        for (int j = 0; j < nOffsets; ++j) {
+            if (!haveRange) {
+                coveredMin = coveredMax = offsets[j];
+                haveRange = true;
+            }
+            coveredMin = std::min(coveredMin, offsets[j]);
+            coveredMax = std::max(coveredMax, offsets[j]);
+        }
+    }
+    if (haveRange && candidateMin >= coveredMin && candidateMax <= coveredMax)
+        return true;
+
+    // Otherwise, see if the addresses are known to be inside a variable.
+    // This requires the varying offsets to be constant as well.
+    int64_t varyingOffsets[ISPC_MAX_NVEC];
+    int nVarying;
+    llvm::ConstantInt *scale =
+        llvm::dyn_cast<llvm::ConstantInt>(candidate->getArgOperand(2));
+    if (scale == NULL ||
+        !LLVMExtractVectorInts(candidate->getArgOperand(1), varyingOffsets,
+                               &nVarying))
+        return false;
+    int64_t baseOffset;
+    uint64_t size;
+    if (!lGetConstantOffsetInObject(candidate->getArgOperand(0), &baseOffset,
+                                    &size))
+        return false;
+    for (int i = 0; i < nCandidate && i < nVarying; ++i) {
+        int64_t offset = baseOffset + varyingOffsets[i] * scale->getSExtValue() +
+            candidateOffsets[i];
+        if (offset < 0 || (uint64_t)(offset + elementSize) > size)
+            return false;
+    }
+    return true;
+}
+
+
+/** Returns true if none of the instructions in the given basic block may
+    write to memory.  The results are cached in the given map. */
+static bool
+lBlockIsWriteFree(llvm::BasicBlock *bb,
+                  std::map<llvm::BasicBlock *, bool> &writeFreeCache) {
+    std::map<llvm::BasicBlock *, bool>::iterator iter = writeFreeCache.find(bb);
+    if (iter != writeFreeCache.end())
+        return iter->second;
+
+    bool writeFree = true;
+    for (llvm::BasicBlock::iterator inst = bb->begin(); inst != bb->end(); ++inst)
+        if (lInstructionMayWriteToMemory(&*inst)) {
+            writeFree = false;
+            break;
+        }
+    writeFreeCache[bb] = writeFree;
+    return writeFree;
+}
+
+
+/** Given a basic block 'from' that dominates the basic block 'to', returns
+    true if there are no writes to memory in any of the blocks strictly
+    between them on any path from the end of 'from' to the start of 'to'
+    (that doesn't go through 'from' again, which would re-execute the
+    initial gather.)  Returns false if 'to' is in a cycle that doesn't
+    include 'from', since a gather in 'to' may then run more than once for
+    each execution of the initial gather.
+ */
+static bool
+lPathsAreWriteFree(llvm::BasicBlock *from, llvm::BasicBlock *to,
+                   std::map<llvm::BasicBlock *, bool> &writeFreeCache) {
+    // Walk backward from 'to'; since 'from' dominates it, all of the paths
+    // end at 'from'.
+    std::set<llvm::BasicBlock *> visited;
+    std::vector<llvm::BasicBlock *> worklist;
+    worklist.push_back(to);
+    while (!worklist.empty()) {
+        llvm::BasicBlock *bb = worklist.back();
+        worklist.pop_back();
+        for (llvm::pred_iterator pi = llvm::pred_begin(bb), pe = llvm::pred_end(bb);
+             pi != pe; ++pi) {
+            llvm::BasicBlock *pred = *pi;
+            if (pred == from)
+                continue;
+            if (pred == to)
+                return false;
+            if (visited.find(pred) != visited.end())
+                continue;
+            if (!lBlockIsWriteFree(pred, writeFreeCache))
+                return false;
+            visited.insert(pred);
+            worklist.push_back(pred);
+        }
+    }
+    return true;
+}
+
+
+/** Adds gathers from the basic blocks dominated by the block of the
+    initial gather in coalesceGroup to the group when they can be
+    coalesced with it.  This is only called if there are no writes to
+    memory after the initial gather in its basic block. */
+static void
+lFindDominatedGathers(llvm::DominatorTree &dt,
+                      std::vector<llvm::CallInst *> &coalesceGroup) {
+    llvm::CallInst *first = coalesceGroup[0];
+    llvm::BasicBlock *firstBlock = first->getParent();
+    llvm::Function *calledFunc = first->getCalledFunction();
+    std::map<llvm::BasicBlock *, bool> writeFreeCache;
+    // The gathers from the initial gather's block, which always execute.
+    const std::vector<llvm::CallInst *> blockGathers = coalesceGroup;
+
+    // Visit the dominated blocks in depth-first order over the dominator
+    // tree, so that gathers closer to the initial one are considered
+    // first.
+    std::vector<llvm::DomTreeNode *> worklist;
+    llvm::DomTreeNode *firstNode = dt.getNode(firstBlock);
+    for (llvm::DomTreeNode::iterator child = firstNode->begin();
+         child != firstNode->end(); ++child)
+        worklist.push_back(*child);
+
+    while (!worklist.empty() &&
+           (int)coalesceGroup.size() < MAX_COALESCE_GROUP_SIZE) {
+        llvm::DomTreeNode *node = worklist.back();
+        worklist.pop_back();
+        llvm::BasicBlock *bb = node->getBlock();
+
+        if (!lPathsAreWriteFree(firstBlock, bb, writeFreeCache))
+            // Neither this block nor the ones it dominates are reachable
+            // without an intervening write.
+            continue;
+
+        bool sawWrite = false;
+        for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end();
+             ++iter) {
+            if (lInstructionMayWriteToMemory(&*iter)) {
+                sawWrite = true;
+                break;
+            }
+
+            llvm::CallInst *callInst = llvm::dyn_cast<llvm::CallInst>(&*iter);
+            if (callInst == NULL || callInst->getCalledFunction() != calledFunc)
+                continue;
+
+            if (lGathersMatch(first, callInst) &&
+                lSpeculativeGatherIsSafe(blockGathers, callInst)) {
+                coalesceGroup.push_back(callInst);
+                if ((int)coalesceGroup.size() == MAX_COALESCE_GROUP_SIZE)
+                    return;
+            }
+        }
+
+        if (!sawWrite)
+            for (llvm::DomTreeNode::iterator child = node->begin();
+                 child != node->end(); ++child)
+                worklist.push_back(*child);
+    }
+}
+
+#endif // LLVM 3.5+
+
+
+/** Looks for gathers in the given basic block that can be coalesced,
+    either with other gathers in the same block or (if a dominator tree is
+    provided) with gathers in blocks that it dominates.  Returns true if
+    any were coalesced. */
+static bool
+lCoalesceGathersInBlock(llvm::BasicBlock &bb, void *domTree) {
     DEBUG_START_PASS("GatherCoalescePass");
 
     llvm::Function *gatherFuncs[] = {
@@ -4232,9 +6473,7 @@ GatherCoalescePass::runOnBasicBlock(llvm::BasicBlock &bb) {
         lGetSourcePosFromMetadata(callInst, &pos);
         Debug(pos, "Checking for coalescable gathers starting here...");
 
-        llvm::Value *base = callInst->getArgOperand(0);
         llvm::Value *variableOffsets = callInst->getArgOperand(1);
-        llvm::Value *offsetScale = callInst->getArgOperand(2);
         llvm::Value *mask = callInst->getArgOperand(4);
 
         // To apply this optimization, we need a set of one or more gathers
@@ -4266,63 +6505,37 @@ GatherCoalescePass::runOnBasicBlock(llvm::BasicBlock &bb) {
         // gathers that can coalesce with this one.
         llvm::BasicBlock::iterator fwdIter = iter;
         ++fwdIter;
+        bool sawWrite = false;
         for (; fwdIter != bb.end(); ++fwdIter) {
             // Must stop once we come to an instruction that may write to
             // memory; otherwise we could end up moving a read before this
             // write.
-            if (lInstructionMayWriteToMemory(&*fwdIter))
+            if (lInstructionMayWriteToMemory(&*fwdIter)) {
+                sawWrite = true;
                 break;
+            }
 
             llvm::CallInst *fwdCall = llvm::dyn_cast<llvm::CallInst>(&*fwdIter);
             if (fwdCall == NULL ||
                 fwdCall->getCalledFunction() != calledFunc)
                 continue;
 
-            SourcePos fwdPos;
-            bool ok = lGetSourcePosFromMetadata(fwdCall, &fwdPos);
-            Assert(ok);
-
-            if (g->debugPrint) {
-                if (base != fwdCall->getArgOperand(0)) {
-                    Debug(fwdPos, "base pointers mismatch");
-                    LLVMDumpValue(base);
-                    LLVMDumpValue(fwdCall->getArgOperand(0));
-                }
-                if (variableOffsets != fwdCall->getArgOperand(1)) {
-                    Debug(fwdPos, "varying offsets mismatch");
-                    LLVMDumpValue(variableOffsets);
-                    LLVMDumpValue(fwdCall->getArgOperand(1));
-                }
-                if (offsetScale != fwdCall->getArgOperand(2)) {
-                    Debug(fwdPos, "offset scales mismatch");
-                    LLVMDumpValue(offsetScale);
-                    LLVMDumpValue(fwdCall->getArgOperand(2));
-                }
-                if (mask != fwdCall->getArgOperand(4)) {
-                    Debug(fwdPos, "masks mismatch");
-                    LLVMDumpValue(mask);
-                    LLVMDumpValue(fwdCall->getArgOperand(4));
-                }
-            }
-
-            if (base == fwdCall->getArgOperand(0) &&
-                variableOffsets == fwdCall->getArgOperand(1) &&
-                offsetScale == fwdCall->getArgOperand(2) &&
-                mask == fwdCall->getArgOperand(4)) {
-                Debug(fwdPos, "This gather can be coalesced.");
+            if (lGathersMatch(callInst, fwdCall)) {
                 coalesceGroup.push_back(fwdCall);
-
-                if (coalesceGroup.size() == 4)
-                    // FIXME: untested heuristic: don't try to coalesce
-                    // over a window of more than 4 gathers, so that we
-                    // don't cause too much register pressure and end up
-                    // spilling to memory anyway.
+                if ((int)coalesceGroup.size() == MAX_COALESCE_GROUP_SIZE)
                     break;
             }
-            else
-                Debug(fwdPos, "This gather doesn't match the initial one.");
         }
 
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
+        // If nothing after the gather in this block writes to memory, the
+        // gathers in the blocks it dominates may be coalesced with it as
+        // well.
+        if (domTree != NULL && !sawWrite &&
+            (int)coalesceGroup.size() < MAX_COALESCE_GROUP_SIZE)
+            lFindDominatedGathers(*(llvm::DominatorTree *)domTree, coalesceGroup);
+#endif
+
         Debug(pos, "Done with checking for matching gathers");
 
         // Now that we have a group of gathers, see if we can coalesce them
@@ -4339,12 +6552,732 @@ GatherCoalescePass::runOnBasicBlock(llvm::BasicBlock &bb) {
 }
 
 
+bool
+GatherCoalescePass::runOnFunction(llvm::Function &func) {
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
+    // Coalescing only adds instructions; it never changes the CFG, so the
+    // dominator tree stays valid throughout.
+    llvm::DominatorTree domTree;
+    domTree.recalculate(func);
+    void *dt = &domTree;
+#else
+    void *dt = NULL;
+#endif
+
+    bool modifiedAny = false;
+    for (llvm::Function::iterator bb = func.begin(); bb != func.end(); ++bb)
+        modifiedAny |= lCoalesceGathersInBlock(*bb, dt);
+    return modifiedAny;
+}
+
+
 static llvm::Pass *
 CreateGatherCoalescePass() {
     return new GatherCoalescePass;
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+// ScatterCoalescePass
+
+/** This pass is the store-side counterpart of GatherCoalescePass: it looks
+    for groups of scatters of 32-bit values that have the same base
+    pointer and uniform varying offsets, an "all on" mask, and compile-time
+    constant offsets from there.  (These come up for example when the
+    members of a varying struct are written to an array of uniform structs,
+    as in "out[index].x = ...; out[index].y = ...;".)
+
+    If the combined offsets of the group cover a small number of
+    contiguous, vector-width-sized chunks of memory, the scatters are
+    replaced with shuffles that assemble the values for each chunk and a
+    masked vector store for each chunk; the mask for a chunk is all on if
+    the scatters write every element of it, in which case later passes
+    turn it into a regular vector store.
+ */
+class ScatterCoalescePass : public llvm::BasicBlockPass {
+public:
+    static char ID;
+    ScatterCoalescePass() : BasicBlockPass(ID) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Scatter Coalescing"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Scatter Coalescing"; }
+#endif
+    bool runOnBasicBlock(llvm::BasicBlock &BB);
+};
+
+char ScatterCoalescePass::ID = 0;
+
+
+/** Replaces the given group of scatters, all with the same base pointer,
+    varying offsets and offset scale and with an all-on mask, with
+    shuffles and masked vector stores, if their constant offsets allow.
+    The new stores are emitted at the position of the last scatter in the
+    group.  Returns true if the scatters were replaced. */
+static bool
+lCoalesceScatters(const std::vector<llvm::CallInst *> &coalesceGroup) {
+    int width = g->target->getVectorWidth();
+    int nScatters = (int)coalesceGroup.size();
+    llvm::CallInst *last = coalesceGroup.back();
+
+    llvm::Type *valueType = last->getArgOperand(4)->getType();
+    const int elementSize = 4;
+    Assert(valueType == LLVMTypes::Int32VectorType ||
+           valueType == LLVMTypes::FloatVectorType);
+
+    // Gather up the constant offsets of all of the scatters, in units of
+    // elements, and figure out which scatter and lane writes each
+    // location.
+    std::map<int64_t, std::pair<int, int> > writers;
+    for (int i = 0; i < nScatters; ++i) {
+        int64_t offsets[ISPC_MAX_NVEC];
+        int nElts;
+        if (!LLVMExtractVectorInts(coalesceGroup[i]->getArgOperand(3), offsets,
+                                   &nElts))
+            return false;
+        Assert(nElts == width);
+
+        for (int lane = 0; lane < width; ++lane) {
+            if ((offsets[lane] % elementSize) != 0)
+                return false;
+            int64_t offset = offsets[lane] / elementSize;
+            if (writers.find(offset) != writers.end())
+                // Multiple writes to the same location; leave it to the
+                // scatters to get the ordering right.
+                return false;
+            writers[offset] = std::make_pair(i, lane);
+        }
+    }
+
+    // Split the range of written locations into vector-width chunks
+    // starting at the lowest offset; only do the transformation if that
+    // doesn't need more stores than there were scatters.
+    int64_t startOffset = writers.begin()->first;
+    std::set<int64_t> chunks;
+    for (std::map<int64_t, std::pair<int, int> >::iterator iter = writers.begin();
+         iter != writers.end(); ++iter)
+        chunks.insert((iter->first - startOffset) / width);
+    if ((int)chunks.size() > nScatters)
+        return false;
+
+    SourcePos pos;
+    lGetSourcePosFromMetadata(coalesceGroup[0], &pos);
+    PerformanceRemark(OptRemarkPassed, pos, "ScatterCoalesce", "CoalescedScatter",
+                      lFunctionName(last).c_str(), "Coalesced %d scatter%s into "
+                      "%d vector store%s.", nScatters, (nScatters > 1) ? "s" : "",
+                      (int)chunks.size(), (chunks.size() > 1) ? "s" : "");
+
+    // Compute the base pointer shared by all of the scatters, as done for
+    // gathers by lComputeBasePtr().
+    llvm::Value *basePtr = lComputeBasePtr(last, last);
+    llvm::Type *vecPtrType = (valueType == LLVMTypes::Int32VectorType) ?
+        LLVMTypes::Int32VectorPointerType : LLVMTypes::FloatVectorPointerType;
+    llvm::Function *maskedStoreFunc =
+        m->module->getFunction((valueType == LLVMTypes::Int32VectorType) ?
+                               "__pseudo_masked_store_i32" :
+                               "__pseudo_masked_store_float");
+    Assert(maskedStoreFunc != NULL);
+
+    for (std::set<int64_t>::iterator iter = chunks.begin(); iter != chunks.end();
+         ++iter) {
+        int64_t chunkStart = startOffset + *iter * width;
+
+        // Assemble the value to store with a shuffle for each scatter that
+        // contributes elements to this chunk.
+        llvm::Value *value = llvm::UndefValue::get(valueType);
+        bool maskOn[ISPC_MAX_NVEC];
+        for (int lane = 0; lane < width; ++lane)
+            maskOn[lane] = writers.find(chunkStart + lane) != writers.end();
+
+        for (int i = 0; i < nScatters; ++i) {
+            int32_t shuffle[ISPC_MAX_NVEC];
+            bool used = false;
+            for (int lane = 0; lane < width; ++lane) {
+                std::map<int64_t, std::pair<int, int> >::iterator w =
+                    writers.find(chunkStart + lane);
+                if (w != writers.end() && w->second.first == i) {
+                    shuffle[lane] = width + w->second.second;
+                    used = true;
+                }
+                else
+                    shuffle[lane] = lane;
+            }
+            if (used)
+                value = LLVMShuffleVectors(value, coalesceGroup[i]->getArgOperand(4),
+                                           shuffle, width, last);
+        }
+
+        llvm::Value *ptr = lGEPInst(basePtr, LLVMInt64(chunkStart * elementSize),
+                                    "chunk_ptr", last);
+        ptr = new llvm::BitCastInst(ptr, vecPtrType, "chunk_ptr_cast", last);
+        llvm::Instruction *store =
+            lCallInst(maskedStoreFunc, ptr, value, LLVMBoolVector(maskOn), "", last);
+        lCopyMetadata(store, last);
+    }
+
+    for (int i = 0; i < nScatters; ++i)
+        coalesceGroup[i]->eraseFromParent();
+
+    return true;
+}
+
+
+bool
+ScatterCoalescePass::runOnBasicBlock(llvm::BasicBlock &bb) {
+    DEBUG_START_PASS("ScatterCoalescePass");
+
+    llvm::Function *scatterFuncs[] = {
+        m->module->getFunction("__pseudo_scatter_factored_base_offsets32_i32"),
+        m->module->getFunction("__pseudo_scatter_factored_base_offsets32_float"),
+        m->module->getFunction("__pseudo_scatter_factored_base_offsets64_i32"),
+        m->module->getFunction("__pseudo_scatter_factored_base_offsets64_float"),
+    };
+    int nScatterFuncs = sizeof(scatterFuncs) / sizeof(scatterFuncs[0]);
+
+    bool modifiedAny = false;
+
+ restart:
+    for (llvm::BasicBlock::iterator iter = bb.begin(), e = bb.end(); iter != e;
+         ++iter) {
+        llvm::CallInst *callInst = llvm::dyn_cast<llvm::CallInst>(&*iter);
+        if (callInst == NULL)
+            continue;
+
+        llvm::Function *calledFunc = callInst->getCalledFunction();
+        if (calledFunc == NULL)
+            continue;
+
+        int i;
+        for (i = 0; i < nScatterFuncs; ++i)
+            if (scatterFuncs[i] != NULL && calledFunc == scatterFuncs[i])
+                break;
+        if (i == nScatterFuncs)
+            continue;
+
+        llvm::Value *base = callInst->getArgOperand(0);
+        llvm::Value *variableOffsets = callInst->getArgOperand(1);
+        llvm::Value *offsetScale = callInst->getArgOperand(2);
+        llvm::Value *mask = callInst->getArgOperand(5);
+
+        if (lGetMaskStatus(mask) != ALL_ON ||
+            !LLVMVectorValuesAllEqual(variableOffsets))
+            continue;
+
+        std::vector<llvm::CallInst *> coalesceGroup;
+        coalesceGroup.push_back(callInst);
+
+        // Find the following scatters that match this one.  Since the
+        // stores will be done at the position of the last scatter of the
+        // group, we have to stop at any other instruction that may access
+        // memory.
+        llvm::BasicBlock::iterator fwdIter = iter;
+        ++fwdIter;
+        for (; fwdIter != bb.end(); ++fwdIter) {
+            llvm::CallInst *fwdCall = llvm::dyn_cast<llvm::CallInst>(&*fwdIter);
+            if (fwdCall != NULL && fwdCall->getCalledFunction() == calledFunc &&
+                base == fwdCall->getArgOperand(0) &&
+                variableOffsets == fwdCall->getArgOperand(1) &&
+                offsetScale == fwdCall->getArgOperand(2) &&
+                mask == fwdCall->getArgOperand(5)) {
+                coalesceGroup.push_back(fwdCall);
+                if ((int)coalesceGroup.size() == MAX_COALESCE_GROUP_SIZE)
+                    break;
+            }
+            else if (fwdIter->mayReadOrWriteMemory())
+                break;
+        }
+
+        if (lCoalesceScatters(coalesceGroup)) {
+            modifiedAny = true;
+            goto restart;
+        }
+    }
+
+    DEBUG_END_PASS("ScatterCoalescePass");
+
+    return modifiedAny;
+}
+
+
+static llvm::Pass *
+CreateScatterCoalescePass() {
+    return new ScatterCoalescePass;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// PrefetchGathersPass
+
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_5 // LLVM 3.5+
+/** This pass inserts software prefetches for gathers whose offsets are
+    computed from indices that come from a regular vector load in a loop,
+    as in "foreach (j = 0 ... n) { ... x[col[j]] ... }".  The address of
+    the index load is a linear function of the loop's induction variable,
+    so the pass loads the indices that will be used a few iterations
+    later and issues a prefetch of the locations that they will gather
+    from.  The prefetch itself goes through the __pseudo_prefetch_*
+    machinery, so targets with vector prefetch instructions (KNL's
+    AVX-512PF) get a single instruction.
+
+    Loading indices ahead of the current iteration must never read past
+    what the loop itself would read; the pass only handles loops whose
+    induction variable is compared against a bound that dominates the
+    gather, and clamps the "ahead" value of the induction variable to lie
+    between its current value and the last full vector before that
+    bound.
+
+    The distance, in loop iterations, is given by --opt=prefetch-gathers=<n>;
+    without a distance, one that prefetches roughly 64 indices ahead is
+    used.
+ */
+class PrefetchGathersPass : public llvm::FunctionPass {
+public:
+    static char ID;
+    PrefetchGathersPass() : FunctionPass(ID) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Prefetch Gathers"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Prefetch Gathers"; }
+#endif
+    bool runOnFunction(llvm::Function &func);
+};
+
+char PrefetchGathersPass::ID = 0;
+
+
+/** Returns the given PHI node's step if it's an induction variable
+    incremented by a positive compile-time constant on its back edge;
+    returns 0 otherwise.  If non-NULL, the add instruction that computes
+    the next value is returned in *next. */
+static int64_t
+lInductionStep(llvm::PHINode *phi, llvm::BinaryOperator **next) {
+    if (phi->getNumIncomingValues() != 2 ||
+        llvm::isa<llvm::IntegerType>(phi->getType()) == false)
+        return 0;
+
+    for (int i = 0; i < 2; ++i) {
+        llvm::BinaryOperator *add =
+            llvm::dyn_cast<llvm::BinaryOperator>(phi->getIncomingValue(i));
+        if (add == NULL || add->getOpcode() != llvm::Instruction::Add ||
+            add->getOperand(0) != phi)
+            continue;
+        llvm::ConstantInt *step =
+            llvm::dyn_cast<llvm::ConstantInt>(add->getOperand(1));
+        if (step == NULL || step->getSExtValue() <= 0)
+            continue;
+        if (next != NULL)
+            *next = add;
+        return step->getSExtValue();
+    }
+    return 0;
+}
+
+
+/** Walks up the operands of the given value to find an induction
+    variable that it depends on.  Returns NULL if none is found within a
+    few levels. */
+static llvm::PHINode *
+lFindInductionVariable(llvm::Value *v, int depth = 0) {
+    if (depth > 12)
+        return NULL;
+
+    llvm::PHINode *phi = llvm::dyn_cast<llvm::PHINode>(v);
+    if (phi != NULL)
+        return (lInductionStep(phi, NULL) > 0) ? phi : NULL;
+
+    llvm::Instruction *inst = llvm::dyn_cast<llvm::Instruction>(v);
+    if (inst == NULL || llvm::isa<llvm::LoadInst>(inst) ||
+        llvm::isa<llvm::CallInst>(inst))
+        return NULL;
+
+    for (unsigned int i = 0; i < inst->getNumOperands(); ++i) {
+        llvm::PHINode *iv = lFindInductionVariable(inst->getOperand(i), depth + 1);
+        if (iv != NULL)
+            return iv;
+    }
+    return NULL;
+}
+
+
+/** Checks whether the value v depends on the value "root" only through
+    instructions that compute an affine function of it (integer adds,
+    subtracts, multiplies and shifts, casts, GEPs, and vector element
+    insertion, extraction and broadcasts), where every other operand is
+    independent of root.  If "affineOnly" is false, any cast, binary
+    operator or select is accepted along the way.
+
+    Returns 1 if v depends on root and the instructions in between have
+    been appended to chain in def-before-use order, 0 if v doesn't depend
+    on root, and -1 if it depends on it in some other way. */
+static int
+lGetDependenceChain(llvm::Value *v, llvm::Value *root, bool affineOnly,
+                    std::vector<llvm::Instruction *> &chain, int depth = 0) {
+    if (v == root)
+        return 1;
+    if (std::find(chain.begin(), chain.end(), v) != chain.end())
+        return 1;
+
+    llvm::Instruction *inst = llvm::dyn_cast<llvm::Instruction>(v);
+    if (inst == NULL)
+        return 0;
+    if (depth > 12)
+        return -1;
+
+    bool ok;
+    if (llvm::isa<llvm::GetElementPtrInst>(inst) ||
+        llvm::isa<llvm::InsertElementInst>(inst) ||
+        llvm::isa<llvm::ExtractElementInst>(inst) ||
+        llvm::isa<llvm::ShuffleVectorInst>(inst))
+        ok = true;
+    else if (llvm::CastInst *cast = llvm::dyn_cast<llvm::CastInst>(inst))
+        ok = (affineOnly == false || cast->getOpcode() != llvm::Instruction::Trunc);
+    else if (llvm::BinaryOperator *bop = llvm::dyn_cast<llvm::BinaryOperator>(inst)) {
+        llvm::Instruction::BinaryOps op = bop->getOpcode();
+        ok = (affineOnly == false || op == llvm::Instruction::Add ||
+              op == llvm::Instruction::Sub || op == llvm::Instruction::Mul ||
+              op == llvm::Instruction::Shl);
+    }
+    else
+        ok = (affineOnly == false && llvm::isa<llvm::SelectInst>(inst));
+
+    // Anything else can't be looked through.  Values loaded or computed
+    // by calls are assumed to be invariant for the offsets (getting them
+    // slightly wrong only costs a useless prefetch), but the address of
+    // the index load must be exact.
+    if (ok == false) {
+        if (affineOnly == false &&
+            (llvm::isa<llvm::PHINode>(inst) || llvm::isa<llvm::LoadInst>(inst) ||
+             llvm::isa<llvm::CallInst>(inst)))
+            return 0;
+        if (affineOnly && (llvm::isa<llvm::LoadInst>(inst) ||
+                           llvm::isa<llvm::CallInst>(inst))) {
+            std::vector<llvm::Instruction *> scratch;
+            for (unsigned int i = 0; i < inst->getNumOperands(); ++i)
+                if (lGetDependenceChain(inst->getOperand(i), root, false,
+                                        scratch, depth + 1) != 0)
+                    return -1;
+            return 0;
+        }
+        return -1;
+    }
+
+    int nDependent = 0;
+    for (unsigned int i = 0; i < inst->getNumOperands(); ++i) {
+        int dep = lGetDependenceChain(inst->getOperand(i), root, affineOnly,
+                                      chain, depth + 1);
+        if (dep < 0)
+            return -1;
+        nDependent += dep;
+    }
+    if (nDependent == 0)
+        return 0;
+    // Something like "iv * iv" isn't affine.
+    if (affineOnly && nDependent > 1 &&
+        llvm::isa<llvm::BinaryOperator>(inst) &&
+        llvm::cast<llvm::BinaryOperator>(inst)->getOpcode() != llvm::Instruction::Add &&
+        llvm::cast<llvm::BinaryOperator>(inst)->getOpcode() != llvm::Instruction::Sub)
+        return -1;
+
+    chain.push_back(inst);
+    return 1;
+}
+
+
+/** Finds a comparison of the given induction variable (or of its next
+    value) against a bound that dominates "before", of the form "iv < bound"
+    with a signed comparison.  Returns the bound, or NULL if there is no
+    such comparison. */
+static llvm::Value *
+lFindInductionBound(llvm::PHINode *iv, llvm::BinaryOperator *next,
+                    llvm::Instruction *before, llvm::DominatorTree &dt) {
+    llvm::Value *candidates[2] = { iv, next };
+    for (int c = 0; c < 2; ++c) {
+        for (llvm::Value::user_iterator ui = candidates[c]->user_begin();
+             ui != candidates[c]->user_end(); ++ui) {
+            llvm::ICmpInst *cmp = llvm::dyn_cast<llvm::ICmpInst>(*ui);
+            if (cmp == NULL)
+                continue;
+
+            llvm::Value *bound = NULL;
+            llvm::CmpInst::Predicate pred = cmp->getPredicate();
+            if (cmp->getOperand(0) == candidates[c] &&
+                pred == llvm::CmpInst::ICMP_SLT)
+                bound = cmp->getOperand(1);
+            else if (cmp->getOperand(1) == candidates[c] &&
+                     pred == llvm::CmpInst::ICMP_SGT)
+                bound = cmp->getOperand(0);
+            if (bound == NULL)
+                continue;
+
+            llvm::Instruction *boundInst = llvm::dyn_cast<llvm::Instruction>(bound);
+            if (boundInst != NULL && dt.dominates(boundInst, before) == false)
+                continue;
+            if (llvm::isa<llvm::Constant>(bound) == false &&
+                llvm::isa<llvm::Argument>(bound) == false && boundInst == NULL)
+                continue;
+
+            return bound;
+        }
+    }
+    return NULL;
+}
+
+
+/** Clones the instructions in chain, which must be in def-before-use
+    order, before insertBefore, replacing operands with the values given
+    in valueMap.  The clones are added to valueMap as well. */
+static void
+lCloneChain(const std::vector<llvm::Instruction *> &chain,
+            std::map<llvm::Value *, llvm::Value *> &valueMap,
+            llvm::Instruction *insertBefore) {
+    for (int i = 0; i < (int)chain.size(); ++i) {
+        llvm::Instruction *clone = chain[i]->clone();
+        for (unsigned int j = 0; j < clone->getNumOperands(); ++j) {
+            std::map<llvm::Value *, llvm::Value *>::iterator iter =
+                valueMap.find(clone->getOperand(j));
+            if (iter != valueMap.end())
+                clone->setOperand(j, iter->second);
+        }
+        clone->setName(LLVMGetName(chain[i], "_ahead"));
+        clone->insertBefore(insertBefore);
+        valueMap[chain[i]] = clone;
+    }
+}
+
+
+/** Broadcasts the given scalar value across a vector of the given type,
+    inserting the instructions before insertBefore. */
+static llvm::Value *
+lSmearForPrefetch(llvm::Value *value, llvm::Type *vecType,
+                  llvm::Instruction *insertBefore) {
+    llvm::Value *insertVec =
+        llvm::InsertElementInst::Create(llvm::UndefValue::get(vecType), value,
+                                        LLVMInt32(0), "smear", insertBefore);
+    llvm::Value *zeroMask = llvm::ConstantVector::getSplat(
+        vecType->getVectorNumElements(),
+        llvm::Constant::getNullValue(llvm::Type::getInt32Ty(*g->ctx)));
+    return new llvm::ShuffleVectorInst(insertVec, llvm::UndefValue::get(vecType),
+                                       zeroMask, "smear", insertBefore);
+}
+
+
+static int
+lPrefetchDistance() {
+    if (g->opt.prefetchGatherDistance > 0)
+        return g->opt.prefetchGatherDistance;
+    int width = g->target->getVectorWidth();
+    return std::max(2, 64 / width);
+}
+
+
+/** Tries to insert a prefetch for the given gather; offsetsIndex is the
+    operand that holds the offsets (or pointers) and constOffsetsIndex the
+    one with the constant offsets, or -1 if there are none; scaleIndex is
+    similarly the operand with the offset scale, or -1. */
+static bool
+lPrefetchGather(llvm::CallInst *gather, int offsetsIndex, int scaleIndex,
+                int constOffsetsIndex, llvm::DominatorTree &dt) {
+    // Find the vector load of the indices that the offsets are computed
+    // from, and make sure that everything in between can be recomputed.
+    llvm::Value *offsets = gather->getArgOperand(offsetsIndex);
+    llvm::LoadInst *indexLoad = NULL;
+    llvm::Value *v = offsets;
+    for (int depth = 0; depth < 8 && indexLoad == NULL; ++depth) {
+        if ((indexLoad = llvm::dyn_cast<llvm::LoadInst>(v)) != NULL)
+            break;
+        llvm::Instruction *inst = llvm::dyn_cast<llvm::Instruction>(v);
+        if (inst == NULL ||
+            (llvm::isa<llvm::CastInst>(inst) == false &&
+             llvm::isa<llvm::BinaryOperator>(inst) == false))
+            return false;
+        // Follow the operand that isn't a constant.
+        v = llvm::isa<llvm::Constant>(inst->getOperand(0)) ?
+            inst->getOperand(inst->getNumOperands() - 1) : inst->getOperand(0);
+    }
+    if (indexLoad == NULL || indexLoad->isVolatile() ||
+        llvm::isa<llvm::VectorType>(indexLoad->getType()) == false)
+        return false;
+
+    std::vector<llvm::Instruction *> offsetsChain;
+    if (lGetDependenceChain(offsets, indexLoad, false, offsetsChain) != 1)
+        return false;
+    std::vector<llvm::Instruction *> constOffsetsChain;
+    if (constOffsetsIndex >= 0 &&
+        lGetDependenceChain(gather->getArgOperand(constOffsetsIndex), indexLoad,
+                            false, constOffsetsChain) < 0)
+        return false;
+
+    // The index load's address must be an affine function of an induction
+    // variable.
+    llvm::Value *indexPtr = indexLoad->getPointerOperand();
+    llvm::PHINode *iv = lFindInductionVariable(indexPtr);
+    if (iv == NULL)
+        return false;
+    llvm::BinaryOperator *next = NULL;
+    int64_t step = lInductionStep(iv, &next);
+    std::vector<llvm::Instruction *> ptrChain;
+    if (lGetDependenceChain(indexPtr, iv, true, ptrChain) != 1)
+        return false;
+
+    llvm::Value *bound = lFindInductionBound(iv, next, gather, dt);
+    if (bound == NULL)
+        return false;
+
+    // ahead = max(min(iv + distance * step, bound - step), iv); the
+    // comparisons are signed, so that a bound smaller than the step or
+    // an overflowing iv + distance * step both leave us at iv.
+    llvm::Type *ivType = iv->getType();
+    llvm::CmpInst::Predicate lt = llvm::CmpInst::ICMP_SLT;
+    llvm::Value *aheadIV =
+        llvm::BinaryOperator::Create(llvm::Instruction::Add, iv,
+                                     LLVMIntAsType(lPrefetchDistance() * step, ivType),
+                                     "iv_ahead", gather);
+    llvm::Value *lastIV =
+        llvm::BinaryOperator::Create(llvm::Instruction::Sub, bound,
+                                     LLVMIntAsType(step, ivType), "iv_last", gather);
+    llvm::Value *beforeLast =
+        llvm::CmpInst::Create(llvm::Instruction::ICmp, lt, aheadIV, lastIV,
+                              "ahead_before_last", gather);
+    aheadIV = llvm::SelectInst::Create(beforeLast, aheadIV, lastIV,
+                                       "iv_ahead_clamped", gather);
+    llvm::Value *afterCurrent =
+        llvm::CmpInst::Create(llvm::Instruction::ICmp, lt, iv, aheadIV,
+                              "ahead_after_current", gather);
+    aheadIV = llvm::SelectInst::Create(afterCurrent, aheadIV, iv, "iv_ahead_clamped",
+                                       gather);
+
+    // Recompute the index load's address, the indices, and the offsets
+    // for the later iteration.
+    std::map<llvm::Value *, llvm::Value *> valueMap;
+    valueMap[iv] = aheadIV;
+    lCloneChain(ptrChain, valueMap, gather);
+    llvm::LoadInst *aheadLoad =
+        new llvm::LoadInst(valueMap[indexPtr], LLVMGetName(indexLoad, "_ahead"),
+                           gather);
+    aheadLoad->setAlignment(indexLoad->getAlignment());
+    valueMap[indexLoad] = aheadLoad;
+    lCloneChain(offsetsChain, valueMap, gather);
+    lCloneChain(constOffsetsChain, valueMap, gather);
+
+    // Compute the addresses that the gather will access in that
+    // iteration: base + offsets * scale [+ constant offsets].
+    llvm::Value *addresses = valueMap[offsets];
+    if (scaleIndex >= 0) {
+        llvm::Value *scale = gather->getArgOperand(scaleIndex);
+        llvm::Type *offsetType = addresses->getType()->getScalarType();
+        if (scale->getType() != offsetType)
+            scale = new llvm::SExtInst(scale, offsetType, "scale_ext", gather);
+        addresses = llvm::BinaryOperator::Create(
+            llvm::Instruction::Mul, addresses,
+            lSmearForPrefetch(scale, addresses->getType(), gather),
+            "offsets_scaled", gather);
+    }
+    if (constOffsetsIndex >= 0) {
+        llvm::Value *constOffsets = gather->getArgOperand(constOffsetsIndex);
+        if (valueMap.find(constOffsets) != valueMap.end())
+            constOffsets = valueMap[constOffsets];
+        addresses = llvm::BinaryOperator::Create(llvm::Instruction::Add, addresses,
+                                                 constOffsets, "offsets_ahead", gather);
+    }
+    if (scaleIndex >= 0) {
+        if (addresses->getType() != LLVMTypes::Int64VectorType)
+            addresses = new llvm::SExtInst(addresses, LLVMTypes::Int64VectorType,
+                                           "offsets64", gather);
+        llvm::Value *base =
+            new llvm::PtrToIntInst(gather->getArgOperand(0), LLVMTypes::Int64Type,
+                                   "base_int", gather);
+        addresses = llvm::BinaryOperator::Create(
+            llvm::Instruction::Add,
+            lSmearForPrefetch(base, LLVMTypes::Int64VectorType, gather),
+            addresses, "prefetch_addr", gather);
+    }
+    else if (addresses->getType() != LLVMTypes::Int64VectorType)
+        // 32-bit pointers
+        addresses = new llvm::ZExtInst(addresses, LLVMTypes::Int64VectorType,
+                                       "prefetch_addr", gather);
+
+    llvm::Function *prefetchFunc =
+        m->module->getFunction("__pseudo_prefetch_read_varying_1");
+    Assert(prefetchFunc != NULL);
+    llvm::Value *mask = gather->getArgOperand(gather->getNumArgOperands() - 1);
+    llvm::Instruction *prefetch = lCallInst(prefetchFunc, addresses, mask, "", gather);
+    lCopyMetadata(prefetch, gather);
+
+    SourcePos pos;
+    lGetSourcePosFromMetadata(gather, &pos);
+    OptRemark(OptRemarkPassed, pos, "PrefetchGathers", "PrefetchedGather",
+              lFunctionName(gather).c_str(), "Prefetching gather %d loop "
+              "iteration%s ahead.", lPrefetchDistance(),
+              (lPrefetchDistance() > 1) ? "s" : "");
+    return true;
+}
+
+
+bool
+PrefetchGathersPass::runOnFunction(llvm::Function &func) {
+    llvm::DominatorTree domTree;
+    domTree.recalculate(func);
+
+    const char *types[] = { "i8", "i16", "i32", "float", "i64", "double" };
+    const int nTypes = sizeof(types) / sizeof(types[0]);
+
+    // The gathers handled, with the operand numbers of their offsets,
+    // of the offset scale, and of the constant offsets.
+    struct GatherFuncs {
+        const char *prefix;
+        int offsetsIndex, scaleIndex, constOffsetsIndex;
+    };
+    GatherFuncs gatherFuncs[] = {
+        { "__pseudo_gather_factored_base_offsets32_", 1, 2, 3 },
+        { "__pseudo_gather_factored_base_offsets64_", 1, 2, 3 },
+        { "__pseudo_gather_base_offsets32_", 2, 1, -1 },
+        { "__pseudo_gather_base_offsets64_", 2, 1, -1 },
+        { "__pseudo_gather32_", 0, -1, -1 },
+        { "__pseudo_gather64_", 0, -1, -1 },
+    };
+    const int nGatherFuncs = sizeof(gatherFuncs) / sizeof(gatherFuncs[0]);
+
+    std::map<llvm::Function *, GatherFuncs *> funcs;
+    for (int i = 0; i < nGatherFuncs; ++i)
+        for (int j = 0; j < nTypes; ++j) {
+            std::string name = std::string(gatherFuncs[i].prefix) + types[j];
+            llvm::Function *f = m->module->getFunction(name);
+            if (f != NULL)
+                funcs[f] = &gatherFuncs[i];
+        }
+
+    // Collect the gathers first, since we'll be adding instructions.
+    std::vector<std::pair<llvm::CallInst *, GatherFuncs *> > gathers;
+    for (llvm::Function::iterator bb = func.begin(); bb != func.end(); ++bb)
+        for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end(); ++iter) {
+            llvm::CallInst *callInst = llvm::dyn_cast<llvm::CallInst>(&*iter);
+            if (callInst == NULL || callInst->getCalledFunction() == NULL)
+                continue;
+            std::map<llvm::Function *, GatherFuncs *>::iterator fi =
+                funcs.find(callInst->getCalledFunction());
+            if (fi != funcs.end())
+                gathers.push_back(std::make_pair(callInst, fi->second));
+        }
+
+    bool modifiedAny = false;
+    for (int i = 0; i < (int)gathers.size(); ++i)
+        modifiedAny |= lPrefetchGather(gathers[i].first, gathers[i].second->offsetsIndex,
+                                       gathers[i].second->scaleIndex,
+                                       gathers[i].second->constOffsetsIndex, domTree);
+
+    return modifiedAny;
+}
+
+
+static llvm::Pass *
+CreatePrefetchGathersPass() {
+    return new PrefetchGathersPass;
+}
+#endif // LLVM 3.5+
+
+
 ///////////////////////////////////////////////////////////////////////////
 // ReplacePseudoMemoryOpsPass
 
@@ -4630,81 +7563,468 @@ lReplacePseudoGS(llvm::CallInst *callInst) {
         LowerGSInfo("__pseudo_prefetch_read_varying_2_native",
                     "__prefetch_read_varying_2_native", false, true),
 
-        LowerGSInfo("__pseudo_prefetch_read_varying_3",
-                    "__prefetch_read_varying_3", false, true),
-        LowerGSInfo("__pseudo_prefetch_read_varying_3_native",
-                    "__prefetch_read_varying_3_native", false, true),
+        LowerGSInfo("__pseudo_prefetch_read_varying_3",
+                    "__prefetch_read_varying_3", false, true),
+        LowerGSInfo("__pseudo_prefetch_read_varying_3_native",
+                    "__prefetch_read_varying_3_native", false, true),
+
+        LowerGSInfo("__pseudo_prefetch_read_varying_nt",
+                    "__prefetch_read_varying_nt", false, true),
+        LowerGSInfo("__pseudo_prefetch_read_varying_nt_native",
+                    "__prefetch_read_varying_nt_native", false, true),
+    };
+
+    llvm::Function *calledFunc = callInst->getCalledFunction();
+
+    LowerGSInfo *info = NULL;
+    for (unsigned int i = 0; i < sizeof(lgsInfo) / sizeof(lgsInfo[0]); ++i) {
+        if (lgsInfo[i].pseudoFunc != NULL &&
+            calledFunc == lgsInfo[i].pseudoFunc) {
+            info = &lgsInfo[i];
+            break;
+        }
+    }
+    if (info == NULL)
+        return false;
+
+    Assert(info->actualFunc != NULL);
+
+    // Get the source position from the metadata attached to the call
+    // instruction so that we can issue PerformanceWarning()s below.
+    SourcePos pos;
+    bool gotPosition = lGetSourcePosFromMetadata(callInst, &pos);
+
+    // Figure out why the gather or scatter couldn't be turned into
+    // something better: if it's still in the general form, then no
+    // uniform base pointer was found for the addresses; otherwise the
+    // offsets from it weren't all the same or consecutive.
+    const char *reason;
+    if (g->opt.disableGatherScatterOptimizations)
+        reason = "gather/scatter optimizations are disabled";
+    else if (strstr(info->pseudoFunc->getName().str().c_str(), "base_offsets") == NULL)
+        reason = "no common uniform base pointer was found for the addresses";
+    else
+        reason = "the offsets from the base pointer are neither equal nor "
+            "consecutive across the program instances";
+
+    callInst->setCalledFunction(info->actualFunc);
+    if (gotPosition && g->target->getVectorWidth() > 1) {
+        std::string funcName = lFunctionName(callInst);
+        if (info->isGather)
+            PerformanceRemark(OptRemarkMissed, pos, "ReplacePseudoMemoryOps",
+                              "Gather", funcName.c_str(),
+                              "Gather required to load value (%s).", reason);
+        else if (!info->isPrefetch)
+            PerformanceRemark(OptRemarkMissed, pos, "ReplacePseudoMemoryOps",
+                              "Scatter", funcName.c_str(),
+                              "Scatter required to store value (%s).", reason);
+    }
+    return true;
+}
+
+
+bool
+ReplacePseudoMemoryOpsPass::runOnBasicBlock(llvm::BasicBlock &bb) {
+    DEBUG_START_PASS("ReplacePseudoMemoryOpsPass");
+
+    bool modifiedAny = false;
+
+ restart:
+    for (llvm::BasicBlock::iterator iter = bb.begin(), e = bb.end(); iter != e; ++iter) {
+        llvm::CallInst *callInst = llvm::dyn_cast<llvm::CallInst>(&*iter);
+        if (callInst == NULL ||
+            callInst->getCalledFunction() == NULL)
+            continue;
+
+        if (lReplacePseudoGS(callInst)) {
+            modifiedAny = true;
+            goto restart;
+        }
+        else if (lReplacePseudoMaskedStore(callInst)) {
+            modifiedAny = true;
+            goto restart;
+        }
+    }
+
+    DEBUG_END_PASS("ReplacePseudoMemoryOpsPass");
+
+    return modifiedAny;
+}
+
+
+static llvm::Pass *
+CreateReplacePseudoMemoryOpsPass() {
+    return new ReplacePseudoMemoryOpsPass;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// SpecializeConstantArgsPass
+
+/** Functions that take uniform parameters like a channel count or a mode
+    enum are often called with compile-time constant values for them.  If
+    the function is inlined, the constants propagate into its body, but
+    for larger functions that the inliner leaves alone, the body is left
+    generic.  This pass makes a copy of such a function for each distinct
+    combination of constant uniform arguments that it's called with, with
+    those parameters replaced by the constants, and has the call sites
+    call that copy instead.  Later passes can then unroll loops over the
+    constant trip count, remove switches on the constant, and so forth.
+
+    Functions that are 'inline' (and so will be inlined anyway) and very
+    small ones are left alone, and the number of copies made of each
+    function is limited.
+ */
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_3 // LLVM 3.3+
+class SpecializeConstantArgsPass : public llvm::ModulePass {
+public:
+    static char ID;
+    SpecializeConstantArgsPass() : ModulePass(ID) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Specialize Constant Arguments"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Specialize Constant Arguments"; }
+#endif
+    bool runOnModule(llvm::Module &m);
+
+private:
+    /** Functions with fewer instructions than this are left to the
+        inliner. */
+    static const int MIN_FUNCTION_SIZE = 32;
+    /** Functions with more instructions than this aren't copied. */
+    static const int MAX_FUNCTION_SIZE = 4096;
+    /** Maximum number of specialized copies of any one function. */
+    static const int MAX_SPECIALIZATIONS = 8;
+};
+
+char SpecializeConstantArgsPass::ID = 0;
+
+
+/** Returns true if the given function is a candidate for specialization. */
+static bool
+lCanSpecialize(llvm::Function *func, int minSize, int maxSize) {
+    if (func == NULL || func->isDeclaration() || func->isVarArg() ||
+        func->hasFnAttribute(llvm::Attribute::AlwaysInline) ||
+        func->getName().startswith("__"))
+        return false;
+
+    int size = 0;
+    for (llvm::Function::iterator bb = func->begin(); bb != func->end(); ++bb)
+        size += (int)bb->size();
+    return size >= minSize && size <= maxSize;
+}
+
+
+bool
+SpecializeConstantArgsPass::runOnModule(llvm::Module &module) {
+    // Find the calls to candidate functions with constant uniform
+    // arguments first, since we'll be adding functions to the module.
+    std::vector<llvm::CallInst *> calls;
+    std::map<llvm::Function *, bool> candidates;
+    for (llvm::Module::iterator fi = module.begin(); fi != module.end(); ++fi)
+        for (llvm::Function::iterator bb = fi->begin(); bb != fi->end(); ++bb)
+            for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end(); ++iter) {
+                llvm::CallInst *callInst = llvm::dyn_cast<llvm::CallInst>(&*iter);
+                if (callInst == NULL)
+                    continue;
+                llvm::Function *callee = callInst->getCalledFunction();
+                if (callee == NULL)
+                    continue;
+                if (candidates.find(callee) == candidates.end())
+                    candidates[callee] = lCanSpecialize(callee, MIN_FUNCTION_SIZE,
+                                                        MAX_FUNCTION_SIZE);
+                if (candidates[callee] == false)
+                    continue;
+
+                for (unsigned int i = 0; i < callInst->getNumArgOperands(); ++i) {
+                    llvm::Value *arg = callInst->getArgOperand(i);
+                    if (llvm::isa<llvm::ConstantInt>(arg) ||
+                        llvm::isa<llvm::ConstantFP>(arg)) {
+                        calls.push_back(callInst);
+                        break;
+                    }
+                }
+            }
+
+    // The constant arguments, or NULL for the ones that aren't constant,
+    // identify a specialization.
+    typedef std::pair<llvm::Function *, std::vector<llvm::Constant *> > SpecKey;
+    std::map<SpecKey, llvm::Function *> specializations;
+    std::map<llvm::Function *, int> numSpecializations;
+    bool modifiedAny = false;
+
+    for (int i = 0; i < (int)calls.size(); ++i) {
+        llvm::CallInst *callInst = calls[i];
+        llvm::Function *callee = callInst->getCalledFunction();
+
+        SpecKey key(callee, std::vector<llvm::Constant *>());
+        for (unsigned int j = 0; j < callInst->getNumArgOperands(); ++j) {
+            llvm::Value *arg = callInst->getArgOperand(j);
+            if (llvm::isa<llvm::ConstantInt>(arg) || llvm::isa<llvm::ConstantFP>(arg))
+                key.second.push_back(llvm::cast<llvm::Constant>(arg));
+            else
+                key.second.push_back(NULL);
+        }
+
+        llvm::Function *spec = NULL;
+        std::map<SpecKey, llvm::Function *>::iterator si = specializations.find(key);
+        if (si != specializations.end())
+            spec = si->second;
+        else {
+            if (numSpecializations[callee] == MAX_SPECIALIZATIONS)
+                continue;
+            ++numSpecializations[callee];
+
+            // Mapping the parameters to the constants makes CloneFunction
+            // drop them from the copy's parameter list.
+            llvm::ValueToValueMapTy vmap;
+            int j = 0;
+            for (llvm::Function::arg_iterator ai = callee->arg_begin();
+                 ai != callee->arg_end(); ++ai, ++j)
+                if (key.second[j] != NULL)
+                    vmap[&*ai] = key.second[j];
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_8
+            spec = llvm::CloneFunction(callee, vmap, false);
+            module.getFunctionList().push_back(spec);
+#else // LLVM 3.9+
+            spec = llvm::CloneFunction(callee, vmap);
+#endif
+            spec->setName(callee->getName() + "___spec");
+            spec->setLinkage(llvm::GlobalValue::InternalLinkage);
+            specializations[key] = spec;
+        }
+
+        std::vector<llvm::Value *> args;
+        for (unsigned int j = 0; j < callInst->getNumArgOperands(); ++j)
+            if (key.second[j] == NULL)
+                args.push_back(callInst->getArgOperand(j));
+        llvm::CallInst *newCall =
+            llvm::CallInst::Create(spec, args, "", callInst);
+        newCall->setCallingConv(callInst->getCallingConv());
+        newCall->setTailCall(callInst->isTailCall());
+        lCopyMetadata(newCall, callInst);
+        newCall->takeName(callInst);
+        callInst->replaceAllUsesWith(newCall);
+
+        SourcePos pos;
+        lGetSourcePosFromMetadata(callInst, &pos);
+        OptRemark(OptRemarkPassed, pos, "SpecializeConstantArgs", "Specialized",
+                  lFunctionName(callInst).c_str(), "Calling copy of \"%s\" "
+                  "specialized for constant arguments.", callee->getName().str().c_str());
+
+        callInst->eraseFromParent();
+        modifiedAny = true;
+    }
+
+    return modifiedAny;
+}
+
+
+static llvm::Pass *
+CreateSpecializeConstantArgsPass() {
+    return new SpecializeConstantArgsPass;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// AllOnClonesPass
+
+/** A function that isn't inlined runs with the mask that its caller
+    passes as its last parameter, so its whole body uses masked stores,
+    blends and the like, even though most calls are made with all of the
+    program instances active.  This pass makes an "all on" copy of such
+    functions, with the mask parameter replaced by an all-on mask, so that
+    the mask-all-on optimizations in IntrinsicsOpt and elsewhere apply
+    throughout the copy.  Calls with a mask that is known to be all on
+    call the copy directly; calls with a mask that isn't known at compile
+    time check it and call the copy if it's all on and the original
+    function otherwise.
+
+    The same size limits as for SpecializeConstantArgsPass apply.
+ */
+class AllOnClonesPass : public llvm::ModulePass {
+public:
+    static char ID;
+    AllOnClonesPass() : ModulePass(ID) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "All-On Clones"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "All-On Clones"; }
+#endif
+    bool runOnModule(llvm::Module &m);
 
-        LowerGSInfo("__pseudo_prefetch_read_varying_nt",
-                    "__prefetch_read_varying_nt", false, true),
-        LowerGSInfo("__pseudo_prefetch_read_varying_nt_native",
-                    "__prefetch_read_varying_nt_native", false, true),
-    };
+private:
+    static const int MIN_FUNCTION_SIZE = 32;
+    static const int MAX_FUNCTION_SIZE = 4096;
+};
 
-    llvm::Function *calledFunc = callInst->getCalledFunction();
+char AllOnClonesPass::ID = 0;
 
-    LowerGSInfo *info = NULL;
-    for (unsigned int i = 0; i < sizeof(lgsInfo) / sizeof(lgsInfo[0]); ++i) {
-        if (lgsInfo[i].pseudoFunc != NULL &&
-            calledFunc == lgsInfo[i].pseudoFunc) {
-            info = &lgsInfo[i];
-            break;
-        }
-    }
-    if (info == NULL)
-        return false;
 
-    Assert(info->actualFunc != NULL);
+/** Returns the given function's mask parameter, or NULL if it doesn't
+    have one. */
+static llvm::Argument *
+lGetMaskParameter(llvm::Function *func) {
+    if (func->arg_empty())
+        return NULL;
+    llvm::Function::arg_iterator last = func->arg_end();
+    --last;
+    if (last->getType() != LLVMTypes::MaskType || last->getName() != "__mask")
+        return NULL;
+    return &*last;
+}
 
-    // Get the source position from the metadata attached to the call
-    // instruction so that we can issue PerformanceWarning()s below.
-    SourcePos pos;
-    bool gotPosition = lGetSourcePosFromMetadata(callInst, &pos);
 
-    callInst->setCalledFunction(info->actualFunc);
-    if (gotPosition && g->target->getVectorWidth() > 1) {
-        if (info->isGather)
-            PerformanceWarning(pos, "Gather required to load value.");
-        else if (!info->isPrefetch)
-            PerformanceWarning(pos, "Scatter required to store value.");
-    }
-    return true;
+/** Replaces the given call, whose mask isn't known at compile time, with
+    a check of the mask (using the target's __all() builtin, allFunc) and
+    calls to either the all-on clone or the original function. */
+static llvm::Value *
+lEmitAllOnCheck(llvm::CallInst *callInst, llvm::Function *clone,
+                const std::vector<llvm::Value *> &cloneArgs,
+                llvm::Function *allFunc) {
+    llvm::Value *mask =
+        callInst->getArgOperand(callInst->getNumArgOperands() - 1);
+    llvm::BasicBlock *bb = callInst->getParent();
+    llvm::Function *func = bb->getParent();
+    llvm::BasicBlock *tail = bb->splitBasicBlock(callInst, "allon_done");
+    llvm::BasicBlock *allOnBB =
+        llvm::BasicBlock::Create(*g->ctx, "allon_call", func, tail);
+    llvm::BasicBlock *mixedBB =
+        llvm::BasicBlock::Create(*g->ctx, "mixed_call", func, tail);
+
+    // __all() is the target's movmsk-based test (and is inlined later),
+    // rather than a compare of the whole mask as one wide integer, which
+    // the code generators handle poorly for the wider masks.
+    bb->getTerminator()->eraseFromParent();
+    llvm::Value *allOn =
+        llvm::CallInst::Create(allFunc, mask, "mask_all_on", bb);
+    llvm::BranchInst::Create(allOnBB, mixedBB, allOn, bb);
+
+    llvm::CallInst *newCall =
+        llvm::CallInst::Create(clone, cloneArgs, "", allOnBB);
+    newCall->setCallingConv(callInst->getCallingConv());
+    lCopyMetadata(newCall, callInst);
+    llvm::BranchInst::Create(tail, allOnBB);
+
+    llvm::BranchInst *mixedBr = llvm::BranchInst::Create(tail, mixedBB);
+    callInst->moveBefore(mixedBr);
+
+    if (callInst->getType()->isVoidTy())
+        return NULL;
+    llvm::PHINode *phi = llvm::PHINode::Create(callInst->getType(), 2,
+                                               callInst->getName(), &*tail->begin());
+    callInst->replaceAllUsesWith(phi);
+    phi->addIncoming(newCall, allOnBB);
+    phi->addIncoming(callInst, mixedBB);
+    return phi;
 }
 
 
 bool
-ReplacePseudoMemoryOpsPass::runOnBasicBlock(llvm::BasicBlock &bb) {
-    DEBUG_START_PASS("ReplacePseudoMemoryOpsPass");
-
+AllOnClonesPass::runOnModule(llvm::Module &module) {
+    std::vector<llvm::CallInst *> calls;
+    for (llvm::Module::iterator fi = module.begin(); fi != module.end(); ++fi)
+        for (llvm::Function::iterator bb = fi->begin(); bb != fi->end(); ++bb)
+            for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end(); ++iter)
+                if (llvm::CallInst *callInst = llvm::dyn_cast<llvm::CallInst>(&*iter))
+                    calls.push_back(callInst);
+
+    std::map<llvm::Function *, bool> candidates;
+    std::map<llvm::Function *, llvm::Function *> clones;
     bool modifiedAny = false;
+    // Calls whose mask isn't known at compile time can only be handled if
+    // the builtin that checks it is still around.
+    llvm::Function *allFunc = module.getFunction("__all");
+
+    // The calls in the clones are added to the worklist as the clones are
+    // made, so that calls from all-on code reach all-on code, too.
+    for (int i = 0; i < (int)calls.size(); ++i) {
+        llvm::CallInst *callInst = calls[i];
+        llvm::Function *callee = callInst->getCalledFunction();
+        if (callee == NULL)
+            continue;
+        if (candidates.find(callee) == candidates.end())
+            candidates[callee] = lCanSpecialize(callee, MIN_FUNCTION_SIZE,
+                                                MAX_FUNCTION_SIZE) &&
+                lGetMaskParameter(callee) != NULL;
+        if (candidates[callee] == false)
+            continue;
 
- restart:
-    for (llvm::BasicBlock::iterator iter = bb.begin(), e = bb.end(); iter != e; ++iter) {
-        llvm::CallInst *callInst = llvm::dyn_cast<llvm::CallInst>(&*iter);
-        if (callInst == NULL ||
-            callInst->getCalledFunction() == NULL)
+        llvm::Value *mask =
+            callInst->getArgOperand(callInst->getNumArgOperands() - 1);
+        MaskStatus maskStatus = lGetMaskStatus(mask);
+        if (maskStatus == ALL_OFF || maskStatus == MIXED ||
+            (maskStatus != ALL_ON && allFunc == NULL))
             continue;
 
-        if (lReplacePseudoGS(callInst)) {
-            modifiedAny = true;
-            goto restart;
+        llvm::Function *clone = clones[callee];
+        if (clone == NULL) {
+            // Mapping the mask to the all-on value makes CloneFunction
+            // drop it from the copy's parameter list.
+            llvm::ValueToValueMapTy vmap;
+            vmap[lGetMaskParameter(callee)] = LLVMMaskAllOn;
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_8
+            clone = llvm::CloneFunction(callee, vmap, false);
+            module.getFunctionList().push_back(clone);
+#else // LLVM 3.9+
+            clone = llvm::CloneFunction(callee, vmap);
+#endif
+            clone->setName(callee->getName() + "___allon");
+            clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+            clones[callee] = clone;
+            // Calls to the clone itself never come up, since it doesn't
+            // have a mask parameter.
+            candidates[clone] = false;
+
+            for (llvm::Function::iterator bb = clone->begin(); bb != clone->end(); ++bb)
+                for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end(); ++iter)
+                    if (llvm::CallInst *ci = llvm::dyn_cast<llvm::CallInst>(&*iter))
+                        calls.push_back(ci);
         }
-        else if (lReplacePseudoMaskedStore(callInst)) {
-            modifiedAny = true;
-            goto restart;
+
+        std::vector<llvm::Value *> args;
+        for (unsigned int j = 0; j < callInst->getNumArgOperands() - 1; ++j)
+            args.push_back(callInst->getArgOperand(j));
+
+        SourcePos pos;
+        lGetSourcePosFromMetadata(callInst, &pos);
+        std::string caller = lFunctionName(callInst);
+
+        if (maskStatus == ALL_ON) {
+            llvm::CallInst *newCall =
+                llvm::CallInst::Create(clone, args, "", callInst);
+            newCall->setCallingConv(callInst->getCallingConv());
+            newCall->setTailCall(callInst->isTailCall());
+            lCopyMetadata(newCall, callInst);
+            newCall->takeName(callInst);
+            callInst->replaceAllUsesWith(newCall);
+            callInst->eraseFromParent();
+            OptRemark(OptRemarkPassed, pos, "AllOnClones", "Clone",
+                      caller.c_str(), "Calling all-on copy of \"%s\".",
+                      callee->getName().str().c_str());
+        }
+        else {
+            lEmitAllOnCheck(callInst, clone, args, allFunc);
+            OptRemark(OptRemarkPassed, pos, "AllOnClones", "CheckedClone",
+                      caller.c_str(), "Calling all-on copy of \"%s\" when "
+                      "the mask is all on at runtime.",
+                      callee->getName().str().c_str());
         }
+        modifiedAny = true;
     }
 
-    DEBUG_END_PASS("ReplacePseudoMemoryOpsPass");
-
     return modifiedAny;
 }
 
 
 static llvm::Pass *
-CreateReplacePseudoMemoryOpsPass() {
-    return new ReplacePseudoMemoryOpsPass;
+CreateAllOnClonesPass() {
+    return new AllOnClonesPass;
 }
+#endif // LLVM 3.3+
 
 
 ///////////////////////////////////////////////////////////////////////////
@@ -4983,6 +8303,375 @@ CreateMakeInternalFuncsStaticPass() {
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+// LocalsToScratchPass
+
+/** Large local variables, such as varying arrays, make for large stack
+    frames, which may overflow the stacks of the threads that run tasks
+    and touch many pages of memory.  With --opt=scratch-locals=<n>, this
+    pass replaces the stack allocations of more than <n> bytes with
+    thread-local global variables, which are allocated once per thread
+    and reused by each call.  This is only safe in functions that can't be
+    called again on the same thread before they return, so it's only done
+    for functions that can't reach themselves through calls: that don't
+    call themselves, directly or indirectly, and that don't make any
+    calls through function pointers or to functions outside of the module
+    other than ispc's builtins (which may call back into ispc code, as
+    ISPCSync() may run tasks on the calling thread).
+ */
+class LocalsToScratchPass : public llvm::ModulePass {
+public:
+    static char ID;
+    LocalsToScratchPass() : ModulePass(ID) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Locals To Scratch"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Locals To Scratch"; }
+#endif
+    bool runOnModule(llvm::Module &m);
+
+private:
+    bool canReenter(llvm::Function *func);
+    std::map<llvm::Function *, bool> reentrant;
+};
+
+char LocalsToScratchPass::ID = 0;
+
+
+/** Returns true if the given function may be called again while it's
+    running on the same thread, per the rules described above. */
+bool
+LocalsToScratchPass::canReenter(llvm::Function *func) {
+    std::map<llvm::Function *, bool>::iterator iter = reentrant.find(func);
+    if (iter != reentrant.end())
+        return iter->second;
+
+    // Walk the functions that func calls; it's reentrant if we find it
+    // again, or find a call that we can't follow.
+    std::set<llvm::Function *> seen;
+    std::vector<llvm::Function *> worklist;
+    worklist.push_back(func);
+    bool result = false;
+    while (worklist.size() > 0 && result == false) {
+        llvm::Function *f = worklist.back();
+        worklist.pop_back();
+        for (llvm::Function::iterator bb = f->begin(); bb != f->end() &&
+                 result == false; ++bb)
+            for (llvm::BasicBlock::iterator inst = bb->begin();
+                 inst != bb->end(); ++inst) {
+                llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(&*inst);
+                if (call == NULL)
+                    continue;
+                llvm::Function *callee =
+                    llvm::dyn_cast<llvm::Function>(call->getCalledValue()->stripPointerCasts());
+                if (callee == NULL || callee == func) {
+                    result = true;
+                    break;
+                }
+                if (callee->isIntrinsic())
+                    continue;
+                if (callee->isDeclaration()) {
+                    if (callee->getName().startswith("__") == false) {
+                        result = true;
+                        break;
+                    }
+                    continue;
+                }
+                if (seen.insert(callee).second)
+                    worklist.push_back(callee);
+            }
+    }
+
+    reentrant[func] = result;
+    return result;
+}
+
+
+bool
+LocalsToScratchPass::runOnModule(llvm::Module &module) {
+    const llvm::DataLayout *dl = g->target->getDataLayout();
+    bool modifiedAny = false;
+
+    for (llvm::Module::iterator fi = module.begin(); fi != module.end(); ++fi) {
+        llvm::Function *func = &*fi;
+        if (func->isDeclaration())
+            continue;
+
+        std::vector<llvm::AllocaInst *> bigAllocas;
+        for (llvm::Function::iterator bb = func->begin(); bb != func->end(); ++bb)
+            for (llvm::BasicBlock::iterator inst = bb->begin();
+                 inst != bb->end(); ++inst) {
+                llvm::AllocaInst *alloca = llvm::dyn_cast<llvm::AllocaInst>(&*inst);
+                if (alloca == NULL)
+                    continue;
+                llvm::ConstantInt *count =
+                    llvm::dyn_cast<llvm::ConstantInt>(alloca->getArraySize());
+                if (count == NULL)
+                    continue;
+                uint64_t size = dl->getTypeAllocSize(alloca->getAllocatedType()) *
+                    count->getZExtValue();
+                if (size > (uint64_t)g->opt.scratchLocalsThreshold)
+                    bigAllocas.push_back(alloca);
+            }
+        if (bigAllocas.size() == 0 || canReenter(func))
+            continue;
+
+        for (unsigned int i = 0; i < bigAllocas.size(); ++i) {
+            llvm::AllocaInst *alloca = bigAllocas[i];
+            llvm::Type *type = alloca->getAllocatedType();
+            uint64_t count =
+                llvm::cast<llvm::ConstantInt>(alloca->getArraySize())->getZExtValue();
+            if (count != 1)
+                type = llvm::ArrayType::get(type, count);
+
+            std::string name = func->getName().str() + "." +
+                alloca->getName().str() + ".scratch";
+            llvm::GlobalVariable *scratch =
+                new llvm::GlobalVariable(module, type, false,
+                                         llvm::GlobalValue::InternalLinkage,
+                                         llvm::Constant::getNullValue(type),
+                                         name);
+            scratch->setThreadLocal(true);
+            scratch->setAlignment(alloca->getAlignment());
+
+            // Lifetime markers only apply to stack allocations.
+            std::vector<llvm::Instruction *> dead;
+            for (llvm::Value::user_iterator ui = alloca->user_begin();
+                 ui != alloca->user_end(); ++ui) {
+                llvm::Instruction *user = llvm::dyn_cast<llvm::Instruction>(*ui);
+                if (user != NULL && llvm::isa<llvm::BitCastInst>(user))
+                    for (llvm::Value::user_iterator bi = user->user_begin();
+                         bi != user->user_end(); ++bi) {
+                        llvm::IntrinsicInst *ii =
+                            llvm::dyn_cast<llvm::IntrinsicInst>(*bi);
+                        if (ii != NULL &&
+                            (ii->getIntrinsicID() == llvm::Intrinsic::lifetime_start ||
+                             ii->getIntrinsicID() == llvm::Intrinsic::lifetime_end))
+                            dead.push_back(ii);
+                    }
+            }
+            for (unsigned int j = 0; j < dead.size(); ++j)
+                dead[j]->eraseFromParent();
+
+            Debug(SourcePos(), "Moving %d-byte local \"%s\" of \"%s\" to "
+                  "thread-local scratch memory.",
+                  (int)dl->getTypeAllocSize(type), alloca->getName().str().c_str(),
+                  func->getName().str().c_str());
+            OptRemark(OptRemarkPassed, SourcePos(), "LocalsToScratch",
+                      "LocalToScratch", func->getName().str().c_str(),
+                      "%d-byte local \"%s\" stored in thread-local scratch memory",
+                      (int)dl->getTypeAllocSize(type),
+                      alloca->getName().str().c_str());
+
+            alloca->replaceAllUsesWith(
+                llvm::ConstantExpr::getBitCast(scratch, alloca->getType()));
+            alloca->eraseFromParent();
+            modifiedAny = true;
+        }
+    }
+    return modifiedAny;
+}
+
+
+static llvm::Pass *
+CreateLocalsToScratchPass() {
+    return new LocalsToScratchPass;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// PerfReportPass
+
+/** This pass writes the --emit-perf-report report: for each exported and
+    task function, the number of gathers, scatters, masked loads and
+    stores, calls to other functions and remaining stack allocations, an
+    estimate of the number of vector values that will be spilled, and an
+    estimate of its cost.  It runs once the pseudo memory
+    operations have been replaced with the target's builtins but before
+    those are inlined.  The cost estimate uses the same weights as the AST
+    cost model (the COST_* values in ispc.h); "cost/iter" is the cost of
+    the most expensive loop in the function, counting the blocks of any
+    loops nested inside it once, which is the cost of a gang iteration for
+    the usual foreach kernel. */
+class PerfReportPass : public llvm::ModulePass {
+public:
+    static char ID;
+    PerfReportPass() : ModulePass(ID) { }
+
+    void getAnalysisUsage(llvm::AnalysisUsage &AU) const {
+        AU.setPreservesAll();
+    }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Performance Report"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Performance Report"; }
+#endif
+    bool runOnModule(llvm::Module &m);
+};
+
+char PerfReportPass::ID = 0;
+
+
+struct PerfReportCounts {
+    PerfReportCounts()
+        : gathers(0), scatters(0), maskedLoads(0), maskedStores(0),
+          calls(0), allocas(0), stackBytes(0), cost(0) { }
+    int gathers, scatters, maskedLoads, maskedStores, calls, allocas;
+    int stackBytes, cost;
+};
+
+
+static bool
+lStartsWith(const std::string &str, const char *prefix) {
+    return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+
+/** Adds the given instruction to the counts, returning its estimated
+    cost. */
+static int
+lPerfReportInstruction(llvm::Instruction *inst, PerfReportCounts *counts) {
+    if (llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(inst)) {
+        llvm::Function *callee =
+            llvm::dyn_cast<llvm::Function>(call->getCalledValue()->stripPointerCasts());
+        if (callee == NULL) {
+            ++counts->calls;
+            return COST_FUNPTR_UNIFORM;
+        }
+        if (callee->isIntrinsic())
+            return COST_SIMPLE_ARITH_LOGIC_OP;
+
+        std::string name = callee->getName().str();
+        if (lStartsWith(name, "__gather") || lStartsWith(name, "__scatter")) {
+            if (name[2] == 'g')
+                ++counts->gathers;
+            else
+                ++counts->scatters;
+            return COST_GATHER;
+        }
+        if (lStartsWith(name, "__masked_load")) {
+            ++counts->maskedLoads;
+            return COST_LOAD;
+        }
+        if (lStartsWith(name, "__masked_store")) {
+            ++counts->maskedStores;
+            return COST_LOAD + COST_SELECT;
+        }
+        if (lStartsWith(name, "__prefetch"))
+            return COST_SIMPLE_ARITH_LOGIC_OP;
+        if (lStartsWith(name, "__"))
+            // Other builtins: math functions, reductions and the like.
+            return COST_COMPLEX_ARITH_OP;
+        ++counts->calls;
+        return COST_FUNCALL;
+    }
+
+    if (llvm::AllocaInst *alloca = llvm::dyn_cast<llvm::AllocaInst>(inst)) {
+        ++counts->allocas;
+        llvm::ConstantInt *count =
+            llvm::dyn_cast<llvm::ConstantInt>(alloca->getArraySize());
+        if (count != NULL)
+            counts->stackBytes += (int)(count->getZExtValue() *
+                g->target->getDataLayout()->getTypeAllocSize(alloca->getAllocatedType()));
+        return 0;
+    }
+    if (llvm::isa<llvm::LoadInst>(inst) || llvm::isa<llvm::StoreInst>(inst))
+        return COST_LOAD;
+    if (llvm::isa<llvm::PHINode>(inst) || llvm::isa<llvm::GetElementPtrInst>(inst) ||
+        llvm::isa<llvm::BitCastInst>(inst) || llvm::isa<llvm::ReturnInst>(inst))
+        return 0;
+    if (llvm::BranchInst *br = llvm::dyn_cast<llvm::BranchInst>(inst))
+        return br->isConditional() ? COST_UNIFORM_IF : 0;
+    if (llvm::isa<llvm::SwitchInst>(inst))
+        return COST_UNIFORM_SWITCH;
+    if (llvm::isa<llvm::SelectInst>(inst))
+        return COST_SELECT;
+    if (llvm::isa<llvm::CastInst>(inst))
+        return COST_TYPECAST_SIMPLE;
+    switch (inst->getOpcode()) {
+    case llvm::Instruction::UDiv:
+    case llvm::Instruction::SDiv:
+    case llvm::Instruction::FDiv:
+    case llvm::Instruction::URem:
+    case llvm::Instruction::SRem:
+    case llvm::Instruction::FRem:
+        return COST_COMPLEX_ARITH_OP;
+    default:
+        return COST_SIMPLE_ARITH_LOGIC_OP;
+    }
+}
+
+
+bool
+PerfReportPass::runOnModule(llvm::Module &module) {
+    FILE *f = fopen(g->perfReportFile, "a");
+    if (f == NULL) {
+        perror(g->perfReportFile);
+        return false;
+    }
+
+    fprintf(f, "# ispc performance report, target %s (%d-wide)\n",
+            g->target->GetISATargetString(), g->target->getVectorWidth());
+    fprintf(f, "# %-30s %-6s %7s %8s %6s %7s %5s %7s %7s %6s %7s %9s  %s\n",
+            "function", "kind", "gathers", "scatters", "mloads", "mstores",
+            "calls", "allocas", "stack", "spills", "cost", "cost/iter",
+            "source");
+
+    for (unsigned int i = 0; i < m->perfReportFunctions.size(); ++i) {
+        const Module::PerfReportFunction &rf = m->perfReportFunctions[i];
+        llvm::Function *func = module.getFunction(rf.llvmName);
+        if (func == NULL || func->empty())
+            continue;
+
+        PerfReportCounts counts;
+        std::map<llvm::BasicBlock *, int> blockCost;
+        for (llvm::Function::iterator bb = func->begin(); bb != func->end(); ++bb) {
+            int cost = 0;
+            for (llvm::BasicBlock::iterator inst = bb->begin(); inst != bb->end(); ++inst)
+                cost += lPerfReportInstruction(&*inst, &counts);
+            blockCost[&*bb] = cost;
+            counts.cost += cost;
+        }
+
+        // The loops are the strongly connected components of the CFG
+        // that have cycles; the outermost loops are the largest ones.
+        int loopCost = -1;
+        for (llvm::scc_iterator<llvm::Function *> scc = llvm::scc_begin(func);
+             !scc.isAtEnd(); ++scc) {
+            if (!scc.hasLoop())
+                continue;
+            int cost = 0;
+            const std::vector<llvm::BasicBlock *> &blocks = *scc;
+            for (unsigned int j = 0; j < blocks.size(); ++j)
+                cost += blockCost[blocks[j]];
+            loopCost = std::max(loopCost, cost);
+        }
+
+        char loopCostString[32] = "-";
+        if (loopCost >= 0)
+            snprintf(loopCostString, sizeof(loopCostString), "%d", loopCost);
+        fprintf(f, "  %-30s %-6s %7d %8d %6d %7d %5d %7d %7d %6d %7d %9s  %s:%d\n",
+                rf.name.c_str(), rf.kind, counts.gathers, counts.scatters,
+                counts.maskedLoads, counts.maskedStores, counts.calls,
+                counts.allocas, counts.stackBytes,
+                EstimateSpilledVectorValues(func),
+                counts.cost, loopCostString,
+                rf.pos.name ? rf.pos.name : "", rf.pos.first_line);
+    }
+    fprintf(f, "\n");
+    fclose(f);
+    return false;
+}
+
+
+static llvm::Pass *
+CreatePerfReportPass() {
+    return new PerfReportPass;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 // PeepholePass
 
@@ -5375,6 +9064,375 @@ CreatePeepholePass() {
   return new PeepholePass;
 }
 
+
+///////////////////////////////////////////////////////////////////////////
+// VectorDivisionPass
+
+/** Most of the targets don't have SIMD integer divide instructions, so
+    the code generator scalarizes varying integer divisions and
+    remainders, doing a separate divide for each program instance.  This
+    pass computes the ones with 8, 16 and 32-bit elements with vector
+    instructions instead:
+
+    - When the divisor is a broadcast of a uniform value that isn't a
+      compile-time constant (as in the "i / width" and "i % width"
+      computations that unflatten indices), a magic multiplier and two
+      shift amounts are computed from it with scalar instructions,
+      following Granlund and Montgomery's method (as libdivide does).
+      The quotient is then a vector multiply that gives the high half
+      of the products, an add and two shifts.  The scalar code is
+      emitted right after the definition of the divisor, so it's done
+      once even when the division is in a loop, and it's shared by all
+      of the divisions by that value.  Signed divisions are done with
+      the magnitudes of the operands.
+
+    - When the divisor is varying, the operands are converted to floating
+      point and divided there, in single precision for 8 and 16-bit
+      types and in double precision for 32-bit ones.  Truncating the
+      quotient gives the exact result, since the rounding error of the
+      divide is always smaller than the distance from the true quotient
+      to the next integer.  This is only done for the x86 targets, which
+      have vector floating-point divides.
+
+    Remainders are computed from the quotients as x - (x / d) * d.
+    Divisions by compile-time constants are left to the code generator,
+    which already turns them into multiplies.
+ */
+class VectorDivisionPass : public llvm::FunctionPass {
+public:
+    static char ID;
+    VectorDivisionPass() : FunctionPass(ID) { }
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_9
+    const char *getPassName() const { return "Vector Integer Division"; }
+#else // LLVM 4.0+
+    llvm::StringRef getPassName() const { return "Vector Integer Division"; }
+#endif
+    bool runOnFunction(llvm::Function &F);
+
+private:
+    /** The values computed from a uniform divisor, broadcast across
+        gang-width vectors. */
+    struct Divisor {
+        /** Magic multiplier, extended to twice the element width. */
+        llvm::Value *magic;
+        /** Shift amounts applied after the multiply. */
+        llvm::Value *shift1, *shift2;
+    };
+
+    const Divisor &getDivisor(llvm::Value *d, bool isSigned,
+                              llvm::Function &F);
+    llvm::Value *uniformQuotient(llvm::BinaryOperator *bop, llvm::Value *d,
+                                 bool isSigned, llvm::Function &F);
+    llvm::Value *varyingQuotient(llvm::BinaryOperator *bop, bool isSigned);
+
+    /** Divisors computed so far, indexed by the scalar divisor and whether
+        it's used for signed divisions. */
+    std::map<std::pair<llvm::Value *, bool>, Divisor> divisors;
+};
+
+char VectorDivisionPass::ID = 0;
+
+
+/** Emits the scalar computation of the magic multiplier and shift amounts
+    for the given uniform divisor, if they haven't been computed already.
+    With l = ceil(log2(d)) and B the number of bits in the type, the
+    multiplier is floor(2^B * (2^l - d) / d) + 1, which always fits in B
+    bits, and the shifts are min(l, 1) and max(l - 1, 0); see "Division
+    by Invariant Integers using Multiplication", Granlund and Montgomery,
+    1994. */
+const VectorDivisionPass::Divisor &
+VectorDivisionPass::getDivisor(llvm::Value *d, bool isSigned,
+                               llvm::Function &F) {
+    std::pair<llvm::Value *, bool> key(d, isSigned);
+    std::map<std::pair<llvm::Value *, bool>, Divisor>::iterator iter =
+        divisors.find(key);
+    if (iter != divisors.end())
+        return iter->second;
+
+    // Put the computation right after the definition of the divisor, so
+    // that it's outside of any loops that the divisions are in.
+    llvm::Instruction *insertBefore = NULL;
+    if (llvm::Instruction *dInst = llvm::dyn_cast<llvm::Instruction>(d)) {
+        if (llvm::isa<llvm::PHINode>(dInst))
+            insertBefore = dInst->getParent()->getFirstNonPHI();
+        else
+            insertBefore = dInst->getNextNode();
+    }
+    else
+        insertBefore = F.getEntryBlock().getFirstNonPHI();
+
+    llvm::Type *type = d->getType();
+    int bits = type->getPrimitiveSizeInBits();
+    llvm::Type *wideType = llvm::IntegerType::get(*g->ctx, 2 * bits);
+    llvm::Value *zero = llvm::ConstantInt::get(type, 0);
+    llvm::Value *one = llvm::ConstantInt::get(type, 1);
+
+    llvm::Value *ud = d;
+    if (isSigned) {
+        llvm::Value *isNeg =
+            llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLT,
+                                  d, zero, "div_neg", insertBefore);
+        llvm::Value *negD =
+            llvm::BinaryOperator::CreateSub(zero, d, "div_negd", insertBefore);
+        ud = llvm::SelectInst::Create(isNeg, negD, d, "div_abs", insertBefore);
+    }
+    // Division by zero is undefined; using one instead keeps this code,
+    // which may run even if the division doesn't, from trapping.
+    llvm::Value *isZero =
+        llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                              ud, zero, "div_zero", insertBefore);
+    ud = llvm::SelectInst::Create(isZero, one, ud, "div_safe", insertBefore);
+
+    // l = B - ctlz(d - 1) = ceil(log2(d))
+    llvm::Function *ctlz =
+        llvm::Intrinsic::getDeclaration(F.getParent(), llvm::Intrinsic::ctlz,
+                                        type);
+    llvm::Value *dm1 =
+        llvm::BinaryOperator::CreateSub(ud, one, "div_dm1", insertBefore);
+    llvm::Value *lz = lCallInst(ctlz, dm1, LLVMFalse, "div_lz", insertBefore);
+    llvm::Value *l =
+        llvm::BinaryOperator::CreateSub(llvm::ConstantInt::get(type, bits), lz,
+                                        "div_log2", insertBefore);
+
+    llvm::Value *wideL = new llvm::ZExtInst(l, wideType, "div_log2_wide",
+                                            insertBefore);
+    llvm::Value *wideD = new llvm::ZExtInst(ud, wideType, "div_wide",
+                                            insertBefore);
+    llvm::Value *pow2 =
+        llvm::BinaryOperator::CreateShl(llvm::ConstantInt::get(wideType, 1),
+                                        wideL, "div_pow2", insertBefore);
+    llvm::Value *num =
+        llvm::BinaryOperator::CreateSub(pow2, wideD, "div_num", insertBefore);
+    num = llvm::BinaryOperator::CreateShl(num,
+                                          llvm::ConstantInt::get(wideType, bits),
+                                          "div_num", insertBefore);
+    llvm::Value *magic =
+        llvm::BinaryOperator::CreateUDiv(num, wideD, "div_magic", insertBefore);
+    magic = llvm::BinaryOperator::CreateAdd(magic,
+                                            llvm::ConstantInt::get(wideType, 1),
+                                            "div_magic", insertBefore);
+
+    llvm::Value *lNonZero =
+        llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_NE,
+                              l, zero, "div_log2_nonzero", insertBefore);
+    llvm::Value *shift1 = new llvm::ZExtInst(lNonZero, type, "div_shift1",
+                                             insertBefore);
+    llvm::Value *shift2 =
+        llvm::BinaryOperator::CreateSub(l, shift1, "div_shift2", insertBefore);
+
+    Divisor &divisor = divisors[key];
+    divisor.magic = lSmearScalar(magic, insertBefore);
+    divisor.shift1 = lSmearScalar(shift1, insertBefore);
+    divisor.shift2 = lSmearScalar(shift2, insertBefore);
+    return divisor;
+}
+
+
+/** Returns the quotient for the given division by a broadcast of the
+    uniform value d, computed with the divisor's magic multiplier. */
+llvm::Value *
+VectorDivisionPass::uniformQuotient(llvm::BinaryOperator *bop, llvm::Value *d,
+                                    bool isSigned, llvm::Function &F) {
+    const Divisor &divisor = getDivisor(d, isSigned, F);
+    llvm::Value *x = bop->getOperand(0);
+    llvm::Type *vecType = x->getType();
+    llvm::Type *wideType = divisor.magic->getType();
+    int bits = vecType->getScalarSizeInBits();
+    llvm::Value *signShift = LLVMIntAsType(bits - 1, vecType);
+
+    llvm::Value *xSign = NULL;
+    if (isSigned) {
+        // |x| = (x ^ s) - s, where s is all ones for negative x.
+        xSign = llvm::BinaryOperator::CreateAShr(x, signShift, "div_xsign", bop);
+        x = llvm::BinaryOperator::CreateXor(x, xSign, "div_xabs", bop);
+        x = llvm::BinaryOperator::CreateSub(x, xSign, "div_xabs", bop);
+    }
+
+    // t = mulhi(x, magic)
+    llvm::Value *wideX = new llvm::ZExtInst(x, wideType, "div_xwide", bop);
+    llvm::Value *prod =
+        llvm::BinaryOperator::CreateMul(wideX, divisor.magic, "div_prod", bop);
+    prod = llvm::BinaryOperator::CreateLShr(prod, LLVMIntAsType(bits, wideType),
+                                            "div_prod_hi", bop);
+    llvm::Value *t = new llvm::TruncInst(prod, vecType, "div_mulhi", bop);
+
+    // q = (t + ((x - t) >> shift1)) >> shift2
+    llvm::Value *q = llvm::BinaryOperator::CreateSub(x, t, "div_q", bop);
+    q = llvm::BinaryOperator::CreateLShr(q, divisor.shift1, "div_q", bop);
+    q = llvm::BinaryOperator::CreateAdd(q, t, "div_q", bop);
+    q = llvm::BinaryOperator::CreateLShr(q, divisor.shift2, "div_q", bop);
+
+    if (isSigned) {
+        // The quotient is negative if exactly one of the operands is.
+        llvm::Value *qSign =
+            llvm::BinaryOperator::CreateXor(bop->getOperand(0),
+                                            bop->getOperand(1), "div_qsign", bop);
+        qSign = llvm::BinaryOperator::CreateAShr(qSign, signShift, "div_qsign",
+                                                 bop);
+        q = llvm::BinaryOperator::CreateXor(q, qSign, "div_q", bop);
+        q = llvm::BinaryOperator::CreateSub(q, qSign, "div_q", bop);
+    }
+    return q;
+}
+
+
+/** Returns the quotient for the given division by a varying divisor,
+    computed with a floating-point divide. */
+llvm::Value *
+VectorDivisionPass::varyingQuotient(llvm::BinaryOperator *bop,
+                                    bool isSigned) {
+    llvm::Value *x = bop->getOperand(0), *d = bop->getOperand(1);
+    llvm::Type *vecType = x->getType();
+    int bits = vecType->getScalarSizeInBits();
+    llvm::Type *int32VecType = LLVMTypes::Int32VectorType;
+    llvm::Type *fpVecType = (bits == 32) ? LLVMTypes::DoubleVectorType :
+        LLVMTypes::FloatVectorType;
+
+    llvm::Value *xf, *df;
+    if (isSigned || bits < 32) {
+        // Smaller types are extended to 32 bits, which is then exactly
+        // representable as a signed value.
+        llvm::Value *x32 = x, *d32 = d;
+        if (bits < 32) {
+            llvm::Instruction::CastOps ext = isSigned ? llvm::Instruction::SExt :
+                llvm::Instruction::ZExt;
+            x32 = llvm::CastInst::Create(ext, x, int32VecType, "div_x32", bop);
+            d32 = llvm::CastInst::Create(ext, d, int32VecType, "div_d32", bop);
+        }
+        xf = new llvm::SIToFPInst(x32, fpVecType, "div_xf", bop);
+        df = new llvm::SIToFPInst(d32, fpVecType, "div_df", bop);
+    }
+    else {
+        // Unsigned 32-bit values are converted as signed ones after
+        // flipping the sign bit, with 2^31 then added back; this avoids
+        // the unsigned conversions that most targets don't have.
+        llvm::Value *bias = LLVMUIntAsType(0x80000000u, vecType);
+        llvm::Value *fpBias = llvm::ConstantFP::get(fpVecType, 2147483648.);
+        xf = llvm::BinaryOperator::CreateXor(x, bias, "div_xflip", bop);
+        xf = new llvm::SIToFPInst(xf, fpVecType, "div_xf", bop);
+        xf = llvm::BinaryOperator::CreateFAdd(xf, fpBias, "div_xf", bop);
+        df = llvm::BinaryOperator::CreateXor(d, bias, "div_dflip", bop);
+        df = new llvm::SIToFPInst(df, fpVecType, "div_df", bop);
+        df = llvm::BinaryOperator::CreateFAdd(df, fpBias, "div_df", bop);
+    }
+
+    llvm::Value *qf = llvm::BinaryOperator::CreateFDiv(xf, df, "div_qf", bop);
+    // fptosi truncates toward zero, as integer division does.
+    llvm::Value *q = new llvm::FPToSIInst(qf, int32VecType, "div_q", bop);
+    if (bits < 32)
+        q = new llvm::TruncInst(q, vecType, "div_q", bop);
+    else if (!isSigned) {
+        // Quotients of 2^31 and above, which don't fit in a signed
+        // integer, only come from dividing by one.
+        llvm::Value *dIsOne =
+            llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                                  d, LLVMIntAsType(1, vecType), "div_by_one", bop);
+        q = llvm::SelectInst::Create(dIsOne, x, q, "div_q", bop);
+    }
+    return q;
+}
+
+
+bool
+VectorDivisionPass::runOnFunction(llvm::Function &F) {
+    // The generic targets' divisions are left to the C++ compiler, and
+    // only the x86 targets have vector floating-point divides for the
+    // varying divisor case.
+    bool isX86 = (g->target->getISA() < Target::GENERIC);
+    bool handleUniform = isX86;
+#ifdef ISPC_ARM_ENABLED
+    handleUniform |= (g->target->getISA() == Target::NEON32 ||
+                      g->target->getISA() == Target::NEON16 ||
+                      g->target->getISA() == Target::NEON8);
+#endif
+    if (handleUniform == false)
+        return false;
+    divisors.clear();
+
+    std::vector<llvm::BinaryOperator *> divs;
+    for (llvm::Function::iterator bb = F.begin(); bb != F.end(); ++bb) {
+        for (llvm::BasicBlock::iterator iter = bb->begin(); iter != bb->end();
+             ++iter) {
+            llvm::BinaryOperator *bop =
+                llvm::dyn_cast<llvm::BinaryOperator>(&*iter);
+            if (bop == NULL || !lIsGangVectorType(bop->getType()) ||
+                !bop->getType()->getScalarType()->isIntegerTy())
+                continue;
+            int bits = bop->getType()->getScalarSizeInBits();
+            if (bits != 8 && bits != 16 && bits != 32)
+                continue;
+            switch (bop->getOpcode()) {
+            case llvm::Instruction::UDiv:
+            case llvm::Instruction::SDiv:
+            case llvm::Instruction::URem:
+            case llvm::Instruction::SRem:
+                // Constant divisors are already handled well.
+                if (!llvm::isa<llvm::Constant>(bop->getOperand(1)))
+                    divs.push_back(bop);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    int numUniform = 0, numVarying = 0;
+    for (unsigned int i = 0; i < divs.size(); ++i) {
+        llvm::BinaryOperator *bop = divs[i];
+        llvm::Instruction::BinaryOps opcode = bop->getOpcode();
+        bool isSigned = (opcode == llvm::Instruction::SDiv ||
+                         opcode == llvm::Instruction::SRem);
+        bool isRem = (opcode == llvm::Instruction::URem ||
+                      opcode == llvm::Instruction::SRem);
+        llvm::Value *divisor = bop->getOperand(1);
+
+        llvm::Value *d = NULL;
+        if (llvm::isa<llvm::InsertElementInst>(divisor) ||
+            llvm::isa<llvm::ShuffleVectorInst>(divisor))
+            d = LLVMFlattenInsertChain(divisor, g->target->getVectorWidth());
+
+        llvm::Value *q = NULL;
+        if (d != NULL) {
+            if (llvm::isa<llvm::Constant>(d))
+                continue;
+            q = uniformQuotient(bop, d, isSigned, F);
+            ++numUniform;
+        }
+        else if (isX86) {
+            q = varyingQuotient(bop, isSigned);
+            ++numVarying;
+        }
+        else
+            continue;
+
+        llvm::Value *result = q;
+        if (isRem) {
+            llvm::Value *prod =
+                llvm::BinaryOperator::CreateMul(q, divisor, "div_prod", bop);
+            result = llvm::BinaryOperator::CreateSub(bop->getOperand(0), prod,
+                                                     "div_rem", bop);
+        }
+        lCopyMetadata(result, bop);
+        result->takeName(bop);
+        bop->replaceAllUsesWith(result);
+        bop->eraseFromParent();
+    }
+
+    if (numUniform + numVarying > 0)
+        Debug(SourcePos(), "VectorDivisionPass: rewrote %d divisions by uniform "
+              "values and %d by varying values in \"%s\".", numUniform,
+              numVarying, F.getName().str().c_str());
+
+    return (numUniform + numVarying > 0);
+}
+
+
+static llvm::Pass *
+CreateVectorDivisionPass() {
+    return new VectorDivisionPass;
+}
+
 /** Given an llvm::Value known to be an integer, return its value as
     an int64_t.
 */
@@ -67,6 +67,7 @@
     while (0)
 
 struct ForeachDimension;
+struct TemplateArg;
 
 }
 
@@ -83,6 +84,7 @@ struct ForeachDimension;
 #include "util.h"
 
 #include <stdio.h>
+#include <algorithm>
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
   #include <llvm/Constants.h>
 #else
@@ -114,18 +116,46 @@ static const char *lGetStorageClassString(StorageClass sc);
 static bool lGetConstantInt(Expr *expr, int *value, SourcePos pos, const char *usage);
 static EnumType *lCreateEnumType(const char *name, std::vector<Symbol *> *enums,
                                  SourcePos pos);
+static Stmt *lApplyUnrollPragma(Stmt *stmt, int unrollCount, SourcePos pos);
+static Stmt *lApplyAlignPragma(Stmt *stmt, const std::string &names,
+                               SourcePos pos);
+static Stmt *lApplyTilePragma(Stmt *stmt, const std::string &list,
+                              SourcePos pos);
+static Stmt *lApplyFPContractPragma(Stmt *stmt, bool contract);
+static Stmt *lCreateParallelForeach(const std::vector<Symbol *> &dimSyms,
+                                    const std::vector<Expr *> &begins,
+                                    const std::vector<Expr *> &ends,
+                                    Stmt *body, SourcePos pos);
 static void lFinalizeEnumeratorSymbols(std::vector<Symbol *> &enums,
                                        const EnumType *enumType);
+static Expr *lMemberExpr(Expr *expr, const char *identifier, SourcePos pos,
+                         SourcePos identifierPos, bool derefLValue);
+static void lAddTemplateParameter(const char *name, const Type *type,
+                                  SourcePos pos);
+static void lStartTemplateDefinition(DeclSpecs *ds, Declarator *decl);
+struct TemplateArg;
+static Expr *lInstantiateTemplate(const std::string &name,
+                                  std::vector<TemplateArg> *args, SourcePos pos);
+
+extern void TakeTemplateTokens(std::vector<TemplateToken> *tokens);
+extern void ReplayTemplateTokens(const std::vector<TemplateToken> *tokens);
+
+/** The function template whose definition is being parsed, if any.  The
+    types of expressions in its body may depend on the template
+    parameters, so they aren't type checked while it's parsed. */
+static FunctionTemplate *lTemplate = NULL;
 
 static const char *lBuiltinTokens[] = {
     "assert", "bool", "break", "case", "cdo",
     "cfor", "cif", "cwhile", "const", "continue", "default",
     "do", "delete", "double", "else", "enum", "export", "extern", "false",
-    "float", "for", "foreach", "foreach_active", "foreach_tiled",
+    "float", "for", "foreach", "foreach_active", "foreach_compact",
+    "foreach_tiled",
      "foreach_unique", "goto", "if", "in", "inline",
     "int", "int8", "int16", "int32", "int64", "launch", "new", "NULL",
-    "print", "return", "signed", "sizeof", "static", "struct", "switch",
-    "sync", "task", "true", "typedef", "uniform", "unmasked", "unsigned",
+    "parallel_foreach", "print", "return", "signed", "sizeof", "static", "struct", "switch",
+    "sync", "task", "template", "true", "typedef", "typename", "uniform",
+    "unmasked", "unsigned",
     "varying", "void", "while", NULL
 };
 
@@ -145,6 +175,17 @@ struct ForeachDimension {
     Expr *beginExpr, *endExpr;
 };
 
+struct TemplateArg {
+    TemplateArg(const Type *t, Expr *e, SourcePos p) {
+        type = t;
+        expr = e;
+        pos = p;
+    }
+    const Type *type;
+    Expr *expr;
+    SourcePos pos;
+};
+
 %}
 
 %union {
@@ -175,6 +216,8 @@ struct ForeachDimension {
     std::vector<Symbol *> *symbolList;
     ForeachDimension *foreachDimension;
     std::vector<ForeachDimension *> *foreachDimensionList;
+    TemplateArg *templateArg;
+    std::vector<TemplateArg> *templateArgList;
     std::pair<std::string, SourcePos> *declspecPair;
     std::vector<std::pair<std::string, SourcePos> > *declspecList;
 }
@@ -195,18 +238,25 @@ struct ForeachDimension {
 %token TOKEN_AND_ASSIGN TOKEN_OR_ASSIGN TOKEN_XOR_ASSIGN
 %token TOKEN_SIZEOF TOKEN_NEW TOKEN_DELETE TOKEN_IN
 
-%token TOKEN_EXTERN TOKEN_EXPORT TOKEN_STATIC TOKEN_INLINE TOKEN_TASK TOKEN_DECLSPEC
+%token TOKEN_EXTERN TOKEN_EXPORT TOKEN_STATIC TOKEN_INLINE TOKEN_TASK TOKEN_TASK_LOCAL TOKEN_DECLSPEC
 %token TOKEN_UNIFORM TOKEN_VARYING TOKEN_TYPEDEF TOKEN_SOA TOKEN_UNMASKED
+%token TOKEN_NOALIAS TOKEN_ALIGNED
 %token TOKEN_CHAR TOKEN_INT TOKEN_SIGNED TOKEN_UNSIGNED TOKEN_FLOAT TOKEN_DOUBLE
 %token TOKEN_INT8 TOKEN_INT16 TOKEN_INT64 TOKEN_CONST TOKEN_VOID TOKEN_BOOL
 %token TOKEN_ENUM TOKEN_STRUCT TOKEN_TRUE TOKEN_FALSE
 
 %token TOKEN_CASE TOKEN_DEFAULT TOKEN_IF TOKEN_ELSE TOKEN_SWITCH
 %token TOKEN_WHILE TOKEN_DO TOKEN_LAUNCH TOKEN_FOREACH TOKEN_FOREACH_TILED
-%token TOKEN_FOREACH_UNIQUE TOKEN_FOREACH_ACTIVE TOKEN_DOTDOTDOT
+%token TOKEN_FOREACH_UNIQUE TOKEN_FOREACH_ACTIVE TOKEN_FOREACH_COMPACT
+%token TOKEN_PARALLEL_FOREACH
+%token TOKEN_DOTDOTDOT
 %token TOKEN_FOR TOKEN_GOTO TOKEN_CONTINUE TOKEN_BREAK TOKEN_RETURN
 %token TOKEN_CIF TOKEN_CDO TOKEN_CFOR TOKEN_CWHILE
-%token TOKEN_SYNC TOKEN_PRINT TOKEN_ASSERT
+%token TOKEN_SYNC TOKEN_PRINT TOKEN_ASSERT TOKEN_ASSUME TOKEN_AFTER
+%token TOKEN_TEMPLATE TOKEN_TYPENAME
+%token <stringVal> TOKEN_TEMPLATE_NAME
+%token <intVal> TOKEN_PRAGMA_UNROLL TOKEN_PRAGMA_FP_CONTRACT
+%token <stringVal> TOKEN_PRAGMA_ALIGN TOKEN_PRAGMA_TILE
 
 %type <expr> primary_expression postfix_expression integer_dotdotdot
 %type <expr> unary_expression cast_expression funcall_expression launch_expression
@@ -216,12 +266,12 @@ struct ForeachDimension {
 %type <expr> logical_and_expression logical_or_expression new_expression
 %type <expr> conditional_expression assignment_expression expression
 %type <expr> initializer constant_expression for_test
-%type <exprList> argument_expression_list initializer_list
+%type <exprList> argument_expression_list initializer_list launch_after
 
 %type <stmt> statement labeled_statement compound_statement for_init_statement
 %type <stmt> expression_statement selection_statement iteration_statement
 %type <stmt> jump_statement statement_list declaration_statement print_statement
-%type <stmt> assert_statement sync_statement delete_statement unmasked_statement
+%type <stmt> assert_statement assume_statement sync_statement delete_statement unmasked_statement
 
 %type <declaration> declaration parameter_declaration
 %type <declarators> init_declarator_list
@@ -258,6 +308,9 @@ struct ForeachDimension {
 %type <foreachDimension> foreach_dimension_specifier
 %type <foreachDimensionList> foreach_dimension_list
 
+%type <templateArg> template_argument
+%type <templateArgList> template_argument_list
+
 %type <declspecPair> declspec_item
 %type <declspecList> declspec_specifier declspec_list
 
@@ -345,81 +398,109 @@ primary_expression
     }
 /*    | TOKEN_STRING_LITERAL
        { UNIMPLEMENTED }*/
+    | TOKEN_TEMPLATE_NAME '<' template_argument_list '>'
+      { $$ = lInstantiateTemplate(*$1, $3, Union(@1, @4)); }
     | '(' expression ')' { $$ = $2; }
     | '(' error ')' { $$ = NULL; }
     ;
 
+template_argument_list
+    : template_argument
+      {
+          $$ = new std::vector<TemplateArg>;
+          if ($1 != NULL)
+              $$->push_back(*$1);
+      }
+    | template_argument_list ',' template_argument
+      {
+          $$ = $1;
+          if ($3 != NULL)
+              $$->push_back(*$3);
+      }
+    ;
+
+template_argument
+    : type_name { $$ = $1 ? new TemplateArg($1, NULL, @1) : NULL; }
+    | shift_expression { $$ = $1 ? new TemplateArg(NULL, $1, @1) : NULL; }
+    ;
+
+launch_after
+    : /* empty */ { $$ = NULL; }
+    | TOKEN_AFTER '(' argument_expression_list ')'
+      { $$ = $3; }
+    ;
+
 launch_expression
-    : TOKEN_LAUNCH postfix_expression '(' argument_expression_list ')'
+    : TOKEN_LAUNCH launch_after postfix_expression '(' argument_expression_list ')'
       {
-          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @2);
+          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @3);
           Expr *launchCount[3] = {oneExpr, oneExpr, oneExpr};
-          $$ = new FunctionCallExpr($2, $4, Union(@2, @5), true, launchCount);
+          $$ = new FunctionCallExpr($3, $5, Union(@3, @6), true, launchCount, $2);
       }
-    | TOKEN_LAUNCH postfix_expression '(' ')'
+    | TOKEN_LAUNCH launch_after postfix_expression '(' ')'
       {
-          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @2);
+          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @3);
           Expr *launchCount[3] = {oneExpr, oneExpr, oneExpr};
-          $$ = new FunctionCallExpr($2, new ExprList(Union(@3,@4)), Union(@2, @4), true, launchCount);
+          $$ = new FunctionCallExpr($3, new ExprList(Union(@4,@5)), Union(@3, @5), true, launchCount, $2);
        }
 
-    | TOKEN_LAUNCH '[' assignment_expression ']' postfix_expression '(' argument_expression_list ')'
+    | TOKEN_LAUNCH '[' assignment_expression ']' launch_after postfix_expression '(' argument_expression_list ')'
       { 
-          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @5);
+          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @6);
           Expr *launchCount[3] = {$3, oneExpr, oneExpr};
-          $$ = new FunctionCallExpr($5, $7, Union(@5,@8), true, launchCount);
+          $$ = new FunctionCallExpr($6, $8, Union(@6,@9), true, launchCount, $5);
       }
-    | TOKEN_LAUNCH '[' assignment_expression ']' postfix_expression '(' ')'
+    | TOKEN_LAUNCH '[' assignment_expression ']' launch_after postfix_expression '(' ')'
       { 
-          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @5);
+          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @6);
           Expr *launchCount[3] = {$3, oneExpr, oneExpr};
-          $$ = new FunctionCallExpr($5, new ExprList(Union(@5,@6)), Union(@5,@7), true, launchCount);
+          $$ = new FunctionCallExpr($6, new ExprList(Union(@6,@7)), Union(@6,@8), true, launchCount, $5);
       }
 
-    | TOKEN_LAUNCH '[' assignment_expression ',' assignment_expression ']' postfix_expression '(' argument_expression_list ')'
+    | TOKEN_LAUNCH '[' assignment_expression ',' assignment_expression ']' launch_after postfix_expression '(' argument_expression_list ')'
       { 
-          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @7);
+          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @8);
           Expr *launchCount[3] = {$3, $5, oneExpr};
-          $$ = new FunctionCallExpr($7, $9, Union(@7,@10), true, launchCount);
+          $$ = new FunctionCallExpr($8, $10, Union(@8,@11), true, launchCount, $7);
       }
-    | TOKEN_LAUNCH '[' assignment_expression ',' assignment_expression ']' postfix_expression '(' ')'
+    | TOKEN_LAUNCH '[' assignment_expression ',' assignment_expression ']' launch_after postfix_expression '(' ')'
       { 
-          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @7);
+          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @8);
           Expr *launchCount[3] = {$3, $5, oneExpr};
-          $$ = new FunctionCallExpr($7, new ExprList(Union(@7,@8)), Union(@7,@9), true, launchCount);
+          $$ = new FunctionCallExpr($8, new ExprList(Union(@8,@9)), Union(@8,@10), true, launchCount, $7);
       }
-    | TOKEN_LAUNCH '[' assignment_expression ']' '[' assignment_expression ']' postfix_expression '(' argument_expression_list ')'
+    | TOKEN_LAUNCH '[' assignment_expression ']' '[' assignment_expression ']' launch_after postfix_expression '(' argument_expression_list ')'
       { 
-          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @8);
+          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @9);
           Expr *launchCount[3] = {$6, $3, oneExpr};
-          $$ = new FunctionCallExpr($8, $10, Union(@8,@11), true, launchCount);
+          $$ = new FunctionCallExpr($9, $11, Union(@9,@12), true, launchCount, $8);
       }
-    | TOKEN_LAUNCH '[' assignment_expression ']' '[' assignment_expression ']' postfix_expression '(' ')'
+    | TOKEN_LAUNCH '[' assignment_expression ']' '[' assignment_expression ']' launch_after postfix_expression '(' ')'
       { 
-          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @8);
+          ConstExpr *oneExpr = new ConstExpr(AtomicType::UniformInt32, (int32_t)1, @9);
           Expr *launchCount[3] = {$6, $3, oneExpr};
-          $$ = new FunctionCallExpr($8, new ExprList(Union(@8,@9)), Union(@8,@10), true, launchCount);
+          $$ = new FunctionCallExpr($9, new ExprList(Union(@9,@10)), Union(@9,@11), true, launchCount, $8);
       }
 
-    | TOKEN_LAUNCH '[' assignment_expression ',' assignment_expression ',' assignment_expression ']' postfix_expression '(' argument_expression_list ')'
+    | TOKEN_LAUNCH '[' assignment_expression ',' assignment_expression ',' assignment_expression ']' launch_after postfix_expression '(' argument_expression_list ')'
       { 
           Expr *launchCount[3] = {$3, $5, $7};
-          $$ = new FunctionCallExpr($9, $11, Union(@9,@12), true, launchCount);
+          $$ = new FunctionCallExpr($10, $12, Union(@10,@13), true, launchCount, $9);
       }
-    | TOKEN_LAUNCH '[' assignment_expression ',' assignment_expression ',' assignment_expression ']' postfix_expression '(' ')'
+    | TOKEN_LAUNCH '[' assignment_expression ',' assignment_expression ',' assignment_expression ']' launch_after postfix_expression '(' ')'
       { 
           Expr *launchCount[3] = {$3, $5, $7};
-          $$ = new FunctionCallExpr($9, new ExprList(Union(@9,@10)), Union(@9,@11), true, launchCount);
+          $$ = new FunctionCallExpr($10, new ExprList(Union(@10,@11)), Union(@10,@12), true, launchCount, $9);
       }
-    | TOKEN_LAUNCH '[' assignment_expression ']' '[' assignment_expression ']' '[' assignment_expression ']' postfix_expression '(' argument_expression_list ')'
+    | TOKEN_LAUNCH '[' assignment_expression ']' '[' assignment_expression ']' '[' assignment_expression ']' launch_after postfix_expression '(' argument_expression_list ')'
       { 
           Expr *launchCount[3] = {$9, $6, $3};
-          $$ = new FunctionCallExpr($11, $13, Union(@11,@14), true, launchCount);
+          $$ = new FunctionCallExpr($12, $14, Union(@12,@15), true, launchCount, $11);
       }
-    | TOKEN_LAUNCH '[' assignment_expression ']' '[' assignment_expression ']' '[' assignment_expression ']' postfix_expression '(' ')'
+    | TOKEN_LAUNCH '[' assignment_expression ']' '[' assignment_expression ']' '[' assignment_expression ']' launch_after postfix_expression '(' ')'
       { 
           Expr *launchCount[3] = {$9, $6, $3};
-          $$ = new FunctionCallExpr($11, new ExprList(Union(@11,@12)), Union(@11,@13), true, launchCount);
+          $$ = new FunctionCallExpr($12, new ExprList(Union(@12,@13)), Union(@12,@14), true, launchCount, $11);
       }
 
 
@@ -457,9 +538,17 @@ postfix_expression
       { $$ = NULL; }
     | launch_expression
     | postfix_expression '.' TOKEN_IDENTIFIER
-      { $$ = MemberExpr::create($1, yytext, Union(@1,@3), @3, false); }
+      { $$ = lMemberExpr($1, yytext, Union(@1,@3), @3, false); }
+    | postfix_expression '.' TOKEN_TYPE_NAME
+      { $$ = lMemberExpr($1, yytext, Union(@1,@3), @3, false); }
+    | postfix_expression '.' TOKEN_TEMPLATE_NAME
+      { $$ = lMemberExpr($1, yytext, Union(@1,@3), @3, false); }
     | postfix_expression TOKEN_PTR_OP TOKEN_IDENTIFIER
-      { $$ = MemberExpr::create($1, yytext, Union(@1,@3), @3, true); }
+      { $$ = lMemberExpr($1, yytext, Union(@1,@3), @3, true); }
+    | postfix_expression TOKEN_PTR_OP TOKEN_TYPE_NAME
+      { $$ = lMemberExpr($1, yytext, Union(@1,@3), @3, true); }
+    | postfix_expression TOKEN_PTR_OP TOKEN_TEMPLATE_NAME
+      { $$ = lMemberExpr($1, yytext, Union(@1,@3), @3, true); }
     | postfix_expression TOKEN_INC_OP
       { $$ = new UnaryExpr(UnaryExpr::PostInc, $1, Union(@1,@2)); }
     | postfix_expression TOKEN_DEC_OP
@@ -904,6 +993,7 @@ storage_class_specifier
     | TOKEN_EXTERN { $$ = SC_EXTERN; }
     | TOKEN_EXTERN TOKEN_STRING_C_LITERAL  { $$ = SC_EXTERN_C; }
     | TOKEN_STATIC { $$ = SC_STATIC; }
+    | TOKEN_TASK_LOCAL { $$ = SC_TASK_LOCAL; }
     ;
 
 type_specifier
@@ -1135,6 +1225,29 @@ specifier_qualifier_list
                       "function declarations.");
                 $$ = $2;
             }
+            else if ($1 == TYPEQUAL_NOALIAS) {
+                const PointerType *pt = CastType<PointerType>($2);
+                if (pt != NULL)
+                    $$ = pt->GetAsNoAliasType();
+                else {
+                    Error(@1, "\"noalias\" qualifier is only legal with "
+                          "pointer types.");
+                    $$ = $2;
+                }
+            }
+            else if (($1 & TYPEQUAL_ALIGN_MASK) != 0) {
+                const PointerType *pt = CastType<PointerType>($2);
+                if (pt != NULL)
+                    $$ = pt->GetAsAlignedType(TYPEQUAL_ALIGNMENT($1));
+                else {
+                    Error(@1, "\"aligned\" qualifier is only legal with "
+                          "pointer types.");
+                    $$ = $2;
+                }
+            }
+            else if ($1 == TYPEQUAL_NONE)
+                // An invalid "aligned" qualifier; already reported.
+                $$ = $2;
             else
                 FATAL("Unhandled type qualifier in parser.");
         }
@@ -1272,6 +1385,22 @@ type_qualifier
     | TOKEN_INLINE     { $$ = TYPEQUAL_INLINE; }
     | TOKEN_SIGNED     { $$ = TYPEQUAL_SIGNED; }
     | TOKEN_UNSIGNED   { $$ = TYPEQUAL_UNSIGNED; }
+    | TOKEN_NOALIAS    { $$ = TYPEQUAL_NOALIAS; }
+    | TOKEN_ALIGNED '(' int_constant ')'
+      {
+          int64_t align = $3, log2Align = 0;
+          if (align <= 1 || align > 4096 || (align & (align - 1)) != 0) {
+              Error(Union(@1, @4), "Alignment %d given with \"aligned\" "
+                    "qualifier must be a power of two between 2 and 4096.",
+                    (int)align);
+              $$ = TYPEQUAL_NONE;
+          }
+          else {
+              while ((1 << log2Align) < align)
+                  ++log2Align;
+              $$ = (int)(log2Align << TYPEQUAL_ALIGN_SHIFT);
+          }
+      }
     ;
 
 type_qualifier_list
@@ -1327,6 +1456,13 @@ direct_declarator
           d->name = yytext;
           $$ = d;
       }
+    | TOKEN_TEMPLATE_NAME
+      {
+          // A local variable or parameter hides the function template.
+          Declarator *d = new Declarator(DK_BASE, @1);
+          d->name = yytext;
+          $$ = d;
+      }
     | '(' declarator ')'
     {
         $$ = $2;
@@ -1656,9 +1792,24 @@ statement
     | declaration_statement
     | print_statement
     | assert_statement
+    | assume_statement
     | sync_statement
     | delete_statement
     | unmasked_statement
+    | TOKEN_PRAGMA_UNROLL statement
+      { $$ = lApplyUnrollPragma($2, (int)$1, @1); }
+    | TOKEN_PRAGMA_ALIGN statement
+      {
+          $$ = lApplyAlignPragma($2, *$1, @1);
+          delete $1;
+      }
+    | TOKEN_PRAGMA_TILE statement
+      {
+          $$ = lApplyTilePragma($2, *$1, @1);
+          delete $1;
+      }
+    | TOKEN_PRAGMA_FP_CONTRACT statement
+      { $$ = lApplyFPContractPragma($2, $1 != 0); }
     | error ';'
     {
         lSuggestBuiltinAlternates();
@@ -1774,6 +1925,14 @@ foreach_active_scope
     : TOKEN_FOREACH_ACTIVE { m->symbolTable->PushScope(); }
     ;
 
+foreach_compact_scope
+    : TOKEN_FOREACH_COMPACT { m->symbolTable->PushScope(); }
+    ;
+
+parallel_foreach_scope
+    : TOKEN_PARALLEL_FOREACH { m->symbolTable->PushScope(); }
+    ;
+
 foreach_active_identifier
     : TOKEN_IDENTIFIER
     {
@@ -1920,6 +2079,51 @@ iteration_statement
          $$ = new ForeachStmt(syms, begins, ends, $6, true, @1);
          m->symbolTable->PopScope();
      }
+    | parallel_foreach_scope '(' foreach_dimension_list ')'
+     {
+         std::vector<ForeachDimension *> *dims = $3;
+         if (dims == NULL) {
+             AssertPos(@3, m->errorCount > 0);
+             dims = new std::vector<ForeachDimension *>;
+         }
+         for (unsigned int i = 0; i < dims->size(); ++i)
+             m->symbolTable->AddVariable((*dims)[i]->sym);
+     }
+     statement
+     {
+         std::vector<ForeachDimension *> *dims = $3;
+         if (dims == NULL) {
+             AssertPos(@3, m->errorCount > 0);
+             dims = new std::vector<ForeachDimension *>;
+         }
+
+         std::vector<Symbol *> syms;
+         std::vector<Expr *> begins, ends;
+         for (unsigned int i = 0; i < dims->size(); ++i) {
+             syms.push_back((*dims)[i]->sym);
+             begins.push_back((*dims)[i]->beginExpr);
+             ends.push_back((*dims)[i]->endExpr);
+         }
+         // The loop's own variables must be out of scope when the
+         // variables that its body uses from the enclosing function are
+         // found.
+         m->symbolTable->PopScope();
+         $$ = lCreateParallelForeach(syms, begins, ends, $6, @1);
+     }
+    | foreach_compact_scope '(' foreach_dimension_specifier ')'
+     {
+         if ($3 != NULL)
+             m->symbolTable->AddVariable($3->sym);
+     }
+     statement
+     {
+         if ($3 != NULL)
+             $$ = new ForeachCompactStmt($3->sym, $3->beginExpr, $3->endExpr,
+                                         $6, @1);
+         else
+             $$ = NULL;
+         m->symbolTable->PopScope();
+     }
     | foreach_active_scope '(' foreach_active_identifier ')'
      {
          if ($3 != NULL)
@@ -1935,7 +2139,14 @@ iteration_statement
      {
          Expr *expr = $5;
          const Type *type;
-         if (expr != NULL &&
+         if (lTemplate != NULL) {
+             // The type of the expression may depend on the template
+             // parameters.
+             const Type *iterType =
+                 new TemplateTypeParmType("auto", Variability::Uniform, true, @3);
+             m->symbolTable->AddVariable(new Symbol($3, @3, iterType));
+         }
+         else if (expr != NULL &&
              (expr = TypeCheck(expr)) != NULL &&
              (type = expr->GetType()) != NULL) {
              const Type *iterType = type->GetAsUniformType()->GetAsConstType();
@@ -1970,6 +2181,8 @@ jump_statement
 sync_statement
     : TOKEN_SYNC ';'
       { $$ = new ExprStmt(new SyncExpr(@1), @1); }
+    | TOKEN_SYNC expression ';'
+      { $$ = new ExprStmt(new SyncExpr(@1, $2), Union(@1, @2)); }
     ;
 
 delete_statement
@@ -2004,6 +2217,13 @@ assert_statement
       }
     ;
 
+assume_statement
+    : TOKEN_ASSUME '(' expression ')' ';'
+      {
+          $$ = new AssumeStmt($3, @1);
+      }
+    ;
+
 translation_unit
     : external_declaration
     | translation_unit external_declaration
@@ -2012,6 +2232,7 @@ translation_unit
 
 external_declaration
     : function_definition
+    | template_definition
     | TOKEN_EXTERN TOKEN_STRING_C_LITERAL '{' declaration '}'
     | TOKEN_EXPORT '{' type_specifier_list '}' ';'
     {
@@ -2020,9 +2241,23 @@ external_declaration
     }
     | declaration
     {
-        if ($1 != NULL)
-            for (unsigned int i = 0; i < $1->declarators.size(); ++i)
+        if ($1 != NULL) {
+            // "export typedef" also makes the typedef available to the
+            // application through the generated header file.
+            bool isExportedTypeDef = ($1->declSpecs != NULL &&
+                                      $1->declSpecs->storageClass == SC_TYPEDEF &&
+                                      ($1->declSpecs->typeQualifiers & TYPEQUAL_EXPORT) != 0);
+            if (isExportedTypeDef)
+                $1->declSpecs->typeQualifiers &= ~TYPEQUAL_EXPORT;
+            for (unsigned int i = 0; i < $1->declarators.size(); ++i) {
                 lAddDeclaration($1->declSpecs, $1->declarators[i]);
+                if (isExportedTypeDef && $1->declarators[i] != NULL &&
+                    $1->declarators[i]->type != NULL)
+                    m->AddExportedTypeDef($1->declarators[i]->name,
+                                          $1->declarators[i]->type,
+                                          $1->declarators[i]->pos);
+            }
+        }
     }
     | ';'
     ;
@@ -2063,6 +2298,45 @@ func(...)
 */
     ;
 
+template_definition
+    : TOKEN_TEMPLATE '<'
+    {
+        m->symbolTable->PushScope(); // for the template parameters
+        lTemplate = new FunctionTemplate;
+        lTemplate->pos = @1;
+        lTemplate->type = NULL;
+    }
+    template_parameter_list '>' declaration_specifiers declarator
+    {
+        lStartTemplateDefinition($6, $7);
+        lAddFunctionParams($7);
+        lAddMaskToSymbolTable(@7);
+        if ($6->typeQualifiers & TYPEQUAL_TASK)
+            lAddThreadIndexCountToSymbolTable(@7);
+    }
+    compound_statement
+    {
+        TakeTemplateTokens(&lTemplate->tokens);
+        lTemplate = NULL;
+        m->symbolTable->PopScope(); // push in lAddFunctionParams();
+        m->symbolTable->PopScope();
+    }
+    ;
+
+template_parameter_list
+    : template_parameter
+    | template_parameter_list ',' template_parameter
+    ;
+
+template_parameter
+    : TOKEN_TYPENAME TOKEN_IDENTIFIER
+      { lAddTemplateParameter(yytext, NULL, @2); }
+    | TOKEN_TYPENAME TOKEN_TYPE_NAME
+      { lAddTemplateParameter(yytext, NULL, @2); }
+    | specifier_qualifier_list TOKEN_IDENTIFIER
+      { lAddTemplateParameter(yytext, $1, @2); }
+    ;
+
 %%
 
 
@@ -2321,6 +2595,8 @@ lGetStorageClassString(StorageClass sc) {
         return "typedef";
     case SC_EXTERN_C:
         return "extern \"C\"";
+    case SC_TASK_LOCAL:
+        return "task_local";
     default:
         Assert(!"logic error in lGetStorageClassString()");
         return "";
@@ -2337,6 +2613,13 @@ static bool
 lGetConstantInt(Expr *expr, int *value, SourcePos pos, const char *usage) {
     if (expr == NULL)
         return false;
+    if (lTemplate != NULL && llvm::dyn_cast<ConstExpr>(expr) == NULL) {
+        // In the definition of a function template, the value may depend
+        // on the template parameters; it's checked when the template is
+        // instantiated.
+        *value = 1;
+        return true;
+    }
     expr = TypeCheck(expr);
     if (expr == NULL)
         return false;
@@ -2431,3 +2714,704 @@ lFinalizeEnumeratorSymbols(std::vector<Symbol *> &enums,
         }
     }
 }
+
+
+/** Records the unroll count from a "#pragma unroll" or "#pragma
+    nounroll" in the loop statement that follows it.  Pragmas before
+    other kinds of statements are ignored with a warning.
+*/
+static Stmt *
+lApplyUnrollPragma(Stmt *stmt, int unrollCount, SourcePos pos) {
+    if (stmt == NULL)
+        return NULL;
+
+    if (ForStmt *fs = llvm::dyn_cast<ForStmt>(stmt))
+        fs->unrollCount = unrollCount;
+    else if (DoStmt *ds = llvm::dyn_cast<DoStmt>(stmt))
+        ds->unrollCount = unrollCount;
+    else if (ForeachStmt *fes = llvm::dyn_cast<ForeachStmt>(stmt))
+        fes->unrollCount = unrollCount;
+    else
+        Warning(pos, "Ignoring \"#pragma unroll\" that isn't followed by a "
+                "\"for\", \"while\", \"do\" or \"foreach\" loop.");
+    return stmt;
+}
+
+
+/** Records the setting from a "#pragma fp_contract" in the statement
+    that follows it, which is wrapped in a statement list to carry it if
+    it isn't a compound statement already.
+*/
+static Stmt *
+lApplyFPContractPragma(Stmt *stmt, bool contract) {
+    if (stmt == NULL)
+        return NULL;
+
+    StmtList *sl = llvm::dyn_cast<StmtList>(stmt);
+    if (sl == NULL) {
+        sl = new StmtList(stmt->pos);
+        sl->Add(stmt);
+    }
+    sl->fpContract = contract ? 1 : 0;
+    if (contract == false)
+        m->noFPContract = true;
+    return sl;
+}
+
+
+/** Splits the comma-separated list from a "#pragma align" or "#pragma
+    tile" into its whitespace-trimmed items.
+*/
+static void
+lSplitPragmaList(const std::string &list, std::vector<std::string> *items) {
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string item = list.substr(start, end - start);
+        start = end + 1;
+
+        size_t first = item.find_first_not_of(" \t");
+        size_t last = item.find_last_not_of(" \t\r");
+        items->push_back((first == std::string::npos) ? std::string() :
+                         item.substr(first, last - first + 1));
+    }
+}
+
+
+/** Records the pointer variables named in a "#pragma align" in the
+    "foreach" loop that follows it; the loop's iterations are then aligned
+    so that the first pointer is indexed at aligned addresses (see
+    ForeachStmt::EmitCode()).
+*/
+static Stmt *
+lApplyAlignPragma(Stmt *stmt, const std::string &names, SourcePos pos) {
+    if (stmt == NULL)
+        return NULL;
+
+    ForeachStmt *fes = llvm::dyn_cast<ForeachStmt>(stmt);
+    if (fes == NULL) {
+        Warning(pos, "Ignoring \"#pragma align\" that isn't followed by a "
+                "\"foreach\" loop.");
+        return stmt;
+    }
+    if (fes->dimVariables.size() != 1) {
+        Warning(pos, "Ignoring \"#pragma align\" for multi-dimensional "
+                "\"foreach\" loop.");
+        return stmt;
+    }
+
+    std::vector<std::string> nameList;
+    lSplitPragmaList(names, &nameList);
+    for (unsigned int i = 0; i < nameList.size(); ++i) {
+        const std::string &name = nameList[i];
+        Symbol *sym = name.empty() ? NULL :
+            m->symbolTable->LookupVariable(name.c_str());
+        if (sym == NULL) {
+            Error(pos, "Undeclared variable \"%s\" in \"#pragma align\".",
+                  name.c_str());
+            continue;
+        }
+
+        const PointerType *pt = CastType<PointerType>(sym->type);
+        if (pt == NULL || pt->IsUniformType() == false || pt->IsSlice() ||
+            pt->GetBaseType()->IsVoidType() ||
+            CastType<FunctionType>(pt->GetBaseType()) != NULL) {
+            Error(pos, "Variable \"%s\" in \"#pragma align\" must be a "
+                  "uniform pointer to data, not \"%s\".", name.c_str(),
+                  sym->type->GetString().c_str());
+            continue;
+        }
+        fes->alignSymbols.push_back(sym);
+    }
+    return stmt;
+}
+
+
+/** Records the lane order ("morton" or "hilbert") and/or tile shape (one
+    power-of-two extent per dimension, innermost last) given with a
+    "#pragma tile" in the "foreach_tiled" loop that follows it.
+*/
+static Stmt *
+lApplyTilePragma(Stmt *stmt, const std::string &list, SourcePos pos) {
+    if (stmt == NULL)
+        return NULL;
+
+    ForeachStmt *fes = llvm::dyn_cast<ForeachStmt>(stmt);
+    if (fes == NULL || fes->isTiled == false) {
+        Warning(pos, "Ignoring \"#pragma tile\" that isn't followed by a "
+                "\"foreach_tiled\" loop.");
+        return stmt;
+    }
+
+    std::vector<std::string> items;
+    lSplitPragmaList(list, &items);
+    std::vector<int> shape;
+    for (unsigned int i = 0; i < items.size(); ++i) {
+        char *endPtr = NULL;
+        long extent = strtol(items[i].c_str(), &endPtr, 0);
+        if (items[i] == "morton")
+            fes->laneOrder = ForeachStmt::LANES_MORTON;
+        else if (items[i] == "hilbert")
+            fes->laneOrder = ForeachStmt::LANES_HILBERT;
+        else if (items[i].empty() == false && *endPtr == '\0' &&
+                 extent > 0 && extent <= ISPC_MAX_NVEC &&
+                 (extent & (extent - 1)) == 0)
+            shape.push_back((int)extent);
+        else
+            Error(pos, "Expected \"morton\", \"hilbert\" or a power-of-two "
+                  "tile extent in \"#pragma tile\", not \"%s\".",
+                  items[i].c_str());
+    }
+
+    if (shape.size() > 0 && shape.size() != fes->dimVariables.size())
+        Error(pos, "\"#pragma tile\" gives %d tile extents for %d-dimensional "
+              "\"foreach_tiled\" loop.", (int)shape.size(),
+              (int)fes->dimVariables.size());
+    else
+        fes->tileShape = shape;
+    return stmt;
+}
+
+
+/** Information about the variables from the enclosing function that the
+    body of a "parallel_foreach" loop uses. */
+struct ParallelForeachCaptures {
+    /** The variables, and the pointer parameters of the task function
+        that they're accessed through. */
+    std::vector<Symbol *> symbols, pointers;
+    bool error;
+};
+
+
+static bool
+lFindParallelForeachCaptures(ASTNode *node, void *d) {
+    ParallelForeachCaptures *captures = (ParallelForeachCaptures *)d;
+    if (SymbolExpr *se = llvm::dyn_cast<SymbolExpr>(node)) {
+        Symbol *sym = se->GetBaseSymbol();
+        if (sym != NULL && m->symbolTable->IsLocalVariable(sym) &&
+            std::find(captures->symbols.begin(), captures->symbols.end(),
+                      sym) == captures->symbols.end())
+            captures->symbols.push_back(sym);
+    }
+    else if (llvm::dyn_cast<ReturnStmt>(node) != NULL) {
+        Error(node->pos, "\"return\" statements are illegal in "
+              "\"parallel_foreach\" loops.");
+        captures->error = true;
+    }
+    return true;
+}
+
+
+static ASTNode *
+lReplaceParallelForeachCaptures(ASTNode *node, void *d) {
+    ParallelForeachCaptures *captures = (ParallelForeachCaptures *)d;
+    if (SymbolExpr *se = llvm::dyn_cast<SymbolExpr>(node)) {
+        for (unsigned int i = 0; i < captures->symbols.size(); ++i)
+            if (captures->symbols[i] == se->GetBaseSymbol())
+                return new PtrDerefExpr(new SymbolExpr(captures->pointers[i],
+                                                       se->pos), se->pos);
+    }
+    return node;
+}
+
+
+/** Chooses the size of the tile of iterations that each task of a
+    "parallel_foreach" loop with the given number of dimensions runs, given
+    the estimated cost of one gang-wide iteration of its body.  The
+    innermost (last) dimension's extent is always a multiple of the gang
+    size. */
+static void
+lGetParallelForeachTileSize(int nDims, int cost, int tile[3]) {
+    int iterations = std::max(1, (int)PARALLEL_FOREACH_TASK_COST /
+                                 std::max(1, cost));
+    int width = g->target->getVectorWidth();
+    if (nDims == 1) {
+        tile[0] = iterations * width;
+        return;
+    }
+
+    // Make the tiles roughly square, in elements, with the innermost
+    // dimension spanning one or more gangs.
+    int inner = 1;
+    while (inner * inner * 4 <= iterations)
+        inner *= 2;
+    tile[nDims - 1] = inner * width;
+    iterations = std::max(1, iterations / inner);
+    if (nDims == 2)
+        tile[0] = iterations;
+    else {
+        int middle = 1;
+        while (middle * middle * 4 <= iterations)
+            middle *= 2;
+        tile[1] = middle;
+        tile[0] = std::max(1, iterations / middle);
+    }
+}
+
+
+/** Lowers "parallel_foreach" loops.  The body is moved to a new task
+    function, where it's run by a regular foreach over one tile of the
+    iteration space; the statement itself is replaced with the launch of
+    one task for each tile, followed by a sync.  The variables from the
+    enclosing function that the body uses are passed to the tasks by
+    pointer, since they are only accessed until the sync.
+*/
+static Stmt *
+lCreateParallelForeach(const std::vector<Symbol *> &dimSyms,
+                       const std::vector<Expr *> &begins,
+                       const std::vector<Expr *> &ends,
+                       Stmt *body, SourcePos pos) {
+    int nDims = (int)dimSyms.size();
+    if (body == NULL || nDims == 0) {
+        AssertPos(pos, m->errorCount > 0);
+        return NULL;
+    }
+    if (nDims > 3) {
+        Error(pos, "\"parallel_foreach\" loops can have at most three "
+              "dimensions.");
+        return NULL;
+    }
+    if (lTemplate != NULL)
+        // The task function is created when the template is instantiated.
+        return body;
+
+    ParallelForeachCaptures captures;
+    captures.error = false;
+    WalkAST(body, lFindParallelForeachCaptures, NULL, &captures);
+    if (captures.error)
+        return NULL;
+
+    int tile[3];
+    lGetParallelForeachTileSize(nDims, EstimateCost(body), tile);
+
+    // The task function's parameters: the extent of each dimension,
+    // followed by pointers to the captured variables.
+    const Type *int32Type = AtomicType::UniformInt32->GetAsConstType();
+    llvm::SmallVector<const Type *, 8> argTypes;
+    llvm::SmallVector<std::string, 8> argNames;
+    llvm::SmallVector<Expr *, 8> argDefaults;
+    llvm::SmallVector<SourcePos, 8> argPos;
+    std::vector<Symbol *> params;
+    for (int i = 0; i < nDims; ++i) {
+        char name[32];
+        sprintf(name, "__pf_start%d", i);
+        params.push_back(new Symbol(name, pos, int32Type));
+        sprintf(name, "__pf_end%d", i);
+        params.push_back(new Symbol(name, pos, int32Type));
+    }
+    for (unsigned int i = 0; i < captures.symbols.size(); ++i) {
+        const Type *type = captures.symbols[i]->type;
+        if (CastType<ReferenceType>(type) != NULL)
+            type = type->GetReferenceTarget();
+        char name[32];
+        sprintf(name, "__pf_capture%d", (int)i);
+        Symbol *ptr = new Symbol(name, captures.symbols[i]->pos,
+                                 PointerType::GetUniform(type)->GetAsConstType());
+        captures.pointers.push_back(ptr);
+        params.push_back(ptr);
+    }
+    for (unsigned int i = 0; i < params.size(); ++i) {
+        argTypes.push_back(params[i]->type);
+        argNames.push_back(params[i]->name);
+        argDefaults.push_back(NULL);
+        argPos.push_back(params[i]->pos);
+    }
+
+    const FunctionType *taskType =
+        new FunctionType(AtomicType::Void, argTypes, argNames, argDefaults,
+                         argPos, true /* task */, false, false, false);
+    static int count = 0;
+    char taskName[64];
+    sprintf(taskName, "__parallel_foreach_%d", count++);
+    m->AddFunctionDeclaration(taskName, taskType, SC_STATIC, false, pos);
+
+    // Define the task function, as if it appeared at global scope.
+    m->symbolTable->SuspendLocalScopes();
+    m->symbolTable->PushScope();
+    for (unsigned int i = 0; i < params.size(); ++i)
+        m->symbolTable->AddVariable(params[i]);
+    lAddMaskToSymbolTable(pos);
+    lAddThreadIndexCountToSymbolTable(pos);
+
+    // Its body computes the bounds of the task's tile, clamped to the
+    // loop's, and runs the original body over them with a foreach.  The
+    // innermost dimension is mapped to the first task index.
+    body = (Stmt *)WalkAST(body, NULL, lReplaceParallelForeachCaptures, &captures);
+    StmtList *taskBody = new StmtList(pos);
+    std::vector<Expr *> tileBegins, tileEnds;
+    for (int i = 0; i < nDims; ++i) {
+        const char *taskIndexNames[3] = { "taskIndex0", "taskIndex1", "taskIndex2" };
+        Symbol *taskIndex =
+            m->symbolTable->LookupVariable(taskIndexNames[nDims - 1 - i]);
+        Symbol *start = params[2 * i], *end = params[2 * i + 1];
+        Symbol *tileBegin = new Symbol("__pf_tile_begin", pos, int32Type);
+        Symbol *tileEnd = new Symbol("__pf_tile_end", pos, int32Type);
+
+        Expr *beginExpr =
+            new BinaryExpr(BinaryExpr::Add, new SymbolExpr(start, pos),
+                           new BinaryExpr(BinaryExpr::Mul,
+                                          new TypeCastExpr(int32Type,
+                                                           new SymbolExpr(taskIndex, pos),
+                                                           pos),
+                                          new ConstExpr(int32Type, (int32_t)tile[i], pos),
+                                          pos), pos);
+        Expr *endExpr =
+            new SelectExpr(new BinaryExpr(BinaryExpr::Lt,
+                                          new BinaryExpr(BinaryExpr::Add,
+                                                         new SymbolExpr(tileBegin, pos),
+                                                         new ConstExpr(int32Type, (int32_t)tile[i], pos),
+                                                         pos),
+                                          new SymbolExpr(end, pos), pos),
+                           new BinaryExpr(BinaryExpr::Add, new SymbolExpr(tileBegin, pos),
+                                          new ConstExpr(int32Type, (int32_t)tile[i], pos),
+                                          pos),
+                           new SymbolExpr(end, pos), pos);
+
+        std::vector<VariableDeclaration> vars;
+        vars.push_back(VariableDeclaration(tileBegin, beginExpr));
+        vars.push_back(VariableDeclaration(tileEnd, endExpr));
+        taskBody->Add(new DeclStmt(vars, pos));
+        tileBegins.push_back(new SymbolExpr(tileBegin, pos));
+        tileEnds.push_back(new SymbolExpr(tileEnd, pos));
+    }
+    taskBody->Add(new ForeachStmt(dimSyms, tileBegins, tileEnds, body, false, pos));
+    m->AddFunctionDefinition(taskName, taskType, taskBody);
+
+    m->symbolTable->PopScope();
+    m->symbolTable->ResumeLocalScopes();
+
+    // Now replace the loop with the evaluation of its bounds and the
+    // launch of the tasks, if there's anything to do.
+    StmtList *stmts = new StmtList(pos);
+    std::vector<Symbol *> bounds;
+    std::vector<VariableDeclaration> vars;
+    for (int i = 0; i < nDims; ++i) {
+        bounds.push_back(new Symbol("__pf_start", pos, int32Type));
+        bounds.push_back(new Symbol("__pf_end", pos, int32Type));
+        vars.push_back(VariableDeclaration(bounds[2 * i], begins[i]));
+        vars.push_back(VariableDeclaration(bounds[2 * i + 1], ends[i]));
+    }
+    stmts->Add(new DeclStmt(vars, pos));
+
+    Expr *nonEmpty = NULL;
+    Expr *launchCount[3];
+    for (int i = 0; i < 3; ++i)
+        launchCount[i] = new ConstExpr(int32Type, (int32_t)1, pos);
+    ExprList *args = new ExprList(pos);
+    for (int i = 0; i < nDims; ++i) {
+        Expr *test = new BinaryExpr(BinaryExpr::Gt,
+                                    new SymbolExpr(bounds[2 * i + 1], pos),
+                                    new SymbolExpr(bounds[2 * i], pos), pos);
+        nonEmpty = (nonEmpty == NULL) ? test :
+            new BinaryExpr(BinaryExpr::LogicalAnd, nonEmpty, test, pos);
+
+        // (end - start + tile - 1) / tile
+        Expr *extent = new BinaryExpr(BinaryExpr::Sub,
+                                      new SymbolExpr(bounds[2 * i + 1], pos),
+                                      new SymbolExpr(bounds[2 * i], pos), pos);
+        launchCount[nDims - 1 - i] =
+            new BinaryExpr(BinaryExpr::Div,
+                           new BinaryExpr(BinaryExpr::Add, extent,
+                                          new ConstExpr(int32Type, (int32_t)(tile[i] - 1), pos),
+                                          pos),
+                           new ConstExpr(int32Type, (int32_t)tile[i], pos), pos);
+
+        args->exprs.push_back(new SymbolExpr(bounds[2 * i], pos));
+        args->exprs.push_back(new SymbolExpr(bounds[2 * i + 1], pos));
+    }
+    for (unsigned int i = 0; i < captures.symbols.size(); ++i)
+        args->exprs.push_back(new AddressOfExpr(new SymbolExpr(captures.symbols[i], pos),
+                                                pos));
+
+    std::vector<Symbol *> funcs;
+    m->symbolTable->LookupFunction(taskName, &funcs);
+    Expr *func = new FunctionSymbolExpr(taskName, funcs, pos);
+    StmtList *launch = new StmtList(pos);
+    launch->Add(new ExprStmt(new FunctionCallExpr(func, args, pos, true, launchCount), pos));
+    launch->Add(new ExprStmt(new SyncExpr(pos), pos));
+    stmts->Add(new IfStmt(nonEmpty, launch, NULL, false, pos));
+    return stmts;
+}
+
+
+/** Creates the expression for a member access.  In the definition of a
+    function template, the type of the struct may depend on the template
+    parameters, so the access is left unchecked. */
+static Expr *
+lMemberExpr(Expr *expr, const char *identifier, SourcePos pos,
+            SourcePos identifierPos, bool derefLValue) {
+    if (lTemplate != NULL)
+        return expr;
+    return MemberExpr::create(expr, identifier, pos, identifierPos,
+                              derefLValue);
+}
+
+
+/** Adds a parameter of the function template being defined to its scope.
+    Type parameters (with a NULL type) name a TemplateTypeParmType there;
+    integer parameters are declared as constants whose value isn't known
+    until the template is instantiated. */
+static void
+lAddTemplateParameter(const char *name, const Type *type, SourcePos pos) {
+    Assert(lTemplate != NULL);
+    if (std::find(lTemplate->paramNames.begin(), lTemplate->paramNames.end(),
+                  name) != lTemplate->paramNames.end()) {
+        Error(pos, "Redeclaration of template parameter \"%s\".", name);
+        return;
+    }
+
+    if (type == NULL)
+        m->symbolTable->AddScopedType(name,
+                                      new TemplateTypeParmType(name, Variability::Unbound,
+                                                               false, pos));
+    else {
+        const AtomicType *at = CastType<AtomicType>(type);
+        if (at == NULL || at->IsIntType() == false) {
+            Error(pos, "Template parameter \"%s\" must be declared with "
+                  "\"typename\" or an integer type.", name);
+            return;
+        }
+        type = at->GetAsUniformType()->GetAsConstType();
+        m->symbolTable->AddVariable(new Symbol(name, pos, type));
+    }
+
+    lTemplate->paramNames.push_back(name);
+    lTemplate->paramTypes.push_back(type);
+}
+
+
+/** Called once the declarator of a function template's definition has
+    been parsed: records its function type and adds the template to the
+    symbol table, so that the body can refer to it. */
+static void
+lStartTemplateDefinition(DeclSpecs *ds, Declarator *decl) {
+    Assert(lTemplate != NULL);
+    if (ds == NULL || decl == NULL)
+        return;
+
+    decl->InitFromDeclSpecs(ds);
+    const FunctionType *ft = NULL;
+    if (decl->type != NULL)
+        ft = CastType<FunctionType>(decl->type->ResolveUnboundVariability(Variability::Varying));
+    if (ft == NULL) {
+        if (decl->type != NULL)
+            Error(decl->pos, "Only function templates are supported.");
+        return;
+    }
+    if (ds->storageClass == SC_TYPEDEF || ds->storageClass == SC_EXTERN_C) {
+        Error(decl->pos, "Illegal storage class \"%s\" for function template.",
+              lGetStorageClassString(ds->storageClass));
+        return;
+    }
+    if (ft->isExported) {
+        Error(decl->pos, "Function templates can't be \"export\"ed.");
+        return;
+    }
+
+    std::vector<Symbol *> funcs;
+    m->symbolTable->LookupFunction(decl->name.c_str(), &funcs);
+    if (funcs.size() > 0) {
+        Error(decl->pos, "Function template \"%s\" has the same name as a "
+              "previously-declared function.", decl->name.c_str());
+        return;
+    }
+
+    lTemplate->name = decl->name;
+    lTemplate->pos = decl->pos;
+    lTemplate->type = ft;
+    lTemplate->storageClass = ds->storageClass;
+    lTemplate->isInline = (ds->typeQualifiers & TYPEQUAL_INLINE) != 0;
+    if (m->symbolTable->AddFunctionTemplate(lTemplate) == false) {
+        FunctionTemplate *prev =
+            m->symbolTable->LookupFunctionTemplate(decl->name.c_str());
+        Error(decl->pos, "Redefinition of function template \"%s\" "
+              "(previously defined at %s:%d).", decl->name.c_str(),
+              prev->pos.name, prev->pos.first_line);
+        lTemplate->type = NULL;
+    }
+}
+
+
+/** A use of a function template that needs its definition parsed with
+    the given arguments. */
+struct TemplateInstantiation {
+    FunctionTemplate *templ;
+    std::string name;
+    std::map<std::string, const Type *> typeArgs;
+    std::vector<int> intArgs;
+    int depth;
+};
+
+static std::vector<TemplateInstantiation> lPendingInstantiations;
+/** Depth of the template instantiation being parsed; 0 for the source
+    file itself. */
+static int lInstantiationDepth = 0;
+
+#define MAX_TEMPLATE_INSTANTIATION_DEPTH 64
+
+
+/** Handles "name<args>", the use of a function template: returns the
+    function symbol for the specialization of the template for the given
+    arguments, declaring it if this is the first use with them.  Its
+    definition is parsed by InstantiateFunctionTemplates(). */
+static Expr *
+lInstantiateTemplate(const std::string &name, std::vector<TemplateArg> *args,
+                     SourcePos pos) {
+    FunctionTemplate *templ =
+        m->symbolTable->LookupFunctionTemplate(name.c_str());
+    if (templ == NULL || args == NULL) {
+        AssertPos(pos, m->errorCount > 0);
+        return NULL;
+    }
+    if (templ->type == NULL)
+        // Error in the template's definition
+        return NULL;
+    if (args->size() != templ->paramNames.size()) {
+        Error(pos, "Function template \"%s\" takes %d template arguments, "
+              "but %d were provided.", name.c_str(),
+              (int)templ->paramNames.size(), (int)args->size());
+        return NULL;
+    }
+
+    if (lTemplate != NULL) {
+        // A use in the definition of a template is only checked for
+        // syntax; it's instantiated along with the template.
+        std::vector<Symbol *> none;
+        return new FunctionSymbolExpr(name.c_str(), none, pos);
+    }
+
+    TemplateInstantiation inst;
+    inst.templ = templ;
+    inst.name = name + "___";
+    for (unsigned int i = 0; i < args->size(); ++i) {
+        const TemplateArg &arg = (*args)[i];
+        const std::string &paramName = templ->paramNames[i];
+        std::string argString;
+        if (templ->paramTypes[i] == NULL) {
+            if (arg.type == NULL) {
+                Error(arg.pos, "Template argument for \"%s\" must be a type.",
+                      paramName.c_str());
+                return NULL;
+            }
+            inst.typeArgs[paramName] = arg.type;
+            argString = arg.type->GetString();
+        }
+        else {
+            int value;
+            if (arg.expr == NULL) {
+                Error(arg.pos, "Template argument for \"%s\" must be an "
+                      "integer constant.", paramName.c_str());
+                return NULL;
+            }
+            if (lGetConstantInt(arg.expr, &value, arg.pos,
+                                "Template argument") == false)
+                return NULL;
+            inst.intArgs.push_back(value);
+            char buf[32];
+            sprintf(buf, "%d", value);
+            argString = buf;
+        }
+
+        if (i > 0)
+            inst.name += "__";
+        for (unsigned int j = 0; j < argString.size(); ++j) {
+            unsigned char c = argString[j];
+            if (isalnum(c))
+                inst.name += c;
+            else {
+                char buf[8];
+                sprintf(buf, "_%02x", c);
+                inst.name += buf;
+            }
+        }
+    }
+
+    std::vector<Symbol *> funcs;
+    m->symbolTable->LookupFunction(inst.name.c_str(), &funcs);
+    if (funcs.size() == 0) {
+        inst.depth = lInstantiationDepth + 1;
+        if (inst.depth > MAX_TEMPLATE_INSTANTIATION_DEPTH) {
+            Error(pos, "Maximum depth of nested template instantiations "
+                  "exceeded (%d) when instantiating \"%s\".",
+                  MAX_TEMPLATE_INSTANTIATION_DEPTH, name.c_str());
+            return NULL;
+        }
+
+        const Type *type =
+            TemplateTypeParmType::Substitute(templ->type, inst.typeArgs);
+        const FunctionType *ft = type ?
+            CastType<FunctionType>(type->ResolveUnboundVariability(Variability::Varying)) :
+            NULL;
+        if (ft == NULL) {
+            AssertPos(pos, m->errorCount > 0);
+            return NULL;
+        }
+        m->AddFunctionDeclaration(inst.name, ft, templ->storageClass,
+                                  templ->isInline, templ->pos);
+        m->symbolTable->LookupFunction(inst.name.c_str(), &funcs);
+        if (funcs.size() == 0)
+            return NULL;
+        lPendingInstantiations.push_back(inst);
+    }
+    return new FunctionSymbolExpr(inst.name.c_str(), funcs, pos);
+}
+
+
+/** Parses the definitions of the function templates instantiated in the
+    source file, each with the template parameters bound to the arguments
+    it was instantiated with, as an ordinary function named with the
+    mangled name of the instantiation.  Instantiations that these
+    definitions use are handled in turn. */
+void
+InstantiateFunctionTemplates() {
+    // (After a syntax error, the parser may not have finished the
+    // definition of a template.)
+    lTemplate = NULL;
+
+    // Instantiating a template may add more to the end of the list.
+    for (unsigned int i = 0; i < lPendingInstantiations.size(); ++i) {
+        TemplateInstantiation inst = lPendingInstantiations[i];
+        FunctionTemplate *templ = inst.templ;
+        if (templ->tokens.size() == 0)
+            continue;
+
+        m->symbolTable->PushScope();
+        unsigned int intIndex = 0;
+        for (unsigned int j = 0; j < templ->paramNames.size(); ++j) {
+            const char *paramName = templ->paramNames[j].c_str();
+            const Type *paramType = templ->paramTypes[j];
+            if (paramType == NULL)
+                m->symbolTable->AddScopedType(paramName, inst.typeArgs[paramName]);
+            else {
+                Expr *value =
+                    new ConstExpr(AtomicType::UniformInt32->GetAsConstType(),
+                                  (int32_t)inst.intArgs[intIndex++], templ->pos);
+                value = Optimize(new TypeCastExpr(paramType, value, templ->pos));
+                Symbol *sym = new Symbol(paramName, templ->pos, paramType);
+                sym->constValue = llvm::dyn_cast_or_null<ConstExpr>(value);
+                m->symbolTable->AddVariable(sym);
+            }
+        }
+
+        // The definition, with the function renamed.
+        std::vector<TemplateToken> tokens = templ->tokens;
+        for (unsigned int j = 0; j < tokens.size(); ++j)
+            if (tokens[j].token == TOKEN_IDENTIFIER &&
+                tokens[j].text == templ->name) {
+                tokens[j].text = inst.name;
+                tokens[j].stringVal = inst.name;
+                break;
+            }
+
+        lInstantiationDepth = inst.depth;
+        ReplayTemplateTokens(&tokens);
+        yyparse();
+        ReplayTemplateTokens(NULL);
+        m->symbolTable->PopScope();
+    }
+
+    lPendingInstantiations.clear();
+    lInstantiationDepth = 0;
+}
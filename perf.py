@@ -346,6 +346,25 @@ def perf(options1, args):
             if not (" " + iterator + " " in test_only_r):
                 error("unknow option for target: " + iterator, 1)
 
+    # With --cpp-avx2 (--cpp-skx) the test binary is built from the C++
+    # emitted for generic-8 (generic-16) with examples/intrinsics/avx2.h
+    # (skx.h), while the reference keeps using the native target.
+    test_suffix = ""
+    if options.cpp_avx2 and options.cpp_skx:
+        error("--cpp-avx2 and --cpp-skx can't be used together", 1)
+    if options.cpp_avx2:
+        if is_windows:
+            error("--cpp-avx2 is not supported on Windows", 1)
+        test_suffix = "-avx2"
+        if options.perf_target == "":
+            options.perf_target = "avx2-i32x8"
+    if options.cpp_skx:
+        if is_windows:
+            error("--cpp-skx is not supported on Windows", 1)
+        test_suffix = "-skx"
+        if options.perf_target == "":
+            options.perf_target = "avx512skx-i32x16"
+
     # check if cpu usage is low now
     cpu_percent = cpu_check()
     if cpu_percent > 20:
@@ -488,9 +507,9 @@ def perf(options1, args):
 	    Target_out = target_out_temp + perf_targets[target_i]
             if is_windows == False:
                 ex_command_ref = "./ref " + command + " >> " + perf_temp + "_ref"
-                ex_command = "./test " + command + " >> " + perf_temp + "_test"
+                ex_command = "./test" + test_suffix + " " + command + " >> " + perf_temp + "_test"
                 bu_command_ref = "make CXX="+ref_compiler+" CC="+refc_compiler+ " EXAMPLE=ref ISPC="+ispc_ref+target_str+" >> "+build_log+" 2>> "+build_log
-                bu_command = "make CXX="+ref_compiler+" CC="+refc_compiler+ " EXAMPLE=test ISPC="+ispc_test+target_str+" >> "+build_log+" 2>> "+build_log
+                bu_command = "make CXX="+ref_compiler+" CC="+refc_compiler+ " EXAMPLE=test ISPC="+ispc_test+target_str+" test"+test_suffix+" >> "+build_log+" 2>> "+build_log
                 re_command = "make clean >> "+build_log
             else:
                 ex_command_ref = "x64\\Release\\ref.exe " + command + " >> " + perf_temp + "_ref"
@@ -575,5 +594,13 @@ if __name__ == "__main__":
         help='file to save perf output', default="")
     parser.add_option('-t', '--target', dest='perf_target',
         help='set ispc target for building benchmarks (both test and ref)', default="")
+    parser.add_option('--cpp-avx2', dest='cpp_avx2',
+        help='build the test with --emit-c++ for generic-8 and examples/intrinsics/avx2.h, ' +
+        'to compare it with the native avx2-i32x8 target built by the reference compiler',
+        default=False, action="store_true")
+    parser.add_option('--cpp-skx', dest='cpp_skx',
+        help='build the test with --emit-c++ for generic-16 and examples/intrinsics/skx.h, ' +
+        'to compare it with the native avx512skx-i32x16 target built by the reference compiler',
+        default=False, action="store_true")
     (options, args) = parser.parse_args()
     perf(options, args)
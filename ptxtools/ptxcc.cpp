@@ -41,7 +41,10 @@ met:
 #include <fstream>
 #include <cassert>
 #include <algorithm>
+#include <sstream>
 #include <sys/time.h>
+#include <stdint.h>
+#include <unistd.h>
 #include "PTXParser.h"
 #include "GPUTargets.h"
 
@@ -115,6 +118,29 @@ static std::vector<std::string> lSplitString(const std::string &s, char delim)
   return elems;
 }
 
+/* 64-bit FNV-1a hash; only used to name entries in the object cache */
+static uint64_t lHashString(const std::string &s, uint64_t hash = 14695981039346656037ULL)
+{
+  for (size_t i = 0; i < s.size(); i++)
+  {
+    hash ^= (unsigned char)s[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static bool lCopyFile(const std::string &from, const std::string &to)
+{
+  std::ifstream in(from.c_str(), std::ios::binary);
+  if (!in)
+    return false;
+  std::ofstream out(to.c_str(), std::ios::binary);
+  if (!out)
+    return false;
+  out << in.rdbuf();
+  return (bool)out;
+}
+
 static void lUsage(const int ret)
 {
   fprintf(stdout, "\nusage: ptxcc [options] file.ptx \n");
@@ -127,6 +153,8 @@ static void lUsage(const int ret)
   fprintf(stdout, "\n");
   fprintf(stdout, "    [-o <name>]\t\t\t Output file name\n");
   fprintf(stdout, "    [-Xnvcc=<arguments>]\t Arguments to pass through to \"nvcc\"\n");
+  fprintf(stdout, "    [--cache-dir=<dir>]\t\t Reuse objects compiled from identical PTX, arch and\n");
+  fprintf(stdout, "     \t\t\t\t   \"nvcc\" arguments (default: $ISPC_PTXCC_CACHE, if set)\n");
   fprintf(stdout, " \n");
   exit(ret);
 }
@@ -144,6 +172,8 @@ int main(int _argc, char * _argv[])
   bool keepTemporaries = false;
   bool verbose = false;
   std::string nvccArguments;
+  const char *cacheEnv = getenv("ISPC_PTXCC_CACHE");
+  std::string cacheDir = cacheEnv ? cacheEnv : "";
 
   for (int i = 1; i < argc; ++i) 
   {
@@ -157,6 +187,8 @@ int main(int _argc, char * _argv[])
       verbose = true;
     else if (!strncmp(argv[i], "-Xnvcc=", 7))
       nvccArguments = std::string(argv[i]+7);
+    else if (!strncmp(argv[i], "--cache-dir=", 12))
+      cacheDir = std::string(argv[i]+12);
     else if (!strcmp(argv[i], "-o"))
     {
       if (++i == argc)
@@ -219,6 +251,28 @@ int main(int _argc, char * _argv[])
     exit(1);
   }
 
+  // The cached object is keyed by a hash of the PTX source, the target
+  // arch and the nvcc arguments; on a hit, nvcc isn't run at all.
+  std::string fileCache;
+  if (!cacheDir.empty())
+  {
+    std::stringstream ptxSource;
+    ptxSource << inputPTX.rdbuf();
+    inputPTX.clear();
+    inputPTX.seekg(0);
+    const uint64_t hash = lHashString(nvccArguments,
+                                      lHashString(ptxSource.str()));
+    char hashString[17];
+    snprintf(hashString, sizeof(hashString), "%016llx", (unsigned long long)hash);
+    fileCache = cacheDir + "/" + hashString + "_" + arch + ".o";
+    if (lCopyFile(fileCache, fileOBJ))
+    {
+      if (verbose)
+        fprintf(stderr, "cache hit: %s\n", fileCache.c_str());
+      return 0;
+    }
+  }
+
   std::string randomBaseName = std::string("/tmp/") + lRandomString(8) + "_" + lSplitString(lSplitString(filePTX,'/').back(),'.')[0];
   if (verbose)
     fprintf(stderr, "baseFileName= %s\n", randomBaseName.c_str());
@@ -311,6 +365,17 @@ int main(int _argc, char * _argv[])
     }
   }
 
+  if (!fileCache.empty())
+  {
+    /* write under a temporary name first, so that concurrent builds
+     * never see a partially written object */
+    const std::string fileTmp = fileCache + "." + lRandomString(8);
+    if (lCopyFile(fileOBJ, fileTmp))
+      rename(fileTmp.c_str(), fileCache.c_str());
+    else
+      unlink(fileTmp.c_str());
+  }
+
   if (!keepTemporaries)
   {
     /* remove temporaries */
@@ -152,6 +152,20 @@ def check_test(filename):
     return done
 
 
+# Tests may ask for additional ispc flags (e.g. to enable an optimization
+# that's off by default) with comment lines of the form
+# "// ispc-flags: <flags>"; returns those flags.
+def get_test_flags(filename):
+    test_flags = ""
+    file = open(filename, 'r')
+    for line in file:
+        flags_match = re.match(r"\s*//\s*ispc-flags:(.*)", line)
+        if flags_match != None:
+            test_flags += " " + flags_match.group(1).strip()
+    file.close()
+    return test_flags
+
+
 def run_test(testname):
     # testname is a path to the test from the root of ispc dir
     # filename is a path to the test from the current dir
@@ -171,6 +185,7 @@ def run_test(testname):
         else:
             ispc_cmd = ispc_exe_rel + " --werror --nowrap %s --arch=%s --target=%s" % \
                 (filename, options.arch, options.target) 
+        ispc_cmd += get_test_flags(filename)
         (return_code, output) = run_command(ispc_cmd)
         got_error = (return_code != 0)
 
@@ -246,6 +261,8 @@ def run_test(testname):
 
                 if options.arch == 'arm':
                      gcc_arch = '--with-fpu=hardfp -marm -mfpu=neon -mfloat-abi=hard'
+                elif options.arch == 'aarch64':
+                     gcc_arch = ''
                 else:
                     if options.arch == 'x86':
                         gcc_arch = '-m32'
@@ -258,11 +275,15 @@ def run_test(testname):
                 if (options.target == 'generic-8'):
                   if (options.include_file.find("knc-i1x8.h")!=-1 or options.include_file.find("knc-i1x8unsafe_fast.h")!=-1):
                     gcc_isa = '-mmic'
+                  elif (options.include_file.find("avx2.h")!=-1):
+                    gcc_isa = '-mavx2 -mfma -mf16c -mbmi2 -mpopcnt'
                   else:
                     gcc_isa = '-mavx'
                 if (options.target == 'generic-16' or options.target == 'generic-32' or options.target == 'generic-64') \
                         and (options.include_file.find("knc-i1x16.h")!=-1 or options.include_file.find("knc.h")!=-1 or options.include_file.find("knc2x.h")!=-1):
                     gcc_isa = '-mmic'
+                if (options.target == 'generic-16') and (options.include_file.find("skx.h")!=-1):
+                    gcc_isa = '-mavx512f -mavx512bw -mavx512dq -mavx512vl -mfma -mf16c -mpopcnt'
 
                 if (options.target == "knc-generic"):
                     cc_cmd = "%s -O2 -I. %s %s test_static.cpp -DTEST_SIG=%d %s -o %s" % \
@@ -300,6 +321,7 @@ def run_test(testname):
 
             if options.no_opt:
                 ispc_cmd += " -O0" 
+            ispc_cmd += get_test_flags(filename)
             if is_generic_target:
                 ispc_cmd += " --emit-c++ --c++-include-file=%s" % add_prefix(options.include_file)
 
@@ -554,6 +576,7 @@ def verify():
              ["sse2-i32x4", "sse2-i32x8", "sse4-i32x4", "sse4-i32x8", "sse4-i16x8",
               "sse4-i8x16", "avx1-i32x4" "avx1-i32x8", "avx1-i32x16", "avx1-i64x4", "avx1.1-i32x8",
               "avx1.1-i32x16", "avx1.1-i64x4", "avx2-i32x8", "avx2-i32x16", "avx2-i64x4",
+              "avx2-i16x16", "avx2-i8x32",
               "generic-1", "generic-4", "generic-8",
               "generic-16", "generic-32", "generic-64", "knc-generic", "knl-generic", "avx512knl-i32x16"]]
     for i in range (0,len(f_lines)):
@@ -642,7 +665,8 @@ def run_tests(options1, args, print_version):
             options.include_file = "examples/intrinsics/sse4.h"
             options.target = "generic-4"
         elif options.target == "generic-8" or options.target == "generic-x8":
-            error("No generics #include specified and no default available for \"generic-8\" target.\n", 1)
+            error("No generics #include specified; using examples/intrinsics/avx2.h\n", 2)
+            options.include_file = "examples/intrinsics/avx2.h"
             options.target = "generic-8"
         elif options.target == "generic-16" or options.target == "generic-x16":
             error("No generics #include specified; using examples/intrinsics/generic-16.h\n", 2)
@@ -909,7 +933,7 @@ if __name__ == "__main__":
                   'avx2-i32x8, avx2-i32x16, avx512knl-i32x16, generic-x1, generic-x4, generic-x8, generic-x16, ' + 
                   'generic-x32, generic-x64, knc-generic, knl-generic)'), default="sse4")
     parser.add_option('-a', '--arch', dest='arch',
-                  help='Set architecture (arm, x86, x86-64)',default="x86-64")
+                  help='Set architecture (arm, aarch64, x86, x86-64)',default="x86-64")
     parser.add_option("-c", "--compiler", dest="compiler_exe", help="C/C++ compiler binary to use to run tests",
                   default=None)
     parser.add_option('-o', '--no-opt', dest='no_opt', help='Disable optimization',
@@ -66,6 +66,7 @@
   #include <llvm/IR/LLVMContext.h>
   #include <llvm/IR/Metadata.h>
   #include <llvm/IR/CallingConv.h>
+  #include <llvm/IR/Intrinsics.h>
 #endif
 #include <llvm/Support/raw_ostream.h>
 
@@ -267,7 +268,44 @@ DeclStmt::EmitCode(FunctionEmitContext *ctx) const {
             return;
         }
 
-        if (sym->storageClass == SC_STATIC) {
+        if (sym->storageClass == SC_TASK_LOCAL) {
+#ifdef ISPC_NVPTX_ENABLED
+            if (g->target->getISA() == Target::NVPTX) {
+                Error(sym->pos, "\"task_local\" variable \"%s\" is not "
+                      "supported with \"nvptx\" target.", sym->name.c_str());
+                return;
+            }
+#endif /* ISPC_NVPTX_ENABLED */
+            if (sym->type->IsConstType()) {
+                Error(sym->pos, "\"task_local\" variable \"%s\" can't be "
+                      "\"const\".", sym->name.c_str());
+                continue;
+            }
+            if (initExpr != NULL) {
+                Error(initExpr->pos, "Initializer can't be provided with "
+                      "\"task_local\" variable \"%s\".", sym->name.c_str());
+                continue;
+            }
+
+            // One copy per worker thread, allocated once when the thread
+            // starts and then reused by every task that runs on it.
+            // Cache-line alignment keeps different threads' copies from
+            // sharing a line.
+            llvm::GlobalVariable *gv =
+                new llvm::GlobalVariable(*m->module, llvmType, false,
+                                         llvm::GlobalValue::InternalLinkage,
+                                         llvm::Constant::getNullValue(llvmType),
+                                         llvm::Twine("task_local.") +
+                                         llvm::Twine(sym->pos.first_line) +
+                                         llvm::Twine(".") + sym->name.c_str());
+            gv->setThreadLocal(true);
+            gv->setAlignment(64);
+            sym->storagePtr = gv;
+
+            // Tell the FunctionEmitContext about the variable
+            ctx->EmitVariableDebugInfo(sym);
+        }
+        else if (sym->storageClass == SC_STATIC) {
 #ifdef ISPC_NVPTX_ENABLED
             if (g->target->getISA() == Target::NVPTX && !sym->type->IsConstType())
             {
@@ -375,11 +413,11 @@ DeclStmt::EmitCode(FunctionEmitContext *ctx) const {
                 nel *= at->GetElementCount();
                 if (sym->type->IsSOAType())
                   nel *= sym->type->GetSOAWidth();
-                nat = new ArrayType(at->GetElementType(), nel);
+                nat = ArrayType::Get(at->GetElementType(), nel);
                 variable = false;
               }
               else
-                nat = new ArrayType(sym->type, nel);
+                nat = ArrayType::Get(sym->type, nel);
 
               llvm::Type *llvmTypeUn = nat->LLVMType(g->ctx);
               llvm::Constant *cinit = llvm::UndefValue::get(llvmTypeUn);
@@ -579,6 +617,15 @@ IfStmt::EmitCode(FunctionEmitContext *ctx) const {
     if (!testType)
         return;
 
+    bool unswitchedValue;
+    if (ctx->GetUnswitchedIf(this, &unswitchedValue)) {
+        // The test was hoisted out of the enclosing foreach loop, and
+        // its value is known in the copy of the loop being emitted.
+        lEmitIfStatements(ctx, unswitchedValue ? trueStmts : falseStmts,
+                          unswitchedValue ? "true" : "false");
+        return;
+    }
+
     ctx->SetDebugPos(pos);
     bool isUniform = testType->IsUniformType();
 
@@ -716,13 +763,83 @@ IfStmt::emitMaskedTrueAndFalse(FunctionEmitContext *ctx, llvm::Value *oldMask,
     }
 }
 
+/** Lane-occupancy profile data for a varying 'if', from --profile-use. */
+struct IfProfile {
+    /** Fraction of the times the 'if' ran with all lanes on. */
+    double allOn;
+    /** Fraction of the times that all of the active lanes agreed on the
+        value of the test, so that only one of the two sides had to run. */
+    double uniformTest;
+};
+
+
+/** Looks up the profile for the varying 'if' at the given position,
+    returning false if there isn't one or if there weren't enough samples
+    to go on. */
+static bool
+lGetIfProfile(SourcePos pos, IfProfile *profile) {
+    const std::vector<int64_t> *mask =
+        GetOccupancyProfile(pos, "varying if: mask");
+    const std::vector<int64_t> *testTrue =
+        GetOccupancyProfile(pos, "varying if: test true");
+    const std::vector<int64_t> *testFalse =
+        GetOccupancyProfile(pos, "varying if: test false");
+    if (mask == NULL || testTrue == NULL || testFalse == NULL)
+        return false;
+
+    int64_t count = 0;
+    for (size_t i = 0; i < mask->size(); ++i)
+        count += (*mask)[i];
+    if (count < 16)
+        return false;
+
+    profile->allOn = double(mask->back()) / count;
+    profile->uniformTest =
+        std::min(1., double((*testTrue)[0] + (*testFalse)[0]) / count);
+    return true;
+}
+
+
 /** Emit code for an if test that checks the mask and the test values and
     tries to be smart about jumping over code that doesn't need to be run.
  */
 void
 IfStmt::emitVaryingIf(FunctionEmitContext *ctx, llvm::Value *ltest) const {
     llvm::Value *oldMask = ctx->GetInternalMask();
-    if (doAllCheck) {
+
+    ctx->SetDebugPos(pos);
+    if (g->emitOccupancyProfile) {
+        // Record how often the mask coming in is all on and how often the
+        // active lanes all agree about the test, for --profile-use.  These
+        // points don't depend on the code we choose to emit below.
+        llvm::Value *fullMask = ctx->GetFullMask();
+        ctx->AddOccupancyPoint("varying if: mask", fullMask);
+        ctx->AddOccupancyPoint("varying if: test true",
+            ctx->BinaryOperator(llvm::Instruction::And, fullMask, ltest,
+                                "test_true"));
+        ctx->AddOccupancyPoint("varying if: test false",
+            ctx->BinaryOperator(llvm::Instruction::And, fullMask,
+                                ctx->NotOperator(ltest), "test_false"));
+    }
+
+    // With profile data, use coherent control flow if the 'if' usually
+    // starts with all lanes on and only needs to run one of its sides;
+    // otherwise the extra checks and code are just overhead.
+    IfProfile profile;
+    bool haveProfile = lGetIfProfile(pos, &profile);
+    bool coherent = doAllCheck;
+    if (haveProfile && !g->opt.disableCoherentControlFlow) {
+        coherent = (profile.allOn >= 0.5 && profile.uniformTest >= 0.5);
+        if (coherent != doAllCheck)
+            OptRemark(OptRemarkPassed, pos, "ispc", "ProfileGuidedIf", NULL,
+                      "Using %s control flow for \"%s\"; the mask was all on "
+                      "%.0f%% of the time and the test was uniform %.0f%% of "
+                      "the time.", coherent ? "coherent" : "non-coherent",
+                      doAllCheck ? "cif" : "if", 100. * profile.allOn,
+                      100. * profile.uniformTest);
+    }
+
+    if (coherent) {
         // We can't tell if the mask going into the if is all on at the
         // compile time.  Emit code to check for this and then either run
         // the code for the 'all on' or the 'mixed' case depending on the
@@ -779,6 +896,13 @@ IfStmt::emitVaryingIf(FunctionEmitContext *ctx, llvm::Value *ltest) const {
               ::EstimateCost(trueStmts), (int)SafeToRunWithMaskAllOff(trueStmts),
               ::EstimateCost(falseStmts), (int)SafeToRunWithMaskAllOff(falseStmts));
 
+        // When the profile shows that one of the sides usually doesn't
+        // need to run, jumping over it beats running both with the mask
+        // updated; when both sides usually run, the checks for that are
+        // pure overhead, regardless of how much code there is.
+        if (haveProfile)
+            costIsAcceptable = (profile.uniformTest < 0.25);
+
         if (safeToRunWithAllLanesOff &&
             (costIsAcceptable || g->opt.disableCoherentControlFlow)) {
             ctx->StartVaryingIf(oldMask);
@@ -1016,9 +1140,57 @@ lHasVaryingBreakOrContinue(Stmt *stmt) {
 }
 
 
+/** Attaches "llvm.loop" metadata with the unroll hint given by a "#pragma
+    unroll" to the terminator of the given basic block, which should be
+    the one that branches back to the start of the loop.  The LLVM loop
+    unrolling pass then follows the hint.
+ */
+static void
+lAddLoopUnrollMetadata(llvm::BasicBlock *bblock, int unrollCount,
+                       SourcePos pos) {
+    if (unrollCount < 0 || bblock == NULL)
+        return;
+
+    llvm::Instruction *latch = bblock->getTerminator();
+    if (latch == NULL)
+        return;
+
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6
+    std::vector<llvm::Metadata *> hint;
+    if (unrollCount == 0)
+        hint.push_back(llvm::MDString::get(*g->ctx, "llvm.loop.unroll.full"));
+    else if (unrollCount == 1)
+        hint.push_back(llvm::MDString::get(*g->ctx, "llvm.loop.unroll.disable"));
+    else {
+        hint.push_back(llvm::MDString::get(*g->ctx, "llvm.loop.unroll.count"));
+        hint.push_back(llvm::ConstantAsMetadata::get(LLVMInt32(unrollCount)));
+    }
+
+    // The loop id is a distinct node whose first operand refers to
+    // itself; a uniqued node would be shared by all of the loops with the
+    // same hint, and LLVM could then merge or drop the hints.  Distinct
+    // nodes aren't uniqued, so the first operand can start out null and be
+    // pointed at the node once it exists.
+    std::vector<llvm::Metadata *> loopId;
+    loopId.push_back(NULL);
+    loopId.push_back(llvm::MDNode::get(*g->ctx, hint));
+    llvm::MDNode *md = llvm::MDNode::getDistinct(*g->ctx, loopId);
+    md->replaceOperandWith(0, md);
+    latch->setMetadata("llvm.loop", md);
+#else
+    static bool warned = false;
+    if (!warned) {
+        Warning(pos, "\"#pragma unroll\" requires LLVM 3.6 or later; ignoring it.");
+        warned = true;
+    }
+#endif
+}
+
+
 DoStmt::DoStmt(Expr *t, Stmt *s, bool cc, SourcePos p)
     : Stmt(p, DoStmtID), testExpr(t), bodyStmts(s),
-      doCoherentCheck(cc && !g->opt.disableCoherentControlFlow) {
+      doCoherentCheck(cc && !g->opt.disableCoherentControlFlow),
+      unrollCount(-1) {
 }
 
 
@@ -1112,6 +1284,7 @@ void DoStmt::EmitCode(FunctionEmitContext *ctx) const {
     if (!testValue)
         return;
 
+    llvm::BasicBlock *blatch = ctx->GetCurrentBasicBlock();
     if (uniformTest)
         // For the uniform case, just jump to the top of the loop or the
         // exit basic block depending on the value of the test.
@@ -1124,6 +1297,7 @@ void DoStmt::EmitCode(FunctionEmitContext *ctx) const {
         ctx->SetInternalMaskAnd(mask, testValue);
         ctx->BranchIfMaskAny(bloop, bexit);
     }
+    lAddLoopUnrollMetadata(blatch, unrollCount, pos);
 
     // ...and we're done.  Set things up for subsequent code to be emitted
     // in the right basic block.
@@ -1194,7 +1368,8 @@ DoStmt::Print(int indent) const {
 
 ForStmt::ForStmt(Stmt *i, Expr *t, Stmt *s, Stmt *st, bool cc, SourcePos p)
     : Stmt(p, ForStmtID), init(i), test(t), step(s), stmts(st),
-      doCoherentCheck(cc && !g->opt.disableCoherentControlFlow) {
+      doCoherentCheck(cc && !g->opt.disableCoherentControlFlow),
+      unrollCount(-1) {
 }
 
 
@@ -1320,6 +1495,7 @@ ForStmt::EmitCode(FunctionEmitContext *ctx) const {
     if (step)
         step->EmitCode(ctx);
     ctx->BranchInst(btest);
+    lAddLoopUnrollMetadata(ctx->GetCurrentBasicBlock(), unrollCount, pos);
 
     // Set the current emission basic block to the loop exit basic block
     ctx->SetCurrentBasicBlock(bexit);
@@ -1467,7 +1643,74 @@ ForeachStmt::ForeachStmt(const std::vector<Symbol *> &lvs,
                          const std::vector<Expr *> &ee,
                          Stmt *s, bool t, SourcePos pos)
     : Stmt(pos, ForeachStmtID), dimVariables(lvs), startExprs(se), endExprs(ee), isTiled(t),
-      stmts(s) {
+      stmts(s), unrollCount(-1), laneOrder(LANES_ROW_MAJOR) {
+}
+
+
+/* Returns the offset in the given dimension of the element that the given
+   program instance processes in each iteration of a foreach loop with the
+   given spans.  By default, the lanes are laid out over the tile in
+   row-major order.  With Morton order, the bits of the lane index are
+   dealt out to the dimensions in turn, starting with the innermost one,
+   and with Hilbert order, the lanes follow a Hilbert curve over the tile;
+   this is only possible for square two-dimensional tiles, and Morton
+   order is used for other shapes.
+ */
+static int
+lLaneOffset(int lane, int dim, int nDims, const std::vector<int> &spans,
+            ForeachStmt::LaneOrder order) {
+    if (order == ForeachStmt::LANES_HILBERT && nDims == 2 &&
+        spans[0] == spans[1]) {
+        int x = 0, y = 0, t = lane;
+        for (int s = 1; s < spans[1]; s *= 2) {
+            int rx = 1 & (t / 2);
+            int ry = 1 & (t ^ rx);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+            x += s * rx;
+            y += s * ry;
+            t /= 4;
+        }
+        return (dim == 1) ? x : y;
+    }
+    else if (order != ForeachStmt::LANES_ROW_MAJOR) {
+        std::vector<int> bitsLeft(nDims, 0);
+        for (int j = 0; j < nDims; ++j)
+            while ((1 << bitsLeft[j]) < spans[j])
+                ++bitsLeft[j];
+
+        int offset = 0, offsetBit = 0, laneBit = 0;
+        bool anyLeft = true;
+        while (anyLeft) {
+            anyLeft = false;
+            for (int j = nDims-1; j >= 0; --j) {
+                if (bitsLeft[j] == 0)
+                    continue;
+                if (j == dim)
+                    offset |= ((lane >> laneBit) & 1) << offsetBit++;
+                --bitsLeft[j];
+                ++laneBit;
+                anyLeft = true;
+            }
+        }
+        return offset;
+    }
+
+    int d = lane;
+    // First, account for the effect of any dimensions at deeper
+    // nesting levels than the current one.
+    int prevDimSpanCount = 1;
+    for (int j = dim; j < nDims-1; ++j)
+        prevDimSpanCount *= spans[j+1];
+    d /= prevDimSpanCount;
+
+    // And now with what's left, figure out our own offset
+    return d % spans[dim];
 }
 
 
@@ -1479,7 +1722,8 @@ static llvm::Value *
 lUpdateVaryingCounter(int dim, int nDims, FunctionEmitContext *ctx,
                       llvm::Value *uniformCounterPtr,
                       llvm::Value *varyingCounterPtr,
-                      const std::vector<int> &spans) {
+                      const std::vector<int> &spans,
+                      ForeachStmt::LaneOrder order) {
 #ifdef ISPC_NVPTX_ENABLED
     if (g->target->getISA() == Target::NVPTX)
     {
@@ -1499,16 +1743,7 @@ lUpdateVaryingCounter(int dim, int nDims, FunctionEmitContext *ctx,
       std::vector<llvm::Constant*> constDeltaList;
       for (int i = 0; i < vecWidth; ++i) 
       {
-        int d = i;
-        // First, account for the effect of any dimensions at deeper
-        // nesting levels than the current one.
-        int prevDimSpanCount = 1;
-        for (int j = dim; j < nDims-1; ++j)
-          prevDimSpanCount *= spans[j+1];
-        d /= prevDimSpanCount;
-
-        // And now with what's left, figure out our own offset
-        delta[i] = d % spans[dim];
+        delta[i] = lLaneOffset(i, dim, nDims, spans, order);
         constDeltaList.push_back(LLVMInt8(delta[i]));
       }
 
@@ -1585,18 +1820,8 @@ lUpdateVaryingCounter(int dim, int nDims, FunctionEmitContext *ctx,
     // (0,1,2,3,0,1,2,3), and for the outer dimension we want
     // (0,0,0,0,1,1,1,1).
     int32_t delta[ISPC_MAX_NVEC];
-    for (int i = 0; i < g->target->getVectorWidth(); ++i) {
-        int d = i;
-        // First, account for the effect of any dimensions at deeper
-        // nesting levels than the current one.
-        int prevDimSpanCount = 1;
-        for (int j = dim; j < nDims-1; ++j)
-            prevDimSpanCount *= spans[j+1];
-        d /= prevDimSpanCount;
-
-        // And now with what's left, figure out our own offset
-        delta[i] = d % spans[dim];
-    }
+    for (int i = 0; i < g->target->getVectorWidth(); ++i)
+        delta[i] = lLaneOffset(i, dim, nDims, spans, order);
 
     // Add the deltas to compute the varying counter values; store the
     // result to memory and then return it directly as well.
@@ -1656,17 +1881,303 @@ lGetSpans(int dimsLeft, int nDims, int itemsLeft, bool isTiled, int *a) {
 }
 
 
+/* Returns the alignment in bytes that can be had for the address of each
+   full vector's worth of elements from a "#pragma align" pointer in a
+   foreach loop with the given span, and the size of the pointed-to
+   elements in *eltSize.  Zero is returned if no useful alignment is
+   possible (i.e. when the element size isn't a power of two).
+ */
+static int
+lForeachPointerAlignment(const PointerType *pt, int span, int *eltSize) {
+    llvm::Type *eltType = pt->GetBaseType()->LLVMType(g->ctx);
+    if (eltType == NULL)
+        return 0;
+
+    *eltSize = (int)g->target->getDataLayout()->getTypeAllocSize(eltType);
+    if (*eltSize <= 0 || (*eltSize & (*eltSize - 1)) != 0)
+        return 0;
+
+    int alignment = (*eltSize) * span;
+    if (alignment > g->target->getNativeVectorAlignment())
+        alignment = g->target->getNativeVectorAlignment();
+    return (alignment > *eltSize) ? alignment : 0;
+}
+
+
+/* Emits code that computes the offset of &basePtr[index] from the nearest
+   smaller address with the given alignment.
+ */
+static llvm::Value *
+lEmitMisalignment(FunctionEmitContext *ctx, llvm::Value *basePtr,
+                  llvm::Value *index, const PointerType *pt, int alignment) {
+    llvm::Value *ptr = ctx->GetElementPtrInst(basePtr, index, pt, "align_ptr");
+    llvm::Value *ptrInt = ctx->PtrToIntInst(ptr, "align_ptr_int");
+    return ctx->BinaryOperator(llvm::Instruction::And, ptrInt,
+                               llvm::ConstantInt::get(ptrInt->getType(),
+                                                      alignment - 1),
+                               "misalign");
+}
+
+
+/* Emits a test of whether &basePtr[index] has the given alignment.
+ */
+static llvm::Value *
+lEmitIsAligned(FunctionEmitContext *ctx, llvm::Value *basePtr,
+               llvm::Value *index, const PointerType *pt, int alignment) {
+    llvm::Value *misalign =
+        lEmitMisalignment(ctx, basePtr, index, pt, alignment);
+    return ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                        misalign, llvm::ConstantInt::get(misalign->getType(), 0),
+                        "is_aligned");
+}
+
+
 /* Emit code for a foreach statement.  We effectively emit code to run the
    set of n-dimensional nested loops corresponding to the dimensionality of
    the foreach statement along with the extra logic to deal with mismatches
    between the vector width we're compiling to and the number of elements
    to process.
  */
+struct UnswitchInfo {
+    UnswitchInfo(FunctionEmitContext *c) {
+        ctx = c;
+        ifStmt = NULL;
+        ok = true;
+        addressOnly = false;
+    }
+
+    FunctionEmitContext *ctx;
+    /** Symbols used by the test of the "if" statement being considered. */
+    std::vector<const Symbol *> symbols;
+    /** Symbols declared in the loop body; these are never invariant in
+        it, and their storage may belong to another copy of the body. */
+    std::vector<const Symbol *> bodySymbols;
+    /** The "if" statement found to hoist. */
+    IfStmt *ifStmt;
+    bool ok;
+    /** Whether lCheckUnswitchWrites() only looks for symbols whose
+        address is taken, rather than also for assignments to them. */
+    bool addressOnly;
+};
+
+
+/** Adds the symbols that the given expression uses to *symbols.  Returns
+    false if the expression uses anything other than compile-time
+    constants, uniform atomic and enum-typed local variables and
+    parameters, and operators that have no side effects and can't trap,
+    in which case it can't be evaluated before the loop it's in. */
+static bool
+lGetUnswitchSymbols(Expr *expr, const Function *func,
+                    std::vector<const Symbol *> *symbols) {
+    if (expr == NULL)
+        return false;
+    if (llvm::dyn_cast<ConstExpr>(expr) != NULL)
+        return true;
+    if (SymbolExpr *se = llvm::dyn_cast<SymbolExpr>(expr)) {
+        const Symbol *sym = se->GetBaseSymbol();
+        if (sym == NULL || sym->type == NULL ||
+            sym->parentFunction != func || sym->storageClass != SC_NONE ||
+            sym->type->IsUniformType() == false ||
+            (CastType<AtomicType>(sym->type) == NULL &&
+             CastType<EnumType>(sym->type) == NULL))
+            return false;
+        symbols->push_back(sym);
+        return true;
+    }
+    if (UnaryExpr *ue = llvm::dyn_cast<UnaryExpr>(expr)) {
+        if (ue->op != UnaryExpr::Negate && ue->op != UnaryExpr::LogicalNot &&
+            ue->op != UnaryExpr::BitNot)
+            return false;
+        return lGetUnswitchSymbols(ue->expr, func, symbols);
+    }
+    if (BinaryExpr *be = llvm::dyn_cast<BinaryExpr>(expr)) {
+        if (be->op == BinaryExpr::Div || be->op == BinaryExpr::Mod ||
+            be->op == BinaryExpr::Comma)
+            return false;
+        return (lGetUnswitchSymbols(be->arg0, func, symbols) &&
+                lGetUnswitchSymbols(be->arg1, func, symbols));
+    }
+    if (TypeCastExpr *tce = llvm::dyn_cast<TypeCastExpr>(expr))
+        return lGetUnswitchSymbols(tce->expr, func, symbols);
+    return false;
+}
+
+
+/** Preorder callback that clears info->ok if the node modifies (including
+    by initializing it in a declaration) or takes the address of any of
+    the symbols in info->symbols. */
+static bool
+lCheckUnswitchWrites(ASTNode *node, void *d) {
+    UnswitchInfo *info = (UnswitchInfo *)d;
+    Expr *target = NULL;
+    if (AddressOfExpr *ae = llvm::dyn_cast<AddressOfExpr>(node))
+        target = ae->expr;
+    else if (ReferenceExpr *re = llvm::dyn_cast<ReferenceExpr>(node))
+        target = re->expr;
+    else if (info->addressOnly == false) {
+        if (AssignExpr *ae = llvm::dyn_cast<AssignExpr>(node))
+            target = ae->lvalue;
+        else if (UnaryExpr *ue = llvm::dyn_cast<UnaryExpr>(node)) {
+            if (ue->op == UnaryExpr::PreInc || ue->op == UnaryExpr::PreDec ||
+                ue->op == UnaryExpr::PostInc || ue->op == UnaryExpr::PostDec)
+                target = ue->expr;
+        }
+        else if (DeclStmt *ds = llvm::dyn_cast<DeclStmt>(node)) {
+            for (unsigned int i = 0; i < ds->vars.size(); ++i)
+                if (std::find(info->symbols.begin(), info->symbols.end(),
+                              ds->vars[i].sym) != info->symbols.end())
+                    info->ok = false;
+            return info->ok;
+        }
+    }
+
+    Symbol *sym = target ? target->GetBaseSymbol() : NULL;
+    if (sym != NULL &&
+        std::find(info->symbols.begin(), info->symbols.end(), sym) !=
+        info->symbols.end())
+        info->ok = false;
+    return info->ok;
+}
+
+
+/** Preorder callback that clears info->ok if emitting the code for the
+    node twice would be wrong: static variables would be duplicated, and
+    so would labels.  It also records the symbols declared in
+    info->bodySymbols. */
+static bool
+lCheckUnswitchBody(ASTNode *node, void *d) {
+    UnswitchInfo *info = (UnswitchInfo *)d;
+    if (llvm::dyn_cast<LabeledStmt>(node) != NULL ||
+        llvm::dyn_cast<GotoStmt>(node) != NULL)
+        info->ok = false;
+    else if (DeclStmt *ds = llvm::dyn_cast<DeclStmt>(node)) {
+        for (unsigned int i = 0; i < ds->vars.size(); ++i) {
+            if (ds->vars[i].sym == NULL)
+                continue;
+            if (ds->vars[i].sym->storageClass != SC_NONE)
+                info->ok = false;
+            info->bodySymbols.push_back(ds->vars[i].sym);
+        }
+    }
+    return info->ok;
+}
+
+
+/** Preorder callback that looks for a uniform "if" statement whose test
+    is loop-invariant in the foreach loop body given by info; the first
+    one found is stored in info->ifStmt. */
+static bool
+lFindUnswitchIf(ASTNode *node, void *d) {
+    UnswitchInfo *info = (UnswitchInfo *)d;
+    if (info->ifStmt != NULL)
+        return false;
+
+    IfStmt *ifStmt = llvm::dyn_cast<IfStmt>(node);
+    bool value;
+    if (ifStmt == NULL || ifStmt->test == NULL ||
+        ifStmt->test->GetType() == NULL ||
+        ifStmt->test->GetType()->IsUniformType() == false ||
+        info->ctx->GetUnswitchedIf(ifStmt, &value))
+        return true;
+
+    const Function *func = info->ctx->GetFunction();
+    std::vector<const Symbol *> symbols;
+    if (lGetUnswitchSymbols(ifStmt->test, func, &symbols) == false ||
+        symbols.empty())
+        return true;
+    for (unsigned int i = 0; i < symbols.size(); ++i)
+        if (std::find(info->bodySymbols.begin(), info->bodySymbols.end(),
+                      symbols[i]) != info->bodySymbols.end())
+            return true;
+
+    info->ifStmt = ifStmt;
+    info->symbols = symbols;
+    return false;
+}
+
+
+/** Returns a uniform "if" statement in the body of a foreach loop to
+    hoist out of it, if there is one that is worth it and safe to
+    hoist.  Its test must be loop-invariant and free of side effects,
+    so that it can be evaluated once before the loop (even if the loop
+    body doesn't run at all), and the loop body must be small enough
+    for emitting it twice to be reasonable. */
+static IfStmt *
+lGetUnswitchIf(FunctionEmitContext *ctx, Stmt *stmts) {
+    // Emitting all of the loop's code twice for each hoisted test grows
+    // it quickly, so the number of tests is limited.
+    if (g->opt.disableForeachUnswitching ||
+        (g->generateDebuggingSymbols && !g->debugLineTablesOnly) ||
+        ctx->GetNumUnswitchedIfs() >= 2 ||
+        EstimateCost(stmts) > 128)
+        return NULL;
+
+    UnswitchInfo info(ctx);
+    WalkAST(stmts, lCheckUnswitchBody, NULL, &info);
+    if (info.ok == false)
+        return NULL;
+
+    // Look for a candidate whose test's symbols aren't assigned to in the
+    // loop and don't have their address taken anywhere in the function.
+    WalkAST(stmts, lFindUnswitchIf, NULL, &info);
+    if (info.ifStmt == NULL)
+        return NULL;
+    WalkAST(stmts, lCheckUnswitchWrites, NULL, &info);
+    info.addressOnly = true;
+    if (info.ok)
+        WalkAST(ctx->GetFunction()->GetCode(), lCheckUnswitchWrites, NULL, &info);
+    return info.ok ? info.ifStmt : NULL;
+}
+
+
+/** Emits the code for the given foreach loop with a uniform "if" test in
+    its body hoisted out of it: the test is evaluated once, and a copy of
+    the loop where the "if" is replaced with its "true" statements or its
+    "false" statements runs depending on its value.  This leaves each copy
+    with a tight loop body.  Returns false, having emitted nothing, if the
+    test's value couldn't be computed. */
+static bool
+lEmitUnswitchedForeach(FunctionEmitContext *ctx, const ForeachStmt *fs,
+                       IfStmt *ifStmt) {
+    ctx->SetDebugPos(ifStmt->test->pos);
+    llvm::Value *testValue = ifStmt->test->GetValue(ctx);
+    if (testValue == NULL)
+        return false;
+
+    ctx->StartUniformIf();
+    llvm::BasicBlock *bbTrue = ctx->CreateBasicBlock("foreach_unswitch_true");
+    llvm::BasicBlock *bbFalse = ctx->CreateBasicBlock("foreach_unswitch_false");
+    llvm::BasicBlock *bbDone = ctx->CreateBasicBlock("foreach_unswitch_done");
+    ctx->BranchInst(bbTrue, bbFalse, testValue);
+
+    ctx->SetCurrentBasicBlock(bbTrue);
+    ctx->SetUnswitchedIf(ifStmt, true);
+    fs->EmitCode(ctx);
+    if (ctx->GetCurrentBasicBlock())
+        ctx->BranchInst(bbDone);
+
+    ctx->SetCurrentBasicBlock(bbFalse);
+    ctx->SetUnswitchedIf(ifStmt, false);
+    fs->EmitCode(ctx);
+    if (ctx->GetCurrentBasicBlock())
+        ctx->BranchInst(bbDone);
+    ctx->ClearUnswitchedIf(ifStmt);
+
+    ctx->SetCurrentBasicBlock(bbDone);
+    ctx->EndIf();
+    return true;
+}
+
+
 void
 ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
     if (ctx->GetCurrentBasicBlock() == NULL || stmts == NULL)
         return;
 
+    IfStmt *ifStmt = lGetUnswitchIf(ctx, stmts);
+    if (ifStmt != NULL && lEmitUnswitchedForeach(ctx, this, ifStmt))
+        return;
+
     llvm::BasicBlock *bbFullBody = ctx->CreateBasicBlock("foreach_full_body");
     llvm::BasicBlock *bbMaskedBody = ctx->CreateBasicBlock("foreach_masked_body");
     llvm::BasicBlock *bbExit = ctx->CreateBasicBlock("foreach_exit");
@@ -1692,14 +2203,37 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
     std::vector<llvm::Value *> startVals, endVals, uniformCounterPtrs;
     std::vector<llvm::Value *> nExtras, alignedEnd, extrasMaskPtrs;
 
+    // Pointers from a "#pragma align" as loaded at loop entry, along with
+    // the alignment that their element addresses have in the full-vector
+    // iterations of the loop.
+    std::vector<llvm::Value *> alignPtrs;
+    std::vector<const PointerType *> alignPtrTypes;
+    std::vector<int> alignments;
+    llvm::Value *peelStart = NULL, *peelEnd = NULL, *allAligned = NULL;
+    llvm::Value *inPeelHeadPtr = NULL;
+    llvm::BasicBlock *bbPeelHead = NULL;
+
     std::vector<int> span(nDims, 0);
 #ifdef ISPC_NVPTX_ENABLED
     const int vectorWidth = 
       g->target->getISA() == Target::NVPTX ? 32 : g->target->getVectorWidth();
     lGetSpans(nDims-1, nDims, vectorWidth, isTiled, &span[0]);
 #else /* ISPC_NVPTX_ENABLED */
-    lGetSpans(nDims-1, nDims, g->target->getVectorWidth(), isTiled, &span[0]);
+    const int vectorWidth = g->target->getVectorWidth();
+    lGetSpans(nDims-1, nDims, vectorWidth, isTiled, &span[0]);
 #endif /* ISPC_NVPTX_ENABLED */
+    if (tileShape.size() == span.size()) {
+        // Use the tile shape from a "#pragma tile" instead, if it covers
+        // the gang exactly.
+        int count = 1;
+        for (int i = 0; i < nDims; ++i)
+            count *= tileShape[i];
+        if (count == vectorWidth)
+            span = tileShape;
+        else
+            Warning(pos, "Ignoring \"#pragma tile\" shape with %d elements "
+                    "for %d-wide gang.", count, vectorWidth);
+    }
 
     for (int i = 0; i < nDims; ++i) {
         // Basic blocks that we'll fill in later with the looping logic for
@@ -1715,6 +2249,77 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
         llvm::Value *ev = endExprs[i]->GetValue(ctx);
         if (sv == NULL || ev == NULL)
             return;
+
+        if (nDims == 1 && alignSymbols.size() > 0) {
+            // With "#pragma align", the first few items are peeled off
+            // and run in a masked iteration of their own ahead of the
+            // loop, so that the first pointer's address is aligned at the
+            // start of each full vector's worth of elements that follow.
+            // The loop proper then starts at peelEnd.
+            for (unsigned int j = 0; j < alignSymbols.size(); ++j) {
+                const PointerType *pt =
+                    CastType<PointerType>(alignSymbols[j]->type);
+                int eltSize = 0;
+                int alignment = (pt == NULL) ? 0 :
+                    lForeachPointerAlignment(pt, span[0], &eltSize);
+                if (alignment == 0 || alignSymbols[j]->storagePtr == NULL) {
+                    Warning(pos, "Ignoring \"%s\" in \"#pragma align\": its "
+                            "elements can't be aligned to a vector's worth.",
+                            alignSymbols[j]->name.c_str());
+                    continue;
+                }
+
+                llvm::Value *ptr = ctx->LoadInst(alignSymbols[j]->storagePtr,
+                                                 alignSymbols[j]->name.c_str());
+                if (peelEnd == NULL) {
+                    // peel = ((alignment - misalign) % alignment) / eltSize
+                    llvm::Value *misalign =
+                        lEmitMisalignment(ctx, ptr, sv, pt, alignment);
+                    llvm::Type *intType = misalign->getType();
+                    llvm::Value *peelBytes =
+                        ctx->BinaryOperator(llvm::Instruction::Sub,
+                                            llvm::ConstantInt::get(intType, alignment),
+                                            misalign, "peel_bytes");
+                    peelBytes =
+                        ctx->BinaryOperator(llvm::Instruction::And, peelBytes,
+                                            llvm::ConstantInt::get(intType, alignment - 1),
+                                            "peel_bytes");
+                    llvm::Value *peel =
+                        ctx->BinaryOperator(llvm::Instruction::UDiv, peelBytes,
+                                            llvm::ConstantInt::get(intType, eltSize),
+                                            "peel");
+                    if (intType != LLVMTypes::Int32Type)
+                        peel = ctx->TruncInst(peel, LLVMTypes::Int32Type, "peel");
+
+                    // peelEnd = min(startVal + peel, endVal)
+                    llvm::Value *svPeel =
+                        ctx->BinaryOperator(llvm::Instruction::Add, sv, peel,
+                                            "start_peel");
+                    llvm::Value *beforeEnd =
+                        ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLT,
+                                     svPeel, ev, "peel_before_end");
+                    peelStart = sv;
+                    peelEnd = ctx->SelectInst(beforeEnd, svPeel, ev, "peel_end");
+                    sv = peelEnd;
+                }
+
+                // Check whether each of the pointers does in fact end up
+                // aligned at the start of the loop proper.
+                llvm::Value *aligned =
+                    lEmitIsAligned(ctx, ptr, peelEnd, pt, alignment);
+                allAligned = (allAligned == NULL) ? aligned :
+                    ctx->BinaryOperator(llvm::Instruction::And, allAligned,
+                                        aligned, "all_aligned");
+                alignPtrs.push_back(ptr);
+                alignPtrTypes.push_back(pt);
+                alignments.push_back(alignment);
+            }
+
+            if (peelEnd != NULL) {
+                inPeelHeadPtr = ctx->AllocaInst(LLVMTypes::BoolType, "in_peel_head");
+                ctx->StoreInst(LLVMFalse, inPeelHeadPtr);
+            }
+        }
         startVals.push_back(sv);
         endVals.push_back(ev);
 
@@ -1761,8 +2366,17 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
 
     ctx->StartForeach(FunctionEmitContext::FOREACH_REGULAR);
 
-    // On to the outermost loop's test
-    ctx->BranchInst(bbTest[0]);
+    if (peelEnd != NULL) {
+        // Run the peeled-off items first, if there are any.
+        bbPeelHead = ctx->CreateBasicBlock("foreach_peel_head");
+        llvm::Value *havePeel =
+            ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLT,
+                         peelStart, peelEnd, "have_peel");
+        ctx->BranchInst(bbPeelHead, bbTest[0], havePeel);
+    }
+    else
+        // On to the outermost loop's test
+        ctx->BranchInst(bbTest[0]);
 
     ///////////////////////////////////////////////////////////////////////////
     // foreach_reset: this code runs when we need to reset the counter for
@@ -1821,7 +2435,7 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
 
         llvm::Value *varyingCounter =
             lUpdateVaryingCounter(i, nDims, ctx, uniformCounterPtrs[i],
-                                  dimVariables[i]->storagePtr, span);
+                                  dimVariables[i]->storagePtr, span, laneOrder);
 
         llvm::Value *smearEnd = ctx->BroadcastValue(
             endVals[i], LLVMTypes::Int32VectorType, "smear_end");
@@ -1916,7 +2530,7 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
         // Update the varying counter value here, since all subsequent
         // blocks along this path need it.
         lUpdateVaryingCounter(nDims-1, nDims, ctx, uniformCounterPtrs[nDims-1],
-                              dimVariables[nDims-1]->storagePtr, span);
+                              dimVariables[nDims-1]->storagePtr, span, laneOrder);
 
         // here we just check to see if counter < alignedEnd
         llvm::Value *counter = ctx->LoadInst(uniformCounterPtrs[nDims-1], "counter");
@@ -2028,11 +2642,38 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
     // loop body emit their code.
     llvm::BasicBlock *bbFullBodyContinue =
         ctx->CreateBasicBlock("foreach_full_continue");
-    ctx->SetCurrentBasicBlock(bbFullBody); {
+    //
+    // With "#pragma align", there are two versions of the full body: one
+    // that is told that all of the pointers are aligned, which is run if
+    // the check at loop entry found them to be, and a generic one.
+    std::vector<llvm::BasicBlock *> bbFullBodyVersions;
+    ctx->SetCurrentBasicBlock(bbFullBody);
+    if (allAligned != NULL) {
+        bbFullBodyVersions.push_back(ctx->CreateBasicBlock("foreach_full_body_aligned"));
+        bbFullBodyVersions.push_back(ctx->CreateBasicBlock("foreach_full_body_unaligned"));
+        ctx->BranchInst(bbFullBodyVersions[0], bbFullBodyVersions[1], allAligned);
+    }
+    else
+        bbFullBodyVersions.push_back(bbFullBody);
+
+    for (unsigned int v = 0; v < bbFullBodyVersions.size(); ++v) {
+        ctx->SetCurrentBasicBlock(bbFullBodyVersions[v]);
         ctx->SetInternalMask(LLVMMaskAllOn);
         ctx->SetBlockEntryMask(LLVMMaskAllOn);
         lUpdateVaryingCounter(nDims-1, nDims, ctx, uniformCounterPtrs[nDims-1],
-                              dimVariables[nDims-1]->storagePtr, span);
+                              dimVariables[nDims-1]->storagePtr, span, laneOrder);
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+        if (allAligned != NULL && v == 0) {
+            llvm::Value *counter = ctx->LoadInst(uniformCounterPtrs[nDims-1],
+                                                 "counter");
+            llvm::Function *assumeFunc =
+                llvm::Intrinsic::getDeclaration(m->module, llvm::Intrinsic::assume);
+            for (unsigned int j = 0; j < alignPtrs.size(); ++j)
+                ctx->CallInst(assumeFunc, NULL,
+                              lEmitIsAligned(ctx, alignPtrs[j], counter,
+                                             alignPtrTypes[j], alignments[j]));
+        }
+#endif
         ctx->SetContinueTarget(bbFullBodyContinue);
         ctx->AddInstrumentationPoint("foreach loop body (all on)");
         stmts->EmitCode(ctx);
@@ -2047,6 +2688,7 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
                                 LLVMInt32(span[nDims-1]), "new_counter");
         ctx->StoreInst(newCounter, uniformCounterPtrs[nDims-1]);
         ctx->BranchInst(bbOuterNotInExtras);
+        lAddLoopUnrollMetadata(ctx->GetCurrentBasicBlock(), unrollCount, pos);
     }
 
     ///////////////////////////////////////////////////////////////////////////
@@ -2069,7 +2711,7 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
     ctx->SetCurrentBasicBlock(bbSetInnerMask); {
         llvm::Value *varyingCounter =
             lUpdateVaryingCounter(nDims-1, nDims, ctx, uniformCounterPtrs[nDims-1],
-                                  dimVariables[nDims-1]->storagePtr, span);
+                                  dimVariables[nDims-1]->storagePtr, span, laneOrder);
         llvm::Value *smearEnd = ctx->BroadcastValue(
             endVals[nDims-1], LLVMTypes::Int32VectorType, "smear_end");
         llvm::Value *emask =
@@ -2083,6 +2725,32 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
         ctx->BranchInst(bbMaskedBody);
     }
 
+    ///////////////////////////////////////////////////////////////////////////
+    // foreach_peel_head: run the masked body for the items peeled off
+    // ahead of an aligned "#pragma align" loop.  They're the last ones of
+    // the vector's worth that ends at peelEnd.
+    if (peelEnd != NULL) {
+        ctx->SetCurrentBasicBlock(bbPeelHead);
+        llvm::Value *counter =
+            ctx->BinaryOperator(llvm::Instruction::Sub, peelEnd,
+                                LLVMInt32(span[0]), "peel_counter");
+        ctx->StoreInst(counter, uniformCounterPtrs[0]);
+        llvm::Value *varyingCounter =
+            lUpdateVaryingCounter(0, nDims, ctx, uniformCounterPtrs[0],
+                                  dimVariables[0]->storagePtr, span, laneOrder);
+        llvm::Value *smearStart = ctx->BroadcastValue(
+            peelStart, LLVMTypes::Int32VectorType, "smear_start");
+        llvm::Value *pmask =
+            ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SGE,
+                         varyingCounter, smearStart);
+        pmask = ctx->I1VecToBoolVec(pmask);
+        ctx->SetInternalMask(pmask);
+
+        ctx->StoreInst(LLVMTrue, inPeelHeadPtr);
+        ctx->StoreInst(LLVMFalse, stepIndexAfterMaskedBodyPtr);
+        ctx->BranchInst(bbMaskedBody);
+    }
+
     ///////////////////////////////////////////////////////////////////////////
     // masked_body: set the mask and have the statements emit their
     // code again.  Note that it's generally worthwhile having two copies
@@ -2104,6 +2772,22 @@ ForeachStmt::EmitCode(FunctionEmitContext *ctx) const {
     }
     ctx->SetCurrentBasicBlock(bbMaskedBodyContinue); {
         ctx->RestoreContinuedLanes();
+        if (peelEnd != NULL) {
+            // After the peeled-off items, start the loop proper.
+            llvm::BasicBlock *bbPeelDone =
+                ctx->CreateBasicBlock("foreach_peel_done");
+            llvm::BasicBlock *bbNotPeel =
+                ctx->CreateBasicBlock("foreach_masked_step");
+            llvm::Value *inPeelHead = ctx->LoadInst(inPeelHeadPtr);
+            ctx->BranchInst(bbPeelDone, bbNotPeel, inPeelHead);
+
+            ctx->SetCurrentBasicBlock(bbPeelDone);
+            ctx->StoreInst(LLVMFalse, inPeelHeadPtr);
+            ctx->StoreInst(peelEnd, uniformCounterPtrs[0]);
+            ctx->BranchInst(bbTest[0]);
+
+            ctx->SetCurrentBasicBlock(bbNotPeel);
+        }
         llvm::Value *stepIndex = ctx->LoadInst(stepIndexAfterMaskedBodyPtr);
         ctx->BranchInst(bbStepInnerIndex, bbReset[nDims-1], stepIndex);
     }
@@ -2489,6 +3173,37 @@ ForeachUniqueStmt::EmitCode(FunctionEmitContext *ctx) const {
     llvm::Value *exprMem = ctx->AllocaInst(llvmExprType, "expr_mem");
     ctx->StoreInst(exprValue, exprMem);
 
+    // On targets with hardware conflict detection, we can find all of the
+    // distinct values up front: a lane is the first one with its value
+    // if none of the earlier active lanes have the same value.  In that
+    // case, *maskBitsPtr holds just these "leader" lanes, so that each
+    // trip through the loop only needs to clear the lowest set bit,
+    // rather than recomputing the remaining lanes from the loop mask.
+    // Floating-point values are excluded, since conflict detection
+    // compares bits rather than following FCMP_OEQ semantics.
+    bool useConflict = false;
+    if (g->target->hasConflictDetection() &&
+        g->target->getVectorWidth() <= 32 &&
+        llvmExprType->getElementType() == LLVMTypes::Int32Type) {
+        llvm::Function *conflictFunc =
+            m->module->getFunction("__conflict_i32");
+        Assert(conflictFunc != NULL);
+        std::vector<llvm::Value *> args;
+        args.push_back(exprValue);
+        args.push_back(oldFullMask);
+        llvm::Value *conflicts =
+            ctx->CallInst(conflictFunc, NULL, args, "conflicts");
+        llvm::Value *noConflict =
+            ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ,
+                         conflicts, LLVMInt32Vector(0), "no_conflict");
+        noConflict = ctx->I1VecToBoolVec(noConflict);
+        llvm::Value *leaders =
+            ctx->BinaryOperator(llvm::Instruction::And, oldFullMask,
+                                noConflict, "leader_lanes");
+        ctx->StoreInst(ctx->LaneMask(leaders), maskBitsPtr);
+        useConflict = true;
+    }
+
     // Onward to find the first set of lanes to run the loop for
     ctx->BranchInst(bbFindNext);
 
@@ -2554,13 +3269,25 @@ ForeachUniqueStmt::EmitCode(FunctionEmitContext *ctx) const {
         ctx->SetInternalMask(loopMask);
 
         // Also update the bitvector of lanes left to process in subsequent
-        // loop iterations:
+        // loop iterations.  With the leader lanes, that's just
+        // remainingBits &= (remainingBits - 1); otherwise it's
         // remainingBits &= ~movmsk(current mask)
-        llvm::Value *loopMaskMM = ctx->LaneMask(loopMask);
-        llvm::Value *notLoopMaskMM = ctx->NotOperator(loopMaskMM);
-        llvm::Value *newRemaining =
-            ctx->BinaryOperator(llvm::Instruction::And, remainingBits,
-                                notLoopMaskMM, "new_remaining");
+        llvm::Value *newRemaining;
+        if (useConflict) {
+            llvm::Value *remainingMinusOne =
+                ctx->BinaryOperator(llvm::Instruction::Sub, remainingBits,
+                                    LLVMInt64(1), "remaining_minus_one");
+            newRemaining =
+                ctx->BinaryOperator(llvm::Instruction::And, remainingBits,
+                                    remainingMinusOne, "new_remaining");
+        }
+        else {
+            llvm::Value *loopMaskMM = ctx->LaneMask(loopMask);
+            llvm::Value *notLoopMaskMM = ctx->NotOperator(loopMaskMM);
+            newRemaining =
+                ctx->BinaryOperator(llvm::Instruction::And, remainingBits,
+                                    notLoopMaskMM, "new_remaining");
+        }
         ctx->StoreInst(newRemaining, maskBitsPtr);
 
         // and onward...
@@ -2659,6 +3386,377 @@ ForeachUniqueStmt::EstimateCost() const {
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+// ForeachCompactStmt
+
+ForeachCompactStmt::ForeachCompactStmt(Symbol *s, Expr *se, Expr *ee,
+                                       Stmt *st, SourcePos pos)
+    : Stmt(pos, ForeachCompactStmtID) {
+    sym = s;
+    startExpr = se;
+    endExpr = ee;
+    stmts = st;
+}
+
+
+/** Finds the loop in the body of a foreach_compact statement whose
+    iterations are scheduled across the lanes: it's either the body itself
+    or the first top-level loop in it.  Returns the index of the loop in
+    the body's statement list in *index (or -1 if the body is the loop).
+ */
+static Stmt *
+lGetCompactLoop(Stmt *stmts, int *index) {
+    *index = -1;
+    if (llvm::dyn_cast_or_null<ForStmt>(stmts) != NULL ||
+        llvm::dyn_cast_or_null<DoStmt>(stmts) != NULL)
+        return stmts;
+
+    StmtList *sl = llvm::dyn_cast_or_null<StmtList>(stmts);
+    if (sl == NULL)
+        return NULL;
+    for (unsigned int i = 0; i < sl->stmts.size(); ++i)
+        if (llvm::dyn_cast_or_null<ForStmt>(sl->stmts[i]) != NULL ||
+            llvm::dyn_cast_or_null<DoStmt>(sl->stmts[i]) != NULL) {
+            *index = (int)i;
+            return sl->stmts[i];
+        }
+    return NULL;
+}
+
+
+/** Emits code for the statements in the body of a foreach_compact
+    statement before (or after) its loop. */
+static void
+lEmitCompactStmts(FunctionEmitContext *ctx, Stmt *stmts, int loopIndex,
+                  bool before) {
+    StmtList *sl = llvm::dyn_cast_or_null<StmtList>(stmts);
+    if (sl == NULL)
+        return;
+    int start = before ? 0 : loopIndex + 1;
+    int end = before ? loopIndex : (int)sl->stmts.size();
+    for (int i = start; i < end && ctx->GetCurrentBasicBlock() != NULL; ++i)
+        if (sl->stmts[i] != NULL)
+            sl->stmts[i]->EmitCode(ctx);
+}
+
+
+/** Returns a mask with the lanes where the given loop test value is true
+    on. */
+static llvm::Value *
+lCompactTestMask(FunctionEmitContext *ctx, llvm::Value *test) {
+    if (test->getType() == LLVMTypes::BoolType)
+        return ctx->SelectInst(test, LLVMMaskAllOn, LLVMMaskAllOff, "test_mask");
+    return test;
+}
+
+
+void
+ForeachCompactStmt::EmitCode(FunctionEmitContext *ctx) const {
+    if (ctx->GetCurrentBasicBlock() == NULL || stmts == NULL || sym == NULL)
+        return;
+
+    int loopIndex;
+    Stmt *loop = lGetCompactLoop(stmts, &loopIndex);
+    ForStmt *forLoop = llvm::dyn_cast_or_null<ForStmt>(loop);
+    DoStmt *doLoop = llvm::dyn_cast_or_null<DoStmt>(loop);
+    AssertPos(pos, forLoop != NULL || doLoop != NULL);
+
+    llvm::BasicBlock *bbRefill = ctx->CreateBasicBlock("foreach_compact_refill");
+    llvm::BasicBlock *bbStart = ctx->CreateBasicBlock("foreach_compact_start");
+    llvm::BasicBlock *bbCheck = ctx->CreateBasicBlock("foreach_compact_check");
+    llvm::BasicBlock *bbTest = ctx->CreateBasicBlock("foreach_compact_test");
+    llvm::BasicBlock *bbBody = ctx->CreateBasicBlock("foreach_compact_body");
+    llvm::BasicBlock *bbStep = ctx->CreateBasicBlock("foreach_compact_step");
+    llvm::BasicBlock *bbBreak = ctx->CreateBasicBlock("foreach_compact_break");
+    llvm::BasicBlock *bbRetire = ctx->CreateBasicBlock("foreach_compact_retire");
+    llvm::BasicBlock *bbFinish = ctx->CreateBasicBlock("foreach_compact_finish");
+    llvm::BasicBlock *bbExit = ctx->CreateBasicBlock("foreach_compact_exit");
+
+    llvm::Value *oldMask = ctx->GetInternalMask();
+    llvm::Value *oldFunctionMask = ctx->GetFunctionMask();
+
+    ctx->SetDebugPos(pos);
+    ctx->StartScope();
+
+    ctx->SetInternalMask(LLVMMaskAllOn);
+    ctx->SetFunctionMask(LLVMMaskAllOn);
+    ctx->StartForeach(FunctionEmitContext::FOREACH_REGULAR);
+
+    llvm::Value *startVal = startExpr->GetValue(ctx);
+    llvm::Value *endVal = endExpr->GetValue(ctx);
+    if (startVal == NULL || endVal == NULL) {
+        ctx->EndForeach();
+        ctx->EndScope();
+        return;
+    }
+    llvm::Value *endVec = ctx->BroadcastValue(endVal, LLVMTypes::Int32VectorType,
+                                              "end_broadcast");
+
+    // The next item to hand out, the lanes that are currently working on
+    // an item, and the lanes that are still running the loop after the
+    // current iteration.
+    llvm::Value *nextPtr = ctx->AllocaInst(LLVMTypes::Int32Type, "next_item");
+    ctx->StoreInst(startVal, nextPtr);
+    llvm::Value *activePtr = ctx->AllocaInst(LLVMTypes::MaskType, "active_lanes");
+    ctx->StoreInst(LLVMMaskAllOff, activePtr);
+    llvm::Value *runningPtr = ctx->AllocaInst(LLVMTypes::MaskType, "running_lanes");
+
+    sym->storagePtr = ctx->AllocaInst(LLVMTypes::Int32VectorType,
+                                      sym->name.c_str());
+    ctx->EmitVariableDebugInfo(sym);
+
+    // For each lane, a bitmask of the lanes before it; the number of idle
+    // lanes before a lane gives the offset of its new item.
+    int64_t before[ISPC_MAX_NVEC];
+    for (int i = 0; i < g->target->getVectorWidth(); ++i)
+        before[i] = (i == 0) ? 0 : (int64_t)(~0ull >> (64 - i));
+    llvm::Value *beforeMasks = LLVMInt64Vector(before);
+    llvm::Function *popcntVec =
+        llvm::Intrinsic::getDeclaration(m->module, llvm::Intrinsic::ctpop,
+                                        LLVMTypes::Int64VectorType);
+    llvm::Function *popcnt =
+        llvm::Intrinsic::getDeclaration(m->module, llvm::Intrinsic::ctpop,
+                                        LLVMTypes::Int64Type);
+    ctx->BranchInst(bbRefill);
+
+    ///////////////////////////////////////////////////////////////////////
+    // Refill: hand out the next items to the idle lanes, in order.
+    ctx->SetCurrentBasicBlock(bbRefill); {
+        llvm::Value *active = ctx->LoadInst(activePtr, "active");
+        llvm::Value *idle = ctx->NotOperator(active, "idle");
+        llvm::Value *idleBits = ctx->LaneMask(idle);
+        llvm::Value *next = ctx->LoadInst(nextPtr, "next");
+        llvm::Value *haveIdle =
+            ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_NE,
+                         idleBits, LLVMInt64(0), "have_idle");
+        llvm::Value *haveItems =
+            ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLT,
+                         next, endVal, "have_items");
+        llvm::Value *refill =
+            ctx->BinaryOperator(llvm::Instruction::And, haveIdle, haveItems,
+                                "refill");
+        ctx->BranchInst(bbStart, bbCheck, refill);
+
+        ctx->SetCurrentBasicBlock(bbStart);
+        llvm::Value *idleBefore =
+            ctx->BinaryOperator(llvm::Instruction::And,
+                                ctx->BroadcastValue(idleBits,
+                                                    LLVMTypes::Int64VectorType),
+                                beforeMasks, "idle_before");
+        llvm::Value *offsets =
+            ctx->TruncInst(ctx->CallInst(popcntVec, NULL, idleBefore, "offsets64"),
+                           LLVMTypes::Int32VectorType, "offsets");
+        llvm::Value *items =
+            ctx->BinaryOperator(llvm::Instruction::Add,
+                                ctx->BroadcastValue(next, LLVMTypes::Int32VectorType),
+                                offsets, "items");
+        llvm::Value *inRange =
+            ctx->CmpInst(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLT,
+                         items, endVec, "items_in_range");
+        llvm::Value *started =
+            ctx->BinaryOperator(llvm::Instruction::And, idle,
+                                ctx->I1VecToBoolVec(inRange), "started");
+        llvm::Value *nIdle =
+            ctx->TruncInst(ctx->CallInst(popcnt, NULL, idleBits, "n_idle64"),
+                           LLVMTypes::Int32Type, "n_idle");
+        ctx->StoreInst(ctx->BinaryOperator(llvm::Instruction::Add, next, nIdle,
+                                           "new_next"), nextPtr);
+        ctx->StoreInst(ctx->BinaryOperator(llvm::Instruction::Or, active,
+                                           started, "new_active"), activePtr);
+
+        // Run the statements that start work on an item for the lanes
+        // that just got one.
+        ctx->SetInternalMask(started);
+        ctx->StoreInst(items, sym->storagePtr, started, AtomicType::VaryingInt32,
+                       PointerType::GetUniform(AtomicType::VaryingInt32));
+        ctx->AddInstrumentationPoint("foreach_compact start item");
+        lEmitCompactStmts(ctx, stmts, loopIndex, true);
+        if (forLoop != NULL && forLoop->init != NULL &&
+            ctx->GetCurrentBasicBlock() != NULL)
+            forLoop->init->EmitCode(ctx);
+        if (ctx->GetCurrentBasicBlock() != NULL)
+            ctx->BranchInst(bbCheck);
+    }
+
+    ///////////////////////////////////////////////////////////////////////
+    // Check: we're done once no lane has an item to work on.
+    ctx->SetCurrentBasicBlock(bbCheck); {
+        llvm::Value *active = ctx->LoadInst(activePtr, "active");
+        ctx->SetInternalMask(active);
+        ctx->StoreInst(LLVMMaskAllOff, runningPtr);
+        ctx->BranchIfMaskNone(bbExit, bbTest);
+    }
+
+    ///////////////////////////////////////////////////////////////////////
+    // One iteration of the loop for all lanes whose loop test holds; the
+    // loop test of a "do" loop is evaluated after its body.
+    ctx->SetCurrentBasicBlock(bbTest); {
+        if (forLoop != NULL && forLoop->test != NULL) {
+            llvm::Value *test = forLoop->test->GetValue(ctx);
+            if (test == NULL) {
+                ctx->EndForeach();
+                ctx->EndScope();
+                return;
+            }
+            llvm::Value *active = ctx->GetInternalMask();
+            ctx->SetInternalMaskAnd(active, lCompactTestMask(ctx, test));
+        }
+        // This has to happen before the branch below terminates the
+        // block; it also clears the break and continue lanes at the start
+        // of each iteration.
+        ctx->StartLoop(bbBreak, bbStep, false);
+        ctx->BranchIfMaskAny(bbBody, bbRetire);
+    }
+
+    ctx->SetCurrentBasicBlock(bbBody); {
+        ctx->SetBlockEntryMask(ctx->GetFullMask());
+        ctx->AddInstrumentationPoint("foreach_compact loop body");
+        Stmt *body = forLoop ? forLoop->stmts : doLoop->bodyStmts;
+        bool isList = (llvm::dyn_cast_or_null<StmtList>(body) != NULL);
+        if (!isList)
+            ctx->StartScope();
+        if (body != NULL)
+            body->EmitCode(ctx);
+        if (!isList)
+            ctx->EndScope();
+        if (ctx->GetCurrentBasicBlock() != NULL)
+            ctx->BranchInst(bbStep);
+    }
+
+    ctx->SetCurrentBasicBlock(bbStep); {
+        ctx->RestoreContinuedLanes();
+        ctx->ClearBreakLanes();
+        if (forLoop != NULL && forLoop->step != NULL)
+            forLoop->step->EmitCode(ctx);
+        if (doLoop != NULL && doLoop->testExpr != NULL) {
+            llvm::Value *test = doLoop->testExpr->GetValue(ctx);
+            if (test != NULL)
+                ctx->SetInternalMaskAnd(ctx->GetInternalMask(),
+                                        lCompactTestMask(ctx, test));
+        }
+        ctx->StoreInst(ctx->GetInternalMask(), runningPtr);
+        ctx->BranchInst(bbRetire);
+    }
+
+    // All of the running lanes executed a "break".
+    ctx->SetCurrentBasicBlock(bbBreak);
+    ctx->BranchInst(bbRetire);
+
+    ///////////////////////////////////////////////////////////////////////
+    // Retire: lanes that are done with the loop run the statements after
+    // it and become idle.
+    ctx->SetCurrentBasicBlock(bbRetire); {
+        ctx->EndLoop();
+        llvm::Value *active = ctx->LoadInst(activePtr, "active");
+        llvm::Value *running = ctx->LoadInst(runningPtr, "running");
+        llvm::Value *done =
+            ctx->BinaryOperator(llvm::Instruction::And, active,
+                                ctx->NotOperator(running, "~running"), "done");
+        ctx->StoreInst(running, activePtr);
+        ctx->SetInternalMask(done);
+        ctx->BranchIfMaskAny(bbFinish, bbRefill);
+    }
+
+    ctx->SetCurrentBasicBlock(bbFinish); {
+        ctx->AddInstrumentationPoint("foreach_compact finish item");
+        lEmitCompactStmts(ctx, stmts, loopIndex, false);
+        if (ctx->GetCurrentBasicBlock() != NULL)
+            ctx->BranchInst(bbRefill);
+    }
+
+    ///////////////////////////////////////////////////////////////////////
+    // All done.  Restore the old mask and clean up
+    ctx->SetCurrentBasicBlock(bbExit);
+    ctx->SetInternalMask(oldMask);
+    ctx->SetFunctionMask(oldFunctionMask);
+
+    ctx->EndForeach();
+    ctx->EndScope();
+}
+
+
+void
+ForeachCompactStmt::Print(int indent) const {
+    printf("%*cForeach_compact Stmt", indent, ' ');
+    pos.Print();
+    printf("\n");
+
+    printf("%*cVar: %s\n", indent+4, ' ', sym ? sym->name.c_str() : "NULL");
+    printf("%*cStart:\n", indent+4, ' ');
+    if (startExpr != NULL)
+        startExpr->Print();
+    printf("\n%*cEnd:\n", indent+4, ' ');
+    if (endExpr != NULL)
+        endExpr->Print();
+    printf("\n");
+    if (stmts != NULL)
+        stmts->Print(indent+4);
+}
+
+
+/** Preorder callback for checking the body of a foreach_compact statement
+    for statements that would leave it other than by finishing an item. */
+static bool
+lCompactJumpCheck(ASTNode *node, void *data) {
+    bool *inLoop = (bool *)data;
+    if (llvm::dyn_cast<ReturnStmt>(node) != NULL ||
+        llvm::dyn_cast<GotoStmt>(node) != NULL) {
+        Error(node->pos, "\"return\" and \"goto\" statements are illegal "
+              "inside \"foreach_compact\" loops.");
+        return false;
+    }
+    if (*inLoop == false &&
+        (llvm::dyn_cast<BreakStmt>(node) != NULL ||
+         llvm::dyn_cast<ContinueStmt>(node) != NULL)) {
+        Error(node->pos, "\"break\" and \"continue\" statements are only "
+              "allowed inside the loop in the body of \"foreach_compact\".");
+        return false;
+    }
+    if (*inLoop == false &&
+        (llvm::dyn_cast<ForStmt>(node) != NULL ||
+         llvm::dyn_cast<DoStmt>(node) != NULL ||
+         llvm::dyn_cast<SwitchStmt>(node) != NULL)) {
+        // Jumps inside nested loops and switches are fine.
+        *inLoop = true;
+        WalkAST(node, lCompactJumpCheck, NULL, data);
+        *inLoop = false;
+        return false;
+    }
+    return true;
+}
+
+
+Stmt *
+ForeachCompactStmt::TypeCheck() {
+    if (startExpr != NULL)
+        startExpr = TypeConvertExpr(startExpr, AtomicType::UniformInt32,
+                                    "foreach_compact starting value");
+    if (endExpr != NULL)
+        endExpr = TypeConvertExpr(endExpr, AtomicType::UniformInt32,
+                                  "foreach_compact ending value");
+    if (startExpr == NULL || endExpr == NULL || sym == NULL)
+        return NULL;
+
+    int loopIndex;
+    if (lGetCompactLoop(stmts, &loopIndex) == NULL) {
+        Error(pos, "The body of a \"foreach_compact\" statement must have "
+              "a \"for\", \"while\", or \"do\" loop.");
+        return NULL;
+    }
+
+    bool inLoop = false;
+    int errorCount = m->errorCount;
+    WalkAST(stmts, lCompactJumpCheck, NULL, &inLoop);
+    return (m->errorCount == errorCount) ? this : NULL;
+}
+
+
+int
+ForeachCompactStmt::EstimateCost() const {
+    return COST_VARYING_LOOP;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 // CaseStmt
 
@@ -3229,12 +4327,18 @@ LabeledStmt::EstimateCost() const {
 
 void
 StmtList::EmitCode(FunctionEmitContext *ctx) const {
+    bool savedFPContract = ctx->GetFPContract();
+    if (fpContract != -1)
+        ctx->SetFPContract(fpContract == 1);
+
     ctx->StartScope();
     ctx->SetDebugPos(pos);
     for (unsigned int i = 0; i < stmts.size(); ++i)
         if (stmts[i])
             stmts[i]->EmitCode(ctx);
     ctx->EndScope();
+
+    ctx->SetFPContract(savedFPContract);
 }
 
 
@@ -3254,6 +4358,8 @@ void
 StmtList::Print(int indent) const {
     printf("%*cStmt List", indent, ' ');
     pos.Print();
+    if (fpContract != -1)
+        printf(" fp_contract(%s)", (fpContract == 1) ? "on" : "off");
     printf(":\n");
     for (unsigned int i = 0; i < stmts.size(); ++i)
         if (stmts[i])
@@ -3550,6 +4656,84 @@ AssertStmt::EstimateCost() const {
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+// AssumeStmt
+
+AssumeStmt::AssumeStmt(Expr *e, SourcePos p)
+    : Stmt(p, AssumeStmtID), expr(e) {
+}
+
+
+void
+AssumeStmt::EmitCode(FunctionEmitContext *ctx) const {
+    if (!ctx->GetCurrentBasicBlock())
+        return;
+
+    const Type *type;
+    if (expr == NULL ||
+        (type = expr->GetType()) == NULL) {
+        AssertPos(pos, m->errorCount > 0);
+        return;
+    }
+
+#if ISPC_LLVM_VERSION >= ISPC_LLVM_3_6 // LLVM 3.6+
+    llvm::Value *exprValue = expr->GetValue(ctx);
+    if (exprValue == NULL) {
+        AssertPos(pos, m->errorCount > 0);
+        return;
+    }
+
+    llvm::Value *fact = exprValue;
+    if (type->IsVaryingType()) {
+        // A varying condition only has to hold for the program instances
+        // that are running, so what we can tell LLVM is that there are no
+        // active lanes where it's false.
+        llvm::Value *notExpr =
+            ctx->BinaryOperator(llvm::Instruction::Xor, exprValue,
+                                LLVMMaskAllOn, "~assume");
+        llvm::Value *violated =
+            ctx->BinaryOperator(llvm::Instruction::And, ctx->GetFullMask(),
+                                notExpr, "assume_violated");
+        fact = ctx->None(violated);
+    }
+
+    llvm::Function *assumeFunc =
+        llvm::Intrinsic::getDeclaration(m->module, llvm::Intrinsic::assume);
+    ctx->CallInst(assumeFunc, NULL, fact);
+#else
+    // There's no way to pass the assumption along to LLVM before 3.6, so
+    // just ignore it.
+#endif
+}
+
+
+void
+AssumeStmt::Print(int indent) const {
+    printf("%*cAssume Stmt", indent, ' ');
+}
+
+
+Stmt *
+AssumeStmt::TypeCheck() {
+    const Type *type;
+    if (expr && (type = expr->GetType()) != NULL) {
+        bool isUniform = type->IsUniformType();
+        expr = TypeConvertExpr(expr, isUniform ? AtomicType::UniformBool :
+                                                 AtomicType::VaryingBool,
+                               "\"assume\" statement");
+        if (expr == NULL)
+            return NULL;
+    }
+    return this;
+}
+
+
+int
+AssumeStmt::EstimateCost() const {
+    return COST_ASSUME;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 // DeleteStmt
 
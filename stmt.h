@@ -189,6 +189,10 @@ public:
     Expr *testExpr;
     Stmt *bodyStmts;
     const bool doCoherentCheck;
+    /** Unroll count given with a "#pragma unroll" before the loop: zero
+        to unroll the loop completely, one to not unroll it, and -1 if no
+        pragma was given, in which case the optimizer decides. */
+    int unrollCount;
 };
 
 
@@ -222,6 +226,9 @@ public:
     /** Loop body statements */
     Stmt *stmts;
     const bool doCoherentCheck;
+    /** Unroll count given with a "#pragma unroll"; see
+        DoStmt::unrollCount. */
+    int unrollCount;
 };
 
 
@@ -267,6 +274,10 @@ public:
  */
 class ForeachStmt : public Stmt {
 public:
+    /** Order in which the program instances are laid out over each
+        iteration's tile of a "foreach_tiled" loop. */
+    enum LaneOrder { LANES_ROW_MAJOR, LANES_MORTON, LANES_HILBERT };
+
     ForeachStmt(const std::vector<Symbol *> &loopVars,
                 const std::vector<Expr *> &startExprs,
                 const std::vector<Expr *> &endExprs,
@@ -288,6 +299,22 @@ public:
     std::vector<Expr *> endExprs;
     bool isTiled;
     Stmt *stmts;
+    /** Unroll count given with a "#pragma unroll" before the loop, as
+        for DoStmt.  It applies to the loop over the full vectors of the
+        innermost dimension, where the mask is all on. */
+    int unrollCount;
+    /** Pointers given with a "#pragma align" before a one-dimensional
+        loop.  The first iterations are peeled off so that the first
+        pointer is indexed with the loop variable at aligned addresses in
+        the remaining ones; if there are others, a second copy of the loop
+        body that assumes that they are aligned as well is used when a
+        check at loop entry shows that they are. */
+    std::vector<Symbol *> alignSymbols;
+    /** Lane layout and per-dimension tile shape given with a "#pragma
+        tile" before a "foreach_tiled" loop; if the shape is empty, the
+        one from lGetSpans() in stmt.cpp is used. */
+    LaneOrder laneOrder;
+    std::vector<int> tileShape;
 };
 
 
@@ -338,6 +365,34 @@ public:
 };
 
 
+/** Parallel iteration over a range of work items where lanes that finish
+    their item early are refilled with new items.  The body consists of
+    statements that start work on a new item, a loop whose iterations are
+    the unit of scheduling, and statements that finish the item after the
+    loop has terminated.
+ */
+class ForeachCompactStmt : public Stmt {
+public:
+    ForeachCompactStmt(Symbol *sym, Expr *startExpr, Expr *endExpr,
+                       Stmt *stmts, SourcePos pos);
+
+    static inline bool classof(ForeachCompactStmt const*) { return true; }
+    static inline bool classof(ASTNode const* N) {
+        return N->getValueID() == ForeachCompactStmtID;
+    }
+
+    void EmitCode(FunctionEmitContext *ctx) const;
+    void Print(int indent) const;
+
+    Stmt *TypeCheck();
+    int EstimateCost() const;
+
+    Symbol *sym;
+    Expr *startExpr, *endExpr;
+    Stmt *stmts;
+};
+
+
 /**
  */
 class UnmaskedStmt : public Stmt {
@@ -501,7 +556,7 @@ public:
  */
 class StmtList : public Stmt {
 public:
-    StmtList(SourcePos p) : Stmt(p, StmtListID) { }
+    StmtList(SourcePos p) : Stmt(p, StmtListID), fpContract(-1) { }
 
     static inline bool classof(StmtList const*) { return true; }
     static inline bool classof(ASTNode const* N) {
@@ -517,6 +572,11 @@ public:
     void Add(Stmt *s) { if (s) stmts.push_back(s); }
 
     std::vector<Stmt *> stmts;
+
+    /** Set by "#pragma fp_contract(on)" (1) or "#pragma fp_contract(off)"
+        (0) to control floating-point contraction in the statements; -1 if
+        the enclosing setting applies. */
+    int fpContract;
 };
 
 
@@ -582,6 +642,33 @@ public:
 };
 
 
+/** @brief Representation of an assume statement in the program.
+
+    assume() tells the optimizer that the given condition is true at this
+    point in the program without generating any code to check it.  For
+    varying conditions, the condition must be true for all of the program
+    instances that are currently executing.
+*/
+class AssumeStmt : public Stmt {
+public:
+    AssumeStmt(Expr *e, SourcePos p);
+
+    static inline bool classof(AssumeStmt const*) { return true; }
+    static inline bool classof(ASTNode const* N) {
+        return N->getValueID() == AssumeStmtID;
+    }
+
+    void EmitCode(FunctionEmitContext *ctx) const;
+    void Print(int indent) const;
+
+    Stmt *TypeCheck();
+    int EstimateCost() const;
+
+    /** The expression that is assumed to be true. */
+    Expr *expr;
+};
+
+
 /** Representation of a delete statement in the program.
 */
 class DeleteStmt : public Stmt {
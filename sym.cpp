@@ -36,9 +36,11 @@
 */
 
 #include "sym.h"
+#include "module.h"
 #include "type.h"
 #include "util.h"
 #include <stdio.h>
+#include <string.h>
 
 ///////////////////////////////////////////////////////////////////////////
 // Symbol
@@ -56,6 +58,90 @@ Symbol::Symbol(const std::string &n, SourcePos p, const Type *t,
 }
 
 
+static void
+lDestroySymbol(void *ptr) {
+    ((Symbol *)ptr)->~Symbol();
+}
+
+
+void *
+Symbol::operator new(size_t size) {
+    if (m == NULL)
+        return ::operator new(size);
+
+    void *ptr = m->arena.Allocate(size);
+    m->arena.AddDestructor(lDestroySymbol, ptr);
+    return ptr;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// Identifier interning
+
+/** The interned identifiers are stored in a single open-addressing hash
+    table, hashed by contents; this is the only place where the full
+    string is hashed and compared.  The table and the strings it refers to
+    live for the duration of the program, since Symbols and Types that use
+    interned names are shared across the Modules for different targets. */
+static std::vector<const char *> lInternTable(1024, (const char *)NULL);
+static int lInternCount = 0;
+
+
+static size_t
+lHashString(const char *str) {
+    // FNV-1a
+    size_t h = 2166136261u;
+    for (; *str != '\0'; ++str) {
+        h ^= (unsigned char)*str;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+/** Returns the slot in lInternTable that holds the given string, or the
+    empty slot where it would be inserted. */
+static size_t
+lInternSlot(const std::vector<const char *> &table, const char *str) {
+    size_t mask = table.size() - 1;
+    size_t slot = lHashString(str) & mask;
+    while (table[slot] != NULL && strcmp(table[slot], str) != 0)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+
+const char *
+FindInternedIdentifier(const char *name) {
+    return lInternTable[lInternSlot(lInternTable, name)];
+}
+
+
+const char *
+InternIdentifier(const char *name) {
+    size_t slot = lInternSlot(lInternTable, name);
+    if (lInternTable[slot] != NULL)
+        return lInternTable[slot];
+
+    if (2 * (lInternCount + 1) > (int)lInternTable.size()) {
+        std::vector<const char *> newTable(2 * lInternTable.size(),
+                                           (const char *)NULL);
+        for (unsigned int i = 0; i < lInternTable.size(); ++i)
+            if (lInternTable[i] != NULL)
+                newTable[lInternSlot(newTable, lInternTable[i])] = lInternTable[i];
+        lInternTable.swap(newTable);
+        slot = lInternSlot(lInternTable, name);
+    }
+
+    size_t len = strlen(name);
+    char *copy = new char[len + 1];
+    memcpy(copy, name, len + 1);
+    lInternTable[slot] = copy;
+    ++lInternCount;
+    return copy;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 // SymbolTable
 
@@ -77,7 +163,7 @@ SymbolTable::PushScope() {
     if (freeSymbolMaps.size() > 0) {
         sm = freeSymbolMaps.back();
         freeSymbolMaps.pop_back();
-        sm->erase(sm->begin(), sm->end());
+        sm->Clear();
     }
     else
         sm = new SymbolMapType;
@@ -91,6 +177,32 @@ SymbolTable::PopScope() {
     Assert(variables.size() > 1);
     freeSymbolMaps.push_back(variables.back());
     variables.pop_back();
+
+    while (scopedTypes.size() > 0 &&
+           scopedTypes.back().depth > (int)variables.size())
+        scopedTypes.pop_back();
+}
+
+
+void
+SymbolTable::SuspendLocalScopes() {
+    Assert(variables.size() >= 1);
+    suspendedScopes.push_back(std::vector<SymbolMapType *>(variables.begin() + 1,
+                                                           variables.end()));
+    variables.resize(1);
+    suspendedScopedTypes.push_back(scopedTypes);
+    scopedTypes.clear();
+}
+
+
+void
+SymbolTable::ResumeLocalScopes() {
+    Assert(suspendedScopes.size() > 0 && variables.size() == 1);
+    std::vector<SymbolMapType *> &scopes = suspendedScopes.back();
+    variables.insert(variables.end(), scopes.begin(), scopes.end());
+    suspendedScopes.pop_back();
+    scopedTypes = suspendedScopedTypes.back();
+    suspendedScopedTypes.pop_back();
 }
 
 
@@ -98,10 +210,12 @@ bool
 SymbolTable::AddVariable(Symbol *symbol) {
     Assert(symbol != NULL);
 
+    const char *id = InternIdentifier(symbol->name.c_str());
+
     // Check to see if a symbol of the same name has already been declared.
     for (int i = (int)variables.size() - 1; i >= 0; --i) {
         SymbolMapType &sm = *(variables[i]);
-        if (sm.find(symbol->name) != sm.end()) {
+        if (sm.Find(id) != NULL) {
             if (i == (int)variables.size()-1) {
                 // If a symbol of the same name was declared in the
                 // same scope, it's an error.
@@ -115,34 +229,54 @@ SymbolTable::AddVariable(Symbol *symbol) {
                 Warning(symbol->pos,
                         "Symbol \"%s\" shadows symbol declared in outer scope.",
                         symbol->name.c_str());
-                (*variables.back())[symbol->name] = symbol;
+                (*variables.back())[id] = symbol;
                 return true;
             }
         }
     }
 
     // No matches, so go ahead and add it...
-    (*variables.back())[symbol->name] = symbol;
+    (*variables.back())[id] = symbol;
     return true;
 }
 
 
 Symbol *
 SymbolTable::LookupVariable(const char *name) {
+    // If the name has never been interned, it can't be in any scope.
+    const char *id = FindInternedIdentifier(name);
+    if (id == NULL)
+        return NULL;
+
     // Note that we iterate through the variables vectors backwards, since
     // we want to search from the innermost scope to the outermost, so that
     // we get the right symbol if we have multiple variables in different
     // scopes that shadow each other.
     for (int i = (int)variables.size() - 1; i >= 0; --i) {
         SymbolMapType &sm = *(variables[i]);
-        SymbolMapType::iterator iter = sm.find(name);
-        if (iter != sm.end())
-            return iter->second;
+        Symbol **sym = sm.Find(id);
+        if (sym != NULL)
+            return *sym;
     }
     return NULL;
 }
 
 
+bool
+SymbolTable::IsLocalVariable(const Symbol *symbol) {
+    const char *id = FindInternedIdentifier(symbol->name.c_str());
+    if (id == NULL)
+        return false;
+
+    for (int i = (int)variables.size() - 1; i >= 1; --i) {
+        Symbol **sym = variables[i]->Find(id);
+        if (sym != NULL)
+            return (*sym == symbol);
+    }
+    return false;
+}
+
+
 bool
 SymbolTable::AddFunction(Symbol *symbol) {
     const FunctionType *ft = CastType<FunctionType>(symbol->type);
@@ -152,23 +286,27 @@ SymbolTable::AddFunction(Symbol *symbol) {
         // the symbol table
         return false;
 
-    std::vector<Symbol *> &funOverloads = functions[symbol->name];
-    funOverloads.push_back(symbol);
+    FunctionOverloads &overloads =
+        functions[InternIdentifier(symbol->name.c_str())];
+    overloads.all.push_back(symbol);
+    int nParams = ft->GetNumParameters();
+    if ((int)overloads.byParamCount.size() <= nParams)
+        overloads.byParamCount.resize(nParams + 1);
+    overloads.byParamCount[nParams].push_back(symbol);
     return true;
 }
 
 
 bool
 SymbolTable::LookupFunction(const char *name, std::vector<Symbol *> *matches) {
-    FunctionMapType::iterator iter = functions.find(name);
-    if (iter != functions.end()) {
+    const char *id = FindInternedIdentifier(name);
+    const FunctionOverloads *overloads = id ? functions.Find(id) : NULL;
+    if (overloads != NULL) {
         if (matches == NULL)
             return true;
-        else {
-            const std::vector<Symbol *> &funcs = iter->second;
-            for (int j = 0; j < (int)funcs.size(); ++j)
-                matches->push_back(funcs[j]);
-        }
+        else
+            matches->insert(matches->end(), overloads->all.begin(),
+                            overloads->all.end());
     }
     return matches ? (matches->size() > 0) : false;
 }
@@ -176,13 +314,19 @@ SymbolTable::LookupFunction(const char *name, std::vector<Symbol *> *matches) {
 
 Symbol *
 SymbolTable::LookupFunction(const char *name, const FunctionType *type) {
-    FunctionMapType::iterator iter = functions.find(name);
-    if (iter != functions.end()) {
-        std::vector<Symbol *> funcs = iter->second;
-        for (int j = 0; j < (int)funcs.size(); ++j) {
-            if (Type::Equal(funcs[j]->type, type))
-                return funcs[j];
-        }
+    const char *id = FindInternedIdentifier(name);
+    const FunctionOverloads *overloads = id ? functions.Find(id) : NULL;
+    if (overloads == NULL)
+        return NULL;
+
+    // Only overloads with the same number of parameters can match.
+    int nParams = type->GetNumParameters();
+    if (nParams >= (int)overloads->byParamCount.size())
+        return NULL;
+    const std::vector<Symbol *> &funcs = overloads->byParamCount[nParams];
+    for (int j = 0; j < (int)funcs.size(); ++j) {
+        if (Type::Equal(funcs[j]->type, type))
+            return funcs[j];
     }
     return NULL;
 }
@@ -200,28 +344,58 @@ SymbolTable::AddType(const char *name, const Type *type, SourcePos pos) {
         return false;
     }
 
-    types[name] = type;
+    types[InternIdentifier(name)] = type;
     return true;
 }
 
 
+void
+SymbolTable::AddScopedType(const char *name, const Type *type) {
+    ScopedType st;
+    st.name = InternIdentifier(name);
+    st.type = type;
+    st.depth = (int)variables.size();
+    scopedTypes.push_back(st);
+}
+
+
 const Type *
 SymbolTable::LookupType(const char *name) const {
-    // Again, search through the type maps backward to get scoping right.
-    TypeMapType::const_iterator iter = types.find(name);
-    if (iter != types.end())
-        return iter->second;
-    return NULL;
+    const char *id = FindInternedIdentifier(name);
+    if (id == NULL)
+        return NULL;
+    for (int i = (int)scopedTypes.size() - 1; i >= 0; --i)
+        if (scopedTypes[i].name == id)
+            return scopedTypes[i].type;
+    const Type * const *type = types.Find(id);
+    return type ? *type : NULL;
+}
+
+
+bool
+SymbolTable::AddFunctionTemplate(FunctionTemplate *templ) {
+    FunctionTemplate *&entry = functionTemplates[InternIdentifier(templ->name.c_str())];
+    if (entry != NULL)
+        return false;
+    entry = templ;
+    return true;
+}
+
+
+FunctionTemplate *
+SymbolTable::LookupFunctionTemplate(const char *name) const {
+    const char *id = FindInternedIdentifier(name);
+    if (id == NULL)
+        return NULL;
+    FunctionTemplate * const *templ = functionTemplates.Find(id);
+    return templ ? *templ : NULL;
 }
 
 bool
 SymbolTable::ContainsType(const Type *type) const {
-    TypeMapType::const_iterator iter = types.begin();
-    while (iter != types.end()) {
-        if (iter->second == type) {
+    for (int i = 0; i < types.Size(); ++i) {
+        if (types.Value(i) == type)
             return true;
-        }
-        iter++;
     }
     return false;
 }
@@ -238,26 +412,29 @@ SymbolTable::ClosestVariableOrFunctionMatch(const char *str) const {
 
     for (int i = 0; i < (int)variables.size(); ++i) {
         const SymbolMapType &sv = *(variables[i]);
-        SymbolMapType::const_iterator iter;
-        for (iter = sv.begin(); iter != sv.end(); ++iter) {
-            const Symbol *sym = iter->second;
+        for (int j = 0; j < sv.Size(); ++j) {
+            const Symbol *sym = sv.Value(j);
             int dist = StringEditDistance(str, sym->name, maxDelta+1);
             if (dist <= maxDelta)
                 matches[dist].push_back(sym->name);
         }
     }
 
-    FunctionMapType::const_iterator iter;
-    for (iter = functions.begin(); iter != functions.end(); ++iter) {
-        int dist = StringEditDistance(str, iter->first, maxDelta+1);
+    for (int i = 0; i < functions.Size(); ++i) {
+        std::string name = functions.Key(i);
+        int dist = StringEditDistance(str, name, maxDelta+1);
         if (dist <= maxDelta)
-            matches[dist].push_back(iter->first);
+            matches[dist].push_back(name);
     }
 
     // Now, return the first entry of matches[] that is non-empty, if any.
+    // The maps aren't ordered, so sort the suggestions to keep the
+    // diagnostics stable.
     for (int i = 0; i <= maxDelta; ++i) {
-        if (matches[i].size())
+        if (matches[i].size()) {
+            std::sort(matches[i].begin(), matches[i].end());
             return matches[i];
+        }
     }
 
     // Otherwise, no joy.
@@ -286,24 +463,26 @@ SymbolTable::closestTypeMatch(const char *str, bool structsVsEnums) const {
     const int maxDelta = 2;
     std::vector<std::string> matches[maxDelta+1];
 
-    TypeMapType::const_iterator iter;
-    for (iter = types.begin(); iter != types.end(); ++iter) {
+    for (int i = 0; i < types.Size(); ++i) {
         // Skip over either StructTypes or EnumTypes, depending on the
         // value of the structsVsEnums parameter
-        bool isEnum = (CastType<EnumType>(iter->second) != NULL);
+        bool isEnum = (CastType<EnumType>(types.Value(i)) != NULL);
         if (isEnum && structsVsEnums)
             continue;
         else if (!isEnum && !structsVsEnums)
             continue;
 
-        int dist = StringEditDistance(str, iter->first, maxDelta+1);
+        std::string name = types.Key(i);
+        int dist = StringEditDistance(str, name, maxDelta+1);
         if (dist <= maxDelta)
-            matches[dist].push_back(iter->first);
+            matches[dist].push_back(name);
     }
 
     for (int i = 0; i <= maxDelta; ++i) {
-        if (matches[i].size())
+        if (matches[i].size()) {
+            std::sort(matches[i].begin(), matches[i].end());
             return matches[i];
+        }
     }
     return std::vector<std::string>();
 }
@@ -315,10 +494,9 @@ SymbolTable::Print() {
     fprintf(stderr, "Variables:\n----------------\n");
     for (int i = 0; i < (int)variables.size(); ++i) {
         SymbolMapType &sm = *(variables[i]);
-        SymbolMapType::iterator iter;
-        for (iter = sm.begin(); iter != sm.end(); ++iter) {
+        for (int j = 0; j < sm.Size(); ++j) {
             fprintf(stderr, "%*c", depth, ' ');
-            Symbol *sym = iter->second;
+            Symbol *sym = sm.Value(j);
             fprintf(stderr, "%s [%s]", sym->name.c_str(),
                     sym->type->GetString().c_str());
         }
@@ -327,23 +505,19 @@ SymbolTable::Print() {
     }
 
     fprintf(stderr, "Functions:\n----------------\n");
-    FunctionMapType::iterator fiter = functions.begin();
-    while (fiter != functions.end()) {
-        fprintf(stderr, "%s\n", fiter->first.c_str());
-        std::vector<Symbol *> &syms = fiter->second;
+    for (int i = 0; i < functions.Size(); ++i) {
+        fprintf(stderr, "%s\n", functions.Key(i));
+        std::vector<Symbol *> &syms = functions.Value(i).all;
         for (unsigned int j = 0; j < syms.size(); ++j)
             fprintf(stderr, "    %s\n", syms[j]->type->GetString().c_str());
-        ++fiter;
     }
 
     depth = 0;
     fprintf(stderr, "Named types:\n---------------\n");
-    TypeMapType::iterator siter = types.begin();
-    while (siter != types.end()) {
+    for (int i = 0; i < types.Size(); ++i) {
         fprintf(stderr, "%*c", depth, ' ');
-        fprintf(stderr, "%s -> %s\n", siter->first.c_str(),
-                siter->second->GetString().c_str());
-        ++siter;
+        fprintf(stderr, "%s -> %s\n", types.Key(i),
+                types.Value(i)->GetString().c_str());
     }
 }
 
@@ -360,25 +534,16 @@ inline int ispcRand() {
 Symbol *
 SymbolTable::RandomSymbol() {
     int v = ispcRand() % variables.size();
-    if (variables[v]->size() == 0)
+    if (variables[v]->Size() == 0)
         return NULL;
-    int count = ispcRand() % variables[v]->size();
-    SymbolMapType::iterator iter = variables[v]->begin();
-    while (count-- > 0) {
-        ++iter;
-        Assert(iter != variables[v]->end());
-    }
-    return iter->second;
+    int count = ispcRand() % variables[v]->Size();
+    return variables[v]->Value(count);
 }
 
 
 const Type *
 SymbolTable::RandomType() {
-    int count = types.size();
-    TypeMapType::iterator iter = types.begin();
-    while (count-- > 0) {
-        ++iter;
-        Assert(iter != types.end());
-    }
-    return iter->second;
+    if (types.Size() == 0)
+        return NULL;
+    return types.Value(ispcRand() % types.Size());
 }
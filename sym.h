@@ -43,6 +43,8 @@
 #include "ispc.h"
 #include "decl.h"
 #include <map>
+#include <vector>
+#include <algorithm>
 
 class StructType;
 class ConstExpr;
@@ -67,6 +69,12 @@ public:
     Symbol(const std::string &name, SourcePos pos, const Type *t = NULL,
            StorageClass sc = SC_NONE);
 
+    /** Like AST nodes, Symbols are allocated from the current Module's
+        MemoryArena and are destroyed along with it rather than
+        individually. */
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr) { }
+
     SourcePos pos;            /*!< Source file position where the symbol was defined */
     std::string name;         /*!< Symbol's name */
     llvm::Value *storagePtr;  /*!< For symbols with storage associated with
@@ -108,6 +116,153 @@ public:
 };
 
 
+/** @brief A token of a function template's definition, as recorded by
+    the lexer.
+
+    Along with the token itself, this holds the token's text (what \c
+    yytext held for it), its position, and the semantic value that the
+    lexer provided with it in \c yylval.
+ */
+struct TemplateToken {
+    int token;
+    std::string text;
+    SourcePos pos;
+    uint64_t intVal;
+    double floatVal;
+    std::string stringVal;
+};
+
+
+/** @brief Representation of a function template.
+
+    The definition of a function template, "template <typename T, int N>"
+    followed by a function definition, is parsed where it appears with the
+    type parameters naming TemplateTypeParmTypes and the integer
+    parameters declared as constants of unknown value, so that syntax
+    errors and undeclared names in it are reported even if it's never
+    used.  The tokens of the function definition are recorded, so that
+    each instantiation of the template can be parsed as an ordinary
+    function definition with the parameters bound to the template
+    arguments.
+ */
+struct FunctionTemplate {
+    std::string name;
+    SourcePos pos;
+    /** Names of the template parameters. */
+    std::vector<std::string> paramNames;
+    /** For integer parameters, the parameter's type; NULL for type
+        parameters. */
+    std::vector<const Type *> paramTypes;
+    /** Type of the template's function, in terms of the
+        TemplateTypeParmTypes of its type parameters. */
+    const FunctionType *type;
+    StorageClass storageClass;
+    bool isInline;
+    /** Tokens of the function definition, from the first one after the
+        template parameter list through the closing brace of its body. */
+    std::vector<TemplateToken> tokens;
+};
+
+
+/** Returns the unique, permanently allocated copy of the given
+    identifier, creating it if this is the first time it has been seen.
+    Interned identifiers can be compared for equality (and hashed) by
+    pointer rather than by their contents. */
+const char *InternIdentifier(const char *name);
+
+/** Returns the interned copy of the given identifier if one has already
+    been created by InternIdentifier(), or NULL otherwise.  Since every
+    name in the symbol table is interned when it is added, a NULL return
+    value means that a lookup of \c name can't succeed. */
+const char *FindInternedIdentifier(const char *name);
+
+
+/** @brief Open-addressing hash map from interned identifiers to values.
+
+    Keys must have been returned by InternIdentifier(), so that they can be
+    hashed and compared by address.  Entries are stored in insertion order
+    in a single vector, and the hash table itself just holds indices into
+    that vector; this keeps iteration cheap and deterministic.  Individual
+    entries can't be removed, but the whole map can be cleared, which is
+    all that symbol table scopes need.
+ */
+template <typename T> class IdentifierMap {
+public:
+    IdentifierMap() : slots(16, -1) { }
+
+    /** Returns a pointer to the value associated with the given interned
+        identifier, or NULL if it isn't present. */
+    T *Find(const char *id) {
+        int index = slots[lookupSlot(id)];
+        return (index == -1) ? NULL : &entries[index].second;
+    }
+    const T *Find(const char *id) const {
+        int index = slots[lookupSlot(id)];
+        return (index == -1) ? NULL : &entries[index].second;
+    }
+
+    /** Returns a reference to the value associated with the given interned
+        identifier, default-constructing it first if needed. */
+    T &operator[](const char *id) {
+        int slot = lookupSlot(id);
+        if (slots[slot] != -1)
+            return entries[slots[slot]].second;
+
+        if (2 * (entries.size() + 1) > slots.size()) {
+            grow();
+            slot = lookupSlot(id);
+        }
+        slots[slot] = (int)entries.size();
+        entries.push_back(std::make_pair(id, T()));
+        return entries.back().second;
+    }
+
+    void Clear() {
+        if (entries.size() == 0)
+            return;
+        entries.clear();
+        std::fill(slots.begin(), slots.end(), -1);
+    }
+
+    int Size() const { return (int)entries.size(); }
+
+    /** Accessors for the i'th entry, in insertion order. */
+    const char *Key(int i) const { return entries[i].first; }
+    T &Value(int i) { return entries[i].second; }
+    const T &Value(int i) const { return entries[i].second; }
+
+private:
+    static size_t hash(const char *id) {
+        size_t h = (size_t)id;
+        return (h >> 4) ^ (h >> 13);
+    }
+
+    /** Returns the slot that holds \c id, or the empty slot where it
+        would be inserted. */
+    int lookupSlot(const char *id) const {
+        size_t mask = slots.size() - 1;
+        size_t slot = hash(id) & mask;
+        while (slots[slot] != -1 && entries[slots[slot]].first != id)
+            slot = (slot + 1) & mask;
+        return (int)slot;
+    }
+
+    void grow() {
+        slots.assign(2 * slots.size(), -1);
+        size_t mask = slots.size() - 1;
+        for (int i = 0; i < (int)entries.size(); ++i) {
+            size_t slot = hash(entries[i].first) & mask;
+            while (slots[slot] != -1)
+                slot = (slot + 1) & mask;
+            slots[slot] = i;
+        }
+    }
+
+    std::vector<std::pair<const char *, T> > entries;
+    std::vector<int> slots;
+};
+
+
 /** @brief Symbol table that holds all known symbols during parsing and compilation.
 
     A single instance of a SymbolTable is stored in the Module class
@@ -133,6 +288,17 @@ public:
         that scope. */
     void PopScope();
 
+    /** Temporarily hides all of the scopes other than the global one, so
+        that code can be parsed as if it appeared at global scope (used
+        when defining the task function of a parallel_foreach).  Each
+        call must be matched by a call to
+        SymbolTable::ResumeLocalScopes(). */
+    void SuspendLocalScopes();
+
+    /** Restores the scopes hidden by the most recent call to
+        SymbolTable::SuspendLocalScopes(). */
+    void ResumeLocalScopes();
+
     /** Adds the given variable symbol to the symbol table.
         @param symbol The symbol to be added
 
@@ -151,6 +317,11 @@ public:
         Symbol with the given name is in the symbol table. */
     Symbol *LookupVariable(const char *name);
 
+    /** Returns true if the given variable is visible from the current
+        scope and was declared in one of the local (i.e., non-global)
+        scopes. */
+    bool IsLocalVariable(const Symbol *symbol);
+
     /** Adds the given function symbol to the symbol table.
         @param symbol The function symbol to be added.
 
@@ -214,11 +385,29 @@ public:
     */
     bool AddType(const char *name, const Type *type, SourcePos pos);
 
+    /** Adds a type name that is only visible in the current scope and
+        the scopes nested in it, hiding any other type with the same name
+        until the matching call to PopScope().  This is used for the type
+        parameters of function templates. */
+    void AddScopedType(const char *name, const Type *type);
+
     /** Looks for a type of the given name in the symbol table.
 
         @return Pointer to the Type, if found; otherwise NULL is returned.
     */
     const Type *LookupType(const char *name) const;
+
+    /** Adds the given function template to the symbol table.  Like
+        functions, function templates aren't scoped.
+
+        @return true if successful; false if a function template with the
+        same name has already been defined. */
+    bool AddFunctionTemplate(FunctionTemplate *templ);
+
+    /** Looks for the function template with the given name.
+
+        @return Pointer to the FunctionTemplate, if found; NULL otherwise. */
+    FunctionTemplate *LookupFunctionTemplate(const char *name) const;
     
     /** Look for a type given a pointer.
 
@@ -261,25 +450,64 @@ private:
         active scopes as the program is being parsed.  New maps are added
         and removed from the end of the main vector, so searches for
         symbols start looking at the end of \c variables and work
-        backwards.
+        backwards.  Maps are keyed by interned identifier, so each
+        per-scope probe is a pointer hash rather than a series of string
+        comparisons.
      */
-    typedef std::map<std::string, Symbol *> SymbolMapType;
+    typedef IdentifierMap<Symbol *> SymbolMapType;
     std::vector<SymbolMapType *> variables;
 
     std::vector<SymbolMapType *> freeSymbolMaps;
 
+    /** Scopes set aside by SuspendLocalScopes(), innermost suspension
+        last. */
+    std::vector<std::vector<SymbolMapType *> > suspendedScopes;
+
+    /** All of the overloads of a single function name.  \c byParamCount
+        buckets the same symbols by their number of parameters, so that
+        looking for an exact signature match (as AddFunction() does for
+        every declaration) only compares against overloads that could
+        possibly be equal. */
+    struct FunctionOverloads {
+        std::vector<Symbol *> all;
+        std::vector<std::vector<Symbol *> > byParamCount;
+    };
+
     /** Function declarations are *not* scoped.  (C99, for example, allows
         an implementation to maintain function declarations in a single
-        namespace.)  A STL \c vector is used to store the function symbols
-        for a given name since, due to function overloading, a name can
-        have multiple function symbols associated with it. */
-    typedef std::map<std::string, std::vector<Symbol *> > FunctionMapType;
+        namespace.)  A \c FunctionOverloads is stored for each name since,
+        due to function overloading, a name can have multiple function
+        symbols associated with it. */
+    typedef IdentifierMap<FunctionOverloads> FunctionMapType;
     FunctionMapType functions;
 
     /** Type definitions can't currently be scoped.
      */
-    typedef std::map<std::string, const Type *> TypeMapType;
+    typedef IdentifierMap<const Type *> TypeMapType;
     TypeMapType types;
+
+    /** Types added with AddScopedType(), innermost last; \c depth is the
+        number of scopes that were active when the type was added. */
+    struct ScopedType {
+        const char *name;
+        const Type *type;
+        int depth;
+    };
+    std::vector<ScopedType> scopedTypes;
+    /** The scoped types set aside by SuspendLocalScopes(). */
+    std::vector<std::vector<ScopedType> > suspendedScopedTypes;
+
+    typedef IdentifierMap<FunctionTemplate *> FunctionTemplateMapType;
+    FunctionTemplateMapType functionTemplates;
+};
+
+
+/** Orders symbols by name; std::stable_sort() with this keeps overloads
+    of the same name in declaration order. */
+struct SymbolNameLess {
+    bool operator()(const Symbol *a, const Symbol *b) const {
+        return a->name < b->name;
+    }
 };
 
 
@@ -287,15 +515,19 @@ template <typename Predicate> void
 SymbolTable::GetMatchingFunctions(Predicate pred,
                                   std::vector<Symbol *> *matches) const {
     // Iterate through all function symbols and apply the given predicate.
-    // If it returns true, add the Symbol * to the provided vector.
-    FunctionMapType::const_iterator iter;
-    for (iter = functions.begin(); iter != functions.end(); ++iter) {
-        const std::vector<Symbol *> &syms = iter->second;
+    // If it returns true, add the Symbol * to the provided vector.  The
+    // matches are sorted by name so that callers (e.g. header emission)
+    // see them in a stable order, independent of the hash table layout.
+    std::vector<Symbol *> found;
+    for (int i = 0; i < functions.Size(); ++i) {
+        const std::vector<Symbol *> &syms = functions.Value(i).all;
         for (unsigned int j = 0; j < syms.size(); ++j) {
             if (pred(syms[j]))
-                matches->push_back(syms[j]);
+                found.push_back(syms[j]);
         }
     }
+    std::stable_sort(found.begin(), found.end(), SymbolNameLess());
+    matches->insert(matches->end(), found.begin(), found.end());
 }
 
 
@@ -303,11 +535,10 @@ template <typename Predicate> void
 SymbolTable::GetMatchingVariables(Predicate pred,
                                   std::vector<Symbol *> *matches) const {
     for (unsigned int i = 0; i < variables.size(); ++i) {
-        SymbolMapType &sm = *(variables[i]);
-        SymbolMapType::const_iterator iter;
-        for (iter = sm.begin(); iter != sm.end(); ++iter) {
-            if (pred(iter->second))
-                matches->push_back(iter->second);
+        const SymbolMapType &sm = *(variables[i]);
+        for (int j = 0; j < sm.Size(); ++j) {
+            if (pred(sm.Value(j)))
+                matches->push_back(sm.Value(j));
         }
     }
 }
@@ -0,0 +1,122 @@
+/*
+  Copyright (c) 2017, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Test of the caching in libispc: a program that includes a header must
+   be recompiled when the header changes, both in the process and when
+   going through a cache directory, and must come from the cache when
+   nothing changed.  Run with "make jit_test". */
+
+#include "jit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+// The pass number keeps the two passes from sharing a program: only the
+// preprocessed text, not the macro definitions, is part of the cache key.
+static const char *source =
+    "#include \"value.isph\"\n"
+    "export uniform int value() { return VALUE + 0 * PASS; }\n";
+
+static void
+lWriteHeader(const std::string &dir, int value) {
+    std::string fn = dir + "/value.isph";
+    FILE *f = fopen(fn.c_str(), "w");
+    if (f == NULL) {
+        perror(fn.c_str());
+        exit(1);
+    }
+    fprintf(f, "#define VALUE %d\n", value);
+    fclose(f);
+}
+
+
+static int
+lRun(const ispc::Program *program) {
+    if (program == NULL) {
+        fprintf(stderr, "Compilation failed.\n");
+        exit(1);
+    }
+    typedef int (*ValueFunc)();
+    ValueFunc func = (ValueFunc)program->GetFunction("value");
+    if (func == NULL) {
+        fprintf(stderr, "Function \"value\" not found.\n");
+        exit(1);
+    }
+    return func();
+}
+
+
+static int errors = 0;
+
+static void
+lCheck(const char *what, bool ok) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        ++errors;
+    }
+}
+
+
+int main() {
+    char dirTemplate[] = "/tmp/ispc-jit-test-XXXXXX";
+    if (mkdtemp(dirTemplate) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = dirTemplate;
+
+    for (int useCacheDir = 0; useCacheDir < 2; ++useCacheDir) {
+        ispc::JITOptions options;
+        options.includePaths.push_back(dir);
+        if (useCacheDir)
+            options.cacheDir = dir;
+        options.defines.push_back(useCacheDir ? "PASS=2" : "PASS=1");
+
+        lWriteHeader(dir, 1);
+        const ispc::Program *p1 = ispc::Compile(source, options);
+        lCheck("first compilation", lRun(p1) == 1);
+
+        const ispc::Program *p2 = ispc::Compile(source, options);
+        lCheck("unchanged source and header is cached", p2 == p1);
+
+        lWriteHeader(dir, 2);
+        const ispc::Program *p3 = ispc::Compile(source, options);
+        lCheck("changed header is recompiled", lRun(p3) == 2);
+        lCheck("changed header gives a new program", p3 != p1);
+    }
+
+    system(("/bin/rm -rf " + dir).c_str());
+    if (errors == 0)
+        printf("libispc cache test passed.\n");
+    return errors ? 1 : 0;
+}
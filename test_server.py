@@ -0,0 +1,124 @@
+#!/usr/bin/python
+#
+#  Copyright (c) 2017, Intel Corporation
+#  All rights reserved.
+#
+#  Redistribution and use in source and binary forms, with or without
+#  modification, are permitted provided that the following conditions are
+#  met:
+#
+#    * Redistributions of source code must retain the above copyright
+#      notice, this list of conditions and the following disclaimer.
+#
+#    * Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+#
+#    * Neither the name of Intel Corporation nor the names of its
+#      contributors may be used to endorse or promote products derived from
+#      this software without specific prior written permission.
+#
+#
+#   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+#   IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+#   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+#   PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+#   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+#   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+#   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+#   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+#   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+#   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+#   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Round-trip test of the compile server: starts "ispc --server" with its
+# socket in a private directory, compiles a file with ispc-client and
+# checks that the result matches what ispc produces itself, and that the
+# client refuses to use a socket in a directory that others can access.
+# Run with "make server_test".
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+ispc = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else "ispc")
+client = os.path.abspath(sys.argv[2] if len(sys.argv) > 2 else "ispc-client")
+
+source = """
+export void scale(uniform float a[], uniform int count, uniform float s) {
+    foreach (i = 0 ... count)
+        a[i] *= s;
+}
+"""
+
+failures = 0
+def check(ok, what):
+    global failures
+    if not ok:
+        failures += 1
+    print("%s: %s" % ("PASS" if ok else "FAIL", what))
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+dir = tempfile.mkdtemp()
+runtime_dir = os.path.join(dir, "runtime")
+os.mkdir(runtime_dir, 0o700)
+env = dict(os.environ)
+env.pop("ISPC_SERVER_SOCKET", None)
+env.pop("ISPC_ARGS", None)
+env["XDG_RUNTIME_DIR"] = runtime_dir
+# If the client runs ispc itself rather than using the server, it fails.
+env["ISPC_EXECUTABLE"] = "false"
+
+with open(os.path.join(dir, "scale.ispc"), "w") as f:
+    f.write(source)
+
+server = subprocess.Popen([ispc, "--server", "--quiet", "--target=sse4"],
+                          cwd=dir, env=env)
+try:
+    socket = os.path.join(runtime_dir, "ispc-server")
+    for i in range(600):
+        if os.path.exists(socket) or server.poll() is not None:
+            break
+        time.sleep(0.1)
+    check(os.path.exists(socket), "server listens on " + socket)
+
+    args = ["scale.ispc", "--target=sse4", "-O2"]
+    ret = subprocess.call([client] + args + ["-o", "client.o", "-h", "client.h"],
+                          cwd=dir, env=env)
+    check(ret == 0, "ispc-client compiles through the server")
+    ret = subprocess.call([ispc] + args + ["-o", "direct.o", "-h", "direct.h"],
+                          cwd=dir, env=env)
+    check(ret == 0 and read(os.path.join(dir, "client.h")) ==
+          read(os.path.join(dir, "direct.h")) and
+          len(read(os.path.join(dir, "client.o"))) > 0,
+          "server output matches ispc's")
+
+    p = subprocess.Popen([client, "missing.ispc", "--target=sse4", "-o",
+                          "missing.o"], cwd=dir, env=env,
+                         stderr=subprocess.PIPE)
+    err = p.communicate()[1]
+    check(p.returncode != 0 and b"missing.ispc" in err,
+          "compile errors are reported to the client")
+
+    # Others could replace the socket in a directory they can write to, so
+    # the client must not use it.
+    os.chmod(runtime_dir, 0o777)
+    p = subprocess.Popen([client] + args + ["-o", "unsafe.o"], cwd=dir,
+                         env=env, stderr=subprocess.PIPE)
+    err = p.communicate()[1]
+    check(p.returncode != 0 and b"not using the ispc server" in err and
+          not os.path.exists(os.path.join(dir, "unsafe.o")),
+          "client refuses a socket in a directory others can access")
+    os.chmod(runtime_dir, 0o700)
+finally:
+    server.kill()
+    server.wait()
+    shutil.rmtree(dir)
+
+sys.exit(1 if failures else 0)
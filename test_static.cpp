@@ -74,7 +74,13 @@ extern "C" {
 
     void ISPCLaunch(void **handlePtr, void *f, void *d, int,int,int);
     void ISPCSync(void *handle);
+    void ISPCSyncLaunch(void *handle, int32_t launch);
+    void ISPCLaunchAfter(void **handlePtr, void *f, void *d, int,int,int,
+                         int32_t numDeps, const int32_t *deps);
     void *ISPCAlloc(void **handlePtr, int64_t size, int32_t alignment);
+    void ISPCTraceMemory(const char *fn, int line, int kind, int elementSize,
+                         int count, const uint64_t *addresses, uint64_t mask);
+    int ISPCTraceMemoryCalls();
 }
 
 void ISPCLaunch(void **handle, void *f, void *d, int count0, int count1, int count2) {
@@ -92,6 +98,17 @@ void ISPCSync(void *) {
 }
 
 
+void ISPCSyncLaunch(void *, int32_t) {
+}
+
+
+// Earlier launches have always finished by the time ISPCLaunch() returns.
+void ISPCLaunchAfter(void **handle, void *f, void *d, int count0, int count1,
+                     int count2, int32_t, const int32_t *) {
+    ISPCLaunch(handle, f, d, count0, count1, count2);
+}
+
+
 void *ISPCAlloc(void **handle, int64_t size, int32_t alignment) {
     *handle = (void *)0xdeadbeef;
     // and now, we leak...
@@ -112,6 +129,21 @@ void *ISPCAlloc(void **handle, int64_t size, int32_t alignment) {
 }
 
 
+// Tests compiled with --trace-memory call this at each memory access; they
+// can check that it was called with ISPCTraceMemoryCalls().
+static int traceMemoryCalls = 0;
+
+void ISPCTraceMemory(const char *, int, int, int, int, const uint64_t *,
+                     uint64_t) {
+    ++traceMemoryCalls;
+}
+
+
+int ISPCTraceMemoryCalls() {
+    return traceMemoryCalls;
+}
+
+
 #if defined(_WIN32) || defined(_WIN64)
 #define ALIGN __declspec(align(64))
 #else
@@ -520,8 +520,8 @@ AtomicType::LLVMType(llvm::LLVMContext *ctx) const {
         }
     }
     else {
-        ArrayType at(GetAsUniformType(), variability.soaWidth);
-        return at.LLVMType(ctx);
+        const ArrayType *at = ArrayType::Get(GetAsUniformType(), variability.soaWidth);
+        return at->LLVMType(ctx);
     }
 }
 
@@ -668,8 +668,8 @@ llvm::DIType *AtomicType::GetDIType(llvm::DIScope *scope) const {
     }
     else {
         Assert(variability == Variability::SOA);
-        ArrayType at(GetAsUniformType(), variability.soaWidth);
-        return at.GetDIType(scope);
+        const ArrayType *at = ArrayType::Get(GetAsUniformType(), variability.soaWidth);
+        return at->GetDIType(scope);
     }
 }
 
@@ -886,8 +886,8 @@ EnumType::LLVMType(llvm::LLVMContext *ctx) const {
     case Variability::Varying:
         return LLVMTypes::Int32VectorType;
     case Variability::SOA: {
-        ArrayType at(AtomicType::UniformInt32, variability.soaWidth);
-        return at.LLVMType(ctx);
+        const ArrayType *at = ArrayType::Get(AtomicType::UniformInt32, variability.soaWidth);
+        return at->LLVMType(ctx);
     }
     default:
         FATAL("Unexpected variability in EnumType::LLVMType()");
@@ -998,25 +998,64 @@ EnumType::GetEnumerator(int i) const {
 // PointerType
 
 PointerType *PointerType::Void =
-    new PointerType(AtomicType::Void, Variability(Variability::Uniform), false);
+    PointerType::Get(AtomicType::Void, Variability(Variability::Uniform), false);
 
 
 PointerType::PointerType(const Type *t, Variability v, bool ic, bool is,
-                         bool fr)
-    : Type(POINTER_TYPE), variability(v), isConst(ic), isSlice(is), isFrozen(fr) {
+                         bool fr, bool na, int al)
+    : Type(POINTER_TYPE), variability(v), isConst(ic), isSlice(is), isFrozen(fr),
+      isNoAlias(na), alignment(al) {
     baseType = t;
 }
 
 
+/** Everything that distinguishes one PointerType from another. */
+struct PointerTypeKey {
+    const Type *baseType;
+    int variability, soaWidth;
+    int flags;
+    int alignment;
+
+    bool operator<(const PointerTypeKey &k) const {
+        if (baseType != k.baseType) return baseType < k.baseType;
+        if (variability != k.variability) return variability < k.variability;
+        if (soaWidth != k.soaWidth) return soaWidth < k.soaWidth;
+        if (flags != k.flags) return flags < k.flags;
+        return alignment < k.alignment;
+    }
+};
+
+
+PointerType *
+PointerType::Get(const Type *t, Variability v, bool ic, bool is, bool fr,
+                 bool na, int al) {
+    // This is a function-level static so that it's initialized before
+    // PointerType::Void is created during static initialization.
+    static std::map<PointerTypeKey, PointerType *> pointerTypes;
+
+    PointerTypeKey key;
+    key.baseType = t;
+    key.variability = (int)v.type;
+    key.soaWidth = v.soaWidth;
+    key.flags = (ic ? 1 : 0) | (is ? 2 : 0) | (fr ? 4 : 0) | (na ? 8 : 0);
+    key.alignment = al;
+
+    PointerType *&pt = pointerTypes[key];
+    if (pt == NULL)
+        pt = new PointerType(t, v, ic, is, fr, na, al);
+    return pt;
+}
+
+
 PointerType *
 PointerType::GetUniform(const Type *t, bool is) {
-    return new PointerType(t, Variability(Variability::Uniform), false, is);
+    return PointerType::Get(t, Variability(Variability::Uniform), false, is);
 }
 
 
 PointerType *
 PointerType::GetVarying(const Type *t) {
-    return new PointerType(t, Variability(Variability::Varying), false);
+    return PointerType::Get(t, Variability(Variability::Varying), false);
 }
 
 
@@ -1074,8 +1113,9 @@ PointerType::GetAsVaryingType() const {
     if (variability == Variability::Varying)
         return this;
     else
-        return new PointerType(baseType, Variability(Variability::Varying),
-                               isConst, isSlice, isFrozen);
+        return PointerType::Get(baseType, Variability(Variability::Varying),
+                                isConst, isSlice, isFrozen, isNoAlias,
+                                alignment);
 }
 
 
@@ -1084,8 +1124,9 @@ PointerType::GetAsUniformType() const {
     if (variability == Variability::Uniform)
         return this;
     else
-        return new PointerType(baseType, Variability(Variability::Uniform),
-                               isConst, isSlice, isFrozen);
+        return PointerType::Get(baseType, Variability(Variability::Uniform),
+                                isConst, isSlice, isFrozen, isNoAlias,
+                                alignment);
 }
 
 
@@ -1094,8 +1135,9 @@ PointerType::GetAsUnboundVariabilityType() const {
     if (variability == Variability::Unbound)
         return this;
     else
-        return new PointerType(baseType, Variability(Variability::Unbound),
-                               isConst, isSlice, isFrozen);
+        return PointerType::Get(baseType, Variability(Variability::Unbound),
+                                isConst, isSlice, isFrozen, isNoAlias,
+                                alignment);
 }
 
 
@@ -1104,8 +1146,9 @@ PointerType::GetAsSOAType(int width) const {
     if (GetSOAWidth() == width)
         return this;
     else
-        return new PointerType(baseType, Variability(Variability::SOA, width),
-                               isConst, isSlice, isFrozen);
+        return PointerType::Get(baseType, Variability(Variability::SOA, width),
+                                isConst, isSlice, isFrozen, isNoAlias,
+                                alignment);
 }
 
 
@@ -1113,7 +1156,8 @@ const PointerType *
 PointerType::GetAsSlice() const {
     if (isSlice)
         return this;
-    return new PointerType(baseType, variability, isConst, true);
+    return PointerType::Get(baseType, variability, isConst, true, false,
+                            isNoAlias, alignment);
 }
 
 
@@ -1121,7 +1165,8 @@ const PointerType *
 PointerType::GetAsNonSlice() const {
     if (isSlice == false)
         return this;
-    return new PointerType(baseType, variability, isConst, false);
+    return PointerType::Get(baseType, variability, isConst, false, false,
+                            isNoAlias, alignment);
 }
 
 
@@ -1129,7 +1174,26 @@ const PointerType *
 PointerType::GetAsFrozenSlice() const {
     if (isFrozen)
         return this;
-    return new PointerType(baseType, variability, isConst, true, true);
+    return PointerType::Get(baseType, variability, isConst, true, true,
+                            isNoAlias, alignment);
+}
+
+
+const PointerType *
+PointerType::GetAsNoAliasType() const {
+    if (isNoAlias)
+        return this;
+    return PointerType::Get(baseType, variability, isConst, isSlice, isFrozen,
+                            true, alignment);
+}
+
+
+const PointerType *
+PointerType::GetAsAlignedType(int align) const {
+    if (alignment == align)
+        return this;
+    return PointerType::Get(baseType, variability, isConst, isSlice, isFrozen,
+                            isNoAlias, align);
 }
 
 
@@ -1145,8 +1209,8 @@ PointerType::ResolveUnboundVariability(Variability v) const {
         variability;
     const Type *resolvedBaseType =
         baseType->ResolveUnboundVariability(Variability::Uniform);
-    return new PointerType(resolvedBaseType, ptrVariability, isConst, isSlice,
-                           isFrozen);
+    return PointerType::Get(resolvedBaseType, ptrVariability, isConst, isSlice,
+                            isFrozen, isNoAlias, alignment);
 }
 
 
@@ -1155,7 +1219,8 @@ PointerType::GetAsConstType() const {
     if (isConst == true)
         return this;
     else
-        return new PointerType(baseType, variability, true, isSlice);
+        return PointerType::Get(baseType, variability, true, isSlice, false,
+                                isNoAlias, alignment);
 }
 
 
@@ -1164,7 +1229,8 @@ PointerType::GetAsNonConstType() const {
     if (isConst == false)
         return this;
     else
-        return new PointerType(baseType, variability, false, isSlice);
+        return PointerType::Get(baseType, variability, false, isSlice, false,
+                                isNoAlias, alignment);
 }
 
 
@@ -1179,6 +1245,12 @@ PointerType::GetString() const {
 
     ret += std::string(" * ");
     if (isConst) ret += "const ";
+    if (isNoAlias) ret += "noalias ";
+    if (alignment > 0) {
+        char buf[32];
+        sprintf(buf, "aligned(%d) ", alignment);
+        ret += buf;
+    }
     if (isSlice) ret += "slice ";
     if (isFrozen) ret += "/*frozen*/ ";
     ret += variability.GetString();
@@ -1224,6 +1296,7 @@ PointerType::GetCDeclaration(const std::string &name) const {
     if (baseIsBasicVarying) ret += std::string("(");
     ret += std::string(" *");
     if (isConst) ret += " const";
+    if (isNoAlias) ret += " __restrict";
     ret += std::string(" ");
     ret += name;
     if (baseIsBasicVarying) ret += std::string(")");
@@ -1295,8 +1368,8 @@ PointerType::LLVMType(llvm::LLVMContext *ctx) const {
         // pointers
         return LLVMTypes::VoidPointerVectorType;
     case Variability::SOA: {
-        ArrayType at(GetAsUniformType(), variability.soaWidth);
-        return at.LLVMType(ctx);
+        const ArrayType *at = ArrayType::Get(GetAsUniformType(), variability.soaWidth);
+        return at->LLVMType(ctx);
     }
     default:
         FATAL("Unexpected variability in PointerType::LLVMType()");
@@ -1337,8 +1410,8 @@ llvm::DIType *PointerType::GetDIType(llvm::DIScope *scope) const {
         return lCreateDIArray(eltType, g->target->getVectorWidth());
     }
     case Variability::SOA: {
-        ArrayType at(GetAsUniformType(), variability.soaWidth);
-        return at.GetDIType(scope);
+        const ArrayType *at = ArrayType::Get(GetAsUniformType(), variability.soaWidth);
+        return at->GetDIType(scope);
     }
     default:
         FATAL("Unexpected variability in PointerType::GetDIType()");
@@ -1370,6 +1443,17 @@ ArrayType::ArrayType(const Type *c, int a)
 }
 
 
+ArrayType *
+ArrayType::Get(const Type *c, int a) {
+    static std::map<std::pair<const Type *, int>, ArrayType *> arrayTypes;
+
+    ArrayType *&at = arrayTypes[std::make_pair(c, a)];
+    if (at == NULL)
+        at = new ArrayType(c, a);
+    return at;
+}
+
+
 llvm::ArrayType *
 ArrayType::LLVMType(llvm::LLVMContext *ctx) const {
     if (child == NULL) {
@@ -1441,7 +1525,7 @@ ArrayType::GetAsVaryingType() const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ArrayType(child->GetAsVaryingType(), numElements);
+    return ArrayType::Get(child->GetAsVaryingType(), numElements);
 }
 
 
@@ -1451,7 +1535,7 @@ ArrayType::GetAsUniformType() const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ArrayType(child->GetAsUniformType(), numElements);
+    return ArrayType::Get(child->GetAsUniformType(), numElements);
 }
 
 
@@ -1461,7 +1545,7 @@ ArrayType::GetAsUnboundVariabilityType() const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ArrayType(child->GetAsUnboundVariabilityType(), numElements);
+    return ArrayType::Get(child->GetAsUnboundVariabilityType(), numElements);
 }
 
 
@@ -1471,7 +1555,7 @@ ArrayType::GetAsSOAType(int width) const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ArrayType(child->GetAsSOAType(width), numElements);
+    return ArrayType::Get(child->GetAsSOAType(width), numElements);
 }
 
 
@@ -1481,7 +1565,7 @@ ArrayType::ResolveUnboundVariability(Variability v) const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ArrayType(child->ResolveUnboundVariability(v), numElements);
+    return ArrayType::Get(child->ResolveUnboundVariability(v), numElements);
 }
 
 
@@ -1491,7 +1575,7 @@ ArrayType::GetAsUnsignedType() const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ArrayType(child->GetAsUnsignedType(), numElements);
+    return ArrayType::Get(child->GetAsUnsignedType(), numElements);
 }
 
 
@@ -1501,7 +1585,7 @@ ArrayType::GetAsConstType() const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ArrayType(child->GetAsConstType(), numElements);
+    return ArrayType::Get(child->GetAsConstType(), numElements);
 }
 
 
@@ -1511,7 +1595,7 @@ ArrayType::GetAsNonConstType() const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ArrayType(child->GetAsNonConstType(), numElements);
+    return ArrayType::Get(child->GetAsNonConstType(), numElements);
 }
 
 
@@ -1579,7 +1663,12 @@ ArrayType::GetCDeclaration(const std::string &name) const {
 
     int soaWidth = base->GetSOAWidth();
     int vWidth = (base->IsVaryingType()) ? g->target->getVectorWidth() : 0;
-    base = base->GetAsUniformType();
+    if (soaWidth > 0 && CastType<StructType>(base) != NULL)
+        // The soa width is part of the struct's name in this case; each
+        // array element is a whole soa block.
+        soaWidth = 0;
+    else
+        base = base->GetAsUniformType();
 
     std::string s = base->GetCDeclaration(name);
 
@@ -1642,7 +1731,7 @@ llvm::DIType *ArrayType::GetDIType(llvm::DIScope *scope) const {
 ArrayType *
 ArrayType::GetSizedArray(int sz) const {
     Assert(numElements == 0);
-    return new ArrayType(child, sz);
+    return ArrayType::Get(child, sz);
 }
 
 
@@ -1699,8 +1788,8 @@ ArrayType::SizeUnsizedArrays(const Type *type, Expr *initExpr) {
 
     // Recursively call SizeUnsizedArrays() to get the child type for the
     // array that we were able to size here.
-    return new ArrayType(SizeUnsizedArrays(at->GetElementType(), nextList),
-                         at->GetElementCount());
+    return ArrayType::Get(SizeUnsizedArrays(at->GetElementType(), nextList),
+                          at->GetElementCount());
 }
 
 
@@ -1850,11 +1939,11 @@ VectorType::LLVMType(llvm::LLVMContext *ctx) const {
 
     if (base->IsUniformType())
         // vectors of uniform types are laid out across LLVM vectors, with
-        // the llvm vector size set to be a multiple of the machine's
-        // natural vector size (e.g. 4 on SSE).  This is a roundabout way
-        // of ensuring that LLVM lays them out into machine vector
-        // registers so that e.g. if we want to add two uniform 4 float
-        // vectors, that is turned into a single addps on SSE.
+        // the llvm vector size rounded up as described in
+        // getVectorMemoryCount().  This is a roundabout way of ensuring
+        // that LLVM lays them out into machine vector registers so that
+        // e.g. if we want to add two uniform 4 float vectors, that is
+        // turned into a single addps on SSE or AVX.
         return llvm::VectorType::get(bt, getVectorMemoryCount());
     else if (base->IsVaryingType())
         // varying types are already laid out to fill HW vector registers,
@@ -1898,13 +1987,13 @@ llvm::DIType *VectorType::GetDIType(llvm::DIScope *scope) const {
 #endif
 
     if (IsUniformType())
-        align = 4 * g->target->getNativeVectorWidth();
+        align = 8 * g->target->getDataLayout()->getABITypeAlignment(LLVMType(g->ctx));
 
     if (IsUniformType() || IsVaryingType())
         return m->diBuilder->createVectorType(sizeBits, align, eltType, subArray);
     else if (IsSOAType()) {
-        ArrayType at(base, numElements);
-        return at.GetDIType(scope);
+        const ArrayType *at = ArrayType::Get(base, numElements);
+        return at->GetDIType(scope);
     }
     else {
         FATAL("Unexpected variability in VectorType::GetDIType()");
@@ -1930,8 +2019,16 @@ VectorType::getVectorMemoryCount() const {
             // values, so for the 64-bit guys, it takes half as many of
             // them to fill the native width
             nativeWidth /= 2;
-        // and now round up the element count to be a multiple of
-        // nativeWidth
+        // Vectors that fit in a native vector are rounded up to the next
+        // power of two elements, so that e.g. a float<3> or float<4> is
+        // held in a single 128-bit register even on AVX and AVX-512
+        // targets, and has the same layout for all of them.  The generic
+        // targets only have vector types of the full native width in
+        // their C++ headers.  Longer vectors are rounded up to a
+        // multiple of the native width.
+        int pow2Count = (int)RoundUpPow2(numElements);
+        if (pow2Count <= nativeWidth && g->target->getISA() != Target::GENERIC)
+            return pow2Count;
         return (numElements + (nativeWidth - 1)) & ~(nativeWidth-1);
     }
     else if (base->IsSOAType()) {
@@ -2284,17 +2381,15 @@ StructType::GetCDeclaration(const std::string &n) const {
     std::string ret;
     if (isConst) ret += "const ";
     ret += std::string("struct ") + GetCStructName();
-    if (lShouldPrintName(n)) {
-        ret += std::string(" ") + n;
-
-        if (variability.soaWidth > 0) {
-            char buf[32];
-            // This has to match the naming scheme used in lEmitStructDecls()
-            // in module.cpp
-            sprintf(buf, "_SOA%d", variability.soaWidth);
-            ret += buf;
-        }
+    if (variability.soaWidth > 0) {
+        char buf[32];
+        // This has to match the naming scheme used in lEmitStructDecls()
+        // in module.cpp
+        sprintf(buf, "_SOA%d", variability.soaWidth);
+        ret += buf;
     }
+    if (lShouldPrintName(n))
+        ret += std::string(" ") + n;
 
     return ret;
 }
@@ -2666,6 +2761,17 @@ ReferenceType::ReferenceType(const Type *t)
 }
 
 
+ReferenceType *
+ReferenceType::Get(const Type *t) {
+    static std::map<const Type *, ReferenceType *> referenceTypes;
+
+    ReferenceType *&rt = referenceTypes[t];
+    if (rt == NULL)
+        rt = new ReferenceType(t);
+    return rt;
+}
+
+
 Variability
 ReferenceType::GetVariability() const {
     if (targetType == NULL) {
@@ -2750,7 +2856,7 @@ ReferenceType::GetAsVaryingType() const {
     }
     if (IsVaryingType())
         return this;
-    return new ReferenceType(targetType->GetAsVaryingType());
+    return ReferenceType::Get(targetType->GetAsVaryingType());
 }
 
 
@@ -2762,7 +2868,7 @@ ReferenceType::GetAsUniformType() const {
     }
     if (IsUniformType())
         return this;
-    return new ReferenceType(targetType->GetAsUniformType());
+    return ReferenceType::Get(targetType->GetAsUniformType());
 }
 
 
@@ -2774,14 +2880,14 @@ ReferenceType::GetAsUnboundVariabilityType() const {
     }
     if (HasUnboundVariability())
         return this;
-    return new ReferenceType(targetType->GetAsUnboundVariabilityType());
+    return ReferenceType::Get(targetType->GetAsUnboundVariabilityType());
 }
 
 
 const Type *
 ReferenceType::GetAsSOAType(int width) const {
     // FIXME: is this right?
-    return new ArrayType(this, width);
+    return ArrayType::Get(this, width);
 }
 
 
@@ -2791,7 +2897,7 @@ ReferenceType::ResolveUnboundVariability(Variability v) const {
         Assert(m->errorCount > 0);
         return NULL;
     }
-    return new ReferenceType(targetType->ResolveUnboundVariability(v));
+    return ReferenceType::Get(targetType->ResolveUnboundVariability(v));
 }
 
 
@@ -2805,7 +2911,7 @@ ReferenceType::GetAsConstType() const {
         return this;
 
     if (asOtherConstType == NULL) {
-        asOtherConstType = new ReferenceType(targetType->GetAsConstType());
+        asOtherConstType = ReferenceType::Get(targetType->GetAsConstType());
         asOtherConstType->asOtherConstType = this;
     }
     return asOtherConstType;
@@ -2822,7 +2928,7 @@ ReferenceType::GetAsNonConstType() const {
         return this;
 
     if (asOtherConstType == NULL) {
-        asOtherConstType = new ReferenceType(targetType->GetAsNonConstType());
+        asOtherConstType = ReferenceType::Get(targetType->GetAsNonConstType());
         asOtherConstType->asOtherConstType = this;
     }
     return asOtherConstType;
@@ -2939,6 +3045,10 @@ FunctionType::FunctionType(const Type *r,
     Assert(returnType != NULL);
     isSafe = false;
     costOverride = -1;
+    gangWidth = 0;
+    isVectorABI = false;
+    isFastMath = false;
+    fpContract = -1;
 }
 
 
@@ -2957,6 +3067,10 @@ FunctionType::FunctionType(const Type *r,
     Assert(returnType != NULL);
     isSafe = false;
     costOverride = -1;
+    gangWidth = 0;
+    isVectorABI = false;
+    isFastMath = false;
+    fpContract = -1;
 }
 
 
@@ -3053,6 +3167,10 @@ FunctionType::ResolveUnboundVariability(Variability v) const {
                                          isExternC, isUnmasked);
     ret->isSafe = isSafe;
     ret->costOverride = costOverride;
+    ret->gangWidth = gangWidth;
+    ret->isVectorABI = isVectorABI;
+    ret->isFastMath = isFastMath;
+    ret->fpContract = fpContract;
 
     return ret;
 }
@@ -3104,23 +3222,94 @@ FunctionType::Mangle() const {
 }
 
 
+std::string
+FunctionType::GetVectorABICType(const Type *type) {
+    const AtomicType *at = CastType<AtomicType>(type);
+    if (at == NULL || at->IsVaryingType() == false ||
+        g->target->getISA() >= Target::GENERIC)
+        return "";
+
+    int width = g->target->getVectorWidth();
+    int elementBits;
+    const char *suffix = "i";
+    switch (at->basicType) {
+    case AtomicType::TYPE_BOOL:
+        // With one-bit masks, varying bools are AVX-512 mask registers.
+        if (g->target->getMaskBitCount() == 1)
+            return (width == 8) ? "__mmask8" : (width == 16) ? "__mmask16" : "";
+        elementBits = g->target->getMaskBitCount();
+        break;
+    case AtomicType::TYPE_INT8:
+    case AtomicType::TYPE_UINT8:
+        elementBits = 8;
+        break;
+    case AtomicType::TYPE_INT16:
+    case AtomicType::TYPE_UINT16:
+        elementBits = 16;
+        break;
+    case AtomicType::TYPE_INT32:
+    case AtomicType::TYPE_UINT32:
+        elementBits = 32;
+        break;
+    case AtomicType::TYPE_FLOAT:
+        elementBits = 32;
+        suffix = "";
+        break;
+    case AtomicType::TYPE_INT64:
+    case AtomicType::TYPE_UINT64:
+        elementBits = 64;
+        break;
+    case AtomicType::TYPE_DOUBLE:
+        elementBits = 64;
+        suffix = "d";
+        break;
+    default:
+        return "";
+    }
+
+    // The vector has to fit in one of the target's registers.
+    int bits = width * elementBits;
+    if ((bits != 128 && bits != 256 && bits != 512) ||
+        bits > 8 * g->target->getNativeVectorAlignment())
+        return "";
+
+    char buf[16];
+    sprintf(buf, "__m%d%s", bits, suffix);
+    return buf;
+}
+
+
 std::string
 FunctionType::GetCDeclaration(const std::string &fname) const {
     std::string ret;
-    ret += returnType->GetCDeclaration("");
+    if (isVectorABI && returnType->IsVaryingType())
+        ret += GetVectorABICType(returnType);
+    else
+        ret += returnType->GetCDeclaration("");
     ret += " ";
+    if (isVectorABI)
+        ret += "ISPC_VECTOR_ABI ";
     ret += fname;
     ret += "(";
     for (unsigned int i = 0; i < paramTypes.size(); ++i) {
         const Type *type = paramTypes[i];
 
+        if (isVectorABI && type->IsVaryingType()) {
+            ret += GetVectorABICType(type);
+            if (paramNames[i] != "")
+                ret += " " + paramNames[i];
+            if (i != paramTypes.size() - 1)
+                ret += ", ";
+            continue;
+        }
+
         // Convert pointers to arrays to unsized arrays, which are more clear
         // to print out for multidimensional arrays (i.e. "float foo[][4] "
         // versus "float (foo *)[4]").
         const PointerType *pt = CastType<PointerType>(type);
         if (pt != NULL &&
             CastType<ArrayType>(pt->GetBaseType()) != NULL) {
-            type = new ArrayType(pt->GetBaseType(), 0);
+            type = ArrayType::Get(pt->GetBaseType(), 0);
         }
         
         if (paramNames[i] != "")
@@ -3151,7 +3340,7 @@ FunctionType::GetCDeclarationForDispatch(const std::string &fname) const {
         const PointerType *pt = CastType<PointerType>(type);
         if (pt != NULL &&
             CastType<ArrayType>(pt->GetBaseType()) != NULL) {
-            type = new ArrayType(pt->GetBaseType(), 0);
+            type = ArrayType::Get(pt->GetBaseType(), 0);
         }
         
         // Change pointers to varying thingies to void *
@@ -3195,19 +3384,23 @@ llvm::DIType *FunctionType::GetDIType(llvm::DIScope *scope) const {
 #else // LLVM 3.6++
     std::vector<llvm::Metadata *> retArgTypes;
 #endif
-    retArgTypes.push_back(returnType->GetDIType(scope));
-    for (int i = 0; i < GetNumParameters(); ++i) {
-        const Type *t = GetParameterType(i);
-        if (t == NULL)
+    // With -gline-tables-only, functions are described without their
+    // return and parameter types.
+    if (g->debugLineTablesOnly == false) {
+        retArgTypes.push_back(returnType->GetDIType(scope));
+        for (int i = 0; i < GetNumParameters(); ++i) {
+            const Type *t = GetParameterType(i);
+            if (t == NULL)
 
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_3
-            return llvm::DIType();
+                return llvm::DIType();
 #elif ISPC_LLVM_VERSION <= ISPC_LLVM_3_6
-            return llvm::DICompositeType();
+                return llvm::DICompositeType();
 #else // LLVM 3.7++
-            return NULL;
+                return NULL;
 #endif
-        retArgTypes.push_back(t->GetDIType(scope));
+            retArgTypes.push_back(t->GetDIType(scope));
+        }
     }
 #if ISPC_LLVM_VERSION <= ISPC_LLVM_3_5
     llvm::DIArray retArgTypesArray =
@@ -3252,11 +3445,24 @@ FunctionType::GetReturnTypeString() const {
         ret += "unmasked ";
     if (isSafe)
         ret += "/*safe*/ ";
+    if (isVectorABI)
+        ret += "/*vector_abi*/ ";
+    if (isFastMath)
+        ret += "/*fastmath*/ ";
+    if (fpContract == 0)
+        ret += "/*fp_contract_off*/ ";
+    else if (fpContract == 1)
+        ret += "/*fp_contract_on*/ ";
     if (costOverride > 0) {
         char buf[32];
         sprintf(buf, "/*cost=%d*/ ", costOverride);
         ret += buf;
     }
+    if (gangWidth > 0) {
+        char buf[32];
+        sprintf(buf, "/*width=%d*/ ", gangWidth);
+        ret += buf;
+    }
 
     return ret + returnType->GetString();
 }
@@ -3281,6 +3487,11 @@ FunctionType::LLVMFunctionType(llvm::LLVMContext *ctx, bool removeMask) const {
             Assert(m->errorCount > 0);
             return NULL;
         }
+        // The application-callable version of a "vector_abi" function
+        // takes one-bit-mask varying bools as __mmask8/16 integers.
+        if (removeMask && isVectorABI && t == LLVMTypes::BoolVectorType &&
+            g->target->getMaskBitCount() == 1)
+            t = llvm::IntegerType::get(*ctx, g->target->getVectorWidth());
         llvmArgTypes.push_back(t);
     }
 
@@ -3324,6 +3535,9 @@ FunctionType::LLVMFunctionType(llvm::LLVMContext *ctx, bool removeMask) const {
     llvm::Type *llvmReturnType = returnType->LLVMType(g->ctx);
     if (llvmReturnType == NULL)
         return NULL;
+    if (removeMask && isVectorABI && llvmReturnType == LLVMTypes::BoolVectorType &&
+        g->target->getMaskBitCount() == 1)
+        llvmReturnType = llvm::IntegerType::get(*ctx, g->target->getVectorWidth());
 
     return llvm::FunctionType::get(llvmReturnType, callTypes, false);
 }
@@ -3357,6 +3571,260 @@ FunctionType::GetParameterName(int i) const {
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+// TemplateTypeParmType
+
+TemplateTypeParmType::TemplateTypeParmType(const std::string &n,
+                                           Variability v, bool ic,
+                                           SourcePos p)
+    : Type(TEMPLATE_TYPE_PARM_TYPE), name(n), variability(v), isConst(ic),
+      pos(p) {
+}
+
+
+Variability
+TemplateTypeParmType::GetVariability() const {
+    return variability;
+}
+
+
+bool
+TemplateTypeParmType::IsBoolType() const {
+    return false;
+}
+
+
+bool
+TemplateTypeParmType::IsFloatType() const {
+    return false;
+}
+
+
+bool
+TemplateTypeParmType::IsIntType() const {
+    return false;
+}
+
+
+bool
+TemplateTypeParmType::IsUnsignedType() const {
+    return false;
+}
+
+
+bool
+TemplateTypeParmType::IsConstType() const {
+    return isConst;
+}
+
+
+const Type *
+TemplateTypeParmType::GetBaseType() const {
+    return this;
+}
+
+
+const TemplateTypeParmType *
+TemplateTypeParmType::GetAsVaryingType() const {
+    if (variability == Variability::Varying)
+        return this;
+    return new TemplateTypeParmType(name, Variability::Varying, isConst, pos);
+}
+
+
+const TemplateTypeParmType *
+TemplateTypeParmType::GetAsUniformType() const {
+    if (variability == Variability::Uniform)
+        return this;
+    return new TemplateTypeParmType(name, Variability::Uniform, isConst, pos);
+}
+
+
+const TemplateTypeParmType *
+TemplateTypeParmType::GetAsUnboundVariabilityType() const {
+    if (variability == Variability::Unbound)
+        return this;
+    return new TemplateTypeParmType(name, Variability::Unbound, isConst, pos);
+}
+
+
+const TemplateTypeParmType *
+TemplateTypeParmType::GetAsSOAType(int width) const {
+    Variability v(Variability::SOA, width);
+    if (variability == v)
+        return this;
+    return new TemplateTypeParmType(name, v, isConst, pos);
+}
+
+
+const TemplateTypeParmType *
+TemplateTypeParmType::ResolveUnboundVariability(Variability v) const {
+    // An unqualified "T" takes the variability of the template argument,
+    // so it's left unbound until the template is instantiated.
+    return this;
+}
+
+
+const TemplateTypeParmType *
+TemplateTypeParmType::GetAsConstType() const {
+    if (isConst)
+        return this;
+    return new TemplateTypeParmType(name, variability, true, pos);
+}
+
+
+const TemplateTypeParmType *
+TemplateTypeParmType::GetAsNonConstType() const {
+    if (isConst == false)
+        return this;
+    return new TemplateTypeParmType(name, variability, false, pos);
+}
+
+
+std::string
+TemplateTypeParmType::GetString() const {
+    std::string ret;
+    if (isConst)
+        ret += "const ";
+    if (variability != Variability::Unbound) {
+        ret += variability.GetString();
+        ret += " ";
+    }
+    ret += name;
+    return ret;
+}
+
+
+std::string
+TemplateTypeParmType::Mangle() const {
+    std::string ret;
+    if (isConst)
+        ret += "C";
+    if (variability != Variability::Unbound)
+        ret += variability.MangleString();
+    ret += std::string("_T_") + name;
+    return ret;
+}
+
+
+std::string
+TemplateTypeParmType::GetCDeclaration(const std::string &n) const {
+    std::string ret;
+    if (isConst)
+        ret += "const ";
+    ret += name;
+    if (lShouldPrintName(n))
+        ret += std::string(" ") + n;
+    return ret;
+}
+
+
+llvm::Type *
+TemplateTypeParmType::LLVMType(llvm::LLVMContext *ctx) const {
+    // Template definitions are never compiled, only their instantiations.
+    Assert(m->errorCount > 0);
+    return NULL;
+}
+
+
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_6
+llvm::DIType TemplateTypeParmType::GetDIType(llvm::DIDescriptor scope) const {
+    FATAL("TemplateTypeParmType::GetDIType() shouldn't be called.");
+    return llvm::DIType();
+}
+#else // LLVM 3.7++
+llvm::DIType *TemplateTypeParmType::GetDIType(llvm::DIScope *scope) const {
+    FATAL("TemplateTypeParmType::GetDIType() shouldn't be called.");
+    return NULL;
+}
+#endif
+
+
+const Type *
+TemplateTypeParmType::Substitute(const Type *type,
+                                 const std::map<std::string, const Type *> &args) {
+    if (type == NULL)
+        return NULL;
+
+    const TemplateTypeParmType *tp = CastType<TemplateTypeParmType>(type);
+    if (tp != NULL) {
+        std::map<std::string, const Type *>::const_iterator iter =
+            args.find(tp->name);
+        if (iter == args.end())
+            return type;
+        const Type *t = iter->second;
+        if (tp->variability == Variability::Uniform)
+            t = t->GetAsUniformType();
+        else if (tp->variability == Variability::Varying)
+            t = t->GetAsVaryingType();
+        else if (tp->variability == Variability::SOA)
+            t = t->GetAsSOAType(tp->variability.soaWidth);
+        if (t != NULL && tp->isConst)
+            t = t->GetAsConstType();
+        return t;
+    }
+
+    const PointerType *pt = CastType<PointerType>(type);
+    if (pt != NULL) {
+        const Type *base = Substitute(pt->GetBaseType(), args);
+        if (base == NULL)
+            return NULL;
+        return PointerType::Get(base, pt->GetVariability(), pt->IsConstType(),
+                                pt->IsSlice(), pt->IsFrozenSlice(),
+                                pt->IsNoAlias(), pt->GetAlignment());
+    }
+
+    const ArrayType *at = CastType<ArrayType>(type);
+    if (at != NULL) {
+        const Type *elt = Substitute(at->GetElementType(), args);
+        if (elt == NULL)
+            return NULL;
+        return ArrayType::Get(elt, at->GetElementCount());
+    }
+
+    const ReferenceType *rt = CastType<ReferenceType>(type);
+    if (rt != NULL) {
+        const Type *target = Substitute(rt->GetReferenceTarget(), args);
+        if (target == NULL)
+            return NULL;
+        return ReferenceType::Get(target);
+    }
+
+    const FunctionType *ft = CastType<FunctionType>(type);
+    if (ft != NULL) {
+        const Type *ret = Substitute(ft->GetReturnType(), args);
+        llvm::SmallVector<const Type *, 8> pt;
+        llvm::SmallVector<std::string, 8> pn;
+        llvm::SmallVector<Expr *, 8> pd;
+        llvm::SmallVector<SourcePos, 8> pp;
+        for (int i = 0; i < ft->GetNumParameters(); ++i) {
+            const Type *paramType = Substitute(ft->GetParameterType(i), args);
+            if (paramType == NULL)
+                return NULL;
+            pt.push_back(paramType);
+            pn.push_back(ft->GetParameterName(i));
+            pd.push_back(ft->GetParameterDefault(i));
+            pp.push_back(ft->GetParameterSourcePos(i));
+        }
+        if (ret == NULL)
+            return NULL;
+
+        FunctionType *sft = new FunctionType(ret, pt, pn, pd, pp, ft->isTask,
+                                             ft->isExported, ft->isExternC,
+                                             ft->isUnmasked);
+        sft->isSafe = ft->isSafe;
+        sft->costOverride = ft->costOverride;
+        sft->gangWidth = ft->gangWidth;
+        sft->isVectorABI = ft->isVectorABI;
+        sft->isFastMath = ft->isFastMath;
+        sft->fpContract = ft->fpContract;
+        return sft;
+    }
+
+    return type;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 // Type
 
@@ -3581,6 +4049,12 @@ lCheckTypeEquality(const Type *a, const Type *b, bool ignoreConst) {
     if (a == NULL || b == NULL)
         return false;
 
+    // Pointer, array and reference types are hash-consed and the atomic
+    // types are mostly shared, so this catches most equal types right
+    // away.
+    if (a == b)
+        return true;
+
     if (ignoreConst == false &&
         a->IsConstType() != b->IsConstType())
         return false;
@@ -3648,6 +4122,12 @@ lCheckTypeEquality(const Type *a, const Type *b, bool ignoreConst) {
         return (lCheckTypeEquality(rta->GetReferenceTarget(),
                                    rtb->GetReferenceTarget(), ignoreConst));
 
+    const TemplateTypeParmType *tpa = CastType<TemplateTypeParmType>(a);
+    const TemplateTypeParmType *tpb = CastType<TemplateTypeParmType>(b);
+    if (tpa != NULL && tpb != NULL)
+        return (tpa->GetName() == tpb->GetName() &&
+                tpa->GetVariability() == tpb->GetVariability());
+
     const FunctionType *fta = CastType<FunctionType>(a);
     const FunctionType *ftb = CastType<FunctionType>(b);
     if (fta != NULL && ftb != NULL) {
@@ -48,6 +48,7 @@
   #include <llvm/IR/DerivedTypes.h>
 #endif
 #include <llvm/ADT/SmallVector.h>
+#include <map>
 
 class ConstExpr;
 class StructType;
@@ -89,7 +90,8 @@ enum TypeId {
   STRUCT_TYPE,           // 5
   UNDEFINED_STRUCT_TYPE, // 6
   REFERENCE_TYPE,        // 7
-  FUNCTION_TYPE          // 8
+  FUNCTION_TYPE,         // 8
+  TEMPLATE_TYPE_PARM_TYPE // 9
 };
 
 
@@ -442,11 +444,21 @@ private:
       pointer, and the value of the minor offset should be left unchanged.
       Pointers to lvalues from structure member access have the frozen
       property; see discussion in comments in the StructMemberExpr class.
+
+    Pointers may also be declared "noalias" in the language, which asserts
+    that the memory they point to isn't accessed through any other pointer
+    while they're in scope, in the same way as C99's "restrict", and
+    "aligned(N)", which asserts that the pointer's value is a multiple of N
+    bytes.
  */
 class PointerType : public Type {
 public:
-    PointerType(const Type *t, Variability v, bool isConst,
-                bool isSlice = false, bool frozen = false);
+    /** Returns the PointerType with the given properties.  PointerTypes
+        are hash-consed: asking for the same pointer type twice returns
+        the same object. */
+    static PointerType *Get(const Type *t, Variability v, bool isConst,
+                            bool isSlice = false, bool frozen = false,
+                            bool noAlias = false, int alignment = 0);
 
     /** Helper method to return a uniform pointer to the given type. */
     static PointerType *GetUniform(const Type *t, bool isSlice = false);
@@ -466,9 +478,17 @@ public:
 
     bool IsSlice() const { return isSlice; }
     bool IsFrozenSlice() const { return isFrozen; }
+    bool IsNoAlias() const { return isNoAlias; }
+    /** Returns the alignment in bytes declared for the pointer's value
+        with the "aligned" qualifier, or zero if none was given. */
+    int GetAlignment() const { return alignment; }
     const PointerType *GetAsSlice() const;
     const PointerType *GetAsNonSlice() const;
     const PointerType *GetAsFrozenSlice() const;
+    const PointerType *GetAsNoAliasType() const;
+    /** Returns the same pointer type with the given declared alignment;
+        zero removes any declared alignment. */
+    const PointerType *GetAsAlignedType(int alignment) const;
 
     const Type *GetBaseType() const;
     const PointerType *GetAsVaryingType() const;
@@ -494,9 +514,14 @@ public:
     static PointerType *Void;
 
 private:
+    PointerType(const Type *t, Variability v, bool isConst,
+                bool isSlice, bool frozen, bool noAlias, int alignment);
+
     const Variability variability;
     const bool isConst;
     const bool isSlice, isFrozen;
+    const bool isNoAlias;
+    const int alignment;
     const Type *baseType;
 };
 
@@ -565,8 +590,11 @@ public:
                             can be converted to unsized arrays to be passed
                             to functions that take array parameters, for
                             example).
+
+        ArrayTypes are hash-consed, so Get() returns the same object when
+        called with the same arguments.
      */
-    ArrayType(const Type *elementType, int numElements);
+    static ArrayType *Get(const Type *elementType, int numElements);
 
     Variability GetVariability() const;
 
@@ -618,6 +646,8 @@ public:
     static const Type *SizeUnsizedArrays(const Type *type, Expr *initExpr);
 
 private:
+    ArrayType(const Type *elementType, int numElements);
+
     /** Type of the elements of the array. */
     const Type * const child;
     /** Number of elements in the array. */
@@ -633,8 +663,9 @@ private:
     arithmetic and logical operations that are value for the element type
     can be performed on corresponding VectorTypes (as long as the two
     VectorTypes have the same size). Second, VectorTypes of uniform
-    elements are laid out in memory aligned to the target's vector size;
-    this allows them to be packed 'horizontally' into vector registers.
+    elements are padded and aligned in memory to fill a whole number of
+    vector registers; this allows them to be packed 'horizontally' into
+    vector registers.
  */
 class VectorType : public SequentialType {
 public:
@@ -679,8 +710,9 @@ private:
     const int numElements;
 
     /** Returns the number of elements stored in memory for the vector.
-        For uniform vectors, this is rounded up so that the number of
-        elements evenly divides the target's native vector width. */
+        For uniform vectors, this is rounded up to a power of two if that
+        fits in the target's native vector width, and to a multiple of the
+        native vector width otherwise. */
     int getVectorMemoryCount() const;
 };
 
@@ -831,7 +863,8 @@ private:
  */
 class ReferenceType : public Type {
 public:
-    ReferenceType(const Type *targetType);
+    /** Returns the (hash-consed) reference to the given type. */
+    static ReferenceType *Get(const Type *targetType);
 
     Variability GetVariability() const;
 
@@ -864,6 +897,8 @@ public:
 #endif
 
 private:
+    ReferenceType(const Type *targetType);
+
     const Type * const targetType;
     mutable const ReferenceType *asOtherConstType;
 };
@@ -963,6 +998,31 @@ public:
         function estimate for the function. */
     int costOverride;
 
+    /** If non-zero, the function was declared with __declspec(width<N>)
+        and is only compiled for targets with this gang size. */
+    int gangWidth;
+
+    /** Indicates whether this exported function was declared with
+        __declspec(vector_abi): its varying parameters and return value
+        are passed in vector registers, as the platform's SIMD types
+        (__m256, __mmask16, ...), rather than being illegal. */
+    bool isVectorABI;
+
+    /** Indicates whether the function was declared with
+        __declspec(fastmath), which applies the --opt=fast-math
+        transformations to it regardless of the command line. */
+    bool isFastMath;
+
+    /** Set by __declspec(fp_contract_on) (1) or __declspec(fp_contract_off)
+        (0) to control whether floating-point multiplies and adds in the
+        function may be fused; -1 if the global setting applies. */
+    int fpContract;
+
+    /** Returns the name of the C/C++ SIMD type (e.g. "__m256") that the
+        given varying type is passed as in "vector_abi" exported functions
+        for the current target, or an empty string if it has none. */
+    static std::string GetVectorABICType(const Type *type);
+
 private:
     const Type * const returnType;
 
@@ -981,6 +1041,68 @@ private:
 };
 
 
+/** @brief Type standing for a type parameter of a function template.
+
+    While the definition of a function template is parsed, each of its
+    type parameters ("typename T") names a TemplateTypeParmType; it
+    records the uniform/varying and const qualifiers applied to the
+    parameter so that they can be applied to the template argument when
+    the template's function type is instantiated with Substitute().  Code
+    that uses these types is only parsed, never type checked or compiled.
+ */
+class TemplateTypeParmType : public Type {
+public:
+    TemplateTypeParmType(const std::string &name, Variability variability,
+                         bool isConst, SourcePos pos);
+
+    Variability GetVariability() const;
+
+    bool IsBoolType() const;
+    bool IsFloatType() const;
+    bool IsIntType() const;
+    bool IsUnsignedType() const;
+    bool IsConstType() const;
+
+    const Type *GetBaseType() const;
+    const TemplateTypeParmType *GetAsVaryingType() const;
+    const TemplateTypeParmType *GetAsUniformType() const;
+    const TemplateTypeParmType *GetAsUnboundVariabilityType() const;
+    const TemplateTypeParmType *GetAsSOAType(int width) const;
+    const TemplateTypeParmType *ResolveUnboundVariability(Variability v) const;
+
+    const TemplateTypeParmType *GetAsConstType() const;
+    const TemplateTypeParmType *GetAsNonConstType() const;
+
+    std::string GetString() const;
+    std::string Mangle() const;
+    std::string GetCDeclaration(const std::string &name) const;
+
+    llvm::Type *LLVMType(llvm::LLVMContext *ctx) const;
+#if ISPC_LLVM_VERSION <= ISPC_LLVM_3_6
+    llvm::DIType GetDIType(llvm::DIDescriptor scope) const;
+#else // LLVM 3.7++
+    llvm::DIType *GetDIType(llvm::DIScope *scope) const;
+#endif
+
+    /** Returns the name of the template parameter. */
+    const std::string &GetName() const { return name; }
+
+    /** Returns the given type with each TemplateTypeParmType in it
+        replaced with the type that \c args maps its name to, qualified
+        in the same way as the parameter was.  Pointer, array, reference
+        and function types are rebuilt around the substituted types; all
+        other types are returned unchanged. */
+    static const Type *Substitute(const Type *type,
+                                  const std::map<std::string, const Type *> &args);
+
+private:
+    const std::string name;
+    const Variability variability;
+    const bool isConst;
+    const SourcePos pos;
+};
+
+
 /* Efficient dynamic casting of Types.  First, we specify a default
    template function that returns NULL, indicating a failed cast, for
    arbitrary types. */
@@ -1089,6 +1211,14 @@ CastType(const Type *type) {
         return NULL;
 }
 
+template <> inline const TemplateTypeParmType *
+CastType(const Type *type) {
+    if (type != NULL && type->typeId == TEMPLATE_TYPE_PARM_TYPE)
+        return (const TemplateTypeParmType *)type;
+    else
+        return NULL;
+}
+
 
 inline bool IsReferenceType(const Type *t) {
     return CastType<ReferenceType>(t) != NULL;
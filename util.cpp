@@ -63,7 +63,12 @@
 #include <errno.h>
 #endif // ISPC_IS_WINDOWS
 #include <set>
+#include <map>
 #include <algorithm>
+#ifndef ISPC_IS_WINDOWS
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
 
 #if ISPC_LLVM_VERSION == ISPC_LLVM_3_2
   #include <llvm/DataLayout.h>
@@ -422,19 +427,251 @@ Warning(SourcePos p, const char *fmt, ...) {
 }
 
 
+/** File that optimization remarks are written to, if --opt-remarks was
+    specified. */
+static FILE *optRemarksFile = NULL;
+
+
+bool
+OpenOptRemarksFile(const char *filename) {
+    optRemarksFile = fopen(filename, "w");
+    if (optRemarksFile == NULL) {
+        perror(filename);
+        return false;
+    }
+    return true;
+}
+
+
+/** Returns the given string as a single-quoted YAML scalar. */
+static std::string
+lYAMLQuote(const char *str) {
+    std::string ret = "'";
+    for (; *str != '\0'; ++str) {
+        if (*str == '\'')
+            ret += "''";
+        else if (*str == '\n')
+            ret += ' ';
+        else
+            ret += *str;
+    }
+    return ret + "'";
+}
+
+
+/** Writes a single optimization remark to the --opt-remarks file, as a
+    YAML document following LLVM's -opt-remarks layout. */
+static void
+lRecordOptRemark(OptRemarkKind kind, SourcePos p, const char *pass,
+                 const char *name, const char *function, const char *message) {
+    // As with performance warnings, we don't report on code from the
+    // standard library.
+    if (optRemarksFile == NULL || strcmp(p.name, "stdlib.ispc") == 0)
+        return;
+
+    const char *kindName = (kind == OptRemarkPassed) ? "Passed" :
+        ((kind == OptRemarkMissed) ? "Missed" : "Analysis");
+    char *remark;
+    if (asprintf(&remark, "--- !%s\n"
+                 "Pass:            %s\n"
+                 "Name:            %s\n"
+                 "DebugLoc:        { File: %s, Line: %d, Column: %d }\n",
+                 kindName, pass, name, lYAMLQuote(p.name).c_str(),
+                 p.first_line, p.first_column) == -1) {
+        fprintf(stderr, "asprintf() unable to allocate memory!\n");
+        exit(1);
+    }
+    std::string str = remark;
+    free(remark);
+
+    if (function != NULL)
+        str += std::string("Function:        ") + lYAMLQuote(function) + "\n";
+    if (g->target != NULL)
+        str += std::string("Target:          ") + g->target->GetISAString() + "\n";
+    str += std::string("Message:         ") + lYAMLQuote(message) + "\n...\n";
+
+    // Some passes run more than once and may repeat a remark; only write
+    // each one once.
+    static std::set<std::string> recorded;
+    if (recorded.find(str) != recorded.end())
+        return;
+    recorded.insert(str);
+
+    // Write each remark with a single call and flush it right away, so
+    // that remarks from the processes used by --jobs don't interleave.
+    fwrite(str.c_str(), 1, str.size(), optRemarksFile);
+    fflush(optRemarksFile);
+}
+
+
 void
-PerformanceWarning(SourcePos p, const char *fmt, ...) {
-    if (!g->emitPerfWarnings || strcmp(p.name, "stdlib.ispc") == 0 ||
-        g->quiet)
+OptRemark(OptRemarkKind kind, SourcePos p, const char *pass, const char *name,
+          const char *function, const char *fmt, ...) {
+    if (optRemarksFile == NULL)
         return;
 
     va_list args;
     va_start(args, fmt);
-    lPrint("Performance Warning", false, p, fmt, args);
+    char *message;
+    if (vasprintf(&message, fmt, args) == -1) {
+        fprintf(stderr, "vasprintf() unable to allocate memory!\n");
+        abort();
+    }
+    va_end(args);
+
+    lRecordOptRemark(kind, p, pass, name, function, message);
+    free(message);
+}
+
+
+/** Helper for calling lPrint() with an already-formatted message. */
+static void
+lPrintMessage(const char *type, bool isError, SourcePos p, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    lPrint(type, isError, p, fmt, args);
     va_end(args);
 }
 
 
+/** Helper for PerformanceWarning() and PerformanceRemark(): issues the
+    warning (unless performance warnings have been disabled) and records
+    the corresponding optimization remark. */
+static void
+lPerformanceRemark(OptRemarkKind kind, SourcePos p, const char *pass,
+                   const char *name, const char *function, const char *fmt,
+                   va_list args) {
+    bool warn = (g->emitPerfWarnings && strcmp(p.name, "stdlib.ispc") != 0 &&
+                 !g->quiet);
+    if (!warn && optRemarksFile == NULL)
+        return;
+
+    char *message;
+    if (vasprintf(&message, fmt, args) == -1) {
+        fprintf(stderr, "vasprintf() unable to allocate memory!\n");
+        abort();
+    }
+
+    lRecordOptRemark(kind, p, pass, name, function, message);
+    if (warn)
+        lPrintMessage("Performance Warning", false, p, "%s", message);
+    free(message);
+}
+
+
+void
+PerformanceWarning(SourcePos p, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    lPerformanceRemark(OptRemarkAnalysis, p, "ispc", "PerformanceWarning",
+                       NULL, fmt, args);
+    va_end(args);
+}
+
+
+void
+PerformanceRemark(OptRemarkKind kind, SourcePos p, const char *pass,
+                  const char *name, const char *function, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    lPerformanceRemark(kind, p, pass, name, function, fmt, args);
+    va_end(args);
+}
+
+
+typedef std::map<std::string, std::vector<int64_t> > OccupancyProfileMap;
+static OccupancyProfileMap occupancyProfile;
+
+
+/** Returns the key used for the given point in occupancyProfile. */
+static std::string
+lOccupancyProfileKey(const char *file, int line, const char *note) {
+    const char *base = strrchr(file, '/');
+#ifdef ISPC_IS_WINDOWS
+    const char *bs = strrchr(file, '\\');
+    if (bs != NULL && (base == NULL || bs > base))
+        base = bs;
+#endif
+    char lineStr[16];
+    snprintf(lineStr, sizeof(lineStr), "%d", line);
+    return std::string(base ? base + 1 : file) + "\t" + lineStr + "\t" + note;
+}
+
+
+bool
+ReadOccupancyProfile(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        perror(filename);
+        return false;
+    }
+
+    char buf[4096];
+    int lineNumber = 0;
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        ++lineNumber;
+        if (buf[0] == '#' || buf[0] == '\n')
+            continue;
+
+        // file \t line \t note \t counts
+        char *fields[4];
+        int nFields = 0;
+        char *p = buf;
+        while (nFields < 4) {
+            fields[nFields++] = p;
+            p = strchr(p, '\t');
+            if (p == NULL)
+                break;
+            *p++ = '\0';
+        }
+        if (nFields != 4) {
+            fprintf(stderr, "%s:%d: malformed occupancy profile entry.\n",
+                    filename, lineNumber);
+            fclose(f);
+            return false;
+        }
+
+        std::vector<int64_t> counts;
+        char *end, *c = fields[3];
+        while (true) {
+            long long v = strtoll(c, &end, 10);
+            if (end == c)
+                break;
+            counts.push_back((int64_t)v);
+            c = end;
+        }
+        if (counts.size() < 2) {
+            fprintf(stderr, "%s:%d: malformed occupancy profile entry.\n",
+                    filename, lineNumber);
+            fclose(f);
+            return false;
+        }
+
+        // Points that appear more than once (e.g. from multiple runs that
+        // were concatenated) are added together.
+        std::vector<int64_t> &entry =
+            occupancyProfile[lOccupancyProfileKey(fields[0], atoi(fields[1]),
+                                                  fields[2])];
+        if (entry.size() < counts.size())
+            entry.resize(counts.size(), 0);
+        for (size_t i = 0; i < counts.size(); ++i)
+            entry[i] += counts[i];
+    }
+    fclose(f);
+    return true;
+}
+
+
+const std::vector<int64_t> *
+GetOccupancyProfile(SourcePos p, const char *note) {
+    if (occupancyProfile.empty() || p.name == NULL)
+        return NULL;
+    OccupancyProfileMap::const_iterator iter =
+        occupancyProfile.find(lOccupancyProfileKey(p.name, p.first_line, note));
+    return (iter != occupancyProfile.end()) ? &iter->second : NULL;
+}
+
+
 static void
 lPrintBugText() {
     static bool printed = false;
@@ -543,6 +780,19 @@ MatchStrings(const std::string &str, const std::vector<std::string> &options) {
 }
 
 
+std::string
+HashString(const std::string &str) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned int i = 0; i < str.size(); ++i) {
+        h ^= (unsigned char)str[i];
+        h *= 1099511628211ULL;
+    }
+    char buf[32];
+    sprintf(buf, "%016llx", (unsigned long long)h);
+    return buf;
+}
+
+
 void
 GetDirectoryAndFileName(const std::string &currentDirectory,
                         const std::string &relativeName,
@@ -657,3 +907,260 @@ VerifyDataLayoutCompatibility(const std::string &module_dl,
     return true;
 }
 
+
+
+double
+GetWallClockTime() {
+#ifdef ISPC_IS_WINDOWS
+    LARGE_INTEGER frequency, count;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&count);
+    return double(count.QuadPart) / double(frequency.QuadPart);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6 * tv.tv_usec;
+#endif
+}
+
+
+long
+GetPeakMemoryUsage() {
+#ifdef ISPC_IS_WINDOWS
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef ISPC_IS_APPLE
+    // ru_maxrss is in bytes on OS X and in kilobytes elsewhere.
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+
+static std::vector<TimeReportEntry> timeReportEntries;
+
+
+TimeReportEntry::TimeReportEntry(const std::string &p, const std::string &f,
+                                 int st, double sec)
+    : phase(p), function(f), stage(st), seconds(sec) {
+    if (g->target != NULL)
+        target = g->target->GetISAString();
+    instsBefore = instsAfter = blocksBefore = blocksAfter = -1;
+    peakMemory = g->timeReport ? GetPeakMemoryUsage() : -1;
+}
+
+
+void
+AddTimeReportEntry(const TimeReportEntry &entry) {
+    if (g->timeReport)
+        timeReportEntries.push_back(entry);
+}
+
+
+TimeReportScope::TimeReportScope(const char *p, const std::string &f)
+    : phase(p), function(f) {
+    startTime = g->timeReport ? GetWallClockTime() : 0.;
+}
+
+
+TimeReportScope::~TimeReportScope() {
+    if (g->timeReport)
+        AddTimeReportEntry(TimeReportEntry(phase, function, -1,
+                                           GetWallClockTime() - startTime));
+}
+
+
+/** Prints the given string to the given file as a JSON string literal. */
+static void
+lPrintJSONString(FILE *f, const std::string &str) {
+    fputc('"', f);
+    for (unsigned int i = 0; i < str.size(); ++i) {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+
+/** Writes all of the time report entries to the given file as a JSON
+    array of objects, one per entry. */
+static void
+lWriteTimeReportJSON(FILE *f) {
+    fprintf(f, "[\n");
+    for (unsigned int i = 0; i < timeReportEntries.size(); ++i) {
+        const TimeReportEntry &e = timeReportEntries[i];
+        fprintf(f, "  { \"target\": ");
+        lPrintJSONString(f, e.target);
+        fprintf(f, ", \"phase\": ");
+        lPrintJSONString(f, e.phase);
+        fprintf(f, ", \"function\": ");
+        lPrintJSONString(f, e.function);
+        fprintf(f, ", \"stage\": %d, \"seconds\": %.6f", e.stage, e.seconds);
+        if (e.peakMemory >= 0)
+            fprintf(f, ", \"peak_rss_kb\": %ld", e.peakMemory);
+        if (e.instsBefore >= 0)
+            fprintf(f, ", \"insts_before\": %d, \"insts_after\": %d, "
+                    "\"blocks_before\": %d, \"blocks_after\": %d",
+                    e.instsBefore, e.instsAfter, e.blocksBefore, e.blocksAfter);
+        fprintf(f, " }%s\n", (i + 1 < timeReportEntries.size()) ? "," : "");
+    }
+    fprintf(f, "]\n");
+}
+
+
+/** Prints a summary of the time report to stderr: the time for each
+    phase and, for the optimization passes, the total over all functions
+    for each stage, along with the change in the total instruction and
+    basic block counts that the pass caused. */
+static void
+lPrintTimeReportSummary() {
+    // Entries are accumulated by (target, stage, phase), in the order in
+    // which they were first seen.
+    std::vector<TimeReportEntry> summary;
+    std::map<std::string, int> summaryIndex;
+    double total = 0.;
+    for (unsigned int i = 0; i < timeReportEntries.size(); ++i) {
+        const TimeReportEntry &e = timeReportEntries[i];
+        char stage[16];
+        snprintf(stage, sizeof(stage), "%d", e.stage);
+        std::string key = e.target + "/" + stage + "/" + e.phase;
+        std::map<std::string, int>::iterator iter = summaryIndex.find(key);
+        if (iter == summaryIndex.end()) {
+            summaryIndex[key] = (int)summary.size();
+            summary.push_back(TimeReportEntry(e.phase, "", e.stage, 0.));
+            summary.back().target = e.target;
+            summary.back().peakMemory = -1;
+            if (e.instsBefore >= 0)
+                summary.back().instsBefore = summary.back().instsAfter =
+                    summary.back().blocksBefore = summary.back().blocksAfter = 0;
+            iter = summaryIndex.find(key);
+        }
+        TimeReportEntry &s = summary[iter->second];
+        s.seconds += e.seconds;
+        s.peakMemory = std::max(s.peakMemory, e.peakMemory);
+        if (e.instsBefore >= 0) {
+            s.instsBefore += e.instsBefore;
+            s.instsAfter += e.instsAfter;
+            s.blocksBefore += e.blocksBefore;
+            s.blocksAfter += e.blocksAfter;
+        }
+        // Optimization passes are nested inside the "optimization" phase
+        // and type checking inside parsing, so don't count them twice.
+        if (e.stage == -1 && e.phase != "type checking")
+            total += e.seconds;
+    }
+
+    fprintf(stderr, "===-------------------------------------------------------------------===\n");
+    fprintf(stderr, "                      ispc compile-time report\n");
+    fprintf(stderr, "===-------------------------------------------------------------------===\n");
+    fprintf(stderr, "  %-12s %5s  %-40s %10s %8s %8s %8s\n", "Target", "Stage",
+            "Phase / pass", "Time (ms)", "RSS (MB)", "Insts", "Blocks");
+    for (unsigned int i = 0; i < summary.size(); ++i) {
+        const TimeReportEntry &s = summary[i];
+        char stage[16] = "";
+        if (s.stage >= 0)
+            snprintf(stage, sizeof(stage), "%d", s.stage);
+        fprintf(stderr, "  %-12s %5s  %-40.40s %10.3f", s.target.c_str(), stage,
+                s.phase.c_str(), 1000. * s.seconds);
+        if (s.peakMemory >= 0)
+            fprintf(stderr, " %8.1f", s.peakMemory / 1024.);
+        else
+            fprintf(stderr, " %8s", "");
+        if (s.instsBefore >= 0)
+            fprintf(stderr, " %+8d %+8d", s.instsAfter - s.instsBefore,
+                    s.blocksAfter - s.blocksBefore);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "  Total: %.3f ms", 1000. * total);
+    long peak = GetPeakMemoryUsage();
+    if (peak >= 0)
+        fprintf(stderr, ", peak RSS %.1f MB", peak / 1024.);
+    fprintf(stderr, "\n");
+}
+
+
+void
+WriteTimeReport() {
+    if (!g->timeReport)
+        return;
+
+    if (g->timeReportFile == NULL) {
+        lPrintTimeReportSummary();
+        return;
+    }
+
+    FILE *f = fopen(g->timeReportFile, "w");
+    if (f == NULL) {
+        perror(g->timeReportFile);
+        return;
+    }
+    lWriteTimeReportJSON(f);
+    fclose(f);
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// MemoryArena
+
+// Requests are carved out of slabs of this size; larger requests get a
+// slab of their own.
+static const size_t lArenaSlabSize = 64 * 1024;
+static const size_t lArenaAlignment = 16;
+
+MemoryArena::MemoryArena()
+    : current(NULL), remaining(0), bytesAllocated(0) {
+}
+
+
+MemoryArena::~MemoryArena() {
+    for (size_t i = destructors.size(); i > 0; --i)
+        destructors[i - 1].first(destructors[i - 1].second);
+    for (unsigned int i = 0; i < slabs.size(); ++i)
+        free(slabs[i]);
+}
+
+
+void *
+MemoryArena::Allocate(size_t size) {
+    size = (size + lArenaAlignment - 1) & ~(lArenaAlignment - 1);
+    bytesAllocated += size;
+
+    if (size > lArenaSlabSize / 4) {
+        // Big allocations go in their own slab so that they don't waste
+        // the rest of the current one.
+        char *slab = (char *)malloc(size);
+        if (slab == NULL)
+            FATAL("Out of memory in MemoryArena::Allocate()");
+        slabs.push_back(slab);
+        return slab;
+    }
+
+    if (size > remaining) {
+        current = (char *)malloc(lArenaSlabSize);
+        if (current == NULL)
+            FATAL("Out of memory in MemoryArena::Allocate()");
+        slabs.push_back(current);
+        remaining = lArenaSlabSize;
+    }
+
+    void *ret = current;
+    current += size;
+    remaining -= size;
+    return ret;
+}
+
+
+void
+MemoryArena::AddDestructor(void (*destroy)(void *), void *object) {
+    destructors.push_back(std::make_pair(destroy, object));
+}
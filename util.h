@@ -106,6 +106,57 @@ void Error(SourcePos p, const char *format, ...) PRINTF_FUNC;
 */
 void PerformanceWarning(SourcePos p, const char *format, ...) PRINTF_FUNC;
 
+/** Kinds of optimization remarks, following LLVM's terminology: an
+    optimization that was applied, one that couldn't be applied, or
+    general information about the generated code. */
+enum OptRemarkKind {
+    OptRemarkPassed,
+    OptRemarkMissed,
+    OptRemarkAnalysis
+};
+
+/** Opens the file that optimization remarks are written to (in YAML) for
+    --opt-remarks.  Returns false, after printing an error message, if
+    the file can't be opened. */
+bool OpenOptRemarksFile(const char *filename);
+
+/** Records an optimization remark for the code at the given source
+    position.  Remarks are only written out if --opt-remarks was given;
+    nothing is printed to the console.
+
+    @param kind      Kind of remark
+    @param p         Source position of the code the remark is about
+    @param pass      Name of the optimization pass issuing the remark
+    @param name      Short identifier for the remark (e.g. "GatherToVectorLoad")
+    @param function  Name of the function containing the code, or NULL
+    @param format    printf()-style format string for the remark's message
+*/
+void OptRemark(OptRemarkKind kind, SourcePos p, const char *pass,
+               const char *name, const char *function, const char *format, ...);
+
+/** Issues a performance warning, like PerformanceWarning(), and records
+    it as an optimization remark of the given kind, name and pass.
+    (Performance warnings issued via PerformanceWarning() are recorded as
+    "Analysis" remarks from the "ispc" pass.) */
+void PerformanceRemark(OptRemarkKind kind, SourcePos p, const char *pass,
+                       const char *name, const char *function,
+                       const char *format, ...);
+
+/** Reads the lane-occupancy profile for --profile-use.  Each line of the
+    file gives an instrumentation point from a program compiled with
+    --instrument=occupancy, as tab-separated fields: the source file, the
+    line number, the note, and then the space-separated counts of the
+    number of times the point was reached with 0, 1, ..., programCount
+    program instances active.  Returns false, after printing an error
+    message, if the file can't be read. */
+bool ReadOccupancyProfile(const char *filename);
+
+/** Returns the lane-count histogram recorded in the --profile-use file for
+    the instrumentation point with the given note at the given position,
+    or NULL if there isn't one.  Source files are matched by their base
+    name. */
+const std::vector<int64_t> *GetOccupancyProfile(SourcePos p, const char *note);
+
 /** Reports a fatal error that causes the program to terminate.  This
     should only be used for cases where there is an internal error in the
     compiler.
@@ -140,6 +191,10 @@ int StringEditDistance(const std::string &str1, const std::string &str2,
 std::vector<std::string> MatchStrings(const std::string &str,
                                       const std::vector<std::string> &options);
 
+/** Returns a 64-bit FNV-1a hash of the given string, formatted as 16
+    hexadecimal digits; used to name compilation cache entries. */
+std::string HashString(const std::string &str);
+
 /** Given the current working directory and a filename relative to that
     directory, this function returns the final directory that the resulting
     file is in and the base name of the file itself. */
@@ -170,4 +225,93 @@ void PrintWithWordBreaks(const char *buf, int indent, int columnWidth,
  */
 int TerminalWidth();
 
+/** Returns the current wall-clock time in seconds.  The value is only
+    meaningful when compared with other values returned by this function.
+ */
+double GetWallClockTime();
+
+/** Returns the peak resident set size of the compiler process so far, in
+    kilobytes, or -1 if it isn't available on the host system. */
+long GetPeakMemoryUsage();
+
+/** One entry in the --time-report output: the time spent in one phase of
+    compilation or in one optimization pass.  Instruction and basic block
+    counts are only meaningful for optimization passes; they're -1
+    otherwise.  peakMemory is the peak resident set size of the process,
+    in kilobytes, when the entry was recorded (-1 if unavailable). */
+struct TimeReportEntry {
+    TimeReportEntry(const std::string &phase, const std::string &function,
+                    int stage, double seconds);
+
+    /** Target the entry was recorded for, or the empty string for the
+        phases that aren't specific to a target. */
+    std::string target;
+    std::string phase;
+    /** Function the time was spent on, or the empty string if the entry
+        covers the whole module. */
+    std::string function;
+    /** Optimization stage number (as used by --debug-phase and
+        --off-phase), or -1 if the entry isn't for an optimization pass. */
+    int stage;
+    double seconds;
+    int instsBefore, instsAfter;
+    int blocksBefore, blocksAfter;
+    long peakMemory;
+};
+
+/** Adds the given entry to the --time-report data; does nothing if
+    --time-report wasn't specified. */
+void AddTimeReportEntry(const TimeReportEntry &entry);
+
+/** Measures the time from its construction until its destruction and
+    adds an entry for it to the --time-report data. */
+class TimeReportScope {
+public:
+    TimeReportScope(const char *phase, const std::string &function = "");
+    ~TimeReportScope();
+
+private:
+    const char *phase;
+    std::string function;
+    double startTime;
+};
+
+/** Writes out the --time-report data, either as JSON to
+    g->timeReportFile or as a summary to stderr. */
+void WriteTimeReport();
+
+/** A bump-pointer allocator.  Memory returned by Allocate() can't be
+    freed individually; it's all released at once when the MemoryArena is
+    destroyed.  Objects stored in it that own other memory (e.g. a
+    std::string member) must be registered with AddDestructor() so that
+    their destructors are run first.  This is used for the AST nodes and
+    Symbols, which are created in large numbers and all live until the
+    Module that they belong to is done. */
+class MemoryArena {
+public:
+    MemoryArena();
+    ~MemoryArena();
+
+    /** Returns size bytes of memory, aligned suitably for any type. */
+    void *Allocate(size_t size);
+
+    /** Arranges for destroy(object) to be called when the arena is
+        destroyed, before its memory is freed.  Destructors are run in the
+        reverse of the order in which they were added. */
+    void AddDestructor(void (*destroy)(void *), void *object);
+
+    /** Returns the total number of bytes handed out so far. */
+    size_t BytesAllocated() const { return bytesAllocated; }
+
+private:
+    MemoryArena(const MemoryArena &);
+    MemoryArena &operator=(const MemoryArena &);
+
+    std::vector<char *> slabs;
+    std::vector<std::pair<void (*)(void *), void *> > destructors;
+    char *current;
+    size_t remaining;
+    size_t bytesAllocated;
+};
+
 #endif // ISPC_UTIL_H